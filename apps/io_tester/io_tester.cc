@@ -33,8 +33,12 @@
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/io_trace.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/util/later.hh>
 #include <chrono>
+#include <fstream>
 #include <optional>
 #include <utility>
 #include <unordered_set>
@@ -57,6 +61,7 @@
 #include <boost/range/adaptor/map.hpp>
 #include <boost/array.hpp>
 #include <iomanip>
+#include <sstream>
 #include <random>
 #include <yaml-cpp/yaml.h>
 
@@ -70,7 +75,7 @@ static auto random_seed = std::chrono::duration_cast<std::chrono::microseconds>(
 static thread_local std::default_random_engine random_generator(random_seed);
 
 class context;
-enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu, unlink };
+enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu, unlink, replay };
 
 namespace std {
 
@@ -255,6 +260,10 @@ struct job_config {
     // the number of files to create and unlink by unlink_class_data per shard
     // remaining operations utilize only one file per shard
     std::optional<uint64_t> files_count;
+    // the trace replayed by replay_class_data, in the format io_trace_event
+    // is formatted in, and the I/O class of the trace to replay (all if unset)
+    std::optional<std::string> trace_file;
+    std::optional<std::string> trace_class;
     uint64_t offset_in_bdev;
     std::unique_ptr<class_data> gen_class_data();
 };
@@ -388,15 +397,20 @@ class class_data {
         });
     }
 
+protected:
+    virtual future<> do_issue_requests(std::chrono::steady_clock::time_point stop) {
+        if (rps() == 0) {
+            return issue_requests_in_parallel(stop, parallelism());
+        } else {
+            return issue_requests_at_rate(stop, rps(), parallelism());
+        }
+    }
+
 public:
     future<> issue_requests(std::chrono::steady_clock::time_point stop) {
         _start = std::chrono::steady_clock::now();
         return with_scheduling_group(_sg, [this, stop] {
-            if (rps() == 0) {
-                return issue_requests_in_parallel(stop, parallelism());
-            } else {
-                return issue_requests_at_rate(stop, rps(), parallelism());
-            }
+            return do_issue_requests(stop);
         }).then([this] {
             _total_duration = std::chrono::steady_clock::now() - _start;
         });
@@ -419,6 +433,7 @@ class class_data {
     // random writes     : will overwrite the file at a random position, between 0 and EOF
     // append            : will write to the file from pos = EOF onwards, always appending to the end.
     // unlink            : will unlink files created at the beginning of the execution
+    // replay            : will read and write the file as a recorded trace did, at the trace's pace
     // cpu               : CPU-only load, file is not created.
     future<> start(sstring dir, directory_entry_type type) {
         return do_start(dir, type).then([this] {
@@ -450,6 +465,7 @@ class class_data {
             { request_type::append , "APPEND" },
             { request_type::cpu , "CPU" },
             { request_type::unlink, "UNLINK" },
+            { request_type::replay, "REPLAY" },
         }[_config.type];;
     }
 
@@ -637,8 +653,9 @@ class io_class_data : public class_data {
         const auto& mf = values.find(m_name);
         assert(mf != values.end());
         for (auto&& mi : mf->second) {
-            auto&& cname = mi.first.find("class");
-            if (cname != mi.first.end() && cname->second == name()) {
+            auto&& labels = mi.first.get();
+            auto&& cname = labels.find("class");
+            if (cname != labels.end() && cname->second == name()) {
                 out << YAML::Key << m_name << YAML::Value << mi.second->get_function()().d();
             }
         }
@@ -694,6 +711,146 @@ class write_io_class_data : public io_class_data {
     }
 };
 
+// Replays the requests of a trace recorded with seastar::set_io_trace_hook() on
+// the job's file, at the offsets (modulo the file size) and with the lengths
+// (aligned) of the trace, and at the pace of the trace: a request is issued
+// as long after the job started as the traced one was submitted after the
+// first traced request, whether or not the previous ones completed. Each
+// shard replays the requests its shard (modulo the number of shards) made,
+// and starts the trace over if it lasts shorter than the job. Parallelism,
+// if set, caps the number of requests in flight.
+class replay_io_class_data : public io_class_data {
+    struct trace_entry {
+        std::chrono::microseconds at;
+        io_trace_op op;
+        uint64_t pos;
+        size_t size;
+    };
+    std::vector<trace_entry> _trace;
+    semaphore _in_flight;
+    gate _pending;
+
+public:
+    replay_io_class_data(job_config cfg)
+        : io_class_data(std::move(cfg))
+        , _in_flight(parallelism() ? parallelism() : semaphore::max_counter())
+    {
+        if (!_config.trace_file.has_value()) {
+            throw std::runtime_error("request_type::replay requires specifying 'trace'");
+        }
+    }
+
+    future<> do_start(sstring path, directory_entry_type type) override {
+        load_trace();
+        return io_class_data::do_start(std::move(path), type);
+    }
+
+    future<size_t> issue_request(char *buf, io_intent* intent) override {
+        // Requests are issued by do_issue_requests(), as the trace says
+        throw std::logic_error("replay_io_class_data issues requests from the trace");
+    }
+
+protected:
+    future<> do_issue_requests(std::chrono::steady_clock::time_point stop) override {
+        if (_trace.empty()) {
+            return make_ready_future<>();
+        }
+        return do_until([this, stop] { return std::chrono::steady_clock::now() > stop || requests() > limit(); }, [this, stop] {
+            return replay_trace(stop);
+        }).then([this] {
+            return _pending.close();
+        });
+    }
+
+private:
+    void load_trace() {
+        std::ifstream in(*_config.trace_file);
+        if (!in) {
+            throw std::runtime_error(format("Cannot open trace {}", *_config.trace_file));
+        }
+        std::optional<int64_t> first;
+        std::vector<std::pair<int64_t, trace_entry>> entries;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream ls(line);
+            int64_t ts;
+            unsigned shard;
+            std::string cname, op;
+            uint64_t offset;
+            size_t length;
+            if (!(ls >> ts >> shard >> cname >> op >> offset >> length) || (op != "read" && op != "write")) {
+                throw std::runtime_error(format("Malformed trace event in {}: {}", *_config.trace_file, line));
+            }
+            first = std::min(first.value_or(ts), ts);
+            if (shard % smp::count != this_shard_id() || (_config.trace_class && cname != *_config.trace_class)) {
+                continue;
+            }
+            entries.emplace_back(ts, trace_entry{
+                .at = {},
+                .op = op == "read" ? io_trace_op::read : io_trace_op::write,
+                .pos = offset,
+                .size = length,
+            });
+        }
+
+        // Fit the requests into the file, keeping them aligned
+        const auto fsize = align_down<uint64_t>(_config.file_size, _alignment);
+        _trace.reserve(entries.size());
+        for (auto& [ts, e] : entries) {
+            e.at = std::chrono::microseconds(ts - *first);
+            e.size = std::min<uint64_t>(align_up<uint64_t>(std::max<size_t>(e.size, 1), _alignment), fsize);
+            e.pos = std::min<uint64_t>(align_down<uint64_t>(e.pos % fsize, _alignment), fsize - e.size);
+            _trace.push_back(e);
+        }
+        std::stable_sort(_trace.begin(), _trace.end(), [] (const trace_entry& a, const trace_entry& b) {
+            return a.at < b.at;
+        });
+    }
+
+    future<> replay_trace(std::chrono::steady_clock::time_point stop) {
+        auto start = std::chrono::steady_clock::now();
+        return do_with(size_t(0), [this, start, stop] (size_t& idx) {
+            return repeat([this, start, stop, &idx] {
+                auto now = std::chrono::steady_clock::now();
+                if (idx == _trace.size() || now > stop || requests() > limit()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                const trace_entry& e = _trace[idx++];
+                auto until = std::min(start + e.at, stop);
+                auto f = until > now ? _sleep_fn(until, now) : make_ready_future<>();
+                return f.then([this] {
+                    return get_units(_in_flight, 1);
+                }).then([this, &e, stop] (auto units) {
+                    issue_entry(e, stop, std::move(units));
+                    return stop_iteration::no;
+                });
+            });
+        });
+    }
+
+    void issue_entry(const trace_entry& e, std::chrono::steady_clock::time_point stop, semaphore_units<> units) {
+        (void)with_gate(_pending, [this, &e, stop, units = std::move(units)] () mutable {
+            auto bufptr = allocate_aligned_buffer<char>(e.size, _alignment);
+            auto buf = bufptr.get();
+            auto start = std::chrono::steady_clock::now();
+            auto f = e.op == io_trace_op::read
+                    ? _file.dma_read(e.pos + _offset, buf, e.size)
+                    : _file.dma_write(e.pos + _offset, buf, e.size);
+            return f.then([this, &e, start, stop] (size_t size) {
+                auto now = std::chrono::steady_clock::now();
+                if (now < stop) {
+                    this->add_result(_is_dev_null ? e.size : size, std::chrono::duration_cast<std::chrono::microseconds>(now - start));
+                }
+            }).finally([bufptr = std::move(bufptr), units = std::move(units)] {});
+        }).handle_exception([] (std::exception_ptr ex) {
+            fmt::print("[WARNING]: Replayed request failed: {}\n", ex);
+        });
+    }
+};
+
 class unlink_class_data : public class_data {
 private:
     sstring _dir_path{};
@@ -821,6 +978,8 @@ std::unique_ptr<class_data> job_config::gen_class_data() {
         return std::make_unique<cpu_class_data>(*this);
     } else if (type == request_type::unlink) {
         return std::make_unique<unlink_class_data>(*this);
+    } else if (type == request_type::replay) {
+        return std::make_unique<replay_io_class_data>(*this);
     } else if ((type == request_type::seqread) || (type == request_type::randread)) {
         return std::make_unique<read_io_class_data>(*this);
     } else {
@@ -903,6 +1062,7 @@ struct convert<request_type> {
             { "append", request_type::append},
             { "cpu", request_type::cpu},
             { "unlink", request_type::unlink },
+            { "replay", request_type::replay },
         };
         auto reqstr = node.as<std::string>();
         if (!mappings.count(reqstr)) {
@@ -1011,6 +1171,15 @@ struct convert<job_config> {
             cl.files_count = node["files_count"].as<uint64_t>();
         }
 
+        // Replay jobs issue the requests of a trace recorded with
+        // seastar::set_io_trace_hook(), optionally only those of one class.
+        if (node["trace"]) {
+            cl.trace_file = node["trace"].as<std::string>();
+        }
+        if (node["trace_class"]) {
+            cl.trace_class = node["trace_class"].as<std::string>();
+        }
+
         if (node["shard_info"]) {
             cl.shard_info = node["shard_info"].as<shard_info>();
         }
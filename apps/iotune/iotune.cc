@@ -189,11 +189,17 @@ struct evaluation_directory {
 struct io_rates {
     float bytes_per_sec = 0;
     float iops = 0;
+    // Average request latency
+    std::chrono::duration<double> latency = 0s;
     io_rates operator+(const io_rates& a) const {
-        return io_rates{bytes_per_sec + a.bytes_per_sec, iops + a.iops};
+        io_rates r = *this;
+        return r += a;
     }
 
     io_rates& operator+=(const io_rates& a) {
+        if (iops + a.iops > 0) {
+            latency = (latency * iops + a.latency * a.iops) / (iops + a.iops);
+        }
         bytes_per_sec += a.bytes_per_sec;
         iops += a.iops;
         return *this;
@@ -313,6 +319,20 @@ class read_request_issuer : public request_issuer {
     }
 };
 
+class mixed_request_issuer : public request_issuer {
+    file _file;
+    std::bernoulli_distribution _is_write;
+public:
+    mixed_request_issuer(file f, double write_fraction) : _file(f), _is_write(write_fraction) {}
+    future<size_t> issue_request(uint64_t pos, char* buf, uint64_t size) override {
+        if (_is_write(random_generator)) {
+            return _file.dma_write(pos, buf, size);
+        } else {
+            return _file.dma_read(pos, buf, size);
+        }
+    }
+};
+
 class io_worker {
     class requests_rate_meter {
         std::vector<unsigned>& _rates;
@@ -349,6 +369,7 @@ class io_worker {
     uint64_t _bytes = 0;
     uint64_t _max_offset = 0;
     unsigned _requests = 0;
+    std::chrono::duration<double> _total_latency = 0s;
     size_t _buffer_size;
     std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _start_measuring;
     std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _end_measuring;
@@ -385,13 +406,15 @@ class io_worker {
 
     future<> issue_request(char* buf) {
         uint64_t pos = _pos_impl->get_pos();
-        return _req_impl->issue_request(pos, buf, _buffer_size).then([this, pos] (size_t size) {
+        auto start = iotune_clock::now();
+        return _req_impl->issue_request(pos, buf, _buffer_size).then([this, pos, start] (size_t size) {
             auto now = iotune_clock::now();
             _max_offset = std::max(_max_offset, pos + size);
             if ((now > _start_measuring) && (now < _end_measuring)) {
                 _last_time_seen = now;
                 _bytes += size;
                 _requests++;
+                _total_latency += now - start;
             }
         });
     }
@@ -406,6 +429,7 @@ class io_worker {
         }
         rates.bytes_per_sec = _bytes / t.count();
         rates.iops = _requests / t.count();
+        rates.latency = _requests ? _total_latency / _requests : 0s;
         return rates;
     }
 };
@@ -509,6 +533,17 @@ class test_file {
         });
     }
 
+    // Random reads and writes, write_fraction of the requests being writes
+    future<io_rates> mixed_workload(size_t buffer_size, double write_fraction, unsigned max_os_concurrency, std::chrono::duration<double> duration, std::vector<unsigned>& rates) {
+        buffer_size = calculate_buffer_size(pattern::random, buffer_size, std::max(_file.disk_read_dma_alignment(), _file.disk_write_dma_alignment()));
+        auto worker = std::make_unique<io_worker>(buffer_size, duration, std::make_unique<mixed_request_issuer>(_file, write_fraction), get_position_generator(buffer_size, pattern::random), rates);
+        return do_workload(std::move(worker), max_os_concurrency).then([this] (io_rates r) {
+            return _file.flush().then([r = std::move(r)] () mutable {
+                return make_ready_future<io_rates>(std::move(r));
+            });
+        });
+    }
+
     future<> stop() {
         return _file ? _file.close() : make_ready_future<>();
     }
@@ -519,8 +554,12 @@ class iotune_multi_shard_context {
     uint64_t _random_io_buffer_size;
 
     unsigned per_shard_io_depth() const {
-        auto iodepth = _test_directory.max_iodepth() / smp::count;
-        if (this_shard_id() < _test_directory.max_iodepth() % smp::count) {
+        return per_shard_io_depth(_test_directory.max_iodepth());
+    }
+
+    unsigned per_shard_io_depth(unsigned total) const {
+        auto iodepth = total / smp::count;
+        if (this_shard_id() < total % smp::count) {
             iodepth++;
         }
         return std::min(iodepth, 128u);
@@ -599,6 +638,25 @@ class iotune_multi_shard_context {
         }, io_rates(), std::plus<io_rates>());
     }
 
+    // Random requests of the given size with the given total io depth, spread
+    // over the shards, write_fraction of them being writes
+    future<io_rates> random_data_at_depth(size_t buffer_size, double write_fraction, unsigned iodepth, std::chrono::duration<double> duration) {
+        return _iotune_test_file.map_reduce0([buffer_size, write_fraction, iodepth, this, duration] (test_file& tf) {
+            const auto shard_io_depth = per_shard_io_depth(iodepth);
+            if (shard_io_depth == 0) {
+                return make_ready_future<io_rates>();
+            } else if (write_fraction == 0.0) {
+                return tf.read_workload(buffer_size, test_file::pattern::random, shard_io_depth, duration, sharded_rates.local());
+            } else if (write_fraction == 1.0) {
+                return tf.write_workload(buffer_size, test_file::pattern::random, shard_io_depth, duration, sharded_rates.local());
+            } else {
+                return tf.mixed_workload(buffer_size, write_fraction, shard_io_depth, duration, sharded_rates.local());
+            }
+        }, io_rates(), std::plus<io_rates>()).finally([this] {
+            return sharded_rates.invoke_on_all([] (std::vector<unsigned>& rates) { rates.clear(); });
+        });
+    }
+
 private:
     template <typename Fn>
     future<uint64_t> saturate(float rate_threshold, size_t buffer_size, std::chrono::duration<double> duration, Fn&& workload) {
@@ -631,6 +689,30 @@ class iotune_multi_shard_context {
     {}
 };
 
+// A measurement of random requests of one size at one io depth
+struct latency_point {
+    unsigned iodepth;
+    io_rates rates;
+};
+
+struct latency_curve {
+    uint64_t request_size;
+    std::vector<latency_point> points;
+
+    // The point past which more concurrency mostly adds latency: the one
+    // with the highest throughput to latency ratio (Kleinrock's power)
+    const latency_point& knee() const {
+        return *std::max_element(points.begin(), points.end(), [] (const latency_point& a, const latency_point& b) {
+            return a.rates.iops / a.rates.latency.count() < b.rates.iops / b.rates.latency.count();
+        });
+    }
+};
+
+struct mixed_point {
+    double write_fraction;
+    io_rates rates;
+};
+
 struct disk_descriptor {
     std::string mountpoint;
     uint64_t read_iops;
@@ -639,8 +721,63 @@ struct disk_descriptor {
     uint64_t write_bw;
     std::optional<uint64_t> read_sat_len;
     std::optional<uint64_t> write_sat_len;
+    std::vector<latency_curve> read_curves;
+    std::vector<latency_curve> write_curves;
+    std::vector<mixed_point> mixed_points;
+    std::optional<double> write_penalty;
 };
 
+// How much more a write costs when mixed with reads than the pure read and
+// write rates suggest. The io_queue model assumes that a mix of r reads and
+// w writes per second saturates the disk when r/read_iops + w/write_iops = 1;
+// the penalty is the factor p for which r/read_iops + p*w/write_iops = 1 holds
+// on average over the measured mixes.
+static std::optional<double> write_penalty_of(const std::vector<mixed_point>& mixes, double read_iops, double write_iops) {
+    double sum = 0;
+    unsigned nr = 0;
+    for (auto& m : mixes) {
+        double reads = m.rates.iops * (1.0 - m.write_fraction);
+        double writes = m.rates.iops * m.write_fraction;
+        if (writes > 0 && reads < read_iops) {
+            sum += (1.0 - reads / read_iops) * write_iops / writes;
+            nr++;
+        }
+    }
+    if (nr == 0) {
+        return std::nullopt;
+    }
+    return sum / nr;
+}
+
+static void emit_rates(YAML::Emitter& out, const io_rates& r) {
+    out << YAML::Key << "iops" << YAML::Value << uint64_t(r.iops);
+    out << YAML::Key << "bandwidth" << YAML::Value << uint64_t(r.bytes_per_sec);
+    out << YAML::Key << "latency_us" << YAML::Value << uint64_t(r.latency / 1us);
+}
+
+static void emit_curves(YAML::Emitter& out, const std::vector<latency_curve>& curves) {
+    out << YAML::BeginSeq;
+    for (auto& c : curves) {
+        out << YAML::BeginMap;
+        out << YAML::Key << "request_size" << YAML::Value << c.request_size;
+        out << YAML::Key << "points" << YAML::Value << YAML::BeginSeq;
+        for (auto& p : c.points) {
+            out << YAML::Flow << YAML::BeginMap;
+            out << YAML::Key << "iodepth" << YAML::Value << p.iodepth;
+            emit_rates(out, p.rates);
+            out << YAML::EndMap;
+        }
+        out << YAML::EndSeq;
+        auto& knee = c.knee();
+        out << YAML::Key << "knee" << YAML::Value << YAML::Flow << YAML::BeginMap;
+        out << YAML::Key << "iodepth" << YAML::Value << knee.iodepth;
+        emit_rates(out, knee.rates);
+        out << YAML::EndMap;
+        out << YAML::EndMap;
+    }
+    out << YAML::EndSeq;
+}
+
 void string_to_file(sstring conf_file, sstring buf) {
     auto f = file_desc::open(conf_file, O_WRONLY | O_CLOEXEC | O_CREAT | O_TRUNC, 0664);
     auto ret = f.write(buf.data(), buf.size());
@@ -677,6 +814,29 @@ void write_property_file(sstring conf_file, std::vector<disk_descriptor> disk_de
         if (desc.write_sat_len) {
             out << YAML::Key << "write_saturation_length" << YAML::Value << *desc.write_sat_len;
         }
+        if (desc.write_penalty) {
+            out << YAML::Key << "write_penalty" << YAML::Value << *desc.write_penalty;
+        }
+        if (!desc.read_curves.empty()) {
+            out << YAML::Key << "latency_profile" << YAML::Value << YAML::BeginMap;
+            out << YAML::Key << "read" << YAML::Value;
+            emit_curves(out, desc.read_curves);
+            out << YAML::Key << "write" << YAML::Value;
+            emit_curves(out, desc.write_curves);
+            out << YAML::EndMap;
+        }
+        if (!desc.mixed_points.empty()) {
+            out << YAML::Key << "mixed_profile" << YAML::Value << YAML::BeginSeq;
+            for (auto& m : desc.mixed_points) {
+                out << YAML::Flow << YAML::BeginMap;
+                out << YAML::Key << "write_ratio" << YAML::Value << m.write_fraction;
+                out << YAML::Key << "read_iops" << YAML::Value << uint64_t(m.rates.iops * (1.0 - m.write_fraction));
+                out << YAML::Key << "write_iops" << YAML::Value << uint64_t(m.rates.iops * m.write_fraction);
+                out << YAML::Key << "latency_us" << YAML::Value << uint64_t(m.rates.latency / 1us);
+                out << YAML::EndMap;
+            }
+            out << YAML::EndSeq;
+        }
         out << YAML::EndMap;
     }
     out << YAML::EndSeq;
@@ -709,6 +869,7 @@ fs::path mountpoint_of(sstring filename) {
 int main(int ac, char** av) {
     namespace bpo = boost::program_options;
     bool fs_check = false;
+    bool latency_profile = false;
 
     app_template::config app_cfg;
     app_cfg.name = "IOTune";
@@ -725,6 +886,7 @@ int main(int ac, char** av) {
         ("accuracy", bpo::value<unsigned>()->default_value(3), "acceptable deviation of measurements (percents)")
         ("saturation", bpo::value<sstring>()->default_value(""), "measure saturation lengths (read | write | both) (this is very slow!)")
         ("random-io-buffer-size", bpo::value<unsigned>()->default_value(0), "force buffer size for random write and random read")
+        ("latency-profile", bpo::bool_switch(&latency_profile), "measure latency vs throughput curves for several request sizes, and mixed read/write interference (this is slow!)")
     ;
 
     return app.run(ac, av, [&] {
@@ -881,6 +1043,51 @@ int main(int ac, char** av) {
                 fmt::print("{} IOPS{}\n", uint64_t(read_iops.iops), accuracy_msg());
 
                 struct disk_descriptor desc;
+                if (latency_profile) {
+                    auto point_duration = std::max(duration * 0.01, std::chrono::duration<double>(1s));
+                    auto min_io_size = test_directory.minimum_io_size();
+                    std::vector<uint64_t> sizes;
+                    for (uint64_t size : { uint64_t(4 << 10), uint64_t(16 << 10), uint64_t(64 << 10), uint64_t(128 << 10) }) {
+                        if (size >= min_io_size) {
+                            sizes.push_back(size);
+                        }
+                    }
+                    if (sizes.empty() || sizes.front() != min_io_size) {
+                        sizes.insert(sizes.begin(), min_io_size);
+                    }
+
+                    auto measure_curve = [&] (uint64_t size, double write_fraction) {
+                        latency_curve curve{size, {}};
+                        for (unsigned depth = 1; depth <= test_directory.max_iodepth(); depth *= 2) {
+                            auto r = iotune_tests.random_data_at_depth(size, write_fraction, depth, point_duration).get();
+                            curve.points.push_back(latency_point{depth, r});
+                        }
+                        auto& knee = curve.knee();
+                        fmt::print("  {}B: knee at iodepth {}, {} IOPS, {} us\n", size, knee.iodepth, uint64_t(knee.rates.iops), uint64_t(knee.rates.latency / 1us));
+                        return curve;
+                    };
+
+                    fmt::print("Measuring random read latency curves:\n");
+                    for (auto size : sizes) {
+                        desc.read_curves.push_back(measure_curve(size, 0.0));
+                    }
+                    fmt::print("Measuring random write latency curves:\n");
+                    for (auto size : sizes) {
+                        desc.write_curves.push_back(measure_curve(size, 1.0));
+                    }
+
+                    fmt::print("Measuring mixed read/write IOPS:\n");
+                    for (double write_fraction : { 0.1, 0.25, 0.5, 0.75, 0.9 }) {
+                        auto r = iotune_tests.random_data_at_depth(min_io_size, write_fraction, test_directory.max_iodepth(), point_duration).get();
+                        fmt::print("  {}% writes: {} read IOPS, {} write IOPS\n", int(write_fraction * 100),
+                                uint64_t(r.iops * (1.0 - write_fraction)), uint64_t(r.iops * write_fraction));
+                        desc.mixed_points.push_back(mixed_point{write_fraction, r});
+                    }
+                    desc.write_penalty = write_penalty_of(desc.mixed_points, read_iops.iops, write_iops.iops);
+                    if (desc.write_penalty) {
+                        fmt::print("Write penalty: {:.2f}\n", *desc.write_penalty);
+                    }
+                }
                 desc.mountpoint = mountpoint;
                 desc.read_iops = read_iops.iops;
                 desc.read_bw = read_bw.bytes_per_sec;
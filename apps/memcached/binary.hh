@@ -0,0 +1,197 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// The requests of the memcached binary protocol: a header of 24 bytes,
+// followed by the extras, the key and the value of the command, without
+// terminators, all the integers big endian.
+class memcache_binary_parser {
+public:
+    static constexpr uint8_t magic_request = 0x80;
+    static constexpr uint8_t magic_response = 0x81;
+    static constexpr size_t header_size = 24;
+    // Enough for the largest value the slabs take and a key
+    static constexpr uint32_t max_body_length = (1 << 20) + 1024;
+
+    enum class opcode : uint8_t {
+        get = 0x00,
+        set = 0x01,
+        add = 0x02,
+        replace = 0x03,
+        del = 0x04,
+        increment = 0x05,
+        decrement = 0x06,
+        quit = 0x07,
+        flush = 0x08,
+        getq = 0x09,
+        noop = 0x0a,
+        version = 0x0b,
+        getk = 0x0c,
+        getkq = 0x0d,
+        setq = 0x11,
+        addq = 0x12,
+        replaceq = 0x13,
+        delq = 0x14,
+        incrementq = 0x15,
+        decrementq = 0x16,
+        quitq = 0x17,
+        flushq = 0x18,
+    };
+
+    struct header {
+        uint8_t magic;
+        opcode op;
+        uint16_t key_length;
+        uint8_t extras_length;
+        uint8_t data_type;
+        // The vbucket of a request, unused, or the status of a response
+        uint16_t status;
+        uint32_t body_length;
+        uint32_t opaque;
+        uint64_t cas;
+
+        static header read(const char* p) noexcept {
+            return header{
+                .magic = uint8_t(p[0]),
+                .op = opcode(p[1]),
+                .key_length = seastar::read_be<uint16_t>(p + 2),
+                .extras_length = uint8_t(p[4]),
+                .data_type = uint8_t(p[5]),
+                .status = seastar::read_be<uint16_t>(p + 6),
+                .body_length = seastar::read_be<uint32_t>(p + 8),
+                .opaque = seastar::read_be<uint32_t>(p + 12),
+                .cas = seastar::read_be<uint64_t>(p + 16),
+            };
+        }
+
+        void write(char* p) const noexcept {
+            p[0] = char(magic);
+            p[1] = char(op);
+            seastar::write_be<uint16_t>(p + 2, key_length);
+            p[4] = char(extras_length);
+            p[5] = char(data_type);
+            seastar::write_be<uint16_t>(p + 6, status);
+            seastar::write_be<uint32_t>(p + 8, body_length);
+            seastar::write_be<uint32_t>(p + 12, opaque);
+            seastar::write_be<uint64_t>(p + 16, cas);
+        }
+    };
+
+    struct request {
+        header hdr;
+        seastar::temporary_buffer<char> body;
+
+        std::string_view extras() const noexcept {
+            return std::string_view(body.get(), hdr.extras_length);
+        }
+        std::string_view key() const noexcept {
+            return std::string_view(body.get() + hdr.extras_length, hdr.key_length);
+        }
+        std::string_view value() const noexcept {
+            auto offset = hdr.extras_length + hdr.key_length;
+            return std::string_view(body.get() + offset, hdr.body_length - offset);
+        }
+    };
+
+    // The get commands, which are looked up together
+    static bool is_get(opcode op) noexcept {
+        return op == opcode::get || op == opcode::getq || op == opcode::getk || op == opcode::getkq;
+    }
+private:
+    char _header[header_size];
+    size_t _header_read = 0;
+    std::optional<header> _hdr;
+    seastar::temporary_buffer<char> _body;
+    size_t _body_read = 0;
+public:
+    // The requests parsed by the last consumption: gets, possibly
+    // followed by one other command
+    std::vector<request> _requests;
+    // Set on a request the connection cannot go on after
+    bool _error = false;
+
+    // Stops at the end of the data available with complete requests, or
+    // after a command other than a get, for the gets pipelined by the
+    // client to be looked up at once.
+    seastar::future<seastar::consumption_result<char>> operator()(seastar::temporary_buffer<char> data) {
+        using consumption_result = seastar::consumption_result<char>;
+        auto stop = [] (seastar::temporary_buffer<char> rest) {
+            return seastar::make_ready_future<consumption_result>(seastar::stop_consuming<char>(std::move(rest)));
+        };
+        if (data.empty()) {
+            return stop(std::move(data));
+        }
+        while (!data.empty()) {
+            if (!_hdr) {
+                auto n = std::min(data.size(), header_size - _header_read);
+                std::copy_n(data.get(), n, _header + _header_read);
+                _header_read += n;
+                data.trim_front(n);
+                if (_header_read < header_size) {
+                    break;
+                }
+                _header_read = 0;
+                _hdr = header::read(_header);
+                if (_hdr->magic != magic_request || _hdr->body_length > max_body_length
+                        || size_t(_hdr->key_length) + _hdr->extras_length > _hdr->body_length) {
+                    _error = true;
+                    return stop(std::move(data));
+                }
+                if (data.size() >= _hdr->body_length) {
+                    _body = data.share(0, _hdr->body_length);
+                    data.trim_front(_hdr->body_length);
+                    _body_read = _hdr->body_length;
+                } else {
+                    _body = seastar::temporary_buffer<char>(_hdr->body_length);
+                    _body_read = 0;
+                }
+            }
+            auto n = std::min(data.size(), _body.size() - _body_read);
+            std::copy_n(data.get(), n, _body.get_write() + _body_read);
+            _body_read += n;
+            data.trim_front(n);
+            if (_body_read < _body.size()) {
+                break;
+            }
+            auto op = _hdr->op;
+            _requests.push_back(request{*_hdr, std::move(_body)});
+            _hdr.reset();
+            if (!is_get(op)) {
+                return stop(std::move(data));
+            }
+        }
+        if (!_requests.empty()) {
+            return stop(std::move(data));
+        }
+        return seastar::make_ready_future<consumption_result>(seastar::continue_consuming{});
+    }
+};
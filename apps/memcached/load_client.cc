@@ -0,0 +1,595 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+// A load client of apps/memcached, both of its protocols, much like the
+// workloads of YCSB: keys picked with a zipfian popularity, a mix of gets,
+// of one or several keys, and sets, of values of a range of sizes, sent
+// as fast as the server answers them or at a fixed rate.
+//
+//   memcached_load -c4 --server 127.0.0.1:11211 --populate --duration 10
+//   memcached_load -c4 --protocol binary --rate 200000 --get-ratio 0.95 --multiget 4
+
+#include <random>
+#include <boost/range/irange.hpp>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/coroutine/parallel_for_each.hh>
+#include <seastar/net/api.hh>
+#include <seastar/util/defer.hh>
+#include "binary.hh"
+
+using namespace seastar;
+
+namespace bpo = boost::program_options;
+
+using clock_type = steady_clock_type;
+
+// Latencies in nanoseconds, from 1us to about a minute, within 1/64 of
+// their value
+using latency_histogram = metrics::internal::approximate_exponential_histogram<1024, uint64_t(1) << 36, 64>;
+
+// The zipfian generator of YCSB (Gray et al., "Quickly generating
+// billion-record synthetic databases"), the ranks scattered over the key
+// space for the popular keys not to be neighbours
+class zipfian {
+    uint64_t _n;
+    double _theta;
+    double _alpha;
+    double _zetan;
+    double _eta;
+    std::mt19937_64 _rng;
+    std::uniform_real_distribution<double> _uniform{0, 1};
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) {
+            sum += 1 / std::pow(double(i), theta);
+        }
+        return sum;
+    }
+
+    uint64_t rank() {
+        auto u = _uniform(_rng);
+        if (_theta == 0) {
+            return std::min(uint64_t(u * _n), _n - 1);
+        }
+        auto uz = u * _zetan;
+        if (uz < 1) {
+            return 0;
+        }
+        if (uz < 1 + std::pow(0.5, _theta)) {
+            return 1;
+        }
+        return std::min(uint64_t(_n * std::pow(_eta * u - _eta + 1, _alpha)), _n - 1);
+    }
+public:
+    zipfian(uint64_t n, double theta, uint64_t seed)
+        : _n(n)
+        , _theta(theta)
+        , _alpha(1 / (1 - theta))
+        , _zetan(theta ? zeta(n, theta) : 0)
+        , _eta(theta ? (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / _zetan) : 0)
+        , _rng(seed)
+    {}
+
+    uint64_t next() {
+        // FNV-1a of the rank
+        uint64_t h = 14695981039346656037ull;
+        auto r = rank();
+        for (int i = 0; i < 8; i++) {
+            h = (h ^ ((r >> (i * 8)) & 0xff)) * 1099511628211ull;
+        }
+        return _theta ? h % _n : r;
+    }
+
+    double uniform() {
+        return _uniform(_rng);
+    }
+};
+
+struct load_config {
+    bool binary;
+    unsigned total_conn;
+    uint64_t keys;
+    double zipf;
+    size_t value_size_min;
+    size_t value_size_max;
+    double get_ratio;
+    unsigned multiget;
+    // Operations a second of all the shards, 0 to send each operation of
+    // a connection when the previous one is answered
+    double rate;
+    unsigned duration;
+};
+
+struct op_stats {
+    uint64_t ops = 0;
+    latency_histogram latency;
+
+    op_stats& operator+=(const op_stats& o) {
+        ops += o.ops;
+        latency.merge(o.latency);
+        return *this;
+    }
+};
+
+struct load_stats {
+    op_stats get;
+    op_stats set;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t errors = 0;
+    uint64_t dropped = 0;
+
+    load_stats& operator+=(const load_stats& o) {
+        get += o.get;
+        set += o.set;
+        hits += o.hits;
+        misses += o.misses;
+        errors += o.errors;
+        dropped += o.dropped;
+        return *this;
+    }
+};
+
+load_stats operator+(load_stats a, const load_stats& b) {
+    return a += b;
+}
+
+// Reads the responses of the server, line by line or bytes at a time
+class response_reader {
+    input_stream<char>& _in;
+    temporary_buffer<char> _buf;
+
+    future<> fill() {
+        _buf = co_await _in.read();
+        if (_buf.empty()) {
+            throw std::runtime_error("connection closed by the server");
+        }
+    }
+public:
+    explicit response_reader(input_stream<char>& in) : _in(in) {}
+
+    // A line, without its terminator
+    future<sstring> line() {
+        sstring line;
+        while (true) {
+            auto nl = std::find(_buf.begin(), _buf.end(), '\n');
+            if (nl != _buf.end()) {
+                auto n = nl - _buf.begin();
+                line.append(_buf.get(), n);
+                _buf.trim_front(n + 1);
+                break;
+            }
+            line.append(_buf.get(), _buf.size());
+            co_await fill();
+        }
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.resize(line.size() - 1);
+        }
+        co_return line;
+    }
+
+    future<> read(char* dst, size_t n) {
+        while (n) {
+            if (_buf.empty()) {
+                co_await fill();
+            }
+            auto k = std::min(n, _buf.size());
+            if (dst) {
+                dst = std::copy_n(_buf.get(), k, dst);
+            }
+            _buf.trim_front(k);
+            n -= k;
+        }
+    }
+
+    future<> skip(size_t n) {
+        return read(nullptr, n);
+    }
+};
+
+class connection {
+protected:
+    connected_socket _fd;
+    input_stream<char> _in;
+    output_stream<char> _out;
+    response_reader _reader;
+public:
+    explicit connection(connected_socket fd)
+        : _fd(std::move(fd))
+        , _in(_fd.input())
+        , _out(_fd.output())
+        , _reader(_in)
+    {}
+    virtual ~connection() = default;
+
+    virtual future<> set(const sstring& key, std::string_view value) = 0;
+    // The number of the keys found
+    virtual future<unsigned> get(const std::vector<sstring>& keys) = 0;
+
+    future<> close() {
+        co_await _out.close();
+        co_await _in.close();
+    }
+};
+
+class ascii_connection final : public connection {
+public:
+    using connection::connection;
+
+    virtual future<> set(const sstring& key, std::string_view value) override {
+        co_await _out.write(fmt::format("set {} 0 0 {}\r\n", key, value.size()));
+        co_await _out.write(value.data(), value.size());
+        co_await _out.write("\r\n");
+        co_await _out.flush();
+        auto resp = co_await _reader.line();
+        if (resp != "STORED") {
+            throw std::runtime_error(fmt::format("set failed: {}", resp));
+        }
+    }
+
+    virtual future<unsigned> get(const std::vector<sstring>& keys) override {
+        sstring req = "get";
+        for (auto& k : keys) {
+            req += " ";
+            req += k;
+        }
+        req += "\r\n";
+        co_await _out.write(req);
+        co_await _out.flush();
+        unsigned found = 0;
+        while (true) {
+            auto resp = co_await _reader.line();
+            if (resp == "END") {
+                co_return found;
+            }
+            // VALUE <key> <flags> <bytes>
+            auto bytes = resp.find_last_of(' ');
+            if (!resp.starts_with("VALUE ") || bytes == sstring::npos) {
+                throw std::runtime_error(fmt::format("get failed: {}", resp));
+            }
+            co_await _reader.skip(std::stoul(std::string(resp.substr(bytes + 1))) + 2);
+            found++;
+        }
+    }
+};
+
+class binary_connection final : public connection {
+    using parser = memcache_binary_parser;
+
+    future<> write_request(parser::opcode op, std::string_view extras, std::string_view key, std::string_view value) {
+        char hdr[parser::header_size];
+        parser::header{
+            .magic = parser::magic_request,
+            .op = op,
+            .key_length = uint16_t(key.size()),
+            .extras_length = uint8_t(extras.size()),
+            .data_type = 0,
+            .status = 0,
+            .body_length = uint32_t(extras.size() + key.size() + value.size()),
+            .opaque = 0,
+            .cas = 0,
+        }.write(hdr);
+        co_await _out.write(hdr, sizeof(hdr));
+        co_await _out.write(extras.data(), extras.size());
+        co_await _out.write(key.data(), key.size());
+        co_await _out.write(value.data(), value.size());
+    }
+
+    future<parser::header> read_response() {
+        char hdr[parser::header_size];
+        co_await _reader.read(hdr, sizeof(hdr));
+        auto h = parser::header::read(hdr);
+        if (h.magic != parser::magic_response) {
+            throw std::runtime_error("bad response magic");
+        }
+        co_await _reader.skip(h.body_length);
+        co_return h;
+    }
+public:
+    using connection::connection;
+
+    virtual future<> set(const sstring& key, std::string_view value) override {
+        // Flags and expiration
+        char extras[8] = {};
+        co_await write_request(parser::opcode::set, std::string_view(extras, sizeof(extras)), key, value);
+        co_await _out.flush();
+        auto h = co_await read_response();
+        if (h.status) {
+            throw std::runtime_error(fmt::format("set failed: status {}", h.status));
+        }
+    }
+
+    virtual future<unsigned> get(const std::vector<sstring>& keys) override {
+        if (keys.size() == 1) {
+            co_await write_request(parser::opcode::get, {}, keys.front(), {});
+            co_await _out.flush();
+            auto h = co_await read_response();
+            co_return h.status == 0;
+        }
+        // Quiet gets answer only the keys found, the noop ending them
+        for (auto& k : keys) {
+            co_await write_request(parser::opcode::getkq, {}, k, {});
+        }
+        co_await write_request(parser::opcode::noop, {}, {}, {});
+        co_await _out.flush();
+        unsigned found = 0;
+        while ((co_await read_response()).op != parser::opcode::noop) {
+            found++;
+        }
+        co_return found;
+    }
+};
+
+class load_client {
+    load_config _cfg;
+    socket_address _server;
+    unsigned _conn_per_core;
+    zipfian _keys;
+    sstring _value;
+    std::vector<std::unique_ptr<connection>> _conns;
+    load_stats _stats;
+
+    // Open-loop: the times the operations waiting for a connection were
+    // due, their latency including the wait
+    static constexpr size_t max_pending = 1 << 20;
+    circular_buffer<clock_type::time_point> _pending;
+    condition_variable _pending_cv;
+    bool _generating = false;
+
+    static sstring key_name(uint64_t k) {
+        return fmt::format("key:{:012}", k);
+    }
+
+    std::string_view next_value() {
+        auto size = _cfg.value_size_min;
+        if (_cfg.value_size_max > size) {
+            size += uint64_t(_keys.uniform() * (_cfg.value_size_max - size + 1));
+        }
+        return std::string_view(_value.data(), std::min(size, _value.size()));
+    }
+
+    future<> do_op(connection& c, clock_type::time_point due) {
+        if (_keys.uniform() < _cfg.get_ratio) {
+            std::vector<sstring> keys;
+            for (unsigned i = 0; i < _cfg.multiget; i++) {
+                keys.push_back(key_name(_keys.next()));
+            }
+            auto found = co_await c.get(keys);
+            _stats.hits += found;
+            _stats.misses += keys.size() - found;
+            record(_stats.get, due);
+        } else {
+            co_await c.set(key_name(_keys.next()), next_value());
+            record(_stats.set, due);
+        }
+    }
+
+    static void record(op_stats& s, clock_type::time_point due) {
+        s.ops++;
+        s.latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - due).count());
+    }
+
+    future<> closed_loop(connection& c, clock_type::time_point end) {
+        while (clock_type::now() < end) {
+            co_await do_op(c, clock_type::now());
+        }
+    }
+
+    future<> open_loop(connection& c) {
+        while (true) {
+            co_await _pending_cv.wait([this] { return !_pending.empty() || !_generating; });
+            if (_pending.empty()) {
+                co_return;
+            }
+            auto due = _pending.front();
+            _pending.pop_front();
+            co_await do_op(c, due);
+        }
+    }
+
+    // Issues the operations at the configured rate, the time each one was
+    // due counting towards its latency, however late it is sent
+    future<> generate(clock_type::time_point end) {
+        auto interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(smp::count / _cfg.rate));
+        auto next = clock_type::now();
+        while (next < end) {
+            auto now = clock_type::now();
+            if (next > now) {
+                co_await seastar::sleep(next - now);
+                now = clock_type::now();
+            }
+            for (; next <= now && next < end; next += interval) {
+                if (_pending.size() < max_pending) {
+                    _pending.push_back(next);
+                    _pending_cv.signal();
+                } else {
+                    _stats.dropped++;
+                }
+            }
+        }
+        _generating = false;
+        _pending_cv.broadcast();
+    }
+public:
+    load_client(load_config cfg, socket_address server)
+        : _cfg(std::move(cfg))
+        , _server(server)
+        , _conn_per_core(_cfg.total_conn / smp::count)
+        , _keys(_cfg.keys, _cfg.zipf, std::random_device()())
+        , _value(sstring(sstring::initialized_later(), _cfg.value_size_max))
+    {
+        std::fill(_value.begin(), _value.end(), 'x');
+    }
+
+    future<> connect() {
+        co_await coroutine::parallel_for_each(boost::irange(0u, _conn_per_core), [this] (unsigned) -> future<> {
+            auto fd = co_await seastar::connect(_server);
+            if (_cfg.binary) {
+                _conns.push_back(std::make_unique<binary_connection>(std::move(fd)));
+            } else {
+                _conns.push_back(std::make_unique<ascii_connection>(std::move(fd)));
+            }
+        });
+    }
+
+    // Sets the keys of this shard, every smp::count-th one, for the gets
+    // to find them
+    future<> populate() {
+        auto conns = _conns.size();
+        co_await coroutine::parallel_for_each(boost::irange(size_t(0), conns), [this, conns] (size_t i) -> future<> {
+            for (uint64_t k = this_shard_id() + i * smp::count; k < _cfg.keys; k += conns * smp::count) {
+                co_await _conns[i]->set(key_name(k), next_value());
+            }
+        });
+    }
+
+    future<> run() {
+        auto end = clock_type::now() + std::chrono::seconds(_cfg.duration);
+        _generating = _cfg.rate > 0;
+        auto generating = _generating ? generate(end) : make_ready_future<>();
+        co_await coroutine::parallel_for_each(_conns, [this, end] (std::unique_ptr<connection>& c) -> future<> {
+            try {
+                co_await (_cfg.rate > 0 ? open_loop(*c) : closed_loop(*c, end));
+            } catch (std::exception& ex) {
+                _stats.errors++;
+                fmt::print("memcached request error: {}\n", ex.what());
+            }
+        });
+        co_await std::move(generating);
+        // Left behind by the connections that failed
+        _stats.dropped += _pending.size();
+        _pending.clear();
+    }
+
+    future<load_stats> stats() {
+        return make_ready_future<load_stats>(_stats);
+    }
+
+    future<> stop() {
+        for (auto& c : _conns) {
+            co_await c->close().handle_exception([] (auto) {});
+        }
+        _conns.clear();
+    }
+};
+
+static void print_latency(const char* name, const op_stats& s, double secs) {
+    fmt::print("{:<4} {:>10} ops {:>12.0f} ops/s  latency (us):", name, s.ops, s.ops / secs);
+    if (s.ops) {
+        for (auto [p, q] : {std::pair{"p50", 0.5f}, {"p90", 0.9f}, {"p99", 0.99f}, {"p99.9", 0.999f}}) {
+            fmt::print(" {}={:.1f}", p, s.latency.quantile(q) / 1000.0);
+        }
+        fmt::print(" max={:.1f}", s.latency.max() / 1000.0);
+    }
+    fmt::print("\n");
+}
+
+int main(int ac, char** av) {
+    app_template app;
+    app.add_options()
+        ("server,s", bpo::value<std::string>()->default_value("127.0.0.1:11211"), "server address")
+        ("protocol", bpo::value<std::string>()->default_value("ascii"), "ascii or binary")
+        ("conn", bpo::value<unsigned>()->default_value(16), "total connections, a multiple of the cpus")
+        ("keys", bpo::value<uint64_t>()->default_value(100000), "number of keys")
+        ("zipf", bpo::value<double>()->default_value(0.99), "zipfian skew of the key popularity, in [0, 1), 0 for uniform")
+        ("value-size", bpo::value<size_t>()->default_value(100), "size of the values set")
+        ("value-size-max", bpo::value<size_t>()->default_value(0), "if larger than --value-size, values are of uniformly distributed sizes up to it")
+        ("get-ratio", bpo::value<double>()->default_value(0.9), "fraction of the operations that are gets")
+        ("multiget", bpo::value<unsigned>()->default_value(1), "keys of each get")
+        ("rate", bpo::value<double>()->default_value(0),
+            "operations per second of all the cpus, sent however long the previous ones take to be answered "
+            "and whose latency counts the time they waited for a connection (0 to send an operation when the previous one is answered)")
+        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds")
+        ("populate", "set all the keys before the test")
+        ;
+
+    return app.run(ac, av, [&app] () -> future<int> {
+        return async([&app] {
+            auto& config = app.configuration();
+            auto protocol = config["protocol"].as<std::string>();
+            load_config cfg{
+                .binary = protocol == "binary",
+                .total_conn = config["conn"].as<unsigned>(),
+                .keys = config["keys"].as<uint64_t>(),
+                .zipf = config["zipf"].as<double>(),
+                .value_size_min = config["value-size"].as<size_t>(),
+                .value_size_max = std::max(config["value-size"].as<size_t>(), config["value-size-max"].as<size_t>()),
+                .get_ratio = config["get-ratio"].as<double>(),
+                .multiget = config["multiget"].as<unsigned>(),
+                .rate = config["rate"].as<double>(),
+                .duration = config["duration"].as<unsigned>(),
+            };
+            if (protocol != "ascii" && protocol != "binary") {
+                fmt::print("Error: unknown protocol {}\n", protocol);
+                return -1;
+            }
+            if (cfg.total_conn == 0 || cfg.total_conn % smp::count != 0) {
+                fmt::print("Error: conn needs to be n * cpu_nr\n");
+                return -1;
+            }
+            if (cfg.zipf < 0 || cfg.zipf >= 1 || cfg.keys < 2 || cfg.multiget == 0) {
+                fmt::print("Error: needs --zipf within [0, 1), at least 2 --keys and a --multiget of at least 1\n");
+                return -1;
+            }
+
+            distributed<load_client> clients;
+            clients.start(cfg, socket_address(ipv4_addr{config["server"].as<std::string>()})).get();
+            auto stop = defer([&] () noexcept { clients.stop().get(); });
+            clients.invoke_on_all(&load_client::connect).get();
+            if (config.count("populate")) {
+                fmt::print("Populating {} keys\n", cfg.keys);
+                clients.invoke_on_all(&load_client::populate).get();
+            }
+
+            auto started = clock_type::now();
+            clients.invoke_on_all(&load_client::run).get();
+            auto secs = std::chrono::duration<double>(clock_type::now() - started).count();
+            auto stats = clients.map_reduce0(std::mem_fn(&load_client::stats), load_stats{}, std::plus<>()).get();
+
+            fmt::print("Protocol: {}, connections: {}, keys: {}, zipf: {}, get ratio: {}, multiget: {}\n",
+                       protocol, cfg.total_conn, cfg.keys, cfg.zipf, cfg.get_ratio, cfg.multiget);
+            fmt::print("Total time: {:f}s, operations/sec: {:.0f}", secs, (stats.get.ops + stats.set.ops) / secs);
+            if (cfg.rate > 0) {
+                fmt::print(" (target {:.0f})", cfg.rate);
+            }
+            fmt::print("\n");
+            print_latency("get", stats.get, secs);
+            print_latency("set", stats.set, secs);
+            if (stats.hits + stats.misses) {
+                fmt::print("Hit ratio: {:.3f}\n", double(stats.hits) / (stats.hits + stats.misses));
+            }
+            if (stats.errors || stats.dropped) {
+                fmt::print("Errors: {}, operations not sent: {}\n", stats.errors, stats.dropped);
+            }
+            return 0;
+        });
+    });
+}
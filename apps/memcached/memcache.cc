@@ -25,6 +25,9 @@
 #include <boost/lexical_cast.hpp>
 #include <iostream>
 #include <iomanip>
+#include <charconv>
+#include <optional>
+#include <ranges>
 #include <sstream>
 #include <seastar/core/app-template.hh>
 #include <seastar/core/reactor.hh>
@@ -39,13 +42,13 @@
 #include <seastar/core/vector-data-sink.hh>
 #include <seastar/core/bitops.hh>
 #include <seastar/core/slab.hh>
-#include <seastar/core/align.hh>
 #include <seastar/core/print.hh>
 #include <seastar/net/api.hh>
 #include <seastar/net/packet-data-source.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/log.hh>
 #include "ascii.hh"
+#include "binary.hh"
 #include "memcached.hh"
 #include <unistd.h>
 
@@ -63,6 +66,7 @@ namespace bi = boost::intrusive;
 static constexpr double default_slab_growth_factor = 1.25;
 static constexpr uint64_t default_slab_page_size = 1UL*MB;
 static constexpr uint64_t default_per_cpu_slab_size = 0UL; // zero means reclaimer is enabled.
+static constexpr unsigned default_slab_rebalance_period = 10; // seconds
 static __thread slab_allocator<item>* slab;
 static thread_local std::unique_ptr<slab_allocator<item>> slab_holder;
 
@@ -134,7 +138,6 @@ class item : public slab_item_base {
     using version_type = uint64_t;
     using time_point = expiration::time_point;
     using duration = expiration::duration;
-    static constexpr uint8_t field_alignment = alignof(void*);
 private:
     using hook_type = bi::unordered_set_member_hook<>;
     // TODO: align shared data to cache line boundary
@@ -148,7 +151,9 @@ class item : public slab_item_base {
     uint16_t _ref_count;
     uint8_t _key_size;
     uint8_t _ascii_prefix_size;
-    char _data[]; // layout: data=key, (data+key_size)=ascii_prefix, (data+key_size+ascii_prefix_size)=value.
+    // layout: data=key, (data+key_size)=ascii_prefix, (data+key_size+ascii_prefix_size)=value, packed,
+    // padding none of them, for the small items to fit in the small slab classes.
+    char _data[];
     friend class cache;
 public:
     item(uint32_t slab_page_index, item_key&& key, sstring&& ascii_prefix,
@@ -167,10 +172,9 @@ class item : public slab_item_base {
         // storing key
         memcpy(_data, key.key().c_str(), _key_size);
         // storing ascii_prefix
-        memcpy(_data + align_up(_key_size, field_alignment), ascii_prefix.c_str(), _ascii_prefix_size);
+        memcpy(_data + _key_size, ascii_prefix.c_str(), _ascii_prefix_size);
         // storing value
-        memcpy(_data + align_up(_key_size, field_alignment) + align_up(_ascii_prefix_size, field_alignment),
-               value.c_str(), _value_size);
+        memcpy(_data + _key_size + _ascii_prefix_size, value.c_str(), _value_size);
     }
 
     item(const item&) = delete;
@@ -189,13 +193,12 @@ class item : public slab_item_base {
     }
 
     const std::string_view ascii_prefix() const {
-        const char *p = _data + align_up(_key_size, field_alignment);
+        const char *p = _data + _key_size;
         return std::string_view(p, _ascii_prefix_size);
     }
 
     const std::string_view value() const {
-        const char *p = _data + align_up(_key_size, field_alignment) +
-            align_up(_ascii_prefix_size, field_alignment);
+        const char *p = _data + _key_size + _ascii_prefix_size;
         return std::string_view(p, _value_size);
     }
 
@@ -313,6 +316,9 @@ struct cache_stats {
     size_t _evicted {};
     size_t _bytes {};
     size_t _resize_failure {};
+    size_t _resizes {};
+    size_t _resize_migrated_buckets {};
+    size_t _resize_pending_buckets {};
     size_t _size {};
     size_t _reclaims{};
 
@@ -334,6 +340,9 @@ struct cache_stats {
         _evicted += o._evicted;
         _bytes += o._bytes;
         _resize_failure += o._resize_failure;
+        _resizes += o._resizes;
+        _resize_migrated_buckets += o._resize_migrated_buckets;
+        _resize_pending_buckets += o._resize_pending_buckets;
         _size += o._size;
         _reclaims += o._reclaims;
     }
@@ -372,32 +381,41 @@ class cache {
         bi::member_hook<item, item::hook_type, &item::_cache_link>,
         bi::power_2_buckets<true>,
         bi::constant_time_size<true>>;
-    using cache_iterator = typename cache_type::iterator;
     static constexpr size_t initial_bucket_count = 1 << 10;
     static constexpr float load_factor = 0.75f;
+    // Old buckets migrated on every insertion while resizing: twice the
+    // growth of the cache until the next resize
+    static constexpr size_t migration_step = 2;
     size_t _resize_up_threshold = load_factor * initial_bucket_count;
     std::vector<cache_type::bucket_type> _buckets;
     cache_type _cache;
+    // While resizing, the items of the old buckets not migrated yet, those
+    // of the keys hashing to them inserted since included, stay in _old,
+    // in the buckets of _old_buckets from _migrated on, all the others
+    // are in _cache.
+    std::vector<cache_type::bucket_type> _old_buckets;
+    std::optional<cache_type> _old;
+    size_t _migrated = 0;
+    future<> _migration = make_ready_future<>();
     seastar::timer_set<item, &item::_timer_link> _alive;
     timer<clock_type> _timer;
     // delta in seconds between the current values of a wall clock and a clock_type clock
     clock_type::duration _wc_to_clock_type_delta;
     cache_stats _stats;
     timer<clock_type> _flush_timer;
+    timer<clock_type> _rebalance_timer;
 private:
     size_t item_size(item& item_ref) {
-        constexpr size_t field_alignment = alignof(void*);
         return sizeof(item) +
-            align_up(item_ref.key_size(), field_alignment) +
-            align_up(item_ref.ascii_prefix_size(), field_alignment) +
+            item_ref.key_size() +
+            item_ref.ascii_prefix_size() +
             item_ref.value_size();
     }
 
     size_t item_size(item_insertion_data& insertion) {
-        constexpr size_t field_alignment = alignof(void*);
         auto size = sizeof(item) +
-            align_up(insertion.key.key().size(), field_alignment) +
-            align_up(insertion.ascii_prefix.size(), field_alignment) +
+            insertion.key.key().size() +
+            insertion.ascii_prefix.size() +
             insertion.data.size();
 #ifdef __DEBUG__
         static bool print_item_footprint = true;
@@ -416,7 +434,8 @@ class cache {
     template <bool IsInCache = true, bool IsInTimerList = true, bool Release = true>
     void erase(item& item_ref) {
         if (IsInCache) {
-            _cache.erase(_cache.iterator_to(item_ref));
+            auto& table = table_of(item_ref);
+            table.erase(table.iterator_to(item_ref));
         }
         if (IsInTimerList) {
             if (item_ref._expiry.ever_expires()) {
@@ -450,15 +469,24 @@ class cache {
         _timer.arm(_alive.get_next_timeout());
     }
 
+    bool in_old(size_t old_bucket) const noexcept {
+        return _old && old_bucket >= _migrated;
+    }
+
+    cache_type& table_of(const item& item_ref) {
+        return in_old(_old ? _old->bucket(item_ref) : 0) ? *_old : _cache;
+    }
+
     inline
-    cache_iterator find(const item_key& key) {
-        return _cache.find(key, std::hash<item_key>(), item_key_cmp());
+    item* find(const item_key& key) {
+        auto& table = in_old(_old ? _old->bucket(key, std::hash<item_key>()) : 0) ? *_old : _cache;
+        auto i = table.find(key, std::hash<item_key>(), item_key_cmp());
+        return i != table.end() ? &*i : nullptr;
     }
 
     template <typename Origin>
     inline
-    cache_iterator add_overriding(cache_iterator i, item_insertion_data& insertion) {
-        auto& old_item = *i;
+    item& add_overriding(item& old_item, item_insertion_data& insertion) {
         uint64_t old_item_version = old_item._version;
 
         erase(old_item);
@@ -468,13 +496,13 @@ class cache {
             Origin::move_if_local(insertion.data), insertion.expiry, old_item_version + 1);
         intrusive_ptr_add_ref(new_item);
 
-        auto insert_result = _cache.insert(*new_item);
+        auto insert_result = table_of(*new_item).insert(*new_item);
         assert(insert_result.second);
         if (insertion.expiry.ever_expires() && _alive.insert(*new_item)) {
             _timer.rearm(new_item->get_timeout());
         }
         _stats._bytes += size;
-        return insert_result.first;
+        return *new_item;
     }
 
     template <typename Origin>
@@ -485,7 +513,7 @@ class cache {
             Origin::move_if_local(insertion.data), insertion.expiry);
         intrusive_ptr_add_ref(new_item);
         auto& item_ref = *new_item;
-        _cache.insert(item_ref);
+        table_of(item_ref).insert(item_ref);
         if (insertion.expiry.ever_expires() && _alive.insert(item_ref)) {
             _timer.rearm(item_ref.get_timeout());
         }
@@ -493,22 +521,60 @@ class cache {
         maybe_rehash();
     }
 
-    void maybe_rehash() {
-        if (_cache.size() >= _resize_up_threshold) {
-            auto new_size = _cache.bucket_count() * 2;
-            std::vector<cache_type::bucket_type> old_buckets;
-            try {
-                old_buckets = std::exchange(_buckets, std::vector<cache_type::bucket_type>(new_size));
-            } catch (const std::bad_alloc& e) {
-                _stats._resize_failure++;
-                return;
+    // Moves the items of up to that many old buckets to the new ones,
+    // returns whether the resize is over
+    bool migrate(size_t buckets) {
+        if (!_old) {
+            return true;
+        }
+        auto end = std::min(_migrated + buckets, _old->bucket_count());
+        for (; _migrated < end; _migrated++) {
+            while (_old->begin(_migrated) != _old->end(_migrated)) {
+                auto& item_ref = *_old->begin(_migrated);
+                _old->erase(_old->iterator_to(item_ref));
+                _cache.insert(item_ref);
             }
-            _cache.rehash(typename cache_type::bucket_traits(_buckets.data(), new_size));
-            _resize_up_threshold = _cache.bucket_count() * load_factor;
+            _stats._resize_migrated_buckets++;
+        }
+        if (_migrated < _old->bucket_count()) {
+            return false;
+        }
+        assert(_old->empty());
+        _old.reset();
+        _old_buckets = {};
+        return true;
+    }
+
+    // Doubles the buckets, moving the items to the new ones a few buckets
+    // at a time, on insertions and in the background, rather than all at
+    // once, which stalls the shard for as long as it takes to rehash all
+    // of them.
+    void maybe_rehash() {
+        if (!migrate(migration_step) || size() < _resize_up_threshold) {
+            return;
+        }
+        auto new_size = _cache.bucket_count() * 2;
+        std::vector<cache_type::bucket_type> buckets;
+        try {
+            buckets = std::vector<cache_type::bucket_type>(new_size);
+        } catch (const std::bad_alloc& e) {
+            _stats._resize_failure++;
+            return;
         }
+        _old.emplace(cache_type::bucket_traits(buckets.data(), new_size));
+        _cache.swap(*_old);
+        _old_buckets = std::exchange(_buckets, std::move(buckets));
+        _migrated = 0;
+        _resize_up_threshold = new_size * load_factor;
+        _stats._resizes++;
+        _migration = _migration.then([this] {
+            return repeat([this] {
+                return make_ready_future<stop_iteration>(stop_iteration(migrate(migration_step)));
+            });
+        });
     }
 public:
-    cache(uint64_t per_cpu_slab_size, uint64_t slab_page_size)
+    cache(uint64_t per_cpu_slab_size, uint64_t slab_page_size, unsigned slab_rebalance_period)
         : _buckets(initial_bucket_count)
         , _cache(cache_type::bucket_traits(_buckets.data(), initial_bucket_count))
     {
@@ -524,6 +590,11 @@ class cache {
         slab_holder = std::make_unique<slab_allocator<item>>(default_slab_growth_factor, per_cpu_slab_size, slab_page_size,
                 [this](item& item_ref) { erase<true, true, false>(item_ref); _stats._evicted++; });
         slab = slab_holder.get();
+        // Pages only move between the slab classes once the limit is reached
+        if (per_cpu_slab_size && slab_rebalance_period) {
+            _rebalance_timer.set_callback([] { slab->rebalance(); });
+            _rebalance_timer.arm_periodic(std::chrono::seconds(slab_rebalance_period));
+        }
 #ifdef __DEBUG__
         static bool print_slab_classes = true;
         if (print_slab_classes) {
@@ -542,6 +613,11 @@ class cache {
         _cache.erase_and_dispose(_cache.begin(), _cache.end(), [this] (item* it) {
             erase<false, true>(*it);
         });
+        if (_old) {
+            _old->erase_and_dispose(_old->begin(), _old->end(), [this] (item* it) {
+                erase<false, true>(*it);
+            });
+        }
     }
 
     void flush_at(uint32_t time) {
@@ -552,8 +628,8 @@ class cache {
     template <typename Origin = local_origin_tag>
     bool set(item_insertion_data& insertion) {
         auto i = find(insertion.key);
-        if (i != _cache.end()) {
-            add_overriding<Origin>(i, insertion);
+        if (i) {
+            add_overriding<Origin>(*i, insertion);
             _stats._set_replaces++;
             return true;
         } else {
@@ -566,7 +642,7 @@ class cache {
     template <typename Origin = local_origin_tag>
     bool add(item_insertion_data& insertion) {
         auto i = find(insertion.key);
-        if (i != _cache.end()) {
+        if (i) {
             return false;
         }
 
@@ -578,42 +654,49 @@ class cache {
     template <typename Origin = local_origin_tag>
     bool replace(item_insertion_data& insertion) {
         auto i = find(insertion.key);
-        if (i == _cache.end()) {
+        if (!i) {
             return false;
         }
 
         _stats._set_replaces++;
-        add_overriding<Origin>(i, insertion);
+        add_overriding<Origin>(*i, insertion);
         return true;
     }
 
     bool remove(const item_key& key) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._delete_misses++;
             return false;
         }
         _stats._delete_hits++;
-        auto& item_ref = *i;
-        erase(item_ref);
+        erase(*i);
         return true;
     }
 
     item_ptr get(const item_key& key) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._get_misses++;
             return nullptr;
         }
         _stats._get_hits++;
-        auto& item_ref = *i;
-        return item_ptr(&item_ref);
+        return item_ptr(i);
+    }
+
+    std::vector<item_ptr> get_many(const std::vector<item_key>& keys, const std::vector<unsigned>& indexes) {
+        std::vector<item_ptr> items;
+        items.reserve(indexes.size());
+        for (auto i : indexes) {
+            items.push_back(get(keys[i]));
+        }
+        return items;
     }
 
     template <typename Origin = local_origin_tag>
     cas_result cas(item_insertion_data& insertion, item::version_type version) {
         auto i = find(insertion.key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._cas_misses++;
             return cas_result::not_found;
         }
@@ -623,12 +706,12 @@ class cache {
             return cas_result::bad_version;
         }
         _stats._cas_hits++;
-        add_overriding<Origin>(i, insertion);
+        add_overriding<Origin>(*i, insertion);
         return cas_result::stored;
     }
 
     size_t size() {
-        return _cache.size();
+        return _cache.size() + (_old ? _old->size() : 0);
     }
 
     size_t bucket_count() {
@@ -637,13 +720,14 @@ class cache {
 
     cache_stats stats() {
         _stats._size = size();
+        _stats._resize_pending_buckets = _old ? _old->bucket_count() - _migrated : 0;
         return _stats;
     }
 
     template <typename Origin = local_origin_tag>
     std::pair<item_ptr, bool> incr(item_key& key, uint64_t delta) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._incr_misses++;
             return {item_ptr{}, false};
         }
@@ -659,14 +743,14 @@ class cache {
             .data = to_sstring(*value + delta),
             .expiry = item_ref._expiry
         };
-        i = add_overriding<local_origin_tag>(i, insertion);
-        return {boost::intrusive_ptr<item>(&*i), true};
+        auto& new_item = add_overriding<local_origin_tag>(item_ref, insertion);
+        return {boost::intrusive_ptr<item>(&new_item), true};
     }
 
     template <typename Origin = local_origin_tag>
     std::pair<item_ptr, bool> decr(item_key& key, uint64_t delta) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._decr_misses++;
             return {item_ptr{}, false};
         }
@@ -682,8 +766,8 @@ class cache {
             .data = to_sstring(*value - std::min(*value, delta)),
             .expiry = item_ref._expiry
         };
-        i = add_overriding<local_origin_tag>(i, insertion);
-        return {boost::intrusive_ptr<item>(&*i), true};
+        auto& new_item = add_overriding<local_origin_tag>(item_ref, insertion);
+        return {boost::intrusive_ptr<item>(&new_item), true};
     }
 
     std::pair<unsigned, foreign_ptr<lw_shared_ptr<std::string>>> print_hash_stats() {
@@ -707,9 +791,12 @@ class cache {
 
         std::stringstream ss;
 
-        ss << "size: " << _cache.size() << "\n";
+        ss << "size: " << size() << "\n";
         ss << "buckets: " << _cache.bucket_count() << "\n";
-        ss << "load: " << format("{:.2f}", (double)_cache.size() / _cache.bucket_count()) << "\n";
+        ss << "load: " << format("{:.2f}", (double)size() / _cache.bucket_count()) << "\n";
+        if (_old) {
+            ss << "resizing: " << _migrated << "/" << _old->bucket_count() << " old buckets migrated\n";
+        }
         ss << "max bucket occupancy: " << max_size << "\n";
         ss << "bucket occupancy histogram:\n";
 
@@ -727,7 +814,7 @@ class cache {
         return {this_shard_id(), make_foreign(make_lw_shared<std::string>(ss.str()))};
     }
 
-    future<> stop() { return make_ready_future<>(); }
+    future<> stop() { return std::exchange(_migration, make_ready_future<>()); }
     clock_type::duration get_wc_to_clock_type_delta() { return _wc_to_clock_type_delta; }
 };
 
@@ -791,6 +878,43 @@ class sharded_cache {
         return _peers.invoke_on(cpu, &cache::get, std::ref(key));
     }
 
+    // The caller must keep @keys live until the resulting future resolves.
+    // Looks the keys of each shard up in a single message to it, rather than
+    // in one per key; the items are in the order of the keys, null for the
+    // missing ones.
+    future<std::vector<item_ptr>> get(const std::vector<item_key>& keys) {
+        struct lookup {
+            std::vector<std::vector<unsigned>> by_cpu;
+            std::vector<item_ptr> items;
+        };
+        return do_with(lookup{}, [this, &keys] (lookup& l) {
+            l.by_cpu.resize(smp::count);
+            l.items.resize(keys.size());
+            for (unsigned i = 0; i < keys.size(); i++) {
+                l.by_cpu[get_cpu(keys[i])].push_back(i);
+            }
+            return parallel_for_each(std::views::iota(0u, smp::count), [this, &keys, &l] (unsigned cpu) {
+                auto& indexes = l.by_cpu[cpu];
+                if (indexes.empty()) {
+                    return make_ready_future<>();
+                }
+                if (cpu == this_shard_id()) {
+                    for (auto i : indexes) {
+                        l.items[i] = _peers.local().get(keys[i]);
+                    }
+                    return make_ready_future<>();
+                }
+                return _peers.invoke_on(cpu, &cache::get_many, std::cref(keys), std::cref(indexes)).then([&l, &indexes] (std::vector<item_ptr> items) {
+                    for (size_t j = 0; j < indexes.size(); j++) {
+                        l.items[indexes[j]] = std::move(items[j]);
+                    }
+                });
+            }).then([&l] {
+                return std::move(l.items);
+            });
+        });
+    }
+
     // The caller must keep @insertion live until the resulting future resolves.
     future<cas_result> cas(item_insertion_data& insertion, item::version_type version) {
         auto cpu = get_cpu(insertion.key);
@@ -826,7 +950,7 @@ class sharded_cache {
 
     future<> print_hash_stats(output_stream<char>& out) {
         return _peers.map_reduce([&out] (std::pair<unsigned, foreign_ptr<lw_shared_ptr<std::string>>> data) mutable {
-            return out.write("=== CPU " + std::to_string(data.first) + " ===\r\n")
+            return out.write_formatted("=== CPU {} ===\r\n", data.first)
                 .then([&out, str = std::move(data.second)] {
                     return out.write(*str);
                 });
@@ -870,7 +994,6 @@ class ascii_protocol {
     memcache_ascii_parser _parser;
     item_key _item_key;
     item_insertion_data _insertion;
-    std::vector<item_ptr> _items;
 private:
     static constexpr const char *msg_crlf = "\r\n";
     static constexpr const char *msg_error = "ERROR\r\n";
@@ -919,14 +1042,9 @@ class ascii_protocol {
                 return out.write(std::move(msg));
             });
         } else {
-            _items.clear();
-            return parallel_for_each(_parser._keys.begin(), _parser._keys.end(), [this] (const auto& key) {
-                return _cache.get(key).then([this] (auto item) {
-                    _items.emplace_back(std::move(item));
-                });
-            }).then([this, &out] () {
+            return _cache.get(_parser._keys).then([&out] (std::vector<item_ptr> items) {
                 scattered_message<char> msg;
-                for (auto& item : _items) {
+                for (auto& item : items) {
                     append_item<WithVersion>(msg, std::move(item));
                 }
                 msg.append_static(msg_end);
@@ -937,11 +1055,7 @@ class ascii_protocol {
 
     template <typename Value>
     static future<> print_stat(output_stream<char>& out, const char* key, Value value) {
-        return out.write(msg_stat)
-                .then([&out, key] { return out.write(key); })
-                .then([&out] { return out.write(" "); })
-                .then([&out, value] { return out.write(to_sstring(value)); })
-                .then([&out] { return out.write(msg_crlf); });
+        return out.write_formatted("{}{} {}{}", msg_stat, key, value, msg_crlf);
     }
 
     future<> print_stats(output_stream<char>& out) {
@@ -1016,6 +1130,12 @@ class ascii_protocol {
                             return print_stat(out, "seastar.expired", v);
                         }).then([&out, v = all_cache_stats._resize_failure] {
                             return print_stat(out, "seastar.resize_failure", v);
+                        }).then([&out, v = all_cache_stats._resizes] {
+                            return print_stat(out, "seastar.resizes", v);
+                        }).then([&out, v = all_cache_stats._resize_migrated_buckets] {
+                            return print_stat(out, "seastar.resize_migrated_buckets", v);
+                        }).then([&out, v = all_cache_stats._resize_pending_buckets] {
+                            return print_stat(out, "seastar.resize_pending_buckets", v);
                         }).then([&out, v = all_cache_stats._evicted] {
                             return print_stat(out, "evictions", v);
                         }).then([&out, v = all_cache_stats._bytes] {
@@ -1219,6 +1339,341 @@ class ascii_protocol {
     };
 };
 
+class binary_protocol {
+private:
+    using parser = memcache_binary_parser;
+    using opcode = parser::opcode;
+    using request = parser::request;
+    static constexpr size_t max_key_length = 250;
+
+    enum class status : uint16_t {
+        no_error = 0x0000,
+        key_not_found = 0x0001,
+        key_exists = 0x0002,
+        invalid_arguments = 0x0004,
+        not_stored = 0x0005,
+        non_numeric_value = 0x0006,
+        unknown_command = 0x0081,
+        out_of_memory = 0x0082,
+    };
+
+    sharded_cache& _cache;
+    distributed<system_stats>& _system_stats;
+    parser _parser;
+    std::vector<request> _requests;
+    std::vector<item_key> _keys;
+    item_key _key;
+    item_insertion_data _insertion;
+    bool _quit = false;
+private:
+    static std::string_view message(status st) {
+        switch (st) {
+            case status::no_error: return {};
+            case status::key_not_found: return "Not found";
+            case status::key_exists: return "Data exists for key";
+            case status::invalid_arguments: return "Invalid arguments";
+            case status::not_stored: return "Not stored";
+            case status::non_numeric_value: return "Non-numeric server-side value for incr or decr";
+            case status::unknown_command: return "Unknown command";
+            case status::out_of_memory: return "Out of memory";
+        }
+        std::abort();
+    }
+
+    // The command of a quiet opcode, which only responds to failures
+    static std::pair<opcode, bool> unquiet(opcode op) {
+        switch (op) {
+            case opcode::setq: return {opcode::set, true};
+            case opcode::addq: return {opcode::add, true};
+            case opcode::replaceq: return {opcode::replace, true};
+            case opcode::delq: return {opcode::del, true};
+            case opcode::incrementq: return {opcode::increment, true};
+            case opcode::decrementq: return {opcode::decrement, true};
+            case opcode::quitq: return {opcode::quit, true};
+            case opcode::flushq: return {opcode::flush, true};
+            default: return {op, false};
+        }
+    }
+
+    static bool valid_key(const request& req) {
+        return req.hdr.key_length && req.hdr.key_length <= max_key_length;
+    }
+
+    // The header, extras and key of the response to @req, the value left
+    // to the caller to append
+    static sstring response_head(const request& req, status st, std::string_view extras, std::string_view key,
+            size_t value_size, uint64_t cas) {
+        sstring head(sstring::initialized_later(), parser::header_size + extras.size() + key.size());
+        parser::header{
+            .magic = parser::magic_response,
+            .op = req.hdr.op,
+            .key_length = uint16_t(key.size()),
+            .extras_length = uint8_t(extras.size()),
+            .data_type = 0,
+            .status = uint16_t(st),
+            .body_length = uint32_t(extras.size() + key.size() + value_size),
+            .opaque = req.hdr.opaque,
+            .cas = cas,
+        }.write(head.data());
+        auto p = std::copy(extras.begin(), extras.end(), head.data() + parser::header_size);
+        std::copy(key.begin(), key.end(), p);
+        return head;
+    }
+
+    static sstring response(const request& req, status st, std::string_view key = {}, std::string_view value = {},
+            uint64_t cas = 0) {
+        if (st != status::no_error && value.empty()) {
+            value = message(st);
+        }
+        auto r = response_head(req, st, {}, key, value.size(), cas);
+        r.append(value.data(), value.size());
+        return r;
+    }
+
+    future<> respond(output_stream<char>& out, const request& req, bool quiet, status st,
+            std::string_view value = {}, uint64_t cas = 0) {
+        if (quiet && st == status::no_error) {
+            return make_ready_future<>();
+        }
+        return out.write(response(req, st, {}, value, cas));
+    }
+
+    future<> respond_number(output_stream<char>& out, const request& req, bool quiet, uint64_t n, uint64_t cas) {
+        char value[sizeof(n)];
+        write_be<uint64_t>(value, n);
+        return respond(out, req, quiet, status::no_error, std::string_view(value, sizeof(value)), cas);
+    }
+
+    // The flags the client stored the item with, which the ASCII protocol
+    // keeps as text, as it returns them
+    static uint32_t flags_of(const item& item_ref) {
+        auto prefix = item_ref.ascii_prefix();
+        uint32_t flags = 0;
+        std::from_chars(prefix.data() + 1, prefix.data() + prefix.size(), flags);
+        return flags;
+    }
+
+    static void append_get(scattered_message<char>& msg, const request& req, item_ptr item) {
+        auto op = req.hdr.op;
+        bool quiet = op == opcode::getq || op == opcode::getkq;
+        bool with_key = op == opcode::getk || op == opcode::getkq;
+        if (!item) {
+            if (!quiet) {
+                msg.append(response(req, status::key_not_found, with_key ? req.key() : std::string_view()));
+            }
+            return;
+        }
+        char flags[4];
+        write_be<uint32_t>(flags, flags_of(*item));
+        msg.append(response_head(req, status::no_error, std::string_view(flags, sizeof(flags)),
+                with_key ? item->key() : std::string_view(), item->value_size(), item->version()));
+        msg.append_static(item->value());
+        msg.on_delete([item = std::move(item)] {});
+    }
+
+    void prepare_insertion(std::string_view key, uint32_t flags, std::string_view value, uint32_t expiration) {
+        _insertion = item_insertion_data{
+            .key = item_key(sstring(key.data(), key.size())),
+            .ascii_prefix = format(" {} {}", flags, value.size()),
+            .data = sstring(value.data(), value.size()),
+            .expiry = memcache::expiration(_cache.get_wc_to_clock_type_delta(), expiration)
+        };
+    }
+
+    future<> handle_store(output_stream<char>& out, const request& req, opcode op, bool quiet) {
+        auto extras = req.extras();
+        if (extras.size() != 8 || !valid_key(req)) {
+            return respond(out, req, quiet, status::invalid_arguments);
+        }
+        _system_stats.local()._cmd_set++;
+        prepare_insertion(req.key(), read_be<uint32_t>(extras.data()), req.value(), read_be<uint32_t>(extras.data() + 4));
+        if (req.hdr.cas && op != opcode::add) {
+            return _cache.cas(_insertion, req.hdr.cas).then([this, &out, &req, quiet] (cas_result result) {
+                switch (result) {
+                    case cas_result::stored:
+                        return respond(out, req, quiet, status::no_error);
+                    case cas_result::not_found:
+                        return respond(out, req, quiet, status::key_not_found);
+                    case cas_result::bad_version:
+                        return respond(out, req, quiet, status::key_exists);
+                    default:
+                        std::abort();
+                }
+            });
+        }
+        switch (op) {
+            case opcode::set:
+                return _cache.set(_insertion).then([this, &out, &req, quiet] (bool) {
+                    return respond(out, req, quiet, status::no_error);
+                });
+            case opcode::add:
+                return _cache.add(_insertion).then([this, &out, &req, quiet] (bool added) {
+                    return respond(out, req, quiet, added ? status::no_error : status::key_exists);
+                });
+            case opcode::replace:
+                return _cache.replace(_insertion).then([this, &out, &req, quiet] (bool replaced) {
+                    return respond(out, req, quiet, replaced ? status::no_error : status::key_not_found);
+                });
+            default:
+                std::abort();
+        }
+    }
+
+    // Creates the missing counter with the initial value, unless the
+    // expiration is all ones
+    future<> handle_arithmetic(output_stream<char>& out, const request& req, opcode op, bool quiet) {
+        auto extras = req.extras();
+        if (extras.size() != 20 || !valid_key(req)) {
+            return respond(out, req, quiet, status::invalid_arguments);
+        }
+        auto delta = read_be<uint64_t>(extras.data());
+        auto initial = read_be<uint64_t>(extras.data() + 8);
+        auto expiration = read_be<uint32_t>(extras.data() + 16);
+        _key = item_key(sstring(req.key().data(), req.key().size()));
+        auto f = op == opcode::increment ? _cache.incr(_key, delta) : _cache.decr(_key, delta);
+        return std::move(f).then([this, &out, &req, quiet, initial, expiration] (std::pair<item_ptr, bool> result) {
+            auto& [item, changed] = result;
+            if (item) {
+                if (!changed) {
+                    return respond(out, req, quiet, status::non_numeric_value);
+                }
+                return respond_number(out, req, quiet, *item->data_as_integral(), item->version());
+            }
+            if (expiration == std::numeric_limits<uint32_t>::max()) {
+                return respond(out, req, quiet, status::key_not_found);
+            }
+            auto value = to_sstring(initial);
+            prepare_insertion(req.key(), 0, value, expiration);
+            return _cache.add(_insertion).then([this, &out, &req, quiet, initial] (bool added) {
+                if (!added) {
+                    return respond(out, req, quiet, status::not_stored);
+                }
+                return respond_number(out, req, quiet, initial, 0);
+            });
+        });
+    }
+
+    future<> handle_command(output_stream<char>& out, const request& req) {
+        auto [op, quiet] = unquiet(req.hdr.op);
+        switch (op) {
+            case opcode::set:
+            case opcode::add:
+            case opcode::replace:
+                return handle_store(out, req, op, quiet);
+
+            case opcode::del:
+            {
+                if (!valid_key(req) || !req.extras().empty()) {
+                    return respond(out, req, quiet, status::invalid_arguments);
+                }
+                _key = item_key(sstring(req.key().data(), req.key().size()));
+                return _cache.remove(_key).then([this, &out, &req, quiet] (bool removed) {
+                    return respond(out, req, quiet, removed ? status::no_error : status::key_not_found);
+                });
+            }
+
+            case opcode::increment:
+            case opcode::decrement:
+                return handle_arithmetic(out, req, op, quiet);
+
+            case opcode::flush:
+            {
+                auto extras = req.extras();
+                if (!extras.empty() && extras.size() != 4) {
+                    return respond(out, req, quiet, status::invalid_arguments);
+                }
+                _system_stats.local()._cmd_flush++;
+                auto expiration = extras.empty() ? 0 : read_be<uint32_t>(extras.data());
+                auto f = expiration ? _cache.flush_at(expiration) : _cache.flush_all();
+                return std::move(f).then([this, &out, &req, quiet] {
+                    return respond(out, req, quiet, status::no_error);
+                });
+            }
+
+            case opcode::quit:
+                _quit = true;
+                return respond(out, req, quiet, status::no_error);
+
+            case opcode::noop:
+                return respond(out, req, false, status::no_error);
+
+            case opcode::version:
+                return respond(out, req, false, status::no_error, VERSION_STRING);
+
+            default:
+                return respond(out, req, false, status::unknown_command);
+        }
+    }
+
+    // Looks the keys of all the gets up at once, responding in the order
+    // of the requests
+    future<> handle_requests(output_stream<char>& out) {
+        _keys.clear();
+        for (auto& req : _requests) {
+            if (parser::is_get(req.hdr.op)) {
+                _system_stats.local()._cmd_get++;
+                _keys.emplace_back(sstring(req.key().data(), req.key().size()));
+            }
+        }
+        future<std::vector<item_ptr>> f = make_ready_future<std::vector<item_ptr>>();
+        if (_keys.size() == 1) {
+            f = _cache.get(_keys[0]).then([] (item_ptr item) {
+                std::vector<item_ptr> items;
+                items.push_back(std::move(item));
+                return items;
+            });
+        } else if (!_keys.empty()) {
+            f = _cache.get(_keys);
+        }
+        return std::move(f).then([this, &out] (std::vector<item_ptr> items) {
+            scattered_message<char> msg;
+            size_t i = 0;
+            for (auto& req : _requests) {
+                if (parser::is_get(req.hdr.op)) {
+                    append_get(msg, req, std::move(items[i++]));
+                }
+            }
+            auto f = msg.size() ? out.write(std::move(msg)) : make_ready_future<>();
+            auto& last = _requests.back();
+            if (parser::is_get(last.hdr.op)) {
+                return f;
+            }
+            return std::move(f).then([this, &out, &last] {
+                return handle_command(out, last);
+            });
+        });
+    }
+public:
+    binary_protocol(sharded_cache& cache, distributed<system_stats>& system_stats)
+        : _cache(cache)
+        , _system_stats(system_stats)
+    {}
+
+    // Whether the connection is to be closed, on a quit or a malformed
+    // request
+    bool quit() const noexcept {
+        return _quit;
+    }
+
+    future<> handle(input_stream<char>& in, output_stream<char>& out) {
+        return in.consume(_parser).then([this, &out] {
+            _requests = std::exchange(_parser._requests, {});
+            _quit |= _parser._error;
+            if (_requests.empty()) {
+                return make_ready_future<>();
+            }
+            return handle_requests(out).then_wrapped([this, &out] (auto&& f) -> future<> {
+                try {
+                    f.get();
+                } catch (std::bad_alloc& e) {
+                    return out.write(response(_requests.back(), status::out_of_memory));
+                }
+                return make_ready_future<>();
+            });
+        });
+    }
+};
+
 class udp_server {
 public:
     static const size_t default_max_datagram_size = 1400;
@@ -1266,15 +1721,18 @@ class udp_server {
         {}
 
         future<> respond(udp_channel& chan) {
-            int i = 0;
-            return do_for_each(_out_bufs.begin(), _out_bufs.end(), [this, i, &chan] (packet& p) mutable {
+            std::vector<net::outgoing_datagram> datagrams;
+            datagrams.reserve(_out_bufs.size());
+            uint16_t i = 0;
+            for (auto& p : _out_bufs) {
                 header* out_hdr = p.prepend_header<header>(0);
                 out_hdr->_request_id = _request_id;
                 out_hdr->_sequence_number = i++;
                 out_hdr->_n = _out_bufs.size();
                 *out_hdr = hton(*out_hdr);
-                return chan.send(_src, std::move(p));
-            });
+                datagrams.push_back({_src, std::move(p)});
+            }
+            return chan.send_batch(std::move(datagrams));
         }
     };
 
@@ -1347,6 +1805,8 @@ class tcp_server {
         input_stream<char> _in;
         output_stream<char> _out;
         ascii_protocol _proto;
+        binary_protocol _binary_proto;
+        bool _binary = false;
         distributed<system_stats>& _system_stats;
         connection(connected_socket&& socket, socket_address addr, sharded_cache& c, distributed<system_stats>& system_stats)
             : _socket(std::move(socket))
@@ -1354,6 +1814,7 @@ class tcp_server {
             , _in(_socket.input())
             , _out(_socket.output())
             , _proto(c, system_stats)
+            , _binary_proto(c, system_stats)
             , _system_stats(system_stats)
         {
             _system_stats.local()._curr_connections++;
@@ -1362,6 +1823,25 @@ class tcp_server {
         ~connection() {
             _system_stats.local()._curr_connections--;
         }
+
+        // A connection speaks the binary protocol if its first byte is
+        // the magic of the binary requests, the ASCII one otherwise
+        future<> detect_protocol() {
+            return _in.consume([this] (temporary_buffer<char> buf) {
+                if (!buf.empty()) {
+                    _binary = uint8_t(buf[0]) == memcache_binary_parser::magic_request;
+                }
+                return make_ready_future<consumption_result<char>>(stop_consuming<char>(std::move(buf)));
+            });
+        }
+
+        bool done() const {
+            return _in.eof() || (_binary && _binary_proto.quit());
+        }
+
+        future<> handle() {
+            return _binary ? _binary_proto.handle(_in, _out) : _proto.handle(_in, _out);
+        }
     };
 public:
     tcp_server(sharded_cache& cache, distributed<system_stats>& system_stats, uint16_t port = 11211)
@@ -1380,9 +1860,11 @@ class tcp_server {
                 connected_socket fd = std::move(ar.connection);
                 socket_address addr = std::move(ar.remote_address);
                 auto conn = make_lw_shared<connection>(std::move(fd), addr, _cache, _system_stats);
-                (void)do_until([conn] { return conn->_in.eof(); }, [conn] {
-                    return conn->_proto.handle(conn->_in, conn->_out).then([conn] {
-                        return conn->_out.flush();
+                (void)conn->detect_protocol().then([conn] {
+                    return do_until([conn] { return conn->done(); }, [conn] {
+                        return conn->handle().then([conn] {
+                            return conn->_out.flush();
+                        });
                     });
                 }).finally([conn] {
                     return conn->_out.close().finally([conn]{});
@@ -1446,6 +1928,8 @@ int main(int ac, char** av) {
              "Maximum memory to be used for items (value in megabytes) (reclaimer is disabled if set)")
         ("slab-page-size", bpo::value<uint64_t>()->default_value(memcache::default_slab_page_size/MB),
              "Size of slab page (value in megabytes)")
+        ("slab-rebalance-period", bpo::value<unsigned>()->default_value(memcache::default_slab_rebalance_period),
+             "Period of the moves of slab pages to the slab classes evicting the most (value in seconds) (0 disables them), with max-slab-size")
         ("stats",
              "Print basic statistics periodically (every second)")
         ("port", bpo::value<uint16_t>()->default_value(11211),
@@ -1462,7 +1946,8 @@ int main(int ac, char** av) {
         uint16_t port = config["port"].as<uint16_t>();
         uint64_t per_cpu_slab_size = config["max-slab-size"].as<uint64_t>() * MB;
         uint64_t slab_page_size = config["slab-page-size"].as<uint64_t>() * MB;
-        return cache_peers.start(std::move(per_cpu_slab_size), std::move(slab_page_size)).then([&system_stats] {
+        unsigned slab_rebalance_period = config["slab-rebalance-period"].as<unsigned>();
+        return cache_peers.start(std::move(per_cpu_slab_size), std::move(slab_page_size), slab_rebalance_period).then([&system_stats] {
             return system_stats.start(memcache::clock_type::now());
         }).then([&] {
             std::cout << PLATFORM << " memcached " << VERSION << "\n";
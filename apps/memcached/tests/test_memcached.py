@@ -388,6 +388,19 @@ class TestCommands(MemcacheTest):
         self.delete('key')
         self.assertEqual(0, int(self.getStat('curr_items')))
 
+    def test_items_remain_while_resizing(self):
+        resizes = int(self.getStat('seastar.resizes'))
+        keys = ['key%d' % i for i in range(4000)]
+        for key in keys:
+            self.setKey(key)
+        self.assertLess(resizes, int(self.getStat('seastar.resizes')))
+        for key in keys:
+            self.assertHasKey(key)
+        self.assertEqual(len(keys), int(self.getStat('curr_items')))
+        for key in keys:
+            self.delete(key)
+        self.assertEqual(0, int(self.getStat('curr_items')))
+
     def test_how_stats_change_with_different_commands(self):
         get_count = int(self.getStat('cmd_get'))
         set_count = int(self.getStat('cmd_set'))
@@ -545,6 +558,89 @@ class TestCommands(MemcacheTest):
                 self.assertEqual(call('get key\r\n'), prev)
                 self.delete('key')
 
+class BinaryProtocolTests(unittest.TestCase):
+    GET, SET, ADD, DELETE, INCREMENT, NOOP, VERSION, GETK, GETKQ, SETQ = 0x00, 0x01, 0x02, 0x04, 0x05, 0x0a, 0x0b, 0x0c, 0x0d, 0x11
+
+    def setUp(self):
+        self.s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.s.settimeout(1)
+        self.s.connect(server_addr)
+
+    def tearDown(self):
+        self.s.close()
+        tcp_call('flush_all\r\n')
+
+    @staticmethod
+    def request(opcode, key=b'', value=b'', extras=b'', opaque=0, cas=0):
+        return struct.pack('>BBHBBHIIQ', 0x80, opcode, len(key), len(extras), 0, 0,
+                           len(extras) + len(key) + len(value), opaque, cas) + extras + key + value
+
+    def recv_exactly(self, n):
+        data = b''
+        while len(data) < n:
+            chunk = self.s.recv(n - len(data))
+            if not chunk:
+                raise Exception('Connection closed')
+            data += chunk
+        return data
+
+    def response(self):
+        magic, opcode, key_length, extras_length, _, status, body_length, opaque, cas = \
+            struct.unpack('>BBHBBHIIQ', self.recv_exactly(24))
+        self.assertEqual(0x81, magic)
+        body = self.recv_exactly(body_length)
+        return {'opcode': opcode, 'status': status, 'opaque': opaque, 'cas': cas,
+                'extras': body[:extras_length], 'key': body[extras_length:extras_length + key_length],
+                'value': body[extras_length + key_length:]}
+
+    def call(self, *requests):
+        self.s.send(b''.join(requests))
+        return self.response()
+
+    def set(self, key, value, flags=0):
+        return self.call(self.request(self.SET, key, value, struct.pack('>II', flags, 0)))
+
+    def test_set_and_get(self):
+        self.assertEqual(0, self.set(b'key', b'value', flags=7)['status'])
+        r = self.call(self.request(self.GET, b'key', opaque=3))
+        self.assertEqual((0, 3, b'value', b''), (r['status'], r['opaque'], r['value'], r['key']))
+        self.assertEqual(7, struct.unpack('>I', r['extras'])[0])
+        self.assertEqual(tcp_call('get key\r\n'), b'VALUE key 7 5\r\nvalue\r\nEND\r\n')
+        self.assertEqual(1, self.call(self.request(self.GET, b'missing'))['status'])
+
+    def test_multi_get_responds_in_order(self):
+        keys = [b'key%d' % i for i in range(20)]
+        for key in keys[::2]:
+            self.s.send(self.request(self.SETQ, key, key + b'-value', struct.pack('>II', 0, 0)))
+        self.s.send(b''.join(self.request(self.GETKQ, key, opaque=i) for i, key in enumerate(keys)))
+        self.s.send(self.request(self.NOOP, opaque=100))
+        for i, key in enumerate(keys[::2]):
+            r = self.response()
+            self.assertEqual((self.GETKQ, 2 * i, key, key + b'-value'), (r['opcode'], r['opaque'], r['key'], r['value']))
+        r = self.response()
+        self.assertEqual((self.NOOP, 100), (r['opcode'], r['opaque']))
+
+    def test_add_and_delete(self):
+        extras = struct.pack('>II', 0, 0)
+        self.assertEqual(0, self.call(self.request(self.ADD, b'key', b'a', extras))['status'])
+        self.assertEqual(2, self.call(self.request(self.ADD, b'key', b'a', extras))['status'])
+        self.assertEqual(0, self.call(self.request(self.DELETE, b'key'))['status'])
+        self.assertEqual(1, self.call(self.request(self.DELETE, b'key'))['status'])
+
+    def test_increment(self):
+        extras = struct.pack('>QQI', 2, 10, 0)
+        self.assertEqual(10, struct.unpack('>Q', self.call(self.request(self.INCREMENT, b'n', extras=extras))['value'])[0])
+        self.assertEqual(12, struct.unpack('>Q', self.call(self.request(self.INCREMENT, b'n', extras=extras))['value'])[0])
+        self.assertEqual(tcp_call('get n\r\n'), b'VALUE n 0 2\r\n12\r\nEND\r\n')
+        no_create = struct.pack('>QQI', 2, 10, 0xffffffff)
+        self.assertEqual(1, self.call(self.request(self.INCREMENT, b'm', extras=no_create))['status'])
+
+    def test_version_and_unknown_command(self):
+        r = self.call(self.request(self.VERSION))
+        self.assertEqual(0, r['status'])
+        self.assertTrue(r['value'])
+        self.assertEqual(0x81, self.call(self.request(0x42))['status'])
+
 def wait_for_memcache_tcp(timeout=4):
     s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
     timeout_at = time.time() + timeout
@@ -595,6 +691,7 @@ if __name__ == '__main__':
         suite.addTest(loader.loadTestsFromTestCase(UdpSpecificTests))
     else:
         suite.addTest(loader.loadTestsFromTestCase(TcpSpecificTests))
+        suite.addTest(loader.loadTestsFromTestCase(BinaryProtocolTests))
     result = runner.run(suite)
     if not result.wasSuccessful():
         sys.exit(1)
@@ -20,31 +20,24 @@
  */
 
 #include <vector>
+#include <bit>
 #include <chrono>
+#include <cmath>
+#include <limits>
 #include <random>
 #include <yaml-cpp/yaml.h>
 #include <fmt/core.h>
 #include <boost/range/irange.hpp>
-#pragma GCC diagnostic push
-// see https://github.com/boostorg/accumulators/pull/54
-#pragma GCC diagnostic ignored "-Wuninitialized"
-#include <boost/accumulators/accumulators.hpp>
-#include <boost/accumulators/statistics/stats.hpp>
-#include <boost/accumulators/statistics/max.hpp>
-#include <boost/accumulators/statistics/mean.hpp>
-#include <boost/accumulators/statistics/p_square_quantile.hpp>
-#include <boost/accumulators/statistics/extended_p_square.hpp>
-#include <boost/accumulators/statistics/extended_p_square_quantile.hpp>
-#pragma GCC diagnostic pop
 #include <seastar/core/app-template.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/sharded.hh>
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/rpc/rpc.hh>
 
 using namespace seastar;
-using namespace boost::accumulators;
 using namespace std::chrono_literals;
 
 struct serializer {};
@@ -155,6 +148,39 @@ class uniform_process : public pause_distribution {
     }
 };
 
+// The gaps between the arrivals of a Poisson process of \c rate per second
+class exponential_process : public pause_distribution {
+    std::random_device _rd;
+    std::mt19937 _rng;
+    std::exponential_distribution<double> _gaps;
+
+public:
+    explicit exponential_process(double rate) : _rng(_rd()), _gaps(rate) { }
+
+    std::chrono::duration<double> get() override {
+        return std::chrono::duration<double>(_gaps(_rng));
+    }
+};
+
+// Arrivals coming \c burst at a time, the bursts arriving as a Poisson process
+class bursty_process : public pause_distribution {
+    exponential_process _bursts;
+    unsigned _burst;
+    unsigned _left = 0;
+
+public:
+    bursty_process(double rate, unsigned burst) : _bursts(rate / burst), _burst(burst) { }
+
+    std::chrono::duration<double> get() override {
+        if (_left) {
+            _left--;
+            return std::chrono::duration<double>(0);
+        }
+        _left = _burst - 1;
+        return _bursts.get();
+    }
+};
+
 struct duration_range {
     std::chrono::duration<double> min;
     std::chrono::duration<double> max;
@@ -164,6 +190,11 @@ std::unique_ptr<pause_distribution> make_uniform_pause(duration_range range) {
     return std::make_unique<uniform_process>(range.min, range.max);
 }
 
+struct size_range {
+    size_t min;
+    size_t max;
+};
+
 struct client_config {
     bool nodelay = true;
 };
@@ -176,7 +207,7 @@ struct job_config {
     std::string name;
     std::string type;
     std::string verb;
-    unsigned parallelism;
+    unsigned parallelism = 1;
     unsigned shares = 100;
     std::chrono::duration<double> exec_time;
     std::optional<duration_range> exec_time_range;
@@ -184,6 +215,13 @@ struct job_config {
     std::optional<duration_range> sleep_time_range;
     std::optional<std::chrono::duration<double>> timeout;
     size_t payload;
+    std::optional<size_range> payload_range;
+    // Open loop: requests sent at that rate, whether the previous ones
+    // were replied to or not
+    std::optional<double> rate;
+    std::string arrival = "poisson";
+    unsigned burst = 1;
+    std::optional<unsigned> max_in_flight;
 
     bool client = false;
     bool server = false;
@@ -234,11 +272,33 @@ struct convert<job_config> {
     static bool decode(const Node& node, job_config& cfg) {
         cfg.name = node["name"].as<std::string>();
         cfg.type = node["type"].as<std::string>();
-        cfg.parallelism = node["parallelism"].as<unsigned>();
+        if (cfg.type != "rpc" || !node["rate"]) {
+            cfg.parallelism = node["parallelism"].as<unsigned>();
+        }
         if (cfg.type == "rpc") {
             cfg.verb = node["verb"].as<std::string>();
-            cfg.payload = node["payload"].as<byte_size>().size;
+            if (node["payload_min"] && node["payload_max"]) {
+                size_range r;
+                r.min = node["payload_min"].as<byte_size>().size;
+                r.max = node["payload_max"].as<byte_size>().size;
+                cfg.payload_range = r;
+                cfg.payload = r.max;
+            } else {
+                cfg.payload = node["payload"].as<byte_size>().size;
+            }
             cfg.client = true;
+            if (node["rate"]) {
+                cfg.rate = node["rate"].as<double>();
+            }
+            if (node["arrival"]) {
+                cfg.arrival = node["arrival"].as<std::string>();
+            }
+            if (node["burst"]) {
+                cfg.burst = node["burst"].as<unsigned>();
+            }
+            if (node["max_in_flight"]) {
+                cfg.max_in_flight = node["max_in_flight"].as<unsigned>();
+            }
             if (node["sleep_time"]) {
                 cfg.sleep_time = node["sleep_time"].as<duration_time>().time;
             }
@@ -353,7 +413,65 @@ enum class rpc_verb : int32_t {
 };
 
 using rpc_protocol = rpc::protocol<serializer, rpc_verb>;
-static std::array<double, 4> quantiles = { 0.5, 0.95, 0.99, 0.999};
+static std::array<double, 6> quantiles = { 0.5, 0.9, 0.95, 0.99, 0.999, 0.9999};
+
+// Counts the values in log-linear buckets, as HdrHistogram does: each power
+// of two is split into 2^precision buckets, for the values of a bucket to be
+// within 1% of one another over the whole range, tails included.
+class hdr_histogram {
+    static constexpr unsigned precision = 7;
+    static constexpr uint64_t sub_buckets = uint64_t(1) << precision;
+
+    std::vector<uint64_t> _buckets;
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+    uint64_t _max = 0;
+
+    static size_t index(uint64_t v) noexcept {
+        unsigned width = std::bit_width(v);
+        if (width <= precision + 1) {
+            return v;
+        }
+        unsigned shift = width - precision - 1;
+        return (shift + 1) * sub_buckets + (v >> shift) - sub_buckets;
+    }
+
+    // The highest value of a bucket
+    static uint64_t value(size_t i) noexcept {
+        if (i < 2 * sub_buckets) {
+            return i;
+        }
+        unsigned shift = i / sub_buckets - 1;
+        uint64_t mantissa = i % sub_buckets + sub_buckets;
+        return (mantissa << shift) + ((uint64_t(1) << shift) - 1);
+    }
+
+public:
+    hdr_histogram() : _buckets(index(std::numeric_limits<uint64_t>::max()) + 1) { }
+
+    void record(uint64_t v) noexcept {
+        _buckets[index(v)]++;
+        _count++;
+        _sum += v;
+        _max = std::max(_max, v);
+    }
+
+    uint64_t count() const noexcept { return _count; }
+    uint64_t max() const noexcept { return _max; }
+    uint64_t mean() const noexcept { return _count ? _sum / _count : 0; }
+
+    uint64_t quantile(double q) const noexcept {
+        auto target = std::max<uint64_t>(1, std::ceil(q * _count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _buckets.size(); i++) {
+            seen += _buckets[i];
+            if (seen >= target) {
+                return std::min(value(i), _max);
+            }
+        }
+        return _max;
+    }
+};
 
 class job {
 public:
@@ -364,8 +482,6 @@ class job {
 };
 
 class job_rpc : public job {
-    using accumulator_type = accumulator_set<double, stats<tag::extended_p_square_quantile(quadratic), tag::mean, tag::max>>;
-
     job_config _cfg;
     socket_address _caddr;
     client_config _ccfg;
@@ -374,7 +490,34 @@ class job_rpc : public job {
     std::function<future<>(unsigned)> _call;
     std::chrono::steady_clock::time_point _stop;
     uint64_t _total_messages = 0;
-    accumulator_type _latencies;
+    uint64_t _errors = 0;
+    // In nanoseconds, from the time the request was meant to be sent at
+    hdr_histogram _latencies;
+    std::mt19937 _rng;
+    std::unique_ptr<pause_distribution> _arrival;
+    semaphore _in_flight;
+    gate _pending;
+
+    std::unique_ptr<pause_distribution> make_arrival() {
+        if (!_cfg.rate) {
+            return nullptr;
+        }
+        auto rate = *_cfg.rate;
+        if (_cfg.arrival == "poisson") {
+            return std::make_unique<exponential_process>(rate);
+        }
+        if (_cfg.arrival == "bursty") {
+            return std::make_unique<bursty_process>(rate, std::max(_cfg.burst, 1u));
+        }
+        if (_cfg.arrival == "steady") {
+            return make_steady_pause(std::chrono::duration<double>(1.0 / rate));
+        }
+        throw std::runtime_error("unknown arrival");
+    }
+
+    void record(std::chrono::steady_clock::time_point start) {
+        _latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
 
     future<> call_echo(unsigned dummy) {
         auto cln = _rpc.make_client<uint64_t(uint64_t)>(rpc_verb::ECHO);
@@ -399,10 +542,19 @@ class job_rpc : public job {
             , _ccfg(ccfg)
             , _rpc(rpc)
             , _stop(std::chrono::steady_clock::now() + _cfg.duration)
-            , _latencies(extended_p_square_probabilities = quantiles)
+            , _rng(std::random_device{}())
+            , _arrival(make_arrival())
+            , _in_flight(_cfg.max_in_flight.value_or(semaphore::max_counter()))
     {
         if (_cfg.verb == "echo") {
             _call = [this] (unsigned x) { return call_echo(x); };
+        } else if (_cfg.verb == "write" && _cfg.payload_range) {
+            std::uniform_int_distribution<size_t> sizes(_cfg.payload_range->min, _cfg.payload_range->max);
+            _call = [this, sizes] (unsigned x) mutable {
+                return do_with(payload_t(sizes(_rng) / sizeof(payload_t::value_type), 0), [this, x] (const payload_t& payload) {
+                    return call_write(x, payload);
+                });
+            };
         } else if (_cfg.verb == "write") {
             payload_t payload;
             payload.resize(_cfg.payload / sizeof(payload_t::value_type), 0);
@@ -423,12 +575,58 @@ class job_rpc : public job {
 
     virtual std::string name() const override { return _cfg.name; }
 
+    // Sends the requests at the times the arrival distribution says, not
+    // waiting for the previous ones to be replied to, for the latencies of
+    // a slow server not to be hidden by fewer requests sent to it: they
+    // are measured from the time a request was meant to be sent at, the
+    // time waited for \c max_in_flight included.
+    future<> run_open_loop() {
+        return do_with(std::chrono::steady_clock::now(), [this] (auto& next) {
+            return do_until([this, &next] {
+                return next > _stop;
+            }, [this, &next] {
+                auto now = std::chrono::steady_clock::now();
+                // Catches up with the requests due while the reactor was
+                // busy, as many as they are
+                while (next <= now && next <= _stop) {
+                    send_at(next);
+                    next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(_arrival->get());
+                }
+                return seastar::sleep(std::min(next, _stop) - now);
+            });
+        }).finally([this] {
+            return _pending.close();
+        });
+    }
+
+    void send_at(std::chrono::steady_clock::time_point intended) {
+        auto x = _total_messages++;
+        // The gate, closed once all are sent, waits for the replies
+        (void)with_gate(_pending, [this, intended, x] {
+            return get_units(_in_flight, 1).then([this, intended, x] (auto units) {
+                return _call(x).then_wrapped([this, intended, units = std::move(units)] (future<> f) {
+                    if (f.failed()) {
+                        f.ignore_ready_future();
+                        _errors++;
+                    } else {
+                        record(intended);
+                    }
+                });
+            });
+        });
+    }
+
     virtual future<> run() override {
       return with_scheduling_group(_cfg.sg, [this] {
         rpc::client_options co;
         co.tcp_nodelay = _ccfg.nodelay;
         co.isolation_cookie = _cfg.sg_name;
         _client = std::make_unique<rpc_protocol::client>(_rpc, co, _caddr);
+        if (_arrival) {
+            return run_open_loop().finally([this] {
+                return _client->stop();
+            });
+        }
         return parallel_for_each(boost::irange(0u, _cfg.parallelism), [this] (auto dummy) {
           auto f = make_ready_future<>();
           if (_cfg.sleep_time) {
@@ -442,8 +640,7 @@ class job_rpc : public job {
                 _total_messages++;
                 auto now = std::chrono::steady_clock::now();
                 return _call(dummy).then([this, start = now] {
-                    std::chrono::microseconds lat = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
-                    _latencies(lat.count());
+                    record(start);
                 }).then([this] {
                     if (_cfg.sleep_time) {
                         return seastar::sleep(std::chrono::duration_cast<std::chrono::nanoseconds>(*_cfg.sleep_time));
@@ -460,14 +657,18 @@ class job_rpc : public job {
     }
 
     virtual void emit_result(YAML::Emitter& out) const override {
+        auto usec = [] (uint64_t ns) { return ns / 1000; };
         out << YAML::Key << "messages" << YAML::Value << _total_messages;
+        if (_arrival) {
+            out << YAML::Key << "errors" << YAML::Value << _errors;
+        }
         out << YAML::Key << "latencies" << YAML::Comment("usec");
         out << YAML::BeginMap;
-        out << YAML::Key << "average" << YAML::Value << (uint64_t)mean(_latencies);
+        out << YAML::Key << "average" << YAML::Value << usec(_latencies.mean());
         for (auto& q: quantiles) {
-            out << YAML::Key << fmt::format("p{}", q) << YAML::Value << (uint64_t)quantile(_latencies, quantile_probability = q);
+            out << YAML::Key << fmt::format("p{}", q) << YAML::Value << usec(_latencies.quantile(q));
         }
-        out << YAML::Key << "max" << YAML::Value << (uint64_t)max(_latencies);
+        out << YAML::Key << "max" << YAML::Value << usec(_latencies.max());
         out << YAML::EndMap;
     }
 };
@@ -21,11 +21,20 @@
 
 #include <seastar/http/response_parser.hh>
 #include <seastar/net/api.hh>
+#include <seastar/net/tls.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/app-template.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/distributed.hh>
-#include <seastar/core/semaphore.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/coroutine/parallel_for_each.hh>
+#include <boost/range/irange.hpp>
 #include <chrono>
 
 using namespace seastar;
@@ -37,25 +46,122 @@ void http_debug(const char* fmt, Args&&... args) {
 #endif
 }
 
+using clock_type = steady_clock_type;
+
+// Latencies in nanoseconds, from 1us to about a minute, within 1/64 of
+// their value
+using latency_histogram = metrics::internal::approximate_exponential_histogram<1024, uint64_t(1) << 36, 64>;
+
+struct request_config {
+    sstring host;
+    sstring method;
+    std::vector<sstring> paths;
+    std::vector<sstring> headers;
+    sstring body;
+};
+
+struct load_config {
+    unsigned duration;
+    unsigned total_conn;
+    unsigned reqs_per_conn;
+    // Requests a second of all the shards, 0 to send each request of a
+    // connection when the previous one is answered
+    double rate;
+    // Fraction of the requests sent on connections of their own
+    double new_conn_ratio;
+    bool tls;
+    sstring trust;
+    sstring server_name;
+};
+
+struct load_stats {
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t non_2xx = 0;
+    uint64_t dropped = 0;
+    latency_histogram latency;
+
+    load_stats& operator+=(const load_stats& o) {
+        requests += o.requests;
+        errors += o.errors;
+        non_2xx += o.non_2xx;
+        dropped += o.dropped;
+        latency.merge(o.latency);
+        return *this;
+    }
+};
+
+load_stats operator+(load_stats a, const load_stats& b) {
+    return a += b;
+}
+
 class http_client {
 private:
-    unsigned _duration;
+    load_config _cfg;
     unsigned _conn_per_core;
-    unsigned _reqs_per_conn;
+    socket_address _server;
+    // The requests to send in turn, keeping the connection alive and closing it
+    std::vector<sstring> _keep_alive_reqs;
+    std::vector<sstring> _close_reqs;
+    size_t _next_req = 0;
+    shared_ptr<tls::certificate_credentials> _creds;
     std::vector<connected_socket> _sockets;
-    semaphore _conn_connected{0};
-    semaphore _conn_finished{0};
     timer<> _run_timer;
     bool _timer_based;
     bool _timer_done{false};
-    uint64_t _total_reqs{0};
+    load_stats _stats;
+
+    // Open-loop: the times the requests waiting for a connection were due,
+    // their latency including the wait
+    static constexpr size_t max_pending = 1 << 20;
+    circular_buffer<clock_type::time_point> _pending;
+    condition_variable _pending_cv;
+    bool _generating = false;
+    double _new_conn_credit = 0;
+    gate _new_conns;
+
+    static std::vector<sstring> make_requests(const request_config& rc, bool close) {
+        std::vector<sstring> reqs;
+        for (auto& path : rc.paths) {
+            auto req = fmt::format("{} {} HTTP/1.1\r\nHost: {}\r\n", rc.method, path, rc.host);
+            for (auto& h : rc.headers) {
+                req += fmt::format("{}\r\n", h);
+            }
+            if (!rc.body.empty()) {
+                req += fmt::format("Content-Length: {}\r\n", rc.body.size());
+            }
+            if (close) {
+                req += "Connection: close\r\n";
+            }
+            req += "\r\n";
+            req += rc.body;
+            reqs.emplace_back(std::move(req));
+        }
+        return reqs;
+    }
+
+    const sstring& next_request(bool close) {
+        auto& reqs = close ? _close_reqs : _keep_alive_reqs;
+        return reqs[_next_req++ % reqs.size()];
+    }
+
+    void record(clock_type::time_point due, unsigned status) {
+        auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - due).count();
+        _stats.latency.add(latency);
+        _stats.requests++;
+        if (status < 200 || status >= 300) {
+            _stats.non_2xx++;
+        }
+    }
 public:
-    http_client(unsigned duration, unsigned total_conn, unsigned reqs_per_conn)
-        : _duration(duration)
-        , _conn_per_core(total_conn / smp::count)
-        , _reqs_per_conn(reqs_per_conn)
+    http_client(load_config cfg, socket_address server, request_config rc)
+        : _cfg(std::move(cfg))
+        , _conn_per_core(_cfg.total_conn / smp::count)
+        , _server(server)
+        , _keep_alive_reqs(make_requests(rc, false))
+        , _close_reqs(make_requests(rc, true))
         , _run_timer([this] { _timer_done = true; })
-        , _timer_based(reqs_per_conn == 0) {
+        , _timer_based(_cfg.reqs_per_conn == 0) {
     }
 
     class connection {
@@ -78,91 +184,164 @@ class http_client {
             return _nr_done;
         }
 
+        // Sends a request and reads its response, returning its status
+        future<unsigned> send(const sstring& req) {
+            co_await _write_buf.write(req);
+            co_await _write_buf.flush();
+            _parser.init();
+            // Read HTTP response header first
+            co_await _read_buf.consume(_parser);
+            if (_parser.eof()) {
+                throw std::runtime_error("connection closed by the server");
+            }
+            auto _rsp = _parser.get_parsed_response();
+            auto it = _rsp->_headers.find("Content-Length");
+            if (it == _rsp->_headers.end()) {
+                throw std::runtime_error("HTTP response does not contain: Content-Length");
+            }
+            auto content_len = std::stoi(it->second);
+            http_debug("Content-Length = %d\n", content_len);
+            // Read HTTP response body
+            auto buf = co_await _read_buf.read_exactly(content_len);
+            if (buf.size() < size_t(content_len)) {
+                throw std::runtime_error("connection closed by the server");
+            }
+            _nr_done++;
+            co_return unsigned(_rsp->_status);
+        }
+
+        future<> close() {
+            co_await _write_buf.close();
+            co_await _read_buf.close();
+        }
+
+        // Closed-loop: each request sent when the previous one is answered
         future<> do_req() {
-            return _write_buf.write("GET / HTTP/1.1\r\nHost: 127.0.0.1:10000\r\n\r\n").then([this] {
-                return _write_buf.flush();
-            }).then([this] {
-                _parser.init();
-                return _read_buf.consume(_parser).then([this] {
-                    // Read HTTP response header first
-                    if (_parser.eof()) {
-                        return make_ready_future<>();
-                    }
-                    auto _rsp = _parser.get_parsed_response();
-                    auto it = _rsp->_headers.find("Content-Length");
-                    if (it == _rsp->_headers.end()) {
-                        fmt::print("Error: HTTP response does not contain: Content-Length\n");
-                        return make_ready_future<>();
-                    }
-                    auto content_len = std::stoi(it->second);
-                    http_debug("Content-Length = %d\n", content_len);
-                    // Read HTTP response body
-                    return _read_buf.read_exactly(content_len).then([this] (temporary_buffer<char> buf) {
-                        _nr_done++;
-                        http_debug("%s\n", buf.get());
-                        if (_http_client->done(_nr_done)) {
-                            return make_ready_future();
-                        } else {
-                            return do_req();
-                        }
-                    });
+            while (!_http_client->done(_nr_done)) {
+                auto start = clock_type::now();
+                auto status = co_await send(_http_client->next_request(false));
+                _http_client->record(start, status);
+            }
+        }
+
+        // Open-loop: the requests due, as long as there are some
+        future<> serve_pending() {
+            while (true) {
+                co_await _http_client->_pending_cv.wait([this] {
+                    return !_http_client->_pending.empty() || !_http_client->_generating;
                 });
-            });
+                if (_http_client->_pending.empty()) {
+                    co_return;
+                }
+                auto due = _http_client->_pending.front();
+                _http_client->_pending.pop_front();
+                auto status = co_await send(_http_client->next_request(false));
+                _http_client->record(due, status);
+            }
         }
     };
 
-    future<uint64_t> total_reqs() {
-        fmt::print("Requests on cpu {:2d}: {:d}\n", this_shard_id(), _total_reqs);
-        return make_ready_future<uint64_t>(_total_reqs);
+    future<load_stats> stats() {
+        fmt::print("Requests on cpu {:2d}: {:d}\n", this_shard_id(), _stats.requests);
+        return make_ready_future<load_stats>(_stats);
     }
 
     bool done(uint64_t nr_done) {
         if (_timer_based) {
             return _timer_done;
         } else {
-            return nr_done >= _reqs_per_conn;
+            return nr_done >= _cfg.reqs_per_conn;
+        }
+    }
+
+    future<connected_socket> connect_one() {
+        if (_creds) {
+            return tls::connect(_creds, _server, tls::tls_options{.server_name = _cfg.server_name});
         }
+        return seastar::connect(_server);
     }
 
-    future<> connect(ipv4_addr server_addr) {
+    future<> connect() {
+        if (_cfg.tls) {
+            _creds = make_shared<tls::certificate_credentials>();
+            if (_cfg.trust.empty()) {
+                co_await _creds->set_system_trust();
+            } else {
+                co_await _creds->set_x509_trust_file(_cfg.trust, tls::x509_crt_format::PEM);
+            }
+        }
         // Establish all the TCP connections first
-        for (unsigned i = 0; i < _conn_per_core; i++) {
-            // Connect in the background, signal _conn_connected when done.
-            (void)seastar::connect(make_ipv4_address(server_addr)).then([this] (connected_socket fd) {
-                _sockets.push_back(std::move(fd));
-                http_debug("Established connection %6d on cpu %3d\n", _conn_connected.current(), this_shard_id());
-                _conn_connected.signal();
-            }).or_terminate();
+        co_await coroutine::parallel_for_each(boost::irange(0u, _conn_per_core), [this] (unsigned) -> future<> {
+            _sockets.push_back(co_await connect_one());
+            http_debug("Established connection %6d on cpu %3d\n", _sockets.size(), this_shard_id());
+        });
+    }
+
+    // Sends a request on a connection of its own, closed along with it
+    future<> new_conn_req(clock_type::time_point due) {
+        try {
+            auto conn = std::make_unique<connection>(co_await connect_one(), this);
+            auto status = co_await conn->send(next_request(true));
+            record(due, status);
+            co_await conn->close();
+        } catch (...) {
+            _stats.errors++;
+        }
+    }
+
+    // Issues the requests at the configured rate, the time each one was
+    // due counting towards its latency, however late it is sent
+    future<> generate() {
+        auto interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(smp::count / _cfg.rate));
+        auto next = clock_type::now();
+        auto end = next + std::chrono::seconds(_cfg.duration);
+        while (next < end) {
+            auto now = clock_type::now();
+            if (next > now) {
+                co_await seastar::sleep(next - now);
+                now = clock_type::now();
+            }
+            for (; next <= now && next < end; next += interval) {
+                _new_conn_credit += _cfg.new_conn_ratio;
+                if (_new_conn_credit >= 1) {
+                    _new_conn_credit -= 1;
+                    (void)with_gate(_new_conns, [this, next] { return new_conn_req(next); });
+                } else if (_pending.size() < max_pending) {
+                    _pending.push_back(next);
+                    _pending_cv.signal();
+                } else {
+                    _stats.dropped++;
+                }
+            }
         }
-        return _conn_connected.wait(_conn_per_core);
+        _generating = false;
+        _pending_cv.broadcast();
     }
 
     future<> run() {
         // All connected, start HTTP request
         http_debug("Established all %6d tcp connections on cpu %3d\n", _conn_per_core, this_shard_id());
         if (_timer_based) {
-            _run_timer.arm(std::chrono::seconds(_duration));
-        }
-        for (auto&& fd : _sockets) {
-            auto conn = new connection(std::move(fd), this);
-            // Run in the background, signal _conn_finished when done.
-            (void)conn->do_req().then_wrapped([this, conn] (auto&& f) {
-                http_debug("Finished connection %6d on cpu %3d\n", _conn_finished.current(), this_shard_id());
-                _total_reqs += conn->nr_done();
-                _conn_finished.signal();
-                delete conn;
-                // FIXME: should _conn_finished.signal be called only after this?
-                // nothing seems to synchronize with this background work.
-                try {
-                    f.get();
-                } catch (std::exception& ex) {
-                    fmt::print("http request error: {}\n", ex.what());
-                }
-            });
+            _run_timer.arm(std::chrono::seconds(_cfg.duration));
         }
-
-        // All finished
-        return _conn_finished.wait(_conn_per_core);
+        _generating = _cfg.rate > 0;
+        auto generating = _generating ? generate() : make_ready_future<>();
+        co_await coroutine::parallel_for_each(_sockets, [this] (connected_socket& fd) -> future<> {
+            auto conn = std::make_unique<connection>(std::move(fd), this);
+            try {
+                co_await (_cfg.rate > 0 ? conn->serve_pending() : conn->do_req());
+                co_await conn->close();
+            } catch (std::exception& ex) {
+                _stats.errors++;
+                fmt::print("http request error: {}\n", ex.what());
+            }
+            http_debug("Finished connection on cpu %3d\n", this_shard_id());
+        });
+        co_await std::move(generating);
+        co_await _new_conns.close();
+        // Left behind by the connections that failed
+        _stats.dropped += _pending.size();
+        _pending.clear();
     }
     future<> stop() {
         return make_ready_future();
@@ -180,52 +359,104 @@ int main(int ac, char** av) {
         ("server,s", bpo::value<std::string>()->default_value("192.168.66.100:10000"), "Server address")
         ("conn,c", bpo::value<unsigned>()->default_value(100), "total connections")
         ("reqs,r", bpo::value<unsigned>()->default_value(0), "reqs per connection")
-        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)");
+        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)")
+        ("rate", bpo::value<double>()->default_value(0),
+            "requests per second of all the cpus, sent however long the previous ones take to be answered "
+            "and whose latency counts the time they waited for a connection (0 to send a request when the previous one is answered)")
+        ("new-conn-ratio", bpo::value<double>()->default_value(0),
+            "with --rate, the fraction of the requests sent on a connection of their own, opened for them and closed after")
+        ("method", bpo::value<std::string>()->default_value("GET"), "request method")
+        ("path", bpo::value<std::vector<std::string>>()->multitoken()->default_value({"/"}, "/"),
+            "request paths, requested in turn")
+        ("header", bpo::value<std::vector<std::string>>()->multitoken(), "additional \"name: value\" request headers")
+        ("body", bpo::value<std::string>()->default_value(""), "request body")
+        ("tls", "connect with TLS")
+        ("trust", bpo::value<std::string>()->default_value(""), "PEM file of the CAs to trust, instead of the system ones")
+        ("server-name", bpo::value<std::string>()->default_value(""), "name to verify the server certificate against");
 
     return app.run(ac, av, [&app] () -> future<int> {
-        auto& config = app.configuration();
-        auto server = config["server"].as<std::string>();
-        auto reqs_per_conn = config["reqs"].as<unsigned>();
-        auto total_conn= config["conn"].as<unsigned>();
-        auto duration = config["duration"].as<unsigned>();
-
-        if (total_conn % smp::count != 0) {
-            fmt::print("Error: conn needs to be n * cpu_nr\n");
-            return make_ready_future<int>(-1);
-        }
+        return async([&app] {
+            auto& config = app.configuration();
+            auto server = config["server"].as<std::string>();
+            load_config cfg {
+                .duration = config["duration"].as<unsigned>(),
+                .total_conn = config["conn"].as<unsigned>(),
+                .reqs_per_conn = config["reqs"].as<unsigned>(),
+                .rate = config["rate"].as<double>(),
+                .new_conn_ratio = config["new-conn-ratio"].as<double>(),
+                .tls = bool(config.count("tls")),
+                .trust = config["trust"].as<std::string>(),
+                .server_name = config["server-name"].as<std::string>(),
+            };
+            request_config rc {
+                .host = server,
+                .method = config["method"].as<std::string>(),
+            };
+            for (auto& p : config["path"].as<std::vector<std::string>>()) {
+                rc.paths.emplace_back(p);
+            }
+            if (config.count("header")) {
+                for (auto& h : config["header"].as<std::vector<std::string>>()) {
+                    rc.headers.emplace_back(h);
+                }
+            }
+            rc.body = config["body"].as<std::string>();
+
+            if (cfg.total_conn % smp::count != 0) {
+                fmt::print("Error: conn needs to be n * cpu_nr\n");
+                return -1;
+            }
+            if (cfg.rate > 0 && cfg.reqs_per_conn) {
+                fmt::print("Error: --rate sends requests for --duration, not --reqs per connection\n");
+                return -1;
+            }
+            if (cfg.new_conn_ratio < 0 || cfg.new_conn_ratio > 1 || (cfg.new_conn_ratio && cfg.rate <= 0)) {
+                fmt::print("Error: --new-conn-ratio needs to be within [0, 1], with --rate\n");
+                return -1;
+            }
+            if (cfg.rate > 0 && cfg.new_conn_ratio < 1 && cfg.total_conn == 0) {
+                fmt::print("Error: --rate needs connections to keep alive, or --new-conn-ratio 1\n");
+                return -1;
+            }
 
-        auto http_clients = new distributed<http_client>;
-
-        // Start http requests on all the cores
-        auto started = steady_clock_type::now();
-        fmt::print("========== http_client ============\n");
-        fmt::print("Server: {}\n", server);
-        fmt::print("Connections: {:d}\n", total_conn);
-        fmt::print("Requests/connection: {}\n", reqs_per_conn == 0 ? "dynamic (timer based)" : std::to_string(reqs_per_conn));
-        return http_clients->start(std::move(duration), std::move(total_conn), std::move(reqs_per_conn)).then([http_clients, server] {
-            return http_clients->invoke_on_all(&http_client::connect, ipv4_addr{server});
-        }).then([http_clients] {
-            return http_clients->invoke_on_all(&http_client::run);
-        }).then([http_clients] {
-            return http_clients->map_reduce(adder<uint64_t>(), &http_client::total_reqs);
-        }).then([http_clients, started] (auto total_reqs) {
-           // All the http requests are finished
-           auto finished = steady_clock_type::now();
-           auto elapsed = finished - started;
-           auto secs = static_cast<double>(elapsed.count() / 1000000000.0);
-           fmt::print("Total cpus: {:d}\n", smp::count);
-           fmt::print("Total requests: {:d}\n", total_reqs);
-           fmt::print("Total time: {:f}\n", secs);
-           fmt::print("Requests/sec: {:f}\n", static_cast<double>(total_reqs) / secs);
-           fmt::print("==========     done     ============\n");
-           return http_clients->stop().then([http_clients] {
-               // FIXME: If we call engine().exit(0) here to exit when
-               // requests are done. The tcp connection will not be closed
-               // properly, becasue we exit too earily and the FIN packets are
-               // not exchanged.
-                delete http_clients;
-                return make_ready_future<int>(0);
-           });
+            distributed<http_client> http_clients;
+
+            // Start http requests on all the cores
+            fmt::print("========== http_client ============\n");
+            fmt::print("Server: {}{}\n", server, cfg.tls ? " (TLS)" : "");
+            fmt::print("Connections: {:d}\n", cfg.total_conn);
+            if (cfg.rate > 0) {
+                fmt::print("Rate: {:.0f} requests/sec, {:.0f}% on new connections\n", cfg.rate, cfg.new_conn_ratio * 100);
+            } else {
+                fmt::print("Requests/connection: {}\n", cfg.reqs_per_conn == 0 ? "dynamic (timer based)" : std::to_string(cfg.reqs_per_conn));
+            }
+            http_clients.start(cfg, socket_address(ipv4_addr{server}), rc).get();
+            auto started = steady_clock_type::now();
+            http_clients.invoke_on_all(&http_client::connect).get();
+            http_clients.invoke_on_all(&http_client::run).get();
+            auto stats = http_clients.map_reduce0(std::mem_fn(&http_client::stats), load_stats{}, std::plus<>()).get();
+
+            // All the http requests are finished
+            auto finished = steady_clock_type::now();
+            auto elapsed = finished - started;
+            auto secs = static_cast<double>(elapsed.count() / 1000000000.0);
+            fmt::print("Total cpus: {:d}\n", smp::count);
+            fmt::print("Total requests: {:d}\n", stats.requests);
+            fmt::print("Total time: {:f}\n", secs);
+            fmt::print("Requests/sec: {:f}\n", static_cast<double>(stats.requests) / secs);
+            if (stats.errors || stats.non_2xx || stats.dropped) {
+                fmt::print("Errors: {:d}, non-2xx responses: {:d}, requests not sent: {:d}\n", stats.errors, stats.non_2xx, stats.dropped);
+            }
+            if (stats.requests) {
+                fmt::print("Latency (us):");
+                for (auto [name, q] : {std::pair{"p50", 0.5f}, {"p90", 0.9f}, {"p99", 0.99f}, {"p99.9", 0.999f}, {"p99.99", 0.9999f}}) {
+                    fmt::print(" {}={:.1f}", name, stats.latency.quantile(q) / 1000.0);
+                }
+                fmt::print(" max={:.1f}\n", stats.latency.max() / 1000.0);
+            }
+            fmt::print("==========     done     ============\n");
+            http_clients.stop().get();
+            return 0;
         });
     });
 }
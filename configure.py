@@ -115,6 +115,11 @@ add_tristate(
     name='task-backtrace',
     dest='task_backtrace',
     help='Collect backtrace at deferring points')
+add_tristate(
+    arg_parser,
+    name='lowres-timer-wheel',
+    dest='lowres_timer_wheel',
+    help='Keep lowres_clock timers in a hierarchical timing wheel')
 add_tristate(
     arg_parser,
     name='unused-result-error',
@@ -130,6 +135,16 @@ add_tristate(
     name='io_uring',
     dest='io_uring',
     help='Support io_uring via liburing')
+add_tristate(
+    arg_parser,
+    name='zstd',
+    dest='zstd',
+    help='Support the zstd RPC compressor via libzstd')
+add_tristate(
+    arg_parser,
+    name='zlib',
+    dest='zlib',
+    help='Support gzip and deflate HTTP compression via zlib')
 arg_parser.add_argument('--allocator-page-size', dest='alloc_page_size', type=int, help='override allocator page size')
 arg_parser.add_argument('--without-tests', dest='exclude_tests', action='store_true', help='Do not build tests by default')
 arg_parser.add_argument('--without-apps', dest='exclude_apps', action='store_true', help='Do not build applications by default')
@@ -201,8 +216,11 @@ def configure_mode(mode):
         tr(args.dpdk_machine, 'DPDK_MACHINE'),
         tr(args.hwloc, 'HWLOC', value_when_none='yes'),
         tr(args.io_uring, 'IO_URING', value_when_none=None),
+        tr(args.zstd, 'ZSTD', value_when_none=None),
+        tr(args.zlib, 'ZLIB', value_when_none=None),
         tr(args.alloc_failure_injection, 'ALLOC_FAILURE_INJECTION', value_when_none='DEFAULT'),
         tr(args.task_backtrace, 'TASK_BACKTRACE'),
+        tr(args.lowres_timer_wheel, 'LOWRES_TIMER_WHEEL'),
         tr(args.alloc_page_size, 'ALLOC_PAGE_SIZE'),
         tr(args.split_dwarf, 'SPLIT_DWARF'),
         tr(args.heap_profiling, 'HEAP_PROFILING'),
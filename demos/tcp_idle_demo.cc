@@ -0,0 +1,188 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+// Opens many connections between two native TCP stacks, linked back to
+// back on the same shard, leaves them idle, and reports the memory each
+// connection holds, e.g.
+//
+//     tcp_idle_demo --smp 1 --memory 8G --connections 1000000
+
+#include <seastar/core/app-template.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/net/tcp.hh>
+#include <seastar/net/native-stack.hh>
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace seastar;
+using namespace net;
+using namespace std::chrono_literals;
+namespace bpo = boost::program_options;
+
+namespace {
+
+class wire_device;
+
+// Sends copies of the frames to the peer of its device, which receives
+// them from its queue's poller, as it would from a NIC
+class wire_qp : public qp {
+    wire_device& _dev;
+    std::unique_ptr<internal::poller> _rx_poller;
+public:
+    explicit wire_qp(wire_device& dev) : _dev(dev) {}
+    virtual future<> send(packet p) override;
+    virtual void rx_start() override;
+};
+
+class wire_device : public device {
+    ethernet_address _hw_address;
+    wire_device* _peer = nullptr;
+    circular_buffer<packet> _rx;
+    friend class wire_qp;
+public:
+    explicit wire_device(ethernet_address hw_address) : _hw_address(hw_address) {}
+    void link(wire_device& peer) {
+        _peer = &peer;
+        peer._peer = this;
+    }
+    virtual ethernet_address hw_address() override { return _hw_address; }
+    virtual net::hw_features hw_features() override { return {}; }
+    virtual std::unique_ptr<qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override {
+        return std::make_unique<wire_qp>(*this);
+    }
+};
+
+future<> wire_qp::send(packet p) {
+    temporary_buffer<char> frame(p.len());
+    auto out = frame.get_write();
+    for (auto& f : p.fragments()) {
+        out = std::copy_n(f.base, f.size, out);
+    }
+    _dev._peer->_rx.push_back(packet(std::move(frame)));
+    return make_ready_future<>();
+}
+
+void wire_qp::rx_start() {
+    _rx_poller = std::make_unique<internal::poller>(reactor::poller::simple([this] {
+        if (_dev._rx.empty()) {
+            return false;
+        }
+        auto rx = std::exchange(_dev._rx, {});
+        for (auto& p : rx) {
+            _dev.l2receive(std::move(p));
+        }
+        return true;
+    }));
+}
+
+// A native stack on one end of the link
+struct host {
+    interface netif;
+    ipv4 inet;
+
+    host(std::shared_ptr<wire_device> dev, ipv4_address address)
+            : netif(std::move(dev)), inet(&netif) {
+        inet.set_host_address(address);
+        inet.set_netmask_address(ipv4_address("255.255.255.0"));
+    }
+};
+
+std::shared_ptr<wire_device> make_device(const native_stack_options& opts, uint8_t id) {
+    auto dev = std::make_shared<wire_device>(ethernet_address{0x02, 0, 0, 0, 0, id});
+    dev->set_local_queue(dev->init_local_queue(opts, 0));
+    return dev;
+}
+
+}
+
+int main(int ac, char** av) {
+    app_template app;
+    app.add_options()
+        ("connections", bpo::value<unsigned>()->default_value(100000), "number of connections to open")
+        ("ports", bpo::value<unsigned>()->default_value(100), "number of server ports to spread them over, "
+                "each taking up to about 20000 connections")
+        ("batch", bpo::value<unsigned>()->default_value(100), "number of connections opened at once")
+        ;
+    return app.run(ac, av, [&app] {
+        return seastar::async([&app] {
+            using tcp = net::tcp<ipv4_traits>;
+            auto& config = app.configuration();
+            auto nr_connections = config["connections"].as<unsigned>();
+            auto nr_ports = config["ports"].as<unsigned>();
+            auto batch = config["batch"].as<unsigned>();
+            constexpr uint16_t base_port = 10000;
+
+            native_stack_options opts;
+            auto client_dev = make_device(opts, 1);
+            auto server_dev = make_device(opts, 2);
+            client_dev->link(*server_dev);
+            // Like the native stack, these live as long as the reactor
+            auto client = new host(client_dev, ipv4_address("10.0.0.1"));
+            auto server = new host(server_dev, ipv4_address("10.0.0.2"));
+
+            std::vector<tcp::listener> listeners;
+            listeners.reserve(nr_ports);
+            for (unsigned i = 0; i < nr_ports; ++i) {
+                listeners.push_back(server->inet.get_tcp().listen(base_port + i, batch));
+            }
+            std::vector<tcp::connection> clients;
+            std::vector<tcp::connection> servers;
+            clients.reserve(nr_connections);
+            servers.reserve(nr_connections);
+            auto server_address = ipv4_address("10.0.0.2").ip;
+
+            auto before = memory::stats().allocated_memory();
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned done = 0; done < nr_connections; ) {
+                auto n = std::min(batch, nr_connections - done);
+                std::vector<future<>> connected;
+                for (unsigned i = 0; i < n; ++i) {
+                    uint16_t port = base_port + (done + i) % nr_ports;
+                    clients.push_back(client->inet.get_tcp().connect(make_ipv4_address(server_address, port)));
+                    connected.push_back(clients.back().connected());
+                }
+                when_all_succeed(connected.begin(), connected.end()).get();
+                for (unsigned i = 0; i < n; ++i) {
+                    servers.push_back(listeners[(done + i) % nr_ports].accept().get());
+                }
+                done += n;
+            }
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+            // Let the last ACKs go, and the queues of the idle connections
+            // be compacted
+            sleep(3s).get();
+            auto after = memory::stats().allocated_memory();
+            auto per_end = double(after - before) / (2 * nr_connections);
+            fmt::print("{} connections opened in {:.3f}s ({:.0f}/s)\n", nr_connections, elapsed.count(), nr_connections / elapsed.count());
+            fmt::print("memory per idle connection end: {:.0f} bytes, {:.2f} GiB for 1M connections (both ends)\n",
+                    per_end, per_end * 2 * 1000000 / (1 << 30));
+        });
+    });
+}
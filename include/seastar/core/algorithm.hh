@@ -0,0 +1,405 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/util/destroy_gently.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#endif
+
+/// \file
+///
+/// Preemptible versions of a few standard algorithms. They process their
+/// input in chunks, yielding to the reactor between chunks when it needs to
+/// run other tasks, so that large inputs don't cause stalls. Inputs that
+/// are long enough can also be split across shards.
+///
+/// The caller must keep the input and output ranges alive, and not touch
+/// them, until the returned future resolves.
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Options for the preemptible algorithms in this file.
+struct algorithm_options {
+    /// Split the input across shards, giving each at least this many
+    /// elements. Zero, the default, keeps all the work on the calling shard.
+    ///
+    /// The pieces are processed on other shards in place, so the elements,
+    /// comparators and functions must be safe to use from other shards:
+    /// comparators and functions are copied to each shard, and elements
+    /// are moved (by \ref sort()) or read there.
+    size_t min_elements_per_shard = 0;
+    /// Options for the calls to smp::submit_to() that start the pieces.
+    smp_submit_to_options submit_options;
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+namespace internal {
+
+// The elements processed between checks for preemption.
+inline constexpr size_t algorithm_chunk = 1024;
+
+inline unsigned algorithm_pieces(size_t n, const algorithm_options& opts) noexcept {
+    if (opts.min_elements_per_shard == 0 || smp::count == 1) {
+        return 1;
+    }
+    return std::max<size_t>(1, std::min<size_t>(smp::count, n / opts.min_elements_per_shard));
+}
+
+// Splits [0, n) into up to `pieces` non-empty contiguous parts and runs
+// func(begin, end) on each, starting `shard_offset` shards after this one.
+// Waits for all of them, even if some fail, since they use the caller's
+// memory. For non-void results, returns them in order.
+template <typename Func>
+auto on_pieces(size_t n, unsigned pieces, const algorithm_options& opts, Func func, unsigned shard_offset = 0) {
+    using fut = futurize_t<std::invoke_result_t<Func&, size_t, size_t>>;
+    using result = typename fut::value_type;
+    size_t piece = std::max<size_t>(1, (n + pieces - 1) / pieces);
+    pieces = (n + piece - 1) / piece;
+    std::vector<fut> fs;
+    fs.reserve(pieces);
+    for (unsigned k = 0; k < pieces; ++k) {
+        size_t b = k * piece;
+        size_t e = std::min(n, b + piece);
+        auto shard = (this_shard_id() + shard_offset + k) % smp::count;
+        if (shard == this_shard_id()) {
+            fs.push_back(futurize_invoke(func, b, e));
+        } else {
+            fs.push_back(smp::submit_to(shard, opts.submit_options, [func, b, e] () mutable {
+                return func(b, e);
+            }));
+        }
+    }
+    return when_all(fs.begin(), fs.end()).then([] (std::vector<fut> fs) {
+        std::exception_ptr ex;
+        if constexpr (std::is_same_v<fut, future<>>) {
+            for (auto& f : fs) {
+                if (f.failed()) {
+                    auto e = f.get_exception();
+                    if (!ex) {
+                        ex = std::move(e);
+                    }
+                }
+            }
+            if (ex) {
+                return seastar::make_exception_future<>(std::move(ex));
+            }
+            return make_ready_future<>();
+        } else {
+            std::vector<result> rs;
+            rs.reserve(fs.size());
+            for (auto& f : fs) {
+                if (f.failed()) {
+                    auto e = f.get_exception();
+                    if (!ex) {
+                        ex = std::move(e);
+                    }
+                } else {
+                    rs.push_back(f.get());
+                }
+            }
+            if (ex) {
+                return seastar::make_exception_future<std::vector<result>>(std::move(ex));
+            }
+            return make_ready_future<std::vector<result>>(std::move(rs));
+        }
+    });
+}
+
+template <typename In, typename Out>
+future<Out> copy_chunked(In first, In last, Out out) {
+    while (first != last) {
+        for (size_t n = algorithm_chunk; n && first != last; --n) {
+            *out = *first;
+            ++first;
+            ++out;
+        }
+        co_await coroutine::maybe_yield();
+    }
+    co_return out;
+}
+
+template <typename In1, typename In2, typename Out, typename Compare>
+future<Out> merge_chunked(In1 first1, In1 last1, In2 first2, In2 last2, Out out, Compare cmp) {
+    while (first1 != last1 && first2 != last2) {
+        for (size_t n = algorithm_chunk; n && first1 != last1 && first2 != last2; --n) {
+            if (cmp(*first2, *first1)) {
+                *out = *first2;
+                ++first2;
+            } else {
+                *out = *first1;
+                ++first1;
+            }
+            ++out;
+        }
+        co_await coroutine::maybe_yield();
+    }
+    out = co_await copy_chunked(std::move(first1), std::move(last1), std::move(out));
+    co_return co_await copy_chunked(std::move(first2), std::move(last2), std::move(out));
+}
+
+// Finds how many of the first `d` elements of the merge of [a, a + na) and
+// [b, b + nb) come from the first range, so that a merge can be split into
+// independent parts (the "merge path").
+template <typename In1, typename In2, typename Compare>
+size_t merge_split(In1 a, size_t na, In2 b, size_t nb, size_t d, Compare& cmp) {
+    size_t lo = d > nb ? d - nb : 0;
+    size_t hi = std::min(d, na);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cmp(b[d - mid - 1], a[mid])) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+template <typename In1, typename In2, typename Out, typename Compare>
+future<> parallel_merge(In1 a, size_t na, In2 b, size_t nb, Out out, Compare cmp, unsigned pieces, const algorithm_options& opts,
+        unsigned shard_offset = 0) {
+    return on_pieces(na + nb, pieces, opts, [=] (size_t db, size_t de) mutable {
+        auto ab = merge_split(a, na, b, nb, db, cmp);
+        auto ae = merge_split(a, na, b, nb, de, cmp);
+        return merge_chunked(a + ab, a + ae, b + (db - ab), b + (de - ae), out + db, cmp).discard_result();
+    }, shard_offset);
+}
+
+// Merges the consecutive pairs of sorted runs of length `run` of [src, src + n)
+// into dst, moving the elements.
+template <typename Src, typename Dst, typename Compare>
+future<> merge_runs(Src src, size_t n, size_t run, Dst dst, Compare cmp, unsigned pieces, const algorithm_options& opts) {
+    auto from = std::make_move_iterator(src);
+    if (pieces == 1) {
+        for (size_t b = 0; b < n; b += 2 * run) {
+            size_t m = std::min(n, b + run);
+            size_t e = std::min(n, m + run);
+            co_await merge_chunked(from + b, from + m, from + m, from + e, dst + b, cmp);
+        }
+        co_return;
+    }
+    // Merge the pairs concurrently, each split across its share of the
+    // shards, so that every pass (including the last) uses them all.
+    size_t pairs = (n + 2 * run - 1) / (2 * run);
+    auto share = std::max<unsigned>(1, pieces / pairs);
+    std::vector<future<>> fs;
+    fs.reserve(pairs);
+    for (size_t p = 0; p < pairs; ++p) {
+        size_t b = p * 2 * run;
+        size_t m = std::min(n, b + run);
+        size_t e = std::min(n, m + run);
+        fs.push_back(parallel_merge(from + b, m - b, from + m, e - m, dst + b, cmp, share, opts, p * share));
+    }
+    std::exception_ptr ex;
+    for (auto& f : co_await when_all(fs.begin(), fs.end())) {
+        if (f.failed()) {
+            auto e = f.get_exception();
+            if (!ex) {
+                ex = std::move(e);
+            }
+        }
+    }
+    if (ex) {
+        std::rethrow_exception(std::move(ex));
+    }
+}
+
+template <typename In, typename Out, typename Func>
+future<Out> transform_chunked(In first, In last, Out out, Func func) {
+    while (first != last) {
+        for (size_t n = algorithm_chunk; n && first != last; --n) {
+            *out = func(*first);
+            ++first;
+            ++out;
+        }
+        co_await coroutine::maybe_yield();
+    }
+    co_return out;
+}
+
+template <typename In, typename T, typename BinaryOp>
+future<T> accumulate_chunked(In first, In last, T init, BinaryOp op) {
+    while (first != last) {
+        for (size_t n = algorithm_chunk; n && first != last; --n) {
+            init = op(std::move(init), *first);
+            ++first;
+        }
+        co_await coroutine::maybe_yield();
+    }
+    co_return init;
+}
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup future-util
+/// @{
+
+/// \brief Sorts a range without stalling the reactor.
+///
+/// Sorts runs of the range with std::sort() and merges them, moving the
+/// elements through a temporary buffer as large as the range. Like
+/// std::sort(), it is not stable.
+///
+/// With \ref algorithm_options::min_elements_per_shard set, sorts parts of
+/// the range on other shards, and splits each merge across them.
+///
+/// \return a future that resolves once the range is sorted. If it fails
+///         (e.g. the buffer can't be allocated, or a comparison throws),
+///         the contents of the range are unspecified.
+template <std::random_access_iterator It, typename Compare = std::less<>>
+future<> sort(It first, It last, Compare cmp = {}, algorithm_options opts = {}) {
+    using value_type = std::iter_value_t<It>;
+    size_t n = last - first;
+    auto pieces = internal::algorithm_pieces(n, opts);
+    size_t run;
+    if (pieces > 1) {
+        run = (n + pieces - 1) / pieces;
+        co_await internal::on_pieces(n, pieces, opts, [first, cmp] (size_t b, size_t e) {
+            return seastar::sort(first + b, first + e, cmp);
+        });
+    } else {
+        run = internal::algorithm_chunk;
+        for (size_t b = 0; b < n; b += run) {
+            std::sort(first + b, first + std::min(n, b + run), cmp);
+            co_await coroutine::maybe_yield();
+        }
+    }
+    if (run >= n) {
+        co_return;
+    }
+    std::vector<value_type> buf;
+    buf.reserve(n);
+    co_await internal::copy_chunked(std::make_move_iterator(first), std::make_move_iterator(last), std::back_inserter(buf));
+    bool in_buf = true;
+    for (; run < n; run *= 2) {
+        if (in_buf) {
+            co_await internal::merge_runs(buf.begin(), n, run, first, cmp, pieces, opts);
+        } else {
+            co_await internal::merge_runs(first, n, run, buf.begin(), cmp, pieces, opts);
+        }
+        in_buf = !in_buf;
+    }
+    if (in_buf) {
+        co_await internal::copy_chunked(std::make_move_iterator(buf.begin()), std::make_move_iterator(buf.end()), first);
+    }
+    co_await clear_gently(buf);
+}
+
+/// \brief Merges two sorted ranges without stalling the reactor.
+///
+/// Copies the elements of both ranges to \c out in order, like
+/// std::merge(), preferring the first range on ties.
+///
+/// With \ref algorithm_options::min_elements_per_shard set, and random
+/// access ranges, splits the merge into parts done on different shards.
+///
+/// \return a future for the end of the output range.
+template <std::input_iterator In1, std::input_iterator In2, typename Out, typename Compare = std::less<>>
+future<Out> merge(In1 first1, In1 last1, In2 first2, In2 last2, Out out, Compare cmp = {}, algorithm_options opts = {}) {
+    if constexpr (std::random_access_iterator<In1> && std::random_access_iterator<In2> && std::random_access_iterator<Out>) {
+        size_t n1 = last1 - first1;
+        size_t n2 = last2 - first2;
+        auto pieces = internal::algorithm_pieces(n1 + n2, opts);
+        if (pieces > 1) {
+            co_await internal::parallel_merge(first1, n1, first2, n2, out, cmp, pieces, opts);
+            co_return out + (n1 + n2);
+        }
+    }
+    co_return co_await internal::merge_chunked(std::move(first1), std::move(last1), std::move(first2), std::move(last2), std::move(out), std::move(cmp));
+}
+
+/// \brief Applies a function to a range without stalling the reactor.
+///
+/// Stores func(x) for each element x of the range to \c out, like
+/// std::transform().
+///
+/// With \ref algorithm_options::min_elements_per_shard set, and random
+/// access ranges, calls \c func for parts of the range on other shards.
+///
+/// \return a future for the end of the output range.
+template <std::input_iterator In, typename Out, typename Func>
+future<Out> transform(In first, In last, Out out, Func func, algorithm_options opts = {}) {
+    if constexpr (std::random_access_iterator<In> && std::random_access_iterator<Out>) {
+        size_t n = last - first;
+        auto pieces = internal::algorithm_pieces(n, opts);
+        if (pieces > 1) {
+            co_await internal::on_pieces(n, pieces, opts, [first, out, func] (size_t b, size_t e) {
+                return internal::transform_chunked(first + b, first + e, out + b, func).discard_result();
+            });
+            co_return out + n;
+        }
+    }
+    co_return co_await internal::transform_chunked(std::move(first), std::move(last), std::move(out), std::move(func));
+}
+
+/// \brief Folds a range without stalling the reactor.
+///
+/// Computes op(...op(op(init, x0), x1)..., xn), like std::accumulate().
+///
+/// With \ref algorithm_options::min_elements_per_shard set, and a random
+/// access range, folds parts of the range on other shards and then folds
+/// the results in order. That is only correct if \c op is associative. The
+/// partial results are moved back to the calling shard.
+///
+/// \return a future for the result.
+template <std::input_iterator In, typename T, typename BinaryOp = std::plus<>>
+future<T> accumulate(In first, In last, T init, BinaryOp op = {}, algorithm_options opts = {}) {
+    if constexpr (std::random_access_iterator<In>) {
+        size_t n = last - first;
+        auto pieces = internal::algorithm_pieces(n, opts);
+        if (pieces > 1) {
+            auto parts = co_await internal::on_pieces(n, pieces, opts, [first, op] (size_t b, size_t e) {
+                return internal::accumulate_chunked(first + b + 1, first + e, T(first[b]), op);
+            });
+            for (auto& part : parts) {
+                init = op(std::move(init), std::move(part));
+            }
+            co_return init;
+        }
+    }
+    co_return co_await internal::accumulate_chunked(std::move(first), std::move(last), std::move(init), std::move(op));
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -27,8 +27,9 @@
 #include <concepts>
 #include <future>
 #include <memory>
+#include <ranges>
 #include <type_traits>
-#include <boost/lockfree/queue.hpp>
+#include <vector>
 #endif
 
 #include <seastar/core/future.hh>
@@ -47,18 +48,24 @@ class reactor;
 /// \brief Integration with non-seastar applications.
 namespace alien {
 
+// The messages of the alien threads form an intrusive list, which they push
+// themselves, or a chain of themselves, to the front of with a single
+// compare-and-swap, and which the shard detaches as a whole and reverses to
+// process them in the order they were sent. Only the push that finds the list
+// empty may have to wake the shard up: a shard not sleeping then is bound to
+// see the list non-empty before it sleeps, and until it detaches the list
+// this push was part of, the following ones have nothing to wake it up from.
 class message_queue {
     static constexpr size_t batch_size = 128;
-    static constexpr size_t prefetch_cnt = 2;
     struct work_item;
     struct lf_queue_remote {
         reactor* remote;
     };
-    using lf_queue_base = boost::lockfree::queue<work_item*>;
     // use inheritence to control placement order
-    struct lf_queue : lf_queue_remote, lf_queue_base {
+    struct lf_queue : lf_queue_remote {
+        std::atomic<work_item*> head{nullptr};
         lf_queue(reactor* remote)
-            : lf_queue_remote{remote}, lf_queue_base{batch_size} {}
+            : lf_queue_remote{remote} {}
         void maybe_wakeup();
     } _pending;
     struct alignas(seastar::cache_line_size) {
@@ -70,10 +77,14 @@ class message_queue {
     // cache line used by another cpu.
     metrics::metric_groups _metrics;
     struct alignas(seastar::cache_line_size) {
+        // detached from _pending, oldest first, not processed yet
+        work_item* _ready = nullptr;
         size_t _received = 0;
         size_t _last_rcv_batch = 0;
+        size_t _received_batches = 0;
     };
     struct work_item {
+        work_item* next = nullptr;
         virtual ~work_item() = default;
         virtual void process() = 0;
     };
@@ -85,17 +96,48 @@ class message_queue {
             _func();
         }
     };
+    struct chain {
+        // newest first, as they are linked in _pending
+        work_item* first = nullptr;
+        work_item* last = nullptr;
+        size_t size = 0;
+        void push(work_item* wi) noexcept {
+            wi->next = first;
+            first = wi;
+            if (!last) {
+                last = wi;
+            }
+            ++size;
+        }
+        ~chain();
+    };
     template<typename Func>
-    size_t process_queue(lf_queue& q, Func process);
-    void submit_item(std::unique_ptr<work_item> wi);
+    size_t process_queue(Func process);
+    void submit_items(chain& items) noexcept;
 public:
     message_queue(reactor *to);
     void start();
     void stop();
     template <typename Func>
     void submit(Func&& func) {
-        auto wi = std::make_unique<async_work_item<Func>>(std::forward<Func>(func));
-        submit_item(std::move(wi));
+        chain items;
+        items.push(new async_work_item<Func>(std::forward<Func>(func)));
+        submit_items(items);
+    }
+    /// Submits all the functions of \c funcs at once, to be run in order,
+    /// nothing being submitted if allocating one of them fails. The
+    /// functions are moved out of the range.
+    template <std::ranges::input_range Range>
+    requires (!std::is_lvalue_reference_v<Range>)
+    void submit_batch(Range&& funcs) {
+        using func_type = std::ranges::range_value_t<Range>;
+        chain items;
+        for (auto&& func : funcs) {
+            items.push(new async_work_item<func_type>(func_type(std::move(func))));
+        }
+        if (items.size) {
+            submit_items(items);
+        }
     }
     size_t process_incoming();
     bool pure_poll_rx() const;
@@ -150,6 +192,24 @@ void run_on(instance& instance, unsigned shard, Func func) {
     instance._qs[shard].submit(std::move(func));
 }
 
+/// Runs functions on a remote shard from an alien thread where engine() is not available.
+///
+/// The functions are run in order, as if each was passed to run_on(), but are
+/// submitted to the shard at once, with a single synchronization with it,
+/// and wake it up at most once.
+///
+/// \param instance designates the Seastar instance to process the messages
+/// \param shard designates the shard to run the functions on
+/// \param funcs the callables to run on \c shard, moved out of the range, which
+///          must be an rvalue; an empty range submits nothing
+/// \note the functions must not throw and should return \c void, as for run_on()
+SEASTAR_MODULE_EXPORT
+template <std::ranges::input_range Range>
+requires std::is_nothrow_invocable_r_v<void, std::ranges::range_value_t<Range>> && (!std::is_lvalue_reference_v<Range>)
+void run_batch_on(instance& instance, unsigned shard, Range&& funcs) {
+    instance._qs[shard].submit_batch(std::forward<Range>(funcs));
+}
+
 /// Runs a function on a remote shard from an alien thread where engine() is not available.
 ///
 /// \param shard designates the shard to run the function on
@@ -188,6 +248,24 @@ struct return_type_of<Func, false> {
     }
 };
 template <typename Func> using return_type_t = typename return_type_of<Func>::type;
+
+// Runs func, fulfilling pr with its result
+template <typename Func, typename T>
+struct promise_work {
+    Func func;
+    std::promise<T> pr;
+    explicit promise_work(Func&& f) : func(std::move(f)) {}
+    void operator()() noexcept {
+        // std::future returned via std::promise.
+        (void)func().then_wrapped([pr = std::move(pr)] (auto&& result) mutable {
+            try {
+                return_type_of<Func>::set(pr, result.get());
+            } catch (...) {
+                pr.set_exception(std::current_exception());
+            }
+        });
+    }
+};
 }
 
 /// Runs a function on a remote shard from an alien thread where engine() is not available.
@@ -217,6 +295,38 @@ std::future<T> submit_to(instance& instance, unsigned shard, Func func) {
     return fut;
 }
 
+/// Runs functions on a remote shard from an alien thread where engine() is not available.
+///
+/// The batch version of submit_to(), submitting the functions to the shard at
+/// once as run_batch_on() does.
+///
+/// \param instance designates the Seastar instance to process the messages
+/// \param shard designates the shard to run the functions on
+/// \param funcs the callables to run on \c shard, moved out of the range, which
+///          must be an rvalue
+/// \return whatever each function returns, as a \c std::future<>, in order;
+///         nothing for an empty range
+/// \note the caller must keep the returned futures alive until the functions return
+SEASTAR_MODULE_EXPORT
+template<std::ranges::input_range Range,
+         typename Func = std::ranges::range_value_t<Range>,
+         typename T = internal::return_type_t<Func>>
+requires std::invocable<Func> && (!std::is_lvalue_reference_v<Range>)
+std::vector<std::future<T>> submit_batch_to(instance& instance, unsigned shard, Range&& funcs) {
+    std::vector<std::future<T>> futs;
+    std::vector<internal::promise_work<Func, T>> items;
+    if constexpr (std::ranges::sized_range<Range>) {
+        futs.reserve(std::ranges::size(funcs));
+        items.reserve(std::ranges::size(funcs));
+    }
+    for (auto&& func : funcs) {
+        auto& item = items.emplace_back(Func(std::move(func)));
+        futs.push_back(item.pr.get_future());
+    }
+    run_batch_on(instance, shard, std::move(items));
+    return futs;
+}
+
 /// Runs a function on a remote shard from an alien thread where engine() is not available.
 ///
 /// \param shard designates the shard to run the function on
@@ -0,0 +1,182 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <compare>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <sys/types.h>
+#include <boost/intrusive/list.hpp>
+#include <seastar/core/file.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+class cached_file_impl;
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// \brief A per-shard cache of file blocks.
+///
+/// \ref file objects are unbuffered, so components reading the same data
+/// over and over (index lookups, say) end up keeping caches of their own,
+/// with no common memory accounting. A block_cache keeps aligned blocks of
+/// the files opened through \ref make_cached_file(), within a memory budget,
+/// and serves reads of them from memory. Files opened for the same inode
+/// share their cached blocks.
+///
+/// Blocks are evicted in CLOCK (second chance) order when the budget is
+/// exceeded, and when the shard is short of memory. Concurrent reads of a
+/// block that is not cached wait for a single read of it.
+///
+/// Writes, truncations and discards made through a cached file invalidate
+/// the blocks they touch once they complete; reads running concurrently
+/// with them may see either the old or the new data. Modifications made
+/// through other files of the same inode are not noticed.
+///
+/// The cache must outlive the files opened through it, and be used on the
+/// shard that created it only.
+class block_cache {
+public:
+    struct config {
+        /// Size of the cached blocks. Must be a multiple of the read
+        /// alignment of the files opened through the cache.
+        size_t block_size = 32 << 10;
+        /// Bytes of cached blocks the cache may hold
+        size_t memory_budget = 64 << 20;
+        /// Metrics label identifying the cache, unique among the caches
+        /// of the shard; the metrics are only registered for a named
+        /// cache, so that unnamed ones do not collide.
+        sstring name;
+    };
+    struct stats {
+        /// Blocks looked up and found cached (or being read)
+        uint64_t hits = 0;
+        /// Blocks looked up and read from the file
+        uint64_t misses = 0;
+        /// Blocks read ahead of a miss
+        uint64_t read_ahead = 0;
+        /// Blocks evicted to stay within the budget or to free memory
+        uint64_t evictions = 0;
+        /// Blocks dropped because they were modified
+        uint64_t invalidations = 0;
+        /// Bytes of cached blocks
+        size_t cached_bytes = 0;
+    };
+private:
+    struct block_key {
+        dev_t dev;
+        ino_t ino;
+        uint64_t index;
+        auto operator<=>(const block_key&) const = default;
+    };
+    struct block {
+        block_key key;
+        temporary_buffer<char> data;
+        // Bytes of data that are part of the file; short at its end
+        size_t size = 0;
+        bool referenced = false;
+        // Invalidated while being read, dropped once the read completes
+        bool stale = false;
+        // Engaged while the block is being read
+        std::optional<shared_promise<>> loading;
+        boost::intrusive::list_member_hook<> clock_hook;
+    };
+    using block_map = std::map<block_key, block>;
+    using clock_list = boost::intrusive::list<block,
+        boost::intrusive::member_hook<block, boost::intrusive::list_member_hook<>, &block::clock_hook>,
+        boost::intrusive::constant_time_size<false>>;
+
+    config _cfg;
+    block_map _blocks;
+    // Cached (not loading) blocks, the hand of the CLOCK at the front
+    clock_list _clock;
+    stats _stats;
+    memory::reclaimer _reclaimer;
+    metrics::metric_groups _metrics;
+
+    // What load() copied out of the blocks it read
+    struct loaded {
+        size_t bytes = 0;
+        // The copy stopped at the end of the file
+        bool eof = false;
+    };
+
+    friend class cached_file_impl;
+    using reader = noncopyable_function<future<size_t> (uint64_t pos, std::vector<iovec> iov)>;
+    future<size_t> read(dev_t dev, ino_t ino, uint64_t pos, char* buffer, size_t len,
+            unsigned read_ahead, size_t alignment, reader& rd);
+    future<loaded> load(dev_t dev, ino_t ino, uint64_t first, uint64_t nr_wanted, unsigned read_ahead,
+            size_t alignment, reader& rd, size_t off, char* buffer, size_t len);
+    void invalidate(dev_t dev, ino_t ino, uint64_t pos, uint64_t len) noexcept;
+    size_t evict(size_t target) noexcept;
+    void erase(block_map::iterator it) noexcept;
+    memory::reclaiming_result reclaim(memory::reclaimer::request r) noexcept;
+    void register_metrics();
+public:
+    explicit block_cache(config cfg);
+    block_cache(const block_cache&) = delete;
+    block_cache& operator=(const block_cache&) = delete;
+    ~block_cache();
+
+    size_t block_size() const noexcept { return _cfg.block_size; }
+    size_t memory_budget() const noexcept { return _cfg.memory_budget; }
+    /// Changes the memory budget, evicting blocks beyond it.
+    void set_memory_budget(size_t budget) noexcept;
+    const stats& get_stats() const noexcept { return _stats; }
+};
+
+/// Options for files opened through a \ref block_cache
+struct cached_file_options {
+    /// Number of blocks following a missed one to read along with it, for
+    /// files that are read sequentially.
+    unsigned read_ahead_blocks = 0;
+};
+
+/// \brief Caches reads of a file in a \ref block_cache.
+///
+/// Returns a file reading through \c cache and forwarding everything else
+/// to \c f (closing it closes \c f). The cached file can be read at any
+/// offset and length, as reads are served from aligned cached blocks.
+///
+/// \param f the file to cache reads of
+/// \param cache the cache to keep the blocks in; must outlive the file
+/// \param opts caching options for this file
+future<file> make_cached_file(file f, block_cache& cache, cached_file_options opts = {});
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
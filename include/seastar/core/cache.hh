@@ -0,0 +1,487 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include <boost/intrusive/list.hpp>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// Estimates how often keys were used recently, for TinyLFU admission: a
+// count-min sketch of 4-bit counters, 16 to a word, each key counted in 4
+// of them. The counters are halved after as many increments as 10 times
+// the entries it was sized for, for the estimates to age.
+class frequency_sketch {
+    std::vector<uint64_t> _table;
+    size_t _increments = 0;
+    size_t _sample_size = 0;
+
+    void halve() noexcept;
+public:
+    explicit frequency_sketch(size_t entries = 0);
+    // Resizes for that many entries, forgetting the counts
+    void resize(size_t entries);
+    // The entries it is sized for
+    size_t capacity() const noexcept {
+        return _table.size();
+    }
+    void increment(uint64_t hash) noexcept;
+    unsigned estimate(uint64_t hash) const noexcept;
+};
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup memory-module
+/// @{
+
+/// \brief A per-shard cache of values, within a memory budget.
+///
+/// Entries are kept under the W-TinyLFU policy: new entries go to a small
+/// LRU admission window, and those it evicts only make it to the main
+/// (segmented LRU) part of the cache if they were used more often recently
+/// than the entry they would evict from it, as estimated by a frequency
+/// sketch of the keys looked up. A scan of keys used once then does not
+/// flush the keys used over and over, as it would from an LRU cache.
+///
+/// Entries are sized by \ref config::entry_size, to be kept within the
+/// memory budget, may expire after a time to live, and are evicted when
+/// the shard is short of memory. Concurrent \ref get_or_load() misses of
+/// the same key wait for a single load of it.
+///
+/// A cache is used on the shard that created it only. Keep one per shard
+/// in a \ref sharded, and route the lookups to the shard owning keys with
+/// a \ref sharded_map:
+///
+/// \code
+/// sharded<cache<sstring, sstring>> c;
+/// co_await c.start(cache<sstring, sstring>::config{.memory_budget = 1 << 30});
+/// sharded_map<sstring, cache<sstring, sstring>> m(c);
+/// auto v = co_await m.invoke_on(key, [] (auto& c, sstring key) {
+///     return c.get_or_load(key, [] (const sstring& key) { return read(key); });
+/// });
+/// \endcode
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class cache {
+public:
+    using clock_type = lowres_clock;
+    struct config {
+        /// Bytes of entries the cache may hold
+        size_t memory_budget = 64 << 20;
+        /// The part of the budget for the admission window; larger windows
+        /// suit workloads where recency matters more than frequency
+        double window_fraction = 0.01;
+        /// The time to live of the entries, unless given when inserting
+        /// them; zero keeps them until they are evicted
+        clock_type::duration ttl = clock_type::duration::zero();
+        /// The size of an entry, which the cache adds its own overhead to;
+        /// by default the size of the key and value types
+        noncopyable_function<size_t (const Key&, const Value&)> entry_size;
+        /// Metrics label identifying the cache, unique among the caches
+        /// of the shard; the metrics are only registered for a named
+        /// cache, so that unnamed ones do not collide.
+        sstring name;
+    };
+    struct stats {
+        /// Lookups which found the key
+        uint64_t hits = 0;
+        /// Lookups which did not, or found it expired
+        uint64_t misses = 0;
+        /// Values loaded by \ref get_or_load()
+        uint64_t loads = 0;
+        /// Entries let into the main part of the cache from the window
+        uint64_t admissions = 0;
+        /// Entries evicted from the window as less used than the main
+        /// part's ones
+        uint64_t rejections = 0;
+        /// Entries evicted to stay within the budget or to free memory
+        uint64_t evictions = 0;
+        /// Entries dropped as they expired
+        uint64_t expirations = 0;
+        /// Bytes of entries
+        size_t bytes = 0;
+    };
+private:
+    enum class segment : uint8_t { window, probation, protected_ };
+    struct entry {
+        Value value;
+        size_t size;
+        uint64_t hash;
+        clock_type::time_point expiry;
+        segment seg = segment::window;
+        const Key* key = nullptr;
+        boost::intrusive::list_member_hook<> lru_hook;
+
+        entry(Value v, size_t s, uint64_t h, clock_type::time_point e) : value(std::move(v)), size(s), hash(h), expiry(e) {}
+    };
+    using map_type = std::unordered_map<Key, entry, Hash, KeyEqual>;
+    // Least recently used at the front
+    using lru_list = boost::intrusive::list<entry,
+        boost::intrusive::member_hook<entry, boost::intrusive::list_member_hook<>, &entry::lru_hook>,
+        boost::intrusive::constant_time_size<false>>;
+    struct load {
+        shared_promise<Value> pr;
+        // Erased or replaced while loading, not to be cached
+        bool stale = false;
+    };
+    // Beyond the entry size, for the node of the map
+    static constexpr size_t entry_overhead = sizeof(entry) + 4 * sizeof(void*);
+    // The part of the main part of the cache for the entries used again
+    // since they were admitted
+    static constexpr double protected_fraction = 0.8;
+
+    config _cfg;
+    [[no_unique_address]] Hash _hash;
+    map_type _entries;
+    lru_list _window;
+    lru_list _probation;
+    lru_list _protected;
+    size_t _window_bytes = 0;
+    size_t _probation_bytes = 0;
+    size_t _protected_bytes = 0;
+    internal::frequency_sketch _sketch;
+    std::unordered_map<Key, load, Hash, KeyEqual> _loading;
+    gate _loads;
+    stats _stats;
+    memory::reclaimer _reclaimer;
+    metrics::metric_groups _metrics;
+
+    uint64_t hash_of(const Key& key) const noexcept {
+        uint64_t h = _hash(key);
+        // std::hash is the identity for integers: mix, for the sketch
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+    size_t window_budget() const noexcept {
+        return std::max<size_t>(_cfg.memory_budget * _cfg.window_fraction, 1);
+    }
+    size_t main_budget() const noexcept {
+        return _cfg.memory_budget - std::min(_cfg.memory_budget, window_budget());
+    }
+    lru_list& list_of(entry& e) noexcept {
+        switch (e.seg) {
+        case segment::window: return _window;
+        case segment::probation: return _probation;
+        case segment::protected_: return _protected;
+        }
+        __builtin_unreachable();
+    }
+    size_t& bytes_of(segment seg) noexcept {
+        switch (seg) {
+        case segment::window: return _window_bytes;
+        case segment::probation: return _probation_bytes;
+        case segment::protected_: return _protected_bytes;
+        }
+        __builtin_unreachable();
+    }
+    void move_to(entry& e, segment seg) noexcept {
+        list_of(e).erase(list_of(e).iterator_to(e));
+        bytes_of(e.seg) -= e.size;
+        e.seg = seg;
+        list_of(e).push_back(e);
+        bytes_of(e.seg) += e.size;
+    }
+    void remove(entry& e) noexcept {
+        list_of(e).erase(list_of(e).iterator_to(e));
+        bytes_of(e.seg) -= e.size;
+        _stats.bytes -= e.size;
+        _entries.erase(_entries.find(*e.key));
+    }
+    void touch(entry& e) noexcept {
+        if (e.seg == segment::probation) {
+            move_to(e, segment::protected_);
+            // Demote the least recently used protected entries beyond its share
+            while (_protected_bytes > main_budget() * protected_fraction && &_protected.front() != &e) {
+                move_to(_protected.front(), segment::probation);
+            }
+        } else {
+            auto& list = list_of(e);
+            list.erase(list.iterator_to(e));
+            list.push_back(e);
+        }
+    }
+    // Makes room for the window to fit in its budget, admitting the entries
+    // it evicts to the main part of the cache if they are used more than
+    // those they would evict there
+    void balance() noexcept {
+        while (_window_bytes > window_budget()) {
+            auto& candidate = _window.front();
+            move_to(candidate, segment::probation);
+            bool admitted = true;
+            while (admitted && _probation_bytes + _protected_bytes > main_budget()) {
+                auto& victim = _probation.front();
+                if (&victim == &candidate) {
+                    remove(candidate);
+                    _stats.evictions++;
+                    admitted = false;
+                } else if (_sketch.estimate(candidate.hash) <= _sketch.estimate(victim.hash)) {
+                    remove(candidate);
+                    _stats.rejections++;
+                    admitted = false;
+                } else {
+                    remove(victim);
+                    _stats.evictions++;
+                }
+            }
+            if (admitted) {
+                _stats.admissions++;
+            }
+        }
+        // The main part shrinks with the budget
+        if (_stats.bytes > _cfg.memory_budget) {
+            evict(_stats.bytes - _cfg.memory_budget);
+        }
+    }
+    // Evicts at least that many bytes, the probation, protected, then
+    // window entries first, returning the bytes evicted
+    size_t evict(size_t bytes) noexcept {
+        size_t freed = 0;
+        for (auto* list : {&_probation, &_protected, &_window}) {
+            while (freed < bytes && !list->empty()) {
+                auto& e = list->front();
+                freed += e.size;
+                remove(e);
+                _stats.evictions++;
+            }
+        }
+        return freed;
+    }
+    memory::reclaiming_result reclaim(memory::reclaimer::request r) noexcept {
+        return evict(r.bytes_to_reclaim) ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+    }
+    void invalidate_load(const Key& key) noexcept {
+        if (!_loading.empty()) {
+            if (auto it = _loading.find(key); it != _loading.end()) {
+                it->second.stale = true;
+            }
+        }
+    }
+    void register_metrics() {
+        if (_cfg.name.empty()) {
+            return;
+        }
+        namespace sm = seastar::metrics;
+        auto name = sm::label("name")(_cfg.name);
+        _metrics.add_group("cache", {
+            sm::make_counter("hits", _stats.hits,
+                    sm::description("Total number of lookups which found their key"), {name}),
+            sm::make_counter("misses", _stats.misses,
+                    sm::description("Total number of lookups which did not find their key, or found it expired"), {name}),
+            sm::make_counter("loads", _stats.loads,
+                    sm::description("Total number of values loaded on a miss"), {name}),
+            sm::make_counter("admissions", _stats.admissions,
+                    sm::description("Total number of entries let into the main part of the cache from the admission window"), {name}),
+            sm::make_counter("rejections", _stats.rejections,
+                    sm::description("Total number of entries evicted from the admission window as less used than the main part's"), {name}),
+            sm::make_counter("evictions", _stats.evictions,
+                    sm::description("Total number of entries evicted from the cache"), {name}),
+            sm::make_counter("expirations", _stats.expirations,
+                    sm::description("Total number of entries dropped as they expired"), {name}),
+            sm::make_gauge("bytes", [this] { return _stats.bytes; },
+                    sm::description("Bytes held by the entries"), {name}),
+            sm::make_gauge("entries", [this] { return _entries.size(); },
+                    sm::description("Number of entries"), {name}),
+        });
+    }
+public:
+    explicit cache(config cfg)
+            : _cfg(std::move(cfg))
+            , _sketch(64)
+            // Not sync: the reclaimer could run while an insertion allocates
+            , _reclaimer([this] (memory::reclaimer::request r) { return reclaim(r); }, memory::reclaimer_scope::async) {
+        register_metrics();
+    }
+    cache(const cache&) = delete;
+    cache& operator=(const cache&) = delete;
+
+    /// Looks up \c key, returning a pointer to its value, valid until the
+    /// cache is next modified, or nullptr if it is not cached or expired
+    Value* find(const Key& key) noexcept {
+        auto h = hash_of(key);
+        _sketch.increment(h);
+        auto it = _entries.find(key);
+        if (it == _entries.end()) {
+            _stats.misses++;
+            return nullptr;
+        }
+        auto& e = it->second;
+        if (e.expiry <= clock_type::now()) {
+            remove(e);
+            _stats.expirations++;
+            _stats.misses++;
+            return nullptr;
+        }
+        _stats.hits++;
+        touch(e);
+        return &e.value;
+    }
+
+    /// Inserts or replaces the value of \c key, which expires after \c ttl,
+    /// or \ref config::ttl if not given. An entry larger than the budget
+    /// is not cached.
+    void insert(Key key, Value value, std::optional<clock_type::duration> ttl = {}) {
+        invalidate_load(key);
+        auto size = (_cfg.entry_size ? _cfg.entry_size(key, value) : sizeof(Key) + sizeof(Value)) + entry_overhead;
+        auto t = ttl.value_or(_cfg.ttl);
+        auto expiry = t != clock_type::duration::zero() ? clock_type::now() + t : clock_type::time_point::max();
+        if (auto it = _entries.find(key); it != _entries.end()) {
+            remove(it->second);
+        }
+        if (size > _cfg.memory_budget) {
+            return;
+        }
+        auto h = hash_of(key);
+        auto [it, inserted] = _entries.try_emplace(std::move(key), std::move(value), size, h, expiry);
+        auto& e = it->second;
+        e.key = &it->first;
+        _window.push_back(e);
+        _window_bytes += size;
+        _stats.bytes += size;
+        if (_entries.size() > _sketch.capacity()) {
+            _sketch.resize(_sketch.capacity() * 2);
+        }
+        balance();
+    }
+
+    /// Removes \c key, returning whether it was cached. A load of it
+    /// running meanwhile is not cached.
+    bool erase(const Key& key) noexcept {
+        invalidate_load(key);
+        auto it = _entries.find(key);
+        if (it == _entries.end()) {
+            return false;
+        }
+        remove(it->second);
+        return true;
+    }
+
+    /// Removes all the entries
+    void clear() noexcept {
+        for (auto& l : _loading) {
+            l.second.stale = true;
+        }
+        _window.clear();
+        _probation.clear();
+        _protected.clear();
+        _entries.clear();
+        _window_bytes = _probation_bytes = _protected_bytes = _stats.bytes = 0;
+    }
+
+    /// Drops the expired entries, which are otherwise dropped when looked
+    /// up or evicted. Walks all of them.
+    void evict_expired() noexcept {
+        auto now = clock_type::now();
+        for (auto* list : {&_window, &_probation, &_protected}) {
+            for (auto it = list->begin(); it != list->end();) {
+                auto& e = *it++;
+                if (e.expiry <= now) {
+                    remove(e);
+                    _stats.expirations++;
+                }
+            }
+        }
+    }
+
+    /// Looks up \c key, loading its value with \c loader on a miss and
+    /// caching it. The misses of a key being loaded wait for the same load.
+    ///
+    /// \param loader a callable with signature `future<Value> (const Key&)`
+    ///        or `Value (const Key&)`; an exception it fails with is passed
+    ///        to all the lookups waiting, and nothing is cached
+    template <typename Loader>
+    requires std::invocable<Loader, const Key&>
+    future<Value> get_or_load(const Key& key, Loader&& loader) {
+        if (auto v = find(key)) {
+            return make_ready_future<Value>(*v);
+        }
+        if (_loads.is_closed()) {
+            return make_exception_future<Value>(gate_closed_exception());
+        }
+        auto [it, inserted] = _loading.try_emplace(key);
+        auto ret = it->second.pr.get_shared_future();
+        if (inserted) {
+            _stats.loads++;
+            // FIXME: future is discarded
+            (void)with_gate(_loads, [this, &key, &loader] {
+                return futurize_invoke(std::forward<Loader>(loader), key).then_wrapped([this, key] (future<Value> f) {
+                    auto node = _loading.extract(key);
+                    auto& l = node.mapped();
+                    if (f.failed()) {
+                        l.pr.set_exception(f.get_exception());
+                        return;
+                    }
+                    auto v = f.get();
+                    if (!l.stale) {
+                        try {
+                            insert(key, v);
+                        } catch (...) {
+                            // Not cached
+                        }
+                    }
+                    l.pr.set_value(std::move(v));
+                });
+            });
+        }
+        return ret;
+    }
+
+    size_t memory_budget() const noexcept { return _cfg.memory_budget; }
+    /// Changes the memory budget, evicting entries beyond it.
+    void set_memory_budget(size_t budget) noexcept {
+        _cfg.memory_budget = budget;
+        balance();
+    }
+    size_t size() const noexcept { return _entries.size(); }
+    const stats& get_stats() const noexcept { return _stats; }
+
+    /// Waits for the loads running. Must be called before destroying the
+    /// cache if \ref get_or_load() was used.
+    future<> stop() noexcept {
+        return _loads.close();
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <seastar/core/file.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Options for files opened through \ref make_checksummed_file()
+struct checksummed_file_options {
+    /// Size of the checksummed blocks, which becomes the read and write
+    /// alignment of the file. Must be a power of two and a multiple of the
+    /// alignments of the data file.
+    size_t block_size = 4096;
+};
+
+/// Thrown when a block read from a checksummed file does not match its
+/// checksum.
+class checksum_error : public std::runtime_error {
+    uint64_t _position;
+public:
+    explicit checksum_error(uint64_t position);
+    /// Position in the (logical) file of the corrupt block
+    uint64_t position() const noexcept { return _position; }
+};
+
+/// \brief Checksums the blocks of a file, keeping the checksums in it.
+///
+/// Returns a file storing the CRC32C of each block written through it and
+/// verifying the blocks it reads, failing the read with \ref checksum_error
+/// at the first one not matching. Blocks that were never written (holes)
+/// read back as zeros and pass.
+///
+/// The checksums are interleaved with the data: every block of checksums
+/// is followed by the block_size / 4 data blocks they cover, so \c data
+/// is not a plain copy of the checksummed file. Reads, writes, and
+/// discards must be aligned to the block size.
+///
+/// Writing a block writes its data and then its checksum, so a crash
+/// between the two leaves it failing verification: the file detects
+/// torn writes, it does not prevent them.
+///
+/// \param data the file to keep the data and checksums in; closing the
+///             returned file closes it
+/// \param opts checksumming options
+file make_checksummed_file(file data, checksummed_file_options opts = {});
+
+/// \brief Checksums the blocks of a file, keeping the checksums in another.
+///
+/// Like \ref make_checksummed_file(file, checksummed_file_options), but
+/// keeps \c data as is, storing the checksum of block \c b at offset
+/// <tt>b * 4</tt> of \c checksums (little endian). The data file stays
+/// readable as a plain file.
+///
+/// \param data the file to checksum
+/// \param checksums the file to keep the checksums in; closing the returned
+///                  file closes both
+/// \param opts checksumming options
+file make_checksummed_file(file data, file checksums, checksummed_file_options opts = {});
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
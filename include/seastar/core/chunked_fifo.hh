@@ -23,7 +23,13 @@
 
 #ifndef SEASTAR_MODULE
 #include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <span>
 #include <type_traits>
+#include <utility>
+#include <seastar/core/prefetch.hh>
 #include <seastar/util/modules.hh>
 #endif
 
@@ -84,6 +90,11 @@ namespace seastar {
 // chunked_fifo uses uninitialized storage for unoccupied elements, and thus
 // uses move/copy constructors instead of move/copy assignments, which are
 // less efficient.
+//
+// Beyond the freed chunk each queue keeps, the chunks freed are kept for all
+// the queues of the same type on the shard to reuse, up to a limit, so that
+// the queues that fill up as others drain, as the ones of connections do,
+// do not allocate.
 
 SEASTAR_MODULE_EXPORT
 template <typename T, size_t items_per_chunk = 128>
@@ -121,6 +132,15 @@ class chunked_fifo {
     // here (see save_free_chunks constant below).
     chunk* _free_chunks = nullptr;
     size_t _nfree_chunks = 0;
+    // The chunks freed by all the queues of the type on the shard, beyond
+    // the ones each keeps. Trivially destructible, for the queues destroyed
+    // after the chunks were freed at thread exit to still see it closed.
+    struct shard_chunks {
+        chunk* head = nullptr;
+        size_t count = 0;
+        bool closed = false;
+    };
+    static constexpr size_t max_shard_chunks = std::max<size_t>(2, (128 << 10) / sizeof(chunk));
 public:
     using value_type = T;
     using size_type = size_t;
@@ -180,8 +200,20 @@ class chunked_fifo {
     const T& back() const noexcept;
     template <typename... A>
     inline void emplace_back(A&&... args);
+    // push_back_n() appends the n elements from first, copying them, or
+    // moving them with a std::move_iterator, a chunk at a time. Trivially
+    // copyable elements in contiguous memory are copied with memcpy(). If
+    // constructing one throws, the ones before it stay appended.
+    template <std::input_iterator It>
+    void push_back_n(It first, size_t n);
     inline T& front() const noexcept;
     inline void pop_front() noexcept;
+    // pop_front_n() removes the first n elements, of which there must be as
+    // many.
+    void pop_front_n(size_t n) noexcept;
+    // drain_into() moves as many of the first elements as fit into out, and
+    // removes them, returning how many it did.
+    size_t drain_into(std::span<T> out) noexcept;
     inline bool empty() const noexcept;
     inline size_t size() const noexcept;
     void clear() noexcept;
@@ -207,6 +239,9 @@ class chunked_fifo {
     inline void ensure_room_back();
     void undo_room_back() noexcept;
     static inline size_t mask(size_t idx) noexcept;
+    static shard_chunks& shard_free_chunks() noexcept;
+    static chunk* get_shard_chunk() noexcept;
+    static void put_shard_chunk(chunk* c) noexcept;
 
 };
 
@@ -382,7 +417,51 @@ chunked_fifo<T, items_per_chunk>::shrink_to_fit() noexcept {
 template <typename T, size_t items_per_chunk>
 chunked_fifo<T, items_per_chunk>::~chunked_fifo() {
     clear();
-    shrink_to_fit();
+    while (_free_chunks) {
+        put_shard_chunk(std::exchange(_free_chunks, _free_chunks->next));
+    }
+}
+
+template <typename T, size_t items_per_chunk>
+inline typename chunked_fifo<T, items_per_chunk>::shard_chunks&
+chunked_fifo<T, items_per_chunk>::shard_free_chunks() noexcept {
+    static thread_local shard_chunks chunks;
+    return chunks;
+}
+
+template <typename T, size_t items_per_chunk>
+inline typename chunked_fifo<T, items_per_chunk>::chunk*
+chunked_fifo<T, items_per_chunk>::get_shard_chunk() noexcept {
+    auto& chunks = shard_free_chunks();
+    if (!chunks.head) {
+        return nullptr;
+    }
+    --chunks.count;
+    return std::exchange(chunks.head, chunks.head->next);
+}
+
+template <typename T, size_t items_per_chunk>
+void
+chunked_fifo<T, items_per_chunk>::put_shard_chunk(chunk* c) noexcept {
+    auto& chunks = shard_free_chunks();
+    if (chunks.closed || chunks.count >= max_shard_chunks) {
+        delete c;
+        return;
+    }
+    // Frees the chunks kept when the thread exits
+    static thread_local struct reaper {
+        ~reaper() {
+            auto& chunks = shard_free_chunks();
+            chunks.closed = true;
+            while (chunks.head) {
+                delete std::exchange(chunks.head, chunks.head->next);
+            }
+            chunks.count = 0;
+        }
+    } chunks_reaper;
+    c->next = chunks.head;
+    chunks.head = c;
+    ++chunks.count;
 }
 
 template <typename T, size_t items_per_chunk>
@@ -393,6 +472,8 @@ chunked_fifo<T, items_per_chunk>::back_chunk_new() {
         _back_chunk = _free_chunks;
         _free_chunks = _free_chunks->next;
         --_nfree_chunks;
+    } else if (auto c = get_shard_chunk()) {
+        _back_chunk = c;
     } else {
         _back_chunk = new chunk;
     }
@@ -531,7 +612,7 @@ chunked_fifo<T, items_per_chunk>::front_chunk_delete() noexcept {
         _free_chunks = _front_chunk;
         ++_nfree_chunks;
     } else {
-        delete _front_chunk;
+        put_shard_chunk(_front_chunk);
     }
     // If we only had one chunk, _back_chunk is gone too.
     if (_back_chunk == _front_chunk) {
@@ -552,6 +633,86 @@ chunked_fifo<T, items_per_chunk>::pop_front() noexcept {
     }
 }
 
+template <typename T, size_t items_per_chunk>
+template <std::input_iterator It>
+void
+chunked_fifo<T, items_per_chunk>::push_back_n(It first, size_t n) {
+    if constexpr (std::is_trivially_copyable_v<T> && std::contiguous_iterator<It>
+            && std::is_same_v<std::iter_value_t<It>, T>) {
+        auto src = std::to_address(first);
+        while (n) {
+            ensure_room_back();
+            auto c = _back_chunk;
+            auto e = mask(c->end);
+            auto k = std::min<size_t>(n, items_per_chunk - (c->end - c->begin));
+            auto head = std::min<size_t>(k, items_per_chunk - e);
+            std::memcpy(&c->items[e].data, src, head * sizeof(T));
+            std::memcpy(&c->items[0].data, src + head, (k - head) * sizeof(T));
+            c->end += k;
+            src += k;
+            n -= k;
+        }
+    } else {
+        for (; n; --n, ++first) {
+            emplace_back(*first);
+        }
+    }
+}
+
+template <typename T, size_t items_per_chunk>
+void
+chunked_fifo<T, items_per_chunk>::pop_front_n(size_t n) noexcept {
+    while (n) {
+        auto c = _front_chunk;
+        auto k = std::min<size_t>(n, c->end - c->begin);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (auto i = c->begin; i != c->begin + k; ++i) {
+                c->items[mask(i)].data.~T();
+            }
+        }
+        c->begin += k;
+        n -= k;
+        if (c->begin == c->end) {
+            if (c->next) {
+                prefetch<1>(&c->next->items[mask(c->next->begin)]);
+            }
+            front_chunk_delete();
+        }
+    }
+}
+
+template <typename T, size_t items_per_chunk>
+size_t
+chunked_fifo<T, items_per_chunk>::drain_into(std::span<T> out) noexcept {
+    static_assert(std::is_nothrow_move_assignable_v<T>, "drain_into() assumes move assignment does not throw");
+    size_t n = 0;
+    while (n != out.size() && _front_chunk) {
+        auto c = _front_chunk;
+        auto k = std::min<size_t>(out.size() - n, c->end - c->begin);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            auto b = mask(c->begin);
+            auto head = std::min<size_t>(k, items_per_chunk - b);
+            std::memcpy(out.data() + n, &c->items[b].data, head * sizeof(T));
+            std::memcpy(out.data() + n + head, &c->items[0].data, (k - head) * sizeof(T));
+        } else {
+            for (size_t i = 0; i != k; ++i) {
+                auto& item = c->items[mask(c->begin + i)].data;
+                out[n + i] = std::move(item);
+                item.~T();
+            }
+        }
+        c->begin += k;
+        n += k;
+        if (c->begin == c->end) {
+            if (c->next) {
+                prefetch<1>(&c->next->items[mask(c->next->begin)]);
+            }
+            front_chunk_delete();
+        }
+    }
+    return n;
+}
+
 template <typename T, size_t items_per_chunk>
 void chunked_fifo<T, items_per_chunk>::reserve(size_t n) {
     // reserve() guarantees that (n - size()) additional push()es will
@@ -574,7 +735,10 @@ void chunked_fifo<T, items_per_chunk>::reserve(size_t n) {
     }
     needed_chunks -= _nfree_chunks;
     while (needed_chunks--) {
-        chunk *c = new chunk;
+        chunk *c = get_shard_chunk();
+        if (!c) {
+            c = new chunk;
+        }
         c->next = _free_chunks;
         _free_chunks = c;
         ++_nfree_chunks;
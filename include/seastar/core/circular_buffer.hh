@@ -26,8 +26,11 @@
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <concepts>
+#include <cstring>
+#include <iterator>
 #include <memory>
 #include <algorithm>
+#include <span>
 #endif
 
 namespace seastar {
@@ -103,12 +106,24 @@ class circular_buffer {
     void push_back(T&& data);
     template <typename... A>
     void emplace_back(A&&... args);
+    /// Appends the \c n elements from \c first, copying them, or moving
+    /// them with a \c std::move_iterator, making room for them at once.
+    /// Trivially copyable elements in contiguous memory are copied with
+    /// at most two memcpy(). If constructing one throws, the ones before
+    /// it stay appended.
+    template <std::input_iterator It>
+    void push_back_n(It first, size_t n);
     T& front() noexcept;
     const T& front() const noexcept;
     T& back() noexcept;
     const T& back() const noexcept;
     void pop_front() noexcept;
     void pop_back() noexcept;
+    /// Removes the first \c n elements, of which there must be as many
+    void pop_front_n(size_t n) noexcept;
+    /// Moves as many of the first elements as fit into \c out, and removes
+    /// them, returning how many it did
+    size_t drain_into(std::span<T> out) noexcept;
     bool empty() const noexcept;
     size_t size() const noexcept;
     size_t capacity() const noexcept;
@@ -422,6 +437,31 @@ circular_buffer<T, Alloc>::emplace_back(Args&&... args) {
     ++_impl.end;
 }
 
+template <typename T, typename Alloc>
+template <std::input_iterator It>
+inline
+void
+circular_buffer<T, Alloc>::push_back_n(It first, size_t n) {
+    if (!n) {
+        return;
+    }
+    reserve(size() + n);
+    if constexpr (std::is_trivially_copyable_v<T> && std::contiguous_iterator<It>
+            && std::is_same_v<std::iter_value_t<It>, T>) {
+        auto src = std::to_address(first);
+        auto e = mask(_impl.end);
+        auto head = std::min(n, _impl.capacity - e);
+        std::memcpy(_impl.storage + e, src, head * sizeof(T));
+        std::memcpy(_impl.storage, src + head, (n - head) * sizeof(T));
+        _impl.end += n;
+    } else {
+        for (; n; --n, ++first) {
+            std::allocator_traits<Alloc>::construct(_impl, &_impl.storage[mask(_impl.end)], *first);
+            ++_impl.end;
+        }
+    }
+}
+
 template <typename T, typename Alloc>
 inline
 T&
@@ -466,6 +506,42 @@ circular_buffer<T, Alloc>::pop_back() noexcept {
     --_impl.end;
 }
 
+template <typename T, typename Alloc>
+inline
+void
+circular_buffer<T, Alloc>::pop_front_n(size_t n) noexcept {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        for (auto i = _impl.begin; i != _impl.begin + n; ++i) {
+            std::allocator_traits<Alloc>::destroy(_impl, &_impl.storage[mask(i)]);
+        }
+    }
+    _impl.begin += n;
+}
+
+template <typename T, typename Alloc>
+inline
+size_t
+circular_buffer<T, Alloc>::drain_into(std::span<T> out) noexcept {
+    static_assert(std::is_nothrow_move_assignable_v<T>, "drain_into() assumes move assignment does not throw");
+    auto n = std::min(out.size(), size());
+    if (!n) {
+        return 0;
+    }
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        auto b = mask(_impl.begin);
+        auto head = std::min(n, _impl.capacity - b);
+        std::memcpy(out.data(), _impl.storage + b, head * sizeof(T));
+        std::memcpy(out.data() + head, _impl.storage, (n - head) * sizeof(T));
+        _impl.begin += n;
+    } else {
+        for (size_t i = 0; i != n; ++i) {
+            out[i] = std::move(front());
+            pop_front();
+        }
+    }
+    return n;
+}
+
 template <typename T, typename Alloc>
 inline
 T&
@@ -0,0 +1,91 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#include <seastar/core/file.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Compression algorithms of compressed files
+enum class compressed_file_algorithm : uint8_t {
+    lz4 = 1,
+    /// Only available when Seastar is built with zstd
+    zstd = 2,
+};
+
+/// Options for writing files with \ref make_compressed_file_output_stream()
+struct compressed_file_options {
+    /// Size of the chunks the data is compressed in. Reads decompress whole
+    /// chunks, so larger chunks compress better but make small reads more
+    /// expensive.
+    size_t chunk_size = 64 << 10;
+    compressed_file_algorithm algorithm = compressed_file_algorithm::lz4;
+    /// Compression level for zstd; 0 picks its default.
+    int level = 0;
+};
+
+/// \brief Writes a compressed file.
+///
+/// Returns a stream compressing the data written to it in chunks of
+/// \c opts.chunk_size bytes and writing them to \c f, followed, when the
+/// stream is closed, by an index of the chunks. Chunks that do not compress
+/// are stored as is. The file can then be read through
+/// \ref open_compressed_file().
+///
+/// Flushing the stream writes out the complete chunks only, so that the data
+/// of a partial chunk is not durable until the stream is closed.
+future<output_stream<char>> make_compressed_file_output_stream(file f, compressed_file_options opts = {}) noexcept;
+
+/// \brief Opens a compressed file for reading.
+///
+/// Returns a read-only file, holding the uncompressed data of \c f, which
+/// must have been written through \ref make_compressed_file_output_stream().
+/// Reads can be made at any position and length: each reads the compressed
+/// chunks it covers with a single read of \c f and decompresses those
+/// falling entirely in the read directly into its buffer, so that reads of
+/// \ref make_file_input_stream() with a buffer size a multiple of the chunk
+/// size decompress each chunk once, straight into the stream's buffers. The
+/// last chunk decompressed on behalf of a partial read of it is kept to
+/// serve the following read.
+///
+/// Writes, truncations, discards and allocations fail with EBADF.
+///
+/// \param f the compressed file; closing the returned file closes it
+future<file> open_compressed_file(file f);
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
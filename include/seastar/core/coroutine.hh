@@ -23,6 +23,7 @@
 
 
 #include <seastar/core/future.hh>
+#include <seastar/core/internal/coroutine_frame_pool.hh>
 #include <seastar/coroutine/exception.hh>
 #include <seastar/util/modules.hh>
 #include <seastar/util/std-compat.hh>
@@ -46,6 +47,15 @@ class coroutine_traits_base {
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+#ifdef SEASTAR_COROUTINE_FRAME_POOL
+        static void* operator new(size_t size) {
+            return this_thread_coroutine_frame_pool.allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size) noexcept {
+            this_thread_coroutine_frame_pool.deallocate(ptr, size);
+        }
+#endif
+
         template<typename... U>
         void return_value(U&&... value) {
             _promise.set_value(std::forward<U>(value)...);
@@ -98,6 +108,15 @@ class coroutine_traits_base<> {
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+#ifdef SEASTAR_COROUTINE_FRAME_POOL
+        static void* operator new(size_t size) {
+            return this_thread_coroutine_frame_pool.allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size) noexcept {
+            this_thread_coroutine_frame_pool.deallocate(ptr, size);
+        }
+#endif
+
         void return_void() noexcept {
             _promise.set_value();
         }
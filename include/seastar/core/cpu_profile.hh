@@ -0,0 +1,80 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// \brief A profile of where the reactors spend their CPU time, sampled
+/// continuously.
+///
+/// With \c --cpu-profiler-hz, every reactor thread is signaled that many
+/// times per second of the CPU time it uses, by a timer of its CPU time, and
+/// takes the backtrace it was interrupted at, with the scheduling group and
+/// the type of the task it was running, into a profile of its shard. The
+/// profile counts the samples of each distinct scheduling group, task type
+/// and backtrace, of \c --cpu-profiler-max-entries of them at most, the
+/// samples of any others being dropped. Backtraces are only resolved to
+/// symbols when the profile is collected, by the syscall thread, off the
+/// reactor.
+///
+/// The profile is formatted in the folded stacks format of flamegraph.pl
+/// and other flamegraph tools, as that of \ref stall_profile: a line for each
+/// entry, of the frames of its backtrace, outermost first, under frames of
+/// its shard, scheduling group and task type, followed by its samples. The
+/// samples taken while the reactor ran no task, as when it polled, are
+/// under a \c task:[reactor] frame.
+///
+/// \code
+/// shard 0;sg:main;task:seastar::continuation<...>;main;...;my::parse() 42
+/// \endcode
+namespace cpu_profile {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The profile of all the shards, in the folded stacks format
+///
+/// \param reset starts the profiles of the shards over once collected
+future<sstring> collect(bool reset = false);
+
+/// Starts the profiles of all the shards over
+future<> reset();
+
+/// Adds a GET endpoint serving the profile, started over if the request has
+/// the \c reset=true query parameter
+future<> add_routes(httpd::http_server& server, sstring path = "/cpu_profile");
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
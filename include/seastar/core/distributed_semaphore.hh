@@ -0,0 +1,155 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <utility>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fiber-module
+/// @{
+
+class distributed_semaphore;
+
+/// Units of a \ref distributed_semaphore, returned to it on destruction.
+/// Must be destroyed on the shard that acquired them.
+class distributed_semaphore_units {
+    distributed_semaphore* _sem = nullptr;
+    size_t _n = 0;
+public:
+    distributed_semaphore_units() noexcept = default;
+    distributed_semaphore_units(distributed_semaphore& sem, size_t n) noexcept : _sem(&sem), _n(n) {}
+    distributed_semaphore_units(distributed_semaphore_units&& x) noexcept
+        : _sem(std::exchange(x._sem, nullptr)), _n(std::exchange(x._n, 0)) {}
+    distributed_semaphore_units& operator=(distributed_semaphore_units&& x) noexcept {
+        if (this != &x) {
+            return_all();
+            _sem = std::exchange(x._sem, nullptr);
+            _n = std::exchange(x._n, 0);
+        }
+        return *this;
+    }
+    ~distributed_semaphore_units() {
+        return_all();
+    }
+    /// The number of units held.
+    size_t count() const noexcept { return _n; }
+    /// Returns the units to the semaphore early.
+    void return_all() noexcept;
+};
+
+/// \brief A semaphore limiting a resource across all the shards.
+///
+/// A node-wide limit (say, of concurrent heavy queries) can be split between
+/// shard-local \ref semaphore "semaphores" statically, but then a busy shard
+/// can't use the units of the idle ones. A distributed_semaphore keeps the
+/// units in a pool on shard 0, and each shard caches a few of them
+/// locally: acquiring units is local as long as the shard's cache has them,
+/// and a shard that runs short borrows \c batch units (or as many as it is
+/// waiting for) at a time from the pool. Shards return what they cache
+/// beyond \c batch units to the pool, and when the pool runs dry, all the
+/// shards give back the units they cache and don't wait for, so the limit
+/// is node-wide and exact.
+///
+/// A distributed_semaphore is a \ref sharded service:
+///
+/// \code
+/// sharded<distributed_semaphore> heavy;
+/// co_await heavy.start(1000, 16);
+/// // on any shard
+/// auto units = co_await heavy.local().get_units();
+/// \endcode
+///
+/// Waiters on each shard are served in FIFO order; shards get units from
+/// the pool in the order they ask for them.
+class distributed_semaphore : public peering_sharded_service<distributed_semaphore> {
+    friend class distributed_semaphore_units;
+    struct borrower {
+        promise<size_t> pr;
+        size_t want;
+    };
+    size_t _batch;
+    // This shard's cache of the units
+    semaphore _local;
+    // Units waited for on this shard
+    size_t _waiting = 0;
+    bool _borrowing = false;
+    // Set while shard 0 has borrowers it can't serve: this shard then
+    // returns all the units it doesn't wait for, rather than keep a batch
+    bool _starving = false;
+    gate _gate;
+    // On shard 0: the units no shard caches, and the shards waiting for
+    // some
+    size_t _pool = 0;
+    std::deque<borrower> _borrowers;
+    bool _reclaiming = false;
+
+    void signal(size_t n) noexcept;
+    void maybe_borrow() noexcept;
+    void trim() noexcept;
+    void return_to_pool(size_t n) noexcept;
+    // On shard 0
+    future<size_t> lend(size_t want) noexcept;
+    void take_back(size_t n) noexcept;
+    void set_starving(bool starving) noexcept;
+    void broadcast_starving(bool starving) noexcept;
+    future<distributed_semaphore_units> wait_for(future<> f, size_t n) noexcept;
+public:
+    /// \param units the node-wide number of units
+    /// \param batch the number of units shards borrow and keep at a time
+    distributed_semaphore(size_t units, size_t batch = 1);
+
+    /// Acquires \c n units, waiting until they are available.
+    future<distributed_semaphore_units> get_units(size_t n = 1) noexcept;
+    /// Acquires \c n units, failing with \ref semaphore_timed_out if they
+    /// aren't available by \c timeout.
+    future<distributed_semaphore_units> get_units(semaphore::time_point timeout, size_t n = 1) noexcept;
+    /// Acquires \c n units right away if this shard caches them.
+    std::optional<distributed_semaphore_units> try_get_units(size_t n = 1) noexcept;
+
+    /// The units this shard caches and doesn't use.
+    size_t available_units() const noexcept;
+    /// The number of fibers waiting for units on this shard.
+    size_t waiters() const noexcept { return _local.waiters(); }
+
+    /// Fails the waiters on this shard and waits for the exchanges with
+    /// the other shards to complete. Called by \ref sharded::stop().
+    future<> stop() noexcept;
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -34,6 +34,9 @@
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <fmt/format.h>
+#include <array>
+#include <chrono>
+#include <limits>
 #include <vector>
 #include <boost/range/irange.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -122,11 +125,48 @@ std::reference_wrapper<T> unwrap_for_es(reference_wrapper_for_es<T> ref) {
 SEASTAR_MODULE_EXPORT
 class execution_stage {
 public:
+    /// Number of buckets of \ref stats::batch_sizes
+    static constexpr size_t batch_size_buckets = 12;
+
     struct stats {
         uint64_t tasks_scheduled = 0;
         uint64_t tasks_preempted = 0;
         uint64_t function_calls_enqueued = 0;
         uint64_t function_calls_executed = 0;
+        /// Calls which ran right after another call of the stage, in the
+        /// same batch, and likely found its code in the instruction cache
+        uint64_t function_calls_batched = 0;
+        /// Tasks scheduled because \ref batching_policy::max_delay passed
+        uint64_t flushes_on_deadline = 0;
+        /// Number of batches by size: the i-th bucket counts the batches
+        /// of more than 2^(i-1) and at most 2^i calls, the last one the
+        /// larger ones too
+        std::array<uint64_t, batch_size_buckets> batch_sizes = {};
+    };
+
+    /// How an execution stage batches the calls enqueued to it
+    ///
+    /// By default a stage schedules a task to run its queued calls as soon
+    /// as a call is enqueued, so the size of the batches its tasks run is
+    /// the number of calls enqueued before they got to run. The policy can
+    /// make the stage wait for larger batches, for a bounded time, and bound
+    /// the size of the batches.
+    struct batching_policy {
+        /// Number of queued calls for which the stage schedules a task
+        /// right away. The stage runs its calls in place, without waiting
+        /// for a task, once 1024 of them are queued.
+        size_t min_batch = 1;
+        /// Longest time the stage waits for \ref min_batch calls before
+        /// scheduling a task for the calls it has, checked whenever the
+        /// reactor polls.
+        std::chrono::microseconds max_delay{0};
+        /// Most calls a task of the stage runs.
+        size_t max_batch = std::numeric_limits<size_t>::max();
+        /// Adapt the number of calls to wait for to their arrival: when
+        /// \ref max_delay passes before the batch fills up, wait only for
+        /// as many calls as it had from then on, and double that (up to
+        /// \ref min_batch) every time such a batch fills up.
+        bool adaptive = false;
     };
 protected:
     bool _empty = true;
@@ -135,8 +175,19 @@ class execution_stage {
     stats _stats;
     sstring _name;
     metrics::metric_group _metric_group;
+    batching_policy _policy;
+    size_t _batch_threshold = 1;
+    std::chrono::steady_clock::time_point _batch_start;
 protected:
     virtual void do_flush() noexcept = 0;
+    virtual size_t queue_length() const noexcept = 0;
+    // Called before a call is enqueued to an empty queue
+    void start_batch() noexcept {
+        if (_policy.min_batch > 1) {
+            _batch_start = std::chrono::steady_clock::now();
+        }
+    }
+    void account_batch(size_t calls) noexcept;
 public:
     explicit execution_stage(const sstring& name, scheduling_group sg = {});
     virtual ~execution_stage();
@@ -157,15 +208,29 @@ class execution_stage {
     /// Returns execution stage usage statistics
     const stats& get_stats() const noexcept { return _stats; }
 
+    /// Sets the batching policy of the stage
+    void set_batching_policy(batching_policy policy) noexcept;
+
+    /// Returns the batching policy of the stage
+    const batching_policy& get_batching_policy() const noexcept { return _policy; }
+
     /// Flushes execution stage
     ///
     /// Ensures that a task which would execute all queued operations is
     /// scheduled. Does not schedule a new task if there is one already pending
     /// or the queue is empty.
     ///
+    /// Flushes regardless of the \ref batching_policy, so it can be used to
+    /// flush a stage early, e.g. under latency pressure.
+    ///
     /// \return true if a new task has been scheduled
     bool flush() noexcept;
 
+    /// Flushes execution stage if its \ref batching_policy says so
+    ///
+    /// \return true if a new task has been scheduled
+    bool maybe_flush() noexcept;
+
     /// Checks whether there are pending operations.
     ///
     /// \return true if there is at least one queued operation
@@ -241,6 +306,7 @@ class concrete_execution_stage final : public execution_stage {
     }
 
     virtual void do_flush() noexcept override {
+        size_t calls = 0;
         while (!_queue.empty()) {
             auto& wi = _queue.front();
             auto wi_in = std::move(wi._in);
@@ -249,13 +315,21 @@ class concrete_execution_stage final : public execution_stage {
             futurize<ReturnType>::apply(_function, unwrap(std::move(wi_in))).forward_to(std::move(wi_ready));
             _stats.function_calls_executed++;
 
+            if (++calls == _policy.max_batch) {
+                break;
+            }
             if (internal::scheduler_need_preempt()) {
                 _stats.tasks_preempted++;
                 break;
             }
         }
+        account_batch(calls);
         _empty = _queue.empty();
     }
+
+    virtual size_t queue_length() const noexcept override {
+        return _queue.size();
+    }
 public:
     explicit concrete_execution_stage(const sstring& name, scheduling_group sg, noncopyable_function<ReturnType (Args...)> f)
         : execution_stage(name, sg)
@@ -292,11 +366,14 @@ class concrete_execution_stage final : public execution_stage {
         if (_queue.size() >= max_queue_length) {
             do_flush();
         }
+        if (_queue.empty()) {
+            start_batch();
+        }
         _queue.emplace_back(std::move(args)...);
         _empty = false;
         _stats.function_calls_enqueued++;
         auto f = _queue.back()._ready.get_future();
-        flush();
+        maybe_flush();
         return f;
     }
 };
@@ -331,6 +408,7 @@ class inheriting_concrete_execution_stage final : public inheriting_execution_st
 
     sstring _name;
     noncopyable_function<ReturnType (Args...)> _function;
+    execution_stage::batching_policy _policy;
     std::vector<std::optional<per_group_stage_type>> _stage_for_group{max_scheduling_groups()};
 private:
     per_group_stage_type make_stage_for_group(scheduling_group sg) {
@@ -340,7 +418,9 @@ class inheriting_concrete_execution_stage final : public inheriting_execution_st
             return _function(std::forward<Args>(args)...);
         };
         auto name = fmt::format("{}.{}", _name, sg.name());
-        return per_group_stage_type(name, sg, wrapped_function);
+        auto stage = per_group_stage_type(name, sg, wrapped_function);
+        stage.set_batching_policy(_policy);
+        return stage;
     }
 public:
     /// Construct an inheriting concrete execution stage.
@@ -383,6 +463,18 @@ class inheriting_concrete_execution_stage final : public inheriting_execution_st
         return (*slot)(std::move(args)...);
     }
 
+    /// Sets the batching policy of the per-scheduling group stages
+    ///
+    /// \see execution_stage::set_batching_policy()
+    void set_batching_policy(execution_stage::batching_policy policy) noexcept {
+        _policy = policy;
+        for (auto& stage : _stage_for_group) {
+            if (stage) {
+                stage->set_batching_policy(policy);
+            }
+        }
+    }
+
     /// Returns summary of individual execution stage usage statistics
     ///
     /// \returns a vector of the stats of the individual per-scheduling group
@@ -28,6 +28,8 @@
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/util/shared_token_bucket.hh>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <functional>
@@ -112,6 +114,8 @@ class fair_queue_entry {
 
 private:
     capacity_t _capacity;
+    // When the entry was queued, if its class has a latency target
+    std::chrono::steady_clock::time_point _queued_at;
     bi::slist_member_hook<> _hook;
 
 public:
@@ -216,6 +220,17 @@ class fair_group {
 
     token_bucket_t _token_bucket;
     const capacity_t _per_tick_threshold;
+    const capacity_t _grab_batch;
+    double _rate_factor = 1.0;
+
+    /*
+     * Each queue dispatches up to its 1/nr_queues share of the bucket limit
+     * per tick. With idle capacity sharing the limit is split among the
+     * queues that have requests to dispatch instead, so that the share of
+     * idle shards goes to busy ones rather than being left in the bucket.
+     */
+    const bool _share_idle_capacity;
+    std::atomic<unsigned> _nr_active_queues = 0;
 
 public:
 
@@ -245,13 +260,30 @@ class fair_group {
         double min_tokens = 0.0;
         double limit_min_tokens = 0.0;
         std::chrono::duration<double> rate_limit_duration = std::chrono::milliseconds(1);
+        bool share_idle_capacity = false;
+        /*
+         * The fraction of its per-tick share a queue grabs from the bucket
+         * at once, for the next requests to take from rather than from the
+         * bucket shared with the other shards. 0 grabs for every request.
+         */
+        double grab_batch = 0.0;
     };
 
     explicit fair_group(config cfg, unsigned nr_queues);
     fair_group(fair_group&&) = delete;
 
     capacity_t maximum_capacity() const noexcept { return _token_bucket.limit(); }
-    capacity_t per_tick_grab_threshold() const noexcept { return _per_tick_threshold; }
+    capacity_t per_tick_grab_threshold() const noexcept {
+        if (_share_idle_capacity) {
+            return _token_bucket.limit() / std::max(_nr_active_queues.load(std::memory_order_relaxed), 1u);
+        }
+        return _per_tick_threshold;
+    }
+    // The per-tick share of a queue when all the queues are busy
+    capacity_t fair_share_per_tick() const noexcept { return _per_tick_threshold; }
+    void activate_queue() noexcept { _nr_active_queues.fetch_add(1, std::memory_order_relaxed); }
+    void deactivate_queue() noexcept { _nr_active_queues.fetch_sub(1, std::memory_order_relaxed); }
+    unsigned active_queues() const noexcept { return _nr_active_queues.load(std::memory_order_relaxed); }
     capacity_t grab_capacity(capacity_t cap) noexcept;
     clock_type::time_point replenished_ts() const noexcept { return _token_bucket.replenished_ts(); }
     void replenish_capacity(clock_type::time_point now) noexcept;
@@ -265,6 +297,16 @@ class fair_group {
     }
 
     const token_bucket_t& token_bucket() const noexcept { return _token_bucket; }
+    token_bucket_t& token_bucket() noexcept { return _token_bucket; }
+    capacity_t grab_batch() const noexcept { return _grab_batch; }
+
+    // Scales the replenish rate relative to the configured one, for when
+    // the device turns out to be faster or slower than configured
+    void set_rate_factor(double factor) noexcept {
+        _rate_factor = factor;
+        _token_bucket.update_rate(fixed_point_factor * factor);
+    }
+    double rate_factor() const noexcept { return _rate_factor; }
 };
 
 /// \brief Fair queuing class
@@ -319,6 +361,12 @@ class fair_queue {
         void assert_enough_capacity() const noexcept {
             assert(c.size() < c.capacity());
         }
+
+        // Removes an entry that's not necessarily on top
+        void remove(priority_class_ptr pc) noexcept {
+            c.erase(std::find(c.begin(), c.end(), pc));
+            std::make_heap(c.begin(), c.end(), comp);
+        }
     };
 
     config _config;
@@ -328,6 +376,8 @@ class fair_queue {
     fair_queue_ticket _resources_queued;
     priority_queue _handles;
     std::vector<std::unique_ptr<priority_class_data>> _priority_classes;
+    // Classes with a latency target, see set_latency_target_for_class()
+    std::vector<priority_class_ptr> _latency_classes;
     size_t _nr_classes = 0;
     capacity_t _last_accumulated = 0;
 
@@ -350,12 +400,18 @@ class fair_queue {
     };
 
     std::optional<pending> _pending;
+    internal::token_bucket_batch<fair_group::token_bucket_t> _grabs;
+    // Whether the queue is counted in the group's active queues
+    bool _active = false;
+    capacity_t _borrowed_capacity = 0;
 
     void push_priority_class(priority_class_data& pc) noexcept;
     void push_priority_class_from_idle(priority_class_data& pc) noexcept;
     void pop_priority_class(priority_class_data& pc) noexcept;
     void plug_priority_class(priority_class_data& pc) noexcept;
     void unplug_priority_class(priority_class_data& pc) noexcept;
+    capacity_t max_deviation(const priority_class_data& pc) const noexcept;
+    priority_class_data& pick_priority_class(clock_type::time_point now) noexcept;
 
     enum class grab_result { grabbed, cant_preempt, pending };
     grab_result grab_capacity(const fair_queue_entry& ent) noexcept;
@@ -370,6 +426,10 @@ class fair_queue {
 
     sstring label() const noexcept { return _config.label; }
 
+    /// Total capacity dispatched beyond the queue's fair share of its group,
+    /// out of the share of idle queues
+    capacity_t borrowed_capacity() const noexcept { return _borrowed_capacity; }
+
     /// Registers a priority class against this fair queue.
     ///
     /// \param shares how many shares to create this class with
@@ -382,6 +442,20 @@ class fair_queue {
 
     void update_shares_for_class(class_id c, uint32_t new_shares);
 
+    /// Sets the latency target of a priority class.
+    ///
+    /// Requests of a class with a latency target are dispatched ahead of
+    /// their share-based turn once they have been waiting for half of the
+    /// target, most urgent (by deadline) first. Shares are still honoured
+    /// over time: such a class is charged for what it dispatches as usual,
+    /// and is not let ahead of the class whose turn it is by more than it
+    /// could consume in \ref config::tau with its shares.
+    ///
+    /// \param c the class
+    /// \param target how long requests of the class are expected to wait
+    ///        for at most, or zero for no target (the default)
+    void set_latency_target_for_class(class_id c, std::chrono::microseconds target);
+
     /// \return how much resources (weight, size) are currently queued for all classes.
     fair_queue_ticket resources_currently_waiting() const;
 
@@ -410,6 +484,12 @@ class fair_queue {
     void notify_request_finished(fair_queue_entry::capacity_t cap) noexcept;
     void notify_request_cancelled(fair_queue_entry& ent) noexcept;
 
+    /// Changes the capacity of a queued entry, unless it may be the one
+    /// capacity is reserved for, and the reservation would not cover it.
+    ///
+    /// \return whether the capacity was changed
+    bool try_update_request_capacity(fair_queue_entry& ent, fair_queue_entry::capacity_t cap) noexcept;
+
     /// Try to execute new requests if there is capacity left in the queue.
     void dispatch_requests(std::function<void(fair_queue_entry&)> cb);
 
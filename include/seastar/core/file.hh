@@ -44,6 +44,7 @@
 #include <cstdint>
 #include <functional>
 #include <optional>
+#include <span>
 #endif
 
 namespace seastar {
@@ -61,6 +62,26 @@ struct directory_entry {
     std::optional<directory_entry_type> type;
 };
 
+/// One of a batch of reads submitted with \ref file::dma_read_many().
+struct dma_read_request {
+    /// Offset to begin reading at (should be aligned)
+    uint64_t pos;
+    /// Output buffer (should be aligned)
+    void* buffer;
+    /// Number of bytes to read (should be aligned)
+    size_t len;
+};
+
+/// The completion of a read of a batch submitted with \ref file::dma_read_many().
+struct dma_read_result {
+    /// Index of the read in the batch
+    size_t index;
+    /// Number of bytes actually read, if the read succeeded
+    size_t size;
+    /// The error the read failed with, if it did
+    std::exception_ptr error;
+};
+
 /// Filesystem object stat information
 struct stat_data {
     uint64_t  device_id;      // ID of device containing file
@@ -100,12 +121,59 @@ struct file_open_options {
     static constexpr uint32_t min_extent_size_hint_alignment{128u << 10}; // 128KB
 };
 
+/// \brief A read-only memory mapping of a range of a file.
+///
+/// Returned by \ref file::map_readonly(). Touching a page of the mapping
+/// that is not resident blocks the reactor on a page fault, so ranges must
+/// be made resident with \ref ensure_resident() before they are accessed.
+/// The kernel may evict clean pages again under memory pressure; callers
+/// needing a guarantee should check with \ref is_resident() right before an
+/// access, which costs no I/O.
+///
+/// The mapping is unmapped when the object is destroyed, and remains valid
+/// after the file is closed. The file must not be truncated while mapped, as
+/// accessing pages past its end raises SIGBUS.
+class file_mapping {
+    void* _map = nullptr;
+    size_t _map_size = 0;
+    const char* _data = nullptr;
+    size_t _size = 0;
+public:
+    /// Constructs an empty mapping.
+    file_mapping() noexcept = default;
+    /// \cond internal
+    file_mapping(void* map, size_t map_size, const char* data, size_t size) noexcept
+        : _map(map), _map_size(map_size), _data(data), _size(size) {}
+    /// \endcond
+    file_mapping(file_mapping&& x) noexcept;
+    file_mapping& operator=(file_mapping&& x) noexcept;
+    ~file_mapping();
+
+    /// The mapped data, at the offset the mapping was requested for
+    const char* data() const noexcept { return _data; }
+    /// Length of the mapped data
+    size_t size() const noexcept { return _size; }
+
+    /// \brief Pages in a range of the mapping.
+    ///
+    /// Returns once the pages backing \c len bytes at \c offset (relative
+    /// to \ref data()) are resident, having read the missing ones in the
+    /// syscall thread pool. Resident ranges are detected with mincore(2)
+    /// and complete immediately.
+    future<> ensure_resident(size_t offset, size_t len) noexcept;
+
+    /// Checks, without blocking, whether the pages backing \c len bytes at
+    /// \c offset are resident.
+    bool is_resident(size_t offset, size_t len) const noexcept;
+};
+
 class file;
 class file_impl;
 class io_intent;
 class file_handle;
 class file_data_sink_impl;
 class file_data_source_impl;
+namespace net { class posix_data_sink_impl; }
 
 // A handle that can be transported across shards and used to
 // create a dup(2)-like `file` object referring to the same underlying file
@@ -167,6 +235,7 @@ class file_impl {
     virtual future<int> ioctl_short(uint64_t cmd, void* argp) noexcept;
     virtual future<int> fcntl(int op, uintptr_t arg) noexcept;
     virtual future<int> fcntl_short(int op, uintptr_t arg) noexcept;
+    virtual future<file_mapping> map_readonly(uint64_t offset, size_t length) noexcept;
     virtual future<> allocate(uint64_t position, uint64_t length) = 0;
     virtual future<uint64_t> size() = 0;
     virtual future<> close() = 0;
@@ -327,6 +396,25 @@ class file {
         return dma_read_impl(aligned_pos, reinterpret_cast<uint8_t*>(aligned_buffer), aligned_len, internal::maybe_priority_class_ref(), intent);
     }
 
+    /**
+     * Perform a batch of DMA reads at scattered offsets.
+     *
+     * All the reads are queued at once, so that they are dispatched to the
+     * disk together (reads of adjacent ranges are merged), and their results
+     * are yielded in the order they complete, rather than each one needing
+     * a future of its own to be waited for.
+     *
+     * @param reqs the reads to perform; the same alignment rules as for
+     *        \ref dma_read() apply. The requests and their buffers must be
+     *        kept alive until all the results have been yielded.
+     * @param intent the IO intention confirmation (\ref seastar::io_intent),
+     *        covering the whole batch
+     *
+     * @return a generator of the results of the reads, one per request
+     */
+    coroutine::experimental::generator<dma_read_result>
+    dma_read_many(std::span<const dma_read_request> reqs, io_intent* intent = nullptr);
+
 #if SEASTAR_API_LEVEL < 7
     /**
      * Read the requested amount of bytes starting from the given offset.
@@ -617,6 +705,25 @@ class file {
     ///         if the operation has failed
     future<int> fcntl_short(int op, uintptr_t arg = 0UL) noexcept;
 
+    /// Maps a range of the file into memory, read-only.
+    ///
+    /// seastar avoids memory mapped files, as page faults block the reactor.
+    /// The mapping returned is meant for large read-only data (lookup tables,
+    /// say) that would otherwise be copied into memory in full: the pages of
+    /// a range are read in asynchronously by awaiting
+    /// \ref file_mapping::ensure_resident() before the range is accessed.
+    /// Only POSIX files can be mapped.
+    ///
+    /// \param offset offset of the range in the file, need not be aligned
+    /// \param length length of the range
+    /// \return a future resolving to the mapping
+    future<file_mapping> map_readonly(uint64_t offset, size_t length) noexcept;
+
+    /// Maps the whole file into memory, read-only.
+    ///
+    /// \see map_readonly(uint64_t, size_t)
+    future<file_mapping> map_readonly() noexcept;
+
     /// Set a lifetime hint for the open file descriptor corresponding to seastar::file
     ///
     /// Write lifetime  hints  can be used to inform the kernel about the relative
@@ -780,6 +887,7 @@ class file {
     friend class file_impl;
     friend class file_data_sink_impl;
     friend class file_data_source_impl;
+    friend class net::posix_data_sink_impl; // for sendfile()
 };
 
 /// \brief Helper for ensuring a file is closed after \c func is called.
@@ -0,0 +1,568 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+// An unordered map of keys to values, stored in place in an open-addressing
+// table, for the lookups to touch a cache line or two rather than follow the
+// nodes of std::unordered_map.
+//
+// The table is a "Swiss table": next to the slots of the values, a control
+// byte for each slot tells whether it is empty, deleted, or full, with 7
+// bits of the hash of the key it holds. A lookup probes the slots by groups
+// of 16, comparing the control bytes of a whole group with those 7 bits at
+// once (with SSE2 when available), and only compares the keys of the slots
+// that matched, which is about never for those of other keys.
+//
+// Unlike std::unordered_map, and other Swiss tables, flat_hash_map never
+// rehashes all its entries at once: when the table is too full, it allocates
+// one twice as large (or as large, to purge the deleted slots) and migrates
+// the entries of the previous one to it as it goes, a couple of groups per
+// insertion, or more with migrate(), which can be called in a loop with
+// maybe_yield() to finish migrating a large table sooner. Lookups and
+// erasures look in both tables meanwhile. Growing a map of millions of
+// entries does not stall the reactor; it costs twice its memory until the
+// migration is over, as growing any table does.
+//
+//     while (!map.migrate(1024)) {
+//         co_await coroutine::maybe_yield();
+//     }
+//
+// Inserting may move entries, invalidating references and iterators, as
+// rehashing an std::unordered_map does; erasing invalidates only those of
+// the entries erased. The key and the value must be nothrow move
+// constructible, to be migrated.
+SEASTAR_MODULE_EXPORT
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class flat_hash_map {
+    static_assert(std::is_nothrow_move_constructible_v<Key> && std::is_nothrow_move_constructible_v<T>,
+            "flat_hash_map entries are migrated between tables");
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using reference = value_type&;
+    using const_reference = const value_type&;
+    // The slots of a group, probed at once
+    static constexpr size_t group_size = 16;
+    // The groups migrated on each insertion while the map grows, enough to
+    // be done well before the new table fills up
+    static constexpr size_t groups_migrated_per_insertion = 2;
+private:
+    // The control byte of a full slot is 7 bits of the hash of its key,
+    // those of the free slots have their sign bit set
+    static constexpr int8_t ctrl_empty = -128;
+    static constexpr int8_t ctrl_deleted = -2;
+
+    struct table {
+        value_type* slots = nullptr;
+        int8_t* ctrl = nullptr;
+        // A power of two, multiple of group_size, or zero
+        size_t capacity = 0;
+        // The full slots, and those that are full or deleted, which the
+        // load factor counts as a probe does not stop at them
+        size_t size = 0;
+        size_t used = 0;
+
+        bool is_full(size_t i) const noexcept {
+            return ctrl[i] >= 0;
+        }
+    };
+
+    // The control bytes of a group, as masks of its slots
+    class group {
+#ifdef __SSE2__
+        __m128i _ctrl;
+    public:
+        explicit group(const int8_t* ctrl) noexcept : _ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+        uint32_t match(int8_t h2) const noexcept {
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), _ctrl));
+        }
+        uint32_t match_free() const noexcept {
+            return _mm_movemask_epi8(_ctrl);
+        }
+#else
+        const int8_t* _ctrl;
+    public:
+        explicit group(const int8_t* ctrl) noexcept : _ctrl(ctrl) {}
+        uint32_t match(int8_t h2) const noexcept {
+            uint32_t m = 0;
+            for (size_t i = 0; i < group_size; ++i) {
+                m |= uint32_t(_ctrl[i] == h2) << i;
+            }
+            return m;
+        }
+        uint32_t match_free() const noexcept {
+            uint32_t m = 0;
+            for (size_t i = 0; i < group_size; ++i) {
+                m |= uint32_t(_ctrl[i] < 0) << i;
+            }
+            return m;
+        }
+#endif
+        uint32_t match_empty() const noexcept {
+            return match(ctrl_empty);
+        }
+    };
+
+    // The table inserted into, and the one migrated from, if any
+    table _cur;
+    table _old;
+    // The slots of _old migrated so far
+    size_t _migrated = 0;
+    [[no_unique_address]] Hash _hash;
+    [[no_unique_address]] KeyEqual _eq;
+
+    static constexpr size_t npos = size_t(-1);
+    // What a group probed returns to probe the next one
+    static constexpr size_t next_group = npos - 1;
+
+    // Mixes the hash for its low bits, std::hash of integers being the
+    // integers themselves
+    size_t hash_of(const Key& key) const {
+        uint64_t h = uint64_t(_hash(key)) * 0x9e3779b97f4a7c15ull;
+        return h ^ (h >> 32);
+    }
+    static int8_t h2(size_t h) noexcept {
+        return int8_t(h & 0x7f);
+    }
+    // Probes the groups of t from that of h, triangularly, which visits
+    // them all as their number is a power of two
+    template <typename Func>
+    static size_t probe(const table& t, size_t h, Func func) noexcept(noexcept(func(group(nullptr), size_t(0)))) {
+        auto mask = t.capacity / group_size - 1;
+        auto g = (h >> 7) & mask;
+        for (size_t i = 1; ; ++i) {
+            auto base = g * group_size;
+            auto found = func(group(t.ctrl + base), base);
+            if (found != next_group) {
+                return found;
+            }
+            g = (g + i) & mask;
+        }
+    }
+    size_t find_in(const table& t, const Key& key, size_t h) const {
+        if (!t.size) {
+            return npos;
+        }
+        return probe(t, h, [&] (group grp, size_t base) {
+            for (auto m = grp.match(h2(h)); m; m &= m - 1) {
+                auto i = base + std::countr_zero(m);
+                if (_eq(t.slots[i].first, key)) {
+                    return i;
+                }
+            }
+            return grp.match_empty() ? npos : next_group;
+        });
+    }
+    static size_t find_free(const table& t, size_t h) noexcept {
+        return probe(t, h, [] (group grp, size_t base) noexcept {
+            auto m = grp.match_free();
+            return m ? base + std::countr_zero(m) : next_group;
+        });
+    }
+    // At most 7/8 of the slots are used, leaving probes empty slots to stop at
+    static size_t max_used(size_t capacity) noexcept {
+        return capacity - capacity / 8;
+    }
+
+    static table make_table(size_t capacity) {
+        table t;
+        t.capacity = capacity;
+        auto p = static_cast<char*>(::operator new(capacity * (sizeof(value_type) + 1), std::align_val_t(alignof(value_type))));
+        t.slots = reinterpret_cast<value_type*>(p);
+        t.ctrl = reinterpret_cast<int8_t*>(p + capacity * sizeof(value_type));
+        std::memset(t.ctrl, ctrl_empty, capacity);
+        return t;
+    }
+    static void destroy_table(table& t) noexcept {
+        if (!t.capacity) {
+            return;
+        }
+        if constexpr (!std::is_trivially_destructible_v<value_type>) {
+            for (size_t i = 0; i < t.capacity && t.size; ++i) {
+                if (t.is_full(i)) {
+                    t.slots[i].~value_type();
+                    --t.size;
+                }
+            }
+        }
+        ::operator delete(static_cast<void*>(t.slots), std::align_val_t(alignof(value_type)));
+        t = table();
+    }
+    static void erase_slot(table& t, size_t i) noexcept {
+        t.slots[i].~value_type();
+        t.ctrl[i] = ctrl_deleted;
+        --t.size;
+    }
+
+    // Moves the entries of the next groups of _old to _cur, freeing _old
+    // once they all are
+    void migrate_groups(size_t groups) noexcept {
+        auto end = std::min(_old.capacity, _migrated + groups * group_size);
+        for (; _migrated < end && _old.size; ++_migrated) {
+            if (!_old.is_full(_migrated)) {
+                continue;
+            }
+            auto& from = _old.slots[_migrated];
+            auto h = hash_of(from.first);
+            auto i = find_free(_cur, h);
+            _cur.used += _cur.ctrl[i] == ctrl_empty;
+            new (&_cur.slots[i]) value_type(std::move(const_cast<Key&>(from.first)), std::move(from.second));
+            _cur.ctrl[i] = h2(h);
+            ++_cur.size;
+            // Deleted rather than empty, for the probes of the entries
+            // not migrated yet to go past it
+            erase_slot(_old, _migrated);
+        }
+        if (!_old.size) {
+            destroy_table(_old);
+            _migrated = 0;
+        }
+    }
+    // Makes room for an entry in _cur
+    void prepare_insert() {
+        if (_old.capacity) {
+            migrate_groups(groups_migrated_per_insertion);
+        }
+        if (_cur.used < max_used(_cur.capacity)) {
+            return;
+        }
+        // Migrations are over long before the table fills up again, but
+        // for tables too small to migrate over many insertions
+        if (_old.capacity) {
+            migrate_groups(_old.capacity / group_size);
+        }
+        // Grown unless most of the used slots are deleted ones, that a
+        // table as large purges
+        auto capacity = std::max(group_size, _cur.size * 2 >= max_used(_cur.capacity) ? _cur.capacity * 2 : _cur.capacity);
+        start_migration(capacity);
+    }
+    void start_migration(size_t capacity) {
+        auto t = make_table(capacity);
+        _old = std::exchange(_cur, t);
+        _migrated = 0;
+        if (!_old.size) {
+            destroy_table(_old);
+        }
+    }
+    template <typename K, typename... Args>
+    std::pair<size_t, bool> insert_in_cur(size_t h, K&& key, Args&&... args) {
+        prepare_insert();
+        auto i = find_free(_cur, h);
+        new (&_cur.slots[i]) value_type(std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        _cur.used += _cur.ctrl[i] == ctrl_empty;
+        _cur.ctrl[i] = h2(h);
+        ++_cur.size;
+        return {i, true};
+    }
+
+    template <bool Const>
+    class iterator_type {
+        using map_type = std::conditional_t<Const, const flat_hash_map, flat_hash_map>;
+        map_type* _map = nullptr;
+        // Into _cur, then _old
+        bool _in_old = false;
+        size_t _i = 0;
+
+        const table& t() const noexcept {
+            return _in_old ? _map->_old : _map->_cur;
+        }
+        void skip_free() noexcept {
+            while (true) {
+                auto& tbl = t();
+                while (_i < tbl.capacity && !tbl.is_full(_i)) {
+                    ++_i;
+                }
+                if (_i < tbl.capacity || _in_old) {
+                    return;
+                }
+                _in_old = true;
+                _i = 0;
+            }
+        }
+        iterator_type(map_type* map, bool in_old, size_t i) noexcept : _map(map), _in_old(in_old), _i(i) {}
+        friend class flat_hash_map;
+        template <bool>
+        friend class iterator_type;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = flat_hash_map::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+        iterator_type() noexcept = default;
+        operator iterator_type<true>() const noexcept {
+            return iterator_type<true>(_map, _in_old, _i);
+        }
+        reference operator*() const noexcept {
+            return t().slots[_i];
+        }
+        pointer operator->() const noexcept {
+            return &t().slots[_i];
+        }
+        iterator_type& operator++() noexcept {
+            ++_i;
+            skip_free();
+            return *this;
+        }
+        iterator_type operator++(int) noexcept {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        bool operator==(const iterator_type& o) const noexcept {
+            return _in_old == o._in_old && _i == o._i;
+        }
+    };
+public:
+    using iterator = iterator_type<false>;
+    using const_iterator = iterator_type<true>;
+
+    flat_hash_map() noexcept(std::is_nothrow_default_constructible_v<Hash> && std::is_nothrow_default_constructible_v<KeyEqual>) = default;
+    explicit flat_hash_map(size_t n, const Hash& hash = Hash(), const KeyEqual& eq = KeyEqual())
+            : _hash(hash), _eq(eq) {
+        reserve(n);
+    }
+    flat_hash_map(std::initializer_list<value_type> init) {
+        reserve(init.size());
+        for (auto& v : init) {
+            insert(v);
+        }
+    }
+    flat_hash_map(flat_hash_map&& o) noexcept
+            : _cur(std::exchange(o._cur, {}))
+            , _old(std::exchange(o._old, {}))
+            , _migrated(std::exchange(o._migrated, 0))
+            , _hash(std::move(o._hash))
+            , _eq(std::move(o._eq)) {
+    }
+    flat_hash_map(const flat_hash_map& o)
+            : _hash(o._hash)
+            , _eq(o._eq) {
+        reserve(o.size());
+        for (auto& v : o) {
+            insert(v);
+        }
+    }
+    flat_hash_map& operator=(flat_hash_map&& o) noexcept {
+        if (this != &o) {
+            clear();
+            _cur = std::exchange(o._cur, {});
+            _old = std::exchange(o._old, {});
+            _migrated = std::exchange(o._migrated, 0);
+            _hash = std::move(o._hash);
+            _eq = std::move(o._eq);
+        }
+        return *this;
+    }
+    flat_hash_map& operator=(const flat_hash_map& o) {
+        if (this != &o) {
+            *this = flat_hash_map(o);
+        }
+        return *this;
+    }
+    ~flat_hash_map() {
+        destroy_table(_cur);
+        destroy_table(_old);
+    }
+
+    iterator begin() noexcept {
+        iterator it(this, false, 0);
+        it.skip_free();
+        return it;
+    }
+    const_iterator begin() const noexcept {
+        const_iterator it(this, false, 0);
+        it.skip_free();
+        return it;
+    }
+    iterator end() noexcept {
+        return iterator(this, true, _old.capacity);
+    }
+    const_iterator end() const noexcept {
+        return const_iterator(this, true, _old.capacity);
+    }
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    size_t size() const noexcept {
+        return _cur.size + _old.size;
+    }
+    bool empty() const noexcept {
+        return !size();
+    }
+    // The slots of the table inserted into
+    size_t capacity() const noexcept {
+        return _cur.capacity;
+    }
+    // Whether the entries of a previous table are still being migrated
+    bool migrating() const noexcept {
+        return _old.capacity;
+    }
+    // Migrates the entries of the next groups of the previous table, if
+    // any, returning whether the migration is over
+    bool migrate(size_t groups) noexcept {
+        if (_old.capacity) {
+            migrate_groups(groups);
+        }
+        return !_old.capacity;
+    }
+
+    iterator find(const Key& key) {
+        auto h = hash_of(key);
+        if (auto i = find_in(_cur, key, h); i != npos) {
+            return iterator(this, false, i);
+        }
+        if (auto i = find_in(_old, key, h); i != npos) {
+            return iterator(this, true, i);
+        }
+        return end();
+    }
+    const_iterator find(const Key& key) const {
+        return const_cast<flat_hash_map*>(this)->find(key);
+    }
+    bool contains(const Key& key) const {
+        return find(key) != end();
+    }
+    size_t count(const Key& key) const {
+        return contains(key);
+    }
+    T& at(const Key& key) {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("flat_hash_map::at");
+        }
+        return it->second;
+    }
+    const T& at(const Key& key) const {
+        return const_cast<flat_hash_map*>(this)->at(key);
+    }
+
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        auto h = hash_of(key);
+        if (auto i = find_in(_cur, key, h); i != npos) {
+            return {iterator(this, false, i), false};
+        }
+        if (auto i = find_in(_old, key, h); i != npos) {
+            return {iterator(this, true, i), false};
+        }
+        auto [i, inserted] = insert_in_cur(h, std::forward<K>(key), std::forward<Args>(args)...);
+        return {iterator(this, false, i), inserted};
+    }
+    template <typename K, typename V>
+    std::pair<iterator, bool> emplace(K&& key, V&& value) {
+        return try_emplace(std::forward<K>(key), std::forward<V>(value));
+    }
+    std::pair<iterator, bool> insert(const value_type& v) {
+        return try_emplace(v.first, v.second);
+    }
+    std::pair<iterator, bool> insert(value_type&& v) {
+        return try_emplace(std::move(const_cast<Key&>(v.first)), std::move(v.second));
+    }
+    template <typename V>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, V&& value) {
+        auto [it, inserted] = try_emplace(key, std::forward<V>(value));
+        if (!inserted) {
+            it->second = std::forward<V>(value);
+        }
+        return {it, inserted};
+    }
+    T& operator[](const Key& key) {
+        return try_emplace(key).first->second;
+    }
+    T& operator[](Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    size_t erase(const Key& key) {
+        auto it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+    iterator erase(const_iterator pos) noexcept {
+        iterator it(this, pos._in_old, pos._i);
+        erase_slot(it._in_old ? _old : _cur, it._i);
+        ++it;
+        return it;
+    }
+    void clear() noexcept {
+        destroy_table(_cur);
+        destroy_table(_old);
+        _migrated = 0;
+    }
+    // Makes room for n entries, in a table the current entries migrate to
+    // if it is not large enough
+    void reserve(size_t n) {
+        auto needed = std::bit_ceil(std::max(group_size, n + n / 7 + 1));
+        if (needed <= _cur.capacity) {
+            return;
+        }
+        // A single migration at a time
+        if (_old.capacity) {
+            migrate_groups(_old.capacity / group_size);
+        }
+        start_migration(needed);
+    }
+
+    hasher hash_function() const {
+        return _hash;
+    }
+    key_equal key_eq() const {
+        return _eq;
+    }
+};
+
+}
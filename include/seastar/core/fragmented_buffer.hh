@@ -0,0 +1,273 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cassert>
+#include <string_view>
+#include <utility>
+#include <vector>
+#endif
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+/// \addtogroup memory-module
+/// @{
+
+/// An immutable sequence of bytes made of \ref temporary_buffer fragments.
+///
+/// A \c fragmented_buffer carries a payload through parsing, routing and
+/// replying without copying it: the buffers received or built are appended
+/// as they are, and slicing it, \ref share(), only shares them. The
+/// fragments are in an array shared by the buffers sliced from one another,
+/// with the offset each ends at, so that a slice takes O(1) and finding a
+/// position O(log n) of the fragments. Appending adds to the shared array
+/// when the buffer ends at the end of it, which another buffer sharing it
+/// does not see, and copies the fragments of the buffer first otherwise,
+/// but never their bytes.
+///
+/// It converts to and from \ref net::packet, and rpc's \c snd_buf and
+/// \c rcv_buf, as the fragments of these are, move-constructing from the
+/// \c std::vector of its fragments, as \ref net::packet::release() returns.
+///
+/// As a \ref temporary_buffer, a \c fragmented_buffer keeps all the memory of
+/// the buffers it shares, and should not be held indefinitely.
+SEASTAR_MODULE_EXPORT
+class fragmented_buffer {
+    struct rep {
+        std::vector<temporary_buffer<char>> fragments;
+        // The offset, from the start of the first fragment, past each
+        std::vector<size_t> ends;
+
+        size_t size() const noexcept {
+            return ends.empty() ? 0 : ends.back();
+        }
+        void reserve(size_t n) {
+            fragments.reserve(fragments.size() + n);
+            ends.reserve(ends.size() + n);
+        }
+        // Needs the room reserved
+        void push_back(temporary_buffer<char> buf) noexcept {
+            ends.push_back(size() + buf.size());
+            fragments.push_back(std::move(buf));
+        }
+        // The fragment holding the byte at pos
+        size_t fragment_at(size_t pos) const noexcept {
+            return std::upper_bound(ends.begin(), ends.end(), pos) - ends.begin();
+        }
+    };
+    lw_shared_ptr<rep> _rep;
+    // The bytes of the array this buffer is
+    size_t _begin = 0;
+    size_t _size = 0;
+
+    // Calls func with each fragment, trimmed to the bytes of the buffer, and
+    // the offset into it they start at
+    template <typename Func>
+    void walk(Func&& func) const {
+        if (!_size) {
+            return;
+        }
+        auto& r = *_rep;
+        auto end = _begin + _size;
+        for (auto i = r.fragment_at(_begin), pos = _begin; pos != end; ++i) {
+            auto& frag = r.fragments[i];
+            auto off = pos - (r.ends[i] - frag.size());
+            auto n = std::min(r.ends[i], end) - pos;
+            func(frag, off, n);
+            pos += n;
+        }
+    }
+    // Makes this buffer the end of an array of its own, if another
+    // sharing its array goes further
+    void prepare_append(size_t nr_fragments) {
+        if (!_rep) {
+            _rep = make_lw_shared<rep>();
+        } else if (_begin + _size != _rep->size()) {
+            auto r = make_lw_shared<rep>();
+            r->reserve(nr_fragments + _rep->fragments.size());
+            walk([&r] (temporary_buffer<char>& frag, size_t off, size_t n) {
+                r->push_back(frag.share(off, n));
+            });
+            _rep = std::move(r);
+            _begin = 0;
+        }
+        _rep->reserve(nr_fragments);
+    }
+public:
+    /// Creates an empty buffer
+    fragmented_buffer() noexcept = default;
+    /// Creates a buffer of a single fragment
+    explicit fragmented_buffer(temporary_buffer<char> buf) {
+        append(std::move(buf));
+    }
+    /// Creates a buffer of the given fragments
+    explicit fragmented_buffer(std::vector<temporary_buffer<char>> fragments) {
+        prepare_append(fragments.size());
+        for (auto& f : fragments) {
+            if (!f.empty()) {
+                _size += f.size();
+                _rep->push_back(std::move(f));
+            }
+        }
+    }
+    fragmented_buffer(fragmented_buffer&& x) noexcept
+        : _rep(std::move(x._rep)), _begin(std::exchange(x._begin, 0)), _size(std::exchange(x._size, 0)) {}
+    fragmented_buffer& operator=(fragmented_buffer&& x) noexcept {
+        if (this != &x) {
+            _rep = std::move(x._rep);
+            _begin = std::exchange(x._begin, 0);
+            _size = std::exchange(x._size, 0);
+        }
+        return *this;
+    }
+
+    size_t size() const noexcept {
+        return _size;
+    }
+    bool empty() const noexcept {
+        return !_size;
+    }
+
+    /// Creates a buffer of the same bytes, sharing their fragments
+    fragmented_buffer share() const noexcept {
+        return share(0, _size);
+    }
+    /// Creates a buffer of the \c len bytes from \c pos, sharing their
+    /// fragments, in O(1)
+    fragmented_buffer share(size_t pos, size_t len) const noexcept {
+        assert(pos + len <= _size);
+        fragmented_buffer ret;
+        if (len) {
+            ret._rep = _rep;
+            ret._begin = _begin + pos;
+            ret._size = len;
+        }
+        return ret;
+    }
+    /// Removes the first \c n bytes
+    void trim_front(size_t n) noexcept {
+        assert(n <= _size);
+        _begin += n;
+        _size -= n;
+    }
+    /// Keeps only the first \c n bytes
+    void trim(size_t n) noexcept {
+        assert(n <= _size);
+        _size = n;
+    }
+
+    /// Appends a fragment
+    void append(temporary_buffer<char> buf) {
+        if (buf.empty()) {
+            return;
+        }
+        prepare_append(1);
+        _size += buf.size();
+        _rep->push_back(std::move(buf));
+    }
+    /// Appends the bytes of another buffer, sharing their fragments
+    void append(const fragmented_buffer& x) {
+        if (x.empty()) {
+            return;
+        }
+        auto& xr = *x._rep;
+        prepare_append(xr.fragment_at(x._begin + x._size - 1) - xr.fragment_at(x._begin) + 1);
+        x.walk([this] (temporary_buffer<char>& frag, size_t off, size_t n) {
+            _rep->push_back(frag.share(off, n));
+        });
+        _size += x._size;
+    }
+
+    /// The byte at \c pos, in O(log n) of the fragments
+    char operator[](size_t pos) const noexcept {
+        auto& r = *_rep;
+        pos += _begin;
+        auto i = r.fragment_at(pos);
+        return r.fragments[i][pos - (r.ends[i] - r.fragments[i].size())];
+    }
+
+    /// Calls \c func with each fragment, as a \c std::string_view
+    template <typename Func>
+    void for_each_fragment(Func&& func) const {
+        walk([&func] (temporary_buffer<char>& frag, size_t off, size_t n) {
+            func(std::string_view(frag.get() + off, n));
+        });
+    }
+
+    /// The number of fragments
+    size_t fragment_count() const noexcept {
+        if (!_size) {
+            return 0;
+        }
+        return _rep->fragment_at(_begin + _size - 1) - _rep->fragment_at(_begin) + 1;
+    }
+
+    /// Buffers sharing the fragments, trimmed to the bytes of this buffer
+    std::vector<temporary_buffer<char>> share_fragments() const {
+        std::vector<temporary_buffer<char>> ret;
+        ret.reserve(fragment_count());
+        walk([&ret] (temporary_buffer<char>& frag, size_t off, size_t n) {
+            ret.push_back(frag.share(off, n));
+        });
+        return ret;
+    }
+
+    /// The bytes in a single buffer, sharing the fragment if there is
+    /// only one, or copying them otherwise
+    temporary_buffer<char> linearize() const {
+        if (fragment_count() == 1) {
+            temporary_buffer<char> ret;
+            walk([&ret] (temporary_buffer<char>& frag, size_t off, size_t n) {
+                ret = frag.share(off, n);
+            });
+            return ret;
+        }
+        temporary_buffer<char> ret(_size);
+        auto p = ret.get_write();
+        for_each_fragment([&p] (std::string_view f) {
+            p = std::copy(f.begin(), f.end(), p);
+        });
+        return ret;
+    }
+
+    /// Whether the bytes are those of \c s
+    bool operator==(std::string_view s) const noexcept {
+        if (s.size() != _size) {
+            return false;
+        }
+        bool equal = true;
+        for_each_fragment([&s, &equal] (std::string_view f) {
+            equal = equal && s.starts_with(f);
+            s.remove_prefix(f.size());
+        });
+        return equal;
+    }
+};
+
+/// @}
+
+}
@@ -22,6 +22,9 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstddef>
+#include <vector>
 #include <sys/inotify.h>
 
 #include <seastar/core/future.hh>
@@ -165,6 +168,32 @@ class fsnotifier {
     /// \return a future that becomes ready when registered events occur.
     future<std::vector<event>> wait() const;
 
+    /// \brief Options of a batched \ref wait().
+    struct batch_options {
+        /// The events to return. The names of the others are not copied.
+        /// The \ref flags::ignored events are always returned.
+        flags mask = flags(IN_ALL_EVENTS);
+        /// How long to keep collecting events after the first ones, for
+        /// the bursts of events of a file to be coalesced.
+        std::chrono::milliseconds window{0};
+        /// The size of the buffer the events are read in at a time.
+        size_t buffer_size = 65536;
+    };
+
+    /// Wait for events, and take them in batches.
+    ///
+    /// The events of a file that only tell it was accessed, modified,
+    /// opened or closed, or had its metadata changed, are coalesced into
+    /// the previous such event of the file in the batch, unless an event
+    /// that created, deleted or moved it came in between: a storm of
+    /// writes to a file is reported as a single event, with the union of
+    /// the flags of the events it stands for.
+    ///
+    /// \return a future that becomes ready when registered events matching
+    ///         \c opts.mask occur, with those that came within
+    ///         \c opts.window of the first ones.
+    future<std::vector<event>> wait(const batch_options& opts) const;
+
     /// Shutdown the notifier and abort any waiting events.
     ///
     /// \note After shutdown, all watches are invalidated,
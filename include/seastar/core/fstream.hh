@@ -64,8 +64,23 @@ struct file_input_stream_options {
     ::seastar::io_priority_class io_priority_class = default_priority_class();
 #endif
     lw_shared_ptr<file_input_stream_history> dynamic_adjustments = { }; ///< Input stream history, if null dynamic adjustments are disabled
+    /// Scale the read-ahead depth with the stream's consumption rate and
+    /// I/O latency, keeping enough reads in flight to cover the latency at
+    /// the rate the data is consumed, up to \c read_ahead (or an internal
+    /// limit if it is zero). Read-ahead buffers of all adaptive streams of
+    /// a shard are capped by \ref set_read_ahead_memory_budget().
+    bool adaptive_read_ahead = false;
 };
 
+/// \brief Sets the per-shard memory budget of adaptive read-ahead.
+///
+/// Streams opened with file_input_stream_options::adaptive_read_ahead
+/// don't issue read-aheads while their buffers (in flight or waiting to be
+/// consumed), together with those of the other such streams on the shard,
+/// exceed the budget. Reads the consumer is waiting for are always issued.
+/// Defaults to 1/32 of the shard's memory.
+void set_read_ahead_memory_budget(size_t bytes) noexcept;
+
 /// \brief Creates an input_stream to read a portion of a file.
 ///
 /// \param file File to read; multiple streams for the same file may coexist
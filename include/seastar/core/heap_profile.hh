@@ -0,0 +1,90 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// \brief The sampled heap profiles of all the shards, exported in the
+/// format of pprof.
+///
+/// The allocations sampled by the heap profiler, see
+/// \ref memory::set_heap_profiling_sampling_rate(), are exported in the
+/// protobuf format of pprof and other profile viewers, aggregated over the
+/// shards. A profile has four values for each allocation backtrace, as the
+/// heap profiles of Go have:
+///
+///  * \c alloc_objects and \c alloc_space, all the allocations sampled, see
+///    \ref memory::sampled_cumulative_memory_profile();
+///  * \c inuse_objects and \c inuse_space, those still live, see
+///    \ref memory::sampled_memory_profile(), the default.
+///
+/// The sizes are extrapolated from the samples. The frames are resolved
+/// from the dynamic symbol table by seastar, for the binaries linked with
+/// \c -rdynamic; pprof resolves the others from the binaries mapped, given
+/// their debug information.
+///
+/// \code
+/// curl -X POST 'http://host:port/heap_profile/sampling_rate?rate=1000003'
+/// curl -o heap.pb 'http://host:port/heap_profile'
+/// pprof -http=: heap.pb
+/// \endcode
+///
+/// It needs seastar to be built with \c SEASTAR_HEAPPROF and its allocator;
+/// the profiles are empty otherwise.
+namespace heap_profile {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The profile of all the shards, an uncompressed pprof \c Profile message
+///
+/// \param reset starts the cumulative profiles of the shards over once
+///     collected
+future<sstring> collect(bool reset = false);
+
+/// Sets the heap profiling sampling rate of all the shards, zero disabling
+/// the profiler, see \ref memory::set_heap_profiling_sampling_rate()
+future<> set_sampling_rate(size_t rate);
+
+/// Adds endpoints to \c server:
+///
+///  * GET \c path serves the profile, starting the cumulative ones over if
+///    the request has the \c reset=true query parameter;
+///  * GET \c path/sampling_rate serves the sampling rate;
+///  * POST \c path/sampling_rate sets it to its \c rate query parameter.
+future<> add_routes(httpd::http_server& server, sstring path = "/heap_profile");
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -0,0 +1,128 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/std-compat.hh>
+
+#ifndef SEASTAR_MODULE
+#include <array>
+#include <cstddef>
+#include <new>
+#endif
+
+// Coroutine frames are allocated from the pool unless the build opts out
+// with SEASTAR_NO_COROUTINE_FRAME_POOL. Debug and sanitizer builds opt out,
+// since recycled frames would hide use-after-free bugs from them.
+#if !defined(SEASTAR_NO_COROUTINE_FRAME_POOL) && !defined(SEASTAR_DEBUG) && !defined(SEASTAR_ASAN_ENABLED)
+#define SEASTAR_COROUTINE_FRAME_POOL
+#endif
+
+namespace seastar::internal {
+
+// Per-thread freelists of coroutine frames, by size class.
+//
+// Coroutines allocate and free their frames at a high rate, in a few
+// distinct sizes per program, so frames of the sizes the pool covers are
+// recycled in LIFO order, reusing the most recently freed (and likely
+// cache-hot) frame. Frames are rounded up to their size class, so that
+// any frame of a class can serve any coroutine of it.
+class coroutine_frame_pool {
+    static constexpr size_t granularity = 16;
+    static constexpr size_t max_frame_size = 2048;
+    static constexpr size_t nr_classes = max_frame_size / granularity;
+
+    struct free_frame {
+        free_frame* next;
+    };
+
+    std::array<free_frame*, nr_classes> _free = {};
+    size_t _pooled_bytes = 0;
+    size_t _max_pooled_bytes = default_max_pooled_bytes;
+
+    static size_t class_of(size_t size) noexcept {
+        return (size - 1) / granularity;
+    }
+    static size_t class_size(size_t size) noexcept {
+        return (class_of(size) + 1) * granularity;
+    }
+public:
+    static constexpr size_t default_max_pooled_bytes = 256 << 10;
+
+    void* allocate(size_t size) {
+        if (size > max_frame_size) {
+            return ::operator new(size);
+        }
+        auto& head = _free[class_of(size)];
+        if (auto* frame = head) {
+            head = frame->next;
+            _pooled_bytes -= class_size(size);
+            return frame;
+        }
+        return ::operator new(class_size(size));
+    }
+
+    void deallocate(void* ptr, size_t size) noexcept {
+        if (size > max_frame_size) {
+            ::operator delete(ptr, size);
+            return;
+        }
+        auto csize = class_size(size);
+        if (_pooled_bytes + csize > _max_pooled_bytes) {
+            ::operator delete(ptr, csize);
+            return;
+        }
+        auto& head = _free[class_of(size)];
+        head = new (ptr) free_frame{head};
+        _pooled_bytes += csize;
+    }
+
+    // Sets the number of bytes of free frames kept; 0 disables pooling
+    void set_max_pooled_bytes(size_t bytes) noexcept {
+        _max_pooled_bytes = bytes;
+        drain();
+    }
+
+    size_t max_pooled_bytes() const noexcept {
+        return _max_pooled_bytes;
+    }
+
+    size_t pooled_bytes() const noexcept {
+        return _pooled_bytes;
+    }
+
+    // Frees the pooled frames
+    void drain() noexcept {
+        for (size_t c = 0; c < nr_classes; ++c) {
+            while (auto* frame = _free[c]) {
+                _free[c] = frame->next;
+                ::operator delete(frame, (c + 1) * granularity);
+            }
+        }
+        _pooled_bytes = 0;
+    }
+};
+
+// Trivially destructible and constant initialized, so that accessing it
+// needs no TLS wrapper; the reactor drains it when it is destroyed.
+extern thread_local constinit coroutine_frame_pool this_thread_coroutine_frame_pool;
+
+}
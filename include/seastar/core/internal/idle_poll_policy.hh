@@ -0,0 +1,145 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/spinlock.hh>
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace seastar::internal {
+
+// How a reactor with no work waits for some more
+enum class idle_action {
+    spin,   // poll again after cpu_relax()
+    pause,  // poll again after a short light sleep of the core (tpause)
+    sleep,  // block in the reactor backend
+};
+
+// Whether the CPU can pause a core until a deadline (tpause, from WAITPKG)
+inline bool have_tpause() noexcept {
+#if defined(__x86_64__)
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return ecx & (1 << 5);
+#else
+    return false;
+#endif
+}
+
+// Pauses the core for up to the given number of TSC cycles in its
+// power-saving C0.2 state, or until an interrupt. The kernel may cap the
+// pause to a shorter one. Only to be called if have_tpause().
+inline void tpause(uint64_t cycles) noexcept {
+#if defined(__x86_64__)
+    uint64_t deadline = __rdtsc() + cycles;
+    // tpause %ecx, encoded so that the assembler needs no WAITPKG support
+    __asm__ volatile(".byte 0x66, 0x0f, 0xae, 0xf1"
+            :
+            : "c"(0), "a"(uint32_t(deadline)), "d"(uint32_t(deadline >> 32))
+            : "cc", "memory");
+#else
+    cpu_relax();
+#endif
+}
+
+// Chooses how an idle reactor waits for work, from the lengths of its
+// past idle periods.
+//
+// The fixed policy spins for the whole --idle-poll-time-us window before
+// sleeping: a mostly idle shard burns a core spinning for work that will
+// not come in time, while a shard whose work arrives just after the window
+// pays for a wakeup. The adaptive one keeps an exponentially weighted
+// average of the idle periods and
+// - sleeps right away if work is not expected within the window;
+// - otherwise spins until the expected arrival of work, then pauses the
+//   core (if the CPU supports it) until several times that, and sleeps
+//   past it, never longer than the window.
+class idle_poll_policy {
+public:
+    using duration = std::chrono::nanoseconds;
+private:
+    static constexpr unsigned ewma_shift = 3;
+    static constexpr unsigned window_factor = 4;
+    // The shortest spin, so that a few short idle periods in a row do
+    // not make every following one sleep
+    static constexpr duration min_window = std::chrono::microseconds(10);
+    // A few microseconds, short enough for the pause not to add latency
+    // noticeable next to a poll
+    static constexpr uint64_t pause_cycles = 10000;
+
+    duration _max_poll_time;
+    duration _expected{0};
+    bool _adaptive;
+    bool _pause;
+public:
+    idle_poll_policy(duration max_poll_time, bool adaptive, bool pause) noexcept
+            : _max_poll_time(max_poll_time), _adaptive(adaptive), _pause(pause) {}
+
+    duration max_poll_time() const noexcept {
+        return _max_poll_time;
+    }
+
+    // Records an idle period, ended by work arriving
+    void record_idle(duration idle) noexcept {
+        _expected += (idle - _expected) / (1 << ewma_shift);
+    }
+
+    // The expected length of the next idle period
+    duration expected_idle() const noexcept {
+        return _expected;
+    }
+
+    // How to wait, after having been idle for the given time
+    idle_action decide(duration idle) const noexcept {
+        if (!_adaptive) {
+            return idle > _max_poll_time ? idle_action::sleep : idle_action::spin;
+        }
+        if (_expected >= _max_poll_time) {
+            return idle_action::sleep;
+        }
+        auto window = std::min(std::max(_expected * window_factor, min_window), _max_poll_time);
+        if (idle > window) {
+            return idle_action::sleep;
+        }
+        if (idle < _expected || !_pause) {
+            return idle_action::spin;
+        }
+        return idle_action::pause;
+    }
+
+    // Waits as idle_action::pause does
+    void pause() const noexcept {
+        tpause(pause_cycles);
+    }
+};
+
+}
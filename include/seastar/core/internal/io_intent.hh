@@ -46,9 +46,20 @@ namespace internal {
  * This IO queue is the fair_queue's priority_class's one.
  * Beware, if requests from different IO queues happen
  * in the same cancellable queue the whole thing blows up.
+ *
+ * Requests that are dispatched from the IO queue move to
+ * the list of dispatched ones, which are cancelled in the
+ * kernel (if the reactor backend can) along with the queue.
  */
 class cancellable_queue {
 public:
+    class dispatched_link : public bi::list_base_hook<bi::link_mode<bi::auto_unlink>> {
+    public:
+        virtual void on_cancel() noexcept = 0;
+    protected:
+        ~dispatched_link() = default;
+    };
+
     class link {
         friend class cancellable_queue;
 
@@ -65,10 +76,13 @@ class cancellable_queue {
             cq.push_back(*this);
         }
 
-        void maybe_dequeue() noexcept {
-            if (_ref != nullptr) {
-                _ref->pop_front();
+        // Returns the queue the link was dequeued from, if any
+        cancellable_queue* maybe_dequeue() noexcept {
+            auto cq = _ref;
+            if (cq != nullptr) {
+                cq->pop_front();
             }
+            return cq;
         }
     };
 
@@ -79,8 +93,11 @@ class cancellable_queue {
         bi::cache_last<true>,
         bi::member_hook<link, bi::slist_member_hook<>, &link::_hook>>;
 
+    using list_of_dispatched_t = bi::list<dispatched_link, bi::constant_time_size<false>>;
+
     link* _first;
     list_of_links_t _rest;
+    list_of_dispatched_t _dispatched;
 
     void push_back(link& il) noexcept;
     void pop_front() noexcept;
@@ -91,6 +108,10 @@ class cancellable_queue {
     cancellable_queue(cancellable_queue&& o) noexcept;
     cancellable_queue& operator=(cancellable_queue&& o) noexcept;
     ~cancellable_queue();
+
+    void track_dispatched(dispatched_link& dl) noexcept {
+        _dispatched.push_back(dl);
+    }
 };
 
 /*
@@ -30,6 +30,7 @@
 #include <vector>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 namespace seastar {
 extern logger io_log;
@@ -38,7 +39,8 @@ namespace internal {
 
 class io_request {
 public:
-    enum class operation { read, readv, write, writev, fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel };
+    enum class operation { read, readv, write, writev, fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel,
+        statx, openat, unlinkat, renameat, mkdirat, nvme_cmd };
 private:
     operation _op;
     // the upper layers give us void pointers, but storing void pointers here is just
@@ -101,6 +103,54 @@ class io_request {
         int fd;
         char* addr;
     };
+    // The metadata operations, which only the io_uring backend submits
+    // (see reactor_backend::submits_metadata_ops())
+    struct statx_op {
+        int dirfd;
+        const char* path;
+        int flags;
+        unsigned mask;
+        struct ::statx* statxbuf;
+    };
+    struct openat_op {
+        int dirfd;
+        const char* path;
+        int flags;
+        mode_t mode;
+    };
+    struct unlinkat_op {
+        int dirfd;
+        const char* path;
+        int flags;
+    };
+    struct renameat_op {
+        int olddirfd;
+        const char* oldpath;
+        int newdirfd;
+        const char* newpath;
+        unsigned flags;
+    };
+    struct mkdirat_op {
+        int dirfd;
+        const char* path;
+        mode_t mode;
+    };
+    // An NVMe I/O command passed through to an NVMe generic char device,
+    // which only the io_uring backend submits (see
+    // reactor_backend::supports_nvme_passthrough())
+    struct nvme_cmd_op {
+        int fd;
+        uint32_t nsid;
+        uint8_t opcode;
+        uint32_t cdw10;
+        uint32_t cdw11;
+        uint32_t cdw12;
+        // The data buffer and its length or, if vectored, the
+        // iovec array and its length
+        char* addr;
+        size_t size;
+        bool vectored;
+    };
     union {
         read_op _read;
         readv_op _readv;
@@ -116,6 +166,12 @@ class io_request {
         poll_add_op _poll_add;
         poll_remove_op _poll_remove;
         cancel_op _cancel;
+        statx_op _statx;
+        openat_op _openat;
+        unlinkat_op _unlinkat;
+        renameat_op _renameat;
+        mkdirat_op _mkdirat;
+        nvme_cmd_op _nvme_cmd;
     };
 
 public:
@@ -279,6 +335,100 @@ class io_request {
         return req;
     }
 
+    static io_request make_statx(int dirfd, const char* path, int flags, unsigned mask, struct ::statx* statxbuf) {
+        io_request req;
+        req._op = operation::statx;
+        req._statx = {
+          .dirfd = dirfd,
+          .path = path,
+          .flags = flags,
+          .mask = mask,
+          .statxbuf = statxbuf,
+        };
+        return req;
+    }
+
+    static io_request make_openat(int dirfd, const char* path, int flags, mode_t mode) {
+        io_request req;
+        req._op = operation::openat;
+        req._openat = {
+          .dirfd = dirfd,
+          .path = path,
+          .flags = flags,
+          .mode = mode,
+        };
+        return req;
+    }
+
+    static io_request make_unlinkat(int dirfd, const char* path, int flags) {
+        io_request req;
+        req._op = operation::unlinkat;
+        req._unlinkat = {
+          .dirfd = dirfd,
+          .path = path,
+          .flags = flags,
+        };
+        return req;
+    }
+
+    static io_request make_renameat(int olddirfd, const char* oldpath, int newdirfd, const char* newpath, unsigned flags) {
+        io_request req;
+        req._op = operation::renameat;
+        req._renameat = {
+          .olddirfd = olddirfd,
+          .oldpath = oldpath,
+          .newdirfd = newdirfd,
+          .newpath = newpath,
+          .flags = flags,
+        };
+        return req;
+    }
+
+    static io_request make_mkdirat(int dirfd, const char* path, mode_t mode) {
+        io_request req;
+        req._op = operation::mkdirat;
+        req._mkdirat = {
+          .dirfd = dirfd,
+          .path = path,
+          .mode = mode,
+        };
+        return req;
+    }
+
+    static io_request make_nvme_cmd(int fd, uint32_t nsid, uint8_t opcode, uint32_t cdw10, uint32_t cdw11, uint32_t cdw12, void* address, size_t size) {
+        io_request req;
+        req._op = operation::nvme_cmd;
+        req._nvme_cmd = {
+          .fd = fd,
+          .nsid = nsid,
+          .opcode = opcode,
+          .cdw10 = cdw10,
+          .cdw11 = cdw11,
+          .cdw12 = cdw12,
+          .addr = reinterpret_cast<char*>(address),
+          .size = size,
+          .vectored = false,
+        };
+        return req;
+    }
+
+    static io_request make_nvme_cmd(int fd, uint32_t nsid, uint8_t opcode, uint32_t cdw10, uint32_t cdw11, uint32_t cdw12, std::vector<iovec>& iov) {
+        io_request req;
+        req._op = operation::nvme_cmd;
+        req._nvme_cmd = {
+          .fd = fd,
+          .nsid = nsid,
+          .opcode = opcode,
+          .cdw10 = cdw10,
+          .cdw11 = cdw11,
+          .cdw12 = cdw12,
+          .addr = reinterpret_cast<char*>(iov.data()),
+          .size = iov.size(),
+          .vectored = true,
+        };
+        return req;
+    }
+
     bool is_read() const {
         switch (_op) {
         case operation::read:
@@ -353,6 +503,24 @@ class io_request {
         if constexpr (Op == operation::cancel) {
             return _cancel;
         }
+        if constexpr (Op == operation::statx) {
+            return _statx;
+        }
+        if constexpr (Op == operation::openat) {
+            return _openat;
+        }
+        if constexpr (Op == operation::unlinkat) {
+            return _unlinkat;
+        }
+        if constexpr (Op == operation::renameat) {
+            return _renameat;
+        }
+        if constexpr (Op == operation::mkdirat) {
+            return _mkdirat;
+        }
+        if constexpr (Op == operation::nvme_cmd) {
+            return _nvme_cmd;
+        }
     }
 
     struct part;
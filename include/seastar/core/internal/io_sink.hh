@@ -50,6 +50,7 @@ class pending_io_request : private internal::io_request {
 
 class io_sink {
     circular_buffer<pending_io_request> _pending_io;
+    static void on_submitted(io_completion* desc) noexcept;
 public:
     void submit(io_completion* desc, internal::io_request req) noexcept;
 
@@ -64,6 +65,9 @@ class io_sink {
         while (pending > drained) {
             pending_io_request& req = _pending_io[drained];
 
+            // Before consuming it, as it may complete the request right
+            // away. If it is not consumed, the next drain marks it again.
+            on_submitted(req._completion);
             if (!consume(req, req._completion)) {
                 break;
             }
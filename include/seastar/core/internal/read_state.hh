@@ -36,8 +36,15 @@ struct file_read_state {
 
     file_read_state(uint64_t offset, uint64_t front, size_t to_read,
             size_t memory_alignment, size_t disk_alignment, io_intent* intent)
-    : buf(tmp_buf_type::aligned(memory_alignment,
-                                align_up(to_read, disk_alignment)))
+    : file_read_state(offset, front, to_read,
+            tmp_buf_type::aligned(memory_alignment, align_up(to_read, disk_alignment)), intent)
+    {}
+
+    // \c buf must be suitably aligned and at least \c to_read bytes long,
+    // rounded up to the disk alignment
+    file_read_state(uint64_t offset, uint64_t front, size_t to_read,
+            tmp_buf_type buf, io_intent* intent)
+    : buf(std::move(buf))
     , _offset(offset)
     , _to_read(to_read)
     , _front(front)
@@ -28,7 +28,9 @@
 #include <limits>
 #include <chrono>
 #include <functional>
+#include <map>
 #include <memory>
+#include <vector>
 #include <linux/perf_event.h>
 #endif
 #include <seastar/core/posix.hh>
@@ -48,9 +50,47 @@ struct cpu_stall_detector_config {
     unsigned stall_detector_reports_per_minute = 1;
     float slack = 0.3;  // fraction of threshold that we're allowed to overshoot
     bool oneline = true; // print a simplified backtrace on a single line
+    bool profile = false; // aggregate the backtraces, see stall_profile.hh
     std::function<void ()> report;  // alternative reporting function for tests
 };
 
+// The backtraces of the stalls of a shard, taken by the signal handler of
+// the stall detector into a ring, and aggregated, out of it, by the reactor
+// thread, for the handler not to allocate
+class stall_profile_recorder {
+public:
+    static constexpr unsigned max_depth = 64;
+    static constexpr unsigned ring_size = 64;
+    // The stalls of each backtrace, of its return addresses, innermost first
+    using stacks_type = std::map<std::vector<uintptr_t>, uint64_t>;
+private:
+    struct sample {
+        unsigned depth;
+        uintptr_t frames[max_depth];
+    };
+    std::unique_ptr<sample[]> _ring;
+    // The signal handler interrupts the thread draining the ring, so that
+    // the indexes only need fences against the compiler
+    std::atomic<unsigned> _head = { 0 };
+    std::atomic<unsigned> _tail = { 0 };
+    std::atomic<uint64_t> _dropped = { 0 };
+    stacks_type _stacks;
+public:
+    stall_profile_recorder();
+    // Called by the signal handler
+    void record() noexcept;
+    void drain() noexcept;
+    const stacks_type& stacks() noexcept {
+        drain();
+        return _stacks;
+    }
+    // The stalls not recorded, as the ring was full
+    uint64_t dropped() const noexcept {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+    void reset() noexcept;
+};
+
 // Detects stalls in continuations that run for too long
 class cpu_stall_detector {
 protected:
@@ -69,6 +109,9 @@ class cpu_stall_detector {
     sched_clock::duration _threshold;
     sched_clock::duration _slack;
     cpu_stall_detector_config _config;
+    // Never destroyed before the detector, for the signal handler not to
+    // see it go away
+    std::unique_ptr<stall_profile_recorder> _profile;
     seastar::metrics::metric_groups _metrics;
     friend reactor;
     virtual bool is_spurious_signal() {
@@ -91,6 +134,10 @@ class cpu_stall_detector {
     void generate_trace();
     void update_config(cpu_stall_detector_config cfg);
     cpu_stall_detector_config get_config() const;
+    // The profile of the stalls, nullptr if they are not profiled
+    stall_profile_recorder* profile() noexcept {
+        return _config.profile ? _profile.get() : nullptr;
+    }
     void on_signal();
     virtual void start_sleep() = 0;
     void end_sleep();
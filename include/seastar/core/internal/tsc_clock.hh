@@ -0,0 +1,144 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace seastar::internal {
+
+struct tsc_clock_state {
+    bool enabled = false;
+    // The reading at which the clock showed base_ns.
+    uint64_t base_ticks = 0;
+    int64_t base_ns = 0;
+    // Nanoseconds per tick, in 32.32 fixed point.
+    uint64_t mult = 0;
+    // The last calibration point, and the rate measured since the one
+    // before it.
+    uint64_t calibrated_ticks = 0;
+    int64_t calibrated_ns = 0;
+    double ns_per_tick = 0;
+    // Whether ns_per_tick was measured over a full period, rather than by
+    // the initial calibration.
+    bool rate_measured = false;
+    // system_clock minus steady_clock at the last calibration.
+    std::chrono::system_clock::duration system_offset{};
+    // The last time the clock showed from refresh(), or before it was
+    // disabled: once disabled it doesn't go below it, even if
+    // steady_clock is behind it.
+    int64_t floor_ns = 0;
+};
+
+/// A clock reading the CPU's timestamp counter, for the reactor's frequent
+/// time reads (\ref reactor::now()).
+///
+/// Its time points are those of std::chrono::steady_clock: each shard
+/// calibrates the counter against steady_clock when it starts, and then
+/// periodically (from \ref refresh()), slewing its rate so that it tracks
+/// steady_clock closely without going backwards. On threads where it isn't
+/// enabled, because the CPU lacks an invariant counter, it was disabled
+/// by configuration, or calibration found the counter unreliable, it just
+/// reads steady_clock. When it is disabled while running ahead of
+/// steady_clock, it stays at the last time it showed until steady_clock
+/// catches up, so that it never goes backwards.
+class tsc_clock {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+private:
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+    static thread_local tsc_clock_state _state;
+#else
+    inline static thread_local tsc_clock_state _state;
+#endif
+
+    static void recalibrate() noexcept;
+public:
+    static bool supported() noexcept;
+
+    /// Calibrates the counter and starts using it on this thread, if it is
+    /// supported. Spins for a millisecond. Returns whether it is enabled.
+    static bool enable() noexcept;
+    static void disable() noexcept {
+        if (_state.enabled) {
+            auto n = std::chrono::duration_cast<std::chrono::nanoseconds>(now().time_since_epoch()).count();
+            // A counter that went backwards reads behind what it showed
+            _state.floor_ns = std::max(_state.floor_ns, n);
+            _state.enabled = false;
+        }
+    }
+    static bool enabled() noexcept {
+        return _state.enabled;
+    }
+
+    static uint64_t ticks() noexcept {
+#if defined(__x86_64__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t t;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+        return t;
+#else
+        return 0;
+#endif
+    }
+
+    static time_point now() noexcept {
+        if (!_state.enabled) [[unlikely]] {
+            auto n = std::chrono::steady_clock::now();
+            auto floor = time_point(std::chrono::nanoseconds(_state.floor_ns));
+            return n < floor ? floor : n;
+        }
+        auto delta = int64_t(ticks() - _state.base_ticks);
+        // Another core's counter may lag slightly behind; don't go back.
+        if (delta < 0) [[unlikely]] {
+            delta = 0;
+        }
+        auto ns = int64_t((static_cast<unsigned __int128>(delta) * _state.mult) >> 32);
+        return time_point(std::chrono::nanoseconds(_state.base_ns + ns));
+    }
+
+    /// Like \ref now(), but recalibrates if it is due. Called whenever the
+    /// reactor updates the low resolution clocks.
+    static time_point refresh() noexcept;
+
+    /// For tests: makes the clock run \c d ahead of steady_clock, as a
+    /// counter running fast would.
+    static void skew(std::chrono::nanoseconds d) noexcept {
+        _state.base_ns += d.count();
+    }
+
+    /// The system time for a time point of this clock, as of the last
+    /// calibration.
+    static std::chrono::system_clock::time_point to_system(time_point t) noexcept {
+        return std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(t.time_since_epoch()) + _state.system_offset);
+    }
+};
+
+}
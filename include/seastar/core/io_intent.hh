@@ -90,6 +90,12 @@ class io_intent {
     /// Explicitly cancels all the requests attached to this intent
     /// so far. The respective futures are resolved into the \ref
     /// cancelled_error "cancelled_error"
+    ///
+    /// Requests that have already been dispatched to the kernel are
+    /// cancelled there, if the reactor backend supports it (io_uring
+    /// does). Their futures resolve once the kernel completes them: into
+    /// the \ref cancelled_error "cancelled_error" if they failed, as
+    /// usual if the cancellation came too late.
     void cancel() noexcept {
         _refs.clear();
         _intents.clear();
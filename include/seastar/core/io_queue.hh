@@ -23,6 +23,8 @@
 
 #ifndef SEASTAR_MODULE
 #include <boost/container/static_vector.hpp>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <vector>
@@ -108,6 +110,7 @@ class io_queue {
     priority_class_data& find_or_create_class(internal::priority_class pc);
     future<size_t> queue_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept;
     future<size_t> queue_one_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept;
+    void trace_request(reactor& r, internal::priority_class pc, internal::io_direction_and_length dnl, const internal::io_request& req) noexcept;
 
     // The fields below are going away, they are just here so we can implement deprecated
     // functions that used to be provided by the fair_queue and are going away (from both
@@ -126,6 +129,18 @@ class io_queue {
 
     void update_flow_ratio() noexcept;
 
+    // Disk model calibration, accumulated per stream and handed over to
+    // the group on every flow ratio update
+    struct model_sample {
+        uint64_t latency_sum_us = 0;
+        uint64_t completions = 0;
+        fair_queue_entry::capacity_t dispatched = 0;
+    };
+    std::array<model_sample, 2> _model_samples;
+
+    void update_model() noexcept;
+    double model_factor(unsigned direction) const noexcept;
+
     metrics::metric_groups _metric_groups;
 public:
 
@@ -157,6 +172,25 @@ class io_queue {
         unsigned flow_ratio_ticks = 100;
         double flow_ratio_ema_factor = 0.95;
         double flow_ratio_backpressure_threshold = 1.1;
+        // Bounds of the factor by which the disk model (the rates above)
+        // is scaled at runtime to keep completion latencies within the
+        // latency goal. Equal bounds disable the calibration.
+        double model_factor_min = 1.0;
+        double model_factor_max = 1.0;
+        double model_calibration_step = 0.02;
+        // Whether a read queued right after one of the same class reading
+        // what precedes it is sent to the disk along with it as one readv
+        bool merge_adjacent_reads = true;
+        // Whether shards with nothing to dispatch leave their share of the
+        // group capacity to the others
+        bool share_idle_capacity = false;
+        // The fraction of its per-tick share of the group capacity a
+        // shard grabs at once, see fair_group::config::grab_batch
+        double capacity_grab_batch = 0.0;
+        // Requests taking longer than this, from being queued to their
+        // completion, are logged along with their breakdown. Zero disables
+        // the log.
+        std::chrono::duration<double> slow_io_threshold = std::chrono::duration<double>(0);
     };
 
     io_queue(io_group_ptr group, internal::io_sink& sink);
@@ -171,8 +205,11 @@ class io_queue {
 
     void submit_request(io_desc_read_write* desc, internal::io_request req) noexcept;
     void cancel_request(queued_io_request& req) noexcept;
+    void cancel_dispatched_request(io_desc_read_write& desc) noexcept;
+    bool try_update_queued_request_capacity(queued_io_request& req, fair_queue_entry::capacity_t cap) noexcept;
     void complete_cancelled_request(queued_io_request& req) noexcept;
-    void complete_request(io_desc_read_write& desc) noexcept;
+    void complete_request(io_desc_read_write& desc, std::chrono::duration<double> latency) noexcept;
+    void maybe_log_slow_request(const io_desc_read_write& desc, clock_type::time_point now) noexcept;
 
     [[deprecated("I/O queue users should not track individual requests, but resources (weight, size) passing through the queue")]]
     size_t queued_requests() const {
@@ -195,6 +232,7 @@ class io_queue {
     dev_t dev_id() const noexcept;
 
     void update_shares_for_class(internal::priority_class pc, size_t new_shares);
+    void set_latency_target_for_class(internal::priority_class pc, std::chrono::microseconds target);
     future<> update_bandwidth_for_class(internal::priority_class pc, uint64_t new_bandwidth);
     void rename_priority_class(internal::priority_class pc, sstring new_name);
     void throttle_priority_class(const priority_class_data& pc) noexcept;
@@ -229,12 +267,22 @@ class io_group {
     const io_queue::config _config;
     size_t _max_request_length[2];
     boost::container::static_vector<fair_group, 2> _fgs;
+    // Samples of each fair group's completions, collected from all the queues
+    struct model_calibration {
+        std::atomic<uint64_t> latency_sum_us = 0;
+        std::atomic<uint64_t> completions = 0;
+        std::atomic<uint64_t> dispatched = 0;
+        std::chrono::steady_clock::time_point last_update;
+    };
+    std::array<model_calibration, 2> _calibration;
+    std::chrono::duration<double> _model_latency_goal;
     std::vector<std::unique_ptr<priority_class_data>> _priority_classes;
     util::spinlock _lock;
     const shard_id _allocated_on;
 
     static fair_group::config make_fair_group_config(const io_queue::config& qcfg) noexcept;
     priority_class_data& find_or_create_class(internal::priority_class pc);
+    void calibrate_model(std::chrono::steady_clock::time_point now) noexcept;
 };
 
 inline const io_queue::config& io_queue::get_config() const noexcept {
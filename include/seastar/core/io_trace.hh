@@ -0,0 +1,90 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <fmt/format.h>
+#include <seastar/core/shard_id.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+/// \file
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Direction of a traced I/O request
+enum class io_trace_op { read, write };
+
+/// \brief A disk I/O request, as submitted to an io_queue.
+///
+/// Requests are traced before they are split to the disk's maximum request
+/// length, and before adjacent reads are merged, so that a trace describes
+/// the application's request mix rather than what the queue made of it.
+struct io_trace_event {
+    /// When the request was submitted
+    std::chrono::steady_clock::time_point timestamp;
+    /// Shard that submitted the request
+    shard_id shard;
+    /// Name of the I/O class (scheduling group) of the request
+    sstring class_name;
+    io_trace_op op;
+    /// Offset in the file the request was issued to
+    uint64_t offset;
+    size_t length;
+};
+
+/// Signature of a callback called for every disk I/O request submitted on
+/// the shard.
+///
+/// The callback is called synchronously on the submission path, so it
+/// should only record the event (say, into a buffer that is flushed
+/// elsewhere); it must not throw.
+using io_trace_hook = noncopyable_function<void (const io_trace_event&) noexcept>;
+
+/// Installs a hook tracing the disk I/O requests submitted on the current
+/// shard, replacing the previous one. An empty hook disables tracing.
+///
+/// Events formatted with fmt (one per line) can be replayed by the
+/// io_tester's \c replay jobs.
+void set_io_trace_hook(io_trace_hook hook) noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+/// Formats an event as "<timestamp_us> <shard> <class> <read|write> <offset> <length>"
+template <>
+struct fmt::formatter<seastar::io_trace_event> : fmt::formatter<string_view> {
+    template <typename FormatContext>
+    auto format(const seastar::io_trace_event& ev, FormatContext& ctx) const {
+        return fmt::format_to(ctx.out(), "{} {} {} {} {} {}",
+                std::chrono::duration_cast<std::chrono::microseconds>(ev.timestamp.time_since_epoch()).count(),
+                ev.shard, ev.class_name, ev.op == seastar::io_trace_op::read ? "read" : "write",
+                ev.offset, ev.length);
+    }
+};
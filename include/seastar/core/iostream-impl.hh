@@ -110,11 +110,47 @@ output_stream<CharType>::zero_copy_split_and_put(net::packet p) noexcept {
     });
 }
 
+// Appends p to what cork() holds back. The zero-copy buffers written
+// before, if any, go first, so what is held is always put in order.
+template <typename CharType>
+void output_stream<CharType>::hold(net::packet p) {
+    static_assert(std::is_same_v<CharType, char>, "packet works on char");
+    if (_zc_bufs) {
+        _corked_bufs = std::exchange(_zc_bufs, net::packet::make_null_packet());
+    }
+    if (_corked_bufs) {
+        _corked_bufs.append(std::move(p));
+    } else {
+        _corked_bufs = std::move(p);
+    }
+}
+
+// Puts what is held back once it has max_corked_buffers fragments, after
+// the batch flush in progress, like the other puts
+template <typename CharType>
+future<> output_stream<CharType>::maybe_put_held() noexcept {
+    if (_corked_bufs.nr_frags() < max_corked_buffers) {
+        return make_ready_future<>();
+    }
+    return zero_copy_put(std::exchange(_corked_bufs, net::packet::make_null_packet()));
+}
+
 template<typename CharType>
 future<> output_stream<CharType>::write(net::packet p) noexcept {
     static_assert(std::is_same_v<CharType, char>, "packet works on char");
   try {
     if (p.len() != 0) {
+        // Held back after what is buffered, also when uncorked with a
+        // flush of what was held still to come
+        if (_corked || _corked_bufs) {
+            if (_end) {
+                _buf.trim(_end);
+                _end = 0;
+                hold(net::packet(std::move(_buf)));
+            }
+            hold(std::move(p));
+            return maybe_put_held();
+        }
         assert(!_end && "Mixing buffered writes and zero-copy writes not supported yet");
 
         if (_zc_bufs) {
@@ -168,7 +204,7 @@ input_stream<CharType>::read_exactly_part(size_t n) noexcept {
         }
 
         // _buf is now empty
-        temporary_buffer<CharType> buf = co_await _fd.get();
+        temporary_buffer<CharType> buf = co_await next_buffer();
         if (buf.size() == 0) {
             _eof = true;
             out.trim(completed);
@@ -192,7 +228,7 @@ input_stream<CharType>::read_exactly(size_t n) noexcept {
         return make_ready_future<tmp_buf>(std::move(front));
     } else if (_buf.size() == 0) {
         // buffer is empty: grab one and retry
-        return _fd.get().then([this, n] (auto buf) mutable {
+        return next_buffer().then([this, n] (auto buf) mutable {
             if (buf.size() == 0) {
                 _eof = true;
                 return make_ready_future<tmp_buf>(std::move(buf));
@@ -213,7 +249,7 @@ future<>
 input_stream<CharType>::consume(Consumer&& consumer) noexcept(std::is_nothrow_move_constructible_v<Consumer>) {
     return repeat([consumer = std::move(consumer), this] () mutable {
         if (_buf.empty() && !_eof) {
-            return _fd.get().then([this] (tmp_buf buf) {
+            return next_buffer().then([this] (tmp_buf buf) {
                 _buf = std::move(buf);
                 _eof = _buf.empty();
                 return make_ready_future<stop_iteration>(stop_iteration::no);
@@ -231,10 +267,7 @@ input_stream<CharType>::consume(Consumer&& consumer) noexcept(std::is_nothrow_mo
                 this->_buf = std::move(stop.get_buffer());
                 return make_ready_future<stop_iteration>(stop_iteration::yes);
             }, [this] (const skip_bytes& skip) {
-                return this->_fd.skip(skip.get_value()).then([this](tmp_buf buf) {
-                    if (!buf.empty()) {
-                        this->_buf = std::move(buf);
-                    }
+                return this->skip(skip.get_value()).then([] {
                     return make_ready_future<stop_iteration>(stop_iteration::no);
                 });
             });
@@ -258,7 +291,7 @@ input_stream<CharType>::read_up_to(size_t n) noexcept {
         if (_eof) {
             return make_ready_future<tmp_buf>();
         } else {
-            return _fd.get().then([this, n] (tmp_buf buf) {
+            return next_buffer().then([this, n] (tmp_buf buf) {
                 _eof = buf.empty();
                 _buf = std::move(buf);
                 return read_up_to(n);
@@ -287,7 +320,7 @@ input_stream<CharType>::read() noexcept {
         return make_ready_future<tmp_buf>();
     }
     if (_buf.empty()) {
-        return _fd.get().then([this] (tmp_buf buf) {
+        return next_buffer().then([this] (tmp_buf buf) {
             _eof = buf.empty();
             return make_ready_future<tmp_buf>(std::move(buf));
         });
@@ -302,6 +335,15 @@ input_stream<CharType>::skip(uint64_t n) noexcept {
     auto skip_buf = std::min(n, _buf.size());
     _buf.trim_front(skip_buf);
     n -= skip_buf;
+    if (!_frags.empty()) {
+        skip_buf = std::min<uint64_t>(n, _frags_size);
+        consume_buffered(skip_buf);
+        n -= skip_buf;
+        // What is left is the end of stream, if anything
+        if (!_frags.empty()) {
+            n = 0;
+        }
+    }
     if (!n) {
         return make_ready_future<>();
     }
@@ -313,13 +355,60 @@ input_stream<CharType>::skip(uint64_t n) noexcept {
 template <typename CharType>
 data_source
 input_stream<CharType>::detach() && {
-    if (_buf) {
+    if (_buf || !_frags.empty()) {
         throw std::logic_error("detach() called on a used input_stream");
     }
 
     return std::move(_fd);
 }
 
+template <typename CharType>
+future<temporary_buffer<CharType>>
+input_stream<CharType>::next_buffer() noexcept {
+    if (_frags.empty()) {
+        return _fd.get();
+    }
+    auto buf = std::move(_frags.front());
+    _frags.erase(_frags.begin());
+    _frags_size -= buf.size();
+    return make_ready_future<tmp_buf>(std::move(buf));
+}
+
+template <typename CharType>
+future<std::span<const temporary_buffer<CharType>>>
+input_stream<CharType>::peek_fragments(size_t n) noexcept {
+    if (_buf) {
+        _frags.insert(_frags.begin(), std::move(_buf));
+        _frags_size += _frags.front().size();
+    }
+    if (_eof && _frags.empty()) {
+        _frags.emplace_back();
+    }
+    while (_frags_size < n && (_frags.empty() || !_frags.back().empty())) {
+        auto buf = co_await _fd.get();
+        _frags_size += buf.size();
+        _frags.push_back(std::move(buf));
+    }
+    co_return std::span<const tmp_buf>(_frags);
+}
+
+template <typename CharType>
+void
+input_stream<CharType>::consume_buffered(size_t n) noexcept {
+    assert(n <= _frags_size);
+    _frags_size -= n;
+    auto i = _frags.begin();
+    while (n) {
+        auto now = std::min(n, i->size());
+        i->trim_front(now);
+        n -= now;
+        if (i->empty()) {
+            ++i;
+        }
+    }
+    _frags.erase(_frags.begin(), i);
+}
+
 // Writes @buf in chunks of _size length. The last chunk is buffered if smaller.
 template <typename CharType>
 future<>
@@ -354,6 +443,31 @@ output_stream<CharType>::write(const char_type* buf, size_t n) noexcept {
     return make_ready_future<>();
 }
 
+template <typename CharType>
+template <typename... Args>
+future<>
+output_stream<CharType>::write_formatted(fmt::format_string<Args...> format_str, Args&&... args) noexcept {
+    static_assert(std::is_same_v<CharType, char>, "write_formatted() is only available for output_stream<char>");
+  try {
+    auto fargs = fmt::make_format_args(args...);
+    if (__builtin_expect(_buf && !_zc_bufs, true)) {
+        auto room = _size - _end;
+        auto r = fmt::vformat_to_n(_buf.get_write() + _end, room, format_str, fargs);
+        if (__builtin_expect(r.size <= room, true)) {
+            _end += r.size;
+            return make_ready_future<>();
+        }
+        // The part that fit was written past _end, so it is simply
+        // overwritten by the copy below.
+    }
+    fmt::memory_buffer spill;
+    fmt::vformat_to(std::back_inserter(spill), format_str, fargs);
+    return slow_write(spill.data(), spill.size());
+  } catch (...) {
+    return current_exception_as_future();
+  }
+}
+
 template <typename CharType>
 future<>
 output_stream<CharType>::slow_write(const char_type* buf, size_t n) noexcept {
@@ -414,6 +528,24 @@ void add_to_flush_poller(output_stream<char>& x) noexcept;
 
 template <typename CharType>
 future<> output_stream<CharType>::do_flush() noexcept {
+  if constexpr (std::is_same_v<CharType, char>) {
+    // What is held back, and zero-copy buffers followed by buffered
+    // writes made while corked, go out together, in order
+    if (_corked_bufs || (_zc_bufs && _end)) {
+      try {
+        if (_end) {
+            _buf.trim(_end);
+            _end = 0;
+            hold(net::packet(std::move(_buf)));
+        }
+      } catch (...) {
+        return current_exception_as_future();
+      }
+        return _fd.put(std::exchange(_corked_bufs, net::packet::make_null_packet())).then([this] {
+            return _fd.flush();
+        });
+    }
+  }
     if (_end) {
         _buf.trim(_end);
         _end = 0;
@@ -432,6 +564,9 @@ future<> output_stream<CharType>::do_flush() noexcept {
 template <typename CharType>
 future<>
 output_stream<CharType>::flush() noexcept {
+    if (_corked) {
+        return make_ready_future<>();
+    }
     if (!_batch_flushes) {
         return do_flush();
     } else {
@@ -452,6 +587,18 @@ output_stream<CharType>::flush() noexcept {
 template <typename CharType>
 future<>
 output_stream<CharType>::put(temporary_buffer<CharType> buf) noexcept {
+  if constexpr (std::is_same_v<CharType, char>) {
+    // Also held when uncorked with a flush of what was held still to
+    // come, not to overtake it
+    if (_corked || _corked_bufs) {
+      try {
+        hold(net::packet(std::move(buf)));
+      } catch (...) {
+        return current_exception_as_future();
+      }
+        return maybe_put_held();
+    }
+  }
     // if flush is scheduled, disable it, so it will not try to write in parallel
     _flush = false;
     if (_flushing) {
@@ -494,6 +641,7 @@ output_stream<CharType>::poll_flush() noexcept {
 template <typename CharType>
 future<>
 output_stream<CharType>::close() noexcept {
+    _corked = false;
     return flush().finally([this] {
         if (_in_batch) {
             return _in_batch.value().get_future();
@@ -513,7 +661,7 @@ output_stream<CharType>::close() noexcept {
 template <typename CharType>
 data_sink
 output_stream<CharType>::detach() && {
-    if (_buf) {
+    if (_buf || _corked_bufs) {
         throw std::logic_error("detach() called on a used output_stream");
     }
 
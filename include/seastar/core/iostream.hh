@@ -42,9 +42,11 @@
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <boost/intrusive/slist.hpp>
+#include <fmt/format.h>
 #include <algorithm>
 #include <memory>
 #include <optional>
+#include <span>
 #include <variant>
 #include <vector>
 #endif
@@ -56,6 +58,7 @@ namespace seastar {
 SEASTAR_MODULE_EXPORT_BEGIN
 
 namespace net { class packet; }
+class file;
 
 class data_source_impl {
 public:
@@ -121,6 +124,10 @@ class data_sink_impl {
     virtual future<> flush() {
         return make_ready_future<>();
     }
+    // Sends len bytes of the file starting at offset. Sinks that can move
+    // file contents to their destination without a userspace copy override
+    // this; the default reads the file in chunks and put()s them.
+    virtual future<> put_file(file f, uint64_t offset, size_t len);
     virtual future<> close() = 0;
 
     // The method should return the maximum buffer size that's acceptable by
@@ -183,6 +190,7 @@ class data_sink {
         return current_exception_as_future();
       }
     }
+    future<> put_file(file f, uint64_t offset, size_t len) noexcept;
     future<> close() noexcept {
         try {
             return _dsi->close();
@@ -281,12 +289,18 @@ class input_stream final {
     static_assert(sizeof(CharType) == 1, "must buffer stream of bytes");
     data_source _fd;
     temporary_buffer<CharType> _buf;
+    // The buffers peek_fragments() read, which come before what _fd
+    // returns next; _buf is empty as long as there are some. An empty
+    // one last is the end of stream.
+    std::vector<temporary_buffer<CharType>> _frags;
+    size_t _frags_size = 0;
     bool _eof = false;
 private:
     using tmp_buf = temporary_buffer<CharType>;
     size_t available() const noexcept { return _buf.size(); }
+    future<tmp_buf> next_buffer() noexcept;
 protected:
-    void reset() noexcept { _buf = {}; }
+    void reset() noexcept { _buf = {}; _frags.clear(); _frags_size = 0; }
     data_source* fd() noexcept { return &_fd; }
 public:
     using consumption_result_type = consumption_result<CharType>;
@@ -341,6 +355,22 @@ class input_stream final {
     /// Ignores n next bytes from the stream.
     future<> skip(uint64_t n) noexcept;
 
+    /// Buffers at least n bytes, or all those left before the end of
+    /// stream, as the fragments the data source returned them in.
+    ///
+    /// Lets a parser look at data crossing fragment boundaries without
+    /// copying it together, as read_exactly() does, then drop what it
+    /// parsed with consume_buffered(). Reading from the stream returns
+    /// the buffered bytes first.
+    ///
+    /// \returns the buffered fragments, valid until the stream is used
+    /// again; the first is what is left of a fragment partly consumed,
+    /// and the last is empty if the end of stream was reached.
+    future<std::span<const temporary_buffer<CharType>>> peek_fragments(size_t n) noexcept;
+    /// Drops the first n bytes of the fragments peek_fragments()
+    /// returned, which must have as many.
+    void consume_buffered(size_t n) noexcept;
+
     /// Detaches the underlying \c data_source from the \c input_stream.
     ///
     /// The intended usage is custom \c data_source_impl implementations
@@ -380,6 +410,7 @@ class output_stream final {
     data_sink _fd;
     temporary_buffer<CharType> _buf;
     net::packet _zc_bufs = net::packet::make_null_packet(); //zero copy buffers
+    net::packet _corked_bufs = net::packet::make_null_packet(); // filled while corked
     size_t _size = 0;
     size_t _begin = 0;
     size_t _end = 0;
@@ -388,9 +419,12 @@ class output_stream final {
     std::optional<promise<>> _in_batch;
     bool _flush = false;
     bool _flushing = false;
+    bool _corked = false;
     std::exception_ptr _ex;
     bi::slist_member_hook<> _in_poller;
 
+    // The most buffers held while corked, sent together when reached
+    static constexpr unsigned max_corked_buffers = 64;
 private:
     size_t available() const noexcept { return _end - _begin; }
     future<> split_and_put(temporary_buffer<CharType> buf) noexcept;
@@ -399,6 +433,8 @@ class output_stream final {
     future<> do_flush() noexcept;
     future<> zero_copy_put(net::packet p) noexcept;
     future<> zero_copy_split_and_put(net::packet p) noexcept;
+    void hold(net::packet p);
+    future<> maybe_put_held() noexcept;
     [[gnu::noinline]]
     future<> slow_write(const CharType* buf, size_t n) noexcept;
 public:
@@ -417,7 +453,7 @@ class output_stream final {
         if (_batch_flushes) {
             assert(!_in_batch && "Was this stream properly closed?");
         } else {
-            assert(!_end && !_zc_bufs && "Was this stream properly closed?");
+            assert(!_end && !_zc_bufs && !_corked_bufs && "Was this stream properly closed?");
         }
     }
     future<> write(const char_type* buf, size_t n) noexcept;
@@ -430,8 +466,55 @@ class output_stream final {
     future<> write(net::packet p) noexcept;
     future<> write(scattered_message<char_type> msg) noexcept;
     future<> write(temporary_buffer<char_type>) noexcept;
+    /// Formats the arguments straight into the stream's buffer, as
+    /// \c fmt::format_to() would, without building a string to write
+    /// first. Output that doesn't fit into the current buffer spills over
+    /// into the next one.
+    ///
+    /// Only available for \c output_stream<char>.
+    template <typename... Args>
+    future<> write_formatted(fmt::format_string<Args...> format_str, Args&&... args) noexcept;
+    /// Writes a range of a file to the stream.
+    ///
+    /// Data buffered in the stream so far is put into the sink first,
+    /// then the file contents follow. Sinks backed by a posix socket
+    /// transfer the data with sendfile(2), so it never passes through
+    /// userspace; other sinks get it read with dma_read() in chunks.
+    ///
+    /// Only available for \c output_stream<char>.
+    ///
+    /// \param f the file to send from
+    /// \param offset position within the file of the first byte to send
+    /// \param len number of bytes to send; the file must not end before
+    ///        \c offset + \c len
+    future<> write_from_file(file f, uint64_t offset, size_t len) noexcept;
     future<> flush() noexcept;
 
+    /// Holds what is written back until uncork().
+    ///
+    /// flush() does nothing meanwhile, and the buffers filled are kept
+    /// rather than put into the sink one by one, for them to be put
+    /// together, as one packet, which a socket sends with one sendmsg(2).
+    /// Past \ref max_corked_buffers of them, they are put without
+    /// waiting for uncork(). Zero-copy writes are held back too, and
+    /// put in the order they were written in with the others.
+    ///
+    /// With \ref output_stream_options::batch_flushes, which already
+    /// flushes all the streams once a poll cycle, corking a stream
+    /// while writing a batch of replies keeps it from being flushed
+    /// half way through.
+    void cork() noexcept {
+        _corked = true;
+    }
+    /// Stops holding what is written back, and flushes it.
+    future<> uncork() noexcept {
+        _corked = false;
+        return flush();
+    }
+    bool corked() const noexcept {
+        return _corked;
+    }
+
     /// Flushes the stream before closing it (and the underlying data sink) to
     /// any further writes.  The resulting future must be waited on before
     /// destroying this object.
@@ -457,6 +540,9 @@ class output_stream final {
     friend class reactor;
 };
 
+template <>
+future<> output_stream<char>::write_from_file(file f, uint64_t offset, size_t len) noexcept;
+
 /*!
  * \brief copy all the content from the input stream to the output stream
  */
@@ -25,6 +25,7 @@
 #ifndef SEASTAR_MODULE
 #include <cassert>
 #include <cstddef>
+#include <exception>
 #include <iterator>
 #include <memory>
 #include <optional>
@@ -757,6 +758,211 @@ max_concurrent_for_each(Range&& range, size_t max_concurrent, Func&& func) noexc
     }
 }
 
+/// \cond internal
+namespace internal {
+
+// Number of elements chunked_for_each() processes between checks of
+// need_preempt()
+inline constexpr size_t chunked_for_each_chunk_size = 64;
+
+template <typename Iterator, typename Sentinel, typename Func>
+class chunked_for_each_state final : public task {
+    Iterator _begin;
+    Sentinel _end;
+    Func _func;
+    size_t _max_concurrent;
+    size_t _in_flight = 0;
+    // Set when the loop waits for an invocation to complete, either to
+    // start another one or to complete itself
+    bool _waiting = false;
+    bool _stopped = false;
+    std::exception_ptr _ex;
+    promise<> _promise;
+private:
+    void record(std::exception_ptr ex) noexcept {
+        if (!_ex) {
+            _ex = std::move(ex);
+        }
+    }
+public:
+    chunked_for_each_state(Iterator begin, Sentinel end, size_t max_concurrent, Func func, std::exception_ptr ex)
+        : _begin(std::move(begin)), _end(std::move(end)), _func(std::move(func))
+        , _max_concurrent(max_concurrent), _ex(std::move(ex)) {}
+    future<> get_future() noexcept { return _promise.get_future(); }
+    task* waiting_task() noexcept override { return _promise.waiting_task(); }
+    // Keeps track of an invocation which did not complete successfully
+    // right away
+    void add(future<> f) noexcept {
+        if (f.available()) {
+            record(f.get_exception());
+            return;
+        }
+        ++_in_flight;
+        memory::scoped_critical_alloc_section _;
+        (void)std::move(f).then_wrapped([this] (future<> f) noexcept {
+            if (f.failed()) {
+                record(f.get_exception());
+            }
+            --_in_flight;
+            if (_waiting) {
+                _waiting = false;
+                schedule(this);
+            }
+        });
+    }
+    virtual void run_and_dispose() noexcept override {
+        try {
+            size_t n = 0;
+            while (!_stopped && _begin != _end) {
+                if (_in_flight == _max_concurrent) {
+                    _waiting = true;
+                    return;
+                }
+                auto f = futurize_invoke(_func, *_begin);
+                ++_begin;
+                if (!f.available() || f.failed()) {
+                    add(std::move(f));
+                }
+                if (++n == chunked_for_each_chunk_size) {
+                    n = 0;
+                    if (need_preempt()) {
+                        schedule(this);
+                        return;
+                    }
+                }
+            }
+        } catch (...) {
+            record(std::current_exception());
+            _stopped = true;
+        }
+        if (_in_flight) {
+            _waiting = true;
+            return;
+        }
+        if (_ex) {
+            _promise.set_exception(std::move(_ex));
+        } else {
+            _promise.set_value();
+        }
+        delete this;
+    }
+};
+
+} // namespace internal
+/// \endcond
+
+/// Run tasks in chunks, with a maximum of \c max_concurrent asynchronous ones in parallel (iterator version).
+///
+/// Given a range [\c begin, \c end) of objects, run \c func on each \c *i in
+/// the range, and return a future<> that resolves when all the functions
+/// complete.  \c func should return a future<> that indicates when it is
+/// complete.
+///
+/// Unlike parallel_for_each() and max_concurrent_for_each(), which keep
+/// track of every invocation, invocations returning a successfully
+/// resolved future cost nothing but the call: they are processed one after
+/// the other, in chunks of a few dozens, checking whether the loop should
+/// yield only between chunks. Allocations happen only when the loop does
+/// yield, or for invocations which do not complete immediately; up to
+/// \c max_concurrent such invocations are performed in parallel, and the
+/// loop waits for one of them to complete before starting another one.
+/// This makes it fit for in-memory loops over large ranges, most of whose
+/// elements are processed synchronously.
+///
+/// This does not allow the range to refer to stack objects. The caller
+/// must ensure that the range outlives the call to chunked_for_each so it
+/// can be iterated in the background.
+///
+/// \param begin an \c InputIterator designating the beginning of the range
+/// \param end an \c InputIterator designating the end of the range
+/// \param max_concurrent maximum number of invocations of \c func not complete yet, must be greater than zero.
+/// \param func Function to invoke with each element in the range (returning
+///             a \c future<>)
+/// \return a \c future<> that resolves when all the function invocations
+///         complete.  If one or more return an exception, the return value
+///         contains one of the exceptions.
+template <typename Iterator, typename Sentinel, typename Func>
+requires (requires (Func f, Iterator i) { { f(*i) } -> std::same_as<future<>>; { ++i }; } && (std::same_as<Sentinel, Iterator> || std::sentinel_for<Sentinel, Iterator>) )
+inline
+future<>
+chunked_for_each(Iterator begin, Sentinel end, size_t max_concurrent, Func&& func) noexcept {
+    using state = internal::chunked_for_each_state<Iterator, Sentinel, std::remove_cvref_t<Func>>;
+
+    assert(max_concurrent > 0);
+
+    std::exception_ptr ex;
+    std::optional<future<>> pending;
+    try {
+        size_t n = 0;
+        while (begin != end) {
+            auto f = futurize_invoke(func, *begin);
+            ++begin;
+            if (!f.available()) {
+                pending = std::move(f);
+                break;
+            }
+            if (f.failed()) {
+                auto e = f.get_exception();
+                if (!ex) {
+                    ex = std::move(e);
+                }
+            }
+            if (++n == internal::chunked_for_each_chunk_size) {
+                n = 0;
+                if (need_preempt()) {
+                    break;
+                }
+            }
+        }
+        if (begin == end && !pending) {
+            if (ex) {
+                return make_exception_future<>(std::move(ex));
+            }
+            return make_ready_future<>();
+        }
+    } catch (...) {
+        return current_exception_as_future();
+    }
+    // Hand off the rest of the range to a task, which runs right away if
+    // there is an invocation to wait for, and when scheduled otherwise.
+    memory::scoped_critical_alloc_section _;
+    auto s = new state(std::move(begin), std::move(end), max_concurrent, std::forward<Func>(func), std::move(ex));
+    auto ret = s->get_future();
+    if (pending) {
+        s->add(std::move(*pending));
+        s->run_and_dispose();
+    } else {
+        schedule(s);
+    }
+    return ret;
+}
+
+/// Run tasks in chunks, with a maximum of \c max_concurrent asynchronous ones in parallel (range version).
+///
+/// \see chunked_for_each(Iterator, Sentinel, size_t, Func&&)
+///
+/// \param range a \c Range to be processed
+/// \param max_concurrent maximum number of invocations of \c func not complete yet, must be greater than zero.
+/// \param func Function to invoke with each element in the range (returning
+///             a \c future<>)
+/// \return a \c future<> that resolves when all the function invocations
+///         complete.  If one or more return an exception, the return value
+///         contains one of the exceptions.
+template <typename Range, typename Func>
+requires requires (Func f, Range r) {
+    { f(*std::begin(r)) } -> std::same_as<future<>>;
+    std::end(r);
+}
+inline
+future<>
+chunked_for_each(Range&& range, size_t max_concurrent, Func&& func) noexcept {
+    try {
+        return chunked_for_each(std::begin(range), std::end(range), max_concurrent, std::forward<Func>(func));
+    } catch (...) {
+        return current_exception_as_future();
+    }
+}
+
 /// @}
 
 SEASTAR_MODULE_EXPORT_END
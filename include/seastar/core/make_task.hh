@@ -49,6 +49,28 @@ class lambda_task final : public task {
     }
 };
 
+/// A \ref lambda_task accounted under a tag rather than its type
+template <typename Func>
+class tagged_lambda_task final : public task {
+    Func _func;
+    const char* _tag;
+    using futurator = futurize<std::invoke_result_t<Func>>;
+    typename futurator::promise_type _result;
+public:
+    tagged_lambda_task(scheduling_group sg, const char* tag, Func&& func) : task(sg), _func(std::move(func)), _tag(tag) {}
+    typename futurator::type get_future() noexcept { return _result.get_future(); }
+    virtual void run_and_dispose() noexcept override {
+        futurator::invoke(_func).forward_to(std::move(_result));
+        delete this;
+    }
+    virtual task* waiting_task() noexcept override {
+        return _result.waiting_task();
+    }
+    virtual const char* tag() const noexcept override {
+        return _tag;
+    }
+};
+
 template <typename Func>
 inline
 lambda_task<Func>*
@@ -63,6 +85,16 @@ make_task(scheduling_group sg, Func&& func) noexcept {
     return new lambda_task<Func>(sg, std::forward<Func>(func));
 }
 
+/// Makes a task accounted under \c tag when sampled by type, such as the
+/// name of the subsystem it runs for, rather than the type of \c func.
+/// \c tag must outlive the reactor, as a string literal does.
+template <typename Func>
+inline
+tagged_lambda_task<std::decay_t<Func>>*
+make_task(scheduling_group sg, const char* tag, Func&& func) noexcept {
+    return new tagged_lambda_task<std::decay_t<Func>>(sg, tag, std::decay_t<Func>(std::forward<Func>(func)));
+}
+
 SEASTAR_MODULE_EXPORT_END
 
 }
@@ -23,6 +23,7 @@
 
 #include <seastar/core/resource.hh>
 #include <seastar/core/bitops.hh>
+#include <seastar/core/scheduling.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/modules.hh>
 #include <seastar/util/sampler.hh>
@@ -159,6 +160,10 @@ struct numa_layout {
 
 numa_layout merge(numa_layout one, numa_layout two);
 
+// Records that the calling thread's memory belongs to seastar shard \c shard,
+// for statistics reported by shard (see cross_shard_free_stats()).
+void set_shard_id(unsigned shard) noexcept;
+
 }
 
 internal::numa_layout configure(std::vector<resource::memory> m, bool mbind,
@@ -339,6 +344,87 @@ class statistics {
     friend statistics stats();
 };
 
+/// Statistics of objects freed on this shard that belong to another one.
+struct cross_shard_free_statistics {
+    /// Number of the other shard's objects freed on this shard.
+    uint64_t frees = 0;
+    /// Number of batches in which they were handed back to their owner.
+    uint64_t batches = 0;
+};
+
+/// Capture a snapshot of the statistics of objects freed on this shard
+/// that belong to shard \c shard.
+cross_shard_free_statistics cross_shard_free_stats(unsigned shard);
+
+/// Usage of one size class of the allocator's small object pools.
+struct small_pool_statistics {
+    /// Size of the objects in the class, in bytes.
+    size_t object_size = 0;
+    /// Number of allocated objects.
+    uint64_t objects_in_use = 0;
+    /// Number of free objects in the spans held by the class.
+    uint64_t free_objects = 0;
+    /// Number of page spans held by the class.
+    uint64_t spans = 0;
+    /// Memory held by the class, in bytes.
+    size_t memory = 0;
+    /// Fraction of \ref memory held in free objects. This memory can only be
+    /// reused for objects of this class, not by other classes or by large
+    /// allocations.
+    double fragmentation() const noexcept {
+        return memory ? double(free_objects * object_size) / memory : 0;
+    }
+};
+
+/// Usage of the page spans of one size order.
+struct span_statistics {
+    /// Size of the spans of this order, in bytes; the order also counts
+    /// spans up to twice this size.
+    size_t span_size = 0;
+    /// Number of free spans.
+    uint64_t free_spans = 0;
+    /// Memory in free spans, in bytes.
+    size_t free_memory = 0;
+    /// Number of spans in use, by large allocations or by small object pools.
+    uint64_t used_spans = 0;
+    /// Memory in spans in use, in bytes.
+    size_t used_memory = 0;
+};
+
+/// Breakdown of the memory of a shard by allocator size class.
+struct fragmentation_report {
+    /// Small object pools, by increasing object size.
+    std::vector<small_pool_statistics> small_pools;
+    /// Page spans, by increasing size order; orders without spans are omitted.
+    std::vector<span_statistics> spans;
+    /// Free memory, in bytes.
+    size_t free_memory = 0;
+    /// Size of the largest free span, in bytes. Larger allocations cannot be
+    /// satisfied without reclaiming memory.
+    size_t largest_free_span = 0;
+    /// Fraction of free memory outside of the largest free span.
+    double fragmentation() const noexcept {
+        return free_memory ? 1 - double(largest_free_span) / free_memory : 0;
+    }
+};
+
+/// Capture a breakdown of this shard's memory by allocator size class.
+///
+/// This walks all of the shard's pages, so it is meant for diagnostics
+/// rather than frequent polling. See also \ref get_small_pool_statistics().
+fragmentation_report get_fragmentation_report();
+
+/// Number of size classes of the allocator's small object pools.
+unsigned small_pool_count();
+
+/// Capture the usage of the small object pool size class \c idx, which
+/// must be below \ref small_pool_count(). Cheaper than
+/// \ref get_fragmentation_report().
+small_pool_statistics get_small_pool_statistics(unsigned idx);
+
+/// Size of the largest free span of this shard, in bytes.
+size_t largest_free_span();
+
 struct memory_layout {
     uintptr_t start;
     uintptr_t end;
@@ -409,9 +495,77 @@ class scoped_large_allocation_warning_disable {
     void operator=(scoped_large_allocation_warning_disable&&) = delete;
 };
 
+/// Statistics of the huge page backed large allocation path, see
+/// \ref set_huge_page_allocation_threshold().
+struct huge_page_statistics {
+    /// Number of allocations served from whole huge pages.
+    uint64_t large_allocations = 0;
+    /// Number of huge pages the kernel was asked to back with a transparent huge page.
+    uint64_t collapses = 0;
+    /// Number of such requests which failed.
+    uint64_t collapse_failures = 0;
+    /// Memory known to be backed by transparent huge pages, in bytes.
+    size_t backed_memory = 0;
+};
+
+/// Serve large allocations from whole huge pages.
+///
+/// Allocations of at least \c threshold bytes are rounded up to a multiple
+/// of \ref huge_page_size, and so get huge-page aligned spans that do not
+/// share a huge page with smaller allocations. Unless seastar memory is
+/// backed by hugetlbfs, the kernel is also asked to back these with
+/// transparent huge pages right away (\p MADV_COLLAPSE, Linux 6.1 or later),
+/// rather than eventually.
+///
+/// Applies to the calling shard only. Zero (the default) disables it.
+///
+/// \note Rounding up can waste up to a huge page per allocation: with a
+/// threshold below \ref huge_page_size, the smallest affected allocations
+/// may take up to twice their size.
+void set_huge_page_allocation_threshold(size_t threshold);
+
+/// Capture a snapshot of the huge page backed large allocation statistics
+/// of this shard.
+huge_page_statistics get_huge_page_statistics();
+
+/// Statistics of the free memory handed back to the kernel, see
+/// \ref release_free_memory().
+struct released_memory_statistics {
+    /// Free memory currently released to the kernel, in bytes. It does not
+    /// count towards the resident memory of the process.
+    size_t released_memory = 0;
+    /// Total amount of memory released, in bytes.
+    uint64_t released_bytes = 0;
+    /// Total amount of released memory allocated again, and so faulted
+    /// back in, in bytes.
+    uint64_t reused_bytes = 0;
+};
+
+/// Hand idle free memory of this shard back to the kernel.
+///
+/// Seastar keeps all of a shard's memory once touched. This releases the
+/// free huge pages (\ref huge_page_size) of memory that stayed free since
+/// the previous call (\p MADV_DONTNEED), so that they no longer count
+/// towards the resident memory of the process, up to leaving \c keep_free
+/// bytes of free memory resident. The kernel faults released memory back
+/// in, zeroed, once it is allocated again. The largest free spans are
+/// released first.
+///
+/// The reactor calls this periodically when \ref reactor_options::memory_release_period_ms
+/// is set. Does nothing when seastar memory is backed by hugetlbfs, or is
+/// locked.
+///
+/// \return the amount of memory released, in bytes
+size_t release_free_memory(size_t keep_free);
+
+/// Capture a snapshot of the statistics of the free memory this shard
+/// handed back to the kernel.
+released_memory_statistics get_released_memory_statistics();
+
 /// @brief Describes an allocation location in the code.
 ///
-/// The location is identified by its backtrace. One allocation_site can
+/// The location is identified by its backtrace, and by the scheduling group
+/// the allocations were made in. One allocation_site can
 /// represent many allocations at the same location. `count` and `size`
 /// represent the cumulative sum of all allocations at the location. Note the
 /// size represents an extrapolated size and not the sampled one, i.e.: when
@@ -421,6 +575,7 @@ struct allocation_site {
     mutable size_t count = 0; /// number of live objects allocated at backtrace.
     mutable size_t size = 0; /// amount of bytes in live objects allocated at backtrace.
     simple_backtrace backtrace; /// call site for this allocation
+    unsigned group_index = 0; /// index of the scheduling group that was current at the allocations
 
     // All allocation sites are linked to each other. This can be used for easy
     // iteration across them in gdb scripts where it's difficult to work with
@@ -429,7 +584,7 @@ struct allocation_site {
     mutable const allocation_site* prev = nullptr; // previous allocation site in the chain
 
     bool operator==(const allocation_site& o) const {
-        return backtrace == o.backtrace;
+        return backtrace == o.backtrace && group_index == o.group_index;
     }
 
     bool operator!=(const allocation_site& o) const {
@@ -460,6 +615,33 @@ std::vector<allocation_site> sampled_memory_profile();
 /// @return number of \ref allocation_site copied to the vector
 size_t sampled_memory_profile(allocation_site* output, size_t size);
 
+/// @brief Returns all the allocations sampled so far, live or not
+///
+/// The \ref allocation_site::count and \ref allocation_site::size of the
+/// sites are those of all the allocations sampled at their backtrace since
+/// heap profiling was enabled, or since \ref reset_cumulative_memory_profile(),
+/// rather than those of the live ones: where the memory churns rather than
+/// where it is held. Their \c next and \c prev are null.
+///
+/// @return a vector of \ref allocation_site
+std::vector<allocation_site> sampled_cumulative_memory_profile();
+
+/// @brief Starts the cumulative profile of \ref sampled_cumulative_memory_profile() over
+void reset_cumulative_memory_profile();
+
+/// @brief Returns the memory held by the allocations a scheduling group made on this shard
+///
+/// Allocations are attributed to the scheduling group current when they
+/// were made, whichever group frees them. The amount is extrapolated from
+/// the allocations sampled by the heap profiler, like the \ref allocation_site::size
+/// of \ref sampled_memory_profile(), so it is only known while heap profiling
+/// is enabled (see \ref set_heap_profiling_sampling_rate()), and then only
+/// for memory allocated since; otherwise it is 0. It is an estimate, whose
+/// error shrinks with the sampling rate.
+///
+/// See \ref scheduling_group_soft_limit for acting on it.
+size_t scheduling_group_memory_usage(scheduling_group sg) noexcept;
+
 /// @brief Enable sampled heap profiling by setting a sample rate
 ///
 /// @param sample_rate the sample rate to use. Disable heap profiling by setting
@@ -508,7 +690,7 @@ namespace std {
 template<>
 struct hash<seastar::memory::allocation_site> {
     size_t operator()(const seastar::memory::allocation_site& bi) const {
-        return std::hash<seastar::simple_backtrace>()(bi.backtrace);
+        return std::hash<seastar::simple_backtrace>()(bi.backtrace) ^ bi.group_index;
     }
 };
 
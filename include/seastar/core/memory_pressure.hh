@@ -0,0 +1,147 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/weak_ptr.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+class memory_pressure_monitor;
+}
+
+namespace memory {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief How short of free memory the current shard is.
+///
+/// The level is derived from the fraction of the shard's memory that is
+/// free, compared against \ref reactor_options::memory_pressure_elevated_threshold
+/// and \ref reactor_options::memory_pressure_critical_threshold. A level is
+/// only left once free memory is comfortably (a quarter of the threshold)
+/// above it again, so that the level does not flap around a threshold.
+enum class pressure_level {
+    /// Free memory is plentiful.
+    normal,
+    /// Free memory is getting low; cold data should be shed.
+    elevated,
+    /// Free memory is about to run out and allocations are about to trigger
+    /// synchronous reclaim; shed whatever can be shed.
+    critical,
+};
+
+/// Returns the memory pressure level of the current shard.
+///
+/// Must be called on a reactor thread.
+pressure_level current_pressure_level() noexcept;
+
+/// \brief Subscribes to memory pressure level changes on the current shard.
+///
+/// Unlike a \ref reclaimer, which is only called once free memory is
+/// already below the reclaim watermark, the listener's callback is called
+/// (in a fiber of its own) as soon as the shard's pressure level changes,
+/// with the new level, giving caches a chance to shed data incrementally
+/// before any allocation has to wait for memory.
+///
+/// Callbacks of all listeners on a shard are called one after the other, in
+/// subscription order, each one waiting for the future returned by the
+/// previous one. If the level changes again while callbacks are running,
+/// they are called again with the latest level once the round completes.
+/// Exceptions are logged and otherwise ignored.
+///
+/// The listener must be created, and destroyed, on a reactor thread.
+/// It may be destroyed while its callback is running, but then the future
+/// returned by the callback must not depend on the listener.
+class pressure_listener {
+public:
+    using callback_type = noncopyable_function<future<> (pressure_level)>;
+private:
+    callback_type _callback;
+    boost::intrusive::list_member_hook<> _hook;
+    friend class seastar::internal::memory_pressure_monitor;
+public:
+    explicit pressure_listener(callback_type callback);
+    pressure_listener(const pressure_listener&) = delete;
+    pressure_listener& operator=(const pressure_listener&) = delete;
+    ~pressure_listener();
+};
+
+/// \brief A soft limit on the memory a scheduling group holds on the current shard.
+///
+/// Watches the group's \ref scheduling_group_memory_usage(), which is only
+/// known while heap profiling is enabled. Once it exceeds the limit, the
+/// callback is called (in a fiber of its own, running in the group) with
+/// the usage, so that the group releases memory: drops caches, defers or
+/// aborts background work. If a CPU cap is given, the group is also held to
+/// it (see \ref scheduling_group::set_cpu_cap()) for as long as it is over
+/// the limit, slowing it down without stopping it, since its own tasks may
+/// be needed to release the memory. Its original CPU cap is then restored,
+/// with the default period.
+///
+/// The group is back under the limit once its usage drops an eighth below
+/// the limit; the callback is called again if it exceeds the limit once
+/// more. Nothing stops the group from allocating beyond the limit.
+/// Exceptions from the callback are logged and otherwise ignored.
+///
+/// The limit must be created, and destroyed, on a reactor thread. It may be
+/// destroyed while its callback is running, but then the future returned by
+/// the callback must not depend on the limit.
+class scheduling_group_soft_limit : public weakly_referencable<scheduling_group_soft_limit> {
+public:
+    using callback_type = noncopyable_function<future<> (size_t usage)>;
+private:
+    scheduling_group _sg;
+    size_t _limit;
+    callback_type _callback;
+    float _throttle_cpu_cap;
+    float _saved_cpu_cap = 1.0f;
+    bool _exceeded = false;
+    bool _notifying = false;
+    boost::intrusive::list_member_hook<> _hook;
+    friend class seastar::internal::memory_pressure_monitor;
+public:
+    /// \param sg the group to watch
+    /// \param limit the soft limit on the memory of \c sg, in bytes
+    /// \param callback called when \c sg exceeds \c limit
+    /// \param throttle_cpu_cap the CPU cap \c sg is held to while over
+    ///        \c limit; 1 not to throttle it
+    scheduling_group_soft_limit(scheduling_group sg, size_t limit, callback_type callback, float throttle_cpu_cap = 1.0f);
+    scheduling_group_soft_limit(const scheduling_group_soft_limit&) = delete;
+    scheduling_group_soft_limit& operator=(const scheduling_group_soft_limit&) = delete;
+    ~scheduling_group_soft_limit();
+    /// Whether the group is over the limit.
+    bool exceeded() const noexcept { return _exceeded; }
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
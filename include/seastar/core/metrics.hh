@@ -22,6 +22,7 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <concepts>
 #include <functional>
 #include <limits>
 #include <map>
@@ -415,12 +416,25 @@ metric_function make_function(T val, data_type dt) {
     };
 }
 
-template<typename T, typename = std::enable_if_t<!std::is_invocable_v<T>>>
+// A histogram recorded into, such as log_linear_histogram
+template<typename T>
+concept histogram_source = requires (const T& val) {
+    { val.to_metrics_histogram() } -> std::same_as<histogram>;
+};
+
+template<typename T, typename = std::enable_if_t<!std::is_invocable_v<T> && !histogram_source<T>>>
 metric_function make_function(T& val, data_type dt) {
     return [dt, &val] {
         return metric_value(val, dt);
     };
 }
+
+template<histogram_source T>
+metric_function make_function(T& val, data_type dt) {
+    return [dt, &val] {
+        return metric_value(val.to_metrics_histogram(), dt);
+    };
+}
 }
 
 extern const bool metric_disabled;
@@ -65,6 +65,61 @@ struct hash<seastar::metrics::impl::labels_type> {
 
 namespace seastar {
 namespace metrics {
+namespace impl {
+
+/*!
+ * \brief An immutable set of labels, interned in a table of the shard
+ *
+ * All the metric ids of a shard with the same labels, the registrations,
+ * the metrics' current and original labels and the metadata snapshots,
+ * share one copy of the set, which is dropped from the table with its last
+ * reference. Interned sets must be copied and destroyed on the shard that
+ * interned them.
+ */
+class interned_labels {
+    lw_shared_ptr<const labels_type> _labels;
+    void release() noexcept;
+public:
+    // The empty set, which isn't interned
+    interned_labels() noexcept = default;
+    explicit interned_labels(const labels_type& labels);
+    interned_labels(const interned_labels&) = default;
+    interned_labels(interned_labels&&) noexcept = default;
+    interned_labels& operator=(const interned_labels& o) noexcept {
+        if (_labels != o._labels) {
+            release();
+            _labels = o._labels;
+        }
+        return *this;
+    }
+    interned_labels& operator=(interned_labels&& o) noexcept {
+        if (this != &o) {
+            release();
+            _labels = std::move(o._labels);
+        }
+        return *this;
+    }
+    ~interned_labels() {
+        release();
+    }
+    const labels_type& get() const noexcept;
+    bool operator==(const interned_labels& o) const noexcept {
+        return _labels == o._labels || get() == o.get();
+    }
+    // Orders the sets by their labels, and so allows looking them up with
+    // a plain labels_type.
+    struct less {
+        using is_transparent = void;
+        bool operator()(const interned_labels& a, const interned_labels& b) const noexcept { return a.get() < b.get(); }
+        bool operator()(const interned_labels& a, const labels_type& b) const noexcept { return a.get() < b; }
+        bool operator()(const labels_type& a, const interned_labels& b) const noexcept { return a < b.get(); }
+    };
+};
+
+// The number of distinct label sets interned on this shard
+size_t interned_label_sets() noexcept;
+
+}
 
 SEASTAR_MODULE_EXPORT
 struct relabel_config;
@@ -106,7 +161,7 @@ class metric_id {
 public:
     metric_id() = default;
     metric_id(group_name_type group, metric_name_type name,
-                    labels_type labels = {})
+                    const labels_type& labels = {})
                     : _group(std::move(group)), _name(
                                     std::move(name)), _labels(labels) {
     }
@@ -123,17 +178,23 @@ class metric_id {
         _group = name;
     }
     const instance_id_type & instance_id() const {
-        return _labels.at(shard_label.name());
+        return _labels.get().at(shard_label.name());
     }
     const metric_name_type & name() const {
         return _name;
     }
     const labels_type& labels() const {
-        return _labels;
+        return _labels.get();
     }
-    labels_type& labels() {
+    const interned_labels& interned() const {
         return _labels;
     }
+    void set_labels(const labels_type& labels) {
+        _labels = interned_labels(labels);
+    }
+    void set_labels(const interned_labels& labels) {
+        _labels = labels;
+    }
     sstring full_name() const;
 
     bool operator<(const metric_id&) const;
@@ -144,7 +205,7 @@ class metric_id {
     }
     group_name_type _group;
     metric_name_type _name;
-    labels_type _labels;
+    interned_labels _labels;
 };
 }
 }
@@ -191,7 +252,7 @@ struct metric_family_info {
  */
 struct metric_info {
     metric_id id;
-    labels_type original_labels;
+    interned_labels original_labels;
     bool enabled;
     skip_when_empty should_skip_when_empty;
 };
@@ -249,11 +310,13 @@ class registered_metric final {
 };
 
 using register_ref = shared_ptr<registered_metric>;
-using metric_instances = std::map<labels_type, register_ref>;
+using metric_instances = std::map<interned_labels, register_ref, interned_labels::less>;
 
 class metric_family {
     metric_instances _instances;
     metric_family_info _info;
+    // Whether the family changed since the metadata was last built
+    bool _changed = true;
 public:
     using iterator = metric_instances::iterator;
     using const_iterator = metric_instances::const_iterator;
@@ -270,11 +333,31 @@ class metric_family {
     }
 
     register_ref& operator[](const labels_type& l) {
+        auto i = _instances.find(l);
+        if (i == _instances.end()) {
+            i = _instances.emplace(interned_labels(l), register_ref()).first;
+        }
+        return i->second;
+    }
+
+    register_ref& operator[](const interned_labels& l) {
         return _instances[l];
     }
 
     const register_ref& at(const labels_type& l) const {
-        return _instances.at(l);
+        auto i = _instances.find(l);
+        if (i == _instances.end()) {
+            throw std::out_of_range("metric_family::at");
+        }
+        return i->second;
+    }
+
+    bool changed() const noexcept {
+        return _changed;
+    }
+
+    void set_changed(bool changed = true) noexcept {
+        _changed = changed;
     }
 
     metric_family_info& info() {
@@ -337,7 +420,8 @@ using metric_metadata_fifo = std::deque<metric_info>;
  * The struct is used for two purposes. First, it allows iterating over all metric_families
  * and all metrics related to them. Second, it only contains enabled metrics,
  * making disabled metrics more efficient.
- * The struct is recreated when impl._value_map changes
+ * The struct is recreated when impl._value_map changes, rebuilding only the
+ * families which changed and taking the others from the previous one
  */
 struct metric_family_metadata {
     metric_family_info mf;
@@ -0,0 +1,122 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#endif
+#include <seastar/core/metrics_types.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+namespace metrics {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/*!
+ * \brief A histogram to record values into, and to report as a metric.
+ *
+ * The buckets are log-linear: each power of two between \c Min and \c Max
+ * is split into \c Precision buckets of the same width, as by
+ * \ref internal::approximate_exponential_histogram, so that recording a
+ * value only takes finding the bucket from its highest bits. The values
+ * up to \c Min are counted in the first bucket, those from \c Max in the
+ * last one, which is reported as the +Inf bucket. The sum of the values
+ * is kept exactly.
+ *
+ * A histogram is meant to be recorded into by one shard, without any
+ * synchronization, and registered as a metric there: the metrics of the
+ * shards, of the same bucket limits, are summed when aggregated over the
+ * \c shard label. They are exported as both classic and native Prometheus
+ * histograms, the schema of which is log2(Precision).
+ *
+ * \code
+ * metrics::log_linear_histogram<> latency; // in microseconds
+ * _metrics.add_group("requests", {
+ *     sm::make_histogram("latency", sm::description("Request latency in microseconds"), latency),
+ * });
+ * ...
+ * latency.record(std::chrono::steady_clock::now() - start);
+ * \endcode
+ *
+ * \param Min - the lowest value told apart, a power of two not lower than Precision
+ * \param Max - the lowest value counted in the +Inf bucket, a power of two
+ * \param Precision - the number of buckets of each power of two, a power of two
+ */
+template <uint64_t Min = 512, uint64_t Max = 33554432, size_t Precision = 4>
+class log_linear_histogram {
+    internal::approximate_exponential_histogram<Min, Max, Precision> _buckets;
+    double _sum = 0;
+public:
+    /// Counts \c value in its bucket
+    void record(uint64_t value) noexcept {
+        _buckets[_buckets.find_bucket_index(value)]++;
+        _sum += value;
+    }
+
+    /// Counts \c d, in microseconds, in its bucket
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d) noexcept {
+        record(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    }
+
+    /// Adds the values recorded into \c o
+    log_linear_histogram& merge(const log_linear_histogram& o) noexcept {
+        _buckets.merge(o._buckets);
+        _sum += o._sum;
+        return *this;
+    }
+
+    void clear() noexcept {
+        _buckets.clear();
+        _sum = 0;
+    }
+
+    /// The number of values recorded
+    uint64_t count() const noexcept {
+        return _buckets.count();
+    }
+
+    /// The sum of the values recorded
+    double sum() const noexcept {
+        return _sum;
+    }
+
+    /// The lower limit of the bucket of the value at \c q, in [0, 1]
+    uint64_t quantile(float q) const {
+        return _buckets.quantile(q);
+    }
+
+    /// The buckets, as reported
+    histogram to_metrics_histogram() const {
+        auto h = _buckets.to_metrics_histogram();
+        h.sample_sum = _sum;
+        return h;
+    }
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shard_id.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+struct offload_slot {
+    shard_id shard;
+    semaphore& units;
+};
+
+// Picks the offload shard with the fewest requests in flight from the
+// current shard, or returns nothing if the work is to run here.
+std::optional<offload_slot> pick_offload_slot() noexcept;
+
+void configure_offload(unsigned shards, unsigned queue_depth);
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// The number of shards reserved for offloaded work with
+/// \ref smp_options::offload_shards, the highest-numbered ones.
+unsigned offload_shard_count() noexcept;
+
+/// \brief Whether a shard is reserved for offloaded work.
+///
+/// Offload shards run reactors like all the others, and services started
+/// with \ref sharded::start() have instances there too. Those should stay
+/// dormant on them, owning no data and not listening for connections, so
+/// that the offload shards are left to what \ref offload() sends them.
+bool is_offload_shard(shard_id id = this_shard_id()) noexcept;
+
+/// \brief Runs CPU-bound background work on an offload shard.
+///
+/// Runs \c func in \c sg on the offload shard with the fewest requests in
+/// flight from the current shard, so that background work (compression,
+/// checksumming, merging) doesn't take task quota away from the
+/// latency-sensitive work of the current shard. Work submitted from an
+/// offload shard, or when there are none, runs in place.
+///
+/// Each shard has at most \ref smp_options::offload_queue_depth requests
+/// in flight to each offload shard; further calls wait for one to
+/// complete before being sent, which pushes back on the submitter.
+///
+/// Like with \ref smp::submit_to(), \c func is moved to the offload shard
+/// and destroyed there, and must not touch the current shard's state; the
+/// result is moved back.
+///
+/// \param sg the scheduling group to run \c func in on the offload shard; a
+///        group whose work is all submitted through offload() is thereby
+///        pinned to the offload shards
+/// \param func callable to run, returning a value or a future
+template <typename Func>
+requires std::is_invocable_v<Func>
+futurize_t<std::invoke_result_t<Func>>
+offload(scheduling_group sg, Func func) {
+    auto slot = internal::pick_offload_slot();
+    if (!slot) {
+        return with_scheduling_group(sg, std::move(func));
+    }
+    return get_units(slot->units, 1).then([shard = slot->shard, sg, func = std::move(func)] (auto units) mutable {
+        return smp::submit_to(shard, [sg, func = std::move(func)] () mutable {
+            return with_scheduling_group(sg, std::move(func));
+        }).finally([units = std::move(units)] {});
+    });
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
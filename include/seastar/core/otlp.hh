@@ -0,0 +1,130 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#endif
+#include <seastar/core/abort_source.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/socket_defs.hh>
+#include <seastar/net/tls.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace http::experimental {
+class client;
+class connection_factory;
+}
+
+/// \brief Pushing the metrics to an OpenTelemetry collector.
+///
+/// The metrics are sent, every \ref config::interval, as an OTLP
+/// ExportMetricsServiceRequest encoded in protobuf, POSTed over HTTP, as
+/// OTLP/HTTP defines it. Each shard encodes its own series; the shard the
+/// exporter runs on only puts those of the shards together, family by
+/// family, summing the series the families aggregate, as the Prometheus
+/// endpoint does. Gauges are sent as gauges, counters as monotonic sums,
+/// histograms as explicit bucket histograms and summaries as summaries.
+namespace otlp {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// How the sums and histograms are reported, see the OTLP
+/// AggregationTemporality
+enum class temporality {
+    /// What was counted since the previous push; a failed push is
+    /// covered by the next one
+    delta,
+    /// What was counted since the exporter was started
+    cumulative,
+};
+
+struct config {
+    /// The address of the collector
+    socket_address address;
+    /// The value of the Host header; the address if empty
+    sstring host;
+    /// The credentials to connect to the collector with TLS, none for
+    /// plain HTTP
+    shared_ptr<tls::certificate_credentials> credentials;
+    sstring path = "/v1/metrics";
+    std::chrono::milliseconds interval = std::chrono::seconds(10);
+    otlp::temporality temporality = otlp::temporality::cumulative;
+    /// A prefix added to the metric names, followed by '_'
+    sstring prefix = "seastar";
+    /// The attributes of the resource, such as host.name; service.name
+    /// is sent as \ref service_name if not set
+    std::vector<std::pair<sstring, sstring>> resource_attributes;
+    sstring service_name = "seastar";
+    /// Sum the series over the labels their families aggregate, as the
+    /// Prometheus endpoint does by default
+    bool aggregate = true;
+};
+
+/// \cond internal
+class shard_exporter;
+/// \endcond
+
+/// Pushes the metrics of all the shards from the shard it is started on
+class exporter {
+    config _cfg;
+    sharded<shard_exporter> _shards;
+    std::unique_ptr<http::experimental::client> _client;
+    abort_source _as;
+    std::optional<future<>> _loop;
+
+    future<> run();
+    future<sstring> encode();
+public:
+    explicit exporter(config cfg);
+    /// Connects to the collector with \c factory, rather than to
+    /// \ref config::address with \ref config::credentials
+    exporter(config cfg, std::unique_ptr<http::experimental::connection_factory> factory);
+    ~exporter();
+
+    /// Starts pushing every \ref config::interval
+    future<> start();
+    /// Pushes the metrics now, once started
+    ///
+    /// \throws what sending them to the collector failed with, such as
+    ///     std::runtime_error if it did not reply with 200 OK
+    future<> push();
+    /// Stops pushing, waiting for a push in progress, and closes the
+    /// connections to the collector
+    future<> stop();
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -26,6 +26,11 @@
 
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <optional>
+#include <vector>
+#endif
 
 /// \defgroup fiber-module Fibers
 ///
@@ -94,9 +99,27 @@ class pipe_buffer {
     future<std::optional<T>> read() {
         return _buf.pop_eventually();
     }
+    future<std::vector<T>> read_batch(size_t max) {
+        return _buf.not_empty().then([this, max] {
+            std::vector<T> ret;
+            ret.reserve(std::min(max, _buf.size()));
+            _buf.consume([&ret, max] (std::optional<T>&& item) {
+                if (!item) {
+                    // EOF, which is the only item left.
+                    return false;
+                }
+                ret.push_back(std::move(*item));
+                return ret.size() < max;
+            });
+            return ret;
+        });
+    }
     future<> write(T&& data) {
         return _buf.push_eventually(std::move(data));
     }
+    future<> write_batch(std::vector<T>&& data) {
+        return _buf.push_eventually_batch(std::move(data));
+    }
     bool readable() const {
         return _write_open || !_buf.empty();
     }
@@ -161,6 +184,25 @@ class pipe_reader {
             return make_ready_future<std::optional<T>>();
         }
     }
+    /// \brief Read up to \c max items from the pipe
+    ///
+    /// Like read(), but returns all the items that are ready, up to
+    /// \c max (which must be positive), with a single continuation. An
+    /// empty vector marks the end of file.
+    future<std::vector<T>> read_batch(size_t max) {
+        max = std::max<size_t>(max, 1);
+        if (_unread) {
+            std::vector<T> ret;
+            ret.push_back(std::move(*_unread));
+            _unread = {};
+            return make_ready_future<std::vector<T>>(std::move(ret));
+        }
+        if (_bufp->readable()) {
+            return _bufp->read_batch(max);
+        } else {
+            return make_ready_future<std::vector<T>>();
+        }
+    }
     /// \brief Return an item to the front of the pipe
     ///
     /// Pushes the given item to the front of the pipe, so it will be
@@ -216,6 +258,17 @@ class pipe_writer {
             return make_exception_future<>(broken_pipe_exception());
         }
     }
+    /// \brief Write several items to the pipe
+    ///
+    /// Like write(), but writes all of \c data, waking the reader once for
+    /// each group of items that fit in the buffer together.
+    future<> write_batch(std::vector<T>&& data) {
+        if (_bufp->writeable()) {
+            return _bufp->write_batch(std::move(data));
+        } else {
+            return make_exception_future<>(broken_pipe_exception());
+        }
+    }
     ~pipe_writer() {
         if (_bufp && _bufp->close_write()) {
             delete _bufp;
@@ -0,0 +1,157 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <seastar/core/future.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+template <typename Stage, typename... Args>
+using pipeline_stage_result_t = std::invoke_result_t<Stage&, Args&&...>;
+
+// Runs the stages of a pipeline from the I-th one on, with the value (if
+// any) produced by the previous one. Stages are run back to back for as
+// long as they produce values, or available futures; the first stage
+// returning an unavailable future gets the remaining stages chained to it
+// in a single continuation.
+template <size_t I, typename Stages, typename... Args>
+auto run_pipeline_stages(Stages& stages, Args&&... args) {
+    if constexpr (I == std::tuple_size_v<Stages>) {
+        return make_ready_future<std::remove_cvref_t<Args>...>(std::forward<Args>(args)...);
+    } else {
+        auto& stage = std::get<I>(stages);
+        using result = pipeline_stage_result_t<std::tuple_element_t<I, Stages>, Args...>;
+        if constexpr (is_future<result>::value) {
+            auto f = std::invoke(stage, std::forward<Args>(args)...);
+            if (f.available() && !f.failed()) {
+                if constexpr (std::is_same_v<result, future<>>) {
+                    f.get();
+                    return run_pipeline_stages<I + 1>(stages);
+                } else {
+                    return run_pipeline_stages<I + 1>(stages, f.get());
+                }
+            }
+            return std::move(f).then([stages = std::move(stages)] <typename... V> (V&&... v) mutable {
+                return run_pipeline_stages<I + 1>(stages, std::forward<V>(v)...);
+            });
+        } else if constexpr (std::is_void_v<result>) {
+            std::invoke(stage, std::forward<Args>(args)...);
+            return run_pipeline_stages<I + 1>(stages);
+        } else {
+            return run_pipeline_stages<I + 1>(stages, std::invoke(stage, std::forward<Args>(args)...));
+        }
+    }
+}
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup future-util
+/// @{
+
+/// \brief A lazily evaluated chain of transforms of a future's value.
+///
+/// Every \ref future::then() in a chain creates a future, and, when the
+/// future it is called on is not available yet, allocates a continuation
+/// for it; a chain of n transforms of a value that is not ready allocates
+/// n continuations. A pipeline only records its stages as they are added,
+/// and runs them once \ref get_future() is called: stages producing
+/// values (or available futures) run back to back without creating
+/// futures in between, and only the first stage returning an unavailable
+/// future (or the source, if it is not available) gets a continuation,
+/// which runs all the remaining stages. Only get_future() returns a
+/// future.
+///
+/// Stages are callables taking the value of the previous stage (or of the
+/// source future), or nothing for \c void; they may return a value, a
+/// future, or nothing. An exception thrown by a stage, or a failed
+/// future, skips the remaining stages and fails the pipeline's future.
+///
+/// \code
+/// future<reply> f = make_pipeline(read_frame())
+///         .then([] (temporary_buffer<char> frame) { return parse_header(frame); })
+///         .then([] (header h) { return validate(h); })
+///         .then([] (header h) { return make_reply(h); })
+///         .get_future();
+/// \endcode
+///
+/// \tparam T the type of the source future's value
+/// \tparam Stages the types of the stages
+template <typename T, typename... Stages>
+class pipeline {
+    future<T> _source;
+    std::tuple<Stages...> _stages;
+
+    template <typename U, typename... S>
+    friend class pipeline;
+public:
+    pipeline(future<T> source, std::tuple<Stages...> stages) noexcept(std::is_nothrow_move_constructible_v<std::tuple<Stages...>>)
+            : _source(std::move(source)), _stages(std::move(stages)) {}
+
+    /// Returns the pipeline with \c func added as its last stage
+    template <typename Func>
+    pipeline<T, Stages..., std::decay_t<Func>> then(Func&& func) && {
+        return pipeline<T, Stages..., std::decay_t<Func>>(std::move(_source),
+                std::tuple_cat(std::move(_stages), std::make_tuple(std::forward<Func>(func))));
+    }
+
+    /// Runs the pipeline
+    ///
+    /// \return a future resolving to the value of the last stage
+    auto get_future() && noexcept {
+        if (_source.available() && !_source.failed()) {
+            return futurize_invoke([this] {
+                if constexpr (std::is_void_v<T>) {
+                    _source.get();
+                    return internal::run_pipeline_stages<0>(_stages);
+                } else {
+                    return internal::run_pipeline_stages<0>(_stages, _source.get());
+                }
+            });
+        }
+        return std::move(_source).then([stages = std::move(_stages)] <typename... V> (V&&... v) mutable {
+            return internal::run_pipeline_stages<0>(stages, std::forward<V>(v)...);
+        });
+    }
+};
+
+/// Starts a \ref pipeline transforming the value of \c source
+template <typename T>
+pipeline<T> make_pipeline(future<T> source) noexcept {
+    return pipeline<T>(std::move(source), std::tuple<>());
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
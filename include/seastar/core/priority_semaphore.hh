@@ -0,0 +1,253 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+#endif
+#include <seastar/core/abort_on_expiry.hh>
+#include <seastar/core/abortable_fifo.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fiber-module
+/// @{
+
+/// A counted semaphore sharing its units among the scheduling groups
+/// waiting for them, in proportion to their shares.
+///
+/// A \ref semaphore serves its waiters in the order they came, so a
+/// waiter for many units, or a burst of background waiters, holds up all
+/// the ones behind it. This one queues the waiters of each scheduling
+/// group apart, in the order they came, the group being the one wait() is
+/// called in, and serves next the group that got the fewest units for its
+/// shares so far. A group that did not wait for a while does not get to
+/// catch up on the units it did not use.
+///
+/// Two settings of \ref config soften that:
+/// - \ref config::small_request_bypass lets the waiters for few units go
+///   as soon as there are units for them, rather than waiting for the ones
+///   in front of them;
+/// - \ref config::max_wait bounds the time a waiter waits before it is
+///   served first, whatever the shares of its group, and before the
+///   bypass stops until it is, so that neither starves.
+///
+/// The time each group's waiters waited is kept in a histogram, see
+/// get_stats().
+///
+/// Units are returned with signal(), or by the \ref priority_semaphore::units
+/// returned by get_units().
+class priority_semaphore {
+public:
+    using clock = timer<>::clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    struct config {
+        /// Waiters for that many units or fewer do not queue behind larger
+        /// ones when there are units for them; 0 disables the bypass
+        size_t small_request_bypass = 0;
+        /// A waiter waiting longer than that is served first
+        duration max_wait = std::chrono::seconds(1);
+    };
+
+    /// Statistics of the waiters of a scheduling group
+    struct class_stats {
+        /// Waiters served after waiting
+        uint64_t waits = 0;
+        /// Waiters served at once, though others were waiting, for they
+        /// waited for few units
+        uint64_t bypasses = 0;
+        /// Waiters served first, for they waited longer than \ref config::max_wait
+        uint64_t aged = 0;
+        /// How long the waiters served after waiting waited
+        metrics::internal::time_estimated_histogram wait_time;
+    };
+
+    /// Units of a \ref priority_semaphore, returned to it when destroyed
+    class units {
+        priority_semaphore* _sem = nullptr;
+        size_t _n = 0;
+    public:
+        units() noexcept = default;
+        units(priority_semaphore& sem, size_t n) noexcept : _sem(&sem), _n(n) {}
+        units(units&& o) noexcept : _sem(o._sem), _n(std::exchange(o._n, 0)) {}
+        units& operator=(units&& o) noexcept {
+            if (this != &o) {
+                return_all();
+                _sem = o._sem;
+                _n = std::exchange(o._n, 0);
+            }
+            return *this;
+        }
+        ~units() {
+            return_all();
+        }
+        /// Returns the units to the semaphore
+        void return_all() noexcept {
+            if (_n) {
+                _sem->signal(std::exchange(_n, 0));
+            }
+        }
+        /// Releases ownership of the units, the caller returning them
+        size_t release() noexcept {
+            return std::exchange(_n, 0);
+        }
+        size_t count() const noexcept {
+            return _n;
+        }
+    };
+
+private:
+    struct entry {
+        promise<> pr;
+        size_t nr;
+        time_point since;
+        std::optional<abort_on_expiry<clock>> timer;
+        entry(promise<>&& pr_, size_t nr_, time_point since_) noexcept : pr(std::move(pr_)), nr(nr_), since(since_) {}
+    };
+    struct expiry_handler {
+        priority_semaphore& sem;
+        void operator()(entry& e) noexcept;
+    };
+    struct priority_class {
+        internal::abortable_fifo<entry, expiry_handler> waiters;
+        // The units the class got divided by its shares; the class served
+        // next is the one with the least
+        double vtime = 0;
+        float shares = 1;
+        class_stats stats;
+        explicit priority_class(priority_semaphore& sem) noexcept : waiters(expiry_handler{sem}) {}
+    };
+
+    ssize_t _count;
+    config _cfg;
+    std::exception_ptr _ex;
+    // Created as scheduling groups wait
+    std::array<std::unique_ptr<priority_class>, max_scheduling_groups()> _classes;
+    // The vtime of the last class served, a class that starts waiting
+    // again catching up to it
+    double _vtime = 0;
+
+    bool has_available_units(size_t nr) const noexcept {
+        return _count >= 0 && static_cast<size_t>(_count) >= nr;
+    }
+    priority_class& class_of(scheduling_group sg);
+    bool empty() const noexcept;
+    bool may_proceed(size_t nr, time_point now) const noexcept;
+    // The class whose first waiter is the oldest, if it waited for too long
+    priority_class* aged(time_point now) const noexcept;
+    void consume_for(priority_class& c, size_t nr) noexcept;
+    void serve(priority_class& c, time_point now) noexcept;
+    void wake_waiters() noexcept;
+    future<> wait(scheduling_group sg, time_point timeout, abort_source* as, size_t nr) noexcept;
+public:
+    /// \param count the units initially available
+    priority_semaphore(size_t count, config cfg) noexcept;
+    explicit priority_semaphore(size_t count) noexcept : priority_semaphore(count, config{}) {}
+    priority_semaphore(const priority_semaphore&) = delete;
+    priority_semaphore& operator=(const priority_semaphore&) = delete;
+    ~priority_semaphore();
+
+    /// Waits for \c nr units, in the waiters of the current scheduling group.
+    future<> wait(size_t nr = 1) noexcept {
+        return wait(current_scheduling_group(), time_point::max(), nullptr, nr);
+    }
+    /// Waits for \c nr units until \c timeout, failing with a
+    /// \ref semaphore_timed_out then.
+    future<> wait(time_point timeout, size_t nr = 1) noexcept {
+        return wait(current_scheduling_group(), timeout, nullptr, nr);
+    }
+    /// Waits for \c nr units for at most \c timeout.
+    future<> wait(duration timeout, size_t nr = 1) noexcept {
+        return wait(clock::now() + timeout, nr);
+    }
+    /// Waits for \c nr units until \c as is aborted, failing with a
+    /// \ref semaphore_aborted then.
+    future<> wait(abort_source& as, size_t nr = 1) noexcept {
+        return wait(current_scheduling_group(), time_point::max(), &as, nr);
+    }
+    /// Waits for \c nr units in the waiters of \c sg, rather than in those
+    /// of the current scheduling group.
+    future<> wait(scheduling_group sg, size_t nr) noexcept {
+        return wait(sg, time_point::max(), nullptr, nr);
+    }
+
+    /// Takes \c nr units if there are and, unless they are few enough to
+    /// bypass them, no one is waiting.
+    bool try_wait(size_t nr = 1) noexcept;
+    /// Returns \c nr units, serving the waiters they are enough for.
+    void signal(size_t nr = 1) noexcept;
+    /// Takes \c nr units at once, the count possibly going negative.
+    void consume(size_t nr = 1) noexcept;
+
+    /// Fails the current and future waits with \c ex.
+    void broken(std::exception_ptr ex) noexcept;
+    /// Fails the current and future waits with \ref broken_semaphore.
+    void broken() noexcept {
+        broken(std::make_exception_ptr(broken_semaphore()));
+    }
+
+    /// The units available, which is negative after consume() took more
+    ssize_t available_units() const noexcept {
+        return _count;
+    }
+    /// The number of waiters, of all the scheduling groups
+    size_t waiters() const noexcept;
+
+    /// The statistics of the waiters of \c sg
+    const class_stats& get_stats(scheduling_group sg) const noexcept;
+};
+
+/// Waits for \c nr units of \c sem, returned when the result is destroyed.
+inline future<priority_semaphore::units> get_units(priority_semaphore& sem, size_t nr) noexcept {
+    return sem.wait(nr).then([&sem, nr] {
+        return priority_semaphore::units(sem, nr);
+    });
+}
+
+/// Waits for \c nr units of \c sem until \c timeout.
+inline future<priority_semaphore::units> get_units(priority_semaphore& sem, size_t nr, priority_semaphore::time_point timeout) noexcept {
+    return sem.wait(timeout, nr).then([&sem, nr] {
+        return priority_semaphore::units(sem, nr);
+    });
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
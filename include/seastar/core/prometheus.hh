@@ -26,6 +26,7 @@
 #include <seastar/core/metrics.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/modules.hh>
+#include <chrono>
 #include <optional>
 #endif
 
@@ -44,6 +45,7 @@ struct config {
     std::optional<metrics::label_instance> label; //!< A label that will be added to all metrics, we advice not to use it and set it on the prometheus server
     sstring prefix = "seastar"; //!< a prefix that will be added to metric names
     bool allow_protobuf = false; // protobuf support is experimental and off by default
+    std::chrono::milliseconds cache_interval{0}; //!< how long a reply is served again to the requests for the same metrics, for the scrapers of an interval to share the cost of one; zero renders each
 };
 
 future<> start(httpd::http_server_control& http_server, config ctx);
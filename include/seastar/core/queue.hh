@@ -25,8 +25,12 @@
 #include <seastar/core/future.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <concepts>
+#include <iterator>
 #include <optional>
 #include <queue>
+#include <vector>
 #endif
 
 namespace seastar {
@@ -50,6 +54,8 @@ class queue {
 private:
     void notify_not_empty() noexcept;
     void notify_not_full() noexcept;
+    template <typename U>
+    future<> push_remaining(std::vector<U> items, size_t done) noexcept;
 public:
     explicit queue(size_t size);
 
@@ -58,11 +64,27 @@ class queue {
     /// Returns false if the queue was full and the item was not pushed.
     bool push(T&& a);
 
+    /// \brief Push as many items as fit.
+    ///
+    /// Pushes items constructed from [first, last) until the queue is full,
+    /// waking a blocked consumer once. Use std::make_move_iterator() to move
+    /// the items rather than copy them.
+    ///
+    /// Returns an iterator to the first item that was not pushed.
+    template <std::input_iterator It>
+    It push_batch(It first, It last);
+
     /// \brief Pop an item.
     ///
     /// Popping from an empty queue will result in undefined behavior.
     T pop() noexcept;
 
+    /// \brief Pop up to \c max items.
+    ///
+    /// Pops items from the front of the queue, waking a blocked producer
+    /// once. Returns an empty vector if the queue is empty.
+    std::vector<T> pop_batch(size_t max);
+
     /// \brief access the front element in the queue
     ///
     /// Accessing the front of an empty or aborted queue will result in undefined
@@ -98,6 +120,15 @@ class queue {
     /// A consumer-side operation. Cannot be called concurrently with other consumer-side operations.
     future<T> pop_eventually() noexcept;
 
+    /// Pops up to \c max elements now, or when there are some. Returns a
+    /// future that becomes available with at least one element, unless
+    /// \c max is zero. Amortizes the cost of a continuation over all the
+    /// elements that are ready.
+    /// If the queue is, or already was, abort()ed, the future resolves with
+    /// the exception provided to abort().
+    /// A consumer-side operation. Cannot be called concurrently with other consumer-side operations.
+    future<std::vector<T>> pop_eventually_batch(size_t max) noexcept;
+
     /// Pushes the element now or when there is room. Returns a future<> which
     /// resolves when data was pushed.
     /// If the queue is, or already was, abort()ed, the future resolves with
@@ -105,6 +136,17 @@ class queue {
     /// A producer-side operation. Cannot be called concurrently with other producer-side operations.
     future<> push_eventually(T&& data) noexcept;
 
+    /// Pushes elements constructed from all of \c items, now or as room
+    /// becomes available, waking the consumer once for each group of elements
+    /// that can be pushed together. Returns a future<> which resolves when
+    /// all of them were pushed.
+    /// If the queue is, or already was, abort()ed, the future resolves with
+    /// the exception provided to abort().
+    /// A producer-side operation. Cannot be called concurrently with other producer-side operations.
+    template <typename U = T>
+    requires std::constructible_from<T, U&&>
+    future<> push_eventually_batch(std::vector<U>&& items) noexcept;
+
     /// Returns the number of items currently in the queue.
     size_t size() const noexcept {
         // std::queue::size() has no reason to throw
@@ -194,6 +236,29 @@ bool queue<T>::push(T&& data) {
     }
 }
 
+template <typename T>
+requires std::is_nothrow_move_constructible_v<T>
+template <std::input_iterator It>
+inline
+It queue<T>::push_batch(It first, It last) {
+    bool pushed = false;
+    try {
+        for (; first != last && _q.size() < _max; ++first) {
+            _q.emplace(*first);
+            pushed = true;
+        }
+    } catch (...) {
+        if (pushed) {
+            notify_not_empty();
+        }
+        throw;
+    }
+    if (pushed) {
+        notify_not_empty();
+    }
+    return first;
+}
+
 template <typename T>
 requires std::is_nothrow_move_constructible_v<T>
 inline
@@ -219,6 +284,23 @@ T queue<T>::pop() noexcept {
     return data;
 }
 
+template <typename T>
+requires std::is_nothrow_move_constructible_v<T>
+inline
+std::vector<T> queue<T>::pop_batch(size_t max) {
+    std::vector<T> ret;
+    ret.reserve(std::min(max, _q.size()));
+    // Moving the elements into the reserved vector doesn't throw.
+    while (ret.size() < max && !_q.empty()) {
+        ret.push_back(std::move(_q.front()));
+        _q.pop();
+    }
+    if (!full()) {
+        notify_not_full();
+    }
+    return ret;
+}
+
 template <typename T>
 requires std::is_nothrow_move_constructible_v<T>
 inline
@@ -244,6 +326,30 @@ future<T> queue<T>::pop_eventually() noexcept {
     }
 }
 
+template <typename T>
+requires std::is_nothrow_move_constructible_v<T>
+inline
+future<std::vector<T>> queue<T>::pop_eventually_batch(size_t max) noexcept {
+    if (_ex) {
+        return make_exception_future<std::vector<T>>(_ex);
+    }
+    if (empty() && max) {
+        return not_empty().then([this, max] {
+            if (_ex) {
+                return make_exception_future<std::vector<T>>(_ex);
+            } else {
+                return make_ready_future<std::vector<T>>(pop_batch(max));
+            }
+        });
+    } else {
+      try {
+        return make_ready_future<std::vector<T>>(pop_batch(max));
+      } catch (...) {
+        return current_exception_as_future<std::vector<T>>();
+      }
+    }
+}
+
 template <typename T>
 requires std::is_nothrow_move_constructible_v<T>
 inline
@@ -267,6 +373,37 @@ future<> queue<T>::push_eventually(T&& data) noexcept {
     }
 }
 
+template <typename T>
+requires std::is_nothrow_move_constructible_v<T>
+template <typename U>
+requires std::constructible_from<T, U&&>
+inline
+future<> queue<T>::push_eventually_batch(std::vector<U>&& items) noexcept {
+    if (_ex) {
+        return make_exception_future<>(_ex);
+    }
+    return push_remaining(std::move(items), 0);
+}
+
+template <typename T>
+requires std::is_nothrow_move_constructible_v<T>
+template <typename U>
+inline
+future<> queue<T>::push_remaining(std::vector<U> items, size_t done) noexcept {
+    try {
+        auto it = push_batch(std::make_move_iterator(items.begin() + done), std::make_move_iterator(items.end()));
+        done = it.base() - items.begin();
+    } catch (...) {
+        return current_exception_as_future();
+    }
+    if (done == items.size()) {
+        return make_ready_future<>();
+    }
+    return not_full().then([this, items = std::move(items), done] () mutable {
+        return push_remaining(std::move(items), done);
+    });
+}
+
 template <typename T>
 requires std::is_nothrow_move_constructible_v<T>
 template <typename Func>
@@ -29,6 +29,7 @@
 #include <memory>
 #include <cassert>
 #include <optional>
+#include <string_view>
 #include <seastar/util/modules.hh>
 #include <seastar/core/future.hh>
 #endif
@@ -92,6 +93,17 @@ class sstring_builder::guard {
         }
         _builder._start = nullptr;
     }
+    // Ends the string at p, returning it if it is all in this block
+    // rather than building it; the builder is then left empty
+    std::optional<std::string_view> mark_end_view(const char* p) {
+        if (!_builder._value.empty()) {
+            mark_end(p);
+            return std::nullopt;
+        }
+        std::string_view ret(_builder._start, p - _builder._start);
+        _builder._start = nullptr;
+        return ret;
+    }
 };
 
 SEASTAR_MODULE_EXPORT_BEGIN
@@ -32,6 +32,7 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/idle_cpu_handler.hh>
 #include <seastar/core/internal/io_request.hh>
+#include <seastar/core/io_trace.hh>
 #include <seastar/core/internal/io_sink.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/linux-aio.hh>
@@ -41,6 +42,8 @@
 #include <seastar/core/memory.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/internal/idle_poll_policy.hh>
+#include <seastar/core/internal/tsc_clock.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor_config.hh>
 #include <seastar/core/scattered_message.hh>
@@ -72,8 +75,11 @@
 #include <chrono>
 #include <cstring>
 #include <memory>
+#include <optional>
 #include <string_view>
+#include <typeindex>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 #include <unistd.h>
 #include <sys/epoll.h>
@@ -132,7 +138,14 @@ namespace internal {
 
 class reactor_stall_sampler;
 class cpu_stall_detector;
+class stall_profiler;
+class cpu_profiler;
+class heap_profiler;
 class buffer_allocator;
+class dma_buffer_pool;
+class memory_pressure_monitor;
+class warm_restart_saver;
+class work_stealing_queues;
 class priority_class;
 class poller;
 
@@ -153,6 +166,8 @@ class io_completion : public kernel_completion {
 
     virtual void complete(size_t res) noexcept = 0;
     virtual void set_exception(std::exception_ptr eptr) noexcept = 0;
+    // Called when the request is handed over to the kernel
+    virtual void on_submitted() noexcept {}
 };
 
 SEASTAR_MODULE_EXPORT
@@ -166,6 +181,8 @@ class reactor {
     class batch_flush_pollfn;
     class smp_pollfn;
     class drain_cross_cpu_freelist_pollfn;
+    class memory_pressure_pollfn;
+    class work_stealing_pollfn;
     class lowres_timer_pollfn;
     class manual_timer_pollfn;
     class epoll_pollfn;
@@ -205,6 +222,7 @@ class reactor {
         uint64_t fstream_read_bytes_blocked = 0;
         uint64_t fstream_read_aheads_discarded = 0;
         uint64_t fstream_read_ahead_discarded_bytes = 0;
+        uint64_t fsyncs_coalesced = 0;
     };
     /// Scheduling statistics.
     struct sched_stats {
@@ -247,12 +265,20 @@ class reactor {
     // ... when dispatched all requests get into this single sink
     internal::io_sink _io_sink;
     unsigned _num_io_groups = 0;
+    // Asks the kernel to cancel a request dispatched from the io_queue,
+    // if the backend can
+    void cancel_io(io_completion* desc) noexcept;
+    // Whether the files of NVMe generic char devices can issue NVMe
+    // commands (see reactor_options::uring_nvme_passthrough)
+    bool supports_nvme_passthrough() const noexcept;
 
     std::vector<noncopyable_function<future<> ()>> _exit_funcs;
     unsigned _id = 0;
     bool _stopping = false;
     bool _stopped = false;
     bool _finished_running_tasks = false;
+    // Set by smp::park(), for the reactor to sleep as soon as it is idle
+    bool _parked = false;
     condition_variable _stop_requested;
     bool _handle_sigint = true;
     std::optional<future<std::unique_ptr<network_stack>>> _network_stack_ready;
@@ -264,8 +290,11 @@ class reactor {
     uint64_t _polls = 0;
     metrics::internal::time_estimated_histogram _stalls_histogram;
     std::unique_ptr<internal::cpu_stall_detector> _cpu_stall_detector;
+    std::unique_ptr<internal::cpu_profiler> _cpu_profiler;
 
     unsigned _max_task_backlog = 1000;
+    unsigned _task_sample_interval = 0;
+    bool _task_latency_by_type = false;
     timer<>::set_t _timers;
     timer<>::set_t::timer_list_t _expired_timers;
     timer<lowres_clock>::set_t _lowres_timers;
@@ -273,6 +302,7 @@ class reactor {
     timer<manual_clock>::set_t _manual_timers;
     timer<manual_clock>::set_t::timer_list_t _expired_manual_timers;
     io_stats _io_stats;
+    io_trace_hook _io_trace_hook;
     uint64_t _fsyncs = 0;
     uint64_t _cxx_exceptions = 0;
     uint64_t _abandoned_failed_futures = 0;
@@ -280,6 +310,9 @@ class reactor {
         explicit task_queue(unsigned id, sstring name, sstring shortname, float shares);
         int64_t _vruntime = 0;
         float _shares;
+        // Derived from the shares the queue competes with on the flat
+        // active list: its own for top level queues, its part of its
+        // parent's for nested ones (see update_nested_shares())
         int64_t _reciprocal_shares_times_2_power_32;
         bool _active = false;
         uint8_t _id;
@@ -294,8 +327,50 @@ class reactor {
         // chars are used.
         static constexpr size_t shortname_size = 4;
         sstring _shortname;
+        task_queue* _parent = nullptr;
+        std::vector<task_queue*> _children;
         int64_t to_vruntime(sched_clock::duration runtime) const;
         void set_shares(float shares) noexcept;
+        void set_effective_shares(float shares) noexcept;
+        bool nested() const noexcept { return _parent || !_children.empty(); }
+        bool subtree_active() const noexcept;
+        void distribute_shares(float shares) noexcept;
+        float own_and_children_shares() const noexcept;
+        float subtree_io_shares() const noexcept;
+        float io_shares() const noexcept;
+        // CPU cap (see scheduling_group::set_cpu_cap()); 1 when uncapped
+        float _cpu_cap = 1.0f;
+        sched_clock::duration _cpu_cap_period = {};
+        sched_clock::time_point _cpu_cap_period_start = {};
+        // Runtime charged against the current period's budget
+        sched_clock::duration _cpu_cap_runtime = {};
+        // Held off the active list until its budget is refilled; the queue
+        // stays _active meanwhile, so that add_task() does not activate it
+        bool _throttled = false;
+        sched_clock::time_point _throttled_since = {};
+        sched_clock::duration _throttled_time = {};
+        sched_clock::duration cpu_cap_budget() const noexcept;
+        // Sampling of the queueing delay and runtime of tasks (see
+        // reactor_options::task_latency_sample_interval): one task is
+        // tracked at a time, from add_task() until it runs.
+        using task_latency_histogram = metrics::internal::approximate_exponential_histogram<4, 33554432, 2>;
+        // Tasks are accounted by their type, or by their tag if they have
+        // one, at most max_task_types of them, the others together
+        using task_type_key = std::variant<std::type_index, std::string_view>;
+        static constexpr size_t max_task_types = 64;
+        struct task_type_stats {
+            sstring name;
+            uint64_t samples = 0;
+            sched_clock::duration queueing_delay = {};
+            sched_clock::duration runtime = {};
+            seastar::metrics::metric_groups metrics;
+        };
+        unsigned _sample_countdown = 1;
+        task* _sampled_task = nullptr;
+        sched_clock::time_point _sampled_at;
+        task_latency_histogram _queueing_delay_histogram;
+        task_latency_histogram _task_runtime_histogram;
+        std::unordered_map<task_type_key, task_type_stats> _task_type_stats;
         struct indirect_compare;
         sched_clock::duration _time_spent_on_task_quota_violations = {};
         seastar::metrics::metric_groups _metrics;
@@ -307,11 +382,20 @@ class reactor {
     boost::container::static_vector<std::unique_ptr<task_queue>, max_scheduling_groups()> _task_queues;
     internal::scheduling_group_specific_thread_local_data _scheduling_group_specific_data;
     int64_t _last_vruntime = 0;
+    // Number of task queues with a parent
+    unsigned _nr_nested_task_queues = 0;
     task_queue_list _active_task_queues;
     task_queue_list _activating_task_queues;
+    std::vector<task_queue*> _throttled_task_queues;
+    timer<> _cpu_cap_timer;
+    // Hands idle free memory back to the OS, see --memory-release-period-ms
+    timer<lowres_clock> _memory_release_timer;
     task_queue* _at_destroy_tasks;
     sched_clock::duration _task_quota;
     task* _current_task = nullptr;
+    // The type of the task running, for the CPU profiler, only kept when
+    // it is on
+    const std::type_info* _current_task_type = nullptr;
     /// Handler that will be called when there is no task to execute on cpu.
     /// It represents a low priority work.
     /// 
@@ -329,8 +413,11 @@ class reactor {
     double _load = 0;
     sched_clock::duration _total_idle{0};
     sched_clock::duration _total_sleep;
+    sched_clock::duration _total_idle_spin{0};
+    sched_clock::duration _total_idle_pause{0};
+    uint64_t _sleeps = 0;
     sched_clock::time_point _start_time = now();
-    std::chrono::nanoseconds _max_poll_time = calculate_poll_time();
+    internal::idle_poll_policy _idle_poll_policy{calculate_poll_time(), false, false};
     output_stream<char>::batch_flush_list_t _flush_batching;
     std::atomic<bool> _sleeping alignas(seastar::cache_line_size){0};
     pthread_t _thread_id alignas(seastar::cache_line_size) = pthread_self();
@@ -392,24 +479,45 @@ class reactor {
 
     signals _signals;
     std::unique_ptr<thread_pool> _thread_pool;
+    std::unique_ptr<internal::dma_buffer_pool> _dma_buffer_pool;
+    std::unique_ptr<internal::memory_pressure_monitor> _memory_pressure_monitor;
     friend class thread_pool;
     friend class thread_context;
     friend class internal::cpu_stall_detector;
+    friend class internal::stall_profiler;
+    friend class internal::cpu_profiler;
+    friend class internal::heap_profiler;
+    friend class internal::memory_pressure_monitor;
+    friend class internal::warm_restart_saver;
 
     uint64_t pending_task_count() const;
     void run_tasks(task_queue& tq);
+    void maybe_sample_task(task_queue& tq, task* t) noexcept;
+    void run_sampled_task(task_queue& tq, task& t) noexcept;
+    void account_task_type(task_queue& tq, const std::type_info& type, const char* tag, sched_clock::duration queueing_delay, sched_clock::duration runtime);
     bool have_more_tasks() const;
     bool posix_reuseport_detect();
+    // The CPU the calling thread is pinned to, if it is pinned to a single one
+    static std::optional<int> pinned_cpu() noexcept;
+    // Applies --net-busy-poll-usec to a TCP socket
+    void maybe_set_busy_poll(file_desc& fd) noexcept;
     void run_some_tasks();
     void activate(task_queue& tq);
     void insert_active_task_queue(task_queue* tq);
     task_queue* pop_active_task_queue(sched_clock::time_point now);
     void insert_activating_task_queues();
     void account_runtime(task_queue& tq, sched_clock::duration runtime);
+    void update_nested_shares() noexcept;
+    void update_nested_io_shares(task_queue& tq);
+    void refill_cpu_cap(task_queue& tq, sched_clock::time_point now) noexcept;
+    void charge_cpu_cap(task_queue& tq, sched_clock::duration runtime, sched_clock::time_point now) noexcept;
+    void rearm_cpu_cap_timer() noexcept;
+    void unthrottle_task_queues() noexcept;
     void account_idle(sched_clock::duration idletime);
     void allocate_scheduling_group_specific_data(scheduling_group sg, unsigned long key_id);
     future<> rename_scheduling_group_specific_data(scheduling_group sg);
-    future<> init_scheduling_group(scheduling_group sg, sstring name, sstring shortname, float shares);
+    future<> init_scheduling_group(scheduling_group sg, sstring name, sstring shortname, float shares, std::optional<scheduling_group> parent = std::nullopt);
+    static future<scheduling_group> do_create_scheduling_group(sstring name, sstring shortname, float shares, std::optional<scheduling_group> parent) noexcept;
     future<> init_new_scheduling_group_key(scheduling_group_key key, scheduling_group_key_config cfg);
     future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     uint64_t tasks_processed() const;
@@ -446,7 +554,7 @@ class reactor {
     void operator=(const reactor&) = delete;
 
     static sched_clock::time_point now() noexcept {
-        return sched_clock::now();
+        return internal::tsc_clock::now();
     }
     sched_clock::duration uptime() {
         return now() - _start_time;
@@ -478,6 +586,8 @@ class reactor {
     void rename_queues(internal::priority_class pc, sstring new_name);
     /// @private
     void update_shares_for_queues(internal::priority_class pc, uint32_t shares);
+    /// @private
+    void set_latency_target_for_queues(internal::priority_class pc, std::chrono::microseconds target);
 
     void configure(const reactor_options& opts);
 
@@ -489,6 +599,9 @@ class reactor {
     pollable_fd posix_listen(socket_address sa, listen_options opts = {});
 
     bool posix_reuseport_available() const { return _reuseport; }
+    // Whether listening with load_balancing_algorithm::incoming_cpu gives
+    // each shard a socket of its own, steered to its CPU
+    bool posix_incoming_cpu_steering_available() const noexcept;
 
     pollable_fd make_pollable_fd(socket_address sa, int proto);
 
@@ -516,6 +629,35 @@ class reactor {
 
     future<size_t> read_directory(int fd, char* buffer, size_t buffer_size);
 
+    /// \cond internal
+    /// Allocates an aligned buffer for DMA I/O. If the reactor backend keeps
+    /// memory pre-registered with the kernel (see \ref reactor_options::uring_registered_buffers)
+    /// the buffer is carved out of it, so I/O on it is cheaper to submit;
+    /// otherwise it is recycled through the shard's DMA buffer pool (see
+    /// \ref reactor_options::dma_buffer_pool_high_watermark) when possible,
+    /// and is the same as \ref temporary_buffer::aligned() if not.
+    template <typename CharType>
+    temporary_buffer<CharType> allocate_dma_buffer(size_t alignment, size_t size) {
+        static_assert(sizeof(CharType) == 1, "must allocate byte type");
+        auto buf = try_allocate_registered_buffer(alignment, size);
+        if (!buf) {
+            buf = try_allocate_pooled_buffer(alignment, size);
+        }
+        if (!buf) {
+            return temporary_buffer<CharType>::aligned(alignment, size);
+        }
+        auto p = reinterpret_cast<CharType*>(buf.get_write());
+        return temporary_buffer<CharType>(p, size, buf.release());
+    }
+    temporary_buffer<char> try_allocate_registered_buffer(size_t alignment, size_t size) noexcept;
+    temporary_buffer<char> try_allocate_pooled_buffer(size_t alignment, size_t size) noexcept;
+    /// Lets the reactor backend cache kernel state for a file opened by this
+    /// shard, to make I/O on it cheaper to submit. Returns whether it did; if so,
+    /// \ref unregister_file() must be called before the descriptor is closed.
+    bool register_file(int fd) noexcept;
+    void unregister_file(int fd) noexcept;
+    /// \endcond
+
     future<int> inotify_add_watch(int fd, std::string_view path, uint32_t flags);
 
     future<std::tuple<file_desc, file_desc>> make_pipe();
@@ -574,6 +716,12 @@ class reactor {
     void set_idle_cpu_handler(idle_cpu_handler&& handler) {
         _idle_cpu_handler = std::move(handler);
     }
+    /// Set a hook that will be called for every disk I/O request submitted on this shard.
+    ///
+    /// \see seastar::set_io_trace_hook()
+    void set_io_trace_hook(io_trace_hook hook) noexcept {
+        _io_trace_hook = std::move(hook);
+    }
     void force_poll();
 
     void add_high_priority_task(task*) noexcept;
@@ -596,6 +744,22 @@ class reactor {
     /// See \ref sched_stats for a description of individual statistics.
     /// \return An object containing a snapshot of the statistics at this point in time.
     sched_stats get_sched_stats() const;
+    /// The sampled runtime of the tasks of a type in a scheduling group,
+    /// see \ref reactor_options::task_latency_by_type
+    struct task_type_runtime {
+        /// The type of the tasks, or their tag, see \ref task::tag()
+        sstring name;
+        /// The tasks of the type sampled
+        uint64_t samples;
+        /// The time the sampled tasks ran for
+        sched_clock::duration runtime;
+        /// The time the sampled tasks waited in the queue before running
+        sched_clock::duration queueing_delay;
+    };
+    /// Returns the \c n task types of \c sg that the sampled tasks ran the
+    /// longest for, longest first. The statistics are local to this shard,
+    /// and empty unless sampled tasks are accounted by type.
+    std::vector<task_type_runtime> top_task_types(scheduling_group sg, size_t n) const;
     uint64_t abandoned_failed_futures() const { return _abandoned_failed_futures; }
 #ifdef HAVE_OSV
     void timer_thread_func();
@@ -635,11 +799,14 @@ class reactor {
     friend class pollable_fd_state;
     friend class posix_file_impl;
     friend class blockdev_file_impl;
+    friend class file_mapping; // for the thread pool
     friend class timer<>;
     friend class timer<lowres_clock>;
     friend class timer<manual_clock>;
     friend class smp;
     friend class smp_message_queue;
+    friend class shard_scaler;
+    friend class internal::work_stealing_queues;
     friend class internal::poller;
     friend class scheduling_group;
     friend void internal::add_to_flush_poller(output_stream<char>& os) noexcept;
@@ -648,6 +815,7 @@ class reactor {
     metrics::metric_groups _metric_groups;
     friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
     friend future<> seastar::destroy_scheduling_group(scheduling_group) noexcept;
+    friend future<scheduling_group> seastar::create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_group parent) noexcept;
     friend future<> seastar::rename_scheduling_group(scheduling_group sg, sstring new_name, sstring new_shortname) noexcept;
     friend future<scheduling_group_key> scheduling_group_key_create(scheduling_group_key_config cfg) noexcept;
 
@@ -682,6 +850,10 @@ class reactor {
         /// resets the supression state.
         static void set_stall_detector_report_function(std::function<void ()> report);
         static std::function<void ()> get_stall_detector_report_function();
+        static void set_stall_profile(bool enabled);
+        /// Samples the CPU at \c hz into at most \c max_entries, as with
+        /// \c --cpu-profiler-hz, or stops, and drops the profile, if zero
+        static void set_cpu_profiler(unsigned hz, size_t max_entries = 1024);
     };
 };
 
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <seastar/core/resource.hh>
 #include <seastar/util/program-options.hh>
 #include <seastar/util/memory_diagnostics.hh>
 #include <seastar/util/modules.hh>
@@ -31,6 +32,30 @@ namespace seastar {
 struct reactor_config {
     bool auto_handle_sigint_sigterm = true;
     unsigned max_networking_aio_io_control_blocks = 10000;
+    size_t uring_registered_buffers_size = 0;
+    unsigned uring_registered_files = 1024;
+    bool uring_sqpoll = false;
+    unsigned uring_sqpoll_idle_ms = 1000;
+    std::vector<unsigned> uring_sqpoll_cpus;
+    bool uring_multishot = false;
+    unsigned uring_buffer_ring_entries = 1024;
+    unsigned uring_buffer_ring_buffer_size = 16384;
+    bool uring_nvme_passthrough = false;
+    std::string uring_zcrx_interface;
+    unsigned uring_zcrx_rx_queue = 0;
+    size_t uring_zcrx_area_size = 0;
+    unsigned net_busy_poll_usec = 0;
+    bool net_prefer_busy_poll = false;
+    size_t dma_buffer_pool_low_watermark = 0;
+    size_t dma_buffer_pool_high_watermark = 0;
+    bool dump_memory_diagnostics_on_sigusr2 = true;
+    bool dump_stall_profile_on_sigusr1 = false;
+    double memory_pressure_elevated_threshold = 0;
+    double memory_pressure_critical_threshold = 0;
+    bool work_stealing = false;
+    bool tsc_clock = true;
+    bool smp_queue_metrics = false;
+    unsigned syscall_threads = 1;
 };
 /// \endcond
 
@@ -53,14 +78,34 @@ struct reactor_options : public program_options::option_group {
     /// \brief Idle polling time in microseconds.
     ///
     /// Reduce for overprovisioned environments or laptops.
+    ///
+    /// Default: 0 when a cgroup CPU quota gives the shards less than a CPU
+    /// each, for them not to spend it spinning.
     program_options::value<unsigned> idle_poll_time_us;
+    /// \brief Adapt idle polling to the arrival of work.
+    ///
+    /// Learns the usual length of the reactor's idle periods, sleeps right
+    /// away when no work is expected within \ref idle_poll_time_us, and
+    /// polls only for a few times the usual idle period otherwise.
+    ///
+    /// Default: false.
+    program_options::value<bool> adaptive_idle_poll;
+    /// \brief Pause the core between polls once work is late.
+    ///
+    /// With \ref adaptive_idle_poll, polls with the core paused in a
+    /// power-saving state (with the tpause instruction) between polls,
+    /// where the CPU supports it.
+    ///
+    /// Default: true.
+    program_options::value<bool> idle_poll_pause;
     /// \brief Busy-poll for disk I/O.
     ///
     /// Reduces latency and increases throughput.
     program_options::value<bool> poll_aio;
     /// \brief Max time (ms) between polls.
     ///
-    /// Default: 0.5.
+    /// Default: 0.5, or less under a cgroup CPU quota, for the shards to
+    /// poll several times within the CPU time they get every quota period.
     program_options::value<double> task_quota_ms;
     /// \brief Max time (ms) IO operations must take.
     ///
@@ -74,12 +119,99 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 1.1
     program_options::value<double> io_flow_ratio_threshold;
+    /// \brief Lower bound of the runtime disk model calibration.
+    ///
+    /// The IO scheduler watches completion latencies and, when requests
+    /// take longer than the latency goal, steps down the rates of the disk
+    /// model (from \ref smp_options::io_properties) down to this fraction of
+    /// them. Together with \ref io_model_factor_max, 1.0 disables the
+    /// calibration.
+    ///
+    /// Default: 1.0
+    program_options::value<double> io_model_factor_min;
+    /// \brief Upper bound of the runtime disk model calibration.
+    ///
+    /// When requests complete well within the latency goal while the disk
+    /// is kept busy, the IO scheduler steps up the rates of the disk model,
+    /// up to this multiple of them.
+    ///
+    /// Default: 1.0
+    program_options::value<double> io_model_factor_max;
+    /// \brief Let busy shards use the disk capacity of idle ones.
+    ///
+    /// Shards sharing an IO group dispatch up to an equal share of the
+    /// group capacity per poll, which caps a single busy shard at a fraction
+    /// of the disk. With this option the capacity is shared among the shards
+    /// that have requests to dispatch, so that idle shards lend theirs.
+    ///
+    /// Default: false
+    program_options::value<bool> io_share_idle_capacity;
+    /// \brief Fraction of its per-tick share of the IO group capacity a
+    /// shard grabs at once.
+    ///
+    /// The shards of an IO group grab its capacity from one counter,
+    /// whose cache line they contend on with many shards. With this
+    /// option, a shard grabs capacity for several requests at once, and
+    /// gets ahead of the others by that much at most. 0 grabs it request
+    /// by request.
+    ///
+    /// Default: 0
+    program_options::value<double> io_capacity_grab_batch;
+    /// \brief Log disk requests taking longer than this (in milliseconds).
+    ///
+    /// Requests taking longer, from being queued to their completion, are
+    /// logged (at most once in 10 seconds) with their size, priority class
+    /// and the time they spent in the I/O queue, waiting to be submitted
+    /// and in the kernel. 0 disables the log.
+    ///
+    /// Default: 0
+    program_options::value<double> io_slow_log_threshold_ms;
     /// \brief Maximum number of task backlog to allow.
     ///
     /// When the number of tasks grow above this, we stop polling (e.g. I/O)
     /// until it goes back below the limit.
     /// Default: 1000.
     program_options::value<unsigned> max_task_backlog;
+    /// \brief Sample the queueing delay and runtime of one task in this many,
+    /// per scheduling group.
+    ///
+    /// The time sampled tasks waited in their queue before they ran, and the
+    /// time they ran for, are exported as the \c scheduler_queueing_delay and
+    /// \c scheduler_task_runtime histograms of their scheduling group.
+    /// 0 disables sampling.
+    /// Default: 128.
+    program_options::value<unsigned> task_latency_sample_interval;
+    /// \brief Break the sampled task latencies down by task type.
+    ///
+    /// Sampled tasks are also accounted per type (the dynamic type of the
+    /// task, such as the continuation or coroutine it runs, or its
+    /// \ref task::tag()), in the \c scheduler_task_type_* metrics labelled
+    /// by scheduling group and task type, and in
+    /// \ref reactor::top_task_types() and \ref task_profile. Each scheduling
+    /// group accounts 64 types at most, the others together as \c [other].
+    /// Default: false.
+    program_options::value<bool> task_latency_by_type;
+    /// \brief Number of stacks of each size kept for reuse by new threads.
+    ///
+    /// Stacks of exited \ref seastar::thread "threads" are kept per shard,
+    /// and handed to the next threads of the same stack size, so that
+    /// spawning a thread does not allocate a stack. 0 disables the pool.
+    /// Default: 16.
+    program_options::value<unsigned> thread_stack_pool_size;
+    /// \brief Give the pages of pooled thread stacks back to the kernel.
+    ///
+    /// Pooled stacks are \c MADV_FREE'd, so that they take no memory until
+    /// they are reused, at the cost of faulting them in again then.
+    /// Default: false.
+    program_options::value<bool> thread_stack_pool_madvise_free;
+    /// \brief Bytes of freed coroutine frames kept for reuse, per shard.
+    ///
+    /// Frames of coroutines returning a \ref future are recycled through
+    /// per-shard freelists by size class, unless the build defines
+    /// \c SEASTAR_NO_COROUTINE_FRAME_POOL (debug and sanitizer builds do
+    /// not pool frames). 0 disables the pool.
+    /// Default: 256KiB.
+    program_options::value<unsigned> coroutine_frame_pool_size;
     /// \brief Threshold in milliseconds over which the reactor is considered
     /// blocked if no progress is made.
     ///
@@ -93,6 +225,30 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> blocked_reactor_report_format_oneline;
+    /// \brief Aggregate the backtraces of all the stalls, not only of those
+    /// reported, into a profile.
+    ///
+    /// The profile, of all the shards, is served in the folded stacks format
+    /// of flamegraphs by \ref stall_profile::add_routes(), and written to a
+    /// file on SIGUSR1, see \ref stall_profile::dump().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> blocked_reactor_profile;
+    /// \brief Sample the backtraces of the reactor that many times per
+    /// second of the CPU time it uses, counting the samples by scheduling
+    /// group, task type and backtrace.
+    ///
+    /// The profile, of all the shards, is served in the folded stacks format
+    /// of flamegraphs by \ref cpu_profile::add_routes(). Zero disables the
+    /// profiler.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> cpu_profiler_hz;
+    /// \brief The distinct entries the CPU profiler counts the samples of,
+    /// per shard, the samples of any others being dropped.
+    ///
+    /// Default: 1024.
+    program_options::value<unsigned> cpu_profiler_max_entries;
     /// \brief Allow using buffered I/O if DMA is not available (reduces performance).
     program_options::value<> relaxed_dma;
     /// \brief Use the Linux NOWAIT AIO feature, which reduces reactor stalls due
@@ -115,6 +271,7 @@ struct reactor_options : public program_options::option_group {
     /// * \ref idle_poll_time_us = 0
     /// * \ref smp_options::thread_affinity = 0
     /// * \ref poll_aio = 0
+    /// * \ref memory_release_period_ms = 10000
     program_options::value<> overprovisioned;
     /// \brief Abort when seastar allocator cannot allocate memory.
     program_options::value<> abort_on_seastar_bad_alloc;
@@ -133,6 +290,14 @@ struct reactor_options : public program_options::option_group {
     /// \note Even if the \p seastar_memory logger is set to debug or trace
     /// level, the diagnostics will be logged irrespective of this setting.
     program_options::value<memory::alloc_failure_kind> dump_memory_diagnostics_on_alloc_failure_kind;
+    /// \brief Dump diagnostics of the seastar allocator state of all shards on \p SIGUSR2.
+    ///
+    /// The diagnostics, including the usage of each small object size class
+    /// and of the page spans, are written to the \p seastar_memory logger,
+    /// with info level.
+    ///
+    /// Default: \p true.
+    program_options::value<bool> dump_memory_diagnostics_on_sigusr2;
     /// \brief Internal reactor implementation.
     ///
     /// Available backends:
@@ -154,6 +319,210 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 10000.
     program_options::value<unsigned> max_networking_io_control_blocks;
+    /// \brief Size (in MB) of the per-shard DMA buffer arena registered with io_uring.
+    ///
+    /// Buffers allocated for DMA file reads and writes are carved out of this
+    /// arena when possible, and the I/O is then submitted as READ_FIXED/WRITE_FIXED,
+    /// which saves the kernel from pinning the pages on every request. Zero
+    /// disables the arena. Only valid for the \p io_uring reactor backend (see
+    /// \ref reactor_backend); requires a matching \p RLIMIT_MEMLOCK.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> uring_registered_buffers;
+    /// \brief Size of the per-shard io_uring registered file table.
+    ///
+    /// Files opened with \ref open_file_dma() are entered into the table, so
+    /// that their I/O is submitted with \p IOSQE_FIXED_FILE and the kernel
+    /// skips the file lookup on every submission. When the table is full,
+    /// further files use their plain file descriptors. Zero disables the
+    /// table. Only valid for the \p io_uring reactor backend (see
+    /// \ref reactor_backend).
+    ///
+    /// Default: 1024.
+    program_options::value<unsigned> uring_registered_files;
+    /// \brief Submit io_uring requests through a kernel polling thread (SQPOLL).
+    ///
+    /// Each shard's ring is set up with \p IORING_SETUP_SQPOLL, so that
+    /// submitting requests does not need a system call while the kernel
+    /// thread is awake. Requires Linux 5.11 or later; falls back to regular
+    /// submission if the ring cannot be set up that way. Only valid for the
+    /// \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> uring_sqpoll;
+    /// \brief Time (ms) the SQPOLL kernel thread spins without work before sleeping.
+    ///
+    /// Default: 1000.
+    program_options::value<unsigned> uring_sqpoll_idle_ms;
+    /// \brief CPUs to pin the SQPOLL kernel threads to (in cpuset(7) format).
+    ///
+    /// Shard N uses the N-th CPU of the set (wrapping around). If not set,
+    /// each thread is pinned to a hyperthread sibling of its shard's CPU,
+    /// when one exists and the shard is pinned to a single CPU.
+    program_options::value<resource::cpuset> uring_sqpoll_cpuset;
+    /// \brief Use multishot accept and receive requests for sockets.
+    ///
+    /// A single io_uring request keeps accepting connections on a listening
+    /// socket, or receiving data on a connected socket, without re-arming a
+    /// poll and issuing a system call for every event. Received data lands in
+    /// a per-shard ring of kernel-provided buffers (see
+    /// \ref uring_buffer_ring_entries) and is handed to the input stream
+    /// without copying. Requires Linux 6.0 or later. Only valid for the
+    /// \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> uring_multishot;
+    /// \brief Number of buffers in the per-shard provided buffer ring (a power of two).
+    ///
+    /// Default: 1024.
+    program_options::value<unsigned> uring_buffer_ring_entries;
+    /// \brief Size of each buffer in the per-shard provided buffer ring.
+    ///
+    /// Default: 16384.
+    program_options::value<unsigned> uring_buffer_ring_buffer_size;
+    /// \brief Issue the I/O of NVMe generic char devices as NVMe passthrough commands.
+    ///
+    /// The files opened on NVMe generic char devices (\p /dev/ngXnY) read,
+    /// write and discard with NVMe commands submitted through io_uring
+    /// (\p IORING_OP_URING_CMD), rather than going through the kernel block
+    /// layer. The ring is set up with 128-byte submission and 32-byte
+    /// completion entries for that. Requires Linux 5.19 or later. Only valid
+    /// for the \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> uring_nvme_passthrough;
+    /// \brief Receive TCP data with zero-copy io_uring receive requests bound to this network interface.
+    ///
+    /// Each shard binds a hardware receive queue of the interface (see
+    /// \ref uring_zcrx_rx_queue) to a memory area of its own (see
+    /// \ref uring_zcrx_area_size), which the NIC places the received payloads
+    /// in. Sockets receive with multishot \p IORING_OP_RECV_ZC requests, and
+    /// the input streams hand out buffers pointing into that area, which go
+    /// back to the NIC when released. Data of connections steered to other
+    /// queues is copied into the area by the kernel. The queues must be set
+    /// up for it (header split, flow steering) with \p ethtool. Requires
+    /// Linux 6.15 or later and \p CAP_NET_ADMIN. Only valid for the
+    /// \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: none (no zero-copy receive).
+    program_options::value<std::string> uring_zcrx_interface;
+    /// \brief Hardware receive queue of \ref uring_zcrx_interface bound by shard 0.
+    ///
+    /// Shard \p N binds queue \p uring_zcrx_rx_queue + \p N.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> uring_zcrx_rx_queue;
+    /// \brief Size (in MB, up to 128) of the per-shard zero-copy receive area.
+    ///
+    /// Default: 64.
+    program_options::value<unsigned> uring_zcrx_area_size;
+    /// \brief Busy-poll the NIC queues of the sockets for this long (in microseconds).
+    ///
+    /// Sets \p SO_BUSY_POLL on the TCP sockets, and the matching busy-poll
+    /// parameters on the epoll instance (\p EPIOCSPARAMS, Linux 6.9 or
+    /// later) or on the io_uring ring (NAPI registration, Linux 6.9 or later)
+    /// of the reactor, so that the kernel polls the receive queues of the NIC
+    /// the connections came in on, rather than waiting for their interrupts,
+    /// when the reactor polls for events. This trades CPU time for receive
+    /// latency. Values above \p net.core.busy_read require \p CAP_NET_ADMIN.
+    ///
+    /// Default: 0 (no busy polling).
+    program_options::value<unsigned> net_busy_poll_usec;
+    /// \brief Prefer busy polling to interrupts on the NIC queues.
+    ///
+    /// Sets \p SO_PREFER_BUSY_POLL along with \ref net_busy_poll_usec, so
+    /// that, combined with the \p napi_defer_hard_irqs and
+    /// \p gro_flush_timeout settings of the device, the queues are left to
+    /// the reactor while it keeps polling them.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> net_prefer_busy_poll;
+    /// \brief Size (in MB) beyond which the per-shard DMA buffer pool is trimmed.
+    ///
+    /// Buffers allocated for DMA file I/O (file stream read-ahead and
+    /// write-behind, \ref file::dma_read_bulk()) are recycled through a
+    /// per-shard pool of 4k-aligned, power-of-two sized buffers of up to 1MB,
+    /// rather than going back to the allocator on every request. When the
+    /// pool caches more than this, it is trimmed back to
+    /// \ref dma_buffer_pool_low_watermark. It is also trimmed when the shard
+    /// is short of memory. Zero disables the pool.
+    ///
+    /// Default: 8.
+    program_options::value<unsigned> dma_buffer_pool_high_watermark;
+    /// \brief Size (in MB) the per-shard DMA buffer pool is trimmed back to.
+    ///
+    /// Default: 2.
+    program_options::value<unsigned> dma_buffer_pool_low_watermark;
+    /// \brief Hand memory that stayed free for this long (in milliseconds)
+    /// back to the OS.
+    ///
+    /// Every period, each shard releases the free memory that stayed free
+    /// throughout it (see \ref memory::release_free_memory()), but for
+    /// \ref memory_release_keep_free, so that co-located processes can use
+    /// it. Zero disables releasing memory.
+    ///
+    /// Default: 0, or 10000 with \ref overprovisioned.
+    program_options::value<unsigned> memory_release_period_ms;
+    /// \brief Fraction of a shard's memory kept resident when free, rather
+    /// than released with \ref memory_release_period_ms.
+    ///
+    /// Default: 0.1.
+    program_options::value<double> memory_release_keep_free;
+    /// \brief Fraction of a shard's memory below which free memory puts the
+    /// shard at the \ref memory::pressure_level::elevated pressure level.
+    ///
+    /// \ref memory::pressure_listener "Pressure listeners" are notified when
+    /// a shard's pressure level changes.
+    ///
+    /// Default: 0.15.
+    program_options::value<double> memory_pressure_elevated_threshold;
+    /// \brief Fraction of a shard's memory below which free memory puts the
+    /// shard at the \ref memory::pressure_level::critical pressure level.
+    ///
+    /// Default: 0.05.
+    program_options::value<double> memory_pressure_critical_threshold;
+    /// \brief Let idle shards steal shard-agnostic work from busy ones.
+    ///
+    /// Work submitted with \ref submit_stealable() is queued on the
+    /// submitting shard; with this option, shards that are idle take it
+    /// from shards that fall behind, run it, and send the result back.
+    /// Without it, such work always runs on the submitting shard.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> work_stealing;
+    /// \brief Read the reactor's clock from the CPU's timestamp counter.
+    ///
+    /// The reactor reads the time several times for every batch of tasks it
+    /// runs. With this option, each shard calibrates the CPU's invariant
+    /// timestamp counter against the system's monotonic clock and reads it
+    /// instead, recalibrating every 100ms. Shards fall back to the monotonic
+    /// clock if the CPU has no invariant counter, or if it drifts.
+    ///
+    /// Default: \p true.
+    program_options::value<bool> tsc_clock;
+    /// \brief Export metrics for each pair of shards.
+    ///
+    /// Every pair of shards has its own cross-shard call queue; with this
+    /// option, each queue exports its length, the number of messages sent,
+    /// received and completed through it, and histograms of the time from
+    /// enqueueing a (sampled) call to the destination shard starting to run
+    /// it and to the source shard processing its response, labelled with the
+    /// source and destination shards. Off by default, as the number of
+    /// metrics grows with the square of the number of shards.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> smp_queue_metrics;
+    /// \brief Number of syscall threads of each shard.
+    ///
+    /// Each shard runs the blocking system calls of its file system
+    /// operations, such as open(2) and getdents64(2), in syscall threads.
+    /// With more than one, the operations of a shard, e.g. opening many
+    /// files at startup, run in parallel. With the \p io_uring reactor
+    /// backend on Linux 5.15 or later, statx, openat, unlinkat, renameat and
+    /// mkdirat are submitted to the ring instead (see \ref reactor_backend).
+    ///
+    /// Default: 1.
+    program_options::value<unsigned> syscall_threads;
     /// \brief Enable seastar heap profiling.
     ///
     /// Allocations will be sampled every N bytes on average. Zero means off.
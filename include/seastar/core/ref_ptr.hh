@@ -0,0 +1,272 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cassert>
+#include <compare>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#endif
+#include <seastar/core/weak_ptr.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+template <typename T>
+class ref_ptr;
+
+/// The base of the objects managed by \ref ref_ptr.
+///
+/// It holds the reference count of the object, which is not atomic, as
+/// for the other smart pointers of seastar the object is for a single
+/// shard, and the function destroying it, set when it is allocated by
+/// \ref make_ref() or \ref allocate_ref(). Knowing the concrete type of
+/// the object and its allocator, the function lets a \ref ref_ptr to a
+/// base class destroy it without a virtual destructor. The object and its
+/// count are one allocation, and a \ref ref_ptr a single pointer to it.
+class ref_counted {
+    template <typename T>
+    friend class ref_ptr;
+    template <typename T, typename Alloc, typename... A>
+    friend ref_ptr<T> allocate_ref(const Alloc& alloc, A&&... a);
+    mutable long _count = 0;
+    void (*_destroy)(ref_counted*) noexcept = nullptr;
+protected:
+    ref_counted() noexcept = default;
+    // A copy of the object is another object, of its own count
+    ref_counted(const ref_counted&) noexcept {}
+    ref_counted& operator=(const ref_counted&) noexcept {
+        return *this;
+    }
+    ~ref_counted() = default;
+public:
+    /// How many \ref ref_ptr to the object there are
+    long use_count() const noexcept {
+        return _count;
+    }
+};
+
+namespace internal {
+
+// An object allocated with a stateful allocator, which is kept with it to
+// free it
+template <typename T, typename Alloc>
+struct ref_counted_with_allocator final : T {
+    [[no_unique_address]] Alloc alloc;
+    template <typename... A>
+    ref_counted_with_allocator(const Alloc& a, A&&... args) : T(std::forward<A>(args)...), alloc(a) {}
+};
+
+template <typename Alloc>
+concept stateless_allocator = std::allocator_traits<Alloc>::is_always_equal::value && std::default_initializable<Alloc>;
+
+}
+
+/// A pointer sharing the ownership of an object with an intrusive count.
+///
+/// \c ref_ptr is an alternative to \ref shared_ptr and \ref lw_shared_ptr
+/// for graphs of objects traversed often: the count is in the object,
+/// which derives from \ref ref_counted, so that a \c ref_ptr is a single
+/// pointer to the object, with no control block to chase, and the object
+/// needs no virtual destructor for a \c ref_ptr to a base class of it to
+/// destroy it. A pointer to an object also deriving from
+/// \ref weakly_referencable is made from a \ref weak_ptr to it, which is
+/// null once the object is destroyed.
+///
+/// Objects are allocated by \ref make_ref(), or \ref allocate_ref() with
+/// an allocator.
+///
+/// \code
+/// struct node : ref_counted, weakly_referencable<node> {
+///     ref_ptr<node> next;
+/// };
+/// auto n = make_ref<node>();
+/// weak_ptr<node> w = n->weak_from_this();
+/// ref_ptr<node> again(w);
+/// \endcode
+template <typename T>
+class ref_ptr {
+    template <typename U>
+    friend class ref_ptr;
+
+    T* _p = nullptr;
+
+    static const ref_counted* counted(const T* p) noexcept {
+        return p;
+    }
+    void acquire() noexcept {
+        if (_p) {
+            ++counted(_p)->_count;
+        }
+    }
+    void release() noexcept {
+        if (_p && --counted(_p)->_count == 0) {
+            auto c = const_cast<ref_counted*>(counted(_p));
+            c->_destroy(c);
+        }
+    }
+public:
+    using element_type = T;
+
+    ref_ptr() noexcept = default;
+    ref_ptr(std::nullptr_t) noexcept {}
+    /// Shares an object already owned by a \c ref_ptr, \c this for one
+    explicit ref_ptr(T* p) noexcept : _p(p) {
+        assert(!_p || counted(_p)->_destroy);
+        acquire();
+    }
+    /// Shares the object of a \ref weak_ptr, if it is still alive
+    template <typename U>
+    requires std::convertible_to<U*, T*>
+    explicit ref_ptr(const weak_ptr<U>& w) noexcept : ref_ptr(w.get()) {}
+    ref_ptr(const ref_ptr& x) noexcept : _p(x._p) {
+        acquire();
+    }
+    ref_ptr(ref_ptr&& x) noexcept : _p(std::exchange(x._p, nullptr)) {}
+    template <typename U>
+    requires std::convertible_to<U*, T*>
+    ref_ptr(const ref_ptr<U>& x) noexcept : _p(x._p) {
+        acquire();
+    }
+    template <typename U>
+    requires std::convertible_to<U*, T*>
+    ref_ptr(ref_ptr<U>&& x) noexcept : _p(std::exchange(x._p, nullptr)) {}
+    ~ref_ptr() {
+        release();
+    }
+    ref_ptr& operator=(const ref_ptr& x) noexcept {
+        if (_p != x._p) {
+            ref_ptr tmp(x);
+            std::swap(_p, tmp._p);
+        }
+        return *this;
+    }
+    ref_ptr& operator=(ref_ptr&& x) noexcept {
+        if (this != &x) {
+            release();
+            _p = std::exchange(x._p, nullptr);
+        }
+        return *this;
+    }
+    ref_ptr& operator=(std::nullptr_t) noexcept {
+        release();
+        _p = nullptr;
+        return *this;
+    }
+
+    T* get() const noexcept {
+        return _p;
+    }
+    T* operator->() const noexcept {
+        return _p;
+    }
+    T& operator*() const noexcept {
+        return *_p;
+    }
+    explicit operator bool() const noexcept {
+        return _p;
+    }
+    long use_count() const noexcept {
+        return _p ? counted(_p)->_count : 0;
+    }
+
+    template <typename U>
+    bool operator==(const ref_ptr<U>& x) const noexcept {
+        return _p == x.get();
+    }
+    bool operator==(std::nullptr_t) const noexcept {
+        return !_p;
+    }
+    template <typename U>
+    std::strong_ordering operator<=>(const ref_ptr<U>& x) const noexcept {
+        return std::compare_three_way()(_p, x.get());
+    }
+};
+
+/// Allocates and constructs an object with an allocator, with its count,
+/// and returns the first \ref ref_ptr to it. A stateful allocator is kept
+/// with the object, which must then not be \c final, to free it.
+template <typename T, typename Alloc, typename... A>
+ref_ptr<T> allocate_ref(const Alloc& alloc, A&&... a) {
+    static_assert(std::is_base_of_v<ref_counted, T>, "ref_ptr objects must derive from ref_counted");
+    using object_type = std::conditional_t<internal::stateless_allocator<Alloc>, T, internal::ref_counted_with_allocator<T, Alloc>>;
+    using traits = typename std::allocator_traits<Alloc>::template rebind_traits<object_type>;
+    typename traits::allocator_type al(alloc);
+    object_type* p = traits::allocate(al, 1);
+    try {
+        if constexpr (internal::stateless_allocator<Alloc>) {
+            traits::construct(al, p, std::forward<A>(a)...);
+        } else {
+            traits::construct(al, p, alloc, std::forward<A>(a)...);
+        }
+    } catch (...) {
+        traits::deallocate(al, p, 1);
+        throw;
+    }
+    static_cast<T*>(p)->ref_counted::_destroy = [] (ref_counted* c) noexcept {
+        auto p = static_cast<object_type*>(static_cast<T*>(c));
+        if constexpr (internal::stateless_allocator<Alloc>) {
+            typename traits::allocator_type al;
+            traits::destroy(al, p);
+            traits::deallocate(al, p, 1);
+        } else {
+            typename traits::allocator_type al(p->alloc);
+            traits::destroy(al, p);
+            traits::deallocate(al, p, 1);
+        }
+    };
+    return ref_ptr<T>(static_cast<T*>(p));
+}
+
+/// Allocates and constructs an object, with its count, and returns the
+/// first \ref ref_ptr to it
+template <typename T, typename... A>
+ref_ptr<T> make_ref(A&&... a) {
+    return allocate_ref<T>(std::allocator<T>(), std::forward<A>(a)...);
+}
+
+template <typename T, typename U>
+ref_ptr<T> static_pointer_cast(const ref_ptr<U>& p) noexcept {
+    return ref_ptr<T>(static_cast<T*>(p.get()));
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+namespace std {
+
+template <typename T>
+struct hash<seastar::ref_ptr<T>> : private hash<T*> {
+    size_t operator()(const seastar::ref_ptr<T>& p) const noexcept {
+        return hash<T*>::operator()(p.get());
+    }
+};
+
+}
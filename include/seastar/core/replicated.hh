@@ -0,0 +1,217 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <boost/range/irange.hpp>
+#endif
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace internal {
+
+// The NUMA node each shard runs on, by shard id
+future<std::vector<unsigned>> numa_nodes_of_shards();
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// An immutable value, published by one shard and read by all of them.
+///
+/// Unlike a \ref sharded service with a copy of the value on every shard,
+/// kept up to date with \ref sharded::invoke_on_all(), there is one copy
+/// of it, or one for each NUMA node if asked at start(), that the shards
+/// read in place: reading is a load from memory, not a message. Updating
+/// it is publishing a new value, from the shard that started the object;
+/// the shards see the new value as soon as it is published, and the old
+/// one is destroyed once every shard went through its reactor's loop since
+/// then, having processed a message from the publishing shard, and cannot
+/// be in the middle of reading it anymore.
+///
+/// The reference returned by local() must therefore not be kept across a
+/// preemption point: copy what is needed out of the value rather than
+/// holding on to it in a continuation.
+///
+/// \code
+/// replicated<routing_table> routes;
+/// co_await routes.start(load_routes(), true);
+/// // on any shard
+/// auto& dest = routes.local().lookup(key);
+/// // on the shard that started it
+/// co_await routes.publish(load_routes());
+/// co_await routes.stop();
+/// \endcode
+template <typename T>
+class replicated {
+    struct copy {
+        // Where the shards of the group read the value from
+        std::atomic<const T*> current = nullptr;
+        // Keeps it alive, on the shard it was allocated on
+        foreign_ptr<std::unique_ptr<const T>> owner;
+        shard_id home = 0;
+    };
+    std::unique_ptr<copy[]> _copies;
+    unsigned _nr_copies = 0;
+    // The copy each shard reads
+    std::vector<unsigned> _copy_of_shard;
+    shard_id _owner = 0;
+    uint64_t _version = 0;
+    semaphore _update_lock{1};
+
+    future<> wait_for_quiescence() {
+        return smp::invoke_on_all([] {});
+    }
+    // Resolves once the values are destroyed, on their shard
+    static future<> destroy(std::vector<foreign_ptr<std::unique_ptr<const T>>>& values) {
+        return parallel_for_each(values, [] (foreign_ptr<std::unique_ptr<const T>>& v) {
+            return v.destroy();
+        });
+    }
+public:
+    replicated() = default;
+    replicated(const replicated&) = delete;
+    replicated& operator=(const replicated&) = delete;
+    ~replicated() {
+        assert(!_copies && "replicated destroyed without being stopped");
+    }
+
+    /// Publishes \c value from the calling shard, which is the only one
+    /// publish() can be called on afterwards.
+    ///
+    /// \param per_numa_node whether to keep a copy of the value in the
+    ///        memory of each NUMA node the shards run on, for them not to
+    ///        read another node's memory, rather than a single one
+    future<> start(T value, bool per_numa_node = false) {
+        _owner = this_shard_id();
+        auto copy_of_shard = per_numa_node ? co_await internal::numa_nodes_of_shards() : std::vector<unsigned>(smp::count, 0);
+        // Number the NUMA nodes from 0, keeping the first shard of each to
+        // allocate their copy on
+        std::vector<unsigned> ids;
+        std::vector<shard_id> homes;
+        for (shard_id s = 0; s != smp::count; ++s) {
+            auto id = std::find(ids.begin(), ids.end(), copy_of_shard[s]);
+            if (id == ids.end()) {
+                ids.push_back(copy_of_shard[s]);
+                homes.push_back(per_numa_node ? s : _owner);
+                id = ids.end() - 1;
+            }
+            copy_of_shard[s] = id - ids.begin();
+        }
+        _copy_of_shard = std::move(copy_of_shard);
+        _nr_copies = ids.size();
+        _copies = std::make_unique<copy[]>(_nr_copies);
+        for (unsigned c = 0; c != _nr_copies; ++c) {
+            _copies[c].home = homes[c];
+        }
+        try {
+            co_await publish(std::move(value));
+        } catch (...) {
+            _copies.reset();
+            throw;
+        }
+    }
+
+    /// Replaces the value, from the shard that started the object.
+    ///
+    /// Resolves once the previous value is destroyed. Concurrent calls are
+    /// serialized, in the order they are made.
+    future<> publish(T value) {
+        assert(this_shard_id() == _owner);
+        auto units = co_await get_units(_update_lock, 1);
+        std::vector<foreign_ptr<std::unique_ptr<const T>>> fresh(_nr_copies);
+        co_await parallel_for_each(boost::irange(0u, _nr_copies), [this, &value, &fresh] (unsigned c) -> future<> {
+            if (_copies[c].home == _owner) {
+                return make_ready_future<>();
+            }
+            return smp::submit_to(_copies[c].home, [&value] {
+                return make_foreign(std::make_unique<const T>(value));
+            }).then([&fresh, c] (foreign_ptr<std::unique_ptr<const T>> p) {
+                fresh[c] = std::move(p);
+            });
+        });
+        // The shards the other copies are made on are done reading value
+        for (unsigned c = 0; c != _nr_copies; ++c) {
+            if (_copies[c].home == _owner) {
+                fresh[c] = make_foreign(std::make_unique<const T>(std::move(value)));
+            }
+        }
+        for (unsigned c = 0; c != _nr_copies; ++c) {
+            _copies[c].current.store(fresh[c].get(), std::memory_order_release);
+            std::swap(_copies[c].owner, fresh[c]);
+        }
+        ++_version;
+        // fresh now holds the previous values
+        co_await wait_for_quiescence();
+        co_await destroy(fresh);
+    }
+
+    /// The current value, for the calling shard.
+    ///
+    /// Valid until the calling continuation yields, see above.
+    const T& local() const noexcept {
+        return *_copies[_copy_of_shard[this_shard_id()]].current.load(std::memory_order_acquire);
+    }
+
+    /// The number of values published, on the shard that started the object
+    uint64_t version() const noexcept {
+        return _version;
+    }
+
+    /// Destroys the value, once every shard stopped reading it and the
+    /// publications in progress are done.
+    future<> stop() {
+        if (!_copies) {
+            co_return;
+        }
+        auto units = co_await get_units(_update_lock, 1);
+        co_await wait_for_quiescence();
+        std::vector<foreign_ptr<std::unique_ptr<const T>>> values;
+        for (unsigned c = 0; c != _nr_copies; ++c) {
+            values.push_back(std::move(_copies[c].owner));
+        }
+        _copies.reset();
+        co_await destroy(values);
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
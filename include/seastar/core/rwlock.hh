@@ -23,7 +23,10 @@
 
 #ifndef SEASTAR_MODULE
 #include <cstddef>
+#include <cstdint>
+#include <optional>
 #endif
+#include <seastar/core/do_with.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/util/modules.hh>
 
@@ -70,6 +73,10 @@ class rwlock_for_write {
 /// fibers running in the same CPU that may use the same resource.
 /// Acquiring the write lock will effectively cause all readers not to be executed
 /// until the write part is done.
+///
+/// Readers that do not yield, or rarely, can also read optimistically,
+/// without taking the lock, as with a seqlock: see \ref optimistic_read_begin()
+/// and \ref with_optimistic_read().
 SEASTAR_MODULE_EXPORT
 template<typename Clock = typename timer<>::clock>
 class basic_rwlock : private rwlock_for_read<Clock>, rwlock_for_write<Clock> {
@@ -78,6 +85,13 @@ class basic_rwlock : private rwlock_for_read<Clock>, rwlock_for_write<Clock> {
     static constexpr size_t max_ops = semaphore_type::max_counter();
 
     semaphore_type _sem;
+    // Incremented every time the lock is taken for write, for optimistic
+    // readers to tell a writer came in while they read
+    uint64_t _version = 0;
+
+    bool write_locked() const noexcept {
+        return _sem.available_units() <= 0;
+    }
 public:
     basic_rwlock()
             : _sem(max_ops) {
@@ -121,11 +135,15 @@ class basic_rwlock : private rwlock_for_read<Clock>, rwlock_for_write<Clock> {
     /// fibers waiting on either \ref read_lock or \ref write_lock are guaranteed
     /// not to execute.
     future<> write_lock(typename semaphore_type::time_point timeout = semaphore_type::time_point::max()) {
-        return _sem.wait(timeout, max_ops);
+        return _sem.wait(timeout, max_ops).then([this] {
+            ++_version;
+        });
     }
 
     future<> write_lock(abort_source& as) {
-        return _sem.wait(as, max_ops);
+        return _sem.wait(as, max_ops).then([this] {
+            ++_version;
+        });
     }
 
     /// Releases the lock, which must have been taken in write mode. After this
@@ -143,7 +161,11 @@ class basic_rwlock : private rwlock_for_read<Clock>, rwlock_for_write<Clock> {
 
     /// Tries to acquire the lock in write mode iff this can be done without waiting.
     bool try_write_lock() {
-        return _sem.try_wait(max_ops);
+        if (!_sem.try_wait(max_ops)) {
+            return false;
+        }
+        ++_version;
+        return true;
     }
 
     using holder = semaphore_units<semaphore_default_exception_factory, Clock>;
@@ -179,11 +201,72 @@ class basic_rwlock : private rwlock_for_read<Clock>, rwlock_for_write<Clock> {
     /// return an exceptional future) when it failed to obtain the lock -
     /// e.g., on allocation failure.
     future<holder> hold_write_lock(typename semaphore_type::time_point timeout = semaphore_type::time_point::max()) {
-        return get_units(_sem, max_ops, timeout);
+        return get_units(_sem, max_ops, timeout).then([this] (holder h) {
+            ++_version;
+            return h;
+        });
     }
 
     future<holder> hold_write_lock(abort_source& as) {
-        return get_units(_sem, max_ops, as);
+        return get_units(_sem, max_ops, as).then([this] (holder h) {
+            ++_version;
+            return h;
+        });
+    }
+
+    /// Starts an optimistic read, which takes no lock.
+    ///
+    /// \return a version to pass to \ref optimistic_read_validate() once
+    ///         done reading, or nothing if the lock is held for write, and
+    ///         the read should take the lock instead.
+    ///
+    /// A read that does not yield cannot see a writer come in, the lock
+    /// being for the fibers of one shard; one that does, or that does not
+    /// know whether it did, must validate what it read.
+    std::optional<uint64_t> optimistic_read_begin() const noexcept {
+        if (write_locked()) {
+            return std::nullopt;
+        }
+        return _version;
+    }
+
+    /// Checks that no writer took the lock since \ref optimistic_read_begin()
+    /// returned \c version, and what was read since is consistent; to be
+    /// read again, or under the lock, otherwise.
+    bool optimistic_read_validate(uint64_t version) const noexcept {
+        return !write_locked() && _version == version;
+    }
+
+    /// Runs \c func without the lock if no writer holds it, or comes in
+    /// until it is done, and under the read lock otherwise.
+    ///
+    /// \c func may therefore run twice, the first result being discarded:
+    /// it should only read. Running it without the lock costs no allocation
+    /// and no continuation when it returns a ready value.
+    ///
+    /// \param func a callable with signature `Value ()` or `future<Value> ()`
+    template <typename Func>
+    futurize_t<std::invoke_result_t<Func&>> with_optimistic_read(Func func) {
+        using futurator = futurize<std::invoke_result_t<Func&>>;
+        auto version = optimistic_read_begin();
+        if (!version) {
+            return with_lock(for_read(), std::move(func));
+        }
+        auto f = futurator::invoke(func);
+        if (f.available()) {
+            if (optimistic_read_validate(*version)) {
+                return f;
+            }
+            f.ignore_ready_future();
+            return with_lock(for_read(), std::move(func));
+        }
+        return f.then_wrapped([this, version = *version, func = std::move(func)] (auto f) mutable -> futurize_t<std::invoke_result_t<Func&>> {
+            if (optimistic_read_validate(version)) {
+                return f;
+            }
+            f.ignore_ready_future();
+            return with_lock(for_read(), std::move(func));
+        });
     }
 
     /// Checks if any read or write locks are currently held.
@@ -79,6 +79,12 @@ class scattered_message {
         }
     }
 
+    void append(const fragmented_buffer& buff) {
+        if (buff.size()) {
+            _p.append(packet(buff));
+        }
+    }
+
     template <typename size_type, size_type max_size>
     void append(basic_sstring<char_type, size_type, max_size> s) {
         if (s.size()) {
@@ -25,6 +25,7 @@
 #include <chrono>
 #include <concepts>
 #include <functional>
+#include <optional>
 #include <typeindex>
 #endif
 #include <seastar/core/sstring.hh>
@@ -91,6 +92,35 @@ future<scheduling_group> create_scheduling_group(sstring name, float shares) noe
 /// \return a scheduling group that can be used on any shard
 future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
 
+/// Creates a scheduling group nested in another one.
+///
+/// Scheduling groups form a tree: top level groups share the CPU in the
+/// proportion of their shares, and a group nested in \c parent shares the
+/// part of the CPU \c parent gets with its siblings and with the tasks run in
+/// \c parent itself, in the proportion of their shares (\c parent's own
+/// tasks competing with its shares). Only groups that have tasks to run, or
+/// have nested groups with tasks to run, take part. For example, tenants
+/// can be given top level groups, each with nested foreground and
+/// background groups, so that the tenants are isolated from each other
+/// whatever their mix of foreground and background work.
+///
+/// IO requests follow the tree too, statically: a nested group's IO is
+/// dispatched with its part of its parent's IO shares, whether or not its
+/// siblings have IO to dispatch.
+///
+/// The operation is global and affects all shards. A group that has nested
+/// groups cannot be destroyed before them.
+///
+/// \param name A name that identifies the group; will be used as a label
+///             in the group's metrics
+/// \param shortname A name that identifies the group; will be printed in the
+///                  logging message aside of the shard id. please note, the
+///                  \c shortname will be truncated to 4 characters.
+/// \param shares number of shares of its parent's CPU time allotted to the group
+/// \param parent the group to nest the new group in
+/// \return a scheduling group that can be used on any shard
+future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_group parent) noexcept;
+
 /// Destroys a scheduling group.
 ///
 /// Destroys a \ref scheduling_group previously created with create_scheduling_group().
@@ -326,6 +356,34 @@ class scheduling_group {
     /// the calling shard
     float get_shares() const noexcept;
 
+    /// Returns the group this group is nested in, if any
+    std::optional<scheduling_group> parent() const noexcept;
+
+    /// Returns the number of shares the group's IO is dispatched with: its
+    /// shares for a top level group, its part of its parent's IO shares for a
+    /// nested one. Only relevant to the calling shard.
+    float get_io_shares() const noexcept;
+
+    /// \brief Caps the fraction of the CPU the group may use.
+    ///
+    /// Shares only matter when groups compete for the CPU: a group that is
+    /// alone in having tasks to run gets all of it, however few shares it
+    /// has. A capped group runs for at most \c cap of every \c period, even
+    /// on an otherwise idle shard; once its budget is spent its tasks are
+    /// held back until the next period, and time it ran over its budget
+    /// is taken off the next periods' budgets. Like \ref set_shares, the
+    /// cap is local to the shard, and it applies to the group's own tasks,
+    /// not to those of the groups nested in it.
+    ///
+    /// \param cap fraction of the CPU the group may use, in the (0, 1]
+    ///            range; 1 removes the cap
+    /// \param period the period the budget is refilled every
+    void set_cpu_cap(float cap, std::chrono::microseconds period = std::chrono::milliseconds(100)) noexcept;
+
+    /// Returns the fraction of the CPU the group may use (1 if uncapped),
+    /// on the calling shard
+    float get_cpu_cap() const noexcept;
+
 #if SEASTAR_API_LEVEL >= 7
     /// \brief Updates the current IO bandwidth for a given scheduling group
     ///
@@ -335,9 +393,24 @@ class scheduling_group {
     /// \param bandwidth the new bandwidth value in bytes/second
     /// \return a future that is ready when the bandwidth update is applied
     future<> update_io_bandwidth(uint64_t bandwidth) const;
+
+    /// \brief Sets a latency target for the group's IO requests
+    ///
+    /// By default, IO requests are dispatched in the proportion of the
+    /// groups' shares only, so a group sharing the disk with a busier one
+    /// of comparable shares sees its requests queue up behind it. With a
+    /// latency target, requests of the group that have waited for half of
+    /// it are dispatched ahead of their turn, while the shares ratio is
+    /// still maintained over time. Like \ref set_shares, the target is
+    /// local to the shard.
+    ///
+    /// \param target the expected maximum queueing time of the group's IO
+    ///               requests, or zero to remove the target
+    void set_io_latency_target(std::chrono::microseconds target) const;
 #endif
 
     friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_group parent) noexcept;
     friend future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     friend future<> rename_scheduling_group(scheduling_group sg, sstring new_name, sstring new_shortname) noexcept;
     friend class reactor;
@@ -0,0 +1,249 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include <seastar/core/align.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar::memory {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief A bump allocator for objects that die together.
+///
+/// Request handlers often make many small, short-lived allocations which
+/// all become garbage when the request completes. A scoped_arena serves
+/// such allocations by bumping a pointer through chunks obtained from the
+/// regular allocator, and releases them all at once when it is destroyed
+/// (or \ref reset()), instead of paying for a malloc/free pair per object.
+///
+/// Allocations larger than a quarter of the chunk size fall back to the
+/// regular allocator; they are freed by \ref deallocate(), or with the
+/// arena if that was not called. Deallocating anything else only reclaims
+/// the memory if it was the last allocation made.
+///
+/// Allocations opt in, through \ref arena_allocator (for standard
+/// containers, see also \ref arena_string), or by using the arena as a
+/// \c std::pmr::memory_resource. The arena must outlive every object
+/// allocated from it, and, like any seastar object, be used from the shard
+/// that created it only.
+class scoped_arena final : public std::pmr::memory_resource {
+    struct chunk {
+        chunk* next;
+    };
+    struct large_allocation {
+        large_allocation* next;
+        large_allocation* prev;
+    };
+    static constexpr size_t large_header_size = align_up(sizeof(large_allocation), alignof(std::max_align_t));
+    size_t _chunk_size;
+    chunk* _chunks = nullptr;
+    char* _pos = nullptr;
+    char* _end = nullptr;
+    char* _last = nullptr;
+    large_allocation* _large = nullptr;
+    size_t _allocated = 0;
+    size_t _reserved = 0;
+public:
+    static constexpr size_t default_chunk_size = 8192;
+
+    /// \param chunk_size size of the chunks the arena allocates from the
+    ///        regular allocator. Keep it at or below 16k for chunks to be
+    ///        served by the seastar allocator's small object pools.
+    explicit scoped_arena(size_t chunk_size = default_chunk_size) noexcept
+        : _chunk_size(std::max(chunk_size, sizeof(chunk) + alignof(std::max_align_t))) {
+    }
+    scoped_arena(const scoped_arena&) = delete;
+    scoped_arena& operator=(const scoped_arena&) = delete;
+    ~scoped_arena() {
+        release_large_allocations();
+        release_chunks(nullptr);
+    }
+
+    /// Allocates \c size bytes aligned to \c alignment (a power of two, at
+    /// most \c alignof(std::max_align_t) for allocations above a quarter of
+    /// the chunk size). Throws \c std::bad_alloc on failure.
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        if (size > _chunk_size / 4) [[unlikely]] {
+            return allocate_large(size);
+        }
+        auto p = align_up(_pos, alignment);
+        if (p + size > _end || !_pos) [[unlikely]] {
+            p = allocate_slow(size, alignment);
+        }
+        _pos = p + size;
+        _last = p;
+        _allocated += size;
+        return p;
+    }
+
+    /// Releases an allocation made by \ref allocate(). Large allocations are
+    /// handed back to the regular allocator; others only give their memory
+    /// back if nothing was allocated after them.
+    void deallocate(void* ptr, size_t size) noexcept {
+        if (size > _chunk_size / 4) [[unlikely]] {
+            _allocated -= size;
+            deallocate_large(ptr);
+            return;
+        }
+        _allocated -= size;
+        if (ptr == _last && static_cast<char*>(ptr) + size == _pos) {
+            _pos = _last;
+            _last = nullptr;
+        }
+    }
+
+    /// Frees everything allocated from the arena, keeping one chunk around
+    /// for reuse.
+    void reset() noexcept {
+        release_large_allocations();
+        if (_chunks) {
+            release_chunks(_chunks);
+            _pos = reinterpret_cast<char*>(_chunks) + sizeof(chunk);
+            _end = reinterpret_cast<char*>(_chunks) + _chunk_size;
+        }
+        _last = nullptr;
+        _allocated = 0;
+    }
+
+    /// Bytes currently allocated from the arena.
+    size_t allocated_bytes() const noexcept { return _allocated; }
+    /// Bytes the arena holds in chunks, whether allocated or not.
+    size_t reserved_bytes() const noexcept { return _reserved; }
+private:
+    virtual void* do_allocate(size_t size, size_t alignment) override {
+        return allocate(size, alignment);
+    }
+    virtual void do_deallocate(void* p, size_t size, size_t) override {
+        deallocate(p, size);
+    }
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    [[gnu::noinline]]
+    char* allocate_slow(size_t size, size_t alignment) {
+        auto c = static_cast<chunk*>(::operator new(_chunk_size));
+        c->next = _chunks;
+        _chunks = c;
+        _reserved += _chunk_size;
+        _pos = reinterpret_cast<char*>(c) + sizeof(chunk);
+        _end = reinterpret_cast<char*>(c) + _chunk_size;
+        auto p = align_up(_pos, alignment);
+        if (p + size > _end) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    [[gnu::noinline]]
+    void* allocate_large(size_t size) {
+        auto l = static_cast<large_allocation*>(::operator new(large_header_size + size));
+        l->prev = nullptr;
+        l->next = _large;
+        if (_large) {
+            _large->prev = l;
+        }
+        _large = l;
+        _allocated += size;
+        return reinterpret_cast<char*>(l) + large_header_size;
+    }
+    void deallocate_large(void* ptr) noexcept {
+        auto l = reinterpret_cast<large_allocation*>(static_cast<char*>(ptr) - large_header_size);
+        if (l->prev) {
+            l->prev->next = l->next;
+        } else {
+            _large = l->next;
+        }
+        if (l->next) {
+            l->next->prev = l->prev;
+        }
+        ::operator delete(l);
+    }
+    void release_large_allocations() noexcept {
+        while (_large) {
+            ::operator delete(std::exchange(_large, _large->next));
+        }
+    }
+    // Frees all chunks but `keep`, or all of them if it is null.
+    void release_chunks(chunk* keep) noexcept {
+        auto c = keep ? std::exchange(keep->next, nullptr) : _chunks;
+        while (c) {
+            ::operator delete(std::exchange(c, c->next));
+            _reserved -= _chunk_size;
+        }
+        if (!keep) {
+            _chunks = nullptr;
+            _pos = _end = nullptr;
+        }
+    }
+};
+
+/// \brief A standard allocator serving allocations from a \ref scoped_arena.
+///
+/// Containers using it must not outlive the arena.
+template <typename T>
+class arena_allocator {
+    scoped_arena* _arena;
+public:
+    using value_type = T;
+
+    explicit arena_allocator(scoped_arena& arena) noexcept : _arena(&arena) {}
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) noexcept : _arena(&other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        _arena->deallocate(p, n * sizeof(T));
+    }
+    scoped_arena& arena() const noexcept { return *_arena; }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U>& other) const noexcept {
+        return _arena == &other.arena();
+    }
+};
+
+/// A string allocated from a \ref scoped_arena.
+///
+/// \ref sstring does not take an allocator, so this is a \c std::basic_string;
+/// it converts to and from sstring through \c std::string_view.
+using arena_string = std::basic_string<char, std::char_traits<char>, arena_allocator<char>>;
+
+/// A vector allocated from a \ref scoped_arena.
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+SEASTAR_MODULE_EXPORT_END
+
+}
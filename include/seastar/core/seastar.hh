@@ -438,7 +438,7 @@ namespace experimental {
 /// \addtogroup interprocess-module
 /// @{
 
-/// Create a pipe using \c pipe2
+/// Create a pipe using \c pipe2, non-blocking and close-on-exec
 ///
 /// \return a tuple of \c file_desc, the first one for reading from the pipe, the second
 /// for writing to it.
@@ -28,6 +28,7 @@
 #include <seastar/core/abortable_fifo.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/abort_on_expiry.hh>
+#include <seastar/util/exception_ptr.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <cassert>
@@ -169,11 +170,18 @@ class basic_semaphore : private ExceptionFactory {
     struct expiry_handler {
         basic_semaphore& sem;
         void operator()(entry& e) noexcept {
+            // Timeouts are expected under overload; the default exceptions
+            // are stateless, so share one instance instead of making one
+            // per waiter.
             if (e.timer) {
-                try {
-                    e.pr.set_exception(sem.timeout());
-                } catch (...) {
-                    e.pr.set_exception(semaphore_timed_out());
+                if constexpr (std::is_same_v<exception_factory, semaphore_default_exception_factory>) {
+                    e.pr.set_exception(cached_exception_ptr<semaphore_timed_out>());
+                } else {
+                    try {
+                        e.pr.set_exception(sem.timeout());
+                    } catch (...) {
+                        e.pr.set_exception(cached_exception_ptr<semaphore_timed_out>());
+                    }
                 }
             } else if (sem._ex) {
                 e.pr.set_exception(sem._ex);
@@ -182,10 +190,10 @@ class basic_semaphore : private ExceptionFactory {
                     try {
                         e.pr.set_exception(static_cast<exception_factory>(sem).aborted());
                     } catch (...) {
-                        e.pr.set_exception(semaphore_aborted());
+                        e.pr.set_exception(cached_exception_ptr<semaphore_aborted>());
                     }
                 } else {
-                    e.pr.set_exception(semaphore_aborted());
+                    e.pr.set_exception(cached_exception_ptr<semaphore_aborted>());
                 }
             }
         }
@@ -459,14 +467,16 @@ class basic_semaphore : private ExceptionFactory {
     /// The future is made available immediately.
     void broken() noexcept {
         std::exception_ptr ep;
-        if constexpr (internal::has_broken<exception_factory>::value) {
+        if constexpr (std::is_same_v<exception_factory, semaphore_default_exception_factory>) {
+            ep = cached_exception_ptr<broken_semaphore>();
+        } else if constexpr (internal::has_broken<exception_factory>::value) {
             try {
                 ep = std::make_exception_ptr(exception_factory::broken());
             } catch (...) {
-                ep = std::make_exception_ptr(broken_semaphore());
+                ep = cached_exception_ptr<broken_semaphore>();
             }
         } else {
-            ep = std::make_exception_ptr(broken_semaphore());
+            ep = cached_exception_ptr<broken_semaphore>();
         }
         broken(std::move(ep));
     }
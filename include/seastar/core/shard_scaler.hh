@@ -0,0 +1,78 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/timer.hh>
+#include <chrono>
+
+namespace seastar {
+
+/// \addtogroup smp-module
+/// @{
+
+/// \brief Parks and unparks shards with the load.
+///
+/// Every \ref config::interval, averages the utilization of the active
+/// shards and, if it is above \ref config::high_utilization, unparks the
+/// lowest parked shard; if it is below \ref config::low_utilization, and
+/// the remaining shards would stay below the high mark doing the work of
+/// one less, parks the highest active one (see \ref smp::park()). The
+/// services have to route their work with \ref smp::active_shard() or
+/// \ref sharded::invoke_on_active() for the parked shards to get none.
+///
+/// Runs on shard 0; \ref stop() unparks all the shards.
+class shard_scaler {
+public:
+    struct config {
+        /// The fewest shards to keep active, shard 0 included
+        unsigned min_active = 1;
+        /// The average utilization of the active shards, between 0 and 1,
+        /// below which one is parked
+        double low_utilization = 0.3;
+        /// The average utilization of the active shards above which one
+        /// is unparked
+        double high_utilization = 0.8;
+        /// How often to look at the utilization
+        std::chrono::milliseconds interval{1000};
+    };
+private:
+    config _cfg;
+    timer<lowres_clock> _timer;
+    gate _gate;
+
+    future<> rescale();
+public:
+    explicit shard_scaler(config cfg);
+    shard_scaler() : shard_scaler(config{}) {}
+
+    /// Starts looking at the utilization, on shard 0
+    void start();
+    /// Stops, and unparks all the shards
+    future<> stop();
+};
+
+/// @}
+
+}
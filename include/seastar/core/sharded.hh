@@ -424,6 +424,57 @@ class sharded {
                             std::move(reduce));
     }
 
+    /// Invoke a function on all instances of `Service`, through a broadcast tree.
+    ///
+    /// Like \ref invoke_on_all(), but the call is forwarded from shard to
+    /// shard instead of being sent from the current shard to every other
+    /// one; see \ref smp::broadcast(). Prefer it on machines with many
+    /// shards.
+    ///
+    /// \param options the options to forward to the \ref smp::submit_to()
+    ///         calls made behind the scenes.
+    /// \param func invocable accepting a `Service&`, to be invoked on all
+    ///        shards; copied to every shard.
+    /// \return Future that becomes ready once all calls have completed
+    template <typename Func>
+    requires std::invocable<Func, Service&>
+    future<> broadcast(smp_submit_to_options options, Func func) noexcept {
+        static_assert(std::is_same_v<futurize_t<std::invoke_result_t<Func, Service&>>, future<>>,
+                      "broadcast()'s func must return void or future<>");
+        return smp::broadcast(options, [this, func = std::move(func)] () mutable {
+            return futurize_invoke(func, *get_local_service());
+        });
+    }
+
+    /// Invoke a function on all instances of `Service`, through a broadcast tree.
+    ///
+    /// Passes the default \ref smp_submit_to_options to the
+    /// \ref smp::submit_to() calls made behind the scenes.
+    template <typename Func>
+    requires std::invocable<Func, Service&>
+    future<> broadcast(Func func) noexcept {
+        return broadcast(smp_submit_to_options{}, std::move(func));
+    }
+
+    /// Applies a map function to all shards, reducing the results along a broadcast tree.
+    ///
+    /// Like \ref map_reduce0(), but values are reduced on the way back
+    /// through the tree described in \ref smp::broadcast_map_reduce(), so
+    /// the current shard only receives two partial results.
+    ///
+    /// \param map callable with the signature `Value (Service&)` or
+    ///               `future<Value> (Service&)` (for some `Value` type).
+    /// \param reduce associative binary function taking two `Value`s and
+    ///               returning a `Value`; copied to every shard.
+    /// \return  Result of reducing the return values of `map` on all shards.
+    template <typename Mapper, typename Reduce>
+    requires std::invocable<Mapper, Service&>
+    auto broadcast_map_reduce(Mapper map, Reduce reduce) noexcept {
+        return smp::broadcast_map_reduce([this, map = std::move(map)] () mutable {
+            return std::invoke(map, *get_local_service());
+        }, std::move(reduce));
+    }
+
     /// Applies a map function to all shards, and return a vector of the result.
     ///
     /// \param mapper callable with the signature `Value (Service&)` or
@@ -488,6 +539,39 @@ class sharded {
         return invoke_on(id, smp_submit_to_options(), std::forward<Func>(func), std::forward<Args>(args)...);
     }
 
+    /// Invoke a callable on the instance of `Service` that serves a shard:
+    /// the instance of the shard, or that of the active shard its work
+    /// goes to if it is parked (see \ref smp::park()).
+    ///
+    /// Only for services whose instances can all do the work of any
+    /// shard, such as stateless or replicated ones.
+    ///
+    /// \param id shard id to call
+    /// \param options the options to forward to the \ref smp::submit_to()
+    ///         called behind the scenes.
+    /// \param func a callable with signature `Value (Service&, Args...)` or
+    ///        `future<Value> (Service&, Args...)` (for some `Value` type), or a pointer
+    ///        to a member function of Service
+    /// \param args parameters to the callable; will be copied or moved. To pass by reference,
+    ///              use std::ref().
+    ///
+    /// \return result of calling `func(instance)` on the instance serving \c id
+    template <typename Func, typename... Args, typename Ret = futurize_t<std::invoke_result_t<Func, Service&, Args...>>>
+    requires std::invocable<Func, Service&, Args&&...>
+    Ret
+    invoke_on_active(unsigned id, smp_submit_to_options options, Func&& func, Args&&... args) {
+        return invoke_on(smp::active_shard(id), options, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    /// Invoke a callable on the instance of `Service` that serves a shard,
+    /// as \ref invoke_on_active(unsigned, smp_submit_to_options, Func&&, Args&&...) does.
+    template <typename Func, typename... Args, typename Ret = futurize_t<std::invoke_result_t<Func, Service&, Args&&...>>>
+    requires std::invocable<Func, Service&, Args&&...>
+    Ret
+    invoke_on_active(unsigned id, Func&& func, Args&&... args) {
+        return invoke_on_active(id, smp_submit_to_options(), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
     /// Gets a reference to the local instance.
     const Service& local() const noexcept;
 
@@ -0,0 +1,282 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <ranges>
+#include <boost/iterator/counting_iterator.hpp>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#endif
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// Maps keys to shards with jump consistent hashing.
+///
+/// Changing the number of shards from \c n to \c m moves only the keys
+/// it has to, about a \c 1-n/m fraction of them when growing, unlike
+/// \c hash(key)%count which moves almost all of them. State persisted by
+/// shard, or cached on the shard a key belonged to, mostly stays where it
+/// is when an application is restarted with another \c --smp.
+///
+/// See "A Fast, Minimal Memory, Consistent Hash Algorithm", Lamping and Veach.
+template <typename Key, typename Hash = std::hash<Key>>
+class jump_consistent_hash {
+    unsigned _shards;
+    [[no_unique_address]] Hash _hash;
+public:
+    explicit jump_consistent_hash(unsigned shards = smp::count, Hash hash = Hash())
+            : _shards(shards), _hash(std::move(hash)) {
+        assert(_shards > 0);
+    }
+    shard_id operator()(const Key& key) const noexcept {
+        uint64_t k = _hash(key);
+        int64_t b = -1;
+        int64_t j = 0;
+        while (j < int64_t(_shards)) {
+            b = j;
+            k = k * 2862933555777941757ULL + 1;
+            j = int64_t(double(b + 1) * (double(int64_t(1) << 31) / double((k >> 33) + 1)));
+        }
+        return b;
+    }
+    unsigned shards() const noexcept {
+        return _shards;
+    }
+};
+
+/// Maps keys to shards by the range they fall into.
+///
+/// With \c n bounds, the keys smaller than the first go to shard 0, those
+/// from the first to the second excluded to shard 1, and so on, the keys
+/// from the last bound on going to shard \c n. Ranges keep the keys close
+/// to one another on the same shard, for scans.
+template <typename Key, typename Compare = std::less<Key>>
+class range_partitioning {
+    std::vector<Key> _bounds;
+    [[no_unique_address]] Compare _cmp;
+public:
+    /// \param bounds the first key of shards 1 to \c bounds.size(), sorted;
+    ///        there must be fewer than \ref smp::count
+    explicit range_partitioning(std::vector<Key> bounds, Compare cmp = Compare())
+            : _bounds(std::move(bounds)), _cmp(std::move(cmp)) {
+        assert(std::is_sorted(_bounds.begin(), _bounds.end(), _cmp));
+    }
+    shard_id operator()(const Key& key) const noexcept {
+        return std::upper_bound(_bounds.begin(), _bounds.end(), key, _cmp) - _bounds.begin();
+    }
+    const std::vector<Key>& bounds() const noexcept {
+        return _bounds;
+    }
+};
+
+/// A function an instance of \ref sharded_map can route its keys with
+template <typename Mapping, typename Key>
+concept shard_mapping = std::copy_constructible<Mapping>
+        && requires (const Mapping& m, const Key& k) {
+    { m(k) } -> std::convertible_to<shard_id>;
+};
+
+/// Routes the operations on keys of a \ref sharded service to the shards
+/// owning them.
+///
+/// It saves spelling out \c invoke_on(hash(key)%smp::count,...) and
+/// getting it subtly different in different places, and sends the
+/// operations on several keys as one message to each shard. The mapping is
+/// pluggable: \ref jump_consistent_hash, the default, or \ref range_partitioning.
+/// A copy of it is in each instance of \ref sharded_map, which does not own
+/// the service.
+///
+/// \code
+/// sharded<cache> c;
+/// sharded_map<sstring, cache> m(c);
+/// m.invoke_on("k", [] (cache& c, sstring key) { return c.get(key); });
+/// m.invoke_on_keys(keys, [] (cache& c, std::vector<sstring> keys) {
+///     return c.get_many(keys);
+/// });
+/// \endcode
+template <typename Key, typename Service, shard_mapping<Key> Mapping = jump_consistent_hash<Key>>
+class sharded_map {
+    sharded<Service>& _service;
+    Mapping _mapping;
+
+    template <typename Func, typename OnDone>
+    future<> send_batches(std::vector<std::vector<Key>>& batches, Func& func, OnDone on_done) {
+        return parallel_for_each(boost::make_counting_iterator<unsigned>(0), boost::make_counting_iterator<unsigned>(batches.size()),
+                [this, &batches, &func, on_done] (unsigned shard) {
+            if (batches[shard].empty()) {
+                return make_ready_future<>();
+            }
+            return _service.invoke_on(shard, func, std::move(batches[shard])).then([shard, on_done] (auto... values) mutable {
+                on_done(shard, std::move(values)...);
+            });
+        });
+    }
+public:
+    explicit sharded_map(sharded<Service>& service, Mapping mapping = Mapping())
+            : _service(service), _mapping(std::move(mapping)) {}
+
+    /// The shard owning \c key
+    shard_id shard_of(const Key& key) const noexcept {
+        return _mapping(key);
+    }
+
+    const Mapping& mapping() const noexcept {
+        return _mapping;
+    }
+
+    sharded<Service>& container() noexcept {
+        return _service;
+    }
+
+    /// Invokes a callable on the instance of the service owning \c key.
+    ///
+    /// \param func a callable with signature `Value (Service&, Key, Args...)`
+    ///        or `future<Value> (Service&, Key, Args...)`
+    /// \param args parameters to the callable, copied or moved as for
+    ///        \ref sharded::invoke_on()
+    template <typename Func, typename... Args, typename Ret = futurize_t<std::invoke_result_t<Func, Service&, Key, Args...>>>
+    requires std::invocable<Func, Service&, Key, Args...>
+    Ret invoke_on(const Key& key, Func&& func, Args&&... args) {
+        return _service.invoke_on(shard_of(key), std::forward<Func>(func), Key(key), std::forward<Args>(args)...);
+    }
+
+    /// Invokes a callable once on each instance of the service owning some
+    /// of \c keys, with those keys, in parallel.
+    ///
+    /// \param func a callable with signature `void (Service&, std::vector<Key>)`,
+    ///        `future<> (Service&, std::vector<Key>)`, or one returning a
+    ///        `std::vector<Value>` or a future of one, of a value for each key
+    ///        it was passed, in the same order
+    /// \return a `future<>`, or a future of a `std::vector<Value>`
+    ///         of the values for \c keys, in their order
+    template <std::ranges::input_range Range, typename Func>
+    requires std::convertible_to<std::ranges::range_reference_t<Range>, const Key&>
+            && std::invocable<Func&, Service&, std::vector<Key>>
+    auto invoke_on_keys(const Range& keys, Func func) {
+        using ret = futurize_t<std::invoke_result_t<Func&, Service&, std::vector<Key>>>;
+        std::vector<std::vector<Key>> batches(smp::count);
+        std::vector<std::vector<size_t>> positions(smp::count);
+        size_t nr_keys = 0;
+        for (const Key& k : keys) {
+            auto shard = shard_of(k);
+            batches[shard].push_back(k);
+            positions[shard].push_back(nr_keys++);
+        }
+        if constexpr (std::is_same_v<ret, future<>>) {
+            return do_with(std::move(batches), std::move(func), [this] (auto& batches, Func& func) {
+                return send_batches(batches, func, [] (unsigned) {});
+            });
+        } else {
+            using value_type = typename ret::value_type::value_type;
+            static_assert(std::is_same_v<typename ret::value_type, std::vector<value_type>>,
+                    "the callable must return a std::vector of a value for each key");
+            static_assert(std::default_initializable<value_type>);
+            return do_with(std::move(batches), std::move(func), std::move(positions), std::vector<value_type>(nr_keys),
+                    [this] (auto& batches, Func& func, auto& positions, auto& results) {
+                return send_batches(batches, func, [&positions, &results] (unsigned shard, std::vector<value_type> values) {
+                    assert(values.size() == positions[shard].size());
+                    for (size_t i = 0; i != values.size(); ++i) {
+                        results[positions[shard][i]] = std::move(values[i]);
+                    }
+                }).then([&results] {
+                    return std::move(results);
+                });
+            });
+        }
+    }
+
+    /// Switches to another mapping, moving the entries whose shard it changes.
+    ///
+    /// Each shard removes from its instance the entries the new mapping puts
+    /// on other shards, with \c extract, and sends them to those, which
+    /// add them to theirs with \c insert. Nothing else should access the
+    /// entries until the returned future resolves. Only this copy of the
+    /// sharded_map switches to \c mapping; the other copies, if any, must be
+    /// switched with set_mapping().
+    ///
+    /// \param extract a callable with signature
+    ///        `std::vector<std::pair<Key, Value>> (Service&, const std::function<bool (const Key&)>& moves)`,
+    ///        or returning a future of one, removing from the instance and
+    ///        returning the entries of the keys \c moves is true for
+    ///        (the keys the instance does not own anymore)
+    /// \param insert a callable with signature
+    ///        `void (Service&, std::vector<std::pair<Key, Value>>)`, or
+    ///        returning a `future<>`, adding the entries to the instance
+    template <typename Extract, typename Insert>
+    future<> rebalance(Mapping mapping, Extract extract, Insert insert) {
+        return _service.invoke_on_all([&service = _service, mapping, extract = std::move(extract), insert = std::move(insert)] (Service& s) {
+            return do_with(mapping, extract, insert, std::function<bool (const Key&)>(),
+                    [&service, &s] (Mapping& mapping, Extract& extract, Insert& insert, auto& moves) {
+                moves = [&mapping, shard = this_shard_id()] (const Key& k) { return shard_id(mapping(k)) != shard; };
+                return futurize_invoke(extract, s, std::as_const(moves)).then([&service, &mapping, &insert] (auto entries) {
+                    using entry = typename decltype(entries)::value_type;
+                    std::vector<std::vector<entry>> by_shard(smp::count);
+                    for (auto& e : entries) {
+                        by_shard[mapping(e.first)].push_back(std::move(e));
+                    }
+                    return do_with(std::move(by_shard), [&service, &insert] (auto& by_shard) {
+                        return parallel_for_each(boost::make_counting_iterator<unsigned>(0), boost::make_counting_iterator<unsigned>(by_shard.size()),
+                                [&service, &insert, &by_shard] (unsigned shard) {
+                            if (by_shard[shard].empty()) {
+                                return make_ready_future<>();
+                            }
+                            return service.invoke_on(shard, [insert] (Service& s, std::vector<entry> entries) mutable {
+                                return futurize_invoke(insert, s, std::move(entries));
+                            }, std::move(by_shard[shard]));
+                        });
+                    });
+                });
+            });
+        }).then([this, mapping = std::move(mapping)] () mutable {
+            _mapping = std::move(mapping);
+        });
+    }
+
+    /// Switches to another mapping, for the copies of the sharded_map
+    /// other than the one rebalance() was called on
+    void set_mapping(Mapping mapping) {
+        _mapping = std::move(mapping);
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -141,6 +141,8 @@ class slab_class {
         &slab_item_base::_lru_link>> _lru;
     size_t _size; // size of objects
     uint8_t _slab_class_id;
+    size_t _pages = 0;
+    uint64_t _evictions = 0;
 private:
     template<typename... Args>
     inline
@@ -162,6 +164,7 @@ class slab_class {
         _lru.erase(_lru.iterator_to(reinterpret_cast<slab_item_base&>(victim)));
         // WARNING: You need to make sure that erase_func will not release victim back to slab.
         erase_func(victim);
+        _evictions++;
 
         return { reinterpret_cast<void*>(&victim), index };
     }
@@ -189,6 +192,20 @@ class slab_class {
         return _lru.empty();
     }
 
+    size_t pages() const {
+        return _pages;
+    }
+
+    // Items evicted to make room for others of the class
+    uint64_t evictions() const {
+        return _evictions;
+    }
+
+    // The least recently used item, if any
+    Item* lru_item() {
+        return _lru.empty() ? nullptr : &reinterpret_cast<Item&>(_lru.back());
+    }
+
     template<typename... Args>
     Item *create(Args&&... args) {
         assert(!_free_slab_pages.empty());
@@ -225,6 +242,7 @@ class slab_class {
 
         _free_slab_pages.push_front(*desc);
         insert_slab_page_desc(*desc);
+        _pages++;
 
         // first object from the allocated slab page is returned.
         return create_item(slab_page, slab_page_index, std::forward<Args>(args)...);
@@ -269,6 +287,22 @@ class slab_class {
         assert(desc.slab_class_id() == _slab_class_id);
         _free_slab_pages.erase(_free_slab_pages.iterator_to(desc));
     }
+
+    void remove_page() {
+        _pages--;
+    }
+
+    /*
+     * Takes over a slab page of another class, emptied of its items, all of
+     * its objects free.
+     */
+    slab_page_desc& adopt_page(void *slab_page, uint64_t max_object_size, uint32_t slab_page_index) {
+        auto desc = new slab_page_desc(slab_page, max_object_size / _size, _size, _slab_class_id, slab_page_index);
+        desc->free_object(slab_page);
+        _free_slab_pages.push_back(*desc);
+        _pages++;
+        return *desc;
+    }
 };
 
 template<typename Item>
@@ -291,19 +325,16 @@ class slab_allocator {
     } _stats;
     memory::reclaimer *_reclaimer = nullptr;
     bool _reclaimed = false;
+    // Evictions of each class at the last rebalancing
+    std::vector<uint64_t> _rebalance_evictions;
+    uint64_t _rebalanced_pages = 0;
 private:
-    memory::reclaiming_result evict_lru_slab_page() {
-        if (_slab_page_desc_lru.empty()) {
-            // NOTE: Nothing to evict. If this happens, it implies that all
-            // slab pages in the slab are being used at the same time.
-            // That being said, this event is very unlikely to happen.
-            return memory::reclaiming_result::reclaimed_nothing;
-        }
-        // get descriptor of the least-recently-used slab page and related info.
-        auto& desc = _slab_page_desc_lru.back();
+    /*
+     * Erases the items of a slab page, none of which may be in use, and
+     * removes the page from its class.
+     */
+    void evict_slab_page_items(slab_page_desc& desc, slab_class<Item>* slab_class) {
         assert(desc.refcnt() == 0);
-        uint8_t slab_class_id = desc.slab_class_id();
-        auto slab_class = get_slab_class(slab_class_id);
         void *slab_page = desc.slab_page();
 
         auto& free_objects = desc.free_objects();
@@ -313,10 +344,6 @@ class slab_allocator {
             // and sort the array of free objects for binary search later on.
             std::sort(free_objects.begin(), free_objects.end());
         }
-        // remove desc from the list of slab page descriptors.
-        _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
-        // remove desc from the slab page vector.
-        _slab_pages_vector[desc.index()] = nullptr;
 
         // Iterate through objects in the slab page and if the object is an allocated
         // item, the item should be removed from LRU and then erased.
@@ -337,6 +364,24 @@ class slab_allocator {
             _erase_func(*item);
             _stats.frees++;
         }
+        slab_class->remove_page();
+    }
+
+    memory::reclaiming_result evict_lru_slab_page() {
+        if (_slab_page_desc_lru.empty()) {
+            // NOTE: Nothing to evict. If this happens, it implies that all
+            // slab pages in the slab are being used at the same time.
+            // That being said, this event is very unlikely to happen.
+            return memory::reclaiming_result::reclaimed_nothing;
+        }
+        // get descriptor of the least-recently-used slab page and related info.
+        auto& desc = _slab_page_desc_lru.back();
+        void *slab_page = desc.slab_page();
+        evict_slab_page_items(desc, get_slab_class(desc.slab_class_id()));
+        // remove desc from the list of slab page descriptors.
+        _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
+        // remove desc from the slab page vector.
+        _slab_pages_vector[desc.index()] = nullptr;
 #ifdef SEASTAR_DEBUG
         printf("lru slab page eviction succeeded! desc_empty?=%d\n", desc.empty());
 #endif
@@ -372,6 +417,7 @@ class slab_allocator {
         }
         _slab_class_sizes.push_back(_max_object_size);
         _slab_classes.emplace_back(_max_object_size, slab_class_id);
+        _rebalance_evictions.resize(_slab_classes.size());
 
         // If slab limit is zero, enable reclaimer.
         if (!limit) {
@@ -403,7 +449,8 @@ class slab_allocator {
             sm::make_counter("free_total_operations", sm::description("Total number of slab free operations"), _stats.frees),
             sm::make_gauge("malloc_objects", sm::description("Number of slab created objects currently in memory"), [this] {
                 return _stats.allocs - _stats.frees;
-            })
+            }),
+            sm::make_counter("rebalanced_pages", sm::description("Total number of slab pages moved from a slab class to another"), _rebalanced_pages),
         });
     }
 
@@ -492,13 +539,10 @@ class slab_allocator {
 
     void lock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (++refcnt == 1) {
-                // remove slab page descriptor from list of slab page descriptors.
-                _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
-            }
+        // Pages with items in use are neither reclaimed nor rebalanced
+        if (++desc.refcnt() == 1 && _reclaimer) {
+            // remove slab page descriptor from list of slab page descriptors.
+            _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
         }
         // remove item from the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
@@ -507,13 +551,9 @@ class slab_allocator {
 
     void unlock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (--refcnt == 0) {
-                // insert slab page descriptor back into list of slab page descriptors.
-                _slab_page_desc_lru.push_front(desc);
-            }
+        if (--desc.refcnt() == 0 && _reclaimer) {
+            // insert slab page descriptor back into list of slab page descriptors.
+            _slab_page_desc_lru.push_front(desc);
         }
         // insert item into the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
@@ -543,6 +583,58 @@ class slab_allocator {
         }
     }
 
+    /**
+     * Moves a slab page to the class that evicted the most items since the
+     * last call, if any did, from a class that evicted none and has more
+     * than one page, evicting the items of the page of the least recently
+     * used item of the donor class. Once the memory limit has been
+     * reached, the pages of a class are otherwise kept by it for good,
+     * even when the sizes of the items shift to other classes, the items
+     * of those then evicting each other while the pages of the former
+     * hold on to stale ones.
+     *
+     * Meant to be called periodically, moving at most one page at a time;
+     * does nothing when the memory is reclaimed rather than limited, the
+     * reclaimer releasing the least recently used pages of all classes.
+     * Returns whether a page was moved.
+     */
+    bool rebalance() {
+        if (_reclaimer) {
+            return false;
+        }
+        slab_class<Item>* receiver = nullptr;
+        slab_class<Item>* donor = nullptr;
+        uint64_t most_evictions = 0;
+        for (auto& sc : _slab_classes) {
+            auto id = &sc - _slab_classes.data();
+            auto evictions = sc.evictions() - std::exchange(_rebalance_evictions[id], sc.evictions());
+            if (evictions > most_evictions) {
+                most_evictions = evictions;
+                receiver = &sc;
+            } else if (!evictions && sc.pages() > 1 && (!donor || sc.pages() > donor->pages())) {
+                donor = &sc;
+            }
+        }
+        if (!receiver || !donor) {
+            return false;
+        }
+        auto victim = donor->lru_item();
+        if (!victim) {
+            return false;
+        }
+        auto& desc = get_slab_page_desc(victim);
+        if (desc.refcnt()) {
+            return false;
+        }
+        void *slab_page = desc.slab_page();
+        auto index = desc.index();
+        evict_slab_page_items(desc, donor);
+        delete &desc;
+        _slab_pages_vector[index] = &receiver->adopt_page(slab_page, _max_object_size, index);
+        _rebalanced_pages++;
+        return true;
+    }
+
     /**
      * Helper function: Print all available slab classes and their respective properties.
      */
@@ -21,7 +21,9 @@
 
 #pragma once
 
+#include <seastar/core/circular_buffer.hh>
 #include <seastar/core/future.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/metrics_registration.hh>
@@ -29,12 +31,14 @@
 #include <seastar/core/reactor_config.hh>
 #include <seastar/core/resource.hh>
 #include <seastar/core/shard_id.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/util/modules.hh>
 
 #ifndef SEASTAR_MODULE
 #include <boost/lockfree/spsc_queue.hpp>
 #include <boost/thread/barrier.hpp>
 #include <boost/range/irange.hpp>
+#include <chrono>
 #include <deque>
 #include <optional>
 #include <thread>
@@ -172,10 +176,17 @@ struct smp_submit_to_options {
     /// processed by the remote shard, and *not* to the time it takes to be
     /// executed there.
     smp_timeout_clock::time_point timeout = smp_no_timeout;
-
-    smp_submit_to_options(smp_service_group service_group = default_smp_service_group(), smp_timeout_clock::time_point timeout = smp_no_timeout) noexcept
+    /// Send the request to the remote shard right away, rather than batching
+    /// it with other requests to the same shard, trading throughput for latency.
+    /// Requests are otherwise only batched while many are in flight; see
+    /// \ref smp::submit_to().
+    bool latency_sensitive = false;
+
+    smp_submit_to_options(smp_service_group service_group = default_smp_service_group(), smp_timeout_clock::time_point timeout = smp_no_timeout,
+            bool latency_sensitive = false) noexcept
         : service_group(service_group)
-        , timeout(timeout) {
+        , timeout(timeout)
+        , latency_sensitive(latency_sensitive) {
     }
 };
 
@@ -183,10 +194,21 @@ void init_default_smp_service_group(shard_id cpu);
 
 smp_service_group_semaphore& get_smp_service_groups_semaphore(unsigned ssg_id, shard_id t) noexcept;
 
+// Requests and responses are handed over to the other shard in batches, as
+// each handover costs a cache line transfer and maybe a wakeup. Batches are
+// sized adaptively (see request_batch_size() and response_batch_size()):
+// small while few requests are in flight, so that a lone request doesn't wait
+// for the end of the current task quota to be sent, and up to max_batch_size
+// under throughput load. The queue also tracks the round-trip time of
+// requests, sampled once per batch.
 class smp_message_queue {
     static constexpr size_t queue_length = 128;
-    static constexpr size_t batch_size = 16;
+    static constexpr size_t max_batch_size = 32;
     static constexpr size_t prefetch_cnt = 2;
+    // Small calls (see small_work_item) are held in preallocated slots of
+    // this size, so that they don't allocate.
+    static constexpr size_t small_item_size = 128;
+    static constexpr size_t nr_small_items = queue_length;
     struct work_item;
     struct lf_queue_remote {
         reactor* remote;
@@ -201,12 +223,16 @@ class smp_message_queue {
     };
     lf_queue _pending;
     lf_queue _completed;
+    // Latencies of sampled requests, in microseconds, from 4us to about 1s.
+    using latency_histogram = metrics::internal::approximate_exponential_histogram<4, 1 << 20, 2>;
     struct alignas(seastar::cache_line_size) {
         size_t _sent = 0;
         size_t _compl = 0;
         size_t _last_snt_batch = 0;
         size_t _last_cmpl_batch = 0;
         size_t _current_queue_length = 0;
+        // Exponentially weighted moving average of round-trip times, in ns.
+        uint64_t _rtt_ns = 0;
     };
     // keep this between two structures with statistics
     // this makes sure that they have at least one cache line
@@ -217,14 +243,28 @@ class smp_message_queue {
         size_t _received = 0;
         size_t _last_rcv_batch = 0;
     };
+    // From enqueueing a request to the remote shard starting to run it;
+    // written by the remote shard.
+    alignas(seastar::cache_line_size) latency_histogram _execution_latency;
+    // From enqueueing a request to processing its response.
+    alignas(seastar::cache_line_size) latency_histogram _completion_latency;
     struct work_item : public task {
-        explicit work_item(smp_service_group ssg) : task(current_scheduling_group()), ssg(ssg) {}
+        explicit work_item(smp_service_group ssg) : task(current_scheduling_group(), shard_agnostic_tag{}), ssg(ssg) {}
         smp_service_group ssg;
+        // Set on the first item of each request batch when it is enqueued,
+        // to sample latencies.
+        std::chrono::steady_clock::time_point sent_at;
         virtual ~work_item() {}
         virtual void fail_with(std::exception_ptr) = 0;
         void process();
         virtual void complete() = 0;
+        // Destroys the item and frees its memory.
+        virtual void release() noexcept { delete this; }
+    };
+    struct work_item_deleter {
+        void operator()(work_item* wi) const noexcept { wi->release(); }
     };
+    using work_item_ptr = std::unique_ptr<work_item, work_item_deleter>;
     template <typename Func>
     struct async_work_item : work_item {
         smp_message_queue& _queue;
@@ -267,12 +307,81 @@ class smp_message_queue {
         }
         future_type get_future() { return _promise.get_future(); }
     };
+    // A call whose function and result are small and trivially copyable, and
+    // which does not return a future, is run directly on the remote shard
+    // and lives in a preallocated slot of its queue: it allocates nothing on
+    // either shard. Typical of cross-shard counter updates and lookups.
+    template <typename Func>
+    struct small_work_item final : work_item {
+        smp_message_queue& _queue;
+        Func _func;
+        using futurator = futurize<std::invoke_result_t<Func>>;
+        using future_type = typename futurator::type;
+        using value_type = typename future_type::value_type;
+        std::optional<value_type> _result;
+        std::exception_ptr _ex; // if !_result
+        typename futurator::promise_type _promise; // used on local side
+        small_work_item(smp_message_queue& queue, smp_service_group ssg, Func&& func) : work_item(ssg), _queue(queue), _func(std::move(func)) {}
+        virtual void fail_with(std::exception_ptr ex) override {
+            _promise.set_exception(std::move(ex));
+        }
+        virtual task* waiting_task() noexcept override {
+            return nullptr;
+        }
+        virtual void run_and_dispose() noexcept override {
+            try {
+                if constexpr (std::is_void_v<std::invoke_result_t<Func>>) {
+                    _func();
+                    _result.emplace();
+                } else {
+                    _result.emplace(_func());
+                }
+            } catch (...) {
+                _ex = std::current_exception();
+            }
+            _queue.respond(this);
+        }
+        virtual void complete() override {
+            if (_result) {
+                _promise.set_value(std::move(*_result));
+            } else {
+                _promise.set_exception(std::move(_ex));
+            }
+        }
+        virtual void release() noexcept override {
+            auto& queue = _queue;
+            this->~small_work_item();
+            queue.free_small_slot(this);
+        }
+        future_type get_future() { return _promise.get_future(); }
+    };
+    template <typename Func>
+    static constexpr bool is_small_call() noexcept {
+        if constexpr (std::is_reference_v<Func> || !std::is_trivially_copyable_v<Func>) {
+            return false;
+        } else {
+            using result_type = std::invoke_result_t<Func>;
+            if constexpr (is_future<result_type>::value) {
+                return false;
+            } else {
+                return (std::is_void_v<result_type> || std::is_trivially_copyable_v<result_type>)
+                    && sizeof(small_work_item<Func>) <= small_item_size
+                    && alignof(small_work_item<Func>) <= alignof(std::max_align_t);
+            }
+        }
+    }
+    union small_slot {
+        small_slot* next;
+        alignas(std::max_align_t) char storage[small_item_size];
+    };
     union tx_side {
         tx_side() {}
         ~tx_side() {}
-        void init() { new (&a) aa; }
+        void init();
         struct aa {
-            std::deque<work_item*> pending_fifo;
+            circular_buffer<work_item*> pending_fifo;
+            std::unique_ptr<small_slot[]> small_slots;
+            small_slot* free_small_slots = nullptr;
         } a;
     } _tx;
     std::vector<work_item*> _completed_fifo;
@@ -282,9 +391,17 @@ class smp_message_queue {
     template <typename Func>
     futurize_t<std::invoke_result_t<Func>> submit(shard_id t, smp_submit_to_options options, Func&& func) noexcept {
         memory::scoped_critical_alloc_section _;
+        if constexpr (is_small_call<Func>()) {
+            if (auto slot = allocate_small_slot()) {
+                auto wi = new (slot) small_work_item<Func>(*this, options.service_group, std::move(func));
+                auto fut = wi->get_future();
+                submit_item(t, options.timeout, options.latency_sensitive, work_item_ptr(wi));
+                return fut;
+            }
+        }
         auto wi = std::make_unique<async_work_item<Func>>(*this, options.service_group, std::forward<Func>(func));
         auto fut = wi->get_future();
-        submit_item(t, options.timeout, std::move(wi));
+        submit_item(t, options.timeout, options.latency_sensitive, work_item_ptr(wi.release()));
         return fut;
     }
     void start(unsigned cpuid);
@@ -295,8 +412,22 @@ class smp_message_queue {
     void stop();
 private:
     void work();
-    void submit_item(shard_id t, smp_timeout_clock::time_point timeout, std::unique_ptr<work_item> wi);
+    void submit_item(shard_id t, smp_timeout_clock::time_point timeout, bool latency_sensitive, work_item_ptr wi);
+    void* allocate_small_slot() noexcept {
+        auto slot = _tx.a.free_small_slots;
+        if (slot) {
+            _tx.a.free_small_slots = slot->next;
+        }
+        return slot;
+    }
+    void free_small_slot(void* p) noexcept {
+        auto slot = static_cast<small_slot*>(p);
+        slot->next = _tx.a.free_small_slots;
+        _tx.a.free_small_slots = slot;
+    }
     void respond(work_item* wi);
+    size_t request_batch_size() const noexcept;
+    size_t response_batch_size() const noexcept;
     void move_pending();
     void flush_request_batch();
     void flush_response_batch();
@@ -350,10 +481,16 @@ class smp : public std::enable_shared_from_this<smp> {
     ///          it will survive the call.
     /// \return whatever \c func returns, as a future<> (if \c func does not return a future,
     ///         submit_to() will wrap it in a future<>).
+    ///
+    /// Calls to a remote core are sent in batches while many calls to it are
+    /// in flight, and right away otherwise, when the remote core is asleep,
+    /// or when \ref smp_submit_to_options::latency_sensitive is set.
     template <typename Func>
     static futurize_t<std::invoke_result_t<Func>> submit_to(unsigned t, smp_submit_to_options options, Func&& func) noexcept {
         using ret_type = std::invoke_result_t<Func>;
         if (t == this_shard_id()) {
+            // Like on the other shards, the call starts with no task-local values
+            internal::no_task_locals_scope no_locals;
             try {
                 if (!is_future<ret_type>::value) {
                     // Non-deferring function, so don't worry about func lifetime
@@ -398,6 +535,47 @@ class smp : public std::enable_shared_from_this<smp> {
     static boost::integer_range<unsigned> all_cpus() noexcept {
         return boost::irange(0u, count);
     }
+    /// Parks a shard, for its reactor to sleep as soon as it is idle
+    /// rather than poll for work, and for the work addressed to it with
+    /// \ref active_shard() to go to the shards still active.
+    ///
+    /// The shard keeps running what it is given, its timers and the work
+    /// submitted to it directly; only the callers routing through
+    /// \ref active_shard() stop sending it any. Must be called on shard 0,
+    /// which cannot be parked.
+    static future<> park(unsigned id);
+    /// Unparks a shard parked by \ref park(). Must be called on shard 0.
+    static future<> unpark(unsigned id);
+    /// Whether a shard is parked
+    static bool parked(unsigned id) noexcept;
+    /// The shard to send the work meant for the given one to: the shard
+    /// itself if it is active, or one of the active shards, the same one
+    /// until the set of parked shards changes, if it is parked
+    static unsigned active_shard(unsigned id) noexcept;
+    /// The number of shards not parked
+    static unsigned active_count() noexcept;
+    /// The NUMA node of the memory of a shard
+    static unsigned numa_node(unsigned id) noexcept;
+    /// All the shards, the given one first, then by increasing NUMA
+    /// distance from it
+    static const std::vector<unsigned>& shards_by_distance(unsigned id) noexcept;
+    /// The nearest shard to the current one, itself first, for which
+    /// \c pred is true, such as one holding a copy of some data, to
+    /// \ref submit_to() rather than a shard across a socket
+    ///
+    /// \code
+    /// auto replica = smp::nearest_shard([&] (unsigned c) { return holders.contains(c); });
+    /// \endcode
+    template <typename Pred>
+    requires std::is_invocable_r_v<bool, Pred, unsigned>
+    static std::optional<unsigned> nearest_shard(Pred pred) {
+        for (auto c : shards_by_distance(this_shard_id())) {
+            if (pred(c)) {
+                return c;
+            }
+        }
+        return std::nullopt;
+    }
     /// Invokes func on all shards.
     ///
     /// \param options the options to forward to the \ref smp::submit_to()
@@ -473,10 +651,155 @@ class smp : public std::enable_shared_from_this<smp> {
     static future<> invoke_on_others(Func func) noexcept {
         return invoke_on_others(this_shard_id(), std::move(func));
     }
+    /// Invokes func on all shards, through a broadcast tree.
+    ///
+    /// Where \ref invoke_on_all() sends a message from the current shard to
+    /// every other shard, broadcast() sends at most two: each shard reached
+    /// forwards the call to (at most) two others before running \c func
+    /// itself, and reports back once its whole subtree is done. The cost of
+    /// the fan-out is thus spread over the shards, and the current shard only
+    /// waits for two completions, at the price of about log2(\ref smp::count)
+    /// hops of latency. Prefer it over invoke_on_all() on machines with many
+    /// shards, or when the call is made often (configuration pushes,
+    /// cache invalidations).
+    ///
+    /// \param options the options to forward to the \ref smp::submit_to()
+    ///         calls made along the tree.
+    /// \param func the function to be invoked on each shard. May return void or
+    ///         future<>. Each invocation works with a separate copy of \c func,
+    ///         made (and destroyed) on the shard forwarding the call.
+    /// \returns a future that resolves when all invocations finish, and fails
+    ///         with one of their exceptions if any of them did.
+    template <typename Func>
+    requires std::is_nothrow_move_constructible_v<Func> && std::is_copy_constructible_v<Func>
+    static future<> broadcast(smp_submit_to_options options, Func func) noexcept {
+        static_assert(std::is_same_v<future<>, typename futurize<std::invoke_result_t<Func>>::type>, "bad Func signature");
+        try {
+            // The tree refers to func until it completes, so keep it in place.
+            auto f = std::make_unique<Func>(std::move(func));
+            auto ret = broadcast_subtree(this_shard_id(), 0, count, options, *f);
+            return ret.finally([f = std::move(f)] {});
+        } catch (...) {
+            return current_exception_as_future();
+        }
+    }
+    /// Invokes func on all shards, through a broadcast tree.
+    ///
+    /// Passes the default \ref smp_submit_to_options to the
+    /// \ref smp::submit_to() calls made along the tree; see
+    /// \ref broadcast(smp_submit_to_options, Func).
+    template <typename Func>
+    requires std::is_nothrow_move_constructible_v<Func> && std::is_copy_constructible_v<Func>
+    static future<> broadcast(Func func) noexcept {
+        return broadcast(smp_submit_to_options{}, std::move(func));
+    }
+    /// Invokes mapper on all shards and reduces the results along a broadcast tree.
+    ///
+    /// Like \ref broadcast(), but each shard also reduces the value returned
+    /// by its own invocation of \c mapper with the values reduced by the
+    /// shards it forwarded the call to, and sends back the result, so the
+    /// current shard receives two partial results instead of one per shard.
+    ///
+    /// \param options the options to forward to the \ref smp::submit_to()
+    ///         calls made along the tree.
+    /// \param mapper the function to be invoked on each shard. May return a
+    ///         value or a future. Each invocation works with a separate copy.
+    /// \param reduce a binary function combining two mapped (or already
+    ///         reduced) values. It must be associative, as values are reduced
+    ///         in shard order, starting from the current shard and wrapping
+    ///         around, but grouped by subtree. It is copied to every shard.
+    /// \returns a future resolving to the reduction of all mapped values.
+    template <typename Mapper, typename Reduce>
+    requires std::is_nothrow_move_constructible_v<Mapper> && std::is_copy_constructible_v<Mapper>
+            && std::is_nothrow_move_constructible_v<Reduce> && std::is_copy_constructible_v<Reduce>
+    static auto broadcast_map_reduce(smp_submit_to_options options, Mapper mapper, Reduce reduce) noexcept
+            -> futurize_t<std::invoke_result_t<Mapper>> {
+        using value_type = typename futurize_t<std::invoke_result_t<Mapper>>::value_type;
+        static_assert(std::is_invocable_r_v<value_type, Reduce, value_type, value_type>, "bad Reduce signature");
+        try {
+            auto fs = std::make_unique<std::pair<Mapper, Reduce>>(std::move(mapper), std::move(reduce));
+            auto ret = broadcast_map_reduce_subtree(this_shard_id(), 0, count, options, fs->first, fs->second);
+            return ret.finally([fs = std::move(fs)] {});
+        } catch (...) {
+            return current_exception_as_future<value_type>();
+        }
+    }
+    /// Invokes mapper on all shards and reduces the results along a broadcast tree.
+    ///
+    /// Passes the default \ref smp_submit_to_options to the
+    /// \ref smp::submit_to() calls made along the tree; see
+    /// \ref broadcast_map_reduce(smp_submit_to_options, Mapper, Reduce).
+    template <typename Mapper, typename Reduce>
+    requires std::is_nothrow_move_constructible_v<Mapper> && std::is_copy_constructible_v<Mapper>
+            && std::is_nothrow_move_constructible_v<Reduce> && std::is_copy_constructible_v<Reduce>
+    static auto broadcast_map_reduce(Mapper mapper, Reduce reduce) noexcept {
+        return broadcast_map_reduce(smp_submit_to_options{}, std::move(mapper), std::move(reduce));
+    }
 private:
+    // The broadcast tree lays out the shards in order starting from origin,
+    // the shard at position k being (origin + k) % count. The shard at
+    // position first covers positions [first, last): it hands [first + 1, mid)
+    // and [mid, last) to the shards at their first positions and runs the
+    // function itself.
+    static unsigned broadcast_split(unsigned first, unsigned last) noexcept {
+        return first + 1 + (last - first) / 2;
+    }
+    template <typename Func>
+    static future<> broadcast_subtree(unsigned origin, unsigned first, unsigned last, smp_submit_to_options options, Func& func) {
+        auto forward = [origin, options] (unsigned from, unsigned to, Func&& f) noexcept -> future<> {
+            if (from >= to) {
+                return make_ready_future<>();
+            }
+            return submit_to((origin + from) % count, options, [origin, from, to, options, f = std::move(f)] () mutable {
+                return broadcast_subtree(origin, from, to, options, f);
+            });
+        };
+        auto mid = broadcast_split(first, last);
+        // Copy first, so that nothing is left running if a copy throws.
+        Func left_func(func);
+        Func right_func(func);
+        auto left = forward(first + 1, mid, std::move(left_func));
+        auto right = forward(mid, last, std::move(right_func));
+        auto local = futurize_invoke(func);
+        return when_all_succeed(std::move(local), std::move(left), std::move(right)).discard_result();
+    }
+    template <typename Mapper, typename Reduce>
+    static auto broadcast_map_reduce_subtree(unsigned origin, unsigned first, unsigned last, smp_submit_to_options options,
+            Mapper& mapper, Reduce& reduce) -> futurize_t<std::invoke_result_t<Mapper>> {
+        using value_type = typename futurize_t<std::invoke_result_t<Mapper>>::value_type;
+        auto forward = [origin, options] (unsigned from, unsigned to, Mapper&& m, Reduce&& r) noexcept -> future<std::optional<value_type>> {
+            if (from >= to) {
+                return make_ready_future<std::optional<value_type>>();
+            }
+            return submit_to((origin + from) % count, options, [origin, from, to, options, m = std::move(m), r = std::move(r)] () mutable {
+                return broadcast_map_reduce_subtree(origin, from, to, options, m, r).then([] (value_type v) {
+                    return std::optional<value_type>(std::move(v));
+                });
+            });
+        };
+        auto mid = broadcast_split(first, last);
+        Mapper left_mapper(mapper);
+        Mapper right_mapper(mapper);
+        Reduce left_reduce(reduce);
+        Reduce right_reduce(reduce);
+        auto left = forward(first + 1, mid, std::move(left_mapper), std::move(left_reduce));
+        auto right = forward(mid, last, std::move(right_mapper), std::move(right_reduce));
+        auto local = futurize_invoke(mapper);
+        return when_all_succeed(std::move(local), std::move(left), std::move(right)).then([&reduce] (auto results) {
+            auto& [v, l, r] = results;
+            if (l) {
+                v = reduce(std::move(v), std::move(*l));
+            }
+            if (r) {
+                v = reduce(std::move(v), std::move(*r));
+            }
+            return std::move(v);
+        });
+    }
     void start_all_queues();
     void pin(unsigned cpu_id);
     void allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_config cfg);
+    void allocate_queues_to(unsigned id, const std::vector<reactor*>& reactors);
     void create_thread(std::function<void ()> thread_loop);
     unsigned adjust_max_networking_aio_io_control_blocks(unsigned network_iocbs);
 public:
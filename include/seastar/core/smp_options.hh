@@ -45,7 +45,8 @@ enum class memory_allocator {
 
 /// Configuration for the multicore aspect of seastar.
 struct smp_options : public program_options::option_group {
-    /// Number of threads (default: one per CPU).
+    /// Number of threads (default: one per CPU, or per CPU worth of a
+    /// cgroup CPU quota).
     program_options::value<unsigned> smp;
     /// CPUs to use (in cpuset(7) format; default: all)).
     program_options::value<resource::cpuset> cpuset;
@@ -75,6 +76,10 @@ struct smp_options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> mbind;
+    /// \brief Serve allocations of at least this size (ex: 2M) from whole huge pages.
+    ///
+    /// See \ref memory::set_huge_page_allocation_threshold(). Off by default.
+    program_options::value<std::string> huge_page_allocation_threshold;
     /// Enable workaround for glibc/gcc c++ exception scalablity problem.
     ///
     /// Default: \p true.
@@ -84,6 +89,16 @@ struct smp_options : public program_options::option_group {
     /// them to remote ones.
     /// \note Unused when seastar is compiled without \p HWLOC support.
     program_options::value<bool> allow_cpus_in_remote_numa_nodes;
+    /// \brief Number of shards, the highest-numbered ones, reserved for the
+    /// background work submitted with \ref offload().
+    ///
+    /// Default: 0, background work runs on the shards submitting it.
+    program_options::value<unsigned> offload_shards;
+    /// \brief Most requests each shard may have in flight to each offload
+    /// shard; \ref offload() waits for one to complete beyond that.
+    ///
+    /// Default: 128.
+    program_options::value<unsigned> offload_queue_depth;
 
     /// Memory allocator to use.
     ///
@@ -92,6 +107,7 @@ struct smp_options : public program_options::option_group {
     /// * \ref smp_options::reserve_memory
     /// * \ref smp_options::hugepages
     /// * \ref smp_options::mbind
+    /// * \ref smp_options::huge_page_allocation_threshold
     /// * \ref reactor_options::heapprof
     /// * \ref reactor_options::abort_on_seastar_bad_alloc
     /// * \ref reactor_options::dump_memory_diagnostics_on_alloc_failure_kind
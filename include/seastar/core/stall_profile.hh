@@ -0,0 +1,84 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// \brief The backtraces of the reactor stalls, aggregated into a profile.
+///
+/// With \c --blocked-reactor-profile, the stall detector takes the backtrace
+/// of every stall it detects, not only of those it reports, into a profile of
+/// its shard, counting the stalls of each distinct backtrace. The backtraces
+/// are taken by the signal handler of the detector, into a ring drained by
+/// the reactor, and only resolved to symbols when the profile is collected,
+/// by the syscall thread, off the reactor.
+///
+/// The profile is formatted in the folded stacks format of flamegraph.pl
+/// and other flamegraph tools: a line for each backtrace, of its frames,
+/// outermost first, under a frame of the shard, separated by semicolons,
+/// followed by the number of stalls it was seen in.
+///
+/// \code
+/// shard 0;main;seastar::reactor::run();...;my::compact() 12
+/// \endcode
+///
+/// Frames are resolved from the dynamic symbol table, for the binaries
+/// linked with \c -rdynamic, the others being the address of the frame in
+/// its object, to resolve with \c seastar-addr2line.
+namespace stall_profile {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The profile of all the shards, in the folded stacks format
+///
+/// \param reset starts the profiles of the shards over once collected
+future<sstring> collect(bool reset = false);
+
+/// Starts the profiles of all the shards over
+future<> reset();
+
+/// Writes the profile of all the shards to \c stall-profile.<pid>.folded,
+/// in the working directory, as on SIGUSR1
+///
+/// \returns the name of the file
+future<sstring> dump();
+
+/// Adds a GET endpoint serving the profile, started over if the request has
+/// the \c reset=true query parameter
+future<> add_routes(httpd::http_server& server, sstring path = "/stall_profile");
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
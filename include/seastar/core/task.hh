@@ -25,16 +25,126 @@
 #include <seastar/util/backtrace.hh>
 
 #ifndef SEASTAR_MODULE
+#include <cstdint>
 #include <utility>
 #endif
 
 namespace seastar {
 
+/// \cond internal
+namespace internal {
+
+// The span of the code running, see tracing.hh, zero if none
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+uint32_t*
+current_span_ptr() noexcept;
+#else
+inline
+uint32_t*
+current_span_ptr() noexcept {
+    static thread_local uint32_t span;
+    return &span;
+}
+#endif
+
+// The task-local values of the code running, see task_local.hh: the
+// slots of a context are never modified once tasks share it, setting a
+// value makes a new one.
+struct task_locals {
+    static constexpr unsigned max_slots = 8;
+    uint32_t refs = 1;
+    // Bit i is set if slot i holds a value
+    uint32_t present = 0;
+    uint64_t slots[max_slots];
+};
+
+inline
+void release_task_locals(task_locals* p) noexcept {
+    if (p && --p->refs == 0) {
+        delete p;
+    }
+}
+
+// A counted reference to a task_locals; they never leave the shard they
+// were made on, so the count is not atomic.
+class task_locals_ref {
+    task_locals* _p;
+public:
+    explicit task_locals_ref(task_locals* p) noexcept : _p(p) {
+        if (_p) {
+            ++_p->refs;
+        }
+    }
+    task_locals_ref(const task_locals_ref& x) noexcept : task_locals_ref(x._p) {}
+    task_locals_ref& operator=(const task_locals_ref&) = delete;
+    ~task_locals_ref() {
+        release_task_locals(_p);
+    }
+    void reset(task_locals* p) noexcept {
+        if (p) {
+            ++p->refs;
+        }
+        release_task_locals(std::exchange(_p, p));
+    }
+    task_locals* get() const noexcept { return _p; }
+};
+
+struct current_task_locals {
+    // The values of the code running, null if none. Owned by the task
+    // running, by the innermost with_task_local(), or by pinned.
+    task_locals* locals = nullptr;
+    // A reference to values restored by a with_task_local() which the task
+    // running may not own (a seastar::thread resumed by another task than
+    // the one which started the with_task_local()), until the task ends
+    task_locals* pinned = nullptr;
+};
+
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+current_task_locals*
+current_task_locals_ptr() noexcept;
+#else
+inline
+current_task_locals*
+current_task_locals_ptr() noexcept {
+    static thread_local current_task_locals locals;
+    return &locals;
+}
+#endif
+
+// Makes no task-local values current while it lives, for work which is
+// to start with none. The values current before are owned by the task
+// running, which outlives the scope.
+class no_task_locals_scope {
+    task_locals* _previous;
+public:
+    no_task_locals_scope() noexcept : _previous(std::exchange(current_task_locals_ptr()->locals, nullptr)) {}
+    no_task_locals_scope(const no_task_locals_scope&) = delete;
+    ~no_task_locals_scope() {
+        current_task_locals_ptr()->locals = _previous;
+    }
+};
+
+// Called by the reactor when a task is done running
+inline
+void reset_task_locals() noexcept {
+    auto& current = *current_task_locals_ptr();
+    current.locals = nullptr;
+    if (current.pinned) [[unlikely]] {
+        release_task_locals(std::exchange(current.pinned, nullptr));
+    }
+}
+
+}
+/// \endcond
+
 SEASTAR_MODULE_EXPORT
 class task {
 protected:
     scheduling_group _sg;
 private:
+    // Fits in the padding after the scheduling group
+    uint32_t _span;
+    internal::task_locals_ref _locals;
 #ifdef SEASTAR_TASK_BACKTRACE
     shared_backtrace _bt;
 #endif
@@ -45,15 +155,37 @@ class task {
     // information via inheritance.
     ~task() = default;
 
+    // For tasks which may run on another shard than the one creating them,
+    // and must not carry its span and task-local values there
+    struct shard_agnostic_tag {};
+    task(scheduling_group sg, shard_agnostic_tag) noexcept : _sg(sg), _span(0), _locals(nullptr) {}
+
+    // Makes the task carry the task-local values current now, for tasks
+    // which reschedule themselves while running
+    void capture_locals() noexcept {
+        _locals.reset(internal::current_task_locals_ptr()->locals);
+    }
+
     scheduling_group set_scheduling_group(scheduling_group new_sg) noexcept{
         return std::exchange(_sg, new_sg);
     }
 public:
-    explicit task(scheduling_group sg = current_scheduling_group()) noexcept : _sg(sg) {}
+    explicit task(scheduling_group sg = current_scheduling_group()) noexcept : _sg(sg), _span(*internal::current_span_ptr())
+            , _locals(internal::current_task_locals_ptr()->locals) {}
     virtual void run_and_dispose() noexcept = 0;
     /// Returns the next task which is waiting for this task to complete execution, or nullptr.
     virtual task* waiting_task() noexcept = 0;
+    /// The name the task is accounted under when sampled by type, see
+    /// \ref reactor::top_task_types(), rather than that of its type; null
+    /// if none.
+    virtual const char* tag() const noexcept { return nullptr; }
     scheduling_group group() const { return _sg; }
+    /// The span which was current when the task was created, to be made
+    /// current again when it runs
+    uint32_t span_handle() const noexcept { return _span; }
+    /// The task-local values which were current when the task was
+    /// created, to be made current again when it runs
+    internal::task_locals* locals_handle() const noexcept { return _locals.get(); }
     shared_backtrace get_backtrace() const;
 #ifdef SEASTAR_TASK_BACKTRACE
     void make_backtrace() noexcept;
@@ -0,0 +1,157 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/task.hh>
+#include <seastar/util/modules.hh>
+
+/// \file
+/// Values following a logical request through its continuations.
+///
+/// Context such as a request's deadline or tenant has to reach code
+/// running many continuations later. Capturing it in every lambda bloats
+/// the captures, and \ref scheduling_group_key "scheduling group keys"
+/// are shared by all the requests of the group. A \ref task_local_key
+/// names a slot that every task carries: the value set with
+/// \ref with_task_local() is seen by the function and by all the
+/// continuations, coroutines and background fibers it starts,
+/// transitively:
+///
+/// \code
+/// static task_local_key<lowres_clock::time_point> deadline;
+///
+/// future<> handle(request r) {
+///     return with_task_local(deadline, lowres_clock::now() + r.timeout, [r] {
+///         return process(r);
+///     });
+/// }
+///
+/// // Called somewhere down the continuation chain of process()
+/// bool expired() {
+///     auto d = deadline.get();
+///     return d && *d < lowres_clock::now();
+/// }
+/// \endcode
+///
+/// Tasks share the values rather than copy them, so starting a task costs
+/// a reference count update, and reading a value costs two loads. Setting
+/// one allocates, once per with_task_local(). The values don't cross
+/// shards: work sent with \ref smp::submit_to() starts with none.
+
+namespace seastar {
+
+namespace internal {
+
+// Allocates a slot of internal::task_locals, for the lifetime of the
+// process.
+unsigned allocate_task_local_slot();
+
+// Makes a copy of the current values, with bits in slot, current while it
+// lives.
+class task_locals_scope {
+    task_locals* _previous;
+    task_locals* _mine;
+public:
+    task_locals_scope(unsigned slot, uint64_t bits);
+    task_locals_scope(const task_locals_scope&) = delete;
+    ~task_locals_scope();
+};
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup future-util
+/// @{
+
+/// \brief Names a task-local value of type \c T.
+///
+/// Keys are meant to be defined once, as globals or static members; each
+/// takes one of the few slots every task carries (8 in all) for the
+/// lifetime of the process, and making more throws std::length_error.
+/// \c T is copied around bitwise, so it must be trivially copyable and fit
+/// in 8 bytes: an integer, a time point, or a pointer to something whose
+/// lifetime is otherwise taken care of.
+template <typename T>
+requires std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T> && (sizeof(T) <= sizeof(uint64_t))
+class task_local_key {
+    unsigned _slot;
+public:
+    task_local_key() : _slot(internal::allocate_task_local_slot()) {}
+    task_local_key(const task_local_key&) = delete;
+
+    /// The value set by the innermost \ref with_task_local() the running
+    /// code was started under, if any.
+    std::optional<T> get() const noexcept {
+        auto locals = internal::current_task_locals_ptr()->locals;
+        if (!locals || !(locals->present & (uint32_t(1) << _slot))) {
+            return std::nullopt;
+        }
+        T value;
+        std::memcpy(&value, &locals->slots[_slot], sizeof(T));
+        return value;
+    }
+
+    /// \cond internal
+    unsigned slot() const noexcept { return _slot; }
+    /// \endcond
+};
+
+/// \brief Runs a function with a task-local value set.
+///
+/// \c func, and everything it starts, sees \c value for \c key (until
+/// some of it sets another one); the code running before and after the
+/// call keeps seeing the value it had.
+///
+/// \param key the value to set
+/// \param value its value
+/// \param func function to run
+/// \return what \c func returns, as a future
+template <typename T, typename Func>
+inline
+futurize_t<std::invoke_result_t<Func>>
+with_task_local(const task_local_key<T>& key, T value, Func&& func) noexcept {
+    using futurator = futurize<std::invoke_result_t<Func>>;
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    std::optional<internal::task_locals_scope> scope;
+    try {
+        scope.emplace(key.slot(), bits);
+    } catch (...) {
+        return futurator::make_exception_future(std::current_exception());
+    }
+    return futurator::invoke(std::forward<Func>(func));
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// \brief The task types that use the most CPU in each scheduling group.
+///
+/// With \c --task-latency-by-type, the tasks sampled every
+/// \c --task-latency-sample-interval are accounted by type, or by tag, see
+/// \ref make_task(scheduling_group, const char*, Func&&), per scheduling
+/// group, see \ref reactor::top_task_types(). The task profile puts
+/// together the types of all the shards that the sampled tasks ran the
+/// longest for, in the folded stacks format: a line for each type in each
+/// group, of the frames of the group and the type, followed by the time
+/// the sampled tasks ran for, in microseconds. Multiplied by the sample
+/// interval, it estimates the CPU time of all the tasks of the type.
+///
+/// \code
+/// sg:main;task:seastar::continuation<...> 123456
+/// \endcode
+namespace task_profile {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The \c n task types of each scheduling group the sampled tasks of all the
+/// shards ran the longest for, longest first, of those of each shard
+future<sstring> collect(size_t n = 10);
+
+/// Adds a GET endpoint serving the profile, of the number of types per group
+/// of the \c n query parameter, 10 if none
+future<> add_routes(httpd::http_server& server, sstring path = "/task_profile");
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
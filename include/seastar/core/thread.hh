@@ -94,7 +94,8 @@ class thread_context final : private task {
     struct stack_deleter {
         void operator()(char *ptr) const noexcept;
         int valgrind_id;
-        stack_deleter(int valgrind_id);
+        size_t size;
+        stack_deleter(int valgrind_id, size_t size);
     };
     using stack_holder = std::unique_ptr<char[], stack_deleter>;
 
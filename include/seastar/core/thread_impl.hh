@@ -76,6 +76,12 @@ void yield();
 void switch_in(thread_context* to);
 void switch_out(thread_context* from);
 void init();
+// Sets how many stacks of each size exited threads leave to the next
+// ones on the current shard, and whether their pages are handed back to
+// the kernel while pooled (see reactor_options::thread_stack_pool_size)
+void configure_stack_pool(unsigned stacks_per_size, bool madvise_free) noexcept;
+// Frees the stacks pooled on the current shard
+void drain_stack_pool() noexcept;
 
 }
 }
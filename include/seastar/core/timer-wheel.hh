@@ -0,0 +1,390 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/bitset-iter.hh>
+#include <seastar/core/scheduling.hh>
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#endif
+
+namespace seastar {
+
+namespace internal {
+void log_timer_callback_exception(std::exception_ptr) noexcept;
+}
+
+/**
+ * A hashed hierarchical timing wheel, holding and expiring timers with the
+ * same interface and contract as timer_set.
+ *
+ * timer_set keeps the timers in buckets of the log2 of their distance from
+ * the last expiry, so every expiry re-sorts the timers of the bucket it
+ * falls into. With many far-away timers (connection idle timers, timeouts)
+ * a single bucket can hold a large share of them, and expiring it costs
+ * a walk over all of them. The wheel instead hashes timers by their expiry
+ * tick (2^TickShift units of the clock's duration) into levels of 64 slots,
+ * each level 64 times coarser than the previous one. Inserting and removing
+ * a timer are O(1), and every timer is moved to a finer level at most once
+ * per level before it expires, whatever the number of timers.
+ *
+ * Timers are still expired at the exact time they were armed for, not at
+ * the granularity of ticks.
+ */
+template<typename Timer, boost::intrusive::list_member_hook<> Timer::*link, unsigned TickShift = 20>
+class timer_wheel {
+public:
+    using time_point = typename Timer::time_point;
+    using timer_list_t = boost::intrusive::list<Timer, boost::intrusive::member_hook<Timer, boost::intrusive::list_member_hook<>, link>>;
+private:
+    using duration = typename Timer::duration;
+    using timestamp_t = typename Timer::duration::rep;
+    using tick_t = uint64_t;
+
+    static constexpr timestamp_t max_timestamp = std::numeric_limits<timestamp_t>::max();
+    static constexpr unsigned slot_bits = 6;
+    static constexpr unsigned n_slots = 1 << slot_bits;
+    static constexpr unsigned n_levels = 6;
+
+    // Level k holds the timers whose tick differs from the current one
+    // in its k-th group of slot_bits bits last, in the slot of their tick's
+    // k-th group. The groups above k are the current tick's, the k-th one
+    // is past the current tick's.
+    struct level {
+        std::array<timer_list_t, n_slots> slots;
+        std::bitset<n_slots> non_empty;
+    };
+
+    // Timers of the current tick, or of earlier ones
+    timer_list_t _current;
+    std::array<level, n_levels> _levels;
+    // Timers too far away for the top level
+    timer_list_t _overflow;
+    tick_t _tick = 0;
+    timestamp_t _last = 0;
+    timestamp_t _next = max_timestamp;
+    size_t _size = 0;
+private:
+    static timestamp_t get_timestamp(time_point _time_point) noexcept
+    {
+        return _time_point.time_since_epoch().count();
+    }
+
+    static timestamp_t get_timestamp(Timer& timer) noexcept
+    {
+        return get_timestamp(timer.get_timeout());
+    }
+
+    static tick_t to_tick(timestamp_t timestamp) noexcept
+    {
+        return tick_t(std::max<timestamp_t>(timestamp, 0)) >> TickShift;
+    }
+
+    static timestamp_t from_tick(tick_t tick) noexcept
+    {
+        if (tick > (tick_t(max_timestamp) >> TickShift)) {
+            return max_timestamp;
+        }
+        return timestamp_t(tick << TickShift);
+    }
+
+    static unsigned slot_of(tick_t tick, unsigned level) noexcept
+    {
+        return (tick >> (level * slot_bits)) & (n_slots - 1);
+    }
+
+    static tick_t prefix_of(tick_t tick, unsigned level) noexcept
+    {
+        return tick >> ((level + 1) * slot_bits);
+    }
+
+    // Where a timer of the given tick is kept; level == n_levels for
+    // _current and _overflow
+    struct location {
+        timer_list_t& list;
+        unsigned level;
+        unsigned slot;
+    };
+
+    location locate(tick_t tick) noexcept
+    {
+        if (tick <= _tick) {
+            return {_current, n_levels, 0};
+        }
+        unsigned level = (std::numeric_limits<tick_t>::digits - 1 - bitsets::count_leading_zeros(tick ^ _tick)) / slot_bits;
+        if (level >= n_levels) {
+            return {_overflow, n_levels, 0};
+        }
+        auto slot = slot_of(tick, level);
+        return {_levels[level].slots[slot], level, slot};
+    }
+
+    void place(Timer& timer) noexcept
+    {
+        auto loc = locate(to_tick(get_timestamp(timer)));
+        loc.list.push_back(timer);
+        if (loc.level < n_levels) {
+            _levels[loc.level].non_empty[loc.slot] = true;
+        }
+    }
+
+    static timestamp_t earliest(const timer_list_t& list) noexcept
+    {
+        auto res = max_timestamp;
+        for (auto& timer : list) {
+            res = std::min(res, get_timestamp(timer.get_timeout()));
+        }
+        return res;
+    }
+
+    // The expiry of the earliest timer, or a lower bound of it if the
+    // earliest timers are on a level above the first one
+    timestamp_t compute_next() const noexcept
+    {
+        if (!_current.empty()) {
+            return earliest(_current);
+        }
+        for (unsigned k = 0; k < n_levels; ++k) {
+            auto& lvl = _levels[k];
+            if (lvl.non_empty.none()) {
+                continue;
+            }
+            auto slot = bitsets::get_first_set(lvl.non_empty);
+            if (k == 0) {
+                return earliest(lvl.slots[slot]);
+            }
+            auto tick = (prefix_of(_tick, k) << ((k + 1) * slot_bits)) | (tick_t(slot) << (k * slot_bits));
+            return from_tick(tick);
+        }
+        return earliest(_overflow);
+    }
+
+public:
+    timer_wheel() noexcept {}
+
+    ~timer_wheel() {
+        auto cancel_all = [] (timer_list_t& list) {
+            while (!list.empty()) {
+                auto& timer = *list.begin();
+                timer.cancel();
+            }
+        };
+        cancel_all(_current);
+        for (auto& lvl : _levels) {
+            for (auto& list : lvl.slots) {
+                cancel_all(list);
+            }
+        }
+        cancel_all(_overflow);
+    }
+
+    /**
+     * Adds timer to the active set; see timer_set::insert().
+     *
+     * Returns true if and only if this timer's timeout is less than get_next_timeout().
+     */
+    bool insert(Timer& timer) noexcept
+    {
+        auto timestamp = get_timestamp(timer);
+        place(timer);
+        ++_size;
+
+        if (timestamp < _next) {
+            _next = timestamp;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Removes timer from the active set; see timer_set::remove().
+     */
+    void remove(Timer& timer) noexcept
+    {
+        auto loc = locate(to_tick(get_timestamp(timer)));
+        loc.list.erase(loc.list.iterator_to(timer));
+        if (loc.level < n_levels && loc.list.empty()) {
+            _levels[loc.level].non_empty[loc.slot] = false;
+        }
+        --_size;
+    }
+
+    /**
+     * Removes timer from the active set or the expired list, if the timer is expired
+     */
+    void remove(Timer& timer, timer_list_t& expired) noexcept
+    {
+        if (timer._expired) {
+            expired.erase(expired.iterator_to(timer));
+            timer._expired = false;
+        } else {
+            remove(timer);
+        }
+    }
+
+    /**
+     * Expires active timers; see timer_set::expire().
+     *
+     * The time points passed to this function must be monotonically increasing.
+     */
+    timer_list_t expire(time_point now) noexcept
+    {
+        timer_list_t exp;
+        auto timestamp = get_timestamp(now);
+
+        if (timestamp < _last) {
+            abort();
+        }
+        _last = timestamp;
+
+        auto tick = to_tick(timestamp);
+        if (tick != _tick) {
+            // Collect the timers of the slots the clock went past, or into,
+            // and place them again relative to the new tick: those up to it
+            // end up in _current, the others on a finer level.
+            timer_list_t moved;
+            moved.splice(moved.end(), _current);
+            auto old_tick = std::exchange(_tick, tick);
+            bool top_level_wrapped = true;
+            for (unsigned k = 0; k < n_levels; ++k) {
+                auto& lvl = _levels[k];
+                bool same_prefix = prefix_of(old_tick, k) == prefix_of(tick, k);
+                // With a higher group changed, the whole level is behind
+                auto last_slot = same_prefix ? slot_of(tick, k) : n_slots - 1;
+                for (int i : bitsets::for_each_set(lvl.non_empty, slot_of(old_tick, k) + 1)) {
+                    if (unsigned(i) > last_slot) {
+                        break;
+                    }
+                    moved.splice(moved.end(), lvl.slots[i]);
+                    lvl.non_empty[i] = false;
+                }
+                if (same_prefix) {
+                    top_level_wrapped = false;
+                    break;
+                }
+            }
+            if (top_level_wrapped) {
+                moved.splice(moved.end(), _overflow);
+            }
+            while (!moved.empty()) {
+                auto& timer = *moved.begin();
+                moved.pop_front();
+                place(timer);
+            }
+        }
+
+        for (auto it = _current.begin(); it != _current.end();) {
+            auto& timer = *it;
+            if (timer.get_timeout() <= now) {
+                it = _current.erase(it);
+                exp.push_back(timer);
+                --_size;
+            } else {
+                ++it;
+            }
+        }
+
+        _next = compute_next();
+        return exp;
+    }
+
+    template <typename EnableFunc>
+    void complete(timer_list_t& expired_timers, EnableFunc&& enable_fn) noexcept(noexcept(enable_fn())) {
+        expired_timers = expire(this->now());
+        for (auto& t : expired_timers) {
+            t._expired = true;
+        }
+        const auto prev_sg = current_scheduling_group();
+        while (!expired_timers.empty()) {
+            auto t = &*expired_timers.begin();
+            expired_timers.pop_front();
+            t->_queued = false;
+            if (t->_armed) {
+                t->_armed = false;
+                if (t->_period) {
+                    t->readd_periodic();
+                }
+                try {
+                    *internal::current_scheduling_group_ptr() = t->_sg;
+                    t->_callback();
+                } catch (...) {
+                    internal::log_timer_callback_exception(std::current_exception());
+                }
+            }
+        }
+        // complete_timers() can be called from the context of run_tasks()
+        // as well so we need to restore the previous scheduling group (set by run_tasks()).
+        *internal::current_scheduling_group_ptr() = prev_sg;
+        enable_fn();
+    }
+
+    /**
+     * Returns a time point at which expire() should be called
+     * in order to ensure timers are expired in a timely manner.
+     *
+     * Returned values are monotonically increasing.
+     */
+    time_point get_next_timeout() const noexcept
+    {
+        return time_point(duration(std::max(_last, _next)));
+    }
+
+    /**
+     * Clears the active set.
+     */
+    void clear() noexcept
+    {
+        _current.clear();
+        for (auto& lvl : _levels) {
+            for (int i : bitsets::for_each_set(lvl.non_empty)) {
+                lvl.slots[i].clear();
+            }
+            lvl.non_empty.reset();
+        }
+        _overflow.clear();
+        _size = 0;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    /**
+     * Returns true if and only if there are no timers in the active set.
+     */
+    bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    time_point now() noexcept {
+        return Timer::clock::now();
+    }
+};
+}
@@ -24,12 +24,14 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/scheduling.hh>
 #include <seastar/core/timer-set.hh>
+#include <seastar/core/timer-wheel.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <boost/intrusive/list.hpp>
 #include <chrono>
 #include <optional>
+#include <type_traits>
 #endif
 
 /// \file
@@ -51,6 +53,24 @@
 
 namespace seastar {
 
+class lowres_clock;
+
+namespace internal {
+
+// Whether the timers of a clock are kept in a timer_wheel rather than in a
+// timer_set, which scales better to millions of timers per shard. Enabled
+// for lowres_clock, which most idle timers and timeouts use, with the
+// Seastar_LOWRES_TIMER_WHEEL build option.
+template <typename Clock>
+struct use_timer_wheel : std::false_type {};
+
+#ifdef SEASTAR_LOWRES_TIMER_WHEEL
+template <>
+struct use_timer_wheel<lowres_clock> : std::true_type {};
+#endif
+
+}
+
 SEASTAR_MODULE_EXPORT_BEGIN
 
 using steady_clock_type = std::chrono::steady_clock;
@@ -85,8 +105,10 @@ class timer {
     typedef typename Clock::time_point time_point;
     typedef typename Clock::duration duration;
     typedef Clock clock;
+    /// The callbacks of timers often capture more than the default inline
+    /// storage of \ref noncopyable_function holds
+    using callback_t = noncopyable_function<void(), 64>;
 private:
-    using callback_t = noncopyable_function<void()>;
     boost::intrusive::list_member_hook<> _link;
     scheduling_group _sg;
     callback_t _callback;
@@ -122,12 +144,12 @@ class timer {
     ///
     /// \param sg Scheduling group to run the callback under.
     /// \param callback function (with signature `void ()`) to execute after the timer is armed and expired.
-    timer(scheduling_group sg, noncopyable_function<void ()>&& callback) noexcept : _sg(sg), _callback{std::move(callback)} {
+    timer(scheduling_group sg, callback_t&& callback) noexcept : _sg(sg), _callback{std::move(callback)} {
     }
     /// Constructs a timer with a callback. The timer is not armed.
     ///
     /// \param callback function (with signature `void ()`) to execute after the timer is armed and expired.
-    explicit timer(noncopyable_function<void ()>&& callback) noexcept : timer(current_scheduling_group(), std::move(callback)) {
+    explicit timer(callback_t&& callback) noexcept : timer(current_scheduling_group(), std::move(callback)) {
     }
     /// Destroys the timer. The timer is cancelled if armed.
     ~timer();
@@ -135,14 +157,14 @@ class timer {
     ///
     /// \param sg the scheduling group under which the callback will be executed.
     /// \param callback the callback to be executed when the timer expires.
-    void set_callback(scheduling_group sg, noncopyable_function<void ()>&& callback) noexcept {
+    void set_callback(scheduling_group sg, callback_t&& callback) noexcept {
         _sg = sg;
         _callback = std::move(callback);
     }
     /// Sets the callback function to be called when the timer expires.
     ///
     /// \param callback the callback to be executed when the timer expires.
-    void set_callback(noncopyable_function<void ()>&& callback) noexcept {
+    void set_callback(callback_t&& callback) noexcept {
         set_callback(current_scheduling_group(), std::move(callback));
     }
     /// Sets the timer expiration time.
@@ -219,7 +241,9 @@ class timer {
     }
 
     friend class timer_set<timer, &timer::_link>;
-    using set_t = timer_set<timer, &timer::_link>;
+    friend class timer_wheel<timer, &timer::_link>;
+    using set_t = std::conditional_t<internal::use_timer_wheel<Clock>::value,
+            timer_wheel<timer, &timer::_link>, timer_set<timer, &timer::_link>>;
 };
 
 extern template class timer<steady_clock_type>;
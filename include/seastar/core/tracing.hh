@@ -0,0 +1,237 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/task.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+/// \brief Spans of the requests, propagated along their continuations,
+/// RPC calls and HTTP requests.
+///
+/// A span is a stage of a request, of a start and a duration, part of a
+/// trace, the tree of the spans of a request, possibly over several nodes:
+/// its parent is the span which was current when it started. The current
+/// span is captured by each task when it is created, and made current again
+/// when it runs, so that it follows a request along its continuations and
+/// coroutines, as the scheduling group does. It is not carried over to
+/// another shard: a span is started there with the \ref span_context of its
+/// parent instead.
+///
+/// Only a fraction of the traces are recorded, the sampling decision being
+/// taken when their first span starts, on the shard it starts on
+/// (\ref set_sample_rate()), or by the peer which sent the request: the
+/// spans of the other ones cost a few branches. The spans recorded are kept
+/// in a buffer of each shard, as they end, for the application to take
+/// (\ref take_spans()) and export.
+///
+/// RPC clients configured to (\ref rpc::client_options::propagate_tracing)
+/// start a span for each call, the context of which is sent with the call
+/// to the servers, which run the handler in a span of their own. The HTTP
+/// server runs the handlers in a span, of the parent of the W3C
+/// \c traceparent header of the request if any, which the HTTP client sets
+/// from the current span.
+///
+/// \code
+/// tracing::set_sample_rate(0.001);
+/// ...
+/// return tracing::with_span(tracing::span("query"), [this] {
+///     return parse().then([this] {
+///         return rpc_call(_client); // in a span of the query and on the peer
+///     });
+/// });
+/// \endcode
+namespace tracing {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The identifier of a trace, the same for all its spans
+struct trace_id {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    explicit operator bool() const noexcept {
+        return high || low;
+    }
+    bool operator==(const trace_id&) const noexcept = default;
+};
+
+/// What a span passes to its children started elsewhere, on another shard
+/// or another node
+struct span_context {
+    trace_id trace;
+    /// The span the children are of, zero if none
+    uint64_t span_id = 0;
+    /// Whether the trace is recorded
+    bool sampled = false;
+
+    /// The size of the context serialized by \ref serialize()
+    static constexpr size_t serialized_size = 2 * sizeof(uint64_t) + sizeof(uint64_t) + 1;
+
+    bool valid() const noexcept {
+        return bool(trace) && span_id;
+    }
+    bool operator==(const span_context&) const noexcept = default;
+
+    /// Writes the context on \ref serialized_size bytes, little endian
+    void serialize(char* p) const noexcept;
+    /// Reads a context written by \ref serialize()
+    static span_context deserialize(const char* p) noexcept;
+
+    /// The W3C trace context \c traceparent header value of the context
+    sstring to_traceparent() const;
+    /// Parses a W3C trace context \c traceparent header value
+    ///
+    /// \returns the context, or std::nullopt if the value is not a valid one
+    static std::optional<span_context> from_traceparent(std::string_view value) noexcept;
+};
+
+/// A span which ended, on a sampled trace
+struct span_record {
+    trace_id trace;
+    uint64_t span_id;
+    /// The span it is a child of, zero for the root of the trace
+    uint64_t parent_id;
+    sstring name;
+    std::chrono::system_clock::time_point start;
+    std::chrono::nanoseconds duration;
+    unsigned shard;
+};
+
+/// \brief A span, from its construction to its end or destruction.
+///
+/// A span is not current by the mere fact of being constructed; it is made
+/// current by \ref span_scope or \ref with_span(). A span of a trace which
+/// is not sampled records nothing and has no effect but to keep its
+/// children from starting traces of their own.
+///
+/// A span is to be ended on the shard it was started on.
+class span {
+    uint32_t _handle = 0;
+
+    void start(std::string_view name, const span_context& parent) noexcept;
+public:
+    /// A span of nothing
+    span() noexcept = default;
+    /// A child of the current span, or the root of a new trace, sampled
+    /// at the rate of the shard, if there is none
+    explicit span(std::string_view name) noexcept;
+    /// A child of \c parent, started elsewhere, or the root of a new trace,
+    /// sampled at the rate of the shard, if it is not valid
+    span(std::string_view name, const span_context& parent) noexcept;
+    span(span&& x) noexcept : _handle(std::exchange(x._handle, 0)) {}
+    span& operator=(span&& x) noexcept {
+        if (this != &x) {
+            end();
+            _handle = std::exchange(x._handle, 0);
+        }
+        return *this;
+    }
+    ~span() {
+        end();
+    }
+
+    /// Whether the span is recorded when it ends
+    bool sampled() const noexcept;
+    /// The context of the span for its children started elsewhere; not
+    /// valid if the span is not sampled
+    span_context context() const noexcept;
+    /// Renames the span, such as with details only worth formatting for a
+    /// span which is sampled
+    void set_name(std::string_view name);
+    /// Ends the span, recording it if it is sampled; a span is ended once
+    void end() noexcept;
+
+    friend class span_scope;
+};
+
+/// Makes a span current while it is alive, the tasks created meanwhile
+/// being of it
+class span_scope {
+    uint32_t _previous;
+public:
+    /// \c s must outlive the scope
+    explicit span_scope(const span& s) noexcept
+            : _previous(std::exchange(*internal::current_span_ptr(), s._handle)) {}
+    span_scope(const span_scope&) = delete;
+    ~span_scope() {
+        *internal::current_span_ptr() = _previous;
+    }
+};
+
+/// The context of the current span; not valid if there is none or it is
+/// not sampled
+span_context current_context() noexcept;
+
+/// Runs \c func in \c s, ending it once the future \c func returns resolves
+template <typename Func>
+futurize_t<std::invoke_result_t<Func>> with_span(span s, Func&& func) noexcept {
+    if (!s.sampled()) {
+        span_scope scope(s);
+        return futurize_invoke(std::forward<Func>(func));
+    }
+    auto f = [&] {
+        span_scope scope(s);
+        return futurize_invoke(std::forward<Func>(func));
+    }();
+    return f.finally([s = std::move(s)] {});
+}
+
+/// Samples the new traces started on the shard at that rate, between 0,
+/// the default, and 1
+void set_sample_rate(double rate) noexcept;
+double sample_rate() noexcept;
+
+/// Keeps up to that many spans which ended on the shard until they are
+/// taken, dropping those which end beyond; 4096 by default
+void set_buffer_capacity(size_t capacity);
+
+/// Takes the spans which ended on the shard since they were last taken
+std::vector<span_record> take_spans() noexcept;
+
+/// The counters of the spans of a shard
+struct stats {
+    /// The spans started of sampled traces
+    uint64_t started = 0;
+    /// The spans kept in the buffer as they ended
+    uint64_t recorded = 0;
+    /// The spans dropped as the buffer was full, or too many were alive
+    uint64_t dropped = 0;
+};
+const stats& get_stats() noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#endif
+#include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/shard_id.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/modules.hh>
+
+/// \file
+/// Handing in-memory state over to the next incarnation of the process.
+///
+/// Before exiting for a restart, shards save state the new process can
+/// start from (warm caches, typically) into memfd-backed regions:
+///
+/// \code
+/// co_await cache.invoke_on_all([] (cache& c) {
+///     return warm_restart::save("cache", c.serialize());
+/// });
+/// \endcode
+///
+/// After \ref app_template::run() returns, the process execs its
+/// successor with \ref warm_restart::environment() added to the
+/// environment, and the regions are inherited by it. On startup, each
+/// shard of the new process maps the region back, without copying:
+///
+/// \code
+/// if (auto state = co_await warm_restart::restore("cache")) {
+///     c.load(state->data(), state->size());
+/// }
+/// warm_restart::discard();
+/// \endcode
+///
+/// Regions are saved per shard. A process started with a different number
+/// of shards may restore the regions of other shards by passing the shard
+/// explicitly.
+
+namespace seastar::experimental::warm_restart {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The environment variable that lists the regions handed over. It is
+/// removed from the environment once read, on the first \ref restore() or
+/// \ref discard(), not to be inherited by the processes spawned then; the
+/// fds it lists that are not sealed memfds are left alone.
+inline constexpr const char* environment_variable = "SEASTAR_WARM_STATE";
+
+/// Saves \c data under \c name for the current shard, replacing what it
+/// saved under that name before.
+///
+/// The data is copied into a sealed memfd in the syscall thread; the
+/// buffers are released when the returned future resolves. \c name may not
+/// contain ',' or ':'.
+future<> save(std::string_view name, std::vector<temporary_buffer<char>> data);
+
+/// Returns the \c NAME=VALUE entry to add to the environment of the next
+/// incarnation of the process, and makes the saved regions inheritable by
+/// it. To be called right before exec(), once the shards are done saving.
+std::string environment();
+
+/// Maps the region \c shard saved under \c name, if the process was handed
+/// one, read-only. A region can only be restored once; the mapping stays
+/// valid after \ref discard().
+future<std::optional<file_mapping>> restore(std::string_view name, unsigned shard = this_shard_id()) noexcept;
+
+/// Closes the regions handed over that were not restored.
+void discard() noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+namespace internal {
+
+// Takes over the regions listed in \c spec, as if it were the value of
+// the environment variable, for tests.
+void take_over(std::string_view spec);
+
+}
+
+}
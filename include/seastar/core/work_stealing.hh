@@ -0,0 +1,128 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/shard_id.hh>
+#include <seastar/core/task.hh>
+#include <seastar/util/modules.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// A unit of shard-agnostic work, submitted by its owner shard and run either
+// there or on a shard that stole it. Scheduled as a task (in its scheduling
+// group) on whichever shard runs it; the result is always delivered on the
+// owner shard.
+class stealable_work_item : public task {
+    shard_id _owner;
+public:
+    explicit stealable_work_item(scheduling_group sg) noexcept : task(sg, shard_agnostic_tag{}), _owner(this_shard_id()) {}
+    shard_id owner() const noexcept { return _owner; }
+    // Runs the work; called on any shard.
+    virtual void run() noexcept = 0;
+    // Delivers the result and destroys the item; called on the owner shard.
+    virtual void complete() noexcept = 0;
+    virtual void run_and_dispose() noexcept override;
+    virtual task* waiting_task() noexcept override { return nullptr; }
+};
+
+template <typename Func>
+class stealable_work_item_impl final : public stealable_work_item {
+    using futurator = futurize<std::invoke_result_t<Func>>;
+    Func _func;
+    typename futurator::promise_type _pr;
+    std::optional<typename futurator::type> _result;
+public:
+    stealable_work_item_impl(scheduling_group sg, Func&& func) : stealable_work_item(sg), _func(std::move(func)) {}
+    typename futurator::type get_future() noexcept { return _pr.get_future(); }
+    virtual void run() noexcept override {
+        _result.emplace(futurator::invoke(_func));
+    }
+    virtual void complete() noexcept override {
+        std::move(*_result).forward_to(std::move(_pr));
+        delete this;
+    }
+};
+
+// Queues the item on the current shard, where it can be stolen.
+void submit_stealable_work(std::unique_ptr<stealable_work_item> item) noexcept;
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// \brief Runs shard-agnostic work on the current shard, or on an idle shard.
+///
+/// Seastar's shards share nothing, so a hot shard can saturate while its
+/// neighbours idle. Work that depends on nothing but its own inputs (pure
+/// CPU work such as compression or checksumming) can be submitted with
+/// submit_stealable() instead of being run in place: it is queued on the
+/// current shard as a task in \c sg, and, with
+/// \ref reactor_options::work_stealing enabled, shards that are idle steal
+/// it when the current shard falls behind, run it (in \c sg too), and send
+/// the result back.
+///
+/// \c func is invoked on an unspecified shard, and destroyed on the current
+/// one. It must therefore not touch shard-local state (including
+/// \ref engine() and anything allocated on the current shard that it does
+/// not own, such as \ref shared_ptr "shared pointers") and must return a
+/// value rather than a future; allocating memory, and returning it, is fine.
+///
+/// \param sg scheduling group to run \c func in, on whichever shard runs it
+/// \param func callable to run
+/// \return a future resolving to what \c func returns (or throws), on the
+///         current shard
+template <typename Func>
+requires std::is_invocable_v<Func> && (!is_future<std::invoke_result_t<Func>>::value)
+futurize_t<std::invoke_result_t<Func>>
+submit_stealable(scheduling_group sg, Func func) {
+    auto item = std::make_unique<internal::stealable_work_item_impl<Func>>(sg, std::move(func));
+    auto f = item->get_future();
+    internal::submit_stealable_work(std::move(item));
+    return f;
+}
+
+/// Runs shard-agnostic work in the current scheduling group, on the current
+/// shard or on an idle shard; see \ref submit_stealable(scheduling_group, Func).
+template <typename Func>
+requires std::is_invocable_v<Func> && (!is_future<std::invoke_result_t<Func>>::value)
+futurize_t<std::invoke_result_t<Func>>
+submit_stealable(Func func) {
+    return submit_stealable(current_scheduling_group(), std::move(func));
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
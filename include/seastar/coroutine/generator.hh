@@ -41,7 +41,9 @@ class generator;
 /// produced values. Instead, it puts the produced values into an internal
 /// buffer, before the buffer is full or the generator is suspended. This helps
 /// to alleviate the problem of pingpong between the generator coroutine and
-/// its caller.
+/// its caller: once the buffer is full, the generator coroutine is only
+/// resumed after its caller has consumed all the buffered values, so a
+/// buffer of N values costs one suspend/resume round trip per N values.
 enum class buffer_size_t : size_t;
 
 namespace internal {
@@ -155,6 +157,7 @@ class generator_buffered_promise final : public seastar::task {
     std::optional<seastar::promise<>> _wait_for_free_space;
     generator_type* _generator = nullptr;
     const size_t _buffer_capacity;
+    bool _started = false;
 
 public:
     template<typename... Args>
@@ -178,11 +181,12 @@ class generator_buffered_promise final : public seastar::task {
         if (_wait_for_next_value) {
             _wait_for_next_value->set_value();
             _wait_for_next_value = {};
-            return {make_ready_future()};
         }
         if (ready) {
             return {make_ready_future()};
         } else {
+            // suspend until the consumer drains the buffer, so that we are
+            // resumed once per buffer, not once per value.
             assert(!_wait_for_free_space);
             return {_wait_for_free_space.emplace().get_future()};
         }
@@ -214,10 +218,20 @@ class generator_buffered_promise final : public seastar::task {
         return _wait_for_next_value.emplace().get_future();
     }
 
-    void on_reclaim_free_space() noexcept {
-        assert(_wait_for_free_space);
-        _wait_for_free_space->set_value();
-        _wait_for_free_space = {};
+    // called by the consumer after it drains the buffer. returns the task
+    // to schedule for producing more values, if the generator coroutine is
+    // suspended waiting for the consumer, or nullptr if it is busy awaiting
+    // something else, and will fill the buffer on its own.
+    seastar::task* producer_to_resume() noexcept {
+        if (!std::exchange(_started, true)) {
+            return this;
+        }
+        if (_wait_for_free_space) {
+            _wait_for_free_space->set_value();
+            _wait_for_free_space = {};
+            return this;
+        }
+        return nullptr;
     }
 
 private:
@@ -266,7 +280,9 @@ struct next_awaiter final {
             seastar::schedule(&current_task);
         } else {
             _next_value_future.set_coroutine(current_task);
-            seastar::schedule(_task);
+            if (_task) {
+                seastar::schedule(_task);
+            }
         }
     }
 
@@ -294,7 +310,7 @@ struct next_awaiter final {
 ///
 /// ```
 /// auto generate_request = [&input_stream](coroutine::experimental::buffer_size_t)
-///     -> seastar::coroutine::generator<Request> {
+///     -> seastar::coroutine::experimental::generator<Request, seastar::circular_buffer> {
 ///     while (!input_stream.eof()) {
 ///         co_yield co_await input_stream.read_exactly(42);
 ///     }
@@ -361,7 +377,8 @@ class generator {
         } else if (_exception) [[unlikely]] {
             return {this, nullptr, make_ready_future<>()};
         } else if (_promise) {
-            return {this, _promise, _promise->wait_for_next_value()};
+            auto f = _promise->wait_for_next_value();
+            return {this, _promise->producer_to_resume(), std::move(f)};
         } else {
             return {this, nullptr, make_ready_future<>()};
         }
@@ -376,13 +393,7 @@ class generator {
     internal::next_value_t<T> take_next_value() {
         if (!_values.empty()) [[likely]] {
             auto value = std::move(_values.front());
-            bool maybe_reclaim = _values.size() == _buffer_capacity;
             _values.pop_front();
-            if (maybe_reclaim) {
-                if (_promise) [[likely]] {
-                    _promise->on_reclaim_free_space();
-                }
-            }
             return internal::next_value_t<T>(std::move(value));
         } else if (_exception) [[unlikely]] {
             std::rethrow_exception(std::exchange(_exception, nullptr));
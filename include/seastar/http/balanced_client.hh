@@ -0,0 +1,187 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+#endif
+#include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/http/client.hh>
+#include <seastar/net/dns.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+namespace http {
+
+namespace experimental {
+
+/**
+ * \brief Client of a service behind a DNS name of several addresses
+ *
+ * The client resolves the name and keeps a \ref client, with its pool of
+ * connections, per address. A request goes to the healthy address expected
+ * to reply the soonest: the one of lowest average time to the reply
+ * headers, times its requests in flight plus one. The addresses no reply
+ * came from yet are tried first. A connection error leaves an address
+ * aside for a backoff, doubling with every error in a row; when all of
+ * them are, the first out of its backoff is tried.
+ *
+ * The name is resolved again when its addresses expire, by the TTL of
+ * the DNS records or every \ref config::refresh_period when the resolver
+ * does not tell. New addresses get a client, and gone ones are closed once
+ * their requests are over. Each address may be kept with idle connections
+ * opened ahead of the requests, \ref config::min_idle_connections.
+ *
+ * \code
+ * auto cln = http::experimental::balanced_client("storage.example.com", {.port = 8080, .min_idle_connections = 2});
+ * co_await cln.make_request(http::request::make("GET", "storage.example.com", "/v1/objects"), handle);
+ * co_await cln.close();
+ * \endcode
+ */
+class balanced_client {
+public:
+    using clock_type = lowres_clock;
+
+    struct config {
+        /// The port of the service
+        uint16_t port = 80;
+        /// Connects with TLS when set
+        shared_ptr<tls::certificate_credentials> creds;
+        /// The family of the addresses to resolve the name to, any if unset
+        net::opt_family family;
+        /// See \ref client::client()
+        unsigned max_connections_per_address = 100;
+        client::retry_requests retry = client::retry_requests::no;
+        client::http2 h2 = client::http2::no;
+        /// The idle connections to keep each address with
+        unsigned min_idle_connections = 0;
+        /// Resolve the name that often when the resolver tells no TTL
+        std::chrono::seconds refresh_period = std::chrono::seconds(30);
+        /// Resolve the name no more often than that, and that long after a
+        /// failure to
+        std::chrono::seconds min_refresh_period = std::chrono::seconds(1);
+        /// The backoff of an address after its first connection error
+        std::chrono::milliseconds min_backoff = std::chrono::milliseconds(100);
+        /// The longest backoff, after errors in a row
+        std::chrono::milliseconds max_backoff = std::chrono::seconds(30);
+        /// The weight of the last reply in the average time to a reply
+        double latency_weight = 0.2;
+        /// Resolves the name, with net::dns::get_host_by_name() if unset
+        std::function<future<net::hostent>(const sstring& name, net::opt_family family)> resolve;
+        /// Makes the connections to an address, over TCP, or TLS with
+        /// \ref creds, if unset
+        std::function<std::unique_ptr<connection_factory>(socket_address addr)> make_connection_factory;
+    };
+
+    struct address_stats {
+        socket_address address;
+        bool healthy;
+        unsigned requests_in_flight;
+        /// Average time to the reply headers, if any came yet
+        std::optional<std::chrono::microseconds> latency;
+        unsigned connections;
+        unsigned idle_connections;
+        uint64_t requests;
+        uint64_t errors;
+    };
+
+private:
+    struct address;
+    using address_ptr = lw_shared_ptr<address>;
+
+    sstring _host;
+    config _cfg;
+    std::vector<address_ptr> _addresses;
+    // The requests waiting for the name to be resolved
+    std::optional<shared_promise<>> _resolved;
+    bool _resolving = false;
+    unsigned _rover = 0;
+    timer<clock_type> _refresh;
+    gate _gate;
+
+    future<> resolve();
+    future<> wait_addresses();
+    void update(const std::vector<net::inet_address>& addrs);
+    void retire(address_ptr a);
+    void preconnect(address_ptr a);
+    address_ptr pick();
+    void failed(address& a);
+
+public:
+    /**
+     * \brief Construct a client of the service at a name
+     *
+     * \param host -- the name to resolve, also the TLS server name
+     * \param cfg -- the configuration
+     */
+    balanced_client(sstring host, config cfg);
+    explicit balanced_client(sstring host) : balanced_client(std::move(host), config{}) {}
+    ~balanced_client();
+
+    /**
+     * \brief Send the request to one of the addresses and handle the response
+     *
+     * See \ref client::make_request(). The first request waits for the name
+     * to be resolved, and fails if it could not be.
+     */
+    future<> make_request(request req, client::reply_handler handle, std::optional<reply::status_type> expected = std::nullopt);
+
+    /**
+     * \brief Resolves the name again now
+     *
+     * Rather than when its addresses expire. Resolves with the error to
+     * resolve it, the addresses being kept meanwhile.
+     */
+    future<> refresh();
+
+    /**
+     * \brief Closes the client
+     *
+     * Waits for the requests in flight. Client must be closed before
+     * destruction unconditionally
+     */
+    future<> close();
+
+    /**
+     * \brief The state of the addresses the name resolved to
+     */
+    std::vector<address_stats> get_address_stats() const;
+};
+
+} // experimental namespace
+
+} // http namespace
+
+SEASTAR_MODULE_EXPORT_END
+
+} // seastar namespace
@@ -26,6 +26,7 @@
 #endif
 #include <seastar/net/api.hh>
 #include <seastar/http/reply.hh>
+#include <seastar/http/internal/http2.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/util/modules.hh>
@@ -80,6 +81,21 @@ class connection : public enable_shared_from_this<connection> {
     // too and thus the connection will be persistent by default. If the server
     // responds with older version, this flag will be dropped (see recv_reply())
     bool _persistent = true;
+    // Set when the connection speaks HTTP/2, its requests multiplexed on
+    // streams of their own
+    std::unique_ptr<internal::http2::session> _h2;
+    future<> _h2_done = make_ready_future<>();
+    sstring _h2_scheme;
+    // The requests in flight, or about to be
+    unsigned _h2_requests = 0;
+    // The requests in flight when the connection was taken to pipeline
+    // them. Each is written once the previous ones were, and its reply
+    // read once the bodies of the previous replies were.
+    unsigned _pipelined = 0;
+    future<> _written = make_ready_future<>();
+    future<> _read = make_ready_future<>();
+    // Set once a reply told whether the connection persists
+    bool _replied = false;
 
 public:
     /**
@@ -101,6 +117,8 @@ class connection : public enable_shared_from_this<connection> {
      *
      * The returned reply only contains the status and headers. To get the reply body the
      * caller should read it via the input_stream provided by the connection.in() method.
+     * On an HTTP/2 connection, requests may be made concurrently, the body of each reply
+     * being read from the stream it came on.
      *
      * \param rq -- request to be sent
      *
@@ -132,6 +150,10 @@ class connection : public enable_shared_from_this<connection> {
     future<reply_ptr> maybe_wait_for_continue(const request& req);
     future<> write_body(const request& rq);
     future<reply_ptr> recv_reply();
+    future<reply_ptr> do_make_pipelined_request(request& rq, promise<>& replied);
+
+    void start_http2(sstring scheme);
+    future<std::tuple<reply_ptr, internal::http2::session::stream_ptr>> do_make_http2_request(request& rq);
 };
 
 /**
@@ -154,6 +176,19 @@ class connection_factory {
     virtual ~connection_factory() {}
 };
 
+/**
+ * \brief The reply to a request made with \ref client::make_streaming_request()
+ */
+struct streaming_reply {
+    /// The status and headers of the reply, and its trailing headers once
+    /// the body was read
+    lw_shared_ptr<reply> rep;
+    /// The body of the reply. It holds the connection the reply came on
+    /// until read to its end or closed, and must be either before the
+    /// client is closed.
+    input_stream<char> body;
+};
+
 /**
  * \brief Class client wraps communications using HTTP protocol
  *
@@ -169,9 +204,11 @@ class client {
 public:
     using reply_handler = noncopyable_function<future<>(const reply&, input_stream<char>&& body)>;
     using retry_requests = bool_class<struct retry_requests_tag>;
+    using http2 = bool_class<struct http2_tag>;
 
 private:
     friend class http::internal::client_ref;
+    class streamed_body_source;
     using connections_list_t = bi::list<connection, bi::member_hook<connection, typename connection::hook_t, &connection::_hook>, bi::constant_time_size<false>>;
     static constexpr unsigned default_max_connections = 100;
 
@@ -180,24 +217,33 @@ class client {
     unsigned _max_connections;
     unsigned long _total_new_connections = 0;
     const retry_requests _retry;
+    const http2 _http2;
+    unsigned _http2_connecting = 0;
     condition_variable _wait_con;
     connections_list_t _pool;
+    // The HTTP/2 connections, shared by the requests in flight
+    connections_list_t _http2_pool;
+    unsigned _pipeline_depth = 1;
+    // The HTTP/1.1 connections requests are pipelined on
+    connections_list_t _pipelining;
 
     using connection_ptr = seastar::shared_ptr<connection>;
 
-    future<connection_ptr> get_connection();
-    future<connection_ptr> make_connection();
+    bool can_pipeline(const request& req) const;
+    future<connection_ptr> get_connection(bool pipelined = false);
+    future<connection_ptr> make_connection(bool pipelined = false);
     future<> put_connection(connection_ptr con);
     future<> shrink_connections();
 
     template <std::invocable<connection&> Fn>
-    auto with_connection(Fn&& fn);
+    auto with_connection(bool pipelined, Fn&& fn);
 
     template <typename Fn>
     requires std::invocable<Fn, connection&>
     auto with_new_connection(Fn&& fn);
 
     future<> do_make_request(connection& con, request& req, reply_handler& handle, std::optional<reply::status_type> expected);
+    future<streaming_reply> do_make_streaming_request(connection_ptr con, request& req, std::optional<reply::status_type> expected);
 
 public:
     /**
@@ -207,9 +253,11 @@ class client {
      * socket
      *
      * \param addr -- host address to connect to
+     * \param h2 -- whether to speak HTTP/2 to the server, which must then
+     * support it, as h2c with prior knowledge
      *
      */
-    explicit client(socket_address addr);
+    explicit client(socket_address addr, http2 h2 = http2::no);
 
     /**
      * \brief Construct a secure client
@@ -220,9 +268,11 @@ class client {
      * \param addr -- host address to connect to
      * \param creds -- credentials
      * \param host -- optional host name
+     * \param h2 -- whether to offer HTTP/2 with ALPN, falling back to HTTP/1.1
+     * with servers that do not select it
      *
      */
-    client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host = {});
+    client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host = {}, http2 h2 = http2::no);
 
     /**
      * \brief Construct a client with connection factory
@@ -235,6 +285,8 @@ class client {
      * \param max_connections -- maximum number of connection a client is allowed to maintain
      * (both active and cached in pool)
      * \param retry -- whether or not to retry requests on connection IO errors
+     * \param h2 -- whether to speak HTTP/2 over the connections of the factory: when
+     * the TLS sockets negotiated "h2" with ALPN, and always over plain ones
      *
      * The client uses connections provided by factory to send requests over and receive responses
      * back. Once request-response cycle is over the connection used for that is kept by a client
@@ -261,8 +313,13 @@ class client {
      * When enabled, it makes client catch the transport error, close the broken connection, open
      * another one and retry the very same request one more time over this new connection. If the
      * second attempt fails, this error is reported back to user.
+     *
+     * Over HTTP/2 the requests in flight share a connection, up to the number of concurrent
+     * streams the server allows, before more connections are opened. The requests the server
+     * refused, or did not process before going away, are retried the same way.
      */
-    explicit client(std::unique_ptr<connection_factory> f, unsigned max_connections = default_max_connections, retry_requests retry = retry_requests::no);
+    explicit client(std::unique_ptr<connection_factory> f, unsigned max_connections = default_max_connections,
+            retry_requests retry = retry_requests::no, http2 h2 = http2::no);
 
     /**
      * \brief Send the request and handle the response
@@ -282,6 +339,24 @@ class client {
      */
     future<> make_request(request req, reply_handler handle, std::optional<reply::status_type> expected = std::nullopt);
 
+    /**
+     * \brief Send the request and return the response as it arrives
+     *
+     * Sends the provided request to the server and resolves with the status and headers
+     * of the response once they arrive, along with a stream of its body. The connection
+     * the response came on goes back to the client once the body is read to its end, or
+     * closed before that, in which case it is not reused. If the expected status is
+     * specified and the response's status is not the expected one, the method resolves
+     * with exceptional future.
+     *
+     * \param req -- request to be sent
+     * \param expected -- the optional expected reply status code, default is std::nullopt
+     *
+     * Requests are retried as with \ref make_request(), until the response arrives: one
+     * failing while its body is read is reported by the stream.
+     */
+    future<streaming_reply> make_streaming_request(request req, std::optional<reply::status_type> expected = std::nullopt);
+
     /**
      * \brief Updates the maximum number of connections a client may have
      *
@@ -292,6 +367,38 @@ class client {
      */
     future<> set_maximum_connections(unsigned nr);
 
+    /**
+     * \brief Sets the number of requests that may be pipelined on a connection
+     *
+     * Once the client has the maximum number of connections, and none is idle, a request
+     * may be sent over an HTTP/1.1 connection still waiting for the replies to up to
+     * depth - 1 others, rather than wait for one to be idle. The replies come in order:
+     * that to a request is only read once the bodies of those before it were, by their
+     * handlers or from their streams. The default depth of 1 does not pipeline.
+     *
+     * Only requests without a body, of idempotent methods other than HEAD, are pipelined,
+     * on connections a reply already told to be persistent. When a connection fails, or
+     * the server closes it, the requests pipelined after the failing one fail with
+     * ECONNABORTED or EPIPE, for clients retrying requests to retry them.
+     *
+     * \param depth -- the number of requests in flight on a connection
+     */
+    void set_pipeline_depth(unsigned depth) noexcept {
+        _pipeline_depth = std::max(depth, 1u);
+    }
+
+    /**
+     * \brief Opens connections until the client has that many idle ones
+     *
+     * Saves the requests that follow the latency of establishing their
+     * connections, within the maximum number of connections. The returned
+     * future resolves when the connections are established, or with the
+     * error of the first that could not be.
+     *
+     * \param nr -- the number of idle connections to have
+     */
+    future<> preconnect(unsigned nr);
+
     /**
      * \brief Closes the client
      *
@@ -312,7 +419,11 @@ class client {
      */
 
     unsigned idle_connections_nr() const noexcept {
-        return _pool.size();
+        unsigned nr = _pool.size();
+        for (auto& con : _http2_pool) {
+            nr += con._h2_requests == 0;
+        }
+        return nr;
     }
 
     /**
@@ -329,6 +440,14 @@ class client {
 
 } // experimental namespace
 
+namespace internal {
+
+// The factory of the connections to an address, over TLS with credentials
+std::unique_ptr<experimental::connection_factory> make_connection_factory(socket_address addr,
+        shared_ptr<tls::certificate_credentials> creds, sstring host, experimental::client::http2 h2);
+
+}
+
 } // http namespace
 
 SEASTAR_MODULE_EXPORT_END
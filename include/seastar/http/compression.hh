@@ -0,0 +1,127 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace http {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The content codings of HTTP bodies, in Content-Encoding and
+/// Accept-Encoding headers, and in the transfer codings of requests.
+///
+/// gzip and deflate are available when Seastar is built with zlib
+/// (\c SEASTAR_HAVE_ZLIB), zstd when it is built with zstd
+/// (\c SEASTAR_HAVE_ZSTD); see \ref is_supported().
+enum class content_encoding {
+    gzip,
+    deflate,
+    zstd,
+};
+
+/// Thrown by the decompressing streams on malformed data, and on data that
+/// decompresses to more than their limit
+class decompression_error : public std::runtime_error {
+    bool _too_large;
+public:
+    explicit decompression_error(const std::string& msg, bool too_large = false)
+            : std::runtime_error(msg), _too_large(too_large) {}
+    bool too_large() const noexcept { return _too_large; }
+};
+
+/// How \ref httpd::http_server compresses its replies and decompresses
+/// the requests
+struct compression_config {
+    /// The encodings the server compresses with, in the order it prefers
+    /// them in, among those the client accepts as much
+    std::vector<content_encoding> encodings = { content_encoding::zstd, content_encoding::gzip, content_encoding::deflate };
+    /// Replies with a smaller body are sent as they are. The bodies of
+    /// replies with a body writer are of unknown size, and compressed.
+    size_t min_size = 1024;
+    /// The content types compressed, the values of Content-Type without
+    /// their parameters; those ending with a '/' match all the subtypes
+    std::vector<sstring> content_types = { "text/", "application/json", "application/javascript",
+            "application/xml", "image/svg+xml" };
+    /// The zlib level of gzip and deflate, from 1, the fastest, to 9
+    int zlib_level = 6;
+    /// The zstd level, the negative ones being the fastest
+    int zstd_level = 3;
+    /// Whether to decompress the request bodies with a Content-Encoding,
+    /// failing unsupported encodings with 415 Unsupported Media Type
+    bool decompress_requests = true;
+
+    /// Whether replies of that content type are worth compressing
+    bool compressible(std::string_view content_type) const noexcept;
+};
+
+/// Whether Seastar was built with the library of \c enc
+bool is_supported(content_encoding enc) noexcept;
+
+/// The name of \c enc in the HTTP headers
+std::string_view to_string(content_encoding enc) noexcept;
+
+/// The encoding a header names, case insensitively, if one
+std::optional<content_encoding> parse_content_encoding(std::string_view name) noexcept;
+
+/// The encoding of \c offered, among those supported, that the value of
+/// an Accept-Encoding header prefers, the earliest of them if it prefers
+/// several as much; none if it accepts none of them
+std::optional<content_encoding> negotiate_content_encoding(std::string_view accept_encoding,
+        const std::vector<content_encoding>& offered);
+
+/// Compresses \c data as a whole
+///
+/// \param level -- the zlib or zstd level
+/// \throws std::invalid_argument if the encoding is not supported
+sstring compress(content_encoding enc, std::string_view data, int level);
+
+/// Returns a stream compressing into \c out what is written to it, and
+/// closing \c out when it is closed. Flushing it flushes what was
+/// compressed so far down to \c out.
+///
+/// \param level -- the zlib or zstd level
+/// \throws std::invalid_argument if the encoding is not supported
+output_stream<char> make_compressing_output_stream(output_stream<char> out, content_encoding enc, int level);
+
+/// Returns a stream of what \c in decompresses to, closing \c in when it
+/// is closed. Reading fails with \ref decompression_error on malformed
+/// data, and once there was more than \c max_size bytes of it.
+///
+/// \throws std::invalid_argument if the encoding is not supported
+input_stream<char> make_decompressing_input_stream(input_stream<char> in, content_encoding enc,
+        size_t max_size = std::numeric_limits<size_t>::max());
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
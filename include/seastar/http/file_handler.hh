@@ -22,8 +22,11 @@
 #pragma once
 
 #include <seastar/http/handlers.hh>
+#include <seastar/http/compression.hh>
 #include <seastar/core/iostream.hh>
+#include <seastar/core/shared_ptr.hh>
 #include <seastar/util/modules.hh>
+#include <optional>
 
 namespace seastar {
 
@@ -56,6 +59,20 @@ class file_transformer {
     virtual ~file_transformer() = default;
 };
 
+/**
+ * How a \ref file_interaction_handler keeps the files it serves in memory
+ */
+struct file_cache_config {
+    /// Larger files are read from the disk on every request
+    size_t max_file_size = 64 * 1024;
+    /// The size of the files kept, and of their compressed variants, over
+    /// which the least recently served are dropped
+    size_t max_size = 16 << 20;
+    /// How the files kept are compressed, once for all the clients
+    /// accepting the same encoding; not at all if disengaged
+    std::optional<http::compression_config> compression = http::compression_config{};
+};
+
 /**
  * A base class for handlers that interact with files.
  * directory and file handlers both share some common logic
@@ -65,10 +82,7 @@ class file_transformer {
  */
 class file_interaction_handler : public handler_base {
 public:
-    file_interaction_handler(file_transformer* p = nullptr)
-            : transformer(p) {
-
-    }
+    file_interaction_handler(file_transformer* p = nullptr);
 
     ~file_interaction_handler();
 
@@ -82,6 +96,24 @@ class file_interaction_handler : public handler_base {
         return this;
     }
 
+    /**
+     * Keeps the small files served in memory, rather than read them from
+     * the disk on every request. A file is dropped once modified, moved or
+     * deleted, as inotify tells.
+     *
+     * The files are served with an ETag and a Last-Modified date, whether
+     * kept in memory or not, the requests they match with If-None-Match or
+     * If-Modified-Since being answered with 304 Not Modified, and with a
+     * single byte range of a Range header. Neither applies to the files a
+     * transformer transforms.
+     *
+     * Handlers are not shared among shards: each keeps the files of its own.
+     * @param cfg how the files are kept
+     * @return this
+     * \throws std::system_error if inotify could not be set up
+     */
+    file_interaction_handler* set_cache(file_cache_config cfg);
+
     /**
      * if the url ends without a slash redirect
      * @param req the request
@@ -111,6 +143,10 @@ class file_interaction_handler : public handler_base {
 
     output_stream<char> get_stream(std::unique_ptr<http::request> req,
             const sstring& extension, output_stream<char>&& s);
+
+private:
+    class file_cache;
+    shared_ptr<file_cache> _cache;
 };
 
 /**
@@ -36,10 +36,15 @@
 #include <seastar/core/distributed.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/metrics_histogram.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/modules.hh>
 #include <seastar/http/routes.hh>
+#include <seastar/http/compression.hh>
+#include <seastar/http/internal/http2.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/core/shared_ptr.hh>
 
@@ -80,8 +85,15 @@ class connection : public boost::intrusive::list_base_hook<> {
     std::unique_ptr<http::reply> _resp;
     // null element marks eof
     queue<std::unique_ptr<http::reply>> _replies { 10 };
+    // The replies on their way to _replies, in the order of the requests,
+    // some of them still being handled
+    future<> _replies_ordered = make_ready_future<>();
+    // The pipelined requests handled at a time
+    semaphore _pipeline { 0 };
     bool _done = false;
     const bool _tls;
+    std::unique_ptr<http::internal::http2::session> _h2;
+    gate _h2_streams;
 public:
     [[deprecated("use connection(http_server&, connected_socket&&, bool tls)")]]
     connection(http_server& server, connected_socket&& fd, socket_address, bool tls) 
@@ -111,6 +123,15 @@ class connection : public boost::intrusive::list_base_hook<> {
     void on_new_connection();
 
     future<> process();
+    future<> process_http1();
+    // Consumes the HTTP/2 connection preface, if the connection starts
+    // with it, rather than with an HTTP/1 request
+    future<bool> read_http2_preface();
+    // Serves the streams of a connection that spoke HTTP/2, with prior
+    // knowledge of h2c or negotiated with ALPN, concurrently
+    future<> process_http2();
+    future<> serve_http2_stream(http::internal::http2::session::stream_ptr s);
+    future<> send_http2_reply(http::internal::http2::session::stream& s, http::reply& resp);
     void shutdown();
     future<> read();
     future<> read_one();
@@ -118,10 +139,23 @@ class connection : public boost::intrusive::list_base_hook<> {
     future<> do_response_loop();
 
     void set_headers(http::reply& resp);
+    // The Server and Date headers, rendered, unless the reply sets them
+    std::string_view server_header(const http::reply& resp) const;
+    std::string_view date_header(const http::reply& resp) const;
 
     future<> start_response();
 
     future<bool> generate_reply(std::unique_ptr<http::request> req);
+    future<std::unique_ptr<http::reply>> handle_request(std::unique_ptr<http::request> req);
+    // Handles a request whose body was read while the next ones are read,
+    // once there is room in the pipeline
+    future<> pipeline_request(std::unique_ptr<http::request> req, std::unique_ptr<input_stream<char>> content_stream);
+    // Queues a reply after those of the previous requests. Nothing is
+    // queued after a failed one, which ends the connection.
+    void queue_reply(future<std::unique_ptr<http::reply>> rep, semaphore_units<> units = {});
+    // Compresses the body of a reply, if worth it, with the encoding the
+    // client prefers
+    static void compress_reply(const http::compression_config& cfg, std::string_view accept_encoding, http::reply& rep);
     void generate_error_reply_and_close(std::unique_ptr<http::request> req, http::reply::status_type status, const sstring& msg);
 
     future<> write_body();
@@ -141,9 +175,21 @@ class http_server {
     uint64_t _respond_errors = 0;
     shared_ptr<seastar::tls::server_credentials> _credentials;
     sstring _date = http_date();
-    timer<> _date_format_timer { [this] {_date = http_date();} };
+    // The Date header, rendered along with the date once a second
+    sstring _date_header = render_date_header(_date);
+    timer<lowres_clock> _date_format_timer { [this] {
+        _date = http_date();
+        _date_header = render_date_header(_date);
+    } };
     size_t _content_length_limit = std::numeric_limits<size_t>::max();
     bool _content_streaming = false;
+    bool _http2 = true;
+    unsigned _pipeline_depth = 1;
+    bool _parse_headers_in_place = false;
+    bool _rx_timestamps = false;
+    // In microseconds, from 16us to 33s
+    metrics::log_linear_histogram<16, 33554432, 4> _wire_to_handler;
+    std::optional<http::compression_config> _compression;
     gate _task_gate;
 public:
     routes _routes;
@@ -189,6 +235,85 @@ class http_server {
 
     void set_content_streaming(bool b);
 
+    bool get_http2() const;
+
+    const std::optional<http::compression_config>& get_compression() const;
+
+    /*!
+     * \brief compress the replies, and decompress the requests
+     *
+     * The replies of the compressible content types, larger than the
+     * minimum size, are compressed with the encoding the client prefers
+     * in its Accept-Encoding header, among those of the configuration.
+     * The bodies of replies with a body writer are compressed as they are
+     * written, each flush sending what was compressed so far. The request
+     * bodies with a Content-Encoding reach the handlers decompressed,
+     * without their Content-Encoding and Content-Length headers, up to the
+     * content length limit. Disabled by default; std::nullopt disables it.
+     * Compressed transfer codings of requests, as in "gzip, chunked", are
+     * decompressed either way.
+     */
+    void set_compression(std::optional<http::compression_config> cfg);
+
+    unsigned get_pipeline_depth() const;
+
+    /*!
+     * \brief handle up to that many pipelined requests of a connection at a time
+     *
+     * A client may send requests without waiting for the replies to the
+     * previous ones. With a depth above 1, the server reads them ahead and
+     * runs their handlers concurrently, the replies still being sent in the
+     * order of the requests. Only applies without content streaming, the
+     * body of a request being read before the next request is. The default
+     * of 1 handles the requests of a connection one at a time. Applies to
+     * the connections accepted afterwards.
+     */
+    void set_pipeline_depth(unsigned depth);
+
+    /*!
+     * \brief serve HTTP/2 on the connections that start with its preface
+     *
+     * The clients with prior knowledge that the server speaks cleartext
+     * HTTP/2 (h2c), and those that negotiated "h2" with ALPN over TLS, send
+     * the HTTP/2 connection preface. The streams of such a connection, each
+     * a request, are handled concurrently, with their bodies flow controlled
+     * as the handlers read and write them. Enabled by default. To have TLS
+     * clients negotiate it, add "h2" to the ALPN protocols of the server
+     * credentials, see tls::certificate_credentials::set_alpn_protocols().
+     */
+    void set_http2(bool b);
+
+    bool get_parse_headers_in_place() const;
+
+    /*!
+     * \brief parse the request headers in place, rather than into strings
+     *
+     * The headers of the HTTP/1 requests are then views of the buffers they
+     * were read in, http::request::_header_views, saving the allocations of
+     * a string for every header name and value. The handlers look them up
+     * with http::request::get_header(), the code accessing
+     * http::request::_headers directly calling
+     * http::request::materialize_headers() first. A request keeps the
+     * buffers its headers were read in until it is destroyed. Applies to
+     * the connections accepted afterwards.
+     */
+    void set_parse_headers_in_place(bool b);
+
+    bool get_rx_timestamps() const;
+
+    /*!
+     * \brief record when the requests arrive
+     *
+     * Has the connections record the time the data of the requests is
+     * received, see connected_socket::enable_rx_timestamps(), for the
+     * handlers to find in http::request::get_rx_timestamp() and for the
+     * wire_to_handler_latency histogram of the time from then to the
+     * handler. Only plain HTTP/1 connections of stacks that can report the
+     * timestamps have them. Disabled by default. Applies to the connections
+     * accepted afterwards.
+     */
+    void set_rx_timestamps(bool b);
+
     future<> listen(socket_address addr, server_credentials_ptr credentials);
     future<> listen(socket_address addr, listen_options lo, server_credentials_ptr credentials);
     future<> listen(socket_address addr, listen_options lo);
@@ -203,10 +328,14 @@ class http_server {
     uint64_t requests_served() const;
     uint64_t read_errors() const;
     uint64_t reply_errors() const;
+    const metrics::log_linear_histogram<16, 33554432, 4>& wire_to_handler_latency() const;
     // Write the current date in the specific "preferred format" defined in
     // RFC 7231, Section 7.1.1.1.
     static sstring http_date();
+    // The same, of time t
+    static sstring http_date(std::chrono::system_clock::time_point t);
 private:
+    static sstring render_date_header(const sstring& date);
     future<> do_accept_one(int which, bool with_tls);
     boost::intrusive::list<connection> _connections;
     friend class seastar::httpd::connection;
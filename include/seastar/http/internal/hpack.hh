@@ -0,0 +1,125 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/sstring.hh>
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+// HPACK, the header compression of HTTP/2 (RFC 7541)
+
+using header_list = std::vector<std::pair<sstring, sstring>>;
+
+class hpack_error : public std::runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
+// The dynamic table, newest entry first
+class hpack_table {
+    struct entry {
+        sstring name;
+        sstring value;
+    };
+    circular_buffer<entry> _entries;
+    size_t _size = 0;
+    size_t _max_size;
+
+    void evict(size_t room);
+public:
+    static constexpr size_t static_size = 61;
+    static constexpr size_t entry_overhead = 32;
+
+    explicit hpack_table(size_t max_size = 4096) : _max_size(max_size) {}
+
+    // Indices from 1, the static table's first
+    std::pair<std::string_view, std::string_view> get(size_t index) const;
+    void add(sstring name, sstring value);
+    void set_max_size(size_t max_size);
+    size_t max_size() const noexcept { return _max_size; }
+    size_t size() const noexcept { return _size; }
+    size_t entries() const noexcept { return _entries.size(); }
+
+    // The index of the entry with both the name and the value, or else,
+    // negated, that of one with the name, zero if none has it
+    ssize_t find(std::string_view name, std::string_view value) const;
+};
+
+class hpack_encoder {
+    hpack_table _table;
+    // The smallest and last sizes the peer allowed since the last block
+    std::optional<size_t> _min_size_update;
+    std::optional<size_t> _size_update;
+    bool _huffman;
+public:
+    explicit hpack_encoder(bool huffman = true) : _huffman(huffman) {}
+
+    // The peer's SETTINGS_HEADER_TABLE_SIZE, announced at the start of
+    // the next block
+    void set_max_table_size(size_t max_size);
+    // Appends the block of the headers, whose names must be lower case
+    void encode(std::string& out, const header_list& headers);
+    void encode(std::string& out, std::string_view name, std::string_view value);
+    const hpack_table& table() const noexcept { return _table; }
+};
+
+class hpack_decoder {
+    hpack_table _table;
+    // Our SETTINGS_HEADER_TABLE_SIZE, that the peer may not exceed
+    size_t _max_table_size;
+    size_t _max_list_size;
+public:
+    // \c max_list_size bounds the decoded headers, as
+    // SETTINGS_MAX_HEADER_LIST_SIZE counts them
+    explicit hpack_decoder(size_t max_table_size = 4096, size_t max_list_size = std::numeric_limits<size_t>::max())
+            : _table(max_table_size), _max_table_size(max_table_size), _max_list_size(max_list_size) {}
+
+    // Decodes the whole block of a HEADERS frame and its CONTINUATIONs
+    //
+    // \throws hpack_error on a malformed block, which is a connection error
+    header_list decode(std::string_view block);
+    const hpack_table& table() const noexcept { return _table; }
+};
+
+void huffman_encode(std::string& out, std::string_view s);
+size_t huffman_encoded_size(std::string_view s) noexcept;
+// \throws hpack_error on an invalid encoding
+sstring huffman_decode(std::string_view s);
+
+}
+
+}
+
+}
@@ -0,0 +1,262 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/http/internal/hpack.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+// The framing layer of HTTP/2 (RFC 9113), which the server and the client
+// connections run their streams over
+namespace http2 {
+
+constexpr std::string_view preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+enum class frame_type : uint8_t {
+    data = 0, headers = 1, priority = 2, rst_stream = 3, settings = 4,
+    push_promise = 5, ping = 6, goaway = 7, window_update = 8, continuation = 9,
+};
+
+enum class error_code : uint32_t {
+    no_error = 0, protocol_error = 1, internal_error = 2, flow_control_error = 3,
+    settings_timeout = 4, stream_closed = 5, frame_size_error = 6, refused_stream = 7,
+    cancel = 8, compression_error = 9, connect_error = 10, enhance_your_calm = 11,
+    inadequate_security = 12, http_1_1_required = 13,
+};
+
+// Fails the connection, with a GOAWAY
+class connection_error : public std::runtime_error {
+    error_code _code;
+public:
+    connection_error(error_code code, const std::string& msg) : runtime_error(msg), _code(code) {}
+    error_code code() const noexcept { return _code; }
+};
+
+// Fails a single stream, reset by one of the ends
+class stream_error : public std::runtime_error {
+    error_code _code;
+public:
+    stream_error(error_code code, const std::string& msg) : runtime_error(msg), _code(code) {}
+    error_code code() const noexcept { return _code; }
+};
+
+struct config {
+    // The streams the peer may open at a time
+    uint32_t max_concurrent_streams = 100;
+    // What the peer may send on a stream, and on the whole connection,
+    // before what was received is consumed
+    uint32_t stream_window = 1 << 20;
+    uint32_t connection_window = 4 << 20;
+    uint32_t max_frame_size = 16384;
+    uint32_t max_header_list_size = 64 << 10;
+    // The streams the peer may reset in a second before the connection
+    // is failed with ENHANCE_YOUR_CALM, a client opening and resetting
+    // streams to have the server do work it does not account for
+    uint32_t max_resets_per_second = 200;
+};
+
+// The HTTP/1 headers about the connection, that HTTP/2 does not carry;
+// lower case
+bool is_connection_specific(std::string_view name) noexcept;
+
+class stream_source;
+class stream_sink;
+
+class session {
+public:
+    enum class role { client, server };
+    class stream;
+    using stream_ptr = lw_shared_ptr<stream>;
+    // Called by a server with the streams the client opens, once their
+    // headers are received
+    using stream_handler = noncopyable_function<void(stream_ptr)>;
+private:
+    struct peer_settings {
+        uint32_t header_table_size = 4096;
+        // Until its SETTINGS tell, not more than that is to be expected
+        uint32_t max_concurrent_streams = 100;
+        uint32_t initial_window_size = 65535;
+        uint32_t max_frame_size = 16384;
+    };
+
+    role _role;
+    input_stream<char>& _in;
+    output_stream<char>& _out;
+    config _cfg;
+    peer_settings _peer;
+    hpack_encoder _encoder;
+    hpack_decoder _decoder;
+    stream_handler _on_stream;
+    std::unordered_map<uint32_t, stream_ptr> _streams;
+    // The streams handed to _on_stream and not released yet, which count
+    // against max_concurrent_streams even once reset by the client
+    size_t _held_streams = 0;
+    // Resets received in the second since _resets_since
+    lowres_clock::time_point _resets_since;
+    uint32_t _resets = 0;
+    uint32_t _next_stream_id;
+    uint32_t _last_peer_stream_id = 0;
+    // The streams above that were not processed by the peer
+    uint32_t _goaway_last_stream_id = std::numeric_limits<uint32_t>::max();
+    int64_t _send_window = 65535;
+    int64_t _recv_window = 65535;
+    size_t _recv_unacked = 0;
+    // The header block being received in CONTINUATION frames
+    uint32_t _continuation_stream = 0;
+    bool _continuation_end_stream = false;
+    std::string _header_block;
+    bool _goaway_sent = false;
+    semaphore _write_sem{1};
+    condition_variable _window_cv;
+    // The frames sent in the background, which the peer may hold back by
+    // not reading; frames are not read while too many are pending
+    size_t _pending_sends = 0;
+    condition_variable _sends_cv;
+    // Set once the connection is over
+    std::exception_ptr _error;
+    gate _background;
+
+    template <typename Func>
+    future<> with_write_lock(Func func);
+    future<> write_frame(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> write_frame_locked(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> write_headers_locked(uint32_t stream_id, const header_list& headers, bool end_stream);
+    future<> send_preamble();
+    void send_in_background(noncopyable_function<future<>()> send);
+    void send_rst_stream(uint32_t stream_id, error_code code);
+    void send_window_update(uint32_t stream_id, uint32_t increment);
+
+    future<> read_frames();
+    future<> handle_frame(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> handle_headers(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    void handle_header_block(uint32_t stream_id, bool end_stream, std::string_view block);
+    void handle_data(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> handle_settings(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    void handle_window_update(uint32_t stream_id, temporary_buffer<char> payload);
+    void handle_rst_stream(uint32_t stream_id, temporary_buffer<char> payload);
+    void handle_goaway(temporary_buffer<char> payload);
+
+    stream_ptr find_stream(uint32_t stream_id) const;
+    void reset_stream(stream& s, std::exception_ptr ex);
+    void maybe_close_stream(stream& s);
+    void erase_stream(stream& s);
+    void consumed(stream& s, size_t size);
+    void consumed(size_t size);
+    void fail(std::exception_ptr ex);
+public:
+    session(role r, input_stream<char>& in, output_stream<char>& out, config cfg, stream_handler on_stream = {});
+    session(const session&) = delete;
+    ~session();
+
+    // Sends the preface and SETTINGS, and handles the frames of the peer
+    // until the connection ends or fails, failing the streams left
+    future<> run();
+    // Sends GOAWAY, for the peer to open no more streams, and waits for
+    // the frames being sent
+    future<> shutdown(error_code code = error_code::no_error);
+
+    // Whether a client may open another stream
+    bool can_open_stream(size_t reserved) const noexcept;
+    bool alive() const noexcept { return !_error && _goaway_last_stream_id == std::numeric_limits<uint32_t>::max(); }
+    size_t active_streams() const noexcept { return _streams.size(); }
+    size_t max_concurrent_streams() const noexcept { return _peer.max_concurrent_streams; }
+
+    // Opens a stream with the headers of a request
+    future<stream_ptr> open_stream(const header_list& headers, bool end_stream);
+    // Sends the headers of a response, or trailers
+    future<> send_headers(stream& s, const header_list& headers, bool end_stream);
+    // Sends DATA, as the windows allow
+    future<> send_data(stream& s, temporary_buffer<char> data, bool end_stream);
+    // Sends END_STREAM, if not sent yet
+    future<> finish(stream& s);
+    // Done with the stream, resetting it if neither end finished it
+    void release(stream& s, error_code code = error_code::cancel);
+
+    // The stream body, respecting the windows
+    input_stream<char> body_source(stream_ptr s, std::unordered_map<sstring, sstring>* trailers = nullptr);
+    output_stream<char> body_sink(stream_ptr s);
+};
+
+class session::stream : public enable_lw_shared_from_this<stream> {
+    friend class session;
+    friend class stream_sink;
+    session* _session;
+    uint32_t _id;
+    header_list _headers;
+    header_list _trailers;
+    bool _headers_received = false;
+    std::optional<promise<>> _headers_waiter;
+    circular_buffer<temporary_buffer<char>> _data;
+    size_t _unread = 0;
+    std::optional<promise<>> _data_waiter;
+    // END_STREAM received, and sent
+    bool _remote_closed = false;
+    bool _local_closed = false;
+    bool _erased = false;
+    // Handed to the stream handler, until released
+    bool _held = false;
+    std::exception_ptr _error;
+    int64_t _send_window;
+    int64_t _recv_window;
+    size_t _recv_unacked = 0;
+
+    void wake();
+    std::exception_ptr closed_error() const;
+public:
+    stream(session& s, uint32_t id, int64_t send_window, int64_t recv_window)
+            : _session(&s), _id(id), _send_window(send_window), _recv_window(recv_window) {}
+    uint32_t id() const noexcept { return _id; }
+    const header_list& headers() const noexcept { return _headers; }
+    const header_list& trailers() const noexcept { return _trailers; }
+    // Waits for the headers of the response, skipping the informational ones
+    future<> wait_headers();
+    // The next bytes of the body, empty at its end
+    future<temporary_buffer<char>> read();
+};
+
+}
+
+}
+
+}
+
+}
@@ -22,6 +22,10 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <charconv>
+#include <optional>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #endif
 
@@ -189,6 +193,66 @@ struct path_description {
     void unset(routes& _routes) const;
 };
 
+namespace internal {
+
+// The parameters the handlers generated by seastar-json2code.py read, as
+// views of the request, parsed where they are
+
+// The value of a query parameter of a request, std::nullopt if it has none
+inline std::optional<std::string_view> query_param(const http::request& req, const sstring& name) noexcept {
+    auto i = req.query_parameters.find(name);
+    if (i == req.query_parameters.end()) {
+        return std::nullopt;
+    }
+    return std::string_view(i->second);
+}
+
+// The value of a path parameter of a request, std::nullopt if it has none.
+// Only a value with escapes is decoded, into decoded.
+inline std::optional<std::string_view> path_param(const http::request& req, const sstring& name, sstring& decoded) {
+    if (!req.param.exists(name)) {
+        return std::nullopt;
+    }
+    std::string_view raw = req.param.path(name);
+    if (!raw.empty()) {
+        raw.remove_prefix(1);
+    }
+    if (raw.find('%') == std::string_view::npos) {
+        return raw;
+    }
+    decoded = req.param.get_decoded_param(name);
+    return std::string_view(decoded);
+}
+
+// A parameter parsed as a number, or as true or false, std::nullopt if it
+// is missing or isn't one as a whole
+template <typename T>
+requires std::is_arithmetic_v<T>
+std::optional<T> parse_param(std::optional<std::string_view> str) noexcept {
+    if (!str) {
+        return std::nullopt;
+    }
+    if constexpr (std::is_same_v<T, bool>) {
+        if (*str == "true") {
+            return true;
+        }
+        if (*str == "false") {
+            return false;
+        }
+        return std::nullopt;
+    } else {
+        T v;
+        auto end = str->data() + str->size();
+        auto [p, ec] = std::from_chars(str->data(), end, v);
+        if (ec != std::errc() || p != end) {
+            return std::nullopt;
+        }
+        return v;
+    }
+}
+
+}
+
 }
 
 }
@@ -112,6 +112,13 @@ class match_rule {
         return *this;
     }
 
+    /**
+     * The matchers of the rule, in the order they are checked
+     */
+    const std::vector<matcher*>& matchers() const noexcept {
+        return _match_list;
+    }
+
 private:
     std::vector<matcher*> _match_list;
     handler_base* _handler;
@@ -32,6 +32,8 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <initializer_list>
+#include <string_view>
 #include <unordered_map>
 #endif
 #include <seastar/core/sstring.hh>
@@ -54,6 +56,10 @@ class routes;
 
 namespace http {
 
+namespace experimental {
+class connection;
+}
+
 /**
  * A reply to be sent to a client.
  */
@@ -92,6 +98,7 @@ struct reply {
         payload_too_large = 413, //!< payload_too_large
         uri_too_long = 414, //!< uri_too_long
         unsupported_media_type = 415, //!< unsupported_media_type
+        range_not_satisfiable = 416, //!< range_not_satisfiable
         expectation_failed = 417, //!< expectation_failed
         unprocessable_entity = 422, //!< unprocessable_entity
         upgrade_required = 426, //!< upgrade_required
@@ -218,12 +225,20 @@ struct reply {
     void write_body(const sstring& content_type, sstring content);
 
 private:
-    future<> write_reply_to_connection(httpd::connection& con);
-    future<> write_reply_headers(httpd::connection& connection);
+    future<> write_reply_to_connection(httpd::connection& con, std::initializer_list<std::string_view> extra_headers);
+    // Renders the response line and the headers, up to the empty line
+    // ending them, into a single buffer. The extra headers, already
+    // rendered, follow those of the reply, of which the one named skip,
+    // if any, is left out.
+    sstring render_head(std::initializer_list<std::string_view> extra_headers, std::string_view skip = {}) const;
 
     noncopyable_function<future<>(output_stream<char>&&)> _body_writer;
+    // Of a reply received on an HTTP/2 connection, the source of its body,
+    // on the stream it came on
+    noncopyable_function<input_stream<char>(reply&)> _h2_body;
     friend class httpd::routes;
     friend class httpd::connection;
+    friend class experimental::connection;
 };
 
 std::ostream& operator<<(std::ostream& os, reply::status_type st);
@@ -32,7 +32,13 @@
 
 #include <seastar/core/iostream.hh>
 #include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <boost/container/small_vector.hpp>
+#include <chrono>
+#include <optional>
+#include <string_view>
 #include <strings.h>
+#include <vector>
 #include <seastar/http/common.hh>
 #include <seastar/http/mime_types.hh>
 #include <seastar/net/socket_defs.hh>
@@ -45,6 +51,67 @@ namespace http {
 
 namespace experimental { class connection; }
 
+/**
+ * The headers of a request parsed in place: views of the input buffers
+ * they were received in, that it keeps, rather than strings. Only the
+ * fields split across buffers, or folded over several lines, are copied.
+ * The fields are in the order they were received, a field received more
+ * than once appearing as many times.
+ *
+ * Keeping the input buffers keeps all of their memory, not only that of
+ * the headers, for as long as the request lives.
+ */
+class header_views {
+public:
+    struct field {
+        std::string_view name;
+        std::string_view value;
+    };
+private:
+    boost::container::small_vector<field, 16> _fields;
+    std::vector<temporary_buffer<char>> _buffers;
+public:
+    /**
+     * Keep a buffer the views point into
+     */
+    void pin(temporary_buffer<char> buf) {
+        _buffers.push_back(std::move(buf));
+    }
+
+    /**
+     * Keep a copy of a string, for views to point into
+     * @return a view of the copy
+     */
+    std::string_view copy(std::string_view str);
+
+    void add(std::string_view name, std::string_view value) {
+        _fields.push_back(field{name, value});
+    }
+
+    /**
+     * Search for the first field of a given name, case insensitively
+     * @return the field, or nullptr if there is none
+     */
+    const field* find(std::string_view name) const noexcept;
+
+    /**
+     * @return the values of the fields of a given name, comma separated,
+     * or an empty string if there is none
+     */
+    sstring get(std::string_view name) const;
+
+    auto begin() const noexcept { return _fields.begin(); }
+    auto end() const noexcept { return _fields.end(); }
+    size_t size() const noexcept { return _fields.size(); }
+    bool empty() const noexcept { return _fields.empty(); }
+    field& back() noexcept { return _fields.back(); }
+
+    void clear() noexcept {
+        _fields.clear();
+        _buffers.clear();
+    }
+};
+
 /**
  * A request received from a client.
  */
@@ -63,6 +130,9 @@ struct request {
     size_t content_length = 0;
     mutable size_t _bytes_written = 0;
     std::unordered_map<sstring, sstring, seastar::internal::case_insensitive_hash, seastar::internal::case_insensitive_cmp> _headers;
+    // The headers parsed in place, when the parser was asked to, until
+    // materialize_headers() moves them to _headers
+    http::header_views _header_views;
     std::unordered_map<sstring, sstring> query_parameters;
     httpd::parameters param;
     sstring content; // server-side deprecated: use content_stream instead
@@ -76,6 +146,8 @@ struct request {
     std::unordered_map<sstring, sstring> chunk_extensions;
     sstring protocol_name = "http";
     noncopyable_function<future<>(output_stream<char>&&)> body_writer; // for client
+    // When the request arrived, if the server records it
+    std::optional<std::chrono::system_clock::time_point> _rx_timestamp;
 
     /**
      * Get the address of the client that generated the request
@@ -101,11 +173,17 @@ struct request {
     sstring get_header(const sstring& name) const {
         auto res = _headers.find(name);
         if (res == _headers.end()) {
-            return "";
+            return _header_views.get(name);
         }
         return res->second;
     }
 
+    /**
+     * Move the headers parsed in place to _headers, releasing the input
+     * buffers they point into, for the code accessing _headers directly
+     */
+    void materialize_headers();
+
     /**
      * Search for the last query parameter of a given key
      * @param key the query paramerter key
@@ -129,6 +207,15 @@ struct request {
         return param.get_decoded_param(key);
     }
 
+    /**
+     * Get the time the request arrived at, as the NIC or the kernel stamped
+     * the data it was read in, when the server records it
+     * (http_server::set_rx_timestamps()).
+     */
+    const std::optional<std::chrono::system_clock::time_point>& get_rx_timestamp() const {
+        return _rx_timestamp;
+    }
+
     /**
      * Get the request protocol name. Can be either "http" or "https".
      */
@@ -159,12 +246,11 @@ struct request {
 
         // TODO: handle HTTP/2.0 when it releases
 
-        auto it = _headers.find("Connection");
+        auto connection = get_header("Connection");
         if (_version == "1.0") {
-            return it != _headers.end()
-                 && seastar::internal::case_insensitive_cmp()(it->second, "keep-alive");
+            return seastar::internal::case_insensitive_cmp()(connection, "keep-alive");
         } else { // HTTP/1.1
-            return it == _headers.end() || !seastar::internal::case_insensitive_cmp()(it->second, "close");
+            return !seastar::internal::case_insensitive_cmp()(connection, "close");
         }
     }
 
@@ -23,6 +23,7 @@
 
 #ifndef SEASTAR_MODULE
 #include <boost/program_options/variables_map.hpp>
+#include <memory>
 #include <unordered_map>
 #endif
 
@@ -77,6 +78,13 @@ struct path_description;
  * (an optional leading slash is permitted) it is choosen
  * If not, the matching rules are used.
  * matching rules are evaluated by their insertion order
+ *
+ * The rules made only of static strings and parameters, as the ones of
+ * \ref url and \ref path_description, are compiled into a trie of the
+ * url segments on the first lookup after they changed, which finds the
+ * first of them to match in one pass over the url, whatever their number.
+ * The others are evaluated one by one. A rule must not be changed once
+ * added.
  */
 class routes {
 public:
@@ -111,6 +119,7 @@ class routes {
      */
     routes& add(match_rule* rule, operation_type type = GET) {
         _rules[type][_rover++] = rule;
+        _rules_changed[type] = true;
         return *this;
     }
 
@@ -180,6 +189,10 @@ class routes {
 private:
     rule_cookie _rover = 0;
     std::map<rule_cookie, match_rule*> _rules[NUM_OPERATION];
+    class rule_trie;
+    // Compiled from _rules, rebuilt when they changed
+    std::unique_ptr<rule_trie> _tries[NUM_OPERATION];
+    bool _rules_changed[NUM_OPERATION] = {};
     //default Handler -- for any HTTP Method and Path (/*)
     handler_base* _default_handler = nullptr;
 public:
@@ -229,6 +242,7 @@ class routes {
     rule_cookie add_cookie(match_rule* rule, operation_type type) {
         auto pos = _rover++;
         _rules[type][pos] = rule;
+        _rules_changed[type] = true;
         return pos;
     }
 
@@ -31,6 +31,7 @@
 #include <seastar/core/do_with.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/json/formatter.hh>
+#include <seastar/json/writer.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/util/modules.hh>
@@ -87,6 +88,14 @@ class json_base_element {
     virtual std::string to_string() = 0;
 
     virtual future<> write(output_stream<char>& s) const = 0;
+
+    /**
+     * writes the internal value with a json writer.
+     * The default implementation writes what to_string returns
+     */
+    virtual void serialize(writer& w) const {
+        w.raw(const_cast<json_base_element*>(this)->to_string());
+    }
     std::string _name;
     bool _mandatory;
     bool _set;
@@ -146,6 +155,10 @@ class json_element : public json_base_element {
     virtual future<> write(output_stream<char>& s) const override {
         return formatter::write(s, _value);
     }
+
+    virtual void serialize(writer& w) const override {
+        w.value(_value);
+    }
 private:
     T _value;
 };
@@ -189,6 +202,10 @@ class json_list : public json_base_element {
     virtual future<> write(output_stream<char>& s) const override {
         return formatter::write(s, _elements);
     }
+
+    virtual void serialize(writer& w) const override {
+        w.value(_elements);
+    }
     std::vector<T> _elements;
 };
 
@@ -213,6 +230,16 @@ class jsonable {
     virtual future<> write(output_stream<char>& s) const {
         return s.write(to_json());
     }
+
+    /*!
+     * \brief write an object with a json writer
+     *
+     * The default implementation uses the to_json
+     * Object implementation override it.
+     */
+    virtual void serialize(writer& w) const {
+        w.raw(to_json());
+    }
 };
 
 /**
@@ -246,6 +273,11 @@ struct json_base : public jsonable {
      */
     virtual future<> write(output_stream<char>&) const;
 
+    /*!
+     * \brief write with a json writer
+     */
+    virtual void serialize(writer& w) const;
+
     /**
      * Check that all mandatory elements are set
      * @return true if all mandatory parameters are set
@@ -0,0 +1,250 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <charconv>
+#include <concepts>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#endif
+
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/json/formatter.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace json {
+
+namespace internal {
+
+/// The most characters \c n characters escape to, as \c \\u001F
+constexpr size_t max_escaped_size(size_t n) noexcept {
+    return 6 * n;
+}
+
+/// The position of the first character of \c str a JSON string escapes,
+/// the size of \c str if there is none
+size_t find_escape(std::string_view str) noexcept;
+
+/// Writes \c str escaped for a JSON string, without the quotes, at \c out,
+/// which has room for \ref max_escaped_size of its size
+///
+/// \returns the end of what was written
+char* escape(std::string_view str, char* out) noexcept;
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief Writes JSON to an output stream, without building strings.
+///
+/// The values are formatted into a buffer of the writer, which is handed
+/// to the stream in bulk by \ref flush(), or by \ref maybe_flush() once it
+/// holds \c flush_size bytes, for a document to be written value after
+/// value with no allocation but that of the buffer, however big it is. The
+/// strings are escaped a vector at a time, and the numbers formatted with
+/// \c std::to_chars. The output is that of \ref formatter, without the
+/// spaces of \ref jsonable::to_json().
+///
+/// The commas are the writer's: values, and the key and value pairs of an
+/// object, follow one another.
+///
+/// \code
+/// json::writer w(out);
+/// w.begin_object().key("name").value(name).key("values").begin_array();
+/// for (auto& v : values) {
+///     w.value(v);
+///     co_await w.maybe_flush();
+/// }
+/// w.end_array().end_object();
+/// co_await w.flush();
+/// \endcode
+class writer {
+    output_stream<char>& _out;
+    size_t _flush_size;
+    std::unique_ptr<char[]> _buf;
+    size_t _capacity = 0;
+    size_t _size = 0;
+    // Whether the object or array being written, the first one being the
+    // top level, has a value yet, for the commas
+    std::vector<bool> _has_value;
+    bool _after_key = false;
+
+    char* reserve(size_t n) {
+        if (_capacity - _size < n) {
+            grow(n);
+        }
+        return _buf.get() + _size;
+    }
+    void grow(size_t n);
+    void put(char c) {
+        *reserve(1) = c;
+        ++_size;
+    }
+    void append(std::string_view str) {
+        std::memcpy(reserve(str.size()), str.data(), str.size());
+        _size += str.size();
+    }
+    void separate() {
+        if (std::exchange(_after_key, false)) {
+            return;
+        }
+        if (_has_value.back()) {
+            put(',');
+        }
+        _has_value.back() = true;
+    }
+    void quoted(std::string_view str);
+    template <std::integral T>
+    void number(T n) {
+        auto p = reserve(24);
+        _size = std::to_chars(p, p + 24, n).ptr - _buf.get();
+    }
+    template <typename K, typename V>
+    void entry(const std::pair<K, V>& p) {
+        value(p.first);
+        put(':');
+        _after_key = true;
+        value(p.second);
+    }
+    template <typename Iter>
+    writer& entries(Iter i, Iter e) {
+        begin_object();
+        for (; i != e; ++i) {
+            entry(*i);
+        }
+        return end_object();
+    }
+public:
+    /// Writes to \c out, which must outlive the writer
+    explicit writer(output_stream<char>& out, size_t flush_size = 8192);
+    writer(writer&&) noexcept = default;
+
+    writer& begin_object();
+    writer& end_object();
+    writer& begin_array();
+    writer& end_array();
+    /// Writes the key of the next value of an object
+    writer& key(std::string_view name);
+
+    writer& value(std::string_view str) {
+        separate();
+        quoted(str);
+        return *this;
+    }
+    writer& value(const char* str) {
+        return value(std::string_view(str));
+    }
+    writer& value(const sstring& str) {
+        return value(std::string_view(str));
+    }
+    writer& value(const std::string& str) {
+        return value(std::string_view(str));
+    }
+    writer& value(bool b) {
+        separate();
+        append(b ? "true" : "false");
+        return *this;
+    }
+    template <std::integral T>
+    writer& value(const T& n) {
+        separate();
+        number(n);
+        return *this;
+    }
+    /// \throws std::out_of_range if \c f is infinite,
+    ///     std::invalid_argument if it is not a number
+    writer& value(float f);
+    /// \throws std::out_of_range if \c d is infinite,
+    ///     std::invalid_argument if it is not a number
+    writer& value(double d);
+    writer& value(const date_time& d);
+    /// Writes \c obj with \ref jsonable::serialize()
+    writer& value(const jsonable& obj);
+
+    template <typename T, typename... Args>
+    writer& value(const std::vector<T, Args...>& vec) {
+        begin_array();
+        for (auto& v : vec) {
+            if constexpr (requires { v.first; v.second; }) {
+                begin_object();
+                entry(v);
+                end_object();
+            } else {
+                value(v);
+            }
+        }
+        return end_array();
+    }
+    template <typename... Args>
+    writer& value(const std::map<Args...>& map) {
+        return entries(map.begin(), map.end());
+    }
+    template <typename... Args>
+    writer& value(const std::unordered_map<Args...>& map) {
+        return entries(map.begin(), map.end());
+    }
+    /// Writes what \ref formatter formats \c v to, for the types the
+    /// writer has no overload of
+    template <typename T>
+    writer& value(const T& v) {
+        if constexpr (std::derived_from<T, jsonable>) {
+            return value(static_cast<const jsonable&>(v));
+        } else {
+            return raw(formatter::to_json(v));
+        }
+    }
+
+    /// Writes a value already formatted as JSON
+    writer& raw(std::string_view json) {
+        separate();
+        append(json);
+        return *this;
+    }
+
+    /// The size of what is written and not flushed yet
+    size_t buffered() const noexcept {
+        return _size;
+    }
+    /// Writes what is buffered to the stream if it is \c flush_size bytes
+    /// or more, letting the next values reuse the buffer
+    future<> maybe_flush() {
+        return _size >= _flush_size ? flush() : make_ready_future<>();
+    }
+    /// Writes what is buffered to the stream, which it leaves to flush
+    future<> flush();
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -113,6 +113,12 @@ class datagram final {
 
 using udp_datagram = datagram;
 
+/// A datagram, with its destination, to be sent by datagram_channel::send_batch()
+struct outgoing_datagram {
+    socket_address dst;
+    packet data;
+};
+
 class datagram_channel {
 private:
     std::unique_ptr<datagram_channel_impl> _impl;
@@ -129,6 +135,22 @@ class datagram_channel {
     future<datagram> receive();
     future<> send(const socket_address& dst, const char* msg);
     future<> send(const socket_address& dst, packet p);
+    /// Receives one or more datagrams
+    ///
+    /// Waits until at least one datagram is available and returns it along
+    /// with whatever other datagrams can be received right away, up to
+    /// \c max_datagrams. The posix stack fetches them with a single
+    /// recvmmsg(2) call and, where the kernel supports it, has UDP_GRO
+    /// coalesce consecutive datagrams of a flow; coalesced datagrams are
+    /// split again before they are returned.
+    future<std::vector<datagram>> receive_batch(size_t max_datagrams = 32);
+    /// Sends several datagrams
+    ///
+    /// The posix stack hands them to the kernel with as few sendmmsg(2)
+    /// calls as possible and, where the kernel supports it, sends runs of
+    /// equally sized datagrams to the same destination as one UDP_SEGMENT
+    /// (GSO) message.
+    future<> send_batch(std::vector<outgoing_datagram> datagrams);
     bool is_closed() const;
     /// Causes a pending receive() to complete (possibly with an exception)
     void shutdown_input();
@@ -229,6 +251,59 @@ class connected_socket {
     /// Linux users should refer to protocol-specific manuals
     /// to see available options, e.g. tcp(7), ip(7), etc.
     int get_sockopt(int level, int optname, void* data, size_t len) const;
+    /// Enables zero-copy transmission (MSG_ZEROCOPY) for large writes
+    ///
+    /// Writes of at least \c threshold bytes are handed to the kernel
+    /// without copying; their buffers are kept alive until the kernel
+    /// reports completion, and closing the output stream waits for all
+    /// such completions. Smaller writes are copied as usual, since page
+    /// pinning costs more than the copy for them.
+    ///
+    /// Must be called before \ref output().
+    ///
+    /// \param threshold minimal write size, in bytes, sent without copying
+    /// \return whether zero-copy transmission is supported and was enabled
+    bool enable_zerocopy_send(size_t threshold = 16384);
+    /// Limits the output queued in the socket but not yet sent
+    ///
+    /// Sets TCP_NOTSENT_LOWAT, and makes writes to the output stream wait,
+    /// before handing data to the kernel, until fewer than \c bytes written
+    /// earlier remain unsent. Without it the socket send buffer accepts data
+    /// long before it can be transmitted, keeping it in memory and out of
+    /// reach of the application's prioritization; with it, writers are held
+    /// back until the socket is about to run out of data to send.
+    ///
+    /// Must be called before \ref output().
+    ///
+    /// \param bytes the amount of unsent data above which writes wait
+    /// \return whether the option is supported by the socket and was set
+    bool set_notsent_lowat(size_t bytes);
+    /// Records the arrival time of the data received
+    ///
+    /// The posix stack asks the kernel for receive timestamps
+    /// (SO_TIMESTAMPING), taken by the NIC when the interface was set up to
+    /// stamp packets (SIOCSHWTSTAMP) and by the kernel otherwise; hardware
+    /// timestamps are those of the NIC clock, expected to be synchronized
+    /// to the system clock (by phc2sys, say). The native stack uses the
+    /// timestamps of devices that stamp packets, see
+    /// \ref last_rx_timestamp().
+    ///
+    /// Must be called before \ref input().
+    ///
+    /// \return whether the socket can report receive timestamps
+    bool enable_rx_timestamps();
+    /// When the data the input stream read last arrived
+    ///
+    /// For the latency from the wire to the code handling a request: the
+    /// time the data of the last buffer the input stream got from the
+    /// socket was received by the NIC, or the kernel (a buffer made of
+    /// several packets has the time of one of them). Data the stream reads
+    /// ahead makes it later than that of the requests parsed from the
+    /// buffers it read before.
+    ///
+    /// \return the timestamp, or std::nullopt when \ref enable_rx_timestamps()
+    ///         was not called or the data came without one
+    std::optional<std::chrono::system_clock::time_point> last_rx_timestamp() const noexcept;
     /// Local address of the socket
     socket_address local_address() const noexcept;
     /// Remote address of the socket
@@ -338,6 +413,13 @@ class server_socket {
         port,
         // This algorithm distributes all new connections to listen_options::fixed_cpu shard only.
         fixed,
+        // This algorithm has every shard accept connections on a listening socket of its own
+        // (SO_REUSEPORT), which the kernel prefers (SO_INCOMING_CPU) for connections whose packets
+        // it receives on the CPU the shard runs on. Connections are thus accepted and processed on
+        // the shard handling their NIC interrupts, and not moved across shards. All shards must
+        // listen. The posix stack falls back to connection_distribution when shards are not pinned
+        // to CPUs; connections received on other CPUs are spread by hash of their addresses.
+        incoming_cpu,
         default_ = connection_distribution
     };
     /// Constructs a \c server_socket without being bound to any address
@@ -396,6 +478,9 @@ struct listen_options {
     int listen_backlog = 100;
     unsigned fixed_cpu = 0u;
     std::optional<file_permissions> unix_domain_socket_permissions;
+    /// TCP congestion control algorithm of the accepted connections, or
+    /// empty for the stack's default one
+    sstring congestion_control;
     void set_fixed_cpu(unsigned cpu) {
         lba = server_socket::load_balancing_algorithm::fixed;
         fixed_cpu = cpu;
@@ -23,10 +23,12 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <chrono>
 #include <unordered_map>
 #endif
 #include <seastar/net/net.hh>
 #include <seastar/core/byteorder.hh>
+#include <seastar/core/lowres_clock.hh>
 #include <seastar/net/ethernet.hh>
 #include <seastar/util/modules.hh>
 
@@ -86,11 +88,29 @@ class arp {
     friend class arp_for;
 };
 
+/// Resolves the addresses of neighbors, with ARP for IPv4.
+///
+/// Learned addresses are used for \ref reachable_time, and refreshed by
+/// the lookups made in the last \ref refresh_time of it, so that the
+/// neighbors in use do not expire. Addresses that did not resolve after
+/// \ref max_queries queries fail lookups for \ref unreachable_time,
+/// without new queries.
+///
+/// Each shard has its own instance. Once shared across shards (see
+/// share()), only the shard owning an address (by its hash) queries it,
+/// for the others, and the replies are learned on all shards: a burst of
+/// misses on all shards sends a single query per address.
 template <typename L3>
 class arp_for : public arp_for_protocol {
 public:
     using l2addr = ethernet_address;
     using l3addr = typename L3::address_type;
+    using clock_type = lowres_clock;
+    static constexpr std::chrono::seconds reachable_time{60};
+    static constexpr std::chrono::seconds refresh_time{15};
+    static constexpr std::chrono::seconds unreachable_time{5};
+    static constexpr std::chrono::seconds query_interval{1};
+    static constexpr unsigned max_queries = 3;
 private:
     static constexpr auto max_waiters = 512;
     enum oper {
@@ -136,31 +156,57 @@ class arp_for : public arp_for_protocol {
             return 8 + 2 * (l2addr::size() + l3addr::size());
         }
     };
+    struct entry {
+        l2addr l2;
+        clock_type::time_point expiry;
+        // When a refresh query was last sent
+        clock_type::time_point refreshed;
+    };
     struct resolution {
         std::vector<promise<l2addr>> _waiters;
+        // Armed while queries are sent
         timer<> _timeout_timer;
+        unsigned _queries = 0;
     };
 private:
     l3addr _l3self = L3::broadcast_address();
-    std::unordered_map<l3addr, l2addr> _table;
+    std::unordered_map<l3addr, entry> _table;
     std::unordered_map<l3addr, resolution> _in_progress;
+    // The addresses that did not resolve, until when they are not queried
+    std::unordered_map<l3addr, clock_type::time_point> _unreachable;
+    bool _shared = false;
 private:
     packet make_query_packet(l3addr paddr);
     virtual future<> received(packet p) override;
     future<> handle_request(arp_hdr* ah);
     l2addr l2self() const noexcept { return _arp.l2self(); }
     void send(l2addr to, packet p);
+    // Has the address queried, by the shard owning it if shared
+    void query(const l3addr& paddr);
+    void refresh(const l3addr& paddr, entry& e, clock_type::time_point now);
+    resolution& resolve(const l3addr& paddr);
+    static entry static_entry(l2addr l2) {
+        return entry{l2, clock_type::time_point::max(), {}};
+    }
 public:
     future<> send_query(const l3addr& paddr);
     explicit arp_for(arp& a) : arp_for_protocol(a, L3::arp_protocol_type()) {
-        _table[L3::broadcast_address()] = ethernet::broadcast_address();
+        _table[L3::broadcast_address()] = static_entry(ethernet::broadcast_address());
     }
     future<ethernet_address> lookup(const l3addr& addr);
     void learn(l2addr l2, l3addr l3);
+    /// Has the instances of all shards share their resolutions, through
+    /// arp_learn() and arp_query()
+    void share() noexcept {
+        _shared = true;
+    }
+    /// Resolves the address on behalf of another shard, which misses it
+    /// or needs it refreshed; the reply is learned on all shards.
+    void resolve_for_shard(const l3addr& paddr);
     void run();
     void set_self_addr(l3addr addr) {
         _table.erase(_l3self);
-        _table[addr] = l2self();
+        _table[addr] = static_entry(l2self());
         _l3self = addr;
     }
     friend class arp;
@@ -213,30 +259,73 @@ class arp_queue_full_error : public arp_error {
 };
 
 template <typename L3>
-future<ethernet_address>
-arp_for<L3>::lookup(const l3addr& paddr) {
-    auto i = _table.find(paddr);
-    if (i != _table.end()) {
-        return make_ready_future<ethernet_address>(i->second);
+void arp_for<L3>::query(const l3addr& paddr) {
+    auto owner = std::hash<l3addr>()(paddr) % smp::count;
+    if (_shared && owner != this_shard_id()) {
+        arp_query(owner, paddr);
+    } else {
+        // FIXME: future is discarded
+        (void)send_query(paddr);
     }
-    auto j = _in_progress.find(paddr);
-    auto first_request = j == _in_progress.end();
-    auto& res = first_request ? _in_progress[paddr] : j->second;
+}
 
-    if (first_request) {
+template <typename L3>
+void arp_for<L3>::refresh(const l3addr& paddr, entry& e, clock_type::time_point now) {
+    if (now - e.refreshed >= query_interval) {
+        e.refreshed = now;
+        query(paddr);
+    }
+}
+
+template <typename L3>
+auto arp_for<L3>::resolve(const l3addr& paddr) -> resolution& {
+    auto& res = _in_progress[paddr];
+    if (!res._timeout_timer.armed()) {
+        res._queries = 1;
         res._timeout_timer.set_callback([paddr, this, &res] {
-            // FIXME: future is discarded
-            (void)send_query(paddr);
             for (auto& w : res._waiters) {
                 w.set_exception(arp_timeout_error());
             }
             res._waiters.clear();
+            if (res._queries++ == max_queries) {
+                // Kept until learned or resolved again, as the timer
+                // can not be destroyed from its callback
+                res._timeout_timer.cancel();
+                _unreachable[paddr] = clock_type::now() + unreachable_time;
+                return;
+            }
+            query(paddr);
         });
-        res._timeout_timer.arm_periodic(std::chrono::seconds(1));
-        // FIXME: future is discarded
-        (void)send_query(paddr);
+        res._timeout_timer.arm_periodic(query_interval);
+        query(paddr);
     }
+    return res;
+}
 
+template <typename L3>
+future<ethernet_address>
+arp_for<L3>::lookup(const l3addr& paddr) {
+    auto now = clock_type::now();
+    auto i = _table.find(paddr);
+    if (i != _table.end()) {
+        auto& e = i->second;
+        if (now < e.expiry) {
+            if (now >= e.expiry - refresh_time) {
+                refresh(paddr, e, now);
+            }
+            return make_ready_future<ethernet_address>(e.l2);
+        }
+        _table.erase(i);
+    }
+    auto u = _unreachable.find(paddr);
+    if (u != _unreachable.end()) {
+        if (now < u->second) {
+            return make_exception_future<ethernet_address>(arp_timeout_error());
+        }
+        _unreachable.erase(u);
+    }
+
+    auto& res = resolve(paddr);
     if (res._waiters.size() >= max_waiters) {
         return make_exception_future<ethernet_address>(arp_queue_full_error());
     }
@@ -245,10 +334,28 @@ arp_for<L3>::lookup(const l3addr& paddr) {
     return res._waiters.back().get_future();
 }
 
+template <typename L3>
+void arp_for<L3>::resolve_for_shard(const l3addr& paddr) {
+    auto now = clock_type::now();
+    auto i = _table.find(paddr);
+    if (i != _table.end() && now < i->second.expiry) {
+        refresh(paddr, i->second, now);
+        return;
+    }
+    auto u = _unreachable.find(paddr);
+    if (u != _unreachable.end() && now < u->second) {
+        return;
+    }
+    resolve(paddr);
+}
+
 template <typename L3>
 void
 arp_for<L3>::learn(l2addr hwaddr, l3addr paddr) {
-    _table[paddr] = hwaddr;
+    auto& e = _table[paddr];
+    e.l2 = hwaddr;
+    e.expiry = clock_type::now() + reachable_time;
+    _unreachable.erase(paddr);
     auto i = _in_progress.find(paddr);
     if (i != _in_progress.end()) {
         auto& res = i->second;
@@ -275,7 +382,11 @@ arp_for<L3>::received(packet p) {
     case op_request:
         return handle_request(&h);
     case op_reply:
-        arp_learn(h.sender_hwaddr, h.sender_paddr);
+        if (_shared) {
+            arp_learn(h.sender_hwaddr, h.sender_paddr);
+        } else {
+            learn(h.sender_hwaddr, h.sender_paddr);
+        }
         return make_ready_future<>();
     default:
         return make_ready_future<>();
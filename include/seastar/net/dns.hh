@@ -21,9 +21,11 @@
 
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <optional>
 #include <seastar/util/std-compat.hh>
 
 #include <seastar/core/future.hh>
@@ -54,6 +56,9 @@ struct hostent {
     std::vector<sstring> names;
     // Primary address is also always first.
     std::vector<inet_address> addr_list;
+    // The time the addresses may be cached for, the lowest of theirs,
+    // when the resolver tells
+    std::optional<std::chrono::seconds> ttl;
 };
 
 typedef std::optional<inet_address::family> opt_family;
@@ -86,6 +91,39 @@ class dns_resolver {
             tcp_port, udp_port;
         std::optional<std::vector<sstring>>
             domains;
+        // The most answers cached, for each kind of query; 0 disables
+        // the cache. Answers are kept for their TTL, those without one
+        // are not kept. Concurrent identical queries share one upstream
+        // query either way. Defaults to 1024.
+        std::optional<size_t>
+            cache_size;
+        // The longest an answer is kept for, whatever its TTL.
+        // Defaults to 5 minutes.
+        std::optional<std::chrono::seconds>
+            cache_max_ttl;
+        // How long names that do not exist, or do not have the records
+        // asked for, are remembered as such; 0 disables it. Defaults
+        // to 5 seconds.
+        std::optional<std::chrono::seconds>
+            negative_ttl;
+        // The fraction of its TTL below which a cached answer is
+        // queried again in the background when asked for, for hot names
+        // never to expire; 0 disables it. Defaults to 0.1.
+        std::optional<double>
+            prefetch_ratio;
+    };
+
+    struct cache_stats {
+        // Queries answered from the cache
+        uint64_t hits = 0;
+        // Queries answered from the cache that the name does not exist
+        uint64_t negative_hits = 0;
+        // Queries sent upstream
+        uint64_t misses = 0;
+        // Queries that waited for an identical one in flight
+        uint64_t coalesced = 0;
+        // Cached answers queried again before they expire
+        uint64_t prefetches = 0;
     };
 
     enum class srv_proto {
@@ -130,6 +168,8 @@ class dns_resolver {
      * Shuts the object down. Great for tests.
      */
     future<> close();
+
+    const cache_stats& get_cache_stats() const noexcept;
 private:
     class impl;
     shared_ptr<impl> _impl;
@@ -149,6 +189,12 @@ future<std::vector<srv_record>> get_srv_records(dns_resolver::srv_proto proto,
                                                 const sstring& service,
                                                 const sstring& domain);
 
+// Makes the default resolvers of all the shards share their caches: only
+// the resolver of the shard a name hashes to queries it upstream, the
+// others ask that one, and keep its answer for what is left of its TTL.
+// Call it once, on any shard.
+future<> share_cache_across_shards();
+
 }
 
 }
@@ -0,0 +1,253 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/byteorder.hh>
+#include <seastar/net/const.hh>
+#include <seastar/net/ip_checksum.hh>
+#include <seastar/net/packet.hh>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+namespace seastar {
+
+namespace net {
+
+/// Software generic receive offload, for devices without LRO.
+///
+/// Merges the in-order TCP segments of a flow, received back to back
+/// from the device, into a single packet before they are handed to the
+/// stack, so that IP and TCP input run once per burst rather than per
+/// segment. Frames are held until \ref flush(), which the interface
+/// calls once per poll of the device, or until a frame of the same flow
+/// that can not be merged arrives.
+///
+/// Only plain IPv4 ACK segments with data, with the same options,
+/// acknowledgment and window are merged; anything else, such as SYN, FIN
+/// or RST segments, fragments or pure ACKs, flushes its flow and is
+/// passed on as is, keeping the order of each flow's frames. The merged
+/// packet keeps the first segment's headers, with the IP length updated;
+/// the TCP checksum is not, so that GRO is only to be used when the device
+/// verifies checksums.
+class gro {
+    static constexpr uint8_t tcp_ack = 0x10;
+    static constexpr uint8_t tcp_psh = 0x08;
+public:
+    static constexpr unsigned max_flows = 8;
+private:
+    struct flow_key {
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint16_t src_port;
+        uint16_t dst_port;
+        bool operator==(const flow_key&) const = default;
+    };
+    struct segment {
+        flow_key key;
+        uint32_t seq;
+        uint32_t ack;
+        uint16_t window;
+        size_t hdr_len;
+        uint8_t flags;
+        size_t payload_len;
+        const char* hdr;
+    };
+    struct held_flow {
+        flow_key key;
+        packet p;
+        uint32_t next_seq;
+        unsigned segments;
+    };
+    std::array<std::optional<held_flow>, max_flows> _flows;
+    unsigned _nr_held = 0;
+    // The slot to evict when all are taken
+    unsigned _next_evict = 0;
+    uint64_t _merged = 0;
+
+    static std::optional<segment> parse(packet& p) {
+        auto eh = p.get_header(0, eth_hdr_len + ipv4_hdr_len_min + tcp_hdr_len_min);
+        if (!eh) {
+            return std::nullopt;
+        }
+        auto ip = eh + eth_hdr_len;
+        // IPv4, with no options, not fragmented, carrying TCP
+        if (read_be<uint16_t>(eh + 12) != uint16_t(eth_protocol_num::ipv4)
+                || uint8_t(ip[0]) != 0x45
+                || (read_be<uint16_t>(ip + 6) & 0x3fff)
+                || uint8_t(ip[9]) != uint8_t(ip_protocol_num::tcp)) {
+            return std::nullopt;
+        }
+        auto tcp = ip + ipv4_hdr_len_min;
+        size_t tcp_len = (uint8_t(tcp[12]) >> 4) * 4;
+        size_t ip_len = read_be<uint16_t>(ip + 2);
+        if (tcp_len < tcp_hdr_len_min || ip_len < ipv4_hdr_len_min + tcp_len || p.len() != eth_hdr_len + ip_len) {
+            return std::nullopt;
+        }
+        segment s;
+        s.hdr_len = eth_hdr_len + ipv4_hdr_len_min + tcp_len;
+        s.flags = tcp[13];
+        s.payload_len = ip_len - ipv4_hdr_len_min - tcp_len;
+        if ((s.flags & ~tcp_psh) != tcp_ack || !s.payload_len) {
+            return std::nullopt;
+        }
+        auto hdr = p.get_header(0, s.hdr_len);
+        if (!hdr) {
+            return std::nullopt;
+        }
+        s.hdr = hdr;
+        ip = hdr + eth_hdr_len;
+        tcp = ip + ipv4_hdr_len_min;
+        s.key = {read_be<uint32_t>(ip + 12), read_be<uint32_t>(ip + 16), read_be<uint16_t>(tcp), read_be<uint16_t>(tcp + 2)};
+        s.seq = read_be<uint32_t>(tcp + 4);
+        s.ack = read_be<uint32_t>(tcp + 8);
+        s.window = read_be<uint16_t>(tcp + 14);
+        return s;
+    }
+
+    // Whether s continues the segments held for its flow
+    static bool mergeable(held_flow& f, const segment& s) {
+        auto hdr = f.p.get_header(0, s.hdr_len);
+        if (!hdr || s.seq != f.next_seq) {
+            return false;
+        }
+        auto ip = hdr + eth_hdr_len;
+        auto tcp = ip + ipv4_hdr_len_min;
+        auto s_tcp = s.hdr + eth_hdr_len + ipv4_hdr_len_min;
+        return (uint8_t(tcp[12]) >> 4) == (uint8_t(s_tcp[12]) >> 4)
+                && read_be<uint32_t>(tcp + 8) == s.ack
+                && read_be<uint16_t>(tcp + 14) == s.window
+                // Same source MAC address
+                && std::memcmp(hdr + 6, s.hdr + 6, 6) == 0
+                && std::memcmp(tcp + tcp_hdr_len_min, s_tcp + tcp_hdr_len_min, s.hdr_len - eth_hdr_len - ipv4_hdr_len_min - tcp_hdr_len_min) == 0
+                && read_be<uint16_t>(ip + 2) + s.payload_len <= ip_packet_len_max;
+    }
+
+    template <typename Deliver>
+    void release(std::optional<held_flow>& f, Deliver& deliver) {
+        if (f->segments > 1) {
+            auto ip = f->p.get_header(eth_hdr_len, ipv4_hdr_len_min);
+            write_be<uint16_t>(ip + 2, f->p.len() - eth_hdr_len);
+            write_be<uint16_t>(ip + 10, 0);
+            checksummer csum;
+            csum.sum(ip, ipv4_hdr_len_min);
+            // Already in network byte order
+            auto c = csum.get();
+            std::memcpy(ip + 10, &c, sizeof(c));
+        }
+        auto p = std::move(f->p);
+        f.reset();
+        --_nr_held;
+        deliver(std::move(p));
+    }
+public:
+    /// Takes a frame from the device, and delivers it, or the frames
+    /// it is merged into or causes to be flushed, by calling
+    /// \c deliver(packet)
+    template <typename Deliver>
+    void receive(packet p, Deliver&& deliver) {
+        auto s = parse(p);
+        if (!s) {
+            // Keep the order of the flow, if it is one held
+            auto eh = p.get_header(0, eth_hdr_len + ipv4_hdr_len_min + tcp_hdr_len_min);
+            if (_nr_held && eh && read_be<uint16_t>(eh + 12) == uint16_t(eth_protocol_num::ipv4)
+                    && uint8_t(eh[eth_hdr_len + 9]) == uint8_t(ip_protocol_num::tcp)) {
+                auto ip = eh + eth_hdr_len;
+                auto tcp = ip + (uint8_t(ip[0]) & 0xf) * 4;
+                if (size_t(tcp - eh) + 4 <= eth_hdr_len + ipv4_hdr_len_min + tcp_hdr_len_min) {
+                    flow_key key{read_be<uint32_t>(ip + 12), read_be<uint32_t>(ip + 16), read_be<uint16_t>(tcp), read_be<uint16_t>(tcp + 2)};
+                    for (auto& f : _flows) {
+                        if (f && f->key == key) {
+                            release(f, deliver);
+                        }
+                    }
+                }
+            }
+            deliver(std::move(p));
+            return;
+        }
+        std::optional<held_flow>* free_slot = nullptr;
+        for (auto& f : _flows) {
+            if (!f) {
+                free_slot = free_slot ? free_slot : &f;
+                continue;
+            }
+            if (f->key != s->key) {
+                continue;
+            }
+            if (mergeable(*f, *s)) {
+                bool psh = s->flags & tcp_psh;
+                p.trim_front(s->hdr_len);
+                f->p.append(std::move(p));
+                f->next_seq += s->payload_len;
+                f->segments++;
+                _merged++;
+                if (psh) {
+                    // Carry the PSH, and do not hold the data back
+                    auto tcp = f->p.get_header(eth_hdr_len + ipv4_hdr_len_min, tcp_hdr_len_min);
+                    tcp[13] |= tcp_psh;
+                    release(f, deliver);
+                }
+                return;
+            }
+            release(f, deliver);
+            free_slot = &f;
+            break;
+        }
+        if (!free_slot) {
+            free_slot = &_flows[_next_evict];
+            _next_evict = (_next_evict + 1) % max_flows;
+            release(*free_slot, deliver);
+        }
+        if (s->flags & tcp_psh) {
+            deliver(std::move(p));
+            return;
+        }
+        *free_slot = held_flow{s->key, std::move(p), s->seq + uint32_t(s->payload_len), 1};
+        ++_nr_held;
+    }
+
+    /// Delivers all the frames held
+    template <typename Deliver>
+    bool flush(Deliver&& deliver) {
+        if (!_nr_held) {
+            return false;
+        }
+        for (auto& f : _flows) {
+            if (f) {
+                release(f, deliver);
+            }
+        }
+        return true;
+    }
+
+    /// Number of segments merged into a previous one
+    uint64_t merged() const noexcept {
+        return _merged;
+    }
+};
+
+}
+
+}
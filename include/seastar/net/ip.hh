@@ -357,6 +357,14 @@ class ipv4 {
     void learn(ethernet_address l2, ipv4_address l3) {
         _arp.learn(l2, l3);
     }
+    /// \see arp_for::share()
+    void share_arp() noexcept {
+        _arp.share();
+    }
+    /// \see arp_for::resolve_for_shard()
+    void arp_resolve_for_shard(ipv4_address l3) {
+        _arp.resolve_for_shard(l3);
+    }
     void register_packet_provider(ipv4_traits::packet_provider_type&& func) {
         _pkt_providers.push_back(std::move(func));
     }
@@ -418,6 +426,8 @@ struct l4connid<InetTraits>::connid_hash : private std::hash<ipaddr>, private st
 };
 
 void arp_learn(ethernet_address l2, ipv4_address l3);
+// Has the native stack of shard cpu resolve the address
+void arp_query(unsigned cpu, ipv4_address l3);
 
 }
 
@@ -31,6 +31,25 @@
 
 namespace seastar {
 
+namespace internal {
+
+// The instruction sets checksummer::sum() can use for long data. The best
+// one the CPU supports is picked on first use.
+enum class checksum_isa {
+    scalar,
+    sse2,
+    avx2,
+    avx512,
+    neon,
+};
+
+// Makes checksummer::sum() use the given instruction set, for tests and
+// benchmarks. Returns false, leaving it unchanged, if the CPU (or the
+// build's architecture) does not support it.
+bool use_checksum_isa(checksum_isa isa) noexcept;
+
+}
+
 namespace net {
 
 uint16_t ip_checksum(const void* data, size_t len);
@@ -24,6 +24,7 @@
 #include <seastar/net/net.hh>
 #include <seastar/net/virtio.hh>
 #include <seastar/net/dpdk.hh>
+#include <seastar/net/xdp.hh>
 #include <seastar/util/program-options.hh>
 
 namespace seastar {
@@ -76,6 +77,31 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// Default: \p on.
     program_options::value<std::string> lro;
+    /// \brief Enable GRO, merging received TCP segments in software,
+    /// for devices without LRO (on/off).
+    ///
+    /// Default: \p on.
+    program_options::value<std::string> gro;
+    /// \brief TCP congestion control algorithm (reno/cubic/bbr).
+    ///
+    /// Default: \p reno.
+    program_options::value<std::string> tcp_congestion_control;
+    /// \brief Negotiate TCP SACK, and recover from losses with it and
+    /// RACK-TLP (on/off).
+    ///
+    /// Default: \p off.
+    program_options::value<std::string> tcp_sack;
+    /// \brief Memory the TCP connections of a shard may buffer the data
+    /// received and not read yet in (e.g. 512M).
+    ///
+    /// Default: a quarter of the shard's memory.
+    program_options::value<std::string> tcp_receive_memory;
+    /// \brief How long to hold the packets to send, for more of them to
+    /// be sent in a single burst (in microseconds, 0 to send them at
+    /// every poll).
+    ///
+    /// Default: \p 0.
+    program_options::value<unsigned> tx_batch_delay_us;
 
     /// Virtio configuration.
     virtio_options virtio_opts;
@@ -83,6 +109,8 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// \note Unused when seastar is compiled without DPDK support.
     dpdk_options dpdk_opts;
+    /// AF_XDP configuration.
+    xdp_options xdp_opts;
 
     /// \cond internal
     bool _hugepages;
@@ -30,6 +30,8 @@
 #include <seastar/net/ethernet.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/net/const.hh>
+#include <seastar/net/gro.hh>
+#include <chrono>
 #include <unordered_map>
 
 namespace seastar {
@@ -85,6 +87,8 @@ struct hw_features {
     bool tx_tso = false;
     // Enable tx UDP fragmentation offload
     bool tx_ufo = false;
+    // The NIC stamps received packets with their arrival time
+    bool rx_timestamps = false;
     // Maximum Transmission Unit
     uint16_t mtu = 1500;
     // Maximun packet len when TCP/UDP offload is enabled
@@ -123,10 +127,25 @@ class interface {
     ethernet_address _hw_address;
     net::hw_features _hw_features;
     std::vector<l3_protocol::packet_provider_type> _pkt_providers;
+    std::optional<gro> _gro;
+    std::unique_ptr<internal::poller> _gro_poller;
+    struct {
+        // Packets passed on to another shard
+        uint64_t forwarded = 0;
+        // Packets dropped since too many were in flight to other shards
+        uint64_t forward_dropped = 0;
+    } _forward_stats;
+    metrics::metric_groups _metrics;
 private:
     future<> dispatch_packet(packet p);
+    void deliver_packet(packet p);
 public:
     explicit interface(std::shared_ptr<device> dev);
+    ~interface();
+    /// Merges the TCP segments received from the device in software,
+    /// unless the device does so itself (LRO) or can not verify their
+    /// checksums
+    void enable_gro();
     ethernet_address hw_address() const noexcept { return _hw_address; }
     const net::hw_features& hw_features() const { return _hw_features; }
     future<> register_l3(eth_protocol_num proto_num,
@@ -139,6 +158,10 @@ class interface {
     }
     uint16_t hw_queues_count();
     rss_key_type rss_key() const;
+    /// \see device::steer_tcp_port()
+    bool steer_tcp_port(uint16_t port, unsigned cpu);
+    /// \see device::unsteer_tcp_port()
+    void unsteer_tcp_port(uint16_t port);
     friend class l3_protocol;
 };
 
@@ -216,6 +239,8 @@ struct qp_stats {
 };
 
 class qp {
+    // The packets queued for a burst to be sent before _tx_batch_delay
+    static constexpr size_t tx_batch_size = 32;
     using packet_provider_type = std::function<std::optional<packet> ()>;
     std::vector<packet_provider_type> _pkt_providers;
     std::optional<std::array<uint8_t, 128>> _sw_reta;
@@ -223,6 +248,9 @@ class qp {
     stream<packet> _rx_stream;
     std::unique_ptr<internal::poller> _tx_poller;
     circular_buffer<packet> _tx_packetq;
+    std::chrono::steady_clock::duration _tx_batch_delay{0};
+    // When the oldest of the packets held in _tx_packetq was queued
+    std::optional<std::chrono::steady_clock::time_point> _tx_held_since;
 
 protected:
     const std::string _stats_plugin_name;
@@ -247,6 +275,12 @@ class qp {
         return sent;
     }
     virtual void rx_start() {};
+    /// Holds the packets to send for up to \c delay, until enough of
+    /// them are queued to be worth a burst (and a doorbell) of their own,
+    /// rather than sending what is queued at every poll. Zero disables it.
+    void set_tx_batch_delay(std::chrono::steady_clock::duration delay) noexcept {
+        _tx_batch_delay = delay;
+    }
     void configure_proxies(const std::map<unsigned, float>& cpu_weights);
     // build REdirection TAble for cpu_weights map: target cpu -> weight
     void build_sw_reta(const std::map<unsigned, float>& cpu_weights);
@@ -285,6 +319,14 @@ class device {
     virtual unsigned hash2qid(uint32_t hash) {
         return hash % hw_queues_count();
     }
+    /// Has the device deliver the TCP segments to a local port to the
+    /// queue of the given shard, rather than to the one RSS picks for
+    /// their flow, so that they need not be forwarded to it.
+    ///
+    /// \return whether the device does so
+    virtual bool steer_tcp_port(uint16_t port, unsigned cpu) { return false; }
+    /// Undoes steer_tcp_port()
+    virtual void unsteer_tcp_port(uint16_t port) {}
     void set_local_queue(std::unique_ptr<qp> dev);
     template <typename Func>
     unsigned forward_dst(unsigned src_cpuid, Func&& hashfn) {
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <seastar/core/deleter.hh>
+#include <seastar/core/fragmented_buffer.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/net/const.hh>
 #include <seastar/util/std-compat.hh>
@@ -29,6 +30,7 @@
 #ifndef SEASTAR_MODULE
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <iosfwd>
@@ -59,6 +61,9 @@ struct offload_info {
     uint16_t tso_seg_size = 0;
     // HW stripped VLAN header (CPU order)
     std::optional<uint16_t> vlan_tci;
+    // When the NIC received the packet, if it stamps them
+    // (hw_features::rx_timestamps)
+    std::optional<std::chrono::system_clock::time_point> rx_timestamp;
 };
 
 // Zero-copy friendly packet class
@@ -226,6 +231,8 @@ class packet final {
     packet(packet&& x, temporary_buffer<char> buf);
     // create from temporary_buffer (zero-copy)
     packet(temporary_buffer<char> buf);
+    // create from the fragments of a fragmented_buffer (zero-copy)
+    explicit packet(const fragmented_buffer& buf);
     // append deleter
     packet(packet&& x, deleter d);
 
@@ -491,6 +498,17 @@ inline
 packet::packet(temporary_buffer<char> buf)
     : packet(fragment{buf.get_write(), buf.size()}, buf.release()) {}
 
+inline
+packet::packet(const fragmented_buffer& buf)
+    : packet(buf.fragment_count()) {
+    auto bufs = buf.share_fragments();
+    for (auto& b : bufs) {
+        _impl->_frags[_impl->_nr_frags++] = {b.get_write(), b.size()};
+    }
+    _impl->_len = buf.size();
+    _impl->_deleter = make_object_deleter(std::move(bufs));
+}
+
 inline
 void packet::append(packet&& p) {
     if (!_impl->_len) {
@@ -21,7 +21,14 @@
 
 #pragma once
 #ifndef SEASTAR_MODULE
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <optional>
 #include <unordered_set>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
 #endif
 #include <seastar/core/sharded.hh>
 #include <seastar/core/internal/pollable_fd.hh>
@@ -109,15 +116,25 @@ class conntrack {
 };
 
 class posix_data_source_impl final : public data_source_impl, private internal::buffer_allocator {
+public:
+    using rx_timestamp = lw_shared_ptr<std::optional<std::chrono::system_clock::time_point>>;
+private:
     std::pmr::polymorphic_allocator<char>* _buffer_allocator;
     pollable_fd _fd;
     connected_socket_input_stream_config _config;
+    // Set with the SCM_TIMESTAMPING of each read, when enabled
+    rx_timestamp _rx_timestamp;
+    ::iovec _iov;
+    ::msghdr _mh;
+    alignas(::cmsghdr) char _control[CMSG_SPACE(sizeof(::scm_timestamping))];
 private:
     virtual temporary_buffer<char> allocate_buffer() override;
+    void adjust_buffer_size(size_t received) noexcept;
+    future<temporary_buffer<char>> get_timestamped();
 public:
     explicit posix_data_source_impl(pollable_fd fd, connected_socket_input_stream_config config,
-            std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator)
-            : _buffer_allocator(allocator), _fd(std::move(fd)), _config(config) {
+            std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator, rx_timestamp rx_ts = {})
+            : _buffer_allocator(allocator), _fd(std::move(fd)), _config(config), _rx_timestamp(std::move(rx_ts)) {
     }
     future<temporary_buffer<char>> get() override;
     future<> close() override;
@@ -126,14 +143,26 @@ class posix_data_source_impl final : public data_source_impl, private internal::
 class posix_data_sink_impl : public data_sink_impl {
     pollable_fd _fd;
     packet _p;
+    // MSG_ZEROCOPY bookkeeping, only present when zero-copy send is enabled
+    struct zerocopy_state;
+    std::unique_ptr<zerocopy_state> _zc;
+    // TCP_NOTSENT_LOWAT of the socket, when writes wait for it
+    std::optional<size_t> _notsent_lowat;
 public:
-    explicit posix_data_sink_impl(pollable_fd fd) : _fd(std::move(fd)) {}
+    explicit posix_data_sink_impl(pollable_fd fd, std::optional<size_t> zerocopy_threshold = std::nullopt,
+            std::optional<size_t> notsent_lowat = std::nullopt);
+    ~posix_data_sink_impl();
     using data_sink_impl::put;
     future<> put(packet p) override;
     future<> put(temporary_buffer<char> buf) override;
+    future<> put_file(file f, uint64_t offset, size_t len) override;
     future<> close() override;
     bool can_batch_flushes() const noexcept override { return true; }
     void on_batch_flush_error() noexcept override;
+private:
+    future<> put_zerocopy(packet p);
+    void reap_zerocopy_completions() noexcept;
+    bool must_wait_for_send_room() const noexcept;
 };
 
 class posix_ap_server_socket_impl : public server_socket_impl {
@@ -0,0 +1,73 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#endif
+#include <seastar/net/api.hh>
+
+namespace seastar {
+
+namespace net {
+
+/// \addtogroup networking-module
+/// @{
+
+/// Options of a connection over shared memory, see \ref make_shm_socket()
+struct shm_options {
+    /// The size of each of the two rings of the connection, the most data
+    /// sent and not yet received in either direction; a power of two
+    size_t ring_size = 1 << 20;
+};
+
+/// \brief Listens for connections over shared memory from the same host.
+///
+/// A connection over shared memory is a memfd both ends map, holding a ring
+/// for each direction, which the client creates and passes to the server
+/// over a unix domain socket, at \c addr. The data goes through the rings
+/// without system calls; the unix domain socket only wakes up an end
+/// waiting for data or for room in a ring, and tells an end the other one
+/// is gone, even if its process died.
+///
+/// The connections are used as TCP ones, by RPC in particular, whose
+/// servers take a \ref server_socket and clients a \ref socket. The TCP
+/// options, as nodelay and keepalive, do nothing on them.
+///
+/// \code
+/// auto addr = socket_address(unix_domain_addr("/run/service.shm"));
+/// rpc_protocol::server server(proto, net::shm_listen(addr));
+/// rpc_protocol::client client(proto, {}, net::make_shm_socket(), addr);
+/// \endcode
+server_socket shm_listen(socket_address addr, listen_options opts = {});
+
+/// A socket connecting over shared memory to a \ref shm_listen() server,
+/// at a unix domain socket address
+///
+/// \throws std::invalid_argument if the ring size is not a power of two
+socket make_shm_socket(shm_options opts = {});
+
+/// @}
+
+}
+
+}
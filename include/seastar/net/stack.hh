@@ -49,6 +49,13 @@ class connected_socket_impl {
     virtual socket_address local_address() const noexcept = 0;
     virtual socket_address remote_address() const noexcept = 0;
     virtual future<> wait_input_shutdown() = 0;
+    virtual bool enable_zerocopy_send(size_t threshold);
+    virtual bool set_notsent_lowat(size_t bytes);
+    virtual bool enable_rx_timestamps();
+    virtual std::optional<std::chrono::system_clock::time_point> last_rx_timestamp() const noexcept;
+    // Sends a non-application record on a socket with kernel TLS transmit
+    // offload enabled (TLS_SET_RECORD_TYPE, see kernel tls.rst)
+    virtual future<> send_tls_control_record(uint8_t record_type, temporary_buffer<char> data);
 };
 
 class socket_impl {
@@ -79,6 +86,8 @@ class datagram_channel_impl {
     virtual future<datagram> receive() = 0;
     virtual future<> send(const socket_address& dst, const char* msg) = 0;
     virtual future<> send(const socket_address& dst, packet p) = 0;
+    virtual future<std::vector<datagram>> receive_batch(size_t max_datagrams);
+    virtual future<> send_batch(std::vector<outgoing_datagram> datagrams);
     virtual void shutdown_input() = 0;
     virtual void shutdown_output() = 0;
     virtual bool is_closed() const = 0;
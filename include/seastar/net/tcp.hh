@@ -25,18 +25,23 @@
 #include <unordered_map>
 #include <map>
 #include <functional>
-#include <deque>
 #include <chrono>
+#include <limits>
+#include <memory>
 #include <random>
 #include <stdexcept>
+#include <string_view>
 #include <system_error>
 #include <gnutls/crypto.h>
 #endif
+#include <seastar/core/circular_buffer.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/byteorder.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/sstring.hh>
 #include <seastar/net/net.hh>
 #include <seastar/net/ip_checksum.hh>
 #include <seastar/net/ip.hh>
@@ -51,6 +56,7 @@ using namespace std::chrono_literals;
 namespace net {
 
 struct tcp_hdr;
+struct tcp_sack_block;
 
 inline auto tcp_error(int err) {
     return std::system_error(err, std::system_category());
@@ -95,8 +101,10 @@ void tcp_debug(const char* fmt, Args&&... args) {
 
 struct tcp_option {
     // The kind and len field are fixed and defined in TCP protocol
-    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, timestamps = 8,  nop = 1, eol = 0 };
-    enum class option_len:  uint8_t { mss = 4, win_scale = 3, sack = 2, timestamps = 10, nop = 1, eol = 1 };
+    // sack is SACK-permitted, sent on SYN; sack_blocks follows it with
+    // 8 bytes per block
+    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, sack_blocks = 5, timestamps = 8,  nop = 1, eol = 0 };
+    enum class option_len:  uint8_t { mss = 4, win_scale = 3, sack = 2, sack_blocks = 2, timestamps = 10, nop = 1, eol = 1 };
     static void write(char* p, option_kind kind, option_len len) {
         p[0] = static_cast<uint8_t>(kind);
         if (static_cast<uint8_t>(len) > 1) {
@@ -173,16 +181,25 @@ struct tcp_option {
         }
     };
     static const uint8_t align = 4;
+    static constexpr uint8_t sack_block_len = 8;
+    // The most that fit in the option space (RFC 2018)
+    static constexpr unsigned max_sack_blocks = 4;
 
     void parse(uint8_t* beg, uint8_t* end);
-    uint8_t fill(void* h, const tcp_hdr* th, uint8_t option_size);
-    uint8_t get_size(bool syn_on, bool ack_on);
+    uint8_t fill(void* h, const tcp_hdr* th, uint8_t option_size,
+                 const tcp_sack_block* sack_blocks = nullptr, unsigned nr_sack_blocks = 0);
+    uint8_t get_size(bool syn_on, bool ack_on, unsigned nr_sack_blocks = 0);
+    // Reads the blocks of a SACK option in [beg, end) into blocks, which
+    // must have room for max_sack_blocks, and returns their number
+    static unsigned parse_sack_blocks(const uint8_t* beg, const uint8_t* end, tcp_sack_block* blocks);
 
     // For option negotiattion
     bool _mss_received = false;
     bool _win_scale_received = false;
     bool _timestamps_received = false;
     bool _sack_received = false;
+    // Whether SACK is offered, and accepted when the peer offers it
+    bool _local_sack = true;
 
     // Option data
     uint16_t _remote_mss = 536;
@@ -224,6 +241,14 @@ inline bool operator>(tcp_seq s, tcp_seq q) { return q < s; }
 inline bool operator<=(tcp_seq s, tcp_seq q) { return !(s > q); }
 inline bool operator>=(tcp_seq s, tcp_seq q) { return !(s < q); }
 
+// A block of data received out of order, as reported by SACK (RFC 2018)
+struct tcp_sack_block {
+    // First sequence number of the block
+    tcp_seq left;
+    // Sequence number following the block
+    tcp_seq right;
+};
+
 struct tcp_hdr {
     static constexpr size_t len = 20;
     uint16_t src_port;
@@ -287,6 +312,58 @@ struct tcp_hdr {
 struct tcp_tag {};
 using tcp_packet_merger = packet_merger<tcp_seq, tcp_tag>;
 
+/// Congestion control algorithm of a native stack TCP connection.
+///
+/// The connection keeps the congestion window and the slow start threshold,
+/// and runs loss recovery (fast retransmit and NewReno fast recovery, RFC
+/// 5681 and RFC 6582, and retransmission timeouts). The algorithm decides
+/// how the window grows as data is acknowledged, how far it backs off on
+/// losses, and whether and how fast the connection paces its segments.
+///
+/// Algorithms are created per connection by make_tcp_congestion_control().
+class tcp_congestion_control {
+public:
+    using clock_type = lowres_clock;
+    /// The connection's window, as the algorithm sees it
+    struct window {
+        /// Congestion window, in bytes
+        uint32_t& cwnd;
+        /// Slow start threshold, in bytes
+        uint32_t& ssthresh;
+        /// Sender maximum segment size
+        uint32_t mss;
+    };
+    virtual ~tcp_congestion_control() = default;
+    /// Name of the algorithm, as passed to make_tcp_congestion_control()
+    virtual const char* name() const noexcept = 0;
+    /// Called as new data is acknowledged
+    virtual void on_ack(window w, uint32_t acked_bytes, clock_type::time_point now) noexcept = 0;
+    /// Called with the round-trip time measured for a segment
+    virtual void on_rtt_sample(std::chrono::milliseconds rtt, clock_type::time_point now) noexcept {}
+    /// Called when duplicate ACKs indicate a loss, before fast recovery
+    /// starts; sets \c w.ssthresh, to which the connection deflates the
+    /// window once it recovers
+    virtual void on_loss(window w, uint32_t flight_size, clock_type::time_point now) noexcept = 0;
+    /// Called when the retransmission timer expires for a segment sent
+    /// once; sets \c w.ssthresh. The connection then restarts from a
+    /// window of one segment.
+    virtual void on_timeout(window w, uint32_t flight_size, clock_type::time_point now) noexcept = 0;
+    /// Rate, in bytes per second, to pace segments to, or 0 not to pace them
+    virtual uint64_t pacing_rate() const noexcept { return 0; }
+};
+
+/// Creates a congestion control algorithm for a native stack TCP connection
+///
+/// \param name one of
+///   * \c "reno": NewReno (RFC 5681), the default;
+///   * \c "cubic": CUBIC (RFC 8312), for links with a large bandwidth-delay product;
+///   * \c "bbr": a BBR-style model-based algorithm, estimating the
+///     bottleneck bandwidth and the minimum round-trip time, which sizes the
+///     window to the bandwidth-delay product, paces segments and does not
+///     back off on isolated losses.
+/// \throws std::invalid_argument for unknown names
+std::unique_ptr<tcp_congestion_control> make_tcp_congestion_control(std::string_view name);
+
 template <typename InetTraits>
 class tcp {
 public:
@@ -325,7 +402,12 @@ class tcp {
             packet p;
             uint16_t data_len;
             unsigned nr_transmits;
+            // Time of the last (re)transmission
             clock_type::time_point tx_time;
+            // Reported received by SACK
+            bool sacked = false;
+            // Deemed lost, and not retransmitted since
+            bool lost = false;
         };
         struct send {
             tcp_seq unacknowledged;
@@ -337,8 +419,9 @@ class tcp {
             tcp_seq wl1;
             tcp_seq wl2;
             tcp_seq initial;
-            std::deque<unacked_segment> data;
-            std::deque<packet> unsent;
+            // Queues of idle connections hold no storage, see compact_queues()
+            circular_buffer<unacked_segment> data;
+            circular_buffer<packet> unsent;
             uint32_t unsent_len = 0;
             bool closed = false;
             promise<> _window_opened;
@@ -359,6 +442,9 @@ class tcp {
             uint32_t cwnd;
             // Slow start threshold
             uint32_t ssthresh;
+            // Bytes the connection may send before pacing makes it wait
+            uint32_t pacing_budget = 0;
+            clock_type::time_point pacing_refill;
             // Duplicated ACKs
             uint16_t dupacks = 0;
             unsigned syn_retransmit = 0;
@@ -368,6 +454,20 @@ class tcp {
             tcp_seq recover;
             bool window_probe = false;
             uint8_t zero_window_probing_out = 0;
+            // SACK loss recovery (RFC 6675), entered once a segment is
+            // deemed lost and left once recover is acknowledged
+            bool sack_recovery = false;
+            unsigned lost_segments = 0;
+            // A tail loss probe is outstanding (RFC 8985)
+            bool loss_probe_out = false;
+            // RACK (RFC 8985): the most recently sent of the segments
+            // delivered so far, and its round-trip time
+            struct {
+                clock_type::time_point tx_time;
+                tcp_seq end_seq;
+                std::chrono::milliseconds rtt{0};
+                std::chrono::milliseconds min_rtt = std::chrono::milliseconds::max();
+            } rack;
         } _snd;
         struct receive {
             tcp_seq next;
@@ -376,14 +476,26 @@ class tcp {
             uint16_t mss;
             tcp_seq urgent;
             tcp_seq initial;
-            std::deque<packet> data;
-            // The total size of data stored in std::deque<packet> data
+            circular_buffer<packet> data;
+            // The total size of data stored in data
             size_t data_size = 0;
             tcp_packet_merger out_of_order;
+            // Start of the latest segment received out of order, reported
+            // first in SACK blocks
+            tcp_seq last_out_of_order;
             std::optional<promise<>> _data_received_promise;
             // The maximun memory buffer size allowed for receiving
             // Currently, it is the same as default receive window size when window scaling is enabled
             size_t max_receive_buf_size = 3737600;
+            // The buffer the window is advertised from: grown by autotuning
+            // to twice what the application reads in a round-trip, up to
+            // max_receive_buf_size, and cut back under memory pressure
+            size_t space = initial_receive_space;
+            // Read since space was last tuned, and when that was
+            size_t copied = 0;
+            clock_type::time_point space_time;
+            // The right edge of the last window advertised
+            tcp_seq window_edge{};
         } _rcv;
         tcp_option _option;
         timer<lowres_clock> _delayed_ack;
@@ -395,8 +507,27 @@ class tcp {
         // Clock granularity
         static constexpr std::chrono::milliseconds _rto_clk_granularity{1};
         static constexpr uint16_t _max_nr_retransmit{5};
+        // Pacing sends up to a clock tick worth of data at once
+        static constexpr std::chrono::milliseconds _pacing_granularity{10};
+        // The least time RACK waits for reordered segments: a clock tick,
+        // as round-trip times are measured in ticks
+        static constexpr std::chrono::milliseconds _rack_min_reo_wnd{10};
+        // Number of segments SACKed above a segment deeming it lost (RFC 6675)
+        static constexpr unsigned _dup_thresh = 3;
+        // The receive buffer of a new connection, as Linux's initial window
+        static constexpr size_t initial_receive_space = 65535;
+        // The least time receive autotuning measures the rate over, when
+        // there are no round-trip time samples yet
+        static constexpr std::chrono::milliseconds _rcv_space_interval{100};
         timer<lowres_clock> _retransmit;
         timer<lowres_clock> _persist;
+        timer<lowres_clock> _pacing;
+        timer<lowres_clock> _rack_reorder;
+        timer<lowres_clock> _loss_probe;
+        // Compacts the queues once the connection was quiet for a while
+        timer<lowres_clock> _compact;
+        static constexpr std::chrono::seconds _compact_delay{1};
+        std::unique_ptr<tcp_congestion_control> _cc;
         uint16_t _nr_full_seg_received = 0;
         struct isn_secret {
             // 512 bits secretkey for ISN generating
@@ -414,6 +545,39 @@ class tcp {
         tcp_seq get_isn();
         circular_buffer<typename InetTraits::l4packet> _packetq;
         bool _poll_active = false;
+        // Frees the storage of a queue that drained: it is allocated
+        // again on activity, so that the (many, mostly) idle connections
+        // hold none
+        template <typename T>
+        static void compact(circular_buffer<T>& q) noexcept {
+            if (q.empty()) {
+                q = circular_buffer<T>();
+            }
+        }
+        // Called as a queue drains; the storage is kept while the
+        // connection is busy, not to be allocated again on every burst
+        template <typename T>
+        void schedule_compact(const circular_buffer<T>& q) noexcept {
+            if (!q.empty()) {
+                return;
+            }
+            if (_compact.armed()) {
+                _queues_active = true;
+            } else {
+                _compact.arm(_compact_delay);
+            }
+        }
+        void compact_queues() noexcept {
+            // Drained again since the last check: give it another delay
+            if (std::exchange(_queues_active, false)) {
+                _compact.arm(_compact_delay);
+                return;
+            }
+            compact(_snd.data);
+            compact(_snd.unsent);
+            compact(_packetq);
+        }
+        bool _queues_active = false;
         uint32_t get_default_receive_window_size() {
             // Linux's default window size
             constexpr uint32_t size = 29200;
@@ -421,15 +585,51 @@ class tcp {
         }
         // Returns the current receive window according to available receiving buffer size
         uint32_t get_modified_receive_window_size() {
-            uint32_t left =  _rcv.data_size > _rcv.max_receive_buf_size ? 0 : _rcv.max_receive_buf_size - _rcv.data_size;
-            return std::min(left, get_default_receive_window_size());
+            auto& mem = _tcp._rcv_memory;
+            if (mem.used > mem.limit / 4 * 3) {
+                // Under memory pressure, cut the buffers larger than their
+                // share of the shard's budget down to it
+                auto share = std::max(mem.limit / std::max<size_t>(_tcp._tcbs.size(), 1), initial_receive_space);
+                if (_rcv.space > share) {
+                    _rcv.space = share;
+                    _tcp._stats.receive_space_cuts++;
+                }
+            }
+            size_t left = _rcv.data_size > _rcv.space ? 0 : _rcv.space - _rcv.data_size;
+            // Nor beyond the budget of the shard, but let an empty connection
+            // take a segment still, for all of them to make progress
+            left = std::min(left, mem.used > mem.limit ? 0 : mem.limit - mem.used);
+            if (!_rcv.data_size) {
+                left = std::max<size_t>(left, _rcv.mss);
+            }
+            return std::min<size_t>(left, get_default_receive_window_size());
+        }
+        // Updates the window advertised, without moving its right edge back
+        // (RFC 9293 3.8.6.2.1): a shrinking window only closes as the
+        // data sent within it arrives
+        void update_receive_window() {
+            uint32_t window = get_modified_receive_window_size();
+            if (_rcv.window_edge > _rcv.next) {
+                window = std::max<uint32_t>(window, _rcv.window_edge - _rcv.next);
+            }
+            _rcv.window = window;
+            _rcv.window_edge = _rcv.next + window;
+        }
+        void queue_received(packet p) {
+            _rcv.data_size += p.len();
+            _tcp._rcv_memory.used += p.len();
+            _rcv.data.push_back(std::move(p));
         }
+        void autotune_receive_space(size_t read);
     public:
         tcb(tcp& t, connid id);
+        ~tcb() {
+            _tcp._rcv_memory.used -= _rcv.data_size;
+        }
         void input_handle_listen_state(tcp_hdr* th, packet p);
         void input_handle_syn_sent_state(tcp_hdr* th, packet p);
         void input_handle_other_state(tcp_hdr* th, packet p);
-        void output_one(bool data_retransmit = false);
+        void output_one(bool data_retransmit = false, size_t seg_index = 0);
         future<> wait_for_data();
         future<> wait_input_shutdown();
         void abort_reader() noexcept;
@@ -468,6 +668,12 @@ class tcp {
         future<> connect_done() {
             return _connect_done.get_future();
         }
+        void set_congestion_control(std::unique_ptr<tcp_congestion_control> cc) noexcept {
+            _cc = std::move(cc);
+        }
+        const char* congestion_control() const noexcept {
+            return _cc->name();
+        }
         tcp_state& state() {
             return _state;
         }
@@ -478,10 +684,10 @@ class tcp {
         void trim_receive_data_after_window();
         bool should_send_ack(uint16_t seg_len);
         void clear_delayed_ack() noexcept;
-        packet get_transmit_packet();
-        void retransmit_one() {
+        packet get_transmit_packet(uint8_t options_size);
+        void retransmit_one(size_t seg_index = 0) {
             bool data_retransmit = true;
-            output_one(data_retransmit);
+            output_one(data_retransmit, seg_index);
         }
         void start_retransmit_timer() {
             auto now = clock_type::now();
@@ -493,6 +699,7 @@ class tcp {
         };
         void stop_retransmit_timer() noexcept {
             _retransmit.cancel();
+            _loss_probe.cancel();
         };
         void start_persist_timer() {
             auto now = clock_type::now();
@@ -508,8 +715,49 @@ class tcp {
         void persist();
         void retransmit();
         void fast_retransmit();
+        bool sack_enabled() const noexcept {
+            return _option._sack_received;
+        }
+        unsigned get_sack_blocks(tcp_sack_block* blocks);
+        void update_scoreboard(const tcp_sack_block* blocks, unsigned nr_blocks);
+        void rack_update(const unacked_segment& seg, tcp_seq end_seq, clock_type::time_point now);
+        void detect_losses();
+        void mark_lost(unacked_segment& seg) noexcept {
+            if (!seg.lost && !seg.sacked) {
+                seg.lost = true;
+                ++_snd.lost_segments;
+            }
+        }
+        void enter_sack_recovery();
+        bool retransmit_lost();
+        void schedule_loss_probe(clock_type::time_point now);
+        void loss_probe();
+        // Bytes in flight, by RFC 6675: neither SACKed nor deemed lost
+        uint32_t pipe() {
+            uint32_t size = 0;
+            for (auto& seg : _snd.data) {
+                if (!seg.sacked && !seg.lost) {
+                    size += seg.p.len();
+                }
+            }
+            return size;
+        }
         void update_rto(clock_type::time_point tx_time);
         void update_cwnd(uint32_t acked_bytes);
+        tcp_congestion_control::window cc_window() noexcept {
+            return {_snd.cwnd, _snd.ssthresh, _snd.mss};
+        }
+        // Refills the pacing budget, and returns it
+        uint32_t pacing_budget(uint64_t rate) {
+            auto now = clock_type::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - _snd.pacing_refill).count();
+            if (elapsed > 0) {
+                _snd.pacing_refill = now;
+                uint64_t burst = std::max<uint64_t>(rate * std::chrono::microseconds(_pacing_granularity).count() / 1000000, 2 * _snd.mss);
+                _snd.pacing_budget = std::min<uint64_t>(burst, _snd.pacing_budget + rate * elapsed / 1000000);
+            }
+            return _snd.pacing_budget;
+        }
         void cleanup();
         uint32_t can_send() {
             if (_snd.window_probe) {
@@ -532,7 +780,11 @@ class tcp {
 
             // Can not send more than congestion window allows
             x = std::min(_snd.cwnd, x);
-            if (_snd.dupacks == 1 || _snd.dupacks == 2) {
+            if (_snd.sack_recovery) {
+                // RFC6675: send while the data in flight is under cwnd
+                auto in_flight = pipe();
+                x = in_flight < _snd.cwnd ? std::min(x, _snd.cwnd - in_flight) : 0;
+            } else if (_snd.dupacks == 1 || _snd.dupacks == 2) {
                 // RFC5681 Step 3.1
                 // Send cwnd + 2 * smss per RFC3042
                 auto flight = flight_size();
@@ -544,6 +796,18 @@ class tcp {
                 // Sent 1 full-sized segment at most
                 x = std::min(uint32_t(_snd.mss), x);
             }
+
+            // Can not send faster than pacing allows; wait for the budget
+            // to refill to at least a full-sized segment
+            if (auto rate = _cc->pacing_rate(); rate && x) {
+                auto budget = pacing_budget(rate);
+                if (x > budget) {
+                    x = budget >= _snd.mss ? budget : 0;
+                }
+                if (!x && !_pacing.armed()) {
+                    _pacing.arm(_pacing_granularity);
+                }
+            }
             return x;
         }
         uint32_t flight_size() {
@@ -648,6 +912,9 @@ class tcp {
             _snd.limited_transfer = 0;
             _snd.partial_ack = 0;
         }
+        void exit_sack_recovery() noexcept {
+            _snd.sack_recovery = false;
+        }
         uint32_t data_segment_acked(tcp_seq seg_ack);
         bool segment_acceptable(tcp_seq seg_seq, unsigned seg_len);
         void init_from_options(tcp_hdr* th, uint8_t* opt_start, uint8_t* opt_end);
@@ -663,6 +930,18 @@ class tcp {
     // queue for packets that do not belong to any tcb
     circular_buffer<ipv4_traits::l4packet> _packetq;
     semaphore _queue_space = {212992};
+    sstring _congestion_control = "reno";
+    bool _sack = false;
+    struct {
+        uint64_t sack_retransmits = 0;
+        uint64_t loss_probes = 0;
+        uint64_t receive_space_cuts = 0;
+    } _stats;
+    // The data received and not read yet, of all the connections
+    struct {
+        size_t limit = std::numeric_limits<size_t>::max();
+        size_t used = 0;
+    } _rcv_memory;
     metrics::metric_groups _metrics;
 public:
     const inet_type& inet() const {
@@ -715,12 +994,26 @@ class tcp {
         void shutdown_connect();
         void close_read() noexcept;
         void close_write() noexcept;
+        /// Sets the congestion control algorithm of the connection
+        ///
+        /// \see make_tcp_congestion_control()
+        void set_congestion_control(std::string_view name) {
+            _tcb->set_congestion_control(make_tcp_congestion_control(name));
+        }
+        const char* congestion_control() const noexcept {
+            return _tcb->congestion_control();
+        }
+        const net::hw_features& hw_features() const {
+            return _tcb->_tcp.hw_features();
+        }
     };
     class listener {
         tcp& _tcp;
         uint16_t _port;
         queue<connection> _q;
         size_t _pending = 0;
+        sstring _congestion_control;
+        bool _steered = false;
     private:
         listener(tcp& t, uint16_t port, size_t queue_length)
             : _tcp(t), _port(port), _q(queue_length) {
@@ -728,13 +1021,16 @@ class tcp {
         }
     public:
         listener(listener&& x)
-            : _tcp(x._tcp), _port(x._port), _q(std::move(x._q)) {
+            : _tcp(x._tcp), _port(x._port), _q(std::move(x._q)), _steered(std::exchange(x._steered, false)) {
             _tcp._listening[_port] = this;
             x._port = 0;
         }
         ~listener() {
             if (_port) {
                 _tcp._listening.erase(_port);
+                if (_steered) {
+                    _tcp._inet._inet.netif()->unsteer_tcp_port(_port);
+                }
             }
         }
         future<connection> accept() {
@@ -755,6 +1051,22 @@ class tcp {
         uint16_t port() const {
             return _port;
         }
+        /// Sets the congestion control algorithm of the connections accepted
+        /// from now on, instead of the stack's default one
+        ///
+        /// \see make_tcp_congestion_control()
+        void set_congestion_control(sstring name) {
+            make_tcp_congestion_control(name);
+            _congestion_control = std::move(name);
+        }
+        /// Has the device deliver the segments to the port to this shard,
+        /// for all the port's connections to be accepted here
+        ///
+        /// \return whether the device does so
+        bool steer_to_local_shard() {
+            _steered = _steered || _tcp._inet._inet.netif()->steer_tcp_port(_port, this_shard_id());
+            return _steered;
+        }
         friend class tcp;
     };
 public:
@@ -765,6 +1077,37 @@ class tcp {
     connection connect(socket_address sa);
     const net::hw_features& hw_features() const { return _inet._inet.hw_features(); }
     future<> poll_tcb(ipaddr to, lw_shared_ptr<tcb> tcb);
+    /// Sets the congestion control algorithm of the connections created from
+    /// now on
+    ///
+    /// \see make_tcp_congestion_control()
+    void set_congestion_control(sstring name) {
+        make_tcp_congestion_control(name);
+        _congestion_control = std::move(name);
+    }
+    const sstring& congestion_control() const noexcept {
+        return _congestion_control;
+    }
+    /// Has the connections created from now on negotiate SACK, and recover
+    /// from losses with it and RACK-TLP; off by default
+    void set_sack(bool enabled) noexcept {
+        _sack = enabled;
+    }
+    bool sack() const noexcept {
+        return _sack;
+    }
+    /// Limits the memory the connections buffer the data received in and
+    /// not read yet
+    ///
+    /// The windows the connections advertise close as the shard runs out
+    /// of the budget, and past three quarters of it, the connections
+    /// buffering more than their share of it have their buffers cut down.
+    void set_receive_memory_limit(size_t bytes) noexcept {
+        _rcv_memory.limit = bytes;
+    }
+    size_t receive_memory_used() const noexcept {
+        return _rcv_memory.used;
+    }
     void add_connected_tcb(lw_shared_ptr<tcb> tcbp, uint16_t local_port) {
         auto it = _listening.find(local_port);
         if (it != _listening.end()) {
@@ -787,7 +1130,15 @@ tcp<InetTraits>::tcp(inet_type& inet)
     _metrics.add_group("tcp", {
         sm::make_counter("linearizations", [] { return tcp_packet_merger::linearizations(); },
                         sm::description("Counts a number of times a buffer linearization was invoked during the buffers merge process. "
-                                        "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet."))
+                                        "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet.")),
+        sm::make_counter("sack_retransmits", _stats.sack_retransmits,
+                        sm::description("Counts segments retransmitted as deemed lost from SACK information")),
+        sm::make_counter("loss_probes", _stats.loss_probes,
+                        sm::description("Counts tail loss probes sent")),
+        sm::make_gauge("receive_memory_used", [this] { return _rcv_memory.used; },
+                        sm::description("Size of the data received by the connections and not read yet")),
+        sm::make_counter("receive_space_cuts", _stats.receive_space_cuts,
+                        sm::description("Counts receive buffers cut down under memory pressure")),
     });
 
     _inet.register_packet_provider([this, tcb_polled = 0u] () mutable {
@@ -834,14 +1185,10 @@ auto tcp<InetTraits>::connect(socket_address sa) -> connection {
     auto dst_ip = ipv4_address(sa);
     auto dst_port = net::ntoh(sa.u.in.sin_port);
 
-    if (smp::count > 1) {
-        do {
-            id = connid{src_ip, dst_ip, _port_dist(_e), dst_port};
-        } while (_inet._inet.netif()->hash2cpu(id.hash(_inet._inet.netif()->rss_key())) != this_shard_id()
-                 || _tcbs.find(id) != _tcbs.end());
-    } else {
+    do {
         id = connid{src_ip, dst_ip, _port_dist(_e), dst_port};
-    }
+    } while ((smp::count > 1 && _inet._inet.netif()->hash2cpu(id.hash(_inet._inet.netif()->rss_key())) != this_shard_id())
+             || _tcbs.find(id) != _tcbs.end());
 
     auto tcbp = make_lw_shared<tcb>(*this, id);
     _tcbs.insert({id, tcbp});
@@ -916,6 +1263,9 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
                 // check the security
                 // NOTE: Ignored for now
                 tcbp = make_lw_shared<tcb>(*this, id);
+                if (!listener->second->_congestion_control.empty()) {
+                    tcbp->set_congestion_control(make_tcp_congestion_control(listener->second->_congestion_control));
+                }
                 _tcbs.insert({id, tcbp});
                 // TODO: we need to remove the tcb and decrease the pending if
                 // it stays SYN_RECEIVED state forever.
@@ -971,7 +1321,13 @@ tcp<InetTraits>::tcb::tcb(tcp& t, connid id)
     , _foreign_port(id.foreign_port)
     , _delayed_ack([this] { _nr_full_seg_received = 0; output(); })
     , _retransmit([this] { retransmit(); })
-    , _persist([this] { persist(); }) {
+    , _persist([this] { persist(); })
+    , _pacing([this] { output(); })
+    , _rack_reorder([this] { detect_losses(); if (retransmit_lost()) { output(); } })
+    , _loss_probe([this] { loss_probe(); })
+    , _compact([this] { compact_queues(); })
+    , _cc(make_tcp_congestion_control(t._congestion_control)) {
+    _option._local_sack = t._sack;
 }
 
 template <typename InetTraits>
@@ -1035,12 +1391,19 @@ uint32_t tcp<InetTraits>::tcb::data_segment_acked(tcp_seq seg_ack) {
         if (_snd.data.front().nr_transmits == 0) {
             update_rto(_snd.data.front().tx_time);
         }
+        if (_snd.data.front().lost) {
+            --_snd.lost_segments;
+        }
+        if (sack_enabled() && !_snd.data.front().sacked) {
+            rack_update(_snd.data.front(), _snd.unacknowledged, clock_type::now());
+        }
         update_cwnd(acked_bytes);
         total_acked_bytes += acked_bytes;
         _snd.current_queue_space -= _snd.data.front().data_len;
         signal_send_available();
         _snd.data.pop_front();
     }
+    schedule_compact(_snd.data);
     // Partial ACK of segment
     if (_snd.unacknowledged < seg_ack) {
         auto acked_bytes = seg_ack - _snd.unacknowledged;
@@ -1091,7 +1454,8 @@ void tcp<InetTraits>::tcb::init_from_options(tcp_hdr* th, uint8_t* opt_start, ui
     // Maximum segment size local can receive
     _rcv.mss = _option._local_mss = local_mss();
 
-    _rcv.window = get_default_receive_window_size();
+    _rcv.window = std::min<uint32_t>(_rcv.space, get_default_receive_window_size());
+    _rcv.window_edge = _rcv.next + _rcv.window;
     _snd.window = th->window << _snd.window_scale;
 
     // Segment sequence number used for last window update
@@ -1214,6 +1578,15 @@ void tcp<InetTraits>::tcb::input_handle_syn_sent_state(tcp_hdr* th, packet p) {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
+    tcp_sack_block sack_blocks[tcp_option::max_sack_blocks];
+    unsigned nr_sack_blocks = 0;
+    if (sack_enabled() && th->data_offset * 4 > tcp_hdr::len) {
+        if (auto hdr = p.get_header(0, th->data_offset * 4)) {
+            auto opt_start = reinterpret_cast<uint8_t*>(hdr) + tcp_hdr::len;
+            auto opt_end = reinterpret_cast<uint8_t*>(hdr) + th->data_offset * 4;
+            nr_sack_blocks = tcp_option::parse_sack_blocks(opt_start, opt_end, sack_blocks);
+        }
+    }
     p.trim_front(th->data_offset * 4);
     bool do_output = false;
     bool do_output_data = false;
@@ -1333,6 +1706,9 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
         if (in_state(ESTABLISHED | CLOSE_WAIT)){
             // When we are in zero window probing phase and packets_out = 0 we bypass "duplicated ack" check
             auto packets_out = _snd.next - _snd.unacknowledged - _snd.zero_window_probing_out;
+            if (nr_sack_blocks) {
+                update_scoreboard(sack_blocks, nr_sack_blocks);
+            }
             // If SND.UNA < SEG.ACK =< SND.NXT then, set SND.UNA <- SEG.ACK.
             if (_snd.unacknowledged < seg_ack && seg_ack <= _snd.next) {
                 // Remote ACKed data we sent
@@ -1354,11 +1730,19 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                         signal_all_data_acked();
                     } else {
                         // Restart the timer becasue new data is acked.
-                        start_retransmit_timer();
+                        auto now = clock_type::now();
+                        start_retransmit_timer(now);
+                        schedule_loss_probe(now);
                     }
                 };
 
-                if (_snd.dupacks >= 3) {
+                if (sack_enabled()) {
+                    _snd.loss_probe_out = false;
+                    if (_snd.sack_recovery && seg_ack > _snd.recover) {
+                        exit_sack_recovery();
+                    }
+                    set_retransmit_timer();
+                } else if (_snd.dupacks >= 3) {
                     // We are in fast retransmit / fast recovery phase
                     uint32_t smss = _snd.mss;
                     if (seg_ack > _snd.recover) {
@@ -1399,7 +1783,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     exit_fast_recovery();
                     set_retransmit_timer();
                 }
-            } else if ((packets_out > 0) && !_snd.data.empty() && seg_len == 0 &&
+            } else if (!sack_enabled() && (packets_out > 0) && !_snd.data.empty() && seg_len == 0 &&
                 th->f_fin == 0 && th->f_syn == 0 &&
                 th->ack == _snd.unacknowledged &&
                 uint32_t(th->window << _snd.window_scale) == _snd.window) {
@@ -1422,7 +1806,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     if (seg_ack - 1 > _snd.recover) {
                         _snd.recover = _snd.next - 1;
                         // RFC5681 Step 3.2
-                        _snd.ssthresh = std::max((flight_size() - _snd.limited_transfer) / 2, 2 * smss);
+                        _cc->on_loss(cc_window(), flight_size() - _snd.limited_transfer, clock_type::now());
                         fast_retransmit();
                     } else {
                         // Do not enter fast retransmit and do not reset ssthresh
@@ -1443,6 +1827,13 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                 update_window();
                 do_output_data = true;
             }
+            if (sack_enabled() && !_snd.data.empty()) {
+                // SACK and RACK replace counting duplicate ACKs
+                detect_losses();
+                if (_snd.lost_segments && pipe() < _snd.cwnd) {
+                    do_output = true;
+                }
+            }
         }
         // FIN_WAIT_1 STATE
         if (in_state(FIN_WAIT_1)) {
@@ -1501,11 +1892,10 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
             // RCV.NXT over the data accepted, and adjusts RCV.WND as
             // apporopriate to the current buffer availability.  The total of
             // RCV.NXT and RCV.WND should not be reduced.
-            _rcv.data_size += p.len();
-            _rcv.data.push_back(std::move(p));
+            queue_received(std::move(p));
             _rcv.next += seg_len;
             auto merged = merge_out_of_order();
-            _rcv.window = get_modified_receive_window_size();
+            update_receive_window();
             signal_data_received();
             // Send an acknowledgment of the form:
             // <SEQ=SND.NXT><ACK=RCV.NXT><CTL=ACK>
@@ -1576,7 +1966,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
 }
 
 template <typename InetTraits>
-packet tcp<InetTraits>::tcb::get_transmit_packet() {
+packet tcp<InetTraits>::tcb::get_transmit_packet(uint8_t options_size) {
     // easy case: empty queue
     if (_snd.unsent.empty()) {
         return packet();
@@ -1590,12 +1980,15 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
     } else {
         len = std::min(uint16_t(_tcp.hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min), _snd.mss);
     }
+    // Leave room for the options
+    len -= std::min<uint32_t>(len, options_size);
     can_send = std::min(can_send, len);
     // easy case: one small packet
     if (_snd.unsent.size() == 1 && _snd.unsent.front().len() <= can_send) {
         auto p = std::move(_snd.unsent.front());
         _snd.unsent.pop_front();
         _snd.unsent_len -= p.len();
+        schedule_compact(_snd.unsent);
         return p;
     }
     // moderate case: need to split one packet
@@ -1621,22 +2014,36 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
         q.trim_front(can_send);
     }
     _snd.unsent_len -= p.len();
+    schedule_compact(_snd.unsent);
     return p;
 }
 
 template <typename InetTraits>
-void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
+void tcp<InetTraits>::tcb::output_one(bool data_retransmit, size_t seg_index) {
     if (in_state(CLOSED)) {
         return;
     }
 
-    packet p = data_retransmit ? _snd.data.front().p.share() : get_transmit_packet();
-    packet clone = p.share();  // early clone to prevent share() from calling packet::unuse_internal_data() on header.
-    uint16_t len = p.len();
     bool syn_on = syn_needs_on();
     bool ack_on = ack_needs_on();
 
-    auto options_size = _option.get_size(syn_on, ack_on);
+    tcp_sack_block sack_blocks[tcp_option::max_sack_blocks];
+    unsigned nr_sack_blocks = syn_on ? 0 : get_sack_blocks(sack_blocks);
+    packet p;
+    if (data_retransmit) {
+        p = _snd.data[seg_index].p.share();
+        // The segment was sized without room for the blocks
+        while (nr_sack_blocks && p.len() <= _snd.mss
+                && p.len() + _option.get_size(syn_on, ack_on, nr_sack_blocks) > _snd.mss) {
+            --nr_sack_blocks;
+        }
+    } else {
+        p = get_transmit_packet(_option.get_size(syn_on, ack_on, nr_sack_blocks));
+    }
+    packet clone = p.share();  // early clone to prevent share() from calling packet::unuse_internal_data() on header.
+    uint16_t len = p.len();
+
+    auto options_size = _option.get_size(syn_on, ack_on, nr_sack_blocks);
     auto th = p.prepend_uninitialized_header(tcp_hdr::len + options_size);
     auto h = tcp_hdr{};
 
@@ -1654,6 +2061,15 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
     tcp_seq seq;
     if (data_retransmit) {
         seq = _snd.unacknowledged;
+        for (size_t i = 0; i < seg_index; ++i) {
+            seq += _snd.data[i].p.len();
+        }
+        auto& seg = _snd.data[seg_index];
+        if (seg.lost) {
+            seg.lost = false;
+            --_snd.lost_segments;
+        }
+        seg.tx_time = clock_type::now();
     } else {
         seq = syn_on ? _snd.initial : _snd.next;
         _snd.next += len;
@@ -1669,7 +2085,7 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
     h.f_fin = fin_on;
 
     // Add tcp options
-    _option.fill(th, &h, options_size);
+    _option.fill(th, &h, options_size, sack_blocks, nr_sack_blocks);
     h.write(th);
 
     offload_info oi;
@@ -1691,7 +2107,7 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
         // CSUM offload case.
         //
         if (_tcp.hw_features().tx_tso && len > _snd.mss) {
-            oi.tso_seg_size = _snd.mss;
+            oi.tso_seg_size = _snd.mss - options_size;
         } else {
             pseudo_hdr_seg_len = tcp_hdr::len + options_size + len;
         }
@@ -1722,10 +2138,12 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
             unsigned nr_transmits = 0;
             _snd.data.emplace_back(unacked_segment{std::move(clone),
                                    len, nr_transmits, now});
+            _snd.pacing_budget -= std::min<uint32_t>(_snd.pacing_budget, len);
         }
         if (!_retransmit.armed()) {
             start_retransmit_timer(now);
         }
+        schedule_loss_probe(now);
     }
 
 
@@ -1787,7 +2205,7 @@ void tcp<InetTraits>::tcb::connect() {
     _rcv.window_scale = _option._local_win_scale = 7;
     // Maximum segment size local can receive
     _rcv.mss = _option._local_mss = local_mss();
-    _rcv.window = get_default_receive_window_size();
+    _rcv.window = std::min<uint32_t>(_rcv.space, get_default_receive_window_size());
 
     do_syn_sent();
 }
@@ -1798,12 +2216,31 @@ packet tcp<InetTraits>::tcb::read() {
     for (auto&& q : _rcv.data) {
         p.append(std::move(q));
     }
+    _tcp._rcv_memory.used -= _rcv.data_size;
+    autotune_receive_space(_rcv.data_size);
     _rcv.data_size = 0;
-    _rcv.data.clear();
-    _rcv.window = get_default_receive_window_size();
+    _rcv.data = {};
+    update_receive_window();
     return p;
 }
 
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::autotune_receive_space(size_t read) {
+    _rcv.copied += read;
+    auto now = clock_type::now();
+    auto interval = _snd.first_rto_sample ? _rcv_space_interval : std::max(_snd.srtt, _rto_clk_granularity);
+    if (now - _rcv.space_time < interval) {
+        return;
+    }
+    // Buffer twice what the application reads in a round-trip, for the
+    // sender not to wait for the window to open as the application keeps up
+    // (dynamic right-sizing, as Linux's tcp_rcv_space_adjust())
+    auto space = std::min(2 * _rcv.copied, _rcv.max_receive_buf_size);
+    _rcv.space = std::max(_rcv.space, space);
+    _rcv.copied = 0;
+    _rcv.space_time = now;
+}
+
 template <typename InetTraits>
 future<> tcp<InetTraits>::tcb::wait_send_available() {
     if (_snd.max_queue_space > _snd.current_queue_space) {
@@ -1912,8 +2349,7 @@ bool tcp<InetTraits>::tcb::merge_out_of_order() {
                 seg_len -= trim;
             }
             _rcv.next += seg_len;
-            _rcv.data_size += p.len();
-            _rcv.data.push_back(std::move(p));
+            queue_received(std::move(p));
             // Since c++11, erase() always returns the value of the following element
             it = _rcv.out_of_order.map.erase(it);
             merged = true;
@@ -1932,6 +2368,7 @@ bool tcp<InetTraits>::tcb::merge_out_of_order() {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::insert_out_of_order(tcp_seq seg, packet p) {
+    _rcv.last_out_of_order = seg;
     _rcv.out_of_order.merge(seg, std::move(p));
 }
 
@@ -1997,7 +2434,7 @@ void tcp<InetTraits>::tcb::retransmit() {
     // Update ssthresh only for the first retransmit
     uint32_t smss = _snd.mss;
     if (unacked_seg.nr_transmits == 0) {
-        _snd.ssthresh = std::max(flight_size() / 2, 2 * smss);
+        _cc->on_timeout(cc_window(), flight_size(), clock_type::now());
     }
     // RFC6582 Step 4
     _snd.recover = _snd.next - 1;
@@ -2005,6 +2442,19 @@ void tcp<InetTraits>::tcb::retransmit() {
     _snd.cwnd = smss;
     // End fast recovery
     exit_fast_recovery();
+    if (sack_enabled()) {
+        // RFC6675 Section 5.1: retransmit all that was not SACKed, as
+        // the window opens. Repeated timeouts may be the receiver having
+        // discarded SACKed data (RFC2018 Section 8), so forget about it.
+        for (auto& seg : _snd.data) {
+            if (unacked_seg.nr_transmits) {
+                seg.sacked = false;
+            }
+            mark_lost(seg);
+        }
+        _snd.sack_recovery = true;
+        _snd.loss_probe_out = false;
+    }
 
     if (unacked_seg.nr_transmits < _max_nr_retransmit) {
         unacked_seg.nr_transmits++;
@@ -2028,10 +2478,200 @@ void tcp<InetTraits>::tcb::fast_retransmit() {
     }
 }
 
+template <typename InetTraits>
+unsigned tcp<InetTraits>::tcb::get_sack_blocks(tcp_sack_block* blocks) {
+    auto& ooo = _rcv.out_of_order.map;
+    if (!sack_enabled() || ooo.empty()) {
+        return 0;
+    }
+    // Calls func with the contiguous ranges of data received out of order
+    auto for_each_block = [&ooo] (auto func) {
+        auto it = ooo.begin();
+        while (it != ooo.end()) {
+            tcp_sack_block b{it->first, it->first + it->second.len()};
+            while (++it != ooo.end() && it->first <= b.right) {
+                b.right = std::max(b.right, it->first + it->second.len());
+            }
+            if (!func(b)) {
+                return;
+            }
+        }
+    };
+    // RFC2018: the first block holds the latest segment received
+    unsigned nr = 0;
+    for_each_block([&] (const tcp_sack_block& b) {
+        if (b.left <= _rcv.last_out_of_order && _rcv.last_out_of_order < b.right) {
+            blocks[nr++] = b;
+            return false;
+        }
+        return true;
+    });
+    for_each_block([&] (const tcp_sack_block& b) {
+        if (nr && b.left == blocks[0].left) {
+            return true;
+        }
+        blocks[nr++] = b;
+        return nr < tcp_option::max_sack_blocks;
+    });
+    return nr;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::update_scoreboard(const tcp_sack_block* blocks, unsigned nr_blocks) {
+    auto now = clock_type::now();
+    auto seq = _snd.unacknowledged;
+    for (auto& seg : _snd.data) {
+        auto end = seq + seg.p.len();
+        for (unsigned i = 0; i < nr_blocks && !seg.sacked; ++i) {
+            // Blocks below SND.UNA are D-SACKs, and ignored
+            if (blocks[i].left <= seq && end <= blocks[i].right && blocks[i].right <= _snd.next) {
+                if (seg.lost) {
+                    seg.lost = false;
+                    --_snd.lost_segments;
+                }
+                seg.sacked = true;
+                rack_update(seg, end, now);
+            }
+        }
+        seq = end;
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::rack_update(const unacked_segment& seg, tcp_seq end_seq, clock_type::time_point now) {
+    auto rtt = std::chrono::duration_cast<std::chrono::milliseconds>(now - seg.tx_time);
+    // The delivery may be of an earlier transmission of the segment
+    if (seg.nr_transmits && rtt < _snd.rack.min_rtt) {
+        return;
+    }
+    if (seg.tx_time > _snd.rack.tx_time || (seg.tx_time == _snd.rack.tx_time && end_seq > _snd.rack.end_seq)) {
+        _snd.rack.tx_time = seg.tx_time;
+        _snd.rack.end_seq = end_seq;
+        _snd.rack.rtt = rtt;
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::detect_losses() {
+    auto now = clock_type::now();
+    auto reo_wnd = _rack_min_reo_wnd;
+    if (_snd.rack.min_rtt != std::chrono::milliseconds::max()) {
+        reo_wnd = std::max(reo_wnd, _snd.rack.min_rtt / 4);
+    }
+    unsigned sacked_above = 0;
+    for (auto& seg : _snd.data) {
+        sacked_above += seg.sacked;
+    }
+    auto lost_before = _snd.lost_segments;
+    std::optional<clock_type::duration> reorder_timeout;
+    auto seq = _snd.unacknowledged;
+    for (auto& seg : _snd.data) {
+        auto end = seq + seg.p.len();
+        seq = end;
+        if (seg.sacked) {
+            --sacked_above;
+            continue;
+        }
+        if (seg.lost) {
+            continue;
+        }
+        // RFC6675 IsLost()
+        if (sacked_above >= _dup_thresh) {
+            mark_lost(seg);
+            continue;
+        }
+        // RACK: a segment not delivered although one sent after it was,
+        // once given time to be reordered
+        if (seg.tx_time < _snd.rack.tx_time || (seg.tx_time == _snd.rack.tx_time && end < _snd.rack.end_seq)) {
+            auto remaining = seg.tx_time + _snd.rack.rtt + reo_wnd - now;
+            if (remaining <= clock_type::duration::zero()) {
+                mark_lost(seg);
+            } else if (!reorder_timeout || remaining < *reorder_timeout) {
+                reorder_timeout = remaining;
+            }
+        }
+    }
+    if (reorder_timeout) {
+        _rack_reorder.rearm(now + *reorder_timeout);
+    }
+    if (_snd.lost_segments > lost_before && !_snd.sack_recovery) {
+        enter_sack_recovery();
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::enter_sack_recovery() {
+    // RFC6675 Section 5: halve the window once per window of data
+    if (_snd.unacknowledged > _snd.recover) {
+        _snd.recover = _snd.next - 1;
+        _cc->on_loss(cc_window(), flight_size(), clock_type::now());
+        _snd.cwnd = _snd.ssthresh;
+    }
+    _snd.sack_recovery = true;
+}
+
+template <typename InetTraits>
+bool tcp<InetTraits>::tcb::retransmit_lost() {
+    if (!_snd.lost_segments || pipe() >= _snd.cwnd) {
+        return false;
+    }
+    for (size_t i = 0; i < _snd.data.size(); ++i) {
+        auto& seg = _snd.data[i];
+        if (seg.lost) {
+            seg.nr_transmits++;
+            retransmit_one(i);
+            _tcp._stats.sack_retransmits++;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::schedule_loss_probe(clock_type::time_point now) {
+    if (!sack_enabled() || _snd.sack_recovery || _snd.loss_probe_out || _snd.data.empty()) {
+        return;
+    }
+    // RFC8985 Section 7.2: PTO = 2 * SRTT, plus the worst case delayed
+    // ACK time if a single segment is in flight
+    std::chrono::milliseconds pto = _snd.first_rto_sample ? _rto : 2 * _snd.srtt;
+    if (_snd.data.size() == 1) {
+        pto += 200ms;
+    }
+    pto = std::max(pto, _rack_min_reo_wnd);
+    if (pto >= _rto) {
+        _loss_probe.cancel();
+        return;
+    }
+    _loss_probe.rearm(now + pto);
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::loss_probe() {
+    if (_snd.data.empty() || in_state(CLOSED)) {
+        return;
+    }
+    // RFC8985 Section 7.3: send new data if possible, or else the last
+    // segment again, for its ACK to carry the SACK information recovering
+    // from a loss at the tail of the window
+    _snd.loss_probe_out = true;
+    _tcp._stats.loss_probes++;
+    if (!(_snd.unsent_len && can_send())) {
+        auto& seg = _snd.data.back();
+        seg.nr_transmits++;
+        retransmit_one(_snd.data.size() - 1);
+    }
+    output();
+    start_retransmit_timer();
+}
+
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
     // Update RTO according to RFC6298
-    auto R = std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - tx_time);
+    auto now = clock_type::now();
+    auto R = std::chrono::duration_cast<std::chrono::milliseconds>(now - tx_time);
+    _cc->on_rtt_sample(R, now);
+    _snd.rack.min_rtt = std::min(_snd.rack.min_rtt, R);
     if (_snd.first_rto_sample) {
         _snd.first_rto_sample = false;
         // RTTVAR <- R/2
@@ -2056,15 +2696,7 @@ void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::update_cwnd(uint32_t acked_bytes) {
-    uint32_t smss = _snd.mss;
-    if (_snd.cwnd < _snd.ssthresh) {
-        // In slow start phase
-        _snd.cwnd += std::min(acked_bytes, smss);
-    } else {
-        // In congestion avoidance phase
-        uint32_t round_up = 1;
-        _snd.cwnd += std::max(round_up, smss * smss / _snd.cwnd);
-    }
+    _cc->on_ack(cc_window(), acked_bytes, clock_type::now());
 }
 
 template <typename InetTraits>
@@ -2072,10 +2704,14 @@ void tcp<InetTraits>::tcb::cleanup() {
     _snd.unsent.clear();
     _snd.data.clear();
     _rcv.out_of_order.map.clear();
+    _tcp._rcv_memory.used -= _rcv.data_size;
     _rcv.data_size = 0;
     _rcv.data.clear();
     stop_retransmit_timer();
     clear_delayed_ack();
+    _pacing.cancel();
+    _rack_reorder.cancel();
+    _snd.lost_segments = 0;
     remove_from_tcbs();
 }
 
@@ -2107,7 +2743,7 @@ tcp_seq tcp<InetTraits>::tcb::get_isn() {
 template <typename InetTraits>
 std::optional<typename InetTraits::l4packet> tcp<InetTraits>::tcb::get_packet() {
     _poll_active = false;
-    if (_packetq.empty()) {
+    if (_packetq.empty() && !retransmit_lost()) {
         output_one();
     }
 
@@ -2119,13 +2755,15 @@ std::optional<typename InetTraits::l4packet> tcp<InetTraits>::tcb::get_packet()
 
     auto p = std::move(_packetq.front());
     _packetq.pop_front();
-    if (!_packetq.empty() || (_snd.dupacks < 3 && can_send() > 0 && (_snd.window > 0))) {
+    if (!_packetq.empty() || (_snd.lost_segments && pipe() < _snd.cwnd)
+            || (_snd.dupacks < 3 && can_send() > 0 && (_snd.window > 0))) {
         // If there are packets to send in the queue or tcb is allowed to send
         // more add tcp back to polling set to keep sending. In addition, dupacks >= 3
         // is an indication that an segment is lost, stop sending more in this case.
         // Finally - we can't send more until window is opened again.
         output();
     }
+    schedule_compact(_packetq);
     return p;
 }
 
@@ -21,9 +21,12 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <chrono>
 #include <functional>
+#include <optional>
 #include <unordered_set>
 #include <map>
+#include <vector>
 #include <boost/any.hpp>
 #include <fmt/format.h>
 #endif
@@ -32,6 +35,7 @@
 #include <seastar/core/internal/api-level.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sharded.hh>
 #include <seastar/net/socket_defs.hh>
 #include <seastar/net/inet_address.hh>
 #include <seastar/util/std-compat.hh>
@@ -66,6 +70,20 @@ namespace tls {
 
     typedef std::basic_string_view<char> blob;
 
+    /**
+     * How the data written to a TLS stream is cut into records.
+     */
+    enum class record_sizing {
+        /// Records as large as the session allows, 16KB, the writes between
+        /// flushes coalesced into them
+        FULL,
+        /// Records which fit in a single TCP segment for the first
+        /// megabyte, and again after a second without sending, then full
+        /// ones, so that the peer can decrypt the start of a response
+        /// without waiting for more segments
+        DYNAMIC,
+    };
+
     class session;
     class server_session;
     class server_credentials;
@@ -115,6 +133,22 @@ namespace tls {
         shared_ptr<impl> _impl;
     };
 
+    /**
+     * Runs the handshakes of server sessions on a pool of threads rather
+     * than on the reactor, which all their public key operations, up to
+     * hundreds of microseconds each, would stall. See
+     * certificate_credentials::set_handshake_offload().
+     */
+    struct handshake_offload_config {
+        /// The most handshakes of the sessions of a shard with the
+        /// credentials run on the pool at once; the others wait
+        unsigned max_concurrency = 16;
+        /// The threads of the pool of each NUMA node, shared by all of its
+        /// shards and by all the credentials: the value is process-wide,
+        /// and all the credentials offloading must agree on it
+        unsigned threads_per_node = 2;
+    };
+
     class abstract_credentials {
     protected:
         abstract_credentials() = default;
@@ -221,6 +255,61 @@ namespace tls {
          */
         void set_dn_verification_callback(dn_callback);
 
+        /**
+         * Enables kernel TLS (kTLS) transmit offload for sessions using these
+         * credentials. Once the handshake completes, the session keys for the
+         * sending direction are handed to the kernel with TCP_ULP "tls", and
+         * written data goes through the socket as plaintext, which also lets
+         * output_stream::write_from_file() use sendfile.
+         *
+         * This only takes effect for TLS 1.2 and 1.3 with AES-GCM or
+         * ChaCha20-Poly1305, on sockets of the posix stack, on kernels
+         * with the tls module. Otherwise the session silently keeps
+         * encrypting in userspace. Received data is always decrypted in
+         * userspace.
+         */
+        void set_kernel_tls_offload(bool);
+
+        /**
+         * Runs the handshakes of the server sessions using these credentials
+         * on the thread pool of the NUMA node of the shard, the reactor
+         * resuming them when they are done, rather than on the reactor.
+         * Only the sessions without a session cache (see
+         * set_session_cache_size()) are offloaded, as the cache is not
+         * thread safe. std::nullopt (the default) disables it.
+         *
+         * Throws std::invalid_argument if the threads_per_node of the
+         * config differs from the one other credentials offloaded with.
+         */
+        void set_handshake_offload(std::optional<handshake_offload_config>);
+
+        /**
+         * Enables a cache of up to \c max_entries TLS sessions. Servers use
+         * it for TLS 1.2 session ID resumption; clients keep the resumption
+         * data of the last session with each server name and offer it when
+         * connecting to that name again without explicit
+         * tls_options::session_resume_data. The cache, like the
+         * credentials, is per shard. Zero (the default) disables it.
+         */
+        void set_session_cache_size(size_t max_entries);
+
+        /**
+         * Sets the application protocols offered (clients) or accepted
+         * (servers) with the ALPN TLS extension, most preferred first,
+         * e.g. {"h2", "http/1.1"}. A server picks the first of its own
+         * protocols the client offers, and fails the handshake if the
+         * client offers ALPN but none of them. Empty (the default) does
+         * not negotiate one. See get_selected_alpn_protocol().
+         */
+        void set_alpn_protocols(std::vector<sstring> protocols);
+
+        /**
+         * Sets how the data written is cut into TLS records, see
+         * record_sizing. The default coalesces the writes into full
+         * records. Does not apply to kernel TLS offloaded sessions.
+         */
+        void set_record_sizing(record_sizing);
+
     private:
         class impl;
         friend class session;
@@ -275,6 +364,12 @@ namespace tls {
          * a new window of TLS session keys.
         */
         void set_session_resume_mode(session_resume_mode);
+
+        /**
+         * Sets how long session tickets and cached sessions issued by
+         * this server remain valid for resumption.
+         */
+        void set_session_resume_lifetime(std::chrono::seconds);
     };
 
     class reloadable_credentials_base;
@@ -308,7 +403,21 @@ namespace tls {
         future<> set_system_trust();
         void set_client_auth(client_auth);
         void set_priority_string(const sstring&);
+        /**
+         * Sets session resume mode. For TLS1.3 session tickets a ticket
+         * key is generated here, once, so that all credentials built from
+         * this builder (e.g. on every shard) accept each other's tickets.
+         * gnutls derives the actual encryption keys from it and rotates
+         * them as time passes, the same on every shard. Call again to
+         * replace the key itself.
+         */
         void set_session_resume_mode(session_resume_mode);
+        void set_session_resume_lifetime(std::chrono::seconds);
+        void set_session_cache_size(size_t max_entries);
+        void set_kernel_tls_offload(bool);
+        void set_handshake_offload(std::optional<handshake_offload_config>);
+        void set_alpn_protocols(std::vector<sstring>);
+        void set_record_sizing(record_sizing);
 
         void apply_to(certificate_credentials&) const;
 
@@ -319,13 +428,36 @@ namespace tls {
         // for modification and reloaded if changed
         future<shared_ptr<certificate_credentials>> build_reloadable_certificate_credentials(reload_callback = {}, std::optional<std::chrono::milliseconds> tolerance = {}) const;
         future<shared_ptr<server_credentials>> build_reloadable_server_credentials(reload_callback = {}, std::optional<std::chrono::milliseconds> tolerance = {}) const;
+
+        // same as above, for all the shards at once: only the calling
+        // shard watches and parses the files, the credentials of the
+        // other shards sharing what it parsed, read only, so that a
+        // reload only costs them swapping a pointer. Element i holds the
+        // credentials of shard i, to be used there. The callback runs on
+        // the calling shard, and the credentials are reloaded as long as
+        // those of the calling shard live. The credentials must not be
+        // changed once built, as that would change them for all shards.
+        future<std::vector<foreign_ptr<shared_ptr<certificate_credentials>>>> build_sharded_reloadable_certificate_credentials(reload_callback = {}, std::optional<std::chrono::milliseconds> tolerance = {}) const;
+        future<std::vector<foreign_ptr<shared_ptr<server_credentials>>>> build_sharded_reloadable_server_credentials(reload_callback = {}, std::optional<std::chrono::milliseconds> tolerance = {}) const;
     private:
         friend class reloadable_credentials_base;
+        template<typename Base>
+        friend class reloadable_credentials;
+
+        // Everything but the certificates, keys, CRLs and trust
+        void apply_settings_to(certificate_credentials&) const;
 
         std::multimap<sstring, boost::any> _blobs;
         client_auth _client_auth = client_auth::NONE;
         session_resume_mode _session_resume_mode = session_resume_mode::NONE;
         sstring _priority;
+        std::vector<uint8_t> _session_resume_key;
+        std::optional<std::chrono::seconds> _session_resume_lifetime;
+        size_t _session_cache_size = 0;
+        bool _kernel_tls_offload = false;
+        std::optional<handshake_offload_config> _handshake_offload;
+        std::vector<sstring> _alpn_protocols;
+        record_sizing _record_sizing = record_sizing::FULL;
     };
 
     using session_data = std::vector<uint8_t>;
@@ -340,6 +472,10 @@ namespace tls {
         /// \brief Optional session resume data. Must be retrieved via 
         /// get_session_resume_data below.
         session_data session_resume_data;
+
+        /// \brief ALPN protocols to offer instead of those of the
+        /// credentials, see certificate_credentials::set_alpn_protocols()
+        std::vector<sstring> alpn_protocols;
     };
 
     /**
@@ -499,6 +635,15 @@ namespace tls {
     */
     future<session_data> get_session_resume_data(connected_socket&);
 
+    /**
+     * Get the application protocol negotiated with ALPN. Will force handshake if not already done.
+     *
+     * If the socket is not connected a system_error exception will be thrown.
+     * If the socket is not a TLS socket an exception will be thrown.
+     * If no protocol was negotiated, returns std::nullopt.
+    */
+    future<std::optional<sstring>> get_selected_alpn_protocol(connected_socket&);
+
     std::ostream& operator<<(std::ostream&, const subject_alt_name::value_type&);
     std::ostream& operator<<(std::ostream&, const subject_alt_name&);
 
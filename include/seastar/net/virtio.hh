@@ -54,6 +54,17 @@ struct virtio_options : public program_options::option_group {
     ///
     /// Default: 256.
     program_options::value<unsigned> virtio_ring_size;
+    /// \brief Unix socket of a vhost-user back-end (a userspace virtual
+    /// switch) to connect to, instead of using vhost-net and the tap device.
+    ///
+    /// The rings of each queue pair are shared with the back-end, which
+    /// both sides poll without notifying each other.
+    program_options::value<std::string> vhost_user_socket;
+    /// \brief Maximum number of vhost-user queue pairs, each driven by its
+    /// own shard; 0 for one per shard, as far as the back-end supports.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> vhost_user_queues;
 
     /// \cond internal
     virtio_options(program_options::option_group* parent_group);
@@ -0,0 +1,74 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <memory>
+#include <optional>
+#endif
+#include <seastar/net/net.hh>
+#include <seastar/net/ipv4_address.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/program-options.hh>
+
+namespace seastar {
+
+namespace net {
+
+/// AF_XDP configuration.
+///
+/// The device keeps being driven by its kernel driver: an XDP program
+/// redirects the frames of each of its receive queues to an AF_XDP socket
+/// of the shard owning the queue, and passes the frames it does not
+/// redirect on to the kernel.
+struct xdp_options : public program_options::option_group {
+    /// \brief Network interface to attach to with AF_XDP.
+    program_options::value<std::string> xdp_device;
+    /// \brief Size of each of the AF_XDP rings (must be power-of-two).
+    ///
+    /// Default: 2048.
+    program_options::value<unsigned> xdp_ring_size;
+    /// \brief Size of a UMEM frame, holding a received or sent packet
+    /// (2048 or 4096).
+    ///
+    /// Default: 4096.
+    program_options::value<unsigned> xdp_frame_size;
+    /// \brief Let the driver write received packets right into seastar
+    /// memory, where it supports it (on / off).
+    ///
+    /// Default: \p on.
+    program_options::value<std::string> xdp_zero_copy;
+
+    /// \cond internal
+    xdp_options(program_options::option_group* parent_group);
+    /// \endcond
+};
+
+}
+
+/// \cond internal
+/// \param host_address if set, only IPv4 packets to this address, and ARP
+///                     packets about it, are redirected to seastar
+std::unique_ptr<net::device> create_xdp_net_device(const net::xdp_options& opts, std::optional<net::ipv4_address> host_address);
+/// \endcond
+
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/rpc/rpc_types.hh>
+
+namespace seastar {
+
+namespace rpc {
+
+/// \addtogroup rpc
+/// @{
+
+/// \brief Compresses with another compressor only the frames it is worth it for.
+///
+/// Wraps the compressors of another factory, whose algorithms it negotiates
+/// with an "_ADAPTIVE" suffix, e.g. "LZ4_FRAGMENTED_ADAPTIVE", for a peer
+/// that does not know them to fall back to the plain ones. Frames smaller
+/// than \ref config::min_size are sent as they are, "stored", compressing
+/// them costing more than it saves. So are, for a while, the frames of a
+/// size class that compressed poorly, as already compressed blobs do: each
+/// connection keeps, for each power of two of the frame sizes, the number
+/// of frames to store before trying to compress one again, doubling it
+/// every time compression does not pay off, up to \ref config::max_backoff,
+/// and resetting it when it does. The compressor does not see the verb of
+/// a frame; different kinds of payload tend to come in frames of different
+/// sizes.
+///
+/// \code
+/// rpc::lz4_fragmented_compressor::factory lz4;
+/// rpc::adaptive_compressor_factory adaptive(lz4, {.metrics_domain = "storage"});
+/// rpc::multi_algo_compressor_factory factory{&adaptive, &lz4};
+/// \endcode
+class adaptive_compressor_factory final : public compressor::factory {
+public:
+    struct config {
+        /// Frames smaller than that are stored
+        size_t min_size = 256;
+        /// A frame compressed to more than that fraction of its size did
+        /// not pay off
+        double max_ratio = 0.9;
+        /// The most frames of a size class stored in a row after some
+        /// did not pay off
+        unsigned max_backoff = 64;
+        /// The value of the "domain" label of the "rpc_compression"
+        /// metrics; none are registered if empty
+        sstring metrics_domain;
+    };
+    /// Counters of all the connections of the factory
+    struct stats {
+        /// Frames compressed
+        uint64_t compressed_frames = 0;
+        /// Size of the frames compressed
+        uint64_t compressed_bytes_in = 0;
+        /// Size they were compressed to
+        uint64_t compressed_bytes_out = 0;
+        /// Frames stored
+        uint64_t stored_frames = 0;
+        /// Size of the frames stored
+        uint64_t stored_bytes = 0;
+        /// Time spent compressing, in nanoseconds
+        uint64_t compress_ns = 0;
+    };
+private:
+    const compressor::factory& _inner;
+    config _cfg;
+    sstring _features;
+    mutable stats _stats;
+    metrics::metric_groups _metrics;
+public:
+    /// Wraps the compressors of \c inner, which must outlive the factory
+    adaptive_compressor_factory(const compressor::factory& inner, config cfg);
+    explicit adaptive_compressor_factory(const compressor::factory& inner) : adaptive_compressor_factory(inner, config{}) {}
+
+    virtual const sstring& supported() const override;
+    virtual std::unique_ptr<compressor> negotiate(sstring feature, bool is_server) const override;
+    virtual std::unique_ptr<compressor> negotiate(sstring feature, bool is_server, std::function<future<>()> send_empty_frame) const override;
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+};
+
+/// @}
+
+}
+
+}
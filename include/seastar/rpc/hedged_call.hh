@@ -0,0 +1,180 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <concepts>
+#include <exception>
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/rpc/rpc.hh>
+
+namespace seastar {
+
+namespace rpc {
+
+/// \addtogroup rpc
+/// @{
+
+/// \brief The latency of the recent calls to a peer.
+///
+/// Keeps the latencies of the last \ref window calls, and a percentile of
+/// them, which \ref hedged_call() waits for before sending a call again to
+/// another peer. Meant to be kept by peer, and shared by the calls of verbs
+/// of similar cost.
+class peer_latency {
+public:
+    using clock_type = steady_clock_type;
+    static constexpr size_t window = 128;
+private:
+    // In microseconds, a ring of the last _count ones
+    std::array<uint32_t, window> _samples;
+    size_t _count = 0;
+    size_t _next = 0;
+    // The samples recorded since _delay was computed
+    unsigned _stale = 0;
+    double _percentile;
+    clock_type::duration _delay;
+
+    void update() noexcept;
+public:
+    /// \param percentile the percentile of the latencies to wait for before
+    ///     hedging, in (0, 1]
+    /// \param initial_delay what to wait for until there are latencies
+    explicit peer_latency(double percentile = 0.95, clock_type::duration initial_delay = std::chrono::milliseconds(10));
+
+    /// Records the latency of a call
+    void record(clock_type::duration latency) noexcept;
+    /// The time to wait for a reply before hedging
+    clock_type::duration hedge_delay() const noexcept {
+        return _delay;
+    }
+};
+
+/// \brief Makes a call which any of two peers can answer, hedging against
+/// a slow one.
+///
+/// Makes the call on \c primary and, if it has not replied after its
+/// \ref peer_latency::hedge_delay(), or failed before, again on
+/// \c alternate. Resolves to the first successful reply, cancelling the
+/// other call, or to the last error if both failed.
+///
+/// \c func makes the call on the client it is given, cancellable with the
+/// \ref cancellable it is given; it is called once or twice, and must be
+/// idempotent on the server. The timeout is the call's own. The clients
+/// must outlive the returned future. The latencies of the replies, and of
+/// the losing calls up to their cancellation, are recorded in the
+/// \ref peer_latency of their peers.
+///
+/// \code
+/// auto read = proto.make_client<sstring (sstring)>(READ);
+/// auto value = co_await rpc::hedged_call(replica1, latency1, replica2, latency2,
+///         [&] (rpc::client& c, rpc::cancellable& cancel) {
+///     return read(c, timeout, cancel, key);
+/// });
+/// \endcode
+template <typename Func>
+requires std::invocable<Func&, client&, cancellable&>
+futurize_t<std::invoke_result_t<Func&, client&, cancellable&>>
+hedged_call(client& primary, peer_latency& primary_latency, client& alternate, peer_latency& alternate_latency, Func func) {
+    using futurator = futurize<std::invoke_result_t<Func&, client&, cancellable&>>;
+    struct attempt {
+        client& c;
+        peer_latency& latency;
+        cancellable cancel;
+        peer_latency::clock_type::time_point start;
+        bool pending = false;
+    };
+    struct state : enable_lw_shared_from_this<state> {
+        Func func;
+        std::array<attempt, 2> attempts;
+        typename futurator::promise_type pr;
+        timer<> hedge;
+        unsigned started = 0;
+        bool done = false;
+        std::exception_ptr error;
+
+        state(Func f, client& c1, peer_latency& l1, client& c2, peer_latency& l2)
+                : func(std::move(f))
+                , attempts{attempt{c1, l1}, attempt{c2, l2}}
+                , hedge([this] { start(); }) {
+        }
+        // The hedge timer is only armed while the primary call is pending,
+        // which holds the state
+        void start() {
+            auto& a = attempts[started++];
+            a.pending = true;
+            a.start = peer_latency::clock_type::now();
+            (void)futurator::invoke(func, a.c, a.cancel).then_wrapped([self = this->shared_from_this(), &a] (auto f) {
+                if (!a.pending) {
+                    // Cancelled, the other call won
+                    f.ignore_ready_future();
+                    return;
+                }
+                a.pending = false;
+                if (!f.failed()) {
+                    a.latency.record(peer_latency::clock_type::now() - a.start);
+                    self->finish();
+                    f.forward_to(std::move(self->pr));
+                    return;
+                }
+                self->error = f.get_exception();
+                if (self->started < self->attempts.size()) {
+                    self->hedge.cancel();
+                    self->start();
+                } else if (!self->attempts[0].pending && !self->attempts[1].pending) {
+                    self->done = true;
+                    self->pr.set_exception(std::move(self->error));
+                }
+            });
+        }
+        void finish() {
+            done = true;
+            hedge.cancel();
+            auto now = peer_latency::clock_type::now();
+            for (unsigned i = 0; i < started; ++i) {
+                auto& a = attempts[i];
+                if (a.pending) {
+                    // Slower than the winner, at least
+                    a.latency.record(now - a.start);
+                    a.pending = false;
+                    a.cancel.cancel();
+                }
+            }
+        }
+    };
+    auto st = make_lw_shared<state>(std::move(func), primary, primary_latency, alternate, alternate_latency);
+    auto ret = st->pr.get_future();
+    st->start();
+    if (st->started == 1 && !st->done) {
+        st->hedge.arm(primary_latency.hedge_delay());
+    }
+    return ret;
+}
+
+/// @}
+
+}
+
+}
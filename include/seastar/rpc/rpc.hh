@@ -39,6 +39,9 @@
 #include <seastar/core/queue.hh>
 #include <seastar/core/weak_ptr.hh>
 #include <seastar/core/scheduling.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/tracing.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/log.hh>
 
@@ -104,6 +107,92 @@ struct resource_limits {
     using asyncronous_isolation_function = std::function<future<isolation_config> (sstring isolation_cookie)>;
     using isolation_function_alternatives = std::variant<syncronous_isolation_function, asyncronous_isolation_function>;
     isolation_function_alternatives isolate_connection = default_isolate_connection;
+    /// \brief Sheds the requests queueing for memory under overload.
+    ///
+    /// A request waits for up to \ref interval for the memory it needs, but
+    /// once the queue of requests waiting has not emptied for as long, the
+    /// server being overloaded, only for up to \ref target_delay: the
+    /// newest requests still get served quickly instead of all of them
+    /// growing stale. A request whose timeout is nearer than the latest
+    /// queueing delay is shed on arrival. A shed request gets an
+    /// \ref overloaded_error reply, which costs no memory, cheaper than
+    /// letting it time out on the client.
+    struct admission_control {
+        /// The longest a request waits under overload; zero disables
+        /// admission control
+        std::chrono::milliseconds target_delay{0};
+        /// The time the queue must have been non-empty for the server to be
+        /// overloaded, and the longest a request waits otherwise
+        std::chrono::milliseconds interval{100};
+    };
+    admission_control admission;
+};
+
+/// \brief Latency, size and concurrency metrics of chosen verbs.
+///
+/// The metrics of the clients add up all the verbs of a domain. Those of a
+/// verb_metrics tell the verbs it is told to track apart, and only those,
+/// not to multiply the series by the number of verbs: the calls of other
+/// verbs are not accounted. They are registered in the "rpc_verb" group,
+/// labelled with the domain of the verb_metrics and the name of the verb:
+///
+///  - round_trip_latency, the time from making a call to its reply, or to
+///    its send for a no-wait verb, in microseconds;
+///  - request_size, the size of the requests sent;
+///  - client_in_flight, the calls waiting for their reply;
+///  - handler_latency, the time the handler took on the server;
+///  - received_request_size and reply_size, the size of the requests
+///    handled and of their replies;
+///  - server_in_flight, the requests being handled.
+///
+/// It is passed to the clients and the servers in their options, which it
+/// must outlive, and may be shared by the clients and the servers of a
+/// shard. The domain must be unique on the shard.
+///
+/// \code
+/// rpc::verb_metrics vm("storage");
+/// vm.track(uint64_t(verb::read), "read");
+/// rpc::client_options co{.per_verb_metrics = &vm};
+/// \endcode
+class verb_metrics {
+public:
+    /// In microseconds, from 16us to 33s
+    using latency_histogram = seastar::metrics::internal::approximate_exponential_histogram<16, 33554432, 4>;
+    /// In bytes, from 64B to 1GB
+    using size_histogram = seastar::metrics::internal::approximate_exponential_histogram<64, 1073741824, 2>;
+
+    struct verb {
+        latency_histogram round_trip;
+        size_histogram request_size;
+        uint64_t client_in_flight = 0;
+        latency_histogram handler;
+        // From the arrival of the request to its handler, with
+        // server_options::rx_timestamps
+        latency_histogram wire_to_handler;
+        size_histogram received_request_size;
+        size_histogram reply_size;
+        uint64_t server_in_flight = 0;
+    };
+private:
+    sstring _domain;
+    std::unordered_map<uint64_t, std::unique_ptr<verb>> _verbs;
+    seastar::metrics::metric_groups _metrics;
+public:
+    explicit verb_metrics(sstring domain);
+    verb_metrics(verb_metrics&&) = delete;
+
+    /// Tracks the calls of \c verb, named \c name in the metrics
+    ///
+    /// \throws std::invalid_argument if the verb is already tracked
+    void track(uint64_t verb, sstring name);
+    /// The metrics of \c verb, nullptr if it is not tracked
+    verb* find(uint64_t verb) noexcept {
+        auto i = _verbs.find(verb);
+        return i != _verbs.end() ? i->second.get() : nullptr;
+    }
+    const sstring& domain() const noexcept {
+        return _domain;
+    }
 };
 
 struct client_options {
@@ -118,6 +207,38 @@ struct client_options {
     /// \see resource_limits::isolate_connection
     sstring isolation_cookie;
     sstring metrics_domain = "default";
+    /// Delays the flush of a frame by up to that long, for the frames of
+    /// the calls made meanwhile to go out with it, in as few packets as
+    /// they fit in. Zero flushes each frame once nothing is left to send,
+    /// which already coalesces the calls made back to back.
+    ///
+    /// \see client::batch()
+    std::chrono::microseconds coalescing_window{0};
+    /// The metrics of the calls of some verbs, see \ref verb_metrics
+    verb_metrics* per_verb_metrics = nullptr;
+    /// The sinks of the streams of the client, and those of the server on
+    /// them, pack the elements written while a frame is being sent in the
+    /// next one, up to that many bytes. Zero sends each element in a frame
+    /// of its own. Needs a server that supports it.
+    size_t stream_batch_size = 0;
+    /// The size of the elements a sink of the streams of the client, or of
+    /// the server on them, may send before the source at the other end
+    /// consumes them, granting their size back to the sink as credit. Zero
+    /// lets a sink send as much as the connection takes. Needs a server
+    /// that supports it.
+    size_t stream_window = 0;
+    /// Runs each call in a span, see \ref tracing, the context of which is
+    /// sent with the call for the server to run the handler in a child span.
+    /// Only the calls of sampled traces are recorded, but the context takes
+    /// 25 bytes in the frame of each call to a server that supports it.
+    bool propagate_tracing = false;
+    /// Sends the frames of the calls made from different scheduling groups
+    /// in the proportion of the groups' shares, rather than in the order
+    /// they were made, so that a small call is not held up behind the large
+    /// ones of a background group. Those of a group are still sent in
+    /// order. Frames are not split: a frame being sent holds up the others
+    /// until it is fully written.
+    bool fair_send_queue = false;
 };
 
 /// @}
@@ -153,6 +274,20 @@ struct server_options {
     bool tcp_nodelay = true;
     std::optional<streaming_domain_type> streaming_domain;
     server_socket::load_balancing_algorithm load_balancing_algorithm = server_socket::load_balancing_algorithm::default_;
+    /// Delays the flush of a response by up to that long, for the ones sent
+    /// meanwhile to go out with it. \see client_options::coalescing_window
+    std::chrono::microseconds coalescing_window{0};
+    /// The metrics of the requests of some verbs, see \ref verb_metrics
+    verb_metrics* per_verb_metrics = nullptr;
+    /// Sends the responses of the handlers running in different scheduling
+    /// groups in the proportion of the groups' shares, see
+    /// client_options::fair_send_queue. Applies to the handlers registered
+    /// with a scheduling group, and to the connections isolated in one.
+    bool fair_send_queue = false;
+    /// Makes the connections record when the requests arrive, for the
+    /// latency from the wire to the handlers in the per-verb metrics, see
+    /// connected_socket::enable_rx_timestamps()
+    bool rx_timestamps = false;
     // optional filter function. If set, will be called with remote 
     // (connecting) address.    
     // Returning false will refuse the incoming connection. 
@@ -179,6 +314,9 @@ enum class protocol_features : uint32_t {
     CONNECTION_ID = 2,
     STREAM_PARENT = 3,
     ISOLATION = 4,
+    STREAM_FLOW_CONTROL = 5,
+    TRACING = 6,
+    SHARD_INFO = 7,
 };
 
 // internal representation of feature data
@@ -282,9 +420,31 @@ class connection {
     future<> _outgoing_queue_ready = _negotiated->get_shared_future();
     outgoing_entry::container_t _outgoing_queue;
     size_t _outgoing_queue_size = 0;
+    // With a fair send queue, the frames wait in the queue of the scheduling
+    // group they were sent from, see send_fair(), and the entries of
+    // _outgoing_queue are the slots they are sent in, in turn
+    struct send_class {
+        outgoing_entry::container_t queue;
+        scheduling_group sg;
+        // The bytes the class has been entitled to send, in the proportion
+        // of its shares, while others were sending
+        double credit = 0;
+    };
+    std::unique_ptr<std::array<send_class, max_scheduling_groups()>> _send_classes;
+    unsigned _send_turn = 0;
     std::unique_ptr<compressor> _compressor;
     bool _propagate_timeout = false;
     bool _timeout_negotiated = false;
+    // Whether the request frames have room for a span context, and whether
+    // the peer reads it
+    bool _tracing_reserved = false;
+    bool _tracing_negotiated = false;
+    // Coalescing of the frames sent: while a batch is open, or for up to
+    // the window after one is written, they are not flushed
+    std::chrono::microseconds _coalescing_window{0};
+    timer<> _flush_timer;
+    unsigned _batches = 0;
+    bool _unflushed = false;
     // stream related fields
     bool _is_stream = false;
     connection_id _id = invalid_connection_id;
@@ -292,6 +452,19 @@ class connection {
     std::unordered_map<connection_id, xshard_connection_ptr> _streams;
     queue<rcv_buf> _stream_queue = queue<rcv_buf>(max_queued_stream_buffers);
     semaphore _stream_sem = semaphore(max_stream_buffers_memory);
+    // Negotiated with protocol_features::STREAM_FLOW_CONTROL
+    uint32_t _stream_batch_size = 0;
+    uint32_t _stream_window = 0;
+    // The credit the sink has left, and the frames waiting for more
+    struct pending_stream_frame {
+        snd_buf buf;
+        uint32_t charge;
+        promise<> done;
+    };
+    uint32_t _stream_credit = 0;
+    circular_buffer<pending_stream_frame> _stream_pending;
+    // The credit the source consumed and did not grant back yet
+    uint32_t _stream_credit_owed = 0;
     bool _sink_closed = true;
     bool _source_closed = true;
     // the future holds if sink is already closed
@@ -308,6 +481,12 @@ class connection {
     future<> send_buffer(snd_buf buf);
     future<> send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout = {}, cancellable* cancel = nullptr);
     future<> send_entry(outgoing_entry& d) noexcept;
+    future<> send_fair(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel);
+    outgoing_entry* pick_fair() noexcept;
+    void enable_fair_send_queue();
+    future<> flush_or_delay();
+    void enqueue_flush();
+    void end_batch() noexcept;
     future<> stop_send_loop(std::exception_ptr ex);
     future<std::optional<rcv_buf>>  read_stream_frame_compressed(input_stream<char>& in);
     bool stream_check_twoway_closed() const noexcept {
@@ -316,12 +495,24 @@ class connection {
     future<> stream_close();
     future<> stream_process_incoming(rcv_buf&&);
     future<> handle_stream_frame();
+    void set_stream_flow_control(const sstring& data);
+    // Sends a frame of the sink once the credit of its elements is granted
+    future<> send_stream_frame(snd_buf buf, uint32_t charge);
+    void send_pending_stream_frames();
+    void grant_stream_credit();
+    // The credit the element of that size, with its header, takes, none
+    // without a window
+    uint32_t stream_charge(size_t size) const noexcept {
+        return std::min<size_t>(size, _stream_window);
+    }
 
 public:
     connection(connected_socket&& fd, const logger& l, void* s, connection_id id = invalid_connection_id) : connection(l, s, id) {
         set_socket(std::move(fd));
     }
-    connection(const logger& l, void* s, connection_id id = invalid_connection_id) : _logger(l), _serializer(s), _id(id) {}
+    connection(const logger& l, void* s, connection_id id = invalid_connection_id) : _logger(l), _serializer(s), _id(id) {
+        _flush_timer.set_callback([this] { enqueue_flush(); });
+    }
     virtual ~connection() {}
     size_t outgoing_queue_length() const noexcept {
         return _outgoing_queue_size;
@@ -392,6 +583,7 @@ class connection {
 struct deferred_snd_buf {
     promise<> pr;
     snd_buf data;
+    uint32_t charge = 0;
 };
 
 // send data Out...
@@ -399,6 +591,25 @@ template<typename Serializer, typename... Out>
 class sink_impl : public sink<Out...>::impl {
     // Used on the shard *this lives on.
     alignas (cache_line_size) uint64_t _next_seq_num = 1;
+    // With batching negotiated, the elements are added to the batch in the
+    // order they were written in, those written ahead of their turn waiting
+    // for it, and the batch is sent once no frame is, or once it is full
+    uint32_t _batch_size;
+    uint64_t _next_batched_seq_num = 1;
+    uint64_t _next_frame_seq_num = 1;
+    std::map<uint64_t, std::pair<snd_buf, semaphore_units<>>> _early;
+    struct {
+        std::vector<temporary_buffer<char>> bufs;
+        size_t size = 0;
+        uint32_t charge = 0;
+        semaphore_units<> units;
+    } _batch;
+    unsigned _frames_in_flight = 0;
+
+    void send_frame(uint64_t seq_num, snd_buf data, uint32_t charge, semaphore_units<> su);
+    void batch(uint64_t seq_num, snd_buf data, semaphore_units<> su);
+    void add_to_batch(snd_buf data, semaphore_units<> su);
+    void send_batch();
 
     // Used on the shard the _conn lives on.
     struct alignas (cache_line_size) {
@@ -406,7 +617,9 @@ class sink_impl : public sink<Out...>::impl {
         std::map<uint64_t, deferred_snd_buf> out_of_order_bufs;
     } _remote_state;
 public:
-    sink_impl(xshard_connection_ptr con) : sink<Out...>::impl(std::move(con)) { this->_con->get()->_sink_closed = false; }
+    sink_impl(xshard_connection_ptr con) : sink<Out...>::impl(std::move(con)), _batch_size(this->_con->get()->_stream_batch_size) {
+        this->_con->get()->_sink_closed = false;
+    }
     future<> operator()(const Out&... args) override;
     future<> close() override;
     future<> flush() override;
@@ -421,6 +634,14 @@ class source_impl : public source<In...>::impl {
     future<std::optional<std::tuple<In...>>> operator()() override;
 };
 
+/// The shards of a server, which it tells the clients connecting to it
+struct shard_info {
+    /// The number of shards of the server
+    unsigned shards;
+    /// The shard serving the connection
+    unsigned shard;
+};
+
 class client : public rpc::connection, public weakly_referencable<client> {
     socket _socket;
     id_type _message_id = 1;
@@ -468,11 +689,11 @@ class client : public rpc::connection, public weakly_referencable<client> {
         }
         virtual void timeout() override {
             reply.done = true;
-            reply.p.set_exception(timeout_error());
+            reply.p.set_exception(cached_exception_ptr<timeout_error>());
         }
         virtual void cancel() override {
             reply.done = true;
-            reply.p.set_exception(canceled_error());
+            reply.p.set_exception(cached_exception_ptr<canceled_error>());
         }
         virtual ~reply_handler() {}
     };
@@ -481,6 +702,8 @@ class client : public rpc::connection, public weakly_referencable<client> {
     socket_address _server_addr, _local_addr;
     client_options _options;
     weak_ptr<client> _parent; // for stream clients
+    // Negotiated with protocol_features::SHARD_INFO
+    std::optional<shard_info> _peer_shard_info;
 
     metrics _metrics;
 
@@ -515,9 +738,53 @@ class client : public rpc::connection, public weakly_referencable<client> {
     client(const logger& l, void* s, client_options options, socket socket, const socket_address& addr, const socket_address& local = {});
 
     stats get_stats() const;
+    bool propagates_tracing() const noexcept {
+        return _options.propagate_tracing;
+    }
     size_t incoming_queue_length() const noexcept {
         return _outstanding.size();
     }
+    /// The shards of the server, once the connection is negotiated, if the
+    /// server tells them
+    const std::optional<shard_info>& peer_shard_info() const noexcept {
+        return _peer_shard_info;
+    }
+
+    /// \brief Holds the flush of the frames of the calls made while it is alive.
+    ///
+    /// See \ref client::batch().
+    class batch_guard {
+        weak_ptr<client> _client;
+    public:
+        explicit batch_guard(client& c) noexcept;
+        batch_guard(batch_guard&&) noexcept = default;
+        batch_guard& operator=(batch_guard&&) = delete;
+        ~batch_guard();
+    };
+
+    /// Opens a batch of calls: the frames of the calls made until the
+    /// returned guard is destroyed are written as they are sent but only
+    /// flushed at the end, in as few packets as they fit in. The calls
+    /// still are separate requests, each with its own reply; do not wait
+    /// for one of them before the guard is gone.
+    ///
+    /// \code
+    /// std::vector<future<int>> replies;
+    /// {
+    ///     auto batch = client.batch();
+    ///     for (auto key : keys) {
+    ///         replies.push_back(read(client, key));
+    ///     }
+    /// }
+    /// return when_all_succeed(replies.begin(), replies.end());
+    /// \endcode
+    batch_guard batch() noexcept {
+        return batch_guard(*this);
+    }
+
+    verb_metrics::verb* verb_stats(uint64_t verb) const noexcept {
+        return _options.per_verb_metrics ? _options.per_verb_metrics->find(verb) : nullptr;
+    }
 
     auto next_message_id() { return _message_id++; }
     void wait_for_reply(id_type id, std::unique_ptr<reply_handler_base>&& h, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel);
@@ -544,6 +811,7 @@ class client : public rpc::connection, public weakly_referencable<client> {
             client_options o = _options;
             o.stream_parent = this->get_connection_id();
             o.send_timeout_data = false;
+            o.propagate_tracing = false;
             o.metrics_domain += "_stream";
             auto c = make_shared<client>(_logger, _serializer, o, std::move(socket), _server_addr, _local_addr);
             c->_parent = this->weak_from_this();
@@ -583,6 +851,10 @@ class server {
         client_info _info;
         connection_id _parent_id = invalid_connection_id;
         std::optional<isolation_config> _isolation_config;
+        // The span context of the request being dispatched
+        tracing::span_context _span_context;
+        // When the request being dispatched arrived
+        std::optional<std::chrono::system_clock::time_point> _rx_timestamp;
     private:
         future<> negotiate_protocol();
         future<std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<rcv_buf>>>
@@ -595,6 +867,16 @@ class server {
         future<> respond(int64_t msg_id, snd_buf&& data, std::optional<rpc_clock_type::time_point> timeout);
         client_info& info() { return _info; }
         const client_info& info() const { return _info; }
+        verb_metrics::verb* verb_stats(uint64_t verb) const noexcept;
+        // The span context the client sent with the request the handler is
+        // called for, to be taken before it returns
+        tracing::span_context take_span_context() noexcept {
+            return std::exchange(_span_context, {});
+        }
+        // When the request the handler is called for arrived, likewise
+        std::optional<std::chrono::system_clock::time_point> take_rx_timestamp() noexcept {
+            return std::exchange(_rx_timestamp, std::nullopt);
+        }
         stats get_stats() const {
             stats res = _stats;
             res.pending = outgoing_queue_length();
@@ -611,6 +893,13 @@ class server {
                 return get_units(get_server()._resources_available, memory_consumed);
             }
         }
+        // Like wait_for_resources(), but throws overloaded_error for a request
+        // shed by the admission control
+        future<resource_permit> admit(size_t memory_consumed, std::optional<rpc_clock_type::time_point> timeout);
+        bool admission_control_enabled() const noexcept {
+            return get_server()._limits.admission.target_delay.count();
+        }
+        future<> send_overloaded_reply(int64_t msg_id, std::optional<rpc_clock_type::time_point> timeout);
         size_t estimate_request_size(size_t serialized_size) {
             return rpc::estimate_request_size(get_server()._limits, serialized_size);
         }
@@ -631,6 +920,10 @@ class server {
     server_socket _ss;
     resource_limits _limits;
     rpc_semaphore _resources_available;
+    // When the queue of requests waiting for memory was last seen empty, and
+    // the time the last request admitted waited
+    rpc_clock_type::time_point _resources_queue_empty = rpc_clock_type::now();
+    rpc_clock_type::duration _resources_queue_delay{0};
     std::unordered_map<connection_id, shared_ptr<connection>> _conns;
     promise<> _ss_stopped;
     gate _reply_gate;
@@ -0,0 +1,202 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <optional>
+#include <vector>
+#include <seastar/core/gate.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/rpc/rpc.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+namespace seastar {
+
+namespace rpc {
+
+/// \addtogroup rpc
+/// @{
+
+/// How a \ref client_pool spreads the calls over its connections
+enum class client_pool_balancing {
+    /// Each call on the next connection
+    round_robin,
+    /// Each call on the connection with the fewest calls queued or waiting
+    /// for their reply
+    least_outstanding,
+};
+
+/// The size class of a call, choosing the connections of a \ref client_pool
+/// it may use
+enum class call_size {
+    /// Latency sensitive calls, using the small lanes if there are any
+    small,
+    /// Calls with large arguments or replies, or streams, kept off the
+    /// small lanes
+    large,
+};
+
+struct client_pool_options {
+    /// The number of connections to the peer
+    unsigned connections = 2;
+    /// The connections, out of \ref connections, reserved to the
+    /// \ref call_size::small calls; the large ones use the others. Zero
+    /// has all calls share all the connections.
+    unsigned small_lanes = 0;
+    client_pool_balancing balancing = client_pool_balancing::least_outstanding;
+    /// The number of shards of the peer, if its server balances the
+    /// connections with \ref server_socket::load_balancing_algorithm::port:
+    /// the pool then connects from local ports that have its connections
+    /// served by the peer's shard with the index of the local one (modulo
+    /// its number of shards). IPv4 only.
+    std::optional<unsigned> peer_shards;
+    /// The options of each connection
+    client_options client;
+};
+
+/// \brief Connections to a peer, over which calls are spread.
+///
+/// A \ref client sends calls, and receives their replies, over a single
+/// connection, one after the other: a large call or reply holds up all the
+/// ones behind it. A pool keeps several connections to the peer, and picks
+/// one for each call, as set by \ref client_pool_options. A connection that
+/// failed is replaced by a new one when it is next picked.
+///
+/// \code
+/// rpc::client_pool pool(opts, rpc::make_client_factory(proto, peer));
+/// auto get = proto.make_client<sstring (sstring)>(GET);
+/// auto put = proto.make_client<void (sstring, sstring)>(PUT);
+/// auto value = co_await get(pool.pick(), key);
+/// co_await put(pool.pick(rpc::call_size::large), key, blob);
+/// \endcode
+class client_pool {
+public:
+    /// Makes a connection to the peer, with the given options, from the
+    /// given local address
+    using factory = noncopyable_function<shared_ptr<client> (const client_options&, const socket_address& local)>;
+private:
+    client_pool_options _options;
+    factory _factory;
+    std::vector<shared_ptr<client>> _clients;
+    unsigned _next = 0;
+    // The local port of the next connection, with peer_shards
+    uint16_t _next_port = 0;
+    // Holds the replaced connections until they are stopped
+    gate _replaced;
+
+    shared_ptr<client> connect();
+    client& get(unsigned i);
+public:
+    /// Opens options.connections connections with \c f
+    ///
+    /// \throws std::invalid_argument if there are no connections for the
+    ///     large calls
+    client_pool(client_pool_options options, factory f);
+    client_pool(client_pool&&) = delete;
+
+    /// Picks the connection to make a call of the given size on
+    client& pick(call_size size = call_size::small);
+    /// The number of connections
+    size_t size() const noexcept {
+        return _clients.size();
+    }
+    /// Stops all the connections. Must be called before destroying the
+    /// pool, and no connection may be picked afterwards.
+    future<> stop() noexcept;
+};
+
+struct shard_aware_client_pool_options {
+    /// Maps the key of a call to the shard of the peer owning it, out of its
+    /// shards
+    noncopyable_function<unsigned (uint64_t key, unsigned shards)> key_to_shard = [] (uint64_t key, unsigned shards) {
+        return key % shards;
+    };
+    /// The options of each connection
+    client_options client;
+};
+
+/// \brief Connections to each shard of a peer, over which calls are routed
+/// to the shard owning their key.
+///
+/// A server whose handlers forward the calls to the shard owning their data
+/// adds a cross-shard hop to all the calls arriving on another one. When
+/// its server_socket balances the connections with
+/// \ref server_socket::load_balancing_algorithm::port, a shard aware pool
+/// learns the number of shards of the peer from its first connection,
+/// which the server tells when negotiating, then opens one connection to
+/// each of them, from a local port the peer serves on it. The calls made
+/// with \ref pick() go to the shard \ref
+/// shard_aware_client_pool_options::key_to_shard maps their key to; until
+/// the connections are open, and with a server that does not tell its
+/// shards, they all use the first connection. IPv4 only.
+///
+/// \code
+/// rpc::shard_aware_client_pool pool(opts, rpc::make_client_factory(proto, peer));
+/// auto value = co_await get(pool.pick(hash(key)), key);
+/// \endcode
+class shard_aware_client_pool {
+    shard_aware_client_pool_options _options;
+    client_pool::factory _factory;
+    // The connection the peer's shards are learnt from, and the one the
+    // calls use until then
+    shared_ptr<client> _first;
+    // The connections to each shard of the peer, once learnt
+    std::vector<shared_ptr<client>> _clients;
+    uint16_t _next_port;
+    bool _stopping = false;
+    // Holds the connections being learnt from and the replaced ones
+    gate _background;
+
+    void connect_first();
+    shared_ptr<client> connect(unsigned shard);
+    void replace(shared_ptr<client> failed);
+public:
+    /// Opens the first connection with \c f
+    shard_aware_client_pool(shard_aware_client_pool_options options, client_pool::factory f);
+    shard_aware_client_pool(shard_aware_client_pool&&) = delete;
+
+    /// Picks the connection to the shard owning \c key
+    client& pick(uint64_t key);
+    /// Picks the connection to the peer's shard, modulo its shards
+    client& pick_shard(unsigned shard);
+    /// The number of shards of the peer, zero until they are learnt
+    unsigned peer_shards() const noexcept {
+        return _clients.size();
+    }
+    /// Stops all the connections. Must be called before destroying the
+    /// pool, and no connection may be picked afterwards.
+    future<> stop() noexcept;
+};
+
+/// Makes a \ref client_pool::factory of \ref protocol::client connections
+/// to \c peer
+template <typename Serializer, typename MsgType>
+client_pool::factory make_client_factory(protocol<Serializer, MsgType>& proto, socket_address peer) {
+    return [&proto, peer] (const client_options& options, const socket_address& local) -> shared_ptr<client> {
+        return ::seastar::make_shared<typename protocol<Serializer, MsgType>::client>(proto, options, peer, local);
+    };
+}
+
+/// @}
+
+}
+
+}
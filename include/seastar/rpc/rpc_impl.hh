@@ -38,6 +38,7 @@ namespace rpc {
 enum class exception_type : uint32_t {
     USER = 0,
     UNKNOWN_VERB = 1,
+    OVERLOADED = 2,
 };
 
 template<typename T>
@@ -236,6 +237,23 @@ struct marshall_one {
             put_connection_id(arg.get_id(), out);
         }
     };
+    template <typename T>
+    requires std::same_as<std::remove_cvref_t<T>, fragmented_payload>
+    struct helper<T> {
+        static void doit(Serializer&, Output& out, const fragmented_payload& arg) {
+            uint32_t size = cpu_to_le(uint32_t(arg.size()));
+            out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            if constexpr (requires { out.splice(arg); }) {
+                if (arg.size() >= fragmented_payload::splice_threshold) {
+                    out.splice(arg);
+                    return;
+                }
+            }
+            for (auto& f : arg.fragments()) {
+                out.write(f.get(), f.size());
+            }
+        }
+    };
     template <typename... T> struct helper<tuple<T...>> {
         static void doit(Serializer& serializer, Output& out, const tuple<T...>& arg) {
             auto do_do_marshall = [&serializer, &out] (const auto&... args) {
@@ -266,10 +284,83 @@ static inline memory_output_stream<snd_buf::iterator> make_serializer_stream(snd
     }
 }
 
+// Measures a frame, and where the payloads appended to it without copying
+// them split it
+class splicing_measuring_stream {
+    size_t _size = 0;
+    // The size of the frame written in place before each payload spliced
+    std::vector<size_t> _splices;
+public:
+    void write(const char*, size_t size) {
+        _size += size;
+    }
+    void splice(const fragmented_payload&) {
+        _splices.push_back(_size);
+    }
+    // The size of the frame written in place
+    size_t size() const {
+        return _size;
+    }
+    const std::vector<size_t>& splices() const {
+        return _splices;
+    }
+};
+
+// Writes a frame in place, in a buffer per part between the payloads it
+// appends without copying them
+class splicing_output_stream {
+    const std::vector<size_t>& _splices;
+    size_t _inline_size;
+    std::vector<temporary_buffer<char>> _bufs;
+    simple_memory_output_stream _current;
+    size_t _size = 0;
+    unsigned _next = 0;
+
+    void start_part(size_t size) {
+        _bufs.emplace_back(size);
+        _current = simple_memory_output_stream(_bufs.back().get_write(), size);
+        _size += size;
+    }
+public:
+    splicing_output_stream(size_t head_space, const splicing_measuring_stream& measure)
+            : _splices(measure.splices()), _inline_size(measure.size()) {
+        _bufs.reserve(2 * _splices.size() + 1);
+        start_part(head_space + _splices.front());
+    }
+    void write(const char* p, size_t size) {
+        _current.write(p, size);
+    }
+    void skip(size_t size) {
+        _current.skip(size);
+    }
+    void splice(const fragmented_payload& payload) {
+        for (auto& f : payload.share()) {
+            if (!f.empty()) {
+                _size += f.size();
+                _bufs.push_back(std::move(f));
+            }
+        }
+        auto end = _next + 1 < _splices.size() ? _splices[_next + 1] : _inline_size;
+        auto part = end - _splices[_next++];
+        if (part) {
+            start_part(part);
+        }
+    }
+    snd_buf finish() && {
+        return snd_buf(std::move(_bufs), _size);
+    }
+};
+
 template <typename Serializer, typename... T>
 inline snd_buf marshall(Serializer& serializer, size_t head_space, const T&... args) {
-    measuring_output_stream measure;
+    splicing_measuring_stream measure;
     do_marshall(serializer, measure, args...);
+    if (!measure.splices().empty()) {
+        splicing_output_stream out(head_space, measure);
+        out.skip(head_space);
+        do_marshall(serializer, out, args...);
+        return std::move(out).finish();
+    }
     snd_buf ret(measure.size() + head_space);
     auto out = make_serializer_stream(ret);
     out.skip(head_space);
@@ -280,6 +371,45 @@ inline snd_buf marshall(Serializer& serializer, size_t head_space, const T&... a
 template <typename Serializer, typename Input, typename... T>
 std::tuple<T...> do_unmarshall(connection& c, Input& in);
 
+inline fragmented_payload read_payload(simple_memory_input_stream& in, size_t size) {
+    temporary_buffer<char> buf(size);
+    in.read(buf.get_write(), size);
+    return fragmented_payload(std::move(buf));
+}
+
+// Shares the fragments of the frame
+inline fragmented_payload read_payload(fragmented_memory_input_stream<rcv_buf::iterator>& in, size_t size) {
+    if (size > in.size()) {
+        throw std::out_of_range("deserialization buffer underflow");
+    }
+    std::vector<temporary_buffer<char>> fragments;
+    auto it = in.fragment_iterator();
+    size_t left = size;
+    if (in.first_fragment_size()) {
+        // The rest of the fragment the stream is in
+        auto& current = *std::prev(it);
+        auto n = std::min(left, in.first_fragment_size());
+        fragments.push_back(current.share(in.first_fragment_data() - current.get(), n));
+        left -= n;
+    }
+    for (; left; ++it) {
+        auto n = std::min(left, it->size());
+        if (n) {
+            fragments.push_back(it->share(0, n));
+        }
+        left -= n;
+    }
+    in.skip(size);
+    return fragmented_payload(std::move(fragments));
+}
+
+template <typename T>
+struct has_fragmented_payload : std::is_same<T, fragmented_payload> {};
+template <typename T>
+struct has_fragmented_payload<std::reference_wrapper<const T>> : has_fragmented_payload<T> {};
+template <typename... T>
+struct has_fragmented_payload<tuple<T...>> : std::disjunction<has_fragmented_payload<T>...> {};
+
 template<typename Serializer, typename Input>
 struct unmarshal_one {
     template<typename T> struct helper {
@@ -316,6 +446,18 @@ struct unmarshal_one {
             return source<T...>(make_shared<source_impl<Serializer, T...>>(c.get_stream(get_connection_id(in))));
         }
     };
+    template<typename T>
+    requires std::same_as<T, fragmented_payload>
+    struct helper<T> {
+        static fragmented_payload doit(connection&, Input& in) {
+            uint32_t size;
+            in.read(reinterpret_cast<char*>(&size), sizeof(size));
+            size = le_to_cpu(size);
+            return in.with_stream([size] (auto& stream) {
+                return read_payload(stream, size);
+            });
+        }
+    };
     template <typename... T> struct helper<tuple<T...>> {
         static tuple<T...> doit(connection& c, Input& in) {
             return do_unmarshall<Serializer, Input, T...>(c, in);
@@ -339,6 +481,14 @@ inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
 
 template <typename Serializer, typename... T>
 inline std::tuple<T...> unmarshall(connection& c, rcv_buf input) {
+    if constexpr ((has_fragmented_payload<T>::value || ...)) {
+        // Only the fragmented stream lets the payloads share the buffers
+        if (auto one = std::get_if<temporary_buffer<char>>(&input.bufs)) {
+            std::vector<temporary_buffer<char>> bufs;
+            bufs.push_back(std::move(*one));
+            input.bufs = std::move(bufs);
+        }
+    }
     auto in = make_deserializer_stream(input);
     return do_unmarshall<Serializer, decltype(in), T...>(c, in);
 }
@@ -366,6 +516,9 @@ inline std::exception_ptr unmarshal_exception(rcv_buf& d) {
         ex = std::make_exception_ptr(unknown_verb_error(le_to_cpu(v64)));
         break;
     }
+    case exception_type::OVERLOADED:
+        ex = std::make_exception_ptr(overloaded_error());
+        break;
     default:
         ex = std::make_exception_ptr(unknown_exception_error());
         break;
@@ -384,7 +537,7 @@ struct rcv_reply_base  {
     }
     ~rcv_reply_base() {
         if (!done) {
-            p.set_exception(closed_error());
+            p.set_exception(cached_exception_ptr<closed_error>());
         }
     }
 };
@@ -470,19 +623,51 @@ auto send_helper(MsgType xt, signature<Ret (InArgs...)> xsig) {
         auto send(rpc::client& dst, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel, const InArgs&... args) {
             if (dst.error()) {
                 using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
-                return futurize<cleaned_ret_type>::make_exception_future(closed_error());
+                return futurize<cleaned_ret_type>::make_exception_future(cached_exception_ptr<closed_error>());
+            }
+
+            auto stats = dst.verb_stats(uint64_t(t));
+            auto start = stats ? rpc_clock_type::now() : rpc_clock_type::time_point();
+
+            // The span context goes after the header, see request_frame
+            tracing::span span;
+            size_t headroom = request_frame_headroom;
+            if (dst.propagates_tracing()) {
+                span = tracing::span("rpc.client");
+                if (span.sampled()) {
+                    span.set_name(format("rpc.client {}", uint64_t(t)));
+                }
+                headroom += tracing::span_context::serialized_size;
             }
 
             // send message
             auto msg_id = dst.next_message_id();
-            snd_buf data = marshall(dst.template serializer<Serializer>(), request_frame_headroom, args...);
+            snd_buf data = marshall(dst.template serializer<Serializer>(), headroom, args...);
+            if (stats) {
+                stats->request_size.add(data.size - headroom);
+            }
+            if (dst.propagates_tracing()) {
+                span.context().serialize(data.front().get_write() + request_frame_headroom);
+            }
 
             // prepare reply handler, if return type is now_wait_type this does nothing, since no reply will be sent
             using wait = wait_signature_t<Ret>;
-            return when_all(dst.request(uint64_t(t), msg_id, std::move(data), timeout, cancel), wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig)).then([] (auto r) {
+            auto f = when_all(dst.request(uint64_t(t), msg_id, std::move(data), timeout, cancel), wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig)).then([] (auto r) {
                     std::get<0>(r).ignore_ready_future();
                     return std::move(std::get<1>(r)); // return future of wait_for_reply
             });
+            if (span.sampled()) {
+                f = f.finally([span = std::move(span)] {});
+            }
+            if (!stats) {
+                return f;
+            }
+            stats->client_in_flight++;
+            return f.then_wrapped([stats, start] (auto ret) {
+                stats->round_trip.add(std::chrono::duration_cast<std::chrono::microseconds>(rpc_clock_type::now() - start).count());
+                stats->client_in_flight--;
+                return ret;
+            });
         }
         auto operator()(rpc::client& dst, const InArgs&... args) {
             return send(dst, {}, nullptr, args...);
@@ -496,6 +681,12 @@ auto send_helper(MsgType xt, signature<Ret (InArgs...)> xsig) {
         auto operator()(rpc::client& dst, cancellable& cancel, const InArgs&... args) {
             return send(dst, {}, &cancel, args...);
         }
+        auto operator()(rpc::client& dst, rpc_clock_type::time_point timeout, cancellable& cancel, const InArgs&... args) {
+            return send(dst, timeout, &cancel, args...);
+        }
+        auto operator()(rpc::client& dst, rpc_clock_type::duration timeout, cancellable& cancel, const InArgs&... args) {
+            return send(dst, relative_timeout_to_absolute(timeout), &cancel, args...);
+        }
 
     };
     return shelper{xt, xsig};
@@ -506,7 +697,7 @@ static constexpr size_t response_frame_headroom = 12;
 
 template<typename Serializer, typename RetTypes>
 inline future<> reply(wait_type, future<RetTypes>&& ret, int64_t msg_id, shared_ptr<server::connection> client,
-        std::optional<rpc_clock_type::time_point> timeout) {
+        std::optional<rpc_clock_type::time_point> timeout, verb_metrics::verb* stats = nullptr) {
     if (!client->error()) {
         snd_buf data;
         try {
@@ -529,6 +720,9 @@ inline future<> reply(wait_type, future<RetTypes>&& ret, int64_t msg_id, shared_
             msg_id = -msg_id;
         }
 
+        if (stats) {
+            stats->reply_size.add(data.size - response_frame_headroom);
+        }
         return client->respond(msg_id, std::move(data), timeout);
     } else {
         ret.ignore_ready_future();
@@ -538,7 +732,7 @@ inline future<> reply(wait_type, future<RetTypes>&& ret, int64_t msg_id, shared_
 
 // specialization for no_wait_type which does not send a reply
 template<typename Serializer>
-inline future<> reply(no_wait_type, future<no_wait_type>&& r, int64_t msgid, shared_ptr<server::connection> client, std::optional<rpc_clock_type::time_point>) {
+inline future<> reply(no_wait_type, future<no_wait_type>&& r, int64_t msgid, shared_ptr<server::connection> client, std::optional<rpc_clock_type::time_point>, verb_metrics::verb* = nullptr) {
     try {
         r.get();
     } catch (std::exception& ex) {
@@ -567,10 +761,10 @@ auto lref_to_cref(T& x) {
 // Creates lambda to handle RPC message on a server.
 // The lambda unmarshalls all parameters, calls a handler, marshall return values and sends them back to a client
 template <typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint>
-auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint) {
+auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint, uint64_t verb) {
     using signature = decltype(sig);
     using wait_style = wait_signature_t<Ret>;
-    return [func = lref_to_cref(std::forward<Func>(func))](shared_ptr<server::connection> client,
+    return [func = lref_to_cref(std::forward<Func>(func)), verb](shared_ptr<server::connection> client,
                                                            std::optional<rpc_clock_type::time_point> timeout,
                                                            int64_t msg_id,
                                                            rcv_buf data,
@@ -587,14 +781,45 @@ auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, Wa
             }).handle_exception_type([] (gate_closed_exception&) {/* ignore */});
             return make_ready_future();
         }
+        auto span_context = client->take_span_context();
+        auto rx_timestamp = client->take_rx_timestamp();
         // note: apply is executed asynchronously with regards to networking so we cannot chain futures here by doing "return apply()"
-        auto f = client->wait_for_resources(memory_consumed, timeout).then([client, timeout, msg_id, data = std::move(data), &func, g = std::move(guard)] (auto permit) mutable {
+        auto f = client->admit(memory_consumed, timeout).then([client, timeout, msg_id, data = std::move(data), &func, g = std::move(guard), verb, span_context, rx_timestamp] (auto permit) mutable {
                 // FIXME: future is discarded
-                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), &func] () mutable {
+                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), &func, verb, span_context, rx_timestamp] () mutable {
                     try {
+                        auto stats = client->verb_stats(verb);
+                        if (stats) {
+                            stats->received_request_size.add(data.size);
+                        }
                         auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
-                        return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args)).then_wrapped([client, timeout, msg_id, permit = std::move(permit)] (futurize_t<Ret> ret) mutable {
-                            return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout).handle_exception([permit = std::move(permit), client, msg_id] (std::exception_ptr eptr) {
+                        auto start = stats ? rpc_clock_type::now() : rpc_clock_type::time_point();
+                        if (stats) {
+                            stats->server_in_flight++;
+                            if (rx_timestamp) {
+                                // The NIC clock may run ahead of the system one
+                                auto wait = std::max(std::chrono::system_clock::now() - *rx_timestamp, std::chrono::system_clock::duration(0));
+                                stats->wire_to_handler.add(std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+                            }
+                        }
+                        tracing::span span;
+                        if (span_context.valid()) {
+                            span = tracing::span("rpc.server", span_context);
+                            if (span.sampled()) {
+                                span.set_name(format("rpc.server {}", verb));
+                            }
+                        }
+                        auto applied = [&] {
+                            tracing::span_scope scope(span);
+                            return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args));
+                        }();
+                        return std::move(applied).then_wrapped([client, timeout, msg_id, permit = std::move(permit), stats, start, span = std::move(span)] (futurize_t<Ret> ret) mutable {
+                            span.end();
+                            if (stats) {
+                                stats->handler.add(std::chrono::duration_cast<std::chrono::microseconds>(rpc_clock_type::now() - start).count());
+                                stats->server_in_flight--;
+                            }
+                            return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout, stats).handle_exception([permit = std::move(permit), client, msg_id] (std::exception_ptr eptr) {
                                 client->get_logger()(client->info(), msg_id, format("got exception while processing a message: {}", eptr));
                             });
                         });
@@ -608,6 +833,15 @@ auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, Wa
         if (timeout) {
             f = f.handle_exception_type([] (semaphore_timed_out&) { /* ignore */ });
         }
+        if (client->admission_control_enabled()) {
+            f = f.handle_exception_type([client, msg_id, timeout] (overloaded_error&) {
+                if constexpr (std::is_same_v<wait_style, wait_type>) {
+                    return client->send_overloaded_reply(msg_id, timeout);
+                } else {
+                    return make_ready_future<>();
+                }
+            });
+        }
 
         return f;
     };
@@ -674,7 +908,7 @@ auto protocol<Serializer, MsgType>::register_handler(MsgType t, scheduling_group
     using want_client_info = typename sig_type::want_client_info;
     using want_time_point = typename sig_type::want_time_point;
     auto recv = recv_helper<Serializer>(clean_sig_type(), std::forward<Func>(func),
-            want_client_info(), want_time_point());
+            want_client_info(), want_time_point(), uint64_t(t));
     register_receiver(t, rpc_handler{sg, make_copyable_function(std::move(recv)), {}});
     return make_client(clean_sig_type(), t);
 }
@@ -732,52 +966,130 @@ future<> sink_impl<Serializer, Out...>::operator()(const Out&... args) {
     // but only one at a time
     auto size = std::min(size_t(data.size), max_stream_buffers_memory);
     const auto seq_num = _next_seq_num++;
-    return get_units(this->_sem, size).then([this, data = make_foreign(std::make_unique<snd_buf>(std::move(data))), seq_num] (semaphore_units<> su) mutable {
+    return get_units(this->_sem, size).then([this, data = std::move(data), seq_num] (semaphore_units<> su) mutable {
+        if (_batch_size) {
+            // Even after a failure, for the ones written after it not to
+            // wait for their turn forever
+            batch(seq_num, std::move(data), std::move(su));
+        } else if (!this->_ex) {
+            auto charge = this->_con->get()->stream_charge(data.size);
+            send_frame(seq_num, std::move(data), charge, std::move(su));
+        }
         if (this->_ex) {
             return make_exception_future(this->_ex);
         }
-        // It is OK to discard this future. The user is required to
-        // wait for it when closing.
-        (void)smp::submit_to(this->_con->get_owner_shard(), [this, data = std::move(data), seq_num] () mutable {
-            connection* con = this->_con->get();
-            if (con->error()) {
-                return make_exception_future(closed_error());
-            }
-            if(con->sink_closed()) {
-                return make_exception_future(stream_closed());
-            }
+        return make_ready_future<>();
+    });
+}
+
+template<typename Serializer, typename... Out>
+void sink_impl<Serializer, Out...>::send_frame(uint64_t seq_num, snd_buf data, uint32_t charge, semaphore_units<> su) {
+    _frames_in_flight++;
+    // It is OK to discard this future. The user is required to
+    // wait for it when closing.
+    (void)smp::submit_to(this->_con->get_owner_shard(), [this, data = make_foreign(std::make_unique<snd_buf>(std::move(data))), seq_num, charge] () mutable {
+        connection* con = this->_con->get();
+        if (con->error()) {
+            return make_exception_future(cached_exception_ptr<closed_error>());
+        }
+        if(con->sink_closed()) {
+            return make_exception_future(stream_closed());
+        }
 
-            auto& last_seq_num = _remote_state.last_seq_num;
-            auto& out_of_order_bufs = _remote_state.out_of_order_bufs;
+        auto& last_seq_num = _remote_state.last_seq_num;
+        auto& out_of_order_bufs = _remote_state.out_of_order_bufs;
 
-            auto local_data = make_shard_local_buffer_copy(std::move(data));
-            const auto seq_num_diff = seq_num - last_seq_num;
-            if (seq_num_diff > 1) {
-                auto [it, _] = out_of_order_bufs.emplace(seq_num, deferred_snd_buf{promise<>{}, std::move(local_data)});
-                return it->second.pr.get_future();
-            }
+        auto local_data = make_shard_local_buffer_copy(std::move(data));
+        const auto seq_num_diff = seq_num - last_seq_num;
+        if (seq_num_diff > 1) {
+            auto [it, _] = out_of_order_bufs.emplace(seq_num, deferred_snd_buf{promise<>{}, std::move(local_data), charge});
+            return it->second.pr.get_future();
+        }
 
-            last_seq_num = seq_num;
-            auto ret_fut = con->send(std::move(local_data), {}, nullptr);
-            while (!out_of_order_bufs.empty() && out_of_order_bufs.begin()->first == (last_seq_num + 1)) {
-                auto it = out_of_order_bufs.begin();
-                last_seq_num = it->first;
-                auto fut = con->send(std::move(it->second.data), {}, nullptr);
-                fut.forward_to(std::move(it->second.pr));
-                out_of_order_bufs.erase(it);
-            }
-            return ret_fut;
-        }).then_wrapped([su = std::move(su), this] (future<> f) {
-            if (f.failed() && !this->_ex) { // first error is the interesting one
-                this->_ex = f.get_exception();
+        last_seq_num = seq_num;
+        auto ret_fut = con->send_stream_frame(std::move(local_data), charge);
+        while (!out_of_order_bufs.empty() && out_of_order_bufs.begin()->first == (last_seq_num + 1)) {
+            auto it = out_of_order_bufs.begin();
+            last_seq_num = it->first;
+            auto fut = con->send_stream_frame(std::move(it->second.data), it->second.charge);
+            fut.forward_to(std::move(it->second.pr));
+            out_of_order_bufs.erase(it);
+        }
+        return ret_fut;
+    }).then_wrapped([su = std::move(su), this] (future<> f) {
+        if (f.failed() && !this->_ex) { // first error is the interesting one
+            this->_ex = f.get_exception();
+        } else {
+            f.ignore_ready_future();
+        }
+        if (!--_frames_in_flight && !_batch.bufs.empty()) {
+            if (this->_ex) {
+                _batch = {};
             } else {
-                f.ignore_ready_future();
+                send_batch();
             }
-        });
-        return make_ready_future<>();
+        }
     });
 }
 
+template<typename Serializer, typename... Out>
+void sink_impl<Serializer, Out...>::batch(uint64_t seq_num, snd_buf data, semaphore_units<> su) {
+    if (seq_num != _next_batched_seq_num) {
+        _early.emplace(seq_num, std::make_pair(std::move(data), std::move(su)));
+        return;
+    }
+    auto add = [this] (snd_buf data, semaphore_units<> su) {
+        _next_batched_seq_num++;
+        if (!this->_ex) {
+            add_to_batch(std::move(data), std::move(su));
+        }
+    };
+    add(std::move(data), std::move(su));
+    while (!_early.empty() && _early.begin()->first == _next_batched_seq_num) {
+        auto it = _early.begin();
+        add(std::move(it->second.first), std::move(it->second.second));
+        _early.erase(it);
+    }
+}
+
+template<typename Serializer, typename... Out>
+void sink_impl<Serializer, Out...>::add_to_batch(snd_buf data, semaphore_units<> su) {
+    // The element, with the size in front of it, goes as it is in the batch
+    if (!_batch.bufs.empty() && _batch.size + data.size > _batch_size) {
+        send_batch();
+    }
+    if (_batch.bufs.empty()) {
+        _batch.units = std::move(su);
+    } else {
+        _batch.units.adopt(std::move(su));
+    }
+    _batch.size += data.size;
+    _batch.charge += this->_con->get()->stream_charge(data.size);
+    if (auto one = std::get_if<temporary_buffer<char>>(&data.bufs)) {
+        _batch.bufs.push_back(std::move(*one));
+    } else {
+        for (auto& b : std::get<std::vector<temporary_buffer<char>>>(data.bufs)) {
+            _batch.bufs.push_back(std::move(b));
+        }
+    }
+    if (!_frames_in_flight || _batch.size >= _batch_size) {
+        send_batch();
+    }
+}
+
+template<typename Serializer, typename... Out>
+void sink_impl<Serializer, Out...>::send_batch() {
+    temporary_buffer<char> header(4);
+    write_le<uint32_t>(header.get_write(), _batch.size);
+    _batch.bufs.insert(_batch.bufs.begin(), std::move(header));
+    snd_buf data(std::move(_batch.bufs), _batch.size + 4);
+    auto charge = std::exchange(_batch.charge, 0);
+    auto su = std::move(_batch.units);
+    _batch.bufs.clear();
+    _batch.size = 0;
+    send_frame(_next_frame_seq_num++, std::move(data), charge, std::move(su));
+}
+
 template<typename Serializer, typename... Out>
 future<> sink_impl<Serializer, Out...>::flush() {
     // wait until everything is sent out before returning.
@@ -805,7 +1117,7 @@ future<> sink_impl<Serializer, Out...>::close() {
                 write_le<uint32_t>(p, -1U); // max len fragment marks an end of a stream
                 f = con->send(std::move(data), {}, nullptr);
             } else {
-                f = this->_ex ? make_exception_future(this->_ex) : make_exception_future(closed_error());
+                f = this->_ex ? make_exception_future(this->_ex) : make_exception_future(cached_exception_ptr<closed_error>());
             }
             return f.finally([con] { return con->close_sink(); });
         });
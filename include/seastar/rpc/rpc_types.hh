@@ -34,9 +34,11 @@
 #include <boost/any.hpp>
 #include <boost/type.hpp>
 #include <seastar/util/std-compat.hh>
+#include <seastar/util/exception_ptr.hh>
 #include <seastar/util/variant_utils.hh>
 #include <seastar/core/timer.hh>
 #include <seastar/core/circular_buffer.hh>
+#include <seastar/core/fragmented_buffer.hh>
 #include <seastar/core/simple-stream.hh>
 #include <seastar/core/lowres_clock.hh>
 #include <boost/functional/hash.hpp>
@@ -166,6 +168,13 @@ class canceled_error : public error {
     canceled_error() : error("rpc call was canceled") {}
 };
 
+/// The server shed the request, being overloaded, see
+/// \ref resource_limits::admission_control
+class overloaded_error : public error {
+public:
+    overloaded_error() : error("rpc server is overloaded") {}
+};
+
 class stream_closed : public error {
 public:
     stream_closed() : error("rpc stream was closed by peer") {}
@@ -245,6 +254,8 @@ struct rcv_buf {
     explicit rcv_buf(temporary_buffer<char> b) : size(b.size()), bufs(std::move(b)) {};
     explicit rcv_buf(std::vector<temporary_buffer<char>> bufs, size_t size)
         : size(size), bufs(std::move(bufs)) {};
+    /// Shares the fragments of \c b
+    explicit rcv_buf(const fragmented_buffer& b);
 };
 
 struct snd_buf {
@@ -261,10 +272,66 @@ struct snd_buf {
 
     explicit snd_buf(std::vector<temporary_buffer<char>> bufs, size_t size)
         : size(size), bufs(std::move(bufs)) {};
+    /// Shares the fragments of \c b
+    explicit snd_buf(const fragmented_buffer& b);
 
     temporary_buffer<char>& front();
 };
 
+/// The bytes of a received frame, as a \ref fragmented_buffer of its fragments
+fragmented_buffer make_fragmented_buffer(rcv_buf buf);
+/// The bytes of a frame to send, as a \ref fragmented_buffer of its fragments
+fragmented_buffer make_fragmented_buffer(snd_buf buf);
+
+/// \brief A large argument or return value, passed without copying it.
+///
+/// Marshalling a payload of at least \ref splice_threshold bytes appends its
+/// fragments to the frame, sharing them rather than copying them; smaller
+/// ones are copied, as any other value. Unmarshalling one makes its
+/// fragments share the ones of the received frame, which the payload keeps
+/// alive: a small payload kept for long may hold a much larger receive
+/// buffer. The payload is sent as its size, 4 bytes little endian, followed
+/// by its data, whatever the serializer.
+class fragmented_payload {
+    // Sharing a buffer does not change it, so that a payload can be
+    // marshalled from a const reference
+    mutable std::vector<temporary_buffer<char>> _fragments;
+    size_t _size = 0;
+public:
+    /// The smallest payload sent without copying it
+    static constexpr size_t splice_threshold = 4096;
+
+    fragmented_payload() = default;
+    explicit fragmented_payload(temporary_buffer<char> buf) : _size(buf.size()) {
+        _fragments.push_back(std::move(buf));
+    }
+    explicit fragmented_payload(std::vector<temporary_buffer<char>> fragments) : _fragments(std::move(fragments)) {
+        for (auto& f : _fragments) {
+            _size += f.size();
+        }
+    }
+
+    size_t size() const noexcept {
+        return _size;
+    }
+    const std::vector<temporary_buffer<char>>& fragments() const noexcept {
+        return _fragments;
+    }
+    /// Buffers sharing the fragments
+    std::vector<temporary_buffer<char>> share() const {
+        std::vector<temporary_buffer<char>> ret;
+        ret.reserve(_fragments.size());
+        for (auto& f : _fragments) {
+            ret.push_back(f.share());
+        }
+        return ret;
+    }
+    std::vector<temporary_buffer<char>> release() && noexcept {
+        _size = 0;
+        return std::move(_fragments);
+    }
+};
+
 static inline memory_input_stream<rcv_buf::iterator> make_deserializer_stream(rcv_buf& input) {
     auto* b = std::get_if<temporary_buffer<char>>(&input.bufs);
     if (b) {
@@ -0,0 +1,120 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/rpc/rpc_types.hh>
+
+namespace seastar {
+
+namespace rpc {
+
+/// \addtogroup rpc
+/// @{
+
+/// \brief Compresses the RPC frames with zstd, negotiated as "ZSTD".
+///
+/// Available when Seastar is built with zstd (\c SEASTAR_HAVE_ZSTD).
+///
+/// The frames may be compressed against a shared dictionary, which makes
+/// the small messages of similar shape, that compress poorly on their own,
+/// a fraction of their size. The dictionary is set on the factory, trained
+/// from samples of the frames it compressed or loaded by the application,
+/// and each connection sends it to its peer, on an empty frame, before the
+/// first frame compressed with it. Dictionaries are versioned: a new one
+/// replaces the previous one on all the connections, each of its frames
+/// naming the version it was compressed against. The dictionary of a
+/// connection is only the one of its sender: the two ends of a connection,
+/// and the connections between two nodes, may use different ones.
+///
+/// A factory is to be used on a single shard, by its clients and servers.
+/// It must outlive them.
+///
+/// \code
+/// rpc::zstd_compressor_factory zstd({.level = 5, .sample_every = 100});
+/// rpc::lz4_compressor::factory lz4;
+/// rpc::multi_algo_compressor_factory factory{&zstd, &lz4};
+/// ...
+/// // Once enough traffic was sampled
+/// zstd.train_dictionary(64 * 1024);
+/// \endcode
+class zstd_compressor_factory : public compressor::factory {
+public:
+    struct config {
+        /// The zstd compression level; the negative ones are the fastest
+        int level = 3;
+        /// Keeps one out of that many frames compressed as a sample to
+        /// train a dictionary from; zero keeps none
+        unsigned sample_every = 0;
+        /// The size of the samples kept, after which no more are
+        size_t max_samples_size = 1 << 20;
+    };
+    class state;
+private:
+    std::unique_ptr<state> _state;
+public:
+    /// \throws std::invalid_argument if the level is not one of zstd's
+    explicit zstd_compressor_factory(config cfg);
+    zstd_compressor_factory() : zstd_compressor_factory(config{}) {}
+    ~zstd_compressor_factory();
+
+    virtual const sstring& supported() const override;
+    virtual std::unique_ptr<compressor> negotiate(sstring feature, bool is_server) const override;
+    virtual std::unique_ptr<compressor> negotiate(sstring feature, bool is_server, std::function<future<>()> send_empty_frame) const override;
+
+    /// Compresses with \c dictionary from now on, on all the connections,
+    /// sending it to their peers first. An empty dictionary stops using
+    /// one.
+    ///
+    /// \returns the version of the dictionary
+    uint32_t set_dictionary(temporary_buffer<char> dictionary);
+    /// The version of the current dictionary, zero if there is none
+    uint32_t dictionary_version() const noexcept;
+
+    /// Takes the samples kept so far, letting more be
+    std::vector<temporary_buffer<char>> take_samples();
+    /// Trains a dictionary of at most \c max_size bytes from the samples
+    /// kept so far, and sets it. Blocks the reactor for the time zstd takes
+    /// to train it, about a second per 10MB of samples.
+    ///
+    /// \returns the version of the dictionary
+    /// \throws std::runtime_error if zstd could not train one, as with too
+    ///     few samples
+    uint32_t train_dictionary(size_t max_size);
+
+    /// Trains a dictionary of at most \c max_size bytes from \c samples,
+    /// such as the messages of one verb, for an application to store or to
+    /// set on factories
+    ///
+    /// \throws std::runtime_error if zstd could not train one
+    static temporary_buffer<char> train_dictionary(const std::vector<temporary_buffer<char>>& samples, size_t max_size);
+};
+
+/// @}
+
+}
+
+}
@@ -46,5 +46,7 @@ class linux_perf_event {
 public:
     static linux_perf_event user_instructions_retired();
     static linux_perf_event user_cpu_cycles_retired();
+    static linux_perf_event user_l1_dcache_read_misses();
+    static linux_perf_event user_llc_misses();
 };
 
@@ -37,6 +37,7 @@ namespace perf_tests {
 namespace internal {
 
 struct config;
+struct result;
 
 using clock_type = std::chrono::steady_clock;
 
@@ -46,6 +47,8 @@ class perf_stats {
     uint64_t tasks_executed = 0;
     uint64_t instructions_retired = 0;
     uint64_t cpu_cycles_retired = 0;
+    uint64_t l1_dcache_misses = 0;
+    uint64_t llc_misses = 0;
 
 private:
     static uint64_t perf_mallocs();
@@ -53,17 +56,22 @@ class perf_stats {
 
 public:
     perf_stats() = default;
-    perf_stats(uint64_t allocations_, uint64_t tasks_executed_, uint64_t instructions_retired_ = 0, uint64_t cpu_cycles_retired_ = 0)
+    perf_stats(uint64_t allocations_, uint64_t tasks_executed_, uint64_t instructions_retired_ = 0, uint64_t cpu_cycles_retired_ = 0,
+               uint64_t l1_dcache_misses_ = 0, uint64_t llc_misses_ = 0)
         : allocations(allocations_)
         , tasks_executed(tasks_executed_)
         , instructions_retired(instructions_retired_)
         , cpu_cycles_retired(cpu_cycles_retired_)
+        , l1_dcache_misses(l1_dcache_misses_)
+        , llc_misses(llc_misses_)
     {}
     perf_stats(perf_stats&& o) noexcept
         : allocations(std::exchange(o.allocations, 0))
         , tasks_executed(std::exchange(o.tasks_executed, 0))
         , instructions_retired(std::exchange(o.instructions_retired, 0))
         , cpu_cycles_retired(std::exchange(o.cpu_cycles_retired, 0))
+        , l1_dcache_misses(std::exchange(o.l1_dcache_misses, 0))
+        , llc_misses(std::exchange(o.llc_misses, 0))
     {}
     perf_stats(const perf_stats& o) = default;
 
@@ -73,7 +81,8 @@ class perf_stats {
     perf_stats& operator+=(perf_stats b);
     perf_stats& operator-=(perf_stats b);
 
-    static perf_stats snapshot(linux_perf_event* instructions_retired_counter = nullptr, linux_perf_event* cpu_cycles_retired_counter = nullptr);
+    static perf_stats snapshot(linux_perf_event* instructions_retired_counter = nullptr, linux_perf_event* cpu_cycles_retired_counter = nullptr,
+                               linux_perf_event* l1_dcache_misses_counter = nullptr, linux_perf_event* llc_misses_counter = nullptr);
 };
 
 inline
@@ -83,6 +92,8 @@ operator+(perf_stats a, perf_stats b) {
     a.tasks_executed += b.tasks_executed;
     a.instructions_retired += b.instructions_retired;
     a.cpu_cycles_retired += b.cpu_cycles_retired;
+    a.l1_dcache_misses += b.l1_dcache_misses;
+    a.llc_misses += b.llc_misses;
     return a;
 }
 
@@ -93,6 +104,8 @@ operator-(perf_stats a, perf_stats b) {
     a.tasks_executed -= b.tasks_executed;
     a.instructions_retired -= b.instructions_retired;
     a.cpu_cycles_retired -= b.cpu_cycles_retired;
+    a.l1_dcache_misses -= b.l1_dcache_misses;
+    a.llc_misses -= b.llc_misses;
     return a;
 }
 
@@ -101,6 +114,8 @@ inline perf_stats& perf_stats::operator+=(perf_stats b) {
     tasks_executed += b.tasks_executed;
     instructions_retired += b.instructions_retired;
     cpu_cycles_retired += b.cpu_cycles_retired;
+    l1_dcache_misses += b.l1_dcache_misses;
+    llc_misses += b.llc_misses;
     return *this;
 }
 
@@ -109,6 +124,8 @@ inline perf_stats& perf_stats::operator-=(perf_stats b) {
     tasks_executed -= b.tasks_executed;
     instructions_retired -= b.instructions_retired;
     cpu_cycles_retired -= b.cpu_cycles_retired;
+    l1_dcache_misses -= b.l1_dcache_misses;
+    llc_misses -= b.llc_misses;
     return *this;
 }
 
@@ -121,8 +138,11 @@ class performance_test {
 protected:
     linux_perf_event _instructions_retired_counter = linux_perf_event::user_instructions_retired();
     linux_perf_event _cpu_cycles_retired_counter = linux_perf_event::user_cpu_cycles_retired();
+    linux_perf_event _l1_dcache_misses_counter = linux_perf_event::user_l1_dcache_read_misses();
+    linux_perf_event _llc_misses_counter = linux_perf_event::user_llc_misses();
 private:
-    void do_run(const config&);
+    result do_run(const config&);
+    void run_on_all_shards(const config&);
 public:
     struct run_result {
         clock_type::duration duration;
@@ -142,6 +162,23 @@ class performance_test {
     virtual void set_up() = 0;
     virtual void tear_down() noexcept = 0;
     virtual future<run_result> do_single_run() = 0;
+    // A fresh instance of the test, with its own perf counters, for
+    // another shard to run concurrently with this one
+    virtual std::unique_ptr<performance_test> clone() const = 0;
+
+    void enable_counters() {
+        _instructions_retired_counter.enable();
+        _cpu_cycles_retired_counter.enable();
+        _l1_dcache_misses_counter.enable();
+        _llc_misses_counter.enable();
+    }
+    void disable_counters() {
+        _instructions_retired_counter.disable();
+        _cpu_cycles_retired_counter.disable();
+        _l1_dcache_misses_counter.disable();
+        _llc_misses_counter.disable();
+    }
+    void start_run();
 public:
     performance_test(const std::string& test_case, const std::string& test_group)
         : _test_case(test_case)
@@ -174,18 +211,28 @@ class time_measurement {
 
     linux_perf_event* _instructions_retired_counter = nullptr;
     linux_perf_event* _cpu_cycles_retired_counter = nullptr;
+    linux_perf_event* _l1_dcache_misses_counter = nullptr;
+    linux_perf_event* _llc_misses_counter = nullptr;
 
+    [[gnu::always_inline]] [[gnu::hot]]
+    perf_stats snapshot() {
+        return perf_stats::snapshot(_instructions_retired_counter, _cpu_cycles_retired_counter,
+                                    _l1_dcache_misses_counter, _llc_misses_counter);
+    }
 public:
     [[gnu::always_inline]] [[gnu::hot]]
-    void start_run(linux_perf_event* instructions_retired_counter = nullptr, linux_perf_event* cpu_cycles_retired_counter = nullptr) {
+    void start_run(linux_perf_event* instructions_retired_counter = nullptr, linux_perf_event* cpu_cycles_retired_counter = nullptr,
+                   linux_perf_event* l1_dcache_misses_counter = nullptr, linux_perf_event* llc_misses_counter = nullptr) {
         _instructions_retired_counter = instructions_retired_counter;
         _cpu_cycles_retired_counter = cpu_cycles_retired_counter;
+        _l1_dcache_misses_counter = l1_dcache_misses_counter;
+        _llc_misses_counter = llc_misses_counter;
         _total_time = { };
         _total_stats = {};
         auto t = clock_type::now();
         _run_start_time = t;
         _start_time = t;
-        _start_stats = perf_stats::snapshot(_instructions_retired_counter, _cpu_cycles_retired_counter);
+        _start_stats = snapshot();
     }
 
     [[gnu::always_inline]] [[gnu::hot]]
@@ -194,7 +241,7 @@ class time_measurement {
         performance_test::run_result ret;
         if (_start_time == _run_start_time) {
             ret.duration = t - _start_time;
-            auto stats = perf_stats::snapshot(_instructions_retired_counter, _cpu_cycles_retired_counter);
+            auto stats = snapshot();
             ret.stats = stats - _start_stats;
         } else {
             ret.duration = _total_time;
@@ -202,13 +249,15 @@ class time_measurement {
         }
         _instructions_retired_counter = nullptr;
         _cpu_cycles_retired_counter = nullptr;
+        _l1_dcache_misses_counter = nullptr;
+        _llc_misses_counter = nullptr;
         return ret;
     }
 
     [[gnu::always_inline]] [[gnu::hot]]
     void start_iteration() {
         _start_time = clock_type::now();
-        _start_stats = perf_stats::snapshot(_instructions_retired_counter, _cpu_cycles_retired_counter);
+        _start_stats = snapshot();
     }
 
     [[gnu::always_inline]] [[gnu::hot]]
@@ -216,12 +265,18 @@ class time_measurement {
         auto t = clock_type::now();
         _total_time += t - _start_time;
         perf_stats stats;
-        stats = perf_stats::snapshot(_instructions_retired_counter, _cpu_cycles_retired_counter);
+        stats = snapshot();
         _total_stats += stats - _start_stats;
     }
 };
 
-extern time_measurement measure_time;
+// One per shard, as tests may run on all of them at once
+extern thread_local time_measurement measure_time;
+
+inline void performance_test::start_run() {
+    measure_time.start_run(&_instructions_retired_counter, &_cpu_cycles_retired_counter,
+                           &_l1_dcache_misses_counter, &_llc_misses_counter);
+}
 
 namespace {
 
@@ -269,10 +324,9 @@ class concrete_performance_test final : public performance_test {
     [[gnu::hot]]
     virtual future<run_result> do_single_run() override {
         // Redundant 'this->'s courtesy of https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
-        _instructions_retired_counter.enable();
-        _cpu_cycles_retired_counter.enable();
+        enable_counters();
         return if_constexpr_<is_future<decltype(_test->run())>::value>([&] (auto&&...) {
-            measure_time.start_run(&_instructions_retired_counter);
+            this->start_run();
             return do_until([this] { return this->stop_iteration(); }, [this] {
                 return if_constexpr_<std::is_same_v<decltype(_test->run()), future<>>>([&] (auto&&...) {
                     this->next_iteration(1);
@@ -287,11 +341,10 @@ class concrete_performance_test final : public performance_test {
             }).then([] {
                 return measure_time.stop_run();
             }).finally([this] {
-                _instructions_retired_counter.disable();
-                _cpu_cycles_retired_counter.disable();
+                this->disable_counters();
             });
         }, [&] (auto&&...) {
-            measure_time.start_run(&_instructions_retired_counter, &_cpu_cycles_retired_counter);
+            start_run();
             while (!stop_iteration()) {
                 if_constexpr_<std::is_void_v<decltype(_test->run())>>([&] (auto&&...) {
                     (void)_test->run();
@@ -303,11 +356,14 @@ class concrete_performance_test final : public performance_test {
                 })();
             }
             auto ret = measure_time.stop_run();
-            _instructions_retired_counter.disable();
-            _cpu_cycles_retired_counter.disable();
+            disable_counters();
             return make_ready_future<run_result>(std::move(ret));
         })();
     }
+
+    virtual std::unique_ptr<performance_test> clone() const override {
+        return std::make_unique<concrete_performance_test>(test_case(), test_group());
+    }
 public:
     using performance_test::performance_test;
 };
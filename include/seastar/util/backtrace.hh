@@ -93,6 +93,8 @@ class simple_backtrace {
 
     size_t hash() const noexcept { return _hash; }
     char delimeter() const noexcept { return _delimeter; }
+    /// The frames, innermost first
+    const vector_type& frames() const noexcept { return _frames; }
 
     friend std::ostream& operator<<(std::ostream& out, const simple_backtrace&);
 
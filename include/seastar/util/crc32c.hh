@@ -0,0 +1,61 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// The instruction sets crc32c() can use. The best one the CPU supports is
+// picked on first use.
+enum class crc32c_isa {
+    scalar,
+    sse42,
+    armv8,
+};
+
+// Makes crc32c() use the given instruction set, for tests and benchmarks.
+// Returns false, leaving it unchanged, if the CPU (or the build's
+// architecture) does not support it.
+bool use_crc32c_isa(crc32c_isa isa) noexcept;
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief Computes the CRC32C (Castagnoli) checksum of data.
+///
+/// Continues \c crc, the checksum of the data preceding \c data, so that
+/// data can be checksummed piecewise; 0 starts a new checksum. Uses the
+/// CRC32 instructions of SSE4.2 or ARMv8 when the CPU has them, running
+/// three independent streams over long data to hide their latency.
+uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0) noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+}
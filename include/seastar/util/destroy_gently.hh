@@ -0,0 +1,307 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/chunked_fifo.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/core/internal/run_in_background.hh>
+#include <seastar/util/defer.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <concepts>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief The containers being destroyed gently on this shard.
+///
+/// Exported as the memory group's gentle_destruction metrics.
+struct gentle_destruction_stats {
+    /// Objects passed to \ref destroy_gently() or \ref dispose_gently()
+    /// not yet destroyed
+    uint64_t pending_objects = 0;
+    /// What they held when passed, estimated from their number of elements
+    size_t pending_bytes = 0;
+    /// Elements destroyed by \ref clear_gently(), in total
+    uint64_t destroyed_elements = 0;
+};
+
+const gentle_destruction_stats& get_gentle_destruction_stats() noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+namespace internal {
+
+extern thread_local gentle_destruction_stats gentle_stats;
+
+// The memory held by a container, estimated from its number of elements,
+// with two pointers for the nodes of the node based ones
+template <typename T>
+size_t gentle_size_estimate(const T& x) noexcept {
+    if constexpr (requires { x.size(); typename T::value_type; }) {
+        return x.size() * (sizeof(typename T::value_type) + 2 * sizeof(void*));
+    } else {
+        return sizeof(T);
+    }
+}
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup memory-module
+/// @{
+
+/// A type clearing itself with a `future<> clear_gently()` member, the
+/// customisation point for types \ref clear_gently() does not know
+template <typename T>
+concept has_clear_gently_method = requires (T& x) {
+    { x.clear_gently() } -> std::same_as<future<>>;
+};
+
+// Declared first, for clear_gently() of an element to find the overload
+// of any container
+
+template <has_clear_gently_method T>
+future<> clear_gently(T& x);
+template <typename T, typename A>
+future<> clear_gently(std::vector<T, A>& c);
+template <typename T, typename A>
+future<> clear_gently(std::deque<T, A>& c);
+template <typename T, typename A>
+future<> clear_gently(std::list<T, A>& c);
+template <typename T, typename A>
+future<> clear_gently(circular_buffer<T, A>& c);
+template <typename T, size_t N>
+future<> clear_gently(chunked_fifo<T, N>& c);
+template <typename K, typename V, typename C, typename A>
+future<> clear_gently(std::map<K, V, C, A>& c);
+template <typename K, typename V, typename C, typename A>
+future<> clear_gently(std::multimap<K, V, C, A>& c);
+template <typename K, typename C, typename A>
+future<> clear_gently(std::set<K, C, A>& c);
+template <typename K, typename V, typename H, typename E, typename A>
+future<> clear_gently(std::unordered_map<K, V, H, E, A>& c);
+template <typename K, typename H, typename E, typename A>
+future<> clear_gently(std::unordered_set<K, H, E, A>& c);
+template <typename T, typename D>
+future<> clear_gently(std::unique_ptr<T, D>& p);
+template <typename T>
+future<> clear_gently(std::optional<T>& o);
+
+/// A type \ref clear_gently() clears in steps
+template <typename T>
+concept gently_clearable = requires (T& x) {
+    { clear_gently(x) } -> std::same_as<future<>>;
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+namespace internal {
+
+// Takes the elements out of c one by one, clearing those that are
+// containers themselves gently first, yielding when preempted
+template <typename Container, typename Element, typename Pop>
+future<> clear_elements_gently(Container& c, Element element, Pop pop) {
+    while (!c.empty()) {
+        if constexpr (gently_clearable<std::remove_reference_t<std::invoke_result_t<Element&, Container&>>>) {
+            co_await clear_gently(element(c));
+        }
+        pop(c);
+        gentle_stats.destroyed_elements++;
+        co_await coroutine::maybe_yield();
+    }
+}
+
+template <typename Container>
+future<> clear_sequence_gently(Container& c) {
+    return clear_elements_gently(c, [] (Container& c) -> auto& { return c.back(); }, [] (Container& c) { c.pop_back(); });
+}
+
+template <typename Container>
+future<> clear_fifo_gently(Container& c) {
+    return clear_elements_gently(c, [] (Container& c) -> auto& { return c.front(); }, [] (Container& c) { c.pop_front(); });
+}
+
+template <typename Container>
+future<> clear_map_gently(Container& c) {
+    return clear_elements_gently(c, [] (Container& c) -> auto& { return c.begin()->second; }, [] (Container& c) { c.erase(c.begin()); });
+}
+
+template <typename Container>
+future<> clear_set_gently(Container& c) {
+    // Set elements are const, and not cleared
+    return clear_elements_gently(c, [] (Container& c) { return 0; }, [] (Container& c) { c.erase(c.begin()); });
+}
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief Clears a container in steps, yielding when preempted.
+///
+/// Destroying a container of millions of elements, or of nodes, takes long
+/// enough to stall the reactor. \ref clear_gently() takes the elements out
+/// one by one instead, clearing those that are containers themselves
+/// gently first, and lets the other tasks run whenever the task quota is
+/// used up. A vector of trivially destructible elements is freed at once.
+///
+/// It knows the standard sequence, map and set containers, \ref
+/// circular_buffer, \ref chunked_fifo, std::unique_ptr and std::optional,
+/// and the types having a `future<> clear_gently()` member. The container
+/// must not be used otherwise until it is cleared.
+template <has_clear_gently_method T>
+future<> clear_gently(T& x) {
+    return x.clear_gently();
+}
+
+template <typename T, typename A>
+future<> clear_gently(std::vector<T, A>& c) {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        co_await internal::clear_sequence_gently(c);
+    }
+    c.clear();
+    c.shrink_to_fit();
+}
+
+template <typename T, typename A>
+future<> clear_gently(std::deque<T, A>& c) {
+    co_await internal::clear_sequence_gently(c);
+    c.shrink_to_fit();
+}
+
+template <typename T, typename A>
+future<> clear_gently(std::list<T, A>& c) {
+    return internal::clear_sequence_gently(c);
+}
+
+template <typename T, typename A>
+future<> clear_gently(circular_buffer<T, A>& c) {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        co_await internal::clear_fifo_gently(c);
+    }
+    c = circular_buffer<T, A>();
+}
+
+template <typename T, size_t N>
+future<> clear_gently(chunked_fifo<T, N>& c) {
+    co_await internal::clear_fifo_gently(c);
+    c.shrink_to_fit();
+}
+
+template <typename K, typename V, typename C, typename A>
+future<> clear_gently(std::map<K, V, C, A>& c) {
+    return internal::clear_map_gently(c);
+}
+
+template <typename K, typename V, typename C, typename A>
+future<> clear_gently(std::multimap<K, V, C, A>& c) {
+    return internal::clear_map_gently(c);
+}
+
+template <typename K, typename C, typename A>
+future<> clear_gently(std::set<K, C, A>& c) {
+    return internal::clear_set_gently(c);
+}
+
+template <typename K, typename V, typename H, typename E, typename A>
+future<> clear_gently(std::unordered_map<K, V, H, E, A>& c) {
+    co_await internal::clear_map_gently(c);
+    c.rehash(0);
+}
+
+template <typename K, typename H, typename E, typename A>
+future<> clear_gently(std::unordered_set<K, H, E, A>& c) {
+    co_await internal::clear_set_gently(c);
+    c.rehash(0);
+}
+
+template <typename T, typename D>
+future<> clear_gently(std::unique_ptr<T, D>& p) {
+    if constexpr (gently_clearable<T>) {
+        if (p) {
+            co_await clear_gently(*p);
+        }
+    }
+    p.reset();
+}
+
+template <typename T>
+future<> clear_gently(std::optional<T>& o) {
+    if constexpr (gently_clearable<T>) {
+        if (o) {
+            co_await clear_gently(*o);
+        }
+    }
+    o.reset();
+}
+
+/// \brief Destroys an object gently, see \ref clear_gently().
+///
+/// Takes \c x over, to be moved in, and resolves once it is destroyed.
+/// It is accounted in \ref gentle_destruction_stats meanwhile.
+template <typename T>
+requires std::move_constructible<T>
+future<> dispose_gently(T x) {
+    auto& stats = internal::gentle_stats;
+    auto bytes = internal::gentle_size_estimate(x);
+    stats.pending_objects++;
+    stats.pending_bytes += bytes;
+    auto done = defer([&stats, bytes] () noexcept {
+        stats.pending_objects--;
+        stats.pending_bytes -= bytes;
+    });
+    if constexpr (gently_clearable<T>) {
+        co_await clear_gently(x);
+    }
+}
+
+/// \brief Destroys an object gently in the background.
+///
+/// As \ref dispose_gently(), for an object destroyed in a continuation
+/// which cannot wait for it. The reactor waits for it when stopping.
+template <typename T>
+requires std::move_constructible<T>
+void destroy_gently(T x) {
+    internal::run_in_background(dispose_gently(std::move(x)));
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
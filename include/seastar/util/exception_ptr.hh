@@ -0,0 +1,110 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <exception>
+#include <type_traits>
+#include <typeinfo>
+#endif
+
+/// \file
+/// Cheap handling of expected errors.
+///
+/// Timeouts, broken semaphores and closed connections are ordinary
+/// outcomes under overload, but propagating them as exceptions costs an
+/// allocation when the exception is made and a throw and unwind each time
+/// a handler rethrows it to find out what it is. Code that produces such
+/// errors can hand out a shared, pre-made instance with
+/// \ref cached_exception_ptr(), and code that handles them can test a
+/// failed future's exception with \ref try_catch() without rethrowing:
+///
+/// ```
+/// auto f = co_await coroutine::as_future(sem.wait(timeout));
+/// if (f.failed()) {
+///     auto ex = f.get_exception();
+///     if (try_catch<semaphore_timed_out>(ex)) {
+///         co_return reply_busy();
+///     }
+///     co_await coroutine::return_exception_ptr(std::move(ex));
+/// }
+/// ```
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief Checks the type of the exception held by an exception_ptr,
+/// without rethrowing it.
+///
+/// \return a pointer to the exception held by \c ex if it is an \c E
+///         (or derived from it), nullptr otherwise, or if \c ex is null.
+template <typename E>
+E* try_catch(const std::exception_ptr& ex) noexcept {
+    static_assert(std::is_class_v<E>, "try_catch() only tests for exception classes");
+    if (!ex) {
+        return nullptr;
+    }
+#if defined(__GLIBCXX__) && defined(__cpp_rtti)
+    // Ask the type_info of E whether a handler for it would catch the
+    // exception, as the unwinder does. The object pointer is adjusted to
+    // the E base subobject on a match.
+    void* obj = *reinterpret_cast<void* const*>(&ex);
+    if (typeid(E).__do_catch(ex.__cxa_exception_type(), &obj, 1)) {
+        return static_cast<E*>(obj);
+    }
+    return nullptr;
+#else
+    try {
+        std::rethrow_exception(ex);
+    } catch (E& e) {
+        return &e;
+    } catch (...) {
+        return nullptr;
+    }
+#endif
+}
+
+/// \brief Returns a shard-local exception_ptr holding a default-constructed
+/// \c E.
+///
+/// The exception is made on first use and shared by all the callers on the
+/// shard, so failing a future with it doesn't allocate. Only use it for
+/// exceptions that carry no state of their own.
+template <typename E>
+std::exception_ptr cached_exception_ptr() noexcept {
+    static_assert(std::is_nothrow_copy_constructible_v<E>);
+    static thread_local std::exception_ptr cached;
+    if (!cached) [[unlikely]] {
+        try {
+            cached = std::make_exception_ptr(E());
+        } catch (...) {
+            return std::current_exception();
+        }
+    }
+    return cached;
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -83,6 +83,17 @@ struct options : public program_options::option_group {
     ///
     /// Default: \p false.
     program_options::value<bool> log_to_syslog;
+    /// \brief Write the log from a thread of its own, with a buffer of that
+    /// size per shard.
+    ///
+    /// See \ref logger::set_async(). Default: \p 0, writing it from the
+    /// shards.
+    program_options::value<unsigned> logger_async_buffer_size;
+    /// Have the thread of \ref logger_async_buffer_size format the messages
+    /// it can, rather than the shards.
+    ///
+    /// See \ref logger::set_async(). Default: \p false.
+    program_options::value<bool> logger_async_defer_formatting;
 
     /// Print colored tag prefix in log messages sent to output stream.
     ///
@@ -32,8 +32,12 @@
 #include <unordered_map>
 #include <exception>
 #include <iosfwd>
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <mutex>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <boost/lexical_cast.hpp>
 #include <fmt/core.h>
@@ -80,6 +84,118 @@ seastar::log_level lexical_cast(const std::string& source);
 
 }
 
+namespace seastar {
+
+/// \cond internal
+namespace internal {
+
+// The arguments a message may be formatted with after the call, by the
+// thread of the async log: values, copied as they are, and strings. Those
+// of other types are formatted by the call.
+template <typename T>
+concept deferred_log_value = std::is_arithmetic_v<T> || std::is_enum_v<T>
+        || std::is_same_v<T, void*> || std::is_same_v<T, const void*>;
+
+// Only the strings fmt formats as string views, unlike other types which
+// convert to them
+template <typename T>
+concept deferred_log_string = std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>
+        || std::is_same_v<T, sstring> || std::is_same_v<T, const char*> || std::is_same_v<T, char*>
+        || (std::is_array_v<T> && std::is_same_v<std::remove_extent_t<T>, char>);
+
+template <typename T>
+concept deferrable_log_arg = deferred_log_value<std::remove_cvref_t<T>> || deferred_log_string<std::remove_cvref_t<T>>;
+
+template <typename T>
+struct deferred_log_arg;
+
+template <deferred_log_value T>
+struct deferred_log_arg<T> {
+    using type = T;
+    static size_t encoded_size(const T&) noexcept {
+        return sizeof(T);
+    }
+    static log_buf::inserter_iterator encode(log_buf::inserter_iterator it, const T& v) noexcept {
+        return std::copy_n(reinterpret_cast<const char*>(&v), sizeof(v), it);
+    }
+    static type decode(const char*& p) noexcept {
+        T v;
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
+};
+
+template <deferred_log_string T>
+struct deferred_log_arg<T> {
+    using type = std::string_view;
+    static size_t encoded_size(const T& v) noexcept {
+        return sizeof(uint32_t) + std::string_view(v).size();
+    }
+    static log_buf::inserter_iterator encode(log_buf::inserter_iterator it, const T& v) noexcept {
+        std::string_view str(v);
+        uint32_t size = str.size();
+        it = std::copy_n(reinterpret_cast<const char*>(&size), sizeof(size), it);
+        return std::copy_n(str.data(), size, it);
+    }
+    static type decode(const char*& p) noexcept {
+        uint32_t size;
+        std::memcpy(&size, p, sizeof(size));
+        std::string_view str(p + sizeof(size), size);
+        p += sizeof(size) + size;
+        return str;
+    }
+};
+
+// The arguments of a message, encoded on the shard and decoded by the
+// thread which formats the message
+class deferred_log_args {
+public:
+    using format_func = log_buf::inserter_iterator (*)(log_buf::inserter_iterator, std::string_view format, const char* args);
+    virtual ~deferred_log_args() = default;
+    virtual size_t encoded_size() const noexcept = 0;
+    virtual log_buf::inserter_iterator encode(log_buf::inserter_iterator it) const noexcept = 0;
+    virtual format_func formatter() const noexcept = 0;
+};
+
+template <typename... Args>
+class deferred_log_args_impl final : public deferred_log_args {
+    std::tuple<const Args&...> _args;
+
+    static log_buf::inserter_iterator format(log_buf::inserter_iterator it, std::string_view format, const char* p) {
+        // Braces decode the arguments in order
+        std::tuple<typename deferred_log_arg<Args>::type...> args{deferred_log_arg<Args>::decode(p)...};
+        return std::apply([&] (const auto&... a) {
+#if FMT_VERSION >= 80000
+            return fmt::format_to(it, fmt::runtime(format), a...);
+#else
+            return fmt::format_to(it, format, a...);
+#endif
+        }, args);
+    }
+public:
+    explicit deferred_log_args_impl(const Args&... args) noexcept : _args(args...) {}
+    virtual size_t encoded_size() const noexcept override {
+        return std::apply([] (const Args&... a) {
+            return (size_t(0) + ... + deferred_log_arg<Args>::encoded_size(a));
+        }, _args);
+    }
+    virtual log_buf::inserter_iterator encode(log_buf::inserter_iterator it) const noexcept override {
+        return std::apply([&] (const Args&... a) {
+            ((it = deferred_log_arg<Args>::encode(it, a)), ...);
+            return it;
+        }, _args);
+    }
+    virtual format_func formatter() const noexcept override {
+        return &format;
+    }
+};
+
+}
+/// \endcond
+
+}
+
 namespace seastar {
 SEASTAR_MODULE_EXPORT_BEGIN
 class logger;
@@ -211,6 +327,9 @@ class logger {
 
     // We can't use an std::function<> as it potentially allocates.
     void do_log(log_level level, log_writer& writer);
+    // Hands the message over to the async log to format, returning false if
+    // it does not format messages
+    bool do_log_deferred(log_level level, std::string_view format, const internal::deferred_log_args& args);
     void failed_to_log(std::exception_ptr ex,
                        fmt::string_view fmt,
                        compat::source_location loc) noexcept;
@@ -294,6 +413,13 @@ class logger {
     void log(log_level level, format_info_t<Args...> fmt, Args&&... args) noexcept {
         if (is_enabled(level)) {
             try {
+                if constexpr ((internal::deferrable_log_arg<Args> && ...)) {
+                    internal::deferred_log_args_impl<std::remove_cvref_t<Args>...> deferred(args...);
+                    fmt::string_view format(fmt.format);
+                    if (do_log_deferred(level, std::string_view(format.data(), format.size()), deferred)) {
+                        return;
+                    }
+                }
                 lambda_log_writer writer([&] (internal::log_buf::inserter_iterator it) {
 #if defined(SEASTAR_LOGGER_COMPILE_TIME_FMT) || FMT_VERSION < 80000
                     return fmt::format_to(it, fmt.format, std::forward<Args>(args)...);
@@ -474,6 +600,35 @@ class logger {
     ///       before syslogd can clear it) but can happen.
     static void set_syslog_enabled(bool enabled) noexcept;
 
+    /// Write the log from a thread of its own rather than from the shards
+    ///
+    /// Each shard formats its messages into a ring buffer of \c size bytes,
+    /// for the thread to write to the output stream and to syslog, neither
+    /// of which can then stall the reactor. The messages of a shard whose
+    /// buffer is full are dropped, and counted; the thread writes how many
+    /// it dropped once it catches up. The messages of threads which are not
+    /// shards are written synchronously. Zero, the default, writes all of
+    /// them synchronously. What is buffered is written on exit, before an
+    /// abort reports its backtrace, and on \ref flush_async().
+    ///
+    /// With \c defer_formatting, the messages whose arguments are all
+    /// numbers, enums, pointers or strings are not even formatted by the
+    /// shard: it only copies the format string and the arguments to the
+    /// buffer, for the thread to format them, taking the formatting off the
+    /// reactor. The other messages are formatted on the shard, as without it.
+    ///
+    /// To be called while no shard logs, as before Seastar starts.
+    static void set_async(size_t size, bool defer_formatting = false);
+
+    /// Write what the shards buffered for the thread of \ref set_async()
+    /// from the calling thread, without waiting for the thread if it is
+    /// writing longer than a second
+    static void flush_async() noexcept;
+
+    /// The number of messages dropped since \ref set_async(), the buffer
+    /// of their shard being full
+    static uint64_t async_dropped_messages() noexcept;
+
     /// Set the width of shard id field in log messages
     ///
     /// \c this_shard_id() is printed as a part of the prefix in logging
@@ -568,6 +723,12 @@ struct logging_settings final {
     bool with_color;
     logger_timestamp_style stdout_timestamp_style = logger_timestamp_style::real;
     logger_ostream_type logger_ostream = logger_ostream_type::cerr;
+    /// The size of the buffer of each shard for \ref logger::set_async(),
+    /// zero to log synchronously
+    size_t async_buffer_size = 0;
+    /// Whether the thread of \ref logger::set_async() formats the messages
+    /// it can, rather than the shards
+    bool async_defer_formatting = false;
 };
 
 /// Shortcut for configuring the logging system all at once.
@@ -25,7 +25,10 @@
 #include <seastar/util/used_size.hh>
 
 #ifndef SEASTAR_MODULE
+#include <array>
+#include <bit>
 #include <concepts>
+#include <cstdint>
 #include <utility>
 #include <type_traits>
 #include <functional>
@@ -33,15 +36,23 @@
 
 namespace seastar {
 
-template <typename Signature>
+template <typename Signature, size_t InlineSize = 32>
 class noncopyable_function;
 
 namespace internal {
 
+/// The functions a \ref noncopyable_function allocated on the heap, too
+/// large for its inline storage, on this thread, by size: entry \c n counts
+/// those of 2^(n-1) to 2^n - 1 bytes, for spotting the captures worth a
+/// larger inline storage.
+inline thread_local std::array<uint64_t, 64> noncopyable_function_heap_captures{};
+
+template <size_t InlineSize>
 class noncopyable_function_base {
 private:
     noncopyable_function_base() = default;
-    static constexpr size_t nr_direct = 32;
+    static constexpr size_t nr_direct = InlineSize;
+    static_assert(InlineSize >= sizeof(void*), "the inline storage holds the pointer to the allocated functions");
     union [[gnu::may_alias]] storage {
         char direct[nr_direct];
         void* indirect;
@@ -79,7 +90,7 @@ class noncopyable_function_base {
 private:
     storage _storage;
 
-    template <typename Signature>
+    template <typename Signature, size_t>
     friend class seastar::noncopyable_function;
 };
 
@@ -102,9 +113,24 @@ struct is_nothrow_if_object<> {
 
 /// A clone of \c std::function, but only invokes the move constructor
 /// of the contained function.
+///
+/// Functions of up to \c InlineSize bytes, nothrow move constructible, are
+/// stored inline, larger ones allocated; a larger \c InlineSize saves the
+/// allocations of the larger captures, on the paths creating many
+/// functions, at the cost of the size of all the functions.
 SEASTAR_MODULE_EXPORT
-template <typename Ret, typename... Args, bool Noexcept>
-class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal::noncopyable_function_base {
+template <typename Ret, typename... Args, bool Noexcept, size_t InlineSize>
+class noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize> : private internal::noncopyable_function_base<InlineSize> {
+    using noncopyable_function_base = internal::noncopyable_function_base<InlineSize>;
+    using typename noncopyable_function_base::storage;
+    using typename noncopyable_function_base::move_type;
+    using typename noncopyable_function_base::destroy_type;
+    using noncopyable_function_base::nr_direct;
+    using noncopyable_function_base::empty_move;
+    using noncopyable_function_base::empty_destroy;
+    using noncopyable_function_base::indirect_move;
+    using noncopyable_function_base::trivial_direct_destroy;
+    using noncopyable_function_base::_storage;
     using call_type = Ret (*)(const noncopyable_function* func, Args...);
     struct vtable {
         const call_type call;
@@ -135,7 +161,7 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
         static constexpr move_type select_move_thunk() {
             bool can_trivially_move = std::is_trivially_move_constructible_v<Func>
                     && std::is_trivially_destructible_v<Func>;
-            return can_trivially_move ? trivial_direct_move<internal::used_size<Func>::value> : move;
+            return can_trivially_move ? noncopyable_function_base::template trivial_direct_move<internal::used_size<Func>::value> : move;
         }
         static void destroy(noncopyable_function_base* func) {
             access(func)->~Func();
@@ -162,6 +188,7 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
         }
         static void initialize(Func&& from, noncopyable_function* to) {
             to->_storage.indirect = new Func(std::move(from));
+            internal::noncopyable_function_heap_captures[std::bit_width(sizeof(Func))]++;
         }
         static constexpr vtable make_vtable() { return { call, indirect_move, destroy }; }
         static const vtable s_vtable;
@@ -221,16 +248,16 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
 };
 
 
-template <typename Ret, typename... Args, bool Noexcept>
+template <typename Ret, typename... Args, bool Noexcept, size_t InlineSize>
 template <typename Func>
-const typename noncopyable_function<Ret (Args...) noexcept(Noexcept)>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept)>::direct_vtable_for<Func>::s_vtable
-        = noncopyable_function<Ret (Args...) noexcept(Noexcept)>::direct_vtable_for<Func>::make_vtable();
+const typename noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::direct_vtable_for<Func>::s_vtable
+        = noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::direct_vtable_for<Func>::make_vtable();
 
 
-template <typename Ret, typename... Args, bool Noexcept>
+template <typename Ret, typename... Args, bool Noexcept, size_t InlineSize>
 template <typename Func>
-const typename noncopyable_function<Ret (Args...) noexcept(Noexcept)>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept)>::indirect_vtable_for<Func>::s_vtable
-        = noncopyable_function<Ret (Args...) noexcept(Noexcept)>::indirect_vtable_for<Func>::make_vtable();
+const typename noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::indirect_vtable_for<Func>::s_vtable
+        = noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::indirect_vtable_for<Func>::make_vtable();
 
 }
 
@@ -56,6 +56,11 @@ struct spawn_parameters {
 /// \note the spawned subprocess should always be \c wait()'ed. Otherwise,
 /// the Seastar application spawning the subprocess will leave us with
 /// one ore more zombie subprocesses after it exists.
+///
+/// \note the subprocess is spawned from the reactor's syscall thread, with
+/// vfork semantics: the child shares the parent's address space until it
+/// calls \c exec, so spawning doesn't copy the parent's page tables, however
+/// much memory it maps.
 SEASTAR_MODULE_EXPORT
 class process {
     struct create_tag {};
@@ -22,11 +22,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <concepts>
 #include <cstdint>
+#include <utility>
 
 namespace seastar {
 namespace internal {
@@ -131,6 +133,7 @@ class shared_token_bucket {
 public:
     static constexpr T max_rate = std::numeric_limits<T>::max() / 2 / max_delta.count();
     static constexpr capped_release is_capped = Capped;
+    using tokens_type = T;
 
 private:
     static constexpr T accumulated(T rate, rate_resolution delta) noexcept {
@@ -182,6 +185,21 @@ class shared_token_bucket {
         return wrapping_difference(from, head());
     }
 
+    /*
+     * Gives back tokens that were grabbed, but are not going to be used:
+     * the ones from the rover position "from" on, "tokens" of them. Only
+     * those the head already went past are put back, there's no taking
+     * the tail back past the tokens other shards grabbed since. The rest
+     * are lost, delaying the next grabs by as much, which is the error of
+     * grabbing tokens before they're needed and is bounded by how many.
+     */
+    void refund(T from, T tokens) noexcept {
+        auto covered = std::min(tokens, wrapping_difference(head(), from));
+        if (covered) {
+            fetch_add(_rovers.head, std::min(covered, _rovers.max_extra(_replenish_limit)));
+        }
+    }
+
     template <typename Rep, typename Per>
     static auto rate_cast(const std::chrono::duration<Rep, Per> delta) noexcept {
         return std::chrono::duration_cast<rate_resolution>(delta);
@@ -210,5 +228,66 @@ class shared_token_bucket {
     }
 };
 
+/*
+ * Grabs tokens from a shared_token_bucket in batches, for the shards that
+ * share one not to all increment its tail, on the same cache line, for
+ * every grab. The grabs that fit in what's left of the batch take from it
+ * without touching the bucket; the leftovers are refunded when the batch
+ * is done with, so a shard gets at most one batch of tokens ahead of the
+ * others. A grab of a batch or more goes to the bucket as it is.
+ *
+ * The shard still waits for the head to go past the end position of each
+ * of its grabs, which deficiency() of the bucket tells as for a grab of
+ * its own.
+ */
+template <typename TokenBucket>
+class token_bucket_batch {
+    // Capped buckets would also need the unused tokens released
+    static_assert(TokenBucket::is_capped == capped_release::no);
+    using T = typename TokenBucket::tokens_type;
+    TokenBucket& _tb;
+    T _batch;
+    // The position the grabs from the batch got to, and the tokens after it
+    T _next = 0;
+    T _left = 0;
+    uint64_t _bucket_grabs = 0;
+public:
+    token_bucket_batch(TokenBucket& tb, T batch) noexcept
+            : _tb(tb)
+            , _batch(std::min(batch, tb.limit()))
+    {}
+
+    // Grabs the tokens, returning the position the head has to go past
+    // for them to be there, as shared_token_bucket::grab() does
+    T grab(T tokens) noexcept {
+        if (tokens <= _left) {
+            _left -= tokens;
+            return _next += tokens;
+        }
+        _bucket_grabs++;
+        if (tokens >= _batch) {
+            return _tb.grab(tokens);
+        }
+        // The rest of the batch does not precede the new one
+        refund();
+        auto end = _tb.grab(_batch);
+        _left = _batch - tokens;
+        _next = end - _left;
+        return _next;
+    }
+
+    // Gives back what's left of the batch, when done grabbing for a while
+    void refund() noexcept {
+        if (_left) {
+            _tb.refund(_next, std::exchange(_left, 0));
+        }
+    }
+
+    T batch() const noexcept { return _batch; }
+    T left() const noexcept { return _left; }
+    // The times the bucket's tail was grabbed from
+    uint64_t bucket_grabs() const noexcept { return _bucket_grabs; }
+};
+
 } // internal namespace
 } // seastar namespace
@@ -43,6 +43,15 @@ future<std::vector<temporary_buffer<char>>> read_entire_stream(input_stream<char
 /// \param inp \ref input_stream to be read.
 future<sstring> read_entire_stream_contiguous(input_stream<char>& inp);
 
+/// Returns the bytes from the stream up to the first CRLF, which is
+/// consumed but not returned, or until eof if there is none. The bytes
+/// following the CRLF stay in the stream.
+///
+/// \note use only on streams whose lines are short, to avoid running out of memory.
+///
+/// \param inp \ref input_stream to be read.
+future<sstring> read_line(input_stream<char>& inp);
+
 /// Ignores all bytes in the stream, until eos.
 ///
 /// \param inp \ref input_stream to be read.
@@ -32,6 +32,7 @@
 
 #ifndef SEASTAR_MODULE
 #include <cstring>
+#include <string_view>
 #include <stdio.h>
 #endif
 
@@ -46,17 +47,31 @@ SEASTAR_MODULE_EXPORT_BEGIN
 //
 // Collection of utilities for working with strings .
 //
+// The searches and comparisons go 16 bytes at a time with SSE2 or NEON,
+// for the parsers of text protocols to skip to a delimiter rather than
+// look at every byte. The case insensitive ones only fold ASCII letters,
+// which is what the protocols want, whatever the locale.
+//
+
+// The index of the first character of s which is one of chars, or npos
+size_t find_first_of(std::string_view s, std::string_view chars) noexcept;
+
+// The index of the first "\r\n" in s, or npos
+size_t find_crlf(std::string_view s) noexcept;
+
+bool case_insensitive_equal(std::string_view a, std::string_view b) noexcept;
+
+void ascii_to_lower(char* p, size_t n) noexcept;
 
 struct case_insensitive_cmp {
     bool operator()(const sstring& s1, const sstring& s2) const {
-        return std::equal(s1.begin(), s1.end(), s2.begin(), s2.end(),
-                [](char a, char b) { return ::tolower(a) == ::tolower(b); });
+        return case_insensitive_equal(s1, s2);
     }
 };
 
 struct case_insensitive_hash {
     size_t operator()(sstring s) const {
-        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        ascii_to_lower(s.data(), s.size());
         return std::hash<sstring>()(s);
     }
 };
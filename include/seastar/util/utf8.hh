@@ -0,0 +1,81 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// The instruction sets is_valid_utf8() can use for long text. The best one
+// the CPU supports is picked on first use.
+enum class utf8_isa {
+    scalar,
+    avx2,
+    neon,
+};
+
+// Makes is_valid_utf8() use the given instruction set, for tests and
+// benchmarks. Returns false, leaving it unchanged, if the CPU (or the
+// build's architecture) does not support it.
+bool use_utf8_isa(utf8_isa isa) noexcept;
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \brief Checks that text is well-formed UTF-8.
+///
+/// Rejects overlong encodings, surrogates, code points beyond U+10FFFF and
+/// truncated sequences, as RFC 3629 requires. Checks 32 bytes at a time
+/// with AVX2 or NEON when the CPU has them.
+bool is_valid_utf8(const char* data, size_t len) noexcept;
+
+/// \brief Checks that text received piecewise is well-formed UTF-8.
+///
+/// The pieces may split the encoding of a code point.
+class utf8_validator {
+    unsigned char _pending[4];
+    uint8_t _pending_len = 0;
+    bool _valid = true;
+public:
+    /// Checks the next piece of the text. Returns false if the text is
+    /// invalid, and keeps doing so until \ref reset().
+    bool feed(const char* data, size_t len) noexcept;
+    /// Whether the text so far is valid and doesn't end in the middle of a
+    /// code point. Starts over with a new text.
+    bool finish() noexcept;
+    /// Starts over with a new text.
+    void reset() noexcept {
+        _pending_len = 0;
+        _valid = true;
+    }
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -23,6 +23,8 @@
 
 #include <map>
 #include <functional>
+#include <memory>
+#include <optional>
 
 #include <seastar/http/request_parser.hh>
 #include <seastar/core/seastar.hh>
@@ -31,6 +33,7 @@
 #include <seastar/core/gate.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/when_all.hh>
+#include <seastar/util/utf8.hh>
 
 namespace seastar::experimental::websocket {
 
@@ -132,6 +135,14 @@ class websocket_parser {
     // State of connection - can be valid, closed or should be closed
     // due to error.
     connection_state _cstate;
+    // Whether permessage-deflate was negotiated, allowing RSV1
+    bool _deflate = false;
+    // Whether the message being received is compressed
+    bool _compressed = false;
+    // Whether the message being received is text
+    bool _text = false;
+    // Whether the payload of the frame is all in the last result
+    bool _frame_done = false;
     sstring _buffer;
     std::unique_ptr<frame_header> _header;
     uint64_t _payload_length;
@@ -145,13 +156,9 @@ class websocket_parser {
         return make_ready_future<consumption_result_t>(stop_consuming(std::move(data)));
     }
 
-    // Removes mask from payload given in p.
-    void remove_mask(buff_t& p, size_t n) {
-        char *payload = p.get_write();
-        for (uint64_t i = 0, j = 0; i < n; ++i, j = (j + 1) % 4) {
-            payload[i] ^= static_cast<char>(((_masking_key << (j * 8)) >> 24));
-        }
-    }
+    // Removes mask from the first n bytes of the payload given in p, and
+    // moves the key on for the rest of the payload.
+    void remove_mask(buff_t& p, size_t n);
 public:
     websocket_parser() : _state(parsing_state::flags_and_payload_data),
                          _cstate(connection_state::valid),
@@ -162,6 +169,69 @@ class websocket_parser {
     bool eof() { return _cstate == connection_state::closed; }
     opcodes opcode() const;
     buff_t result();
+    /// Accepts the compressed messages of permessage-deflate
+    void allow_compression() noexcept { _deflate = true; }
+    /// Whether the message the last result is a part of is compressed
+    bool compressed() const noexcept { return _compressed; }
+    /// Whether the message the last result is a part of is text
+    bool text() const noexcept { return _text; }
+    /// Whether the last result ends a message
+    bool end_of_message() const noexcept { return _frame_done && _header && _header->fin; }
+};
+
+/*!
+ * \brief configuration of the permessage-deflate extension (RFC 7692)
+ */
+struct deflate_config {
+    /// The zlib compression level, from 1, the fastest, to 9
+    int level = 6;
+    /// Messages smaller than that are sent uncompressed
+    size_t min_size = 64;
+    /// Whether a connection compresses each message against the previous
+    /// ones, which costs it about 256KB of memory for the whole of its life
+    /// and compresses small messages much better. Also off on the
+    /// connections whose clients ask for \c server_no_context_takeover.
+    bool server_context_takeover = true;
+    /// Whether the clients may compress against their previous messages;
+    /// \c client_no_context_takeover is answered if not
+    bool client_context_takeover = true;
+    /// The largest message the clients may send compressed, once
+    /// decompressed; the connection is closed with status 1009 (message
+    /// too big) as soon as one goes over it
+    size_t max_message_size = 16 << 20;
+};
+
+/*!
+ * \brief a message framed once, to be sent to many connections
+ *
+ * The frame of the message, and that of the message compressed with a
+ * context of its own for the connections which negotiated permessage-deflate,
+ * are made at most once; the connections it is sent to share their buffers.
+ * As the buffers, the message is of the shard it was made on.
+ */
+class message {
+    opcodes _opcode = opcodes::BINARY;
+    temporary_buffer<char> _header;
+    temporary_buffer<char> _payload;
+    bool _deflated = false;
+    temporary_buffer<char> _deflated_header;
+    temporary_buffer<char> _deflated_payload;
+
+    message() = default;
+    // A message with shares of the buffers of this one
+    message share();
+    void deflate(int level);
+    friend class connection;
+    friend class server;
+public:
+    explicit message(temporary_buffer<char> payload, opcodes opcode = opcodes::BINARY);
+    message(message&&) noexcept = default;
+    message& operator=(message&&) noexcept = default;
+
+    /// The size of the payload
+    size_t size() const noexcept {
+        return _payload.size();
+    }
 };
 
 /*!
@@ -170,6 +240,15 @@ class websocket_parser {
 class connection : public boost::intrusive::list_base_hook<> {
     using buff_t = temporary_buffer<char>;
 
+    // What is queued for the response loop to send
+    struct outgoing {
+        // The payload of a binary message to frame
+        buff_t payload;
+        // A message framed already, sent rather than the payload
+        std::optional<message> shared;
+    };
+    class deflate_state;
+
     /*!
      * \brief Implementation of connection's data source.
      */
@@ -199,13 +278,13 @@ class connection : public boost::intrusive::list_base_hook<> {
      * \brief Implementation of connection's data sink.
      */
     class connection_sink_impl final : public data_sink_impl {
-        queue<buff_t>* data;
+        queue<outgoing>* data;
     public:
-        connection_sink_impl(queue<buff_t>* data) : data(data) {}
+        connection_sink_impl(queue<outgoing>* data) : data(data) {}
 
         virtual future<> put(net::packet d) override {
             net::fragment f = d.frag(0);
-            return data->push_eventually(temporary_buffer<char>{std::move(f.base), f.size});
+            return data->push_eventually(outgoing{temporary_buffer<char>{std::move(f.base), f.size}});
         }
 
         size_t buffer_size() const noexcept override {
@@ -213,7 +292,7 @@ class connection : public boost::intrusive::list_base_hook<> {
         }
 
         virtual future<> close() override {
-            data->push(buff_t(0));
+            data->push(outgoing{buff_t(0)});
             return make_ready_future<>();
         }
     };
@@ -240,30 +319,21 @@ class connection : public boost::intrusive::list_base_hook<> {
     websocket_parser _websocket_parser;
     queue <temporary_buffer<char>> _input_buffer;
     input_stream<char> _input;
-    queue <temporary_buffer<char>> _output_buffer;
+    queue <outgoing> _output_buffer;
     output_stream<char> _output;
 
     sstring _subprotocol;
     handler_t _handler;
+    // Set if permessage-deflate was negotiated
+    std::unique_ptr<deflate_state> _deflate;
+    // Of the text message being received
+    utf8_validator _utf8;
 public:
     /*!
      * \param server owning \ref server
      * \param fd established socket used for communication
      */
-    connection(server& server, connected_socket&& fd)
-        : _server(server)
-        , _fd(std::move(fd))
-        , _read_buf(_fd.input())
-        , _write_buf(_fd.output())
-        , _input_buffer{PIPE_SIZE}
-        , _output_buffer{PIPE_SIZE}
-    {
-        _input = input_stream<char>{data_source{
-                std::make_unique<connection_source_impl>(&_input_buffer)}};
-        _output = output_stream<char>{data_sink{
-                std::make_unique<connection_sink_impl>(&_output_buffer)}};
-        on_new_connection();
-    }
+    connection(server& server, connected_socket&& fd);
     ~connection();
 
     /*!
@@ -277,6 +347,10 @@ class connection : public boost::intrusive::list_base_hook<> {
     future<> close(bool send_close = true);
 
 protected:
+    /*!
+     * \brief Sends a close frame with \c status_code and closes the socket.
+     */
+    future<> close_with_status(uint16_t status_code);
     future<> read_loop();
     future<> read_one();
     future<> read_http_upgrade_request();
@@ -286,6 +360,18 @@ class connection : public boost::intrusive::list_base_hook<> {
      * \brief Packs buff in websocket frame and sends it to the client.
      */
     future<> send_data(opcodes opcode, temporary_buffer<char>&& buff);
+    /*!
+     * \brief Packs buff in websocket frame and writes it, without flushing.
+     */
+    future<> write_frame(opcodes opcode, bool compressed, temporary_buffer<char>&& buff);
+    future<> write_outgoing(outgoing o);
+    // Negotiates permessage-deflate, returning the header to answer with
+    sstring negotiate_deflate(const sstring& extensions);
+    future<> push_inflated(temporary_buffer<char> data, bool end_of_message, bool text);
+    // Checks the next piece of a text message is valid UTF-8
+    bool check_text(const temporary_buffer<char>& data, bool end_of_message) noexcept;
+
+    friend class server;
 
 };
 
@@ -300,6 +386,7 @@ class server {
     boost::intrusive::list<connection> _connections;
     std::map<std::string, handler_t> _handlers;
     gate _task_gate;
+    std::optional<deflate_config> _deflate;
 public:
     /*!
      * \brief listen for a WebSocket connection on given address
@@ -322,6 +409,26 @@ class server {
 
     void register_handler(std::string&& name, handler_t handler);
 
+    /*!
+     * \brief negotiate the permessage-deflate extension with the clients
+     *
+     * Applies to the connections established after the call. Does nothing
+     * if Seastar is built without zlib (\c SEASTAR_HAVE_ZLIB).
+     */
+    void enable_permessage_deflate(deflate_config cfg = {});
+
+    /*!
+     * \brief queue a message on all the connections of the shard
+     *
+     * Queues \c msg on each connection serving \c subprotocol, or any
+     * subprotocol if empty, whose queue of messages to send has room, for
+     * a slow client not to hold the others back. The message is framed,
+     * compressed, once for all of them.
+     *
+     * \returns the number of connections the message was queued on
+     */
+    size_t broadcast(message msg, std::string_view subprotocol = {});
+
     friend class connection;
 protected:
     void accept(server_socket &listener);
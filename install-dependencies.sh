@@ -48,6 +48,8 @@ debian_packages=(
     liburing-dev
     libxml2-dev
     libyaml-cpp-dev
+    libzstd-dev
+    zlib1g-dev
     make
     meson
     ninja-build
@@ -106,6 +108,8 @@ redhat_packages=(
     valgrind-devel
     xfsprogs-devel
     yaml-cpp-devel
+    libzstd-devel
+    zlib-devel
     "${transitive[@]}"
 )
 
@@ -196,6 +200,8 @@ arch_packages=(
     valgrind
     xfsprogs
     yaml-cpp
+    zlib
+    zstd
 )
 
 opensuse_packages=(
@@ -233,6 +239,8 @@ opensuse_packages=(
     stow
     xfsprogs-devel
     yaml-cpp-devel
+    libzstd-devel
+    zlib-devel
 )
 
 case "$ID" in
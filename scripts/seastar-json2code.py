@@ -197,6 +197,27 @@ class Parameter:
     def enum(self):
         return self.definition.get('enum')
 
+    @property
+    def location(self):
+        # swagger 1.2 'paramType' or swagger 2.0 'in'
+        return self.definition.get('paramType', self.definition.get('in'))
+
+    @property
+    def cpp_type(self):
+        '''the C++ type a parameter of a scalar type is parsed to, None for
+        strings and the types that are not parsed'''
+        param_type = self.definition.get('type')
+        param_format = self.definition.get('format')
+        if param_type == 'integer':
+            return 'int32_t' if param_format == 'int32' else 'int64_t'
+        if param_type == 'number':
+            return 'float' if param_format == 'float' else 'double'
+        if param_type == 'boolean':
+            return 'bool'
+        if param_type in ('int', 'long', 'double', 'float'):
+            return param_type
+        return None
+
 
 def add_path(f, path, details):
     if "summary" in details:
@@ -264,33 +285,90 @@ def generate_code_from_enum(nickname, type_name, enums):
         enum class $type_name {
             $enum_list
         };
-        $type_name str2$type_name(const sstring& str);
+        $type_name str2$type_name(std::string_view str) noexcept;
    }
    ''').substitute(nickname=nickname,
                    type_name=type_name,
                    enum_list=indent_body(enum_list, 3))
 
-    name_list = ',\n'.join(f'"{enum}"' for enum in enums)
+    # compare the string only with the values of its length
+    by_length = {}
+    for enum in enums:
+        by_length.setdefault(len(enum), []).append(enum)
+    cases = []
+    for length in sorted(by_length):
+        compares = '\n'.join(
+            f'if (str == "{enum}") {{\n    return {type_name}::{enum};\n}}'
+            for enum in by_length[length])
+        cases.append(f'case {length}:\n{textwrap.indent(compares, "    ")}\n    break;')
     parse_func = Template('''\
-    $type_name str2$type_name(const sstring& str) {
-        static const sstring arr[] = {
-            $name_list
-        };
-        int i;
-        for (i = 0; i < $num_enums; i++) {
-            if (arr[i] == str) {
-                return ($type_name)i;
-            }
+    $type_name str2$type_name(std::string_view str) noexcept {
+        switch (str.size()) {
+        $cases
         }
-        return ($type_name)i;
+        return $type_name::NUM_ITEMS;
     }
     ''').substitute(type_name=type_name,
-                    name_list=indent_body(name_list, 3),
-                    num_enums=len(enums))
+                    cases=indent_body('\n'.join(cases), 2))
 
     return decl, parse_func
 
 
+def generate_param_accessor(nickname, param):
+    '''generates the typed accessor of a query or path parameter, none for
+    the parameters that are neither enums, nor of a scalar type nor query
+    strings'''
+    location = param.location
+    if location not in ('query', 'path'):
+        return '', ''
+    name = param.name
+    if param.enum is not None:
+        value_type = name
+    elif param.cpp_type is not None:
+        value_type = param.cpp_type
+    elif param.definition.get('type') == 'string' and location == 'query':
+        value_type = 'std::string_view'
+    else:
+        return '', ''
+
+    decl = Template('''\
+    namespace ns_$nickname {
+        // The $name $location parameter, std::nullopt if it is missing or invalid
+        std::optional<$value_type> get_$name(const http::request& req);
+    }
+    ''').substitute(nickname=nickname, name=name, location=location,
+                    value_type=value_type)
+
+    if location == 'query':
+        read = 'auto str = httpd::internal::query_param(req, name);'
+    else:
+        read = 'sstring decoded;\nauto str = httpd::internal::path_param(req, name, decoded);'
+    if param.enum is not None:
+        convert = Template('''\
+        if (!str) {
+            return std::nullopt;
+        }
+        auto v = str2$name(*str);
+        if (v == $name::NUM_ITEMS) {
+            return std::nullopt;
+        }
+        return v;''').substitute(name=name)
+    elif param.cpp_type is not None:
+        convert = f'        return httpd::internal::parse_param<{value_type}>(str);'
+    else:
+        convert = '        return str;'
+    func = Template('''\
+    std::optional<$value_type> get_$name(const http::request& req) {
+        static const sstring name("$name");
+        $read
+$convert
+    }
+    ''').substitute(value_type=value_type, name=name,
+                    read=textwrap.indent(read, 8 * ' ', not_first()),
+                    convert=convert)
+    return decl, func
+
+
 def add_operation(hfile, ccfile, path, oper):
     if "summary" in oper:
         print_ind_comment(hfile, '', oper["summary"])
@@ -353,6 +431,10 @@ $enum_wrapper
                                                             query_param.enum)
             enum_definitions += enum_decl
             funcs += parse_func
+        accessor_decl, accessor_func = generate_param_accessor(nickname, query_param)
+        if accessor_decl:
+            enum_definitions = enum_definitions.rstrip(' ') + accessor_decl
+            funcs = funcs.rstrip(' ') + accessor_func
     fprint(ccfile, '\n,'.join(f'"{param.name}"' for param in required_query_params))
     fprintln(ccfile, '});')
     fprintln(hfile, enum_definitions)
@@ -428,6 +510,12 @@ def create_enum_wrapper(model_name, name, values):
             enum_name=enum_name, enum_entry=enum_entry) for enum_entry in values)
     res = Template("""\
     virtual std::string to_json() const {
+        return std::string(json_view());
+    }
+    virtual void serialize(json::writer& w) const override {
+        w.raw(json_view());
+    }
+    std::string_view json_view() const noexcept {
         switch(v) {
         $case_clauses
         default: return "\\"Unknown\\"";
@@ -537,7 +625,7 @@ def create_h_file(data, hfile_name, api_name, init_method, base_api):
                         '<seastar/json/json_elements.hh>',
                         '<seastar/http/json_path.hh>'])
 
-    add_include(hfile, ['<iostream>', '<boost/range/irange.hpp>'])
+    add_include(hfile, ['<iostream>', '<optional>', '<string_view>', '<boost/range/irange.hpp>'])
     open_namespace(hfile, "seastar")
     open_namespace(hfile, "httpd")
     open_namespace(hfile, api_name)
@@ -555,6 +643,7 @@ def create_h_file(data, hfile_name, api_name, init_method, base_api):
             member_init = ''
             member_assignment = ''
             member_copy = ''
+            member_serialize = ''
             for member_name in model["properties"]:
                 member = model["properties"][member_name]
                 if "description" in member:
@@ -568,6 +657,7 @@ def create_h_file(data, hfile_name, api_name, init_method, base_api):
                 member_init += f'add(&{member_name}, "{member_name}");\n'
                 member_assignment += f'{member_name} = e.{member_name};\n'
                 member_copy += f'e.{member_name} = {member_name} ;\n'
+                member_serialize += f'if ({member_name}._set) {{\n    w.key("{member_name}");\n    {member_name}.serialize(w);\n}}\n'
 
             functions = Template('''
     void register_params() {
@@ -593,10 +683,18 @@ def create_h_file(data, hfile_name, api_name, init_method, base_api):
     $model_name& update(T& e) {
         $member_copy
         return *this;
+    }
+    // Writes the members directly, rather than through the registered
+    // elements, for write() to stream the object
+    void serialize(json::writer& w) const override {
+        w.begin_object();
+        $member_serialize
+        w.end_object();
     }''').substitute(model_name=model_name,
                      member_init=indent(member_init),
                      member_assignment=indent(member_assignment),
-                     member_copy=indent(member_copy))
+                     member_copy=indent(member_copy),
+                     member_serialize=indent(member_serialize))
             fprintln(hfile, functions.lstrip('\n'))
             fprintln(hfile, "};\n\n")
 
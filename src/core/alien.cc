@@ -28,6 +28,7 @@ module;
 #include <atomic>
 #include <iterator>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #ifdef SEASTAR_MODULE
@@ -60,54 +61,71 @@ message_queue::lf_queue::maybe_wakeup() {
     }
 }
 
-void message_queue::submit_item(std::unique_ptr<message_queue::work_item> item) {
-    if (!_pending.push(item.get())) {
-        throw std::bad_alloc();
+message_queue::chain::~chain() {
+    // not submitted, as allocating one of the items failed
+    while (first) {
+        delete std::exchange(first, first->next);
     }
-    item.release();
-    _pending.maybe_wakeup();
-    ++_sent.value;
+}
+
+void message_queue::submit_items(chain& items) noexcept {
+    if (!items.size) {
+        return;
+    }
+    auto head = _pending.head.load(std::memory_order_relaxed);
+    do {
+        items.last->next = head;
+    } while (!_pending.head.compare_exchange_weak(head, items.first,
+            std::memory_order_release, std::memory_order_relaxed));
+    if (!head) {
+        _pending.maybe_wakeup();
+    }
+    _sent.value.fetch_add(items.size, std::memory_order_relaxed);
+    items.first = items.last = nullptr;
 }
 
 bool message_queue::pure_poll_rx() const {
-    return !_pending.empty();
+    return _ready || _pending.head.load(std::memory_order_relaxed);
 }
 
 template<typename Func>
-size_t message_queue::process_queue(lf_queue& q, Func process) {
-    // copy batch to local memory in order to minimize
-    // time in which cross-cpu data is accessed
-    work_item* wi;
-    if (!q.pop(wi)) {
-        return 0;
+size_t message_queue::process_queue(Func process) {
+    if (!_ready) {
+        // detach what the alien threads pushed, newest first, and put it
+        // back in the order it was sent
+        auto wi = _pending.head.exchange(nullptr, std::memory_order_acquire);
+        if (!wi) {
+            return 0;
+        }
+        ++_received_batches;
+        work_item* ready = nullptr;
+        while (wi) {
+            auto next = wi->next;
+            prefetch<2>(next);
+            wi->next = ready;
+            ready = wi;
+            wi = next;
+        }
+        _ready = ready;
     }
-    work_item* items[batch_size + prefetch_cnt];
-    // start prefetching first item before popping the rest to overlap memory
-    // access with potential cache miss the second pop may cause
-    prefetch<2>(wi);
+    // at most a batch per poll, whatever was pushed at once
     size_t nr = 0;
-    while (nr < batch_size && q.pop(items[nr])) {
+    while (_ready && nr < batch_size) {
+        auto wi = std::exchange(_ready, _ready->next);
+        process(wi);
         ++nr;
     }
-    std::fill(std::begin(items) + nr, std::begin(items) + nr + prefetch_cnt, nr ? items[nr - 1] : wi);
-    unsigned i = 0;
-    do {
-        prefetch_n<2>(std::begin(items) + i, std::begin(items) + i + prefetch_cnt);
-        process(wi);
-        wi = items[i++];
-    } while (i <= nr);
-
-    return nr + 1;
+    return nr;
 }
 
 size_t message_queue::process_incoming() {
-    if (_pending.empty()) {
-        return 0;
-    }
-    auto nr = process_queue(_pending, [] (work_item* wi) {
+    auto nr = process_queue([] (work_item* wi) {
         wi->process();
         delete wi;
     });
+    if (!nr) {
+        return 0;
+    }
     _received += nr;
     _last_rcv_batch = nr;
     return nr;
@@ -124,6 +142,8 @@ void message_queue::start() {
         sm::make_counter("total_received_messages", _received, sm::description("Total number of received messages")),
         // total_operations value:DERIVE:0:U
         sm::make_counter("total_sent_messages", [this] { return _sent.value.load(); }, sm::description("Total number of sent messages")),
+        // total_operations value:DERIVE:0:U
+        sm::make_counter("total_received_batches", _received_batches, sm::description("Total number of times the messages sent were taken at once, a wakeup or a poll each")),
     });
 }
 
@@ -0,0 +1,379 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <seastar/core/block_cache.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/metrics.hh>
+
+namespace seastar {
+
+block_cache::block_cache(config cfg)
+    : _cfg(std::move(cfg))
+    , _reclaimer([this] (memory::reclaimer::request r) { return reclaim(r); }, memory::reclaimer_scope::sync)
+{
+    if (_cfg.block_size == 0) {
+        throw std::invalid_argument("block_cache: block size must not be zero");
+    }
+    register_metrics();
+}
+
+block_cache::~block_cache() {
+    // Files must not outlive the cache, so no block can still be loading.
+    _clock.clear();
+}
+
+void block_cache::register_metrics() {
+    if (_cfg.name.empty()) {
+        return;
+    }
+    namespace sm = seastar::metrics;
+    auto name = sm::label("name")(_cfg.name);
+    _metrics.add_group("block_cache", {
+        sm::make_counter("hits", _stats.hits,
+                sm::description("Total number of blocks read from the cache"), {name}),
+        sm::make_counter("misses", _stats.misses,
+                sm::description("Total number of blocks read from the file as they were not cached"), {name}),
+        sm::make_counter("read_ahead", _stats.read_ahead,
+                sm::description("Total number of blocks read ahead of a missed one"), {name}),
+        sm::make_counter("evictions", _stats.evictions,
+                sm::description("Total number of blocks evicted from the cache"), {name}),
+        sm::make_counter("invalidations", _stats.invalidations,
+                sm::description("Total number of cached blocks dropped because they were modified"), {name}),
+        sm::make_gauge("bytes", [this] { return _stats.cached_bytes; },
+                sm::description("Bytes held by cached blocks"), {name}),
+        sm::make_gauge("memory_budget", [this] { return _cfg.memory_budget; },
+                sm::description("Bytes of cached blocks the cache may hold"), {name}),
+    });
+}
+
+void block_cache::set_memory_budget(size_t budget) noexcept {
+    _cfg.memory_budget = budget;
+    evict(budget);
+}
+
+void block_cache::erase(block_map::iterator it) noexcept {
+    if (!it->second.loading) {
+        _clock.erase(_clock.iterator_to(it->second));
+    }
+    _stats.cached_bytes -= _cfg.block_size;
+    _blocks.erase(it);
+}
+
+// Evicts unreferenced blocks in CLOCK order until at most target bytes are
+// cached, giving referenced ones a second chance. Returns the bytes freed.
+size_t block_cache::evict(size_t target) noexcept {
+    size_t freed = 0;
+    while (_stats.cached_bytes > target && !_clock.empty()) {
+        auto& b = _clock.front();
+        _clock.pop_front();
+        if (b.referenced) {
+            b.referenced = false;
+            _clock.push_back(b);
+            continue;
+        }
+        _stats.cached_bytes -= _cfg.block_size;
+        _stats.evictions++;
+        _blocks.erase(b.key);
+        freed += _cfg.block_size;
+    }
+    return freed;
+}
+
+memory::reclaiming_result block_cache::reclaim(memory::reclaimer::request r) noexcept {
+    auto cached = _stats.cached_bytes;
+    auto freed = evict(cached - std::min(cached, r.bytes_to_reclaim));
+    return freed ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+}
+
+void block_cache::invalidate(dev_t dev, ino_t ino, uint64_t pos, uint64_t len) noexcept {
+    if (len == 0) {
+        return;
+    }
+    auto first = pos / _cfg.block_size;
+    auto last = (pos + std::min(len, std::numeric_limits<uint64_t>::max() - pos) - 1) / _cfg.block_size;
+    auto it = _blocks.lower_bound(block_key{dev, ino, first});
+    while (it != _blocks.end() && it->first <= block_key{dev, ino, last}) {
+        auto next = std::next(it);
+        if (it->second.loading) {
+            it->second.stale = true;
+        } else {
+            erase(it);
+            _stats.invalidations++;
+        }
+        it = next;
+    }
+}
+
+// Reads the run of missing blocks starting at first, at most nr_wanted of
+// them plus read_ahead more, with a single read, and copies up to len bytes
+// from offset off of the first one on into buffer. The data is copied out
+// before the cache is evicted down to its budget, which may drop the blocks
+// just read.
+future<block_cache::loaded> block_cache::load(dev_t dev, ino_t ino, uint64_t first, uint64_t nr_wanted, unsigned read_ahead,
+        size_t alignment, reader& rd, size_t off, char* buffer, size_t len) {
+    auto bs = _cfg.block_size;
+    std::vector<block_map::iterator> loading;
+    std::exception_ptr ex;
+    size_t res = 0;
+    loaded l;
+    bool copying = true;
+    try {
+        std::vector<iovec> iov;
+        auto nr = nr_wanted + read_ahead;
+        loading.reserve(nr);
+        iov.reserve(nr);
+        for (uint64_t i = first; i < first + nr; i++) {
+            auto buf = temporary_buffer<char>::aligned(alignment, bs);
+            auto [it, inserted] = _blocks.try_emplace(block_key{dev, ino, i});
+            if (!inserted) {
+                break;
+            }
+            it->second.key = it->first;
+            it->second.data = std::move(buf);
+            it->second.loading.emplace();
+            _stats.cached_bytes += bs;
+            loading.push_back(it);
+            iov.push_back({ it->second.data.get_write(), bs });
+        }
+        res = co_await rd(first * bs, std::move(iov));
+    } catch (...) {
+        ex = std::current_exception();
+    }
+
+    for (unsigned i = 0; i < loading.size(); i++) {
+        auto it = loading[i];
+        auto& b = it->second;
+        auto pr = std::move(*b.loading);
+        b.loading.reset();
+        if (i < nr_wanted) {
+            _stats.misses++;
+        } else {
+            _stats.read_ahead++;
+        }
+        b.size = std::min(bs, res - std::min(res, size_t(i) * bs));
+        // Copy out what was wanted, stopping at a block invalidated while
+        // being read, which read() reads again
+        if (copying && !ex && !b.stale && i < nr_wanted && l.bytes < len) {
+            auto n = std::min(len - l.bytes, b.size - std::min(b.size, off));
+            std::memcpy(buffer + l.bytes, b.data.get() + off, n);
+            l.bytes += n;
+            off = 0;
+            l.eof = b.size < bs;
+            copying = !l.eof;
+        } else {
+            copying = false;
+        }
+        // Blocks read ahead past the end of the file are of no use
+        if (ex || b.stale || (i >= nr_wanted && b.size == 0)) {
+            _stats.cached_bytes -= bs;
+            _blocks.erase(it);
+        } else {
+            b.referenced = i < nr_wanted;
+            _clock.push_back(b);
+        }
+        if (ex) {
+            pr.set_exception(ex);
+        } else {
+            pr.set_value();
+        }
+    }
+    evict(_cfg.memory_budget);
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+    co_return l;
+}
+
+future<size_t> block_cache::read(dev_t dev, ino_t ino, uint64_t pos, char* buffer, size_t len,
+        unsigned read_ahead, size_t alignment, reader& rd) {
+    auto bs = _cfg.block_size;
+    size_t done = 0;
+    while (done < len) {
+        auto idx = (pos + done) / bs;
+        auto off = (pos + done) % bs;
+        auto it = _blocks.find(block_key{dev, ino, idx});
+        if (it == _blocks.end()) {
+            auto nr_wanted = (off + len - done + bs - 1) / bs;
+            auto l = co_await load(dev, ino, idx, nr_wanted, read_ahead, alignment, rd, off, buffer + done, len - done);
+            done += l.bytes;
+            if (l.eof) {
+                break;
+            }
+            continue;
+        }
+        auto& b = it->second;
+        if (b.loading) {
+            _stats.hits++;
+            co_await b.loading->get_shared_future();
+            continue;
+        }
+        _stats.hits++;
+        b.referenced = true;
+        if (off >= b.size) {
+            break;
+        }
+        auto n = std::min(len - done, b.size - off);
+        std::memcpy(buffer + done, b.data.get() + off, n);
+        done += n;
+        if (b.size < bs) {
+            break;
+        }
+    }
+    co_return done;
+}
+
+class cached_file_impl : public layered_file_impl {
+    block_cache& _cache;
+    dev_t _dev;
+    ino_t _ino;
+    cached_file_options _opts;
+
+    template <typename... IoArgs>
+    future<size_t> do_read(uint64_t pos, char* buffer, size_t len, IoArgs... io_args) {
+        block_cache::reader rd = [this, io_args...] (uint64_t pos, std::vector<iovec> iov) {
+            return _underlying_file.dma_read(pos, std::move(iov), io_args...);
+        };
+        co_return co_await _cache.read(_dev, _ino, pos, buffer, len, _opts.read_ahead_blocks, _memory_dma_alignment, rd);
+    }
+
+    template <typename... IoArgs>
+    future<size_t> do_read(uint64_t pos, std::vector<iovec> iov, IoArgs... io_args) {
+        size_t done = 0;
+        for (auto& v : iov) {
+            auto n = co_await do_read(pos + done, static_cast<char*>(v.iov_base), v.iov_len, io_args...);
+            done += n;
+            if (n < v.iov_len) {
+                break;
+            }
+        }
+        co_return done;
+    }
+
+    template <typename... IoArgs>
+    future<temporary_buffer<uint8_t>> do_read_bulk(uint64_t offset, size_t range_size, IoArgs... io_args) {
+        auto buf = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, range_size);
+        auto n = co_await do_read(offset, reinterpret_cast<char*>(buf.get_write()), range_size, io_args...);
+        buf.trim(n);
+        co_return buf;
+    }
+
+    // Drops the blocks an operation modifies once it completes, whether it
+    // succeeded or not.
+    template <typename T>
+    future<T> invalidating(uint64_t pos, uint64_t len, future<T> f) noexcept {
+        return f.finally([this, pos, len] {
+            _cache.invalidate(_dev, _ino, pos, len);
+        });
+    }
+
+    static uint64_t length(const std::vector<iovec>& iov) noexcept {
+        uint64_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return len;
+    }
+public:
+    cached_file_impl(file f, block_cache& cache, dev_t dev, ino_t ino, cached_file_options opts)
+        : layered_file_impl(std::move(f))
+        , _cache(cache)
+        , _dev(dev)
+        , _ino(ino)
+        , _opts(opts)
+    {
+    }
+
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) override {
+        return invalidating(pos, len, _underlying_file.dma_write(pos, static_cast<const char*>(buffer), len, intent));
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        auto len = length(iov);
+        return invalidating(pos, len, _underlying_file.dma_write(pos, std::move(iov), intent));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) override {
+        return do_read(pos, static_cast<char*>(buffer), len, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        return do_read(pos, std::move(iov), intent);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) override {
+        return do_read_bulk(offset, range_size, intent);
+    }
+#else
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        return invalidating(pos, len, _underlying_file.dma_write(pos, static_cast<const char*>(buffer), len, pc));
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        auto len = length(iov);
+        return invalidating(pos, len, _underlying_file.dma_write(pos, std::move(iov), pc));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return do_read(pos, static_cast<char*>(buffer), len, std::cref(pc));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return do_read(pos, std::move(iov), std::cref(pc));
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return do_read_bulk(offset, range_size, std::cref(pc));
+    }
+#endif
+
+    virtual future<> flush() override {
+        return _underlying_file.flush();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat();
+    }
+    virtual future<> truncate(uint64_t length) override {
+        return invalidating(length, std::numeric_limits<uint64_t>::max() - length, _underlying_file.truncate(length));
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return invalidating(offset, length, _underlying_file.discard(offset, length));
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return _underlying_file.allocate(position, length);
+    }
+    virtual future<uint64_t> size() override {
+        return _underlying_file.size();
+    }
+    virtual future<> close() override {
+        return _underlying_file.close();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+future<file> make_cached_file(file f, block_cache& cache, cached_file_options opts) {
+    if (cache.block_size() % f.disk_read_dma_alignment() || cache.block_size() % f.memory_dma_alignment()) {
+        throw std::invalid_argument(format("block_cache: block size {} is not a multiple of the file's read alignment", cache.block_size()));
+    }
+    auto st = co_await f.stat();
+    co_return file(make_shared<cached_file_impl>(std::move(f), cache, st.st_dev, st.st_ino, opts));
+}
+
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#include <algorithm>
+#include <algorithm>
+#include <bit>
+
+#include <seastar/core/cache.hh>
+
+namespace seastar {
+
+namespace internal {
+
+frequency_sketch::frequency_sketch(size_t entries) {
+    resize(entries);
+}
+
+void frequency_sketch::resize(size_t entries) {
+    // A word of 16 counters per entry, the words hashed to with a mask
+    auto words = std::bit_ceil(std::max<size_t>(entries, 16));
+    _table.assign(words, 0);
+    _increments = 0;
+    _sample_size = 10 * words;
+}
+
+// The 4 counters of a key: one in each of 4 words, and one of the 16 of
+// each word, from different bits of the hash rehashed
+static inline void for_each_counter(uint64_t hash, size_t words, auto func) {
+    static constexpr uint64_t seeds[] = {
+        0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL,
+    };
+    for (auto seed : seeds) {
+        auto h = (hash + seed) * seed;
+        h += h >> 32;
+        func(size_t(h) & (words - 1), unsigned(h >> 60) * 4);
+    }
+}
+
+void frequency_sketch::increment(uint64_t hash) noexcept {
+    bool added = false;
+    for_each_counter(hash, _table.size(), [&] (size_t word, unsigned shift) {
+        if (((_table[word] >> shift) & 0xf) != 0xf) {
+            _table[word] += uint64_t(1) << shift;
+            added = true;
+        }
+    });
+    if (added && ++_increments == _sample_size) {
+        halve();
+    }
+}
+
+unsigned frequency_sketch::estimate(uint64_t hash) const noexcept {
+    unsigned freq = 0xf;
+    for_each_counter(hash, _table.size(), [&] (size_t word, unsigned shift) {
+        freq = std::min(freq, unsigned(_table[word] >> shift) & 0xf);
+    });
+    return freq;
+}
+
+void frequency_sketch::halve() noexcept {
+    for (auto& w : _table) {
+        w = (w >> 1) & 0x7777777777777777ULL;
+    }
+    _increments /= 2;
+}
+
+}
+
+}
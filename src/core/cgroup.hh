@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <chrono>
+#include <filesystem>
 #include <string>
 #include <seastar/util/std-compat.hh>
 #include <set>
@@ -35,6 +37,34 @@ using cpuset = std::set<unsigned>;
 optional<cpuset> cpu_set();
 size_t memory_limit();
 
+/// The CPU bandwidth limit of a cgroup: at most \c quota of CPU time, of
+/// all its threads, every \c period, beyond which they are throttled until
+/// the end of the period
+struct cpu_quota {
+    std::chrono::microseconds quota;
+    std::chrono::microseconds period;
+    /// The cgroup holding the limit, and its cpu.stat
+    std::filesystem::path dir;
+    bool v2;
+
+    double cpus() const noexcept {
+        return double(quota.count()) / period.count();
+    }
+};
+
+/// The tightest CPU bandwidth limit of our cgroup and its ancestors,
+/// cpu.max for cgroups v2, cpu.cfs_quota_us and cpu.cfs_period_us for v1
+optional<cpu_quota> cpu_limit();
+
+struct cpu_throttling {
+    uint64_t periods = 0;
+    uint64_t throttled_periods = 0;
+    std::chrono::microseconds throttled_time{0};
+};
+
+/// What the cgroup of the limit reports in its cpu.stat
+optional<cpu_throttling> cpu_throttling_stats(const cpu_quota&);
+
 template <typename T>
 optional<T> read_setting_as(std::string path);
 
@@ -0,0 +1,427 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/checksummed_file.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/util/crc32c.hh>
+#include <seastar/util/defer.hh>
+
+namespace seastar {
+
+checksum_error::checksum_error(uint64_t position)
+    : std::runtime_error(format("checksummed_file: checksum mismatch in block at {}", position))
+    , _position(position)
+{
+}
+
+namespace {
+
+constexpr size_t checksum_size = sizeof(uint32_t);
+
+// Continues crc over len zero bytes
+uint32_t crc32c_zeros(uint32_t crc, size_t len) noexcept {
+    static const std::array<char, 4096> zeros = {};
+    while (len) {
+        auto n = std::min(len, zeros.size());
+        crc = crc32c(zeros.data(), n, crc);
+        len -= n;
+    }
+    return crc;
+}
+
+bool all_zeros(const char* p, size_t len) noexcept {
+    return len == 0 || (p[0] == 0 && std::memcmp(p, p + 1, len - 1) == 0);
+}
+
+}
+
+// Block b of the file is checksummed as a whole, the bytes past the end of
+// the file counting as zeros, so that a block cut short by a truncation
+// stays valid when the file is extended again.
+//
+// In the interleaved layout the underlying file is a sequence of groups,
+// each a block of checksums followed by the _per_group data blocks they
+// cover. In the side-car layout the data is kept as is, its checksums in
+// a file of their own.
+class checksummed_file_impl : public layered_file_impl {
+    file _checksum_file;
+    bool _interleaved;
+    size_t _block_size;
+    uint64_t _per_group;
+    // Ranges of _checksum_file being read, modified and written back
+    std::vector<std::pair<uint64_t, uint64_t>> _locked;
+    condition_variable _unlocked;
+
+    uint64_t group_start(uint64_t block) const noexcept {
+        return block / _per_group * (_per_group + 1) * _block_size;
+    }
+    uint64_t data_pos(uint64_t block) const noexcept {
+        if (!_interleaved) {
+            return block * _block_size;
+        }
+        return group_start(block) + (1 + block % _per_group) * _block_size;
+    }
+    uint64_t checksum_pos(uint64_t block) const noexcept {
+        if (!_interleaved) {
+            return block * checksum_size;
+        }
+        return group_start(block) + block % _per_group * checksum_size;
+    }
+    // Number of the nr blocks starting at block that are contiguous in the
+    // underlying file
+    uint64_t run_length(uint64_t block, uint64_t nr) const noexcept {
+        return std::min(nr, _per_group - block % _per_group);
+    }
+    // Length of the underlying file holding a file of the given length
+    uint64_t physical_size(uint64_t length) const noexcept {
+        if (!_interleaved || length == 0) {
+            return length;
+        }
+        auto off = length % _block_size;
+        auto block = length / _block_size;
+        return off ? data_pos(block) + off : data_pos(block - 1) + _block_size;
+    }
+    uint64_t logical_size(uint64_t physical) const noexcept {
+        if (!_interleaved) {
+            return physical;
+        }
+        auto group_size = (_per_group + 1) * _block_size;
+        auto rem = physical % group_size;
+        return physical / group_size * _per_group * _block_size + (rem > _block_size ? rem - _block_size : 0);
+    }
+
+    uint32_t block_checksum(const char* data, size_t len) const noexcept {
+        return crc32c_zeros(crc32c(data, len), _block_size - len);
+    }
+
+    void check_aligned(uint64_t pos, uint64_t len) const {
+        if (pos % _block_size || len % _block_size) {
+            throw std::invalid_argument(format("checksummed_file: access to [{}, +{}) is not aligned to the block size {}",
+                    pos, len, _block_size));
+        }
+    }
+
+    future<> lock(uint64_t start, uint64_t end) {
+        auto overlaps = [this, start, end] {
+            return std::any_of(_locked.begin(), _locked.end(), [start, end] (auto& r) {
+                return r.first < end && start < r.second;
+            });
+        };
+        co_await _unlocked.wait([&overlaps] { return !overlaps(); });
+        _locked.emplace_back(start, end);
+    }
+    void unlock(uint64_t start) noexcept {
+        auto it = std::find_if(_locked.begin(), _locked.end(), [start] (auto& r) { return r.first == start; });
+        _locked.erase(it);
+        _unlocked.broadcast();
+    }
+
+    // Stores the checksums of the sums.size() blocks starting at block,
+    // which must be contiguous in the checksum file.
+    template <typename... IoArgs>
+    future<> store_checksums(uint64_t block, std::vector<uint32_t> sums, IoArgs... io_args) {
+        if (sums.empty()) {
+            co_return;
+        }
+        uint64_t alignment = _checksum_file.disk_write_dma_alignment();
+        auto start = checksum_pos(block);
+        auto end = start + sums.size() * checksum_size;
+        auto first = start / alignment * alignment;
+        auto last = (end + alignment - 1) / alignment * alignment;
+        co_await lock(first, last);
+        auto unlock_range = defer([this, first] () noexcept { unlock(first); });
+
+        auto old = co_await _checksum_file.dma_read_bulk<char>(first, last - first, io_args...);
+        auto buf = temporary_buffer<char>::aligned(_checksum_file.memory_dma_alignment(), last - first);
+        std::memcpy(buf.get_write(), old.get(), old.size());
+        std::memset(buf.get_write() + old.size(), 0, buf.size() - old.size());
+        for (size_t i = 0; i < sums.size(); i++) {
+            write_le<uint32_t>(buf.get_write() + (start - first) + i * checksum_size, sums[i]);
+        }
+        auto n = co_await _checksum_file.dma_write(first, buf.get(), buf.size(), io_args...);
+        if (n < end - first) {
+            throw std::runtime_error(format("checksummed_file: short write of checksums at {}", first));
+        }
+    }
+
+    // Reads the nr blocks starting at block, contiguous in the underlying
+    // file, along with their checksums, and verifies them.
+    template <typename... IoArgs>
+    future<size_t> read_run(uint64_t block, uint64_t nr, char* buffer, IoArgs... io_args) {
+        auto [n, sums] = co_await when_all_succeed(
+                _underlying_file.dma_read(data_pos(block), buffer, nr * _block_size, io_args...),
+                _checksum_file.dma_read_bulk<char>(checksum_pos(block), nr * checksum_size, io_args...));
+        for (uint64_t i = 0; i * _block_size < n; i++) {
+            auto data = buffer + i * _block_size;
+            auto len = std::min<size_t>(_block_size, n - i * _block_size);
+            auto off = i * checksum_size;
+            auto stored = off + checksum_size <= sums.size() ? read_le<uint32_t>(sums.get() + off) : uint32_t(0);
+            if (block_checksum(data, len) != stored && !(stored == 0 && all_zeros(data, len))) {
+                throw checksum_error((block + i) * _block_size);
+            }
+        }
+        co_return n;
+    }
+
+    template <typename... IoArgs>
+    future<size_t> do_read(uint64_t pos, char* buffer, size_t len, IoArgs... io_args) {
+        check_aligned(pos, len);
+        size_t done = 0;
+        while (done < len) {
+            auto block = (pos + done) / _block_size;
+            auto nr = run_length(block, (len - done) / _block_size);
+            auto n = co_await read_run(block, nr, buffer + done, io_args...);
+            done += n;
+            if (n < nr * _block_size) {
+                break;
+            }
+        }
+        co_return done;
+    }
+
+    template <typename... IoArgs>
+    future<size_t> do_read(uint64_t pos, std::vector<iovec> iov, IoArgs... io_args) {
+        size_t done = 0;
+        for (auto& v : iov) {
+            auto n = co_await do_read(pos + done, static_cast<char*>(v.iov_base), v.iov_len, io_args...);
+            done += n;
+            if (n < v.iov_len) {
+                break;
+            }
+        }
+        co_return done;
+    }
+
+    template <typename... IoArgs>
+    future<temporary_buffer<uint8_t>> do_read_bulk(uint64_t offset, size_t range_size, IoArgs... io_args) {
+        auto front = offset % _block_size;
+        auto pos = offset - front;
+        auto len = (front + range_size + _block_size - 1) / _block_size * _block_size;
+        auto buf = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, len);
+        auto n = co_await do_read(pos, reinterpret_cast<char*>(buf.get_write()), len, io_args...);
+        buf.trim(std::min(n, front + range_size));
+        buf.trim_front(std::min(front, buf.size()));
+        co_return buf;
+    }
+
+    template <typename... IoArgs>
+    future<size_t> do_write(uint64_t pos, const char* buffer, size_t len, IoArgs... io_args) {
+        check_aligned(pos, len);
+        size_t done = 0;
+        while (done < len) {
+            auto block = (pos + done) / _block_size;
+            auto nr = run_length(block, (len - done) / _block_size);
+            std::vector<uint32_t> sums;
+            sums.reserve(nr);
+            for (uint64_t i = 0; i < nr; i++) {
+                sums.push_back(crc32c(buffer + done + i * _block_size, _block_size));
+            }
+            auto n = co_await _underlying_file.dma_write(data_pos(block), buffer + done, nr * _block_size, io_args...);
+            // Only fully written blocks get their checksums
+            sums.resize(n / _block_size);
+            co_await store_checksums(block, std::move(sums), io_args...);
+            done += n / _block_size * _block_size;
+            if (n < nr * _block_size) {
+                break;
+            }
+        }
+        co_return done;
+    }
+
+    template <typename... IoArgs>
+    future<size_t> do_write(uint64_t pos, std::vector<iovec> iov, IoArgs... io_args) {
+        size_t done = 0;
+        for (auto& v : iov) {
+            auto n = co_await do_write(pos + done, static_cast<const char*>(v.iov_base), v.iov_len, io_args...);
+            done += n;
+            if (n < v.iov_len) {
+                break;
+            }
+        }
+        co_return done;
+    }
+
+    future<> do_truncate(uint64_t length) {
+        auto block = length / _block_size;
+        auto off = length % _block_size;
+        // A block cut short is checksummed anew, zeros standing for the
+        // bytes it loses.
+        std::optional<uint32_t> tail;
+        if (off) {
+            auto buf = temporary_buffer<char>::aligned(_memory_dma_alignment, _block_size);
+            auto n = co_await do_read(block * _block_size, buf.get_write(), _block_size);
+            if (n > off) {
+                tail = block_checksum(buf.get(), off);
+            }
+        }
+        auto kept = block + (off != 0);
+        co_await _underlying_file.truncate(physical_size(length));
+        if (!_interleaved) {
+            co_await _checksum_file.truncate(kept * checksum_size);
+            if (tail) {
+                std::vector<uint32_t> sums(1, *tail);
+                co_await store_checksums(block, std::move(sums));
+            }
+            co_return;
+        }
+        // Clear the checksums of the blocks dropped from the last group, so
+        // they read as holes if the file is extended again.
+        std::vector<uint32_t> sums;
+        auto first = kept;
+        if (tail) {
+            first = block;
+            sums.push_back(*tail);
+        }
+        if (kept % _per_group) {
+            sums.resize(sums.size() + _per_group - kept % _per_group, 0);
+        }
+        co_await store_checksums(first, std::move(sums));
+    }
+
+    future<> do_discard(uint64_t offset, uint64_t length) {
+        check_aligned(offset, length);
+        for (uint64_t done = 0; done < length;) {
+            auto block = (offset + done) / _block_size;
+            auto nr = run_length(block, (length - done) / _block_size);
+            co_await _underlying_file.discard(data_pos(block), nr * _block_size);
+            co_await store_checksums(block, std::vector<uint32_t>(nr, 0));
+            done += nr * _block_size;
+        }
+    }
+public:
+    checksummed_file_impl(file data, file checksums, bool interleaved, size_t block_size)
+        : layered_file_impl(std::move(data))
+        , _checksum_file(std::move(checksums))
+        , _interleaved(interleaved)
+        , _block_size(block_size)
+        , _per_group(interleaved ? block_size / checksum_size : std::numeric_limits<uint64_t>::max())
+    {
+        _disk_read_dma_alignment = block_size;
+        _disk_write_dma_alignment = block_size;
+        _disk_overwrite_dma_alignment = block_size;
+    }
+
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) override {
+        return do_write(pos, static_cast<const char*>(buffer), len, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        return do_write(pos, std::move(iov), intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) override {
+        return do_read(pos, static_cast<char*>(buffer), len, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        return do_read(pos, std::move(iov), intent);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) override {
+        return do_read_bulk(offset, range_size, intent);
+    }
+#else
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        return do_write(pos, static_cast<const char*>(buffer), len, std::cref(pc));
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return do_write(pos, std::move(iov), std::cref(pc));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return do_read(pos, static_cast<char*>(buffer), len, std::cref(pc));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return do_read(pos, std::move(iov), std::cref(pc));
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return do_read_bulk(offset, range_size, std::cref(pc));
+    }
+#endif
+
+    virtual future<> flush() override {
+        if (_interleaved) {
+            return _underlying_file.flush();
+        }
+        return when_all_succeed(_underlying_file.flush(), _checksum_file.flush()).discard_result();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat().then([this] (struct stat st) {
+            st.st_size = logical_size(st.st_size);
+            return st;
+        });
+    }
+    virtual future<> truncate(uint64_t length) override {
+        return do_truncate(length);
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return do_discard(offset, length);
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        auto start = _interleaved ? group_start(position / _block_size) : position;
+        return _underlying_file.allocate(start, physical_size(position + length) - start);
+    }
+    virtual future<uint64_t> size() override {
+        return _underlying_file.size().then([this] (uint64_t size) {
+            return logical_size(size);
+        });
+    }
+    virtual future<> close() override {
+        if (_interleaved) {
+            return _underlying_file.close();
+        }
+        return when_all_succeed(_underlying_file.close(), _checksum_file.close()).discard_result();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+static void check_block_size(const file& f, size_t block_size) {
+    if (block_size < 512 || (block_size & (block_size - 1))) {
+        throw std::invalid_argument(format("checksummed_file: block size {} is not a power of two of at least 512", block_size));
+    }
+    if (block_size % f.disk_read_dma_alignment() || block_size % f.disk_write_dma_alignment()
+            || block_size % f.disk_overwrite_dma_alignment() || block_size % f.memory_dma_alignment()) {
+        throw std::invalid_argument(format("checksummed_file: block size {} is not a multiple of the file's alignment", block_size));
+    }
+}
+
+file make_checksummed_file(file data, checksummed_file_options opts) {
+    check_block_size(data, opts.block_size);
+    auto checksums = data;
+    return file(make_shared<checksummed_file_impl>(std::move(data), std::move(checksums), true, opts.block_size));
+}
+
+file make_checksummed_file(file data, file checksums, checksummed_file_options opts) {
+    check_block_size(data, opts.block_size);
+    return file(make_shared<checksummed_file_impl>(std::move(data), std::move(checksums), false, opts.block_size));
+}
+
+}
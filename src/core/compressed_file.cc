@@ -0,0 +1,473 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <lz4.h>
+#ifdef SEASTAR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/compressed_file.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+
+namespace seastar {
+
+// A compressed file is a sequence of chunks, each the compressed data of
+// chunk_size bytes (short for the last one) or, if that does not compress,
+// the data itself, followed by the index: the offsets of the chunks plus
+// the offset past the last one, as 64-bit little endian integers. It ends
+// with a trailer of
+//
+//   u64 index offset, u64 data size, u32 chunk size, u8 algorithm,
+//   3 zero bytes, u64 magic
+//
+// A chunk is stored as is if and only if its stored size is its data size.
+
+namespace {
+
+constexpr size_t trailer_size = 32;
+constexpr uint64_t compressed_file_magic = 0x3146'5a43'5241'5453; // "STARCZF1"
+constexpr size_t max_chunk_size = size_t(1) << 30;
+
+[[noreturn]] void throw_malformed(const char* what) {
+    throw std::runtime_error(format("compressed_file: {}", what));
+}
+
+#ifdef SEASTAR_HAVE_ZSTD
+struct zstd_deleter {
+    void operator()(ZSTD_CCtx* p) const noexcept { ZSTD_freeCCtx(p); }
+    void operator()(ZSTD_DCtx* p) const noexcept { ZSTD_freeDCtx(p); }
+};
+#endif
+
+// Compresses and decompresses chunks, keeping the contexts the algorithm
+// needs.
+class chunk_codec {
+    compressed_file_algorithm _algorithm;
+    int _level;
+#ifdef SEASTAR_HAVE_ZSTD
+    std::unique_ptr<ZSTD_CCtx, zstd_deleter> _cctx;
+    std::unique_ptr<ZSTD_DCtx, zstd_deleter> _dctx;
+#endif
+public:
+    explicit chunk_codec(compressed_file_algorithm algorithm, int level = 0)
+        : _algorithm(algorithm)
+        , _level(level)
+    {
+        switch (_algorithm) {
+        case compressed_file_algorithm::lz4:
+            return;
+#ifdef SEASTAR_HAVE_ZSTD
+        case compressed_file_algorithm::zstd:
+            return;
+#endif
+        default:
+            break;
+        }
+        throw std::invalid_argument(format("compressed_file: unsupported compression algorithm {}", int(_algorithm)));
+    }
+
+    // Compresses len bytes of src into dst, returning the compressed size,
+    // or 0 if it would not be smaller than len.
+    size_t compress(const char* src, size_t len, char* dst) {
+        if (len < 2) {
+            return 0;
+        }
+        switch (_algorithm) {
+        case compressed_file_algorithm::lz4:
+            return LZ4_compress_default(src, dst, len, len - 1);
+#ifdef SEASTAR_HAVE_ZSTD
+        case compressed_file_algorithm::zstd: {
+            if (!_cctx) {
+                _cctx.reset(ZSTD_createCCtx());
+                if (!_cctx) {
+                    throw std::bad_alloc();
+                }
+            }
+            auto n = ZSTD_compressCCtx(_cctx.get(), dst, len - 1, src, len, _level);
+            return ZSTD_isError(n) ? 0 : n;
+        }
+#endif
+        default:
+            return 0;
+        }
+    }
+
+    // Decompresses src into the len bytes of dst, returning false unless it
+    // decompresses to exactly len bytes.
+    bool decompress(const char* src, size_t src_len, char* dst, size_t len) {
+        switch (_algorithm) {
+        case compressed_file_algorithm::lz4:
+            return LZ4_decompress_safe(src, dst, src_len, len) == int(len);
+#ifdef SEASTAR_HAVE_ZSTD
+        case compressed_file_algorithm::zstd: {
+            if (!_dctx) {
+                _dctx.reset(ZSTD_createDCtx());
+                if (!_dctx) {
+                    throw std::bad_alloc();
+                }
+            }
+            auto n = ZSTD_decompressDCtx(_dctx.get(), dst, len, src, src_len);
+            return !ZSTD_isError(n) && n == len;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+};
+
+void check_options(const compressed_file_options& opts) {
+    if (opts.chunk_size == 0 || opts.chunk_size > max_chunk_size) {
+        throw std::invalid_argument(format("compressed_file: invalid chunk size {}", opts.chunk_size));
+    }
+    chunk_codec(opts.algorithm, opts.level);
+}
+
+std::exception_ptr read_only_error() {
+    return std::make_exception_ptr(std::system_error(EBADF, std::system_category(), "compressed files are read-only"));
+}
+
+}
+
+class compressed_file_data_sink_impl : public data_sink_impl {
+    output_stream<char> _out;
+    size_t _chunk_size;
+    compressed_file_algorithm _algorithm;
+    chunk_codec _codec;
+    temporary_buffer<char> _chunk;
+    size_t _chunk_len = 0;
+    temporary_buffer<char> _compressed;
+    std::vector<uint64_t> _offsets = {0};
+    uint64_t _size = 0;
+
+    future<> write_chunk() {
+        auto n = _codec.compress(_chunk.get(), _chunk_len, _compressed.get_write());
+        if (n) {
+            co_await _out.write(_compressed.get(), n);
+        } else {
+            n = _chunk_len;
+            co_await _out.write(_chunk.get(), n);
+        }
+        _offsets.push_back(_offsets.back() + n);
+        _size += _chunk_len;
+        _chunk_len = 0;
+    }
+
+    future<> append(const char* data, size_t len) {
+        while (len) {
+            auto n = std::min(len, _chunk_size - _chunk_len);
+            std::memcpy(_chunk.get_write() + _chunk_len, data, n);
+            _chunk_len += n;
+            data += n;
+            len -= n;
+            if (_chunk_len == _chunk_size) {
+                co_await write_chunk();
+            }
+        }
+    }
+
+    future<> finish() {
+        if (_chunk_len) {
+            co_await write_chunk();
+        }
+        auto index_size = _offsets.size() * sizeof(uint64_t);
+        temporary_buffer<char> tail(index_size + trailer_size);
+        auto p = tail.get_write();
+        for (auto off : _offsets) {
+            write_le<uint64_t>(p, off);
+            p += sizeof(uint64_t);
+        }
+        std::memset(p, 0, trailer_size);
+        write_le<uint64_t>(p, _offsets.back());
+        write_le<uint64_t>(p + 8, _size);
+        write_le<uint32_t>(p + 16, _chunk_size);
+        p[20] = char(_algorithm);
+        write_le<uint64_t>(p + 24, compressed_file_magic);
+        co_await _out.write(tail.get(), tail.size());
+        co_await _out.flush();
+    }
+public:
+    compressed_file_data_sink_impl(output_stream<char> out, compressed_file_options opts)
+        : _out(std::move(out))
+        , _chunk_size(opts.chunk_size)
+        , _algorithm(opts.algorithm)
+        , _codec(opts.algorithm, opts.level)
+        , _chunk(opts.chunk_size)
+        , _compressed(opts.chunk_size)
+    {
+    }
+
+    virtual future<> put(net::packet data) override {
+        for (auto& frag : data.fragments()) {
+            co_await append(frag.base, frag.size);
+        }
+    }
+    virtual future<> put(temporary_buffer<char> buf) override {
+        co_await append(buf.get(), buf.size());
+    }
+    virtual future<> flush() override {
+        return _out.flush();
+    }
+    virtual future<> close() override {
+        std::exception_ptr ex;
+        try {
+            co_await finish();
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await _out.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return _chunk_size;
+    }
+};
+
+class compressed_file_impl : public layered_file_impl {
+    uint64_t _size;
+    size_t _chunk_size;
+    std::vector<uint64_t> _offsets;
+    chunk_codec _codec;
+    // The last chunk decompressed for a read of part of it
+    uint64_t _cached_index = std::numeric_limits<uint64_t>::max();
+    temporary_buffer<char> _cached;
+
+    size_t chunk_length(uint64_t i) const noexcept {
+        return std::min<uint64_t>(_chunk_size, _size - i * _chunk_size);
+    }
+
+    void decompress(uint64_t i, const char* src, char* dst) {
+        auto stored = _offsets[i + 1] - _offsets[i];
+        auto len = chunk_length(i);
+        if (stored == len) {
+            std::memcpy(dst, src, len);
+        } else if (!_codec.decompress(src, stored, dst, len)) {
+            throw std::runtime_error(format("compressed_file: chunk {} is corrupt", i));
+        }
+    }
+
+    template <typename... IoArgs>
+    future<size_t> do_read(uint64_t pos, char* buffer, size_t len, IoArgs... io_args) {
+        if (pos >= _size) {
+            co_return 0;
+        }
+        len = std::min<uint64_t>(len, _size - pos);
+        if (len == 0) {
+            co_return 0;
+        }
+        auto end = pos + len;
+        auto first = pos / _chunk_size;
+        auto last = (end - 1) / _chunk_size;
+        if (first == _cached_index) {
+            auto off = pos - first * _chunk_size;
+            auto n = std::min(len, _cached.size() - off);
+            std::memcpy(buffer, _cached.get() + off, n);
+            if (first++ == last) {
+                co_return len;
+            }
+        }
+        // All the chunks are read at once; those entirely covered by the
+        // read are decompressed in place.
+        auto compressed = co_await _underlying_file.dma_read_bulk<char>(_offsets[first], _offsets[last + 1] - _offsets[first], io_args...);
+        if (compressed.size() < _offsets[last + 1] - _offsets[first]) {
+            throw_malformed("unexpected end of file");
+        }
+        for (auto i = first; i <= last; i++) {
+            auto src = compressed.get() + (_offsets[i] - _offsets[first]);
+            auto chunk_pos = i * _chunk_size;
+            auto chunk_len = chunk_length(i);
+            if (chunk_pos >= pos && chunk_pos + chunk_len <= end) {
+                decompress(i, src, buffer + (chunk_pos - pos));
+            } else {
+                temporary_buffer<char> chunk(chunk_len);
+                decompress(i, src, chunk.get_write());
+                auto from = std::max(pos, chunk_pos);
+                auto to = std::min(end, chunk_pos + chunk_len);
+                std::memcpy(buffer + (from - pos), chunk.get() + (from - chunk_pos), to - from);
+                _cached_index = i;
+                _cached = std::move(chunk);
+            }
+            co_await coroutine::maybe_yield();
+        }
+        co_return len;
+    }
+
+    template <typename... IoArgs>
+    future<size_t> do_read(uint64_t pos, std::vector<iovec> iov, IoArgs... io_args) {
+        size_t done = 0;
+        for (auto& v : iov) {
+            auto n = co_await do_read(pos + done, static_cast<char*>(v.iov_base), v.iov_len, io_args...);
+            done += n;
+            if (n < v.iov_len) {
+                break;
+            }
+        }
+        co_return done;
+    }
+
+    template <typename... IoArgs>
+    future<temporary_buffer<uint8_t>> do_read_bulk(uint64_t offset, size_t range_size, IoArgs... io_args) {
+        auto buf = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, range_size);
+        auto n = co_await do_read(offset, reinterpret_cast<char*>(buf.get_write()), range_size, io_args...);
+        buf.trim(n);
+        co_return buf;
+    }
+public:
+    compressed_file_impl(file f, uint64_t size, size_t chunk_size, std::vector<uint64_t> offsets, compressed_file_algorithm algorithm)
+        : layered_file_impl(std::move(f))
+        , _size(size)
+        , _chunk_size(chunk_size)
+        , _offsets(std::move(offsets))
+        , _codec(algorithm)
+    {
+    }
+
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> write_dma(uint64_t, const void*, size_t, io_intent*) override {
+        return make_exception_future<size_t>(read_only_error());
+    }
+    virtual future<size_t> write_dma(uint64_t, std::vector<iovec>, io_intent*) override {
+        return make_exception_future<size_t>(read_only_error());
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) override {
+        return do_read(pos, static_cast<char*>(buffer), len, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        return do_read(pos, std::move(iov), intent);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) override {
+        return do_read_bulk(offset, range_size, intent);
+    }
+#else
+    virtual future<size_t> write_dma(uint64_t, const void*, size_t, const io_priority_class&) override {
+        return make_exception_future<size_t>(read_only_error());
+    }
+    virtual future<size_t> write_dma(uint64_t, std::vector<iovec>, const io_priority_class&) override {
+        return make_exception_future<size_t>(read_only_error());
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return do_read(pos, static_cast<char*>(buffer), len, std::cref(pc));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return do_read(pos, std::move(iov), std::cref(pc));
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return do_read_bulk(offset, range_size, std::cref(pc));
+    }
+#endif
+
+    virtual future<> flush() override {
+        return make_ready_future<>();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat().then([this] (struct stat st) {
+            st.st_size = _size;
+            return st;
+        });
+    }
+    virtual future<> truncate(uint64_t) override {
+        return make_exception_future<>(read_only_error());
+    }
+    virtual future<> discard(uint64_t, uint64_t) override {
+        return make_exception_future<>(read_only_error());
+    }
+    virtual future<> allocate(uint64_t, uint64_t) override {
+        return make_exception_future<>(read_only_error());
+    }
+    virtual future<uint64_t> size() override {
+        return make_ready_future<uint64_t>(_size);
+    }
+    virtual future<> close() override {
+        return _underlying_file.close();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+future<output_stream<char>> make_compressed_file_output_stream(file f, compressed_file_options opts) noexcept {
+    try {
+        check_options(opts);
+    } catch (...) {
+        return f.close().then([ex = std::current_exception()] {
+            return make_exception_future<output_stream<char>>(ex);
+        });
+    }
+    return make_file_output_stream(std::move(f)).then([opts] (output_stream<char> out) {
+        return output_stream<char>(data_sink(std::make_unique<compressed_file_data_sink_impl>(std::move(out), opts)), opts.chunk_size);
+    });
+}
+
+future<file> open_compressed_file(file f) {
+    auto size = co_await f.size();
+    if (size < trailer_size) {
+        throw_malformed("file too short");
+    }
+    auto trailer = co_await f.dma_read_exactly<char>(size - trailer_size, trailer_size);
+    auto p = trailer.get();
+    if (read_le<uint64_t>(p + 24) != compressed_file_magic) {
+        throw_malformed("bad magic");
+    }
+    auto index_offset = read_le<uint64_t>(p);
+    auto data_size = read_le<uint64_t>(p + 8);
+    size_t chunk_size = read_le<uint32_t>(p + 16);
+    auto algorithm = compressed_file_algorithm(p[20]);
+    if (chunk_size == 0 || chunk_size > max_chunk_size) {
+        throw_malformed("bad chunk size");
+    }
+    auto nr_chunks = data_size / chunk_size + (data_size % chunk_size != 0);
+    auto index_size = (nr_chunks + 1) * sizeof(uint64_t);
+    if (index_offset > size - trailer_size || size - trailer_size - index_offset != index_size) {
+        throw_malformed("bad index size");
+    }
+    auto index = co_await f.dma_read_exactly<char>(index_offset, index_size);
+    std::vector<uint64_t> offsets;
+    offsets.reserve(nr_chunks + 1);
+    for (uint64_t i = 0; i <= nr_chunks; i++) {
+        offsets.push_back(read_le<uint64_t>(index.get() + i * sizeof(uint64_t)));
+    }
+    if (offsets.front() != 0 || offsets.back() != index_offset) {
+        throw_malformed("bad index");
+    }
+    for (uint64_t i = 0; i < nr_chunks; i++) {
+        auto chunk_len = std::min<uint64_t>(chunk_size, data_size - i * chunk_size);
+        if (offsets[i + 1] < offsets[i] || offsets[i + 1] - offsets[i] > chunk_len) {
+            throw_malformed("bad index");
+        }
+    }
+    co_return file(seastar::make_shared<compressed_file_impl>(std::move(f), data_size, chunk_size, std::move(offsets), algorithm));
+}
+
+}
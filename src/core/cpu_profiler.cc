@@ -0,0 +1,279 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <chrono>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/cpu_profile.hh>
+#include <seastar/core/internal/stall_detector.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/util/backtrace.hh>
+#endif
+
+#include "core/cpu_profiler.hh"
+#include "core/symbolizer.hh"
+#include "core/thread_pool.hh"
+
+namespace seastar {
+
+namespace internal {
+
+using namespace std::chrono_literals;
+
+bool cpu_profiler::key::operator<(const key& o) const noexcept {
+    return std::tie(group, task_type, backtrace) < std::tie(o.group, o.task_type, o.backtrace);
+}
+
+cpu_profiler* cpu_profiler::local() noexcept {
+    return engine()._cpu_profiler.get();
+}
+
+template <typename T, typename Func>
+future<T> cpu_profiler::off_reactor(Func func) noexcept {
+    return engine()._thread_pool->submit<T>(std::move(func));
+}
+
+void cpu_profiler::signal_handler(int) noexcept {
+    // The timer of a reactor signals its own thread only, but may have been
+    // deleted with a signal still pending
+    auto r = local_engine;
+    if (!r || !r->_cpu_profiler) {
+        return;
+    }
+    r->_cpu_profiler->on_signal(scheduling_group_index(*current_scheduling_group_ptr()), r->_current_task_type);
+}
+
+cpu_profiler::cpu_profiler(unsigned hz, size_t max_entries)
+        : _max_entries(max_entries)
+        , _ring(std::make_unique<sample[]>(ring_size))
+        , _drain_timer([this] { drain(); }) {
+    // The backtraces of the stall detector and of the profiler are not to
+    // interrupt one another
+    struct sigaction sa = {};
+    sa.sa_handler = &cpu_profiler::signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, cpu_stall_detector::signal_number());
+    auto r = sigaction(signal_number(), &sa, nullptr);
+    throw_system_error_on(r == -1);
+    auto mask = make_sigset_mask(signal_number());
+    r = ::pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+    throw_pthread_error(r);
+
+    struct sigevent sev = {};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = signal_number();
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+    sev.sigev_notify_thread_id = syscall(SYS_gettid);
+    r = timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &_timer);
+    throw_system_error_on(r == -1, "timer_create");
+    auto period = std::chrono::nanoseconds(1s) / hz;
+    auto its = posix::to_relative_itimerspec(period, period);
+    r = timer_settime(_timer, 0, &its, nullptr);
+    if (r == -1) {
+        auto e = errno;
+        timer_delete(_timer);
+        throw std::system_error(e, std::system_category(), "timer_settime");
+    }
+    // Drained well before the ring fills up, at up to 1000 samples a second
+    _drain_timer.arm_periodic(100ms);
+}
+
+cpu_profiler::~cpu_profiler() {
+    timer_delete(_timer);
+}
+
+void cpu_profiler::on_signal(unsigned group, const std::type_info* task_type) noexcept {
+    auto head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_relaxed) == ring_size) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto& s = _ring[head % ring_size];
+    s.group = group;
+    s.task_type = task_type;
+    s.depth = 0;
+    backtrace([&s] (frame f) {
+        if (s.depth < max_depth) {
+            s.frames[s.depth++] = f.so->begin + f.addr;
+        }
+    });
+    std::atomic_signal_fence(std::memory_order_release);
+    _head.store(head + 1, std::memory_order_relaxed);
+}
+
+void cpu_profiler::drain() noexcept {
+    auto head = _head.load(std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    for (auto tail = _tail.load(std::memory_order_relaxed); tail != head; ++tail) {
+        auto& s = _ring[tail % ring_size];
+        try {
+            key k{s.group, s.task_type, std::vector<uintptr_t>(s.frames, s.frames + s.depth)};
+            auto i = _entries.find(k);
+            if (i != _entries.end()) {
+                i->second++;
+                _samples++;
+            } else if (_entries.size() < _max_entries) {
+                _entries.emplace(std::move(k), 1);
+                _samples++;
+            } else {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        } catch (...) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::atomic_signal_fence(std::memory_order_release);
+        _tail.store(tail + 1, std::memory_order_relaxed);
+    }
+}
+
+void cpu_profiler::reset() noexcept {
+    drain();
+    _entries.clear();
+    _samples = 0;
+    _dropped.store(0, std::memory_order_relaxed);
+}
+
+}
+
+namespace cpu_profile {
+
+using internal::cpu_profiler;
+
+struct entry {
+    sstring group;
+    const std::type_info* task_type;
+    std::vector<uintptr_t> backtrace;
+    uint64_t samples;
+};
+
+struct shard_profile {
+    std::vector<entry> entries;
+    uint64_t dropped = 0;
+};
+
+static future<std::vector<shard_profile>> gather(bool reset) {
+    std::vector<shard_profile> profiles(smp::count);
+    return do_with(std::move(profiles), [reset] (std::vector<shard_profile>& profiles) {
+        return smp::invoke_on_all([&profiles, reset] {
+            auto p = cpu_profiler::local();
+            if (!p) {
+                return;
+            }
+            auto& profile = profiles[this_shard_id()];
+            for (auto& [k, samples] : p->entries()) {
+                profile.entries.push_back(entry{internal::scheduling_group_from_index(k.group).name(), k.task_type, k.backtrace, samples});
+            }
+            profile.dropped = p->dropped();
+            if (reset) {
+                p->reset();
+            }
+        }).then([&profiles] {
+            return std::move(profiles);
+        });
+    });
+}
+
+// Runs on the syscall thread, which only reads the profiles
+static std::string fold(const std::vector<shard_profile>& profiles) {
+    internal::symbolizer symbolizer;
+    std::unordered_map<const std::type_info*, std::string> types;
+    std::string out;
+    for (unsigned shard = 0; shard < profiles.size(); ++shard) {
+        for (auto& e : profiles[shard].entries) {
+            auto t = types.find(e.task_type);
+            if (t == types.end()) {
+                t = types.emplace(e.task_type, e.task_type ? internal::symbolizer::demangle(e.task_type->name()) : "[reactor]").first;
+            }
+            auto frames = symbolizer.frames(e.backtrace);
+            out += fmt::format("shard {};sg:{};task:{}", shard, e.group, t->second);
+            for (auto i = frames.rbegin(); i != frames.rend(); ++i) {
+                out += ';';
+                out += **i;
+            }
+            out += fmt::format(" {}\n", e.samples);
+        }
+        if (profiles[shard].dropped) {
+            out += fmt::format("shard {};[dropped] {}\n", shard, profiles[shard].dropped);
+        }
+    }
+    return out;
+}
+
+future<sstring> collect(bool reset) {
+    return gather(reset).then([] (std::vector<shard_profile> profiles) {
+        return do_with(std::move(profiles), [] (const std::vector<shard_profile>& profiles) {
+            return cpu_profiler::off_reactor<std::string>([&profiles] {
+                return fold(profiles);
+            }).then([] (std::string folded) {
+                return sstring(folded);
+            });
+        });
+    });
+}
+
+future<> reset() {
+    return smp::invoke_on_all([] {
+        if (auto p = cpu_profiler::local()) {
+            p->reset();
+        }
+    });
+}
+
+future<> add_routes(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new httpd::function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+        if (!cpu_profiler::local()) {
+            throw httpd::not_found_exception("The CPU is not profiled, see --cpu-profiler-hz");
+        }
+        return collect(req->get_query_param("reset") == "true").then([rep = std::move(rep)] (sstring folded) mutable {
+            rep->_content = std::move(folded);
+            return std::move(rep);
+        });
+    }, "txt"));
+    return make_ready_future<>();
+}
+
+}
+
+}
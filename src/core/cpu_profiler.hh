@@ -0,0 +1,108 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+#include <ctime>
+#include <signal.h>
+#include <seastar/core/future.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/lowres_clock.hh>
+
+namespace seastar {
+
+namespace internal {
+
+// Samples the backtrace of the reactor thread every so much CPU time it
+// uses, with a timer of the CPU time of the thread signaling it, counting
+// the samples of each scheduling group, task type and backtrace. The signal
+// handler takes the samples into a ring, drained by a timer of the reactor
+// into a table of a bounded number of entries.
+class cpu_profiler {
+public:
+    static constexpr unsigned max_depth = 32;
+    static constexpr unsigned ring_size = 128;
+    struct key {
+        unsigned group;
+        // Null when the reactor is not running a task, as when polling
+        const std::type_info* task_type;
+        // The return addresses, innermost first
+        std::vector<uintptr_t> backtrace;
+        bool operator<(const key& o) const noexcept;
+    };
+    using entries_type = std::map<key, uint64_t>;
+private:
+    struct sample {
+        unsigned group;
+        const std::type_info* task_type;
+        unsigned depth;
+        uintptr_t frames[max_depth];
+    };
+    timer_t _timer;
+    size_t _max_entries;
+    std::unique_ptr<sample[]> _ring;
+    // The signal handler interrupts the thread draining the ring, so that
+    // the indexes only need fences against the compiler
+    std::atomic<unsigned> _head = { 0 };
+    std::atomic<unsigned> _tail = { 0 };
+    std::atomic<uint64_t> _dropped = { 0 };
+    uint64_t _samples = 0;
+    entries_type _entries;
+    timer<lowres_clock> _drain_timer;
+
+    static void signal_handler(int) noexcept;
+public:
+    // Samples every 1/hz second of CPU time, into at most max_entries
+    cpu_profiler(unsigned hz, size_t max_entries);
+    ~cpu_profiler();
+    static int signal_number() { return SIGRTMIN + 2; }
+    // That of the shard, null if it is off
+    static cpu_profiler* local() noexcept;
+    // Runs func on the syscall thread
+    template <typename T, typename Func>
+    static future<T> off_reactor(Func func) noexcept;
+    void on_signal(unsigned group, const std::type_info* task_type) noexcept;
+    void drain() noexcept;
+    const entries_type& entries() noexcept {
+        drain();
+        return _entries;
+    }
+    // The samples counted, and those not, as the ring or the table were
+    // full
+    uint64_t samples() const noexcept {
+        return _samples;
+    }
+    uint64_t dropped() const noexcept {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+    void reset() noexcept;
+};
+
+}
+
+}
@@ -0,0 +1,213 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/distributed_semaphore.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/exception_ptr.hh>
+#endif
+
+namespace seastar {
+
+void distributed_semaphore_units::return_all() noexcept {
+    if (_sem) {
+        _sem->signal(std::exchange(_n, 0));
+        _sem = nullptr;
+    }
+}
+
+distributed_semaphore::distributed_semaphore(size_t units, size_t batch)
+        : _batch(std::max<size_t>(batch, 1))
+        , _local(0)
+        , _pool(this_shard_id() == 0 ? units : 0) {
+}
+
+size_t distributed_semaphore::available_units() const noexcept {
+    return std::max<ssize_t>(_local.available_units(), 0);
+}
+
+future<distributed_semaphore_units> distributed_semaphore::get_units(size_t n) noexcept {
+    if (_local.try_wait(n)) {
+        return make_ready_future<distributed_semaphore_units>(*this, n);
+    }
+    _waiting += n;
+    auto f = _local.wait(n);
+    maybe_borrow();
+    return wait_for(std::move(f), n);
+}
+
+future<distributed_semaphore_units> distributed_semaphore::get_units(semaphore::time_point timeout, size_t n) noexcept {
+    if (_local.try_wait(n)) {
+        return make_ready_future<distributed_semaphore_units>(*this, n);
+    }
+    _waiting += n;
+    auto f = _local.wait(timeout, n);
+    maybe_borrow();
+    return wait_for(std::move(f), n);
+}
+
+std::optional<distributed_semaphore_units> distributed_semaphore::try_get_units(size_t n) noexcept {
+    if (_local.try_wait(n)) {
+        return distributed_semaphore_units(*this, n);
+    }
+    return std::nullopt;
+}
+
+future<distributed_semaphore_units> distributed_semaphore::wait_for(future<> f, size_t n) noexcept {
+    return f.then_wrapped([this, n] (future<> f) {
+        _waiting -= n;
+        if (f.failed()) {
+            // Units borrowed for this waiter may now be surplus
+            trim();
+            return make_exception_future<distributed_semaphore_units>(f.get_exception());
+        }
+        return make_ready_future<distributed_semaphore_units>(*this, n);
+    });
+}
+
+void distributed_semaphore::signal(size_t n) noexcept {
+    _local.signal(n);
+    trim();
+}
+
+void distributed_semaphore::trim() noexcept {
+    if (_local.waiters()) {
+        return;
+    }
+    auto keep = _starving ? 0 : _batch;
+    auto available = available_units();
+    if (available > keep) {
+        return_to_pool(available - keep);
+    }
+}
+
+// Borrows, one request at a time, what the waiters on this shard lack,
+// and at least a batch.
+void distributed_semaphore::maybe_borrow() noexcept {
+    if (_borrowing || _gate.is_closed()) {
+        return;
+    }
+    auto available = available_units();
+    if (_waiting <= available) {
+        return;
+    }
+    auto want = std::max(_batch, _waiting - available);
+    _borrowing = true;
+    auto g = _gate.hold();
+    (void)container().invoke_on(0, [want] (distributed_semaphore& s) {
+        return s.lend(want);
+    }).then_wrapped([this, g = std::move(g)] (future<size_t> f) {
+        _borrowing = false;
+        if (f.failed()) {
+            // Shard 0 is stopping
+            f.ignore_ready_future();
+            return;
+        }
+        _local.signal(f.get());
+        maybe_borrow();
+        trim();
+    });
+}
+
+void distributed_semaphore::return_to_pool(size_t n) noexcept {
+    if (_gate.is_closed()) {
+        return;
+    }
+    _local.consume(n);
+    auto g = _gate.hold();
+    (void)container().invoke_on(0, [n] (distributed_semaphore& s) {
+        s.take_back(n);
+    }).finally([g = std::move(g)] {});
+}
+
+future<size_t> distributed_semaphore::lend(size_t want) noexcept {
+    if (_gate.is_closed()) {
+        return make_exception_future<size_t>(cached_exception_ptr<broken_semaphore>());
+    }
+    if (_pool && _borrowers.empty()) {
+        auto n = std::min(want, _pool);
+        _pool -= n;
+        return make_ready_future<size_t>(n);
+    }
+    try {
+        _borrowers.push_back(borrower{promise<size_t>(), want});
+    } catch (...) {
+        return current_exception_as_future<size_t>();
+    }
+    auto f = _borrowers.back().pr.get_future();
+    if (!_reclaiming) {
+        _reclaiming = true;
+        broadcast_starving(true);
+    }
+    return f;
+}
+
+void distributed_semaphore::take_back(size_t n) noexcept {
+    _pool += n;
+    while (_pool && !_borrowers.empty()) {
+        auto& b = _borrowers.front();
+        auto granted = std::min(b.want, _pool);
+        _pool -= granted;
+        b.pr.set_value(granted);
+        _borrowers.pop_front();
+    }
+    if (_borrowers.empty() && _reclaiming) {
+        _reclaiming = false;
+        broadcast_starving(false);
+    }
+}
+
+void distributed_semaphore::set_starving(bool starving) noexcept {
+    _starving = starving;
+    if (starving) {
+        trim();
+    }
+}
+
+void distributed_semaphore::broadcast_starving(bool starving) noexcept {
+    if (_gate.is_closed()) {
+        return;
+    }
+    auto g = _gate.hold();
+    (void)container().invoke_on_all([starving] (distributed_semaphore& s) {
+        s.set_starving(starving);
+    }).finally([g = std::move(g)] {});
+}
+
+future<> distributed_semaphore::stop() noexcept {
+    _local.broken();
+    auto close = _gate.close();
+    for (auto& b : _borrowers) {
+        b.pr.set_exception(cached_exception_ptr<broken_semaphore>());
+    }
+    _borrowers.clear();
+    return close;
+}
+
+}
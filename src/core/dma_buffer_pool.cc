@@ -0,0 +1,117 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/deleter.hh>
+
+#include "core/dma_buffer_pool.hh"
+
+namespace seastar::internal {
+
+dma_buffer_pool::cache::~cache() {
+    trim(0);
+}
+
+void dma_buffer_pool::cache::release(char* p, unsigned order) noexcept {
+    if (retired) {
+        ::free(p);
+        return;
+    }
+    auto b = reinterpret_cast<free_buffer*>(p);
+    auto& head = free_lists[order - min_order];
+    b->next = head;
+    head = b;
+    st.cached_bytes += size_t(1) << order;
+    if (st.cached_bytes > high_watermark) {
+        trim(low_watermark);
+    }
+}
+
+// Frees cached buffers, largest first, until at most target bytes remain.
+// Returns the number of bytes freed.
+size_t dma_buffer_pool::cache::trim(size_t target) noexcept {
+    size_t freed = 0;
+    for (unsigned order = max_order; order >= min_order && st.cached_bytes > target; --order) {
+        auto& head = free_lists[order - min_order];
+        while (head && st.cached_bytes > target) {
+            auto b = std::exchange(head, head->next);
+            ::free(b);
+            st.cached_bytes -= size_t(1) << order;
+            freed += size_t(1) << order;
+        }
+    }
+    st.trimmed_bytes += freed;
+    return freed;
+}
+
+dma_buffer_pool::dma_buffer_pool(size_t low_watermark, size_t high_watermark)
+    : _cache(make_lw_shared<cache>(std::min(low_watermark, high_watermark), high_watermark))
+    , _reclaimer([this] (memory::reclaimer::request r) { return reclaim(r); }, memory::reclaimer_scope::sync)
+{
+}
+
+dma_buffer_pool::~dma_buffer_pool() {
+    _cache->trim(0);
+    _cache->retired = true;
+}
+
+memory::reclaiming_result dma_buffer_pool::reclaim(memory::reclaimer::request r) noexcept {
+    auto cached = _cache->st.cached_bytes;
+    if (!cached) {
+        return memory::reclaiming_result::reclaimed_nothing;
+    }
+    // Give back what was asked for, and at least the excess over the low
+    // watermark: a shard short on memory is not going to need it soon.
+    auto target = std::min(_cache->low_watermark, cached - std::min(cached, r.bytes_to_reclaim));
+    return _cache->trim(target) ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+}
+
+temporary_buffer<char> dma_buffer_pool::allocate(size_t alignment, size_t size) noexcept {
+    auto order = std::max<unsigned>(min_order, log2ceil(std::max<size_t>(size, 1)));
+    if (!_cache->high_watermark || alignment > (size_t(1) << min_order) || order > max_order) {
+        return {};
+    }
+    auto& head = _cache->free_lists[order - min_order];
+    char* p;
+    if (head) {
+        p = reinterpret_cast<char*>(std::exchange(head, head->next));
+        _cache->st.cached_bytes -= size_t(1) << order;
+        _cache->st.hits++;
+    } else {
+        p = static_cast<char*>(::aligned_alloc(size_t(1) << min_order, size_t(1) << order));
+        if (!p) {
+            return {};
+        }
+        _cache->st.misses++;
+    }
+    try {
+        return temporary_buffer<char>(p, size, make_deleter([c = _cache, p, order] {
+            c->release(p, order);
+        }));
+    } catch (...) {
+        _cache->release(p, order);
+        return {};
+    }
+}
+
+}
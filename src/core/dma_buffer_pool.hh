@@ -0,0 +1,88 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <seastar/core/memory.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/temporary_buffer.hh>
+
+namespace seastar::internal {
+
+// A per-shard cache of DMA-aligned buffers, recycled between file reads and
+// writes instead of going back to the allocator each time.
+//
+// Buffers are kept in power-of-two size classes from 4k to 1M, all 4k
+// aligned. Sequential streams allocate and free same-sized buffers at a high
+// rate; serving them from the cache keeps them from churning (and
+// fragmenting) the large-allocation spans of the seastar allocator.
+//
+// Freed buffers are cached until the cache grows beyond the high watermark,
+// at which point it is trimmed back to the low watermark. The cache is also
+// trimmed when the allocator is short of memory.
+class dma_buffer_pool {
+public:
+    static constexpr unsigned min_order = 12;
+    static constexpr unsigned max_order = 20;
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t trimmed_bytes = 0;
+        size_t cached_bytes = 0;
+    };
+private:
+    struct free_buffer {
+        free_buffer* next;
+    };
+    // Shared with the deleters of outstanding buffers, which may outlive
+    // the pool.
+    struct cache {
+        std::array<free_buffer*, max_order - min_order + 1> free_lists = {};
+        size_t low_watermark;
+        size_t high_watermark;
+        bool retired = false;
+        stats st;
+
+        cache(size_t low, size_t high) noexcept : low_watermark(low), high_watermark(high) {}
+        ~cache();
+        void release(char* p, unsigned order) noexcept;
+        size_t trim(size_t target) noexcept;
+    };
+    lw_shared_ptr<cache> _cache;
+    memory::reclaimer _reclaimer;
+private:
+    memory::reclaiming_result reclaim(memory::reclaimer::request r) noexcept;
+public:
+    // A high watermark of zero disables the pool.
+    dma_buffer_pool(size_t low_watermark, size_t high_watermark);
+    dma_buffer_pool(const dma_buffer_pool&) = delete;
+    ~dma_buffer_pool();
+    // Returns an empty buffer if the request can't be served from the pool,
+    // i.e. it is disabled, the alignment is stricter than 4k, the size is
+    // beyond the largest class, or the allocation failed.
+    temporary_buffer<char> allocate(size_t alignment, size_t size) noexcept;
+    const stats& get_stats() const noexcept { return _cache->st; }
+};
+
+}
@@ -26,6 +26,7 @@ module;
 module seastar;
 #else
 #include <seastar/core/execution_stage.hh>
+#include <seastar/core/bitops.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/make_task.hh>
 #include <seastar/util/defer.hh>
@@ -70,7 +71,7 @@ execution_stage* execution_stage_manager::get_stage(const sstring& name) {
 bool execution_stage_manager::flush() noexcept {
     bool did_work = false;
     for (auto&& stage : _execution_stages) {
-        did_work |= stage->flush();
+        did_work |= stage->maybe_flush();
     }
     return did_work;
 }
@@ -101,6 +102,8 @@ execution_stage::execution_stage(execution_stage&& other)
     , _stats(other._stats)
     , _name(std::move(other._name))
     , _metric_group(std::move(other._metric_group))
+    , _policy(other._policy)
+    , _batch_threshold(other._batch_threshold)
 {
     internal::execution_stage_manager::get().update_execution_stage_registration(other, *this);
 }
@@ -136,10 +139,74 @@ execution_stage::execution_stage(const sstring& name, scheduling_group sg)
                                   [name, &esm = internal::execution_stage_manager::get()] {
                                       return esm.get_stage(name)->get_stats().function_calls_executed;
                                   }),
+             metrics::make_counter("function_calls_batched",
+                                  metrics::description("Counts function calls which ran right after another call of the same execution stage, and likely found its code in the instruction cache"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return esm.get_stage(name)->get_stats().function_calls_batched;
+                                  }),
+             metrics::make_counter("flushes_on_deadline",
+                                  metrics::description("Counts tasks scheduled by execution stages because the batching policy's max delay passed before the batch filled up"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return esm.get_stage(name)->get_stats().flushes_on_deadline;
+                                  }),
+             metrics::make_histogram("batch_size",
+                                  metrics::description("Histogram of the number of function calls execution stages ran in a batch"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      auto& stats = esm.get_stage(name)->get_stats();
+                                      metrics::histogram h;
+                                      uint64_t count = 0;
+                                      for (size_t i = 0; i < batch_size_buckets; ++i) {
+                                          count += stats.batch_sizes[i];
+                                          h.buckets.push_back({count, double(uint64_t(1) << i)});
+                                      }
+                                      h.sample_count = count;
+                                      h.sample_sum = stats.function_calls_executed;
+                                      return h;
+                                  }).set_skip_when_empty(),
            });
     undo.cancel();
 }
 
+void execution_stage::set_batching_policy(batching_policy policy) noexcept {
+    policy.min_batch = std::max<size_t>(policy.min_batch, 1);
+    policy.max_batch = std::max<size_t>(policy.max_batch, 1);
+    _policy = policy;
+    _batch_threshold = policy.min_batch;
+    start_batch();
+}
+
+void execution_stage::account_batch(size_t calls) noexcept {
+    if (!calls) {
+        return;
+    }
+    size_t bucket = calls == 1 ? 0 : std::numeric_limits<size_t>::digits - count_leading_zeros(calls - 1);
+    _stats.batch_sizes[std::min(bucket, batch_size_buckets - 1)]++;
+    _stats.function_calls_batched += calls - 1;
+}
+
+bool execution_stage::maybe_flush() noexcept {
+    if (_empty || _flush_scheduled) {
+        return false;
+    }
+    if (queue_length() >= _batch_threshold) {
+        if (_policy.adaptive) {
+            _batch_threshold = std::min(_policy.min_batch, _batch_threshold * 2);
+        }
+        return flush();
+    }
+    if (std::chrono::steady_clock::now() < _batch_start + _policy.max_delay) {
+        return false;
+    }
+    _stats.flushes_on_deadline++;
+    if (_policy.adaptive) {
+        _batch_threshold = queue_length();
+    }
+    return flush();
+}
+
 bool execution_stage::flush() noexcept {
     if (_empty || _flush_scheduled) {
         return false;
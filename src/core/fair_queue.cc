@@ -23,6 +23,7 @@
 module;
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <queue>
@@ -108,6 +109,8 @@ fair_group::fair_group(config cfg, unsigned nr_queues)
                         tokens_capacity(cfg.min_tokens)
                        )
         , _per_tick_threshold(_token_bucket.limit() / nr_queues)
+        , _grab_batch(_per_tick_threshold * std::clamp(cfg.grab_batch, 0.0, 1.0))
+        , _share_idle_capacity(cfg.share_idle_capacity)
 {
     if (tokens_capacity(cfg.min_tokens) > _token_bucket.threshold()) {
         throw std::runtime_error("Fair-group replenisher limit is lower than threshold");
@@ -146,6 +149,8 @@ class fair_queue::priority_class_data {
     fair_queue_entry::container_list_t _queue;
     bool _queued = false;
     bool _plugged = true;
+    std::chrono::microseconds _latency_target = std::chrono::microseconds(0);
+    uint64_t _deadline_dispatches = 0;
 
 public:
     explicit priority_class_data(uint32_t shares) noexcept : _shares(std::max(shares, 1u)) {}
@@ -165,6 +170,7 @@ fair_queue::fair_queue(fair_group& group, config cfg)
     : _config(std::move(cfg))
     , _group(group)
     , _group_replenish(clock_type::now())
+    , _grabs(group.token_bucket(), group.grab_batch())
 {
 }
 
@@ -172,6 +178,10 @@ fair_queue::~fair_queue() {
     for (const auto& fq : _priority_classes) {
         assert(!fq);
     }
+    _grabs.refund();
+    if (_active) {
+        _group.deactivate_queue();
+    }
 }
 
 void fair_queue::push_priority_class(priority_class_data& pc) noexcept {
@@ -181,29 +191,61 @@ void fair_queue::push_priority_class(priority_class_data& pc) noexcept {
     pc._queued = true;
 }
 
+// How many capacity units the class can accumulate with its shares in tau:
+// estimate it per rate resolution and scale it up to tau.
+auto fair_queue::max_deviation(const priority_class_data& pc) const noexcept -> capacity_t {
+    return fair_group::fixed_point_factor / pc._shares * fair_group::token_bucket_t::rate_cast(_config.tau).count();
+}
+
 void fair_queue::push_priority_class_from_idle(priority_class_data& pc) noexcept {
     if (!pc._queued) {
         // Don't let the newcomer monopolize the disk for more than tau
-        // duration. For this estimate how many capacity units can be
-        // accumulated with the current class shares per rate resulution
-        // and scale it up to tau.
-        capacity_t max_deviation = fair_group::fixed_point_factor / pc._shares * fair_group::token_bucket_t::rate_cast(_config.tau).count();
+        // duration.
         // On start this deviation can go to negative values, so not to
         // introduce extra if's for that short corner case, use signed
         // arithmetics and make sure the _accumulated value doesn't grow
         // over signed maximum (see overflow check below)
-        pc._accumulated = std::max<signed_capacity_t>(_last_accumulated - max_deviation, pc._accumulated);
+        pc._accumulated = std::max<signed_capacity_t>(_last_accumulated - max_deviation(pc), pc._accumulated);
         _handles.assert_enough_capacity();
         _handles.push(&pc);
         pc._queued = true;
     }
 }
 
-// ATTN: This can only be called on pc that is from _handles.top()
+// ATTN: This can only be called on pc that is in _handles
 void fair_queue::pop_priority_class(priority_class_data& pc) noexcept {
     assert(pc._queued);
     pc._queued = false;
-    _handles.pop();
+    if (_handles.top() == &pc) {
+        _handles.pop();
+    } else {
+        _handles.remove(&pc);
+    }
+}
+
+// Picks the class whose turn it is, unless a class with a latency target
+// has a request that has waited for half of it. The most urgent of those
+// goes first, provided that it's not ahead of the class whose turn it is by
+// more than it could consume in tau.
+auto fair_queue::pick_priority_class(clock_type::time_point now) noexcept -> priority_class_data& {
+    priority_class_data& top = *_handles.top();
+    priority_class_data* urgent = nullptr;
+    auto urgent_deadline = clock_type::time_point::max();
+    for (auto pc : _latency_classes) {
+        if (!pc->_queued || !pc->_plugged || pc->_queue.empty()) {
+            continue;
+        }
+        auto queued_at = pc->_queue.front()._queued_at;
+        if (queued_at == clock_type::time_point() || now - queued_at < pc->_latency_target / 2) {
+            continue;
+        }
+        auto deadline = queued_at + pc->_latency_target;
+        if (deadline < urgent_deadline && pc->_accumulated <= top._accumulated + max_deviation(*pc)) {
+            urgent = pc;
+            urgent_deadline = deadline;
+        }
+    }
+    return urgent ? *urgent : top;
 }
 
 void fair_queue::plug_priority_class(priority_class_data& pc) noexcept {
@@ -249,7 +291,8 @@ auto fair_queue::grab_capacity(const fair_queue_entry& ent) noexcept -> grab_res
     }
 
     capacity_t cap = ent._capacity;
-    capacity_t want_head = _group.grab_capacity(cap);
+    assert(cap <= _group.maximum_capacity());
+    capacity_t want_head = _grabs.grab(cap);
     if (_group.capacity_deficiency(want_head)) {
         _pending.emplace(want_head, cap);
         return grab_result::pending;
@@ -273,10 +316,26 @@ void fair_queue::register_priority_class(class_id id, uint32_t shares) {
 void fair_queue::unregister_priority_class(class_id id) {
     auto& pclass = _priority_classes[id];
     assert(pclass);
+    std::erase(_latency_classes, pclass.get());
     pclass.reset();
     _nr_classes--;
 }
 
+void fair_queue::set_latency_target_for_class(class_id id, std::chrono::microseconds target) {
+    assert(id < _priority_classes.size());
+    auto& pc = _priority_classes[id];
+    assert(pc);
+    auto it = std::find(_latency_classes.begin(), _latency_classes.end(), pc.get());
+    if (target.count() > 0) {
+        if (it == _latency_classes.end()) {
+            _latency_classes.push_back(pc.get());
+        }
+    } else if (it != _latency_classes.end()) {
+        _latency_classes.erase(it);
+    }
+    pc->_latency_target = target;
+}
+
 void fair_queue::update_shares_for_class(class_id id, uint32_t shares) {
     assert(id < _priority_classes.size());
     auto& pc = _priority_classes[id];
@@ -300,6 +359,9 @@ void fair_queue::queue(class_id id, fair_queue_entry& ent) noexcept {
     if (pc._plugged) {
         push_priority_class_from_idle(pc);
     }
+    if (pc._latency_target.count() > 0) {
+        ent._queued_at = clock_type::now();
+    }
     pc._queue.push_back(ent);
 }
 
@@ -310,6 +372,14 @@ void fair_queue::notify_request_cancelled(fair_queue_entry& ent) noexcept {
     ent._capacity = 0;
 }
 
+bool fair_queue::try_update_request_capacity(fair_queue_entry& ent, fair_queue_entry::capacity_t cap) noexcept {
+    if (_pending && cap > _pending->cap) {
+        return false;
+    }
+    ent._capacity = cap;
+    return true;
+}
+
 fair_queue::clock_type::time_point fair_queue::next_pending_aio() const noexcept {
     if (_pending) {
         /*
@@ -333,9 +403,17 @@ fair_queue::clock_type::time_point fair_queue::next_pending_aio() const noexcept
 void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
     capacity_t dispatched = 0;
     boost::container::small_vector<priority_class_ptr, 2> preempt;
+    auto now = _latency_classes.empty() ? clock_type::time_point() : clock_type::now();
 
-    while (!_handles.empty() && (dispatched < _group.per_tick_grab_threshold())) {
-        priority_class_data& h = *_handles.top();
+    if (!_active && !_handles.empty()) {
+        _group.activate_queue();
+        _active = true;
+    }
+    auto threshold = _group.per_tick_grab_threshold();
+
+    while (!_handles.empty() && (dispatched < threshold)) {
+        priority_class_data& h = _latency_classes.empty() ? *_handles.top() : pick_priority_class(now);
+        bool ahead_of_turn = &h != _handles.top();
         if (h._queue.empty() || !h._plugged) {
             pop_priority_class(h);
             continue;
@@ -380,6 +458,10 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
         h._pure_accumulated += req_cap;
         dispatched += req_cap;
 
+        if (ahead_of_turn) {
+            h._deadline_dispatches++;
+        }
+
         cb(req);
 
         if (h._plugged && !h._queue.empty()) {
@@ -390,6 +472,15 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
     for (auto&& h : preempt) {
         push_priority_class(*h);
     }
+
+    if (dispatched > _group.fair_share_per_tick()) {
+        _borrowed_capacity += dispatched - _group.fair_share_per_tick();
+    }
+    if (_active && _handles.empty()) {
+        _grabs.refund();
+        _group.deactivate_queue();
+        _active = false;
+    }
 }
 
 std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::metrics(class_id c) {
@@ -402,6 +493,8 @@ std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::metrics(
             sm::make_counter("adjusted_consumption",
                     [&pc] { return fair_group::capacity_tokens(pc._accumulated); },
                     sm::description("Consumed disk capacity units adjusted for class shares and idling preemption")),
+            sm::make_counter("deadline_dispatches", [&pc] { return pc._deadline_dispatches; },
+                    sm::description("Requests dispatched ahead of their share-based turn to meet the class latency target")),
     });
 }
 
@@ -22,11 +22,13 @@
 #pragma once
 
 #include <seastar/core/file.hh>
+#include <seastar/core/shared_future.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <atomic>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 #include <sys/uio.h>
 
@@ -36,6 +38,7 @@ class io_queue;
 namespace internal {
 
 struct fs_info;
+class io_request;
 
 }
 
@@ -75,9 +78,19 @@ class posix_file_impl : public file_impl {
     const bool _nowait_works;
     io_queue& _io_queue;
     const open_flags _open_flags;
+    // Whether _fd is registered with the reactor (see reactor::register_file())
+    bool _registered = false;
+    // Group commit: flushes arriving while a sync is in flight wait for a
+    // single sync issued once it completes
+    bool _flush_in_flight = false;
+    std::optional<shared_promise<>> _next_flush;
 protected:
     int _fd;
 
+    io_queue& get_io_queue() const noexcept {
+        return _io_queue;
+    }
+
     posix_file_impl(int fd, open_flags, file_open_options options, dev_t device_id, bool nowait_works);
     posix_file_impl(int fd, open_flags, file_open_options options, dev_t device_id, const internal::fs_info& fsi);
     posix_file_impl(int fd, open_flags, std::atomic<unsigned>* refcount, dev_t device_id,
@@ -96,6 +109,7 @@ class posix_file_impl : public file_impl {
     future<int> ioctl_short(uint64_t cmd, void* argp) noexcept override;
     future<int> fcntl(int op, uintptr_t arg) noexcept override;
     future<int> fcntl_short(int op, uintptr_t arg) noexcept override;
+    future<file_mapping> map_readonly(uint64_t offset, size_t length) noexcept override;
     virtual future<> allocate(uint64_t position, uint64_t length) noexcept override;
     future<uint64_t> size() noexcept override;
     // close() never fails. It just reports errors and swallows them.
@@ -105,6 +119,11 @@ class posix_file_impl : public file_impl {
     virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override;
     virtual coroutine::experimental::generator<directory_entry> experimental_list_directory() override;
 
+    // Sends up to len bytes at pos to out_fd with sendfile(2). It runs in the
+    // syscall thread so that reading cold data does not block the reactor.
+    // Returns std::nullopt if a non-blocking out_fd cannot take more data.
+    future<std::optional<size_t>> sendfile_to(int out_fd, uint64_t pos, size_t len) noexcept;
+
 #if SEASTAR_API_LEVEL >= 7
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) noexcept override = 0;
     virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override = 0;
@@ -141,6 +160,7 @@ class posix_file_impl : public file_impl {
 private:
     void configure_dma_alignment(const internal::fs_info& fsi);
     void configure_io_lengths() noexcept;
+    void flush_next() noexcept;
 
     /**
      * Try to read from the given position where the previous short read has
@@ -418,4 +438,71 @@ class blockdev_file_impl final : public posix_file_impl {
 
 };
 
+// A file on an NVMe generic char device (/dev/ngXnY). It reads, writes
+// and discards with NVMe commands passed through io_uring, which skip
+// the kernel block layer, but are still queued in the io_queue of the
+// namespace's block device (see reactor_options::uring_nvme_passthrough).
+class nvme_file_impl final : public posix_file_impl {
+    uint32_t _nsid;
+    unsigned _lba_shift;
+    uint64_t _nr_blocks;
+
+    future<size_t> do_nvme_io(uint8_t opcode, uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> do_nvme_io(uint8_t opcode, uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> submit_nvme_io(uint8_t opcode, uint64_t pos, size_t len, internal::io_request req, internal::maybe_priority_class_ref pc, io_intent* intent, std::vector<iovec> iovs = {}) noexcept;
+    size_t clamp_length(uint8_t opcode, uint64_t pos, size_t len) const;
+
+    future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+
+public:
+    nvme_file_impl(int fd, open_flags, file_open_options options, dev_t device_id, uint32_t nsid, unsigned lba_shift, uint64_t nr_blocks);
+    future<> flush() noexcept override;
+    future<> truncate(uint64_t length) noexcept override;
+    future<> discard(uint64_t offset, uint64_t length) noexcept override;
+    future<uint64_t> size() noexcept override;
+    virtual future<> allocate(uint64_t position, uint64_t length) noexcept override;
+    virtual std::unique_ptr<seastar::file_handle_impl> dup() override;
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) noexcept override {
+        return read_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return read_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) noexcept override {
+        return dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref{}, intent);
+    }
+#else
+    using posix_file_impl::read_dma;
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return read_dma(pos, buffer, len, internal::maybe_priority_class_ref(pc), intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return read_dma(pos, std::move(iov), internal::maybe_priority_class_ref(pc), intent);
+    }
+    using posix_file_impl::write_dma;
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref(pc), intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref(pc), intent);
+    }
+    using posix_file_impl::dma_read_bulk;
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref(pc), intent);
+    }
+#endif
+
+};
+
 }
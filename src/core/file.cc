@@ -24,12 +24,16 @@ module;
 #endif
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <coroutine>
 #include <deque>
 #include <filesystem>
+#include <fstream>
 #include <functional>
+#include <limits>
 #include <memory>
+#include <numeric>
 #include <optional>
 #include <vector>
 
@@ -40,7 +44,16 @@ module;
 #include <linux/types.h> // for xfs, below
 #include <linux/fs.h> // BLKBSZGET
 #include <linux/major.h>
+#if __has_include(<linux/nvme_ioctl.h>)
+#include <linux/nvme_ioctl.h>
+#endif
+#ifdef NVME_URING_CMD_IO
+// Kernel headers of Linux 5.19 or later, with NVMe passthrough commands
+#define SEASTAR_HAVE_NVME_PASSTHROUGH
+#endif
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <xfs/linux.h>
@@ -58,6 +71,7 @@ module;
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/byteorder.hh>
 #include <seastar/core/internal/read_state.hh>
 #include <seastar/core/internal/uname.hh>
 #include <seastar/core/reactor.hh>
@@ -69,6 +83,7 @@ module seastar;
 #include <seastar/util/internal/iovec_utils.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/queue.hh>
+#include <seastar/core/when_all.hh>
 #include "core/file-impl.hh"
 #include "core/syscall_result.hh"
 #include "core/thread_pool.hh"
@@ -127,6 +142,7 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
         , _fd(fd)
 {
     configure_io_lengths();
+    _registered = engine().register_file(_fd);
 }
 
 posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, const internal::fs_info& fsi)
@@ -136,6 +152,9 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
 }
 
 posix_file_impl::~posix_file_impl() {
+    if (_registered && _fd != -1 && engine_is_ready()) {
+        engine().unregister_file(_fd);
+    }
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         return;
     }
@@ -201,7 +220,40 @@ posix_file_impl::flush() noexcept {
     if ((_open_flags & open_flags::dsync) != open_flags{}) {
         return make_ready_future<>();
     }
-    return engine().fdatasync(_fd);
+    if (!_flush_in_flight) {
+        _flush_in_flight = true;
+        return engine().fdatasync(_fd).finally([this] {
+            flush_next();
+        });
+    }
+    // The sync in flight may have started before the caller's writes
+    // completed, so wait for the next one, shared by all the flushes that
+    // arrive meanwhile.
+    if (_next_flush) {
+        engine()._io_stats.fsyncs_coalesced++;
+    } else {
+        _next_flush.emplace();
+    }
+    return _next_flush->get_shared_future();
+}
+
+void
+posix_file_impl::flush_next() noexcept {
+    if (!_next_flush) {
+        _flush_in_flight = false;
+        return;
+    }
+    auto pr = std::move(*_next_flush);
+    _next_flush.reset();
+    // Waited for by the flushes that joined pr, which keep the file alive
+    (void)engine().fdatasync(_fd).then_wrapped([this, pr = std::move(pr)] (future<> f) mutable {
+        if (f.failed()) {
+            pr.set_exception(f.get_exception());
+        } else {
+            pr.set_value();
+        }
+        flush_next();
+    });
 }
 
 future<struct stat>
@@ -226,6 +278,20 @@ posix_file_impl::truncate(uint64_t length) noexcept {
     });
 }
 
+future<std::optional<size_t>>
+posix_file_impl::sendfile_to(int out_fd, uint64_t pos, size_t len) noexcept {
+    return engine()._thread_pool->submit<syscall_result<ssize_t>>([this, out_fd, pos, len] {
+        auto off = off_t(pos);
+        return wrap_syscall<ssize_t>(::sendfile(out_fd, _fd, &off, len));
+    }).then([] (syscall_result<ssize_t> sr) {
+        if (sr.result == -1 && (sr.error == EAGAIN || sr.error == EWOULDBLOCK)) {
+            return std::optional<size_t>();
+        }
+        sr.throw_if_error();
+        return std::optional<size_t>(sr.result);
+    });
+}
+
 future<int>
 posix_file_impl::ioctl(uint64_t cmd, void* argp) noexcept {
     return engine()._thread_pool->submit<syscall_result<int>>([this, cmd, argp] () mutable {
@@ -268,6 +334,109 @@ posix_file_impl::fcntl_short(int op, uintptr_t arg) noexcept {
     return make_ready_future<int>(ret);
 }
 
+static size_t os_page_size() noexcept {
+    static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+future<file_mapping>
+posix_file_impl::map_readonly(uint64_t offset, size_t length) noexcept {
+    return size().then([this, offset, length] (uint64_t size) {
+        // Pages past the end of the file cannot be accessed
+        if (offset >= size || length == 0) {
+            return file_mapping();
+        }
+        auto len = std::min<uint64_t>(length, size - offset);
+        auto map_offset = align_down<uint64_t>(offset, os_page_size());
+        auto map_size = len + (offset - map_offset);
+        // Without MAP_POPULATE, mmap() only sets up the mapping and does no I/O
+        auto p = ::mmap(nullptr, map_size, PROT_READ, MAP_SHARED, _fd, map_offset);
+        if (p == MAP_FAILED) {
+            throw std::system_error(errno, std::system_category(), "mmap failed");
+        }
+        return file_mapping(p, map_size, static_cast<const char*>(p) + (offset - map_offset), len);
+    });
+}
+
+file_mapping::file_mapping(file_mapping&& x) noexcept
+    : _map(std::exchange(x._map, nullptr))
+    , _map_size(std::exchange(x._map_size, 0))
+    , _data(std::exchange(x._data, nullptr))
+    , _size(std::exchange(x._size, 0))
+{
+}
+
+file_mapping& file_mapping::operator=(file_mapping&& x) noexcept {
+    if (this != &x) {
+        if (_map) {
+            ::munmap(_map, _map_size);
+        }
+        _map = std::exchange(x._map, nullptr);
+        _map_size = std::exchange(x._map_size, 0);
+        _data = std::exchange(x._data, nullptr);
+        _size = std::exchange(x._size, 0);
+    }
+    return *this;
+}
+
+file_mapping::~file_mapping() {
+    if (_map) {
+        ::munmap(_map, _map_size);
+    }
+}
+
+bool file_mapping::is_resident(size_t offset, size_t len) const noexcept {
+    if (offset >= _size || len == 0) {
+        return true;
+    }
+    auto page = os_page_size();
+    auto start = align_down(reinterpret_cast<uintptr_t>(_data + offset), page);
+    auto end = align_up(reinterpret_cast<uintptr_t>(_data + offset + std::min(len, _size - offset)), page);
+    // mincore(2) only walks the page tables; query it in batches to bound
+    // the stack used for its result.
+    std::array<unsigned char, 4096> vec;
+    while (start < end) {
+        auto n = std::min<size_t>((end - start) / page, vec.size());
+        if (::mincore(reinterpret_cast<void*>(start), n * page, vec.data()) != 0) {
+            return false;
+        }
+        if (std::any_of(vec.begin(), vec.begin() + n, [] (unsigned char v) { return !(v & 1); })) {
+            return false;
+        }
+        start += n * page;
+    }
+    return true;
+}
+
+future<> file_mapping::ensure_resident(size_t offset, size_t len) noexcept {
+    if (is_resident(offset, len)) {
+        return make_ready_future<>();
+    }
+    auto page = os_page_size();
+    auto start = align_down(reinterpret_cast<uintptr_t>(_data + offset), page);
+    auto end = align_up(reinterpret_cast<uintptr_t>(_data + offset + std::min(len, _size - offset)), page);
+    return engine()._thread_pool->submit<syscall_result<int>>([start, end, page] {
+        auto p = reinterpret_cast<void*>(start);
+        auto size = end - start;
+#ifdef MADV_POPULATE_READ
+        // Reads the range in, waiting for it, with no page touched by us
+        auto r = ::madvise(p, size, MADV_POPULATE_READ);
+        if (r == 0 || errno != EINVAL) {
+            return wrap_syscall<int>(r);
+        }
+#endif
+        // Older kernels: start reading the whole range ahead, then wait for
+        // it page by page.
+        ::madvise(p, size, MADV_WILLNEED);
+        for (auto a = start; a < end; a += page) {
+            (void)*reinterpret_cast<volatile const char*>(a);
+        }
+        return wrap_syscall<int>(0);
+    }).then([] (syscall_result<int> sr) {
+        sr.throw_if_error();
+    });
+}
+
 future<>
 posix_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
     return engine()._thread_pool->submit<syscall_result<int>>([this, offset, length] () mutable {
@@ -319,6 +488,9 @@ posix_file_impl::close() noexcept {
         return make_ready_future<>();
     }
     auto fd = _fd;
+    if (std::exchange(_registered, false)) {
+        engine().unregister_file(fd);
+    }
     _fd = -1;  // Prevent a concurrent close (which is illegal) from closing another file's fd
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         _refcount = nullptr;
@@ -540,8 +712,8 @@ posix_file_impl::do_dma_read_bulk(uint64_t offset, size_t range_size, internal::
 
     auto rstate = make_lw_shared<internal::file_read_state<uint8_t>>(offset, front,
                                                        range_size,
-                                                       _memory_dma_alignment,
-                                                       _disk_read_dma_alignment,
+                                                       engine().allocate_dma_buffer<uint8_t>(_memory_dma_alignment,
+                                                               align_up(range_size, size_t(_disk_read_dma_alignment))),
                                                        intent);
 
     //
@@ -596,7 +768,7 @@ posix_file_impl::read_maybe_eof(uint64_t pos, size_t len, internal::maybe_priori
     // We have to allocate a new aligned buffer to make sure we don't get
     // an EINVAL error due to unaligned destination buffer.
     //
-    temporary_buffer<uint8_t> buf = temporary_buffer<uint8_t>::aligned(
+    temporary_buffer<uint8_t> buf = engine().allocate_dma_buffer<uint8_t>(
                _memory_dma_alignment, align_up(len, size_t(_disk_read_dma_alignment)));
 
     // try to read a single bulk from the given position
@@ -693,6 +865,244 @@ blockdev_file_impl::dma_read_bulk(uint64_t offset, size_t range_size, internal::
     return posix_file_impl::do_dma_read_bulk(offset, range_size, pc, intent);
 }
 
+#ifdef SEASTAR_HAVE_NVME_PASSTHROUGH
+
+namespace nvme {
+
+// NVM command set opcodes
+constexpr uint8_t cmd_flush = 0x00;
+constexpr uint8_t cmd_write = 0x01;
+constexpr uint8_t cmd_read = 0x02;
+constexpr uint8_t cmd_dsm = 0x09;
+constexpr uint8_t admin_identify = 0x06;
+
+// Dataset management: deallocate the ranges
+constexpr uint32_t dsm_attr_deallocate = 1 << 2;
+constexpr size_t dsm_max_ranges = 256;
+
+struct dsm_range {
+    uint32_t cattr;
+    uint32_t nlb;
+    uint64_t slba;
+};
+
+// The command completes with the NVMe status, rather than with the length
+static size_t check_status(size_t status, size_t len) {
+    if (status != 0) {
+        throw std::system_error(EIO, std::system_category(), fmt::format("NVMe command failed with status 0x{:x}", status));
+    }
+    return len;
+}
+
+}
+
+nvme_file_impl::nvme_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, uint32_t nsid, unsigned lba_shift, uint64_t nr_blocks)
+        : posix_file_impl(fd, f, options, device_id, false)
+        , _nsid(nsid)
+        , _lba_shift(lba_shift)
+        , _nr_blocks(nr_blocks) {
+    _disk_read_dma_alignment = 1u << _lba_shift;
+    _disk_write_dma_alignment = 1u << _lba_shift;
+    _disk_overwrite_dma_alignment = 1u << _lba_shift;
+    _read_max_length = align_down<size_t>(_read_max_length, 1u << _lba_shift);
+    _write_max_length = align_down<size_t>(_write_max_length, 1u << _lba_shift);
+}
+
+// Reads stop at the end of the namespace, like those of a block device,
+// the rest fail on misaligned or out of range blocks
+size_t
+nvme_file_impl::clamp_length(uint8_t opcode, uint64_t pos, size_t len) const {
+    auto mask = (uint64_t(1) << _lba_shift) - 1;
+    if ((pos & mask) || (len & mask)) {
+        throw std::system_error(EINVAL, std::system_category(), "NVMe I/O is not aligned to the logical block size");
+    }
+    auto size = _nr_blocks << _lba_shift;
+    if (opcode == nvme::cmd_read) {
+        return pos < size ? std::min<uint64_t>(len, size - pos) : 0;
+    }
+    if (pos > size || len > size - pos) {
+        throw std::system_error(ENOSPC, std::system_category(), "NVMe write beyond the end of the namespace");
+    }
+    return len;
+}
+
+future<size_t>
+nvme_file_impl::submit_nvme_io(uint8_t opcode, uint64_t pos, size_t len, internal::io_request req, internal::maybe_priority_class_ref pc, io_intent* intent, std::vector<iovec> iovs) noexcept {
+    auto f = opcode == nvme::cmd_read
+        ? get_io_queue().submit_io_read(internal::priority_class(pc), len, std::move(req), intent, std::move(iovs))
+        : get_io_queue().submit_io_write(internal::priority_class(pc), len, std::move(req), intent, std::move(iovs));
+    return f.then([len] (size_t status) {
+        return nvme::check_status(status, len);
+    });
+}
+
+future<size_t>
+nvme_file_impl::do_nvme_io(uint8_t opcode, uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+  try {
+    len = clamp_length(opcode, pos, len);
+    if (len == 0) {
+        return make_ready_future<size_t>(0);
+    }
+    auto max_length = opcode == nvme::cmd_read ? _read_max_length : _write_max_length;
+    if (len > max_length) {
+        return do_nvme_io(opcode, pos, std::vector<iovec>{{buffer, len}}, pc, intent);
+    }
+    auto slba = pos >> _lba_shift;
+    auto nlb = uint32_t((len >> _lba_shift) - 1);
+    auto req = internal::io_request::make_nvme_cmd(_fd, _nsid, opcode, uint32_t(slba), uint32_t(slba >> 32), nlb, buffer, len);
+    return submit_nvme_io(opcode, pos, len, std::move(req), pc, intent);
+  } catch (...) {
+    return current_exception_as_future<size_t>();
+  }
+}
+
+future<size_t>
+nvme_file_impl::do_nvme_io(uint8_t opcode, uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+  try {
+    auto len = internal::sanitize_iovecs(iov, 1u << _lba_shift);
+    auto clamped = clamp_length(opcode, pos, len);
+    if (clamped == 0) {
+        return make_ready_future<size_t>(0);
+    }
+    if (clamped < len) {
+        iov = internal::io_request::make_readv(_fd, pos, iov, false).split(clamped).front().iovecs;
+        len = clamped;
+    }
+    // Commands are limited to the request lengths of the io_queue, which
+    // won't split them itself, not knowing how to tell their parts apart
+    auto max_length = opcode == nvme::cmd_read ? _read_max_length : _write_max_length;
+    std::vector<internal::io_request::part> parts;
+    if (len > max_length) {
+        parts = internal::io_request::make_readv(_fd, pos, iov, false).split(max_length);
+    } else {
+        parts.push_back({internal::io_request::make_readv(_fd, pos, iov, false), len, std::move(iov)});
+    }
+    std::vector<future<size_t>> results;
+    results.reserve(parts.size());
+    for (auto&& part : parts) {
+        auto part_pos = part.req.as<internal::io_request::operation::readv>().pos;
+        auto slba = part_pos >> _lba_shift;
+        auto nlb = uint32_t((part.size >> _lba_shift) - 1);
+        auto req = internal::io_request::make_nvme_cmd(_fd, _nsid, opcode, uint32_t(slba), uint32_t(slba >> 32), nlb, part.iovecs);
+        results.push_back(submit_nvme_io(opcode, part_pos, part.size, std::move(req), pc, intent, std::move(part.iovecs)));
+    }
+    return when_all_succeed(results.begin(), results.end()).then([] (std::vector<size_t> lens) {
+        return std::accumulate(lens.begin(), lens.end(), size_t(0));
+    });
+  } catch (...) {
+    return current_exception_as_future<size_t>();
+  }
+}
+
+future<size_t>
+nvme_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_nvme_io(nvme::cmd_write, pos, const_cast<void*>(buffer), len, pc, intent);
+}
+
+future<size_t>
+nvme_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_nvme_io(nvme::cmd_write, pos, std::move(iov), pc, intent);
+}
+
+future<size_t>
+nvme_file_impl::read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_nvme_io(nvme::cmd_read, pos, buffer, len, pc, intent);
+}
+
+future<size_t>
+nvme_file_impl::read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_nvme_io(nvme::cmd_read, pos, std::move(iov), pc, intent);
+}
+
+future<temporary_buffer<uint8_t>>
+nvme_file_impl::dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+  try {
+    auto block_size = size_t(1) << _lba_shift;
+    auto front = offset & (block_size - 1);
+    offset -= front;
+    range_size += front;
+    auto buf = engine().allocate_dma_buffer<uint8_t>(_memory_dma_alignment, align_up(range_size, block_size));
+    auto addr = buf.get_write();
+    auto size = buf.size();
+    return do_nvme_io(nvme::cmd_read, offset, addr, size, pc, intent).then([buf = std::move(buf), front, range_size] (size_t len) mutable {
+        buf.trim(std::min(len, range_size));
+        buf.trim_front(std::min<size_t>(front, buf.size()));
+        return std::move(buf);
+    });
+  } catch (...) {
+    return current_exception_as_future<temporary_buffer<uint8_t>>();
+  }
+}
+
+// The char device can't be synced, the namespace is flushed instead
+future<>
+nvme_file_impl::flush() noexcept {
+    auto req = internal::io_request::make_nvme_cmd(_fd, _nsid, nvme::cmd_flush, 0, 0, 0, nullptr, 0);
+    return submit_nvme_io(nvme::cmd_flush, 0, 0, std::move(req), internal::maybe_priority_class_ref{}, nullptr).discard_result();
+}
+
+future<>
+nvme_file_impl::truncate(uint64_t length) noexcept {
+    return make_ready_future<>();
+}
+
+future<>
+nvme_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
+  try {
+    auto mask = (uint64_t(1) << _lba_shift) - 1;
+    if ((offset & mask) || (length & mask) || offset + length > (_nr_blocks << _lba_shift)) {
+        throw std::system_error(EINVAL, std::system_category(), "NVMe discard is not aligned to the logical block size or out of range");
+    }
+    auto slba = offset >> _lba_shift;
+    auto nr_blocks = length >> _lba_shift;
+    if (nr_blocks == 0) {
+        return make_ready_future<>();
+    }
+    // A range covers up to 2^32 - 1 blocks, a command up to 256 ranges;
+    // larger discards take several commands
+    constexpr uint64_t max_range_blocks = std::numeric_limits<uint32_t>::max();
+    auto nr_ranges = (nr_blocks + max_range_blocks - 1) / max_range_blocks;
+    auto ranges = std::make_unique<nvme::dsm_range[]>(nr_ranges);
+    for (uint64_t i = 0; i < nr_ranges; i++) {
+        auto nlb = std::min(nr_blocks - i * max_range_blocks, max_range_blocks);
+        ranges[i] = nvme::dsm_range{
+            .cattr = 0,
+            .nlb = cpu_to_le(uint32_t(nlb)),
+            .slba = cpu_to_le(slba + i * max_range_blocks),
+        };
+    }
+    std::vector<future<size_t>> results;
+    for (uint64_t i = 0; i < nr_ranges; i += nvme::dsm_max_ranges) {
+        auto n = std::min<uint64_t>(nr_ranges - i, nvme::dsm_max_ranges);
+        // The ranges are the command's data, but don't count as bytes
+        // transferred for the io_queue
+        auto req = internal::io_request::make_nvme_cmd(_fd, _nsid, nvme::cmd_dsm, uint32_t(n - 1), nvme::dsm_attr_deallocate, 0, &ranges[i], n * sizeof(nvme::dsm_range));
+        results.push_back(submit_nvme_io(nvme::cmd_dsm, 0, 0, std::move(req), internal::maybe_priority_class_ref{}, nullptr));
+    }
+    return when_all_succeed(results.begin(), results.end()).discard_result().finally([ranges = std::move(ranges)] {});
+  } catch (...) {
+    return current_exception_as_future<>();
+  }
+}
+
+future<>
+nvme_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
+    // nothing to do for block device
+    return make_ready_future<>();
+}
+
+future<uint64_t>
+nvme_file_impl::size() noexcept {
+    return make_ready_future<uint64_t>(_nr_blocks << _lba_shift);
+}
+
+std::unique_ptr<seastar::file_handle_impl>
+nvme_file_impl::dup() {
+    throw std::runtime_error("NVMe passthrough files cannot be shared with other shards");
+}
+
+#endif
+
 append_challenged_posix_file_impl::append_challenged_posix_file_impl(int fd, open_flags f, file_open_options options, const internal::fs_info& fsi, dev_t device_id)
         : posix_file_impl(fd, f, options, device_id, fsi)
         , _max_size_changing_ops(fsi.append_concurrency)
@@ -1054,8 +1464,78 @@ xfs_concurrency_from_kernel_version() {
     return 0;
 }
 
+#ifdef SEASTAR_HAVE_NVME_PASSTHROUGH
+
+// The block device of the namespace of an NVMe generic char device (nvmeXnY
+// for ngXnY), which selects the io_queue the file's commands go through
+static dev_t nvme_block_device(dev_t char_dev) {
+    namespace fs = std::filesystem;
+    try {
+        auto name = fs::canonical(fmt::format("/sys/dev/char/{}:{}", major(char_dev), minor(char_dev))).filename().native();
+        if (name.starts_with("ng")) {
+            std::ifstream dev(fmt::format("/sys/block/nvme{}/dev", name.substr(2)));
+            unsigned maj, min;
+            char colon;
+            if (dev >> maj >> colon >> min) {
+                return makedev(maj, min);
+            }
+        }
+    } catch (...) {
+        // No sysfs, or not an NVMe device; the default io_queue will do
+    }
+    return char_dev;
+}
+
+// Returns nullptr if fd is not an NVMe generic char device
+static shared_ptr<file_impl> make_nvme_file_impl(int fd, file_open_options options, int flags, const struct stat& st) {
+    int nsid = ::ioctl(fd, NVME_IOCTL_ID);
+    if (nsid <= 0) {
+        return nullptr;
+    }
+    constexpr size_t identify_size = 4096;
+    auto id = std::make_unique<char[]>(identify_size);
+    ::nvme_admin_cmd cmd = {};
+    cmd.opcode = nvme::admin_identify;
+    cmd.nsid = nsid;
+    cmd.addr = reinterpret_cast<uintptr_t>(id.get());
+    cmd.data_len = identify_size;
+    cmd.cdw10 = 0; // CNS 0: the namespace data structure
+    auto ret = ::ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
+    if (ret < 0) {
+        throw std::system_error(errno, std::system_category(), "NVMe identify namespace failed");
+    }
+    nvme::check_status(ret, 0);
+    auto nsze = read_le<uint64_t>(id.get());
+    uint8_t flbas = id[26];
+    unsigned format = (flbas & 0xf) | (((flbas >> 5) & 0x3) << 4);
+    auto lbaf = read_le<uint32_t>(id.get() + 128 + 4 * format);
+    auto metadata_size = lbaf & 0xffff;
+    auto lba_shift = (lbaf >> 16) & 0xff;
+    if (metadata_size != 0 && (flbas & 0x10)) {
+        throw std::runtime_error("NVMe namespaces with metadata in extended LBAs are not supported");
+    }
+    if (lba_shift < 9) {
+        throw std::runtime_error(fmt::format("Unexpected NVMe logical block size 2^{}", lba_shift));
+    }
+    return make_shared<nvme_file_impl>(fd, open_flags(flags), std::move(options), nvme_block_device(st.st_rdev), nsid, lba_shift, nsze);
+}
+
+#endif
+
 future<shared_ptr<file_impl>>
 make_file_impl(int fd, file_open_options options, int flags, struct stat st) noexcept {
+#ifdef SEASTAR_HAVE_NVME_PASSTHROUGH
+    if (S_ISCHR(st.st_mode) && engine().supports_nvme_passthrough()) {
+        try {
+            if (auto impl = make_nvme_file_impl(fd, options, flags, st)) {
+                return make_ready_future<shared_ptr<file_impl>>(std::move(impl));
+            }
+        } catch (...) {
+            return current_exception_as_future<shared_ptr<file_impl>>();
+        }
+    }
+#endif
+
     if (S_ISBLK(st.st_mode)) {
         size_t block_size;
         auto ret = ::ioctl(fd, BLKBSZGET, &block_size);
@@ -1163,6 +1643,27 @@ file::list_directory(std::function<future<>(directory_entry de)> next) {
     return _file_impl->list_directory(std::move(next));
 }
 
+coroutine::experimental::generator<dma_read_result>
+file::dma_read_many(std::span<const dma_read_request> reqs, io_intent* intent) {
+    // Shared with the reads, which may outlive the generator if it is
+    // not consumed to the end. The queue is large enough for pushes never
+    // to wait.
+    auto done = make_lw_shared<queue<dma_read_result>>(std::max<size_t>(reqs.size(), 1));
+    for (size_t i = 0; i < reqs.size(); i++) {
+        auto& r = reqs[i];
+        (void)dma_read(r.pos, static_cast<char*>(r.buffer), r.len, intent).then_wrapped([done, i] (future<size_t> f) {
+            if (f.failed()) {
+                done->push(dma_read_result{i, 0, f.get_exception()});
+            } else {
+                done->push(dma_read_result{i, f.get(), nullptr});
+            }
+        });
+    }
+    for (size_t n = 0; n < reqs.size(); n++) {
+        co_yield co_await done->pop_eventually();
+    }
+}
+
 coroutine::experimental::generator<directory_entry> file::experimental_list_directory() {
     return _file_impl->experimental_list_directory();
 }
@@ -1183,6 +1684,15 @@ future<int> file::fcntl_short(int op, uintptr_t arg) noexcept {
     return _file_impl->fcntl_short(op, arg);
 }
 
+future<file_mapping> file::map_readonly(uint64_t offset, size_t length) noexcept {
+    return _file_impl->map_readonly(offset, length);
+}
+
+future<file_mapping> file::map_readonly() noexcept {
+    // The mapped range is cut short at the end of the file
+    return _file_impl->map_readonly(0, std::numeric_limits<size_t>::max());
+}
+
 future<> file::set_lifetime_hint_impl(int op, uint64_t hint) noexcept {
     return do_with(hint, [op, this] (uint64_t& arg) {
         try {
@@ -1410,6 +1920,10 @@ future<int> file_impl::fcntl_short(int op, uintptr_t arg) noexcept {
     return make_exception_future<int>(std::runtime_error("this file type does not support fcntl_short"));
 }
 
+future<file_mapping> file_impl::map_readonly(uint64_t offset, size_t length) noexcept {
+    return make_exception_future<file_mapping>(std::runtime_error("this file type does not support memory mapping"));
+}
+
 future<file> open_file_dma(std::string_view name, open_flags flags) noexcept {
     return engine().open_file_dma(name, flags, file_open_options());
 }
@@ -23,19 +23,32 @@
 
 module;
 
+#include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <cstdint>
+#include <functional>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <sys/inotify.h>
+#include <unistd.h>
 
 module seastar;
 
 #else
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <unistd.h>
 #include <seastar/core/internal/pollable_fd.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/fsnotify.hh>
+#include <seastar/core/sleep.hh>
 #endif
 
 namespace seastar::experimental {
@@ -52,6 +65,11 @@ class fsnotifier::impl : public enable_shared_from_this<impl> {
     };
     my_poll_fd _fd;
     watch_token _close_dummy = -1;
+
+    class batch;
+    // Calls func with each event read in [p, e), but that of the shutdown
+    template <typename Func>
+    void parse(const char* p, const char* e, Func func);
 public:
     impl()
         : _fd(file_desc::inotify_init(IN_NONBLOCK | IN_CLOEXEC))
@@ -59,6 +77,7 @@ class fsnotifier::impl : public enable_shared_from_this<impl> {
     void remove_watch(watch_token);
     future<watch_token> create_watch(const sstring& path, flags events);
     future<std::vector<event>> wait();
+    future<std::vector<event>> wait(const batch_options& opts);
     void shutdown();
     bool active() const {
         return bool(_fd);
@@ -80,30 +99,117 @@ future<fsnotifier::watch_token> fsnotifier::impl::create_watch(const sstring& pa
     return engine().inotify_add_watch(_fd, path, uint32_t(events));
 }
 
+template <typename Func>
+void fsnotifier::impl::parse(const char* p, const char* e, Func func) {
+    while (p < e) {
+        auto ev = reinterpret_cast<const ::inotify_event*>(p);
+        if (ev->wd == _close_dummy && _close_dummy != -1) {
+            _fd.close();
+        } else {
+            func(*ev);
+        }
+        p += sizeof(::inotify_event) + ev->len;
+    }
+}
+
 future<std::vector<fsnotifier::event>> fsnotifier::impl::wait() {
     // be paranoid about buffer alignment
     auto buf = temporary_buffer<char>::aligned(std::max(alignof(::inotify_event), alignof(int64_t)), 4096);
     auto f = _fd.read_some(buf.get_write(), buf.size());
     return f.then([me = shared_from_this(), buf = std::move(buf)](size_t n) {
-        auto p = buf.get();
-        auto e = buf.get() + n;
-
         std::vector<event> events;
 
-        while (p < e) {
-            auto ev = reinterpret_cast<const ::inotify_event*>(p);
-            if (ev->wd == me->_close_dummy && me->_close_dummy != -1) {
-                me->_fd.close();                
-            } else {
-                events.emplace_back(event {
-                    ev->wd, flags(ev->mask), ev->cookie,
-                    ev->len != 0 ? sstring(ev->name) : sstring{}
-                });
+        me->parse(buf.get(), buf.get() + n, [&] (const ::inotify_event& ev) {
+            events.emplace_back(event {
+                ev.wd, flags(ev.mask), ev.cookie,
+                ev.len != 0 ? sstring(ev.name) : sstring{}
+            });
+        });
+
+        return events;
+    });
+}
+
+// The events of a batched wait, with the coalescable ones merged
+class fsnotifier::impl::batch {
+    // The events that only tell what happened to the contents or the
+    // metadata of a file, and not to the file itself
+    static constexpr uint32_t coalescable = IN_ACCESS | IN_ATTRIB | IN_MODIFY | IN_OPEN | IN_CLOSE;
+
+    uint32_t _mask;
+    std::vector<event> _events;
+    // The last coalescable event of each file in _events, by the hash of
+    // its watch and name
+    std::unordered_multimap<size_t, size_t> _last;
+
+    static size_t hash(watch_token wd, std::string_view name) noexcept {
+        return std::hash<std::string_view>()(name) ^ (size_t(uint32_t(wd)) * 0x9e3779b97f4a7c15);
+    }
+public:
+    explicit batch(flags mask) noexcept : _mask(uint32_t(mask) | IN_IGNORED | IN_Q_OVERFLOW) {}
+
+    void add(const ::inotify_event& ev) {
+        // The name is padded with NULs
+        auto name = ev.len ? std::string_view(ev.name) : std::string_view();
+        auto h = hash(ev.wd, name);
+        auto [b, e] = _last.equal_range(h);
+        auto last = std::find_if(b, e, [&] (const auto& x) {
+            return _events[x.second].id == ev.wd && _events[x.second].name == name;
+        });
+        bool wanted = ev.mask & _mask;
+        if (!(ev.mask & ~coalescable)) {
+            if (!wanted) {
+                return;
             }
-            p += sizeof(::inotify_event) + ev->len;
+            if (last != e) {
+                _events[last->second].mask |= flags(ev.mask);
+                return;
+            }
+            _last.emplace(h, _events.size());
+        } else if (last != e) {
+            // What comes after can't be merged into what came before
+            _last.erase(last);
+        }
+        if (wanted) {
+            _events.emplace_back(event{ev.wd, flags(ev.mask), ev.cookie, sstring(name)});
         }
+    }
 
-        return events;
+    bool empty() const noexcept {
+        return _events.empty();
+    }
+
+    std::vector<event> release() noexcept {
+        return std::move(_events);
+    }
+};
+
+future<std::vector<fsnotifier::event>> fsnotifier::impl::wait(const batch_options& opts) {
+    // Room for at least an event with the longest name
+    auto size = std::max(opts.buffer_size, sizeof(::inotify_event) + NAME_MAX + 1);
+    auto buf = temporary_buffer<char>::aligned(std::max(alignof(::inotify_event), alignof(int64_t)), size);
+    auto f = _fd.read_some(buf.get_write(), buf.size());
+    return f.then([me = shared_from_this(), buf = std::move(buf), opts] (size_t n) mutable {
+        auto b = std::make_unique<batch>(opts.mask);
+        me->parse(buf.get(), buf.get() + n, [&] (const ::inotify_event& ev) { b->add(ev); });
+        if (b->empty() && me->active()) {
+            return me->wait(opts);
+        }
+        if (opts.window == std::chrono::milliseconds(0) || !me->active()) {
+            return make_ready_future<std::vector<event>>(b->release());
+        }
+        return sleep(opts.window).then([me = std::move(me), buf = std::move(buf), b = std::move(b)] () mutable {
+            // Take what came meanwhile, without waiting for more: the
+            // descriptor is non-blocking
+            while (me->active()) {
+                auto n = ::read(me->_fd, buf.get_write(), buf.size());
+                if (n <= 0) {
+                    break;
+                }
+                me->parse(buf.get(), buf.get() + n, [&] (const ::inotify_event& ev) { b->add(ev); });
+            }
+            return b->release();
+        });
     });
 }
 
@@ -158,6 +264,10 @@ future<std::vector<fsnotifier::event>> fsnotifier::wait() const {
     return _impl->wait();
 }
 
+future<std::vector<fsnotifier::event>> fsnotifier::wait(const batch_options& opts) const {
+    return _impl->wait(opts);
+}
+
 void fsnotifier::shutdown() {
     _impl->shutdown();
 }
@@ -28,6 +28,8 @@ module;
 #include <malloc.h>
 #include <string.h>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <ratio>
 #include <optional>
 #include <utility>
@@ -42,6 +44,7 @@ module seastar;
 #include <seastar/core/reactor.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/memory.hh>
 #endif
 
 namespace seastar {
@@ -72,6 +75,21 @@ static inline T select_buffer_size(T configured_value, T maximum_value) noexcept
     }
 }
 
+// Memory held by the buffers of adaptive read-ahead streams of the shard
+struct read_ahead_memory {
+    size_t budget = memory::stats().total_memory() / 32;
+    size_t used = 0;
+};
+
+static read_ahead_memory& shard_read_ahead_memory() noexcept {
+    static thread_local read_ahead_memory mem;
+    return mem;
+}
+
+void set_read_ahead_memory_budget(size_t bytes) noexcept {
+    shard_read_ahead_memory().budget = bytes;
+}
+
 #if SEASTAR_API_LEVEL >= 7
 template <typename Options>
 inline internal::maybe_priority_class_ref get_io_priority(const Options& opts) {
@@ -89,10 +107,19 @@ class file_data_source_impl : public data_source_impl {
         uint64_t _pos;
         uint64_t _size;
         future<temporary_buffer<char>> _ready;
-
-        issued_read(uint64_t pos, uint64_t size, future<temporary_buffer<char>> f)
-            : _pos(pos), _size(size), _ready(std::move(f)) { }
+        // Bytes accounted against the shard's read-ahead memory budget
+        size_t _reserved;
+
+        issued_read(uint64_t pos, uint64_t size, future<temporary_buffer<char>> f, size_t reserved = 0)
+            : _pos(pos), _size(size), _ready(std::move(f)), _reserved(reserved) { }
+        issued_read(issued_read&& o) noexcept
+            : _pos(o._pos), _size(o._size), _ready(std::move(o._ready)), _reserved(std::exchange(o._reserved, 0)) { }
+        ~issued_read() {
+            shard_read_ahead_memory().used -= _reserved;
+        }
     };
+    using clock_type = std::chrono::steady_clock;
+    static constexpr unsigned max_adaptive_read_ahead = 64;
 
     reactor& _reactor = engine();
     file _file;
@@ -108,7 +135,49 @@ class file_data_source_impl : public data_source_impl {
     bool _in_slow_start = false;
     io_intent _intent;
     using unused_ratio_target = std::ratio<25, 100>;
+    // Adaptive read-ahead state: moving averages of the consumption rate
+    // (bytes/s) and of the read latency (s)
+    double _consumption_rate = 0;
+    double _read_latency = 0;
+    clock_type::time_point _last_get;
+    uint64_t _last_consumed = 0;
 private:
+    unsigned max_read_ahead() const noexcept {
+        if (!_options.adaptive_read_ahead) {
+            return _options.read_ahead;
+        }
+        return _options.read_ahead ? _options.read_ahead : max_adaptive_read_ahead;
+    }
+
+    static void update_average(double& avg, double sample) noexcept {
+        avg = avg ? avg * 0.75 + sample * 0.25 : sample;
+    }
+
+    // Grows the read-ahead when the consumer has to wait for a buffer, and
+    // otherwise keeps it at what covers the read latency at the consumption
+    // rate (Little's law), shrinking towards that slowly.
+    void adapt_read_ahead(bool consumer_waits) {
+        auto now = clock_type::now();
+        if (_last_get != clock_type::time_point{}) {
+            auto interval = std::chrono::duration<double>(now - _last_get).count();
+            if (interval > 0) {
+                update_average(_consumption_rate, _last_consumed / interval);
+            }
+        }
+        _last_get = now;
+        if (consumer_waits) {
+            _current_read_ahead = std::min(_current_read_ahead + 1, max_read_ahead());
+            return;
+        }
+        auto wanted = unsigned(std::min(std::ceil(_consumption_rate * _read_latency / _current_buffer_size), double(max_read_ahead())));
+        wanted = std::max(wanted, 1u);
+        if (wanted > _current_read_ahead) {
+            _current_read_ahead = wanted;
+        } else if (wanted < _current_read_ahead) {
+            _current_read_ahead--;
+        }
+    }
+
     size_t minimal_buffer_size() const {
         return std::min(std::max(_options.buffer_size / 4, size_t(8192)), _options.buffer_size);
     }
@@ -126,6 +195,9 @@ class file_data_source_impl : public data_source_impl {
         }
     }
     unsigned get_initial_read_ahead() const {
+        if (_options.adaptive_read_ahead) {
+            return 1;
+        }
         return _options.dynamic_adjustments
                ? std::min(_options.dynamic_adjustments->read_ahead, _options.read_ahead)
                : !!_options.read_ahead;
@@ -230,12 +302,16 @@ class file_data_source_impl : public data_source_impl {
         assert(_reads_in_progress == 0);
     }
     virtual future<temporary_buffer<char>> get() override {
-        if (!_read_buffers.empty() && !_read_buffers.front()._ready.available()) {
+        bool waits = !_read_buffers.empty() && !_read_buffers.front()._ready.available();
+        if (_options.adaptive_read_ahead) {
+            adapt_read_ahead(waits);
+        } else if (waits) {
             try_increase_read_ahead();
         }
         issue_read_aheads(1);
         auto ret = std::move(_read_buffers.front());
         _read_buffers.pop_front();
+        _last_consumed = ret._size;
         update_history_consumed(ret._size);
         _reactor._io_stats.fstream_reads += 1;
         _reactor._io_stats.fstream_read_bytes += ret._size;
@@ -308,7 +384,6 @@ class file_data_source_impl : public data_source_impl {
                 _read_buffers.emplace_back(_pos, 0, make_ready_future<temporary_buffer<char>>());
                 continue;
             }
-            ++_reads_in_progress;
             // if _pos is not dma-aligned, we'll get a short read.  Account for that.
             // Also avoid reading beyond _remain.
             uint64_t align = _file.disk_read_dma_alignment();
@@ -316,11 +391,24 @@ class file_data_source_impl : public data_source_impl {
             auto end = std::min(align_up(start + _current_buffer_size, align), _pos + _remain);
             auto len = end - start;
             auto actual_size = std::min(end - _pos, _remain);
+            size_t reserved = 0;
+            if (_options.adaptive_read_ahead) {
+                auto& mem = shard_read_ahead_memory();
+                if (_read_buffers.size() >= additional && mem.used + len > mem.budget) {
+                    return;
+                }
+                mem.used += len;
+                reserved = len;
+            }
+            ++_reads_in_progress;
             _read_buffers.emplace_back(_pos, actual_size, futurize_invoke([&] {
                     return _file.dma_read_bulk_impl(start, len, get_io_priority(_options), &_intent);
             }).then_wrapped(
-                    [this, start, pos = _pos, remain = _remain] (future<temporary_buffer<uint8_t>> ret) {
+                    [this, start, pos = _pos, remain = _remain, issued = clock_type::now()] (future<temporary_buffer<uint8_t>> ret) {
                 --_reads_in_progress;
+                if (_options.adaptive_read_ahead) {
+                    update_average(_read_latency, std::chrono::duration<double>(clock_type::now() - issued).count());
+                }
                 if (_done && !_reads_in_progress) {
                     _done->set_value();
                 }
@@ -342,7 +430,7 @@ class file_data_source_impl : public data_source_impl {
                     }
                     return make_ready_future<temporary_buffer<char>>(temporary_buffer<char>(reinterpret_cast<char*>(tmp.get_write()), tmp.size(), tmp.release()));
                 }
-            }));
+            }), reserved);
             _remain -= end - _pos;
             _pos = end;
         };
@@ -388,7 +476,7 @@ class file_data_sink_impl : public data_sink_impl {
     }
     future<> put(net::packet data) override { abort(); }
     virtual temporary_buffer<char> allocate_buffer(size_t size) override {
-        return temporary_buffer<char>::aligned(_file.memory_dma_alignment(), size);
+        return engine().allocate_dma_buffer<char>(_file.memory_dma_alignment(), size);
     }
     using data_sink_impl::put;
     virtual future<> put(temporary_buffer<char> buf) override {
@@ -527,6 +615,60 @@ future<output_stream<char>> make_file_output_stream(file f, file_output_stream_o
     });
 }
 
+// Chunk size used when a file range has to be read into memory on its way to a sink
+static constexpr size_t put_file_chunk_size = 128 * 1024;
+
+future<> data_sink_impl::put_file(file f, uint64_t offset, size_t len) {
+    return do_with(std::move(f), offset, len, [this] (file& f, uint64_t& pos, size_t& left) {
+        return repeat([this, &f, &pos, &left] {
+            if (!left) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            // Reads go through the io_queue of the current scheduling group
+            return f.dma_read<char>(pos, std::min(left, put_file_chunk_size)).then([this, &pos, &left] (temporary_buffer<char> buf) {
+                if (buf.empty()) {
+                    return make_exception_future<stop_iteration>(std::runtime_error(
+                            format("put_file: unexpected end of file at offset {}, {} bytes short", pos, left)));
+                }
+                pos += buf.size();
+                left -= buf.size();
+                return put(std::move(buf)).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    });
+}
+
+future<> data_sink::put_file(file f, uint64_t offset, size_t len) noexcept {
+    try {
+        return _dsi->put_file(std::move(f), offset, len);
+    } catch (...) {
+        return current_exception_as_future();
+    }
+}
+
+template <>
+future<> output_stream<char>::write_from_file(file f, uint64_t offset, size_t len) noexcept {
+    // if flush is scheduled, disable it, so it will not try to write in parallel
+    _flush = false;
+    auto flushed = _flushing ? _in_batch.value().get_future() : make_ready_future<>();
+    return flushed.then([this, f = std::move(f), offset, len] () mutable {
+        // Buffered data goes out ahead of the file contents
+        auto buffered = make_ready_future<>();
+        if (_end) {
+            _buf.trim(_end);
+            _end = 0;
+            buffered = _fd.put(std::move(_buf));
+        } else if (_zc_bufs) {
+            buffered = _fd.put(std::move(_zc_bufs));
+        }
+        return buffered.then([this, f = std::move(f), offset, len] () mutable {
+            return _fd.put_file(std::move(f), offset, len);
+        });
+    });
+}
+
 /*
  * template initialization, definition in iostream-impl.hh
  */
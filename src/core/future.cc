@@ -29,6 +29,7 @@ module;
 module seastar;
 #else
 #include <seastar/core/future.hh>
+#include <seastar/core/internal/coroutine_frame_pool.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/report_exception.hh>
@@ -59,6 +60,8 @@ namespace internal {
 
 static_assert(std::is_empty_v<uninitialized_wrapper<std::tuple<>>>, "This should still be empty");
 
+thread_local constinit coroutine_frame_pool this_thread_coroutine_frame_pool;
+
 void promise_base::move_it(promise_base&& x) noexcept {
     // Don't use std::exchange to make sure x's values are nulled even
     // if &x == this.
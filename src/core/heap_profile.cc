@@ -0,0 +1,308 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <array>
+#include <chrono>
+#include <climits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/heap_profile.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/util/backtrace.hh>
+#endif
+
+#include "core/proto_writer.hh"
+#include "core/symbolizer.hh"
+#include "core/thread_pool.hh"
+
+namespace seastar {
+
+namespace internal {
+
+class heap_profiler {
+public:
+    // Runs func on the syscall thread
+    template <typename T, typename Func>
+    static future<T> off_reactor(Func func) noexcept {
+        return engine()._thread_pool->submit<T>(std::move(func));
+    }
+};
+
+}
+
+namespace heap_profile {
+
+using internal::heap_profiler;
+using internal::proto_writer;
+
+struct shard_profile {
+    std::vector<memory::allocation_site> live;
+    std::vector<memory::allocation_site> cumulative;
+};
+
+static future<std::vector<shard_profile>> gather(bool reset) {
+    std::vector<shard_profile> profiles(smp::count);
+    return do_with(std::move(profiles), [reset] (std::vector<shard_profile>& profiles) {
+        return smp::invoke_on_all([&profiles, reset] {
+            auto& profile = profiles[this_shard_id()];
+            profile.live = memory::sampled_memory_profile();
+            profile.cumulative = memory::sampled_cumulative_memory_profile();
+            if (reset) {
+                memory::reset_cumulative_memory_profile();
+            }
+        }).then([&profiles] {
+            return std::move(profiles);
+        });
+    });
+}
+
+// The fields of the messages of pprof, from its profile.proto
+namespace field {
+// Profile
+constexpr uint32_t sample_type = 1;
+constexpr uint32_t sample = 2;
+constexpr uint32_t mapping = 3;
+constexpr uint32_t location = 4;
+constexpr uint32_t function = 5;
+constexpr uint32_t string_table = 6;
+constexpr uint32_t time_nanos = 9;
+constexpr uint32_t period_type = 11;
+constexpr uint32_t period = 12;
+constexpr uint32_t default_sample_type = 14;
+// ValueType
+constexpr uint32_t type = 1;
+constexpr uint32_t unit = 2;
+// Sample
+constexpr uint32_t location_id = 1;
+constexpr uint32_t value = 2;
+// Mapping, Location and Function
+constexpr uint32_t id = 1;
+// Mapping
+constexpr uint32_t memory_start = 2;
+constexpr uint32_t memory_limit = 3;
+constexpr uint32_t filename = 5;
+// Location
+constexpr uint32_t mapping_id = 2;
+constexpr uint32_t address = 3;
+constexpr uint32_t line = 4;
+// Line
+constexpr uint32_t function_id = 1;
+// Function
+constexpr uint32_t name = 2;
+constexpr uint32_t system_name = 3;
+}
+
+struct backtrace_hash {
+    size_t operator()(const simple_backtrace& b) const noexcept {
+        return b.hash();
+    }
+};
+
+// Encodes a Profile, the strings of which are indexes in its table
+class profile_writer {
+    std::string _out;
+    proto_writer _w{_out};
+    std::unordered_map<std::string, uint64_t> _strings;
+    std::vector<std::string_view> _string_table;
+    std::unordered_map<const shared_object*, uint64_t> _mappings;
+    std::unordered_map<uintptr_t, uint64_t> _locations;
+    std::unordered_map<std::string, uint64_t> _functions;
+    std::string _self;
+
+    uint64_t string(std::string s) {
+        auto [i, inserted] = _strings.emplace(std::move(s), _string_table.size());
+        if (inserted) {
+            _string_table.push_back(i->first);
+        }
+        return i->second;
+    }
+    void value_type(uint32_t f, std::string type, std::string unit) {
+        auto m = _w.begin(f);
+        _w.uint_field(field::type, string(std::move(type)));
+        _w.uint_field(field::unit, string(std::move(unit)));
+        _w.end(m);
+    }
+    uint64_t mapping(const shared_object* so) {
+        auto [i, inserted] = _mappings.emplace(so, _mappings.size() + 1);
+        if (inserted) {
+            auto m = _w.begin(field::mapping);
+            _w.uint_field(field::id, i->second);
+            _w.uint_field(field::memory_start, so->begin);
+            _w.uint_field(field::memory_limit, so->end);
+            // The executable is the object without a name
+            _w.uint_field(field::filename, string(so->name.empty() ? _self : std::string(so->name)));
+            _w.end(m);
+        }
+        return i->second;
+    }
+    uint64_t function(std::string name) {
+        auto [i, inserted] = _functions.emplace(std::move(name), _functions.size() + 1);
+        if (inserted) {
+            auto name = string(i->first);
+            auto m = _w.begin(field::function);
+            _w.uint_field(field::id, i->second);
+            _w.uint_field(field::name, name);
+            _w.uint_field(field::system_name, name);
+            _w.end(m);
+        }
+        return i->second;
+    }
+    uint64_t location(frame f) {
+        auto addr = f.so->begin + f.addr;
+        auto [i, inserted] = _locations.emplace(addr, _locations.size() + 1);
+        if (inserted) {
+            auto mapping_id = mapping(f.so);
+            auto symbol = internal::symbolizer::dynamic_symbol(addr);
+            auto function_id = symbol ? function(std::move(*symbol)) : 0;
+            auto m = _w.begin(field::location);
+            _w.uint_field(field::id, i->second);
+            _w.uint_field(field::mapping_id, mapping_id);
+            _w.uint_field(field::address, addr);
+            if (function_id) {
+                auto l = _w.begin(field::line);
+                _w.uint_field(field::function_id, function_id);
+                _w.end(l);
+            }
+            _w.end(m);
+        }
+        return i->second;
+    }
+public:
+    profile_writer() {
+        // The first string of the table is the empty one
+        string("");
+        char self[PATH_MAX];
+        auto n = ::readlink("/proc/self/exe", self, sizeof(self));
+        _self = n > 0 ? std::string(self, n) : std::string();
+    }
+
+    std::string write(const std::vector<shard_profile>& profiles, size_t rate) {
+        // alloc_objects, alloc_space, inuse_objects and inuse_space
+        std::unordered_map<simple_backtrace, std::array<uint64_t, 4>, backtrace_hash> samples;
+        for (auto& profile : profiles) {
+            for (auto& site : profile.cumulative) {
+                auto& v = samples[site.backtrace];
+                v[0] += site.count;
+                v[1] += site.size;
+            }
+            for (auto& site : profile.live) {
+                auto& v = samples[site.backtrace];
+                v[2] += site.count;
+                v[3] += site.size;
+            }
+        }
+        value_type(field::sample_type, "alloc_objects", "count");
+        value_type(field::sample_type, "alloc_space", "bytes");
+        value_type(field::sample_type, "inuse_objects", "count");
+        value_type(field::sample_type, "inuse_space", "bytes");
+        std::vector<uint64_t> ids;
+        for (auto& [backtrace, values] : samples) {
+            ids.clear();
+            for (auto& f : backtrace.frames()) {
+                ids.push_back(location(f));
+            }
+            auto s = _w.begin(field::sample);
+            auto p = _w.begin(field::location_id);
+            for (auto id : ids) {
+                _w.varint(id);
+            }
+            _w.end(p);
+            p = _w.begin(field::value);
+            for (auto v : values) {
+                _w.varint(v);
+            }
+            _w.end(p);
+            _w.end(s);
+        }
+        value_type(field::period_type, "space", "bytes");
+        _w.uint_field(field::period, rate);
+        _w.uint_field(field::default_sample_type, string("inuse_space"));
+        _w.uint_field(field::time_nanos, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        for (auto s : _string_table) {
+            _w.string_field(field::string_table, s);
+        }
+        return std::move(_out);
+    }
+};
+
+future<sstring> collect(bool reset) {
+    auto rate = memory::get_heap_profiling_sample_rate();
+    return gather(reset).then([rate] (std::vector<shard_profile> profiles) {
+        return do_with(std::move(profiles), [rate] (const std::vector<shard_profile>& profiles) {
+            return heap_profiler::off_reactor<std::string>([&profiles, rate] {
+                return profile_writer().write(profiles, rate);
+            }).then([] (std::string profile) {
+                return sstring(profile);
+            });
+        });
+    });
+}
+
+future<> set_sampling_rate(size_t rate) {
+    return smp::invoke_on_all([rate] {
+        memory::set_heap_profiling_sampling_rate(rate);
+    });
+}
+
+future<> add_routes(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new httpd::function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+        return collect(req->get_query_param("reset") == "true").then([rep = std::move(rep)] (sstring profile) mutable {
+            rep->_content = std::move(profile);
+            return std::move(rep);
+        });
+    }, "bin"));
+    server._routes.put(httpd::GET, path + "/sampling_rate", new httpd::function_handler([] (const http::request&) {
+        return to_sstring(memory::get_heap_profiling_sample_rate());
+    }, "txt"));
+    server._routes.put(httpd::POST, path + "/sampling_rate", new httpd::function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+        size_t rate;
+        try {
+            rate = boost::lexical_cast<size_t>(req->get_query_param("rate"));
+        } catch (const boost::bad_lexical_cast&) {
+            throw httpd::bad_param_exception("The rate parameter is not a number of bytes");
+        }
+        return set_sampling_rate(rate).then([rep = std::move(rep)] () mutable {
+            return std::move(rep);
+        });
+    }, "txt"));
+    return make_ready_future<>();
+}
+
+}
+
+}
@@ -44,13 +44,16 @@ module seastar;
 #include <seastar/core/fair_queue.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/io_trace.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/metrics_histogram.hh>
 #include <seastar/core/linux-aio.hh>
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/io_sink.hh>
 #include <seastar/core/io_priority_class.hh>
+#include <seastar/util/exception_ptr.hh>
 #include <seastar/util/log.hh>
 #endif
 
@@ -65,8 +68,10 @@ static constexpr auto io_direction_read = io_direction_and_length::read_idx;
 static constexpr auto io_direction_write = io_direction_and_length::write_idx;
 
 struct default_io_exception_factory {
-    static auto cancelled() {
-        return cancelled_error();
+    // Cancellation fails every request of an intent at once, so they all
+    // share one exception.
+    static std::exception_ptr cancelled() noexcept {
+        return cached_exception_ptr<cancelled_error>();
     }
 };
 
@@ -99,6 +104,7 @@ struct io_group::priority_class_data {
 class io_queue::priority_class_data {
     io_queue& _queue;
     const internal::priority_class _pc;
+    const sstring _name;
     uint32_t _shares;
     struct {
         size_t bytes = 0;
@@ -108,7 +114,7 @@ class io_queue::priority_class_data {
             ops++;
             bytes += len;
         }
-    } _rwstat[2] = {}, _splits = {};
+    } _rwstat[2] = {}, _splits = {}, _merges = {};
     uint32_t _nr_queued;
     uint32_t _nr_executing;
     std::chrono::duration<double> _queue_time;
@@ -116,6 +122,15 @@ class io_queue::priority_class_data {
     std::chrono::duration<double> _total_execution_time;
     std::chrono::duration<double> _starvation_time;
     io_queue::clock_type::time_point _activated;
+    // The latency of requests, in microseconds, split into the wait in the
+    // fair queue, the time from dispatch to submission to the kernel, and
+    // the time in the kernel and the disk, by direction
+    using latency_histogram = metrics::log_linear_histogram<16, 33554432, 4>;
+    struct {
+        latency_histogram queue;
+        latency_histogram submit;
+        latency_histogram device;
+    } _latency[2];
 
     io_group::priority_class_data& _group;
     size_t _replenish_head;
@@ -141,9 +156,10 @@ class io_queue::priority_class_data {
         io_log.debug("Updated {} class bandwidth to {}MB/s", _pc.id(), bandwidth >> 20);
     }
 
-    priority_class_data(internal::priority_class pc, uint32_t shares, io_queue& q, io_group::priority_class_data& pg)
+    priority_class_data(internal::priority_class pc, sstring name, uint32_t shares, io_queue& q, io_group::priority_class_data& pg)
         : _queue(q)
         , _pc(pc)
+        , _name(std::move(name))
         , _shares(shares)
         , _nr_queued(0)
         , _nr_executing(0)
@@ -204,31 +220,80 @@ class io_queue::priority_class_data {
         }
     }
 
+    // Records the phases of a completed request
+    void on_latency(io_direction_and_length dnl, io_queue::clock_type::duration queued,
+            io_queue::clock_type::duration submit, io_queue::clock_type::duration device) noexcept {
+        auto& l = _latency[dnl.rw_idx()];
+        l.queue.record(queued);
+        l.submit.record(submit);
+        l.device.record(device);
+    }
+
+    const sstring& name() const noexcept { return _name; }
+
     void on_split(io_direction_and_length dnl) noexcept {
         _splits.add(dnl.length());
     }
 
+    void on_merge(io_direction_and_length dnl) noexcept {
+        _merges.add(dnl.length());
+    }
+
+    // The last read queued in the class, if adjacent reads can still be
+    // merged into it
+    queued_io_request* last_read = nullptr;
+
     fair_queue::class_id fq_class() const noexcept { return _pc.id(); }
 
     std::vector<seastar::metrics::impl::metric_definition_impl> metrics();
     metrics::metric_groups metric_groups;
 };
 
-class io_desc_read_write final : public io_completion {
+class io_desc_read_write final : public io_completion, public internal::cancellable_queue::dispatched_link {
     io_queue& _ioq;
     io_queue::priority_class_data& _pclass;
     io_queue::clock_type::time_point _ts;
+    // The phases of the request: queued, dispatched (which _ts is set to),
+    // and submitted to the kernel
+    io_queue::clock_type::time_point _queued_at;
+    io_queue::clock_type::time_point _submitted_at;
     const stream_id _stream;
     const io_direction_and_length _dnl;
-    const fair_queue_entry::capacity_t _fq_capacity;
+    fair_queue_entry::capacity_t _fq_capacity;
     promise<size_t> _pr;
     iovec_keeper _iovs;
+    // Reads merged into this one, completed along with it
+    std::unique_ptr<io_desc_read_write> _merged;
+    io_desc_read_write* _merged_tail = this;
+    size_t _merged_length = 0;
+    unsigned _nr_merged = 0;
+    // The intent was cancelled after the request had been dispatched
+    bool _cancelled = false;
+
+    // Completes the merged reads, handing each one its part of what was read
+    static void complete_merged(std::unique_ptr<io_desc_read_write> desc, size_t res, std::chrono::duration<double> latency, io_queue::clock_type::time_point now) noexcept {
+        while (desc) {
+            auto next = std::move(desc->_merged);
+            auto len = std::min(res, desc->_dnl.length());
+            res -= len;
+            desc->_pclass.on_complete(latency);
+            desc->record_latency(now);
+            desc->_pr.set_value(len);
+            desc = std::move(next);
+        }
+    }
+
+    void record_latency(io_queue::clock_type::time_point now) noexcept {
+        auto submitted = std::max(_submitted_at, _ts);
+        _pclass.on_latency(_dnl, _ts - _queued_at, submitted - _ts, now - submitted);
+    }
 
 public:
     io_desc_read_write(io_queue& ioq, io_queue::priority_class_data& pc, stream_id stream, io_direction_and_length dnl, fair_queue_entry::capacity_t cap, iovec_keeper iovs)
         : _ioq(ioq)
         , _pclass(pc)
         , _ts(io_queue::clock_type::now())
+        , _queued_at(_ts)
         , _stream(stream)
         , _dnl(dnl)
         , _fq_capacity(cap)
@@ -240,31 +305,68 @@ class io_desc_read_write final : public io_completion {
     virtual void set_exception(std::exception_ptr eptr) noexcept override {
         io_log.trace("dev {} : req {} error", _ioq.dev_id(), fmt::ptr(this));
         _pclass.on_error();
-        _ioq.complete_request(*this);
+        _ioq.complete_request(*this, io_queue::clock_type::now() - _ts);
+        if (_cancelled) {
+            // Most likely failed with ECANCELED having been cancelled
+            // in the kernel, which the caller sees as any other cancellation
+            eptr = default_io_exception_factory::cancelled();
+        }
         _pr.set_exception(eptr);
+        for (auto d = std::move(_merged); d; d = std::move(d->_merged)) {
+            d->_pclass.on_error();
+            d->_pr.set_exception(eptr);
+        }
         delete this;
     }
 
     virtual void complete(size_t res) noexcept override {
         io_log.trace("dev {} : req {} complete", _ioq.dev_id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
-        _pclass.on_complete(std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
-        _ioq.complete_request(*this);
-        _pr.set_value(res);
+        auto latency = std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts);
+        _pclass.on_complete(latency);
+        _ioq.complete_request(*this, latency);
+        record_latency(now);
+        _ioq.maybe_log_slow_request(*this, now);
+        auto len = std::min(res, _dnl.length());
+        _pr.set_value(len);
+        complete_merged(std::move(_merged), res - len, latency, now);
         delete this;
     }
 
+    virtual void on_submitted() noexcept override {
+        // Merged reads are submitted along with this one
+        auto now = io_queue::clock_type::now();
+        for (auto d = this; d; d = d->_merged.get()) {
+            d->_submitted_at = now;
+        }
+    }
+
     void cancel() noexcept {
         _pclass.on_cancel();
-        _pr.set_exception(std::make_exception_ptr(default_io_exception_factory::cancelled()));
+        _pr.set_exception(default_io_exception_factory::cancelled());
+        for (auto d = std::move(_merged); d; d = std::move(d->_merged)) {
+            d->_pclass.on_cancel();
+            d->_pr.set_exception(default_io_exception_factory::cancelled());
+        }
         delete this;
     }
 
+    // The intent is cancelled while the request is in flight. The kernel
+    // is asked to cancel it, but if it's too late for that it completes
+    // as usual.
+    virtual void on_cancel() noexcept override {
+        io_log.trace("dev {} : req {} cancel in flight", _ioq.dev_id(), fmt::ptr(this));
+        _cancelled = true;
+        _ioq.cancel_dispatched_request(*this);
+    }
+
     void dispatch() noexcept {
         io_log.trace("dev {} : req {} submit", _ioq.dev_id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
-        _pclass.on_dispatch(_dnl, std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
-        _ts = now;
+        for (auto d = this; d; d = d->_merged.get()) {
+            d->_pclass.on_dispatch(d->_dnl, std::chrono::duration_cast<std::chrono::duration<double>>(now - d->_ts));
+            d->_ts = now;
+        }
     }
 
     future<size_t> get_future() {
@@ -273,10 +375,31 @@ class io_desc_read_write final : public io_completion {
 
     fair_queue_entry::capacity_t capacity() const noexcept { return _fq_capacity; }
     stream_id stream() const noexcept { return _stream; }
+    io_direction_and_length dnl() const noexcept { return _dnl; }
+    io_queue::clock_type::time_point queued_at() const noexcept { return _queued_at; }
+    io_queue::clock_type::time_point dispatched_at() const noexcept { return _ts; }
+    io_queue::clock_type::time_point submitted_at() const noexcept { return _submitted_at; }
+    io_queue::priority_class_data& pclass() const noexcept { return _pclass; }
+    size_t total_length() const noexcept { return _dnl.length() + _merged_length; }
+    unsigned nr_merged() const noexcept { return _nr_merged; }
+    iovec_keeper& iovecs() noexcept { return _iovs; }
+
+    // Appends an adjacent read, which is to be read along with this one. The
+    // caller adds its buffer to iovecs() and turns the request into a readv
+    // of them.
+    void merge(std::unique_ptr<io_desc_read_write> desc, fair_queue_entry::capacity_t cap) noexcept {
+        _merged_length += desc->_dnl.length();
+        _nr_merged++;
+        _fq_capacity = cap;
+        auto tail = desc.get();
+        _merged_tail->_merged = std::move(desc);
+        _merged_tail = tail;
+    }
 };
 
 class queued_io_request : private internal::io_request {
     io_queue& _ioq;
+    io_queue::priority_class_data& _pclass;
     const stream_id _stream;
     fair_queue_entry _fq_entry;
     internal::cancellable_queue::link _intent;
@@ -288,6 +411,7 @@ class queued_io_request : private internal::io_request {
     queued_io_request(internal::io_request req, io_queue& q, fair_queue_entry::capacity_t cap, io_queue::priority_class_data& pc, io_direction_and_length dnl, iovec_keeper iovs)
         : io_request(std::move(req))
         , _ioq(q)
+        , _pclass(pc)
         , _stream(_ioq.request_stream(dnl))
         , _fq_entry(cap)
         , _desc(std::make_unique<io_desc_read_write>(_ioq, pc, _stream, dnl, cap, std::move(iovs)))
@@ -297,23 +421,79 @@ class queued_io_request : private internal::io_request {
     queued_io_request(queued_io_request&&) = delete;
 
     void dispatch() noexcept {
+        if (_pclass.last_read == this) {
+            _pclass.last_read = nullptr;
+        }
         if (is_cancelled()) {
             _ioq.complete_cancelled_request(*this);
             delete this;
             return;
         }
 
-        _intent.maybe_dequeue();
+        if (auto cq = _intent.maybe_dequeue()) {
+            cq->track_dispatched(*_desc);
+        }
         _desc->dispatch();
         _ioq.submit_request(_desc.release(), std::move(*this));
         delete this;
     }
 
     void cancel() noexcept {
+        if (_pclass.last_read == this) {
+            _pclass.last_read = nullptr;
+        }
         _ioq.cancel_request(*this);
         _desc.release()->cancel();
     }
 
+    // Whether reads queued next in the class may be merged into this one
+    bool is_merge_candidate(const io_intent* intent) const noexcept {
+        return intent == nullptr && opcode() == operation::read && _desc->iovecs().empty();
+    }
+
+    // If req reads what immediately follows what this request reads, takes
+    // it over, so that both are read with a single readv, and returns its
+    // future.
+    std::optional<future<size_t>> try_merge(const internal::io_request& req, io_direction_and_length dnl, size_t max_length) {
+        static constexpr unsigned max_merged_reads = 32;
+        if (is_cancelled() || req.opcode() != operation::read || _desc->nr_merged() >= max_merged_reads) {
+            return std::nullopt;
+        }
+        int fd;
+        uint64_t pos;
+        bool nowait_works;
+        if (opcode() == operation::read) {
+            const auto& op = as<operation::read>();
+            std::tie(fd, pos, nowait_works) = std::tuple(op.fd, op.pos, op.nowait_works);
+        } else {
+            const auto& op = as<operation::readv>();
+            std::tie(fd, pos, nowait_works) = std::tuple(op.fd, op.pos, op.nowait_works);
+        }
+        const auto& next = req.as<operation::read>();
+        auto len = _desc->total_length();
+        if (next.fd != fd || next.pos != pos + len || next.nowait_works != nowait_works || len + next.size > max_length) {
+            return std::nullopt;
+        }
+
+        auto desc = std::make_unique<io_desc_read_write>(_ioq, _pclass, _stream, dnl, 0, iovec_keeper{});
+        auto& iovs = _desc->iovecs();
+        iovs.reserve(iovs.size() + 2);
+        auto cap = _ioq.request_capacity(io_direction_and_length(io_direction_read, len + next.size));
+        if (!_ioq.try_update_queued_request_capacity(*this, cap)) {
+            return std::nullopt;
+        }
+        // No exceptions from now on
+        if (iovs.empty()) {
+            const auto& op = as<operation::read>();
+            iovs.push_back({ op.addr, op.size });
+        }
+        iovs.push_back({ next.addr, next.size });
+        auto fut = desc->get_future();
+        _desc->merge(std::move(desc), cap);
+        static_cast<io_request&>(*this) = io_request::make_readv(fd, pos, iovs, nowait_works);
+        return fut;
+    }
+
     void set_intent(internal::cancellable_queue& cq) noexcept {
         _intent.enqueue(cq);
     }
@@ -351,7 +531,8 @@ priority_class::priority_class(internal::maybe_priority_class_ref pc) noexcept :
 
 cancellable_queue::cancellable_queue(cancellable_queue&& o) noexcept
         : _first(std::exchange(o._first, nullptr))
-        , _rest(std::move(o._rest)) {
+        , _rest(std::move(o._rest))
+        , _dispatched(std::move(o._dispatched)) {
     if (_first != nullptr) {
         _first->_ref = this;
     }
@@ -361,6 +542,7 @@ cancellable_queue& cancellable_queue::operator=(cancellable_queue&& o) noexcept
     if (this != &o) {
         _first = std::exchange(o._first, nullptr);
         _rest = std::move(o._rest);
+        _dispatched = std::move(o._dispatched);
         if (_first != nullptr) {
             _first->_ref = this;
         }
@@ -373,6 +555,12 @@ cancellable_queue::~cancellable_queue() {
         queued_io_request::from_cq_link(*_first).cancel();
         pop_front();
     }
+    // Cancelling one can complete others, which unlink themselves
+    while (!_dispatched.empty()) {
+        auto& dl = _dispatched.front();
+        _dispatched.pop_front();
+        dl.on_cancel();
+    }
 }
 
 void cancellable_queue::push_back(link& il) noexcept {
@@ -405,7 +593,7 @@ intent_reference::intent_reference(io_intent* intent) noexcept : _intent(intent)
 
 io_intent* intent_reference::retrieve() const {
     if (is_cancelled()) {
-        throw default_io_exception_factory::cancelled();
+        std::rethrow_exception(default_io_exception_factory::cancelled());
     }
 
     return _intent;
@@ -419,6 +607,10 @@ void io_sink::submit(io_completion* desc, io_request req) noexcept {
     }
 }
 
+void io_sink::on_submitted(io_completion* desc) noexcept {
+    desc->on_submitted();
+}
+
 std::vector<io_request::part> io_request::split(size_t max_length) {
     if (_op == operation::read || _op == operation::write) {
         return split_buffer(max_length);
@@ -526,6 +718,18 @@ sstring io_request::opname() const {
         return "poll remove";
     case io_request::operation::cancel:
         return "cancel";
+    case io_request::operation::statx:
+        return "statx";
+    case io_request::operation::openat:
+        return "openat";
+    case io_request::operation::unlinkat:
+        return "unlinkat";
+    case io_request::operation::renameat:
+        return "renameat";
+    case io_request::operation::mkdirat:
+        return "mkdirat";
+    case io_request::operation::nvme_cmd:
+        return "nvme command";
     }
     std::abort();
 }
@@ -551,12 +755,76 @@ void io_queue::update_flow_ratio() noexcept {
 }
 
 void
-io_queue::complete_request(io_desc_read_write& desc) noexcept {
+io_queue::complete_request(io_desc_read_write& desc, std::chrono::duration<double> latency) noexcept {
     _requests_executing--;
     _requests_completed++;
+    auto& sample = _model_samples[desc.stream()];
+    sample.latency_sum_us += std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    sample.completions++;
     _streams[desc.stream()].notify_request_finished(desc.capacity());
 }
 
+double io_queue::model_factor(unsigned direction) const noexcept {
+    return _group->_fgs[get_config().duplex ? direction : 0].rate_factor();
+}
+
+void io_queue::update_model() noexcept {
+    auto& cfg = get_config();
+    if (cfg.model_factor_min >= cfg.model_factor_max) {
+        return;
+    }
+    for (unsigned i = 0; i < _streams.size(); i++) {
+        auto& c = _group->_calibration[i];
+        auto s = std::exchange(_model_samples[i], {});
+        c.latency_sum_us.fetch_add(s.latency_sum_us, std::memory_order_relaxed);
+        c.completions.fetch_add(s.completions, std::memory_order_relaxed);
+        c.dispatched.fetch_add(s.dispatched, std::memory_order_relaxed);
+    }
+    if (_group->_allocated_on == this_shard_id()) {
+        _group->calibrate_model(clock_type::now());
+    }
+}
+
+// The token bucket lets at most a latency goal's worth of work be in flight,
+// so if the disk is as fast as its model says requests complete within the
+// goal. If they take longer, the disk is slower than modelled and the rate
+// is stepped down. If they complete well within the goal while the rate is
+// nearly all consumed, the disk is faster and the rate is stepped up. An
+// idle disk tells nothing and is left alone.
+void io_group::calibrate_model(std::chrono::steady_clock::time_point now) noexcept {
+    static constexpr uint64_t min_completions = 16;
+    static constexpr double busy_utilization = 0.9;
+
+    for (unsigned i = 0; i < _fgs.size(); i++) {
+        auto& c = _calibration[i];
+        auto& fg = _fgs[i];
+        auto elapsed = now - std::exchange(c.last_update, now);
+        auto completions = c.completions.exchange(0, std::memory_order_relaxed);
+        auto latency_sum = c.latency_sum_us.exchange(0, std::memory_order_relaxed);
+        auto dispatched = c.dispatched.exchange(0, std::memory_order_relaxed);
+        if (completions < min_completions) {
+            continue;
+        }
+
+        auto latency = std::chrono::duration<double>(double(latency_sum) / completions / 1'000'000);
+        auto available = fg.token_bucket().accumulated_in(elapsed);
+        auto utilization = available ? double(dispatched) / available : 0.0;
+        auto factor = fg.rate_factor();
+        if (latency > _model_latency_goal) {
+            factor *= 1.0 - _config.model_calibration_step;
+        } else if (latency < _model_latency_goal / 2 && utilization > busy_utilization) {
+            factor *= 1.0 + _config.model_calibration_step;
+        } else {
+            continue;
+        }
+        factor = std::clamp(factor, _config.model_factor_min, _config.model_factor_max);
+        if (factor != fg.rate_factor()) {
+            io_log.debug("dev {} : disk model factor {:.3f} (latency {:.3f}ms, utilization {:.2f})", _config.devid, factor, latency.count() * 1000, utilization);
+            fg.set_rate_factor(factor);
+        }
+    }
+}
+
 fair_queue::config io_queue::make_fair_queue_config(const config& iocfg, sstring label) {
     fair_queue::config cfg;
     cfg.label = label;
@@ -567,7 +835,7 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
     : _priority_classes()
     , _group(std::move(group))
     , _sink(sink)
-    , _flow_ratio_update([this] { update_flow_ratio(); })
+    , _flow_ratio_update([this] { update_flow_ratio(); update_model(); })
 {
     auto& cfg = get_config();
     if (cfg.duplex) {
@@ -588,6 +856,33 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
         sm::make_gauge("flow_ratio", [this] { return _flow_ratio; },
                 sm::description("Ratio of dispatch rate to completion rate. Is expected to be 1.0+ growing larger on reactor stalls or (!) disk problems"),
                 { owner_l, mnt_l, group_l }),
+        sm::make_gauge("model_rate_factor", [this] { return model_factor(io_direction_read); },
+                sm::description("Factor by which the disk model of reads is scaled to match observed completion latencies"),
+                { owner_l, mnt_l, group_l, sm::label("direction")("read") }),
+        sm::make_gauge("model_rate_factor", [this] { return model_factor(io_direction_write); },
+                sm::description("Factor by which the disk model of writes is scaled to match observed completion latencies"),
+                { owner_l, mnt_l, group_l, sm::label("direction")("write") }),
+        sm::make_gauge("model_read_iops", [this] {
+                    return double(get_config().req_count_rate) / read_request_base_count * model_factor(io_direction_read);
+                }, sm::description("Read IOPS the IO group is modelled to sustain"), { owner_l, mnt_l, group_l }),
+        sm::make_gauge("model_read_bandwidth", [this] {
+                    return double(get_config().blocks_count_rate << block_size_shift) / read_request_base_count * model_factor(io_direction_read);
+                }, sm::description("Read bandwidth (bytes/s) the IO group is modelled to sustain"), { owner_l, mnt_l, group_l }),
+        sm::make_gauge("model_write_iops", [this] {
+                    return double(get_config().req_count_rate) / get_config().disk_req_write_to_read_multiplier * model_factor(io_direction_write);
+                }, sm::description("Write IOPS the IO group is modelled to sustain"), { owner_l, mnt_l, group_l }),
+        sm::make_gauge("model_write_bandwidth", [this] {
+                    return double(get_config().blocks_count_rate << block_size_shift) / get_config().disk_blocks_write_to_read_multiplier * model_factor(io_direction_write);
+                }, sm::description("Write bandwidth (bytes/s) the IO group is modelled to sustain"), { owner_l, mnt_l, group_l }),
+        sm::make_counter("borrowed_capacity", [this] {
+                    double tokens = 0;
+                    for (auto& s : _streams) {
+                        tokens += fair_group::capacity_tokens(s.borrowed_capacity());
+                    }
+                    return tokens;
+                }, sm::description("Disk capacity units dispatched beyond the shard's fair share of the IO group, lent by idle shards"), { owner_l, mnt_l, group_l }),
+        sm::make_gauge("active_queues", [this] { return _group->_fgs[0].active_queues(); },
+                sm::description("Number of queues of the IO group that have requests to dispatch"), { owner_l, mnt_l, group_l }),
     });
 }
 
@@ -601,6 +896,8 @@ fair_group::config io_group::make_fair_group_config(const io_queue::config& qcfg
     double limit_min_size = std::max(io_queue::read_request_base_count, qcfg.disk_blocks_write_to_read_multiplier) * qcfg.block_count_limit_min;
     cfg.limit_min_tokens = limit_min_weight / qcfg.req_count_rate + limit_min_size / qcfg.blocks_count_rate;
     cfg.rate_limit_duration = qcfg.rate_limit_duration;
+    cfg.share_idle_capacity = qcfg.share_idle_capacity;
+    cfg.grab_batch = qcfg.capacity_grab_batch;
     return cfg;
 }
 
@@ -619,6 +916,10 @@ io_group::io_group(io_queue::config io_cfg, unsigned nr_queues)
     }
 
     auto goal = io_latency_goal();
+    _model_latency_goal = goal;
+    for (auto& c : _calibration) {
+        c.last_update = std::chrono::steady_clock::now();
+    }
     auto lvl = goal > 1.1 * _config.rate_limit_duration ? log_level::warn : log_level::debug;
     seastar_logger.log(lvl, "IO queue uses {:.2f}ms latency goal for device {}", goal.count() * 1000, _config.devid);
 
@@ -673,7 +974,7 @@ io_queue::~io_queue() {
 #if SEASTAR_API_LEVEL >= 7
 std::tuple<unsigned, sstring> get_class_info(io_priority_class_id pc) {
     auto sg = internal::scheduling_group_from_index(pc);
-    return std::make_tuple(sg.get_shares(), sg.name());
+    return std::make_tuple(unsigned(std::max(1.0f, sg.get_io_shares())), sg.name());
 }
 #else
 
@@ -788,6 +1089,10 @@ std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_c
                     sm::description("Total number of requests split")),
             sm::make_counter("total_split_bytes", _splits.bytes,
                     sm::description("Total number of bytes split")),
+            sm::make_counter("total_merged_ops", _merges.ops,
+                    sm::description("Total number of reads merged into the adjacent read queued before them")),
+            sm::make_counter("total_merged_bytes", _merges.bytes,
+                    sm::description("Total number of bytes read by merged reads")),
             sm::make_counter("total_delay_sec", [this] {
                     return _total_queue_time.count();
                 }, sm::description("Total time spent in the queue")),
@@ -816,7 +1121,19 @@ std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_c
             sm::make_gauge("delay", [this] {
                 return _queue_time.count();
             }, sm::description("random delay time in the queue")),
-            sm::make_gauge("shares", _shares, sm::description("current amount of shares"))
+            sm::make_gauge("shares", _shares, sm::description("current amount of shares")),
+            sm::make_histogram("queue_latency", sm::description("Histogram of the time read requests waited in the queue, in microseconds"),
+                    {sm::label("direction")("read")}, _latency[io_direction_read].queue).set_skip_when_empty(),
+            sm::make_histogram("queue_latency", sm::description("Histogram of the time write requests waited in the queue, in microseconds"),
+                    {sm::label("direction")("write")}, _latency[io_direction_write].queue).set_skip_when_empty(),
+            sm::make_histogram("submit_latency", sm::description("Histogram of the time from dispatching read requests to submitting them to the kernel, in microseconds"),
+                    {sm::label("direction")("read")}, _latency[io_direction_read].submit).set_skip_when_empty(),
+            sm::make_histogram("submit_latency", sm::description("Histogram of the time from dispatching write requests to submitting them to the kernel, in microseconds"),
+                    {sm::label("direction")("write")}, _latency[io_direction_write].submit).set_skip_when_empty(),
+            sm::make_histogram("device_latency", sm::description("Histogram of the time from submitting read requests to the kernel to their completion, in microseconds"),
+                    {sm::label("direction")("read")}, _latency[io_direction_read].device).set_skip_when_empty(),
+            sm::make_histogram("device_latency", sm::description("Histogram of the time from submitting write requests to the kernel to their completion, in microseconds"),
+                    {sm::label("direction")("write")}, _latency[io_direction_write].device).set_skip_when_empty(),
     });
 }
 
@@ -872,7 +1189,7 @@ io_queue::priority_class_data& io_queue::find_or_create_class(internal::priority
             s.register_priority_class(id, shares);
         }
         auto& pg = _group->find_or_create_class(pc);
-        auto pc_data = std::make_unique<priority_class_data>(pc, shares, *this, pg);
+        auto pc_data = std::make_unique<priority_class_data>(pc, name, shares, *this, pg);
         register_stats(name, *pc_data);
 
         _priority_classes[id] = std::move(pc_data);
@@ -944,6 +1261,13 @@ future<size_t> io_queue::queue_one_request(internal::priority_class pc, io_direc
         // First time will hit here, and then we create the class. It is important
         // that we create the shared pointer in the same shard it will be used at later.
         auto& pclass = find_or_create_class(pc);
+        if (intent == nullptr && pclass.last_read && get_config().merge_adjacent_reads) {
+            if (auto fut = pclass.last_read->try_merge(req, dnl, get_request_limits().max_read)) {
+                pclass.on_queue();
+                pclass.on_merge(dnl);
+                return std::move(*fut);
+            }
+        }
         auto cap = request_capacity(dnl);
         auto queued_req = std::make_unique<queued_io_request>(std::move(req), *this, cap, pclass, std::move(dnl), std::move(iovs));
         auto fut = queued_req->get_future();
@@ -953,6 +1277,7 @@ future<size_t> io_queue::queue_one_request(internal::priority_class pc, io_direc
         }
 
         _streams[queued_req->stream()].queue(pclass.fq_class(), queued_req->queue_entry());
+        pclass.last_read = queued_req->is_merge_candidate(intent) ? queued_req.get() : nullptr;
         queued_req.release();
         pclass.on_queue();
         _queued_requests++;
@@ -1019,10 +1344,38 @@ future<size_t> io_queue::queue_request(internal::priority_class pc, io_direction
     });
 }
 
+void io_queue::trace_request(reactor& r, internal::priority_class pc, io_direction_and_length dnl, const internal::io_request& req) noexcept {
+    using op = internal::io_request::operation;
+    uint64_t offset = 0;
+    switch (req.opcode()) {
+    case op::read: offset = req.as<op::read>().pos; break;
+    case op::readv: offset = req.as<op::readv>().pos; break;
+    case op::write: offset = req.as<op::write>().pos; break;
+    case op::writev: offset = req.as<op::writev>().pos; break;
+    default: break;
+    }
+    try {
+        r._io_trace_hook(io_trace_event{
+            .timestamp = std::chrono::steady_clock::now(),
+            .shard = this_shard_id(),
+            .class_name = std::get<1>(get_class_info(pc.id())),
+            .op = dnl.rw_idx() == io_direction_read ? io_trace_op::read : io_trace_op::write,
+            .offset = offset,
+            .length = dnl.length(),
+        });
+    } catch (...) {
+        // Failing to trace a request should not fail the request
+        io_log.debug("Failed to trace request: {}", std::current_exception());
+    }
+}
+
 future<size_t> io_queue::submit_io_read(internal::priority_class pc, size_t len, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
     auto& r = engine();
     ++r._io_stats.aio_reads;
     r._io_stats.aio_read_bytes += len;
+    if (__builtin_expect(bool(r._io_trace_hook), false)) {
+        trace_request(r, pc, io_direction_and_length(io_direction_read, len), req);
+    }
     return queue_request(std::move(pc), io_direction_and_length(io_direction_read, len), std::move(req), intent, std::move(iovs));
 }
 
@@ -1030,6 +1383,9 @@ future<size_t> io_queue::submit_io_write(internal::priority_class pc, size_t len
     auto& r = engine();
     ++r._io_stats.aio_writes;
     r._io_stats.aio_write_bytes += len;
+    if (__builtin_expect(bool(r._io_trace_hook), false)) {
+        trace_request(r, pc, io_direction_and_length(io_direction_write, len), req);
+    }
     return queue_request(std::move(pc), io_direction_and_length(io_direction_write, len), std::move(req), intent, std::move(iovs));
 }
 
@@ -1045,14 +1401,37 @@ void io_queue::submit_request(io_desc_read_write* desc, internal::io_request req
     _queued_requests--;
     _requests_executing++;
     _requests_dispatched++;
+    _model_samples[desc->stream()].dispatched += desc->capacity();
     _sink.submit(desc, std::move(req));
 }
 
+bool io_queue::try_update_queued_request_capacity(queued_io_request& req, fair_queue_entry::capacity_t cap) noexcept {
+    return _streams[req.stream()].try_update_request_capacity(req.queue_entry(), cap);
+}
+
 void io_queue::cancel_request(queued_io_request& req) noexcept {
     _queued_requests--;
     _streams[req.stream()].notify_request_cancelled(req.queue_entry());
 }
 
+void io_queue::cancel_dispatched_request(io_desc_read_write& desc) noexcept {
+    engine().cancel_io(&desc);
+}
+
+void io_queue::maybe_log_slow_request(const io_desc_read_write& desc, clock_type::time_point now) noexcept {
+    auto threshold = get_config().slow_io_threshold;
+    if (threshold.count() <= 0 || now - desc.queued_at() < threshold) {
+        return;
+    }
+    static thread_local logger::rate_limit rate_limit(std::chrono::seconds(10));
+    using usecs = std::chrono::duration<double, std::micro>;
+    auto submitted = std::max(desc.submitted_at(), desc.dispatched_at());
+    io_log.log(log_level::warn, rate_limit, "dev {} : slow {} of {} bytes in class {} ({} merged) took {:.0f}us: queued {:.0f}us, submitted after {:.0f}us, in the kernel {:.0f}us",
+            dev_id(), desc.dnl().rw_idx() == io_direction_read ? "read" : "write", desc.total_length(), desc.pclass().name(), desc.nr_merged(),
+            usecs(now - desc.queued_at()).count(), usecs(desc.dispatched_at() - desc.queued_at()).count(),
+            usecs(submitted - desc.dispatched_at()).count(), usecs(now - submitted).count());
+}
+
 void io_queue::complete_cancelled_request(queued_io_request& req) noexcept {
     _streams[req.stream()].notify_request_finished(req.queue_entry().capacity());
 }
@@ -1079,6 +1458,14 @@ io_queue::update_shares_for_class(internal::priority_class pc, size_t new_shares
     }
 }
 
+void
+io_queue::set_latency_target_for_class(internal::priority_class pc, std::chrono::microseconds target) {
+    auto& pclass = find_or_create_class(pc);
+    for (auto&& s : _streams) {
+        s.set_latency_target_for_class(pclass.fq_class(), target);
+    }
+}
+
 future<> io_queue::update_bandwidth_for_class(internal::priority_class pc, uint64_t new_bandwidth) {
     return futurize_invoke([this, pc, new_bandwidth] {
         if (_group->_allocated_on == this_shard_id()) {
@@ -57,7 +57,8 @@
 // logic) and tracked. The sampled live set can be retrieved with
 // `sampled_memory_profile()`. Sampled allocations carry an extra
 // allocation_site pointer with them which is used on free to remove them from
-// the sampled live set.
+// the sampled live set. All of them are also counted, at allocation, in a
+// cumulative set, retrieved with `sampled_cumulative_memory_profile()`.
 //
 // Large allocations are tracked via a pointer to the allocation_site which is
 // stored on the page structure. To check whether an allocation was sampled or
@@ -90,6 +91,8 @@ module;
 
 #ifndef SEASTAR_DEFAULT_ALLOCATOR
 #include <new>
+#include <array>
+#include <bitset>
 #include <cstdint>
 #include <algorithm>
 #include <limits>
@@ -105,6 +108,10 @@ module;
 #ifdef SEASTAR_HAVE_NUMA
 #include <numaif.h>
 #endif
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
 #endif // !defined(SEASTAR_DEFAULT_ALLOCATOR)
 
 #ifdef SEASTAR_MODULE
@@ -222,7 +229,7 @@ using allocation_site_ptr = const memory::allocation_site*;
 namespace memory {
 
 [[gnu::unused]]
-static allocation_site_ptr get_allocation_site();
+static allocation_site_ptr get_allocation_site(size_t sample_size);
 
 [[gnu::noinline]]
 static void on_allocation_failure(size_t size);
@@ -237,6 +244,10 @@ struct page;
 class page_list;
 
 static std::atomic<bool> live_cpus[max_cpus];
+// NUMA node each cpu's memory lives on, as given to configure()
+static std::atomic<unsigned> cpu_numa_nodes[max_cpus];
+// Allocator cpu id (plus one, zero while unknown) of each seastar shard
+static std::atomic<unsigned> shard_cpus[max_cpus];
 
 using std::optional;
 
@@ -323,6 +334,8 @@ class page_list_link {
     uint32_t _prev;
     uint32_t _next;
     friend class page_list;
+    friend class small_pool;
+    friend struct cpu_pages;
     friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
 };
 
@@ -424,6 +437,8 @@ class page_list {
         }
         _front = ary[_front].link._next;
     }
+    friend class small_pool;
+    friend struct cpu_pages;
     friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
 };
 
@@ -439,6 +454,7 @@ class small_pool {
     unsigned _min_free;
     unsigned _max_free;
     unsigned _pages_in_use = 0;
+    unsigned _spans_in_use = 0;
     // Flag to indicate whether this pool stores sampled allocations.
     // When freeing small allocations this flag is checked to see whether an
     // allocation site pointer is part of the object and the allocation needs
@@ -463,6 +479,7 @@ class small_pool {
 #endif
     }
     bool objects_page_aligned() const { return is_page_aligned(_object_size); }
+    small_pool_statistics get_statistics() const;
     static constexpr unsigned size_to_idx(unsigned size);
     static constexpr unsigned idx_to_size(unsigned idx);
     allocation_site_ptr& alloc_site_holder(void* ptr);
@@ -549,6 +566,23 @@ struct cross_cpu_free_item {
     cross_cpu_free_item* next;
 };
 
+// Objects freed on a reactor thread that belong to another cpu are collected
+// in per-owner batches, and pushed onto the owner's xcpu_freelist a batch at
+// a time, so that the cache line holding the list head bounces once per batch
+// rather than once per object. Batches are flushed when full, and otherwise
+// whenever the reactor polls for cross-cpu frees. They are allowed to grow
+// larger for owners on another NUMA node, where moving the line costs more.
+struct cross_cpu_free_batch {
+    cross_cpu_free_item* head = nullptr;
+    cross_cpu_free_item* tail = nullptr;
+    unsigned count = 0;
+    uint64_t frees = 0;
+    uint64_t flushes = 0;
+};
+
+static constexpr unsigned xcpu_batch_size_local_node = 32;
+static constexpr unsigned xcpu_batch_size_remote_node = 128;
+
 struct cpu_pages {
     small_pool_array<false> small_pools;
     uint32_t min_free_pages = 20000000 / page_size;
@@ -558,12 +592,30 @@ struct cpu_pages {
     uint32_t nr_free_pages;
     uint32_t current_min_free_pages = 0;
     size_t large_allocation_warning_threshold = std::numeric_limits<size_t>::max();
+    // Large allocations of at least this many pages are served from whole
+    // huge pages, see allocate_huge_page_backed()
+    unsigned huge_page_allocation_threshold = std::numeric_limits<unsigned>::max();
+    bool hugetlbfs_backed = false;
+    bool huge_page_collapse_unsupported = false;
+    // Huge pages of this shard's memory known to be backed by a transparent
+    // huge page. Seastar never hands memory back to the kernel, so they stay so.
+    std::bitset<(size_t(1) << cpu_id_shift) / huge_page_size> huge_backed;
+    huge_page_statistics huge_page_stats;
+    // Free huge pages of this shard's memory handed back to the kernel by
+    // release_free_memory(); they are faulted back in once allocated.
+    std::bitset<(size_t(1) << cpu_id_shift) / huge_page_size> released;
+    released_memory_statistics released_stats;
+    bool release_unsupported = false;
+    // The least free memory since release_free_memory() last ran
+    uint32_t min_free_pages_since_release = std::numeric_limits<uint32_t>::max();
     unsigned cpu_id = -1U;
     std::function<void (std::function<void ()>)> reclaim_hook;
     std::vector<reclaimer*> reclaimers;
     static constexpr unsigned nr_span_lists = 32;
     page_list free_spans[nr_span_lists];  // contains aligned spans with span_size == 2^idx
     alignas(seastar::cache_line_size) std::atomic<cross_cpu_free_item*> xcpu_freelist;
+    alignas(seastar::cache_line_size) std::array<cross_cpu_free_batch, max_cpus> xcpu_batches;
+    std::bitset<max_cpus> xcpu_pending_batches;
     static std::atomic<unsigned> cpu_id_gen;
     static cpu_pages* all_cpus[max_cpus];
     union asu {
@@ -573,9 +625,20 @@ struct cpu_pages {
         ~asu() {} // alloc_sites live forever
         alloc_sites_type alloc_sites;
     } asu;
+    // All the sampled allocations of each site, live or not, counted by
+    // their site rather than linked to it
+    union cumulative_asu {
+        cumulative_asu() : alloc_sites{} {
+        }
+        ~cumulative_asu() {} // alloc_sites live forever
+        asu::alloc_sites_type alloc_sites;
+    } cumulative_asu;
     allocation_site_ptr alloc_site_list_head = nullptr; // For easy traversal of asu.alloc_sites from scylla-gdb.py
     sampler heap_prof_sampler;
     small_pool_array<true> sampled_small_pools;
+    // The sizes of the live sampled allocations, by the scheduling group
+    // of their allocation site
+    std::array<size_t, max_scheduling_groups()> group_sampled_size = {};
 
     char* mem() { return memory; }
 
@@ -589,6 +652,10 @@ struct cpu_pages {
     void* allocate_large_and_trim(unsigned nr_pages, bool should_sample);
     void* allocate_large(unsigned nr_pages, bool should_sample);
     void* allocate_large_aligned(unsigned align_pages, unsigned nr_pages, bool should_sample);
+    void* allocate_huge_page_backed(unsigned nr_pages, bool should_sample);
+    void collapse_huge_pages(char* start, size_t len);
+    size_t release_free_memory(size_t keep_free);
+    void reuse_released(uint32_t span_start, uint32_t nr_pages);
     page* find_and_unlink_span(unsigned nr_pages);
     page* find_and_unlink_span_reclaiming(unsigned n_pages);
     void free_large(void* ptr);
@@ -596,6 +663,8 @@ struct cpu_pages {
     void free_span(pageidx start, uint32_t nr_pages);
     void free_span_no_merge(pageidx start, uint32_t nr_pages);
     void free_span_unaligned(pageidx start, uint32_t nr_pages);
+    void get_span_statistics(std::array<span_statistics, nr_span_lists>& stats);
+    size_t largest_free_span();
     void free(void* ptr);
     void free(void* ptr, size_t size);
     static bool try_free_fastpath(void* ptr);
@@ -603,6 +672,10 @@ struct cpu_pages {
     static void do_foreign_free(void* ptr);
     void shrink(void* ptr, size_t new_size);
     static void free_cross_cpu(unsigned cpu_id, void* ptr);
+    static void push_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail);
+    void batch_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* p);
+    void flush_cross_cpu_batch(unsigned cpu_id);
+    bool flush_cross_cpu_batches();
     bool drain_cross_cpu_freelist();
     size_t object_size(void* ptr);
 
@@ -830,6 +903,10 @@ cpu_pages::allocate_large_and_trim(unsigned n_pages, bool should_sample) {
     span->free = span_end->free = false;
     span->span_size = span_end->span_size = span_size;
     span->pool = nullptr;
+    min_free_pages_since_release = std::min(min_free_pages_since_release, nr_free_pages);
+    if (released_stats.released_memory) [[unlikely]] {
+        reuse_released(span_idx, span_size);
+    }
 #ifdef SEASTAR_HEAPPROF
     if (should_sample) {
         auto alloc_site = add_alloc_site(span->span_size * page_size);
@@ -852,10 +929,12 @@ cpu_pages::warn_large_allocation(size_t size) {
 
 allocation_site_ptr
 cpu_pages::add_alloc_site(size_t allocated_size) {
-    allocation_site_ptr alloc_site = get_allocation_site();
+    auto sample_size = heap_prof_sampler.sample_size(allocated_size);
+    allocation_site_ptr alloc_site = get_allocation_site(sample_size);
     if (alloc_site) {
         ++alloc_site->count;
-        alloc_site->size += heap_prof_sampler.sample_size(allocated_size);
+        alloc_site->size += sample_size;
+        group_sampled_size[alloc_site->group_index] += sample_size;
     }
 
     return alloc_site;
@@ -868,6 +947,8 @@ cpu_pages::remove_alloc_site(allocation_site_ptr alloc_site, size_t deallocated_
         auto sample_size = heap_prof_sampler.sample_size(deallocated_size);
         // prevent underflow in case sample rate changed
         alloc_site->size -= alloc_site->size < sample_size ? alloc_site->size : sample_size;
+        auto& group_size = group_sampled_size[alloc_site->group_index];
+        group_size -= std::min(group_size, sample_size);
         if (alloc_site->count == 0) {
             if (alloc_site->prev) {
                 alloc_site->prev->next = alloc_site->next;
@@ -917,6 +998,9 @@ cpu_pages::check_large_allocation(size_t size) {
 inline void*
 cpu_pages::allocate_large(unsigned n_pages, bool should_sample) {
     check_large_allocation(n_pages * page_size);
+    if (n_pages >= huge_page_allocation_threshold) [[unlikely]] {
+        return allocate_huge_page_backed(n_pages, should_sample);
+    }
     return allocate_large_and_trim(n_pages, should_sample);
 }
 
@@ -924,9 +1008,115 @@ void*
 cpu_pages::allocate_large_aligned(unsigned align_pages, unsigned n_pages, bool should_sample) {
     check_large_allocation(n_pages * page_size);
     // buddy allocation is always aligned
+    if (n_pages >= huge_page_allocation_threshold) [[unlikely]] {
+        return allocate_huge_page_backed(std::max(n_pages, align_pages), should_sample);
+    }
     return allocate_large_and_trim(n_pages, should_sample);
 }
 
+// Rounds the allocation up to whole huge pages, so that (spans being
+// naturally aligned) it does not share a huge page with other spans, and
+// has the kernel back those with transparent huge pages right away rather
+// than leaving it to khugepaged.
+void*
+cpu_pages::allocate_huge_page_backed(unsigned n_pages, bool should_sample) {
+    constexpr unsigned huge_page_pages = huge_page_size / page_size;
+    n_pages = align_up(n_pages, huge_page_pages);
+    auto p = static_cast<char*>(allocate_large_and_trim(n_pages, should_sample));
+    if (p) {
+        ++huge_page_stats.large_allocations;
+        collapse_huge_pages(p, size_t(n_pages) * page_size);
+    }
+    return p;
+}
+
+void cpu_pages::collapse_huge_pages(char* start, size_t len) {
+    if (hugetlbfs_backed || huge_page_collapse_unsupported || !use_transparent_hugepages.load(std::memory_order_relaxed)) {
+        return;
+    }
+    for (auto p = start; p < start + len; p += huge_page_size) {
+        auto idx = (p - memory) / huge_page_size;
+        if (huge_backed.test(idx)) {
+            continue;
+        }
+        ++huge_page_stats.collapses;
+        if (::madvise(p, huge_page_size, MADV_COLLAPSE) == 0) {
+            huge_backed.set(idx);
+            huge_page_stats.backed_memory += huge_page_size;
+        } else if (errno == EINVAL) {
+            // Kernel older than 6.1, or THP disabled
+            huge_page_collapse_unsupported = true;
+            ++huge_page_stats.collapse_failures;
+            return;
+        } else {
+            // EAGAIN, ENOMEM: no huge page could be had; khugepaged may still
+            // collapse it later
+            ++huge_page_stats.collapse_failures;
+        }
+    }
+}
+
+// Releases whole free huge pages, largest spans first, as those are the
+// least likely to be needed soon. Free spans of a huge page or more are
+// aligned to their size, so consist of whole huge pages.
+size_t cpu_pages::release_free_memory(size_t keep_free) {
+    // Only what stayed free since the last time is idle
+    auto idle = size_t(std::min(min_free_pages_since_release, nr_free_pages)) * page_size;
+    min_free_pages_since_release = nr_free_pages;
+    if (hugetlbfs_backed || release_unsupported || idle <= keep_free + released_stats.released_memory) {
+        return 0;
+    }
+    auto budget = idle - keep_free - released_stats.released_memory;
+    constexpr unsigned huge_page_pages = huge_page_size / page_size;
+    size_t done = 0;
+    for (auto idx = nr_span_lists; idx-- > index_of(huge_page_pages) && done < budget;) {
+        auto& list = free_spans[idx];
+        if (list.empty()) {
+            continue;
+        }
+        for (auto span = &list.front(pages); done < budget; span = &pages[span->link._next]) {
+            for (uint32_t i = 0; i < span->span_size && done < budget; i += huge_page_pages) {
+                auto p = mem() + (span - pages + i) * page_size;
+                auto hp = (p - memory) / huge_page_size;
+                if (released.test(hp)) {
+                    continue;
+                }
+                if (::madvise(p, huge_page_size, MADV_DONTNEED) != 0) {
+                    // EINVAL for locked memory
+                    seastar_memory_logger.debug("Unable to release free memory to the kernel: {}", std::error_code(errno, std::system_category()).message());
+                    release_unsupported = true;
+                    return done;
+                }
+                released.set(hp);
+                if (huge_backed.test(hp)) {
+                    huge_backed.reset(hp);
+                    huge_page_stats.backed_memory -= huge_page_size;
+                }
+                done += huge_page_size;
+            }
+            if (!span->link._next) {
+                break;
+            }
+        }
+    }
+    released_stats.released_memory += done;
+    released_stats.released_bytes += done;
+    return done;
+}
+
+// The kernel faults released pages back in as they are touched; only the
+// accounting needs updating.
+void cpu_pages::reuse_released(uint32_t span_start, uint32_t nr_pages) {
+    constexpr unsigned huge_page_pages = huge_page_size / page_size;
+    for (auto hp = span_start / huge_page_pages; hp <= (span_start + nr_pages - 1) / huge_page_pages; ++hp) {
+        if (released.test(hp)) {
+            released.reset(hp);
+            released_stats.released_memory -= huge_page_size;
+            released_stats.reused_bytes += huge_page_size;
+        }
+    }
+}
+
 disable_backtrace_temporarily::disable_backtrace_temporarily()
     : _disable_sampling(cpu_mem.heap_prof_sampler.pause_sampling()) {
 }
@@ -938,13 +1128,29 @@ simple_backtrace get_backtrace() noexcept {
 }
 
 static
-allocation_site_ptr get_allocation_site() {
+void add_cumulative_alloc_site(const allocation_site& alloc_site, size_t sample_size) {
+    auto& sites = cpu_mem.cumulative_asu.alloc_sites;
+    auto i = sites.find(alloc_site);
+    if (i == sites.end()) {
+        if (sites.size() >= 1000) {
+            return;
+        }
+        i = sites.insert(alloc_site).first;
+    }
+    ++i->count;
+    i->size += sample_size;
+}
+
+static
+allocation_site_ptr get_allocation_site(size_t sample_size) {
     if (!cpu_mem.is_initialized() || !cpu_mem.heap_prof_sampler.sampling_interval()) {
         return nullptr;
     }
     disable_backtrace_temporarily dbt;
     allocation_site new_alloc_site;
     new_alloc_site.backtrace = get_backtrace();
+    new_alloc_site.group_index = seastar::internal::scheduling_group_index(*seastar::internal::current_scheduling_group_ptr());
+    add_cumulative_alloc_site(new_alloc_site, sample_size);
     if (cpu_mem.asu.alloc_sites.size() >= 1000
         && cpu_mem.asu.alloc_sites.find(new_alloc_site) == cpu_mem.asu.alloc_sites.end()) {
         // Drop sample for now. Could do something smarter like dropping a
@@ -1031,17 +1237,65 @@ void cpu_pages::free_cross_cpu(unsigned cpu_id, void* ptr) {
         return;
     }
     auto p = reinterpret_cast<cross_cpu_free_item*>(ptr);
+    if (is_reactor_thread) {
+        get_cpu_mem().batch_cross_cpu_free(cpu_id, p);
+    } else {
+        push_cross_cpu_free(cpu_id, p, p);
+    }
+    alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+}
+
+// Pushes the chain [head, tail] onto cpu_id's xcpu_freelist
+void cpu_pages::push_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail) {
     auto& list = all_cpus[cpu_id]->xcpu_freelist;
     auto old = list.load(std::memory_order_relaxed);
     do {
-        p->next = old;
-    } while (!list.compare_exchange_weak(old, p, std::memory_order_release, std::memory_order_relaxed));
-    alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+        tail->next = old;
+    } while (!list.compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void cpu_pages::batch_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* p) {
+    auto& b = xcpu_batches[cpu_id];
+    p->next = b.head;
+    b.head = p;
+    if (!b.tail) {
+        b.tail = p;
+        xcpu_pending_batches.set(cpu_id);
+    }
+    ++b.frees;
+    auto same_node = cpu_numa_nodes[cpu_id].load(std::memory_order_relaxed) == cpu_numa_nodes[this->cpu_id].load(std::memory_order_relaxed);
+    if (++b.count >= (same_node ? xcpu_batch_size_local_node : xcpu_batch_size_remote_node)) {
+        flush_cross_cpu_batch(cpu_id);
+    }
+}
+
+void cpu_pages::flush_cross_cpu_batch(unsigned cpu_id) {
+    auto& b = xcpu_batches[cpu_id];
+    // The owner may have gone away while the batch was held; leak the
+    // objects, as free_cross_cpu() does.
+    if (live_cpus[cpu_id].load(std::memory_order_relaxed)) {
+        push_cross_cpu_free(cpu_id, b.head, b.tail);
+        ++b.flushes;
+    }
+    b.head = b.tail = nullptr;
+    b.count = 0;
+    xcpu_pending_batches.reset(cpu_id);
+}
+
+bool cpu_pages::flush_cross_cpu_batches() {
+    if (xcpu_pending_batches.none()) {
+        return false;
+    }
+    for (auto c = xcpu_pending_batches._Find_first(); c < max_cpus; c = xcpu_pending_batches._Find_next(c)) {
+        flush_cross_cpu_batch(c);
+    }
+    return true;
 }
 
 bool cpu_pages::drain_cross_cpu_freelist() {
+    auto flushed = flush_cross_cpu_batches();
     if (!xcpu_freelist.load(std::memory_order_relaxed)) {
-        return false;
+        return flushed;
     }
     auto p = xcpu_freelist.exchange(nullptr, std::memory_order_acquire);
     while (p) {
@@ -1199,10 +1453,48 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
 
 cpu_pages::~cpu_pages() {
     if (is_initialized()) {
+        flush_cross_cpu_batches();
         live_cpus[cpu_id].store(false, std::memory_order_relaxed);
     }
 }
 
+// Walks all pages, so is slow; does not allocate.
+void cpu_pages::get_span_statistics(std::array<span_statistics, nr_span_lists>& stats) {
+    for (unsigned i = 0; i < nr_span_lists; ++i) {
+        stats[i] = span_statistics{};
+        stats[i].span_size = (size_t(1) << i) * page_size;
+    }
+    for (unsigned i = 0; i < nr_pages;) {
+        const auto span_size = pages[i].span_size;
+        if (!span_size) {
+            ++i;
+            continue;
+        }
+        auto& st = stats[log2ceil(span_size)];
+        if (pages[i].free) {
+            ++st.free_spans;
+            st.free_memory += size_t(span_size) * page_size;
+        } else {
+            ++st.used_spans;
+            st.used_memory += size_t(span_size) * page_size;
+        }
+        i += span_size;
+    }
+}
+
+size_t cpu_pages::largest_free_span() {
+    for (unsigned i = nr_span_lists; i-- > 0;) {
+        uint32_t largest = 0;
+        for (auto front = free_spans[i]._front; front; front = pages[front].link._next) {
+            largest = std::max(largest, pages[front].span_size);
+        }
+        if (largest) {
+            return size_t(largest) * page_size;
+        }
+    }
+    return 0;
+}
+
 bool cpu_pages::is_initialized() const {
     return bool(nr_pages);
 }
@@ -1264,6 +1556,7 @@ allocate_hugetlbfs_memory(file_desc& fd, void* where, size_t how_much) {
 }
 
 void cpu_pages::replace_memory_backing(allocate_system_memory_fn alloc_sys_mem) {
+    hugetlbfs_backed = true;
     // We would like to use ::mremap() to atomically replace the old anonymous
     // memory with hugetlbfs backed memory, but mremap() does not support hugetlbfs
     // (for no reason at all).  So we must copy the anonymous memory to some other
@@ -1483,6 +1776,7 @@ small_pool::add_more_objects() {
         auto span = get_cpu_mem().to_page(data);
         span_size = span->span_size;
         _pages_in_use += span_size;
+        ++_spans_in_use;
         for (unsigned i = 0; i < span_size; ++i) {
             span[i].offset_in_span = i;
             span[i].pool = this;
@@ -1518,12 +1812,37 @@ small_pool::trim_free_list() {
         span->freelist = obj;
         if (--span->nr_small_alloc == 0) {
             _pages_in_use -= span->span_size;
+            --_spans_in_use;
             _span_list.erase(get_cpu_mem().pages, *span);
             get_cpu_mem().free_span(span - get_cpu_mem().pages, span->span_size);
         }
     }
 }
 
+small_pool_statistics
+small_pool::get_statistics() const {
+    // There are two types of free objects: pool freelist objects are
+    // pointed to by _free and their count is _free_count. Span freelist
+    // objects are those removed from the pool freelist when that list
+    // becomes too large: they are instead attached to the spans allocated
+    // to this pool. To count this second category, we iterate over the spans.
+    uint64_t span_freelist_objs = 0;
+    auto front = _span_list._front;
+    while (front) {
+        auto& span = get_cpu_mem().pages[front];
+        auto capacity_in_objects = span.span_size * page_size / _object_size;
+        span_freelist_objs += capacity_in_objects - span.nr_small_alloc;
+        front = span.link._next;
+    }
+    small_pool_statistics ret;
+    ret.object_size = _object_size;
+    ret.memory = size_t(_pages_in_use) * page_size;
+    ret.free_objects = _free_count + span_freelist_objs;
+    ret.objects_in_use = ret.memory / _object_size - ret.free_objects;
+    ret.spans = _spans_in_use;
+    return ret;
+}
+
 void
 abort_on_underflow(size_t size) {
     if (std::make_signed_t<size_t>(size) < 0) {
@@ -1824,6 +2143,24 @@ size_t get_large_allocation_warning_threshold() {
     return get_cpu_mem().large_allocation_warning_threshold;
 }
 
+void set_huge_page_allocation_threshold(size_t threshold) {
+    get_cpu_mem().huge_page_allocation_threshold = threshold
+            ? std::min<size_t>(align_up(threshold, page_size) / page_size, std::numeric_limits<unsigned>::max())
+            : std::numeric_limits<unsigned>::max();
+}
+
+huge_page_statistics get_huge_page_statistics() {
+    return get_cpu_mem().huge_page_stats;
+}
+
+size_t release_free_memory(size_t keep_free) {
+    return get_cpu_mem().release_free_memory(keep_free);
+}
+
+released_memory_statistics get_released_memory_statistics() {
+    return get_cpu_mem().released_stats;
+}
+
 void disable_large_allocation_warning() {
     get_cpu_mem().large_allocation_warning_threshold = std::numeric_limits<size_t>::max();
 }
@@ -1851,8 +2188,13 @@ configure(std::vector<resource::memory> m, bool mbind,
     is_reactor_thread = true;
     internal::numa_layout ret_layout;
     size_t total = 0;
+    size_t largest = 0;
     for (auto&& x : m) {
         total += x.bytes;
+        if (x.bytes > largest) {
+            largest = x.bytes;
+            cpu_numa_nodes[cpu_mem.cpu_id].store(x.nodeid, std::memory_order_relaxed);
+        }
     }
     allocate_system_memory_fn sys_alloc = allocate_anonymous_memory;
     if (hugetlbfs_path) {
@@ -1909,6 +2251,60 @@ bool drain_cross_cpu_freelist() {
     return get_cpu_mem().drain_cross_cpu_freelist();
 }
 
+unsigned small_pool_count() {
+    return small_pool_array<false>::nr_small_pools;
+}
+
+small_pool_statistics get_small_pool_statistics(unsigned idx) {
+    auto& sp = get_cpu_mem().small_pools[idx];
+    // Pools too small to fit a free_object are never used
+    if (sp.object_size() < sizeof(free_object)) {
+        return small_pool_statistics{.object_size = sp.object_size()};
+    }
+    return sp.get_statistics();
+}
+
+size_t largest_free_span() {
+    return get_cpu_mem().largest_free_span();
+}
+
+fragmentation_report get_fragmentation_report() {
+    auto& cm = get_cpu_mem();
+    fragmentation_report ret;
+    for (unsigned i = 0; i < cm.small_pools.nr_small_pools; ++i) {
+        auto& sp = cm.small_pools[i];
+        if (sp.object_size() < sizeof(free_object)) {
+            continue;
+        }
+        ret.small_pools.push_back(sp.get_statistics());
+    }
+    std::array<span_statistics, cpu_pages::nr_span_lists> spans;
+    cm.get_span_statistics(spans);
+    for (auto& st : spans) {
+        if (st.free_spans || st.used_spans) {
+            ret.spans.push_back(st);
+        }
+    }
+    ret.free_memory = size_t(cm.nr_free_pages) * page_size;
+    ret.largest_free_span = cm.largest_free_span();
+    return ret;
+}
+
+cross_shard_free_statistics cross_shard_free_stats(unsigned shard) {
+    auto cpu = shard < max_cpus ? shard_cpus[shard].load(std::memory_order_relaxed) : 0;
+    if (!cpu || !is_reactor_thread) {
+        return {};
+    }
+    auto& b = get_cpu_mem().xcpu_batches[cpu - 1];
+    return cross_shard_free_statistics{b.frees, b.flushes};
+}
+
+void internal::set_shard_id(unsigned shard) noexcept {
+    if (is_reactor_thread && shard < max_cpus) {
+        shard_cpus[shard].store(get_cpu_mem().cpu_id + 1, std::memory_order_relaxed);
+    }
+}
+
 memory_layout get_memory_layout() {
     return get_cpu_mem().memory_layout();
 }
@@ -2031,7 +2427,7 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
     }
 
     it = fmt::format_to(it, "Small pools:\n");
-    it = fmt::format_to(it, "objsz spansz usedobj memory unused wst%\n");
+    it = fmt::format_to(it, "objsz spansz usedobj memory unused  spans wst%\n");
     for (unsigned i = 0; i < get_cpu_mem().small_pools.nr_small_pools; i++) {
         auto& sp = get_cpu_mem().small_pools[i];
         // We don't use pools too small to fit a free_object, so skip these, they
@@ -2039,69 +2435,35 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
         if (sp.object_size() < sizeof(free_object)) {
             continue;
         }
-
-        // For the small pools, there are two types of free objects:
-        // Pool freelist objects are poitned to by sp._free and their count is sp._free_count
-        // Span freelist objects are those removed from the pool freelist when that list
-        // becomes too large: they are instead attached to the spans allocated to this
-        // pool. To count this second category, we iterate over the spans below.
-        uint32_t span_freelist_objs = 0;
-        auto front = sp._span_list._front;
-        while (front) {
-            auto& span = get_cpu_mem().pages[front];
-            auto capacity_in_objects = span.span_size * page_size / sp.object_size();
-            span_freelist_objs += capacity_in_objects - span.nr_small_alloc;
-            front = span.link._next;
-        }
-        const auto free_objs = sp._free_count + span_freelist_objs; // pool + span free objects
-        const auto use_count = sp._pages_in_use * page_size / sp.object_size() - free_objs;
-        auto memory = sp._pages_in_use * page_size;
-        const auto unused = free_objs * sp.object_size();
-        const auto wasted_percent = memory ? unused * 100 / memory : 0;
+        const auto st = sp.get_statistics();
         it = fmt::format_to(it,
-                "{:>5}  {:>5}   {:>5}  {:>5}  {:>5} {:>4}\n",
-                sp.object_size(),
+                "{:>5}  {:>5}   {:>5}  {:>5}  {:>5}  {:>5} {:>4}\n",
+                st.object_size,
                 to_hr_size(sp._span_sizes.preferred * page_size),
-                to_hr_number(use_count),
-                to_hr_size(memory),
-                to_hr_size(unused),
-                unsigned(wasted_percent));
+                to_hr_number(st.objects_in_use),
+                to_hr_size(st.memory),
+                to_hr_size(st.free_objects * st.object_size),
+                to_hr_number(st.spans),
+                unsigned(st.fragmentation() * 100));
     }
     it = fmt::format_to(it, "\nPage spans:\n");
     it = fmt::format_to(it, "index  size  free  used spans\n");
 
-    std::array<uint32_t, cpu_pages::nr_span_lists> span_size_histogram;
-    span_size_histogram.fill(0);
-
-    for (unsigned i = 0; i < get_cpu_mem().nr_pages;) {
-        const auto span_size = get_cpu_mem().pages[i].span_size;
-        if (!span_size) {
-            ++i;
-            continue;
-        }
-        ++span_size_histogram[log2ceil(span_size)];
-        i += span_size;
-    }
-
-    for (unsigned i = 0; i< get_cpu_mem().nr_span_lists; i++) {
-        auto& span_list = get_cpu_mem().free_spans[i];
-        auto front = span_list._front;
-        uint32_t free_pages = 0;
-        while (front) {
-            auto& span = get_cpu_mem().pages[front];
-            free_pages += span.span_size;
-            front = span.link._next;
-        }
-        const auto total_spans = span_size_histogram[i];
-        const auto total_pages = total_spans * (1 << i);
+    std::array<span_statistics, cpu_pages::nr_span_lists> spans;
+    get_cpu_mem().get_span_statistics(spans);
+    for (unsigned i = 0; i < get_cpu_mem().nr_span_lists; i++) {
+        const auto& st = spans[i];
         it = fmt::format_to(it,
                 "{:>5} {:>5} {:>5} {:>5} {:>5}\n",
                 i,
-                to_hr_size((uint64_t(1) << i) * page_size),
-                to_hr_size(free_pages * page_size),
-                to_hr_size((total_pages - free_pages) * page_size),
-                to_hr_number(total_spans));
+                to_hr_size(st.span_size),
+                to_hr_size(st.free_memory),
+                to_hr_size(st.used_memory),
+                to_hr_number(st.free_spans + st.used_spans));
     }
+    const auto largest = get_cpu_mem().largest_free_span();
+    it = fmt::format_to(it, "\nLargest free span: {}, free memory fragmentation: {}%\n",
+            to_hr_size(largest), free_mem ? unsigned(100 - largest * 100 / free_mem) : 0);
 
     return it;
 }
@@ -2200,6 +2562,21 @@ size_t sampled_memory_profile(allocation_site* output, size_t size) {
     return to_copy;
 }
 
+size_t scheduling_group_memory_usage(scheduling_group sg) noexcept {
+    return get_cpu_mem().group_sampled_size[seastar::internal::scheduling_group_index(sg)];
+}
+
+std::vector<allocation_site> sampled_cumulative_memory_profile() {
+    disable_backtrace_temporarily dbt;
+    auto& sites = get_cpu_mem().cumulative_asu.alloc_sites;
+    return std::vector<allocation_site>(sites.begin(), sites.end());
+}
+
+void reset_cumulative_memory_profile() {
+    disable_backtrace_temporarily dbt;
+    get_cpu_mem().cumulative_asu.alloc_sites.clear();
+}
+
 }
 
 }
@@ -2605,6 +2982,17 @@ size_t sampled_memory_profile(allocation_site* output, size_t size) {
     return 0;
 }
 
+size_t scheduling_group_memory_usage(scheduling_group sg) noexcept {
+    return 0;
+}
+
+std::vector<allocation_site> sampled_cumulative_memory_profile() {
+    return {};
+}
+
+void reset_cumulative_memory_profile() {
+}
+
 scoped_heap_profiling::scoped_heap_profiling(size_t sample_rate) noexcept {
     set_heap_profiling_sampling_rate(sample_rate); // let it print the warning
 }
@@ -2656,6 +3044,29 @@ bool drain_cross_cpu_freelist() {
     return false;
 }
 
+unsigned small_pool_count() {
+    return 0;
+}
+
+small_pool_statistics get_small_pool_statistics(unsigned idx) {
+    return {};
+}
+
+size_t largest_free_span() {
+    return 0;
+}
+
+fragmentation_report get_fragmentation_report() {
+    return {};
+}
+
+cross_shard_free_statistics cross_shard_free_stats(unsigned shard) {
+    return {};
+}
+
+void internal::set_shard_id(unsigned shard) noexcept {
+}
+
 memory_layout get_memory_layout() {
     throw std::runtime_error("get_memory_layout() not supported");
 }
@@ -2677,6 +3088,23 @@ size_t get_large_allocation_warning_threshold() {
     return std::numeric_limits<size_t>::max();
 }
 
+void set_huge_page_allocation_threshold(size_t) {
+    // Ignore, not supported for default allocator.
+}
+
+huge_page_statistics get_huge_page_statistics() {
+    return {};
+}
+
+size_t release_free_memory(size_t) {
+    // Ignore, not supported for default allocator.
+    return 0;
+}
+
+released_memory_statistics get_released_memory_statistics() {
+    return {};
+}
+
 void disable_large_allocation_warning() {
     // Ignore, not supported for default allocator.
 }
@@ -0,0 +1,221 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#include <algorithm>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/util/log.hh>
+
+#include "core/memory_pressure.hh"
+
+namespace seastar {
+
+namespace internal {
+
+memory_pressure_monitor::memory_pressure_monitor(double elevated_threshold, double critical_threshold) noexcept {
+    auto total = double(memory::stats().total_memory());
+    elevated_threshold = std::clamp(elevated_threshold, 0.0, 1.0);
+    critical_threshold = std::clamp(critical_threshold, 0.0, elevated_threshold);
+    auto set_limits = [&] (level l, double threshold) {
+        auto i = unsigned(l);
+        _enter_below[i] = size_t(total * threshold);
+        _leave_above[i] = size_t(total * threshold * 1.25);
+    };
+    set_limits(level::elevated, elevated_threshold);
+    set_limits(level::critical, critical_threshold);
+}
+
+bool memory_pressure_monitor::poll() noexcept {
+    auto free = memory::free_memory();
+    auto l = unsigned(_level);
+    while (l + 1 < nr_levels && free < _enter_below[l + 1]) {
+        ++l;
+    }
+    while (l > 0 && free > _leave_above[l]) {
+        --l;
+    }
+    bool changed = level(l) != _level;
+    if (changed) {
+        _level = level(l);
+        _stats.transitions[l]++;
+    }
+    changed |= poll_group_limits();
+    // Also retries starting a round that failed to start, e.g. for lack of
+    // memory to allocate it.
+    if (_notified_level != _level && !_dispatching) {
+        try {
+            _dispatching = true;
+            engine().run_in_background(dispatch());
+        } catch (...) {
+            _dispatching = false;
+        }
+    }
+    return changed;
+}
+
+future<> memory_pressure_monitor::dispatch() {
+    auto next_of = [this] (memory::pressure_listener& l) -> memory::pressure_listener* {
+        auto it = std::next(_listeners.iterator_to(l));
+        return it == _listeners.end() ? nullptr : &*it;
+    };
+    while (_notified_level != _level) {
+        auto l = _level;
+        _next = _listeners.empty() ? nullptr : &_listeners.front();
+        while (_next) {
+            auto& listener = *_next;
+            _next = next_of(listener);
+            try {
+                co_await futurize_invoke(listener._callback, l);
+            } catch (...) {
+                seastar_logger.warn("Memory pressure listener failed: {}", std::current_exception());
+            }
+        }
+        _notified_level = l;
+        _stats.notifications++;
+    }
+    _dispatching = false;
+}
+
+void memory_pressure_monitor::add(memory::pressure_listener& l) noexcept {
+    _listeners.push_back(l);
+}
+
+void memory_pressure_monitor::remove(memory::pressure_listener& l) noexcept {
+    if (_next == &l) {
+        auto it = std::next(_listeners.iterator_to(l));
+        _next = it == _listeners.end() ? nullptr : &*it;
+    }
+    _listeners.erase(_listeners.iterator_to(l));
+}
+
+bool memory_pressure_monitor::poll_group_limits() noexcept {
+    bool changed = false;
+    for (auto& l : _group_limits) {
+        auto usage = memory::scheduling_group_memory_usage(l._sg);
+        if (!l._exceeded && usage > l._limit) {
+            l._exceeded = true;
+            _stats.group_limits_exceeded++;
+            throttle(l);
+            notify_group_limit(l, usage);
+            changed = true;
+        } else if (l._exceeded && usage < l._limit - l._limit / 8) {
+            l._exceeded = false;
+            unthrottle(l);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void memory_pressure_monitor::notify_group_limit(memory::scheduling_group_soft_limit& l, size_t usage) noexcept {
+    if (l._notifying) {
+        // Still shedding memory from the last time
+        return;
+    }
+    try {
+        l._notifying = true;
+        engine().run_in_background(with_scheduling_group(l._sg, [w = l.weak_from_this(), usage] () mutable {
+            return run_group_limit_callback(std::move(w), usage);
+        }));
+    } catch (...) {
+        // Retried when the group exceeds the limit again
+        l._notifying = false;
+    }
+}
+
+future<> memory_pressure_monitor::run_group_limit_callback(weak_ptr<memory::scheduling_group_soft_limit> l, size_t usage) {
+    if (!l) {
+        co_return;
+    }
+    try {
+        co_await futurize_invoke(l->_callback, usage);
+    } catch (...) {
+        seastar_logger.warn("Scheduling group soft limit callback failed: {}", std::current_exception());
+    }
+    if (l) {
+        l->_notifying = false;
+    }
+}
+
+void memory_pressure_monitor::throttle(memory::scheduling_group_soft_limit& l) noexcept {
+    if (l._throttle_cpu_cap < 1.0f) {
+        l._saved_cpu_cap = l._sg.get_cpu_cap();
+        l._sg.set_cpu_cap(std::min(l._saved_cpu_cap, l._throttle_cpu_cap));
+    }
+}
+
+void memory_pressure_monitor::unthrottle(memory::scheduling_group_soft_limit& l) noexcept {
+    if (l._throttle_cpu_cap < 1.0f) {
+        l._sg.set_cpu_cap(l._saved_cpu_cap);
+    }
+}
+
+void memory_pressure_monitor::add(memory::scheduling_group_soft_limit& l) noexcept {
+    _group_limits.push_back(l);
+}
+
+void memory_pressure_monitor::remove(memory::scheduling_group_soft_limit& l) noexcept {
+    if (l._exceeded) {
+        unthrottle(l);
+    }
+    _group_limits.erase(_group_limits.iterator_to(l));
+}
+
+memory_pressure_monitor& memory_pressure_monitor::local() noexcept {
+    return *engine()._memory_pressure_monitor;
+}
+
+}
+
+namespace memory {
+
+pressure_level current_pressure_level() noexcept {
+    return seastar::internal::memory_pressure_monitor::local().current_level();
+}
+
+pressure_listener::pressure_listener(callback_type callback)
+    : _callback(std::move(callback))
+{
+    seastar::internal::memory_pressure_monitor::local().add(*this);
+}
+
+pressure_listener::~pressure_listener() {
+    seastar::internal::memory_pressure_monitor::local().remove(*this);
+}
+
+scheduling_group_soft_limit::scheduling_group_soft_limit(scheduling_group sg, size_t limit, callback_type callback, float throttle_cpu_cap)
+    : _sg(sg)
+    , _limit(limit)
+    , _callback(std::move(callback))
+    , _throttle_cpu_cap(throttle_cpu_cap)
+{
+    seastar::internal::memory_pressure_monitor::local().add(*this);
+}
+
+scheduling_group_soft_limit::~scheduling_group_soft_limit() {
+    seastar::internal::memory_pressure_monitor::local().remove(*this);
+}
+
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/intrusive/list.hpp>
+
+#include <seastar/core/memory_pressure.hh>
+
+namespace seastar::internal {
+
+// Tracks the memory pressure level of a shard and notifies the shard's
+// memory::pressure_listeners when it changes.
+//
+// The level is recomputed by poll(), which the reactor calls from a poller;
+// it only compares free memory against two precomputed limits, so it is
+// cheap enough to run on every iteration of the reactor loop. poll() also
+// checks the soft limits of the scheduling groups, which are few.
+class memory_pressure_monitor {
+public:
+    using level = memory::pressure_level;
+    static constexpr unsigned nr_levels = 3;
+    struct stats {
+        // Number of times each level was entered.
+        std::array<uint64_t, nr_levels> transitions = {};
+        uint64_t notifications = 0;
+        // Number of times a scheduling group exceeded its soft limit.
+        uint64_t group_limits_exceeded = 0;
+    };
+private:
+    using listener_list = boost::intrusive::list<memory::pressure_listener,
+            boost::intrusive::member_hook<memory::pressure_listener, boost::intrusive::list_member_hook<>, &memory::pressure_listener::_hook>,
+            boost::intrusive::constant_time_size<false>>;
+    listener_list _listeners;
+    using group_limit_list = boost::intrusive::list<memory::scheduling_group_soft_limit,
+            boost::intrusive::member_hook<memory::scheduling_group_soft_limit, boost::intrusive::list_member_hook<>, &memory::scheduling_group_soft_limit::_hook>,
+            boost::intrusive::constant_time_size<false>>;
+    group_limit_list _group_limits;
+    // The next listener to be notified by the running dispatch() round.
+    memory::pressure_listener* _next = nullptr;
+    // Free memory below which each level is entered, and above which it is
+    // left, indexed by level; entries for level::normal are unused.
+    std::array<size_t, nr_levels> _enter_below = {};
+    std::array<size_t, nr_levels> _leave_above = {};
+    level _level = level::normal;
+    level _notified_level = level::normal;
+    bool _dispatching = false;
+    stats _stats;
+private:
+    future<> dispatch();
+    bool poll_group_limits() noexcept;
+    void notify_group_limit(memory::scheduling_group_soft_limit& l, size_t usage) noexcept;
+    static future<> run_group_limit_callback(weak_ptr<memory::scheduling_group_soft_limit> l, size_t usage);
+    static void throttle(memory::scheduling_group_soft_limit& l) noexcept;
+    static void unthrottle(memory::scheduling_group_soft_limit& l) noexcept;
+public:
+    // Thresholds are fractions of the shard's memory.
+    memory_pressure_monitor(double elevated_threshold, double critical_threshold) noexcept;
+    memory_pressure_monitor(const memory_pressure_monitor&) = delete;
+    // Returns true if the level changed.
+    bool poll() noexcept;
+    level current_level() const noexcept { return _level; }
+    void add(memory::pressure_listener& l) noexcept;
+    void remove(memory::pressure_listener& l) noexcept;
+    void add(memory::scheduling_group_soft_limit& l) noexcept;
+    void remove(memory::scheduling_group_soft_limit& l) noexcept;
+    const stats& get_stats() const noexcept { return _stats; }
+    // The current shard's monitor.
+    static memory_pressure_monitor& local() noexcept;
+};
+
+}
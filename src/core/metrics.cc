@@ -26,6 +26,7 @@ module;
 #include <memory>
 #include <regex>
 #include <random>
+#include <unordered_set>
 #include <boost/range/algorithm.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -38,6 +39,7 @@ module seastar;
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/relabel_config.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/util/defer.hh>
 #endif
 
 namespace seastar {
@@ -181,14 +183,18 @@ static bool apply_relabeling(const relabel_config& rc, impl::metric_info& info)
         }
         case relabel_config::relabel_action::drop_label: {
             if (info.id.labels().find(rc.target_label) != info.id.labels().end()) {
-                info.id.labels().erase(rc.target_label);
+                auto labels = info.id.labels();
+                labels.erase(rc.target_label);
+                info.id.set_labels(labels);
             }
             return true;
         };
         case relabel_config::relabel_action::replace: {
             if (!rc.target_label.empty()) {
                 std::string fmt_s = match.format(rc.replacement);
-                info.id.labels()[rc.target_label] = fmt_s;
+                auto labels = info.id.labels();
+                labels[rc.target_label] = fmt_s;
+                info.id.set_labels(labels);
             }
             return true;
         }
@@ -214,12 +220,91 @@ static std::string get_unique_id() {
 label shard_label("shard");
 namespace impl {
 
+namespace {
+
+struct labels_ptr_hash {
+    using is_transparent = void;
+    size_t operator()(const labels_type& l) const noexcept {
+        return std::hash<labels_type>()(l);
+    }
+    size_t operator()(const lw_shared_ptr<const labels_type>& l) const noexcept {
+        return (*this)(*l);
+    }
+};
+
+struct labels_ptr_equal {
+    using is_transparent = void;
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const noexcept {
+        return deref(a) == deref(b);
+    }
+    static const labels_type& deref(const labels_type& l) noexcept { return l; }
+    static const labels_type& deref(const lw_shared_ptr<const labels_type>& l) noexcept { return *l; }
+};
+
+using label_table = std::unordered_set<lw_shared_ptr<const labels_type>, labels_ptr_hash, labels_ptr_equal>;
+
+// Set when the table is destroyed at thread exit, as the sets of
+// thread-local registrations may outlive it.
+thread_local bool label_table_destroyed = false;
+
+struct label_table_holder {
+    label_table table;
+    ~label_table_holder() {
+        label_table_destroyed = true;
+    }
+};
+
+label_table* local_label_table() {
+    static thread_local label_table_holder holder;
+    return label_table_destroyed ? nullptr : &holder.table;
+}
+
+const labels_type empty_labels;
+
+}
+
+interned_labels::interned_labels(const labels_type& labels) {
+    if (labels.empty()) {
+        return;
+    }
+    auto table = local_label_table();
+    if (!table) {
+        _labels = make_lw_shared<const labels_type>(labels);
+        return;
+    }
+    auto i = table->find(labels);
+    if (i == table->end()) {
+        i = table->insert(make_lw_shared<const labels_type>(labels)).first;
+    }
+    _labels = *i;
+}
+
+void interned_labels::release() noexcept {
+    // The table holds the other reference
+    if (_labels && _labels.use_count() == 2) {
+        if (auto table = local_label_table()) {
+            table->erase(_labels);
+        }
+    }
+    _labels = nullptr;
+}
+
+const labels_type& interned_labels::get() const noexcept {
+    return _labels ? *_labels : empty_labels;
+}
+
+size_t interned_label_sets() noexcept {
+    auto table = local_label_table();
+    return table ? table->size() : 0;
+}
+
 registered_metric::registered_metric(metric_id id, metric_function f, bool enabled, skip_when_empty skip) :
         _f(f), _impl(get_local_impl()) {
     _info.enabled = enabled;
     _info.should_skip_when_empty = skip;
     _info.id = id;
-    _info.original_labels = id.labels();
+    _info.original_labels = id.interned();
 }
 
 metric_value metric_value::operator+(const metric_value& c) {
@@ -359,6 +444,7 @@ void impl::remove_registration(const metric_id& id) {
             j->second = nullptr;
             i->second.erase(j);
         }
+        i->second.set_changed();
         if (i->second.empty()) {
             get_value_map().erase(i);
         }
@@ -401,33 +487,66 @@ instance_id_type shard() {
 
 void impl::update_metrics_if_needed() {
     if (_dirty) {
+        // Families which did not change are taken from the previous
+        // metadata: moved if no one else holds it, copied otherwise.
+        // Both are in _value_map order, and the previous one only has
+        // the families with enabled metrics.
         // Forcing the metadata to an empty initialization
         // Will prevent using corrupted data if an exception is thrown
-        _metadata = ::seastar::make_shared<metric_metadata>();
+        auto old = std::exchange(_metadata, ::seastar::make_shared<metric_metadata>());
+        auto old_functions = std::exchange(_current_metrics, {});
+        bool steal = old && old.use_count() == 1;
+        auto mark_all_changed = defer([this] () noexcept {
+            for (auto&& mf : _value_map) {
+                mf.second.set_changed();
+            }
+        });
 
         auto mt_ref = ::seastar::make_shared<metric_metadata>();
         auto &mt = *(mt_ref.get());
         mt.reserve(_value_map.size());
-        _current_metrics.resize(_value_map.size());
-        size_t i = 0;
+        std::vector<std::deque<metric_function>> current_metrics;
+        current_metrics.reserve(_value_map.size());
+        size_t j = 0;
         for (auto&& mf : _value_map) {
+            while (old && j < old->size() && (*old)[j].mf.name < mf.first) {
+                ++j;
+            }
+            bool in_old = old && j < old->size() && (*old)[j].mf.name == mf.first;
+            if (!mf.second.changed()) {
+                if (in_old) {
+                    if (steal) {
+                        mt.emplace_back(std::move((*old)[j]));
+                        current_metrics.emplace_back(std::move(old_functions[j]));
+                    } else {
+                        mt.emplace_back((*old)[j]);
+                        current_metrics.emplace_back(old_functions[j]);
+                    }
+                    // Kept up to date by set_metric_family_configs()
+                    mt.back().mf = mf.second.info();
+                }
+                continue;
+            }
             metric_metadata_fifo metrics;
-            _current_metrics[i].clear();
+            std::deque<metric_function> functions;
             for (auto&& m : mf.second) {
                 if (m.second && m.second->is_enabled()) {
                     metrics.emplace_back(m.second->info());
-                    _current_metrics[i].emplace_back(m.second->get_function());
+                    functions.emplace_back(m.second->get_function());
                 }
             }
             if (!metrics.empty()) {
                 // If nothing was added, no need to add the metric_family
                 // and no need to progress
                 mt.emplace_back(metric_family_metadata{mf.second.info(), std::move(metrics)});
-                i++;
+                current_metrics.emplace_back(std::move(functions));
             }
         }
-        // Maybe we didn't use all the original size
-        _current_metrics.resize(i);
+        mark_all_changed.cancel();
+        for (auto&& mf : _value_map) {
+            mf.second.set_changed(false);
+        }
+        _current_metrics = std::move(current_metrics);
         _metadata = mt_ref;
         _dirty = false;
     }
@@ -458,7 +577,8 @@ void impl::add_registration(const metric_id& id, const metric_type& type, metric
         if (metric.info().type != type.base_type) {
             throw std::runtime_error("registering metrics " + name + " registered with different type.");
         }
-        metric[rm->info().id.labels()] = rm;
+        metric[rm->info().id.interned()] = rm;
+        metric.set_changed();
         for (auto&& i : rm->info().id.labels()) {
             _labels.insert(i.first);
         }
@@ -469,7 +589,7 @@ void impl::add_registration(const metric_id& id, const metric_type& type, metric
         _value_map[name].info().name = id.full_name();
         _value_map[name].info().aggregate_labels = aggregate_labels;
         impl::update_aggregate(_value_map[name].info());
-        _value_map[name][rm->info().id.labels()] = rm;
+        _value_map[name][rm->info().id.interned()] = rm;
     }
     dirty();
 }
@@ -479,15 +599,16 @@ future<metric_relabeling_result> impl::set_relabel_configs(const std::vector<rel
     metric_relabeling_result conflicts{0};
     for (auto&& family : _value_map) {
         std::vector<shared_ptr<registered_metric>> rms;
+        // The relabeling may change anything, including which metrics are enabled
+        family.second.set_changed();
         for (auto&& metric = family.second.begin(); metric != family.second.end();) {
-            metric->second->info().id.labels().clear();
-            metric->second->info().id.labels() = metric->second->info().original_labels;
+            metric->second->info().id.set_labels(metric->second->info().original_labels);
             for (auto rl : _relabel_configs) {
                 if (apply_relabeling(rl, metric->second->info())) {
                     dirty();
                 }
             }
-            if (metric->first != metric->second->info().id.labels()) {
+            if (metric->first.get() != metric->second->info().id.labels()) {
                 // If a metric labels were changed, we should remove it from the map, and place it back again
                 rms.push_back(metric->second);
                 family.second.erase(metric++);
@@ -510,12 +631,13 @@ future<metric_relabeling_result> impl::set_relabel_configs(const std::vector<rel
                 auto id = get_unique_id();
                 lb["err"] = id;
                 conflicts.metrics_relabeled_due_to_collision++;
-                rm->info().id.labels()["err"] = id;
+                rm->info().id.set_labels(lb);
             }
 
-            family.second[lb] = rm;
+            family.second[rm->info().id.interned()] = rm;
         }
     }
+    dirty();
     return make_ready_future<metric_relabeling_result>(conflicts);
 }
 
@@ -584,6 +706,9 @@ histogram& histogram::operator+=(const histogram& c) {
     }
     sample_count += c.sample_count;
     sample_sum += c.sample_sum;
+    if (!native_histogram) {
+        native_histogram = c.native_histogram;
+    }
     return *this;
 }
 
@@ -0,0 +1,100 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <deque>
+#include <optional>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/offload.hh>
+#include <seastar/core/smp.hh>
+#endif
+
+namespace seastar {
+
+namespace {
+
+unsigned offload_shards = 0;
+unsigned offload_queue_depth = 0;
+
+// The requests the current shard may have in flight to each offload
+// shard. A deque, since semaphores can't be moved.
+struct offload_state {
+    std::deque<semaphore> units;
+    unsigned next = 0;
+};
+
+thread_local std::optional<offload_state> local_offload_state;
+
+}
+
+namespace internal {
+
+void configure_offload(unsigned shards, unsigned queue_depth) {
+    offload_shards = shards;
+    offload_queue_depth = queue_depth;
+}
+
+std::optional<offload_slot> pick_offload_slot() noexcept {
+    if (!offload_shards || is_offload_shard()) {
+        return std::nullopt;
+    }
+    if (!local_offload_state) [[unlikely]] {
+        try {
+            auto& s = local_offload_state.emplace();
+            for (unsigned i = 0; i < offload_shards; ++i) {
+                s.units.emplace_back(offload_queue_depth);
+            }
+        } catch (...) {
+            local_offload_state.reset();
+            return std::nullopt;
+        }
+    }
+    auto& s = *local_offload_state;
+    // Starting after the last pick spreads the work when the shards are
+    // equally loaded
+    unsigned best = s.next;
+    for (unsigned i = 1; i < offload_shards; ++i) {
+        auto j = (s.next + i) % offload_shards;
+        if (s.units[j].available_units() > s.units[best].available_units()) {
+            best = j;
+        }
+    }
+    s.next = (best + 1) % offload_shards;
+    return offload_slot{smp::count - offload_shards + best, s.units[best]};
+}
+
+}
+
+unsigned offload_shard_count() noexcept {
+    return offload_shards;
+}
+
+bool is_offload_shard(shard_id id) noexcept {
+    return id >= smp::count - offload_shards;
+}
+
+}
@@ -0,0 +1,521 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <boost/range/combine.hpp>
+#include <boost/range/irange.hpp>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/otlp.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/http/client.hh>
+#include <seastar/http/request.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/util/log.hh>
+#include <seastar/util/short_streams.hh>
+#endif
+
+#include "core/proto_writer.hh"
+
+namespace seastar {
+
+namespace otlp {
+
+namespace mi = metrics::impl;
+
+static logger otlp_logger("otlp");
+
+namespace {
+
+using internal::proto_writer;
+
+// The fields of the OTLP messages, from opentelemetry/proto/metrics/v1/metrics.proto
+// and its dependencies
+namespace field {
+// ExportMetricsServiceRequest
+constexpr uint32_t resource_metrics = 1;
+// ResourceMetrics
+constexpr uint32_t resource = 1;
+constexpr uint32_t scope_metrics = 2;
+// Resource
+constexpr uint32_t resource_attributes = 1;
+// ScopeMetrics
+constexpr uint32_t scope = 1;
+constexpr uint32_t metrics = 2;
+// InstrumentationScope
+constexpr uint32_t scope_name = 1;
+// KeyValue
+constexpr uint32_t key = 1;
+constexpr uint32_t value = 2;
+// AnyValue
+constexpr uint32_t string_value = 1;
+// Metric
+constexpr uint32_t name = 1;
+constexpr uint32_t description = 2;
+constexpr uint32_t gauge = 5;
+constexpr uint32_t sum = 7;
+constexpr uint32_t histogram = 9;
+constexpr uint32_t summary = 11;
+// Gauge, Sum, Histogram and Summary
+constexpr uint32_t data_points = 1;
+constexpr uint32_t aggregation_temporality = 2;
+// Sum
+constexpr uint32_t is_monotonic = 3;
+// NumberDataPoint, HistogramDataPoint and SummaryDataPoint
+constexpr uint32_t start_time_unix_nano = 2;
+constexpr uint32_t time_unix_nano = 3;
+// NumberDataPoint
+constexpr uint32_t as_double = 4;
+constexpr uint32_t as_int = 6;
+constexpr uint32_t number_attributes = 7;
+// HistogramDataPoint and SummaryDataPoint
+constexpr uint32_t count = 4;
+constexpr uint32_t point_sum = 5;
+// HistogramDataPoint
+constexpr uint32_t bucket_counts = 6;
+constexpr uint32_t explicit_bounds = 7;
+constexpr uint32_t histogram_attributes = 9;
+// SummaryDataPoint
+constexpr uint32_t quantile_values = 6;
+constexpr uint32_t summary_attributes = 7;
+// ValueAtQuantile
+constexpr uint32_t quantile = 1;
+constexpr uint32_t quantile_value = 2;
+}
+
+constexpr uint64_t aggregation_temporality_delta = 1;
+constexpr uint64_t aggregation_temporality_cumulative = 2;
+
+uint64_t unix_nano(std::chrono::system_clock::time_point t) noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+void write_attribute(proto_writer& w, uint32_t field, std::string_view key, std::string_view value) {
+    auto kv = w.begin(field);
+    w.string_field(field::key, key);
+    auto v = w.begin(field::value);
+    w.string_field(field::string_value, value);
+    w.end(v);
+    w.end(kv);
+}
+
+// The labels starting with "__" are internal, as for Prometheus
+void write_attributes(proto_writer& w, uint32_t field, const mi::labels_type& labels) {
+    for (auto& [key, value] : labels) {
+        if (!key.starts_with("__")) {
+            write_attribute(w, field, key, value);
+        }
+    }
+}
+
+uint32_t data_field(mi::data_type type) noexcept {
+    switch (type) {
+    case mi::data_type::GAUGE:
+        return field::gauge;
+    case mi::data_type::COUNTER:
+    case mi::data_type::REAL_COUNTER:
+        return field::sum;
+    case mi::data_type::HISTOGRAM:
+        return field::histogram;
+    case mi::data_type::SUMMARY:
+        return field::summary;
+    }
+    return field::gauge;
+}
+
+struct point_times {
+    uint64_t start;
+    uint64_t now;
+};
+
+// Writes the data point of a series, in the data of its metric
+void write_point(proto_writer& w, const mi::metric_value& value, const mi::labels_type& labels, point_times t) {
+    auto p = w.begin(field::data_points);
+    switch (value.type()) {
+    case mi::data_type::GAUGE:
+        write_attributes(w, field::number_attributes, labels);
+        w.fixed64_field(field::time_unix_nano, t.now);
+        w.double_field(field::as_double, value.d());
+        break;
+    case mi::data_type::COUNTER:
+        write_attributes(w, field::number_attributes, labels);
+        w.fixed64_field(field::start_time_unix_nano, t.start);
+        w.fixed64_field(field::time_unix_nano, t.now);
+        w.fixed64_field(field::as_int, uint64_t(value.i()));
+        break;
+    case mi::data_type::REAL_COUNTER:
+        write_attributes(w, field::number_attributes, labels);
+        w.fixed64_field(field::start_time_unix_nano, t.start);
+        w.fixed64_field(field::time_unix_nano, t.now);
+        w.double_field(field::as_double, value.d());
+        break;
+    case mi::data_type::HISTOGRAM: {
+        auto& h = value.get_histogram();
+        write_attributes(w, field::histogram_attributes, labels);
+        w.fixed64_field(field::start_time_unix_nano, t.start);
+        w.fixed64_field(field::time_unix_nano, t.now);
+        w.fixed64_field(field::count, h.sample_count);
+        w.double_field(field::point_sum, h.sample_sum);
+        // The buckets of seastar are cumulative, those of OTLP are not
+        // and end with the +Inf one
+        auto counts = w.begin(field::bucket_counts);
+        uint64_t previous = 0;
+        for (auto& b : h.buckets) {
+            w.raw_fixed64(b.count - previous);
+            previous = b.count;
+        }
+        w.raw_fixed64(h.sample_count - std::min(previous, h.sample_count));
+        w.end(counts);
+        auto bounds = w.begin(field::explicit_bounds);
+        for (auto& b : h.buckets) {
+            w.raw_double(b.upper_bound);
+        }
+        w.end(bounds);
+        break;
+    }
+    case mi::data_type::SUMMARY: {
+        auto& h = value.get_histogram();
+        write_attributes(w, field::summary_attributes, labels);
+        w.fixed64_field(field::start_time_unix_nano, t.start);
+        w.fixed64_field(field::time_unix_nano, t.now);
+        w.fixed64_field(field::count, h.sample_count);
+        w.double_field(field::point_sum, h.sample_sum);
+        for (auto& b : h.buckets) {
+            auto q = w.begin(field::quantile_values);
+            w.double_field(field::quantile, b.upper_bound);
+            w.double_field(field::quantile_value, b.count);
+            w.end(q);
+        }
+        break;
+    }
+    }
+    w.end(p);
+}
+
+// What was counted since previous, or all of current if it was reset
+mi::metric_value delta(const mi::metric_value& current, const mi::metric_value& previous) {
+    switch (current.type()) {
+    case mi::data_type::COUNTER:
+    case mi::data_type::REAL_COUNTER:
+        if (current.d() < previous.d()) {
+            return current;
+        }
+        return mi::metric_value(current.d() - previous.d(), current.type());
+    case mi::data_type::HISTOGRAM: {
+        auto& c = current.get_histogram();
+        auto& p = previous.get_histogram();
+        if (c.sample_count < p.sample_count || c.buckets.size() != p.buckets.size()) {
+            return current;
+        }
+        metrics::histogram h = c;
+        h.sample_count -= p.sample_count;
+        h.sample_sum -= p.sample_sum;
+        for (size_t i = 0; i < h.buckets.size(); ++i) {
+            h.buckets[i].count -= std::min(p.buckets[i].count, h.buckets[i].count);
+        }
+        return mi::metric_value(std::move(h), current.type());
+    }
+    case mi::data_type::GAUGE:
+    case mi::data_type::SUMMARY:
+        break;
+    }
+    return current;
+}
+
+bool has_delta(mi::data_type type) noexcept {
+    return type == mi::data_type::COUNTER || type == mi::data_type::REAL_COUNTER || type == mi::data_type::HISTOGRAM;
+}
+
+}
+
+/// \cond internal
+// The data points of the families of a shard, encoded on it
+struct shard_points {
+    struct family {
+        const mi::metric_family_info* info;
+        std::string points;
+        // The series summed over the labels the family aggregates
+        std::unordered_map<mi::labels_type, mi::metric_value> aggregated;
+    };
+    foreign_ptr<mi::values_reference> values;
+    point_times times;
+    std::vector<family> families;
+};
+
+// The state of the exporter on a shard: the values of the previous push,
+// to send the deltas from
+class shard_exporter {
+    using series_values = std::unordered_map<sstring, std::unordered_map<mi::labels_type, mi::metric_value>>;
+    const temporality _temporality;
+    const bool _aggregate;
+    const std::chrono::system_clock::time_point _started = std::chrono::system_clock::now();
+    std::chrono::system_clock::time_point _pushed = _started;
+    series_values _pushed_values;
+    // Those of the push in progress, kept once it succeeds
+    std::chrono::system_clock::time_point _pending = _started;
+    series_values _pending_values;
+public:
+    shard_exporter(temporality t, bool aggregate) : _temporality(t), _aggregate(aggregate) {}
+
+    future<foreign_ptr<std::unique_ptr<shard_points>>> encode(std::chrono::system_clock::time_point now);
+
+    void commit() noexcept {
+        _pushed = _pending;
+        _pushed_values = std::move(_pending_values);
+        _pending_values.clear();
+    }
+
+    future<> stop() {
+        return make_ready_future<>();
+    }
+};
+/// \endcond
+
+future<foreign_ptr<std::unique_ptr<shard_points>>> shard_exporter::encode(std::chrono::system_clock::time_point now) {
+    return seastar::async([this, now] {
+        bool deltas = _temporality == temporality::delta;
+        point_times times{unix_nano(deltas ? _pushed : _started), unix_nano(now)};
+        auto result = std::make_unique<shard_points>();
+        result->times = times;
+        result->values = mi::get_values();
+        auto& metadata = *result->values->metadata;
+        _pending = now;
+        _pending_values.clear();
+        for (size_t i = 0; i < metadata.size(); ++i) {
+            auto& mf = metadata[i].mf;
+            auto& family = result->families.emplace_back(&mf);
+            proto_writer w(family.points);
+            bool aggregate = _aggregate && !mf.aggregate_labels.empty();
+            bool track = deltas && has_delta(mf.type);
+            auto* previous = track ? &_pushed_values[mf.name] : nullptr;
+            auto* pending = track ? &_pending_values[mf.name] : nullptr;
+            for (auto&& vm : boost::combine(result->values->values[i], metadata[i].metrics)) {
+                const mi::metric_value& current = boost::get<0>(vm);
+                const mi::metric_info& info = boost::get<1>(vm);
+                auto& labels = info.id.labels();
+                mi::metric_value value = current;
+                if (track) {
+                    auto p = previous->find(labels);
+                    if (p != previous->end()) {
+                        value = delta(current, p->second);
+                    }
+                    pending->insert_or_assign(labels, current);
+                }
+                if (info.should_skip_when_empty && current.is_empty()) {
+                    continue;
+                }
+                if (aggregate) {
+                    auto key = labels;
+                    for (auto& l : mf.aggregate_labels) {
+                        key.erase(l);
+                    }
+                    auto a = family.aggregated.find(key);
+                    if (a == family.aggregated.end()) {
+                        family.aggregated.emplace(std::move(key), std::move(value));
+                    } else {
+                        a->second += value;
+                    }
+                } else {
+                    write_point(w, value, labels, times);
+                }
+                thread::maybe_yield();
+            }
+        }
+        return make_foreign(std::move(result));
+    });
+}
+
+exporter::exporter(config cfg)
+        : _cfg(std::move(cfg))
+        , _client(_cfg.credentials
+                ? std::make_unique<http::experimental::client>(_cfg.address, _cfg.credentials, _cfg.host)
+                : std::make_unique<http::experimental::client>(_cfg.address)) {
+}
+
+exporter::exporter(config cfg, std::unique_ptr<http::experimental::connection_factory> factory)
+        : _cfg(std::move(cfg))
+        , _client(std::make_unique<http::experimental::client>(std::move(factory))) {
+}
+
+exporter::~exporter() = default;
+
+future<> exporter::start() {
+    // Not the config, the credentials of which are not to be shared
+    co_await _shards.start(_cfg.temporality, _cfg.aggregate);
+    _loop = run();
+}
+
+future<> exporter::run() {
+    while (!_as.abort_requested()) {
+        try {
+            co_await sleep_abortable(std::chrono::duration_cast<std::chrono::steady_clock::duration>(_cfg.interval), _as);
+        } catch (const sleep_aborted&) {
+            break;
+        }
+        try {
+            co_await push();
+        } catch (...) {
+            otlp_logger.warn("Failed to push the metrics to {}: {}", _cfg.address, std::current_exception());
+        }
+    }
+}
+
+future<sstring> exporter::encode() {
+    auto now = std::chrono::system_clock::now();
+    std::vector<foreign_ptr<std::unique_ptr<shard_points>>> shards(smp::count);
+    co_await parallel_for_each(boost::irange(0u, smp::count), [this, &shards, now] (unsigned cpu) {
+        return _shards.invoke_on(cpu, [now] (shard_exporter& e) {
+            return e.encode(now);
+        }).then([&shards, cpu] (foreign_ptr<std::unique_ptr<shard_points>> points) {
+            shards[cpu] = std::move(points);
+        });
+    });
+
+    bool deltas = _cfg.temporality == temporality::delta;
+    std::string out;
+    proto_writer w(out);
+    auto rm = w.begin(field::resource_metrics);
+    auto r = w.begin(field::resource);
+    bool has_service_name = false;
+    for (auto& [key, value] : _cfg.resource_attributes) {
+        write_attribute(w, field::resource_attributes, key, value);
+        has_service_name |= key == "service.name";
+    }
+    if (!has_service_name) {
+        write_attribute(w, field::resource_attributes, "service.name", _cfg.service_name);
+    }
+    w.end(r);
+    auto sm = w.begin(field::scope_metrics);
+    auto scope = w.begin(field::scope);
+    w.string_field(field::scope_name, "seastar");
+    w.end(scope);
+
+    // The families are sorted by name on each shard
+    std::vector<size_t> positions(smp::count, 0);
+    std::vector<const shard_points::family*> families;
+    for (;;) {
+        const sstring* family_name = nullptr;
+        for (unsigned i = 0; i < smp::count; ++i) {
+            if (positions[i] < shards[i]->families.size()) {
+                auto& n = shards[i]->families[positions[i]].info->name;
+                if (!family_name || n < *family_name) {
+                    family_name = &n;
+                }
+            }
+        }
+        if (!family_name) {
+            break;
+        }
+        families.clear();
+        bool empty = true;
+        for (unsigned i = 0; i < smp::count; ++i) {
+            if (positions[i] < shards[i]->families.size() && shards[i]->families[positions[i]].info->name == *family_name) {
+                auto& family = shards[i]->families[positions[i]++];
+                families.push_back(&family);
+                empty &= family.points.empty() && family.aggregated.empty();
+            }
+        }
+        if (empty) {
+            continue;
+        }
+        auto& info = *families.front()->info;
+        auto m = w.begin(field::metrics);
+        w.string_field(field::name, _cfg.prefix.empty() ? info.name : _cfg.prefix + "_" + info.name);
+        if (!info.d.str().empty()) {
+            w.string_field(field::description, info.d.str());
+        }
+        auto data = w.begin(data_field(info.type));
+        std::unordered_map<mi::labels_type, mi::metric_value> aggregated;
+        for (auto family : families) {
+            w.raw(family->points);
+            for (auto& [labels, value] : family->aggregated) {
+                auto a = aggregated.find(labels);
+                if (a == aggregated.end()) {
+                    aggregated.emplace(labels, value);
+                } else {
+                    a->second += value;
+                }
+            }
+        }
+        for (auto& [labels, value] : aggregated) {
+            // The shards pushed last together
+            write_point(w, value, labels, shards.front()->times);
+            co_await coroutine::maybe_yield();
+        }
+        if (info.type != mi::data_type::GAUGE && info.type != mi::data_type::SUMMARY) {
+            w.uint_field(field::aggregation_temporality, deltas ? aggregation_temporality_delta : aggregation_temporality_cumulative);
+        }
+        if (info.type == mi::data_type::COUNTER || info.type == mi::data_type::REAL_COUNTER) {
+            w.uint_field(field::is_monotonic, 1);
+        }
+        w.end(data);
+        w.end(m);
+    }
+    w.end(sm);
+    w.end(rm);
+    co_return sstring(out.data(), out.size());
+}
+
+future<> exporter::push() {
+    auto body = co_await encode();
+    auto req = http::request::make("POST", _cfg.host.empty() ? sstring(fmt::to_string(_cfg.address)) : _cfg.host, _cfg.path);
+    req.write_body("bin", std::move(body));
+    req.set_mime_type("application/x-protobuf");
+    co_await _client->make_request(std::move(req), [] (const http::reply&, input_stream<char>&& body) {
+        return do_with(std::move(body), [] (input_stream<char>& body) {
+            return util::skip_entire_stream(body);
+        });
+    }, http::reply::status_type::ok);
+    // Sending deltas from what was sent
+    co_await _shards.invoke_on_all([] (shard_exporter& e) {
+        e.commit();
+    });
+}
+
+future<> exporter::stop() {
+    _as.request_abort();
+    if (_loop) {
+        co_await std::exchange(_loop, std::nullopt).value();
+    }
+    co_await _client->close();
+    co_await _shards.stop();
+}
+
+}
+
+}
@@ -35,8 +35,12 @@ namespace seastar::internal {
 class memory_prefaulter {
     std::atomic<bool> _stop_request = false;
     std::vector<posix_thread> _worker_threads;
-    // Keep this in object scope to avoid allocating in worker thread
-    std::unordered_map<unsigned, std::vector<memory::internal::memory_range>> _layout_by_node_id;
+    // The ranges of each worker, kept in object scope to avoid allocating in
+    // worker thread. A node's ranges are split among several workers when it
+    // has many cpus, one thread faulting in a few hundred gigabytes taking minutes
+    std::vector<std::vector<memory::internal::memory_range>> _ranges_by_worker;
+    // A worker for that many cpus of a node
+    static constexpr unsigned cpus_per_worker = 8;
 public:
     explicit memory_prefaulter(const resource::resources& res, memory::internal::numa_layout layout);
     ~memory_prefaulter();
@@ -0,0 +1,237 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/priority_semaphore.hh>
+#include <seastar/util/exception_ptr.hh>
+#endif
+
+namespace seastar {
+
+void priority_semaphore::expiry_handler::operator()(entry& e) noexcept {
+    if (e.timer) {
+        e.pr.set_exception(cached_exception_ptr<semaphore_timed_out>());
+    } else if (sem._ex) {
+        e.pr.set_exception(sem._ex);
+    } else {
+        e.pr.set_exception(cached_exception_ptr<semaphore_aborted>());
+    }
+}
+
+priority_semaphore::priority_semaphore(size_t count, config cfg) noexcept
+        : _count(count)
+        , _cfg(std::move(cfg)) {
+}
+
+priority_semaphore::~priority_semaphore() {
+    assert(empty() && "priority_semaphore destroyed with waiters");
+}
+
+priority_semaphore::priority_class& priority_semaphore::class_of(scheduling_group sg) {
+    auto& c = _classes[internal::scheduling_group_index(sg)];
+    if (!c) {
+        c = std::make_unique<priority_class>(*this);
+    }
+    // Shares may have changed since it last waited
+    c->shares = std::max(sg.get_shares(), 1.0f);
+    return *c;
+}
+
+bool priority_semaphore::empty() const noexcept {
+    return std::all_of(_classes.begin(), _classes.end(), [] (const std::unique_ptr<priority_class>& c) {
+        return !c || c->waiters.empty();
+    });
+}
+
+size_t priority_semaphore::waiters() const noexcept {
+    size_t n = 0;
+    for (auto& c : _classes) {
+        if (c) {
+            n += c->waiters.size();
+        }
+    }
+    return n;
+}
+
+priority_semaphore::priority_class* priority_semaphore::aged(time_point now) const noexcept {
+    priority_class* oldest = nullptr;
+    for (auto& c : _classes) {
+        if (c && !c->waiters.empty() && (!oldest || c->waiters.front().since < oldest->waiters.front().since)) {
+            oldest = c.get();
+        }
+    }
+    if (oldest && now - oldest->waiters.front().since > _cfg.max_wait) {
+        return oldest;
+    }
+    return nullptr;
+}
+
+bool priority_semaphore::may_proceed(size_t nr, time_point now) const noexcept {
+    if (!has_available_units(nr)) {
+        return false;
+    }
+    if (empty()) {
+        return true;
+    }
+    return nr <= _cfg.small_request_bypass && !aged(now);
+}
+
+void priority_semaphore::consume_for(priority_class& c, size_t nr) noexcept {
+    _count -= nr;
+    c.vtime += nr / c.shares;
+    _vtime = c.vtime;
+}
+
+void priority_semaphore::serve(priority_class& c, time_point now) noexcept {
+    auto& e = c.waiters.front();
+    consume_for(c, e.nr);
+    c.stats.waits++;
+    c.stats.wait_time.add(now - e.since);
+    e.pr.set_value();
+    c.waiters.pop_front();
+}
+
+void priority_semaphore::wake_waiters() noexcept {
+    auto now = clock::now();
+    while (true) {
+        auto next = aged(now);
+        if (next) {
+            next->stats.aged++;
+        } else {
+            for (auto& c : _classes) {
+                if (c && !c->waiters.empty() && (!next || c->vtime < next->vtime)) {
+                    next = c.get();
+                }
+            }
+        }
+        if (!next) {
+            return;
+        }
+        if (has_available_units(next->waiters.front().nr)) {
+            serve(*next, now);
+            continue;
+        }
+        // The waiters for few units at the front of the other classes go
+        // around it, unless it waited for too long already
+        if (_cfg.small_request_bypass && !aged(now)) {
+            for (auto& c : _classes) {
+                while (c && !c->waiters.empty() && c->waiters.front().nr <= _cfg.small_request_bypass
+                        && has_available_units(c->waiters.front().nr)) {
+                    c->stats.bypasses++;
+                    serve(*c, now);
+                }
+            }
+        }
+        return;
+    }
+}
+
+future<> priority_semaphore::wait(scheduling_group sg, time_point timeout, abort_source* as, size_t nr) noexcept {
+    if (_ex) {
+        return make_exception_future(_ex);
+    }
+    try {
+        auto now = clock::now();
+        auto& c = class_of(sg);
+        if (may_proceed(nr, now)) {
+            if (!empty()) {
+                c.stats.bypasses++;
+            }
+            consume_for(c, nr);
+            return make_ready_future<>();
+        }
+        if (c.waiters.empty()) {
+            // No credit for the time it did not wait
+            c.vtime = std::max(c.vtime, _vtime);
+        }
+        entry& e = c.waiters.emplace_back(promise<>(), nr, now);
+        auto f = e.pr.get_future();
+        if (as) {
+            c.waiters.make_back_abortable(*as);
+        } else if (timeout != time_point::max()) {
+            e.timer.emplace(timeout);
+            c.waiters.make_back_abortable(e.timer->abort_source());
+        }
+        return f;
+    } catch (...) {
+        return current_exception_as_future();
+    }
+}
+
+bool priority_semaphore::try_wait(size_t nr) noexcept {
+    if (_ex || !may_proceed(nr, clock::now())) {
+        return false;
+    }
+    priority_class* c;
+    try {
+        c = &class_of(current_scheduling_group());
+    } catch (...) {
+        return false;
+    }
+    if (!empty()) {
+        c->stats.bypasses++;
+    }
+    consume_for(*c, nr);
+    return true;
+}
+
+void priority_semaphore::signal(size_t nr) noexcept {
+    if (_ex) {
+        return;
+    }
+    _count += nr;
+    wake_waiters();
+}
+
+void priority_semaphore::consume(size_t nr) noexcept {
+    if (_ex) {
+        return;
+    }
+    _count -= nr;
+}
+
+void priority_semaphore::broken(std::exception_ptr ex) noexcept {
+    _ex = ex;
+    _count = 0;
+    for (auto& c : _classes) {
+        while (c && !c->waiters.empty()) {
+            c->waiters.front().pr.set_exception(ex);
+            c->waiters.pop_front();
+        }
+    }
+}
+
+const priority_semaphore::class_stats& priority_semaphore::get_stats(scheduling_group sg) const noexcept {
+    static const class_stats none;
+    auto& c = _classes[internal::scheduling_group_index(sg)];
+    return c ? c->stats : none;
+}
+
+}
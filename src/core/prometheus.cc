@@ -34,6 +34,9 @@
 #include <boost/range/combine.hpp>
 #include <seastar/core/thread.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/vector-data-sink.hh>
 #include <regex>
 
 namespace seastar {
@@ -180,10 +183,10 @@ static void fill_metric(pm::MetricFamily& mf, const metrics::impl::metric_value&
         auto mh = add_label(mf.add_metric(), id,ctx)->mutable_histogram();
         mh->set_sample_count(h.sample_count);
         mh->set_sample_sum(h.sample_sum);
+        // Both, for the servers which do not scrape native histograms
+        fill_old_type_histogram(h, mh);
         if (h.native_histogram) {
             fill_native_type_histogram(h, mh);
-        } else {
-            fill_old_type_histogram(h, mh);
         }
         mf.set_type(pm::MetricType::HISTOGRAM);
         break;
@@ -735,30 +738,54 @@ std::string get_value_as_string(std::stringstream& s, const mi::metric_value& va
     return value_str;
 }
 
-future<> write_text_representation(output_stream<char>& out, const config& ctx, const metric_family_range& m, bool show_help, bool enable_aggregation, std::function<bool(const mi::labels_type&)> filter) {
-    return seastar::async([&ctx, &out, &m, show_help, enable_aggregation, filter] () mutable {
+/*!
+ * \brief the text of the series of one shard
+ *
+ * Each shard formats its own series, family by family, for the shard
+ * serving the scrape to only write the text of the shards one after the
+ * other, rather than format the series of all of them. The series a family
+ * aggregates are summed on each shard, and the sums of the shards summed by
+ * the serving shard.
+ */
+struct shard_text {
+    struct family {
+        const mi::metric_family_info* info;
+        // Whether any of the series passed the filter
         bool found = false;
+        std::string text;
+        metric_aggregate_by_labels aggregated;
+
+        family(const mi::metric_family_info& info)
+                : info(&info), aggregated(info.aggregate_labels) {
+        }
+    };
+    foreign_ptr<mi::values_reference> values;
+    std::vector<family> families;
+};
+
+static future<foreign_ptr<std::unique_ptr<shard_text>>> format_shard_text(const config& ctx, const sstring& metric_family_name, bool prefix, bool enable_aggregation, const std::function<bool(const mi::labels_type&)>& filter) {
+    return seastar::async([&ctx, &metric_family_name, prefix, enable_aggregation, &filter] {
+        auto result = std::make_unique<shard_text>();
+        result->values = mi::get_values();
+        auto& metadata = *result->values->metadata;
         std::stringstream s;
-        for (metric_family& metric_family : m) {
-            auto name = ctx.prefix + "_" + metric_family.name();
-            found = false;
-            metric_aggregate_by_labels aggregated_values(metric_family.metadata().aggregate_labels);
-            bool should_aggregate = enable_aggregation && !metric_family.metadata().aggregate_labels.empty();
-            metric_family.foreach_metric([&s, &out, &ctx, &found, &name, &metric_family, &aggregated_values, should_aggregate, show_help, &filter](const mi::metric_value& value, const mi::metric_info& value_info) mutable {
-                s.clear();
-                s.str("");
+        for (size_t i = 0; i < metadata.size(); ++i) {
+            auto& mf = metadata[i].mf;
+            if (!metric_family_name.empty() && !(prefix ? mf.name.starts_with(metric_family_name) : mf.name == metric_family_name)) {
+                continue;
+            }
+            auto& family = result->families.emplace_back(mf);
+            auto name = ctx.prefix + "_" + mf.name;
+            bool should_aggregate = enable_aggregation && !mf.aggregate_labels.empty();
+            for (auto&& vm : boost::combine(result->values->values[i], metadata[i].metrics)) {
+                auto& value = boost::get<0>(vm);
+                auto& value_info = boost::get<1>(vm);
                 if ((value_info.should_skip_when_empty && value.is_empty()) || !filter(value_info.id.labels())) {
-                    return;
-                }
-                if (!found) {
-                    if (show_help && metric_family.metadata().d.str() != "") {
-                        s << "# HELP " << name << " " <<  metric_family.metadata().d.str() << '\n';
-                    }
-                    s << "# TYPE " << name << " " << to_str(metric_family.metadata().type) << '\n';
-                    found = true;
+                    continue;
                 }
+                family.found = true;
                 if (should_aggregate) {
-                    aggregated_values.add(value, value_info.id.labels());
+                    family.aggregated.add(value, value_info.id.labels());
                 } else if (value.type() == mi::data_type::SUMMARY) {
                     write_summary(s, ctx, name, value.get_histogram(), value_info.id.labels());
                 } else if (value.type() == mi::data_type::HISTOGRAM) {
@@ -767,23 +794,82 @@ future<> write_text_representation(output_stream<char>& out, const config& ctx,
                     add_name(s, name, value_info.id.labels(), ctx);
                     s << get_value_as_string(s, value) << '\n';
                 }
-                out.write(s.str()).get();
                 thread::maybe_yield();
+            }
+            family.text = std::move(s).str();
+            s.str("");
+        }
+        return make_foreign(std::move(result));
+    });
+}
+
+future<> write_text_representation(output_stream<char>& out, const config& ctx, const sstring& metric_family_name, bool prefix, bool show_help, bool enable_aggregation, std::function<bool(const mi::labels_type&)> filter) {
+    return seastar::async([&ctx, &out, &metric_family_name, prefix, show_help, enable_aggregation, filter = std::move(filter)] {
+        std::vector<foreign_ptr<std::unique_ptr<shard_text>>> shards(smp::count);
+        parallel_for_each(boost::irange(0u, smp::count), [&] (unsigned cpu) {
+            return smp::submit_to(cpu, [&] {
+                return format_shard_text(ctx, metric_family_name, prefix, enable_aggregation, filter);
+            }).then([&shards, cpu] (foreign_ptr<std::unique_ptr<shard_text>> text) {
+                shards[cpu] = std::move(text);
             });
-            if (!aggregated_values.empty()) {
-                for (auto&& h : aggregated_values.get_values()) {
-                    s.clear();
-                    s.str("");
-                    if (h.second.type() == mi::data_type::HISTOGRAM) {
-                        write_histogram(s, ctx, name, h.second.get_histogram(), h.first);
-                    } else {
-                        add_name(s, name, h.first, ctx);
-                        s << get_value_as_string(s, h.second) << '\n';
+        }).get();
+
+        // The families are sorted by name on each shard
+        std::vector<size_t> positions(smp::count, 0);
+        std::vector<const shard_text::family*> families;
+        std::stringstream s;
+        for (;;) {
+            const sstring* family_name = nullptr;
+            for (unsigned i = 0; i < smp::count; ++i) {
+                if (positions[i] < shards[i]->families.size()) {
+                    auto& n = shards[i]->families[positions[i]].info->name;
+                    if (!family_name || n < *family_name) {
+                        family_name = &n;
                     }
-                    out.write(s.str()).get();
-                    thread::maybe_yield();
                 }
             }
+            if (!family_name) {
+                break;
+            }
+            families.clear();
+            bool found = false;
+            for (unsigned i = 0; i < smp::count; ++i) {
+                if (positions[i] < shards[i]->families.size() && shards[i]->families[positions[i]].info->name == *family_name) {
+                    auto& family = shards[i]->families[positions[i]++];
+                    families.push_back(&family);
+                    found |= family.found;
+                }
+            }
+            if (!found) {
+                continue;
+            }
+            auto& info = *families.front()->info;
+            auto name = ctx.prefix + "_" + info.name;
+            if (show_help && info.d.str() != "") {
+                out.write_formatted("# HELP {} {}\n", name, info.d.str()).get();
+            }
+            out.write_formatted("# TYPE {} {}\n", name, to_str(info.type)).get();
+            metric_aggregate_by_labels aggregated_values(info.aggregate_labels);
+            for (auto family : families) {
+                if (!family->text.empty()) {
+                    out.write(family->text.data(), family->text.size()).get();
+                }
+                for (auto&& [labels, value] : family->aggregated.get_values()) {
+                    aggregated_values.add(value, labels);
+                }
+            }
+            for (auto&& h : aggregated_values.get_values()) {
+                s.clear();
+                s.str("");
+                if (h.second.type() == mi::data_type::HISTOGRAM) {
+                    write_histogram(s, ctx, name, h.second.get_histogram(), h.first);
+                } else {
+                    add_name(s, name, h.first, ctx);
+                    s << get_value_as_string(s, h.second) << '\n';
+                }
+                out.write(s.str()).get();
+                thread::maybe_yield();
+            }
         }
     });
 }
@@ -837,8 +923,15 @@ bool is_accept_protobuf(const std::string& accept) {
 }
 
 class metrics_handler : public httpd::handler_base  {
+    using cached_body = shared_future<lw_shared_ptr<std::vector<net::packet>>>;
+    struct cached_reply {
+        lowres_clock::time_point expires;
+        cached_body body;
+    };
+
     sstring _prefix;
     config _ctx;
+    std::unordered_map<sstring, cached_reply> _cache;
     static std::function<bool(const mi::labels_type&)> _true_function;
 
     /*!
@@ -887,6 +980,48 @@ class metrics_handler : public httpd::handler_base  {
         };
     }
 
+    future<> write_metrics(output_stream<char>& s, bool is_protobuf_format, const sstring& metric_family_name, bool prefix, bool show_help, bool enable_aggregation, std::function<bool(const mi::labels_type&)> filter) {
+        if (!is_protobuf_format) {
+            return write_text_representation(s, _ctx, metric_family_name, prefix, show_help, enable_aggregation, std::move(filter));
+        }
+        return do_with(metrics_families_per_shard(), [this, &s, &metric_family_name, prefix, enable_aggregation, filter = std::move(filter)] (metrics_families_per_shard& families) mutable {
+            return get_map_value(families).then([this, &s, &families, &metric_family_name, prefix, enable_aggregation, filter = std::move(filter)] () mutable {
+                return do_with(get_range(families, metric_family_name, prefix), [this, &s, enable_aggregation, filter = std::move(filter)] (metric_family_range& m) mutable {
+                    return write_protobuf_representation(s, _ctx, m, enable_aggregation, std::move(filter));
+                });
+            });
+        });
+    }
+
+    /*!
+     * \brief the reply to the requests for \c key, rendered once per
+     * config::cache_interval for all the scrapers sending them
+     */
+    cached_body get_cached(sstring key, std::function<future<>(output_stream<char>&)> render) {
+        auto now = lowres_clock::now();
+        auto i = _cache.find(key);
+        if (i != _cache.end() && i->second.expires > now) {
+            return i->second.body;
+        }
+        std::erase_if(_cache, [now] (const auto& entry) { return entry.second.expires <= now; });
+        auto packets = make_lw_shared<std::vector<net::packet>>();
+        auto body = do_with(output_stream<char>(data_sink(std::make_unique<vector_data_sink>(*packets))), std::move(render),
+                [] (output_stream<char>& s, std::function<future<>(output_stream<char>&)>& render) {
+            return render(s).finally([&s] {
+                return s.close();
+            });
+        }).then([packets] {
+            return packets;
+        }).handle_exception([this, key] (std::exception_ptr ex) {
+            // Rendering again on the next request
+            _cache.erase(key);
+            return make_exception_future<lw_shared_ptr<std::vector<net::packet>>>(std::move(ex));
+        });
+        cached_body cached(std::move(body));
+        _cache.insert_or_assign(std::move(key), cached_reply{now + _ctx.cache_interval, cached});
+        return cached;
+    }
+
 public:
     metrics_handler(config ctx) : _ctx(ctx) {}
 
@@ -898,16 +1033,33 @@ class metrics_handler : public httpd::handler_base  {
         bool show_help = req->get_query_param("__help__") != "false";
         bool enable_aggregation = req->get_query_param("__aggregate__") != "false";
         std::function<bool(const mi::labels_type&)> filter = make_filter(*req);
-        rep->write_body(is_protobuf_format ? "proto" : "txt", [this, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, filter] (output_stream<char>&& s) {
-            return do_with(metrics_families_per_shard(), output_stream<char>(std::move(s)),
-                    [this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, filter] (metrics_families_per_shard& families, output_stream<char>& s) mutable {
-                return get_map_value(families).then([&s, &families, this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, filter]() mutable {
-                    return do_with(get_range(families, metric_family_name, prefix),
-                            [&s, this, is_protobuf_format, show_help, enable_aggregation, filter](metric_family_range& m) {
-                        return (is_protobuf_format) ?  write_protobuf_representation(s, _ctx, m, enable_aggregation, filter) :
-                                write_text_representation(s, _ctx, m, show_help, enable_aggregation, filter);
+        if (_ctx.cache_interval.count() > 0) {
+            std::vector<std::pair<sstring, sstring>> params(req->query_parameters.begin(), req->query_parameters.end());
+            std::sort(params.begin(), params.end());
+            sstring key = is_protobuf_format ? "proto" : "txt";
+            for (auto& [name, value] : params) {
+                key += "&" + name + "=" + value;
+            }
+            auto body = get_cached(std::move(key), [this, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, filter] (output_stream<char>& s) {
+                return write_metrics(s, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, filter);
+            });
+            rep->write_body(is_protobuf_format ? "proto" : "txt", [body = std::move(body)] (output_stream<char>&& s) mutable {
+                return do_with(output_stream<char>(std::move(s)), [body = std::move(body)] (output_stream<char>& s) mutable {
+                    return body.get_future().then([&s] (lw_shared_ptr<std::vector<net::packet>> packets) {
+                        return do_for_each(*packets, [&s] (net::packet& p) {
+                            return s.write(p.share());
+                        });
+                    }).finally([&s] {
+                        return s.close();
                     });
-                }).finally([&s] () mutable {
+                });
+            });
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }
+        rep->write_body(is_protobuf_format ? "proto" : "txt", [this, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, filter] (output_stream<char>&& s) {
+            return do_with(output_stream<char>(std::move(s)),
+                    [this, is_protobuf_format, &metric_family_name, prefix, show_help, enable_aggregation, filter] (output_stream<char>& s) mutable {
+                return write_metrics(s, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, std::move(filter)).finally([&s] () mutable {
                     return s.close();
                 });
             });
@@ -0,0 +1,110 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <seastar/core/byteorder.hh>
+
+namespace seastar {
+
+namespace internal {
+
+// The protobuf encoding of messages, written by hand for the few fields of
+// the messages seastar sends, rather than generate the code of their .proto
+// files
+class proto_writer {
+    std::string& _out;
+
+    enum wire_type : uint8_t {
+        varint_type = 0,
+        i64_type = 1,
+        len_type = 2,
+    };
+    // The size of the length of the nested messages, reserved before they
+    // are written; protobuf takes the varints padded with 0x80 bytes
+    static constexpr size_t nested_size_bytes = 5;
+
+    void tag(uint32_t field, wire_type type) {
+        varint((uint64_t(field) << 3) | type);
+    }
+public:
+    explicit proto_writer(std::string& out) noexcept : _out(out) {}
+
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            _out.push_back(char(v | 0x80));
+            v >>= 7;
+        }
+        _out.push_back(char(v));
+    }
+    void raw_fixed64(uint64_t v) {
+        v = cpu_to_le(v);
+        _out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+    void raw_double(double v) {
+        raw_fixed64(std::bit_cast<uint64_t>(v));
+    }
+
+    void uint_field(uint32_t field, uint64_t v) {
+        tag(field, varint_type);
+        varint(v);
+    }
+    void fixed64_field(uint32_t field, uint64_t v) {
+        tag(field, i64_type);
+        raw_fixed64(v);
+    }
+    void double_field(uint32_t field, double v) {
+        tag(field, i64_type);
+        raw_double(v);
+    }
+    void string_field(uint32_t field, std::string_view v) {
+        tag(field, len_type);
+        varint(v.size());
+        _out.append(v);
+    }
+    void raw(std::string_view bytes) {
+        _out.append(bytes);
+    }
+
+    // Starts a nested message, or a packed repeated field, returning what
+    // to end it with
+    size_t begin(uint32_t field) {
+        tag(field, len_type);
+        auto pos = _out.size();
+        _out.append(nested_size_bytes, '\0');
+        return pos;
+    }
+    void end(size_t pos) {
+        uint64_t size = _out.size() - pos - nested_size_bytes;
+        for (size_t i = 0; i < nested_size_bytes; ++i) {
+            _out[pos + i] = char((size & 0x7f) | (i + 1 < nested_size_bytes ? 0x80 : 0));
+            size >>= 7;
+        }
+    }
+};
+
+}
+
+}
@@ -31,7 +31,10 @@ module;
 #include <exception>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <numeric>
 #include <regex>
+#include <sstream>
 #include <thread>
 
 #include <cinttypes>
@@ -50,6 +53,7 @@ module;
 #include <sys/eventfd.h>
 #include <poll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/barrier.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -137,6 +141,7 @@ module seastar;
 #include <seastar/core/make_task.hh>
 #include <seastar/core/memory.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/offload.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/prefetch.hh>
 #include <seastar/core/print.hh>
@@ -147,6 +152,7 @@ module seastar;
 #include <seastar/core/scheduling_specific.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/smp_options.hh>
+#include <seastar/core/stall_profile.hh>
 #include <seastar/core/stall_sampler.hh>
 #include <seastar/core/systemwide_memory_barrier.hh>
 #include <seastar/core/task.hh>
@@ -155,10 +161,12 @@ module seastar;
 #include <seastar/core/when_all.hh>
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/internal/coroutine_frame_pool.hh>
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/uname.hh>
 #include <seastar/core/internal/stall_detector.hh>
 #include <seastar/core/internal/run_in_background.hh>
+#include <seastar/util/destroy_gently.hh>
 #include <seastar/net/native-stack.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/net/posix-stack.hh>
@@ -175,6 +183,10 @@ module seastar;
 #include <seastar/util/internal/iovec_utils.hh>
 #include <seastar/util/internal/magic.hh>
 #include "core/reactor_backend.hh"
+#include "core/cpu_profiler.hh"
+#include "core/dma_buffer_pool.hh"
+#include "core/memory_pressure.hh"
+#include "core/work_stealing.hh"
 #include "core/syscall_result.hh"
 #include "core/thread_pool.hh"
 #include "syscall_work_queue.hh"
@@ -200,6 +212,8 @@ struct mountpoint_params {
     uint64_t write_saturation_length = std::numeric_limits<uint64_t>::max();
     bool duplex = false;
     float rate_factor = 1.0;
+    // Extra cost of writes mixed with reads, as measured by iotune
+    float write_penalty = 1.0;
 };
 
 }
@@ -226,6 +240,9 @@ struct convert<seastar::mountpoint_params> {
         if (node["rate_factor"]) {
             mp.rate_factor = node["rate_factor"].as<float>();
         }
+        if (node["write_penalty"]) {
+            mp.write_penalty = node["write_penalty"].as<float>();
+        }
         return true;
     }
 };
@@ -236,6 +253,9 @@ namespace seastar {
 seastar::logger seastar_logger("seastar");
 seastar::logger sched_logger("scheduler");
 
+// The CPU bandwidth limit of our cgroup, found at startup
+static std::optional<cgroup::cpu_quota> cgroup_cpu_quota;
+
 shard_id reactor::cpu_id() const {
     assert(_id == this_shard_id());
     return _id;
@@ -267,6 +287,12 @@ void reactor::update_shares_for_queues(internal::priority_class pc, uint32_t sha
     }
 }
 
+void reactor::set_latency_target_for_queues(internal::priority_class pc, std::chrono::microseconds target) {
+    for (auto&& q : _io_queues) {
+        q.second->set_latency_target_for_class(pc, target);
+    }
+}
+
 future<> reactor::update_bandwidth_for_queues(internal::priority_class pc, uint64_t bandwidth) {
     return smp::invoke_on_all([pc, bandwidth = bandwidth / _num_io_groups] {
         return parallel_for_each(engine()._io_queues, [pc, bandwidth] (auto& queue) {
@@ -653,7 +679,15 @@ timespec to_timespec(steady_clock_type::time_point t) {
 }
 
 void lowres_clock::update() noexcept {
-    lowres_clock::_now = lowres_clock::time_point(std::chrono::steady_clock::now().time_since_epoch());
+    // Also when the counter isn't used (or was just found unreliable by
+    // refresh()): the clock then doesn't go below the last time read from
+    // it, which lowres timers may have expired at already.
+    auto now = internal::tsc_clock::refresh();
+    lowres_clock::_now = lowres_clock::time_point(now.time_since_epoch());
+    if (internal::tsc_clock::enabled()) {
+        lowres_system_clock::_now = lowres_system_clock::time_point(internal::tsc_clock::to_system(now).time_since_epoch());
+        return;
+    }
     lowres_system_clock::_now = lowres_system_clock::time_point(std::chrono::system_clock::now().time_since_epoch());
 }
 
@@ -980,6 +1014,21 @@ reactor::task_queue::register_stats() {
                 return _time_spent_on_task_quota_violations / 1ms;
         }, sm::description("Total amount in milliseconds we were in violation of the task quota"),
            {group_label}),
+        sm::make_histogram("queueing_delay", sm::description("Histogram of the time sampled tasks of this queue waited to run, in microseconds"),
+                {group_label}, [this] { return _queueing_delay_histogram.to_metrics_histogram(); }).set_skip_when_empty(),
+        sm::make_histogram("task_runtime", sm::description("Histogram of the runtime of sampled tasks of this queue, in microseconds"),
+                {group_label}, [this] { return _task_runtime_histogram.to_metrics_histogram(); }).set_skip_when_empty(),
+        sm::make_gauge("cpu_cap", [this] { return _cpu_cap; },
+                sm::description("Fraction of the CPU this queue may use; 1 if uncapped"),
+                {group_label}),
+        sm::make_counter("throttled_time_ms", [this] {
+                auto throttled = _throttled_time + (_throttled ? now() - _throttled_since : sched_clock::duration(0));
+                return std::chrono::duration_cast<std::chrono::milliseconds>(throttled).count();
+        }, sm::description("Accumulated time this queue was held back for having used up its CPU cap"),
+           {group_label}),
+        sm::make_current_bytes("sampled_memory", [this] { return memory::scheduling_group_memory_usage(internal::scheduling_group_from_index(_id)); },
+                sm::description("Memory held by the allocations of this group, extrapolated from the heap profiler's samples; 0 unless heap profiling is enabled"),
+                {group_label}),
     });
     _metrics = std::exchange(new_metrics, {});
 }
@@ -995,6 +1044,8 @@ reactor::task_queue::rename(sstring new_name, sstring new_shortname) {
             _shortname = fmt::format("{:>{}}", new_shortname, shortname_size);
         }
         register_stats();
+        // Re-registered under the new name when next sampled
+        _task_type_stats.clear();
     }
 }
 
@@ -1014,7 +1065,96 @@ reactor::task_queue::to_vruntime(sched_clock::duration runtime) const {
 void
 reactor::task_queue::set_shares(float shares) noexcept {
     _shares = std::max(shares, 1.0f);
-    _reciprocal_shares_times_2_power_32 = (uint64_t(1) << 32) / _shares;
+    set_effective_shares(_shares);
+}
+
+void
+reactor::task_queue::set_effective_shares(float shares) noexcept {
+    // Deeply nested queues may get a tiny part of their top level queue's
+    // shares; keep the reciprocal within range.
+    _reciprocal_shares_times_2_power_32 = (uint64_t(1) << 32) / std::max(shares, 0.01f);
+}
+
+bool
+reactor::task_queue::subtree_active() const noexcept {
+    return _active || !_q.empty() || std::any_of(_children.begin(), _children.end(), [] (const task_queue* c) {
+        return c->subtree_active();
+    });
+}
+
+// Splits the shares the subtree rooted at this queue gets between the queue
+// itself and its subtrees that have tasks to run, in the proportion of their
+// shares.
+void
+reactor::task_queue::distribute_shares(float shares) noexcept {
+    float total = (_active || !_q.empty()) ? _shares : 0.0f;
+    for (auto* c : _children) {
+        if (c->subtree_active()) {
+            total += c->_shares;
+        }
+    }
+    if (total == 0.0f) {
+        // Nothing to run; the shares are updated again once there is
+        total = own_and_children_shares();
+    }
+    set_effective_shares(shares * _shares / total);
+    for (auto* c : _children) {
+        c->distribute_shares(shares * c->_shares / total);
+    }
+}
+
+float
+reactor::task_queue::own_and_children_shares() const noexcept {
+    float total = _shares;
+    for (auto* c : _children) {
+        total += c->_shares;
+    }
+    return total;
+}
+
+// IO is not tied to the CPU activity of the queues, so IO shares are split
+// between all the queues of a subtree, active or not.
+float
+reactor::task_queue::subtree_io_shares() const noexcept {
+    if (!_parent) {
+        return _shares;
+    }
+    return _parent->subtree_io_shares() * _shares / _parent->own_and_children_shares();
+}
+
+float
+reactor::task_queue::io_shares() const noexcept {
+    return subtree_io_shares() * _shares / own_and_children_shares();
+}
+
+// The scheduler picks queues from a flat list by vruntime, so nesting is
+// implemented by having each nested queue's vruntime advance as if it had
+// its part of its top level queue's shares; the parts are updated whenever
+// a queue of a tree starts or stops having tasks to run.
+void
+reactor::update_nested_shares() noexcept {
+    for (auto& tq : _task_queues) {
+        if (tq && !tq->_parent && !tq->_children.empty()) {
+            tq->distribute_shares(tq->_shares);
+        }
+    }
+}
+
+void
+reactor::update_nested_io_shares(task_queue& tq) {
+#if SEASTAR_API_LEVEL >= 7
+    auto* root = &tq;
+    while (root->_parent) {
+        root = root->_parent;
+    }
+    std::vector<task_queue*> pending = { root };
+    while (!pending.empty()) {
+        auto* q = pending.back();
+        pending.pop_back();
+        update_shares_for_queues(internal::priority_class(scheduling_group(q->_id)), std::max(1.0f, q->io_shares()));
+        pending.insert(pending.end(), q->_children.begin(), q->_children.end());
+    }
+#endif
 }
 
 void
@@ -1027,9 +1167,78 @@ reactor::account_runtime(task_queue& tq, sched_clock::duration runtime) {
     tq._runtime += runtime;
 }
 
+sched_clock::duration
+reactor::task_queue::cpu_cap_budget() const noexcept {
+    return std::chrono::duration_cast<sched_clock::duration>(_cpu_cap_period * _cpu_cap);
+}
+
+// Moves the queue's cap period forward to the one \c now is in, taking the
+// budgets of the elapsed periods off the runtime charged against it, so that
+// running over the budget is paid for in the following periods.
+void
+reactor::refill_cpu_cap(task_queue& tq, sched_clock::time_point now) noexcept {
+    auto elapsed = (now - tq._cpu_cap_period_start) / tq._cpu_cap_period;
+    if (elapsed > 0) {
+        tq._cpu_cap_period_start += elapsed * tq._cpu_cap_period;
+        tq._cpu_cap_runtime = std::max(tq._cpu_cap_runtime - elapsed * tq.cpu_cap_budget(), sched_clock::duration(0));
+    }
+}
+
+void
+reactor::charge_cpu_cap(task_queue& tq, sched_clock::duration runtime, sched_clock::time_point now) noexcept {
+    refill_cpu_cap(tq, now);
+    tq._cpu_cap_runtime += runtime;
+    if (tq._cpu_cap_runtime < tq.cpu_cap_budget()) {
+        return;
+    }
+    sched_print("throttling tq {} {}", (void*)&tq, tq._name);
+    tq._throttled = true;
+    tq._throttled_since = now;
+    _throttled_task_queues.push_back(&tq);
+    rearm_cpu_cap_timer();
+}
+
 void
-reactor::account_idle(sched_clock::duration runtime) {
-    // anything to do here?
+reactor::rearm_cpu_cap_timer() noexcept {
+    if (_throttled_task_queues.empty()) {
+        _cpu_cap_timer.cancel();
+        return;
+    }
+    auto next = sched_clock::time_point::max();
+    for (auto* tq : _throttled_task_queues) {
+        next = std::min(next, tq->_cpu_cap_period_start + tq->_cpu_cap_period);
+    }
+    _cpu_cap_timer.rearm(next);
+}
+
+// Puts the throttled queues whose budget was refilled back into rotation.
+void
+reactor::unthrottle_task_queues() noexcept {
+    auto now = reactor::now();
+    std::erase_if(_throttled_task_queues, [this, now] (task_queue* tq) {
+        refill_cpu_cap(*tq, now);
+        if (tq->_cpu_cap_runtime >= tq->cpu_cap_budget()) {
+            return false;
+        }
+        sched_print("unthrottling tq {} {}", (void*)tq, tq->_name);
+        tq->_throttled = false;
+        tq->_throttled_time += now - tq->_throttled_since;
+        tq->_active = false;
+        // Time spent throttled is accounted for separately from waittime
+        tq->_ts = now;
+        if (!tq->_q.empty()) {
+            activate(*tq);
+        } else if (_nr_nested_task_queues && tq->nested()) {
+            update_nested_shares();
+        }
+        return true;
+    });
+    rearm_cpu_cap_timer();
+}
+
+void
+reactor::account_idle(sched_clock::duration idletime) {
+    _idle_poll_policy.record_idle(idletime);
 }
 
 struct reactor::task_queue::indirect_compare {
@@ -1053,7 +1262,9 @@ reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id,
     , _cpu_started(0)
     , _cpu_stall_detector(internal::make_cpu_stall_detector())
     , _reuseport(posix_reuseport_detect())
-    , _thread_pool(std::make_unique<thread_pool>(*this, seastar::format("syscall-{}", id))) {
+    , _thread_pool(std::make_unique<thread_pool>(*this, seastar::format("syscall-{}", id), cfg.syscall_threads))
+    , _dma_buffer_pool(std::make_unique<internal::dma_buffer_pool>(cfg.dma_buffer_pool_low_watermark, cfg.dma_buffer_pool_high_watermark))
+    , _memory_pressure_monitor(std::make_unique<internal::memory_pressure_monitor>(cfg.memory_pressure_elevated_threshold, cfg.memory_pressure_critical_threshold)) {
     /*
      * The _backend assignment is here, not on the initialization list as
      * the chosen backend constructor may want to handle signals and thus
@@ -1064,6 +1275,7 @@ reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id,
     _task_queues.push_back(std::make_unique<task_queue>(0, "main", "main", 1000));
     _task_queues.push_back(std::make_unique<task_queue>(1, "atexit", "exit", 1000));
     _at_destroy_tasks = _task_queues.back().get();
+    _cpu_cap_timer.set_callback([this] { unthrottle_task_queues(); });
     set_need_preempt_var(&_preemption_monitor);
     seastar::thread_impl::init();
     _backend->start_tick();
@@ -1085,6 +1297,7 @@ reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id,
 }
 
 reactor::~reactor() {
+    _cpu_profiler.reset();
     sigset_t mask;
     sigemptyset(&mask);
     sigaddset(&mask, internal::cpu_stall_detector::signal_number());
@@ -1092,6 +1305,10 @@ reactor::~reactor() {
     assert(r == 0);
 
     _backend->stop_tick();
+    _cpu_cap_timer.cancel();
+    _memory_release_timer.cancel();
+    thread_impl::drain_stack_pool();
+    internal::this_thread_coroutine_frame_pool.drain();
     auto eraser = [](auto& list) {
         while (!list.empty()) {
             auto& timer = *list.begin();
@@ -1129,6 +1346,29 @@ reactor::get_sched_stats() const {
     return ret;
 }
 
+std::vector<reactor::task_type_runtime>
+reactor::top_task_types(scheduling_group sg, size_t n) const {
+    std::vector<task_type_runtime> ret;
+    auto tq = sg._id < _task_queues.size() ? _task_queues[sg._id].get() : nullptr;
+    if (!tq) {
+        return ret;
+    }
+    ret.reserve(tq->_task_type_stats.size());
+    for (auto& [_, stats] : tq->_task_type_stats) {
+        ret.push_back(task_type_runtime{stats.name, stats.samples, stats.runtime, stats.queueing_delay});
+    }
+    auto longest = [] (const task_type_runtime& a, const task_type_runtime& b) {
+        return a.runtime > b.runtime;
+    };
+    if (ret.size() > n) {
+        std::partial_sort(ret.begin(), ret.begin() + n, ret.end(), longest);
+        ret.resize(n);
+    } else {
+        std::sort(ret.begin(), ret.end(), longest);
+    }
+    return ret;
+}
+
 future<> reactor::readable(pollable_fd_state& fd) {
     return _backend->readable(fd);
 }
@@ -1210,6 +1450,10 @@ cpu_stall_detector::get_config() const {
 }
 
 void cpu_stall_detector::update_config(cpu_stall_detector_config cfg) {
+    if (cfg.profile && !_profile) {
+        _profile = std::make_unique<stall_profile_recorder>();
+        std::atomic_signal_fence(std::memory_order_release);
+    }
     _config = cfg;
     _threshold = std::chrono::duration_cast<sched_clock::duration>(cfg.threshold);
     _slack = std::chrono::duration_cast<sched_clock::duration>(cfg.threshold * cfg.slack);
@@ -1219,6 +1463,10 @@ void cpu_stall_detector::update_config(cpu_stall_detector_config cfg) {
 }
 
 void cpu_stall_detector::maybe_report() {
+    // All the stalls are profiled, only their reports are rate limited
+    if (auto p = profile()) {
+        p->record();
+    }
     if (_reported++ < _max_reports_per_minute) {
         generate_trace();
     }
@@ -1279,6 +1527,9 @@ void cpu_stall_detector_posix_timer::arm_timer() {
 
 void cpu_stall_detector::start_task_run(sched_clock::time_point now) {
     if (now > _rearm_timer_at) {
+        if (auto p = profile()) {
+            p->drain();
+        }
         report_suppressions(now);
         _report_at = 1;
         _run_started_at = now;
@@ -1289,6 +1540,48 @@ void cpu_stall_detector::start_task_run(sched_clock::time_point now) {
     std::atomic_signal_fence(std::memory_order_release); // Don't delay this write, so the signal handler can see it
 }
 
+stall_profile_recorder::stall_profile_recorder()
+        : _ring(std::make_unique<sample[]>(ring_size)) {
+}
+
+void stall_profile_recorder::record() noexcept {
+    auto head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_relaxed) == ring_size) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto& s = _ring[head % ring_size];
+    s.depth = 0;
+    backtrace([&s] (frame f) {
+        if (s.depth < max_depth) {
+            s.frames[s.depth++] = f.so->begin + f.addr;
+        }
+    });
+    std::atomic_signal_fence(std::memory_order_release);
+    _head.store(head + 1, std::memory_order_relaxed);
+}
+
+void stall_profile_recorder::drain() noexcept {
+    auto head = _head.load(std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    for (auto tail = _tail.load(std::memory_order_relaxed); tail != head; ++tail) {
+        auto& s = _ring[tail % ring_size];
+        try {
+            _stacks[std::vector<uintptr_t>(s.frames, s.frames + s.depth)]++;
+        } catch (...) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::atomic_signal_fence(std::memory_order_release);
+        _tail.store(tail + 1, std::memory_order_relaxed);
+    }
+}
+
+void stall_profile_recorder::reset() noexcept {
+    drain();
+    _stacks.clear();
+    _dropped.store(0, std::memory_order_relaxed);
+}
+
 void cpu_stall_detector::end_task_run(sched_clock::time_point now) {
     std::atomic_signal_fence(std::memory_order_acquire); // Don't hoist this write, so the signal handler can see it
     _last_tasks_processed_seen.store(0, std::memory_order_relaxed);
@@ -1519,6 +1812,23 @@ reactor::test::get_stall_detector_report_function() {
     return engine()._cpu_stall_detector->get_config().report;
 }
 
+void
+reactor::test::set_stall_profile(bool enabled) {
+    auto& r = engine();
+    auto cfg = r._cpu_stall_detector->get_config();
+    cfg.profile = enabled;
+    r._cpu_stall_detector->update_config(std::move(cfg));
+}
+
+void
+reactor::test::set_cpu_profiler(unsigned hz, size_t max_entries) {
+    auto& r = engine();
+    r._cpu_profiler.reset();
+    if (hz) {
+        r._cpu_profiler = std::make_unique<internal::cpu_profiler>(hz, max_entries);
+    }
+}
+
 void
 reactor::block_notifier(int) {
     engine()._cpu_stall_detector->on_signal();
@@ -1580,15 +1890,50 @@ void reactor::configure(const reactor_options& opts) {
     csdc.threshold = blocked_time;
     csdc.stall_detector_reports_per_minute = opts.blocked_reactor_reports_per_minute.get_value();
     csdc.oneline = opts.blocked_reactor_report_format_oneline.get_value();
+    csdc.profile = opts.blocked_reactor_profile.get_value();
     _cpu_stall_detector->update_config(csdc);
+    if (auto hz = opts.cpu_profiler_hz.get_value()) {
+        _cpu_profiler = std::make_unique<internal::cpu_profiler>(hz, opts.cpu_profiler_max_entries.get_value());
+    }
 
     _max_task_backlog = opts.max_task_backlog.get_value();
-    _max_poll_time = opts.idle_poll_time_us.get_value() * 1us;
+    _task_sample_interval = opts.task_latency_sample_interval.get_value();
+    _task_latency_by_type = opts.task_latency_by_type.get_value();
+    thread_impl::configure_stack_pool(opts.thread_stack_pool_size.get_value(), opts.thread_stack_pool_madvise_free.get_value());
+    internal::this_thread_coroutine_frame_pool.set_max_pooled_bytes(opts.coroutine_frame_pool_size.get_value());
+    std::chrono::nanoseconds max_poll_time = opts.idle_poll_time_us.get_value() * 1us;
     if (opts.poll_mode) {
-        _max_poll_time = std::chrono::nanoseconds::max();
+        max_poll_time = std::chrono::nanoseconds::max();
     }
     if (opts.overprovisioned && opts.idle_poll_time_us.defaulted() && !opts.poll_mode) {
-        _max_poll_time = 0us;
+        max_poll_time = 0us;
+    }
+    if (cgroup_cpu_quota) {
+        // The CPU time a shard gets every period of the quota
+        auto slice = cgroup_cpu_quota->quota / smp::count;
+        // Spinning idle spends the quota the shards run on once busy
+        if (slice < cgroup_cpu_quota->period && opts.idle_poll_time_us.defaulted() && !opts.poll_mode) {
+            max_poll_time = 0us;
+        }
+        // Keep preempting, and so polling for I/O and running timers,
+        // several times within a slice, rather than not at all before
+        // the shard gets throttled
+        auto quota_cap = std::chrono::duration_cast<sched_clock::duration>(slice / 16);
+        if (opts.task_quota_ms.defaulted() && quota_cap < _task_quota) {
+            _task_quota = std::max<sched_clock::duration>(quota_cap, 50us);
+        }
+    }
+    _idle_poll_policy = internal::idle_poll_policy(max_poll_time, opts.adaptive_idle_poll.get_value() && !opts.poll_mode,
+            opts.idle_poll_pause.get_value() && internal::have_tpause());
+    auto memory_release_period = opts.memory_release_period_ms.get_value() * 1ms;
+    if (opts.overprovisioned && opts.memory_release_period_ms.defaulted()) {
+        memory_release_period = 10s;
+    }
+    _memory_release_timer.cancel();
+    if (memory_release_period.count()) {
+        auto keep_free = size_t(memory::stats().total_memory() * std::clamp(opts.memory_release_keep_free.get_value(), 0.0, 1.0));
+        _memory_release_timer.set_callback([keep_free] { memory::release_free_memory(keep_free); });
+        _memory_release_timer.arm_periodic(memory_release_period);
     }
     set_strict_dma(!opts.relaxed_dma);
     if (!opts.poll_aio.get_value() || (opts.poll_aio.defaulted() && opts.overprovisioned)) {
@@ -1629,8 +1974,25 @@ reactor::posix_listen(socket_address sa, listen_options opts) {
     if (opts.reuse_address) {
         fd.setsockopt(SOL_SOCKET, SO_REUSEADDR, 1);
     }
-    if (_reuseport && !sa.is_af_unix())
+    auto steering_cpu = opts.lba == server_socket::load_balancing_algorithm::incoming_cpu && !sa.is_af_unix()
+            ? pinned_cpu() : std::nullopt;
+    if ((_reuseport || steering_cpu) && !sa.is_af_unix())
         fd.setsockopt(SOL_SOCKET, SO_REUSEPORT, 1);
+    if (steering_cpu) {
+        try {
+            fd.setsockopt(SOL_SOCKET, SO_INCOMING_CPU, *steering_cpu);
+        } catch (std::system_error&) {
+            // Old kernel; connections are spread by hash among the shards' sockets
+        }
+    }
+    if (!opts.congestion_control.empty() && !sa.is_af_unix()) {
+        // Inherited by the accepted sockets
+        fd.setsockopt(IPPROTO_TCP, TCP_CONGESTION, opts.congestion_control.c_str());
+    }
+    if (!sa.is_af_unix()) {
+        // Inherited by the accepted sockets too
+        maybe_set_busy_poll(fd);
+    }
 
     try {
         fd.bind(sa.u.sa, sa.length());
@@ -1654,6 +2016,26 @@ reactor::posix_listen(socket_address sa, listen_options opts) {
     return pollable_fd(std::move(fd));
 }
 
+std::optional<int>
+reactor::pinned_cpu() noexcept {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) != 0 || CPU_COUNT(&set) != 1) {
+        return std::nullopt;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            return cpu;
+        }
+    }
+    return std::nullopt;
+}
+
+bool
+reactor::posix_incoming_cpu_steering_available() const noexcept {
+    return pinned_cpu().has_value();
+}
+
 bool
 reactor::posix_reuseport_detect() {
     return false; // FIXME: reuseport currently leads to heavy load imbalance. Until we fix that, just
@@ -1707,9 +2089,32 @@ pollable_fd
 reactor::make_pollable_fd(socket_address sa, int proto) {
     int maybe_nonblock = _backend->do_blocking_io() ? 0 : SOCK_NONBLOCK;
     file_desc fd = file_desc::socket(sa.u.sa.sa_family, SOCK_STREAM | maybe_nonblock | SOCK_CLOEXEC, proto);
+    if (!sa.is_af_unix()) {
+        maybe_set_busy_poll(fd);
+    }
     return pollable_fd(std::move(fd));
 }
 
+void
+reactor::maybe_set_busy_poll(file_desc& fd) noexcept {
+    if (!_cfg.net_busy_poll_usec) {
+        return;
+    }
+    static thread_local bool warned = false;
+    auto set = [&] (int optname, int value, const char* name) {
+        if (::setsockopt(fd.get(), SOL_SOCKET, optname, &value, sizeof(value)) != 0 && !std::exchange(warned, true)) {
+            seastar_logger.warn("Unable to set {} on sockets ({}); continuing without it",
+                    name, std::error_code(errno, std::system_category()).message());
+        }
+    };
+    set(SO_BUSY_POLL, _cfg.net_busy_poll_usec, "SO_BUSY_POLL");
+#ifdef SO_PREFER_BUSY_POLL
+    if (_cfg.net_prefer_busy_poll) {
+        set(SO_PREFER_BUSY_POLL, 1, "SO_PREFER_BUSY_POLL");
+    }
+#endif
+}
+
 future<>
 reactor::posix_connect(pollable_fd pfd, socket_address sa, socket_address local) {
 #ifdef IP_BIND_ADDRESS_NO_PORT
@@ -1822,6 +2227,69 @@ size_t sanitize_iovecs(std::vector<iovec>& iov, size_t disk_alignment) noexcept
 
 }
 
+namespace {
+
+// A metadata syscall submitted to the io_uring ring rather than run by the
+// syscall thread (see reactor_backend::submits_metadata_ops()), with the
+// paths and buffer it needs until it completes, telling its result the way
+// the thread does
+class metadata_io_desc final : public io_completion {
+    promise<syscall_result<int>> _pr;
+public:
+    sstring path;
+    sstring new_path;
+    struct ::statx stx;
+
+    explicit metadata_io_desc(sstring p, sstring np = {}) noexcept
+        : path(std::move(p)), new_path(std::move(np)) {}
+
+    virtual void complete(size_t res) noexcept override {
+        _pr.set_value(syscall_result<int>(int(res), 0));
+    }
+
+    virtual void set_exception(std::exception_ptr eptr) noexcept override {
+        try {
+            std::rethrow_exception(std::move(eptr));
+        } catch (const std::system_error& e) {
+            _pr.set_value(syscall_result<int>(-1, e.code().value()));
+        } catch (...) {
+            _pr.set_exception(std::current_exception());
+        }
+    }
+
+    future<syscall_result<int>> submit(internal::io_sink& sink, internal::io_request req) noexcept {
+        _pr = promise<syscall_result<int>>();
+        auto f = _pr.get_future();
+        sink.submit(this, std::move(req));
+        return f;
+    }
+
+    future<syscall_result_extra<struct stat>> submit_statx(internal::io_sink& sink, int dirfd, int flags) noexcept {
+        auto pathname = (flags & AT_EMPTY_PATH) ? "" : path.c_str();
+        return submit(sink, internal::io_request::make_statx(dirfd, pathname, flags, STATX_BASIC_STATS, &stx)).then([this] (syscall_result<int> sr) {
+            struct stat st = {};
+            if (sr.result != -1) {
+                st.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+                st.st_ino = stx.stx_ino;
+                st.st_mode = stx.stx_mode;
+                st.st_nlink = stx.stx_nlink;
+                st.st_uid = stx.stx_uid;
+                st.st_gid = stx.stx_gid;
+                st.st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+                st.st_size = stx.stx_size;
+                st.st_blksize = stx.stx_blksize;
+                st.st_blocks = stx.stx_blocks;
+                st.st_atim = {stx.stx_atime.tv_sec, stx.stx_atime.tv_nsec};
+                st.st_mtim = {stx.stx_mtime.tv_sec, stx.stx_mtime.tv_nsec};
+                st.st_ctim = {stx.stx_ctime.tv_sec, stx.stx_ctime.tv_nsec};
+            }
+            return syscall_result_extra<struct stat>(sr.result, sr.error, st);
+        });
+    }
+};
+
+}
+
 future<file>
 reactor::open_file_dma(std::string_view nameref, open_flags flags, file_open_options options) noexcept {
     return do_with(static_cast<int>(flags), std::move(options), [this, nameref] (auto& open_flags, file_open_options& options) {
@@ -1900,12 +2368,25 @@ future<>
 reactor::remove_file(std::string_view pathname) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([this, pathname] {
-        return _thread_pool->submit<syscall_result<int>>([pathname = sstring(pathname)] {
-            return wrap_syscall<int>(::remove(pathname.c_str()));
-        }).then([pathname = sstring(pathname)] (syscall_result<int> sr) {
+        auto check = [pathname = sstring(pathname)] (syscall_result<int> sr) {
             sr.throw_fs_exception_if_error("remove failed", pathname);
             return make_ready_future<>();
-        });
+        };
+        if (_backend->submits_metadata_ops()) {
+            // remove(3) is unlink(2), or rmdir(2) for a directory
+            auto desc = std::make_unique<metadata_io_desc>(sstring(pathname));
+            auto f = desc->submit(_io_sink, internal::io_request::make_unlinkat(AT_FDCWD, desc->path.c_str(), 0));
+            return f.then([this, desc = std::move(desc)] (syscall_result<int> sr) mutable {
+                if (sr.result == -1 && sr.error == EISDIR) {
+                    auto f = desc->submit(_io_sink, internal::io_request::make_unlinkat(AT_FDCWD, desc->path.c_str(), AT_REMOVEDIR));
+                    return f.finally([desc = std::move(desc)] {});
+                }
+                return make_ready_future<syscall_result<int>>(sr);
+            }).then(std::move(check));
+        }
+        return _thread_pool->submit<syscall_result<int>>([pathname = sstring(pathname)] {
+            return wrap_syscall<int>(::remove(pathname.c_str()));
+        }).then(std::move(check));
     });
 }
 
@@ -1913,12 +2394,18 @@ future<>
 reactor::rename_file(std::string_view old_pathname, std::string_view new_pathname) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([this, old_pathname, new_pathname] {
-        return _thread_pool->submit<syscall_result<int>>([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] {
-            return wrap_syscall<int>(::rename(old_pathname.c_str(), new_pathname.c_str()));
-        }).then([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] (syscall_result<int> sr) {
+        auto check = [old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] (syscall_result<int> sr) {
             sr.throw_fs_exception_if_error("rename failed",  old_pathname, new_pathname);
             return make_ready_future<>();
-        });
+        };
+        if (_backend->submits_metadata_ops()) {
+            auto desc = std::make_unique<metadata_io_desc>(sstring(old_pathname), sstring(new_pathname));
+            auto f = desc->submit(_io_sink, internal::io_request::make_renameat(AT_FDCWD, desc->path.c_str(), AT_FDCWD, desc->new_path.c_str(), 0));
+            return f.finally([desc = std::move(desc)] {}).then(std::move(check));
+        }
+        return _thread_pool->submit<syscall_result<int>>([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] {
+            return wrap_syscall<int>(::rename(old_pathname.c_str(), new_pathname.c_str()));
+        }).then(std::move(check));
     });
 }
 
@@ -1981,12 +2468,20 @@ future<std::optional<directory_entry_type>>
 reactor::file_type(std::string_view name, follow_symlink follow) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([name, follow, this] {
-        return _thread_pool->submit<syscall_result_extra<struct stat>>([name = sstring(name), follow] {
-            struct stat st;
-            auto stat_syscall = follow ? stat : lstat;
-            auto ret = stat_syscall(name.c_str(), &st);
-            return wrap_syscall(ret, st);
-        }).then([name = sstring(name)] (syscall_result_extra<struct stat> sr) {
+        auto stat = [&] {
+            if (_backend->submits_metadata_ops()) {
+                auto desc = std::make_unique<metadata_io_desc>(sstring(name));
+                auto f = desc->submit_statx(_io_sink, AT_FDCWD, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+                return f.finally([desc = std::move(desc)] {});
+            }
+            return _thread_pool->submit<syscall_result_extra<struct stat>>([name = sstring(name), follow] {
+                struct stat st;
+                auto stat_syscall = follow ? ::stat : ::lstat;
+                auto ret = stat_syscall(name.c_str(), &st);
+                return wrap_syscall(ret, st);
+            });
+        };
+        return stat().then([name = sstring(name)] (syscall_result_extra<struct stat> sr) {
             if (long(sr.result) == -1) {
                 if (sr.error != ENOENT && sr.error != ENOTDIR) {
                     sr.throw_fs_exception_if_error("stat failed", name);
@@ -2022,6 +2517,22 @@ future<size_t> reactor::read_directory(int fd, char* buffer, size_t buffer_size)
     });
 }
 
+temporary_buffer<char> reactor::try_allocate_registered_buffer(size_t alignment, size_t size) noexcept {
+    return _backend->try_allocate_registered_buffer(alignment, size);
+}
+
+temporary_buffer<char> reactor::try_allocate_pooled_buffer(size_t alignment, size_t size) noexcept {
+    return _dma_buffer_pool->allocate(alignment, size);
+}
+
+bool reactor::register_file(int fd) noexcept {
+    return _backend->register_file(fd);
+}
+
+void reactor::unregister_file(int fd) noexcept {
+    _backend->unregister_file(fd);
+}
+
 future<int>
 reactor::inotify_add_watch(int fd, std::string_view path, uint32_t flags) {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
@@ -2040,7 +2551,9 @@ future<std::tuple<file_desc, file_desc>>
 reactor::make_pipe() {
     return do_with(std::array<int, 2>{}, [this] (auto& pipe) {
         return _thread_pool->submit<syscall_result<int>>([&pipe] {
-            return wrap_syscall<int>(::pipe2(pipe.data(), O_NONBLOCK));
+            // Close-on-exec from the start, so that children spawned
+            // concurrently by another shard don't inherit the pipe
+            return wrap_syscall<int>(::pipe2(pipe.data(), O_NONBLOCK | O_CLOEXEC));
         }).then([&pipe] (syscall_result<int> ret) {
             ret.throw_if_error();
             return make_ready_future<std::tuple<file_desc, file_desc>>(file_desc::from_fd(pipe[0]),
@@ -2107,6 +2620,9 @@ reactor::spawn(std::string_view pathname,
                 std::get<pipefd_read_end>(cin_pipe).template ioctl<int>(FIONBIO, 0);
                 std::get<pipefd_write_end>(cout_pipe).template ioctl<int>(FIONBIO, 0);
                 std::get<pipefd_write_end>(cerr_pipe).template ioctl<int>(FIONBIO, 0);
+                // the pipes are close-on-exec (see make_pipe()), so they don't leak
+                // into other children; the dup2()'ed copies this child gets as its
+                // stdin, stdout and stderr are not
 
                 r = ::posix_spawnattr_init(&attr);
                 throw_pthread_error(r);
@@ -2122,7 +2638,15 @@ reactor::spawn(std::string_view pathname,
                 sigemptyset(&mask_signals);
                 r = ::posix_spawnattr_setsigmask(&attr, &mask_signals);
                 throw_pthread_error(r);
-                r = ::posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+                short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_USEVFORK
+                // Share the address space with the child until it execs,
+                // rather than copying the page tables of a reactor that
+                // may map hundreds of gigabytes. glibc does so by itself
+                // since 2.24, where the flag is ignored.
+                flags |= POSIX_SPAWN_USEVFORK;
+#endif
+                r = ::posix_spawnattr_setflags(&attr, flags);
                 throw_pthread_error(r);
 
                 return _thread_pool->submit<syscall_result<int>>([&child_pid, &pathname, &actions, &attr,
@@ -2222,12 +2746,20 @@ future<stat_data>
 reactor::file_stat(std::string_view pathname, follow_symlink follow) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([pathname, follow, this] {
-        return _thread_pool->submit<syscall_result_extra<struct stat>>([pathname = sstring(pathname), follow] {
-            struct stat st;
-            auto stat_syscall = follow ? stat : lstat;
-            auto ret = stat_syscall(pathname.c_str(), &st);
-            return wrap_syscall(ret, st);
-        }).then([pathname = sstring(pathname)] (syscall_result_extra<struct stat> sr) {
+        auto stat = [&] {
+            if (_backend->submits_metadata_ops()) {
+                auto desc = std::make_unique<metadata_io_desc>(sstring(pathname));
+                auto f = desc->submit_statx(_io_sink, AT_FDCWD, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+                return f.finally([desc = std::move(desc)] {});
+            }
+            return _thread_pool->submit<syscall_result_extra<struct stat>>([pathname = sstring(pathname), follow] {
+                struct stat st;
+                auto stat_syscall = follow ? ::stat : ::lstat;
+                auto ret = stat_syscall(pathname.c_str(), &st);
+                return wrap_syscall(ret, st);
+            });
+        };
+        return stat().then([pathname = sstring(pathname)] (syscall_result_extra<struct stat> sr) {
             sr.throw_fs_exception_if_error("stat failed", pathname);
             struct stat& st = sr.extra;
             stat_data sd;
@@ -2342,18 +2874,41 @@ reactor::open_directory(std::string_view name) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([name, this] {
         auto oflags = O_DIRECTORY | O_CLOEXEC | O_RDONLY;
-        return _thread_pool->submit<syscall_result_extra<struct stat>>([name = sstring(name), oflags] {
-            struct stat st;
-            int fd = ::open(name.c_str(), oflags);
-            if (fd != -1) {
-                int r = ::fstat(fd, &st);
-                if (r == -1) {
-                    ::close(fd);
-                    fd = r;
-                }
+        auto open = [&] () -> future<syscall_result_extra<struct stat>> {
+            if (_backend->submits_metadata_ops()) {
+                auto desc = std::make_unique<metadata_io_desc>(sstring(name));
+                auto f = desc->submit(_io_sink, internal::io_request::make_openat(AT_FDCWD, desc->path.c_str(), oflags, 0));
+                return f.then([this, desc = std::move(desc)] (syscall_result<int> sr) mutable {
+                    if (sr.result == -1) {
+                        struct stat st = {};
+                        return make_ready_future<syscall_result_extra<struct stat>>(sr.result, sr.error, st);
+                    }
+                    auto fd = sr.result;
+                    auto f = desc->submit_statx(_io_sink, fd, AT_EMPTY_PATH);
+                    return f.then([fd] (syscall_result_extra<struct stat> sr) {
+                        if (sr.result == -1) {
+                            ::close(fd);
+                        } else {
+                            sr.result = fd;
+                        }
+                        return sr;
+                    }).finally([desc = std::move(desc)] {});
+                });
             }
-            return wrap_syscall(fd, st);
-        }).then([name = sstring(name), oflags] (syscall_result_extra<struct stat> sr) {
+            return _thread_pool->submit<syscall_result_extra<struct stat>>([name = sstring(name), oflags] {
+                struct stat st;
+                int fd = ::open(name.c_str(), oflags);
+                if (fd != -1) {
+                    int r = ::fstat(fd, &st);
+                    if (r == -1) {
+                        ::close(fd);
+                        fd = r;
+                    }
+                }
+                return wrap_syscall(fd, st);
+            });
+        };
+        return open().then([name = sstring(name), oflags] (syscall_result_extra<struct stat> sr) {
             sr.throw_fs_exception_if_error("open failed", name);
             return make_file_impl(sr.result, file_open_options(), oflags, sr.extra);
         }).then([] (shared_ptr<file_impl> file_impl) {
@@ -2366,10 +2921,18 @@ future<>
 reactor::make_directory(std::string_view name, file_permissions permissions) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([name, permissions, this] {
-        return _thread_pool->submit<syscall_result<int>>([name = sstring(name), permissions] {
-            auto mode = static_cast<mode_t>(permissions);
-            return wrap_syscall<int>(::mkdir(name.c_str(), mode));
-        }).then([name = sstring(name)] (syscall_result<int> sr) {
+        auto mode = static_cast<mode_t>(permissions);
+        auto mkdir = [&] {
+            if (_backend->submits_metadata_ops()) {
+                auto desc = std::make_unique<metadata_io_desc>(sstring(name));
+                auto f = desc->submit(_io_sink, internal::io_request::make_mkdirat(AT_FDCWD, desc->path.c_str(), mode));
+                return f.finally([desc = std::move(desc)] {});
+            }
+            return _thread_pool->submit<syscall_result<int>>([name = sstring(name), mode] {
+                return wrap_syscall<int>(::mkdir(name.c_str(), mode));
+            });
+        };
+        return mkdir().then([name = sstring(name)] (syscall_result<int> sr) {
             sr.throw_fs_exception_if_error("mkdir failed", name);
         });
     });
@@ -2379,10 +2942,18 @@ future<>
 reactor::touch_directory(std::string_view name, file_permissions permissions) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([this, name, permissions] {
-        return _thread_pool->submit<syscall_result<int>>([name = sstring(name), permissions] {
-            auto mode = static_cast<mode_t>(permissions);
-            return wrap_syscall<int>(::mkdir(name.c_str(), mode));
-        }).then([name = sstring(name)] (syscall_result<int> sr) {
+        auto mode = static_cast<mode_t>(permissions);
+        auto mkdir = [&] {
+            if (_backend->submits_metadata_ops()) {
+                auto desc = std::make_unique<metadata_io_desc>(sstring(name));
+                auto f = desc->submit(_io_sink, internal::io_request::make_mkdirat(AT_FDCWD, desc->path.c_str(), mode));
+                return f.finally([desc = std::move(desc)] {});
+            }
+            return _thread_pool->submit<syscall_result<int>>([name = sstring(name), mode] {
+                return wrap_syscall<int>(::mkdir(name.c_str(), mode));
+            });
+        };
+        return mkdir().then([name = sstring(name)] (syscall_result<int> sr) {
             if (sr.result == -1 && sr.error != EEXIST) {
                 sr.throw_fs_exception("mkdir failed", fs::path(name));
             }
@@ -2568,6 +3139,15 @@ void reactor::register_metrics() {
             sm::make_gauge("utilization", [this] { return (1-_load)  * 100; }, sm::description("CPU utilization")),
             sm::make_counter("cpu_busy_ms", [this] () -> int64_t { return total_busy_time() / 1ms; },
                     sm::description("Total cpu busy time in milliseconds")),
+            sm::make_counter("sleep_time_ms", [this] () -> int64_t { return _total_sleep / 1ms; },
+                    sm::description("Total time in milliseconds the reactor slept in the kernel waiting for work")),
+            sm::make_counter("idle_spin_time_ms", [this] () -> int64_t { return _total_idle_spin / 1ms; },
+                    sm::description("Total time in milliseconds the reactor spun polling for work")),
+            sm::make_counter("idle_pause_time_ms", [this] () -> int64_t { return _total_idle_pause / 1ms; },
+                    sm::description("Total time in milliseconds the reactor polled for work with the core paused in a power-saving state (see --adaptive-idle-poll)")),
+            sm::make_counter("sleeps", _sleeps, sm::description("Number of times the reactor slept in the kernel waiting for work")),
+            sm::make_gauge("expected_idle_us", [this] { return _idle_poll_policy.expected_idle() / 1us; },
+                    sm::description("Average length in microseconds of the recent idle periods, as learnt by the idle polling policy")),
             sm::make_counter("cpu_steal_time_ms", [this] () -> int64_t { return total_steal_time() / 1ms; },
                     sm::description("Total steal time, the time in which some other process was running while Seastar was not trying to run (not sleeping)."
                                      "Because this is in userspace, some time that could be legitimally thought as steal time is not accounted as such. For example, if we are sleeping and can wake up but the kernel hasn't woken us up yet.")),
@@ -2584,11 +3164,28 @@ void reactor::register_metrics() {
             // total_operations value:DERIVE:0:U
             sm::make_counter("fsyncs", _fsyncs, sm::description("Total number of fsync operations")),
             // total_operations value:DERIVE:0:U
+            sm::make_counter("fsyncs_coalesced", _io_stats.fsyncs_coalesced, sm::description("Total number of file flushes served by a sync issued for another flush")),
+            // total_operations value:DERIVE:0:U
             sm::make_counter("io_threaded_fallbacks", std::bind(&thread_pool::operation_count, _thread_pool.get()),
                     sm::description("Total number of io-threaded-fallbacks operations")),
 
     });
 
+    _backend->register_metrics();
+
+    // Of the whole cgroup, so exported by one shard
+    if (cgroup_cpu_quota && this_shard_id() == 0) {
+        auto stats = [] { return cgroup::cpu_throttling_stats(*cgroup_cpu_quota).value_or(cgroup::cpu_throttling{}); };
+        _metric_groups.add_group("reactor", {
+            sm::make_gauge("cgroup_cpu_quota", [] { return cgroup_cpu_quota->cpus(); },
+                    sm::description("CPUs worth of time the cgroup CPU quota allows")),
+            sm::make_counter("cgroup_cpu_throttled_time_ms", [stats] { return stats().throttled_time.count() / 1000; },
+                    sm::description("Total time in milliseconds the threads of the cgroup were throttled for having used up their CPU quota")),
+            sm::make_counter("cgroup_cpu_throttled_periods", [stats] { return stats().throttled_periods; },
+                    sm::description("Total number of CPU quota periods in which the cgroup was throttled")),
+        });
+    }
+
     _metric_groups.add_group("memory", {
             sm::make_counter("malloc_operations", [] { return memory::stats().mallocs(); },
                     sm::description("Total number of malloc operations")),
@@ -2599,9 +3196,92 @@ void reactor::register_metrics() {
             sm::make_current_bytes("total_memory", [] { return memory::stats().total_memory(); }, sm::description("Total memory size in bytes")),
             sm::make_current_bytes("allocated_memory", [] { return memory::stats().allocated_memory(); }, sm::description("Allocated memory size in bytes")),
             sm::make_counter("reclaims_operations", [] { return memory::stats().reclaims(); }, sm::description("Total reclaims operations")),
-            sm::make_counter("malloc_failed", [] { return memory::stats().failed_allocations(); }, sm::description("Total count of failed memory allocations"))
+            sm::make_counter("malloc_failed", [] { return memory::stats().failed_allocations(); }, sm::description("Total count of failed memory allocations")),
+            sm::make_counter("dma_buffer_pool_hits", [this] { return _dma_buffer_pool->get_stats().hits; },
+                    sm::description("Total number of DMA buffer allocations served from the recycled buffer pool")),
+            sm::make_counter("dma_buffer_pool_misses", [this] { return _dma_buffer_pool->get_stats().misses; },
+                    sm::description("Total number of DMA buffer allocations the recycled buffer pool had to make")),
+            sm::make_counter("dma_buffer_pool_trimmed_bytes", [this] { return _dma_buffer_pool->get_stats().trimmed_bytes; },
+                    sm::description("Total bytes returned by the DMA buffer pool to the allocator, on reaching its high watermark or under memory pressure")),
+            sm::make_current_bytes("dma_buffer_pool_cached_bytes", [this] { return _dma_buffer_pool->get_stats().cached_bytes; },
+                    sm::description("Bytes held in free buffers by the DMA buffer pool"))
+    });
+
+    for (unsigned idx = 0; idx < memory::small_pool_count(); ++idx) {
+        auto object_size = memory::get_small_pool_statistics(idx).object_size;
+        // Pools too small to hold a free list pointer are never used
+        if (object_size < sizeof(void*)) {
+            continue;
+        }
+        auto size_l = sm::label("object_size")(object_size);
+        _metric_groups.add_group("memory", {
+            sm::make_gauge("small_pool_objects_in_use", [idx] { return memory::get_small_pool_statistics(idx).objects_in_use; },
+                    sm::description("Number of allocated objects in the small object pool size class"), {size_l}).set_skip_when_empty(),
+            sm::make_gauge("small_pool_free_objects", [idx] { return memory::get_small_pool_statistics(idx).free_objects; },
+                    sm::description("Number of free objects held by the small object pool size class, unavailable to other size classes"), {size_l}).set_skip_when_empty(),
+            sm::make_current_bytes("small_pool_memory", [idx] { return memory::get_small_pool_statistics(idx).memory; },
+                    sm::description("Memory held by the small object pool size class"), {size_l}).set_skip_when_empty(),
+        });
+    }
+    _metric_groups.add_group("memory", {
+            sm::make_counter("huge_page_large_allocations", [] { return memory::get_huge_page_statistics().large_allocations; },
+                    sm::description("Total number of large allocations served from whole huge pages (see --huge-page-allocation-threshold)")),
+            sm::make_counter("huge_page_collapses", [] { return memory::get_huge_page_statistics().collapses; },
+                    sm::description("Total number of huge pages the kernel was asked to back with a transparent huge page")),
+            sm::make_counter("huge_page_collapse_failures", [] { return memory::get_huge_page_statistics().collapse_failures; },
+                    sm::description("Total number of failed requests to back a huge page with a transparent huge page")),
+            sm::make_current_bytes("huge_page_backed_memory", [] { return memory::get_huge_page_statistics().backed_memory; },
+                    sm::description("Memory known to be backed by transparent huge pages")),
+            sm::make_current_bytes("released_memory", [] { return memory::get_released_memory_statistics().released_memory; },
+                    sm::description("Free memory handed back to the OS (see --memory-release-period-ms)")),
+            sm::make_current_bytes("resident_memory", [] { return memory::stats().total_memory() - memory::get_released_memory_statistics().released_memory; },
+                    sm::description("Memory of the shard that may be resident: total memory less what was handed back to the OS; compare with allocated_memory")),
+            sm::make_counter("released_bytes", [] { return memory::get_released_memory_statistics().released_bytes; },
+                    sm::description("Total amount of free memory handed back to the OS")),
+            sm::make_counter("released_reused_bytes", [] { return memory::get_released_memory_statistics().reused_bytes; },
+                    sm::description("Total amount of memory handed back to the OS and then allocated again")),
+            sm::make_current_bytes("largest_free_span", [] { return memory::largest_free_span(); },
+                    sm::description("Size of the largest free page span; larger allocations need memory to be reclaimed first")),
+            sm::make_gauge("pressure_level", [this] { return unsigned(_memory_pressure_monitor->current_level()); },
+                    sm::description("Memory pressure level of the shard: 0 (normal), 1 (elevated) or 2 (critical)")),
+            sm::make_gauge("gentle_destruction_pending_objects", [] { return get_gentle_destruction_stats().pending_objects; },
+                    sm::description("Number of objects being destroyed in steps by destroy_gently()")),
+            sm::make_current_bytes("gentle_destruction_pending_bytes", [] { return get_gentle_destruction_stats().pending_bytes; },
+                    sm::description("Memory estimated to be held by the objects being destroyed in steps by destroy_gently()")),
+            sm::make_counter("pressure_notifications", [this] { return _memory_pressure_monitor->get_stats().notifications; },
+                    sm::description("Total number of rounds of memory pressure listener notifications")),
+            sm::make_counter("scheduling_group_soft_limits_exceeded", [this] { return _memory_pressure_monitor->get_stats().group_limits_exceeded; },
+                    sm::description("Total number of times a scheduling group exceeded its memory soft limit")),
     });
 
+    _metric_groups.add_group("reactor", {
+            sm::make_counter("stealable_tasks_submitted", [] { return internal::get_work_stealing_stats().submitted; },
+                    sm::description("Total number of shard-agnostic tasks submitted on this shard (see --work-stealing)")),
+            sm::make_counter("stolen_tasks", [] { return internal::get_work_stealing_stats().stolen; },
+                    sm::description("Total number of shard-agnostic tasks this shard took from busier shards and ran")),
+    });
+
+    for (unsigned l = 1; l < internal::memory_pressure_monitor::nr_levels; ++l) {
+        _metric_groups.add_group("memory", {
+            sm::make_counter("pressure_transitions", [this, l] { return _memory_pressure_monitor->get_stats().transitions[l]; },
+                    sm::description("Total number of times the shard entered the memory pressure level"),
+                    {sm::label("level")(l == unsigned(memory::pressure_level::elevated) ? "elevated" : "critical")}),
+        });
+    }
+
+    for (unsigned shard = 0; shard < smp::count; ++shard) {
+        if (shard == this_shard_id()) {
+            continue;
+        }
+        auto dest_l = sm::label("destination_shard")(shard);
+        _metric_groups.add_group("memory", {
+            sm::make_counter("cross_cpu_free_operations_to", [shard] { return memory::cross_shard_free_stats(shard).frees; },
+                    sm::description("Total number of frees of objects owned by the destination shard"), {dest_l}),
+            sm::make_counter("cross_cpu_free_batches_to", [shard] { return memory::cross_shard_free_stats(shard).batches; },
+                    sm::description("Total number of batches in which freed objects were handed back to the destination shard"), {dest_l}),
+        });
+    }
+
     _metric_groups.add_group("reactor", {
             sm::make_counter("logging_failures", [] { return logging_failures; }, sm::description("Total number of logging failures")),
             // total_operations value:DERIVE:0:U
@@ -2648,8 +3328,20 @@ void reactor::run_tasks(task_queue& tq) {
         STAP_PROBE(seastar, reactor_run_tasks_single_start);
         internal::task_histogram_add_task(*tsk);
         _current_task = tsk;
-        tsk->run_and_dispose();
+        if (_cpu_profiler) [[unlikely]] {
+            _current_task_type = &typeid(*tsk);
+        }
+        *internal::current_span_ptr() = tsk->span_handle();
+        internal::current_task_locals_ptr()->locals = tsk->locals_handle();
+        if (tsk == tq._sampled_task) [[unlikely]] {
+            run_sampled_task(tq, *tsk);
+        } else {
+            tsk->run_and_dispose();
+        }
         _current_task = nullptr;
+        _current_task_type = nullptr;
+        // The task may have been the last owner of its values
+        internal::reset_task_locals();
         STAP_PROBE(seastar, reactor_run_tasks_single_end);
         ++tq._tasks_processed;
         ++_global_tasks_processed;
@@ -2668,6 +3360,67 @@ void reactor::run_tasks(task_queue& tq) {
     }
 }
 
+void reactor::maybe_sample_task(task_queue& tq, task* t) noexcept {
+    if (tq._sampled_task || --tq._sample_countdown) [[likely]] {
+        return;
+    }
+    if (!_task_sample_interval) {
+        tq._sample_countdown = std::numeric_limits<unsigned>::max();
+        return;
+    }
+    tq._sample_countdown = _task_sample_interval;
+    tq._sampled_task = t;
+    tq._sampled_at = now();
+}
+
+void reactor::run_sampled_task(task_queue& tq, task& t) noexcept {
+    tq._sampled_task = nullptr;
+    // The task is gone once it ran
+    const std::type_info* type = _task_latency_by_type ? &typeid(t) : nullptr;
+    const char* tag = type ? t.tag() : nullptr;
+    auto start = now();
+    t.run_and_dispose();
+    auto runtime = now() - start;
+    auto queueing_delay = start - tq._sampled_at;
+    tq._queueing_delay_histogram.add(queueing_delay / 1us);
+    tq._task_runtime_histogram.add(runtime / 1us);
+    if (type) {
+        try {
+            account_task_type(tq, *type, tag, queueing_delay, runtime);
+        } catch (...) {
+            // Only statistics are lost
+        }
+    }
+}
+
+void reactor::account_task_type(task_queue& tq, const std::type_info& type, const char* tag, sched_clock::duration queueing_delay, sched_clock::duration runtime) {
+    auto key = tag ? task_queue::task_type_key(std::string_view(tag)) : task_queue::task_type_key(std::type_index(type));
+    if (tq._task_type_stats.size() >= task_queue::max_task_types && !tq._task_type_stats.contains(key)) {
+        tag = "[other]";
+        key = std::string_view(tag);
+    }
+    auto [it, inserted] = tq._task_type_stats.try_emplace(key);
+    auto& stats = it->second;
+    if (inserted) {
+        stats.name = tag ? sstring(tag) : pretty_type_name(type);
+        namespace sm = seastar::metrics;
+        static auto group = sm::label("group");
+        static auto task_type = sm::label("task_type");
+        std::vector<sm::label_instance> labels{group(tq._name), task_type(stats.name)};
+        stats.metrics.add_group("scheduler", {
+            sm::make_counter("task_type_samples", stats.samples,
+                    sm::description("Number of sampled tasks of this type"), labels),
+            sm::make_counter("task_type_queueing_delay_us", [&stats] { return stats.queueing_delay / 1us; },
+                    sm::description("Accumulated time sampled tasks of this type waited in the queue before running"), labels),
+            sm::make_counter("task_type_runtime_us", [&stats] { return stats.runtime / 1us; },
+                    sm::description("Accumulated runtime of the sampled tasks of this type"), labels),
+        });
+    }
+    stats.samples++;
+    stats.queueing_delay += queueing_delay;
+    stats.runtime += runtime;
+}
+
 namespace {
 
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
@@ -2855,6 +3608,37 @@ class reactor::drain_cross_cpu_freelist_pollfn final : public simple_pollfn<true
     }
 };
 
+// Free memory only changes while tasks run, so there is nothing to
+// notice while the reactor sleeps.
+class reactor::memory_pressure_pollfn final : public simple_pollfn<true> {
+    reactor& _r;
+public:
+    memory_pressure_pollfn(reactor& r) : _r(r) {}
+    virtual bool poll() final override {
+        return _r._memory_pressure_monitor->poll();
+    }
+};
+
+// Only steals while there is nothing else to do. Keeps the reactor from
+// going to sleep while another shard has a backlog; shards that are already
+// asleep are woken up by the shard whose backlog builds up.
+class reactor::work_stealing_pollfn final : public reactor::pollfn {
+    reactor& _r;
+public:
+    work_stealing_pollfn(reactor& r) : _r(r) {}
+    virtual bool poll() final override {
+        return !_r.have_more_tasks() && internal::try_steal_work();
+    }
+    virtual bool pure_poll() final override {
+        return internal::have_stealable_work();
+    }
+    virtual bool try_enter_interrupt_mode() override {
+        return !internal::have_stealable_work();
+    }
+    virtual void exit_interrupt_mode() override final {
+    }
+};
+
 class reactor::lowres_timer_pollfn final : public reactor::pollfn {
     reactor& _r;
     // A highres timer is implemented as a waking  signal; so
@@ -2979,6 +3763,14 @@ reactor::wakeup() {
     ::write(_notify_eventfd.get(), &one, sizeof(one));
 }
 
+void reactor::cancel_io(io_completion* desc) noexcept {
+    _backend->cancel_io(desc);
+}
+
+bool reactor::supports_nvme_passthrough() const noexcept {
+    return _backend->supports_nvme_passthrough();
+}
+
 void reactor::start_aio_eventfd_loop() {
     if (!_aio_eventfd) {
         return;
@@ -3049,6 +3841,7 @@ reactor::insert_activating_task_queues() {
 void reactor::add_task(task* t) noexcept {
     auto sg = t->group();
     auto* q = _task_queues[sg._id].get();
+    maybe_sample_task(*q, t);
     bool was_empty = q->_q.empty();
     q->_q.push_back(std::move(t));
     shuffle(q->_q.back(), q->_q);
@@ -3061,6 +3854,7 @@ void reactor::add_urgent_task(task* t) noexcept {
     memory::scoped_critical_alloc_section _;
     auto sg = t->group();
     auto* q = _task_queues[sg._id].get();
+    maybe_sample_task(*q, t);
     bool was_empty = q->_q.empty();
     q->_q.push_front(std::move(t));
     shuffle(q->_q.front(), q->_q);
@@ -3115,13 +3909,21 @@ reactor::run_some_tasks() {
         t_run_completed = now();
         auto delta = t_run_completed - t_run_started;
         account_runtime(*tq, delta);
+        if (tq->_cpu_cap < 1.0f) [[unlikely]] {
+            charge_cpu_cap(*tq, delta, t_run_completed);
+        }
         sched_print("run complete ({} {}); time consumed {} usec; final vruntime {} empty {}",
                 (void*)tq, tq->_name, delta / 1us, tq->_vruntime, tq->_q.empty());
         tq->_ts = t_run_completed;
-        if (!tq->_q.empty()) {
+        if (tq->_throttled) {
+            // Stays off the active list until unthrottle_task_queues()
+        } else if (!tq->_q.empty()) {
             insert_active_task_queue(tq);
         } else {
             tq->_active = false;
+            if (_nr_nested_task_queues && tq->nested()) {
+                update_nested_shares();
+            }
         }
         // We must not use internal::scheduler_need_preempt() below,
         // since in debug mode we'll never have two successive calls
@@ -3134,6 +3936,7 @@ reactor::run_some_tasks() {
     _cpu_stall_detector->end_task_run(t_run_completed);
     STAP_PROBE(seastar, reactor_run_tasks_end);
     *internal::current_scheduling_group_ptr() = default_scheduling_group(); // Prevent inheritance from last group run
+    *internal::current_span_ptr() = 0;
     sched_print("run_some_tasks: end");
 }
 
@@ -3157,6 +3960,9 @@ reactor::activate(task_queue& tq) {
     tq._waittime += now - tq._ts;
     tq._ts = now;
     _activating_task_queues.push_back(&tq);
+    if (_nr_nested_task_queues && tq.nested()) {
+        update_nested_shares();
+    }
 }
 
 void reactor::service_highres_timer() noexcept {
@@ -3217,6 +4023,19 @@ int reactor::do_run() {
        }
        _signals.handle_signal_once(SIGTERM, [this] { stop(); });
     }
+    if (_id == 0 && _cfg.dump_memory_diagnostics_on_sigusr2) {
+        _signals.handle_signal(SIGUSR2, [] {
+            (void)smp::invoke_on_all([] {
+                memory::internal::log_memory_diagnostics_report(log_level::info);
+            });
+        });
+    }
+    if (_id == 0 && _cfg.dump_stall_profile_on_sigusr1) {
+        _signals.handle_signal(SIGUSR1, [] {
+            // FIXME: future is discarded
+            (void)stall_profile::dump();
+        });
+    }
 
     // Start initialization in the background.
     // Communicate when done using _start_promise.
@@ -3236,6 +4055,11 @@ int reactor::do_run() {
     poller syscall_poller(std::make_unique<syscall_pollfn>(*this));
 
     poller drain_cross_cpu_freelist(std::make_unique<drain_cross_cpu_freelist_pollfn>());
+    poller memory_pressure_poller(std::make_unique<memory_pressure_pollfn>(*this));
+    std::optional<poller> work_stealing_poller;
+    if (_cfg.work_stealing && smp::count > 1) {
+        work_stealing_poller.emplace(std::make_unique<work_stealing_pollfn>(*this));
+    }
 
     poller expire_lowres_timers(std::make_unique<lowres_timer_pollfn>(*this));
     poller sig_poller(std::make_unique<signal_pollfn>(*this));
@@ -3267,10 +4091,13 @@ int reactor::do_run() {
     struct sigaction sa_block_notifier = {};
     sa_block_notifier.sa_handler = &reactor::block_notifier;
     sa_block_notifier.sa_flags = SA_RESTART;
+    sigaddset(&sa_block_notifier.sa_mask, internal::cpu_profiler::signal_number());
     auto r = sigaction(internal::cpu_stall_detector::signal_number(), &sa_block_notifier, nullptr);
     assert(r == 0);
 
     bool idle = false;
+    auto last_idle_check = idle_start;
+    auto last_idle_action = internal::idle_action::spin;
 
     std::function<bool()> check_for_work = [this] () {
         return poll_once() || have_more_tasks();
@@ -3312,7 +4139,12 @@ int reactor::do_run() {
             if (!idle) {
                 idle_start = idle_end;
                 idle = true;
+            } else if (last_idle_action == internal::idle_action::pause) {
+                _total_idle_pause += idle_end - last_idle_check;
+            } else {
+                _total_idle_spin += idle_end - last_idle_check;
             }
+            last_idle_action = internal::idle_action::spin;
             bool go_to_sleep = true;
             try {
                 // we can't run check_for_work(), because that can run tasks in the context
@@ -3324,8 +4156,14 @@ int reactor::do_run() {
                 report_exception("Exception while running idle cpu handler", std::current_exception());
             }
             if (go_to_sleep) {
-                internal::cpu_relax();
-                if (idle_end - idle_start > _max_poll_time) {
+                // A parked shard expects no work soon, so does not wait for it
+                auto action = _parked ? internal::idle_action::sleep : _idle_poll_policy.decide(idle_end - idle_start);
+                if (action == internal::idle_action::spin) {
+                    internal::cpu_relax();
+                } else if (action == internal::idle_action::pause) {
+                    _idle_poll_policy.pause();
+                    last_idle_action = action;
+                } else {
                     // Turn off the task quota timer to avoid spurious wakeups
                     struct itimerspec zero_itimerspec = {};
                     _task_quota_timer.timerfd_settime(0, zero_itimerspec);
@@ -3336,6 +4174,7 @@ int reactor::do_run() {
                     // We may have slept for a while, so freshen idle_end
                     idle_end = now();
                     _total_sleep += idle_end - start_sleep;
+                    ++_sleeps;
                     _task_quota_timer.timerfd_settime(0, task_quote_itimerspec);
                 }
             } else {
@@ -3343,6 +4182,7 @@ int reactor::do_run() {
                 // any work.
                 check_for_work();
             }
+            last_idle_check = idle_end;
         }
     }
     // To prevent ordering issues from rising, destroy the I/O queue explicitly at this point.
@@ -3542,6 +4382,10 @@ smp_message_queue::smp_message_queue(reactor* from, reactor* to)
 smp_message_queue::~smp_message_queue()
 {
     if (_pending.remote != _completed.remote) {
+        // Items may live in the small item slots, release them first.
+        auto release = [] (work_item* wi) { wi->release(); };
+        _pending.consume_all(release);
+        _completed.consume_all(release);
         _tx.a.~aa();
     }
 }
@@ -3550,9 +4394,19 @@ void smp_message_queue::stop() {
     _metrics.clear();
 }
 
+void smp_message_queue::tx_side::init() {
+    new (&a) aa;
+    a.pending_fifo.reserve(queue_length);
+    a.small_slots = std::make_unique<small_slot[]>(nr_small_items);
+    for (size_t i = 0; i < nr_small_items; ++i) {
+        a.small_slots[i].next = a.free_small_slots;
+        a.free_small_slots = &a.small_slots[i];
+    }
+}
+
 void smp_message_queue::move_pending() {
-    auto begin = _tx.a.pending_fifo.cbegin();
-    auto end = _tx.a.pending_fifo.cend();
+    auto begin = _tx.a.pending_fifo.begin();
+    auto end = _tx.a.pending_fifo.end();
     end = _pending.push(begin, end);
     if (begin == end) {
         return;
@@ -3571,23 +4425,38 @@ bool smp_message_queue::pure_poll_tx() const {
     return !const_cast<lf_queue&>(_completed).empty();
 }
 
-void smp_message_queue::submit_item(shard_id t, smp_timeout_clock::time_point timeout, std::unique_ptr<smp_message_queue::work_item> item) {
+// Under throughput load, requests in flight keep the remote shard busy while
+// more are batched; a lone request is sent right away.
+size_t smp_message_queue::request_batch_size() const noexcept {
+    return std::clamp<size_t>(_current_queue_length / 4, 1, max_batch_size);
+}
+
+// Responds in batches the size of the request batches coming in, so that a
+// lone request is answered right away.
+size_t smp_message_queue::response_batch_size() const noexcept {
+    return std::clamp<size_t>(_last_rcv_batch, 1, max_batch_size);
+}
+
+void smp_message_queue::submit_item(shard_id t, smp_timeout_clock::time_point timeout, bool latency_sensitive, work_item_ptr item) {
   // matching signal() in process_completions()
   auto ssg_id = internal::smp_service_group_id(item->ssg);
   auto& sem = get_smp_service_groups_semaphore(ssg_id, t);
   // Future indirectly forwarded to `item`.
-  (void)get_units(sem, 1, timeout).then_wrapped([this, item = std::move(item)] (future<smp_service_group_semaphore_units> units_fut) mutable {
+  (void)get_units(sem, 1, timeout).then_wrapped([this, latency_sensitive, item = std::move(item)] (future<smp_service_group_semaphore_units> units_fut) mutable {
     if (units_fut.failed()) {
         item->fail_with(units_fut.get_exception());
         ++_compl;
         ++_last_cmpl_batch;
         return;
     }
+    if (_tx.a.pending_fifo.empty()) {
+        item->sent_at = std::chrono::steady_clock::now();
+    }
     _tx.a.pending_fifo.push_back(item.get());
     // no exceptions from this point
     item.release();
     units_fut.get().release();
-    if (_tx.a.pending_fifo.size() >= batch_size) {
+    if (latency_sensitive || _tx.a.pending_fifo.size() >= request_batch_size() || _pending.remote->_sleeping.load(std::memory_order_relaxed)) {
         move_pending();
     }
   });
@@ -3595,7 +4464,7 @@ void smp_message_queue::submit_item(shard_id t, smp_timeout_clock::time_point ti
 
 void smp_message_queue::respond(work_item* item) {
     _completed_fifo.push_back(item);
-    if (_completed_fifo.size() >= batch_size || engine()._stopped) {
+    if (_completed_fifo.size() >= response_batch_size() || engine()._stopped || _completed.remote->_sleeping.load(std::memory_order_relaxed)) {
         flush_response_batch();
     }
 }
@@ -3636,13 +4505,15 @@ smp_message_queue::lf_queue::maybe_wakeup() {
     if (remote->_sleeping.load(std::memory_order_relaxed)) {
         // We are free to clear it, because we're sending a signal now
         remote->_sleeping.store(false, std::memory_order_relaxed);
-        remote->wakeup();
+        if (!engine()._backend->wake_up(*remote)) {
+            remote->wakeup();
+        }
     }
 }
 
 smp_message_queue::lf_queue::~lf_queue() {
     consume_all([] (work_item* ptr) {
-        delete ptr;
+        ptr->release();
     });
 }
 
@@ -3671,11 +4542,20 @@ size_t smp_message_queue::process_queue(lf_queue& q, Func process) {
 }
 
 size_t smp_message_queue::process_completions(shard_id t) {
-    auto nr = process_queue<prefetch_cnt*2>(_completed, [t] (work_item* wi) {
+    auto now = std::chrono::steady_clock::time_point();
+    auto nr = process_queue<prefetch_cnt*2>(_completed, [this, t, &now] (work_item* wi) {
+        if (wi->sent_at != std::chrono::steady_clock::time_point()) {
+            if (now == std::chrono::steady_clock::time_point()) {
+                now = std::chrono::steady_clock::now();
+            }
+            uint64_t rtt = std::chrono::duration_cast<std::chrono::nanoseconds>(now - wi->sent_at).count();
+            _rtt_ns = _rtt_ns ? (_rtt_ns * 7 + rtt) / 8 : rtt;
+            _completion_latency.add(rtt / 1000);
+        }
         wi->complete();
         auto ssg_id = internal::smp_service_group_id(wi->ssg);
         get_smp_service_groups_semaphore(ssg_id, t).signal();
-        delete wi;
+        wi->release();
     });
     _current_queue_length -= nr;
     _compl += nr;
@@ -3691,7 +4571,14 @@ void smp_message_queue::flush_request_batch() {
 }
 
 size_t smp_message_queue::process_incoming() {
-    auto nr = process_queue<prefetch_cnt>(_pending, [] (work_item* wi) {
+    auto now = std::chrono::steady_clock::time_point();
+    auto nr = process_queue<prefetch_cnt>(_pending, [this, &now] (work_item* wi) {
+        if (wi->sent_at != std::chrono::steady_clock::time_point()) {
+            if (now == std::chrono::steady_clock::time_point()) {
+                now = std::chrono::steady_clock::now();
+            }
+            _execution_latency.add(std::chrono::duration_cast<std::chrono::microseconds>(now - wi->sent_at).count());
+        }
         wi->process();
     });
     _received += nr;
@@ -3704,19 +4591,31 @@ void smp_message_queue::start(unsigned cpuid) {
     namespace sm = seastar::metrics;
     char instance[10];
     std::snprintf(instance, sizeof(instance), "%u-%u", this_shard_id(), cpuid);
+    // There are smp::count * (smp::count - 1) queues, so their metrics are
+    // only exported on request.
+    bool enabled = engine()._cfg.smp_queue_metrics;
+    std::vector<sm::label_instance> labels{sm::shard_label(instance), sm::label("source_shard")(this_shard_id()), sm::label("destination_shard")(cpuid)};
     _metrics.add_group("smp", {
             // queue_length     value:GAUGE:0:U
             // Absolute value of num packets in last tx batch.
-            sm::make_queue_length("send_batch_queue_length", _last_snt_batch, sm::description("Current send batch queue length"), {sm::shard_label(instance)})(sm::metric_disabled),
-            sm::make_queue_length("receive_batch_queue_length", _last_rcv_batch, sm::description("Current receive batch queue length"), {sm::shard_label(instance)})(sm::metric_disabled),
-            sm::make_queue_length("complete_batch_queue_length", _last_cmpl_batch, sm::description("Current complete batch queue length"), {sm::shard_label(instance)})(sm::metric_disabled),
-            sm::make_queue_length("send_queue_length", _current_queue_length, sm::description("Current send queue length"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_queue_length("send_batch_queue_length", _last_snt_batch, sm::description("Current send batch queue length"), labels)(enabled),
+            sm::make_queue_length("receive_batch_queue_length", _last_rcv_batch, sm::description("Current receive batch queue length"), labels)(enabled),
+            sm::make_queue_length("complete_batch_queue_length", _last_cmpl_batch, sm::description("Current complete batch queue length"), labels)(enabled),
+            sm::make_queue_length("send_queue_length", _current_queue_length, sm::description("Current send queue length"), labels)(enabled),
+            sm::make_queue_length("pending_queue_length", [this] { return _tx.a.pending_fifo.size(); },
+                    sm::description("Number of requests waiting to be sent in the next batch"), labels)(enabled),
+            sm::make_gauge("round_trip_time", [this] { return std::chrono::duration<double>(std::chrono::nanoseconds(_rtt_ns)).count(); },
+                    sm::description("Moving average of the time (in seconds) from sending a request to processing its response"), labels)(enabled),
             // total_operations value:DERIVE:0:U
-            sm::make_counter("total_received_messages", _received, sm::description("Total number of received messages"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_counter("total_received_messages", _received, sm::description("Total number of received messages"), labels)(enabled),
             // total_operations value:DERIVE:0:U
-            sm::make_counter("total_sent_messages", _sent, sm::description("Total number of sent messages"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_counter("total_sent_messages", _sent, sm::description("Total number of sent messages"), labels)(enabled),
             // total_operations value:DERIVE:0:U
-            sm::make_counter("total_completed_messages", _compl, sm::description("Total number of messages completed"), {sm::shard_label(instance)})(sm::metric_disabled)
+            sm::make_counter("total_completed_messages", _compl, sm::description("Total number of messages completed"), labels)(enabled),
+            sm::make_histogram("execution_latency", [this] { return _execution_latency.to_metrics_histogram(); },
+                    sm::description("Histogram of the time (in microseconds) from enqueueing a sampled request to the destination shard starting to run it"), labels)(enabled),
+            sm::make_histogram("completion_latency", [this] { return _completion_latency.to_metrics_histogram(); },
+                    sm::description("Histogram of the time (in microseconds) from enqueueing a sampled request to processing its response"), labels)(enabled),
     });
 }
 
@@ -3821,15 +4720,47 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , poll_mode(*this, "poll-mode", "poll continuously (100% cpu use)")
     , idle_poll_time_us(*this, "idle-poll-time-us", reactor::calculate_poll_time() / 1us,
                 "idle polling time in microseconds (reduce for overprovisioned environments or laptops)")
+    , adaptive_idle_poll(*this, "adaptive-idle-poll", false,
+                "adapt idle polling to the arrival of work: sleep right away when no work is expected within --idle-poll-time-us, and poll only for a few times the usual idle period otherwise")
+    , idle_poll_pause(*this, "idle-poll-pause", true,
+                "with --adaptive-idle-poll, pause the core in a power-saving state (tpause) between polls once work is late, where the CPU supports it")
     , poll_aio(*this, "poll-aio", true,
                 "busy-poll for disk I/O (reduces latency and increases throughput)")
     , task_quota_ms(*this, "task-quota-ms", 0.5, "Max time (ms) between polls")
     , io_latency_goal_ms(*this, "io-latency-goal-ms", {}, "Max time (ms) io operations must take (1.5 * task-quota-ms if not set)")
     , io_flow_ratio_threshold(*this, "io-flow-rate-threshold", 1.1, "Dispatch rate to completion rate threshold")
+    , io_model_factor_min(*this, "io-model-factor-min", 1.0,
+                "Lowest fraction of the io-properties rates the disk model can be calibrated down to from observed latencies")
+    , io_model_factor_max(*this, "io-model-factor-max", 1.0,
+                "Highest multiple of the io-properties rates the disk model can be calibrated up to from observed latencies")
+    , io_share_idle_capacity(*this, "io-share-idle-capacity", false,
+                "Let shards with requests to dispatch use the share of the IO group capacity of shards that have none")
+    , io_capacity_grab_batch(*this, "io-capacity-grab-batch", 0.0,
+                "Fraction of its per-tick share of the IO group capacity a shard grabs at once, touching the capacity shared with the other shards less often (0 to grab it request by request)")
+    , io_slow_log_threshold_ms(*this, "io-slow-log-threshold-ms", 0.0,
+                "Log disk requests taking longer than this (ms) from being queued to their completion, with the breakdown of their latency (0 to disable)")
     , max_task_backlog(*this, "max-task-backlog", 1000, "Maximum number of task backlog to allow; above this we ignore I/O")
+    , task_latency_sample_interval(*this, "task-latency-sample-interval", 128,
+                "Sample the queueing delay and runtime of one task in this many, per scheduling group (0 to disable)")
+    , task_latency_by_type(*this, "task-latency-by-type", false,
+                "Break the sampled task queueing delays and runtimes down by task type")
+    , thread_stack_pool_size(*this, "thread-stack-pool-size", 16,
+                "Number of stacks of each size kept for reuse by new seastar threads, per shard (0 to disable)")
+    , thread_stack_pool_madvise_free(*this, "thread-stack-pool-madvise-free", false,
+                "Give the pages of pooled thread stacks back to the kernel (MADV_FREE) until they are reused")
+    , coroutine_frame_pool_size(*this, "coroutine-frame-pool-size", unsigned(internal::coroutine_frame_pool::default_max_pooled_bytes),
+                "Bytes of freed coroutine frames kept for reuse, per shard (0 to disable)")
     , blocked_reactor_notify_ms(*this, "blocked-reactor-notify-ms", 25, "threshold in miliseconds over which the reactor is considered blocked if no progress is made")
     , blocked_reactor_reports_per_minute(*this, "blocked-reactor-reports-per-minute", 5, "Maximum number of backtraces reported by stall detector per minute")
     , blocked_reactor_report_format_oneline(*this, "blocked-reactor-report-format-oneline", true, "Print a simplified backtrace on a single line")
+    , blocked_reactor_profile(*this, "blocked-reactor-profile", false,
+                "Aggregate the backtraces of all the stalls into a profile, in the folded stacks format of flamegraphs,"
+                " served by stall_profile::add_routes() and dumped on SIGUSR1")
+    , cpu_profiler_hz(*this, "cpu-profiler-hz", 0,
+                "Sample the backtraces of the reactor that many times per second of the CPU time it uses, by scheduling group and task type,"
+                " served by cpu_profile::add_routes() (0 to disable)")
+    , cpu_profiler_max_entries(*this, "cpu-profiler-max-entries", 1024,
+                "Distinct backtraces, scheduling groups and task types the CPU profiler counts the samples of, per shard")
     , relaxed_dma(*this, "relaxed-dma", "allow using buffered I/O if DMA is not available (reduces performance)")
     , linux_aio_nowait(*this, "linux-aio-nowait", aio_nowait_supported,
                 "use the Linux NOWAIT AIO feature, which reduces reactor stalls due to aio (autodetected)")
@@ -3837,7 +4768,7 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , kernel_page_cache(*this, "kernel-page-cache", false,
                 "Use the kernel page cache. This disables DMA (O_DIRECT)."
                 " Useful for short-lived functional tests with a small data set.")
-    , overprovisioned(*this, "overprovisioned", "run in an overprovisioned environment (such as docker or a laptop); equivalent to --idle-poll-time-us 0 --thread-affinity 0 --poll-aio 0")
+    , overprovisioned(*this, "overprovisioned", "run in an overprovisioned environment (such as docker or a laptop); equivalent to --idle-poll-time-us 0 --thread-affinity 0 --poll-aio 0 --memory-release-period-ms 10000")
     , abort_on_seastar_bad_alloc(*this, "abort-on-seastar-bad-alloc", "abort when seastar allocator cannot allocate memory")
     , force_aio_syscalls(*this, "force-aio-syscalls", false,
                 "Force io_getevents(2) to issue a system call, instead of bypassing the kernel when possible."
@@ -3847,6 +4778,9 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
                  " Accepted values: none, critical (default), all. When set to critical, only allocations marked as critical will trigger diagnostics dump."
                  " The diagnostics will be written to the seastar_memory logger, with error level."
                  " Note that if the seastar_memory logger is set to debug or trace level, the diagnostics will be logged irrespective of this setting.")
+    , dump_memory_diagnostics_on_sigusr2(*this, "dump-memory-diagnostics-on-sigusr2", true,
+                "Dump diagnostics of the seastar allocator state of all shards, including the usage of each size class, on SIGUSR2."
+                " The diagnostics will be written to the seastar_memory logger, with info level.")
     , reactor_backend(*this, "reactor-backend", backend_selector_candidates(), reactor_backend_selector::default_backend().name(),
                 fmt::format("Internal reactor implementation ({})", reactor_backend_selector::available()))
     , aio_fsync(*this, "aio-fsync", kernel_supports_aio_fsync(),
@@ -3854,6 +4788,61 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , max_networking_io_control_blocks(*this, "max-networking-io-control-blocks", 10000,
                 "Maximum number of I/O control blocks (IOCBs) to allocate per shard. This translates to the number of sockets supported per shard."
                 " Requires tuning /proc/sys/fs/aio-max-nr. Only valid for the linux-aio reactor backend (see --reactor-backend).")
+    , uring_registered_buffers(*this, "uring-registered-buffers", 0,
+                "Size (in MB) of the per-shard DMA buffer arena registered with io_uring; DMA file I/O on buffers from the arena"
+                " avoids per-request page pinning. 0 disables it. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , uring_registered_files(*this, "uring-registered-files", 1024,
+                "Size of the per-shard io_uring registered file table; I/O on files in the table skips the per-submission file lookup."
+                " Files opened once the table is full use plain descriptors. 0 disables it. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , uring_sqpoll(*this, "uring-sqpoll", false,
+                "Submit io_uring requests through a kernel polling thread (IORING_SETUP_SQPOLL), avoiding submission system calls."
+                " Requires Linux 5.11 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , uring_sqpoll_idle_ms(*this, "uring-sqpoll-idle-ms", 1000, "Time (ms) the io_uring SQPOLL kernel thread spins without work before sleeping")
+    , uring_sqpoll_cpuset(*this, "uring-sqpoll-cpuset", {},
+                "CPUs to pin the io_uring SQPOLL kernel threads to (in cpuset(7) list format); shard N uses the N-th CPU."
+                " Default: a hyperthread sibling of the shard's CPU, if any")
+    , uring_multishot(*this, "uring-multishot", false,
+                "Use multishot accept and receive requests, receiving into a ring of kernel-provided buffers, for sockets."
+                " Requires Linux 6.0 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , uring_buffer_ring_entries(*this, "uring-buffer-ring-entries", 1024,
+                "Number of buffers (a power of two) in the per-shard io_uring provided buffer ring used by --uring-multishot")
+    , uring_buffer_ring_buffer_size(*this, "uring-buffer-ring-buffer-size", 16384,
+                "Size of each buffer in the per-shard io_uring provided buffer ring used by --uring-multishot")
+    , uring_nvme_passthrough(*this, "uring-nvme-passthrough", false,
+                "Read, write and discard files on NVMe generic char devices (/dev/ngXnY) with NVMe commands passed through io_uring."
+                " Requires Linux 5.19 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , uring_zcrx_interface(*this, "uring-zcrx-interface", {},
+                "Receive TCP data with zero-copy io_uring receive requests into memory bound to this network interface's queues."
+                " Requires Linux 6.15 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , uring_zcrx_rx_queue(*this, "uring-zcrx-rx-queue", 0,
+                "Hardware receive queue of --uring-zcrx-interface bound by shard 0; shard N binds the queue N after it")
+    , uring_zcrx_area_size(*this, "uring-zcrx-area-size", 64,
+                "Size (in MB, up to 128) of the per-shard memory area the NIC places the data received with --uring-zcrx-interface in")
+    , net_busy_poll_usec(*this, "net-busy-poll-usec", 0,
+                "Busy-poll the NIC queues of the TCP sockets for this long (in microseconds) when polling for network events"
+                " (SO_BUSY_POLL, and epoll or io_uring NAPI busy polling on Linux 6.9 or later). 0 disables busy polling")
+    , net_prefer_busy_poll(*this, "net-prefer-busy-poll", false,
+                "Prefer busy polling to interrupts on the NIC queues polled with --net-busy-poll-usec (SO_PREFER_BUSY_POLL)")
+    , dma_buffer_pool_high_watermark(*this, "dma-buffer-pool-high-watermark", 8,
+                "Size (in MB) beyond which the per-shard pool of recycled DMA file I/O buffers is trimmed. 0 disables the pool.")
+    , dma_buffer_pool_low_watermark(*this, "dma-buffer-pool-low-watermark", 2,
+                "Size (in MB) the per-shard pool of recycled DMA file I/O buffers is trimmed back to")
+    , memory_release_period_ms(*this, "memory-release-period-ms", 0,
+                "Hand the memory that stayed free for this long (in milliseconds) back to the OS; 0 (the default, unless --overprovisioned) disables it")
+    , memory_release_keep_free(*this, "memory-release-keep-free", 0.1,
+                "Fraction of a shard's memory kept resident when free, rather than handed back to the OS with --memory-release-period-ms")
+    , memory_pressure_elevated_threshold(*this, "memory-pressure-elevated-threshold", 0.15,
+                "Fraction of a shard's memory below which free memory raises the shard's memory pressure level to elevated")
+    , memory_pressure_critical_threshold(*this, "memory-pressure-critical-threshold", 0.05,
+                "Fraction of a shard's memory below which free memory raises the shard's memory pressure level to critical")
+    , work_stealing(*this, "work-stealing", false,
+                "Let idle shards steal work submitted with submit_stealable() from shards that fall behind")
+    , tsc_clock(*this, "tsc-clock", true,
+                "Read the reactor's clock from the CPU's timestamp counter, calibrated against the system's monotonic clock, when the counter is invariant")
+    , smp_queue_metrics(*this, "smp-queue-metrics", false,
+                "Export metrics, including latency histograms, for each pair of shards exchanging cross-shard calls")
+    , syscall_threads(*this, "syscall-threads", 1,
+                "Number of threads of each shard running the blocking system calls of file system operations")
 #ifdef SEASTAR_HEAPPROF
     , heapprof(*this, "heapprof", 0, "Enable seastar heap profiling. Sample every ARG bytes. 0 means off")
 #else
@@ -3880,6 +4869,9 @@ smp_options::smp_options(program_options::option_group* parent_group)
     , io_properties_file(*this, "io-properties-file", {}, "path to a YAML file describing the characteristics of the I/O Subsystem")
     , io_properties(*this, "io-properties", {}, "a YAML string describing the characteristics of the I/O Subsystem")
     , mbind(*this, "mbind", true, "enable mbind")
+    , huge_page_allocation_threshold(*this, "huge-page-allocation-threshold", {},
+                "serve allocations of at least this size (ex: 2M) from whole huge pages, asking the kernel to back them with"
+                " transparent huge pages right away (default: off)")
 #ifndef SEASTAR_NO_EXCEPTION_HACK
     , enable_glibc_exception_scaling_workaround(*this, "enable-glibc-exception-scaling-workaround", true, "enable workaround for glibc/gcc c++ exception scalablity problem")
 #else
@@ -3890,6 +4882,8 @@ smp_options::smp_options(program_options::option_group* parent_group)
 #else
     , allow_cpus_in_remote_numa_nodes(*this, "allow-cpus-in-remote-numa-nodes", program_options::unused{})
 #endif
+    , offload_shards(*this, "offload-shards", 0, "number of shards, the highest-numbered ones, to reserve for background work submitted with offload()")
+    , offload_queue_depth(*this, "offload-queue-depth", 128, "most requests each shard may have in flight to each offload shard")
 {
 }
 
@@ -3914,6 +4908,182 @@ void smp::start_all_queues()
         }
     }
     _alien._qs[this_shard_id()].start();
+
+    // The queues from this shard, summed up by the NUMA node of their
+    // destination: unlike those of each queue, always exported
+    namespace sm = seastar::metrics;
+    std::map<unsigned, std::vector<unsigned>> shards_of_node;
+    for (unsigned c = 0; c < count; c++) {
+        if (c != this_shard_id()) {
+            shards_of_node[numa_node(c)].push_back(c);
+        }
+    }
+    std::vector<sm::metric_definition> defs;
+    for (auto& [node, shards] : shards_of_node) {
+        std::vector<sm::label_instance> labels{sm::label("destination_node")(node)};
+        auto queues = [shards] {
+            return shards | boost::adaptors::transformed([] (unsigned c) -> const smp_message_queue& {
+                return _qs[c][this_shard_id()];
+            });
+        };
+        defs.push_back(sm::make_counter("node_sent_messages", [queues] {
+            uint64_t sent = 0;
+            for (auto& q : queues()) {
+                sent += q._sent;
+            }
+            return sent;
+        }, sm::description("Total number of messages sent to the shards of a NUMA node"), labels));
+        defs.push_back(sm::make_gauge("node_round_trip_time", [queues] {
+            uint64_t total = 0, n = 0;
+            for (auto& q : queues()) {
+                if (q._rtt_ns) {
+                    total += q._rtt_ns;
+                    n++;
+                }
+            }
+            return n ? std::chrono::duration<double>(std::chrono::nanoseconds(total / n)).count() : 0.0;
+        }, sm::description("Average of the moving averages of the round-trip times (in seconds) of the messages to the shards of a NUMA node"), labels));
+        defs.push_back(sm::make_histogram("node_completion_latency", [queues] {
+            smp_message_queue::latency_histogram h;
+            for (auto& q : queues()) {
+                h.merge(q._completion_latency);
+            }
+            return h.to_metrics_histogram();
+        }, sm::description("Histogram of the time (in microseconds) from enqueueing a sampled request to a shard of a NUMA node to processing its response"), labels));
+    }
+    engine()._metric_groups.add_group("smp", defs);
+}
+
+// The NUMA node of the memory of each shard, and the shards by increasing
+// distance from each of them, set up before the shards start.
+static std::vector<unsigned> shard_numa_nodes;
+static std::vector<std::vector<unsigned>> shards_by_numa_distance;
+
+// The distances between NUMA nodes from sysfs, in the units of the ACPI
+// SLIT table: 10 for a node to itself, about 20 to 30 across sockets
+static unsigned numa_distance(unsigned from, unsigned to) {
+    static constexpr unsigned local = 10, remote = 20;
+    try {
+        auto line = read_first_line(fmt::format("/sys/devices/system/node/node{}/distance", from));
+        std::istringstream in{std::string(line)};
+        unsigned d = remote;
+        for (unsigned n = 0; n <= to && in >> d; n++) {
+        }
+        return in ? d : (from == to ? local : remote);
+    } catch (...) {
+        return from == to ? local : remote;
+    }
+}
+
+static void set_shard_numa_nodes(const std::vector<resource::cpu>& allocations) {
+    shard_numa_nodes.resize(allocations.size());
+    for (unsigned c = 0; c < allocations.size(); c++) {
+        auto& mem = allocations[c].mem;
+        auto largest = std::max_element(mem.begin(), mem.end(), [] (auto& a, auto& b) { return a.bytes < b.bytes; });
+        shard_numa_nodes[c] = largest == mem.end() ? 0 : largest->nodeid;
+    }
+    std::map<std::pair<unsigned, unsigned>, unsigned> distances;
+    for (auto from : shard_numa_nodes) {
+        for (auto to : shard_numa_nodes) {
+            if (!distances.contains({from, to})) {
+                distances[{from, to}] = numa_distance(from, to);
+            }
+        }
+    }
+    shards_by_numa_distance.assign(allocations.size(), {});
+    for (unsigned c = 0; c < allocations.size(); c++) {
+        auto& order = shards_by_numa_distance[c];
+        order.resize(allocations.size());
+        std::iota(order.begin(), order.end(), 0);
+        // Itself first, then by distance, and by id for the same distance
+        std::stable_sort(order.begin(), order.end(), [&] (unsigned a, unsigned b) {
+            auto da = std::pair(a != c, distances[{shard_numa_nodes[c], shard_numa_nodes[a]}]);
+            auto db = std::pair(b != c, distances[{shard_numa_nodes[c], shard_numa_nodes[b]}]);
+            return da < db;
+        });
+    }
+}
+
+unsigned smp::numa_node(unsigned id) noexcept {
+    return shard_numa_nodes[id];
+}
+
+const std::vector<unsigned>& smp::shards_by_distance(unsigned id) noexcept {
+    return shards_by_numa_distance[id];
+}
+
+// Where the work routed with smp::active_shard() goes: the shard itself,
+// unless it is parked. Only changed on shard 0, read by all of them.
+static std::unique_ptr<std::atomic<unsigned>[]> shard_route;
+
+static void remap_parked_shards(const std::vector<bool>& parked) {
+    std::vector<unsigned> active;
+    for (unsigned c = 0; c < smp::count; c++) {
+        if (!parked[c]) {
+            active.push_back(c);
+        }
+    }
+    for (unsigned c = 0; c < smp::count; c++) {
+        shard_route[c].store(parked[c] ? active[c % active.size()] : c, std::memory_order_relaxed);
+    }
+}
+
+static std::vector<bool> parked_shards() {
+    std::vector<bool> parked(smp::count);
+    for (unsigned c = 0; c < smp::count; c++) {
+        parked[c] = smp::parked(c);
+    }
+    return parked;
+}
+
+future<> smp::park(unsigned id) {
+    assert(this_shard_id() == 0);
+    if (id == 0 || id >= count) {
+        return make_exception_future<>(std::invalid_argument(format("cannot park shard {}", id)));
+    }
+    if (parked(id)) {
+        return make_ready_future<>();
+    }
+    auto parked = parked_shards();
+    parked[id] = true;
+    remap_parked_shards(parked);
+    return submit_to(id, [] {
+        engine()._parked = true;
+    });
+}
+
+future<> smp::unpark(unsigned id) {
+    assert(this_shard_id() == 0);
+    if (id >= count) {
+        return make_exception_future<>(std::invalid_argument(format("cannot unpark shard {}", id)));
+    }
+    if (!parked(id)) {
+        return make_ready_future<>();
+    }
+    // Wake the reactor up before routing work to it again
+    return submit_to(id, [] {
+        engine()._parked = false;
+    }).then([id] {
+        auto parked = parked_shards();
+        parked[id] = false;
+        remap_parked_shards(parked);
+    });
+}
+
+bool smp::parked(unsigned id) noexcept {
+    return active_shard(id) != id;
+}
+
+unsigned smp::active_shard(unsigned id) noexcept {
+    return shard_route[id].load(std::memory_order_relaxed);
+}
+
+unsigned smp::active_count() noexcept {
+    unsigned n = 0;
+    for (unsigned c = 0; c < count; c++) {
+        n += !parked(c);
+    }
+    return n;
 }
 
 #ifdef SEASTAR_HAVE_DPDK
@@ -3962,6 +5132,7 @@ void smp::allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_co
     int r = posix_memalign(&buf, cache_line_size, sizeof(reactor));
     assert(r == 0);
     *internal::this_shard_id_ptr() = id;
+    memory::internal::set_shard_id(id);
     local_engine = new (buf) reactor(this->shared_from_this(), _alien, id, std::move(rbs), cfg);
     reactor_holder.reset(local_engine);
 }
@@ -3969,6 +5140,7 @@ void smp::allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_co
 void smp::cleanup() noexcept {
     smp::_threads = std::vector<posix_thread>();
     _thread_loops.clear();
+    internal::disable_work_stealing();
     reactor_holder.reset();
     local_engine = nullptr;
 }
@@ -4025,11 +5197,13 @@ static void reraise_signal(int signo) {
 }
 
 static void sigsegv_action() noexcept {
+    logger::flush_async();
     print_with_backtrace("Segmentation fault");
     reraise_signal(SIGSEGV);
 }
 
 static void sigabrt_action() noexcept {
+    logger::flush_async();
     print_with_backtrace("Aborting");
     reraise_signal(SIGABRT);
 }
@@ -4042,6 +5216,23 @@ void install_oneshot_signal_handler<SIGSEGV, sigsegv_action>() {
 }
 #endif
 
+// Allocates the queues to a shard from its own memory, on its NUMA node:
+// the senders only write to the rings while the receiver reads and writes
+// them, and polls them even when there is no message.
+void smp::allocate_queues_to(unsigned id, const std::vector<reactor*>& reactors) {
+    _qs_owner[id] = reinterpret_cast<smp_message_queue*>(operator new[] (sizeof(smp_message_queue) * smp::count
+    // smp_message_queue has members with hefty alignment requirements.
+    // if we are reactor thread, or not running with dpdk, doing this
+    // new default aligned seemingly works, as does reordering
+    // dlinit dependencies (ugh). But we should enforce calling out to
+    // aligned_alloc, instead of pure malloc, if possible.
+        , std::align_val_t(alignof(smp_message_queue))
+    ));
+    for (unsigned j = 0; j < smp::count; ++j) {
+        new (&_qs_owner[id][j]) smp_message_queue(reactors[j], reactors[id]);
+    }
+}
+
 void smp::qs_deleter::operator()(smp_message_queue** qs) const {
     for (unsigned i = 0; i < smp::count; i++) {
         for (unsigned j = 0; j < smp::count; j++) {
@@ -4060,6 +5251,11 @@ class disk_config_params {
     std::unordered_map<dev_t, mountpoint_params> _mountpoints;
     std::chrono::duration<double> _latency_goal;
     double _flow_ratio_backpressure_threshold;
+    double _model_factor_min;
+    double _model_factor_max;
+    bool _share_idle_capacity;
+    double _capacity_grab_batch = 0.0;
+    std::chrono::duration<double> _slow_io_threshold;
 
 public:
     explicit disk_config_params(unsigned max_queues) noexcept
@@ -4088,6 +5284,17 @@ class disk_config_params {
         seastar_logger.debug("latency_goal: {}", latency_goal().count());
         _flow_ratio_backpressure_threshold = reactor_opts.io_flow_ratio_threshold.get_value();
         seastar_logger.debug("flow-ratio threshold: {}", _flow_ratio_backpressure_threshold);
+        _model_factor_min = reactor_opts.io_model_factor_min.get_value();
+        _model_factor_max = reactor_opts.io_model_factor_max.get_value();
+        if (_model_factor_min <= 0 || _model_factor_min > 1.0 || _model_factor_max < 1.0) {
+            throw std::runtime_error("io-model-factor-min must be in (0, 1] and io-model-factor-max must be at least 1");
+        }
+        _share_idle_capacity = reactor_opts.io_share_idle_capacity.get_value();
+        _capacity_grab_batch = reactor_opts.io_capacity_grab_batch.get_value();
+        if (_capacity_grab_batch < 0 || _capacity_grab_batch > 1.0) {
+            throw std::runtime_error("io-capacity-grab-batch must be in [0, 1]");
+        }
+        _slow_io_threshold = std::chrono::duration<double>(reactor_opts.io_slow_log_threshold_ms.get_value() / 1000);
 
         if (smp_opts.num_io_groups) {
             _num_io_groups = smp_opts.num_io_groups.get_value();
@@ -4162,11 +5369,11 @@ class disk_config_params {
 
         if (p.read_bytes_rate != std::numeric_limits<uint64_t>::max()) {
             cfg.blocks_count_rate = (io_queue::read_request_base_count * (unsigned long)per_io_group(p.read_bytes_rate, nr_groups)) >> io_queue::block_size_shift;
-            cfg.disk_blocks_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_bytes_rate) / p.write_bytes_rate;
+            cfg.disk_blocks_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_bytes_rate * p.write_penalty) / p.write_bytes_rate;
         }
         if (p.read_req_rate != std::numeric_limits<uint64_t>::max()) {
             cfg.req_count_rate = io_queue::read_request_base_count * (unsigned long)per_io_group(p.read_req_rate, nr_groups);
-            cfg.disk_req_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_req_rate) / p.write_req_rate;
+            cfg.disk_req_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_req_rate * p.write_penalty) / p.write_req_rate;
         }
         if (p.read_saturation_length != std::numeric_limits<uint64_t>::max()) {
             cfg.disk_read_saturation_length = p.read_saturation_length;
@@ -4178,6 +5385,11 @@ class disk_config_params {
         cfg.duplex = p.duplex;
         cfg.rate_limit_duration = latency_goal();
         cfg.flow_ratio_backpressure_threshold = _flow_ratio_backpressure_threshold;
+        cfg.model_factor_min = _model_factor_min;
+        cfg.model_factor_max = _model_factor_max;
+        cfg.share_idle_capacity = _share_idle_capacity;
+        cfg.capacity_grab_batch = _capacity_grab_batch;
+        cfg.slow_io_threshold = _slow_io_threshold;
         // Block count limit should not be less than the minimal IO size on the device
         // On the other hand, even this is not good enough -- in the worst case the
         // scheduler will self-tune to allow for the single 64k request, while it would
@@ -4218,9 +5430,41 @@ unsigned smp::adjust_max_networking_aio_io_control_blocks(unsigned network_iocbs
     return network_iocbs;
 }
 
+namespace {
+
+// The time each phase of smp::configure() took, logged once it is done;
+// where startup time goes on large machines is otherwise hard to tell
+class startup_timeline {
+    using clock = std::chrono::steady_clock;
+    clock::time_point _start = clock::now();
+    clock::time_point _last = _start;
+    std::vector<std::pair<const char*, clock::duration>> _phases;
+public:
+    void phase_done(const char* name) {
+        auto now = clock::now();
+        _phases.emplace_back(name, now - _last);
+        _last = now;
+    }
+    void log() const {
+        using ms = std::chrono::duration<double, std::milli>;
+        std::string phases;
+        for (auto& [name, d] : _phases) {
+            fmt::format_to(std::back_inserter(phases), " {} {:.1f}ms", name, ms(d).count());
+        }
+        seastar_logger.info("Startup took {:.1f}ms:{}", ms(_last - _start).count(), phases);
+    }
+};
+
+}
+
 void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_opts)
 {
+    startup_timeline timeline;
     bool use_transparent_hugepages = !reactor_opts.overprovisioned;
+    size_t huge_page_allocation_threshold = 0;
+    if (smp_opts.huge_page_allocation_threshold) {
+        huge_page_allocation_threshold = parse_memory_size(smp_opts.huge_page_allocation_threshold.get_value());
+    }
 
 #ifndef SEASTAR_NO_EXCEPTION_HACK
     if (smp_opts.enable_glibc_exception_scaling_workaround.get_value()) {
@@ -4290,10 +5534,30 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
         cpu_set = opts_cpuset;
     }
 
+    cgroup_cpu_quota = cgroup::cpu_limit();
     if (smp_opts.smp) {
         smp::count = smp_opts.smp.get_value();
     } else {
         smp::count = cpu_set.size();
+        // More shards than the quota buys CPUs would only get all of
+        // them throttled sooner, and for longer
+        if (cgroup_cpu_quota && cgroup_cpu_quota->cpus() < smp::count) {
+            auto shards = std::max(1u, unsigned(std::ceil(cgroup_cpu_quota->cpus())));
+            seastar_logger.info("cgroup CPU quota of {:.2f} CPUs ({}us every {}us), running {} shards rather than {}",
+                    cgroup_cpu_quota->cpus(), cgroup_cpu_quota->quota.count(), cgroup_cpu_quota->period.count(), shards, smp::count);
+            smp::count = shards;
+        }
+    }
+    auto offload_shards = smp_opts.offload_shards.get_value();
+    if (offload_shards >= smp::count) {
+        seastar_logger.warn("--offload-shards {} would leave none of the {} shards to the application, running offloaded work in place",
+                offload_shards, smp::count);
+        offload_shards = 0;
+    }
+    internal::configure_offload(offload_shards, std::max(smp_opts.offload_queue_depth.get_value(), 1u));
+    shard_route = std::make_unique<std::atomic<unsigned>[]>(smp::count);
+    for (unsigned c = 0; c < smp::count; c++) {
+        shard_route[c].store(c, std::memory_order_relaxed);
     }
     std::vector<reactor*> reactors(smp::count);
     if (smp_opts.memory) {
@@ -4369,20 +5633,24 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 #endif
 
     auto resources = resource::allocate(rc);
+    timeline.phase_done("resources");
     logger::set_shard_field_width(std::ceil(std::log10(smp::count)));
     std::vector<resource::cpu> allocations = std::move(resources.cpus);
+    set_shard_numa_nodes(allocations);
     if (thread_affinity) {
         smp::pin(allocations[0].cpu_id);
     }
     std::optional<memory::internal::numa_layout> layout;
     if (smp_opts.memory_allocator == memory_allocator::seastar) {
         layout = memory::configure(allocations[0].mem, mbind, use_transparent_hugepages, hugepages_path);
+        memory::set_huge_page_allocation_threshold(huge_page_allocation_threshold);
     } else {
         // #2148 - if running seastar allocator but options that contradict this, we still need to
         // init memory at least minimally, otherwise a bunch of stuff breaks.
         // Previously, we got away wth this by accident due to #2137.
         memory::configure_minimal();
     }
+    timeline.phase_done("memory");
 
     if (reactor_opts.abort_on_seastar_bad_alloc) {
         memory::set_abort_on_allocation_failure(true);
@@ -4395,6 +5663,35 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     reactor_config reactor_cfg;
     reactor_cfg.auto_handle_sigint_sigterm = reactor_opts._auto_handle_sigint_sigterm;
     reactor_cfg.max_networking_aio_io_control_blocks = adjust_max_networking_aio_io_control_blocks(reactor_opts.max_networking_io_control_blocks.get_value());
+    reactor_cfg.uring_registered_buffers_size = size_t(reactor_opts.uring_registered_buffers.get_value()) << 20;
+    reactor_cfg.uring_registered_files = reactor_opts.uring_registered_files.get_value();
+    reactor_cfg.uring_sqpoll = reactor_opts.uring_sqpoll.get_value();
+    reactor_cfg.uring_sqpoll_idle_ms = reactor_opts.uring_sqpoll_idle_ms.get_value();
+    if (reactor_opts.uring_sqpoll_cpuset) {
+        auto cpus = reactor_opts.uring_sqpoll_cpuset.get_value();
+        reactor_cfg.uring_sqpoll_cpus.assign(cpus.begin(), cpus.end());
+    }
+    reactor_cfg.uring_multishot = reactor_opts.uring_multishot.get_value();
+    reactor_cfg.uring_buffer_ring_entries = reactor_opts.uring_buffer_ring_entries.get_value();
+    reactor_cfg.uring_buffer_ring_buffer_size = reactor_opts.uring_buffer_ring_buffer_size.get_value();
+    reactor_cfg.uring_nvme_passthrough = reactor_opts.uring_nvme_passthrough.get_value();
+    if (reactor_opts.uring_zcrx_interface) {
+        reactor_cfg.uring_zcrx_interface = reactor_opts.uring_zcrx_interface.get_value();
+    }
+    reactor_cfg.uring_zcrx_rx_queue = reactor_opts.uring_zcrx_rx_queue.get_value();
+    reactor_cfg.uring_zcrx_area_size = size_t(reactor_opts.uring_zcrx_area_size.get_value()) << 20;
+    reactor_cfg.net_busy_poll_usec = reactor_opts.net_busy_poll_usec.get_value();
+    reactor_cfg.net_prefer_busy_poll = reactor_opts.net_prefer_busy_poll.get_value();
+    reactor_cfg.dump_memory_diagnostics_on_sigusr2 = reactor_opts.dump_memory_diagnostics_on_sigusr2.get_value();
+    reactor_cfg.dump_stall_profile_on_sigusr1 = reactor_opts.blocked_reactor_profile.get_value();
+    reactor_cfg.memory_pressure_elevated_threshold = reactor_opts.memory_pressure_elevated_threshold.get_value();
+    reactor_cfg.memory_pressure_critical_threshold = reactor_opts.memory_pressure_critical_threshold.get_value();
+    reactor_cfg.work_stealing = reactor_opts.work_stealing.get_value();
+    reactor_cfg.tsc_clock = reactor_opts.tsc_clock.get_value();
+    reactor_cfg.smp_queue_metrics = reactor_opts.smp_queue_metrics.get_value();
+    reactor_cfg.syscall_threads = std::max(reactor_opts.syscall_threads.get_value(), 1u);
+    reactor_cfg.dma_buffer_pool_high_watermark = size_t(reactor_opts.dma_buffer_pool_high_watermark.get_value()) << 20;
+    reactor_cfg.dma_buffer_pool_low_watermark = size_t(reactor_opts.dma_buffer_pool_low_watermark.get_value()) << 20;
 
     std::mutex mtx;
 
@@ -4421,6 +5718,8 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     // correct smp::count is not known.
     boost::barrier reactors_registered(smp::count);
     boost::barrier smp_queues_constructed(smp::count);
+    // Each shard fills its own row, the queues it receives messages from
+    _qs_owner = decltype(smp::_qs_owner){new smp_message_queue* [smp::count], qs_deleter{}};
     // We use shared_ptr since this thread can exit while other threads are still unlocking
     auto inited = std::make_shared<boost::barrier>(smp::count);
 
@@ -4482,7 +5781,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     auto smp_tmain = smp::_tmain;
     for (i = 1; i < smp::count; i++) {
         auto allocation = allocations[i];
-        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_sampling_rate, mbind, backend_selector, reactor_cfg, &mtx, &layout, use_transparent_hugepages] {
+        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_sampling_rate, mbind, backend_selector, reactor_cfg, &mtx, &layout, use_transparent_hugepages, huge_page_allocation_threshold] {
           try {
             // initialize thread_locals that are equal across all reacto threads of this smp instance
             smp::_tmain = smp_tmain;
@@ -4493,6 +5792,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
             }
             if (smp_opts.memory_allocator == memory_allocator::seastar) {
                 auto another_layout = memory::configure(allocation.mem, mbind, use_transparent_hugepages, hugepages_path);
+                memory::set_huge_page_allocation_threshold(huge_page_allocation_threshold);
                 auto guard = std::lock_guard(mtx);
                 *layout = memory::internal::merge(std::move(*layout), std::move(another_layout));
             } else {
@@ -4510,11 +5810,15 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
             auto r = ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
             throw_pthread_error(r);
             init_default_smp_service_group(i);
+            if (reactor_cfg.tsc_clock) {
+                internal::tsc_clock::enable();
+            }
             lowres_clock::update();
             allocate_reactor(i, backend_selector, reactor_cfg);
             reactors[i] = &engine();
             alloc_io_queues(i);
             reactors_registered.wait();
+            allocate_queues_to(i, reactors);
             smp_queues_constructed.wait();
             // _qs_owner is only initialized here
             _qs = _qs_owner.get();
@@ -4531,6 +5835,9 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     }
 
     init_default_smp_service_group(0);
+    if (reactor_cfg.tsc_clock) {
+        internal::tsc_clock::enable();
+    }
     lowres_clock::update();
     try {
         allocate_reactor(0, backend_selector, reactor_cfg);
@@ -4552,32 +5859,28 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 #endif
 
     reactors_registered.wait();
-    _qs_owner = decltype(smp::_qs_owner){new smp_message_queue* [smp::count], qs_deleter{}};
-    _qs = _qs_owner.get();
-    for(unsigned i = 0; i < smp::count; i++) {
-        smp::_qs_owner[i] = reinterpret_cast<smp_message_queue*>(operator new[] (sizeof(smp_message_queue) * smp::count
-        // smp_message_queue has members with hefty alignment requirements.
-        // if we are reactor thread, or not running with dpdk, doing this
-        // new default aligned seemingly works, as does reordering
-        // dlinit dependencies (ugh). But we should enforce calling out to
-        // aligned_alloc, instead of pure malloc, if possible.
-            , std::align_val_t(alignof(smp_message_queue))
-        ));
-        for (unsigned j = 0; j < smp::count; ++j) {
-            new (&smp::_qs_owner[i][j]) smp_message_queue(reactors[j], reactors[i]);
-        }
+    timeline.phase_done("reactors");
+    // All the shards merged their memory into the layout by now; fault it in
+    // while the queues are set up and the application starts, rather than after
+    if (smp_opts.lock_memory && smp_opts.lock_memory.get_value() && layout && !layout->ranges.empty()) {
+        smp::setup_prefaulter(resources, std::move(*layout));
     }
+    _qs = _qs_owner.get();
+    allocate_queues_to(0, reactors);
     _alien._qs = alien::instance::create_qs(reactors);
+    if (reactor_cfg.work_stealing) {
+        internal::enable_work_stealing(reactors);
+    }
     smp_queues_constructed.wait();
+    timeline.phase_done("queues");
     start_all_queues();
     assign_io_queues(0);
     inited->wait();
+    timeline.phase_done("io-queues");
 
     engine().configure(reactor_opts);
-
-    if (smp_opts.lock_memory && smp_opts.lock_memory.get_value() && layout && !layout->ranges.empty()) {
-        smp::setup_prefaulter(resources, std::move(*layout));
-    }
+    timeline.phase_done("configure");
+    timeline.log();
 }
 
 bool smp::poll_queues() {
@@ -4707,6 +6010,10 @@ void set_idle_cpu_handler(idle_cpu_handler&& handler) {
     engine().set_idle_cpu_handler(std::move(handler));
 }
 
+void set_io_trace_hook(io_trace_hook hook) noexcept {
+    engine().set_io_trace_hook(std::move(hook));
+}
+
 namespace experimental {
 future<std::tuple<file_desc, file_desc>> make_pipe() {
     return engine().make_pipe();
@@ -4848,12 +6155,20 @@ reactor::rename_scheduling_group_specific_data(scheduling_group sg) {
 }
 
 future<>
-reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, sstring shortname, float shares) {
+reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, sstring shortname, float shares, std::optional<scheduling_group> parent) {
     auto& sg_data = _scheduling_group_specific_data;
     auto& this_sg = sg_data.per_scheduling_group_data[sg._id];
     this_sg.queue_is_initialized = true;
     _task_queues.resize(std::max<size_t>(_task_queues.size(), sg._id + 1));
     _task_queues[sg._id] = std::make_unique<task_queue>(sg._id, name, shortname, shares);
+    if (parent) {
+        auto& tq = *_task_queues[sg._id];
+        tq._parent = _task_queues[parent->_id].get();
+        tq._parent->_children.push_back(&tq);
+        _nr_nested_task_queues++;
+        update_nested_shares();
+        update_nested_io_shares(tq);
+    }
     unsigned long num_keys = s_next_scheduling_group_specific_key.load(std::memory_order_relaxed);
 
     return with_scheduling_group(sg, [this, num_keys, sg] () {
@@ -4910,6 +6225,16 @@ reactor::destroy_scheduling_group(scheduling_group sg) noexcept {
         auto& sg_data = _scheduling_group_specific_data;
         auto& this_sg = sg_data.per_scheduling_group_data[sg._id];
         this_sg.queue_is_initialized = false;
+        if (auto* parent = _task_queues[sg._id]->_parent) {
+            std::erase(parent->_children, _task_queues[sg._id].get());
+            _nr_nested_task_queues--;
+            update_nested_shares();
+            update_nested_io_shares(*parent);
+        }
+        if (_task_queues[sg._id]->_throttled) {
+            std::erase(_throttled_task_queues, _task_queues[sg._id].get());
+            rearm_cpu_cap_timer();
+        }
         _task_queues[sg._id].reset();
     });
 
@@ -4962,36 +6287,88 @@ float scheduling_group::get_shares() const noexcept {
     return engine()._task_queues[_id]->_shares;
 }
 
+std::optional<scheduling_group>
+scheduling_group::parent() const noexcept {
+    auto* p = engine()._task_queues[_id]->_parent;
+    return p ? std::make_optional(scheduling_group(p->_id)) : std::nullopt;
+}
+
+float scheduling_group::get_io_shares() const noexcept {
+    return engine()._task_queues[_id]->io_shares();
+}
+
 void
 scheduling_group::set_shares(float shares) noexcept {
-    engine()._task_queues[_id]->set_shares(shares);
+    auto& r = engine();
+    auto& tq = *r._task_queues[_id];
+    tq.set_shares(shares);
+    if (tq.nested()) {
+        r.update_nested_shares();
+        r.update_nested_io_shares(tq);
+        return;
+    }
 #if SEASTAR_API_LEVEL >= 7
-    engine().update_shares_for_queues(internal::priority_class(*this), shares);
+    r.update_shares_for_queues(internal::priority_class(*this), shares);
 #endif
 }
 
+void
+scheduling_group::set_cpu_cap(float cap, std::chrono::microseconds period) noexcept {
+    auto& r = engine();
+    auto& tq = *r._task_queues[_id];
+    tq._cpu_cap = std::clamp(cap, 0.001f, 1.0f);
+    tq._cpu_cap_period = std::max<sched_clock::duration>(period, std::chrono::milliseconds(1));
+    tq._cpu_cap_period_start = reactor::now();
+    tq._cpu_cap_runtime = {};
+    if (tq._throttled) {
+        r.unthrottle_task_queues();
+    }
+}
+
+float scheduling_group::get_cpu_cap() const noexcept {
+    return engine()._task_queues[_id]->_cpu_cap;
+}
+
 #if SEASTAR_API_LEVEL >= 7
 future<> scheduling_group::update_io_bandwidth(uint64_t bandwidth) const {
     return engine().update_bandwidth_for_queues(internal::priority_class(*this), bandwidth);
 }
+
+void scheduling_group::set_io_latency_target(std::chrono::microseconds target) const {
+    engine().set_latency_target_for_queues(internal::priority_class(*this), target);
+}
 #endif
 
 future<scheduling_group>
-create_scheduling_group(sstring name, sstring shortname, float shares) noexcept {
+reactor::do_create_scheduling_group(sstring name, sstring shortname, float shares, std::optional<scheduling_group> parent) noexcept {
     auto aid = allocate_scheduling_group_id();
     if (aid < 0) {
         return make_exception_future<scheduling_group>(std::runtime_error(fmt::format("Scheduling group limit exceeded while creating {}", name)));
     }
     auto id = static_cast<unsigned>(aid);
     assert(id < max_scheduling_groups());
-    auto sg = scheduling_group(id);
-    return smp::invoke_on_all([sg, name, shortname, shares] {
-        return engine().init_scheduling_group(sg, name, shortname, shares);
+    auto sg = internal::scheduling_group_from_index(id);
+    return smp::invoke_on_all([sg, name, shortname, shares, parent] {
+        return engine().init_scheduling_group(sg, name, shortname, shares, parent);
     }).then([sg] {
         return make_ready_future<scheduling_group>(sg);
     });
 }
 
+future<scheduling_group>
+create_scheduling_group(sstring name, sstring shortname, float shares) noexcept {
+    return reactor::do_create_scheduling_group(std::move(name), std::move(shortname), shares, std::nullopt);
+}
+
+future<scheduling_group>
+create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_group parent) noexcept {
+    auto& tqs = engine()._task_queues;
+    if (parent._id >= tqs.size() || !tqs[parent._id]) {
+        return make_exception_future<scheduling_group>(std::invalid_argument(fmt::format("Parent of scheduling group {} does not exist", name)));
+    }
+    return reactor::do_create_scheduling_group(std::move(name), std::move(shortname), shares, parent);
+}
+
 future<scheduling_group>
 create_scheduling_group(sstring name, float shares) noexcept {
     return create_scheduling_group(name, {}, shares);
@@ -5022,6 +6399,9 @@ destroy_scheduling_group(scheduling_group sg) noexcept {
     if (sg == current_scheduling_group()) {
         return make_exception_future<>(make_backtraced_exception_ptr<std::runtime_error>("Attempt to destroy the current scheduling group"));
     }
+    if (!engine()._task_queues[sg._id]->_children.empty()) {
+        return make_exception_future<>(make_backtraced_exception_ptr<std::runtime_error>("Attempt to destroy a scheduling group with nested groups"));
+    }
     return smp::invoke_on_all([sg] {
         return engine().destroy_scheduling_group(sg);
     }).then([sg] {
@@ -22,10 +22,12 @@
 module;
 #endif
 
+#include <algorithm>
 #include <compare>
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <thread>
 #include <utility>
@@ -33,6 +35,7 @@ module;
 #include <signal.h>
 #include <sys/epoll.h>
 #include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/syscall.h>
 #include <sys/resource.h>
 #include <boost/container/small_vector.hpp>
@@ -40,6 +43,32 @@ module;
 
 #ifdef SEASTAR_HAVE_URING
 #include <liburing.h>
+#if defined(IO_URING_CHECK_VERSION) && !IO_URING_CHECK_VERSION(2, 3)
+// liburing 2.4 or later, with provided buffer rings and multishot requests
+#define SEASTAR_HAVE_URING_MULTISHOT
+#endif
+#if defined(IO_URING_CHECK_VERSION) && !IO_URING_CHECK_VERSION(2, 5)
+// liburing 2.6 or later, with NAPI busy polling
+#define SEASTAR_HAVE_URING_NAPI
+#endif
+#if defined(IO_URING_CHECK_VERSION) && !IO_URING_CHECK_VERSION(2, 9)
+// liburing 2.10 or later, with zero-copy receive
+#define SEASTAR_HAVE_URING_ZCRX
+#include <net/if.h>
+#endif
+#if defined(IO_URING_CHECK_VERSION)
+// liburing 2.3 or later, with the prep helpers of all the metadata operations
+#define SEASTAR_HAVE_URING_METADATA_OPS
+// and of IORING_OP_MSG_RING
+#define SEASTAR_HAVE_URING_MSG_RING
+#endif
+#if __has_include(<linux/nvme_ioctl.h>)
+#include <linux/nvme_ioctl.h>
+#endif
+#if defined(NVME_URING_CMD_IO) && defined(IORING_SETUP_SQE128)
+// Kernel headers of Linux 5.19 or later, with NVMe passthrough commands
+#define SEASTAR_HAVE_URING_NVME_PASSTHROUGH
+#endif
 #endif
 
 #ifdef HAVE_OSV
@@ -55,6 +84,9 @@ module seastar;
 #include <seastar/core/internal/buffer_allocator.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 #include <seastar/core/internal/uname.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/bitops.hh>
+#include <seastar/core/metrics.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/util/defer.hh>
@@ -727,6 +759,42 @@ reactor_backend_epoll::reactor_backend_epoll(reactor& r)
     event.data.ptr = &_steady_clock_timer_reactor_thread;
     ret = ::epoll_ctl(_epollfd.get(), EPOLL_CTL_ADD, _steady_clock_timer_reactor_thread.get(), &event);
     throw_system_error_on(ret == -1);
+    setup_busy_poll();
+}
+
+namespace {
+
+#ifdef EPIOCSPARAMS
+using epoll_busy_poll_params = ::epoll_params;
+constexpr unsigned long epoll_set_params = EPIOCSPARAMS;
+#else
+// From <linux/eventpoll.h> of Linux 6.9, which the C library may not have yet
+struct epoll_busy_poll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t pad;
+};
+constexpr unsigned long epoll_set_params = _IOW(0x8A, 0x01, epoll_busy_poll_params);
+#endif
+
+}
+
+// With the sockets busy polled, epoll_wait() polls the NIC queues of the
+// ready list's sockets itself rather than only looking at the ready list
+void
+reactor_backend_epoll::setup_busy_poll() {
+    if (!_r._cfg.net_busy_poll_usec) {
+        return;
+    }
+    epoll_busy_poll_params params{};
+    params.busy_poll_usecs = _r._cfg.net_busy_poll_usec;
+    params.busy_poll_budget = 8; // the kernel's default, which needs no CAP_NET_ADMIN
+    params.prefer_busy_poll = _r._cfg.net_prefer_busy_poll;
+    if (::ioctl(_epollfd.get(), epoll_set_params, &params) != 0) {
+        seastar_logger.info("Unable to set up epoll busy polling ({}), requires Linux 6.9 or later; "
+                "busy polling the sockets only", std::error_code(errno, std::system_category()).message());
+    }
 }
 
 void
@@ -1195,7 +1263,7 @@ reactor_backend_osv::make_pollable_fd_state(file_desc fd, pollable_fd::speculati
 
 static
 std::optional<::io_uring>
-try_create_uring(unsigned queue_len, bool throw_on_error) {
+try_create_uring(unsigned queue_len, bool throw_on_error, ::io_uring_params params = {}) {
     auto required_features =
             IORING_FEAT_SUBMIT_STABLE
             | IORING_FEAT_NODROP;
@@ -1219,7 +1287,6 @@ try_create_uring(unsigned queue_len, bool throw_on_error) {
         }
     };
 
-    auto params = ::io_uring_params{};
     ::io_uring ring;
     auto err = ::io_uring_queue_init_params(queue_len, &ring, &params);
     if (err != 0) {
@@ -1291,26 +1358,492 @@ detect_io_uring() {
     return bool(ring_opt);
 }
 
+// A per-shard memory region registered with io_uring up front, so that
+// I/O on it can be submitted as READ_FIXED/WRITE_FIXED and the kernel does
+// not need to pin and unpin user pages on every request.
+//
+// The region is split into top-level blocks of (1 << _max_order) bytes, each
+// registered as a separate fixed buffer (the kernel caps the size of a single
+// one), and carved up with a buddy allocator. Allocations never cross a
+// top-level block, so any sub-range of one maps onto a single buffer index.
+class registered_buffer_arena {
+    static constexpr unsigned min_order = 12; // 4k, enough for any DMA alignment
+    static constexpr unsigned max_max_order = 22;
+    struct free_block {
+        free_block* next;
+        free_block* prev;
+    };
+    char* _base = nullptr;
+    size_t _size = 0;
+    unsigned _max_order = 0;
+    std::vector<free_block*> _free_lists;
+    // For each min_order-sized block: the order of the free block starting
+    // there, or -1 if no free block starts there.
+    std::vector<int8_t> _free_order;
+private:
+    size_t block_index(const char* p) const noexcept {
+        return (p - _base) >> min_order;
+    }
+    void push(char* p, unsigned order) noexcept {
+        auto b = reinterpret_cast<free_block*>(p);
+        auto& head = _free_lists[order - min_order];
+        b->prev = nullptr;
+        b->next = head;
+        if (head) {
+            head->prev = b;
+        }
+        head = b;
+        _free_order[block_index(p)] = order;
+    }
+    void unlink(char* p, unsigned order) noexcept {
+        auto b = reinterpret_cast<free_block*>(p);
+        if (b->prev) {
+            b->prev->next = b->next;
+        } else {
+            _free_lists[order - min_order] = b->next;
+        }
+        if (b->next) {
+            b->next->prev = b->prev;
+        }
+        _free_order[block_index(p)] = -1;
+    }
+    static unsigned order_for(size_t size) noexcept {
+        return std::max<unsigned>(min_order, log2ceil(size));
+    }
+public:
+    explicit registered_buffer_arena(size_t size) {
+        _max_order = std::min<unsigned>(max_max_order, log2floor(size));
+        if (_max_order < min_order) {
+            throw std::invalid_argument(fmt::format("registered buffer arena of {} bytes is too small", size));
+        }
+        _size = align_down<size_t>(size, size_t(1) << _max_order);
+        _base = static_cast<char*>(::aligned_alloc(size_t(1) << _max_order, _size));
+        if (!_base) {
+            throw std::bad_alloc();
+        }
+        _free_lists.resize(_max_order - min_order + 1, nullptr);
+        _free_order.resize(_size >> min_order, -1);
+        for (size_t off = 0; off < _size; off += size_t(1) << _max_order) {
+            push(_base + off, _max_order);
+        }
+    }
+    registered_buffer_arena(const registered_buffer_arena&) = delete;
+    ~registered_buffer_arena() {
+        ::free(_base);
+    }
+    std::vector<::iovec> iovecs() const {
+        std::vector<::iovec> ret;
+        for (size_t off = 0; off < _size; off += size_t(1) << _max_order) {
+            ret.push_back(::iovec{_base + off, size_t(1) << _max_order});
+        }
+        return ret;
+    }
+    // Returns the fixed buffer index covering [p, p + len), if any
+    std::optional<int> buffer_index(const void* p, size_t len) const noexcept {
+        auto c = static_cast<const char*>(p);
+        if (c < _base || c + len > _base + _size || !len) {
+            return std::nullopt;
+        }
+        auto idx = (c - _base) >> _max_order;
+        if (((c + len - 1 - _base) >> _max_order) != idx) {
+            return std::nullopt;
+        }
+        return int(idx);
+    }
+    char* allocate(size_t size, size_t alignment) noexcept {
+        auto order = order_for(size);
+        if (alignment > (size_t(1) << min_order) || order > _max_order) {
+            return nullptr;
+        }
+        auto o = order;
+        while (o <= _max_order && !_free_lists[o - min_order]) {
+            ++o;
+        }
+        if (o > _max_order) {
+            return nullptr;
+        }
+        auto p = reinterpret_cast<char*>(_free_lists[o - min_order]);
+        unlink(p, o);
+        while (o > order) {
+            --o;
+            push(p + (size_t(1) << o), o);
+        }
+        return p;
+    }
+    void free(char* p, size_t size) noexcept {
+        auto order = order_for(size);
+        while (order < _max_order) {
+            auto buddy = _base + ((p - _base) ^ (size_t(1) << order));
+            if (_free_order[block_index(buddy)] != int(order)) {
+                break;
+            }
+            unlink(buddy, order);
+            p = std::min(p, buddy);
+            ++order;
+        }
+        push(p, order);
+    }
+};
+
+// Completions which need the cqe flags, rather than just the result (multishot
+// requests, provided buffers). They are told apart from kernel_completion by
+// tagging the low bit of the request's user_data.
+class uring_flagged_completion {
+protected:
+    ~uring_flagged_completion() = default;
+public:
+    static constexpr uint64_t tag = 1;
+    virtual void complete_with(ssize_t res, uint32_t flags) = 0;
+    // For those which need the second half of a big (IORING_SETUP_CQE32) cqe
+    virtual void complete_with_cqe(const ::io_uring_cqe& cqe) {
+        complete_with(cqe.res, cqe.flags);
+    }
+    uint64_t user_data() const noexcept {
+        return reinterpret_cast<uintptr_t>(this) | tag;
+    }
+};
+
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+
+// A ring of buffers handed to the kernel up front, which it picks from to
+// complete receive requests (IOSQE_BUFFER_SELECT). Received data is passed
+// on in a temporary_buffer pointing into the ring memory; the buffer is
+// returned to the kernel once that is released.
+class provided_buffer_ring : public enable_lw_shared_from_this<provided_buffer_ring> {
+    ::io_uring* _ring;
+    ::io_uring_buf_ring* _br = nullptr;
+    unsigned _entries;
+    size_t _buffer_size;
+    std::unique_ptr<char[], free_deleter> _memory;
+public:
+    static constexpr int group_id = 0;
+
+    provided_buffer_ring(::io_uring& ring, unsigned entries, size_t buffer_size)
+            : _ring(&ring)
+            , _entries(entries)
+            , _buffer_size(buffer_size)
+            , _memory(allocate_aligned_buffer<char>(entries * buffer_size, 4096)) {
+        if (!_entries || (_entries & (_entries - 1)) || _entries > 32768) {
+            throw std::invalid_argument(fmt::format("buffer ring size must be a power of two up to 32768, got {}", _entries));
+        }
+        int err = 0;
+        _br = ::io_uring_setup_buf_ring(_ring, _entries, group_id, 0, &err);
+        if (!_br) {
+            throw std::system_error(-err, std::system_category(), "io_uring_setup_buf_ring");
+        }
+        for (unsigned bid = 0; bid < _entries; ++bid) {
+            ::io_uring_buf_ring_add(_br, buffer(bid), _buffer_size, bid, ::io_uring_buf_ring_mask(_entries), bid);
+        }
+        ::io_uring_buf_ring_advance(_br, _entries);
+    }
+    provided_buffer_ring(const provided_buffer_ring&) = delete;
+    ~provided_buffer_ring() {
+        detach();
+    }
+    // Called when the ring goes away; buffers still held by the application
+    // are then just freed with the arena.
+    void detach() noexcept {
+        if (_ring) {
+            ::io_uring_free_buf_ring(_ring, _br, _entries, group_id);
+            _ring = nullptr;
+        }
+    }
+    char* buffer(unsigned bid) const noexcept {
+        return _memory.get() + size_t(bid) * _buffer_size;
+    }
+    void give_back(unsigned bid) noexcept {
+        if (_ring) {
+            ::io_uring_buf_ring_add(_br, buffer(bid), _buffer_size, bid, ::io_uring_buf_ring_mask(_entries), 0);
+            ::io_uring_buf_ring_advance(_br, 1);
+        }
+    }
+    // Wraps the data the kernel placed in buffer bid. Always recycles
+    // bid, even if it throws.
+    temporary_buffer<char> take(unsigned bid, size_t len) {
+        auto recycle = defer([this, bid] () noexcept { give_back(bid); });
+        if (len < _buffer_size / 4) {
+            // Copy small reads out and recycle the buffer at once, so that
+            // long-lived small buffers don't starve the ring
+            return temporary_buffer<char>(buffer(bid), len);
+        }
+        auto ret = temporary_buffer<char>(buffer(bid), len, make_deleter([self = shared_from_this(), bid] {
+            self->give_back(bid);
+        }));
+        recycle.cancel();
+        return ret;
+    }
+};
+
+#endif
+
+#ifdef SEASTAR_HAVE_URING_ZCRX
+
+// A memory area bound to a hardware receive queue of the NIC, which places
+// the payloads of the packets it receives there (IORING_OP_RECV_ZC).
+// Received data is passed on in a temporary_buffer pointing into the area;
+// the chunk is handed back to the NIC through the refill queue, a ring
+// shared with the kernel, once that is released.
+class zcrx_area : public enable_lw_shared_from_this<zcrx_area> {
+    static constexpr size_t page_size = 4096;
+    size_t _size;
+    std::unique_ptr<char[], free_deleter> _memory;
+    std::unique_ptr<char[], free_deleter> _refill_memory;
+    uint32_t* _refill_tail = nullptr;
+    ::io_uring_zcrx_rqe* _refill_entries = nullptr;
+    unsigned _refill_mask = 0;
+    uint64_t _area_token = 0;
+    uint32_t _id = 0;
+public:
+    // The refill queue can't have more entries than that
+    static constexpr size_t max_size = size_t(32768 / 2) * page_size;
+
+    zcrx_area(::io_uring& ring, unsigned if_idx, unsigned rx_queue, size_t size)
+            : _size(align_up(std::min(size, max_size), page_size))
+            , _memory(allocate_aligned_buffer<char>(_size, page_size)) {
+        // A page may be returned in several pieces
+        unsigned refill_entries = 1u << log2ceil(2 * _size / page_size);
+        // The kernel places the queue's head and tail ahead of the entries
+        auto refill_size = align_up(page_size + refill_entries * sizeof(::io_uring_zcrx_rqe), page_size);
+        _refill_memory = allocate_aligned_buffer<char>(refill_size, page_size);
+        std::memset(_refill_memory.get(), 0, refill_size);
+
+        ::io_uring_zcrx_area_reg area_reg{};
+        area_reg.addr = reinterpret_cast<uintptr_t>(_memory.get());
+        area_reg.len = _size;
+        ::io_uring_region_desc region{};
+        region.user_addr = reinterpret_cast<uintptr_t>(_refill_memory.get());
+        region.size = refill_size;
+        region.flags = IORING_MEM_REGION_TYPE_USER;
+        ::io_uring_zcrx_ifq_reg reg{};
+        reg.if_idx = if_idx;
+        reg.if_rxq = rx_queue;
+        reg.rq_entries = refill_entries;
+        reg.area_ptr = reinterpret_cast<uintptr_t>(&area_reg);
+        reg.region_ptr = reinterpret_cast<uintptr_t>(&region);
+        auto r = ::io_uring_register_ifq(&ring, &reg);
+        if (r < 0) {
+            throw std::system_error(-r, std::system_category(), "io_uring_register_ifq");
+        }
+        _refill_tail = reinterpret_cast<uint32_t*>(_refill_memory.get() + reg.offsets.tail);
+        _refill_entries = reinterpret_cast<::io_uring_zcrx_rqe*>(_refill_memory.get() + reg.offsets.rqes);
+        _refill_mask = reg.rq_entries - 1;
+        _area_token = area_reg.rq_area_token;
+        _id = reg.zcrx_id;
+        // The queue is unregistered with the ring; chunks still held by the
+        // application then just go back to an unread refill queue.
+    }
+    zcrx_area(const zcrx_area&) = delete;
+    uint32_t id() const noexcept {
+        return _id;
+    }
+    void give_back(uint64_t offset, uint32_t len) noexcept {
+        // We are the only producer, the kernel the consumer
+        auto tail = *_refill_tail;
+        auto& rqe = _refill_entries[tail & _refill_mask];
+        rqe.off = offset | _area_token;
+        rqe.len = len;
+        rqe.__pad = 0;
+        __atomic_store_n(_refill_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    // Wraps the data the completion points at. Always gives the chunk
+    // back, even if it throws.
+    temporary_buffer<char> take(const ::io_uring_cqe& cqe) {
+        auto& zcqe = *reinterpret_cast<const ::io_uring_zcrx_cqe*>(cqe.big_cqe);
+        uint64_t offset = zcqe.off & IORING_ZCRX_AREA_MASK;
+        uint32_t len = cqe.res;
+        auto recycle = defer([this, offset, len] () noexcept { give_back(offset, len); });
+        auto data = _memory.get() + offset;
+        if (len < page_size / 4) {
+            // Copy small reads out and give the chunk back at once, so that
+            // long-lived small buffers don't starve the NIC
+            return temporary_buffer<char>(data, len);
+        }
+        auto ret = temporary_buffer<char>(data, len, make_deleter([self = shared_from_this(), offset, len] {
+            self->give_back(offset, len);
+        }));
+        recycle.cancel();
+        return ret;
+    }
+};
+
+#endif
+
 class reactor_backend_uring final : public reactor_backend {
     // s_queue_len is more or less arbitrary. Too low and we'll be
     // issuing too small batches, too high and we require too much locked
     // memory, but otherwise it doesn't matter.
     static constexpr unsigned s_queue_len = 200;  
     reactor& _r;
+    bool _sqpoll = false; // set by create_uring(), so must precede _uring
+    bool _nvme_passthrough = false; // ditto
+    bool _zcrx = false; // ditto
     ::io_uring _uring;
     bool _did_work_while_getting_sqe = false;
     bool _has_pending_submissions = false;
+    bool _metadata_ops = false;
+    bool _msg_ring = false;
+    uint64_t _msg_ring_wakeups_sent = 0;
+    uint64_t _sq_full_stalls = 0;
+    uint64_t _sqpoll_wakeups = 0;
+    metrics::metric_groups _metrics;
     file_desc _hrtimer_timerfd;
     preempt_io_context _preempt_io_context;
+    // Whether the high resolution timer is the timeout of the ring's wait,
+    // rather than _hrtimer_timerfd (set by setup_ring_timeouts())
+    bool _ring_timeouts = false;
+    std::optional<std::chrono::steady_clock::time_point> _highres_deadline;
+
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    // State shared by the multishot requests below. A multishot request
+    // can outlive its pollable_fd_state: when that is forgotten, the request
+    // is cancelled and the object deletes itself on the final completion.
+    template <typename Item>
+    class multishot_state : public uring_flagged_completion {
+    protected:
+        reactor_backend_uring& _be;
+        bool _detached = false;
+        std::optional<promise<>> _waiter;
+    public:
+        bool armed = false;
+        circular_buffer<Item> ready;
+
+        explicit multishot_state(reactor_backend_uring& be) : _be(be) {}
+        virtual ~multishot_state() = default;
+        future<> wait() {
+            _waiter.emplace();
+            return _waiter->get_future();
+        }
+        // Returns false if the object deleted itself
+        bool finish(uint32_t flags) noexcept {
+            if (!(flags & IORING_CQE_F_MORE)) {
+                armed = false;
+                if (_detached) {
+                    delete this;
+                    return false;
+                }
+            }
+            if (_waiter) {
+                _waiter->set_value();
+                _waiter.reset();
+            }
+            return true;
+        }
+        void detach() noexcept {
+            if (armed) {
+                _detached = true;
+                _be.cancel(user_data());
+            } else {
+                delete this;
+            }
+        }
+    };
+
+    class multishot_recv final : public multishot_state<temporary_buffer<char>> {
+    public:
+        bool eof = false;
+        bool exhausted = false;
+        // Armed as a zero-copy receive, and whether the socket can't do those
+        bool zerocopy = false;
+        bool zerocopy_unsupported = false;
+        std::exception_ptr error;
+
+        using multishot_state::multishot_state;
+        virtual void complete_with(ssize_t res, uint32_t flags) override {
+            receive(res, flags, [&] {
+                return _be._buffer_ring->take(flags >> IORING_CQE_BUFFER_SHIFT, res);
+            });
+        }
+#ifdef SEASTAR_HAVE_URING_ZCRX
+        virtual void complete_with_cqe(const ::io_uring_cqe& cqe) override {
+            if (!zerocopy) {
+                complete_with(cqe.res, cqe.flags);
+            } else if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+                // Not a TCP socket
+                zerocopy_unsupported = true;
+                finish(cqe.flags);
+            } else {
+                receive(cqe.res, cqe.flags, [&] {
+                    return _be._zcrx_area->take(cqe);
+                });
+            }
+        }
+#endif
+    private:
+        template <typename Take>
+        void receive(ssize_t res, uint32_t flags, Take take) {
+            if (res > 0) {
+                try {
+                    ready.push_back(take());
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            } else if (res == 0) {
+                eof = true;
+            } else if (res == -ENOBUFS || (zerocopy && res == -ENOMEM)) {
+                // Out of provided buffers, or of room in the zero-copy area
+                exhausted = true;
+            } else if (res != -ECANCELED) {
+                error = std::make_exception_ptr(std::system_error(-res, std::system_category()));
+            }
+            finish(flags);
+        }
+    };
+
+    class multishot_accept final : public multishot_state<file_desc> {
+    public:
+        int error = 0;
+
+        using multishot_state::multishot_state;
+        virtual void complete_with(ssize_t res, uint32_t flags) override {
+            if (res >= 0) {
+                auto fd = file_desc::from_fd(res);
+                try {
+                    ready.push_back(std::move(fd));
+                } catch (...) {
+                    error = ENOMEM;
+                }
+            } else if (res != -ECANCELED) {
+                error = -res;
+            }
+            finish(flags);
+        }
+    };
+#endif
 
     class uring_pollable_fd_state : public pollable_fd_state {
         pollable_fd_state_completion _completion_pollin;
         pollable_fd_state_completion _completion_pollout;
         pollable_fd_state_completion _completion_pollrdhup;
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        multishot_recv* _recv = nullptr;
+        multishot_accept* _accept = nullptr;
+#endif
     public:
         explicit uring_pollable_fd_state(file_desc desc, speculation speculate)
                 : pollable_fd_state(std::move(desc), std::move(speculate)) {
         }
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        ~uring_pollable_fd_state() {
+            if (_recv) {
+                _recv->detach();
+            }
+            if (_accept) {
+                _accept->detach();
+            }
+        }
+        multishot_recv& recv_state(reactor_backend_uring& be) {
+            if (!_recv) {
+                _recv = new multishot_recv(be);
+            }
+            return *_recv;
+        }
+        multishot_accept& accept_state(reactor_backend_uring& be) {
+            if (!_accept) {
+                _accept = new multishot_accept(be);
+            }
+            return *_accept;
+        }
+#endif
         pollable_fd_state_completion* get_desc(int events) {
             if (events & POLLIN) {
                 return &_completion_pollin;
@@ -1367,13 +1900,370 @@ class reactor_backend_uring final : public reactor_backend {
 
     using smp_wakeup_completion = recurring_eventfd_or_timerfd_completion;
 
+    // For requests whose completion we don't care about (cancellations)
+    class ignore_completion : public kernel_completion {
+    public:
+        virtual void complete_with(ssize_t res) override {}
+    };
+
+    // For a wakeup of another reactor through its ring, only completed
+    // if it failed (e.g. its completion queue overflowed)
+    class msg_ring_wakeup_completion : public kernel_completion {
+    public:
+        reactor* target = nullptr;
+        virtual void complete_with(ssize_t res) override {
+            if (res < 0) {
+                target->wakeup();
+            }
+        }
+    };
+
+    // For the cancellations of I/O requests of cancelled intents, telling
+    // those that cancelled the request from those that came too late
+    class io_cancel_completion : public kernel_completion {
+    public:
+        uint64_t cancelled = 0;
+        uint64_t too_late = 0;
+        virtual void complete_with(ssize_t res) override {
+            if (res == 0) {
+                ++cancelled;
+            } else {
+                // ENOENT if the request had completed, EALREADY if
+                // it's already running and can't be interrupted
+                ++too_late;
+            }
+        }
+    };
+
     hrtimer_completion _hrtimer_completion;
     smp_wakeup_completion _smp_wakeup_completion;
+    ignore_completion _ignore_completion;
+    io_cancel_completion _io_cancel_completion;
+    // By the shard woken up
+    std::vector<msg_ring_wakeup_completion> _msg_ring_wakeups;
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    lw_shared_ptr<provided_buffer_ring> _buffer_ring;
+#endif
+#ifdef SEASTAR_HAVE_URING_ZCRX
+    lw_shared_ptr<zcrx_area> _zcrx_area;
+#endif
+    // Shared with the deleters of the buffers handed out from it, which
+    // may outlive the backend.
+    lw_shared_ptr<registered_buffer_arena> _registered_buffers;
+    // Registered file table: _fixed_file_slots[fd] is the table slot of fd,
+    // or -1 if it isn't registered.
+    std::vector<int> _fixed_file_slots;
+    std::vector<unsigned> _free_fixed_file_slots;
 private:
     static file_desc make_timerfd() {
         return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
     }
 
+    // The CPU to pin this shard's SQPOLL thread to, if any: either picked
+    // from the configured set, or a hyperthread sibling of the shard's CPU.
+    static std::optional<unsigned> sqpoll_cpu(const reactor& r) {
+        const auto& cpus = r._cfg.uring_sqpoll_cpus;
+        if (!cpus.empty()) {
+            return cpus[r._id % cpus.size()];
+        }
+        cpu_set_t mask;
+        if (::sched_getaffinity(0, sizeof(mask), &mask) != 0 || CPU_COUNT(&mask) != 1) {
+            return std::nullopt;
+        }
+        unsigned cpu = ::sched_getcpu();
+        try {
+            auto siblings = resource::parse_cpuset(read_first_line(
+                    fmt::format("/sys/devices/system/cpu/cpu{}/topology/thread_siblings_list", cpu)));
+            if (siblings) {
+                for (auto sibling : *siblings) {
+                    if (sibling != cpu) {
+                        return sibling;
+                    }
+                }
+            }
+        } catch (...) {
+            // No topology information; leave the thread unpinned
+        }
+        return std::nullopt;
+    }
+
+    ::io_uring create_uring() {
+        auto params = ::io_uring_params{};
+        if (_r._cfg.uring_nvme_passthrough) {
+#ifdef SEASTAR_HAVE_URING_NVME_PASSTHROUGH
+            if (!kernel_uname().whitelisted({"5.19"})) {
+                seastar_logger.warn("io_uring NVMe passthrough requires Linux 5.19 or later; using the block layer");
+            } else {
+                // The NVMe commands don't fit the regular entries
+                params.flags |= IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+                _nvme_passthrough = true;
+            }
+#else
+            seastar_logger.warn("io_uring NVMe passthrough is not supported by this build (requires Linux 5.19 or later headers)");
+#endif
+        }
+        if (!_r._cfg.uring_zcrx_interface.empty()) {
+#ifdef SEASTAR_HAVE_URING_ZCRX
+            if (!kernel_uname().whitelisted({"6.15"})) {
+                seastar_logger.warn("io_uring zero-copy receive requires Linux 6.15 or later; using regular receive");
+            } else {
+                // Zero-copy receive completions carry the data's offset in
+                // the second half of a big cqe, and the kernel only posts them
+                // from io_uring_enter(); the last flag has liburing enter the
+                // kernel when peeking at completions still to be posted.
+                params.flags |= IORING_SETUP_CQE32 | IORING_SETUP_SINGLE_ISSUER
+                        | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+                _zcrx = true;
+                if (_r._cfg.uring_sqpoll) {
+                    seastar_logger.warn("io_uring zero-copy receive doesn't work in SQPOLL mode; using regular submission");
+                }
+            }
+#else
+            seastar_logger.warn("io_uring zero-copy receive is not supported by this build (requires liburing 2.10 or later)");
+#endif
+        }
+        if (_r._cfg.uring_sqpoll && !_zcrx) {
+            if (!kernel_uname().whitelisted({"5.11"})) {
+                seastar_logger.warn("io_uring SQPOLL mode requires Linux 5.11 or later; using regular submission");
+            } else {
+                auto sq_params = params;
+                sq_params.flags |= IORING_SETUP_SQPOLL;
+                sq_params.sq_thread_idle = _r._cfg.uring_sqpoll_idle_ms;
+                if (auto cpu = sqpoll_cpu(_r)) {
+                    sq_params.flags |= IORING_SETUP_SQ_AFF;
+                    sq_params.sq_thread_cpu = *cpu;
+                }
+                if (auto ring = try_create_uring(s_queue_len, false, sq_params)) {
+                    _sqpoll = true;
+                    return *ring;
+                }
+                seastar_logger.warn("Unable to set up io_uring in SQPOLL mode; using regular submission");
+            }
+        }
+        if (_zcrx) {
+            if (auto ring = try_create_uring(s_queue_len, false, params)) {
+                return *ring;
+            }
+            seastar_logger.warn("Unable to set up io_uring for zero-copy receive; using regular receive");
+            _zcrx = false;
+#ifdef SEASTAR_HAVE_URING_ZCRX
+            params.flags &= ~(IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_TASKRUN_FLAG);
+            if (!_nvme_passthrough) {
+                params.flags &= ~IORING_SETUP_CQE32;
+            }
+#endif
+        }
+        if (_nvme_passthrough) {
+            if (auto ring = try_create_uring(s_queue_len, false, params)) {
+                return *ring;
+            }
+            seastar_logger.warn("Unable to set up io_uring with large entries for NVMe passthrough; using the block layer");
+            _nvme_passthrough = false;
+        }
+        return try_create_uring(s_queue_len, true).value();
+    }
+
+    int submit() noexcept {
+        if (_sqpoll && (__atomic_load_n(_uring.sq.kflags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)) {
+            // liburing will issue io_uring_enter() to wake the poller thread up
+            ++_sqpoll_wakeups;
+        }
+        return ::io_uring_submit(&_uring);
+    }
+
+    void setup_registered_buffers(size_t size) {
+        if (!size) {
+            return;
+        }
+        auto arena = make_lw_shared<registered_buffer_arena>(size);
+        auto iovecs = arena->iovecs();
+        auto r = ::io_uring_register_buffers(&_uring, iovecs.data(), iovecs.size());
+        if (r < 0) {
+            seastar_logger.warn("Unable to register {} bytes of DMA buffers with io_uring ({}), "
+                    "consider raising RLIMIT_MEMLOCK; continuing without registered buffers",
+                    size, std::error_code(-r, std::system_category()).message());
+            return;
+        }
+        _registered_buffers = std::move(arena);
+    }
+
+    // Has io_uring_wait_cqes() busy poll the NIC queues of the sockets of
+    // the ring's requests before going to sleep
+    void setup_busy_poll() {
+        if (!_r._cfg.net_busy_poll_usec) {
+            return;
+        }
+#ifdef SEASTAR_HAVE_URING_NAPI
+        ::io_uring_napi napi{};
+        napi.busy_poll_to = _r._cfg.net_busy_poll_usec;
+        napi.prefer_busy_poll = _r._cfg.net_prefer_busy_poll;
+        auto r = ::io_uring_register_napi(&_uring, &napi);
+        if (r < 0) {
+            seastar_logger.info("Unable to set up io_uring NAPI busy polling ({}), requires Linux 6.9 or later; "
+                    "busy polling the sockets only", std::error_code(-r, std::system_category()).message());
+        }
+#else
+        seastar_logger.info("io_uring NAPI busy polling is not supported by this build (requires liburing 2.6 or later); "
+                "busy polling the sockets only");
+#endif
+    }
+
+    void setup_registered_files(unsigned nr) {
+        if (!nr) {
+            return;
+        }
+        auto r = ::io_uring_register_files_sparse(&_uring, nr);
+        if (r < 0) {
+            seastar_logger.info("Unable to set up an io_uring registered file table of {} entries ({}); "
+                    "continuing without it", nr, std::error_code(-r, std::system_category()).message());
+            return;
+        }
+        _free_fixed_file_slots.reserve(nr);
+        for (unsigned slot = nr; slot-- > 0; ) {
+            _free_fixed_file_slots.push_back(slot);
+        }
+    }
+
+    // Points the sqe at the registered file table entry of its fd, if any
+    void maybe_use_fixed_file(::io_uring_sqe* sqe, int fd) const noexcept {
+        if (size_t(fd) < _fixed_file_slots.size() && _fixed_file_slots[fd] >= 0) {
+            sqe->fd = _fixed_file_slots[fd];
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
+    void setup_multishot() {
+        if (!_r._cfg.uring_multishot) {
+            return;
+        }
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (!kernel_uname().whitelisted({"6.0"})) {
+            seastar_logger.warn("io_uring multishot receive requires Linux 6.0 or later; using single-shot requests");
+            return;
+        }
+        try {
+            _buffer_ring = make_lw_shared<provided_buffer_ring>(_uring, _r._cfg.uring_buffer_ring_entries, _r._cfg.uring_buffer_ring_buffer_size);
+        } catch (...) {
+            seastar_logger.warn("Unable to set up io_uring provided buffer ring ({}); using single-shot requests", std::current_exception());
+        }
+#else
+        seastar_logger.warn("io_uring multishot requests are not supported by this build (requires liburing 2.4 or later)");
+#endif
+    }
+
+    void setup_zcrx() {
+        if (!_zcrx) {
+            return;
+        }
+#ifdef SEASTAR_HAVE_URING_ZCRX
+        auto& ifname = _r._cfg.uring_zcrx_interface;
+        auto if_idx = ::if_nametoindex(ifname.c_str());
+        if (!if_idx) {
+            seastar_logger.warn("Unknown network interface {} for io_uring zero-copy receive; using regular receive", ifname);
+            return;
+        }
+        auto size = _r._cfg.uring_zcrx_area_size;
+        if (size > zcrx_area::max_size) {
+            seastar_logger.warn("io_uring zero-copy receive area of {} bytes exceeds the maximum; using {} bytes", size, zcrx_area::max_size);
+        }
+        auto rx_queue = _r._cfg.uring_zcrx_rx_queue + _r._id;
+        try {
+            _zcrx_area = make_lw_shared<zcrx_area>(_uring, if_idx, rx_queue, size);
+        } catch (...) {
+            seastar_logger.warn("Unable to bind receive queue {} of {} for io_uring zero-copy receive ({}); using regular receive",
+                    rx_queue, ifname, std::current_exception());
+        }
+#endif
+    }
+
+    bool zerocopy_receive() const noexcept {
+#ifdef SEASTAR_HAVE_URING_ZCRX
+        return bool(_zcrx_area);
+#else
+        return false;
+#endif
+    }
+
+    void setup_metadata_ops() {
+#ifdef SEASTAR_HAVE_URING_METADATA_OPS
+        auto probe = ::io_uring_get_probe_ring(&_uring);
+        if (!probe) {
+            return;
+        }
+        auto free_probe = defer([&] () noexcept { ::io_uring_free_probe(probe); });
+        // mkdirat, the last of them, came with Linux 5.15
+        _metadata_ops = std::ranges::all_of(std::initializer_list<int>{
+                IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_UNLINKAT, IORING_OP_RENAMEAT, IORING_OP_MKDIRAT},
+                [probe] (int op) { return io_uring_opcode_supported(probe, op); });
+#endif
+    }
+
+    // IORING_OP_MSG_RING came with Linux 5.18, and skipping the completions
+    // of the successful ones with 5.17
+    void setup_msg_ring() {
+#ifdef SEASTAR_HAVE_URING_MSG_RING
+        if (!(_uring.features & IORING_FEAT_CQE_SKIP)) {
+            return;
+        }
+        auto probe = ::io_uring_get_probe_ring(&_uring);
+        if (!probe) {
+            return;
+        }
+        auto free_probe = defer([&] () noexcept { ::io_uring_free_probe(probe); });
+        _msg_ring = io_uring_opcode_supported(probe, IORING_OP_MSG_RING);
+        if (_msg_ring) {
+            _msg_ring_wakeups.resize(smp::count);
+        }
+#endif
+    }
+
+    // io_uring_wait_cqes() passes its timeout to the kernel along with the
+    // wait since Linux 5.11; before that liburing queues a timeout request,
+    // whose completion do_process_kernel_completions() would not know.
+    void setup_ring_timeouts() {
+        _ring_timeouts = _uring.features & IORING_FEAT_EXT_ARG;
+    }
+
+    // Runs the high resolution timers if they are due. With ring timeouts
+    // they are checked whenever the reactor polls (so while running tasks,
+    // they wait for the end of the task quota) and when it wakes up.
+    bool maybe_expire_highres_timer() noexcept {
+        if (!_highres_deadline || std::chrono::steady_clock::now() < *_highres_deadline) {
+            return false;
+        }
+        _highres_deadline.reset();
+        _r.service_highres_timer();
+        return true;
+    }
+
+    void setup_nvme_passthrough() {
+        if (!_nvme_passthrough) {
+            return;
+        }
+        auto probe = ::io_uring_get_probe_ring(&_uring);
+        if (!probe || !io_uring_opcode_supported(probe, IORING_OP_URING_CMD)) {
+            seastar_logger.warn("io_uring NVMe passthrough commands are not supported by the kernel; using the block layer");
+            _nvme_passthrough = false;
+        }
+        if (probe) {
+            ::io_uring_free_probe(probe);
+        }
+    }
+
+    void cancel(uint64_t user_data) {
+        auto sqe = get_sqe();
+        ::io_uring_prep_cancel64(sqe, user_data, 0);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&_ignore_completion));
+        _has_pending_submissions = true;
+    }
+
+    std::optional<int> registered_buffer_index(const void* addr, size_t size) const noexcept {
+        if (!_registered_buffers) {
+            return std::nullopt;
+        }
+        return _registered_buffers->buffer_index(addr, size);
+    }
+
     // Can fail if the completion queue is full
     ::io_uring_sqe* try_get_sqe() {
         return ::io_uring_get_sqe(&_uring);
@@ -1383,7 +2273,7 @@ class reactor_backend_uring final : public reactor_backend {
         if (_has_pending_submissions) {
             _has_pending_submissions = false;
             _did_work_while_getting_sqe = false;
-            io_uring_submit(&_uring);
+            submit();
             return true;
         } else {
             return std::exchange(_did_work_while_getting_sqe, false);
@@ -1393,6 +2283,7 @@ class reactor_backend_uring final : public reactor_backend {
     ::io_uring_sqe* get_sqe() {
         ::io_uring_sqe* sqe;
         while (__builtin_expect((sqe = try_get_sqe()) == nullptr, false)) {
+            ++_sq_full_stalls;
             do_flush_submission_ring();
             do_process_kernel_completions_step();
             _did_work_while_getting_sqe = true;
@@ -1415,27 +2306,40 @@ class reactor_backend_uring final : public reactor_backend {
         switch (req.opcode()) {
             case o::read: {
                 const auto& op = req.as<io_request::operation::read>();
-                ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                if (auto idx = registered_buffer_index(op.addr, op.size)) {
+                    ::io_uring_prep_read_fixed(sqe, op.fd, op.addr, op.size, op.pos, *idx);
+                } else {
+                    ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                }
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::write: {
                 const auto& op = req.as<io_request::operation::write>();
-                ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+                if (auto idx = registered_buffer_index(op.addr, op.size)) {
+                    ::io_uring_prep_write_fixed(sqe, op.fd, op.addr, op.size, op.pos, *idx);
+                } else {
+                    ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+                }
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::readv: {
                 const auto& op = req.as<io_request::operation::readv>();
                 ::io_uring_prep_readv(sqe, op.fd, op.iovec, op.iov_len, op.pos);
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::writev: {
                 const auto& op = req.as<io_request::operation::writev>();
                 ::io_uring_prep_writev(sqe, op.fd, op.iovec, op.iov_len, op.pos);
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::fdatasync: {
                 const auto& op = req.as<io_request::operation::fdatasync>();
                 ::io_uring_prep_fsync(sqe, op.fd, IORING_FSYNC_DATASYNC);
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::recv: {
@@ -1468,6 +2372,59 @@ class reactor_backend_uring final : public reactor_backend {
                 ::io_uring_prep_connect(sqe, op.fd, op.sockaddr, op.socklen);
                 break;
             }
+#ifdef SEASTAR_HAVE_URING_METADATA_OPS
+            case o::statx: {
+                const auto& op = req.as<io_request::operation::statx>();
+                ::io_uring_prep_statx(sqe, op.dirfd, op.path, op.flags, op.mask, op.statxbuf);
+                break;
+            }
+            case o::openat: {
+                const auto& op = req.as<io_request::operation::openat>();
+                ::io_uring_prep_openat(sqe, op.dirfd, op.path, op.flags, op.mode);
+                break;
+            }
+            case o::unlinkat: {
+                const auto& op = req.as<io_request::operation::unlinkat>();
+                ::io_uring_prep_unlinkat(sqe, op.dirfd, op.path, op.flags);
+                break;
+            }
+            case o::renameat: {
+                const auto& op = req.as<io_request::operation::renameat>();
+                ::io_uring_prep_renameat(sqe, op.olddirfd, op.oldpath, op.newdirfd, op.newpath, op.flags);
+                break;
+            }
+            case o::mkdirat: {
+                const auto& op = req.as<io_request::operation::mkdirat>();
+                ::io_uring_prep_mkdirat(sqe, op.dirfd, op.path, op.mode);
+                break;
+            }
+#else
+            case o::statx:
+            case o::openat:
+            case o::unlinkat:
+            case o::renameat:
+            case o::mkdirat:
+#endif
+#ifdef SEASTAR_HAVE_URING_NVME_PASSTHROUGH
+            case o::nvme_cmd: {
+                const auto& op = req.as<io_request::operation::nvme_cmd>();
+                ::io_uring_prep_rw(IORING_OP_URING_CMD, sqe, op.fd, nullptr, 0, 0);
+                sqe->cmd_op = op.vectored ? NVME_URING_CMD_IO_VEC : NVME_URING_CMD_IO;
+                auto cmd = reinterpret_cast<::nvme_uring_cmd*>(sqe->cmd);
+                std::memset(cmd, 0, sizeof(*cmd));
+                cmd->opcode = op.opcode;
+                cmd->nsid = op.nsid;
+                cmd->addr = reinterpret_cast<uintptr_t>(op.addr);
+                cmd->data_len = op.size;
+                cmd->cdw10 = op.cdw10;
+                cmd->cdw11 = op.cdw11;
+                cmd->cdw12 = op.cdw12;
+                maybe_use_fixed_file(sqe, op.fd);
+                break;
+            }
+#else
+            case o::nvme_cmd:
+#endif
             case o::poll_add:
             case o::poll_remove:
             case o::cancel:
@@ -1496,6 +2453,11 @@ class reactor_backend_uring final : public reactor_backend {
     void do_process_ready_kernel_completions(::io_uring_cqe** buf, size_t nr) {
         for (auto p = buf; p != buf + nr; ++p) {
             auto cqe = *p;
+            if (cqe->user_data & uring_flagged_completion::tag) {
+                auto completion = reinterpret_cast<uring_flagged_completion*>(cqe->user_data & ~uring_flagged_completion::tag);
+                completion->complete_with_cqe(*cqe);
+                continue;
+            }
             auto completion = reinterpret_cast<kernel_completion*>(cqe->user_data);
             completion->complete_with(cqe->res);
         }
@@ -1528,7 +2490,7 @@ class reactor_backend_uring final : public reactor_backend {
 public:
     explicit reactor_backend_uring(reactor& r)
             : _r(r)
-            , _uring(try_create_uring(s_queue_len, true).value())
+            , _uring(create_uring())
             , _hrtimer_timerfd(make_timerfd())
             , _preempt_io_context(_r, _r._task_quota_timer, _hrtimer_timerfd)
             , _hrtimer_completion(_r, _hrtimer_timerfd)
@@ -1537,46 +2499,130 @@ class reactor_backend_uring final : public reactor_backend {
         // expired when it really hasn't, we don't want to block in read(tfd, ...).
         auto tfd = _r._task_quota_timer.get();
         ::fcntl(tfd, F_SETFL, ::fcntl(tfd, F_GETFL) | O_NONBLOCK);
+        setup_registered_buffers(_r._cfg.uring_registered_buffers_size);
+        setup_registered_files(_r._cfg.uring_registered_files);
+        setup_multishot();
+        setup_zcrx();
+        setup_metadata_ops();
+        setup_msg_ring();
+        setup_nvme_passthrough();
+        setup_busy_poll();
+        setup_ring_timeouts();
     }
     ~reactor_backend_uring() {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_buffer_ring) {
+            _buffer_ring->detach();
+        }
+#endif
         ::io_uring_queue_exit(&_uring);
     }
     virtual bool reap_kernel_completions() override {
-        return do_process_kernel_completions();
+        bool did_work = do_process_kernel_completions();
+        did_work |= maybe_expire_highres_timer();
+        return did_work;
     }
     virtual bool kernel_submit_work() override {
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
+        did_work |= maybe_expire_highres_timer();
         did_work |= queue_pending_file_io();
-        did_work |= ::io_uring_submit(&_uring);
+        did_work |= submit();
         return did_work;
     }
     virtual bool kernel_events_can_sleep() const override {
         // We never need to spin while I/O is in flight.
         return true;
     }
+    virtual bool submits_metadata_ops() const noexcept override {
+        return _metadata_ops;
+    }
+    virtual bool supports_nvme_passthrough() const noexcept override {
+        return _nvme_passthrough;
+    }
+    // Posts a completion straight into the ring of the target, which its
+    // io_uring_wait_cqes() returns on, rather than making it read its
+    // eventfd. The request goes with the next submission of this ring,
+    // along with the other requests of the poll, so costs no syscall of
+    // its own. The reactors only send one wakeup each time the target
+    // goes to sleep, however many messages they send it.
+    virtual bool wake_up(reactor& target) noexcept override {
+#ifdef SEASTAR_HAVE_URING_MSG_RING
+        if (!_msg_ring) {
+            return false;
+        }
+        auto [fd, data] = target._backend->wake_up_target();
+        if (fd < 0) {
+            return false;
+        }
+        auto& completion = _msg_ring_wakeups[target._id];
+        completion.target = &target;
+        auto sqe = get_sqe();
+        ::io_uring_prep_msg_ring(sqe, fd, 0, data, 0);
+        sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&completion));
+        _has_pending_submissions = true;
+        ++_msg_ring_wakeups_sent;
+        return true;
+#else
+        return false;
+#endif
+    }
+    virtual void cancel_io(io_completion* desc) noexcept override {
+        auto user_data = reinterpret_cast<uintptr_t>(static_cast<kernel_completion*>(desc));
+        // The request may still sit in the sink, and the kernel only finds
+        // it if it's ahead of the cancellation in the submission queue
+        queue_pending_file_io();
+        auto sqe = get_sqe();
+        ::io_uring_prep_cancel64(sqe, user_data, 0);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&_io_cancel_completion));
+        _has_pending_submissions = true;
+    }
+    virtual std::pair<int, uint64_t> wake_up_target() const noexcept override {
+        if (!_msg_ring) {
+            return {-1, 0};
+        }
+        // Nothing to do once woken up
+        return {_uring.ring_fd, reinterpret_cast<uintptr_t>(static_cast<const kernel_completion*>(&_ignore_completion))};
+    }
     virtual void wait_and_process_events(const sigset_t* active_sigmask) override {
         _smp_wakeup_completion.maybe_rearm(*this);
-        _hrtimer_completion.maybe_rearm(*this);
-        ::io_uring_submit(&_uring);
+        if (!_ring_timeouts) {
+            _hrtimer_completion.maybe_rearm(*this);
+        }
+        submit();
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= std::exchange(_did_work_while_getting_sqe, false);
+        did_work |= maybe_expire_highres_timer();
         if (did_work) {
             return;
         }
         struct ::io_uring_cqe* cqe = nullptr;
         sigset_t sigs = *active_sigmask; // io_uring_wait_cqes() wants non-const
-        auto r = ::io_uring_wait_cqes(&_uring, &cqe, 1, nullptr, &sigs);
+        ::__kernel_timespec timeout;
+        ::__kernel_timespec* timeoutp = nullptr;
+        if (_highres_deadline) {
+            // Not due yet, as maybe_expire_highres_timer() just checked
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(*_highres_deadline - std::chrono::steady_clock::now()).count();
+            ns = std::max<int64_t>(ns, 0);
+            timeout.tv_sec = ns / 1'000'000'000;
+            timeout.tv_nsec = ns % 1'000'000'000;
+            timeoutp = &timeout;
+        }
+        auto r = ::io_uring_wait_cqes(&_uring, &cqe, 1, timeoutp, &sigs);
         if (__builtin_expect(r < 0, false)) {
             switch (-r) {
             case EINTR:
                 return;
+            case ETIME:
+                break;
             default:
                 abort();
             }
         }
         did_work |= do_process_kernel_completions();
+        did_work |= maybe_expire_highres_timer();
         _preempt_io_context.service_preempting_io();
     }
     virtual future<> readable(pollable_fd_state& fd) override {
@@ -1595,7 +2641,51 @@ class reactor_backend_uring final : public reactor_backend {
         auto* pfd = static_cast<uring_pollable_fd_state*>(&fd);
         delete pfd;
     }
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    future<std::tuple<pollable_fd, socket_address>> accept_multishot(uring_pollable_fd_state& listenfd) {
+        auto& ms = listenfd.accept_state(*this);
+        if (!ms.ready.empty()) {
+            auto fd = std::move(ms.ready.front());
+            ms.ready.pop_front();
+            try {
+                // Multishot accept cannot report the peer address
+                auto sa = fd.get_remote_address();
+                pollable_fd pfd(std::move(fd), pollable_fd::speculation(EPOLLOUT));
+                return make_ready_future<std::tuple<pollable_fd, socket_address>>(std::move(pfd), std::move(sa));
+            } catch (...) {
+                return current_exception_as_future<std::tuple<pollable_fd, socket_address>>();
+            }
+        }
+        if (ms.error) {
+            auto ec = std::exchange(ms.error, 0);
+            try {
+                if (ec == EINVAL) {
+                    // The chances are that we shutting down the connection.
+                    listenfd.maybe_no_more_recv();
+                }
+                throw std::system_error(ec, std::system_category());
+            } catch (...) {
+                return current_exception_as_future<std::tuple<pollable_fd, socket_address>>();
+            }
+        }
+        if (!ms.armed) {
+            auto sqe = get_sqe();
+            ::io_uring_prep_multishot_accept(sqe, listenfd.fd.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            sqe->user_data = ms.user_data();
+            ms.armed = true;
+            _has_pending_submissions = true;
+        }
+        return ms.wait().then([this, &listenfd] {
+            return accept_multishot(listenfd);
+        });
+    }
+#endif
     virtual future<std::tuple<pollable_fd, socket_address>> accept(pollable_fd_state& listenfd) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_buffer_ring) {
+            return accept_multishot(static_cast<uring_pollable_fd_state&>(listenfd));
+        }
+#endif
         if (listenfd.take_speculation(POLLIN)) {
             try {
                 listenfd.maybe_no_more_recv();
@@ -1892,7 +2982,67 @@ class reactor_backend_uring final : public reactor_backend {
         return submit_request(std::move(desc), std::move(req));
     }
 
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    future<temporary_buffer<char>> recv_multishot(uring_pollable_fd_state& fd, internal::buffer_allocator* ba) {
+        auto& ms = fd.recv_state(*this);
+        if (!ms.ready.empty()) {
+            auto buf = std::move(ms.ready.front());
+            ms.ready.pop_front();
+            return make_ready_future<temporary_buffer<char>>(std::move(buf));
+        }
+        if (ms.error) {
+            return make_exception_future<temporary_buffer<char>>(std::exchange(ms.error, nullptr));
+        }
+        if (ms.eof) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        if (ms.exhausted) {
+            // The buffer ring ran dry and the request was terminated; receive
+            // this one into our own buffer and re-arm on the next call.
+            ms.exhausted = false;
+            return do_recv_some(fd, ba);
+        }
+        if (!ms.armed) {
+            if (zerocopy_receive() && !ms.zerocopy_unsupported) {
+#ifdef SEASTAR_HAVE_URING_ZCRX
+                auto sqe = get_sqe();
+                ::io_uring_prep_rw(IORING_OP_RECV_ZC, sqe, fd.fd.get(), nullptr, 0, 0);
+                sqe->ioprio |= IORING_RECV_MULTISHOT;
+                sqe->zcrx_ifq_idx = _zcrx_area->id();
+                sqe->user_data = ms.user_data();
+                ms.zerocopy = true;
+#endif
+            } else if (_buffer_ring) {
+                auto sqe = get_sqe();
+                ::io_uring_prep_recv_multishot(sqe, fd.fd.get(), nullptr, 0, 0);
+                sqe->flags |= IOSQE_BUFFER_SELECT;
+                sqe->buf_group = provided_buffer_ring::group_id;
+                sqe->user_data = ms.user_data();
+                ms.zerocopy = false;
+            } else {
+                return do_recv_some(fd, ba);
+            }
+            ms.armed = true;
+            _has_pending_submissions = true;
+        }
+        return ms.wait().then([this, &fd, ba] {
+            return recv_multishot(fd, ba);
+        });
+    }
+#endif
+
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_buffer_ring || zerocopy_receive()) {
+            // Don't mix in speculative receives, they could overtake data
+            // already completed by the multishot request but not reaped yet.
+            return recv_multishot(static_cast<uring_pollable_fd_state&>(fd), ba);
+        }
+#endif
+        return do_recv_some(fd, ba);
+    }
+
+    future<temporary_buffer<char>> do_recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) {
         if (fd.take_speculation(POLLIN)) {
             auto buffer = ba->allocate_buffer();
             try {
@@ -1956,7 +3106,18 @@ class reactor_backend_uring final : public reactor_backend {
         _preempt_io_context.stop_tick();
     }
     virtual void arm_highres_timer(const ::itimerspec& its) override {
-        _hrtimer_timerfd.timerfd_settime(TFD_TIMER_ABSTIME, its);
+        if (!_ring_timeouts) {
+            _hrtimer_timerfd.timerfd_settime(TFD_TIMER_ABSTIME, its);
+            return;
+        }
+        // Like timerfd_settime(), a zero expiration disarms the timer
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            _highres_deadline.reset();
+            return;
+        }
+        _highres_deadline = std::chrono::steady_clock::time_point(
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::seconds(its.it_value.tv_sec) + std::chrono::nanoseconds(its.it_value.tv_nsec)));
     }
     virtual void reset_preemption_monitor() override {
         _preempt_io_context.reset_preemption_monitor();
@@ -1970,6 +3131,67 @@ class reactor_backend_uring final : public reactor_backend {
     virtual pollable_fd_state_ptr make_pollable_fd_state(file_desc fd, pollable_fd::speculation speculate) override {
         return pollable_fd_state_ptr(new uring_pollable_fd_state(std::move(fd), std::move(speculate)));
     }
+    virtual void register_metrics() override {
+        namespace sm = seastar::metrics;
+        _metrics.add_group("reactor", {
+            sm::make_counter("uring_sq_full_stalls", _sq_full_stalls,
+                    sm::description("Number of times the io_uring submission queue was full and the reactor had to flush it and reap completions before queueing more requests")),
+            sm::make_counter("uring_sqpoll_wakeups", _sqpoll_wakeups,
+                    sm::description("Number of times the io_uring SQPOLL kernel thread was asleep and had to be woken up with a system call")),
+            sm::make_counter("uring_msg_ring_wakeups", _msg_ring_wakeups_sent,
+                    sm::description("Number of times a sleeping shard was woken up for a message through its io_uring ring, rather than its eventfd")),
+            sm::make_counter("uring_io_cancelled", _io_cancel_completion.cancelled,
+                    sm::description("Number of in-flight I/O requests of cancelled intents that were cancelled in the kernel")),
+            sm::make_counter("uring_io_cancel_too_late", _io_cancel_completion.too_late,
+                    sm::description("Number of in-flight I/O requests of cancelled intents that had completed or were running when cancelled")),
+        });
+    }
+    virtual bool register_file(int fd) noexcept override {
+        if (_free_fixed_file_slots.empty() || fd < 0) {
+            return false;
+        }
+        try {
+            if (size_t(fd) >= _fixed_file_slots.size()) {
+                _fixed_file_slots.resize(fd + 1, -1);
+            }
+        } catch (...) {
+            return false;
+        }
+        auto slot = _free_fixed_file_slots.back();
+        auto r = ::io_uring_register_files_update(&_uring, slot, &fd, 1);
+        if (r < 0) {
+            seastar_logger.debug("Unable to register fd {} with io_uring: {}", fd, std::error_code(-r, std::system_category()).message());
+            return false;
+        }
+        _free_fixed_file_slots.pop_back();
+        _fixed_file_slots[fd] = slot;
+        return true;
+    }
+    virtual void unregister_file(int fd) noexcept override {
+        assert(size_t(fd) < _fixed_file_slots.size() && _fixed_file_slots[fd] >= 0);
+        unsigned slot = std::exchange(_fixed_file_slots[fd], -1);
+        int none = -1;
+        ::io_uring_register_files_update(&_uring, slot, &none, 1);
+        // Cannot fail, we reserved room for every slot upfront
+        _free_fixed_file_slots.push_back(slot);
+    }
+    virtual temporary_buffer<char> try_allocate_registered_buffer(size_t alignment, size_t size) noexcept override {
+        if (!_registered_buffers) {
+            return {};
+        }
+        auto p = _registered_buffers->allocate(size, alignment);
+        if (!p) {
+            return {};
+        }
+        try {
+            return temporary_buffer<char>(p, size, make_deleter([arena = _registered_buffers, p, size] {
+                arena->free(p, size);
+            }));
+        } catch (...) {
+            _registered_buffers->free(p, size);
+            return {};
+        }
+    }
 };
 
 #endif
@@ -47,6 +47,7 @@
 namespace seastar {
 
 class reactor;
+class io_completion;
 
 // FIXME: merge it with storage context below. At this point the
 // main thing to do is unify the iocb list
@@ -222,6 +223,55 @@ class reactor_backend {
     virtual void start_handling_signal() = 0;
 
     virtual pollable_fd_state_ptr make_pollable_fd_state(file_desc fd, pollable_fd::speculation speculate) = 0;
+
+    // Allocates memory which the backend can submit I/O on more cheaply than
+    // arbitrary user memory (e.g. buffers registered with the kernel up front).
+    // Returns an empty buffer if no such memory is available.
+    virtual temporary_buffer<char> try_allocate_registered_buffer(size_t alignment, size_t size) noexcept {
+        return {};
+    }
+
+    // Registers a file descriptor with the kernel for cheaper submission of
+    // I/O on it. Returns false if the backend doesn't support it or has no
+    // room left; otherwise unregister_file() must be called before it is closed.
+    virtual bool register_file(int fd) noexcept {
+        return false;
+    }
+    virtual void unregister_file(int fd) noexcept {}
+
+    // Whether the I/O requests of the metadata operations (statx, openat,
+    // unlinkat, renameat, mkdirat) can be submitted to the reactor's I/O
+    // sink, rather than their syscalls being run by the syscall thread.
+    virtual bool submits_metadata_ops() const noexcept {
+        return false;
+    }
+    // Whether NVMe commands (io_request::operation::nvme_cmd) can be
+    // submitted to the reactor's I/O sink, for the files of NVMe generic
+    // char devices.
+    virtual bool supports_nvme_passthrough() const noexcept {
+        return false;
+    }
+
+    // Wakes up a sleeping reactor, messaged by this one, through the
+    // kernel rather than with a write to its eventfd. Returns false if
+    // the backend can't, for the caller to fall back to
+    // reactor::wakeup().
+    virtual bool wake_up(reactor& target) noexcept {
+        return false;
+    }
+    // The ring fd and completion data other reactors wake this one with
+    // through wake_up(), or -1 if it can't be woken up that way
+    virtual std::pair<int, uint64_t> wake_up_target() const noexcept {
+        return {-1, 0};
+    }
+    // Asks the kernel to cancel an I/O request submitted from the reactor's
+    // I/O sink. The request completes as usual either way, with ECANCELED
+    // if the cancellation worked. Backends that can't cancel requests in
+    // flight let them run to completion.
+    virtual void cancel_io(io_completion* desc) noexcept {}
+
+    // Registers backend-specific metrics. Called once from reactor::register_metrics().
+    virtual void register_metrics() {}
 };
 
 // reactor backend using file-descriptor & epoll, suitable for running on
@@ -243,6 +293,7 @@ class reactor_backend_epoll : public reactor_backend {
     file_desc _steady_clock_timer_timer_thread;
 private:
     file_desc _epollfd;
+    void setup_busy_poll();
     void task_quota_timer_thread_fn();
     future<> get_epoll_future(pollable_fd_state& fd, int event);
     void complete_epoll_event(pollable_fd_state& fd, int events, int event);
@@ -34,6 +34,8 @@ module;
 #include <unistd.h>
 #include <limits>
 #include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <unordered_map>
 #include <fmt/core.h>
 #if SEASTAR_HAVE_HWLOC
@@ -188,11 +190,16 @@ static optional<fs::path> locate_lowest_cgroup2(fs::path lowest_subdir, std::str
  * For V2, look for the lowest cgroup in our hierarchy that manages the
  * requested settings.
  */
-template <typename T>
-optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname) {
+static const optional<fs::path>& my_cgroup2_path() {
     // on v2-systems, cg2_path will be initialized with the leaf cgroup that
     // controls this process
     static optional<fs::path> cg2_path{cgroup2_path_my_pid()};
+    return cg2_path;
+}
+
+template <typename T>
+optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname) {
+    auto& cg2_path = my_cgroup2_path();
 
     if (cg2_path) {
         // this is a v2 system
@@ -224,6 +231,72 @@ optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname) {
     return std::nullopt;
 }
 
+optional<cpu_quota> cpu_limit() {
+    using std::chrono::microseconds;
+    if (auto& cg2_path = my_cgroup2_path()) {
+        // Every cgroup with the cpu controller has a cpu.max, "max" when
+        // unlimited; an ancestor may limit all its descendants more
+        optional<cpu_quota> tightest;
+        for (auto dir = *cg2_path; dir.compare("/sys/fs"); dir = dir.parent_path()) {
+            auto file = dir / "cpu.max";
+            if (!fs::exists(file)) {
+                continue;
+            }
+            try {
+                std::istringstream in(read_first_line(file));
+                std::string quota;
+                uint64_t period = 0;
+                in >> quota >> period;
+                if (quota == "max" || !period) {
+                    continue;
+                }
+                auto q = cpu_quota{microseconds(std::stoull(quota)), microseconds(period), dir, true};
+                if (!tightest || q.cpus() < tightest->cpus()) {
+                    tightest = std::move(q);
+                }
+            } catch (...) {
+                seastar_logger.warn("Malformed cgroups file ({}) contents.", file.native());
+            }
+        }
+        return tightest;
+    }
+
+    auto dir = fs::path{"/sys/fs/cgroup/cpu"};
+    try {
+        auto quota = read_first_line_as<int64_t>(dir / "cpu.cfs_quota_us");
+        auto period = read_first_line_as<int64_t>(dir / "cpu.cfs_period_us");
+        if (quota > 0 && period > 0) {
+            return cpu_quota{microseconds(quota), microseconds(period), dir, false};
+        }
+    } catch (...) {
+        seastar_logger.debug("No cgroups v1 CPU quota");
+    }
+    return std::nullopt;
+}
+
+optional<cpu_throttling> cpu_throttling_stats(const cpu_quota& q) {
+    std::ifstream in(q.dir / "cpu.stat");
+    if (!in) {
+        return std::nullopt;
+    }
+    cpu_throttling ret;
+    std::string key;
+    uint64_t value;
+    while (in >> key >> value) {
+        if (key == "nr_periods") {
+            ret.periods = value;
+        } else if (key == "nr_throttled") {
+            ret.throttled_periods = value;
+        } else if (key == "throttled_usec") {
+            ret.throttled_time = std::chrono::microseconds(value);
+        } else if (key == "throttled_time") {
+            // cgroups v1, in nanoseconds
+            ret.throttled_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(value));
+        }
+    }
+    return ret;
+}
+
 }
 
 namespace resource {
@@ -0,0 +1,89 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/shard_scaler.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/log.hh>
+#include <utility>
+
+namespace seastar {
+
+static logger scaler_logger("shard_scaler");
+
+shard_scaler::shard_scaler(config cfg)
+        : _cfg(std::move(cfg))
+        , _timer([this] {
+            // A rescale still waiting for a shard to (un)park skips a tick
+            if (_gate.get_count()) {
+                return;
+            }
+            (void)with_gate(_gate, [this] {
+                return rescale();
+            }).handle_exception([] (std::exception_ptr ex) {
+                scaler_logger.warn("Failed to rescale: {}", ex);
+            });
+        }) {
+}
+
+void shard_scaler::start() {
+    assert(this_shard_id() == 0);
+    _timer.arm_periodic(_cfg.interval);
+}
+
+future<> shard_scaler::rescale() {
+    // The total utilization of the active shards, and their number
+    auto [total, active] = co_await smp::broadcast_map_reduce([] {
+        auto& r = engine();
+        return r._parked ? std::pair(0.0, 0u) : std::pair(1 - r._load, 1u);
+    }, [] (std::pair<double, unsigned> a, std::pair<double, unsigned> b) {
+        return std::pair(a.first + b.first, a.second + b.second);
+    });
+    auto utilization = total / active;
+    if (utilization > _cfg.high_utilization && active < smp::count) {
+        for (unsigned c = 1; c < smp::count; c++) {
+            if (smp::parked(c)) {
+                scaler_logger.info("Utilization {:.2f} of {} shards, unparking shard {}", utilization, active, c);
+                co_await smp::unpark(c);
+                break;
+            }
+        }
+    } else if (utilization < _cfg.low_utilization && active > std::max(_cfg.min_active, 1u)
+            && total / (active - 1) < _cfg.high_utilization) {
+        for (unsigned c = smp::count - 1; c > 0; c--) {
+            if (!smp::parked(c)) {
+                scaler_logger.info("Utilization {:.2f} of {} shards, parking shard {}", utilization, active, c);
+                co_await smp::park(c);
+                break;
+            }
+        }
+    }
+}
+
+future<> shard_scaler::stop() {
+    _timer.cancel();
+    co_await _gate.close();
+    for (unsigned c = 1; c < smp::count; c++) {
+        co_await smp::unpark(c);
+    }
+}
+
+}
@@ -27,6 +27,7 @@ module;
 #include <vector>
 #include <regex>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -34,6 +35,7 @@ module;
 module seastar;
 #else
 #include <seastar/core/smp.hh>
+#include <seastar/core/replicated.hh>
 #include <seastar/core/resource.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/semaphore.hh>
@@ -179,6 +181,21 @@ smp::setup_prefaulter(const seastar::resource::resources& res, seastar::memory::
 #endif
 }
 
+future<std::vector<unsigned>>
+internal::numa_nodes_of_shards() {
+    return do_with(std::vector<unsigned>(smp::count), [] (std::vector<unsigned>& nodes) {
+        return smp::invoke_on_all([&nodes] {
+            unsigned cpu, node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) == -1) {
+                node = 0;
+            }
+            nodes[this_shard_id()] = node;
+        }).then([&nodes] {
+            return std::move(nodes);
+        });
+    });
+}
+
 static
 std::optional<size_t>
 get_huge_page_size() {
@@ -200,14 +217,33 @@ get_huge_page_size() {
 }
 
 internal::memory_prefaulter::memory_prefaulter(const resource::resources& res, memory::internal::numa_layout layout) {
+    std::unordered_map<unsigned, std::vector<memory::internal::memory_range>> layout_by_node_id;
     for (auto& range : layout.ranges) {
-        _layout_by_node_id[range.numa_node_id].push_back(std::move(range));
+        layout_by_node_id[range.numa_node_id].push_back(std::move(range));
     }
     auto page_size = getpagesize();
     auto huge_page_size_opt = get_huge_page_size();
-    for (auto& numa_node_id_and_ranges : _layout_by_node_id) {
-        auto& numa_node_id = numa_node_id_and_ranges.first;
-        auto& ranges = numa_node_id_and_ranges.second;
+    std::vector<std::pair<unsigned, size_t>> workers; // node id, index in _ranges_by_worker
+    for (auto& [numa_node_id, ranges] : layout_by_node_id) {
+        size_t nr_cpus = 1;
+        auto i = res.numa_node_id_to_cpuset.find(numa_node_id);
+        if (i != res.numa_node_id_to_cpuset.end()) {
+            nr_cpus = std::max<size_t>(i->second.size(), 1);
+        }
+        auto nr_workers = std::min(ranges.size(), (nr_cpus + cpus_per_worker - 1) / cpus_per_worker);
+        // Deal the ranges out, each shard's memory being a range of its own
+        auto first = _ranges_by_worker.size();
+        _ranges_by_worker.resize(first + nr_workers);
+        for (size_t r = 0; r != ranges.size(); ++r) {
+            _ranges_by_worker[first + r % nr_workers].push_back(ranges[r]);
+        }
+        for (size_t w = 0; w != nr_workers; ++w) {
+            workers.emplace_back(numa_node_id, first + w);
+        }
+    }
+    // _ranges_by_worker is not resized anymore, the workers can refer to it
+    for (auto [numa_node_id, worker] : workers) {
+        auto& ranges = _ranges_by_worker[worker];
         posix_thread::attr a;
         auto i = res.numa_node_id_to_cpuset.find(numa_node_id);
         if (i != res.numa_node_id_to_cpuset.end()) {
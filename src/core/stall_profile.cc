@@ -0,0 +1,181 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/internal/stall_detector.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/stall_profile.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/util/log.hh>
+#endif
+
+#include "core/symbolizer.hh"
+#include "core/thread_pool.hh"
+
+namespace seastar {
+
+extern logger seastar_logger;
+
+namespace internal {
+
+class stall_profiler {
+public:
+    using stacks_type = stall_profile_recorder::stacks_type;
+
+    static stall_profile_recorder* local() noexcept {
+        return engine()._cpu_stall_detector->profile();
+    }
+
+    // Runs func on the syscall thread
+    template <typename T, typename Func>
+    static future<T> off_reactor(Func func) noexcept {
+        return engine()._thread_pool->submit<T>(std::move(func));
+    }
+};
+
+}
+
+namespace stall_profile {
+
+using internal::stall_profiler;
+
+struct shard_profile {
+    stall_profiler::stacks_type stacks;
+    uint64_t dropped = 0;
+};
+
+static future<std::vector<shard_profile>> gather(bool reset) {
+    std::vector<shard_profile> profiles(smp::count);
+    return do_with(std::move(profiles), [reset] (std::vector<shard_profile>& profiles) {
+        return smp::invoke_on_all([&profiles, reset] {
+            auto p = stall_profiler::local();
+            if (!p) {
+                return;
+            }
+            auto& profile = profiles[this_shard_id()];
+            profile.stacks = p->stacks();
+            profile.dropped = p->dropped();
+            if (reset) {
+                p->reset();
+            }
+        }).then([&profiles] {
+            return std::move(profiles);
+        });
+    });
+}
+
+// Runs on the syscall thread, which only reads the profiles
+static std::string fold(const std::vector<shard_profile>& profiles) {
+    internal::symbolizer symbolizer;
+    std::string out;
+    for (unsigned shard = 0; shard < profiles.size(); ++shard) {
+        for (auto& [stack, count] : profiles[shard].stacks) {
+            auto frames = symbolizer.frames(stack);
+            out += fmt::format("shard {}", shard);
+            for (auto i = frames.rbegin(); i != frames.rend(); ++i) {
+                out += ';';
+                out += **i;
+            }
+            out += fmt::format(" {}\n", count);
+        }
+        if (profiles[shard].dropped) {
+            out += fmt::format("shard {};[dropped] {}\n", shard, profiles[shard].dropped);
+        }
+    }
+    return out;
+}
+
+future<sstring> collect(bool reset) {
+    return gather(reset).then([] (std::vector<shard_profile> profiles) {
+        return do_with(std::move(profiles), [] (const std::vector<shard_profile>& profiles) {
+            return stall_profiler::off_reactor<std::string>([&profiles] {
+                return fold(profiles);
+            }).then([] (std::string folded) {
+                return sstring(folded);
+            });
+        });
+    });
+}
+
+future<> reset() {
+    return smp::invoke_on_all([] {
+        if (auto p = stall_profiler::local()) {
+            p->reset();
+        }
+    });
+}
+
+future<sstring> dump() {
+    sstring name = fmt::format("stall-profile.{}.folded", ::getpid());
+    return gather(false).then([name = std::move(name)] (std::vector<shard_profile> profiles) {
+        return do_with(std::move(profiles), name, [] (const std::vector<shard_profile>& profiles, const sstring& name) {
+            return stall_profiler::off_reactor<int>([&profiles, &name] {
+                auto folded = fold(profiles);
+                auto f = std::fopen(name.c_str(), "w");
+                if (!f) {
+                    return errno;
+                }
+                auto written = std::fwrite(folded.data(), 1, folded.size(), f);
+                auto error = written == folded.size() ? 0 : errno;
+                return std::fclose(f) && !error ? errno : error;
+            });
+        }).then([name] (int error) {
+            if (error) {
+                seastar_logger.error("Failed to write the stall profile to {}: {}", name, std::system_category().message(error));
+                throw std::system_error(error, std::system_category(), fmt::format("writing {}", name));
+            }
+            seastar_logger.info("Wrote the stall profile to {}", name);
+            return name;
+        });
+    });
+}
+
+future<> add_routes(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new httpd::function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+        if (!stall_profiler::local()) {
+            throw httpd::not_found_exception("The stalls are not profiled, see --blocked-reactor-profile");
+        }
+        return collect(req->get_query_param("reset") == "true").then([rep = std::move(rep)] (sstring folded) mutable {
+            rep->_content = std::move(folded);
+            return std::move(rep);
+        });
+    }, "txt"));
+    return make_ready_future<>();
+}
+
+}
+
+}
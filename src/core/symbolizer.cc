@@ -0,0 +1,92 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/util/backtrace.hh>
+#endif
+
+#include "core/symbolizer.hh"
+
+namespace seastar {
+
+namespace internal {
+
+std::string symbolizer::demangle(const char* name) {
+    int status;
+    std::unique_ptr<char, decltype(&::free)> demangled(abi::__cxa_demangle(name, nullptr, nullptr, &status), &::free);
+    return status == 0 ? std::string(demangled.get()) : std::string(name);
+}
+
+std::optional<std::string> symbolizer::dynamic_symbol(uintptr_t addr) {
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(addr), &info) && info.dli_sname) {
+        return demangle(info.dli_sname);
+    }
+    return std::nullopt;
+}
+
+const std::string& symbolizer::operator()(uintptr_t addr) {
+    auto i = _symbols.find(addr);
+    if (i != _symbols.end()) {
+        return i->second;
+    }
+    auto name = dynamic_symbol(addr);
+    if (!name) {
+        auto f = decorate(addr);
+        name = f.so->name.empty() ? fmt::format("0x{:x}", f.addr) : fmt::format("{}+0x{:x}", std::string_view(f.so->name), f.addr);
+    }
+    return _symbols.emplace(addr, std::move(*name)).first->second;
+}
+
+std::vector<const std::string*> symbolizer::frames(const std::vector<uintptr_t>& backtrace) {
+    std::vector<const std::string*> frames;
+    frames.reserve(backtrace.size());
+    for (auto addr : backtrace) {
+        frames.push_back(&(*this)(addr));
+    }
+    for (size_t i = frames.size(); i > 0; --i) {
+        if (frames[i - 1]->starts_with("__restore_rt")) {
+            frames.erase(frames.begin(), frames.begin() + i);
+            break;
+        }
+    }
+    return frames;
+}
+
+}
+
+}
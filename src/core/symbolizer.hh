@@ -0,0 +1,52 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace seastar {
+
+namespace internal {
+
+// Resolves return addresses to symbols, from the dynamic symbol table, or to
+// their offset in their object for seastar-addr2line, caching them. Slow,
+// and allocating with the thread's allocator: for the syscall thread rather
+// than the reactor.
+class symbolizer {
+    std::unordered_map<uintptr_t, std::string> _symbols;
+public:
+    const std::string& operator()(uintptr_t addr);
+    // The frames of a backtrace taken by a signal handler, innermost first,
+    // without those of the handler, up to the trampoline it returns to
+    std::vector<const std::string*> frames(const std::vector<uintptr_t>& backtrace);
+    static std::string demangle(const char* name);
+    // The symbol of addr in the dynamic symbol table, if it is in one
+    static std::optional<std::string> dynamic_symbol(uintptr_t addr);
+};
+
+}
+
+}
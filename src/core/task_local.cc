@@ -0,0 +1,80 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/task_local.hh>
+#endif
+
+namespace seastar::internal {
+
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+current_task_locals*
+current_task_locals_ptr() noexcept {
+    static thread_local current_task_locals locals;
+    return &locals;
+}
+#endif
+
+unsigned allocate_task_local_slot() {
+    static std::atomic<unsigned> next_slot = 0;
+    auto slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= task_locals::max_slots) {
+        throw std::length_error("too many task_local_key instances");
+    }
+    return slot;
+}
+
+task_locals_scope::task_locals_scope(unsigned slot, uint64_t bits)
+        : _previous(current_task_locals_ptr()->locals)
+        , _mine(new task_locals) {
+    if (_previous) {
+        ++_previous->refs;
+        _mine->present = _previous->present;
+        std::copy(std::begin(_previous->slots), std::end(_previous->slots), _mine->slots);
+    }
+    _mine->present |= uint32_t(1) << slot;
+    _mine->slots[slot] = bits;
+    current_task_locals_ptr()->locals = _mine;
+}
+
+task_locals_scope::~task_locals_scope() {
+    // The tasks made in the scope hold their own references to _mine. The
+    // task running now may not be the one the scope started in, so our
+    // reference to _previous is handed over to the reactor, to be dropped
+    // when the task is done.
+    auto& current = *current_task_locals_ptr();
+    current.locals = _previous;
+    release_task_locals(std::exchange(current.pinned, _previous));
+    release_task_locals(_mine);
+}
+
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/reactor.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/task_profile.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/httpd.hh>
+#endif
+
+namespace seastar {
+
+namespace task_profile {
+
+using namespace std::chrono_literals;
+
+struct group_types {
+    sstring group;
+    std::vector<reactor::task_type_runtime> types;
+};
+
+future<sstring> collect(size_t n) {
+    std::vector<std::vector<group_types>> shards(smp::count);
+    return do_with(std::move(shards), [n] (std::vector<std::vector<group_types>>& shards) {
+        return smp::invoke_on_all([&shards, n] {
+            auto& groups = shards[this_shard_id()];
+            for (unsigned i = 0; i < max_scheduling_groups(); ++i) {
+                auto sg = internal::scheduling_group_from_index(i);
+                auto types = engine().top_task_types(sg, n);
+                if (!types.empty()) {
+                    groups.push_back(group_types{sg.name(), std::move(types)});
+                }
+            }
+        }).then([&shards, n] {
+            // The runtime of each type of each group, put together from
+            // the top types of each shard
+            std::map<sstring, std::map<sstring, sched_clock::duration>> runtimes;
+            for (auto& groups : shards) {
+                for (auto& g : groups) {
+                    auto& types = runtimes[g.group];
+                    for (auto& t : g.types) {
+                        types[t.name] += t.runtime;
+                    }
+                }
+            }
+            std::string out;
+            std::vector<std::pair<sched_clock::duration, const sstring*>> top;
+            for (auto& [group, types] : runtimes) {
+                top.clear();
+                for (auto& [name, runtime] : types) {
+                    top.emplace_back(runtime, &name);
+                }
+                std::sort(top.begin(), top.end(), [] (auto& a, auto& b) { return a.first > b.first; });
+                top.resize(std::min(top.size(), n));
+                for (auto& [runtime, name] : top) {
+                    out += fmt::format("sg:{};task:{} {}\n", group, *name, runtime / 1us);
+                }
+            }
+            return sstring(out);
+        });
+    });
+}
+
+future<> add_routes(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new httpd::function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+        size_t n = 10;
+        if (auto param = req->get_query_param("n"); !param.empty()) {
+            try {
+                n = boost::lexical_cast<size_t>(param);
+            } catch (const boost::bad_lexical_cast&) {
+                throw httpd::bad_param_exception("The n parameter is not a number of task types");
+            }
+        }
+        return collect(n).then([rep = std::move(rep)] (sstring profile) mutable {
+            rep->_content = std::move(profile);
+            return std::move(rep);
+        });
+    }, "txt"));
+    return make_ready_future<>();
+}
+
+}
+
+}
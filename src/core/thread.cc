@@ -26,16 +26,19 @@ module;
 #include <ucontext.h>
 #include <setjmp.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <valgrind/valgrind.h>
 #include <algorithm>
 #include <exception>
 #include <utility>
+#include <vector>
 #include <boost/intrusive/list.hpp>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
 #include <seastar/core/thread.hh>
+#include <seastar/core/align.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor.hh>
 #endif
@@ -171,6 +174,93 @@ static constexpr size_t base_stack_size = 256 * 1024;
 static constexpr size_t base_stack_size = 128 * 1024;
 #endif
 
+namespace {
+
+// Stacks of exited threads, handed to the next threads of the same stack
+// size so that spawning a thread neither allocates a stack nor (unless the
+// pages were given back) faults it in. Threads use a handful of distinct
+// stack sizes, so pooled stacks are kept in a list per size.
+class stack_pool {
+    struct size_class {
+        size_t stack_size;
+        std::vector<char*> stacks;
+    };
+    std::vector<size_class> _classes;
+    unsigned _stacks_per_size = 16;
+    bool _madvise_free = false;
+
+    size_class* find(size_t stack_size) noexcept {
+        auto it = std::find_if(_classes.begin(), _classes.end(), [stack_size] (const size_class& c) {
+            return c.stack_size == stack_size;
+        });
+        return it == _classes.end() ? nullptr : &*it;
+    }
+public:
+    ~stack_pool() {
+        drain();
+    }
+
+    void configure(unsigned stacks_per_size, bool madvise_free) noexcept {
+        _stacks_per_size = stacks_per_size;
+        _madvise_free = madvise_free;
+        drain();
+    }
+
+    char* get(size_t stack_size) noexcept {
+        auto* c = find(stack_size);
+        if (!c || c->stacks.empty()) {
+            return nullptr;
+        }
+        auto* stack = c->stacks.back();
+        c->stacks.pop_back();
+        return stack;
+    }
+
+    // Returns false if the stack was not pooled, and must be freed
+    bool put(char* stack, size_t stack_size) noexcept {
+        try {
+            auto* c = find(stack_size);
+            if (!c) {
+                if (!_stacks_per_size) {
+                    return false;
+                }
+                c = &_classes.emplace_back(size_class{stack_size, {}});
+                c->stacks.reserve(_stacks_per_size);
+            }
+            if (c->stacks.size() >= _stacks_per_size) {
+                return false;
+            }
+            if (_madvise_free) {
+                // Only whole pages can be handed back; pooling a stack does
+                // not depend on the kernel taking them.
+                auto page_size = uintptr_t(getpagesize());
+                auto begin = align_up(reinterpret_cast<uintptr_t>(stack), page_size);
+                auto end = align_down(reinterpret_cast<uintptr_t>(stack) + stack_size, page_size);
+                if (end > begin) {
+                    ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_FREE);
+                }
+            }
+            c->stacks.push_back(stack);
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+
+    void drain() noexcept {
+        for (auto& c : _classes) {
+            for (auto* stack : c.stacks) {
+                free(stack);
+            }
+        }
+        _classes.clear();
+    }
+};
+
+thread_local stack_pool this_shard_stack_pool;
+
+}
+
 static size_t get_stack_size(thread_attributes attr) {
 #if defined(__OPTIMIZE__) && defined(SEASTAR_ASAN_ENABLED)
     return std::max(base_stack_size, attr.stack_size);
@@ -195,7 +285,7 @@ thread_context::~thread_context() {
     _all_threads.erase(_all_threads.iterator_to(*this));
 }
 
-thread_context::stack_deleter::stack_deleter(int valgrind_id) : valgrind_id(valgrind_id) {}
+thread_context::stack_deleter::stack_deleter(int valgrind_id, size_t size) : valgrind_id(valgrind_id), size(size) {}
 
 thread_context::stack_holder
 thread_context::make_stack(size_t stack_size) {
@@ -205,12 +295,15 @@ thread_context::make_stack(size_t stack_size) {
 #else
     size_t alignment = 16; // ABI requirement on x86_64
 #endif
-    void* mem = ::aligned_alloc(alignment, stack_size);
+    void* mem = this_shard_stack_pool.get(stack_size);
+    if (mem == nullptr) {
+        mem = ::aligned_alloc(alignment, stack_size);
+    }
     if (mem == nullptr) {
         throw std::bad_alloc();
     }
     int valgrind_id = VALGRIND_STACK_REGISTER(mem, reinterpret_cast<char*>(mem) + stack_size);
-    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id));
+    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id, stack_size));
 #ifdef SEASTAR_ASAN_ENABLED
     // Avoid ASAN false positive due to garbage on stack
     std::memset(stack.get(), 0, stack_size);
@@ -226,7 +319,9 @@ thread_context::make_stack(size_t stack_size) {
 
 void thread_context::stack_deleter::operator()(char* ptr) const noexcept {
     VALGRIND_STACK_DEREGISTER(valgrind_id);
-    free(ptr);
+    if (!this_shard_stack_pool.put(ptr, size)) {
+        free(ptr);
+    }
 }
 
 void
@@ -272,6 +367,7 @@ thread_context::run_and_dispose() noexcept {
 
 void
 thread_context::yield() {
+    capture_locals();
     schedule(this);
     switch_out();
 }
@@ -337,6 +433,14 @@ void init() {
     g_current_context = &g_unthreaded_context;
 }
 
+void configure_stack_pool(unsigned stacks_per_size, bool madvise_free) noexcept {
+    this_shard_stack_pool.configure(stacks_per_size, madvise_free);
+}
+
+void drain_stack_pool() noexcept {
+    this_shard_stack_pool.drain();
+}
+
 scheduling_group
 sched_group(const thread_context* thread) {
     return thread->group();
@@ -38,10 +38,18 @@ namespace seastar {
 
 /* not yet implemented for OSv. TODO: do the notification like we do class smp. */
 #ifndef HAVE_OSV
-thread_pool::thread_pool(reactor& r, sstring name) : _reactor(r), _worker_thread([this, name] { work(name); }) {
+thread_pool::worker::worker(thread_pool& pool, sstring name)
+    : thread([&pool, this, name] { pool.work(*this, name); }) {
 }
 
-void thread_pool::work(sstring name) {
+thread_pool::thread_pool(reactor& r, sstring name, unsigned nr_threads) : _reactor(r) {
+    _workers.reserve(nr_threads);
+    for (unsigned i = 0; i < nr_threads; ++i) {
+        _workers.push_back(std::make_unique<worker>(*this, nr_threads == 1 ? name : seastar::format("{}-{}", name, i)));
+    }
+}
+
+void thread_pool::work(worker& w, sstring name) {
     pthread_setname_np(pthread_self(), name.c_str());
     sigset_t mask;
     sigfillset(&mask);
@@ -50,19 +58,19 @@ void thread_pool::work(sstring name) {
     std::array<syscall_work_queue::work_item*, syscall_work_queue::queue_length> tmp_buf;
     while (true) {
         uint64_t count;
-        auto r = ::read(inter_thread_wq._start_eventfd.get_read_fd(), &count, sizeof(count));
+        auto r = ::read(w.inter_thread_wq._start_eventfd.get_read_fd(), &count, sizeof(count));
         assert(r == sizeof(count));
         if (_stopped.load(std::memory_order_relaxed)) {
             break;
         }
         auto end = tmp_buf.data();
-        inter_thread_wq._pending.consume_all([&] (syscall_work_queue::work_item* wi) {
+        w.inter_thread_wq._pending.consume_all([&] (syscall_work_queue::work_item* wi) {
             *end++ = wi;
         });
         for (auto p = tmp_buf.data(); p != end; ++p) {
             auto wi = *p;
             wi->process();
-            inter_thread_wq._completed.push(wi);
+            w.inter_thread_wq._completed.push(wi);
 
             // Prevent the following load of _main_thread_idle to be hoisted before the writes to _completed above.
             std::atomic_thread_fence(std::memory_order_seq_cst);
@@ -76,8 +84,12 @@ void thread_pool::work(sstring name) {
 
 thread_pool::~thread_pool() {
     _stopped.store(true, std::memory_order_relaxed);
-    inter_thread_wq._start_eventfd.signal(1);
-    _worker_thread.join();
+    for (auto& w : _workers) {
+        w->inter_thread_wq._start_eventfd.signal(1);
+    }
+    for (auto& w : _workers) {
+        w->thread.join();
+    }
 }
 #endif
 
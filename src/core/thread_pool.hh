@@ -22,6 +22,8 @@
 #pragma once
 
 #include "syscall_work_queue.hh"
+#include <memory>
+#include <vector>
 
 namespace seastar {
 
@@ -31,21 +33,38 @@ class thread_pool {
     reactor& _reactor;
     uint64_t _aio_threaded_fallbacks = 0;
 #ifndef HAVE_OSV
-    syscall_work_queue inter_thread_wq;
-    posix_thread _worker_thread;
+    // A syscall thread, with the queue of the work submitted to it
+    struct worker {
+        syscall_work_queue inter_thread_wq;
+        posix_thread thread;
+        worker(thread_pool& pool, sstring thread_name);
+    };
+    std::vector<std::unique_ptr<worker>> _workers;
+    unsigned _next_worker = 0;
     std::atomic<bool> _stopped = { false };
     std::atomic<bool> _main_thread_idle = { false };
 public:
-    explicit thread_pool(reactor& r, sstring thread_name);
+    thread_pool(reactor& r, sstring thread_name, unsigned nr_threads = 1);
     ~thread_pool();
+    // The work is spread over the threads round robin
     template <typename T, typename Func>
     future<T> submit(Func func) noexcept {
         ++_aio_threaded_fallbacks;
-        return inter_thread_wq.submit<T>(std::move(func));
+        auto& w = *_workers[_next_worker];
+        if (++_next_worker == _workers.size()) {
+            _next_worker = 0;
+        }
+        return w.inter_thread_wq.submit<T>(std::move(func));
     }
     uint64_t operation_count() const { return _aio_threaded_fallbacks; }
 
-    unsigned complete() { return inter_thread_wq.complete(); }
+    unsigned complete() {
+        unsigned n = 0;
+        for (auto& w : _workers) {
+            n += w->inter_thread_wq.complete();
+        }
+        return n;
+    }
     // Before we enter interrupt mode, we must make sure that the syscall thread will properly
     // generate signals to wake us up. This means we need to make sure that all modifications to
     // the pending and completed fields in the inter_thread_wq are visible to all threads.
@@ -64,7 +83,7 @@ class thread_pool {
     future<T> submit(Func func) { std::cerr << "thread_pool not yet implemented on osv\n"; abort(); }
 #endif
 private:
-    void work(sstring thread_name);
+    void work(worker& w, sstring thread_name);
 };
 
 
@@ -0,0 +1,330 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <random>
+#include <string_view>
+#include <vector>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/tracing.hh>
+#endif
+
+namespace seastar {
+
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+uint32_t*
+internal::current_span_ptr() noexcept {
+    static thread_local uint32_t span;
+    return &span;
+}
+#endif
+
+namespace tracing {
+
+// A handle is the index of the slot of the span, plus one, in its low bits,
+// and the generation of the slot in its high ones, for the handles which
+// outlived the span, captured by its background tasks, not to be taken for
+// those of the next span of the slot. The largest index is the handle of
+// the spans of the traces which are not sampled.
+static constexpr unsigned index_bits = 20;
+static constexpr uint32_t index_mask = (uint32_t(1) << index_bits) - 1;
+static constexpr uint32_t unsampled = index_mask;
+static constexpr uint32_t no_slot = ~uint32_t(0);
+
+namespace {
+
+struct slot {
+    trace_id trace;
+    uint64_t span_id = 0;
+    uint64_t parent_id = 0;
+    sstring name;
+    std::chrono::system_clock::time_point start;
+    std::chrono::steady_clock::time_point steady_start;
+    uint32_t generation = 0;
+    uint32_t next_free = no_slot;
+    bool live = false;
+};
+
+struct shard_state {
+    std::vector<slot> slots;
+    uint32_t free = no_slot;
+    double rate = 0;
+    // A new trace is sampled if a random number is below the threshold
+    uint64_t threshold = 0;
+    bool always = false;
+    uint64_t rng;
+    size_t capacity = 4096;
+    std::vector<span_record> records;
+    tracing::stats stats;
+
+    shard_state() {
+        std::random_device rd;
+        rng = (uint64_t(rd()) << 32) | rd();
+    }
+
+    // splitmix64
+    uint64_t random() noexcept {
+        uint64_t z = (rng += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+    uint64_t random_id() noexcept {
+        uint64_t id;
+        while (!(id = random())) {
+        }
+        return id;
+    }
+    bool sample() noexcept {
+        return always || (threshold && random() < threshold);
+    }
+
+    // The live span of a handle, nullptr if the handle is none, of a
+    // trace which is not sampled or of a span which ended
+    slot* find(uint32_t handle) noexcept {
+        auto index = handle & index_mask;
+        if (!index || index == unsampled) {
+            return nullptr;
+        }
+        auto& s = slots[index - 1];
+        return s.live && s.generation == (handle >> index_bits) ? &s : nullptr;
+    }
+
+    // Returns nullptr if too many spans are alive
+    slot* allocate(uint32_t& handle) {
+        uint32_t index;
+        if (free != no_slot) {
+            index = free;
+            free = slots[index].next_free;
+        } else if (slots.size() < unsampled - 1) {
+            index = slots.size();
+            slots.emplace_back();
+        } else {
+            return nullptr;
+        }
+        auto& s = slots[index];
+        s.live = true;
+        handle = (s.generation << index_bits) | (index + 1);
+        return &s;
+    }
+
+    void release(slot& s) noexcept {
+        s.live = false;
+        s.generation = (s.generation + 1) & (~uint32_t(0) >> index_bits);
+        s.next_free = std::exchange(free, &s - slots.data());
+    }
+};
+
+}
+
+static shard_state& local() noexcept {
+    static thread_local shard_state state;
+    return state;
+}
+
+void span_context::serialize(char* p) const noexcept {
+    write_le<uint64_t>(p, trace.high);
+    write_le<uint64_t>(p + 8, trace.low);
+    write_le<uint64_t>(p + 16, span_id);
+    p[24] = sampled ? 1 : 0;
+}
+
+span_context span_context::deserialize(const char* p) noexcept {
+    return span_context{
+        .trace{read_le<uint64_t>(p), read_le<uint64_t>(p + 8)},
+        .span_id = read_le<uint64_t>(p + 16),
+        .sampled = bool(p[24] & 1),
+    };
+}
+
+sstring span_context::to_traceparent() const {
+    return fmt::format("00-{:016x}{:016x}-{:016x}-{:02x}", trace.high, trace.low, span_id, sampled ? 1 : 0);
+}
+
+template <typename T>
+static bool parse_hex(std::string_view s, T& value) noexcept {
+    auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), value, 16);
+    return ec == std::errc() && p == s.data() + s.size();
+}
+
+std::optional<span_context> span_context::from_traceparent(std::string_view value) noexcept {
+    // version-trace_id-parent_id-flags, the versions after 00 possibly
+    // adding fields after those
+    constexpr size_t size = 2 + 1 + 32 + 1 + 16 + 1 + 2;
+    if (value.size() < size || value[2] != '-' || value[35] != '-' || value[52] != '-') {
+        return std::nullopt;
+    }
+    uint8_t version, flags;
+    span_context ctx;
+    if (!parse_hex(value.substr(0, 2), version) || version == 0xff
+            || (version == 0 && value.size() != size)
+            || (value.size() > size && value[size] != '-')
+            || !parse_hex(value.substr(3, 16), ctx.trace.high)
+            || !parse_hex(value.substr(19, 16), ctx.trace.low)
+            || !parse_hex(value.substr(36, 16), ctx.span_id)
+            || !parse_hex(value.substr(53, 2), flags)) {
+        return std::nullopt;
+    }
+    ctx.sampled = flags & 1;
+    if (!ctx.valid()) {
+        return std::nullopt;
+    }
+    return ctx;
+}
+
+span::span(std::string_view name) noexcept {
+    auto h = *internal::current_span_ptr();
+    if (!h) {
+        start(name, {});
+        return;
+    }
+    auto parent = local().find(h);
+    if (!parent) {
+        // Of a trace which is not sampled, or of a span which ended, the
+        // background work of which is not worth a trace of its own
+        _handle = unsampled;
+        return;
+    }
+    start(name, span_context{parent->trace, parent->span_id, true});
+}
+
+span::span(std::string_view name, const span_context& parent) noexcept {
+    start(name, parent);
+}
+
+void span::start(std::string_view name, const span_context& parent) noexcept {
+    auto& state = local();
+    _handle = unsampled;
+    if (parent.valid() ? !parent.sampled : !state.sample()) {
+        return;
+    }
+    try {
+        uint32_t handle;
+        auto s = state.allocate(handle);
+        if (!s) {
+            state.stats.dropped++;
+            return;
+        }
+        if (parent.valid()) {
+            s->trace = parent.trace;
+            s->parent_id = parent.span_id;
+        } else {
+            s->trace = trace_id{state.random(), state.random_id()};
+            s->parent_id = 0;
+        }
+        s->span_id = state.random_id();
+        s->name = sstring(name);
+        s->start = std::chrono::system_clock::now();
+        s->steady_start = std::chrono::steady_clock::now();
+        _handle = handle;
+        state.stats.started++;
+    } catch (...) {
+        state.stats.dropped++;
+    }
+}
+
+bool span::sampled() const noexcept {
+    return local().find(_handle);
+}
+
+span_context span::context() const noexcept {
+    auto s = local().find(_handle);
+    return s ? span_context{s->trace, s->span_id, true} : span_context{};
+}
+
+void span::set_name(std::string_view name) {
+    if (auto s = local().find(_handle)) {
+        s->name = sstring(name);
+    }
+}
+
+void span::end() noexcept {
+    auto h = std::exchange(_handle, 0);
+    auto& state = local();
+    auto s = state.find(h);
+    if (!s) {
+        return;
+    }
+    if (state.records.size() < state.capacity) {
+        try {
+            state.records.push_back(span_record{
+                .trace = s->trace,
+                .span_id = s->span_id,
+                .parent_id = s->parent_id,
+                .name = std::move(s->name),
+                .start = s->start,
+                .duration = std::chrono::steady_clock::now() - s->steady_start,
+                .shard = this_shard_id(),
+            });
+            state.stats.recorded++;
+        } catch (...) {
+            state.stats.dropped++;
+        }
+    } else {
+        state.stats.dropped++;
+    }
+    state.release(*s);
+}
+
+span_context current_context() noexcept {
+    auto s = local().find(*internal::current_span_ptr());
+    return s ? span_context{s->trace, s->span_id, true} : span_context{};
+}
+
+void set_sample_rate(double rate) noexcept {
+    auto& state = local();
+    state.rate = std::clamp(rate, 0.0, 1.0);
+    state.always = state.rate >= 1;
+    // 2^64, the range of the random numbers
+    state.threshold = state.always ? 0 : uint64_t(state.rate * 18446744073709551616.0);
+}
+
+double sample_rate() noexcept {
+    return local().rate;
+}
+
+void set_buffer_capacity(size_t capacity) {
+    local().capacity = capacity;
+}
+
+std::vector<span_record> take_spans() noexcept {
+    return std::exchange(local().records, {});
+}
+
+const stats& get_stats() noexcept {
+    return local().stats;
+}
+
+}
+
+}
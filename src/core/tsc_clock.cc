@@ -0,0 +1,190 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include <seastar/core/internal/tsc_clock.hh>
+#include <seastar/util/log.hh>
+
+namespace seastar {
+
+extern logger seastar_logger;
+
+namespace internal {
+
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+thread_local tsc_clock_state tsc_clock::_state;
+#endif
+
+using namespace std::chrono_literals;
+
+// How often the clock is recalibrated against steady_clock.
+static constexpr std::chrono::nanoseconds recalibration_period = 100ms;
+// The rate of the counter may not change between calibrations by more than
+// this, or it isn't considered invariant.
+static constexpr double max_rate_change = 0.01;
+// Errors larger than this are not slewed away, but stepped over (if the
+// clock is behind) or make us give up on the counter (if it is ahead,
+// since stepping back would break monotonicity; the clock then holds
+// until steady_clock catches up with it, see disable()).
+static constexpr std::chrono::nanoseconds max_slew = 1ms;
+
+static int64_t steady_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Reads the counter and steady_clock at (nearly) the same time, retrying
+// to avoid pairs split by an interrupt or a preempted vCPU.
+static void read_both(uint64_t& ticks, int64_t& ns) noexcept {
+    uint64_t best_window = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < 5; ++i) {
+        auto before = tsc_clock::ticks();
+        auto n = steady_ns();
+        auto after = tsc_clock::ticks();
+        if (after - before < best_window) {
+            best_window = after - before;
+            ticks = before + (after - before) / 2;
+            ns = n;
+        }
+    }
+}
+
+static uint64_t to_mult(double ns_per_tick) noexcept {
+    return uint64_t(std::ldexp(ns_per_tick, 32));
+}
+
+bool tsc_clock::supported() noexcept {
+#if defined(__x86_64__)
+    unsigned eax, ebx, ecx, edx;
+    // CPUID.80000007H:EDX[8] is the invariant TSC flag: the counter runs at
+    // a constant rate in all ACPI P-, C- and T-states.
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return edx & (1u << 8);
+#elif defined(__aarch64__)
+    // The generic timer's virtual counter always runs at a fixed frequency.
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool tsc_clock::enable() noexcept {
+    auto& s = _state;
+    s.enabled = false;
+    if (!supported()) {
+        return false;
+    }
+    uint64_t t0, t1;
+    int64_t n0, n1;
+    read_both(t0, n0);
+    do {
+        read_both(t1, n1);
+    } while (n1 - n0 < std::chrono::nanoseconds(1ms).count());
+    if (t1 <= t0) {
+        seastar_logger.warn("The CPU's timestamp counter isn't advancing, keeping the reactor on steady_clock");
+        return false;
+    }
+    s.ns_per_tick = double(n1 - n0) / double(t1 - t0);
+    s.rate_measured = false;
+    s.mult = to_mult(s.ns_per_tick);
+    s.base_ticks = s.calibrated_ticks = t1;
+    // Don't start behind what the clock showed before it was disabled;
+    // recalibration slews the difference away.
+    s.base_ns = std::max(n1, s.floor_ns);
+    s.calibrated_ns = n1;
+    s.system_offset = std::chrono::system_clock::now().time_since_epoch()
+            - std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(n1));
+    s.enabled = true;
+    return true;
+}
+
+void tsc_clock::recalibrate() noexcept {
+    auto& s = _state;
+    uint64_t t;
+    int64_t steady;
+    read_both(t, steady);
+    auto ours = std::chrono::duration_cast<std::chrono::nanoseconds>(now().time_since_epoch()).count();
+    auto dt = int64_t(t - s.calibrated_ticks);
+    auto dn = steady - s.calibrated_ns;
+    if (dt <= 0 || dn <= 0) {
+        seastar_logger.warn("The CPU's timestamp counter went backwards, switching the reactor to steady_clock");
+        disable();
+        return;
+    }
+    auto measured = double(dn) / double(dt);
+    // The rate from the initial, short, calibration is only an estimate.
+    // Over a long interval (the reactor slept) any change is smoothed out,
+    // so only compare rates measured over about one period.
+    if (s.rate_measured && dn < 2 * recalibration_period.count() && std::abs(measured - s.ns_per_tick) > max_rate_change * s.ns_per_tick) {
+        seastar_logger.warn("The CPU's timestamp counter rate changed by {:.1f}%, switching the reactor to steady_clock",
+                100 * (measured - s.ns_per_tick) / s.ns_per_tick);
+        disable();
+        return;
+    }
+    auto error = steady - ours;
+    if (error < -max_slew.count()) {
+        seastar_logger.warn("The CPU's timestamp counter ran {} ns ahead of steady_clock, switching the reactor to it", -error);
+        disable();
+        return;
+    }
+    s.ns_per_tick = measured;
+    s.rate_measured = true;
+    s.base_ticks = t;
+    if (error > max_slew.count()) {
+        s.base_ns = steady;
+        s.mult = to_mult(measured);
+    } else {
+        // Continue from where we are, at a rate that catches up with
+        // steady_clock by the next calibration.
+        s.base_ns = ours;
+        auto period = double(recalibration_period.count());
+        s.mult = to_mult(measured * (period + double(error)) / period);
+    }
+    s.calibrated_ticks = t;
+    s.calibrated_ns = steady;
+    s.system_offset = std::chrono::system_clock::now().time_since_epoch()
+            - std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(steady));
+}
+
+tsc_clock::time_point tsc_clock::refresh() noexcept {
+    auto n = now();
+    if (_state.enabled && n.time_since_epoch() - std::chrono::nanoseconds(_state.calibrated_ns) >= recalibration_period) {
+        recalibrate();
+        n = now();
+    }
+    if (_state.enabled) {
+        _state.floor_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(n.time_since_epoch()).count();
+    }
+    return n;
+}
+
+}
+
+}
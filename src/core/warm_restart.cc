@@ -0,0 +1,269 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/warm_restart.hh>
+#include <seastar/util/log.hh>
+#include "core/syscall_result.hh"
+#include "core/thread_pool.hh"
+#endif
+
+namespace seastar {
+
+extern logger seastar_logger;
+
+namespace internal {
+
+class warm_restart_saver {
+public:
+    // Runs func on the syscall thread
+    template <typename T, typename Func>
+    static future<T> off_reactor(Func func) noexcept {
+        return engine()._thread_pool->submit<T>(std::move(func));
+    }
+};
+
+}
+
+namespace experimental::warm_restart {
+
+namespace {
+
+struct region {
+    std::string name;
+    unsigned shard;
+    file_desc fd;
+};
+
+// The regions are process-wide: the shards save and restore them
+// concurrently, and the environment is built from all of them.
+struct registry {
+    std::mutex mutex;
+    // Saved by this process, for the next one
+    std::vector<region> saved;
+    // Handed over by the previous one
+    std::vector<region> inherited;
+    bool took_over = false;
+};
+
+registry& regions() {
+    static registry r;
+    return r;
+}
+
+// Parses "fd:shard:name,..." into r.inherited. Called with r.mutex held.
+void take_over_locked(registry& r, std::string_view spec) {
+    r.took_over = true;
+    while (!spec.empty()) {
+        auto end = std::min(spec.find(','), spec.size());
+        auto entry = spec.substr(0, end);
+        spec.remove_prefix(std::min(end + 1, spec.size()));
+        int fd = -1;
+        unsigned shard = 0;
+        auto p = entry.data();
+        auto e = entry.data() + entry.size();
+        auto [p1, ec1] = std::from_chars(p, e, fd);
+        if (ec1 != std::errc() || p1 == e || *p1 != ':') {
+            seastar_logger.warn("Ignoring malformed warm restart region {}", entry);
+            continue;
+        }
+        auto [p2, ec2] = std::from_chars(p1 + 1, e, shard);
+        if (ec2 != std::errc() || p2 == e || *p2 != ':') {
+            seastar_logger.warn("Ignoring malformed warm restart region {}", entry);
+            continue;
+        }
+        // Only the sealed memfds save() makes, never whatever else the fd
+        // is in a process that inherited the variable without the regions
+        auto seals = ::fcntl(fd, F_GET_SEALS);
+        constexpr int required_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+        if (seals == -1 || (seals & required_seals) != required_seals) {
+            seastar_logger.warn("Ignoring warm restart region {}: not a sealed memfd", entry);
+            continue;
+        }
+        // Don't let the regions leak into the processes we spawn
+        if (::fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+            seastar_logger.warn("Ignoring warm restart region {}: {}", entry, std::error_code(errno, std::system_category()).message());
+            continue;
+        }
+        r.inherited.push_back(region{std::string(p2 + 1, e), shard, file_desc::from_fd(fd)});
+    }
+}
+
+void ensure_taken_over(registry& r) {
+    if (!r.took_over) {
+        auto value = std::getenv(environment_variable);
+        std::string spec = value ? value : "";
+        // The regions are ours now, not those of the processes we spawn,
+        // which would otherwise take their own fds of those numbers
+        ::unsetenv(environment_variable);
+        take_over_locked(r, spec);
+    }
+}
+
+// Copies data into a new memfd, and seals it so that the mappings of the
+// next process can't be pulled from under it. Runs on the syscall thread.
+syscall_result<int> write_region(const std::string& label, const std::vector<temporary_buffer<char>>& data) noexcept {
+    int fd = ::memfd_create(label.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        return wrap_syscall(fd);
+    }
+    auto fail = [fd] {
+        int error = errno;
+        ::close(fd);
+        return syscall_result<int>(-1, error);
+    };
+    size_t size = 0;
+    for (auto& b : data) {
+        size += b.size();
+    }
+    if (::ftruncate(fd, size) == -1) {
+        return fail();
+    }
+    off_t pos = 0;
+    for (auto& b : data) {
+        size_t done = 0;
+        while (done < b.size()) {
+            auto r = ::pwrite(fd, b.get() + done, b.size() - done, pos);
+            if (r == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return fail();
+            }
+            done += r;
+            pos += r;
+        }
+    }
+    if (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+        return fail();
+    }
+    return syscall_result<int>(fd, 0);
+}
+
+}
+
+future<> save(std::string_view name, std::vector<temporary_buffer<char>> data) {
+    if (name.empty() || name.find_first_of(",:") != std::string_view::npos) {
+        return make_exception_future<>(std::invalid_argument(fmt::format("invalid warm restart region name: {}", name)));
+    }
+    return do_with(std::move(data), [name = std::string(name)] (auto& data) mutable {
+        return seastar::internal::warm_restart_saver::off_reactor<syscall_result<int>>([&data, label = fmt::format("seastar-warm:{}", name)] {
+            return write_region(label, data);
+        }).then([name = std::move(name)] (syscall_result<int> ret) mutable {
+            ret.throw_if_error();
+            auto fd = file_desc::from_fd(ret.result);
+            auto shard = this_shard_id();
+            auto& r = regions();
+            std::lock_guard g(r.mutex);
+            std::erase_if(r.saved, [&] (const region& x) { return x.shard == shard && x.name == name; });
+            r.saved.push_back(region{std::move(name), shard, std::move(fd)});
+        });
+    });
+}
+
+std::string environment() {
+    auto& r = regions();
+    std::lock_guard g(r.mutex);
+    std::string value;
+    for (auto& x : r.saved) {
+        throw_system_error_on(::fcntl(x.fd.get(), F_SETFD, 0) == -1, "fcntl");
+        fmt::format_to(std::back_inserter(value), "{}{}:{}:{}", value.empty() ? "" : ",", x.fd.get(), x.shard, x.name);
+    }
+    return fmt::format("{}={}", environment_variable, value);
+}
+
+future<std::optional<file_mapping>> restore(std::string_view name, unsigned shard) noexcept {
+    try {
+        std::optional<file_desc> fd;
+        {
+            auto& r = regions();
+            std::lock_guard g(r.mutex);
+            ensure_taken_over(r);
+            auto it = std::find_if(r.inherited.begin(), r.inherited.end(), [&] (const region& x) {
+                return x.shard == shard && x.name == name;
+            });
+            if (it == r.inherited.end()) {
+                return make_ready_future<std::optional<file_mapping>>();
+            }
+            fd.emplace(std::move(it->fd));
+            r.inherited.erase(it);
+        }
+        auto size = fd->size();
+        if (size == 0) {
+            return make_ready_future<std::optional<file_mapping>>(file_mapping());
+        }
+        // The region is sealed, as checked when taken over, so a private
+        // mapping shares its pages and can't fault
+        auto map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd->get(), 0);
+        throw_system_error_on(map == MAP_FAILED, "mmap");
+        auto data = static_cast<const char*>(map);
+        return make_ready_future<std::optional<file_mapping>>(file_mapping(map, size, data, size));
+    } catch (...) {
+        return current_exception_as_future<std::optional<file_mapping>>();
+    }
+}
+
+void discard() noexcept {
+    auto& r = regions();
+    std::lock_guard g(r.mutex);
+    if (!std::exchange(r.took_over, true)) {
+        ::unsetenv(environment_variable);
+    }
+    r.inherited.clear();
+}
+
+namespace internal {
+
+void take_over(std::string_view spec) {
+    auto& r = regions();
+    std::lock_guard g(r.mutex);
+    take_over_locked(r, spec);
+}
+
+}
+
+}
+
+}
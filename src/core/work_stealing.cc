@@ -0,0 +1,213 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#include <atomic>
+#include <memory>
+
+#include <boost/lockfree/queue.hpp>
+
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/make_task.hh>
+#include <seastar/core/on_internal_error.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/work_stealing.hh>
+
+#include "core/work_stealing.hh"
+
+namespace seastar::internal {
+
+// The stealable work queues of all shards. Each shard pushes to its own
+// queue only; any shard pops from any queue.
+class work_stealing_queues {
+    // Items submitted beyond this run on the submitting shard without
+    // being offered to others.
+    static constexpr unsigned queue_capacity = 1024;
+    // A queue with fewer items than this has no backlog: its owner is about
+    // to run them, and thieves leave them alone.
+    static constexpr unsigned steal_threshold = 2;
+
+    struct alignas(cache_line_size) queue {
+        boost::lockfree::queue<stealable_work_item*, boost::lockfree::fixed_sized<true>> items{queue_capacity};
+        // Approximate number of items in the queue, so that thieves can skip
+        // shards without a backlog without touching the queue itself.
+        std::atomic<unsigned> queued{0};
+        reactor* r = nullptr;
+
+        stealable_work_item* pop() noexcept {
+            stealable_work_item* item;
+            if (!items.pop(item)) {
+                return nullptr;
+            }
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return item;
+        }
+        bool has_backlog() const noexcept {
+            return queued.load(std::memory_order_relaxed) >= steal_threshold;
+        }
+    };
+    std::unique_ptr<queue[]> _queues;
+    unsigned _nr_queues;
+
+    static thread_local work_stealing_stats _stats;
+    static thread_local unsigned _next_victim;
+    static std::unique_ptr<work_stealing_queues> _instance;
+private:
+    void wake_one_sleeper() noexcept;
+public:
+    explicit work_stealing_queues(const std::vector<reactor*>& reactors);
+
+    void submit(stealable_work_item* item) noexcept;
+    bool try_steal() noexcept;
+    bool have_backlog() const noexcept;
+
+    static work_stealing_queues* get() noexcept { return _instance.get(); }
+    static void set(std::unique_ptr<work_stealing_queues> instance) noexcept { _instance = std::move(instance); }
+    static work_stealing_stats& stats() noexcept { return _stats; }
+};
+
+thread_local work_stealing_stats work_stealing_queues::_stats;
+thread_local unsigned work_stealing_queues::_next_victim = 0;
+std::unique_ptr<work_stealing_queues> work_stealing_queues::_instance;
+
+work_stealing_queues::work_stealing_queues(const std::vector<reactor*>& reactors)
+    : _queues(std::make_unique<queue[]>(reactors.size()))
+    , _nr_queues(reactors.size())
+{
+    for (unsigned i = 0; i < _nr_queues; ++i) {
+        _queues[i].r = reactors[i];
+    }
+}
+
+void work_stealing_queues::submit(stealable_work_item* item) noexcept {
+    auto& q = _queues[this_shard_id()];
+    if (!q.items.bounded_push(item)) {
+        schedule(item);
+        return;
+    }
+    if (q.queued.fetch_add(1, std::memory_order_relaxed) + 1 == steal_threshold) {
+        wake_one_sleeper();
+    }
+    // One runner per queued item. Since thieves take items too, a runner
+    // may find the queue empty, or pick an item queued by another group,
+    // in which case the item is rescheduled in its own group.
+    schedule(make_task(item->group(), [&q] {
+        if (auto item = q.pop()) {
+            if (item->group() == current_scheduling_group()) {
+                item->run_and_dispose();
+            } else {
+                schedule(item);
+            }
+        }
+    }));
+}
+
+// Idle shards that are still polling notice the backlog by themselves; one
+// that went to sleep has to be woken up. The same protocol as for the smp
+// queues applies: sleepers check for a backlog after setting _sleeping.
+void work_stealing_queues::wake_one_sleeper() noexcept {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    auto self = this_shard_id();
+    for (unsigned i = 1; i < _nr_queues; ++i) {
+        auto r = _queues[(self + i) % _nr_queues].r;
+        if (r->_sleeping.load(std::memory_order_relaxed)) {
+            r->_sleeping.store(false, std::memory_order_relaxed);
+            r->wakeup();
+            return;
+        }
+    }
+}
+
+bool work_stealing_queues::try_steal() noexcept {
+    auto self = this_shard_id();
+    for (unsigned i = 0; i < _nr_queues; ++i) {
+        auto victim = _next_victim++ % _nr_queues;
+        if (victim == self || !_queues[victim].has_backlog()) {
+            continue;
+        }
+        if (auto item = _queues[victim].pop()) {
+            _stats.stolen++;
+            schedule(item);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool work_stealing_queues::have_backlog() const noexcept {
+    auto self = this_shard_id();
+    for (unsigned i = 0; i < _nr_queues; ++i) {
+        if (i != self && _queues[i].has_backlog()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void stealable_work_item::run_and_dispose() noexcept {
+    run();
+    if (_owner == this_shard_id()) {
+        complete();
+        return;
+    }
+    try {
+        (void)smp::submit_to(_owner, [this] () noexcept {
+            complete();
+        });
+    } catch (...) {
+        on_fatal_internal_error(seastar_logger, "failed to return stolen work to its shard");
+    }
+}
+
+void submit_stealable_work(std::unique_ptr<stealable_work_item> item) noexcept {
+    work_stealing_queues::stats().submitted++;
+    if (auto queues = work_stealing_queues::get()) {
+        queues->submit(item.release());
+    } else {
+        schedule(item.release());
+    }
+}
+
+bool try_steal_work() noexcept {
+    auto queues = work_stealing_queues::get();
+    return queues && queues->try_steal();
+}
+
+bool have_stealable_work() noexcept {
+    auto queues = work_stealing_queues::get();
+    return queues && queues->have_backlog();
+}
+
+void enable_work_stealing(const std::vector<reactor*>& reactors) {
+    if (reactors.size() < 2) {
+        return;
+    }
+    work_stealing_queues::set(std::make_unique<work_stealing_queues>(reactors));
+}
+
+void disable_work_stealing() noexcept {
+    work_stealing_queues::set(nullptr);
+}
+
+const work_stealing_stats& get_work_stealing_stats() noexcept {
+    return work_stealing_queues::stats();
+}
+
+}
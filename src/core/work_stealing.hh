@@ -0,0 +1,56 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Copyright (C) 2024 ScyllaDB
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace seastar {
+
+class reactor;
+
+namespace internal {
+
+struct work_stealing_stats {
+    // Items submitted on this shard.
+    uint64_t submitted = 0;
+    // Items this shard stole from others, and ran.
+    uint64_t stolen = 0;
+};
+
+// Sets up the per-shard queues of stealable work. Until it is called (and
+// with fewer than two shards), stealable work just runs on the submitting
+// shard. Must be called before the reactors start running.
+void enable_work_stealing(const std::vector<reactor*>& reactors);
+// Called once the reactors have stopped.
+void disable_work_stealing() noexcept;
+
+// Steals one item from a shard with a backlog of stealable work, and
+// schedules it on the current shard. Returns true if it found one.
+bool try_steal_work() noexcept;
+// Whether another shard has a backlog of stealable work.
+bool have_stealable_work() noexcept;
+
+const work_stealing_stats& get_work_stealing_stats() noexcept;
+
+}
+
+}
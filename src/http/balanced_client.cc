@@ -0,0 +1,275 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/http/balanced_client.hh>
+#include <seastar/http/request.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/util/log.hh>
+#include <algorithm>
+#include <system_error>
+
+namespace seastar {
+
+extern logger http_log;
+
+namespace http {
+namespace experimental {
+
+struct balanced_client::address {
+    socket_address addr;
+    client cln;
+    // The requests in flight, and the preconnections
+    gate users;
+    unsigned in_flight = 0;
+    // In microseconds
+    std::optional<double> latency;
+    unsigned errors_in_a_row = 0;
+    clock_type::time_point backoff_until = clock_type::time_point::min();
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+
+    address(socket_address a, std::unique_ptr<connection_factory> f, const config& cfg)
+            : addr(a)
+            , cln(std::move(f), cfg.max_connections_per_address, cfg.retry, cfg.h2)
+    {}
+};
+
+balanced_client::balanced_client(sstring host, config cfg)
+        : _host(std::move(host))
+        , _cfg(std::move(cfg))
+        , _refresh([this] {
+            // A failed resolution is retried, the addresses kept meanwhile
+            (void)try_with_gate(_gate, [this] {
+                return resolve();
+            }).handle_exception([] (std::exception_ptr) {});
+        })
+{
+}
+
+balanced_client::~balanced_client() = default;
+
+future<> balanced_client::resolve() {
+    _resolving = true;
+    auto f = _cfg.resolve ? futurize_invoke(_cfg.resolve, _host, _cfg.family) : net::dns::get_host_by_name(_host, _cfg.family);
+    return f.then_wrapped([this] (future<net::hostent> f) {
+        _resolving = false;
+        std::exception_ptr ex;
+        auto period = _cfg.min_refresh_period;
+        try {
+            auto h = f.get();
+            if (h.addr_list.empty()) {
+                throw std::runtime_error(format("{} resolved to no address", _host));
+            }
+            update(h.addr_list);
+            period = std::max(h.ttl.value_or(_cfg.refresh_period), _cfg.min_refresh_period);
+        } catch (...) {
+            ex = std::current_exception();
+            http_log.warn("failed to resolve {}: {}", _host, ex);
+        }
+        if (!_gate.is_closed()) {
+            _refresh.rearm(clock_type::now() + period);
+        }
+        if (_resolved) {
+            if (!_addresses.empty()) {
+                _resolved->set_value();
+            } else {
+                _resolved->set_exception(ex);
+            }
+            _resolved.reset();
+        }
+        return ex ? make_exception_future<>(std::move(ex)) : make_ready_future<>();
+    });
+}
+
+future<> balanced_client::wait_addresses() {
+    if (!_addresses.empty()) {
+        return make_ready_future<>();
+    }
+    if (!_resolved) {
+        _resolved.emplace();
+        if (!_resolving) {
+            _refresh.cancel();
+            // The waiters get the error
+            (void)resolve().handle_exception([] (std::exception_ptr) {});
+        }
+    }
+    return _resolved->get_shared_future();
+}
+
+void balanced_client::update(const std::vector<net::inet_address>& addrs) {
+    std::vector<address_ptr> addresses;
+    for (auto& ia : addrs) {
+        socket_address sa(ia, _cfg.port);
+        if (std::any_of(addresses.begin(), addresses.end(), [&sa] (const address_ptr& a) { return a->addr == sa; })) {
+            continue;
+        }
+        auto i = std::find_if(_addresses.begin(), _addresses.end(), [&sa] (const address_ptr& a) { return a->addr == sa; });
+        if (i != _addresses.end()) {
+            addresses.push_back(std::move(*i));
+            _addresses.erase(i);
+        } else {
+            http_log.debug("{} resolved to new address {}", _host, sa);
+            auto f = _cfg.make_connection_factory ? _cfg.make_connection_factory(sa)
+                    : internal::make_connection_factory(sa, _cfg.creds, _host, _cfg.h2);
+            addresses.push_back(make_lw_shared<address>(sa, std::move(f), _cfg));
+        }
+    }
+    for (auto& a : _addresses) {
+        http_log.debug("{} no longer resolves to {}", _host, a->addr);
+        retire(std::move(a));
+    }
+    _addresses = std::move(addresses);
+    for (auto& a : _addresses) {
+        preconnect(a);
+    }
+}
+
+void balanced_client::retire(address_ptr a) {
+    (void)try_with_gate(_gate, [a] {
+        return a->users.close().then([a] {
+            return a->cln.close();
+        });
+    }).handle_exception([a] (std::exception_ptr ex) {
+        http_log.debug("failed to close the connections to {}: {}", a->addr, ex);
+    });
+}
+
+void balanced_client::preconnect(address_ptr a) {
+    if (!_cfg.min_idle_connections || clock_type::now() < a->backoff_until) {
+        return;
+    }
+    (void)try_with_gate(a->users, [this, a] {
+        return a->cln.preconnect(_cfg.min_idle_connections).handle_exception([this, a] (std::exception_ptr ex) {
+            http_log.debug("failed to connect to {}: {}", a->addr, ex);
+            failed(*a);
+        });
+    }).handle_exception([] (std::exception_ptr) {});
+}
+
+void balanced_client::failed(address& a) {
+    a.errors++;
+    auto backoff = std::min<clock_type::duration>(_cfg.min_backoff * (1u << std::min(a.errors_in_a_row, 16u)), _cfg.max_backoff);
+    a.errors_in_a_row++;
+    a.backoff_until = clock_type::now() + backoff;
+}
+
+balanced_client::address_ptr balanced_client::pick() {
+    auto now = clock_type::now();
+    address_ptr best;
+    double best_score = 0;
+    // From a different address every time, for the ties to spread
+    auto n = _addresses.size();
+    for (size_t i = 0; i < n; i++) {
+        auto& a = _addresses[(_rover + i) % n];
+        if (a->backoff_until > now) {
+            continue;
+        }
+        double score = a->latency.value_or(0) * (a->in_flight + 1);
+        if (!best || score < best_score) {
+            best = a;
+            best_score = score;
+        }
+    }
+    _rover++;
+    if (!best) {
+        best = *std::min_element(_addresses.begin(), _addresses.end(), [] (const address_ptr& a, const address_ptr& b) {
+            return a->backoff_until < b->backoff_until;
+        });
+    }
+    return best;
+}
+
+future<> balanced_client::make_request(request req, client::reply_handler handle, std::optional<reply::status_type> expected) {
+    return try_with_gate(_gate, [this, req = std::move(req), handle = std::move(handle), expected] () mutable {
+        return wait_addresses().then([this, req = std::move(req), handle = std::move(handle), expected] () mutable {
+            auto a = pick();
+            return try_with_gate(a->users, [this, a, req = std::move(req), handle = std::move(handle), expected] () mutable {
+                a->in_flight++;
+                a->requests++;
+                auto start = std::chrono::steady_clock::now();
+                auto timed = [this, a, start, handle = std::move(handle)] (const reply& rep, input_stream<char>&& in) mutable {
+                    double us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+                    a->latency = a->latency ? *a->latency + (us - *a->latency) * _cfg.latency_weight : us;
+                    a->errors_in_a_row = 0;
+                    a->backoff_until = clock_type::time_point::min();
+                    return handle(rep, std::move(in));
+                };
+                return a->cln.make_request(std::move(req), std::move(timed), expected).then_wrapped([this, a] (future<> f) {
+                    a->in_flight--;
+                    if (f.failed()) {
+                        auto ex = f.get_exception();
+                        try {
+                            std::rethrow_exception(ex);
+                        } catch (const std::system_error&) {
+                            failed(*a);
+                        } catch (...) {
+                        }
+                        return make_exception_future<>(std::move(ex));
+                    }
+                    if (a->cln.idle_connections_nr() < _cfg.min_idle_connections) {
+                        preconnect(a);
+                    }
+                    return make_ready_future<>();
+                });
+            });
+        });
+    });
+}
+
+future<> balanced_client::refresh() {
+    return try_with_gate(_gate, [this] {
+        return resolve();
+    });
+}
+
+future<> balanced_client::close() {
+    _refresh.cancel();
+    return _gate.close().then([this] {
+        return parallel_for_each(_addresses, [] (address_ptr a) {
+            return a->users.close().then([a] {
+                return a->cln.close();
+            });
+        });
+    });
+}
+
+std::vector<balanced_client::address_stats> balanced_client::get_address_stats() const {
+    auto now = clock_type::now();
+    std::vector<address_stats> ret;
+    ret.reserve(_addresses.size());
+    for (auto& a : _addresses) {
+        ret.push_back(address_stats{
+            .address = a->addr,
+            .healthy = a->backoff_until <= now,
+            .requests_in_flight = a->in_flight,
+            .latency = a->latency ? std::optional(std::chrono::microseconds(int64_t(*a->latency))) : std::nullopt,
+            .connections = a->cln.connections_nr(),
+            .idle_connections = a->cln.idle_connections_nr(),
+            .requests = a->requests,
+            .errors = a->errors,
+        });
+    }
+    return ret;
+}
+
+} // experimental namespace
+} // http namespace
+} // seastar namespace
@@ -23,18 +23,23 @@
 module;
 #endif
 
+#include <algorithm>
+#include <cctype>
 #include <concepts>
 #include <memory>
 #include <optional>
 #include <stdexcept>
+#include <tuple>
 #include <utility>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/http/client.hh>
 #include <seastar/http/request.hh>
@@ -121,6 +126,9 @@ void connection::setup_request(request& req) {
         }
         req._headers["Content-Length"] = to_sstring(req.content_length);
     }
+    if (auto ctx = tracing::current_context(); ctx.valid() && req.get_header("traceparent").empty()) {
+        req._headers["traceparent"] = ctx.to_traceparent();
+    }
 }
 
 future<> connection::send_request_head(const request& req) {
@@ -151,6 +159,7 @@ future<connection::reply_ptr> connection::recv_reply() {
             if ((resp->_version != "1.1") || seastar::internal::case_insensitive_cmp()(resp->get_header("Connection"), "close")) {
                 _persistent = false;
             }
+            _replied = true;
             return make_ready_future<reply_ptr>(std::move(resp));
         });
     });
@@ -173,7 +182,125 @@ future<connection::reply_ptr> connection::do_make_request(request& req) {
     });
 }
 
+future<connection::reply_ptr> connection::do_make_pipelined_request(request& req, promise<>& replied) {
+    setup_request(req);
+    promise<> written;
+    auto write_turn = std::exchange(_written, written.get_future());
+    auto read_turn = std::exchange(_read, replied.get_future());
+    // A request pipelined after a failed one, or after the reply telling
+    // the connection closes, would not be answered
+    return write_turn.then([this, &req] {
+        if (!_persistent) {
+            throw std::system_error(EPIPE, std::system_category());
+        }
+        return send_request_head(req).then([this, &req] {
+            return write_body(req);
+        }).then([this] {
+            return _write_buf.flush();
+        }).handle_exception([this] (std::exception_ptr ex) {
+            _persistent = false;
+            return make_exception_future<>(std::move(ex));
+        });
+    }).then_wrapped([written = std::move(written)] (future<> f) mutable {
+        written.set_value();
+        return f;
+    }).then([this, read_turn = std::move(read_turn)] () mutable {
+        return read_turn.then([this] {
+            if (!_persistent) {
+                throw std::system_error(ECONNABORTED, std::system_category());
+            }
+            return recv_reply();
+        });
+    });
+}
+
+namespace h2 = http::internal::http2;
+
+void connection::start_http2(sstring scheme) {
+    _h2_scheme = std::move(scheme);
+    _h2 = std::make_unique<h2::session>(h2::session::role::client, _read_buf, _write_buf, h2::config{});
+    _h2_done = _h2->run().handle_exception([] (std::exception_ptr ex) {
+        http_log.debug("HTTP/2 connection failed: {}", ex);
+    });
+}
+
+future<std::tuple<connection::reply_ptr, h2::session::stream_ptr>> connection::do_make_http2_request(request& req) {
+    if (req.content_length && !req.body_writer && req.content.empty()) {
+        throw std::runtime_error("Request body writer not set and content is empty");
+    }
+    http::internal::header_list headers;
+    headers.emplace_back(":method", req._method);
+    headers.emplace_back(":scheme", _h2_scheme);
+    if (auto host = req.get_header("Host"); !host.empty()) {
+        headers.emplace_back(":authority", std::move(host));
+    }
+    auto path = req.format_url();
+    headers.emplace_back(":path", path.empty() ? sstring("/") : std::move(path));
+    for (auto& [name, value] : req._headers) {
+        sstring lower(name.size(), '\0');
+        std::transform(name.begin(), name.end(), lower.begin(), [] (char c) { return std::tolower(c); });
+        if (h2::is_connection_specific(lower) || lower == "host" || lower == "content-length" || lower == "expect") {
+            continue;
+        }
+        headers.emplace_back(std::move(lower), value);
+    }
+    if (req.content_length) {
+        headers.emplace_back("content-length", to_sstring(req.content_length));
+    }
+    bool has_body = req.body_writer || !req.content.empty();
+
+    auto s = co_await _h2->open_stream(headers, !has_body);
+    std::exception_ptr ex;
+    try {
+        if (req.body_writer) {
+            co_await req.body_writer(_h2->body_sink(s));
+            co_await _h2->finish(*s);
+        } else if (has_body) {
+            co_await _h2->send_data(*s, temporary_buffer<char>(req.content.data(), req.content.size()), true);
+        }
+        co_await s->wait_headers();
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    if (ex) {
+        _h2->release(*s);
+        std::rethrow_exception(ex);
+    }
+
+    auto rep = std::make_unique<reply>();
+    rep->_version = "2.0";
+    for (auto& [name, value] : s->headers()) {
+        if (name == ":status") {
+            rep->_status = reply::status_type(strtol(value.c_str(), nullptr, 10));
+        } else if (!name.starts_with(':')) {
+            auto [it, inserted] = rep->_headers.emplace(name, value);
+            if (!inserted) {
+                it->second += ", " + value;
+            }
+        }
+    }
+    if (int(rep->_status) < 100 || int(rep->_status) > 999) {
+        _h2->release(*s, h2::error_code::protocol_error);
+        throw std::runtime_error("Invalid http server response");
+    }
+    rep->content_length = strtol(rep->get_header("Content-Length").c_str(), nullptr, 10);
+    co_return std::make_tuple(std::move(rep), std::move(s));
+}
+
 future<reply> connection::make_request(request req) {
+    if (_h2) {
+        return do_with(std::move(req), [this] (auto& req) {
+            return do_make_http2_request(req).then([this] (std::tuple<reply_ptr, h2::session::stream_ptr> r) {
+                auto& [rep, s] = r;
+                // With the reply, the requests sharing the connection
+                // each reading the body of its own
+                rep->_h2_body = [this, s = std::move(s)] (reply& self) {
+                    return _h2->body_source(s, &self.trailing_headers);
+                };
+                return make_ready_future<reply>(std::move(*rep));
+            });
+        });
+    }
     return do_with(std::move(req), [this] (auto& req) {
         return do_make_request(req).then([] (reply_ptr rep) {
             return make_ready_future<reply>(std::move(*rep));
@@ -182,6 +309,12 @@ future<reply> connection::make_request(request req) {
 }
 
 input_stream<char> connection::in(reply& rep) {
+    if (_h2) {
+        if (!rep._h2_body) {
+            throw std::invalid_argument("Not a reply of this connection, or its body was taken already");
+        }
+        return std::exchange(rep._h2_body, {})(rep);
+    }
     if (seastar::internal::case_insensitive_cmp()(rep.get_header("Transfer-Encoding"), "chunked")) {
         return input_stream<char>(data_source(std::make_unique<httpd::internal::chunked_source_impl>(_read_buf, rep.chunk_extensions, rep.trailing_headers)));
     }
@@ -190,6 +323,16 @@ input_stream<char> connection::in(reply& rep) {
 }
 
 future<> connection::close() {
+    if (_h2) {
+        // Fails the requests in flight, the read loop ending with the input
+        return _h2->shutdown().handle_exception([] (std::exception_ptr) {}).then([this] {
+            _fd.shutdown_input();
+            return std::move(_h2_done);
+        }).then([this] {
+            _h2.reset();
+            return close();
+        });
+    }
     return when_all(_read_buf.close(), _write_buf.close()).discard_result().then([this] {
         auto la = _fd.local_address();
         return std::move(_closed).then([la = std::move(la)] {
@@ -210,66 +353,176 @@ class basic_connection_factory : public connection_factory {
     }
 };
 
-client::client(socket_address addr)
-        : client(std::make_unique<basic_connection_factory>(std::move(addr)))
-{
-}
 
 class tls_connection_factory : public connection_factory {
     socket_address _addr;
     shared_ptr<tls::certificate_credentials> _creds;
     sstring _host;
+    std::vector<sstring> _alpn_protocols;
 public:
-    tls_connection_factory(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host)
+    tls_connection_factory(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host, std::vector<sstring> alpn_protocols)
             : _addr(std::move(addr))
             , _creds(std::move(creds))
             , _host(std::move(host))
+            , _alpn_protocols(std::move(alpn_protocols))
     {
     }
     virtual future<connected_socket> make() override {
-        return tls::connect(_creds, _addr, tls::tls_options{.server_name = _host});
+        return tls::connect(_creds, _addr, tls::tls_options{.server_name = _host, .alpn_protocols = _alpn_protocols});
     }
 };
 
-client::client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host)
-        : client(std::make_unique<tls_connection_factory>(std::move(addr), std::move(creds), std::move(host)))
+} // experimental namespace
+
+std::unique_ptr<experimental::connection_factory> internal::make_connection_factory(socket_address addr,
+        shared_ptr<tls::certificate_credentials> creds, sstring host, experimental::client::http2 h2) {
+    if (!creds) {
+        return std::make_unique<experimental::basic_connection_factory>(std::move(addr));
+    }
+    return std::make_unique<experimental::tls_connection_factory>(std::move(addr), std::move(creds), std::move(host),
+            h2 ? std::vector<sstring>{"h2", "http/1.1"} : std::vector<sstring>{});
+}
+
+namespace experimental {
+
+client::client(socket_address addr, http2 h2)
+        : client(internal::make_connection_factory(std::move(addr), nullptr, {}, h2), default_max_connections, retry_requests::no, h2)
+{
+}
+
+client::client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host, http2 h2)
+        : client(internal::make_connection_factory(std::move(addr), std::move(creds), std::move(host), h2),
+                default_max_connections, retry_requests::no, h2)
 {
 }
 
-client::client(std::unique_ptr<connection_factory> f, unsigned max_connections, retry_requests retry)
+client::client(std::unique_ptr<connection_factory> f, unsigned max_connections, retry_requests retry, http2 h2)
         : _new_connections(std::move(f))
         , _max_connections(max_connections)
         , _retry(retry)
+        , _http2(h2)
 {
 }
 
-future<client::connection_ptr> client::get_connection() {
+bool client::can_pipeline(const request& req) const {
+    return _pipeline_depth > 1 && !req.body_writer && req.content.empty() && req.get_header("Expect").empty()
+            && (req._method == "GET" || req._method == "PUT" || req._method == "DELETE" || req._method == "OPTIONS");
+}
+
+future<client::connection_ptr> client::get_connection(bool pipelined) {
+    for (auto& con : _http2_pool) {
+        if (con._h2->can_open_stream(con._h2_requests)) {
+            con._h2_requests++;
+            return make_ready_future<connection_ptr>(con.shared_from_this());
+        }
+        if (!con._h2->alive() && !con._h2_requests) {
+            connection_ptr dead = con.shared_from_this();
+            dead->_hook.unlink();
+            return dead->close().handle_exception([] (std::exception_ptr) {}).finally([dead] {}).then([this, pipelined] {
+                return get_connection(pipelined);
+            });
+        }
+    }
+
     if (!_pool.empty()) {
         connection_ptr con = _pool.front().shared_from_this();
         _pool.pop_front();
         http_log.trace("pop http connection {} from pool", con->_fd.local_address());
+        if (pipelined) {
+            con->_pipelined = 1;
+            _pipelining.push_back(*con);
+        }
         return make_ready_future<connection_ptr>(con);
     }
 
-    if (_nr_connections >= _max_connections) {
-        return _wait_con.wait().then([this] {
-            return get_connection();
-        });
+    // The connection being made may well be an HTTP/2 one, to share
+    if (_nr_connections < _max_connections && !_http2_connecting) {
+        return make_connection(pipelined);
     }
 
-    return make_connection();
+    if (pipelined) {
+        for (auto& con : _pipelining) {
+            if (con._pipelined < _pipeline_depth && con._persistent && con._replied) {
+                con._pipelined++;
+                return make_ready_future<connection_ptr>(con.shared_from_this());
+            }
+        }
+    }
+
+    return _wait_con.wait().then([this, pipelined] {
+        return get_connection(pipelined);
+    });
 }
 
-future<client::connection_ptr> client::make_connection() {
+// The scheme of the connection if it is to speak HTTP/2: as negotiated
+// with ALPN over TLS, with prior knowledge otherwise
+static future<std::optional<sstring>> http2_scheme(connected_socket& cs) {
+    try {
+        return tls::get_selected_alpn_protocol(cs).then([] (std::optional<sstring> protocol) {
+            return protocol == "h2" ? std::optional<sstring>("https") : std::nullopt;
+        });
+    } catch (const std::invalid_argument&) {
+        return make_ready_future<std::optional<sstring>>("http");
+    }
+}
+
+future<client::connection_ptr> client::make_connection(bool pipelined) {
     _total_new_connections++;
-    return _new_connections->make().then([cr = internal::client_ref(this)] (connected_socket cs) mutable {
-        http_log.trace("created new http connection {}", cs.local_address());
-        auto con = seastar::make_shared<connection>(std::move(cs), std::move(cr));
-        return make_ready_future<connection_ptr>(std::move(con));
+    if (!_http2) {
+        return _new_connections->make().then([this, pipelined, cr = internal::client_ref(this)] (connected_socket cs) mutable {
+            http_log.trace("created new http connection {}", cs.local_address());
+            auto con = seastar::make_shared<connection>(std::move(cs), std::move(cr));
+            if (pipelined) {
+                con->_pipelined = 1;
+                _pipelining.push_back(*con);
+            }
+            return make_ready_future<connection_ptr>(std::move(con));
+        });
+    }
+
+    _http2_connecting++;
+    return _new_connections->make().then([this, pipelined, cr = internal::client_ref(this)] (connected_socket cs) mutable {
+        return do_with(std::move(cs), [this, pipelined, cr = std::move(cr)] (connected_socket& cs) mutable {
+            return http2_scheme(cs).then([this, pipelined, &cs, cr = std::move(cr)] (std::optional<sstring> scheme) mutable {
+                http_log.trace("created new http{} connection {}", scheme ? "/2" : "", cs.local_address());
+                auto con = seastar::make_shared<connection>(std::move(cs), std::move(cr));
+                if (scheme) {
+                    con->start_http2(std::move(*scheme));
+                    con->_h2_requests++;
+                    _http2_pool.push_back(*con);
+                } else if (pipelined) {
+                    con->_pipelined = 1;
+                    _pipelining.push_back(*con);
+                }
+                return make_ready_future<connection_ptr>(std::move(con));
+            });
+        });
+    }).finally([this] {
+        _http2_connecting--;
+        _wait_con.broadcast();
     });
 }
 
 future<> client::put_connection(connection_ptr con) {
+    if (con->_h2) {
+        con->_h2_requests--;
+        if (con->_h2_requests || (con->_h2->alive() && _nr_connections <= _max_connections)) {
+            _wait_con.signal();
+            return make_ready_future<>();
+        }
+        http_log.trace("dropping http/2 connection {}", con->_fd.local_address());
+        con->_hook.unlink();
+        return con->close().finally([con] {});
+    }
+
+    if (con->_pipelined) {
+        if (--con->_pipelined) {
+            _wait_con.broadcast();
+            return make_ready_future<>();
+        }
+        con->_hook.unlink();
+    }
+
     if (con->_persistent && (_nr_connections <= _max_connections)) {
         http_log.trace("push http connection {} to pool", con->_fd.local_address());
         _pool.push_back(*con);
@@ -294,6 +547,16 @@ future<> client::shrink_connections() {
         });
     }
 
+    for (auto& c : _http2_pool) {
+        if (!c._h2_requests) {
+            connection_ptr con = c.shared_from_this();
+            con->_hook.unlink();
+            return con->close().finally([this, con] {
+                return shrink_connections();
+            });
+        }
+    }
+
     return _wait_con.wait().then([this] {
         return shrink_connections();
     });
@@ -310,9 +573,24 @@ future<> client::set_maximum_connections(unsigned nr) {
     return shrink_connections();
 }
 
+future<> client::preconnect(unsigned nr) {
+    return repeat([this, nr] {
+        if (idle_connections_nr() >= nr || _nr_connections >= _max_connections) {
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        auto idle = idle_connections_nr();
+        return make_connection().then([this] (connection_ptr con) {
+            return put_connection(std::move(con));
+        }).then([this, idle] {
+            // Rather than making again and again connections not kept
+            return stop_iteration(idle_connections_nr() <= idle);
+        });
+    });
+}
+
 template <std::invocable<connection&> Fn>
-auto client::with_connection(Fn&& fn) {
-    return get_connection().then([this, fn = std::move(fn)] (connection_ptr con) mutable {
+auto client::with_connection(bool pipelined, Fn&& fn) {
+    return get_connection(pipelined).then([this, fn = std::move(fn)] (connection_ptr con) mutable {
         return fn(*con).finally([this, con = std::move(con)] () mutable {
             return put_connection(std::move(con));
         });
@@ -331,7 +609,7 @@ auto client::with_new_connection(Fn&& fn) {
 
 future<> client::make_request(request req, reply_handler handle, std::optional<reply::status_type> expected) {
     return do_with(std::move(req), std::move(handle), [this, expected] (request& req, reply_handler& handle) mutable {
-        auto f = with_connection([this, &req, &handle, expected] (connection& con) {
+        auto f = with_connection(can_pipeline(req), [this, &req, &handle, expected] (connection& con) {
             return do_make_request(con, req, handle, expected);
         });
 
@@ -355,32 +633,197 @@ future<> client::make_request(request req, reply_handler handle, std::optional<r
     });
 }
 
+static future<> handle_reply(std::unique_ptr<reply> reply, input_stream<char> in, client::reply_handler& handle, std::optional<reply::status_type> expected) {
+    auto& rep = *reply;
+    if (expected.has_value() && rep._status != expected.value()) {
+        if (!http_log.is_enabled(log_level::debug)) {
+            return make_exception_future<>(httpd::unexpected_status_error(rep._status));
+        }
+
+        return do_with(std::move(in), [reply = std::move(reply)] (auto& in) mutable {
+            return util::read_entire_stream_contiguous(in).then([reply = std::move(reply)] (auto message) {
+                http_log.debug("request finished with {}: {}", reply->_status, message);
+                return make_exception_future<>(httpd::unexpected_status_error(reply->_status));
+            });
+        });
+    }
+
+    return handle(rep, std::move(in)).finally([reply = std::move(reply)] {});
+}
+
 future<> client::do_make_request(connection& con, request& req, reply_handler& handle, std::optional<reply::status_type> expected) {
+    if (con._h2) {
+        return con.do_make_http2_request(req).then([&con, &handle, expected] (std::tuple<connection::reply_ptr, h2::session::stream_ptr> r) {
+            auto& [reply, s] = r;
+            auto in = con._h2->body_source(s, &reply->trailing_headers);
+            return handle_reply(std::move(reply), std::move(in), handle, expected).finally([&con, s = std::move(s)] {
+                if (con._h2) {
+                    con._h2->release(*s);
+                }
+            });
+        });
+    }
+
+    if (con._pipelined) {
+        return do_with(promise<>(), [&con, &req, &handle, expected] (promise<>& replied) {
+            return con.do_make_pipelined_request(req, replied).then([&con, &handle, expected] (connection::reply_ptr reply) mutable {
+                auto in = con.in(*reply);
+                return handle_reply(std::move(reply), std::move(in), handle, expected);
+            }).handle_exception([&con] (auto ex) mutable {
+                con._persistent = false;
+                return make_exception_future<>(std::move(ex));
+            }).finally([&replied] {
+                replied.set_value();
+            });
+        });
+    }
+
     return con.do_make_request(req).then([&con, &handle, expected] (connection::reply_ptr reply) mutable {
-        auto& rep = *reply;
-        if (expected.has_value() && rep._status != expected.value()) {
-            if (!http_log.is_enabled(log_level::debug)) {
-                return make_exception_future<>(httpd::unexpected_status_error(rep._status));
+        auto in = con.in(*reply);
+        return handle_reply(std::move(reply), std::move(in), handle, expected);
+    }).handle_exception([&con] (auto ex) mutable {
+        con._persistent = false;
+        return make_exception_future<>(std::move(ex));
+    });
+}
+
+// The body of a streamed reply, giving the connection it comes on back to
+// the client once read to its end, or closed
+class client::streamed_body_source final : public data_source_impl {
+    client& _client;
+    connection_ptr _con;
+    lw_shared_ptr<reply> _rep;
+    input_stream<char> _in;
+    h2::session::stream_ptr _stream;
+    // Lets the reply pipelined after this one be read
+    std::optional<promise<>> _replied;
+
+    future<> release(bool read) {
+        if (!_con) {
+            return make_ready_future<>();
+        }
+        if (_stream) {
+            if (_con->_h2) {
+                _con->_h2->release(*_stream);
             }
+        } else if (!read) {
+            // The rest of the body is still to come on the connection
+            _con->_persistent = false;
+        }
+        if (_replied) {
+            _replied->set_value();
+            _replied.reset();
+        }
+        return _in.close().then([this] {
+            return _client.put_connection(std::move(_con));
+        });
+    }
+public:
+    streamed_body_source(client& c, connection_ptr con, lw_shared_ptr<reply> rep, input_stream<char> in, h2::session::stream_ptr s, std::optional<promise<>> replied)
+            : _client(c)
+            , _con(std::move(con))
+            , _rep(std::move(rep))
+            , _in(std::move(in))
+            , _stream(std::move(s))
+            , _replied(std::move(replied))
+    {
+    }
+    virtual future<temporary_buffer<char>> get() override {
+        if (!_con) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        return _in.read().then([this] (temporary_buffer<char> buf) {
+            if (!buf.empty()) {
+                return make_ready_future<temporary_buffer<char>>(std::move(buf));
+            }
+            return release(true).then([] {
+                return temporary_buffer<char>();
+            });
+        });
+    }
+    virtual future<> close() override {
+        return release(false);
+    }
+};
+
+future<streaming_reply> client::do_make_streaming_request(connection_ptr con, request& req, std::optional<reply::status_type> expected) {
+    std::optional<promise<>> replied;
+    std::unique_ptr<streamed_body_source> src;
+    lw_shared_ptr<reply> rep;
+    std::exception_ptr ex;
+    try {
+        if (con->_h2) {
+            auto [r, s] = co_await con->do_make_http2_request(req);
+            rep = make_lw_shared<reply>(std::move(*r));
+            auto in = con->_h2->body_source(s, &rep->trailing_headers);
+            src = std::make_unique<streamed_body_source>(*this, con, rep, std::move(in), std::move(s), std::nullopt);
+        } else {
+            connection::reply_ptr r;
+            if (con->_pipelined) {
+                replied.emplace();
+                r = co_await con->do_make_pipelined_request(req, *replied);
+            } else {
+                r = co_await con->do_make_request(req);
+            }
+            rep = make_lw_shared<reply>(std::move(*r));
+            auto in = con->in(*rep);
+            src = std::make_unique<streamed_body_source>(*this, con, rep, std::move(in), nullptr, std::exchange(replied, std::nullopt));
+        }
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    if (ex) {
+        if (!con->_h2) {
+            con->_persistent = false;
+        }
+        if (replied) {
+            replied->set_value();
+        }
+        co_await put_connection(std::move(con));
+        std::rethrow_exception(ex);
+    }
+
+    if (expected && rep->_status != *expected) {
+        co_await src->close();
+        throw httpd::unexpected_status_error(rep->_status);
+    }
+    co_return streaming_reply{std::move(rep), input_stream<char>(data_source(std::move(src)))};
+}
 
-            return do_with(con.in(rep), [reply = std::move(reply)] (auto& in) mutable {
-                return util::read_entire_stream_contiguous(in).then([reply = std::move(reply)] (auto message) {
-                    http_log.debug("request finished with {}: {}", reply->_status, message);
-                    return make_exception_future<>(httpd::unexpected_status_error(reply->_status));
+future<streaming_reply> client::make_streaming_request(request req, std::optional<reply::status_type> expected) {
+    return do_with(std::move(req), [this, expected] (request& req) {
+        auto f = get_connection(can_pipeline(req)).then([this, &req, expected] (connection_ptr con) {
+            return do_make_streaming_request(std::move(con), req, expected);
+        });
+
+        if (_retry) {
+            f = f.handle_exception_type([this, &req, expected] (const std::system_error& ex) {
+                auto code = ex.code().value();
+                if ((code != EPIPE) && (code != ECONNABORTED)) {
+                    return make_exception_future<streaming_reply>(ex);
+                }
+
+                return make_connection().then([this, &req, expected] (connection_ptr con) {
+                    return do_make_streaming_request(std::move(con), req, expected);
                 });
             });
         }
 
-        return handle(rep, con.in(rep)).finally([reply = std::move(reply)] {});
-    }).handle_exception([&con] (auto ex) mutable {
-        con._persistent = false;
-        return make_exception_future<>(std::move(ex));
+        return f;
     });
 }
 
 future<> client::close() {
     if (_pool.empty()) {
-        return make_ready_future<>();
+        if (_http2_pool.empty()) {
+            return make_ready_future<>();
+        }
+        connection_ptr con = _http2_pool.front().shared_from_this();
+        _http2_pool.pop_front();
+        http_log.trace("closing http/2 connection {}", con->_fd.local_address());
+        return con->close().then([this, con] {
+            return close();
+        });
     }
 
     connection_ptr con = _pool.front().shared_from_this();
@@ -0,0 +1,517 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/http/compression.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/print.hh>
+#include <seastar/util/string_utils.hh>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <limits>
+#include <memory>
+#include <boost/algorithm/string/predicate.hpp>
+
+#ifdef SEASTAR_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SEASTAR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace seastar {
+
+namespace http {
+
+namespace {
+
+constexpr size_t chunk_size = 16 * 1024;
+
+// Runs data through a compressor or a decompressor, appending what comes
+// out of it to out. Decompressors stop once they appended limit bytes,
+// keeping what is left of their output for the next call, and return how
+// much of data they consumed; the rest is to be passed again. Compressors
+// ignore the limit and consume everything.
+class codec {
+public:
+    enum class op { process, flush, finish };
+    virtual ~codec() = default;
+    virtual size_t run(const char* data, size_t size, op o, std::vector<temporary_buffer<char>>& out,
+            size_t limit = std::numeric_limits<size_t>::max()) = 0;
+};
+
+#ifdef SEASTAR_HAVE_ZLIB
+
+class zlib_compressor final : public codec {
+    z_stream _strm = {};
+public:
+    zlib_compressor(content_encoding enc, int level) {
+        // Plus 16 for the gzip wrapper rather than the zlib one
+        int window_bits = enc == content_encoding::gzip ? 15 + 16 : 15;
+        if (deflateInit2(&_strm, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::bad_alloc();
+        }
+    }
+    ~zlib_compressor() {
+        deflateEnd(&_strm);
+    }
+    virtual size_t run(const char* data, size_t size, op o, std::vector<temporary_buffer<char>>& out, size_t) override {
+        int flush = o == op::process ? Z_NO_FLUSH : o == op::flush ? Z_SYNC_FLUSH : Z_FINISH;
+        _strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _strm.avail_in = size;
+        for (;;) {
+            temporary_buffer<char> buf(chunk_size);
+            _strm.next_out = reinterpret_cast<Bytef*>(buf.get_write());
+            _strm.avail_out = buf.size();
+            auto r = deflate(&_strm, flush);
+            if (r == Z_STREAM_ERROR) {
+                throw std::runtime_error("zlib compression failure");
+            }
+            buf.trim(buf.size() - _strm.avail_out);
+            auto full = _strm.avail_out == 0;
+            if (!buf.empty()) {
+                out.push_back(std::move(buf));
+            }
+            if (flush == Z_FINISH ? r == Z_STREAM_END : !full) {
+                return size;
+            }
+        }
+    }
+};
+
+class zlib_decompressor final : public codec {
+    z_stream _strm = {};
+    bool _ended = false;
+    // The last output buffer was filled, so inflate() may have more
+    bool _full = false;
+public:
+    zlib_decompressor() {
+        // Plus 32 to detect the gzip and zlib wrappers
+        if (inflateInit2(&_strm, 15 + 32) != Z_OK) {
+            throw std::bad_alloc();
+        }
+    }
+    ~zlib_decompressor() {
+        inflateEnd(&_strm);
+    }
+    virtual size_t run(const char* data, size_t size, op o, std::vector<temporary_buffer<char>>& out, size_t limit) override {
+        _strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _strm.avail_in = size;
+        size_t produced = 0;
+        while ((_strm.avail_in || _full) && produced < limit) {
+            if (_ended) {
+                throw decompression_error("Data after the end of the compressed body");
+            }
+            temporary_buffer<char> buf(std::min(chunk_size, limit - produced));
+            _strm.next_out = reinterpret_cast<Bytef*>(buf.get_write());
+            _strm.avail_out = buf.size();
+            auto r = inflate(&_strm, Z_NO_FLUSH);
+            if (r == Z_STREAM_END) {
+                _ended = true;
+            } else if (r != Z_OK && r != Z_BUF_ERROR) {
+                throw decompression_error(format("Malformed compressed body: {}", _strm.msg ? _strm.msg : "zlib error"));
+            }
+            buf.trim(buf.size() - _strm.avail_out);
+            _full = !_ended && _strm.avail_out == 0;
+            produced += buf.size();
+            if (!buf.empty()) {
+                out.push_back(std::move(buf));
+            }
+            if (r == Z_BUF_ERROR && !_full) {
+                break;
+            }
+        }
+        auto consumed = size - _strm.avail_in;
+        if (o == op::finish && consumed == size && !_full && !_ended) {
+            throw decompression_error("Truncated compressed body");
+        }
+        return consumed;
+    }
+};
+
+#endif
+
+#ifdef SEASTAR_HAVE_ZSTD
+
+class zstd_compressor final : public codec {
+    ZSTD_CCtx* _cctx;
+public:
+    explicit zstd_compressor(int level) : _cctx(ZSTD_createCCtx()) {
+        if (!_cctx) {
+            throw std::bad_alloc();
+        }
+        ZSTD_CCtx_setParameter(_cctx, ZSTD_c_compressionLevel, level);
+    }
+    ~zstd_compressor() {
+        ZSTD_freeCCtx(_cctx);
+    }
+    virtual size_t run(const char* data, size_t size, op o, std::vector<temporary_buffer<char>>& out, size_t) override {
+        auto mode = o == op::process ? ZSTD_e_continue : o == op::flush ? ZSTD_e_flush : ZSTD_e_end;
+        ZSTD_inBuffer in{data, size, 0};
+        for (;;) {
+            temporary_buffer<char> buf(ZSTD_CStreamOutSize());
+            ZSTD_outBuffer output{buf.get_write(), buf.size(), 0};
+            auto remaining = ZSTD_compressStream2(_cctx, &output, &in, mode);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error(format("zstd compression failure: {}", ZSTD_getErrorName(remaining)));
+            }
+            buf.trim(output.pos);
+            if (!buf.empty()) {
+                out.push_back(std::move(buf));
+            }
+            if (mode == ZSTD_e_continue ? in.pos == in.size : remaining == 0) {
+                return size;
+            }
+        }
+    }
+};
+
+class zstd_decompressor final : public codec {
+    ZSTD_DCtx* _dctx;
+    bool _ended = false;
+    // The last output buffer was filled, so the context may have more
+    bool _full = false;
+public:
+    zstd_decompressor() : _dctx(ZSTD_createDCtx()) {
+        if (!_dctx) {
+            throw std::bad_alloc();
+        }
+    }
+    ~zstd_decompressor() {
+        ZSTD_freeDCtx(_dctx);
+    }
+    virtual size_t run(const char* data, size_t size, op o, std::vector<temporary_buffer<char>>& out, size_t limit) override {
+        ZSTD_inBuffer in{data, size, 0};
+        size_t produced = 0;
+        while ((in.pos < in.size || _full) && produced < limit) {
+            temporary_buffer<char> buf(std::min(ZSTD_DStreamOutSize(), limit - produced));
+            ZSTD_outBuffer output{buf.get_write(), buf.size(), 0};
+            auto r = ZSTD_decompressStream(_dctx, &output, &in);
+            if (ZSTD_isError(r)) {
+                throw decompression_error(format("Malformed compressed body: {}", ZSTD_getErrorName(r)));
+            }
+            // Several frames may follow each other
+            _ended = r == 0;
+            _full = !_ended && output.pos == output.size;
+            produced += output.pos;
+            buf.trim(output.pos);
+            if (!buf.empty()) {
+                out.push_back(std::move(buf));
+            }
+        }
+        if (o == op::finish && in.pos == in.size && !_full && !_ended) {
+            throw decompression_error("Truncated compressed body");
+        }
+        return in.pos;
+    }
+};
+
+#endif
+
+std::unique_ptr<codec> make_compressor(content_encoding enc, int level) {
+    switch (enc) {
+#ifdef SEASTAR_HAVE_ZLIB
+    case content_encoding::gzip:
+    case content_encoding::deflate:
+        return std::make_unique<zlib_compressor>(enc, level);
+#endif
+#ifdef SEASTAR_HAVE_ZSTD
+    case content_encoding::zstd:
+        return std::make_unique<zstd_compressor>(level);
+#endif
+    default:
+        throw std::invalid_argument(format("Unsupported content encoding {}", to_string(enc)));
+    }
+}
+
+std::unique_ptr<codec> make_decompressor(content_encoding enc) {
+    switch (enc) {
+#ifdef SEASTAR_HAVE_ZLIB
+    case content_encoding::gzip:
+    case content_encoding::deflate:
+        return std::make_unique<zlib_decompressor>();
+#endif
+#ifdef SEASTAR_HAVE_ZSTD
+    case content_encoding::zstd:
+        return std::make_unique<zstd_decompressor>();
+#endif
+    default:
+        throw std::invalid_argument(format("Unsupported content encoding {}", to_string(enc)));
+    }
+}
+
+class compressing_sink final : public data_sink_impl {
+    output_stream<char> _out;
+    std::unique_ptr<codec> _codec;
+
+    // Copies, the sinks of the HTTP bodies taking no packets
+    future<> write(std::vector<temporary_buffer<char>> bufs) {
+        return do_with(std::move(bufs), [this] (std::vector<temporary_buffer<char>>& bufs) {
+            return do_for_each(bufs, [this] (temporary_buffer<char>& buf) {
+                return _out.write(buf.get(), buf.size());
+            });
+        });
+    }
+    future<> run(const char* data, size_t size, codec::op o) {
+        std::vector<temporary_buffer<char>> bufs;
+        try {
+            _codec->run(data, size, o, bufs);
+        } catch (...) {
+            return current_exception_as_future();
+        }
+        return write(std::move(bufs));
+    }
+public:
+    compressing_sink(output_stream<char> out, std::unique_ptr<codec> c) : _out(std::move(out)), _codec(std::move(c)) {}
+    virtual future<> put(net::packet data) override {
+        std::vector<temporary_buffer<char>> bufs;
+        try {
+            for (auto& f : data.fragments()) {
+                _codec->run(f.base, f.size, codec::op::process, bufs);
+            }
+        } catch (...) {
+            return current_exception_as_future();
+        }
+        return write(std::move(bufs));
+    }
+    virtual future<> put(temporary_buffer<char> buf) override {
+        return run(buf.get(), buf.size(), codec::op::process);
+    }
+    virtual future<> flush() override {
+        return run(nullptr, 0, codec::op::flush).then([this] {
+            return _out.flush();
+        });
+    }
+    virtual future<> close() override {
+        return run(nullptr, 0, codec::op::finish).finally([this] {
+            return _out.close();
+        });
+    }
+};
+
+// Decompresses a chunk at a time, so that a small body inflating to a
+// huge one (a decompression bomb) takes no more memory than that before
+// it is found to be over max_size
+class decompressing_source final : public data_source_impl {
+    input_stream<char> _in;
+    std::unique_ptr<codec> _codec;
+    size_t _max_size;
+    size_t _size = 0;
+    // What was read from _in and not consumed by the codec yet
+    temporary_buffer<char> _input;
+    bool _input_eof = false;
+    std::vector<temporary_buffer<char>> _out;
+    size_t _next = 0;
+    bool _eof = false;
+
+    // Decompresses up to a chunk of _input, or just one byte over
+    // _max_size; returns whether anything came out
+    bool run() {
+        _out.clear();
+        _next = 0;
+        auto budget = _max_size - _size;
+        auto limit = budget < chunk_size ? budget + 1 : chunk_size;
+        auto consumed = _codec->run(_input.get(), _input.size(), _input_eof ? codec::op::finish : codec::op::process, _out, limit);
+        _input.trim_front(consumed);
+        for (auto& buf : _out) {
+            _size += buf.size();
+        }
+        if (_size > _max_size) {
+            throw decompression_error(format("Decompressed body larger than {}", _max_size), true);
+        }
+        if (_out.empty() && !_input.empty()) {
+            throw decompression_error("Malformed compressed body: no progress");
+        }
+        return !_out.empty();
+    }
+public:
+    decompressing_source(input_stream<char> in, std::unique_ptr<codec> c, size_t max_size)
+            : _in(std::move(in)), _codec(std::move(c)), _max_size(max_size) {}
+    virtual future<temporary_buffer<char>> get() override {
+        if (_next < _out.size()) {
+            return make_ready_future<temporary_buffer<char>>(std::move(_out[_next++]));
+        }
+        if (_eof) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        try {
+            if (run()) {
+                return get();
+            }
+        } catch (...) {
+            return current_exception_as_future<temporary_buffer<char>>();
+        }
+        if (_input_eof) {
+            _eof = true;
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        return _in.read().then([this] (temporary_buffer<char> buf) {
+            if (buf.empty()) {
+                _input_eof = true;
+            } else {
+                _input = std::move(buf);
+            }
+            return get();
+        });
+    }
+    virtual future<> close() override {
+        return _in.close();
+    }
+};
+
+}
+
+bool compression_config::compressible(std::string_view content_type) const noexcept {
+    auto end = content_type.find(';');
+    if (end != std::string_view::npos) {
+        content_type = content_type.substr(0, end);
+    }
+    while (!content_type.empty() && content_type.back() == ' ') {
+        content_type.remove_suffix(1);
+    }
+    return std::any_of(content_types.begin(), content_types.end(), [content_type] (const sstring& t) {
+        return t.ends_with('/')
+                ? boost::istarts_with(content_type, std::string_view(t))
+                : boost::iequals(content_type, std::string_view(t));
+    });
+}
+
+bool is_supported(content_encoding enc) noexcept {
+    switch (enc) {
+    case content_encoding::gzip:
+    case content_encoding::deflate:
+#ifdef SEASTAR_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case content_encoding::zstd:
+#ifdef SEASTAR_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+std::string_view to_string(content_encoding enc) noexcept {
+    switch (enc) {
+    case content_encoding::gzip: return "gzip";
+    case content_encoding::deflate: return "deflate";
+    case content_encoding::zstd: return "zstd";
+    }
+    return "unknown";
+}
+
+std::optional<content_encoding> parse_content_encoding(std::string_view name) noexcept {
+    if (boost::iequals(name, "gzip") || boost::iequals(name, "x-gzip")) {
+        return content_encoding::gzip;
+    } else if (boost::iequals(name, "deflate")) {
+        return content_encoding::deflate;
+    } else if (boost::iequals(name, "zstd")) {
+        return content_encoding::zstd;
+    }
+    return std::nullopt;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+std::optional<content_encoding> negotiate_content_encoding(std::string_view accept_encoding,
+        const std::vector<content_encoding>& offered) {
+    // The weights, in thousandths, of each encoding and of "*"
+    constexpr int unlisted = -1;
+    std::array<int, 3> weights;
+    weights.fill(unlisted);
+    int any = unlisted;
+    while (!accept_encoding.empty()) {
+        auto end = accept_encoding.find(',');
+        auto item = accept_encoding.substr(0, end);
+        accept_encoding.remove_prefix(end == std::string_view::npos ? accept_encoding.size() : end + 1);
+        int weight = 1000;
+        auto params = item.find(';');
+        auto name = trim(item.substr(0, params));
+        if (params != std::string_view::npos) {
+            auto q = trim(item.substr(params + 1));
+            if (q.size() < 2 || (q[0] != 'q' && q[0] != 'Q') || q[1] != '=') {
+                continue;
+            }
+            q.remove_prefix(2);
+            double value = 0;
+            auto [ptr, ec] = std::from_chars(q.data(), q.data() + q.size(), value);
+            if (ec != std::errc()) {
+                continue;
+            }
+            weight = std::clamp(int(value * 1000), 0, 1000);
+        }
+        if (name == "*") {
+            any = weight;
+        } else if (auto enc = parse_content_encoding(name)) {
+            weights[size_t(*enc)] = weight;
+        }
+    }
+    std::optional<content_encoding> best;
+    int best_weight = 0;
+    for (auto enc : offered) {
+        auto weight = weights[size_t(enc)] == unlisted ? any : weights[size_t(enc)];
+        if (is_supported(enc) && weight > best_weight) {
+            best = enc;
+            best_weight = weight;
+        }
+    }
+    return best;
+}
+
+sstring compress(content_encoding enc, std::string_view data, int level) {
+    auto c = make_compressor(enc, level);
+    std::vector<temporary_buffer<char>> bufs;
+    c->run(data.data(), data.size(), codec::op::finish, bufs);
+    size_t size = 0;
+    for (auto& buf : bufs) {
+        size += buf.size();
+    }
+    sstring ret = uninitialized_string(size);
+    auto p = ret.data();
+    for (auto& buf : bufs) {
+        p = std::copy_n(buf.get(), buf.size(), p);
+    }
+    return ret;
+}
+
+output_stream<char> make_compressing_output_stream(output_stream<char> out, content_encoding enc, int level) {
+    return output_stream<char>(data_sink(std::make_unique<compressing_sink>(std::move(out), make_compressor(enc, level))), chunk_size);
+}
+
+input_stream<char> make_decompressing_input_stream(input_stream<char> in, content_encoding enc, size_t max_size) {
+    return input_stream<char>(data_source(std::make_unique<decompressing_source>(std::move(in), make_decompressor(enc), max_size)));
+}
+
+}
+
+}
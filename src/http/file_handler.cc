@@ -24,8 +24,12 @@ module;
 #endif
 
 #include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <memory>
+#include <unordered_map>
+#include <vector>
+#include <boost/intrusive/list.hpp>
 
 #ifdef SEASTAR_MODULE
 module seastar;
@@ -36,13 +40,442 @@ module seastar;
 #include <seastar/core/fstream.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/app-template.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/fsnotify.hh>
 #include <seastar/http/exception.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/mime_types.hh>
+#include <seastar/util/log.hh>
+#include <seastar/util/short_streams.hh>
 #endif
 
 namespace seastar {
 
+extern logger hlogger;
+
 namespace httpd {
 
+namespace bi = boost::intrusive;
+using experimental::fsnotifier;
+
+namespace {
+
+// Made of the size and modification time of the file, as most servers do
+sstring make_etag(uint64_t size, std::chrono::system_clock::time_point modified) {
+    return format("\"{:x}-{:x}\"", size,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count());
+}
+
+// Whether the validators of the file match those of a conditional request.
+// The dates are compared as strings, as the clients send back the
+// Last-Modified they were given.
+bool not_modified(const http::request& req, std::string_view etag, const sstring& last_modified) {
+    if (req._method != "GET" && req._method != "HEAD") {
+        return false;
+    }
+    auto if_none_match = req.get_header("If-None-Match");
+    if (!if_none_match.empty()) {
+        std::string_view tags = if_none_match;
+        while (!tags.empty()) {
+            auto comma = tags.find(',');
+            auto tag = tags.substr(0, comma);
+            tags = comma == std::string_view::npos ? std::string_view() : tags.substr(comma + 1);
+            while (!tag.empty() && tag.front() == ' ') {
+                tag.remove_prefix(1);
+            }
+            while (!tag.empty() && tag.back() == ' ') {
+                tag.remove_suffix(1);
+            }
+            // The comparison is the weak one
+            if (tag.starts_with("W/")) {
+                tag.remove_prefix(2);
+            }
+            if (tag == "*" || tag == etag) {
+                return true;
+            }
+        }
+        return false;
+    }
+    auto if_modified_since = req.get_header("If-Modified-Since");
+    return !if_modified_since.empty() && if_modified_since == last_modified;
+}
+
+// The bytes first to last of the content; an unsatisfiable range has first
+// after last
+struct byte_range {
+    uint64_t first;
+    uint64_t last;
+};
+
+std::optional<uint64_t> parse_position(std::string_view s) {
+    uint64_t v;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (s.empty() || ec != std::errc() || end != s.data() + s.size()) {
+        return std::nullopt;
+    }
+    return v;
+}
+
+// The range a Range header asks for, of a single range of bytes. Other
+// ones, like several ranges, are ignored, the whole content being sent.
+std::optional<byte_range> parse_range(std::string_view value, uint64_t size) {
+    if (!value.starts_with("bytes=")) {
+        return std::nullopt;
+    }
+    value.remove_prefix(6);
+    auto dash = value.find('-');
+    if (dash == std::string_view::npos || value.find(',') != std::string_view::npos) {
+        return std::nullopt;
+    }
+    auto last = parse_position(value.substr(dash + 1));
+    if (dash == 0) {
+        // The last bytes
+        if (!last) {
+            return std::nullopt;
+        }
+        if (!*last || !size) {
+            return byte_range{1, 0};
+        }
+        return byte_range{size - std::min(*last, size), size - 1};
+    }
+    auto first = parse_position(value.substr(0, dash));
+    if (!first || (!last && dash + 1 != value.size()) || (last && *last < *first)) {
+        return std::nullopt;
+    }
+    if (*first >= size) {
+        return byte_range{1, 0};
+    }
+    return byte_range{*first, std::min(last.value_or(size - 1), size - 1)};
+}
+
+// Sets the status and Content-Range of the reply to the range the request
+// asks for, if one
+std::optional<byte_range> set_range(const http::request& req, http::reply& rep, uint64_t size,
+        std::string_view etag, const sstring& last_modified) {
+    rep._headers["Accept-Ranges"] = "bytes";
+    auto value = req.get_header("Range");
+    if (value.empty() || req._method != "GET") {
+        return std::nullopt;
+    }
+    // The range is of the content the client has, if it is the current one
+    auto if_range = req.get_header("If-Range");
+    if (!if_range.empty() && if_range != etag && if_range != last_modified) {
+        return std::nullopt;
+    }
+    auto range = parse_range(value, size);
+    if (!range) {
+        return std::nullopt;
+    }
+    if (range->first > range->last) {
+        rep.set_status(http::reply::status_type::range_not_satisfiable);
+        rep._headers["Content-Range"] = format("bytes */{}", size);
+    } else {
+        rep.set_status(http::reply::status_type::partial_content);
+        rep._headers["Content-Range"] = format("bytes {}-{}/{}", range->first, range->last, size);
+    }
+    return range;
+}
+
+}
+
+// Replies with the file from the disk, or the part of it the request asks
+// for
+static std::unique_ptr<http::reply> reply_from_disk(sstring file_name, const sstring& extension, const stat_data& st,
+        const http::request& req, std::unique_ptr<http::reply> rep) {
+    auto etag = make_etag(st.size, st.time_modified);
+    auto last_modified = http_server::http_date(st.time_modified);
+    rep->_headers["ETag"] = etag;
+    rep->_headers["Last-Modified"] = last_modified;
+    if (not_modified(req, etag, last_modified)) {
+        rep->set_status(http::reply::status_type::not_modified).done(extension);
+        return rep;
+    }
+    auto range = set_range(req, *rep, st.size, etag, last_modified);
+    if (range && range->first > range->last) {
+        rep->done(extension);
+        return rep;
+    }
+    // Only the range is read from the disk, in reads as large as for the
+    // whole file
+    uint64_t offset = range ? range->first : 0;
+    uint64_t len = range ? range->last - range->first + 1 : st.size;
+    rep->write_body(extension, [file_name = std::move(file_name), offset, len] (output_stream<char>&& s) mutable {
+        return do_with(std::move(s), [file_name = std::move(file_name), offset, len] (output_stream<char>& os) {
+            return open_file_dma(file_name, open_flags::ro).then([&os, offset, len] (file f) {
+                return do_with(make_file_input_stream(std::move(f), offset, len), [&os] (input_stream<char>& is) {
+                    return copy(is, os).then([&os] {
+                        return os.close();
+                    }).then([&is] {
+                        return is.close();
+                    });
+                });
+            });
+        });
+    });
+    return rep;
+}
+
+class file_interaction_handler::file_cache : public enable_shared_from_this<file_cache> {
+public:
+    struct entry {
+        sstring path;
+        sstring content;
+        sstring etag;
+        sstring last_modified;
+        // The compressed variants made so far
+        std::vector<std::pair<http::content_encoding, sstring>> encoded;
+        fsnotifier::watch_token token;
+        bi::list_member_hook<> hook;
+
+        size_t size() const noexcept {
+            auto size = content.size();
+            for (auto& e : encoded) {
+                size += e.second.size();
+            }
+            return size;
+        }
+    };
+private:
+    struct watched {
+        fsnotifier::watch watch;
+        // The files of the inode
+        std::vector<sstring> paths;
+    };
+
+    file_cache_config _cfg;
+    fsnotifier _notifier;
+    std::unordered_map<sstring, entry> _entries;
+    std::unordered_map<fsnotifier::watch_token, watched> _watches;
+    // The least recently served first
+    bi::list<entry, bi::member_hook<entry, bi::list_member_hook<>, &entry::hook>> _lru;
+    size_t _size = 0;
+    // Bumped on every event, and watch removed, for the files read
+    // meanwhile not to be kept
+    uint64_t _generation = 0;
+    bool _stopped = false;
+
+    void drop(entry& e) noexcept {
+        _size -= e.size();
+        _lru.erase(_lru.iterator_to(e));
+        if (auto w = _watches.find(e.token); w != _watches.end()) {
+            std::erase(w->second.paths, e.path);
+            if (w->second.paths.empty()) {
+                // The files being read may share it
+                _generation++;
+                _watches.erase(w);
+            }
+        }
+        _entries.erase(e.path);
+    }
+
+    void shrink(const entry& keep) noexcept {
+        while (_size > _cfg.max_size && &_lru.front() != &keep) {
+            drop(_lru.front());
+        }
+    }
+
+    void invalidate(fsnotifier::watch_token token) {
+        _generation++;
+        auto w = _watches.find(token);
+        if (w == _watches.end()) {
+            return;
+        }
+        for (auto& path : std::vector<sstring>(w->second.paths)) {
+            if (auto e = _entries.find(path); e != _entries.end()) {
+                drop(e->second);
+            }
+        }
+        _watches.erase(token);
+    }
+
+    void clear() noexcept {
+        while (!_lru.empty()) {
+            drop(_lru.front());
+        }
+    }
+
+    future<> run() {
+        auto me = shared_from_this();
+        try {
+            while (!_stopped) {
+                auto events = co_await _notifier.wait();
+                for (auto& ev : events) {
+                    invalidate(ev.id);
+                }
+            }
+        } catch (...) {
+            // The files could be modified without the cache telling
+            if (!_stopped) {
+                hlogger.warn("Stopped caching files, failed to watch them: {}", std::current_exception());
+                _stopped = true;
+            }
+        }
+        clear();
+    }
+
+public:
+    explicit file_cache(file_cache_config cfg)
+            : _cfg(std::move(cfg)) {
+    }
+
+    void start() {
+        // The loop holds the cache until stopped
+        (void)run();
+    }
+
+    void stop() {
+        if (!_stopped) {
+            _stopped = true;
+            _notifier.shutdown();
+        }
+    }
+
+    const file_cache_config& config() const noexcept {
+        return _cfg;
+    }
+
+    entry* find(const sstring& path) noexcept {
+        auto e = _entries.find(path);
+        if (e == _entries.end()) {
+            return nullptr;
+        }
+        _lru.erase(_lru.iterator_to(e->second));
+        _lru.push_back(e->second);
+        return &e->second;
+    }
+
+    // Replies with the file, read to be kept if it is small enough, from
+    // the disk if it was modified while read
+    future<std::unique_ptr<http::reply>> serve(sstring path, sstring extension, stat_data st,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+        auto me = shared_from_this();
+        auto generation = _generation;
+        std::optional<fsnotifier::watch> w;
+        std::exception_ptr ex;
+        if (!_stopped) {
+            try {
+                w = co_await _notifier.create_watch(path, fsnotifier::flags::modify | fsnotifier::flags::attrib
+                        | fsnotifier::flags::delete_self | fsnotifier::flags::move_self);
+            } catch (...) {
+                hlogger.debug("Not caching {}, failed to watch it: {}", path, std::current_exception());
+            }
+        }
+        if (!w) {
+            co_return reply_from_disk(std::move(path), extension, st, *req, std::move(rep));
+        }
+        // The watch of another path of the same inode is the one kept
+        auto token = w->token();
+        if (_watches.contains(token)) {
+            w->release();
+        }
+        auto f = co_await open_file_dma(path, open_flags::ro);
+        entry e;
+        try {
+            auto fst = co_await f.stat();
+            if (S_ISREG(fst.st_mode) && uint64_t(fst.st_size) <= _cfg.max_file_size) {
+                auto modified = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                        std::chrono::seconds(fst.st_mtim.tv_sec) + std::chrono::nanoseconds(fst.st_mtim.tv_nsec)));
+                auto in = make_file_input_stream(f);
+                e.content = co_await util::read_entire_stream_contiguous(in);
+                co_await in.close();
+                e.etag = make_etag(fst.st_size, modified);
+                e.last_modified = http_server::http_date(modified);
+            }
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await f.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+        if (auto kept = find(path)) {
+            co_return respond(*kept, extension, *req, std::move(rep));
+        }
+        if (e.etag.empty() || e.content.size() > _cfg.max_file_size || generation != _generation || _stopped) {
+            co_return reply_from_disk(std::move(path), extension, st, *req, std::move(rep));
+        }
+
+        auto it = _watches.find(token);
+        if (it == _watches.end()) {
+            it = _watches.emplace(token, watched{std::move(*w), {}}).first;
+        }
+        it->second.paths.push_back(path);
+        e.path = path;
+        e.token = token;
+        auto& kept = _entries.emplace(path, std::move(e)).first->second;
+        _lru.push_back(kept);
+        _size += kept.size();
+        shrink(kept);
+        co_return respond(kept, extension, *req, std::move(rep));
+    }
+
+    // Replies with the file kept, or the part of it the request asks for,
+    // compressed as the client accepts it
+    std::unique_ptr<http::reply> respond(entry& e, const sstring& extension, const http::request& req, std::unique_ptr<http::reply> rep) {
+        const sstring* content = &e.content;
+        sstring etag = e.etag;
+        auto& compression = _cfg.compression;
+        if (compression && e.content.size() >= compression->min_size
+                && compression->compressible(http::mime_types::extension_to_type(extension))) {
+            rep->_headers["Vary"] = "Accept-Encoding";
+            // A range is of the content not compressed
+            auto enc = req.get_header("Range").empty()
+                    ? http::negotiate_content_encoding(req.get_header("Accept-Encoding"), compression->encodings)
+                    : std::nullopt;
+            if (enc) {
+                content = &encoded(e, *enc);
+                // Each variant has a tag of its own
+                etag = format("{}-{}\"", etag.substr(0, etag.size() - 1), http::to_string(*enc));
+                rep->_headers["Content-Encoding"] = sstring(http::to_string(*enc));
+            }
+        }
+        rep->_headers["ETag"] = etag;
+        rep->_headers["Last-Modified"] = e.last_modified;
+        if (not_modified(req, etag, e.last_modified)) {
+            rep->_headers.erase("Content-Encoding");
+            rep->set_status(http::reply::status_type::not_modified).done(extension);
+            return rep;
+        }
+        auto range = set_range(req, *rep, content->size(), etag, e.last_modified);
+        if (!range) {
+            rep->write_body(extension, *content);
+        } else if (range->first > range->last) {
+            rep->done(extension);
+        } else {
+            rep->write_body(extension, content->substr(range->first, range->last - range->first + 1));
+        }
+        return rep;
+    }
+
+    // The content of the entry compressed with enc, compressing it once
+    const sstring& encoded(entry& e, http::content_encoding enc) {
+        for (auto& v : e.encoded) {
+            if (v.first == enc) {
+                return v.second;
+            }
+        }
+        auto& cfg = *_cfg.compression;
+        int level = enc == http::content_encoding::zstd ? cfg.zstd_level : cfg.zlib_level;
+        auto& v = e.encoded.emplace_back(enc, http::compress(enc, e.content, level));
+        _size += v.second.size();
+        shrink(e);
+        return v.second;
+    }
+};
+
+file_interaction_handler::file_interaction_handler(file_transformer* p)
+        : transformer(p) {
+}
+
+file_interaction_handler* file_interaction_handler::set_cache(file_cache_config cfg) {
+    if (_cache) {
+        _cache->stop();
+    }
+    _cache = make_shared<file_cache>(std::move(cfg));
+    _cache->start();
+    return this;
+}
+
 directory_handler::directory_handler(const sstring& doc_root,
         file_transformer* transformer)
         : file_interaction_handler(transformer), doc_root(doc_root) {
@@ -70,6 +503,9 @@ future<std::unique_ptr<http::reply>> directory_handler::handle(const sstring& pa
 }
 
 file_interaction_handler::~file_interaction_handler() {
+    if (_cache) {
+        _cache->stop();
+    }
     delete transformer;
 }
 
@@ -97,6 +533,25 @@ future<std::unique_ptr<http::reply>> file_interaction_handler::read(
         sstring file_name, std::unique_ptr<http::request> req,
         std::unique_ptr<http::reply> rep) {
     sstring extension = get_extension(file_name);
+    if (!transformer) {
+        if (_cache) {
+            if (auto e = _cache->find(file_name)) {
+                return make_ready_future<std::unique_ptr<http::reply>>(_cache->respond(*e, extension, *req, std::move(rep)));
+            }
+        }
+        return file_stat(file_name).handle_exception_type([] (const std::system_error& e) -> stat_data {
+            if (e.code().value() == ENOENT) {
+                throw not_found_exception();
+            }
+            throw;
+        }).then([this, file_name, extension, req = std::move(req), rep = std::move(rep)] (stat_data st) mutable {
+            if (!_cache || st.size > _cache->config().max_file_size || st.type != directory_entry_type::regular) {
+                return make_ready_future<std::unique_ptr<http::reply>>(reply_from_disk(std::move(file_name), extension, st, *req, std::move(rep)));
+            }
+            return _cache->serve(std::move(file_name), std::move(extension), st, std::move(req), std::move(rep));
+        });
+    }
+
     rep->write_body(extension, [req = std::move(req), extension, file_name, this] (output_stream<char>&& s) mutable {
         return do_with(get_stream(std::move(req), extension, std::move(s)),
                 [file_name] (output_stream<char>& os) {
@@ -0,0 +1,519 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/http/internal/hpack.hh>
+#include <seastar/core/print.hh>
+#include <array>
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+namespace {
+
+struct static_entry {
+    std::string_view name;
+    std::string_view value;
+};
+
+// RFC 7541, Appendix A
+constexpr std::array<static_entry, hpack_table::static_size> static_table = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+struct huffman_code {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541, Appendix B, the last one being EOS
+constexpr std::array<huffman_code, 257> huffman_codes = {{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+}};
+
+constexpr unsigned eos = 256;
+
+// The code as a binary tree, each node with the index of its two
+// children, or of the symbol, negated, at the leaves
+class huffman_tree {
+    std::vector<std::array<int16_t, 2>> _nodes;
+public:
+    huffman_tree() {
+        _nodes.push_back({0, 0});
+        for (unsigned sym = 0; sym < huffman_codes.size(); sym++) {
+            auto [code, bits] = huffman_codes[sym];
+            size_t node = 0;
+            for (int b = bits - 1; b >= 0; b--) {
+                auto bit = (code >> b) & 1;
+                if (b == 0) {
+                    _nodes[node][bit] = -int16_t(sym) - 1;
+                } else {
+                    if (_nodes[node][bit] == 0) {
+                        _nodes[node][bit] = _nodes.size();
+                        _nodes.push_back({0, 0});
+                    }
+                    node = _nodes[node][bit];
+                }
+            }
+        }
+    }
+    int16_t next(size_t node, unsigned bit) const noexcept {
+        return _nodes[node][bit];
+    }
+};
+
+const huffman_tree& get_huffman_tree() {
+    static const huffman_tree tree;
+    return tree;
+}
+
+bool is_sensitive(std::string_view name) {
+    return name == "authorization" || name == "proxy-authorization" || name == "set-cookie";
+}
+
+void encode_integer(std::string& out, uint8_t flags, unsigned prefix, uint64_t value) {
+    uint64_t max = (1u << prefix) - 1;
+    if (value < max) {
+        out.push_back(char(flags | value));
+        return;
+    }
+    out.push_back(char(flags | max));
+    value -= max;
+    while (value >= 128) {
+        out.push_back(char(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+void encode_string(std::string& out, std::string_view s, bool huffman) {
+    if (huffman) {
+        auto size = huffman_encoded_size(s);
+        if (size < s.size()) {
+            encode_integer(out, 0x80, 7, size);
+            huffman_encode(out, s);
+            return;
+        }
+    }
+    encode_integer(out, 0, 7, s.size());
+    out.append(s);
+}
+
+class block_reader {
+    const char* _p;
+    const char* _end;
+public:
+    explicit block_reader(std::string_view block) : _p(block.data()), _end(block.data() + block.size()) {}
+
+    bool empty() const noexcept {
+        return _p == _end;
+    }
+    uint8_t peek() const noexcept {
+        return *_p;
+    }
+    uint64_t integer(unsigned prefix) {
+        uint64_t max = (1u << prefix) - 1;
+        uint64_t value = uint8_t(*_p++) & max;
+        if (value < max) {
+            return value;
+        }
+        for (unsigned shift = 0; ; shift += 7) {
+            if (_p == _end) {
+                throw hpack_error("HPACK integer truncated");
+            }
+            // Nothing we take is near as large
+            if (shift > 28) {
+                throw hpack_error("HPACK integer overflow");
+            }
+            uint8_t b = *_p++;
+            value += uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+    }
+    sstring string() {
+        if (_p == _end) {
+            throw hpack_error("HPACK string truncated");
+        }
+        bool huffman = peek() & 0x80;
+        auto size = integer(7);
+        if (size > size_t(_end - _p)) {
+            throw hpack_error("HPACK string truncated");
+        }
+        std::string_view s(_p, size);
+        _p += size;
+        return huffman ? huffman_decode(s) : sstring(s.data(), s.size());
+    }
+};
+
+}
+
+size_t huffman_encoded_size(std::string_view s) noexcept {
+    size_t bits = 0;
+    for (unsigned char c : s) {
+        bits += huffman_codes[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void huffman_encode(std::string& out, std::string_view s) {
+    uint64_t acc = 0;
+    unsigned bits = 0;
+    for (unsigned char c : s) {
+        auto [code, n] = huffman_codes[c];
+        acc = (acc << n) | code;
+        bits += n;
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back(char(acc >> bits));
+        }
+    }
+    if (bits) {
+        // Padded with the most significant bits of EOS, all ones
+        out.push_back(char((acc << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+sstring huffman_decode(std::string_view s) {
+    auto& tree = get_huffman_tree();
+    std::string out;
+    out.reserve(s.size() * 8 / 5);
+    size_t node = 0;
+    // The bits since the last symbol, which may only be the padding
+    unsigned pending = 0;
+    bool all_ones = true;
+    for (unsigned char c : s) {
+        for (int b = 7; b >= 0; b--) {
+            unsigned bit = (c >> b) & 1;
+            auto next = tree.next(node, bit);
+            pending++;
+            all_ones &= bit;
+            if (next < 0) {
+                unsigned sym = -next - 1;
+                if (sym == eos) {
+                    throw hpack_error("HPACK Huffman string contains EOS");
+                }
+                out.push_back(char(sym));
+                node = 0;
+                pending = 0;
+                all_ones = true;
+            } else {
+                node = next;
+            }
+        }
+    }
+    if (pending > 7 || !all_ones) {
+        throw hpack_error("HPACK Huffman string badly padded");
+    }
+    return sstring(out.data(), out.size());
+}
+
+std::pair<std::string_view, std::string_view> hpack_table::get(size_t index) const {
+    if (index == 0) {
+        throw hpack_error("HPACK index 0");
+    }
+    if (index <= static_size) {
+        auto& e = static_table[index - 1];
+        return {e.name, e.value};
+    }
+    index -= static_size + 1;
+    if (index >= _entries.size()) {
+        throw hpack_error(format("HPACK index {} out of the table", index + static_size + 1));
+    }
+    auto& e = _entries[index];
+    return {std::string_view(e.name), std::string_view(e.value)};
+}
+
+void hpack_table::evict(size_t room) {
+    while (!_entries.empty() && _size + room > _max_size) {
+        auto& e = _entries.back();
+        _size -= e.name.size() + e.value.size() + entry_overhead;
+        _entries.pop_back();
+    }
+}
+
+void hpack_table::add(sstring name, sstring value) {
+    auto size = name.size() + value.size() + entry_overhead;
+    evict(size);
+    // An entry larger than the table just empties it
+    if (size <= _max_size) {
+        _entries.push_front(entry{std::move(name), std::move(value)});
+        _size += size;
+    }
+}
+
+void hpack_table::set_max_size(size_t max_size) {
+    _max_size = max_size;
+    evict(0);
+}
+
+ssize_t hpack_table::find(std::string_view name, std::string_view value) const {
+    ssize_t name_index = 0;
+    for (size_t i = 0; i < static_table.size(); i++) {
+        if (static_table[i].name == name) {
+            if (static_table[i].value == value) {
+                return i + 1;
+            }
+            if (!name_index) {
+                name_index = -ssize_t(i + 1);
+            }
+        }
+    }
+    for (size_t i = 0; i < _entries.size(); i++) {
+        if (_entries[i].name == name) {
+            if (_entries[i].value == value) {
+                return static_size + i + 1;
+            }
+            if (!name_index) {
+                name_index = -ssize_t(static_size + i + 1);
+            }
+        }
+    }
+    return name_index;
+}
+
+void hpack_encoder::set_max_table_size(size_t max_size) {
+    // A larger table than the default is allowed, not required
+    max_size = std::min<size_t>(max_size, 4096);
+    if (max_size == _table.max_size() && !_size_update) {
+        return;
+    }
+    _min_size_update = std::min(_min_size_update.value_or(max_size), max_size);
+    _size_update = max_size;
+    _table.set_max_size(max_size);
+}
+
+void hpack_encoder::encode(std::string& out, std::string_view name, std::string_view value) {
+    auto index = _table.find(name, value);
+    if (index > 0) {
+        encode_integer(out, 0x80, 7, index);
+        return;
+    }
+    size_t name_index = -index;
+    if (is_sensitive(name)) {
+        // Never indexed
+        encode_integer(out, 0x10, 4, name_index);
+    } else if (name.size() + value.size() + hpack_table::entry_overhead > _table.max_size() / 2) {
+        // Not worth evicting the rest of the table for
+        encode_integer(out, 0, 4, name_index);
+    } else {
+        encode_integer(out, 0x40, 6, name_index);
+        _table.add(sstring(name.data(), name.size()), sstring(value.data(), value.size()));
+    }
+    if (!name_index) {
+        encode_string(out, name, _huffman);
+    }
+    encode_string(out, value, _huffman);
+}
+
+void hpack_encoder::encode(std::string& out, const header_list& headers) {
+    if (_size_update) {
+        if (*_min_size_update < *_size_update) {
+            encode_integer(out, 0x20, 5, *_min_size_update);
+        }
+        encode_integer(out, 0x20, 5, *_size_update);
+        _min_size_update.reset();
+        _size_update.reset();
+    }
+    for (auto& [name, value] : headers) {
+        encode(out, name, value);
+    }
+}
+
+header_list hpack_decoder::decode(std::string_view block) {
+    header_list headers;
+    block_reader r(block);
+    size_t list_size = 0;
+    bool first = true;
+    while (!r.empty()) {
+        auto b = r.peek();
+        if ((b & 0xe0) == 0x20) {
+            if (!first) {
+                throw hpack_error("HPACK table size update after a header");
+            }
+            auto size = r.integer(5);
+            if (size > _max_table_size) {
+                throw hpack_error(format("HPACK table size update to {} exceeds {}", size, _max_table_size));
+            }
+            _table.set_max_size(size);
+            continue;
+        }
+        first = false;
+        sstring name, value;
+        if (b & 0x80) {
+            auto [n, v] = _table.get(r.integer(7));
+            name = sstring(n.data(), n.size());
+            value = sstring(v.data(), v.size());
+        } else {
+            bool indexing = b & 0x40;
+            auto index = r.integer(indexing ? 6 : 4);
+            if (index) {
+                auto n = _table.get(index).first;
+                name = sstring(n.data(), n.size());
+            } else {
+                name = r.string();
+            }
+            value = r.string();
+            if (indexing) {
+                _table.add(name, value);
+            }
+        }
+        list_size += name.size() + value.size() + hpack_table::entry_overhead;
+        if (list_size > _max_list_size) {
+            throw hpack_error(format("HPACK header list exceeds {} bytes", _max_list_size));
+        }
+        headers.emplace_back(std::move(name), std::move(value));
+    }
+    return headers;
+}
+
+}
+
+}
+
+}
@@ -0,0 +1,888 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/http/internal/http2.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/print.hh>
+#include <seastar/net/packet.hh>
+#include <seastar/util/log.hh>
+#include <system_error>
+#include <vector>
+
+namespace seastar {
+
+extern logger http_log;
+
+namespace http {
+
+namespace internal {
+
+namespace http2 {
+
+namespace {
+
+namespace flags {
+constexpr uint8_t end_stream = 0x1;
+constexpr uint8_t ack = 0x1;
+constexpr uint8_t end_headers = 0x4;
+constexpr uint8_t padded = 0x8;
+constexpr uint8_t priority = 0x20;
+}
+
+enum class setting : uint16_t {
+    header_table_size = 1, enable_push = 2, max_concurrent_streams = 3,
+    initial_window_size = 4, max_frame_size = 5, max_header_list_size = 6,
+};
+
+constexpr size_t frame_header_size = 9;
+constexpr int64_t max_window = (int64_t(1) << 31) - 1;
+constexpr uint32_t max_stream_id = (uint32_t(1) << 31) - 1;
+// The frames sent in the background, replies to PING and SETTINGS and
+// resets among them, that may be pending before frames are not read
+constexpr size_t max_pending_sends = 64;
+
+std::exception_ptr connection_aborted() {
+    return std::make_exception_ptr(std::system_error(ECONNABORTED, std::system_category()));
+}
+
+}
+
+bool is_connection_specific(std::string_view name) noexcept {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+            || name == "transfer-encoding" || name == "upgrade";
+}
+
+class stream_source final : public data_source_impl {
+    session::stream_ptr _s;
+    std::unordered_map<sstring, sstring>* _trailers;
+public:
+    stream_source(session::stream_ptr s, std::unordered_map<sstring, sstring>* trailers) : _s(std::move(s)), _trailers(trailers) {}
+    virtual future<temporary_buffer<char>> get() override {
+        return _s->read().then([this] (temporary_buffer<char> buf) {
+            if (buf.empty() && _trailers) {
+                for (auto& [name, value] : _s->trailers()) {
+                    (*_trailers)[name] = value;
+                }
+            }
+            return buf;
+        });
+    }
+    virtual future<> close() override {
+        return make_ready_future<>();
+    }
+};
+
+class stream_sink final : public data_sink_impl {
+    session::stream_ptr _s;
+public:
+    explicit stream_sink(session::stream_ptr s) : _s(std::move(s)) {}
+    virtual future<> put(net::packet p) override {
+        return put(p.release());
+    }
+    virtual future<> put(std::vector<temporary_buffer<char>> bufs) override {
+        for (auto& buf : bufs) {
+            co_await put(std::move(buf));
+        }
+    }
+    virtual future<> put(temporary_buffer<char> buf) override {
+        if (!_s->_session) {
+            return make_exception_future<>(_s->closed_error());
+        }
+        return _s->_session->send_data(*_s, std::move(buf), false);
+    }
+    virtual future<> close() override {
+        if (!_s->_session) {
+            return _s->_local_closed ? make_ready_future<>() : make_exception_future<>(_s->closed_error());
+        }
+        return _s->_session->finish(*_s);
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return 16384;
+    }
+};
+
+std::exception_ptr session::stream::closed_error() const {
+    return _error ? _error : std::make_exception_ptr(stream_error(error_code::stream_closed, "HTTP/2 stream closed"));
+}
+
+void session::stream::wake() {
+    if (_data_waiter) {
+        std::exchange(_data_waiter, std::nullopt)->set_value();
+    }
+    if (_headers_waiter && (_headers_received || _error)) {
+        auto w = std::exchange(_headers_waiter, std::nullopt);
+        if (_headers_received) {
+            w->set_value();
+        } else {
+            w->set_exception(_error);
+        }
+    }
+}
+
+future<> session::stream::wait_headers() {
+    if (_headers_received) {
+        return make_ready_future<>();
+    }
+    if (_error) {
+        return make_exception_future<>(_error);
+    }
+    _headers_waiter.emplace();
+    return _headers_waiter->get_future();
+}
+
+future<temporary_buffer<char>> session::stream::read() {
+    if (!_data.empty()) {
+        auto buf = std::move(_data.front());
+        _data.pop_front();
+        _unread -= buf.size();
+        if (_session) {
+            _session->consumed(*this, buf.size());
+        }
+        return make_ready_future<temporary_buffer<char>>(std::move(buf));
+    }
+    if (_remote_closed) {
+        return make_ready_future<temporary_buffer<char>>();
+    }
+    if (_error) {
+        return make_exception_future<temporary_buffer<char>>(_error);
+    }
+    _data_waiter.emplace();
+    return _data_waiter->get_future().then([s = shared_from_this()] {
+        return s->read();
+    });
+}
+
+session::session(role r, input_stream<char>& in, output_stream<char>& out, config cfg, stream_handler on_stream)
+        : _role(r)
+        , _in(in)
+        , _out(out)
+        , _cfg(cfg)
+        , _decoder(4096, cfg.max_header_list_size)
+        , _on_stream(std::move(on_stream))
+        , _next_stream_id(r == role::client ? 1 : 2)
+{
+}
+
+session::~session() {
+    fail(connection_aborted());
+}
+
+template <typename Func>
+future<> session::with_write_lock(Func func) {
+    if (_error) {
+        std::rethrow_exception(_error);
+    }
+    auto units = co_await get_units(_write_sem, 1);
+    if (_error) {
+        std::rethrow_exception(_error);
+    }
+    try {
+        co_await futurize_invoke(func);
+        // Writers waiting for the lock flush the frames after theirs
+        if (!_write_sem.waiters()) {
+            co_await _out.flush();
+        }
+    } catch (...) {
+        fail(std::current_exception());
+        throw;
+    }
+}
+
+future<> session::write_frame_locked(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    temporary_buffer<char> head(frame_header_size);
+    auto p = head.get_write();
+    auto size = payload.size();
+    p[0] = size >> 16;
+    p[1] = size >> 8;
+    p[2] = size;
+    p[3] = uint8_t(type);
+    p[4] = flags;
+    write_be<uint32_t>(p + 5, stream_id);
+    if (payload.empty()) {
+        return _out.write(std::move(head));
+    }
+    return _out.write(std::move(head)).then([this, payload = std::move(payload)] () mutable {
+        return _out.write(std::move(payload));
+    });
+}
+
+future<> session::write_frame(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    return with_write_lock([this, type, flags, stream_id, payload = std::move(payload)] () mutable {
+        return write_frame_locked(type, flags, stream_id, std::move(payload));
+    });
+}
+
+future<> session::write_headers_locked(uint32_t stream_id, const header_list& headers, bool end_stream) {
+    // Encoded under the lock, for the blocks to reach the peer in the
+    // order its decoder expects
+    std::string block;
+    _encoder.encode(block, headers);
+    std::string_view rest(block);
+    auto type = frame_type::headers;
+    uint8_t f = end_stream ? flags::end_stream : 0;
+    do {
+        auto n = std::min<size_t>(rest.size(), _peer.max_frame_size);
+        if (n == rest.size()) {
+            f |= flags::end_headers;
+        }
+        co_await write_frame_locked(type, f, stream_id, temporary_buffer<char>(rest.data(), n));
+        rest.remove_prefix(n);
+        type = frame_type::continuation;
+        f = 0;
+    } while (!rest.empty());
+}
+
+void session::send_in_background(noncopyable_function<future<>()> send) {
+    (void)try_with_gate(_background, [this, send = std::move(send)] () mutable {
+        ++_pending_sends;
+        return futurize_invoke(send).finally([this] {
+            --_pending_sends;
+            _sends_cv.signal();
+        });
+    }).handle_exception([] (std::exception_ptr ex) {
+        // The connection fails, if it did not already
+        http_log.trace("HTTP/2 background send failed: {}", ex);
+    });
+}
+
+void session::send_rst_stream(uint32_t stream_id, error_code code) {
+    send_in_background([this, stream_id, code] {
+        temporary_buffer<char> payload(4);
+        write_be<uint32_t>(payload.get_write(), uint32_t(code));
+        return write_frame(frame_type::rst_stream, 0, stream_id, std::move(payload));
+    });
+}
+
+void session::send_window_update(uint32_t stream_id, uint32_t increment) {
+    send_in_background([this, stream_id, increment] {
+        temporary_buffer<char> payload(4);
+        write_be<uint32_t>(payload.get_write(), increment);
+        return write_frame(frame_type::window_update, 0, stream_id, std::move(payload));
+    });
+}
+
+future<> session::send_preamble() {
+    std::vector<std::pair<setting, uint32_t>> settings = {
+        {setting::max_concurrent_streams, _cfg.max_concurrent_streams},
+        {setting::initial_window_size, _cfg.stream_window},
+        {setting::max_frame_size, _cfg.max_frame_size},
+        {setting::max_header_list_size, _cfg.max_header_list_size},
+    };
+    if (_role == role::client) {
+        settings.emplace_back(setting::enable_push, 0);
+    }
+    temporary_buffer<char> payload(settings.size() * 6);
+    auto p = payload.get_write();
+    for (auto [id, value] : settings) {
+        write_be<uint16_t>(p, uint16_t(id));
+        write_be<uint32_t>(p + 2, value);
+        p += 6;
+    }
+    return with_write_lock([this, payload = std::move(payload)] () mutable -> future<> {
+        if (_role == role::client) {
+            co_await _out.write(preface.data(), preface.size());
+        }
+        co_await write_frame_locked(frame_type::settings, 0, 0, std::move(payload));
+        if (_cfg.connection_window > _recv_window) {
+            temporary_buffer<char> update(4);
+            write_be<uint32_t>(update.get_write(), _cfg.connection_window - _recv_window);
+            _recv_window = _cfg.connection_window;
+            co_await write_frame_locked(frame_type::window_update, 0, 0, std::move(update));
+        }
+    });
+}
+
+future<> session::run() {
+    std::exception_ptr ex;
+    std::optional<error_code> goaway;
+    try {
+        co_await send_preamble();
+        co_await read_frames();
+    } catch (const connection_error& e) {
+        http_log.debug("HTTP/2 connection error: {}", e.what());
+        ex = std::current_exception();
+        goaway = e.code();
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    if (goaway) {
+        try {
+            co_await shutdown(*goaway);
+        } catch (...) {
+        }
+    }
+    fail(ex ? ex : connection_aborted());
+    co_await _background.close();
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+}
+
+future<> session::shutdown(error_code code) {
+    if (_goaway_sent) {
+        return make_ready_future<>();
+    }
+    _goaway_sent = true;
+    temporary_buffer<char> payload(8);
+    write_be<uint32_t>(payload.get_write(), _last_peer_stream_id);
+    write_be<uint32_t>(payload.get_write() + 4, uint32_t(code));
+    return write_frame(frame_type::goaway, 0, 0, std::move(payload));
+}
+
+future<> session::read_frames() {
+    while (true) {
+        if (_pending_sends >= max_pending_sends) {
+            // The peer does not read what it is sent
+            co_await _sends_cv.wait([this] { return _pending_sends < max_pending_sends; });
+        }
+        auto head = co_await _in.read_exactly(frame_header_size);
+        if (head.size() < frame_header_size) {
+            co_return;
+        }
+        auto p = reinterpret_cast<const uint8_t*>(head.get());
+        uint32_t size = (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+        auto type = frame_type(p[3]);
+        uint8_t f = p[4];
+        uint32_t stream_id = read_be<uint32_t>(head.get() + 5) & max_stream_id;
+        if (size > _cfg.max_frame_size) {
+            throw connection_error(error_code::frame_size_error, format("HTTP/2 frame of {} bytes", size));
+        }
+        temporary_buffer<char> payload;
+        if (size) {
+            payload = co_await _in.read_exactly(size);
+            if (payload.size() < size) {
+                co_return;
+            }
+        }
+        if (_continuation_stream && (type != frame_type::continuation || stream_id != _continuation_stream)) {
+            throw connection_error(error_code::protocol_error, "HTTP/2 header block interrupted");
+        }
+        co_await handle_frame(type, f, stream_id, std::move(payload));
+    }
+}
+
+future<> session::handle_frame(frame_type type, uint8_t f, uint32_t stream_id, temporary_buffer<char> payload) {
+    switch (type) {
+    case frame_type::data:
+        handle_data(f, stream_id, std::move(payload));
+        break;
+    case frame_type::headers:
+        return handle_headers(f, stream_id, std::move(payload));
+    case frame_type::continuation:
+        if (!_continuation_stream) {
+            throw connection_error(error_code::protocol_error, "HTTP/2 CONTINUATION without HEADERS");
+        }
+        _header_block.append(payload.get(), payload.size());
+        if (_header_block.size() > _cfg.max_header_list_size * 2) {
+            throw connection_error(error_code::enhance_your_calm, "HTTP/2 header block too large");
+        }
+        if (f & flags::end_headers) {
+            auto block = std::exchange(_header_block, {});
+            _continuation_stream = 0;
+            handle_header_block(stream_id, _continuation_end_stream, block);
+        }
+        break;
+    case frame_type::priority:
+        if (stream_id == 0) {
+            throw connection_error(error_code::protocol_error, "HTTP/2 PRIORITY on stream 0");
+        }
+        break;
+    case frame_type::rst_stream:
+        handle_rst_stream(stream_id, std::move(payload));
+        break;
+    case frame_type::settings:
+        return handle_settings(f, stream_id, std::move(payload));
+    case frame_type::push_promise:
+        // The client disables push, and may not push
+        throw connection_error(error_code::protocol_error, "HTTP/2 PUSH_PROMISE");
+    case frame_type::ping:
+        if (stream_id != 0 || payload.size() != 8) {
+            throw connection_error(stream_id ? error_code::protocol_error : error_code::frame_size_error, "HTTP/2 bad PING");
+        }
+        if (!(f & flags::ack)) {
+            send_in_background([this, payload = std::move(payload)] () mutable {
+                return write_frame(frame_type::ping, flags::ack, 0, std::move(payload));
+            });
+        }
+        break;
+    case frame_type::goaway:
+        handle_goaway(std::move(payload));
+        break;
+    case frame_type::window_update:
+        handle_window_update(stream_id, std::move(payload));
+        break;
+    default:
+        // Unknown frames are ignored
+        break;
+    }
+    return make_ready_future<>();
+}
+
+future<> session::handle_headers(uint8_t f, uint32_t stream_id, temporary_buffer<char> payload) {
+    if (stream_id == 0) {
+        throw connection_error(error_code::protocol_error, "HTTP/2 HEADERS on stream 0");
+    }
+    size_t pad = 0;
+    if (f & flags::padded) {
+        if (payload.empty()) {
+            throw connection_error(error_code::protocol_error, "HTTP/2 bad padding");
+        }
+        pad = uint8_t(payload[0]);
+        payload.trim_front(1);
+    }
+    if (f & flags::priority) {
+        if (payload.size() < 5) {
+            throw connection_error(error_code::protocol_error, "HTTP/2 bad priority");
+        }
+        payload.trim_front(5);
+    }
+    if (pad > payload.size()) {
+        throw connection_error(error_code::protocol_error, "HTTP/2 bad padding");
+    }
+    payload.trim(payload.size() - pad);
+    bool end_stream = f & flags::end_stream;
+    if (f & flags::end_headers) {
+        handle_header_block(stream_id, end_stream, std::string_view(payload.get(), payload.size()));
+    } else {
+        _continuation_stream = stream_id;
+        _continuation_end_stream = end_stream;
+        _header_block.assign(payload.get(), payload.size());
+    }
+    return make_ready_future<>();
+}
+
+void session::handle_header_block(uint32_t stream_id, bool end_stream, std::string_view block) {
+    header_list headers;
+    try {
+        // Always decoded, for the table to remain that of the encoder
+        headers = _decoder.decode(block);
+    } catch (const hpack_error& e) {
+        throw connection_error(error_code::compression_error, e.what());
+    }
+    auto s = find_stream(stream_id);
+    if (!s) {
+        if (_role == role::client) {
+            // A stream the client reset
+            return;
+        }
+        if (stream_id % 2 == 0 || stream_id <= _last_peer_stream_id) {
+            throw connection_error(stream_id % 2 ? error_code::stream_closed : error_code::protocol_error,
+                    format("HTTP/2 HEADERS on stream {}", stream_id));
+        }
+        _last_peer_stream_id = stream_id;
+        if (_goaway_sent) {
+            return;
+        }
+        if (_held_streams >= _cfg.max_concurrent_streams) {
+            send_rst_stream(stream_id, error_code::refused_stream);
+            return;
+        }
+        s = make_lw_shared<stream>(*this, stream_id, _peer.initial_window_size, _cfg.stream_window);
+        s->_headers = std::move(headers);
+        s->_headers_received = true;
+        s->_remote_closed = end_stream;
+        s->_held = true;
+        ++_held_streams;
+        _streams.emplace(stream_id, s);
+        _on_stream(std::move(s));
+        return;
+    }
+    if (s->_remote_closed) {
+        send_rst_stream(stream_id, error_code::stream_closed);
+        reset_stream(*s, std::make_exception_ptr(stream_error(error_code::stream_closed, "HTTP/2 HEADERS after END_STREAM")));
+        return;
+    }
+    if (!s->_headers_received) {
+        auto status = std::find_if(headers.begin(), headers.end(), [] (auto& h) { return h.first == ":status"; });
+        if (status != headers.end() && status->second.size() == 3 && status->second[0] == '1') {
+            // An informational response, the final one comes next
+            return;
+        }
+        s->_headers = std::move(headers);
+        s->_headers_received = true;
+    } else if (!end_stream) {
+        send_rst_stream(stream_id, error_code::protocol_error);
+        reset_stream(*s, std::make_exception_ptr(stream_error(error_code::protocol_error, "HTTP/2 trailers without END_STREAM")));
+        return;
+    } else {
+        s->_trailers = std::move(headers);
+    }
+    if (end_stream) {
+        s->_remote_closed = true;
+    }
+    s->wake();
+    maybe_close_stream(*s);
+}
+
+void session::handle_data(uint8_t f, uint32_t stream_id, temporary_buffer<char> payload) {
+    if (stream_id == 0) {
+        throw connection_error(error_code::protocol_error, "HTTP/2 DATA on stream 0");
+    }
+    auto size = payload.size();
+    if (int64_t(size) > _recv_window) {
+        throw connection_error(error_code::flow_control_error, "HTTP/2 connection window exceeded");
+    }
+    _recv_window -= size;
+    if (f & flags::padded) {
+        if (payload.empty() || uint8_t(payload[0]) >= payload.size()) {
+            throw connection_error(error_code::protocol_error, "HTTP/2 bad padding");
+        }
+        size_t pad = uint8_t(payload[0]);
+        payload.trim_front(1);
+        payload.trim(payload.size() - pad);
+    }
+    auto s = find_stream(stream_id);
+    if (!s || s->_remote_closed) {
+        consumed(size);
+        uint32_t last = _role == role::client ? std::max<uint32_t>(_next_stream_id, 2) - 2 : _last_peer_stream_id;
+        if (!s && (stream_id > last || stream_id % 2 == 0)) {
+            throw connection_error(error_code::protocol_error, format("HTTP/2 DATA on idle stream {}", stream_id));
+        }
+        send_rst_stream(stream_id, error_code::stream_closed);
+        if (s) {
+            reset_stream(*s, std::make_exception_ptr(stream_error(error_code::stream_closed, "HTTP/2 DATA after END_STREAM")));
+        }
+        return;
+    }
+    if (int64_t(size) > s->_recv_window) {
+        consumed(size);
+        send_rst_stream(stream_id, error_code::flow_control_error);
+        reset_stream(*s, std::make_exception_ptr(stream_error(error_code::flow_control_error, "HTTP/2 stream window exceeded")));
+        return;
+    }
+    s->_recv_window -= size;
+    // The padding is consumed right away
+    if (size > payload.size()) {
+        consumed(*s, size - payload.size());
+    }
+    if (!payload.empty()) {
+        s->_unread += payload.size();
+        s->_data.push_back(std::move(payload));
+    }
+    if (f & flags::end_stream) {
+        s->_remote_closed = true;
+    }
+    s->wake();
+    maybe_close_stream(*s);
+}
+
+future<> session::handle_settings(uint8_t f, uint32_t stream_id, temporary_buffer<char> payload) {
+    if (stream_id != 0) {
+        throw connection_error(error_code::protocol_error, "HTTP/2 SETTINGS on a stream");
+    }
+    if (f & flags::ack) {
+        if (!payload.empty()) {
+            throw connection_error(error_code::frame_size_error, "HTTP/2 SETTINGS ack with a payload");
+        }
+        return make_ready_future<>();
+    }
+    if (payload.size() % 6) {
+        throw connection_error(error_code::frame_size_error, "HTTP/2 bad SETTINGS");
+    }
+    for (size_t i = 0; i < payload.size(); i += 6) {
+        auto id = setting(read_be<uint16_t>(payload.get() + i));
+        auto value = read_be<uint32_t>(payload.get() + i + 2);
+        switch (id) {
+        case setting::header_table_size:
+            _peer.header_table_size = value;
+            _encoder.set_max_table_size(value);
+            break;
+        case setting::enable_push:
+            if (value > 1) {
+                throw connection_error(error_code::protocol_error, "HTTP/2 bad SETTINGS_ENABLE_PUSH");
+            }
+            break;
+        case setting::max_concurrent_streams:
+            _peer.max_concurrent_streams = value;
+            break;
+        case setting::initial_window_size: {
+            if (value > max_window) {
+                throw connection_error(error_code::flow_control_error, "HTTP/2 bad SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+            int64_t delta = int64_t(value) - _peer.initial_window_size;
+            for (auto& [id, s] : _streams) {
+                s->_send_window += delta;
+                if (s->_send_window > max_window) {
+                    throw connection_error(error_code::flow_control_error, "HTTP/2 stream window overflow");
+                }
+            }
+            _peer.initial_window_size = value;
+            break;
+        }
+        case setting::max_frame_size:
+            if (value < 16384 || value > 16777215) {
+                throw connection_error(error_code::protocol_error, "HTTP/2 bad SETTINGS_MAX_FRAME_SIZE");
+            }
+            _peer.max_frame_size = value;
+            break;
+        default:
+            break;
+        }
+    }
+    _window_cv.broadcast();
+    send_in_background([this] {
+        return write_frame(frame_type::settings, flags::ack, 0, {});
+    });
+    return make_ready_future<>();
+}
+
+void session::handle_window_update(uint32_t stream_id, temporary_buffer<char> payload) {
+    if (payload.size() != 4) {
+        throw connection_error(error_code::frame_size_error, "HTTP/2 bad WINDOW_UPDATE");
+    }
+    uint32_t increment = read_be<uint32_t>(payload.get()) & max_stream_id;
+    if (stream_id == 0) {
+        if (!increment) {
+            throw connection_error(error_code::protocol_error, "HTTP/2 WINDOW_UPDATE of 0");
+        }
+        _send_window += increment;
+        if (_send_window > max_window) {
+            throw connection_error(error_code::flow_control_error, "HTTP/2 connection window overflow");
+        }
+    } else if (auto s = find_stream(stream_id)) {
+        s->_send_window += increment;
+        if (!increment || s->_send_window > max_window) {
+            auto code = increment ? error_code::flow_control_error : error_code::protocol_error;
+            send_rst_stream(stream_id, code);
+            reset_stream(*s, std::make_exception_ptr(stream_error(code, "HTTP/2 bad WINDOW_UPDATE")));
+            return;
+        }
+    }
+    _window_cv.broadcast();
+}
+
+void session::handle_rst_stream(uint32_t stream_id, temporary_buffer<char> payload) {
+    if (stream_id == 0) {
+        throw connection_error(error_code::protocol_error, "HTTP/2 RST_STREAM on stream 0");
+    }
+    if (payload.size() != 4) {
+        throw connection_error(error_code::frame_size_error, "HTTP/2 bad RST_STREAM");
+    }
+    auto code = error_code(read_be<uint32_t>(payload.get()));
+    if (_role == role::server) {
+        auto now = lowres_clock::now();
+        if (now - _resets_since >= std::chrono::seconds(1)) {
+            _resets_since = now;
+            _resets = 0;
+        }
+        if (++_resets > _cfg.max_resets_per_second) {
+            throw connection_error(error_code::enhance_your_calm, "HTTP/2 streams reset too often");
+        }
+    }
+    if (auto s = find_stream(stream_id)) {
+        // A refused stream was not processed, and may be retried
+        reset_stream(*s, code == error_code::refused_stream
+                ? connection_aborted()
+                : std::make_exception_ptr(stream_error(code, format("HTTP/2 stream reset with error {}", uint32_t(code)))));
+    }
+}
+
+void session::handle_goaway(temporary_buffer<char> payload) {
+    if (payload.size() < 8) {
+        throw connection_error(error_code::frame_size_error, "HTTP/2 bad GOAWAY");
+    }
+    _goaway_last_stream_id = read_be<uint32_t>(payload.get()) & max_stream_id;
+    http_log.debug("HTTP/2 GOAWAY with error {}, last stream {}", read_be<uint32_t>(payload.get() + 4), _goaway_last_stream_id);
+    // The streams above were not processed, and may be retried
+    std::vector<stream_ptr> refused;
+    for (auto& [id, s] : _streams) {
+        if (_role == role::client && id > _goaway_last_stream_id) {
+            refused.push_back(s);
+        }
+    }
+    for (auto& s : refused) {
+        reset_stream(*s, connection_aborted());
+    }
+}
+
+session::stream_ptr session::find_stream(uint32_t stream_id) const {
+    auto i = _streams.find(stream_id);
+    return i == _streams.end() ? nullptr : i->second;
+}
+
+void session::reset_stream(stream& s, std::exception_ptr ex) {
+    s._error = std::move(ex);
+    s._remote_closed = false;
+    erase_stream(s);
+    s.wake();
+    _window_cv.broadcast();
+}
+
+void session::maybe_close_stream(stream& s) {
+    if (s._local_closed && s._remote_closed) {
+        erase_stream(s);
+    }
+}
+
+void session::erase_stream(stream& s) {
+    if (s._erased) {
+        return;
+    }
+    s._erased = true;
+    s._session = nullptr;
+    // What was not read is not in the connection window anymore
+    if (s._unread) {
+        consumed(s._unread);
+    }
+    _streams.erase(s._id);
+}
+
+void session::consumed(stream& s, size_t size) {
+    s._recv_unacked += size;
+    if (!s._remote_closed && s._recv_unacked >= _cfg.stream_window / 2) {
+        s._recv_window += s._recv_unacked;
+        send_window_update(s._id, std::exchange(s._recv_unacked, 0));
+    }
+    consumed(size);
+}
+
+void session::consumed(size_t size) {
+    _recv_unacked += size;
+    if (!_error && _recv_unacked >= _cfg.connection_window / 2) {
+        _recv_window += _recv_unacked;
+        send_window_update(0, std::exchange(_recv_unacked, 0));
+    }
+}
+
+void session::fail(std::exception_ptr ex) {
+    if (_error) {
+        return;
+    }
+    _error = ex;
+    auto streams = std::exchange(_streams, {});
+    for (auto& [id, s] : streams) {
+        s->_erased = true;
+        s->_session = nullptr;
+        if (!s->_remote_closed) {
+            s->_error = ex;
+        }
+        s->wake();
+    }
+    _window_cv.broadcast();
+}
+
+bool session::can_open_stream(size_t reserved) const noexcept {
+    return alive() && !_goaway_sent && reserved < _peer.max_concurrent_streams
+            && _next_stream_id + 2 * reserved <= max_stream_id;
+}
+
+future<session::stream_ptr> session::open_stream(const header_list& headers, bool end_stream) {
+    stream_ptr s;
+    co_await with_write_lock([&] {
+        if (!alive() || _next_stream_id > max_stream_id) {
+            return make_ready_future<>();
+        }
+        auto id = _next_stream_id;
+        _next_stream_id += 2;
+        s = make_lw_shared<stream>(*this, id, _peer.initial_window_size, _cfg.stream_window);
+        s->_local_closed = end_stream;
+        _streams.emplace(id, s);
+        return write_headers_locked(id, headers, end_stream);
+    });
+    if (!s) {
+        std::rethrow_exception(connection_aborted());
+    }
+    co_return s;
+}
+
+future<> session::send_headers(stream& s, const header_list& headers, bool end_stream) {
+    if (s._local_closed || !s._session) {
+        return make_exception_future<>(s.closed_error());
+    }
+    return with_write_lock([this, &s, &headers, end_stream] {
+        return write_headers_locked(s._id, headers, end_stream).then([this, &s, end_stream] {
+            if (end_stream) {
+                s._local_closed = true;
+                maybe_close_stream(s);
+            }
+        });
+    });
+}
+
+future<> session::send_data(stream& s, temporary_buffer<char> data, bool end_stream) {
+    auto keep = s.shared_from_this();
+    do {
+        if (s._local_closed || !s._session) {
+            std::rethrow_exception(s.closed_error());
+        }
+        size_t n = 0;
+        if (!data.empty()) {
+            co_await _window_cv.wait([this, &s] {
+                return _error || !s._session || (_send_window > 0 && s._send_window > 0);
+            });
+            if (_error || !s._session) {
+                continue;
+            }
+            n = std::min<size_t>({data.size(), size_t(_send_window), size_t(s._send_window), _peer.max_frame_size});
+            _send_window -= n;
+            s._send_window -= n;
+        }
+        auto chunk = data.share(0, n);
+        data.trim_front(n);
+        bool last = end_stream && data.empty();
+        co_await write_frame(frame_type::data, last ? flags::end_stream : 0, s._id, std::move(chunk));
+        if (last) {
+            s._local_closed = true;
+            if (s._session) {
+                maybe_close_stream(s);
+            }
+        }
+    } while (!data.empty());
+}
+
+future<> session::finish(stream& s) {
+    if (s._local_closed) {
+        return make_ready_future<>();
+    }
+    return send_data(s, {}, true);
+}
+
+void session::release(stream& s, error_code code) {
+    if (s._held) {
+        s._held = false;
+        --_held_streams;
+    }
+    if (s._erased) {
+        return;
+    }
+    send_rst_stream(s._id, code);
+    s._local_closed = true;
+    s._remote_closed = true;
+    erase_stream(s);
+    s.wake();
+}
+
+input_stream<char> session::body_source(stream_ptr s, std::unordered_map<sstring, sstring>* trailers) {
+    return input_stream<char>(data_source(std::make_unique<stream_source>(std::move(s), trailers)));
+}
+
+output_stream<char> session::body_sink(stream_ptr s) {
+    return output_stream<char>(data_sink(std::make_unique<stream_sink>(std::move(s))));
+}
+
+}
+
+}
+
+}
+
+}
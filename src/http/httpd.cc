@@ -45,14 +45,17 @@ module seastar;
 #include <seastar/core/distributed.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/when_all.hh>
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/http/httpd.hh>
 #include <seastar/http/internal/content_source.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/util/short_streams.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/string_utils.hh>
+#include <boost/algorithm/string/predicate.hpp>
 #endif
 
 
@@ -74,7 +77,9 @@ http_stats::http_stats(http_server& server, const sstring& name)
             sm::make_gauge("connections_current", [&server] { return server.current_connections(); }, sm::description("The current number of open  connections"), labels),
             sm::make_counter("read_errors", [&server] { return server.read_errors(); }, sm::description("The total number of errors while reading http requests"), labels),
             sm::make_counter("reply_errors", [&server] { return server.reply_errors(); }, sm::description("The total number of errors while replying to http"), labels),
-            sm::make_counter("requests_served", [&server] { return server.requests_served(); }, sm::description("The total number of http requests served"), labels)
+            sm::make_counter("requests_served", [&server] { return server.requests_served(); }, sm::description("The total number of http requests served"), labels),
+            sm::make_histogram("wire_to_handler_latency", sm::description("Time from the arrival of a request to its handler, in microseconds"), labels,
+                    [&server] { return server.wire_to_handler_latency().to_metrics_histogram(); }).set_skip_when_empty()
     });
 }
 
@@ -99,7 +104,7 @@ future<> connection::do_response_loop() {
 
 future<> connection::start_response() {
     if (_resp->_body_writer) {
-        return _resp->write_reply_to_connection(*this).then_wrapped([this] (auto f) {
+        return _resp->write_reply_to_connection(*this, {server_header(*_resp), date_header(*_resp), "Transfer-Encoding: chunked\r\n"}).then_wrapped([this] (auto f) {
             if (f.failed()) {
                 // In case of an error during the write close the connection
                 _server._respond_errors++;
@@ -135,15 +140,10 @@ future<> connection::start_response() {
             return make_ready_future<>();
         });
     }
-    set_headers(*_resp);
-    _resp->_headers["Content-Length"] = to_sstring(
-            _resp->_content.size());
-    return _write_buf.write(_resp->_response_line.data(),
-            _resp->_response_line.size()).then([this] {
-        return _resp->write_reply_headers(*this);
-    }).then([this] {
-        return _write_buf.write("\r\n", 2);
-    }).then([this] {
+    char length[64];
+    auto length_end = fmt::format_to_n(length, sizeof(length), "Content-Length: {}\r\n", _resp->_content.size()).out;
+    auto head = _resp->render_head({server_header(*_resp), date_header(*_resp), std::string_view(length, length_end - length)}, "Content-Length");
+    return _write_buf.write(head).then([this] {
         return write_body();
     }).then([this] {
         return _write_buf.flush();
@@ -161,6 +161,8 @@ void connection::on_new_connection() {
     ++_server._total_connections;
     ++_server._current_connections;
     _fd.set_nodelay(true);
+    _pipeline.signal(_server._pipeline_depth);
+    _parser.set_parse_in_place(_server._parse_headers_in_place);
     _server._connections.push_back(*this);
 }
 
@@ -173,17 +175,133 @@ future<> connection::read() {
             _server._read_errors++;
         }
         f.ignore_ready_future();
-        return _replies.push_eventually( {});
+        return std::exchange(_replies_ordered, make_ready_future<>()).then_wrapped([this] (future<> f) {
+            f.ignore_ready_future();
+            return _replies.push_eventually( {});
+        });
     });
 }
 
-static input_stream<char> make_content_stream(http::request* req, input_stream<char>& buf) {
-    // Create an input stream based on the requests body encoding or lack thereof
-    if (seastar::internal::case_insensitive_cmp()(req->get_header("Transfer-Encoding"), "chunked")) {
-        return input_stream<char>(data_source(std::make_unique<internal::chunked_source_impl>(buf, req->chunk_extensions, req->trailing_headers)));
+// The codings of a Transfer-Encoding or Content-Encoding header, in the
+// order they were applied in
+static std::vector<std::string_view> split_codings(std::string_view value) {
+    std::vector<std::string_view> codings;
+    while (!value.empty()) {
+        auto end = value.find(',');
+        auto coding = value.substr(0, end);
+        value.remove_prefix(end == std::string_view::npos ? value.size() : end + 1);
+        while (!coding.empty() && (coding.front() == ' ' || coding.front() == '\t')) {
+            coding.remove_prefix(1);
+        }
+        while (!coding.empty() && (coding.back() == ' ' || coding.back() == '\t')) {
+            coding.remove_suffix(1);
+        }
+        if (!coding.empty() && !boost::iequals(coding, "identity")) {
+            codings.push_back(coding);
+        }
+    }
+    return codings;
+}
+
+static bool supported_codings(const std::vector<std::string_view>& codings) {
+    return std::all_of(codings.begin(), codings.end(), [] (std::string_view coding) {
+        auto enc = http::parse_content_encoding(coding);
+        return enc && http::is_supported(*enc);
+    });
+}
+
+// Whether the transfer codings of a request are chunked, after supported
+// compressions if any
+static bool supported_transfer_encoding(std::string_view value) {
+    auto codings = split_codings(value);
+    if (codings.empty() || !boost::iequals(codings.back(), "chunked")) {
+        return false;
+    }
+    codings.pop_back();
+    return supported_codings(codings);
+}
+
+static input_stream<char> decompress(input_stream<char> in, const std::vector<std::string_view>& codings, size_t max_size) {
+    for (auto i = codings.rbegin(); i != codings.rend(); ++i) {
+        in = http::make_decompressing_input_stream(std::move(in), *http::parse_content_encoding(*i), max_size);
+    }
+    return in;
+}
+
+// What the body of a request decodes to, with its content codings if the
+// server decompresses them; they were checked to be supported
+static input_stream<char> decode_content(http::request& req, input_stream<char> in, const http_server& server) {
+    auto& compression = server.get_compression();
+    if (!compression || !compression->decompress_requests) {
+        return in;
+    }
+    sstring content_encoding = req.get_header("Content-Encoding");
+    auto codings = split_codings(content_encoding);
+    if (codings.empty()) {
+        return in;
+    }
+    req.materialize_headers();
+    req._headers.erase("Content-Encoding");
+    req._headers.erase("Content-Length");
+    req.content_length = 0;
+    return decompress(std::move(in), codings, server.get_content_length_limit());
+}
+
+// Whether the server decompresses the content codings of a request, if it
+// has any
+static bool supported_content_encoding(const http::request& req, const http_server& server) {
+    auto& compression = server.get_compression();
+    return !compression || !compression->decompress_requests || supported_codings(split_codings(req.get_header("Content-Encoding")));
+}
+
+// The span the handler of a request runs in, a child of the span of the
+// traceparent header of the request if it has one
+static tracing::span request_span(const http::request& req, const sstring& url) {
+    auto parent = tracing::span_context::from_traceparent(req.get_header("traceparent"));
+    tracing::span span("http.server", parent.value_or(tracing::span_context{}));
+    if (span.sampled()) {
+        span.set_name(format("http.server {} {}", req._method, url));
+    }
+    return span;
+}
+
+void connection::compress_reply(const http::compression_config& cfg, std::string_view accept_encoding, http::reply& rep) {
+    auto status = int(rep._status);
+    // The ranges of a partial reply are those of its content not compressed
+    if (status < 200 || status == 204 || status == 206 || status == 304 || rep._headers.contains("Content-Encoding")
+            || (!rep._body_writer && rep._content.size() < cfg.min_size)
+            || !cfg.compressible(rep.get_header("Content-Type"))) {
+        return;
+    }
+    // For caches to tell the replies to the clients accepting it apart
+    auto& vary = rep._headers["Vary"];
+    vary = vary.empty() ? sstring("Accept-Encoding") : vary + ", Accept-Encoding";
+    auto enc = http::negotiate_content_encoding(accept_encoding, cfg.encodings);
+    if (!enc) {
+        return;
+    }
+    int level = *enc == http::content_encoding::zstd ? cfg.zstd_level : cfg.zlib_level;
+    rep._headers["Content-Encoding"] = sstring(http::to_string(*enc));
+    if (rep._body_writer) {
+        rep._body_writer = [enc = *enc, level, writer = std::move(rep._body_writer)] (output_stream<char>&& out) mutable {
+            return writer(http::make_compressing_output_stream(std::move(out), enc, level));
+        };
     } else {
-        return input_stream<char>(data_source(std::make_unique<internal::content_length_source_impl>(buf, req->content_length)));
+        rep._content = http::compress(*enc, rep._content, level);
+    }
+}
+
+static input_stream<char> make_content_stream(http::request* req, input_stream<char>& buf, const http_server& server) {
+    // Create an input stream based on the requests body encoding or lack thereof
+    sstring transfer_encoding = req->get_header("Transfer-Encoding");
+    if (transfer_encoding.empty()) {
+        return decode_content(*req, input_stream<char>(data_source(std::make_unique<internal::content_length_source_impl>(buf, req->content_length))), server);
     }
+    // The transfer codings were checked to be supported
+    auto codings = split_codings(transfer_encoding);
+    codings.pop_back();
+    auto in = input_stream<char>(data_source(std::make_unique<internal::chunked_source_impl>(buf, req->chunk_extensions, req->trailing_headers)));
+    return decode_content(*req, decompress(std::move(in), codings, server.get_content_length_limit()), server);
 }
 
 static future<std::unique_ptr<http::request>>
@@ -208,7 +326,26 @@ void connection::generate_error_reply_and_close(std::unique_ptr<http::request> r
     resp->set_status(status, msg);
     resp->done();
     _done = true;
-    _replies.push(std::move(resp));
+    queue_reply(make_ready_future<std::unique_ptr<http::reply>>(std::move(resp)));
+}
+
+void connection::queue_reply(future<std::unique_ptr<http::reply>> rep, semaphore_units<> units) {
+    _replies_ordered = _replies_ordered.then_wrapped([this, rep = std::move(rep), units = std::move(units)] (future<> prev) mutable {
+        return std::move(rep).then_wrapped([this, prev = std::move(prev)] (future<std::unique_ptr<http::reply>> rep) mutable {
+            if (prev.failed()) {
+                rep.ignore_ready_future();
+                return std::move(prev);
+            }
+            if (rep.failed()) {
+                // Stop reading the requests a reply would be missing before
+                _server._read_errors++;
+                _done = true;
+                _fd.shutdown_input();
+                return make_exception_future<>(rep.get_exception());
+            }
+            return _replies.push_eventually(rep.get());
+        }).finally([units = std::move(units)] {});
+    });
 }
 
 future<> connection::read_one() {
@@ -223,6 +360,7 @@ future<> connection::read_one() {
 
         req->_server_address = this->_server_addr;
         req->_client_address = this->_client_addr;
+        req->_rx_timestamp = _fd.last_rx_timestamp();
 
         if (_tls) {
             req->protocol_name = "https";
@@ -247,9 +385,14 @@ future<> connection::read_one() {
         }
 
         sstring encoding = req->get_header("Transfer-Encoding");
-        if (encoding.size() && !seastar::internal::case_insensitive_cmp()(encoding, "chunked")){
-            //TODO: add "identity", "gzip"("x-gzip"), "compress"("x-compress"), and "deflate" encodings and their combinations
-            generate_error_reply_and_close(std::move(req), http::reply::status_type::not_implemented, format("Encodings other than \"chunked\" are not implemented (received encoding: \"{}\")", encoding));
+        if (encoding.size() && !supported_transfer_encoding(encoding)) {
+            generate_error_reply_and_close(std::move(req), http::reply::status_type::not_implemented, format("Encodings other than \"chunked\", after supported compressions, are not implemented (received encoding: \"{}\")", encoding));
+            return make_ready_future<>();
+        }
+
+        if (!supported_content_encoding(*req, _server)) {
+            auto msg = format("Content encoding \"{}\" is not supported", req->get_header("Content-Encoding"));
+            generate_error_reply_and_close(std::move(req), http::reply::status_type::unsupported_media_type, std::move(msg));
             return make_ready_future<>();
         }
 
@@ -257,10 +400,9 @@ future<> connection::read_one() {
             if (req->_version == "1.1" && seastar::internal::case_insensitive_cmp()(req->get_header("Expect"), "100-continue")){
                 return _replies.not_full().then([req = std::move(req), this] () mutable {
                     auto continue_reply = std::make_unique<http::reply>();
-                    set_headers(*continue_reply);
                     continue_reply->set_version(req->_version);
                     continue_reply->set_status(http::reply::status_type::continue_).done();
-                    this->_replies.push(std::move(continue_reply));
+                    queue_reply(make_ready_future<std::unique_ptr<http::reply>>(std::move(continue_reply)));
                     return make_ready_future<std::unique_ptr<http::request>>(std::move(req));
                 });
             } else {
@@ -269,8 +411,13 @@ future<> connection::read_one() {
         };
 
         return maybe_reply_continue().then([this] (std::unique_ptr<http::request> req) {
-            return do_with(make_content_stream(req.get(), _read_buf), sstring(req->_version), std::move(req), [this] (input_stream<char>& content_stream, sstring& version, std::unique_ptr<http::request>& req) {
+            return do_with(make_content_stream(req.get(), _read_buf, _server), sstring(req->_version), std::move(req), [this] (input_stream<char>& content_stream, sstring& version, std::unique_ptr<http::request>& req) {
                 return set_request_content(std::move(req), &content_stream, _server.get_content_streaming()).then([this, &content_stream] (std::unique_ptr<http::request> req) {
+                    // Nothing is left of the request to read, unless the
+                    // handler streams it or the connection ends with it
+                    if (_server._pipeline_depth > 1 && !_server.get_content_streaming() && req->should_keep_alive()) {
+                        return pipeline_request(std::move(req), std::make_unique<input_stream<char>>(std::move(content_stream)));
+                    }
                     return _replies.not_full().then([this, req = std::move(req)] () mutable {
                         return generate_reply(std::move(req));
                     }).then([this, &content_stream](bool done) {
@@ -292,13 +439,227 @@ future<> connection::read_one() {
                     auto err_req = std::make_unique<http::request>();
                     err_req->_version = version;
                     generate_error_reply_and_close(std::move(err_req), e.status(), e.str());
+                }).handle_exception_type([this, &version] (const http::decompression_error& e) {
+                    auto err_req = std::make_unique<http::request>();
+                    err_req->_version = version;
+                    generate_error_reply_and_close(std::move(err_req),
+                            e.too_large() ? http::reply::status_type::payload_too_large : http::reply::status_type::bad_request, e.what());
                 });
             });
         });
     });
 }
 
+namespace h2 = http::internal::http2;
+
+namespace {
+
+// Matches the HTTP/2 connection preface, giving back anything else to be
+// parsed as HTTP/1. Nothing is consumed until all of the preface is
+// received, so that HTTP/1 requests read a byte at a time, or starting
+// like it ("P" of POST, PUT and PATCH), get all of their bytes.
+class http2_preface_consumer {
+    // What matched the preface so far, given back if the rest does not
+    sstring _held;
+    bool _matched = false;
+public:
+    bool matched() const noexcept {
+        return _matched;
+    }
+    future<consumption_result<char>> operator()(temporary_buffer<char> buf) {
+        using result = consumption_result<char>;
+        if (buf.empty()) {
+            return make_ready_future<result>(stop_consuming<char>(temporary_buffer<char>(_held.data(), _held.size())));
+        }
+        auto n = std::min(buf.size(), h2::preface.size() - _held.size());
+        if (std::string_view(buf.get(), n) != h2::preface.substr(_held.size(), n)) {
+            if (_held.empty()) {
+                return make_ready_future<result>(stop_consuming<char>(std::move(buf)));
+            }
+            temporary_buffer<char> all(_held.size() + buf.size());
+            std::copy_n(_held.data(), _held.size(), all.get_write());
+            std::copy_n(buf.get(), buf.size(), all.get_write() + _held.size());
+            return make_ready_future<result>(stop_consuming<char>(std::move(all)));
+        }
+        if (_held.size() + n == h2::preface.size()) {
+            _matched = true;
+            buf.trim_front(n);
+            return make_ready_future<result>(stop_consuming<char>(std::move(buf)));
+        }
+        _held.append(buf.get(), n);
+        return make_ready_future<result>(continue_consuming{});
+    }
+};
+
+}
+
+future<bool> connection::read_http2_preface() {
+    return do_with(http2_preface_consumer(), [this] (http2_preface_consumer& consumer) {
+        return _read_buf.consume(consumer).then([&consumer] {
+            return consumer.matched();
+        });
+    });
+}
+
 future<> connection::process() {
+    if (!_server._http2) {
+        return process_http1();
+    }
+    return read_http2_preface().then_wrapped([this] (future<bool> f) {
+        if (f.failed()) {
+            _server._read_errors++;
+            hlogger.debug("Read exception encountered: {}", f.get_exception());
+            return _write_buf.close().then_wrapped([this] (future<> f) {
+                f.ignore_ready_future();
+                return _read_buf.close();
+            }).handle_exception([] (std::exception_ptr e) {
+                hlogger.debug("Close exception encountered: {}", e);
+            });
+        }
+        return f.get() ? process_http2() : process_http1();
+    });
+}
+
+future<> connection::process_http2() {
+    _h2 = std::make_unique<h2::session>(h2::session::role::server, _read_buf, _write_buf, h2::config{},
+            [this] (h2::session::stream_ptr s) {
+        (void)try_with_gate(_h2_streams, [this, s = std::move(s)] () mutable {
+            return serve_http2_stream(std::move(s));
+        }).handle_exception_type([] (const gate_closed_exception&) {});
+    });
+    try {
+        co_await _h2->run();
+    } catch (...) {
+        _server._read_errors++;
+        hlogger.debug("Read exception encountered: {}", std::current_exception());
+    }
+    co_await _h2_streams.close();
+    try {
+        co_await _write_buf.close();
+    } catch (...) {
+        hlogger.debug("Close exception encountered: {}", std::current_exception());
+    }
+    try {
+        co_await _read_buf.close();
+    } catch (...) {
+        hlogger.debug("Close exception encountered: {}", std::current_exception());
+    }
+}
+
+future<> connection::serve_http2_stream(h2::session::stream_ptr s) {
+    auto req = std::make_unique<http::request>();
+    req->_version = "2.0";
+    req->_server_address = _server_addr;
+    req->_client_address = _client_addr;
+    if (_tls) {
+        req->protocol_name = "https";
+    }
+    sstring authority;
+    bool malformed = false;
+    for (auto& [name, value] : s->headers()) {
+        if (name.starts_with(':')) {
+            if (name == ":method") {
+                req->_method = value;
+            } else if (name == ":path") {
+                req->_url = value;
+            } else if (name == ":authority") {
+                authority = value;
+            } else if (name != ":scheme") {
+                malformed = true;
+            }
+            continue;
+        }
+        auto [i, inserted] = req->_headers.emplace(name, value);
+        if (!inserted) {
+            i->second += (name == "cookie" ? "; " : ", ") + value;
+        }
+    }
+    if (!authority.empty() && !req->_headers.contains("Host")) {
+        req->_headers["Host"] = authority;
+    }
+    if (malformed || req->_method.empty() || req->_url.empty()) {
+        _h2->release(*s, h2::error_code::protocol_error);
+        co_return;
+    }
+    ++_server._requests_served;
+
+    auto resp = std::make_unique<http::reply>();
+    resp->set_version(req->_version);
+    set_headers(*resp);
+    req->content_length = strtol(req->get_header("Content-Length").c_str(), nullptr, 10);
+    bool content_supported = supported_content_encoding(*req, _server);
+    auto content_stream = content_supported ? decode_content(*req, _h2->body_source(s), _server) : _h2->body_source(s);
+    auto& compression = _server.get_compression();
+    sstring accept_encoding = compression ? req->get_header("Accept-Encoding") : sstring();
+    bool failed = false;
+    try {
+        size_t content_length_limit = _server.get_content_length_limit();
+        if (req->content_length > content_length_limit) {
+            resp->set_status(http::reply::status_type::payload_too_large,
+                    format("Content length limit ({}) exceeded: {}", content_length_limit, req->content_length));
+        } else if (!content_supported) {
+            resp->set_status(http::reply::status_type::unsupported_media_type,
+                    format("Content encoding \"{}\" is not supported", req->get_header("Content-Encoding")));
+        } else {
+            req->content_stream = &content_stream;
+            std::optional<http::decompression_error> bad_content;
+            if (!_server.get_content_streaming()) {
+                try {
+                    req->content = co_await util::read_entire_stream_contiguous(content_stream);
+                } catch (const http::decompression_error& e) {
+                    bad_content = e;
+                }
+            }
+            if (bad_content) {
+                resp->set_status(bad_content->too_large() ? http::reply::status_type::payload_too_large : http::reply::status_type::bad_request,
+                        bad_content->what());
+            } else {
+                sstring url = req->parse_query_param();
+                auto span = request_span(*req, url);
+                resp = co_await tracing::with_span(std::move(span), [&] {
+                    return _server._routes.handle(url, std::move(req), std::move(resp));
+                });
+                if (compression) {
+                    compress_reply(*compression, accept_encoding, *resp);
+                }
+            }
+        }
+        co_await send_http2_reply(*s, *resp);
+    } catch (...) {
+        _server._respond_errors++;
+        hlogger.debug("HTTP/2 stream {} failed: {}", s->id(), std::current_exception());
+        failed = true;
+    }
+    co_await content_stream.close();
+    // A request body not read to its end is not needed anymore
+    _h2->release(*s, failed ? h2::error_code::internal_error : h2::error_code::no_error);
+}
+
+future<> connection::send_http2_reply(h2::session::stream& s, http::reply& resp) {
+    http::internal::header_list headers;
+    headers.emplace_back(":status", to_sstring(int(resp._status)));
+    for (auto& [name, value] : resp._headers) {
+        sstring lower(name.size(), '\0');
+        std::transform(name.begin(), name.end(), lower.begin(), [] (char c) { return std::tolower(c); });
+        if (h2::is_connection_specific(lower) || lower == "content-length") {
+            continue;
+        }
+        headers.emplace_back(std::move(lower), value);
+    }
+    if (!resp._body_writer) {
+        headers.emplace_back("content-length", to_sstring(resp._content.size()));
+    }
+    bool has_body = resp._body_writer || !resp._content.empty();
+    co_await _h2->send_headers(s, headers, !has_body);
+    if (resp._body_writer) {
+        co_await resp._body_writer(_h2->body_sink(s.shared_from_this()));
+        co_await _h2->finish(s);
+    } else if (has_body) {
+        co_await _h2->send_data(s, std::move(resp._content).release(), true);
+    }
+}
+
+future<> connection::process_http1() {
     // Launch read and write "threads" simultaneously:
     return when_all(read(), respond()).then(
             [] (std::tuple<future<>, future<>> joined) {
@@ -349,10 +710,33 @@ void connection::set_headers(http::reply& resp) {
     resp._headers["Date"] = _server._date;
 }
 
+// HTTP/1 replies get these when rendered, rather than in their header map
+std::string_view connection::server_header(const http::reply& resp) const {
+    return resp._headers.contains("Server") ? std::string_view() : "Server: Seastar httpd\r\n";
+}
+
+std::string_view connection::date_header(const http::reply& resp) const {
+    return resp._headers.contains("Date") ? std::string_view() : std::string_view(_server._date_header);
+}
+
+future<> connection::pipeline_request(std::unique_ptr<http::request> req, std::unique_ptr<input_stream<char>> content_stream) {
+    req->content_stream = content_stream.get();
+    return get_units(_pipeline, 1).then([this, req = std::move(req), content_stream = std::move(content_stream)] (semaphore_units<> units) mutable {
+        queue_reply(handle_request(std::move(req)).finally([content_stream = std::move(content_stream)] {}), std::move(units));
+    });
+}
+
 future<bool> connection::generate_reply(std::unique_ptr<http::request> req) {
+    bool keep_alive = req->should_keep_alive();
+    return handle_request(std::move(req)).then([this, keep_alive] (std::unique_ptr<http::reply> rep) {
+        queue_reply(make_ready_future<std::unique_ptr<http::reply>>(std::move(rep)));
+        return make_ready_future<bool>(!keep_alive);
+    });
+}
+
+future<std::unique_ptr<http::reply>> connection::handle_request(std::unique_ptr<http::request> req) {
     auto resp = std::make_unique<http::reply>();
     resp->set_version(req->_version);
-    set_headers(*resp);
     bool keep_alive = req->should_keep_alive();
     if (keep_alive && req->_version == "1.0") {
         resp->_headers["Connection"] = "Keep-Alive";
@@ -360,12 +744,20 @@ future<bool> connection::generate_reply(std::unique_ptr<http::request> req) {
 
     sstring url = req->parse_query_param();
     sstring version = req->_version;
-    return _server._routes.handle(url, std::move(req), std::move(resp)).
-    // Caller guarantees enough room
-    then([this, keep_alive , version = std::move(version)](std::unique_ptr<http::reply> rep) {
+    sstring accept_encoding = _server._compression ? req->get_header("Accept-Encoding") : sstring();
+    auto span = request_span(*req, url);
+    if (req->_rx_timestamp) {
+        // The NIC clock may run ahead of the system one
+        _server._wire_to_handler.record(std::max(std::chrono::system_clock::now() - *req->_rx_timestamp, std::chrono::system_clock::duration(0)));
+    }
+    return tracing::with_span(std::move(span), [&] {
+        return _server._routes.handle(url, std::move(req), std::move(resp));
+    }).then([this, version = std::move(version), accept_encoding = std::move(accept_encoding)] (std::unique_ptr<http::reply> rep) {
         rep->set_version(version).done();
-        this->_replies.push(std::move(rep));
-        return make_ready_future<bool>(!keep_alive);
+        if (_server._compression) {
+            compress_reply(*_server._compression, accept_encoding, *rep);
+        }
+        return rep;
     });
 }
 
@@ -389,6 +781,46 @@ void http_server::set_content_streaming(bool b) {
     _content_streaming = b;
 }
 
+const std::optional<http::compression_config>& http_server::get_compression() const {
+    return _compression;
+}
+
+void http_server::set_compression(std::optional<http::compression_config> cfg) {
+    _compression = std::move(cfg);
+}
+
+unsigned http_server::get_pipeline_depth() const {
+    return _pipeline_depth;
+}
+
+void http_server::set_pipeline_depth(unsigned depth) {
+    _pipeline_depth = std::max(depth, 1u);
+}
+
+bool http_server::get_parse_headers_in_place() const {
+    return _parse_headers_in_place;
+}
+
+void http_server::set_parse_headers_in_place(bool b) {
+    _parse_headers_in_place = b;
+}
+
+bool http_server::get_rx_timestamps() const {
+    return _rx_timestamps;
+}
+
+void http_server::set_rx_timestamps(bool b) {
+    _rx_timestamps = b;
+}
+
+bool http_server::get_http2() const {
+    return _http2;
+}
+
+void http_server::set_http2(bool b) {
+    _http2 = b;
+}
+
 future<> http_server::listen(socket_address addr, listen_options lo, 
             server_credentials_ptr listener_credentials) {
     if (listener_credentials) {
@@ -445,6 +877,9 @@ future<> http_server::do_accepts(int which){
 future<> http_server::do_accept_one(int which, bool tls) {
     return _listeners[which].accept().then([this, tls] (accept_result ar) mutable {
         auto local_address = ar.connection.local_address();
+        if (_rx_timestamps) {
+            ar.connection.enable_rx_timestamps();
+        }
         auto conn = std::make_unique<connection>(*this, std::move(ar.connection),
                 std::move(ar.remote_address), std::move(local_address), tls);
         (void)try_with_gate(_task_gate, [conn = std::move(conn)]() mutable {
@@ -479,11 +914,23 @@ uint64_t http_server::reply_errors() const {
     return _respond_errors;
 }
 
+const metrics::log_linear_histogram<16, 33554432, 4>& http_server::wire_to_handler_latency() const {
+    return _wire_to_handler;
+}
+
 // Write the current date in the specific "preferred format" defined in
 // RFC 7231, Section 7.1.1.1, a.k.a. IMF (Internet Message Format) fixdate.
 // For example: Sun, 06 Nov 1994 08:49:37 GMT
 sstring http_server::http_date() {
-    auto t = ::time(nullptr);
+    return http_date(std::chrono::system_clock::now());
+}
+
+sstring http_server::render_date_header(const sstring& date) {
+    return "Date: " + date + "\r\n";
+}
+
+sstring http_server::http_date(std::chrono::system_clock::time_point tp) {
+    auto t = std::chrono::system_clock::to_time_t(tp);
     struct tm tm;
     gmtime_r(&t, &tm);
     // Using strftime() would have been easier, but unfortunately relies on
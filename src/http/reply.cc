@@ -79,6 +79,7 @@ const sstring length_required = "411 Length Required";
 const sstring payload_too_large = "413 Payload Too Large";
 const sstring uri_too_long = "414 URI Too Long";
 const sstring unsupported_media_type = "415 Unsupported Media Type";
+const sstring range_not_satisfiable = "416 Range Not Satisfiable";
 const sstring expectation_failed = "417 Expectation Failed";
 const sstring unprocessable_entity = "422 Unprocessable Entity";
 const sstring upgrade_required = "426 Upgrade Required";
@@ -153,6 +154,8 @@ static const sstring& to_string(reply::status_type status) {
         return uri_too_long;
     case reply::status_type::unsupported_media_type:
         return unsupported_media_type;
+    case reply::status_type::range_not_satisfiable:
+        return range_not_satisfiable;
     case reply::status_type::expectation_failed:
         return expectation_failed;
     case reply::status_type::unprocessable_entity:
@@ -199,22 +202,55 @@ void reply::write_body(const sstring& content_type, sstring content) {
     done(content_type);
 }
 
-future<> reply::write_reply_to_connection(httpd::connection& con) {
-    add_header("Transfer-Encoding", "chunked");
-    return con.out().write(response_line()).then([this, &con] () mutable {
-        return write_reply_headers(con);
-    }).then([&con] () mutable {
-        return con.out().write("\r\n", 2);
-    }).then([this, &con] () mutable {
+future<> reply::write_reply_to_connection(httpd::connection& con, std::initializer_list<std::string_view> extra_headers) {
+    return con.out().write(render_head(extra_headers, "Transfer-Encoding")).then([this, &con] () mutable {
         return _body_writer(http::internal::make_http_chunked_output_stream(con.out()));
     });
-
 }
 
-future<> reply::write_reply_headers(httpd::connection& con) {
-    return do_for_each(_headers, [&con](auto& h) {
-        return con.out().write(h.first + ": " + h.second + "\r\n");
-    });
+sstring reply::render_head(std::initializer_list<std::string_view> extra_headers, std::string_view skip) const {
+    static constexpr std::string_view http = "HTTP/";
+    static constexpr std::string_view crlf = "\r\n";
+    static constexpr std::string_view colon = ": ";
+    auto& status = status_strings::to_string(_status);
+    auto skipped = [skip] (const sstring& name) {
+        return !skip.empty() && seastar::internal::case_insensitive_equal(name, skip);
+    };
+
+    size_t len = http.size() + _version.size() + 1 + status.size() + crlf.size();
+    for (auto& [name, value] : _headers) {
+        if (!skipped(name)) {
+            len += name.size() + colon.size() + value.size() + crlf.size();
+        }
+    }
+    for (auto h : extra_headers) {
+        len += h.size();
+    }
+    len += crlf.size();
+
+    sstring head(sstring::initialized_later(), len);
+    auto p = head.data();
+    auto put = [&p] (std::string_view s) {
+        p = std::copy(s.begin(), s.end(), p);
+    };
+    put(http);
+    put(_version);
+    put(" ");
+    put(status);
+    put(crlf);
+    for (auto& [name, value] : _headers) {
+        if (!skipped(name)) {
+            put(name);
+            put(colon);
+            put(value);
+            put(crlf);
+        }
+    }
+    for (auto h : extra_headers) {
+        put(h);
+    }
+    put(crlf);
+    return head;
 }
 
 }
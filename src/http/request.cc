@@ -24,6 +24,7 @@ module;
 #endif
 
 #include <cassert>
+#include <cstring>
 #include <string_view>
 #include <utility>
 
@@ -38,6 +39,47 @@ module seastar;
 namespace seastar {
 namespace http {
 
+std::string_view header_views::copy(std::string_view str) {
+    temporary_buffer<char> buf(str.data(), str.size());
+    std::string_view ret(buf.get(), buf.size());
+    pin(std::move(buf));
+    return ret;
+}
+
+const header_views::field* header_views::find(std::string_view name) const noexcept {
+    for (auto& f : _fields) {
+        if (seastar::internal::case_insensitive_equal(f.name, name)) {
+            return &f;
+        }
+    }
+    return nullptr;
+}
+
+sstring header_views::get(std::string_view name) const {
+    sstring ret;
+    bool found = false;
+    for (auto& f : _fields) {
+        if (seastar::internal::case_insensitive_equal(f.name, name)) {
+            if (found) {
+                ret += ",";
+            }
+            ret += sstring(f.value);
+            found = true;
+        }
+    }
+    return ret;
+}
+
+void request::materialize_headers() {
+    for (auto& f : _header_views) {
+        auto [i, inserted] = _headers.try_emplace(sstring(f.name), f.value);
+        if (!inserted) {
+            i->second += sstring(",") + sstring(f.value);
+        }
+    }
+    _header_views.clear();
+}
+
 sstring request::format_url() const {
     sstring query = "";
     sstring delim = "?";
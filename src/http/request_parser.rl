@@ -23,6 +23,7 @@
 
 #include <seastar/core/ragel.hh>
 #include <memory>
+#include <string_view>
 #include <unordered_map>
 #include <seastar/http/request.hh>
 
@@ -51,7 +52,11 @@ action store_version {
 }
 
 action store_field_name {
-    _field_name = str();
+    if (_in_place) {
+        _field_name_view = view();
+    } else {
+        _field_name = str();
+    }
 }
 
 action store_value {
@@ -59,19 +64,29 @@ action store_value {
 }
 
 action trim_trailing_whitespace_and_store_value {
-    _value = str();
-    trim_trailing_spaces_and_tabs(_value);
+    if (_in_place) {
+        _value_view = view();
+        auto last = _value_view.find_last_not_of(" \t");
+        _value_view = _value_view.substr(0, last == std::string_view::npos ? 0 : last + 1);
+    } else {
+        _value = str();
+        trim_trailing_spaces_and_tabs(_value);
+    }
     g.mark_start(nullptr);
 }
 
 action assign_field {
-    auto [iter, inserted] = _req->_headers.try_emplace(_field_name, std::move(_value));
-    if (!inserted) {
-        // RFC 7230, section 3.2.2.  Field Parsing:
-        // A recipient MAY combine multiple header fields with the same field name into one
-        // "field-name: field-value" pair, without changing the semantics of the message,
-        // by appending each subsequent field value to the combined field value in order, separated by a comma.
-        iter->second += sstring(",") + std::move(_value);
+    if (_in_place) {
+        _req->_header_views.add(_field_name_view, _value_view);
+    } else {
+        auto [iter, inserted] = _req->_headers.try_emplace(_field_name, std::move(_value));
+        if (!inserted) {
+            // RFC 7230, section 3.2.2.  Field Parsing:
+            // A recipient MAY combine multiple header fields with the same field name into one
+            // "field-name: field-value" pair, without changing the semantics of the message,
+            // by appending each subsequent field value to the combined field value in order, separated by a comma.
+            iter->second += sstring(",") + std::move(_value);
+        }
     }
 }
 
@@ -80,7 +95,12 @@ action extend_field  {
     // A server that receives an obs-fold in a request message that is not
     // within a message/http container MUST either reject the message [...]
     // or replace each received obs-fold with one or more SP octets [...]
-    _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+    if (_in_place) {
+        auto& field = _req->_header_views.back();
+        field.value = _req->_header_views.copy(fmt::format("{} {}", field.value, _value_view));
+    } else {
+        _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+    }
 }
 
 action done {
@@ -133,7 +153,28 @@ public:
     sstring _field_name;
     sstring _value;
     state _state;
+private:
+    // Parse the headers into _req->_header_views rather than _req->_headers
+    bool _in_place = false;
+    std::string_view _field_name_view;
+    std::string_view _value_view;
+    // The buffer being parsed, and whether the request keeps it
+    temporary_buffer<char>* _block = nullptr;
+    bool _block_pinned = false;
+
+    std::string_view pin(std::string_view v) {
+        if (!_block_pinned) {
+            _req->_header_views.pin(_block->share());
+            _block_pinned = true;
+        }
+        return v;
+    }
 public:
+    /// Parse the headers of the next requests in place, as views of the
+    /// buffers they are received in, see http::header_views
+    void set_parse_in_place(bool in_place) noexcept {
+        _in_place = in_place;
+    }
     void init() {
         init_base();
         _req.reset(new http::request());
@@ -143,6 +184,13 @@ public:
     char* parse(char* p, char* pe, char* eof) {
         sstring_builder::guard g(_builder, p, pe);
         [[maybe_unused]] auto str = [this, &g, &p] { g.mark_end(p); return get_str(); };
+        // The string whole in the block is not copied
+        [[maybe_unused]] auto view = [this, &g, &p] {
+            if (auto v = g.mark_end_view(p)) {
+                return pin(*v);
+            }
+            return _req->_header_views.copy(get_str());
+        };
         bool done = false;
         if (p != pe) {
             _state = state::error;
@@ -171,6 +219,20 @@ public:
         }
         return p;
     }
+    future<unconsumed_remainder> operator()(temporary_buffer<char> buf) {
+        _block = &buf;
+        _block_pinned = false;
+        char* p = buf.get_write();
+        char* pe = p + buf.size();
+        char* eof = buf.empty() ? pe : nullptr;
+        char* parsed = parse(p, pe, eof);
+        _block = nullptr;
+        if (parsed) {
+            buf.trim_front(parsed - p);
+            return make_ready_future<unconsumed_remainder>(std::move(buf));
+        }
+        return make_ready_future<unconsumed_remainder>();
+    }
     auto get_parsed_request() {
         return std::move(_req);
     }
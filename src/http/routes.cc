@@ -22,7 +22,12 @@
 #ifdef SEASTAR_MODULE
 module;
 #include <exception>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <string_view>
+#include <typeinfo>
+#include <vector>
 module seastar;
 #else
 #include <seastar/http/routes.hh>
@@ -30,6 +35,11 @@ module seastar;
 #include <seastar/http/request.hh>
 #include <seastar/http/exception.hh>
 #include <seastar/http/json_path.hh>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <typeinfo>
+#include <vector>
 #endif
 
 namespace seastar {
@@ -113,6 +123,170 @@ sstring routes::normalize_url(const sstring& url) {
     return url.substr(0, url.length() - 1);
 }
 
+// A node of the trie stands for the url segments, between slashes,
+// leading to it: the rule made of "/api/v1" and a parameter ends at the
+// parameter child of the "v1" child of the "api" child of the root. The
+// trie only tells which rule matches first, without copying the url; that
+// rule matches it again to fill the parameters.
+class routes::rule_trie {
+    static constexpr rule_cookie none = std::numeric_limits<rule_cookie>::max();
+
+    struct entry {
+        rule_cookie cookie = none;
+        match_rule* rule = nullptr;
+
+        void add(const entry& e) noexcept {
+            if (e.cookie < cookie) {
+                *this = e;
+            }
+        }
+    };
+
+    struct node {
+        // Sorted by segment
+        std::vector<std::pair<sstring, std::unique_ptr<node>>> children;
+        std::unique_ptr<node> param;
+        // The first rule ending here
+        entry end;
+        // The first rule ending here with a parameter taking the rest of
+        // the url
+        entry rest;
+        // The first rule of the subtree
+        rule_cookie first = none;
+
+        auto lower_bound(std::string_view segment) const noexcept {
+            return std::lower_bound(children.begin(), children.end(), segment, [] (const auto& c, std::string_view s) {
+                return std::string_view(c.first) < s;
+            });
+        }
+
+        const node* find(std::string_view segment) const noexcept {
+            auto i = lower_bound(segment);
+            return i != children.end() && std::string_view(i->first) == segment ? i->second.get() : nullptr;
+        }
+
+        node& child(std::string_view segment) {
+            auto i = lower_bound(segment);
+            if (i == children.end() || std::string_view(i->first) != segment) {
+                i = children.emplace(i, sstring(segment), std::make_unique<node>());
+            }
+            return *i->second;
+        }
+    };
+
+    node _root;
+    // The rules the trie cannot hold, in order
+    std::vector<std::pair<rule_cookie, match_rule*>> _others;
+
+    bool insert(rule_cookie cookie, match_rule* rule);
+    void find(const node& n, std::string_view url, size_t pos, entry& best) const noexcept;
+public:
+    explicit rule_trie(const std::map<rule_cookie, match_rule*>& rules) {
+        for (auto [cookie, rule] : rules) {
+            if (!insert(cookie, rule)) {
+                _others.emplace_back(cookie, rule);
+            }
+        }
+    }
+
+    // The url must start with a slash
+    handler_base* get(const sstring& url, parameters& params) const;
+};
+
+// Only the rules made of str_matchers of whole segments, and of
+// param_matchers, the one taking the rest of the url last, go in the trie
+bool routes::rule_trie::insert(rule_cookie cookie, match_rule* rule) {
+    auto& matchers = rule->matchers();
+    // A segment, or a parameter if none
+    std::vector<std::optional<std::string_view>> path;
+    bool rest = false;
+    for (size_t i = 0; i < matchers.size(); i++) {
+        auto m = matchers[i];
+        if (typeid(*m) == typeid(str_matcher)) {
+            std::string_view str = static_cast<str_matcher*>(m)->str();
+            if (str.empty() || str[0] != '/') {
+                return false;
+            }
+            for (size_t pos = 0; pos < str.size();) {
+                auto next = std::min(str.find('/', pos + 1), str.size());
+                if (next == pos + 1) {
+                    return false;
+                }
+                path.emplace_back(str.substr(pos + 1, next - pos - 1));
+                pos = next;
+            }
+        } else if (typeid(*m) == typeid(param_matcher)) {
+            if (!static_cast<param_matcher*>(m)->entire_path()) {
+                path.emplace_back(std::nullopt);
+            } else if (i + 1 == matchers.size()) {
+                rest = true;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    if (path.empty() && !rest) {
+        // Matches any url
+        return false;
+    }
+    node* n = &_root;
+    n->first = std::min(n->first, cookie);
+    for (auto& segment : path) {
+        if (segment) {
+            n = &n->child(*segment);
+        } else {
+            if (!n->param) {
+                n->param = std::make_unique<node>();
+            }
+            n = n->param.get();
+        }
+        n->first = std::min(n->first, cookie);
+    }
+    (rest ? n->rest : n->end).add(entry{cookie, rule});
+    return true;
+}
+
+// pos is that of the slash starting the segments left, or the end of the url
+void routes::rule_trie::find(const node& n, std::string_view url, size_t pos, entry& best) const noexcept {
+    if (n.first >= best.cookie) {
+        return;
+    }
+    // The matchers leave a trailing slash
+    if (pos + 1 >= url.size()) {
+        best.add(n.end);
+    }
+    best.add(n.rest);
+    if (pos == url.size()) {
+        return;
+    }
+    auto next = std::min(url.find('/', pos + 1), url.size());
+    if (auto c = n.find(url.substr(pos + 1, next - pos - 1))) {
+        find(*c, url, next, best);
+    }
+    // Parameters take empty segments too
+    if (n.param) {
+        find(*n.param, url, next, best);
+    }
+}
+
+handler_base* routes::rule_trie::get(const sstring& url, parameters& params) const {
+    entry best;
+    find(_root, url, 0, best);
+    for (auto [cookie, rule] : _others) {
+        if (cookie > best.cookie) {
+            break;
+        }
+        auto handler = rule->get(url, params);
+        if (handler != nullptr) {
+            return handler;
+        }
+        params.clear();
+    }
+    return best.rule ? best.rule->get(url, params) : nullptr;
+}
+
 handler_base* routes::get_handler(operation_type type, const sstring& url,
         parameters& params) {
     handler_base* handler = get_exact_match(type, url);
@@ -120,12 +294,26 @@ handler_base* routes::get_handler(operation_type type, const sstring& url,
         return handler;
     }
 
-    for (auto&& rule : _rules[type]) {
-        handler = rule.second->get(url, params);
+    if (url.empty() || url[0] != '/') {
+        // Out of the trie's reach, only parameters may match
+        for (auto&& rule : _rules[type]) {
+            handler = rule.second->get(url, params);
+            if (handler != nullptr) {
+                return handler;
+            }
+            params.clear();
+        }
+        return _default_handler;
+    }
+    if (_rules_changed[type]) {
+        _tries[type] = std::make_unique<rule_trie>(_rules[type]);
+        _rules_changed[type] = false;
+    }
+    if (_tries[type]) {
+        handler = _tries[type]->get(url, params);
         if (handler != nullptr) {
             return handler;
         }
-        params.clear();
     }
     return _default_handler;
 }
@@ -171,6 +359,7 @@ routes& routes::put(operation_type type, const sstring& url, handler_base* handl
 }
 
 match_rule* routes::del_cookie(rule_cookie cookie, operation_type type) {
+    _rules_changed[type] = true;
     return delete_rule_from(type, cookie, _rules);
 }
 
@@ -25,9 +25,6 @@ module;
 
 #include <cmath>
 #include <algorithm>
-#include <iomanip>
-#include <ios>
-#include <sstream>
 #include <string_view>
 
 #ifdef SEASTAR_MODULE
@@ -35,6 +32,7 @@ module seastar;
 #else
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/json/writer.hh>
 #endif
 
 namespace seastar {
@@ -59,58 +57,21 @@ sstring formatter::end(state s) {
     }
 }
 
-static inline bool is_control_char(char c) {
-    return c >= 0 && c <= 0x1F;
-}
-
-static bool needs_escaping(const string_view& str) {
-    return std::any_of(str.begin(), str.end(), [] (char c) {
-        return is_control_char(c) || c == '"' || c == '\\';
-    });
-}
-
 static sstring string_view_to_json(const string_view& str) {
-    if (!needs_escaping(str)) {
+    auto pos = internal::find_escape(str);
+    if (pos == str.size()) {
         return format("\"{}\"", str);
     }
-
-    ostringstream oss;
-    oss << std::hex << std::uppercase << std::setfill('0');
-    oss.put('"');
-    for (char c : str) {
-        switch (c) {
-        case '"':
-            oss.put('\\').put('"');
-            break;
-        case '\\':
-            oss.put('\\').put('\\');
-            break;
-        case '\b':
-            oss.put('\\').put('b');
-            break;
-        case '\f':
-            oss.put('\\').put('f');
-            break;
-        case '\n':
-            oss.put('\\').put('n');
-            break;
-        case '\r':
-            oss.put('\\').put('r');
-            break;
-        case '\t':
-            oss.put('\\').put('t');
-            break;
-        default:
-            if (is_control_char(c)) {
-                oss.put('\\').put('u') << std::setw(4) << static_cast<int>(c);
-            } else {
-                oss.put(c);
-            }
-            break;
-        }
-    }
-    oss.put('"');
-    return oss.str();
+    sstring res;
+    res.resize_and_overwrite(internal::max_escaped_size(str.size()) + 2, [&] (char* buf, size_t) {
+        auto p = buf;
+        *p++ = '"';
+        p = std::copy_n(str.data(), pos, p);
+        p = internal::escape(str.substr(pos), p);
+        *p++ = '"';
+        return size_t(p - buf);
+    });
+    return res;
 }
 
 sstring formatter::to_json(const sstring& str) {
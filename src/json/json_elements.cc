@@ -26,7 +26,6 @@ module;
 #include <string.h>
 #include <string>
 #include <vector>
-#include <sstream>
 #include <fmt/core.h>
 
 #ifdef SEASTAR_MODULE
@@ -43,8 +42,6 @@ using namespace std;
 
 namespace json {
 
-
-class json_stream_builder;
 /**
  * The json builder is a helper class
  * To help create a json object
@@ -54,7 +51,7 @@ class json_builder {
 public:
     json_builder()
             : first(true) {
-        result << OPEN;
+        result += OPEN;
     }
 
     /**
@@ -66,9 +63,12 @@ class json_builder {
         if (first) {
             first = false;
         } else {
-            result << ", ";
+            result += ", ";
         }
-        result << '"' << name << "\": " << str;
+        result += '"';
+        result += name;
+        result += "\": ";
+        result += str;
     }
 
     /**
@@ -91,74 +91,18 @@ class json_builder {
      * @return a string of accumulative object
      */
     string as_json() {
-        result << CLOSE;
-        return result.str();
+        result += CLOSE;
+        return std::move(result);
     }
 
 private:
     static const string OPEN;
     static const string CLOSE;
-    friend class json_stream_builder;
-    stringstream result;
+    string result;
     bool first;
 
 };
 
-/**
- * The json builder is a helper class
- * To help create a json object
- *
- */
-class json_stream_builder {
-public:
-    json_stream_builder(output_stream<char>& s)
-            : first(true), open(false), _s(s) {
-    }
-
-    /**
-     * add a name value to an object
-     * @param name the name of the element
-     * @param str the value already formated
-     */
-    future<> add(const string& name, const json_base_element& element) {
-        if (!open) {
-            open = true;
-            return _s.write(json_builder::OPEN).then([this, &name, &element] {
-                return add(name, element);
-            });
-        }
-        return _s.write(((first)? '"' + name : ",\"" + name) + "\":").then([this, &element] {
-            first = false;
-            return element.write(_s);
-        });
-    }
-
-    /**
-     * add a json element to the an object
-     * @param element
-     */
-    future<> add(json_base_element* element) {
-        if (element == nullptr || element->_set == false) {
-            return make_ready_future<>();
-        }
-        return add(element->_name, *element);
-    }
-
-    /**
-     * Get the string representation of the object
-     * @return a string of accumulative object
-     */
-    future<> done() {
-        return _s.write(json_builder::CLOSE);
-    }
-
-private:
-
-    bool first;
-    bool open;
-    output_stream<char>& _s;
-};
-
 const string json_builder::OPEN("{");
 const string json_builder::CLOSE("}");
 
@@ -176,13 +120,21 @@ string json_base::to_json() const {
     return res.as_json();
 }
 
+void json_base::serialize(writer& w) const {
+    w.begin_object();
+    for (auto e : _elements) {
+        if (e != nullptr && e->_set) {
+            w.key(e->_name);
+            e->serialize(w);
+        }
+    }
+    w.end_object();
+}
+
 future<> json_base::write(output_stream<char>& s) const {
-    return do_with(json_stream_builder(s), [this] (json_stream_builder& builder) {
-        return do_for_each(_elements, [&builder] (auto m) {
-            return builder.add(m);
-        }).then([&builder] {
-            return builder.done();
-        });
+    return do_with(writer(s), [this] (writer& w) {
+        serialize(w);
+        return w.flush();
     });
 }
 
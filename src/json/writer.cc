@@ -0,0 +1,238 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string_view>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/json/json_elements.hh>
+#include <seastar/json/writer.hh>
+#endif
+
+namespace seastar {
+
+namespace json {
+
+namespace internal {
+
+static inline bool needs_escaping(char c) noexcept {
+    return (unsigned char)c < 0x20 || c == '"' || c == '\\';
+}
+
+size_t find_escape(std::string_view str) noexcept {
+    auto p = str.data();
+    size_t n = str.size();
+    size_t i = 0;
+#if defined(__x86_64__)
+    // The control characters are the bytes whose minimum with 0x1f is
+    // themselves, the comparisons of SSE2 being signed
+    const auto quote = _mm_set1_epi8('"');
+    const auto backslash = _mm_set1_epi8('\\');
+    const auto control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        if (auto mask = _mm_movemask_epi8(m)) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (needs_escaping(p[i])) {
+            return i;
+        }
+    }
+    return n;
+}
+
+char* escape(std::string_view str, char* out) noexcept {
+    static constexpr char hex[] = "0123456789ABCDEF";
+    while (!str.empty()) {
+        auto pos = find_escape(str);
+        out = std::copy_n(str.data(), pos, out);
+        if (pos == str.size()) {
+            break;
+        }
+        auto c = str[pos];
+        *out++ = '\\';
+        switch (c) {
+        case '"': *out++ = '"'; break;
+        case '\\': *out++ = '\\'; break;
+        case '\b': *out++ = 'b'; break;
+        case '\f': *out++ = 'f'; break;
+        case '\n': *out++ = 'n'; break;
+        case '\r': *out++ = 'r'; break;
+        case '\t': *out++ = 't'; break;
+        default:
+            out = std::copy_n("u00", 3, out);
+            *out++ = hex[(c >> 4) & 0xf];
+            *out++ = hex[c & 0xf];
+            break;
+        }
+        str.remove_prefix(pos + 1);
+    }
+    return out;
+}
+
+}
+
+writer::writer(output_stream<char>& out, size_t flush_size)
+        : _out(out)
+        , _flush_size(flush_size)
+        , _has_value(1, false) {
+}
+
+void writer::grow(size_t n) {
+    auto capacity = std::max({_capacity * 2, _size + n, _flush_size});
+    auto buf = std::unique_ptr<char[]>(new char[capacity]);
+    std::copy_n(_buf.get(), _size, buf.get());
+    _buf = std::move(buf);
+    _capacity = capacity;
+}
+
+void writer::quoted(std::string_view str) {
+    auto pos = internal::find_escape(str);
+    if (pos == str.size()) {
+        auto p = reserve(str.size() + 2);
+        *p++ = '"';
+        p = std::copy_n(str.data(), str.size(), p);
+        *p = '"';
+        _size += str.size() + 2;
+        return;
+    }
+    put('"');
+    append(str.substr(0, pos));
+    // What may escape is reserved a piece at a time, not 6 times the
+    // size of a long string at once
+    str.remove_prefix(pos);
+    while (!str.empty()) {
+        auto piece = str.substr(0, 4096);
+        auto p = reserve(internal::max_escaped_size(piece.size()));
+        _size = internal::escape(piece, p) - _buf.get();
+        str.remove_prefix(piece.size());
+    }
+    put('"');
+}
+
+writer& writer::value(float f) {
+    if (std::isinf(f)) {
+        throw std::out_of_range("Infinite float value is not supported");
+    } else if (std::isnan(f)) {
+        throw std::invalid_argument("Invalid float value");
+    }
+    separate();
+    auto p = reserve(32);
+    _size = std::to_chars(p, p + 32, f).ptr - _buf.get();
+    return *this;
+}
+
+writer& writer::value(double d) {
+    if (std::isinf(d)) {
+        throw std::out_of_range("Infinite double value is not supported");
+    } else if (std::isnan(d)) {
+        throw std::invalid_argument("Invalid double value");
+    }
+    separate();
+    auto p = reserve(32);
+    _size = std::to_chars(p, p + 32, d).ptr - _buf.get();
+    return *this;
+}
+
+writer& writer::value(const date_time& d) {
+    // The RFC3339 format of formatter::to_json(const date_time&)
+    separate();
+    auto p = reserve(52);
+    *p = '"';
+    auto n = strftime(p + 1, 50, "%FT%TZ", &d);
+    p[n + 1] = '"';
+    _size += n + 2;
+    return *this;
+}
+
+writer& writer::value(const jsonable& obj) {
+    separate();
+    // The object writes a value of its own
+    _after_key = true;
+    obj.serialize(*this);
+    return *this;
+}
+
+writer& writer::begin_object() {
+    separate();
+    put('{');
+    _has_value.push_back(false);
+    return *this;
+}
+
+writer& writer::end_object() {
+    _has_value.pop_back();
+    put('}');
+    return *this;
+}
+
+writer& writer::begin_array() {
+    separate();
+    put('[');
+    _has_value.push_back(false);
+    return *this;
+}
+
+writer& writer::end_array() {
+    _has_value.pop_back();
+    put(']');
+    return *this;
+}
+
+writer& writer::key(std::string_view name) {
+    separate();
+    quoted(name);
+    put(':');
+    _after_key = true;
+    return *this;
+}
+
+future<> writer::flush() {
+    if (!_size) {
+        return make_ready_future<>();
+    }
+    return _out.write(_buf.get(), _size).then([this] {
+        _size = 0;
+    });
+}
+
+}
+
+}
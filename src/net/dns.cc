@@ -36,8 +36,13 @@
 #include <seastar/core/timer.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/smp.hh>
+#include <array>
 #include <system_error>
+#include <unordered_map>
 
 namespace seastar::net {
 
@@ -134,14 +139,45 @@ struct ares_initializer {
     }
 };
 
+static net::dns_resolver& resolver();
+
+// Set on all the shards by dns::share_cache_across_shards()
+static thread_local bool default_cache_shared = false;
+
+// The answers to the queries of one kind, by what was asked, kept for as
+// long as their TTL tells, and the queries in flight, which the identical
+// ones wait for rather than going upstream again
+template <typename Answer>
+struct dns_cache {
+    struct entry {
+        // The answer, or the error telling the name does not exist
+        std::optional<Answer> answer;
+        std::exception_ptr error;
+        lowres_clock::time_point expires;
+        // Asking for the answer past that queries it again
+        lowres_clock::time_point refresh;
+    };
+    std::unordered_map<sstring, entry> entries;
+    std::unordered_map<sstring, shared_promise<Answer>> pending;
+};
+
 class net::dns_resolver::impl
     : public enable_shared_from_this<impl>
 {
+    // SRV records, as cached, with the TTL of the records
+    struct srv_answer {
+        srv_records records;
+        std::optional<std::chrono::seconds> ttl;
+    };
 public:
     impl(network_stack& stack, const options& opts)
         : _stack(stack)
         , _timeout(opts.timeout ? *opts.timeout : std::chrono::milliseconds(5000) /* from ares private */)
         , _timer(std::bind(&impl::poll_sockets, this))
+        , _cache_size(opts.cache_size.value_or(1024))
+        , _cache_max_ttl(opts.cache_max_ttl.value_or(std::chrono::minutes(5)))
+        , _negative_ttl(opts.negative_ttl.value_or(std::chrono::seconds(5)))
+        , _prefetch_ratio(opts.prefetch_ratio.value_or(0.1))
     {
         static const ares_initializer a_init;
 
@@ -235,6 +271,25 @@ class net::dns_resolver::impl
     }
 
     future<hostent> get_host_by_name(sstring name, opt_family family)  {
+        if (!family) {
+            auto res = inet_address::parse_numerical(name);
+            if (res) {
+                return make_ready_future<hostent>(hostent{ {name}, {*res}});
+            }
+        }
+
+        auto& cache = _host_cache[family ? (*family == inet_address::family::INET ? 1 : 2) : 0];
+        return lookup(cache, name, [this, name, family] {
+            if (auto shard = owner_shard(name); shard != this_shard_id()) {
+                return smp::submit_to(shard, [name, family] {
+                    return resolver()._impl->get_host_by_name(name, family);
+                });
+            }
+            return query_host_by_name(name, family);
+        });
+    }
+
+    future<hostent> query_host_by_name(sstring name, opt_family family)  {
         class promise_wrap : public promise<hostent> {
         public:
             promise_wrap(sstring s)
@@ -245,13 +300,6 @@ class net::dns_resolver::impl
 
         dns_log.debug("Query name {} ({})", name, family);
 
-        if (!family) {
-            auto res = inet_address::parse_numerical(name);
-            if (res) {
-                return make_ready_future<hostent>(hostent{ {name}, {*res}});
-            }
-        }
-
         auto p = new promise_wrap(std::move(name));
         auto f = p->get_future();
 
@@ -357,13 +405,29 @@ class net::dns_resolver::impl
     future<srv_records> get_srv_records(srv_proto proto,
                                         const sstring& service,
                                         const sstring& domain) {
-        auto p = std::make_unique<promise<srv_records>>();
-        auto f = p->get_future();
+        auto query = format("_{}._{}.{}",
+                            service,
+                            proto == srv_proto::tcp ? "tcp" : "udp",
+                            domain);
+        return lookup_srv(std::move(query)).then([] (srv_answer a) {
+            return std::move(a.records);
+        });
+    }
 
-        const auto query = format("_{}._{}.{}",
-                                  service,
-                                  proto == srv_proto::tcp ? "tcp" : "udp",
-                                  domain);
+    future<srv_answer> lookup_srv(sstring query) {
+        return lookup(_srv_cache, query, [this, query] {
+            if (auto shard = owner_shard(query); shard != this_shard_id()) {
+                return smp::submit_to(shard, [query] {
+                    return resolver()._impl->lookup_srv(query);
+                });
+            }
+            return query_srv_records(query);
+        });
+    }
+
+    future<srv_answer> query_srv_records(const sstring& query) {
+        auto p = std::make_unique<promise<srv_answer>>();
+        auto f = p->get_future();
 
         dns_log.debug("Query srv {}", query);
 
@@ -373,15 +437,15 @@ class net::dns_resolver::impl
         ares_query_dnsrec(_channel, query.c_str(), ARES_CLASS_IN, ARES_REC_TYPE_SRV,
                           [](void* arg, ares_status_t status, size_t timeouts,
                              const ares_dns_record *dnsrec) {
-            auto p = std::unique_ptr<promise<srv_records>>(
-                reinterpret_cast<promise<srv_records> *>(arg));
+            auto p = std::unique_ptr<promise<srv_answer>>(
+                reinterpret_cast<promise<srv_answer> *>(arg));
             if (status != ARES_SUCCESS) {
                 dns_log.debug("Query failed: {}", fmt::underlying(status));
                 p->set_exception(std::system_error(status, ares_errorc));
                 return;
             }
             const size_t rr_count = ares_dns_record_rr_cnt(dnsrec, ARES_SECTION_ANSWER);
-            srv_records replies;
+            srv_answer replies;
             for (size_t i = 0; i < rr_count; i++) {
                 const ares_dns_rr_t* rr = ares_dns_record_rr_get(
                     const_cast<ares_dns_record*>(dnsrec),
@@ -395,12 +459,16 @@ class net::dns_resolver::impl
                     ares_dns_rr_get_type(rr) != ARES_REC_TYPE_SRV) {
                     continue;
                 }
-                replies.push_back({
+                replies.records.push_back({
                     ares_dns_rr_get_u16(rr, ARES_RR_SRV_PRIORITY),
                     ares_dns_rr_get_u16(rr, ARES_RR_SRV_WEIGHT),
                     ares_dns_rr_get_u16(rr, ARES_RR_SRV_PORT),
                     sstring{ares_dns_rr_get_str(rr, ARES_RR_SRV_TARGET)}
                 });
+                auto ttl = std::chrono::seconds(ares_dns_rr_get_ttl(rr));
+                if (!replies.ttl || ttl < *replies.ttl) {
+                    replies.ttl = ttl;
+                }
             }
             if (status != ARES_SUCCESS) {
                 dns_log.debug("Parse failed: {}", fmt::underlying(status));
@@ -413,8 +481,8 @@ class net::dns_resolver::impl
         ares_query(_channel, query.c_str(), ns_c_in, ns_t_srv,
                    [](void* arg, int status, int timeouts,
                       unsigned char* buf, int len) {
-            auto p = std::unique_ptr<promise<srv_records>>(
-                reinterpret_cast<promise<srv_records> *>(arg));
+            auto p = std::unique_ptr<promise<srv_answer>>(
+                reinterpret_cast<promise<srv_answer> *>(arg));
             if (status != ARES_SUCCESS) {
                 dns_log.debug("Query failed: {}", status);
                 p->set_exception(std::system_error(status, ares_errorc));
@@ -428,7 +496,8 @@ class net::dns_resolver::impl
                 return;
             }
             try {
-                p->set_value(make_srv_records(start));
+                // The old parser does not tell the TTL, the records are not cached
+                p->set_value(srv_answer{make_srv_records(start), std::nullopt});
             } catch (...) {
                 p->set_exception(std::current_exception());
             }
@@ -460,7 +529,107 @@ class net::dns_resolver::impl
         dns_log.trace("Closing gate");
         return _gate.close();
     }
+
+    const cache_stats& get_cache_stats() const noexcept {
+        return _cache_stats;
+    }
 private:
+    // The shard whose resolver queries upstream for \c key, when the
+    // default resolvers share their caches
+    unsigned owner_shard(const sstring& key) const {
+        if (!default_cache_shared || smp::count == 1 || resolver()._impl.get() != this) {
+            return this_shard_id();
+        }
+        return std::hash<sstring>()(key) % smp::count;
+    }
+
+    template <typename Answer, typename Query>
+    future<Answer> lookup(dns_cache<Answer>& cache, const sstring& key, Query query) {
+        if (!_cache_size) {
+            return query();
+        }
+        auto now = lowres_clock::now();
+        if (auto i = cache.entries.find(key); i != cache.entries.end()) {
+            auto& e = i->second;
+            if (e.expires > now) {
+                if (e.error) {
+                    ++_cache_stats.negative_hits;
+                    return make_exception_future<Answer>(e.error);
+                }
+                ++_cache_stats.hits;
+                auto answer = *e.answer;
+                // Like a caching server, tell what is left of the TTL
+                answer.ttl = std::chrono::duration_cast<std::chrono::seconds>(e.expires - now);
+                if (now >= e.refresh && !cache.pending.contains(key) && !_closed) {
+                    ++_cache_stats.prefetches;
+                    dns_log.debug("Prefetching {}", key);
+                    fetch(cache, key, std::move(query));
+                }
+                return make_ready_future<Answer>(std::move(answer));
+            }
+            cache.entries.erase(i);
+        }
+        if (auto i = cache.pending.find(key); i != cache.pending.end()) {
+            ++_cache_stats.coalesced;
+            return i->second.get_shared_future();
+        }
+        ++_cache_stats.misses;
+        fetch(cache, key, std::move(query));
+        return cache.pending.at(key).get_shared_future();
+    }
+
+    // Queries upstream for the pending entry of \c key, and caches the answer
+    template <typename Answer, typename Query>
+    void fetch(dns_cache<Answer>& cache, const sstring& key, Query query) {
+        cache.pending.try_emplace(key);
+        (void)futurize_invoke(std::move(query)).then_wrapped([this, self = shared_from_this(), &cache, key] (future<Answer> f) {
+            auto i = cache.pending.find(key);
+            if (f.failed()) {
+                auto ex = f.get_exception();
+                if (_negative_ttl.count() && is_negative(ex)) {
+                    store(cache, key, std::nullopt, ex, _negative_ttl);
+                }
+                i->second.set_exception(std::move(ex));
+            } else {
+                auto answer = f.get();
+                if (answer.ttl && answer.ttl->count() > 0) {
+                    store(cache, key, answer, nullptr, std::min(*answer.ttl, _cache_max_ttl));
+                }
+                i->second.set_value(std::move(answer));
+            }
+            cache.pending.erase(i);
+        });
+    }
+
+    template <typename Answer>
+    void store(dns_cache<Answer>& cache, const sstring& key, std::optional<std::type_identity_t<Answer>> answer, std::exception_ptr error, std::chrono::seconds ttl) {
+        auto now = lowres_clock::now();
+        if (cache.entries.size() >= _cache_size && !cache.entries.contains(key)) {
+            std::erase_if(cache.entries, [now] (const auto& e) { return e.second.expires <= now; });
+            if (cache.entries.size() >= _cache_size) {
+                cache.entries.erase(cache.entries.begin());
+            }
+        }
+        auto& e = cache.entries[key];
+        e.answer = std::move(answer);
+        e.error = std::move(error);
+        e.expires = now + ttl;
+        e.refresh = e.expires - std::chrono::duration_cast<lowres_clock::duration>(ttl * _prefetch_ratio);
+    }
+
+    // Whether the error tells the name, or the records asked for, do
+    // not exist, rather than that it could not be told
+    static bool is_negative(const std::exception_ptr& ex) {
+        try {
+            std::rethrow_exception(ex);
+        } catch (const std::system_error& e) {
+            return e.code().category() == ares_errorc
+                && (e.code().value() == ARES_ENOTFOUND || e.code().value() == ARES_ENODATA);
+        } catch (...) {
+            return false;
+        }
+    }
+
     enum class type {
         none, tcp, udp
     };
@@ -568,6 +737,9 @@ class net::dns_resolver::impl
             e.names.emplace_back(cname->alias);
         }
         for (auto node = ai->nodes; node != nullptr; node = node->ai_next) {
+            if (!e.ttl || std::chrono::seconds(node->ai_ttl) < *e.ttl) {
+                e.ttl = std::chrono::seconds(node->ai_ttl);
+            }
             switch (node->ai_family) {
                 case AF_INET:
                     e.addr_list.emplace_back(reinterpret_cast<const sockaddr_in*>(node->ai_addr)->sin_addr);
@@ -1110,6 +1282,15 @@ class net::dns_resolver::impl
     timer<> _timer;
     gate _gate;
     bool _closed = false;
+
+    size_t _cache_size;
+    std::chrono::seconds _cache_max_ttl;
+    std::chrono::seconds _negative_ttl;
+    double _prefetch_ratio;
+    // By the family asked for: any, INET, INET6
+    std::array<dns_cache<hostent>, 3> _host_cache;
+    dns_cache<srv_answer> _srv_cache;
+    cache_stats _cache_stats;
 };
 
 net::dns_resolver::dns_resolver()
@@ -1156,7 +1337,11 @@ future<> net::dns_resolver::close() {
     return _impl->close();
 }
 
-static net::dns_resolver& resolver() {
+const net::dns_resolver::cache_stats& net::dns_resolver::get_cache_stats() const noexcept {
+    return _impl->get_cache_stats();
+}
+
+net::dns_resolver& resolver() {
     static thread_local net::dns_resolver resolver;
     return resolver;
 }
@@ -1184,6 +1369,12 @@ future<net::dns_resolver::srv_records> net::dns::get_srv_records(net::dns_resolv
     return resolver().get_srv_records(proto, service, domain);
 }
 
+future<> net::dns::share_cache_across_shards() {
+    return smp::invoke_on_all([] {
+        default_cache_shared = true;
+    });
+}
+
 future<sstring> net::inet_address::hostname() const {
     return dns::resolve_addr(*this);
 }
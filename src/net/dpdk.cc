@@ -28,6 +28,8 @@ module;
 #include <atomic>
 #include <vector>
 #include <queue>
+#include <mutex>
+#include <unordered_map>
 #include <getopt.h>
 #include <malloc.h>
 
@@ -39,7 +41,12 @@ module;
 #include <rte_ethdev.h>
 #include <rte_cycles.h>
 #include <rte_memzone.h>
+#include <rte_memory.h>
+#include <rte_dev.h>
+#include <rte_errno.h>
 #include <rte_vfio.h>
+#include <rte_flow.h>
+#include <rte_mbuf_dyn.h>
 
 #include <boost/preprocessor.hpp>
 
@@ -359,6 +366,13 @@ class dpdk_device : public device {
     bool _is_i40e_device = false;
     bool _is_vmxnet3_device = false;
     dpdk_xstats _xstats;
+    // The rte_flow rules of steer_tcp_port(), installed and removed by
+    // the shards the ports are steered to
+    std::mutex _steered_ports_lock;
+    std::unordered_map<uint16_t, rte_flow*> _steered_ports;
+    // The mbuf dynamic field and flag of the rx timestamps
+    int _rx_timestamp_offset = -1;
+    uint64_t _rx_timestamp_flag = 0;
 
 public:
     rte_eth_dev_info _dev_info = {};
@@ -404,6 +418,18 @@ class dpdk_device : public device {
      */
     void set_hw_flow_control();
 
+    /**
+     * Registers this shard's seastar memory with DPDK as external memory and
+     * maps it for DMA by the device, so that the zero-copy queue can be used
+     * when seastar memory is not backed by hugetlbfs.
+     *
+     * This needs IOVA-as-VA mode, where the IOVA of a page is its virtual
+     * address and does not need to be known to DPDK.
+     *
+     * @return the registered memory, or nullopt if it could not be mapped.
+     */
+    std::optional<memory::memory_layout> register_extmem();
+
 public:
     dpdk_device(uint16_t port_idx, uint16_t num_queues, bool use_lro,
                 bool enable_fc)
@@ -511,7 +537,16 @@ class dpdk_device : public device {
         assert(_redir_table.size());
         return _redir_table[hash & (_redir_table.size() - 1)];
     }
+    virtual bool steer_tcp_port(uint16_t port, unsigned cpu) override;
+    virtual void unsteer_tcp_port(uint16_t port) override;
     uint16_t port_idx() { return _port_idx; }
+    /// The NIC clock reading the device stamped \c m with, if it did
+    std::optional<uint64_t> rx_timestamp_ticks(const rte_mbuf* m) const {
+        if (!(m->ol_flags & _rx_timestamp_flag)) {
+            return std::nullopt;
+        }
+        return *RTE_MBUF_DYNFIELD(m, _rx_timestamp_offset, const rte_mbuf_timestamp_t*);
+    }
     bool is_i40e_device() const {
         return _is_i40e_device;
     }
@@ -961,7 +996,7 @@ class dpdk_qp : public net::qp {
             //
             rte_iova_t iova = rte_mem_virt2iova(va);
 
-            if (iova == RTE_BAD_IOVA) {
+            if (iova == RTE_BAD_IOVA || !qp.dma_mapped(va, buf_len)) {
                 return copy_one_data_buf(qp, m, va, buf_len);
             }
 
@@ -1249,8 +1284,13 @@ class dpdk_qp : public net::qp {
     };
 
 public:
+    /**
+     * @param extmem seastar memory the device has been given access to as
+     *               DPDK external memory, if it is not backed by hugetlbfs
+     */
     explicit dpdk_qp(dpdk_device* dev, uint16_t qid,
-                     const std::string stats_plugin_name);
+                     const std::string stats_plugin_name,
+                     std::optional<memory::memory_layout> extmem = std::nullopt);
 
     virtual void rx_start() override;
     virtual future<> send(packet p) override {
@@ -1302,8 +1342,8 @@ class dpdk_qp : public net::qp {
             rte_mbuf* m = _tx_burst[_tx_burst_idx + i];
             bytes    += m->pkt_len;
             nr_frags += m->nb_segs;
-            pb.pop_front();
         }
+        pb.pop_front_n(sent);
 
         _stats.tx.good.update_frags_stats(nr_frags, bytes);
 
@@ -1360,6 +1400,13 @@ class dpdk_qp : public net::qp {
 
     bool init_rx_mbuf_pool();
     bool map_dma();
+
+    /**
+     * Checks that the device may access the given buffer directly.
+     */
+    bool dma_mapped(const char* va, size_t len) const {
+        return !_extmem || (uintptr_t(va) >= _extmem->start && uintptr_t(va) + len <= _extmem->end);
+    }
     bool rx_gc();
     bool refill_one_cluster(rte_mbuf* head);
 
@@ -1415,6 +1462,15 @@ class dpdk_qp : public net::qp {
      */
     std::optional<packet> from_mbuf_lro(rte_mbuf* m);
 
+    /**
+     * Converts the NIC clock reading an mbuf was stamped with to the system
+     * clock.
+     *
+     * @return the time, or a "disengaged" optional until the NIC clock has
+     *         been sampled for long enough to know its rate.
+     */
+    std::optional<std::chrono::system_clock::time_point> rx_timestamp(uint64_t ticks);
+
 private:
     dpdk_device* _dev;
     uint16_t _qid;
@@ -1431,7 +1487,21 @@ class dpdk_qp : public net::qp {
     internal::poller _tx_gc_poller;
     std::vector<rte_mbuf*> _tx_burst;
     uint16_t _tx_burst_idx = 0;
+    // With seastar memory registered as external memory, memory outside of
+    // it is not mapped for DMA, although it has a (virtual) IOVA
+    std::optional<memory::memory_layout> _extmem;
     static constexpr phys_addr_t page_mask = ~(memory::page_size - 1);
+    // Maps the NIC clock, which counts in device specific ticks, to the
+    // system clock: resampled every second, the rate being that since the
+    // first sample
+    struct {
+        uint64_t first_ticks = 0;
+        std::chrono::system_clock::time_point first;
+        uint64_t base_ticks = 0;
+        std::chrono::system_clock::time_point base;
+        double ns_per_tick = 0;
+        lowres_clock::time_point next_sample;
+    } _rx_clock;
 };
 
 int dpdk_device::init_port_start()
@@ -1562,6 +1632,14 @@ int dpdk_device::init_port_start()
         port_conf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_VLAN_STRIP;
     }
 
+    // Have the NIC stamp the received packets
+    if ((_dev_info.rx_offload_capa & RTE_ETH_RX_OFFLOAD_TIMESTAMP) &&
+        rte_mbuf_dyn_rx_timestamp_register(&_rx_timestamp_offset, &_rx_timestamp_flag) == 0) {
+        printf("RX timestamps supported\n");
+        port_conf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_TIMESTAMP;
+        _hw_features.rx_timestamps = true;
+    }
+
 #ifdef RTE_ETHDEV_HAS_LRO_SUPPORT
     // Enable LRO
     if (_use_lro && (_dev_info.rx_offload_capa & RTE_ETH_RX_OFFLOAD_TCP_LRO)) {
@@ -1738,6 +1816,71 @@ void dpdk_device::init_port_fini()
     printf("Created DPDK device\n");
 }
 
+bool dpdk_device::steer_tcp_port(uint16_t port, unsigned cpu)
+{
+    // The queue of a shard is the one with its index
+    if (cpu >= _num_queues) {
+        return false;
+    }
+
+    rte_flow_attr attr = {};
+    attr.ingress = 1;
+
+    rte_flow_item_tcp tcp_spec = {};
+    rte_flow_item_tcp tcp_mask = {};
+    tcp_spec.hdr.dst_port = rte_cpu_to_be_16(port);
+    tcp_mask.hdr.dst_port = RTE_BE16(0xffff);
+    rte_flow_item pattern[] = {
+        { .type = RTE_FLOW_ITEM_TYPE_ETH },
+        { .type = RTE_FLOW_ITEM_TYPE_IPV4 },
+        { .type = RTE_FLOW_ITEM_TYPE_TCP, .spec = &tcp_spec, .mask = &tcp_mask },
+        { .type = RTE_FLOW_ITEM_TYPE_END },
+    };
+
+    rte_flow_action_queue queue = {};
+    queue.index = cpu;
+    rte_flow_action actions[] = {
+        { .type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &queue },
+        { .type = RTE_FLOW_ACTION_TYPE_END },
+    };
+
+    rte_flow_error error = {};
+    if (rte_flow_validate(_port_idx, &attr, pattern, actions, &error)) {
+        printf("Port %u: can't steer TCP port %u to queue %u: %s\n",
+               _port_idx, port, cpu, error.message ? error.message : "unsupported");
+        return false;
+    }
+    auto flow = rte_flow_create(_port_idx, &attr, pattern, actions, &error);
+    if (!flow) {
+        printf("Port %u: failed to steer TCP port %u to queue %u: %s\n",
+               _port_idx, port, cpu, error.message ? error.message : "unknown error");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> g(_steered_ports_lock);
+    auto [it, inserted] = _steered_ports.emplace(port, flow);
+    if (!inserted) {
+        rte_flow_destroy(_port_idx, it->second, &error);
+        it->second = flow;
+    }
+    return true;
+}
+
+void dpdk_device::unsteer_tcp_port(uint16_t port)
+{
+    std::lock_guard<std::mutex> g(_steered_ports_lock);
+    auto it = _steered_ports.find(port);
+    if (it == _steered_ports.end()) {
+        return;
+    }
+    rte_flow_error error = {};
+    if (rte_flow_destroy(_port_idx, it->second, &error)) {
+        printf("Port %u: failed to remove the steering of TCP port %u: %s\n",
+               _port_idx, port, error.message ? error.message : "unknown error");
+    }
+    _steered_ports.erase(it);
+}
+
 template <bool HugetlbfsMemBackend>
 void* dpdk_qp<HugetlbfsMemBackend>::alloc_mempool_xmem(
     uint16_t num_bufs, uint16_t buf_sz, size_t& xmem_size)
@@ -1874,6 +2017,32 @@ bool dpdk_qp<HugetlbfsMemBackend>::map_dma()
                                       m.start, iova, m.end - m.start) == 0;
 }
 
+std::optional<memory::memory_layout> dpdk_device::register_extmem()
+{
+    if (rte_eal_iova_mode() != RTE_IOVA_VA) {
+        return std::nullopt;
+    }
+
+    auto m = memory::get_memory_layout();
+    void* va = reinterpret_cast<void*>(m.start);
+    size_t len = m.end - m.start;
+
+    if (rte_extmem_register(va, len, nullptr, 0, memory::page_size) < 0) {
+        printf("Port %d: failed to register seastar memory as external memory: %s\n",
+               _port_idx, rte_strerror(rte_errno));
+        return std::nullopt;
+    }
+
+    if (rte_dev_dma_map(_dev_info.device, va, m.start, len) < 0) {
+        printf("Port %d: failed to map seastar memory for DMA: %s\n",
+               _port_idx, rte_strerror(rte_errno));
+        rte_extmem_unregister(va, len);
+        return std::nullopt;
+    }
+
+    return m;
+}
+
 void dpdk_device::check_port_link_status()
 {
     using namespace std::literals::chrono_literals;
@@ -1917,17 +2086,20 @@ void dpdk_device::check_port_link_status()
 
 template <bool HugetlbfsMemBackend>
 dpdk_qp<HugetlbfsMemBackend>::dpdk_qp(dpdk_device* dev, uint16_t qid,
-                                      const std::string stats_plugin_name)
+                                      const std::string stats_plugin_name,
+                                      std::optional<memory::memory_layout> extmem)
      : qp(true, stats_plugin_name, qid), _dev(dev), _qid(qid),
        _rx_gc_poller(reactor::poller::simple([&] { return rx_gc(); })),
        _tx_buf_factory(qid),
-       _tx_gc_poller(reactor::poller::simple([&] { return _tx_buf_factory.gc(); }))
+       _tx_gc_poller(reactor::poller::simple([&] { return _tx_buf_factory.gc(); })),
+       _extmem(extmem)
 {
     if (!init_rx_mbuf_pool()) {
         rte_exit(EXIT_FAILURE, "Cannot initialize mbuf pools\n");
     }
 
-    if (HugetlbfsMemBackend && !map_dma()) {
+    // External memory has been mapped when it was registered
+    if (HugetlbfsMemBackend && !_extmem && !map_dma()) {
         rte_exit(EXIT_FAILURE, "Cannot map DMA\n");
     }
 
@@ -2163,6 +2335,12 @@ void dpdk_qp<HugetlbfsMemBackend>::process_packets(
             oi.vlan_tci = m->vlan_tci;
         }
 
+        if (_dev->hw_features().rx_timestamps) {
+            if (auto ticks = _dev->rx_timestamp_ticks(m)) {
+                oi.rx_timestamp = rx_timestamp(*ticks);
+            }
+        }
+
         if (_dev->hw_features().rx_csum_offload) {
             if (m->ol_flags & (RTE_MBUF_F_RX_IP_CKSUM_BAD | RTE_MBUF_F_RX_L4_CKSUM_BAD)) {
                 // Packet with bad checksum, just drop it.
@@ -2191,6 +2369,36 @@ void dpdk_qp<HugetlbfsMemBackend>::process_packets(
     }
 }
 
+template <bool HugetlbfsMemBackend>
+std::optional<std::chrono::system_clock::time_point>
+dpdk_qp<HugetlbfsMemBackend>::rx_timestamp(uint64_t ticks)
+{
+    auto& c = _rx_clock;
+    auto now = lowres_clock::now();
+    if (now >= c.next_sample) {
+        c.next_sample = now + std::chrono::seconds(1);
+        uint64_t clock_ticks;
+        if (rte_eth_read_clock(_dev->port_idx(), &clock_ticks) == 0) {
+            auto clock_now = std::chrono::system_clock::now();
+            if (!c.first_ticks) {
+                c.first_ticks = clock_ticks;
+                c.first = clock_now;
+            } else if (clock_ticks > c.first_ticks) {
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_now - c.first).count();
+                c.ns_per_tick = double(ns) / (clock_ticks - c.first_ticks);
+            }
+            c.base_ticks = clock_ticks;
+            c.base = clock_now;
+        }
+    }
+    if (!c.ns_per_tick) {
+        return std::nullopt;
+    }
+    // The packet may have been stamped before or after the last sample
+    auto ns = double(int64_t(ticks - c.base_ticks)) * c.ns_per_tick;
+    return c.base + std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double, std::nano>(ns));
+}
+
 template <bool HugetlbfsMemBackend>
 bool dpdk_qp<HugetlbfsMemBackend>::poll_rx_once()
 {
@@ -2245,6 +2453,14 @@ std::unique_ptr<qp> dpdk_device::init_local_queue(const program_options::option_
     if (net_opts->_hugepages) {
         qp = std::make_unique<dpdk_qp<true>>(this, qid,
                                  _stats_plugin_name + "-" + _stats_plugin_inst);
+    } else if (auto extmem = register_extmem()) {
+        //
+        // Without hugetlbfs, seastar memory can still be used for zero-copy
+        // Rx and Tx once the device has been given access to it.
+        //
+        qp = std::make_unique<dpdk_qp<true>>(this, qid,
+                                 _stats_plugin_name + "-" + _stats_plugin_inst,
+                                 extmem);
     } else {
         qp = std::make_unique<dpdk_qp<false>>(this, qid,
                                  _stats_plugin_name + "-" + _stats_plugin_inst);
@@ -24,6 +24,11 @@ module;
 #endif
 
 #include <arpa/inet.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #ifdef SEASTAR_MODULE
 module seastar;
@@ -36,12 +41,163 @@ namespace seastar {
 
 namespace net {
 
+namespace {
+
+// The vector kernels sum the data as little-endian 32-bit words, into
+// 64-bit lanes that can not overflow, and take a length that is a multiple
+// of kernel_block. Summing in the host's byte order and swapping the
+// folded sum gives the same one's complement sum as summing big-endian
+// 16-bit words (RFC 1071).
+using checksum_kernel = uint64_t (*)(const char* data, size_t len) noexcept;
+
+constexpr size_t kernel_block = 64;
+// Shorter data, such as most headers, is not worth the call
+constexpr size_t kernel_min_len = 2 * kernel_block;
+
+#if defined(__x86_64__)
+
+uint64_t sum_sse2(const char* data, size_t len) noexcept {
+    const auto mask = _mm_set1_epi64x(0xffff'ffff);
+    auto lo = _mm_setzero_si128();
+    auto hi = _mm_setzero_si128();
+    for (; len; data += kernel_block, len -= kernel_block) {
+        for (size_t i = 0; i < kernel_block; i += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            lo = _mm_add_epi64(lo, _mm_and_si128(v, mask));
+            hi = _mm_add_epi64(hi, _mm_srli_epi64(v, 32));
+        }
+    }
+    auto acc = _mm_add_epi64(lo, hi);
+    return uint64_t(_mm_cvtsi128_si64(acc)) + uint64_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc)));
+}
+
+[[gnu::target("avx2")]]
+uint64_t sum_avx2(const char* data, size_t len) noexcept {
+    const auto mask = _mm256_set1_epi64x(0xffff'ffff);
+    auto lo = _mm256_setzero_si256();
+    auto hi = _mm256_setzero_si256();
+    for (; len; data += kernel_block, len -= kernel_block) {
+        auto v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        auto v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+        lo = _mm256_add_epi64(lo, _mm256_and_si256(v0, mask));
+        hi = _mm256_add_epi64(hi, _mm256_srli_epi64(v0, 32));
+        lo = _mm256_add_epi64(lo, _mm256_and_si256(v1, mask));
+        hi = _mm256_add_epi64(hi, _mm256_srli_epi64(v1, 32));
+    }
+    auto acc = _mm256_add_epi64(lo, hi);
+    auto acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return uint64_t(_mm_cvtsi128_si64(acc128)) + uint64_t(_mm_extract_epi64(acc128, 1));
+}
+
+[[gnu::target("avx512f")]]
+uint64_t sum_avx512(const char* data, size_t len) noexcept {
+    const auto mask = _mm512_set1_epi64(0xffff'ffff);
+    auto lo = _mm512_setzero_si512();
+    auto hi = _mm512_setzero_si512();
+    for (; len; data += kernel_block, len -= kernel_block) {
+        auto v = _mm512_loadu_si512(data);
+        lo = _mm512_add_epi64(lo, _mm512_and_si512(v, mask));
+        hi = _mm512_add_epi64(hi, _mm512_srli_epi64(v, 32));
+    }
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(lo, hi));
+}
+
+#elif defined(__aarch64__)
+
+uint64_t sum_neon(const char* data, size_t len) noexcept {
+    auto acc0 = vdupq_n_u64(0);
+    auto acc1 = vdupq_n_u64(0);
+    for (; len; data += kernel_block, len -= kernel_block) {
+        auto p = reinterpret_cast<const uint8_t*>(data);
+        acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(p)));
+        acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(p + 16)));
+        acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(p + 32)));
+        acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(p + 48)));
+    }
+    return vaddvq_u64(vaddq_u64(acc0, acc1));
+}
+
+#endif
+
+checksum_kernel kernel_for(seastar::internal::checksum_isa isa) noexcept {
+    using seastar::internal::checksum_isa;
+    switch (isa) {
+    case checksum_isa::scalar:
+        return nullptr;
+#if defined(__x86_64__)
+    case checksum_isa::sse2:
+        return sum_sse2;
+    case checksum_isa::avx2:
+        return __builtin_cpu_supports("avx2") ? sum_avx2 : nullptr;
+    case checksum_isa::avx512:
+        return __builtin_cpu_supports("avx512f") ? sum_avx512 : nullptr;
+#elif defined(__aarch64__)
+    case checksum_isa::neon:
+        return sum_neon;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+checksum_kernel best_kernel() noexcept {
+    using seastar::internal::checksum_isa;
+    for (auto isa : {checksum_isa::avx512, checksum_isa::avx2, checksum_isa::sse2, checksum_isa::neon}) {
+        if (auto k = kernel_for(isa)) {
+            return k;
+        }
+    }
+    return nullptr;
+}
+
+checksum_kernel& active_kernel() noexcept {
+    static checksum_kernel kernel = best_kernel();
+    return kernel;
+}
+
+// Folds a kernel's sum to 16 bits, in network byte order. A zero sum stays
+// zero, and any other one folds to a non-zero value, as in get().
+uint16_t fold_kernel_sum(uint64_t sum) noexcept {
+    sum = (sum & 0xffff'ffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return ntohs(uint16_t(sum));
+}
+
+}
+
+}
+
+namespace internal {
+
+bool use_checksum_isa(checksum_isa isa) noexcept {
+    auto k = net::kernel_for(isa);
+    if (!k && isa != checksum_isa::scalar) {
+        return false;
+    }
+    net::active_kernel() = k;
+    return true;
+}
+
+}
+
+namespace net {
+
 void checksummer::sum(const char* data, size_t len) {
     auto orig_len = len;
     if (odd) {
         csum += uint8_t(*data++);
         --len;
     }
+    if (len >= kernel_min_len) {
+        if (auto kernel = active_kernel()) {
+            auto n = len & ~(kernel_block - 1);
+            csum += fold_kernel_sum(kernel(data, n));
+            data += n;
+            len -= n;
+        }
+    }
     auto p64 = reinterpret_cast<const packed<uint64_t>*>(data);
     while (len >= 8) {
         csum += ntohq(*p64++);
@@ -22,7 +22,14 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <netinet/tcp.h>
 #endif
 
 #include <seastar/net/stack.hh>
@@ -56,6 +63,14 @@ class native_server_socket_impl : public server_socket_impl {
 template <typename Protocol>
 native_server_socket_impl<Protocol>::native_server_socket_impl(Protocol& proto, uint16_t port, listen_options opt)
     : _listener(proto.listen(port)) {
+    if (!opt.congestion_control.empty()) {
+        _listener.set_congestion_control(std::move(opt.congestion_control));
+    }
+    // Connections are only accepted where they land, so have the device
+    // land them all on the shard they are meant for
+    if (opt.lba == server_socket::load_balancing_algorithm::fixed && opt.fixed_cpu == this_shard_id()) {
+        _listener.steer_to_local_shard();
+    }
 }
 
 template <typename Protocol>
@@ -87,7 +102,9 @@ socket_address native_server_socket_impl<Protocol>::local_address() const {
 // native_connected_socket_impl
 template <typename Protocol>
 class native_connected_socket_impl : public connected_socket_impl {
+    using rx_timestamp = lw_shared_ptr<std::optional<std::chrono::system_clock::time_point>>;
     lw_shared_ptr<typename Protocol::connection> _conn;
+    rx_timestamp _rx_timestamp;
     class native_data_source_impl;
     class native_data_sink_impl;
 public:
@@ -109,6 +126,8 @@ class native_connected_socket_impl : public connected_socket_impl {
     socket_address local_address() const noexcept override;
     socket_address remote_address() const noexcept override;
     virtual future<> wait_input_shutdown() override;
+    bool enable_rx_timestamps() override;
+    std::optional<std::chrono::system_clock::time_point> last_rx_timestamp() const noexcept override;
 };
 
 template <typename Protocol>
@@ -158,9 +177,10 @@ class native_connected_socket_impl<Protocol>::native_data_source_impl final
     size_t _cur_frag = 0;
     bool _eof = false;
     packet _buf;
+    rx_timestamp _rx_timestamp;
 public:
-    explicit native_data_source_impl(lw_shared_ptr<connection_type> conn)
-        : _conn(std::move(conn)) {}
+    explicit native_data_source_impl(lw_shared_ptr<connection_type> conn, rx_timestamp rx_ts)
+        : _conn(std::move(conn)), _rx_timestamp(std::move(rx_ts)) {}
     virtual future<temporary_buffer<char>> get() override {
         if (_eof) {
             return make_ready_future<temporary_buffer<char>>(temporary_buffer<char>(0));
@@ -175,6 +195,11 @@ class native_connected_socket_impl<Protocol>::native_data_source_impl final
             _buf = _conn->read();
             _cur_frag = 0;
             _eof = !_buf.len();
+            if (_rx_timestamp && !_eof) {
+                // The segments read are appended to the first one, which
+                // keeps its offload info
+                *_rx_timestamp = _buf.get_offload_info().rx_timestamp;
+            }
             return get();
         });
     }
@@ -208,7 +233,7 @@ class native_connected_socket_impl<Protocol>::native_data_sink_impl final
 
 template <typename Protocol>
 data_source native_connected_socket_impl<Protocol>::source() {
-    return data_source(std::make_unique<native_data_source_impl>(_conn));
+    return data_source(std::make_unique<native_data_source_impl>(_conn, _rx_timestamp));
 }
 
 template <typename Protocol>
@@ -266,11 +291,24 @@ keepalive_params native_connected_socket_impl<Protocol>::get_keepalive_parameter
 
 template<typename Protocol>
 void native_connected_socket_impl<Protocol>::set_sockopt(int level, int optname, const void* data, size_t len) {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        _conn->set_congestion_control(std::string_view(static_cast<const char*>(data), strnlen(static_cast<const char*>(data), len)));
+        return;
+    }
     throw std::runtime_error("Setting custom socket options is not supported for native stack");
 }
 
 template<typename Protocol>
 int native_connected_socket_impl<Protocol>::get_sockopt(int level, int optname, void* data, size_t len) const {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        std::string_view name = _conn->congestion_control();
+        if (len < name.size() + 1) {
+            throw std::invalid_argument("buffer too small for the congestion control algorithm name");
+        }
+        std::copy(name.begin(), name.end(), static_cast<char*>(data));
+        static_cast<char*>(data)[name.size()] = '\0';
+        return name.size() + 1;
+    }
     throw std::runtime_error("Getting custom socket options is not supported for native stack");
 }
 
@@ -289,6 +327,20 @@ future<> native_connected_socket_impl<Protocol>::wait_input_shutdown() {
     return _conn->wait_input_shutdown();
 }
 
+template <typename Protocol>
+bool native_connected_socket_impl<Protocol>::enable_rx_timestamps() {
+    if (!_conn->hw_features().rx_timestamps) {
+        return false;
+    }
+    _rx_timestamp = make_lw_shared<std::optional<std::chrono::system_clock::time_point>>();
+    return true;
+}
+
+template <typename Protocol>
+std::optional<std::chrono::system_clock::time_point> native_connected_socket_impl<Protocol>::last_rx_timestamp() const noexcept {
+    return _rx_timestamp ? *_rx_timestamp : std::nullopt;
+}
+
 }
 
 }
@@ -58,6 +58,7 @@ module seastar;
 #include <seastar/net/dhcp.hh>
 #include <seastar/net/config.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/util/conversions.hh>
 #endif
 
 namespace seastar {
@@ -85,6 +86,13 @@ void create_native_net_device(const native_stack_options& opts) {
     std::unique_ptr<device> dev;
 
     if ( deprecated_config_used) {
+        if (opts.xdp_opts.xdp_device) {
+            std::optional<ipv4_address> host_address;
+            if (!opts.dhcp.get_value()) {
+                host_address = ipv4_address(opts.host_ipv4_addr.get_value());
+            }
+            dev = create_xdp_net_device(opts.xdp_opts, host_address);
+        } else
 #ifdef SEASTAR_HAVE_DPDK
         if ( opts.dpdk_pmd) {
              dev = create_dpdk_net_device(opts.dpdk_opts.dpdk_port_index.get_value(), smp::count,
@@ -131,10 +139,13 @@ void create_native_net_device(const native_stack_options& opts) {
                 }
                 cpu_weights[qid] = opts.hw_queue_weight.get_value();
                 qp->configure_proxies(cpu_weights);
+                qp->set_tx_batch_delay(std::chrono::microseconds(opts.tx_batch_delay_us.get_value()));
                 sdev->set_local_queue(std::move(qp));
             } else {
                 auto master = qid % sdev->hw_queues_count();
-                sdev->set_local_queue(create_proxy_net_device(master, sdev.get()));
+                auto qp = create_proxy_net_device(master, sdev.get());
+                qp->set_tx_batch_delay(std::chrono::microseconds(opts.tx_batch_delay_us.get_value()));
+                sdev->set_local_queue(std::move(qp));
             }
         }).then([sem] {
             sem->signal();
@@ -193,6 +204,9 @@ class native_network_stack : public network_stack {
     void arp_learn(ethernet_address l2, ipv4_address l3) {
         _inet.learn(l2, l3);
     }
+    void arp_query(ipv4_address l3) {
+        _inet.arp_resolve_for_shard(l3);
+    }
     friend class native_server_socket_impl<tcp4>;
 
     class native_network_interface;
@@ -223,7 +237,16 @@ net::datagram_channel native_network_stack::make_bound_datagram_channel(const so
 native_network_stack::native_network_stack(const native_stack_options& opts, std::shared_ptr<device> dev)
     : _netif(std::move(dev))
     , _inet(&_netif) {
+    _inet.share_arp();
+    if (opts.gro.get_value() != "off") {
+        _netif.enable_gro();
+    }
     _inet.get_udp().set_queue_size(opts.udpv4_queue_size.get_value());
+    _inet.get_tcp().set_congestion_control(opts.tcp_congestion_control.get_value());
+    _inet.get_tcp().set_sack(opts.tcp_sack.get_value() == "on");
+    _inet.get_tcp().set_receive_memory_limit(opts.tcp_receive_memory
+            ? parse_memory_size(opts.tcp_receive_memory.get_value())
+            : memory::stats().total_memory() / 4);
     _dhcp = opts.host_ipv4_addr.defaulted()
             && opts.gw_ipv4_addr.defaulted()
             && opts.netmask_ipv4_addr.defaulted() && opts.dhcp.get_value();
@@ -326,6 +349,15 @@ void arp_learn(ethernet_address l2, ipv4_address l3)
     });
 }
 
+void arp_query(unsigned cpu, ipv4_address l3)
+{
+    // FIXME: future is discarded
+    (void)smp::submit_to(cpu, [l3] {
+        auto & ns = static_cast<native_network_stack&>(engine().net());
+        ns.arp_query(l3);
+    });
+}
+
 void create_native_stack(const native_stack_options& opts, std::shared_ptr<device> dev) {
     native_network_stack::ready_promise.set_value(std::unique_ptr<network_stack>(std::make_unique<native_network_stack>(opts, std::move(dev))));
 }
@@ -364,8 +396,24 @@ native_stack_options::native_stack_options()
     , lro(*this, "lro",
                 "on",
                 "Enable LRO")
+    , gro(*this, "gro",
+                "on",
+                "Enable software GRO for devices without LRO")
+    , tcp_congestion_control(*this, "tcp-congestion-control",
+                "reno",
+                "TCP congestion control algorithm (reno, cubic or bbr)")
+    , tcp_sack(*this, "tcp-sack",
+                "off",
+                "Negotiate TCP SACK and recover from losses with it")
+    , tcp_receive_memory(*this, "tcp-receive-memory",
+                std::nullopt,
+                "Memory the TCP connections of a shard may buffer the received data in, in bytes (ex: 512M) (default: a quarter of the shard's memory)")
+    , tx_batch_delay_us(*this, "tx-batch-delay-us",
+                0,
+                "How long to hold the packets to send for more of them to be sent in a single burst, in microseconds (0 to send them at every poll)")
     , virtio_opts(this)
     , dpdk_opts(this)
+    , xdp_opts(this)
 {
 }
 
@@ -102,12 +102,24 @@ bool qp::poll_tx() {
             }
         } while (work && _tx_packetq.size() < 128);
     }
-    if (!_tx_packetq.empty()) {
-        _stats.tx.good.update_pkts_bunch(send(_tx_packetq));
-        return true;
+    if (_tx_packetq.empty()) {
+        return false;
     }
-
-    return false;
+    if (_tx_batch_delay.count() && _tx_packetq.size() < tx_batch_size) {
+        // The reactor does not sleep while the poller is registered, so
+        // the packets held are sent by a later poll
+        auto now = std::chrono::steady_clock::now();
+        if (!_tx_held_since) {
+            _tx_held_since = now;
+            return false;
+        }
+        if (now - *_tx_held_since < _tx_batch_delay) {
+            return false;
+        }
+    }
+    _tx_held_since.reset();
+    _stats.tx.good.update_pkts_bunch(send(_tx_packetq));
+    return true;
 }
 
 qp::qp(bool register_copy_stats,
@@ -288,6 +300,16 @@ interface::interface(std::shared_ptr<device> dev)
             }
             return p;
         });
+
+    namespace sm = metrics;
+    _metrics.add_group("network", {
+        sm::make_counter("forwarded_packets", _forward_stats.forwarded,
+                        sm::description("Counts the received packets passed on to the shard owning their flow. "
+                                        "Each costs a cross-shard message, so a rate close to the receive one means the device does not spread flows the way the shards own them.")),
+        sm::make_counter("forward_dropped_packets", _forward_stats.forward_dropped,
+                        sm::description("Counts the received packets dropped instead of being passed on to the shard owning their flow, "
+                                        "since too many were already in flight to other shards.")),
+    });
 }
 
 future<>
@@ -312,11 +334,20 @@ rss_key_type interface::rss_key() const {
     return _dev->rss_key();
 }
 
+bool interface::steer_tcp_port(uint16_t port, unsigned cpu) {
+    return _dev->steer_tcp_port(port, cpu);
+}
+
+void interface::unsteer_tcp_port(uint16_t port) {
+    _dev->unsteer_tcp_port(port);
+}
+
 void interface::forward(unsigned cpuid, packet p) {
     static __thread unsigned queue_depth;
 
     if (queue_depth < 1000) {
         queue_depth++;
+        _forward_stats.forwarded++;
         auto src_cpu = this_shard_id();
         // FIXME: future is discarded
         (void)smp::submit_to(cpuid, [this, p = std::move(p), src_cpu]() mutable {
@@ -324,10 +355,35 @@ void interface::forward(unsigned cpuid, packet p) {
         }).then([] {
             queue_depth--;
         });
+    } else {
+        _forward_stats.forward_dropped++;
     }
 }
 
+interface::~interface() = default;
+
+void interface::enable_gro() {
+    if (_gro || _hw_features.rx_lro || !_hw_features.rx_csum_offload) {
+        return;
+    }
+    _gro.emplace();
+    // Registered after the device's receive pollers, so runs once they
+    // passed on what they received
+    _gro_poller = std::make_unique<internal::poller>(reactor::poller::simple([this] {
+        return _gro->flush([this] (packet p) { deliver_packet(std::move(p)); });
+    }));
+}
+
 future<> interface::dispatch_packet(packet p) {
+    if (_gro) {
+        _gro->receive(std::move(p), [this] (packet p) { deliver_packet(std::move(p)); });
+    } else {
+        deliver_packet(std::move(p));
+    }
+    return make_ready_future<>();
+}
+
+void interface::deliver_packet(packet p) {
     auto eh = p.get_header<eth_hdr>();
     if (eh) {
         auto i = _proto_map.find(ntoh(eh->eth_proto));
@@ -359,7 +415,6 @@ future<> interface::dispatch_packet(packet p) {
             }
         }
     }
-    return make_ready_future<>();
 }
 
 }
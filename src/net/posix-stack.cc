@@ -27,17 +27,25 @@ module;
 #include <chrono>
 #include <cstring>
 #include <functional>
+#include <limits>
 #include <random>
+#include <deque>
 #include <variant>
 
 #include <unistd.h>
 #include <linux/if.h>
+#include <linux/errqueue.h>
+#include <linux/tls.h>
+#include <linux/net_tstamp.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
+#include <linux/sockios.h>
 #include <arpa/inet.h>
 #include <net/route.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netinet/sctp.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 
 #ifdef SEASTAR_MODULE
@@ -45,12 +53,14 @@ module seastar;
 #else
 #include <seastar/core/loop.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/timer.hh>
 #include <seastar/net/posix-stack.hh>
 #include <seastar/net/net.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/net/api.hh>
 #include <seastar/net/inet_address.hh>
 #include <seastar/util/std-compat.hh>
+#include "core/file-impl.hh"
 #endif
 
 namespace std {
@@ -236,6 +246,9 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     const posix_connected_socket_operations* _ops;
     conntrack::handle _handle;
     std::pmr::polymorphic_allocator<char>* _allocator;
+    std::optional<size_t> _zerocopy_threshold;
+    std::optional<size_t> _notsent_lowat;
+    posix_data_source_impl::rx_timestamp _rx_timestamp;
 private:
     explicit posix_connected_socket_impl(sa_family_t family, int protocol, pollable_fd fd, std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) :
         _fd(std::move(fd)), _ops(get_posix_connected_socket_ops(family, protocol)), _allocator(allocator) {}
@@ -247,10 +260,10 @@ class posix_connected_socket_impl final : public connected_socket_impl {
         return source(connected_socket_input_stream_config());
     }
     virtual data_source source(connected_socket_input_stream_config csisc) override {
-        return data_source(std::make_unique<posix_data_source_impl>(_fd, csisc, _allocator));
+        return data_source(std::make_unique<posix_data_source_impl>(_fd, csisc, _allocator, _rx_timestamp));
     }
     virtual data_sink sink() override {
-        return data_sink(std::make_unique< posix_data_sink_impl>(_fd));
+        return data_sink(std::make_unique< posix_data_sink_impl>(_fd, _zerocopy_threshold, _notsent_lowat));
     }
     virtual void shutdown_input() override {
         shutdown_socket_fd(_fd, SHUT_RD);
@@ -291,6 +304,62 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     future<> wait_input_shutdown() override {
         return _fd.poll_rdhup();
     }
+    future<> send_tls_control_record(uint8_t record_type, temporary_buffer<char> data) override {
+        // The header and cmsg are referenced until the send completes
+        struct control_record {
+            alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(uint8_t))];
+            ::iovec iov;
+            ::msghdr mh;
+            temporary_buffer<char> data;
+        };
+        auto rec = std::make_unique<control_record>();
+        rec->data = std::move(data);
+        rec->iov = {rec->data.get_write(), rec->data.size()};
+        memset(&rec->mh, 0, sizeof(rec->mh));
+        rec->mh.msg_iov = &rec->iov;
+        rec->mh.msg_iovlen = 1;
+        rec->mh.msg_control = rec->control;
+        rec->mh.msg_controllen = sizeof(rec->control);
+        auto cm = CMSG_FIRSTHDR(&rec->mh);
+        cm->cmsg_level = SOL_TLS;
+        cm->cmsg_type = TLS_SET_RECORD_TYPE;
+        cm->cmsg_len = CMSG_LEN(sizeof(record_type));
+        memcpy(CMSG_DATA(cm), &record_type, sizeof(record_type));
+        auto& mh = rec->mh;
+        return _fd.sendmsg(&mh).discard_result().finally([rec = std::move(rec)] {});
+    }
+    bool enable_zerocopy_send(size_t threshold) override {
+        int one = 1;
+        // Fails with EOPNOTSUPP on kernels or socket families without MSG_ZEROCOPY
+        if (::setsockopt(_fd.get_file_desc().get(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) {
+            return false;
+        }
+        _zerocopy_threshold = threshold;
+        return true;
+    }
+    bool set_notsent_lowat(size_t bytes) override {
+        int lowat = std::min<size_t>(bytes, std::numeric_limits<int>::max());
+        // Fails with EOPNOTSUPP on non-TCP sockets
+        if (::setsockopt(_fd.get_file_desc().get(), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) != 0) {
+            return false;
+        }
+        _notsent_lowat = lowat;
+        return true;
+    }
+    bool enable_rx_timestamps() override {
+        // The hardware timestamps are only reported by the interfaces set up
+        // to take them, the software ones otherwise
+        int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+                | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (::setsockopt(_fd.get_file_desc().get(), SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0) {
+            return false;
+        }
+        _rx_timestamp = make_lw_shared<std::optional<std::chrono::system_clock::time_point>>();
+        return true;
+    }
+    std::optional<std::chrono::system_clock::time_point> last_rx_timestamp() const noexcept override {
+        return _rx_timestamp ? *_rx_timestamp : std::nullopt;
+    }
 
     friend class posix_server_socket_impl;
     friend class posix_ap_server_socket_impl;
@@ -508,6 +577,8 @@ posix_server_socket_impl::accept() {
         auto cth = [this, &sa] {
             switch(_lba) {
             case server_socket::load_balancing_algorithm::connection_distribution:
+            // Not steered by the kernel, as the shards are not pinned to CPUs
+            case server_socket::load_balancing_algorithm::incoming_cpu:
                 return _conntrack.get_handle();
             case server_socket::load_balancing_algorithm::port:
                 return _conntrack.get_handle(ntoh(sa.as_posix_sockaddr_in().sin_port) % smp::count);
@@ -629,18 +700,59 @@ posix_ap_server_socket_impl::move_connected_socket(int protocol, socket_address
 
 future<temporary_buffer<char>>
 posix_data_source_impl::get() {
+    if (_rx_timestamp) {
+        return get_timestamped();
+    }
     return _fd.recv_some(static_cast<internal::buffer_allocator*>(this)).then([this] (temporary_buffer<char> b) {
-        if (b.size() >= _config.buffer_size) {
-            _config.buffer_size *= 2;
-            _config.buffer_size = std::min(_config.buffer_size, _config.max_buffer_size);
-        } else if (b.size() <= _config.buffer_size / 4) {
-            _config.buffer_size /= 2;
-            _config.buffer_size = std::max(_config.buffer_size, _config.min_buffer_size);
-        }
+        adjust_buffer_size(b.size());
         return b;
     });
 }
 
+void posix_data_source_impl::adjust_buffer_size(size_t received) noexcept {
+    if (received >= _config.buffer_size) {
+        _config.buffer_size *= 2;
+        _config.buffer_size = std::min(_config.buffer_size, _config.max_buffer_size);
+    } else if (received <= _config.buffer_size / 4) {
+        _config.buffer_size /= 2;
+        _config.buffer_size = std::max(_config.buffer_size, _config.min_buffer_size);
+    }
+}
+
+// Reads with recvmsg(), for the timestamp to come along as a control
+// message
+future<temporary_buffer<char>>
+posix_data_source_impl::get_timestamped() {
+    auto b = allocate_buffer();
+    _iov = {b.get_write(), b.size()};
+    std::memset(&_mh, 0, sizeof(_mh));
+    _mh.msg_iov = &_iov;
+    _mh.msg_iovlen = 1;
+    _mh.msg_control = _control;
+    _mh.msg_controllen = sizeof(_control);
+    return _fd.recvmsg(&_mh).then([this, b = std::move(b)] (size_t n) mutable {
+        b.trim(n);
+        adjust_buffer_size(n);
+        *_rx_timestamp = std::nullopt;
+        for (auto cm = CMSG_FIRSTHDR(&_mh); cm; cm = CMSG_NXTHDR(&_mh, cm)) {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_TIMESTAMPING) {
+                continue;
+            }
+            ::scm_timestamping ts;
+            std::memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+            // ts[2] is the raw hardware timestamp, ts[0] the software one;
+            // zero ones weren't taken
+            auto& t = (ts.ts[2].tv_sec || ts.ts[2].tv_nsec) ? ts.ts[2] : ts.ts[0];
+            if (!t.tv_sec && !t.tv_nsec) {
+                continue;
+            }
+            *_rx_timestamp = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::seconds(t.tv_sec) + std::chrono::nanoseconds(t.tv_nsec)));
+        }
+        return std::move(b);
+    });
+}
+
 temporary_buffer<char>
 posix_data_source_impl::allocate_buffer() {
     return make_temporary_buffer<char>(_buffer_allocator, _config.buffer_size);
@@ -669,21 +781,227 @@ std::vector<iovec> to_iovec(std::vector<temporary_buffer<char>>& buf_vec) {
     return v;
 }
 
+// With MSG_ZEROCOPY every successful sendmsg() call is assigned the next
+// 32-bit sequence number, and the kernel later reports ranges of completed
+// sequence numbers on the socket error queue. Packets are kept alive until
+// all the calls that sent their data are reported complete.
+struct posix_data_sink_impl::zerocopy_state {
+    struct pending_send {
+        uint32_t first_seq;
+        uint32_t count;
+        // sequence numbers in [first_seq, first_seq + count) not reported yet
+        uint32_t outstanding;
+        packet p;
+    };
+    size_t threshold;
+    uint32_t next_seq = 0;
+    std::deque<pending_send> pending;
+    // completions are only reaped on the send path, the timer picks up
+    // the ones arriving after the sender went idle
+    timer<lowres_clock> reaper;
+    std::optional<promise<>> drained;
+
+    explicit zerocopy_state(size_t t) : threshold(t) {}
+    void complete(uint32_t lo, uint32_t hi) noexcept {
+        auto seq_max = [] (uint32_t a, uint32_t b) { return int32_t(a - b) > 0 ? a : b; };
+        auto seq_min = [] (uint32_t a, uint32_t b) { return int32_t(a - b) < 0 ? a : b; };
+        // Ranges are normally reported in order, but nothing guarantees it
+        for (auto& ps : pending) {
+            auto start = seq_max(lo, ps.first_seq);
+            auto end = seq_min(hi, ps.first_seq + ps.count - 1);
+            if (int32_t(end - start) >= 0) {
+                ps.outstanding -= std::min(ps.outstanding, end - start + 1);
+            }
+        }
+        std::erase_if(pending, [] (const pending_send& ps) { return ps.outstanding == 0; });
+    }
+};
+
+posix_data_sink_impl::posix_data_sink_impl(pollable_fd fd, std::optional<size_t> zerocopy_threshold,
+        std::optional<size_t> notsent_lowat)
+        : _fd(std::move(fd)), _notsent_lowat(notsent_lowat) {
+    if (zerocopy_threshold) {
+        _zc = std::make_unique<zerocopy_state>(*zerocopy_threshold);
+        _zc->reaper.set_callback([this] { reap_zerocopy_completions(); });
+    }
+}
+
+posix_data_sink_impl::~posix_data_sink_impl() = default;
+
+// With TCP_NOTSENT_LOWAT the socket polls writable only once less than the
+// low watermark is left unsent, so writers wait for that before queueing
+// more. Checking the unsent amount first saves a poll while it is low.
+bool posix_data_sink_impl::must_wait_for_send_room() const noexcept {
+    if (!_notsent_lowat) {
+        return false;
+    }
+    int unsent = 0;
+    if (::ioctl(_fd.get_file_desc().get(), SIOCOUTQNSD, &unsent) != 0) {
+        return false;
+    }
+    return size_t(unsent) >= *_notsent_lowat;
+}
+
 future<>
 posix_data_sink_impl::put(temporary_buffer<char> buf) {
+    if (must_wait_for_send_room()) {
+        return _fd.writeable().then([this, buf = std::move(buf)] () mutable {
+            return put(std::move(buf));
+        });
+    }
+    if (_zc && buf.size() >= _zc->threshold) {
+        return put_zerocopy(packet(std::move(buf)));
+    }
     return _fd.write_all(buf.get(), buf.size()).then([d = buf.release()] {});
 }
 
 future<>
 posix_data_sink_impl::put(packet p) {
+    if (must_wait_for_send_room()) {
+        return _fd.writeable().then([this, p = std::move(p)] () mutable {
+            return put(std::move(p));
+        });
+    }
+    if (_zc && p.len() >= _zc->threshold) {
+        return put_zerocopy(std::move(p));
+    }
     _p = std::move(p);
     return _fd.write_all(_p).then([this] { _p.reset(); });
 }
 
+future<>
+posix_data_sink_impl::put_zerocopy(packet p) {
+    _p = std::move(p);
+    auto first_seq = _zc->next_seq;
+    return repeat([this] {
+        if (!_p.len()) {
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        ::msghdr mh = {};
+        mh.msg_iov = reinterpret_cast<iovec*>(_p.fragment_array());
+        mh.msg_iovlen = std::min<size_t>(_p.nr_frags(), IOV_MAX);
+        std::optional<ssize_t> r;
+        try {
+            r = _fd.get_file_desc().sendmsg(&mh, MSG_NOSIGNAL | MSG_DONTWAIT | MSG_ZEROCOPY);
+        } catch (const std::system_error& e) {
+            if (e.code().value() != ENOBUFS) {
+                throw;
+            }
+            // Out of optmem for completion notifications, copy the
+            // remainder rather than stalling the connection
+            return _fd.write_all(_p).then([] { return stop_iteration::yes; });
+        }
+        if (!r) {
+            return _fd.writeable().then([] { return stop_iteration::no; });
+        }
+        ++_zc->next_seq;
+        _p.trim_front(*r);
+        return make_ready_future<stop_iteration>(stop_iteration::no);
+    }).then([this, first_seq] {
+        auto count = _zc->next_seq - first_seq;
+        if (count) {
+            _zc->pending.push_back({first_seq, count, count, std::move(_p)});
+        }
+        _p.reset();
+        reap_zerocopy_completions();
+    });
+}
+
+// Upper bound on a single sendfile() call, so that one transfer does not
+// occupy the syscall thread for long
+static constexpr size_t sendfile_chunk_size = 1 << 20;
+
+future<>
+posix_data_sink_impl::put_file(file f, uint64_t offset, size_t len) {
+    if (must_wait_for_send_room()) {
+        return _fd.writeable().then([this, f = std::move(f), offset, len] () mutable {
+            return put_file(std::move(f), offset, len);
+        });
+    }
+    auto pfi = dynamic_cast<posix_file_impl*>(f._file_impl.get());
+    if (!pfi) {
+        return data_sink_impl::put_file(std::move(f), offset, len);
+    }
+    return do_with(std::move(f), offset, len, [this, pfi] (file& f, uint64_t& pos, size_t& left) {
+        return repeat([this, pfi, &f, &pos, &left] {
+            if (!left) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto out_fd = _fd.get_file_desc().get();
+            return pfi->sendfile_to(out_fd, pos, std::min(left, sendfile_chunk_size)).then_wrapped([this, &f, &pos, &left] (future<std::optional<size_t>> fut) {
+                std::optional<size_t> sent;
+                try {
+                    sent = fut.get();
+                } catch (const std::system_error& e) {
+                    if (e.code().value() != EINVAL && e.code().value() != ENOSYS) {
+                        throw;
+                    }
+                    // The file cannot be spliced (e.g. O_DIRECT alignment
+                    // restrictions), copy the rest of the range instead
+                    return data_sink_impl::put_file(f, pos, left).then([] {
+                        return stop_iteration::yes;
+                    });
+                }
+                if (!sent) {
+                    return _fd.writeable().then([] {
+                        return stop_iteration::no;
+                    });
+                }
+                if (*sent == 0) {
+                    return make_exception_future<stop_iteration>(std::runtime_error(
+                            format("put_file: unexpected end of file at offset {}, {} bytes short", pos, left)));
+                }
+                pos += *sent;
+                left -= *sent;
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            });
+        });
+    });
+}
+
+void posix_data_sink_impl::reap_zerocopy_completions() noexcept {
+    auto fd = _fd.get_file_desc().get();
+    while (!_zc->pending.empty()) {
+        alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(::sock_extended_err)) + CMSG_SPACE(sizeof(::sockaddr_in6))];
+        ::msghdr mh = {};
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+        for (auto cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                    && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            auto serr = reinterpret_cast<const ::sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            _zc->complete(serr->ee_info, serr->ee_data);
+        }
+    }
+    if (!_zc->pending.empty()) {
+        if (!_zc->reaper.armed()) {
+            _zc->reaper.arm(lowres_clock::now() + std::chrono::milliseconds(1));
+        }
+    } else {
+        _zc->reaper.cancel();
+        if (_zc->drained) {
+            std::exchange(_zc->drained, std::nullopt)->set_value();
+        }
+    }
+}
+
 future<>
 posix_data_sink_impl::close() {
     _fd.shutdown(SHUT_WR);
-    return make_ready_future<>();
+    if (!_zc || _zc->pending.empty()) {
+        return make_ready_future<>();
+    }
+    // The kernel may still be reading from the buffers of pending sends
+    _zc->drained.emplace();
+    return _zc->drained->get_future();
 }
 
 void posix_data_sink_impl::on_batch_flush_error() noexcept {
@@ -694,6 +1012,12 @@ posix_network_stack::posix_network_stack(const program_options::option_group& op
         : _reuseport(engine().posix_reuseport_available()), _allocator(allocator) {
 }
 
+// With load_balancing_algorithm::incoming_cpu the kernel steers connections
+// to the listening sockets of the shards, so each accepts on its own.
+static bool listens_per_shard(const listen_options& opt) {
+    return opt.lba == server_socket::load_balancing_algorithm::incoming_cpu && engine().posix_incoming_cpu_steering_available();
+}
+
 server_socket
 posix_network_stack::listen(socket_address sa, listen_options opt) {
     using server_socket = seastar::server_socket;
@@ -705,7 +1029,7 @@ posix_network_stack::listen(socket_address sa, listen_options opt) {
         return server_socket(std::make_unique<posix_server_socket_impl>(0, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
     }
     auto protocol = static_cast<int>(opt.proto);
-    return _reuseport ?
+    return _reuseport || listens_per_shard(opt) ?
         server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
         :
         server_socket(std::make_unique<posix_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
@@ -730,7 +1054,7 @@ posix_ap_network_stack::listen(socket_address sa, listen_options opt) {
         return server_socket(std::make_unique<posix_ap_server_socket_impl>(0, sa, _allocator));
     }
     auto protocol = static_cast<int>(opt.proto);
-    return _reuseport ?
+    return _reuseport || listens_per_shard(opt) ?
         server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
         :
         server_socket(std::make_unique<posix_ap_server_socket_impl>(protocol, sa, _allocator));
@@ -806,6 +1130,53 @@ class posix_datagram_channel : public datagram_channel_impl {
         }
     };
 
+    // Buffers and headers for recvmmsg(), allocated on first receive_batch()
+    struct recv_batch_ctx {
+        static constexpr size_t max_batch = 32;
+        // A message coalesced by GRO can be up to 64K long, more than one datagram
+        static constexpr size_t buffer_size = 64 * 1024;
+        struct control {
+            alignas(cmsghdr) char buf[CMSG_SPACE(sizeof(in6_pktinfo)) + CMSG_SPACE(sizeof(int))];
+        };
+        std::array<mmsghdr, max_batch> hdrs;
+        std::array<iovec, max_batch> iovs;
+        std::array<socket_address, max_batch> src_addrs;
+        std::array<control, max_batch> controls;
+        std::unique_ptr<char[]> buffers;
+
+        recv_batch_ctx() : buffers(new char[max_batch * buffer_size]) {}
+
+        void prepare(size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                iovs[i] = {buffers.get() + i * buffer_size, buffer_size};
+                auto& hdr = hdrs[i].msg_hdr;
+                memset(&hdrs[i], 0, sizeof(hdrs[i]));
+                hdr.msg_iov = &iovs[i];
+                hdr.msg_iovlen = 1;
+                hdr.msg_name = &src_addrs[i].u.sa;
+                hdr.msg_namelen = sizeof(src_addrs[i].u.sas);
+                hdr.msg_control = controls[i].buf;
+                hdr.msg_controllen = sizeof(controls[i].buf);
+            }
+        }
+    };
+    // Headers for sendmmsg(); every message covers the datagrams in
+    // [first, first + count) of the batch, more than one when sent with GSO
+    struct send_batch_ctx {
+        struct control {
+            alignas(cmsghdr) char buf[CMSG_SPACE(sizeof(uint16_t))];
+        };
+        std::vector<outgoing_datagram> datagrams;
+        std::vector<mmsghdr> hdrs;
+        std::vector<iovec> iovs;
+        std::vector<socket_address> dsts;
+        std::vector<control> controls;
+        std::vector<std::pair<size_t, size_t>> ranges;
+        size_t next = 0;
+    };
+    // Kernel limit on the number of segments in a UDP GSO message
+    static constexpr size_t max_gso_segments = 64;
+
     static bool is_inet(sa_family_t family) {
         return family == AF_INET || family == AF_INET6;
     }
@@ -828,6 +1199,23 @@ class posix_datagram_channel : public datagram_channel_impl {
     recv_ctx _recv;
     send_ctx _send;
     bool _closed;
+    std::unique_ptr<recv_batch_ctx> _recv_batch;
+    // datagrams received by a batch but not yet handed out
+    std::deque<datagram> _pending;
+    bool _gso = false;
+    bool _gro = false;
+
+    void probe_gso() noexcept {
+        if (is_inet(_address.family())) {
+            int val;
+            socklen_t len = sizeof(val);
+            _gso = ::getsockopt(_fd.get_file_desc().get(), SOL_UDP, UDP_SEGMENT, &val, &len) == 0;
+        }
+    }
+    socket_address recv_dst(msghdr& hdr, size_t& gro_size) const;
+    send_batch_ctx make_send_batch(std::vector<outgoing_datagram> datagrams) const;
+    future<std::vector<datagram>> do_receive_batch(size_t max_datagrams);
+    std::vector<datagram> take_pending(size_t max_datagrams);
 public:
     /// Creates a channel that is not bound to any socket address. The channel
     /// can be used to communicate with adressess that belong to the \param
@@ -838,6 +1226,7 @@ class posix_datagram_channel : public datagram_channel_impl {
 
         _address = fd.get_address();
         _fd = std::move(fd);
+        probe_gso();
     }
 
     /// Creates a channel that is bound to the specified local address. It can be used to
@@ -849,12 +1238,15 @@ class posix_datagram_channel : public datagram_channel_impl {
 
         _address = fd.get_address();
         _fd = std::move(fd);
+        probe_gso();
     }
 
     virtual ~posix_datagram_channel() { if (!_closed) close(); };
     virtual future<datagram> receive() override;
     virtual future<> send(const socket_address& dst, const char *msg) override;
     virtual future<> send(const socket_address& dst, packet p) override;
+    virtual future<std::vector<datagram>> receive_batch(size_t max_datagrams) override;
+    virtual future<> send_batch(std::vector<outgoing_datagram> datagrams) override;
     virtual void shutdown_input() override {
         _fd.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
     }
@@ -864,6 +1256,7 @@ class posix_datagram_channel : public datagram_channel_impl {
     virtual void close() override {
         _closed = true;
         _fd = {};
+        _pending.clear();
     }
     virtual bool is_closed() const override { return _closed; }
     socket_address local_address() const override {
@@ -887,6 +1280,100 @@ future<> posix_datagram_channel::send(const socket_address& dst, packet p) {
             .then([len] (size_t size) { assert(size == len); });
 }
 
+posix_datagram_channel::send_batch_ctx
+posix_datagram_channel::make_send_batch(std::vector<outgoing_datagram> datagrams) const {
+    send_batch_ctx ctx;
+    size_t nr_frags = 0;
+    for (auto& d : datagrams) {
+        nr_frags += d.data.nr_frags();
+    }
+    // iovecs and addresses are pointed to by the headers, so they must not move
+    ctx.iovs.reserve(nr_frags);
+    ctx.dsts.reserve(datagrams.size());
+    ctx.controls.reserve(datagrams.size());
+    for (size_t i = 0; i < datagrams.size();) {
+        auto seg_size = datagrams[i].data.len();
+        size_t total = seg_size;
+        size_t n = 1;
+        // A GSO message is a run of equally sized datagrams for one
+        // destination; only its last segment may be shorter
+        while (_gso && seg_size && i + n < datagrams.size() && n < max_gso_segments) {
+            auto& d = datagrams[i + n];
+            if (!(d.dst == datagrams[i].dst) || d.data.len() > seg_size || total + d.data.len() > MAX_DATAGRAM_SIZE) {
+                break;
+            }
+            total += d.data.len();
+            n++;
+            if (d.data.len() < seg_size) {
+                break;
+            }
+        }
+        mmsghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        auto& dst = ctx.dsts.emplace_back(datagrams[i].dst);
+        resolve_outgoing_address(dst);
+        hdr.msg_hdr.msg_name = &dst.u.sa;
+        hdr.msg_hdr.msg_namelen = dst.addr_length;
+        hdr.msg_hdr.msg_iov = ctx.iovs.data() + ctx.iovs.size();
+        for (size_t j = i; j < i + n; j++) {
+            for (auto& f : datagrams[j].data.fragments()) {
+                ctx.iovs.push_back({f.base, f.size});
+            }
+        }
+        hdr.msg_hdr.msg_iovlen = ctx.iovs.data() + ctx.iovs.size() - hdr.msg_hdr.msg_iov;
+        if (n > 1) {
+            auto& ctl = ctx.controls.emplace_back();
+            hdr.msg_hdr.msg_control = ctl.buf;
+            hdr.msg_hdr.msg_controllen = sizeof(ctl.buf);
+            auto cm = CMSG_FIRSTHDR(&hdr.msg_hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            auto gso_size = uint16_t(seg_size);
+            memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+        }
+        ctx.hdrs.push_back(hdr);
+        ctx.ranges.emplace_back(i, n);
+        i += n;
+    }
+    ctx.datagrams = std::move(datagrams);
+    return ctx;
+}
+
+future<> posix_datagram_channel::send_batch(std::vector<outgoing_datagram> datagrams) {
+    auto ctx = make_send_batch(std::move(datagrams));
+    return do_with(std::move(ctx), [this] (send_batch_ctx& ctx) {
+        return repeat([this, &ctx] () -> future<stop_iteration> {
+            if (ctx.next == ctx.hdrs.size()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto r = ::sendmmsg(_fd.get_file_desc().get(), ctx.hdrs.data() + ctx.next, ctx.hdrs.size() - ctx.next, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (r >= 0) {
+                ctx.next += r;
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return _fd.writeable().then([] {
+                    return stop_iteration::no;
+                });
+            }
+            if ((errno == EIO || errno == EINVAL) && _gso && ctx.ranges[ctx.next].second > 1) {
+                // The egress device cannot checksum GSO messages (EIO) or the
+                // segments exceed the path MTU (EINVAL). Stop using GSO on
+                // this channel and resend the rest one by one
+                _gso = false;
+                std::vector<outgoing_datagram> rest;
+                auto first = ctx.ranges[ctx.next].first;
+                std::move(ctx.datagrams.begin() + first, ctx.datagrams.end(), std::back_inserter(rest));
+                return send_batch(std::move(rest)).then([] {
+                    return stop_iteration::yes;
+                });
+            }
+            return make_exception_future<stop_iteration>(std::system_error(errno, std::system_category(), "sendmmsg"));
+        });
+    });
+}
+
 udp_channel
 posix_network_stack::make_udp_channel(const socket_address& addr) {
     if (!addr.is_unspecified()) {
@@ -940,28 +1427,103 @@ class posix_datagram : public datagram_impl {
     virtual packet& get_data() override { return _p; }
 };
 
+socket_address
+posix_datagram_channel::recv_dst(msghdr& hdr, size_t& gro_size) const {
+    std::optional<socket_address> dst;
+    gro_size = 0;
+    for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+            dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
+        } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+            dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
+        } else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            gro_size = copy_reinterpret_cast<int>(CMSG_DATA(cmsg));
+        }
+    }
+    return dst ? *dst : _address;
+}
+
 future<datagram>
 posix_datagram_channel::receive() {
+    if (!_pending.empty()) {
+        auto d = std::move(_pending.front());
+        _pending.pop_front();
+        return make_ready_future<datagram>(std::move(d));
+    }
+    if (_gro) {
+        // Coalesced datagrams need to be split, which the batch path does
+        return receive_batch(1).then([] (std::vector<datagram> d) {
+            return std::move(d.front());
+        });
+    }
     _recv.prepare();
     return _fd.recvmsg(&_recv._hdr).then([this] (size_t size) {
-        std::optional<socket_address> dst;
-        for (auto* cmsg = CMSG_FIRSTHDR(&_recv._hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&_recv._hdr, cmsg)) {
-            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
-                dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
-                break;
-            } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-                dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
-                break;
-            }
-        }
+        size_t gro_size;
+        auto dst = recv_dst(_recv._hdr, gro_size);
         return make_ready_future<datagram>(datagram(std::make_unique<posix_datagram>(
-            _recv._src_addr, dst ? *dst : _address, packet(fragment{_recv._buffer, size}, make_deleter([buf = _recv._buffer] { delete[] buf; })))));
+            _recv._src_addr, dst, packet(fragment{_recv._buffer, size}, make_deleter([buf = _recv._buffer] { delete[] buf; })))));
     }).handle_exception([p = _recv._buffer](auto ep) {
         delete[] p;
         return make_exception_future<datagram>(std::move(ep));
     });
 }
 
+std::vector<datagram>
+posix_datagram_channel::take_pending(size_t max_datagrams) {
+    std::vector<datagram> ret;
+    auto n = std::min(max_datagrams, _pending.size());
+    ret.reserve(n);
+    std::move(_pending.begin(), _pending.begin() + n, std::back_inserter(ret));
+    _pending.erase(_pending.begin(), _pending.begin() + n);
+    return ret;
+}
+
+future<std::vector<datagram>>
+posix_datagram_channel::receive_batch(size_t max_datagrams) {
+    max_datagrams = std::clamp<size_t>(max_datagrams, 1, recv_batch_ctx::max_batch);
+    if (!_recv_batch) {
+        _recv_batch = std::make_unique<recv_batch_ctx>();
+        if (is_inet(_address.family())) {
+            int one = 1;
+            _gro = ::setsockopt(_fd.get_file_desc().get(), SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0;
+        }
+    }
+    if (!_pending.empty()) {
+        return make_ready_future<std::vector<datagram>>(take_pending(max_datagrams));
+    }
+    return do_receive_batch(max_datagrams);
+}
+
+future<std::vector<datagram>>
+posix_datagram_channel::do_receive_batch(size_t max_datagrams) {
+    auto& ctx = *_recv_batch;
+    ctx.prepare(max_datagrams);
+    auto n = ::recvmmsg(_fd.get_file_desc().get(), ctx.hdrs.data(), max_datagrams, MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return make_exception_future<std::vector<datagram>>(std::system_error(errno, std::system_category(), "recvmmsg"));
+        }
+        return _fd.readable().then([this, max_datagrams] {
+            return do_receive_batch(max_datagrams);
+        });
+    }
+    for (int i = 0; i < n; i++) {
+        size_t gro_size;
+        auto dst = recv_dst(ctx.hdrs[i].msg_hdr, gro_size);
+        size_t size = ctx.hdrs[i].msg_len;
+        auto seg_size = gro_size ? gro_size : size;
+        const char* data = ctx.buffers.get() + i * recv_batch_ctx::buffer_size;
+        // The batch buffers are reused, so each datagram gets its own copy
+        // sized to fit, rather than pinning a maximum sized buffer
+        for (size_t off = 0; off < size; off += seg_size) {
+            auto len = std::min(seg_size, size - off);
+            _pending.push_back(datagram(std::make_unique<posix_datagram>(
+                ctx.src_addrs[i], dst, packet(temporary_buffer<char>(data + off, len)))));
+        }
+    }
+    return make_ready_future<std::vector<datagram>>(take_pending(max_datagrams));
+}
+
 network_stack_entry register_posix_stack() {
     return network_stack_entry{
         "posix", std::make_unique<program_options::option_group>(nullptr, "Posix"),
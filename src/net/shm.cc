@@ -0,0 +1,564 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/net/shm.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/net/packet.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/internal/pollable_fd.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/queue.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/util/log.hh>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+namespace seastar {
+
+namespace net {
+
+static logger shm_log("shm");
+
+namespace {
+
+constexpr uint32_t shm_magic = 0x53484d31;
+constexpr size_t max_ring_size = size_t(1) << 30;
+// The most a read returns
+constexpr size_t max_read_size = 128 * 1024;
+
+// One direction of a connection, at the front of its ring, in the shared
+// memory. The positions only grow, the data of a position being at that
+// position modulo the size of the ring.
+struct ring_header {
+    // Written by the consumer only
+    alignas(64) std::atomic<uint64_t> head;
+    // Written by the producer only
+    alignas(64) std::atomic<uint64_t> tail;
+    // Set by an end before it sleeps, for the other one to wake it up
+    alignas(64) std::atomic<uint32_t> consumer_waiting;
+    std::atomic<uint32_t> producer_waiting;
+    // Nothing is produced after tail
+    std::atomic<uint32_t> closed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+        "the rings are shared with another process");
+
+size_t mapping_size(size_t ring_size) {
+    return 2 * (sizeof(ring_header) + ring_size);
+}
+
+// The message a client sends to set a connection up, with the memfd
+struct handshake_body {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t ring_size;
+};
+
+struct handshake_message {
+    handshake_body body = {};
+    iovec iov;
+    msghdr hdr = {};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+
+    handshake_message() {
+        iov = {&body, sizeof(body)};
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+        std::memset(control, 0, sizeof(control));
+    }
+    void set_fd(int fd) {
+        auto c = CMSG_FIRSTHDR(&hdr);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    }
+    std::optional<file_desc> take_fd() {
+        for (auto c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(&hdr, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(sizeof(int))) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(c), sizeof(int));
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                return file_desc::from_fd(fd);
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+bool valid_ring_size(uint64_t size) {
+    return size && size <= max_ring_size && !(size & (size - 1));
+}
+
+// The memfd of a connection can't change size once sealed, for the peer not
+// to make the mapping fault by truncating it
+constexpr int required_seals = F_SEAL_SHRINK | F_SEAL_GROW;
+
+}
+
+// An end of a connection. The loop reading the wakeups of the unix domain
+// socket keeps it alive until the socket is shut down, when the last of the
+// connected socket, source and sink using it is gone.
+class shm_channel : public enable_lw_shared_from_this<shm_channel> {
+    pollable_fd _sock;
+    mmap_area _area;
+    size_t _ring_size;
+    ring_header* _in;
+    char* _in_data;
+    ring_header* _out;
+    char* _out_data;
+    socket_address _local;
+    socket_address _remote;
+    condition_variable _changed;
+    shared_promise<> _gone;
+    bool _peer_gone = false;
+    bool _input_shutdown = false;
+    bool _output_shutdown = false;
+    // The peer wrote positions that are not in the ring
+    bool _corrupted = false;
+    char _wakeups[64];
+
+    void wake_up_peer() noexcept {
+        char c = 0;
+        try {
+            // A full socket is as many wakeups pending
+            _sock.get_file_desc().send(&c, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        } catch (...) {
+            // The peer is gone, the wakeups loop tells
+        }
+    }
+    static ring_header* header(char* base) {
+        return reinterpret_cast<ring_header*>(base);
+    }
+    // The positions are in the shared memory, written by the peer for one
+    // of them, and checked each time they are loaded not to have us read
+    // or write outside the ring
+    bool valid(uint64_t head, uint64_t tail) noexcept {
+        if (tail - head <= _ring_size) {
+            return true;
+        }
+        if (!std::exchange(_corrupted, true)) {
+            shm_log.warn("shared memory connection with {} has ring positions {} and {}, closing it", _remote, head, tail);
+            shutdown();
+            _changed.broadcast();
+        }
+        return false;
+    }
+    static std::exception_ptr corrupted_error() {
+        return std::make_exception_ptr(std::system_error(EPROTO, std::system_category(), "shm connection"));
+    }
+public:
+    shm_channel(pollable_fd sock, mmap_area area, size_t ring_size, bool is_client, socket_address local, socket_address remote)
+            : _sock(std::move(sock))
+            , _area(std::move(area))
+            , _ring_size(ring_size)
+            , _local(std::move(local))
+            , _remote(std::move(remote)) {
+        // The first ring carries what the client sends
+        auto first = _area.get();
+        auto second = first + sizeof(ring_header) + ring_size;
+        if (!is_client) {
+            std::swap(first, second);
+        }
+        _out = header(first);
+        _out_data = first + sizeof(ring_header);
+        _in = header(second);
+        _in_data = second + sizeof(ring_header);
+    }
+
+    void start() {
+        // FIXME: future is discarded
+        (void)repeat([this] {
+            return _sock.read_some(_wakeups, sizeof(_wakeups)).then([this] (size_t n) {
+                _changed.broadcast();
+                return n ? stop_iteration::no : stop_iteration::yes;
+            });
+        }).handle_exception([] (std::exception_ptr) {}).finally([this, self = shared_from_this()] {
+            _peer_gone = true;
+            _changed.broadcast();
+            _gone.set_value();
+        });
+    }
+
+    // Stops the wakeups loop and tells the peer
+    void shutdown() noexcept {
+        _sock.shutdown(SHUT_RDWR, pollable_fd::shutdown_kernel_only::no);
+    }
+
+    future<temporary_buffer<char>> get() {
+        return repeat_until_value([this] () -> future<std::optional<temporary_buffer<char>>> {
+            auto head = _in->head.load(std::memory_order_relaxed);
+            auto tail = _in->tail.load(std::memory_order_acquire);
+            if (_input_shutdown) {
+                return make_ready_future<std::optional<temporary_buffer<char>>>(temporary_buffer<char>());
+            }
+            if (_corrupted || !valid(head, tail)) {
+                return make_exception_future<std::optional<temporary_buffer<char>>>(corrupted_error());
+            }
+            if (tail != head) {
+                auto offset = head & (_ring_size - 1);
+                auto n = std::min({size_t(tail - head), _ring_size - offset, max_read_size});
+                temporary_buffer<char> buf(_in_data + offset, n);
+                _in->head.store(head + n, std::memory_order_seq_cst);
+                if (_in->producer_waiting.load(std::memory_order_seq_cst) && _in->producer_waiting.exchange(0)) {
+                    wake_up_peer();
+                }
+                return make_ready_future<std::optional<temporary_buffer<char>>>(std::move(buf));
+            }
+            // What the peer sent before closing, or before its process
+            // died, is still to be read
+            if (_in->closed.load(std::memory_order_acquire) || _peer_gone) {
+                if (_in->tail.load(std::memory_order_acquire) != head) {
+                    return make_ready_future<std::optional<temporary_buffer<char>>>(std::nullopt);
+                }
+                return make_ready_future<std::optional<temporary_buffer<char>>>(temporary_buffer<char>());
+            }
+            _in->consumer_waiting.store(1, std::memory_order_seq_cst);
+            if (_in->tail.load(std::memory_order_seq_cst) != head || _in->closed.load(std::memory_order_seq_cst)) {
+                _in->consumer_waiting.store(0, std::memory_order_relaxed);
+                return make_ready_future<std::optional<temporary_buffer<char>>>(std::nullopt);
+            }
+            return _changed.wait().then([] {
+                return std::optional<temporary_buffer<char>>();
+            });
+        });
+    }
+
+    // Writes as much of [p, p + size) as there is room for
+    size_t write(const char* p, size_t size) noexcept {
+        auto tail = _out->tail.load(std::memory_order_relaxed);
+        auto head = _out->head.load(std::memory_order_acquire);
+        if (!valid(head, tail)) {
+            return 0;
+        }
+        auto n = std::min(size, size_t(_ring_size - (tail - head)));
+        if (!n) {
+            return 0;
+        }
+        auto offset = tail & (_ring_size - 1);
+        auto first = std::min(n, _ring_size - offset);
+        std::memcpy(_out_data + offset, p, first);
+        std::memcpy(_out_data, p + first, n - first);
+        _out->tail.store(tail + n, std::memory_order_seq_cst);
+        if (_out->consumer_waiting.load(std::memory_order_seq_cst) && _out->consumer_waiting.exchange(0)) {
+            wake_up_peer();
+        }
+        return n;
+    }
+
+    future<> put(packet p) {
+        return do_with(std::move(p), size_t(0), size_t(0), [this] (packet& p, size_t& fragment, size_t& done) {
+            return repeat([this, &p, &fragment, &done] () -> future<stop_iteration> {
+                if (_corrupted) {
+                    return make_exception_future<stop_iteration>(corrupted_error());
+                }
+                if (_output_shutdown || _peer_gone) {
+                    return make_exception_future<stop_iteration>(std::system_error(EPIPE, std::system_category(), "shm connection"));
+                }
+                while (fragment < p.nr_frags()) {
+                    auto& f = p.fragment_array()[fragment];
+                    auto n = write(f.base + done, f.size - done);
+                    done += n;
+                    if (done < f.size) {
+                        break;
+                    }
+                    fragment++;
+                    done = 0;
+                }
+                if (_corrupted) {
+                    return make_exception_future<stop_iteration>(corrupted_error());
+                }
+                if (fragment == p.nr_frags()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                // Full, wait for the consumer to make room
+                _out->producer_waiting.store(1, std::memory_order_seq_cst);
+                auto tail = _out->tail.load(std::memory_order_relaxed);
+                auto head = _out->head.load(std::memory_order_seq_cst);
+                if (!valid(head, tail) || tail - head < _ring_size) {
+                    _out->producer_waiting.store(0, std::memory_order_relaxed);
+                    return make_ready_future<stop_iteration>(stop_iteration::no);
+                }
+                return _changed.wait().then([] {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    }
+
+    void shutdown_output() noexcept {
+        if (std::exchange(_output_shutdown, true)) {
+            return;
+        }
+        _out->closed.store(1, std::memory_order_seq_cst);
+        if (_out->consumer_waiting.exchange(0)) {
+            wake_up_peer();
+        }
+        _changed.broadcast();
+    }
+
+    void shutdown_input() noexcept {
+        _input_shutdown = true;
+        _changed.broadcast();
+    }
+
+    future<> wait_input_shutdown() {
+        return _gone.get_shared_future();
+    }
+
+    const socket_address& local_address() const noexcept {
+        return _local;
+    }
+    const socket_address& remote_address() const noexcept {
+        return _remote;
+    }
+};
+
+namespace {
+
+// Shuts the channel down when the last user is gone
+struct shm_channel_ref {
+    lw_shared_ptr<shm_channel> channel;
+    explicit shm_channel_ref(lw_shared_ptr<shm_channel> c) noexcept : channel(std::move(c)) {}
+    ~shm_channel_ref() {
+        channel->shutdown();
+    }
+};
+
+using shm_ref = lw_shared_ptr<shm_channel_ref>;
+
+class shm_data_source_impl final : public data_source_impl {
+    shm_ref _ref;
+public:
+    explicit shm_data_source_impl(shm_ref ref) noexcept : _ref(std::move(ref)) {}
+    virtual future<temporary_buffer<char>> get() override {
+        return _ref->channel->get();
+    }
+    virtual future<> close() override {
+        _ref->channel->shutdown_input();
+        return make_ready_future<>();
+    }
+};
+
+class shm_data_sink_impl final : public data_sink_impl {
+    shm_ref _ref;
+public:
+    explicit shm_data_sink_impl(shm_ref ref) noexcept : _ref(std::move(ref)) {}
+    virtual future<> put(packet p) override {
+        return _ref->channel->put(std::move(p));
+    }
+    virtual future<> close() override {
+        _ref->channel->shutdown_output();
+        return make_ready_future<>();
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return 128 * 1024;
+    }
+};
+
+class shm_connected_socket_impl final : public connected_socket_impl {
+    shm_ref _ref;
+public:
+    explicit shm_connected_socket_impl(lw_shared_ptr<shm_channel> channel)
+            : _ref(make_lw_shared<shm_channel_ref>(std::move(channel))) {
+        _ref->channel->start();
+    }
+    virtual data_source source() override {
+        return data_source(std::make_unique<shm_data_source_impl>(_ref));
+    }
+    virtual data_sink sink() override {
+        return data_sink(std::make_unique<shm_data_sink_impl>(_ref));
+    }
+    virtual void shutdown_input() override {
+        _ref->channel->shutdown_input();
+    }
+    virtual void shutdown_output() override {
+        _ref->channel->shutdown_output();
+    }
+    virtual void set_nodelay(bool) override {}
+    virtual bool get_nodelay() const override {
+        return true;
+    }
+    virtual void set_keepalive(bool) override {}
+    virtual bool get_keepalive() const override {
+        return false;
+    }
+    virtual void set_keepalive_parameters(const keepalive_params&) override {}
+    virtual keepalive_params get_keepalive_parameters() const override {
+        return tcp_keepalive_params{std::chrono::seconds(0), std::chrono::seconds(0), 0};
+    }
+    virtual void set_sockopt(int, int, const void*, size_t) override {
+        throw std::runtime_error("Setting custom socket options is not supported for shared memory connections");
+    }
+    virtual int get_sockopt(int, int, void*, size_t) const override {
+        throw std::runtime_error("Getting custom socket options is not supported for shared memory connections");
+    }
+    virtual socket_address local_address() const noexcept override {
+        return _ref->channel->local_address();
+    }
+    virtual socket_address remote_address() const noexcept override {
+        return _ref->channel->remote_address();
+    }
+    virtual future<> wait_input_shutdown() override {
+        return _ref->channel->wait_input_shutdown();
+    }
+};
+
+class shm_socket_impl final : public socket_impl {
+    shm_options _opts;
+    pollable_fd _fd;
+public:
+    explicit shm_socket_impl(shm_options opts) noexcept : _opts(opts) {}
+
+    virtual future<connected_socket> connect(socket_address sa, socket_address local, transport) override {
+        if (!sa.is_af_unix()) {
+            return make_exception_future<connected_socket>(std::invalid_argument("shared memory connections are set up over unix domain sockets"));
+        }
+        if (local.is_unspecified()) {
+            local = socket_address{unix_domain_addr{std::string{}}};
+        }
+        _fd = engine().make_pollable_fd(sa, 0);
+        return engine().posix_connect(_fd, sa, local).then([fd = _fd, sa, ring_size = _opts.ring_size] () mutable {
+            int mfd = ::memfd_create("seastar-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            throw_system_error_on(mfd == -1, "memfd_create");
+            auto memfd = file_desc::from_fd(mfd);
+            memfd.truncate(mapping_size(ring_size));
+            throw_system_error_on(::fcntl(memfd.get(), F_ADD_SEALS, required_seals | F_SEAL_SEAL) == -1, "fcntl(F_ADD_SEALS)");
+            auto area = memfd.map_shared_rw(mapping_size(ring_size), 0);
+            auto msg = std::make_unique<handshake_message>();
+            msg->body.magic = shm_magic;
+            msg->body.ring_size = ring_size;
+            msg->set_fd(memfd.get());
+            auto& hdr = msg->hdr;
+            return fd.sendmsg(&hdr).then([fd, sa, ring_size, memfd = std::move(memfd), area = std::move(area), msg = std::move(msg)] (size_t n) mutable {
+                if (n != sizeof(handshake_body)) {
+                    throw std::runtime_error("short shared memory handshake");
+                }
+                auto local = fd.get_file_desc().get_address();
+                auto channel = make_lw_shared<shm_channel>(fd, std::move(area), ring_size, true, std::move(local), sa);
+                return connected_socket(std::make_unique<shm_connected_socket_impl>(std::move(channel)));
+            });
+        });
+    }
+    virtual void set_reuseaddr(bool) override {}
+    virtual bool get_reuseaddr() const override {
+        return false;
+    }
+    virtual void shutdown() override {
+        if (_fd) {
+            _fd.shutdown(SHUT_RDWR, pollable_fd::shutdown_kernel_only::no);
+        }
+    }
+};
+
+// Accepts in the background, not to have a client that does not complete
+// its handshake hold the others
+class shm_server_socket_impl final : public server_socket_impl {
+    struct state {
+        pollable_fd listener;
+        socket_address local;
+        queue<accept_result> accepted{64};
+    };
+    lw_shared_ptr<state> _state;
+
+    static future<accept_result> handshake(pollable_fd fd, socket_address addr, socket_address local) {
+        auto msg = std::make_unique<handshake_message>();
+        auto& hdr = msg->hdr;
+        return fd.recvmsg(&hdr).then([fd, addr = std::move(addr), local = std::move(local), msg = std::move(msg)] (size_t n) mutable {
+            auto memfd = msg->take_fd();
+            auto& body = msg->body;
+            if (n != sizeof(handshake_body) || body.magic != shm_magic || !valid_ring_size(body.ring_size) || !memfd) {
+                throw std::runtime_error("bad shared memory handshake");
+            }
+            // Sealed first, for the size checked to remain that
+            auto seals = ::fcntl(memfd->get(), F_GET_SEALS);
+            if (seals == -1 || (seals & required_seals) != required_seals) {
+                throw std::runtime_error("shared memory not sealed against resizing");
+            }
+            auto size = mapping_size(body.ring_size);
+            if (memfd->size() != size) {
+                throw std::runtime_error("bad shared memory size");
+            }
+            auto area = memfd->map_shared_rw(size, 0);
+            auto channel = make_lw_shared<shm_channel>(fd, std::move(area), body.ring_size, false, std::move(local), addr);
+            return accept_result{connected_socket(std::make_unique<shm_connected_socket_impl>(std::move(channel))), std::move(addr)};
+        });
+    }
+public:
+    explicit shm_server_socket_impl(pollable_fd listener) : _state(make_lw_shared<state>()) {
+        _state->local = listener.get_file_desc().get_address();
+        _state->listener = std::move(listener);
+        // FIXME: future is discarded
+        (void)keep_doing([s = _state] {
+            return s->listener.accept().then([s] (std::tuple<pollable_fd, socket_address> r) {
+                auto [fd, addr] = std::move(r);
+                // FIXME: future is discarded
+                (void)handshake(std::move(fd), addr, s->local).then([s] (accept_result ar) {
+                    return s->accepted.push_eventually(std::move(ar));
+                }).handle_exception([addr] (std::exception_ptr ep) {
+                    shm_log.warn("failed to set up a shared memory connection from {}: {}", addr, ep);
+                });
+            });
+        }).handle_exception([s = _state] (std::exception_ptr ep) {
+            s->accepted.abort(ep);
+        });
+    }
+    ~shm_server_socket_impl() {
+        abort_accept();
+    }
+    virtual future<accept_result> accept() override {
+        return _state->accepted.pop_eventually();
+    }
+    virtual void abort_accept() override {
+        _state->listener.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
+    }
+    virtual socket_address local_address() const override {
+        return _state->local;
+    }
+};
+
+}
+
+server_socket shm_listen(socket_address addr, listen_options opts) {
+    if (!addr.is_af_unix()) {
+        throw std::invalid_argument("shared memory connections are set up over unix domain sockets");
+    }
+    return server_socket(std::make_unique<shm_server_socket_impl>(engine().posix_listen(addr, opts)));
+}
+
+socket make_shm_socket(shm_options opts) {
+    if (!valid_ring_size(opts.ring_size)) {
+        throw std::invalid_argument(format("shared memory ring size {} is not a power of two up to {}", opts.ring_size, max_ring_size));
+    }
+    return socket(std::make_unique<shm_socket_impl>(opts));
+}
+
+}
+
+}
@@ -31,6 +31,7 @@ module;
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/loop.hh>
 #include <seastar/net/stack.hh>
 #include <seastar/net/inet_address.hh>
 #endif
@@ -78,6 +79,14 @@ future<> net::datagram_channel::send(const socket_address& dst, packet p) {
     return _impl->send(dst, std::move(p));
 }
 
+future<std::vector<net::datagram>> net::datagram_channel::receive_batch(size_t max_datagrams) {
+    return _impl->receive_batch(max_datagrams);
+}
+
+future<> net::datagram_channel::send_batch(std::vector<outgoing_datagram> datagrams) {
+    return _impl->send_batch(std::move(datagrams));
+}
+
 bool net::datagram_channel::is_closed() const {
     return _impl->is_closed();
 }
@@ -146,6 +155,22 @@ int connected_socket::get_sockopt(int level, int optname, void* data, size_t len
     return _csi->get_sockopt(level, optname, data, len);
 }
 
+bool connected_socket::enable_zerocopy_send(size_t threshold) {
+    return _csi->enable_zerocopy_send(threshold);
+}
+
+bool connected_socket::set_notsent_lowat(size_t bytes) {
+    return _csi->set_notsent_lowat(bytes);
+}
+
+bool connected_socket::enable_rx_timestamps() {
+    return _csi->enable_rx_timestamps();
+}
+
+std::optional<std::chrono::system_clock::time_point> connected_socket::last_rx_timestamp() const noexcept {
+    return _csi->last_rx_timestamp();
+}
+
 socket_address connected_socket::local_address() const noexcept {
     return _csi->local_address();
 }
@@ -172,6 +197,51 @@ net::connected_socket_impl::source(connected_socket_input_stream_config csisc) {
     return source();
 }
 
+future<>
+net::connected_socket_impl::send_tls_control_record(uint8_t record_type, temporary_buffer<char> data) {
+    return make_exception_future<>(std::system_error(ENOTSUP, std::system_category(), "kernel TLS is not supported by this stack"));
+}
+
+future<std::vector<net::datagram>>
+net::datagram_channel_impl::receive_batch(size_t max_datagrams) {
+    // Stacks without a batched receive path return one datagram at a time
+    return receive().then([] (datagram d) {
+        std::vector<datagram> ret;
+        ret.push_back(std::move(d));
+        return ret;
+    });
+}
+
+future<>
+net::datagram_channel_impl::send_batch(std::vector<outgoing_datagram> datagrams) {
+    return do_with(std::move(datagrams), [this] (std::vector<outgoing_datagram>& datagrams) {
+        return do_for_each(datagrams, [this] (outgoing_datagram& d) {
+            return send(d.dst, std::move(d.data));
+        });
+    });
+}
+
+bool
+net::connected_socket_impl::enable_zerocopy_send(size_t threshold) {
+    // Stacks that cannot transmit without copying just keep copying
+    return false;
+}
+
+bool
+net::connected_socket_impl::set_notsent_lowat(size_t bytes) {
+    return false;
+}
+
+bool
+net::connected_socket_impl::enable_rx_timestamps() {
+    return false;
+}
+
+std::optional<std::chrono::system_clock::time_point>
+net::connected_socket_impl::last_rx_timestamp() const noexcept {
+    return std::nullopt;
+}
+
 socket::~socket()
 {}
 
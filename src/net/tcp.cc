@@ -22,10 +22,15 @@
 #ifdef SEASTAR_MODULE
 module;
 #include <compare>
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <utility>
 module seastar;
 #else
@@ -35,6 +40,12 @@ module seastar;
 #include <seastar/core/align.hh>
 #include <seastar/core/future.hh>
 #include "net/native-stack-impl.hh"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
 #endif
 
 namespace seastar {
@@ -67,7 +78,7 @@ void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
             beg += option_len::win_scale;
             break;
         case option_kind::sack:
-            _sack_received = true;
+            _sack_received = _local_sack;
             beg += option_len::sack;
             break;
         case option_kind::nop:
@@ -88,7 +99,41 @@ void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
     }
 }
 
-uint8_t tcp_option::fill(void* h, const tcp_hdr* th, uint8_t options_size) {
+unsigned tcp_option::parse_sack_blocks(const uint8_t* beg1, const uint8_t* end1, tcp_sack_block* blocks) {
+    const char* beg = reinterpret_cast<const char*>(beg1);
+    const char* end = reinterpret_cast<const char*>(end1);
+    while (beg < end) {
+        auto kind = option_kind(*beg);
+        if (kind == option_kind::eol) {
+            break;
+        }
+        if (kind == option_kind::nop) {
+            beg += option_len::nop;
+            continue;
+        }
+        if (end - beg < 2) {
+            break;
+        }
+        auto len = uint8_t(beg[1]);
+        if (len < 2 || beg + len > end) {
+            break;
+        }
+        if (kind == option_kind::sack_blocks) {
+            unsigned nr = std::min<unsigned>((len - uint8_t(option_len::sack_blocks)) / sack_block_len, max_sack_blocks);
+            auto p = beg + uint8_t(option_len::sack_blocks);
+            for (unsigned i = 0; i < nr; ++i, p += sack_block_len) {
+                blocks[i].left = make_seq(read_be<uint32_t>(p));
+                blocks[i].right = make_seq(read_be<uint32_t>(p + 4));
+            }
+            return nr;
+        }
+        beg += len;
+    }
+    return 0;
+}
+
+uint8_t tcp_option::fill(void* h, const tcp_hdr* th, uint8_t options_size,
+                         const tcp_sack_block* sack_blocks, unsigned nr_sack_blocks) {
     auto hdr = reinterpret_cast<char*>(h);
     auto off = hdr + tcp_hdr::len;
     uint8_t size = 0;
@@ -110,26 +155,47 @@ uint8_t tcp_option::fill(void* h, const tcp_hdr* th, uint8_t options_size) {
             off += win_scale.len;
             size += win_scale.len;
         }
-    }
-    if (size > 0) {
-        // Insert NOP option
-        auto size_max = align_up(uint8_t(size + 1), tcp_option::align);
-        while (size < size_max - uint8_t(option_len::eol)) {
+        if (_sack_received || (!ack_on && _local_sack)) {
+            auto sack = tcp_option::sack();
+            sack.write(off);
+            off += sack.len;
+            size += sack.len;
+        }
+        if (size > 0) {
+            // Insert NOP option
+            auto size_max = align_up(uint8_t(size + 1), tcp_option::align);
+            while (size < size_max - uint8_t(option_len::eol)) {
+                auto nop = tcp_option::nop();
+                nop.write(off);
+                off += option_len::nop;
+                size += option_len::nop;
+            }
+            auto eol = tcp_option::eol();
+            eol.write(off);
+            size += option_len::eol;
+        }
+    } else if (nr_sack_blocks) {
+        // Two NOPs keep the blocks 32-bit aligned
+        for (auto i = 0; i < 2; ++i) {
             auto nop = tcp_option::nop();
             nop.write(off);
             off += option_len::nop;
             size += option_len::nop;
         }
-        auto eol = tcp_option::eol();
-        eol.write(off);
-        size += option_len::eol;
+        auto len = uint8_t(option_len::sack_blocks) + nr_sack_blocks * sack_block_len;
+        tcp_option::write(off, option_kind::sack_blocks, option_len(len));
+        for (unsigned i = 0; i < nr_sack_blocks; ++i) {
+            write_be<uint32_t>(off + 2 + i * sack_block_len, sack_blocks[i].left.raw);
+            write_be<uint32_t>(off + 6 + i * sack_block_len, sack_blocks[i].right.raw);
+        }
+        size += len;
     }
     assert(size == options_size);
 
     return size;
 }
 
-uint8_t tcp_option::get_size(bool syn_on, bool ack_on) {
+uint8_t tcp_option::get_size(bool syn_on, bool ack_on, unsigned nr_sack_blocks) {
     uint8_t size = 0;
     if (syn_on) {
         if (_mss_received || !ack_on) {
@@ -138,15 +204,244 @@ uint8_t tcp_option::get_size(bool syn_on, bool ack_on) {
         if (_win_scale_received || !ack_on) {
             size += option_len::win_scale;
         }
-    }
-    if (size > 0) {
-        size += option_len::eol;
-        // Insert NOP option to align on 32-bit
-        size = align_up(size, tcp_option::align);
+        if (_sack_received || (!ack_on && _local_sack)) {
+            size += option_len::sack;
+        }
+        if (size > 0) {
+            size += option_len::eol;
+            // Insert NOP option to align on 32-bit
+            size = align_up(size, tcp_option::align);
+        }
+    } else if (nr_sack_blocks) {
+        size += 2 * uint8_t(option_len::nop) + uint8_t(option_len::sack_blocks) + nr_sack_blocks * sack_block_len;
     }
     return size;
 }
 
+namespace {
+
+using cc_clock = tcp_congestion_control::clock_type;
+
+// NewReno (RFC 5681)
+class reno_congestion_control final : public tcp_congestion_control {
+public:
+    const char* name() const noexcept override {
+        return "reno";
+    }
+    void on_ack(window w, uint32_t acked_bytes, cc_clock::time_point) noexcept override {
+        if (w.cwnd < w.ssthresh) {
+            // In slow start phase
+            w.cwnd += std::min(acked_bytes, w.mss);
+        } else {
+            // In congestion avoidance phase
+            uint32_t round_up = 1;
+            w.cwnd += std::max(round_up, w.mss * w.mss / w.cwnd);
+        }
+    }
+    void on_loss(window w, uint32_t flight_size, cc_clock::time_point) noexcept override {
+        w.ssthresh = std::max(flight_size / 2, 2 * w.mss);
+    }
+    void on_timeout(window w, uint32_t flight_size, cc_clock::time_point now) noexcept override {
+        on_loss(w, flight_size, now);
+    }
+};
+
+// CUBIC (RFC 8312): past a loss, the window grows along a cubic function
+// of the time since the loss, centered on the window it was lost at, so
+// that it gets back to it quickly, and probes carefully around it.
+class cubic_congestion_control final : public tcp_congestion_control {
+    static constexpr double c = 0.4;
+    static constexpr double beta = 0.7;
+
+    // Window at the last loss, in segments
+    double _w_max = 0;
+    // Time for the window to grow back to _w_max, in seconds
+    double _k = 0;
+    double _origin = 0;
+    // Window Reno would have, in segments
+    double _w_est = 0;
+    // Growth of the window not applied yet, in bytes
+    double _residual = 0;
+    std::optional<cc_clock::time_point> _epoch_start;
+    std::chrono::milliseconds _min_rtt = std::chrono::milliseconds::max();
+
+    void reduce(window w) noexcept {
+        double cwnd = double(w.cwnd) / w.mss;
+        // Fast convergence: release bandwidth for new flows if the window
+        // could not grow back to where it was lost last time
+        _w_max = cwnd < _w_max ? cwnd * (1 + beta) / 2 : cwnd;
+        w.ssthresh = std::max(uint32_t(w.cwnd * beta), 2 * w.mss);
+        _epoch_start.reset();
+        _residual = 0;
+    }
+public:
+    const char* name() const noexcept override {
+        return "cubic";
+    }
+    void on_ack(window w, uint32_t acked_bytes, cc_clock::time_point now) noexcept override {
+        if (w.cwnd < w.ssthresh) {
+            w.cwnd += std::min(acked_bytes, w.mss);
+            return;
+        }
+        double cwnd = double(w.cwnd) / w.mss;
+        if (!_epoch_start) {
+            _epoch_start = now;
+            if (cwnd < _w_max) {
+                _k = std::cbrt((_w_max - cwnd) / c);
+                _origin = _w_max;
+            } else {
+                _k = 0;
+                _origin = cwnd;
+            }
+            _w_est = cwnd;
+        }
+        auto rtt = _min_rtt == std::chrono::milliseconds::max() ? std::chrono::milliseconds(0) : _min_rtt;
+        double t = std::chrono::duration<double>(now - *_epoch_start + rtt).count();
+        double target = _origin + c * std::pow(t - _k, 3);
+        target = std::clamp(target, cwnd, cwnd * 1.5);
+        // TCP-friendly region: grow at least as fast as Reno would
+        _w_est += 3 * (1 - beta) / (1 + beta) * acked_bytes / w.cwnd;
+        target = std::max(target, _w_est);
+        _residual += (target - cwnd) / cwnd * acked_bytes;
+        if (_residual >= 1) {
+            auto growth = uint32_t(_residual);
+            w.cwnd += growth;
+            _residual -= growth;
+        }
+    }
+    void on_rtt_sample(std::chrono::milliseconds rtt, cc_clock::time_point) noexcept override {
+        _min_rtt = std::min(_min_rtt, rtt);
+    }
+    void on_loss(window w, uint32_t, cc_clock::time_point) noexcept override {
+        reduce(w);
+    }
+    void on_timeout(window w, uint32_t, cc_clock::time_point) noexcept override {
+        reduce(w);
+    }
+};
+
+// BBR-style: models the path by the maximum delivery rate measured over
+// the last rounds and the minimum round-trip time, sizes the window to
+// twice their product, and paces segments at about the delivery rate. It
+// probes for more bandwidth with cycles of higher and lower pacing gains
+// instead of with losses, and keeps its window on isolated losses.
+//
+// Unlike BBR, rates are measured per round rather than per segment, and
+// rounds last at least a lowres_clock tick.
+class bbr_congestion_control final : public tcp_congestion_control {
+    enum class mode { startup, drain, probe_bw };
+
+    static constexpr double high_gain = 2.885;
+    static constexpr double cwnd_gain = 2;
+    static constexpr std::array<double, 8> probe_gains = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+    static constexpr unsigned bw_filter_rounds = 10;
+    static constexpr unsigned full_bw_rounds = 3;
+    static constexpr std::chrono::seconds min_rtt_expiry{10};
+    static constexpr std::chrono::milliseconds min_round{10};
+
+    mode _mode = mode::startup;
+    std::array<uint64_t, bw_filter_rounds> _bw_samples = {};
+    unsigned _round = 0;
+    cc_clock::time_point _round_start;
+    uint64_t _delivered = 0;
+    std::optional<std::chrono::milliseconds> _min_rtt;
+    cc_clock::time_point _min_rtt_stamp;
+    uint64_t _full_bw = 0;
+    unsigned _full_bw_count = 0;
+    unsigned _cycle = 0;
+
+    double pacing_gain() const noexcept {
+        switch (_mode) {
+        case mode::startup: return high_gain;
+        case mode::drain: return 1 / high_gain;
+        case mode::probe_bw: return probe_gains[_cycle];
+        }
+        return 1;
+    }
+    std::chrono::milliseconds round_time() const noexcept {
+        return std::max(_min_rtt.value_or(min_round), min_round);
+    }
+    void end_round(cc_clock::time_point now) noexcept {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - _round_start).count();
+        _bw_samples[_round++ % bw_filter_rounds] = _delivered * 1000000 / std::max<int64_t>(elapsed, 1);
+        _round_start = now;
+        _delivered = 0;
+        switch (_mode) {
+        case mode::startup:
+            // The pipe is full once the bandwidth stops growing by a
+            // quarter in a few rounds
+            if (bandwidth() >= _full_bw * 5 / 4) {
+                _full_bw = bandwidth();
+                _full_bw_count = 0;
+            } else if (++_full_bw_count >= full_bw_rounds) {
+                _mode = mode::drain;
+            }
+            break;
+        case mode::drain:
+            // Drain the queue startup built up for a round
+            _mode = mode::probe_bw;
+            _cycle = 0;
+            break;
+        case mode::probe_bw:
+            _cycle = (_cycle + 1) % probe_gains.size();
+            break;
+        }
+    }
+public:
+    const char* name() const noexcept override {
+        return "bbr";
+    }
+    // The bottleneck bandwidth estimate, in bytes per second
+    uint64_t bandwidth() const noexcept {
+        return *std::max_element(_bw_samples.begin(), _bw_samples.end());
+    }
+    void on_ack(window w, uint32_t acked_bytes, cc_clock::time_point now) noexcept override {
+        if (_round_start == cc_clock::time_point()) {
+            _round_start = now;
+        }
+        _delivered += acked_bytes;
+        if (now - _round_start >= round_time()) {
+            end_round(now);
+        }
+        auto bw = bandwidth();
+        if (_mode == mode::startup || !_min_rtt || !bw) {
+            w.cwnd += acked_bytes;
+            return;
+        }
+        auto bdp = bw * std::chrono::duration_cast<std::chrono::microseconds>(*_min_rtt).count() / 1000000;
+        uint64_t target = std::max<uint64_t>(cwnd_gain * bdp, 4 * w.mss);
+        w.cwnd = std::min<uint64_t>(uint64_t(w.cwnd) + acked_bytes, target);
+    }
+    void on_rtt_sample(std::chrono::milliseconds rtt, cc_clock::time_point now) noexcept override {
+        if (!_min_rtt || rtt <= *_min_rtt || now - _min_rtt_stamp > min_rtt_expiry) {
+            _min_rtt = rtt;
+            _min_rtt_stamp = now;
+        }
+    }
+    void on_loss(window w, uint32_t, cc_clock::time_point) noexcept override {
+        w.ssthresh = std::max(w.cwnd, 4 * w.mss);
+    }
+    void on_timeout(window w, uint32_t, cc_clock::time_point) noexcept override {
+        w.ssthresh = std::max(w.cwnd, 4 * w.mss);
+    }
+    uint64_t pacing_rate() const noexcept override {
+        return pacing_gain() * bandwidth();
+    }
+};
+
+}
+
+std::unique_ptr<tcp_congestion_control> make_tcp_congestion_control(std::string_view name) {
+    if (name == "reno") {
+        return std::make_unique<reno_congestion_control>();
+    } else if (name == "cubic") {
+        return std::make_unique<cubic_congestion_control>();
+    } else if (name == "bbr") {
+        return std::make_unique<bbr_congestion_control>();
+    }
+    throw std::invalid_argument(fmt::format("unknown TCP congestion control algorithm: {}", name));
+}
+
 ipv4_tcp::ipv4_tcp(ipv4& inet)
 	: _inet_l4(inet), _tcp(std::make_unique<tcp<ipv4_traits>>(_inet_l4)) {
 }
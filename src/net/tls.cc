@@ -23,14 +23,22 @@
 module;
 #endif
 
+#include <atomic>
 #include <filesystem>
 #include <stdexcept>
 #include <system_error>
 #include <memory>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
 #include <sys/stat.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
@@ -45,7 +53,13 @@ module;
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/alien.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/resource.hh>
+#include <seastar/core/smp.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/file.hh>
@@ -57,6 +71,8 @@ module seastar;
 #include <seastar/core/with_timeout.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/net/stack.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <seastar/util/read_first_line.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/variant_utils.hh>
 #include <seastar/core/fsnotify.hh>
@@ -358,23 +374,84 @@ struct gnutls_datum : public gnutls_datum_t {
     }
 };
 
-class tls::certificate_credentials::impl: public gnutlsobj {
+// Bounded LRU map of serialized TLS sessions. Servers key it by session ID,
+// clients by server name.
+class session_cache {
+    using entry = std::pair<sstring, std::vector<uint8_t>>;
+    std::list<entry> _lru;
+    std::unordered_map<sstring, std::list<entry>::iterator> _index;
+    size_t _max_entries = 0;
 public:
-    impl()
-            : _creds([] {
-                gnutls_certificate_credentials_t xcred;
-                gnutls_certificate_allocate_credentials(&xcred);
-                if (xcred == nullptr) {
-                    throw std::bad_alloc();
-                }
-                return xcred;
-            }()), _priority(nullptr, &gnutls_priority_deinit)
-    {}
-    ~impl() {
-        if (_creds != nullptr) {
-            gnutls_certificate_free_credentials (_creds);
+    void set_max_entries(size_t n) {
+        _max_entries = n;
+        shrink();
+    }
+    bool enabled() const {
+        return _max_entries != 0;
+    }
+    void put(sstring key, std::vector<uint8_t> data) {
+        if (!enabled()) {
+            return;
+        }
+        remove(key);
+        _lru.emplace_front(key, std::move(data));
+        _index.emplace(std::move(key), _lru.begin());
+        shrink();
+    }
+    const std::vector<uint8_t>* get(const sstring& key) {
+        auto i = _index.find(key);
+        if (i == _index.end()) {
+            return nullptr;
+        }
+        _lru.splice(_lru.begin(), _lru, i->second);
+        return &i->second->second;
+    }
+    void remove(const sstring& key) {
+        auto i = _index.find(key);
+        if (i != _index.end()) {
+            _lru.erase(i->second);
+            _index.erase(i);
+        }
+    }
+private:
+    void shrink() {
+        while (_index.size() > _max_entries) {
+            _index.erase(_lru.back().first);
+            _lru.pop_back();
         }
     }
+};
+
+class tls::certificate_credentials::impl: public gnutlsobj {
+public:
+    // The certificates, keys, CRLs and trust of credentials. The sessions only
+    // read them, so once set up the credentials of all the shards can share
+    // them (see credentials_builder::build_sharded_reloadable_certificate_credentials()).
+    class parsed_certificates {
+    public:
+        std::unique_ptr<tls::dh_params::impl> dh_params;
+        gnutls_certificate_credentials_t creds;
+
+        parsed_certificates() {
+            gnutls_certificate_allocate_credentials(&creds);
+            if (creds == nullptr) {
+                throw std::bad_alloc();
+            }
+        }
+        parsed_certificates(const parsed_certificates&) = delete;
+        ~parsed_certificates() {
+            gnutls_certificate_free_credentials(creds);
+        }
+    };
+
+    impl() : impl(std::make_shared<parsed_certificates>()) {}
+    // Shares certificates parsed for other credentials, not to be changed
+    // any more
+    explicit impl(std::shared_ptr<parsed_certificates> parsed)
+            : _parsed(std::move(parsed))
+            , _creds(_parsed->creds)
+            , _priority(nullptr, &gnutls_priority_deinit)
+    {}
 
     operator gnutls_certificate_credentials_t() const {
         return _creds;
@@ -416,7 +493,7 @@ class tls::certificate_credentials::impl: public gnutlsobj {
 #endif
         auto cpy = std::make_unique<tls::dh_params::impl>(*dh._impl);
         gnutls_certificate_set_dh_params(*this, *cpy);
-        _dh_params = std::move(cpy);
+        _parsed->dh_params = std::move(cpy);
     }
     future<> set_system_trust() {
         return async([this] {
@@ -430,14 +507,35 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     client_auth get_client_auth() const {
         return _client_auth;
     }
-    void set_session_resume_mode(session_resume_mode m) {
+    void set_session_resume_mode(session_resume_mode m, const std::vector<uint8_t>& key = {}) {
         _session_resume_mode = m;
         // (re-)generate session key
         if (m != session_resume_mode::NONE) {
             _session_resume_key = {};
-            gnutls_session_ticket_key_generate(&_session_resume_key);
+            if (key.empty()) {
+                gnutls_session_ticket_key_generate(&_session_resume_key);
+            } else {
+                _session_resume_key.data = static_cast<unsigned char*>(gnutls_malloc(key.size()));
+                if (!_session_resume_key.data) {
+                    throw std::bad_alloc();
+                }
+                _session_resume_key.size = key.size();
+                std::copy(key.begin(), key.end(), _session_resume_key.data);
+            }
         }
     }
+    void set_session_resume_lifetime(std::chrono::seconds s) {
+        _session_resume_lifetime = s;
+    }
+    std::optional<std::chrono::seconds> get_session_resume_lifetime() const {
+        return _session_resume_lifetime;
+    }
+    void set_session_cache_size(size_t n) {
+        _session_cache.set_max_entries(n);
+    }
+    session_cache& get_session_cache() {
+        return _session_cache;
+    }
     session_resume_mode get_session_resume_mode() const {
         return _session_resume_mode;
     }
@@ -461,9 +559,49 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     void set_dn_verification_callback(dn_callback cb) {
         _dn_callback = std::move(cb);
     }
+    void set_kernel_tls_offload(bool v) {
+        _kernel_tls_offload = v;
+    }
+    bool get_kernel_tls_offload() const {
+        return _kernel_tls_offload;
+    }
+    void set_handshake_offload(std::optional<handshake_offload_config> cfg) {
+        if (cfg) {
+            // The pool is process-wide, its size set once
+            static std::atomic<unsigned> pool_threads_per_node{0};
+            auto threads = std::max(cfg->threads_per_node, 1u);
+            auto expected = 0u;
+            if (!pool_threads_per_node.compare_exchange_strong(expected, threads) && expected != threads) {
+                throw std::invalid_argument(fmt::format("handshake offload threads_per_node {} conflicts with the {} of the process-wide pool", threads, expected));
+            }
+        }
+        _handshake_offload = cfg;
+        if (cfg) {
+            _handshake_offload_sem.emplace(std::max(cfg->max_concurrency, 1u));
+        } else {
+            _handshake_offload_sem.reset();
+        }
+    }
+    const std::optional<handshake_offload_config>& get_handshake_offload() const {
+        return _handshake_offload;
+    }
+    void set_alpn_protocols(std::vector<sstring> protocols) {
+        _alpn_protocols = std::move(protocols);
+    }
+    const std::vector<sstring>& get_alpn_protocols() const {
+        return _alpn_protocols;
+    }
+    void set_record_sizing(record_sizing sizing) {
+        _record_sizing = sizing;
+    }
+    record_sizing get_record_sizing() const {
+        return _record_sizing;
+    }
 private:
     friend class credentials_builder;
     friend class session;
+    template<typename Base>
+    friend class reloadable_credentials;
 
     bool need_load_system_trust() const {
         return _load_system_trust;
@@ -477,15 +615,22 @@ class tls::certificate_credentials::impl: public gnutlsobj {
         });
     }
 
+    std::shared_ptr<parsed_certificates> _parsed;
     gnutls_certificate_credentials_t _creds;
-    std::unique_ptr<tls::dh_params::impl> _dh_params;
     std::unique_ptr<std::remove_pointer_t<gnutls_priority_t>, void(*)(gnutls_priority_t)> _priority;
     client_auth _client_auth = client_auth::NONE;
     session_resume_mode _session_resume_mode = session_resume_mode::NONE;
     bool _load_system_trust = false;
+    bool _kernel_tls_offload = false;
+    std::optional<handshake_offload_config> _handshake_offload;
+    std::optional<semaphore> _handshake_offload_sem;
+    std::vector<sstring> _alpn_protocols;
+    record_sizing _record_sizing = record_sizing::FULL;
     semaphore _system_trust_sem {1};
     dn_callback _dn_callback;
     gnutls_datum _session_resume_key;
+    std::optional<std::chrono::seconds> _session_resume_lifetime;
+    session_cache _session_cache;
 };
 
 tls::certificate_credentials::certificate_credentials()
@@ -563,6 +708,26 @@ void tls::certificate_credentials::set_dn_verification_callback(dn_callback cb)
     _impl->set_dn_verification_callback(std::move(cb));
 }
 
+void tls::certificate_credentials::set_kernel_tls_offload(bool v) {
+    _impl->set_kernel_tls_offload(v);
+}
+
+void tls::certificate_credentials::set_handshake_offload(std::optional<handshake_offload_config> cfg) {
+    _impl->set_handshake_offload(cfg);
+}
+
+void tls::certificate_credentials::set_session_cache_size(size_t max_entries) {
+    _impl->set_session_cache_size(max_entries);
+}
+
+void tls::certificate_credentials::set_alpn_protocols(std::vector<sstring> protocols) {
+    _impl->set_alpn_protocols(std::move(protocols));
+}
+
+void tls::certificate_credentials::set_record_sizing(record_sizing sizing) {
+    _impl->set_record_sizing(sizing);
+}
+
 tls::server_credentials::server_credentials()
 #if GNUTLS_VERSION_NUMBER < 0x030600
     : server_credentials(dh_params{})
@@ -589,6 +754,10 @@ void tls::server_credentials::set_session_resume_mode(session_resume_mode m) {
     _impl->set_session_resume_mode(m);
 }
 
+void tls::server_credentials::set_session_resume_lifetime(std::chrono::seconds s) {
+    _impl->set_session_resume_lifetime(s);
+}
+
 
 static const sstring dh_level_key = "dh_level";
 static const sstring x509_trust_key = "x509_trust";
@@ -694,6 +863,36 @@ void tls::credentials_builder::set_priority_string(const sstring& prio) {
 
 void tls::credentials_builder::set_session_resume_mode(session_resume_mode m) {
     _session_resume_mode = m;
+    _session_resume_key.clear();
+    if (m != session_resume_mode::NONE) {
+        gnutls_datum key;
+        gtls_chk(gnutls_session_ticket_key_generate(&key));
+        _session_resume_key.assign(key.data, key.data + key.size);
+    }
+}
+
+void tls::credentials_builder::set_session_resume_lifetime(std::chrono::seconds s) {
+    _session_resume_lifetime = s;
+}
+
+void tls::credentials_builder::set_session_cache_size(size_t max_entries) {
+    _session_cache_size = max_entries;
+}
+
+void tls::credentials_builder::set_kernel_tls_offload(bool v) {
+    _kernel_tls_offload = v;
+}
+
+void tls::credentials_builder::set_handshake_offload(std::optional<handshake_offload_config> cfg) {
+    _handshake_offload = cfg;
+}
+
+void tls::credentials_builder::set_alpn_protocols(std::vector<sstring> protocols) {
+    _alpn_protocols = std::move(protocols);
+}
+
+void tls::credentials_builder::set_record_sizing(record_sizing sizing) {
+    _record_sizing = sizing;
 }
 
 template<typename Blobs, typename Visitor>
@@ -738,13 +937,26 @@ void tls::credentials_builder::apply_to(certificate_credentials& creds) const {
         creds._impl->_load_system_trust = true;
     }
 
+    apply_settings_to(creds);
+}
+
+void tls::credentials_builder::apply_settings_to(certificate_credentials& creds) const {
     if (!_priority.empty()) {
         creds.set_priority_string(_priority);
     }
 
     creds._impl->set_client_auth(_client_auth);
-    // Note: this causes server session key rotation on cert reload
-    creds._impl->set_session_resume_mode(_session_resume_mode);
+    // All credentials built from this builder share the ticket key, so
+    // it survives cert reload and is valid on every shard
+    creds._impl->set_session_resume_mode(_session_resume_mode, _session_resume_key);
+    if (_session_resume_lifetime) {
+        creds._impl->set_session_resume_lifetime(*_session_resume_lifetime);
+    }
+    creds._impl->set_session_cache_size(_session_cache_size);
+    creds._impl->set_kernel_tls_offload(_kernel_tls_offload);
+    creds._impl->set_handshake_offload(_handshake_offload);
+    creds._impl->set_alpn_protocols(_alpn_protocols);
+    creds._impl->set_record_sizing(_record_sizing);
 }
 
 shared_ptr<tls::certificate_credentials> tls::credentials_builder::build_certificate_credentials() const {
@@ -812,7 +1024,7 @@ class tls::reloadable_credentials_base {
         }
         void start() {
             // run the loop in a thread. makes code almost readable.
-            (void)async(std::bind(&reloading_builder::run, this)).finally([me = shared_from_this()] {});
+            (void)seastar::async(std::bind(&reloading_builder::run, this)).finally([me = shared_from_this()] {});
         }
         void run() {
             while (_creds) {
@@ -1008,18 +1220,71 @@ class tls::reloadable_credentials : public Base, public tls::reloadable_credenti
         , tls::reloadable_credentials_base(std::move(builder), std::move(cb), delay)
     {}
     void rebuild(const credentials_builder&) override;
+
+    // Makes the credentials of the other shards share ours, and returns
+    // them, ours included, by shard
+    static future<std::vector<foreign_ptr<shared_ptr<Base>>>> share_with_all_shards(credentials_builder builder, shared_ptr<reloadable_credentials> creds);
+private:
+    future<> share(const credentials_builder& builder);
+
+    // The credentials of the other shards sharing ours, if any
+    std::vector<foreign_ptr<shared_ptr<Base>>> _shared_with;
 };
 
 template<>
 void tls::reloadable_credentials<tls::certificate_credentials>::rebuild(const credentials_builder& builder) {
     auto tmp = builder.build_certificate_credentials();
     this->_impl = std::move(tmp->_impl);
+    if (!_shared_with.empty()) {
+        share(builder).get();
+    }
 }
 
 template<>
 void tls::reloadable_credentials<tls::server_credentials>::rebuild(const credentials_builder& builder) {
     auto tmp = builder.build_server_credentials();
     this->_impl = std::move(tmp->_impl);
+    if (!_shared_with.empty()) {
+        share(builder).get();
+    }
+}
+
+template<typename Base>
+future<> tls::reloadable_credentials<Base>::share(const credentials_builder& builder) {
+    // Loading the system trust changes the parsed certificates, so it
+    // cannot wait for the first handshake of each shard
+    if (this->_impl->need_load_system_trust()) {
+        co_await this->_impl->maybe_load_system_trust();
+    }
+    auto parsed = this->_impl->_parsed;
+    co_await parallel_for_each(_shared_with, [&builder, parsed] (foreign_ptr<shared_ptr<Base>>& creds) {
+        return smp::submit_to(creds.get_owner_shard(), [&builder, &creds, parsed] {
+            // Only the settings, cheap to apply, are set on each shard
+            Base tmp;
+            tmp._impl = seastar::make_shared<certificate_credentials::impl>(parsed);
+            builder.apply_settings_to(tmp);
+            creds->_impl = std::move(tmp._impl);
+        });
+    });
+}
+
+template<typename Base>
+future<std::vector<foreign_ptr<shared_ptr<Base>>>> tls::reloadable_credentials<Base>::share_with_all_shards(credentials_builder builder, shared_ptr<reloadable_credentials> creds) {
+    std::vector<foreign_ptr<shared_ptr<Base>>> all(smp::count);
+    for (unsigned c = 0; c < smp::count; c++) {
+        if (c == this_shard_id()) {
+            all[c] = make_foreign(shared_ptr<Base>(creds));
+            continue;
+        }
+        auto [ours, theirs] = co_await smp::submit_to(c, [] {
+            auto p = seastar::make_shared<Base>();
+            return std::pair(make_foreign(p), make_foreign(p));
+        });
+        creds->_shared_with.push_back(std::move(ours));
+        all[c] = std::move(theirs);
+    }
+    co_await creds->share(builder);
+    co_return all;
 }
 
 future<shared_ptr<tls::certificate_credentials>> tls::credentials_builder::build_reloadable_certificate_credentials(reload_callback cb, std::optional<std::chrono::milliseconds> tolerance) const {
@@ -1036,8 +1301,196 @@ future<shared_ptr<tls::server_credentials>> tls::credentials_builder::build_relo
     });
 }
 
+future<std::vector<foreign_ptr<shared_ptr<tls::certificate_credentials>>>> tls::credentials_builder::build_sharded_reloadable_certificate_credentials(reload_callback cb, std::optional<std::chrono::milliseconds> tolerance) const {
+    using creds_type = reloadable_credentials<tls::certificate_credentials>;
+    auto creds = seastar::make_shared<creds_type>(*this, std::move(cb), std::move(*build_certificate_credentials()), tolerance.value_or(reloadable_credentials_base::default_tolerance));
+    return creds->init().then([creds, builder = *this] () mutable {
+        return creds_type::share_with_all_shards(std::move(builder), creds);
+    });
+}
+
+future<std::vector<foreign_ptr<shared_ptr<tls::server_credentials>>>> tls::credentials_builder::build_sharded_reloadable_server_credentials(reload_callback cb, std::optional<std::chrono::milliseconds> tolerance) const {
+    using creds_type = reloadable_credentials<tls::server_credentials>;
+    auto creds = seastar::make_shared<creds_type>(*this, std::move(cb), std::move(*build_server_credentials()), tolerance.value_or(reloadable_credentials_base::default_tolerance));
+    return creds->init().then([creds, builder = *this] () mutable {
+        return creds_type::share_with_all_shards(std::move(builder), creds);
+    });
+}
+
 namespace tls {
 
+// Fills a kernel tls*_crypto_info struct from the gnutls record state.
+// TLS 1.2 AES-GCM records carry an explicit nonce, which the kernel seeds
+// from the iv field; all other modes derive the nonce from salt + iv, which
+// together make up the 12 byte gnutls IV.
+template <typename Info>
+static std::vector<uint8_t> make_ktls_crypto_info(uint16_t version, uint16_t cipher_type, bool explicit_nonce,
+        const gnutls_datum_t& iv, const gnutls_datum_t& key, const unsigned char* seq) {
+    Info info;
+    memset(&info, 0, sizeof(info));
+    if (key.size != sizeof(info.key)
+            || iv.size != sizeof(info.salt) + (explicit_nonce ? 0 : sizeof(info.iv))) {
+        return {};
+    }
+    info.info.version = version;
+    info.info.cipher_type = cipher_type;
+    memcpy(info.key, key.data, sizeof(info.key));
+    memcpy(info.salt, iv.data, sizeof(info.salt));
+    memcpy(info.iv, explicit_nonce ? seq : iv.data + sizeof(info.salt), sizeof(info.iv));
+    memcpy(info.rec_seq, seq, sizeof(info.rec_seq));
+    auto p = reinterpret_cast<const uint8_t*>(&info);
+    return std::vector<uint8_t>(p, p + sizeof(info));
+}
+
+// Returns an empty vector if the kernel cannot take over this session
+static std::vector<uint8_t> ktls_crypto_info(gnutls_session_t s, bool read) {
+    uint16_t version;
+    switch (gnutls_protocol_get_version(s)) {
+    case GNUTLS_TLS1_2:
+        version = TLS_1_2_VERSION;
+        break;
+    case GNUTLS_TLS1_3:
+        version = TLS_1_3_VERSION;
+        break;
+    default:
+        return {};
+    }
+    gnutls_datum_t mac_key, iv, key;
+    unsigned char seq[8];
+    if (gnutls_record_get_state(s, read, &mac_key, &iv, &key, seq) < 0) {
+        return {};
+    }
+    bool explicit_nonce = version == TLS_1_2_VERSION;
+    switch (gnutls_cipher_get(s)) {
+    case GNUTLS_CIPHER_AES_128_GCM:
+        return make_ktls_crypto_info<tls12_crypto_info_aes_gcm_128>(version, TLS_CIPHER_AES_GCM_128, explicit_nonce, iv, key, seq);
+    case GNUTLS_CIPHER_AES_256_GCM:
+        return make_ktls_crypto_info<tls12_crypto_info_aes_gcm_256>(version, TLS_CIPHER_AES_GCM_256, explicit_nonce, iv, key, seq);
+    case GNUTLS_CIPHER_CHACHA20_POLY1305:
+        return make_ktls_crypto_info<tls12_crypto_info_chacha20_poly1305>(version, TLS_CIPHER_CHACHA20_POLY1305, false, iv, key, seq);
+    default:
+        return {};
+    }
+}
+
+// The threads the offloaded handshakes run on (see
+// certificate_credentials::set_handshake_offload()): one pool for each NUMA
+// node, shared by its shards, its threads allowed on all the CPUs of the
+// node rather than pinned to the CPU of the shard creating them.
+class handshake_offload_pool {
+    struct node_pool {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<noncopyable_function<void ()>> work;
+        std::vector<posix_thread> threads;
+        bool stopped = false;
+    };
+    std::mutex _mtx;
+    std::unordered_map<unsigned, std::unique_ptr<node_pool>> _nodes;
+
+    static void run(node_pool& p) {
+        std::unique_lock lk(p.mtx);
+        for (;;) {
+            p.cv.wait(lk, [&p] { return p.stopped || !p.work.empty(); });
+            if (p.work.empty()) {
+                return;
+            }
+            auto fn = std::move(p.work.front());
+            p.work.pop_front();
+            lk.unlock();
+            fn();
+            lk.lock();
+        }
+    }
+    static cpu_set_t node_cpus(unsigned node) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        std::optional<resource::cpuset> set;
+        try {
+            set = resource::parse_cpuset(std::string(read_first_line(fmt::format("/sys/devices/system/node/node{}/cpulist", node))));
+        } catch (...) {
+        }
+        if (!set || set->empty()) {
+            for (unsigned c = 0; c < CPU_SETSIZE; c++) {
+                CPU_SET(c, &cpus);
+            }
+        } else {
+            for (auto c : *set) {
+                CPU_SET(c, &cpus);
+            }
+        }
+        return cpus;
+    }
+public:
+    ~handshake_offload_pool() {
+        for (auto& [node, p] : _nodes) {
+            {
+                std::lock_guard g(p->mtx);
+                p->stopped = true;
+            }
+            p->cv.notify_all();
+            for (auto& t : p->threads) {
+                t.join();
+            }
+        }
+    }
+    // Runs fn on a thread of the pool of the node, creating it if need be
+    void submit(unsigned node, unsigned nr_threads, noncopyable_function<void ()> fn) {
+        node_pool* p;
+        {
+            std::lock_guard g(_mtx);
+            auto& np = _nodes[node];
+            if (!np) {
+                np = std::make_unique<node_pool>();
+                auto cpus = node_cpus(node);
+                for (unsigned i = 0; i < std::max(nr_threads, 1u); i++) {
+                    np->threads.emplace_back(posix_thread::attr(cpus), [p = np.get()] { run(*p); });
+                }
+            }
+            p = np.get();
+        }
+        {
+            std::lock_guard g(p->mtx);
+            p->work.push_back(std::move(fn));
+        }
+        p->cv.notify_one();
+    }
+    static handshake_offload_pool& get() {
+        static handshake_offload_pool pool;
+        return pool;
+    }
+};
+
+// The offloaded handshakes of a shard
+struct handshake_offload_stats {
+    // From waiting for the concurrency limit to the reactor resuming the
+    // handshake, in microseconds, from 16us to about 1s
+    using latency_histogram = metrics::internal::approximate_exponential_histogram<16, 1 << 20, 2>;
+    uint64_t offloaded = 0;
+    uint64_t waiting = 0;
+    uint64_t running = 0;
+    latency_histogram latency;
+    metrics::metric_groups metrics;
+
+    handshake_offload_stats() {
+        namespace sm = seastar::metrics;
+        metrics.add_group("tls", {
+            sm::make_counter("offloaded_handshake_steps", offloaded,
+                    sm::description("Total number of handshake steps run on the handshake offload threads")),
+            sm::make_queue_length("offloaded_handshake_steps_waiting", waiting,
+                    sm::description("Number of handshake steps waiting for the handshake offload concurrency limit")),
+            sm::make_queue_length("offloaded_handshake_steps_running", running,
+                    sm::description("Number of handshake steps running on the handshake offload threads")),
+            sm::make_histogram("offloaded_handshake_step_latency", [this] { return latency.to_metrics_histogram(); },
+                    sm::description("Histogram of the time (in microseconds) from offloading a handshake step to resuming it on the reactor")),
+        });
+    }
+    static handshake_offload_stats& local() {
+        static thread_local handshake_offload_stats stats;
+        return stats;
+    }
+};
+
 /**
  * Session wraps gnutls session, and is the
  * actual conduit for an TLS/SSL data flow.
@@ -1090,6 +1543,15 @@ class session : public enable_lw_shared_from_this<session> {
                     gnutls_session_ticket_enable_server(*this, _creds->get_session_resume_key());
                     break;
             }
+            if (_creds->get_session_cache().enabled()) {
+                gnutls_db_set_ptr(*this, _creds.get());
+                gnutls_db_set_store_function(*this, &db_store);
+                gnutls_db_set_retrieve_function(*this, &db_retrieve);
+                gnutls_db_set_remove_function(*this, &db_remove);
+            }
+            if (auto lifetime = _creds->get_session_resume_lifetime()) {
+                gnutls_db_set_cache_expiration(*this, lifetime->count());
+            }
         }
  
         auto prio = _creds->get_priority();
@@ -1108,11 +1570,30 @@ class session : public enable_lw_shared_from_this<session> {
             gnutls_session_set_verify_function(*this, &verify_wrapper);
         }
 #endif
+        // without explicit resume data, offer the last session with this server, if cached
+        if (_type == type::CLIENT && _options.session_resume_data.empty() && !_options.server_name.empty()) {
+            if (auto cached = _creds->get_session_cache().get(_options.server_name)) {
+                _options.session_resume_data = *cached;
+            }
+        }
         // if we are a client, check if we have a session ticket to unpack.
         if (_type == type::CLIENT && !_options.session_resume_data.empty()) {
             gtls_chk(gnutls_session_set_data(*this, _options.session_resume_data.data(), _options.session_resume_data.size()));
         }
         _options.session_resume_data.clear(); // no need to keep around
+
+        const auto& alpn = _type == type::CLIENT && !_options.alpn_protocols.empty()
+                ? _options.alpn_protocols : _creds->get_alpn_protocols();
+        if (!alpn.empty()) {
+            std::vector<gnutls_datum_t> protocols;
+            protocols.reserve(alpn.size());
+            for (auto& p : alpn) {
+                protocols.push_back(gnutls_datum_t{reinterpret_cast<unsigned char*>(const_cast<char*>(p.data())), unsigned(p.size())});
+            }
+            // gnutls copies the protocols
+            gtls_chk(gnutls_alpn_set_protocols(*this, protocols.data(), protocols.size(),
+                    _type == type::SERVER ? GNUTLS_ALPN_SERVER_PRECEDENCE : 0));
+        }
     }
     session(type t, shared_ptr<certificate_credentials> creds,
             connected_socket sock,
@@ -1165,8 +1646,81 @@ class session : public enable_lw_shared_from_this<session> {
         if (_type == type::CLIENT && !_options.server_name.empty()) {
             gnutls_server_name_set(*this, GNUTLS_NAME_DNS, _options.server_name.data(), _options.server_name.size());
         }
+        if (offload_handshake()) {
+            return wait_for_output().then([this] {
+                return offloaded_handshake_step();
+            }).then([this] (int res) {
+                return handle_handshake_step(res);
+            });
+        }
+        try {
+            return handle_handshake_step(gnutls_handshake(*this));
+        } catch (...) {
+            return make_exception_future<>(std::current_exception());
+        }
+    }
+    // Whether to run the handshake steps on the offload threads. Not if
+    // gnutls may call back into the session cache, nor for clients, whose
+    // certificate verification it calls back into in the middle of the
+    // handshake.
+    bool offload_handshake() const {
+        return _type == type::SERVER && _creds->get_handshake_offload() && !_creds->get_session_cache().enabled();
+    }
+    // Runs gnutls_handshake() on an offload thread. While it runs, pull()
+    // consumes the input already received, which nothing else touches with
+    // both semaphores held, seeing the end of it as of the submission, and
+    // vec_push() only buffers the output, sent once the reactor resumes.
+    future<int> offloaded_handshake_step() {
+        auto& stats = handshake_offload_stats::local();
+        auto start = std::chrono::steady_clock::now();
+        ++stats.waiting;
+        return get_units(*_creds->_handshake_offload_sem, 1).finally([&stats] {
+            --stats.waiting;
+        }).then([this, &stats, start] (semaphore_units<> units) {
+            _handshake_step.emplace();
+            auto f = _handshake_step->get_future();
+            _offloaded_eof = eof();
+            _offloading = true;
+            try {
+                handshake_offload_pool::get().submit(smp::numa_node(this_shard_id()), _creds->get_handshake_offload()->threads_per_node,
+                        [this, &alien = engine().alien(), shard = this_shard_id()] () noexcept {
+                    auto res = gnutls_handshake(*this);
+                    alien::run_on(alien, shard, [this, res] () noexcept {
+                        _handshake_step->set_value(res);
+                    });
+                });
+            } catch (...) {
+                _offloading = false;
+                _handshake_step.reset();
+                throw;
+            }
+            ++stats.offloaded;
+            ++stats.running;
+            return f.then([this, &stats, start, units = std::move(units)] (int res) {
+                _offloading = false;
+                _handshake_step.reset();
+                --stats.running;
+                stats.latency.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+                send_offloaded_output();
+                return res;
+            });
+        });
+    }
+    void send_offloaded_output() {
+        if (_offloaded_output.empty()) {
+            return;
+        }
+        try {
+            scattered_message<char> msg;
+            msg.append(std::string_view(_offloaded_output.data(), _offloaded_output.size()));
+            _offloaded_output.clear();
+            _output_pending = _out.put(std::move(msg).release());
+        } catch (...) {
+            _output_pending = make_exception_future<>(std::current_exception());
+        }
+    }
+    future<> handle_handshake_step(int res) {
         try {
-            auto res = gnutls_handshake(*this);
             if (res < 0) {
                 switch (res) {
                 case GNUTLS_E_AGAIN:
@@ -1213,7 +1767,10 @@ class session : public enable_lw_shared_from_this<session> {
             }
             _connected = true;
             // make sure we reset output_pending
-            return wait_for_output();
+            return wait_for_output().then([this] {
+                maybe_enable_ktls_tx();
+                maybe_cache_session();
+            });
         } catch (...) {
             return make_exception_future<>(std::current_exception());
         }
@@ -1239,6 +1796,32 @@ class session : public enable_lw_shared_from_this<session> {
         });
     }
 
+    // Hands encryption of outgoing records to the kernel. Decryption stays
+    // in gnutls: with kernel RX, post-handshake messages (session tickets,
+    // key updates, alerts) would have to be read off the socket as control
+    // records, which the socket layer does not support.
+    void maybe_enable_ktls_tx() noexcept {
+        if (_ktls_tx || !_creds->get_kernel_tls_offload()) {
+            return;
+        }
+        try {
+            auto info = ktls_crypto_info(*this, false);
+            if (info.empty()) {
+                return;
+            }
+            static constexpr char ulp[] = "tls";
+            _sock->set_sockopt(SOL_TCP, TCP_ULP, ulp, sizeof(ulp));
+            _sock->set_sockopt(SOL_TLS, TLS_TX, info.data(), info.size());
+            _ktls_tx = true;
+        } catch (...) {
+            // No tls module, or not a TCP socket of the posix stack. The
+            // ULP is inert without TLS_TX, so gnutls keeps encrypting
+        }
+    }
+    bool ktls_tx() const noexcept {
+        return _ktls_tx;
+    }
+
     size_t in_avail() const {
         return _input.size();
     }
@@ -1264,6 +1847,62 @@ class session : public enable_lw_shared_from_this<session> {
         });
     }
 
+    static sstring to_cache_key(const gnutls_datum_t& d) {
+        return sstring(reinterpret_cast<const char*>(d.data), d.size);
+    }
+    static int db_store(void* ptr, gnutls_datum_t key, gnutls_datum_t data) {
+        try {
+            static_cast<tls::certificate_credentials::impl*>(ptr)->get_session_cache().put(to_cache_key(key),
+                    std::vector<uint8_t>(data.data, data.data + data.size));
+            return 0;
+        } catch (...) {
+            return -1;
+        }
+    }
+    static gnutls_datum_t db_retrieve(void* ptr, gnutls_datum_t key) {
+        gnutls_datum_t res = { nullptr, 0 };
+        try {
+            auto data = static_cast<tls::certificate_credentials::impl*>(ptr)->get_session_cache().get(to_cache_key(key));
+            // gnutls takes ownership of the returned data
+            if (data && (res.data = static_cast<unsigned char*>(gnutls_malloc(data->size())))) {
+                std::copy(data->begin(), data->end(), res.data);
+                res.size = data->size();
+            }
+        } catch (...) {
+        }
+        return res;
+    }
+    static int db_remove(void* ptr, gnutls_datum_t key) {
+        try {
+            static_cast<tls::certificate_credentials::impl*>(ptr)->get_session_cache().remove(to_cache_key(key));
+            return 0;
+        } catch (...) {
+            return -1;
+        }
+    }
+    // Remembers the client session for resumption by the next connection to
+    // the same server name. With TLS 1.3 that is only possible once the server
+    // has sent a ticket, i.e. after some data was exchanged, so this also
+    // runs on close.
+    void maybe_cache_session() noexcept {
+        if (_type != type::CLIENT || _options.server_name.empty() || !_connected || _error
+                || !_creds->get_session_cache().enabled()) {
+            return;
+        }
+        try {
+            if (gnutls_protocol_get_version(*this) == GNUTLS_TLS1_3
+                    && (gnutls_session_get_flags(*this) & GNUTLS_SFLAGS_SESSION_TICKET) == 0) {
+                return;
+            }
+            gnutls_datum tmp;
+            if (gnutls_session_get_data2(*this, &tmp) == GNUTLS_E_SUCCESS) {
+                _creds->get_session_cache().put(_options.server_name, std::vector<uint8_t>(tmp.data, tmp.data + tmp.size));
+            }
+        } catch (...) {
+            // caching is best effort
+        }
+    }
+
     static session * from_transport_ptr(gnutls_transport_ptr_t ptr) {
         return static_cast<session *>(ptr);
     }
@@ -1403,28 +2042,85 @@ class session : public enable_lw_shared_from_this<session> {
 
     typedef net::fragment* frag_iter;
 
-    future<> do_put(frag_iter i, frag_iter e) {
-        assert(_output_pending.available());
-        return do_for_each(i, e, [this](net::fragment& f) {
-            auto ptr = f.base;
-            auto size = f.size;
-            size_t off = 0; // here to appease eclipse cdt
-            return repeat([this, ptr, size, off]() mutable {
-                if (off == size) {
-                    return make_ready_future<stop_iteration>(stop_iteration::yes);
-                }
-                auto res = gnutls_record_send(*this, ptr + off, size - off);
-                if (res > 0) { // don't really need to check, but...
-                    off += res;
-                }
-                // what will we wait for? error or results...
-                auto f = res < 0 ? handle_output_error(res) : wait_for_output();
+    // The plaintext size of the next record
+    size_t record_size() noexcept {
+        size_t max = gnutls_record_get_max_size(*this);
+        if (_creds->get_record_sizing() != record_sizing::DYNAMIC) {
+            return max;
+        }
+        if (lowres_clock::now() - _last_record_sent > dynamic_record_idle_reset) {
+            _sent_since_idle = 0;
+        }
+        return _sent_since_idle < dynamic_record_ramp ? std::min(max, dynamic_record_small_size) : max;
+    }
+
+    future<> send_record(const char* ptr, size_t size) {
+        _sent_since_idle += size;
+        _last_record_sent = lowres_clock::now();
+        size_t off = 0; // here to appease eclipse cdt
+        return repeat([this, ptr, size, off]() mutable {
+            if (off == size) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto res = gnutls_record_send(*this, ptr + off, size - off);
+            if (res > 0) { // don't really need to check, but...
+                off += res;
+            }
+            // what will we wait for? error or results...
+            auto f = res < 0 ? handle_output_error(res) : wait_for_output();
+            return f.then([] {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            });
+        });
+    }
+
+    // Sends the record the writes so far were coalesced into
+    future<> send_coalesced() {
+        return send_record(_coalesced.get(), std::exchange(_coalesced_len, 0));
+    }
+
+    // Fills the record being coalesced, sending the records filled. Whole
+    // records of the fragment are sent from it, without copying.
+    future<> coalesce(const char* ptr, size_t size) {
+        return repeat([this, ptr, size] () mutable {
+            if (!size) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            // Dynamic sizing may have shrunk the records since this one started
+            auto rsize = std::max(record_size(), _coalesced_len);
+            if (!_coalesced_len && size >= rsize) {
+                auto f = send_record(ptr, rsize);
+                ptr += rsize;
+                size -= rsize;
                 return f.then([] {
                     return make_ready_future<stop_iteration>(stop_iteration::no);
                 });
+            }
+            if (_coalesced.size() < rsize) {
+                auto buf = temporary_buffer<char>(gnutls_record_get_max_size(*this));
+                std::copy_n(_coalesced.get(), _coalesced_len, buf.get_write());
+                _coalesced = std::move(buf);
+            }
+            auto n = std::min(size, rsize - _coalesced_len);
+            std::copy_n(ptr, n, _coalesced.get_write() + _coalesced_len);
+            _coalesced_len += n;
+            ptr += n;
+            size -= n;
+            if (_coalesced_len < rsize) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            return send_coalesced().then([] {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
             });
         });
     }
+
+    future<> do_put(frag_iter i, frag_iter e) {
+        assert(_output_pending.available());
+        return do_for_each(i, e, [this](net::fragment& f) {
+            return coalesce(f.base, f.size);
+        });
+    }
     future<> put(net::packet p) {
         if (_error) {
             return make_exception_future<>(_error);
@@ -1438,24 +2134,27 @@ class session : public enable_lw_shared_from_this<session> {
             });
         }
 
-        // We want to make sure that we call gnutls_record_send with as large
-        // packets as possible. This is because each call to gnutls_record_send
-        // translates to a sendmsg syscall. Further it results in larger TLS
-        // records which makes encryption/decryption faster. Hence to avoid
-        // cases where we would do an extra syscall for something like a 100
-        // bytes header we linearize the packet if it's below the max TLS record
-        // size.
-        if (p.nr_frags() > 1 && p.len() <= gnutls_record_get_max_size(*this)) {
-            p.linearize();
+        if (_ktls_tx) {
+            // The kernel encrypts, the socket takes plaintext
+            return with_semaphore(_out_sem, 1, [this, p = std::move(p)] () mutable {
+                return _out.put(std::move(p));
+            });
         }
 
+        // We want to make sure that we call gnutls_record_send with as large
+        // records as possible. This is because each call to gnutls_record_send
+        // translates to a sendmsg syscall. Further it results in larger TLS
+        // records which makes encryption/decryption faster. Hence the writes
+        // are coalesced into full records, see coalesce(), the last one
+        // being sent on flush.
         auto i = p.fragments().begin();
         auto e = p.fragments().end();
         return with_semaphore(_out_sem, 1, std::bind(&session::do_put, this, i, e)).finally([p = std::move(p)] {});
     }
 
     ssize_t pull(void* dst, size_t len) {
-        if (eof()) {
+        // close() may set _eof while on an offload thread
+        if (_offloading ? _offloaded_eof : eof()) {
             return 0;
         }
         // If we have data in buffers, we can complete.
@@ -1469,7 +2168,41 @@ class session : public enable_lw_shared_from_this<session> {
         _input.trim_front(n);
         return n;
     }
+    // Only valid with kernel TLS transmit offload enabled, see put()
+    future<> put_file(file f, uint64_t offset, size_t len) {
+        if (_error) {
+            return make_exception_future<>(_error);
+        }
+        if (_shutdown) {
+            return make_exception_future<>(std::system_error(EPIPE, std::system_category()));
+        }
+        return with_semaphore(_out_sem, 1, [this, f = std::move(f), offset, len] () mutable {
+            return _out.put_file(std::move(f), offset, len);
+        });
+    }
+
     ssize_t vec_push(const giovec_t * iov, int iovcnt) {
+        if (_ktls_tx) {
+            // gnutls wants to send a record of its own (e.g. a key update or
+            // renegotiation) and the kernel would encrypt it a second time
+            gnutls_transport_set_errno(*this, EIO);
+            return -1;
+        }
+        if (_offloading) {
+            // On an offload thread, see offloaded_handshake_step()
+            try {
+                ssize_t n = 0;
+                for (int i = 0; i < iovcnt; ++i) {
+                    auto p = reinterpret_cast<const char*>(iov[i].iov_base);
+                    _offloaded_output.insert(_offloaded_output.end(), p, p + iov[i].iov_len);
+                    n += iov[i].iov_len;
+                }
+                return n;
+            } catch (...) {
+                gnutls_transport_set_errno(*this, ENOMEM);
+                return -1;
+            }
+        }
         if (!_output_pending.available()) {
             gnutls_transport_set_errno(*this, EAGAIN);
             return -1;
@@ -1531,6 +2264,14 @@ class session : public enable_lw_shared_from_this<session> {
         if (_error || !_connected) {
             return make_ready_future();
         }
+        if (_ktls_tx) {
+            // The close_notify alert has to be encrypted by the kernel too
+            static constexpr uint8_t alert_record_type = 21;
+            temporary_buffer<char> alert(2);
+            alert.get_write()[0] = char(GNUTLS_AL_WARNING);
+            alert.get_write()[1] = char(GNUTLS_A_CLOSE_NOTIFY);
+            return _sock->send_tls_control_record(alert_record_type, std::move(alert));
+        }
         auto res = gnutls_bye(*this, GNUTLS_SHUT_WR);
         if (res < 0) {
             switch (res) {
@@ -1588,6 +2329,7 @@ class session : public enable_lw_shared_from_this<session> {
     void close() noexcept {
         // only do once.
         if (!std::exchange(_shutdown, true)) {
+            maybe_cache_session();
             auto me = shared_from_this();
             // running in background. try to bye-handshake us nicely, but after 10s we forcefully close.
             engine().run_in_background(with_timeout(timer<>::clock::now() + std::chrono::seconds(10), shutdown()).finally([this] {
@@ -1614,7 +2356,12 @@ class session : public enable_lw_shared_from_this<session> {
     // helper for sink
     future<> flush() noexcept {
         return with_semaphore(_out_sem, 1, [this] {
-            return _out.flush();
+            if (!_coalesced_len) {
+                return _out.flush();
+            }
+            return send_coalesced().then([this] {
+                return _out.flush();
+            });
         });
     }
 
@@ -1669,6 +2416,15 @@ class session : public enable_lw_shared_from_this<session> {
             return session_data(tmp.data, tmp.data + tmp.size);
         });
     }
+    future<std::optional<sstring>> get_selected_alpn_protocol() {
+        return state_checked_access([this] {
+            gnutls_datum_t protocol;
+            if (gnutls_alpn_get_selected_protocol(*this, &protocol) != GNUTLS_E_SUCCESS) {
+                return std::optional<sstring>();
+            }
+            return std::optional<sstring>(sstring(reinterpret_cast<const char*>(protocol.data), protocol.size));
+        });
+    }
     future<std::optional<session_dn>> get_distinguished_name() {
         return state_checked_access([this] {
             return extract_dn_information();
@@ -1797,10 +2553,27 @@ class session : public enable_lw_shared_from_this<session> {
     bool _eof = false;
     bool _shutdown = false;
     bool _connected = false;
+    // Set while gnutls_handshake() runs on an offload thread
+    bool _offloading = false;
+    // eof() as of the offloaded step, which pull() reads instead of _eof
+    bool _offloaded_eof = false;
+    std::vector<char> _offloaded_output;
+    std::optional<promise<int>> _handshake_step;
+    // outgoing records are encrypted by the kernel
+    bool _ktls_tx = false;
     std::exception_ptr _error;
 
     future<> _output_pending;
     buf_type _input;
+    // The plaintext written since the last record was sent, see coalesce()
+    temporary_buffer<char> _coalesced;
+    size_t _coalesced_len = 0;
+    // For record_sizing::DYNAMIC
+    static constexpr size_t dynamic_record_small_size = 1360; // a 1460 byte MSS, less the record and TCP option overheads
+    static constexpr uint64_t dynamic_record_ramp = 1 << 20;
+    static constexpr auto dynamic_record_idle_reset = std::chrono::seconds(1);
+    uint64_t _sent_since_idle = 0;
+    lowres_clock::time_point _last_record_sent;
 
     // modify this to a unique_ptr to handle exceptions in our constructor.
     std::unique_ptr<std::remove_pointer_t<gnutls_session_t>, void(*)(gnutls_session_t)> _session;
@@ -1892,6 +2665,9 @@ class tls_connected_socket_impl : public net::connected_socket_impl, public sess
     future<session_data> get_session_resume_data() {
         return _session->get_session_resume_data();
     }
+    future<std::optional<sstring>> get_selected_alpn_protocol() {
+        return _session->get_selected_alpn_protocol();
+    }
 };
 
 
@@ -1923,6 +2699,12 @@ class tls_connected_socket_impl::sink_impl: public data_sink_impl, public sessio
     future<> put(net::packet p) override {
         return _session->put(std::move(p));
     }
+    future<> put_file(file f, uint64_t offset, size_t len) override {
+        if (_session->ktls_tx()) {
+            return _session->put_file(std::move(f), offset, len);
+        }
+        return data_sink_impl::put_file(std::move(f), offset, len);
+    }
     future<> close() override {
         _session->close();
         return make_ready_future<>();
@@ -2082,6 +2864,10 @@ future<tls::session_data> tls::get_session_resume_data(connected_socket& socket)
     return get_tls_socket(socket)->get_session_resume_data();
 }
 
+future<std::optional<sstring>> tls::get_selected_alpn_protocol(connected_socket& socket) {
+    return get_tls_socket(socket)->get_selected_alpn_protocol();
+}
+
 std::string_view tls::format_as(subject_alt_name_type type) {
     switch (type) {
         case subject_alt_name_type::dnsname:
@@ -28,10 +28,16 @@ module;
 #include <cassert>
 #include <cstring>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <seastar/net/virtio-interface.hh>
 #include <linux/vhost.h>
 #include <linux/if_tun.h>
@@ -53,6 +59,7 @@ module seastar;
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/align.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/smp.hh>
 #include <seastar/util/function_input_iterator.hh>
 #include <seastar/util/transform_iterator.hh>
 #include <seastar/net/ip.hh>
@@ -82,10 +89,165 @@ phys virt_to_phys(void* p) {
 
 #endif
 
+/* The front-end side of the vhost-user protocol, by which a driver hands
+ * the rings of its queues, and the memory they point into, to a back-end
+ * process (a virtual switch) over a unix socket. Like the vhost-net ioctls,
+ * the calls block; they are only made while setting the device and its
+ * queues up, from all the shards, so they are serialized.
+ */
+class vhost_user_frontend {
+public:
+    enum request : uint32_t {
+        get_features = 1,
+        set_features = 2,
+        set_owner = 3,
+        set_mem_table = 5,
+        set_vring_num = 8,
+        set_vring_addr = 9,
+        set_vring_base = 10,
+        set_vring_kick = 12,
+        set_vring_call = 13,
+        get_protocol_features = 15,
+        set_protocol_features = 16,
+        get_queue_num = 17,
+        set_vring_enable = 18,
+    };
+    static constexpr uint64_t f_protocol_features = uint64_t(1) << 30;
+    static constexpr uint64_t protocol_f_mq = uint64_t(1) << 0;
+    // Set in the payload of set_vring_kick and set_vring_call when passing
+    // no eventfd
+    static constexpr uint64_t vring_nofd = uint64_t(1) << 8;
+
+    struct vring_state {
+        uint32_t index;
+        uint32_t num;
+    };
+    struct vring_addr {
+        uint32_t index;
+        uint32_t flags;
+        uint64_t desc_user_addr;
+        uint64_t used_user_addr;
+        uint64_t avail_user_addr;
+        uint64_t log_guest_addr;
+    };
+    struct memory_region {
+        uint64_t guest_phys_addr;
+        uint64_t memory_size;
+        uint64_t userspace_addr;
+        uint64_t mmap_offset;
+    };
+private:
+    struct header {
+        uint32_t request;
+        uint32_t flags;
+        uint32_t size;
+    };
+    static constexpr uint32_t version = 0x1;
+    static constexpr uint32_t reply = 0x4;
+
+    file_desc _fd;
+    std::mutex _mutex;
+
+    void send_locked(uint32_t req, const void* payload, uint32_t size, int fd);
+public:
+    explicit vhost_user_frontend(const std::string& path);
+
+    void send(request req) {
+        std::lock_guard g(_mutex);
+        send_locked(req, nullptr, 0, -1);
+    }
+    template <typename T>
+    void send(request req, const T& payload, int fd = -1) {
+        std::lock_guard g(_mutex);
+        send_locked(req, &payload, sizeof(T), fd);
+    }
+    // Sends one of the get_* requests, and returns what the back-end
+    // replies
+    uint64_t get(request req);
+    void send_mem_table(const memory_region& region, int fd);
+};
+
+vhost_user_frontend::vhost_user_frontend(const std::string& path)
+    : _fd(file_desc::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0))
+{
+    sockaddr_un sun = {};
+    sun.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(sun.sun_path)) {
+        throw std::invalid_argument("vhost-user socket path too long: " + path);
+    }
+    std::copy(path.begin(), path.end(), sun.sun_path);
+    _fd.connect(*reinterpret_cast<sockaddr*>(&sun), sizeof(sun));
+}
+
+void vhost_user_frontend::send_locked(uint32_t req, const void* payload, uint32_t size, int fd) {
+    header h = { req, version, size };
+    iovec iov[2] = {
+        { &h, sizeof(h) },
+        { const_cast<void*>(payload), size },
+    };
+    msghdr mh = {};
+    mh.msg_iov = iov;
+    mh.msg_iovlen = size ? 2 : 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    if (fd != -1) {
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        auto c = CMSG_FIRSTHDR(&mh);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    }
+    auto r = _fd.sendmsg(&mh, MSG_NOSIGNAL);
+    if (!r || *r != sizeof(h) + size) {
+        throw std::runtime_error("vhost-user: short write to the back-end");
+    }
+}
+
+uint64_t vhost_user_frontend::get(request req) {
+    std::lock_guard g(_mutex);
+    send_locked(req, nullptr, 0, -1);
+    struct {
+        header h;
+        uint64_t value;
+    } __attribute__((packed)) msg;
+    auto r = _fd.recv(&msg, sizeof(msg), MSG_WAITALL);
+    if (!r || size_t(*r) != sizeof(msg) || msg.h.request != req || !(msg.h.flags & reply) || msg.h.size != sizeof(uint64_t)) {
+        throw std::runtime_error(fmt::format("vhost-user: bad reply from the back-end to request {}", uint32_t(req)));
+    }
+    return msg.value;
+}
+
+void vhost_user_frontend::send_mem_table(const memory_region& region, int fd) {
+    struct {
+        uint32_t nregions;
+        uint32_t padding;
+        memory_region regions[1];
+    } table = { 1, 0, { region } };
+    std::lock_guard g(_mutex);
+    send_locked(set_mem_table, &table, sizeof(table), fd);
+}
+
+// The frames the rx and tx buffers of a vhost-user queue pair are carved
+// from, each holding a packet and its virtio-net header
+static constexpr uint32_t vhost_user_frame_size = 4096;
+
 class device : public net::device {
 private:
     net::hw_features _hw_features;
     uint64_t _features;
+    // With vhost-user: the control connection, and the memory shared with
+    // the back-end, made of a slice for each queue pair, holding its rings
+    // and frames
+    std::unique_ptr<vhost_user_frontend> _vhost_user;
+    uint64_t _negotiated_features = 0;
+    uint16_t _num_queues = 1;
+    unsigned _ring_size = 0;
+    size_t _queue_bytes = 0;
+    std::optional<file_desc> _shared_fd;
+    mmap_area _shared;
+
+    void setup_vhost_user(const virtio_options& opts);
 
 private:
     uint64_t setup_features(const net::virtio_options& opts, const program_options::value<std::string>& lro) {
@@ -131,7 +293,11 @@ class device : public net::device {
 public:
     device(const virtio_options& opts, const program_options::value<std::string>& lro)
        : _features(setup_features(opts, lro))
-       {}
+    {
+        if (opts.vhost_user_socket) {
+            setup_vhost_user(opts);
+        }
+    }
     ethernet_address hw_address() override {
         return { 0x12, 0x23, 0x34, 0x56, 0x67, 0x78 };
     }
@@ -144,6 +310,24 @@ class device : public net::device {
         return _features;
     }
 
+    uint16_t hw_queues_count() override {
+        return _num_queues;
+    }
+
+    vhost_user_frontend& vhost_user() {
+        return *_vhost_user;
+    }
+    uint64_t negotiated_features() const {
+        return _negotiated_features;
+    }
+    unsigned ring_size() const {
+        return _ring_size;
+    }
+    // The slice of the shared memory of the queue pair
+    char* queue_memory(uint16_t qid) {
+        return _shared.get() + qid * _queue_bytes;
+    }
+
     virtual std::unique_ptr<net::qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
 };
 
@@ -479,21 +663,66 @@ bool vring<BufferChain, Completion>::do_complete() {
     return count;
 }
 
+struct net_hdr {
+    uint8_t needs_csum : 1;
+    uint8_t flags_reserved : 7;
+    enum { gso_none = 0, gso_tcpv4 = 1, gso_udp = 3, gso_tcpv6 = 4, gso_ecn = 0x80 };
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+};
+struct net_hdr_mrg : net_hdr {
+    uint16_t num_buffers;
+};
+
+// The virtio-net header asking the host for the checksum and segmentation
+// offloads p needs
+static net_hdr_mrg tx_net_hdr(const net::hw_features& hw, packet& p) {
+    net_hdr_mrg vhdr = {};
+    // Handle TCP checksum offload
+    auto oi = p.get_offload_info();
+    if (hw.tx_csum_l4_offload) {
+        auto eth_hdr_len = sizeof(eth_hdr);
+        auto ip_hdr_len = oi.ip_hdr_len;
+        auto mtu = hw.mtu;
+        if (oi.protocol == ip_protocol_num::tcp) {
+            auto tcp_hdr_len = oi.tcp_hdr_len;
+            if (oi.needs_csum) {
+                vhdr.needs_csum = 1;
+                vhdr.csum_start = eth_hdr_len + ip_hdr_len;
+                // TCP checksum filed's offset within the TCP header is 16 bytes
+                vhdr.csum_offset = 16;
+            }
+            if (oi.tso_seg_size) {
+                // IPv4 TCP TSO
+                vhdr.gso_type = net_hdr::gso_tcpv4;
+                // Sum of Ethernet, IP and TCP header size
+                vhdr.hdr_len = eth_hdr_len + ip_hdr_len + tcp_hdr_len;
+                // Maximum segment size of packet after the offload
+                vhdr.gso_size = oi.tso_seg_size;
+            }
+        } else if (oi.protocol == ip_protocol_num::udp) {
+            auto udp_hdr_len = oi.udp_hdr_len;
+            if (oi.needs_csum) {
+                vhdr.needs_csum = 1;
+                vhdr.csum_start = eth_hdr_len + ip_hdr_len;
+                // UDP checksum filed's offset within the UDP header is 6 bytes
+                vhdr.csum_offset = 6;
+            }
+            if (hw.tx_ufo && p.len() > mtu + eth_hdr_len) {
+                vhdr.gso_type = net_hdr::gso_udp;
+                vhdr.hdr_len = eth_hdr_len + ip_hdr_len + udp_hdr_len;
+                vhdr.gso_size = mtu - ip_hdr_len - udp_hdr_len;
+            }
+        }
+    }
+    return vhdr;
+}
+
 class qp : public net::qp {
 protected:
-    struct net_hdr {
-        uint8_t needs_csum : 1;
-        uint8_t flags_reserved : 7;
-        enum { gso_none = 0, gso_tcpv4 = 1, gso_udp = 3, gso_tcpv6 = 4, gso_ecn = 0x80 };
-        uint8_t gso_type;
-        uint16_t hdr_len;
-        uint16_t gso_size;
-        uint16_t csum_start;
-        uint16_t csum_offset;
-    };
-    struct net_hdr_mrg : net_hdr {
-        uint16_t num_buffers;
-    };
     class txq {
         static buffer fragment_to_buffer(fragment f) {
             buffer b;
@@ -612,50 +841,13 @@ qp::txq::post(circular_buffer<packet>& pb) {
     _packets.clear();
 
     while (!pb.empty() && pb.front().nr_frags() + 1 <= _ring.available_descriptors().current()) {
-        net_hdr_mrg vhdr = {};
         auto p = std::move(pb.front());
 
         bytes    += p.len();
         nr_frags += p.nr_frags();
 
         pb.pop_front();
-        // Handle TCP checksum offload
-        auto oi = p.get_offload_info();
-        if (_dev._dev->hw_features().tx_csum_l4_offload) {
-            auto eth_hdr_len = sizeof(eth_hdr);
-            auto ip_hdr_len = oi.ip_hdr_len;
-            auto mtu = _dev._dev->hw_features().mtu;
-            if (oi.protocol == ip_protocol_num::tcp) {
-                auto tcp_hdr_len = oi.tcp_hdr_len;
-                if (oi.needs_csum) {
-                    vhdr.needs_csum = 1;
-                    vhdr.csum_start = eth_hdr_len + ip_hdr_len;
-                    // TCP checksum filed's offset within the TCP header is 16 bytes
-                    vhdr.csum_offset = 16;
-                }
-                if (oi.tso_seg_size) {
-                    // IPv4 TCP TSO
-                    vhdr.gso_type = net_hdr::gso_tcpv4;
-                    // Sum of Ethernet, IP and TCP header size
-                    vhdr.hdr_len = eth_hdr_len + ip_hdr_len + tcp_hdr_len;
-                    // Maximum segment size of packet after the offload
-                    vhdr.gso_size = oi.tso_seg_size;
-                }
-            } else if (oi.protocol == ip_protocol_num::udp) {
-                auto udp_hdr_len = oi.udp_hdr_len;
-                if (oi.needs_csum) {
-                    vhdr.needs_csum = 1;
-                    vhdr.csum_start = eth_hdr_len + ip_hdr_len;
-                    // UDP checksum filed's offset within the UDP header is 6 bytes
-                    vhdr.csum_offset = 6;
-                }
-                if (_dev._dev->hw_features().tx_ufo && p.len() > mtu + eth_hdr_len) {
-                    vhdr.gso_type = net_hdr::gso_udp;
-                    vhdr.hdr_len = eth_hdr_len + ip_hdr_len + udp_hdr_len;
-                    vhdr.gso_size = mtu - ip_hdr_len - udp_hdr_len;
-                }
-            }
-        }
+        auto vhdr = tx_net_hdr(_dev._dev->hw_features(), p);
         // prepend virtio-net header
         packet q = packet(fragment{reinterpret_cast<char*>(&vhdr), _dev._header_len},
                 std::move(p));
@@ -776,14 +968,24 @@ qp::qp(device* dev, size_t rx_ring_size, size_t tx_ring_size)
     , _rxq(*this, rxq_config(rx_ring_size)) {
 }
 
-size_t qp::vring_storage_size(size_t ring_size) {
+static size_t ring_storage_size(size_t ring_size) {
     // overestimate, but not by much.
     return 3 * 4096 + ring_size * (16 + 2 + 8);
 }
 
-void qp::common_config(ring_config& r) {
+// Lays the available and used rings out after the r.size descriptors
+// at r.descs
+static void layout_ring(ring_config& r) {
     r.avail = r.descs + 16 * r.size;
     r.used = align_up(r.avail + 2 * r.size + 6, 4096);
+}
+
+size_t qp::vring_storage_size(size_t ring_size) {
+    return ring_storage_size(ring_size);
+}
+
+void qp::common_config(ring_config& r) {
+    layout_ring(r);
     r.event_index = (_dev->features() & VIRTIO_RING_F_EVENT_IDX) != 0;
     r.indirect = false;
 }
@@ -913,6 +1115,269 @@ qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
     _vhost_fd.ioctl(VHOST_NET_SET_BACKEND, vhost_vring_file{1, tap_fd.get()});
 }
 
+void device::setup_vhost_user(const virtio_options& opts) {
+    _vhost_user = std::make_unique<vhost_user_frontend>(opts.vhost_user_socket.get_value());
+    auto& vu = *_vhost_user;
+    vu.send(vhost_user_frontend::set_owner);
+    auto offered = vu.get(vhost_user_frontend::get_features);
+    uint64_t max_queues = 1;
+    if (offered & vhost_user_frontend::f_protocol_features) {
+        auto protocol = vu.get(vhost_user_frontend::get_protocol_features) & vhost_user_frontend::protocol_f_mq;
+        vu.send(vhost_user_frontend::set_protocol_features, protocol);
+        if (protocol & vhost_user_frontend::protocol_f_mq) {
+            max_queues = std::max<uint64_t>(vu.get(vhost_user_frontend::get_queue_num), 1);
+        }
+    }
+    uint64_t wanted = opts.vhost_user_queues.get_value() ? opts.vhost_user_queues.get_value() : smp::count;
+    _num_queues = std::min({wanted, max_queues, uint64_t(smp::count)});
+
+    // Packets are copied in and out of single frames, so segmentation
+    // offloads are out
+    uint64_t ours = _features & (VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MRG_RXBUF
+            | VIRTIO_RING_F_EVENT_IDX | VIRTIO_NET_F_MAC);
+    if (_num_queues > 1) {
+        ours |= VIRTIO_NET_F_MQ;
+    }
+    _negotiated_features = offered & (ours | vhost_user_frontend::f_protocol_features);
+    vu.send(vhost_user_frontend::set_features, _negotiated_features);
+    _hw_features.tx_csum_l4_offload = _negotiated_features & VIRTIO_NET_F_CSUM;
+    _hw_features.rx_csum_offload = _negotiated_features & VIRTIO_NET_F_GUEST_CSUM;
+    _hw_features.tx_tso = false;
+    _hw_features.tx_ufo = false;
+    _hw_features.rx_lro = false;
+
+    _ring_size = config_ring_size(opts);
+    _queue_bytes = 2 * align_up(ring_storage_size(_ring_size), size_t(4096)) + 4 * _ring_size * size_t(vhost_user_frame_size);
+    auto size = _num_queues * _queue_bytes;
+    int fd = ::memfd_create("seastar-vhost-user", MFD_CLOEXEC);
+    throw_system_error_on(fd == -1, "memfd_create");
+    _shared_fd.emplace(file_desc::from_fd(fd));
+    _shared_fd->truncate(size);
+    _shared = _shared_fd->map_shared_rw(size, 0);
+    // Descriptors point into the region by our own addresses
+    auto base = reinterpret_cast<uintptr_t>(_shared.get());
+    vu.send_mem_table(vhost_user_frontend::memory_region{base, size, base, 0}, _shared_fd->get());
+}
+
+/*
+ * A queue pair driven by a vhost-user back-end: rings 2 * qid (rx) and
+ * 2 * qid + 1 (tx), owned by shard qid, in the queue's slice of the memory
+ * shared with the back-end.
+ *
+ * Both sides poll: the back-end is told not to interrupt us, and the
+ * vrings skip the kicks the back-end asks not to get. The rest of the
+ * slice is frames, four per ring entry, like the UMEM of the AF_XDP
+ * backend: received packets are handed to the stack in their frames,
+ * unless fewer than a ring's worth are left free, in which case they are
+ * copied; sent packets are copied into frames.
+ */
+class qp_vhost_user : public net::qp {
+    struct frame_buffer {
+        buffer b;
+        uint32_t frame;
+        buffer* begin() { return &b; }
+        buffer* end() { return &b + 1; }
+    };
+    struct rx_complete {
+        qp_vhost_user& q;
+        void operator()(frame_buffer&& bc, size_t len) {
+            q.complete_rx(bc.frame, len);
+        }
+        void bunch(uint64_t c) {}
+    };
+    struct tx_complete {
+        qp_vhost_user& q;
+        void operator()(frame_buffer&& bc, size_t len) {
+            q._free_frames.push_back(bc.frame);
+            q._tx.available_descriptors().signal(1);
+        }
+        void bunch(uint64_t c) {}
+    };
+    device& _dev;
+    uint16_t _qid;
+    unsigned _ring_size;
+    size_t _header_len;
+    char* _frames;
+    std::vector<uint32_t> _free_frames;
+    vring<frame_buffer, rx_complete> _rx;
+    vring<frame_buffer, tx_complete> _tx;
+    std::vector<frame_buffer> _posting;
+    // The packet being received, over several buffers when they are
+    // mergeable
+    unsigned _remaining_buffers = 0;
+    std::vector<fragment> _fragments;
+    std::vector<uint32_t> _packet_frames;
+    std::optional<reactor::poller> _refill_poller;
+
+    static ring_config make_ring_config(char* storage, unsigned size, uint64_t features, bool mergeable);
+    char* frame_data(uint32_t frame) {
+        return _frames + size_t(frame) * vhost_user_frame_size;
+    }
+    frame_buffer make_frame_buffer(uint32_t frame, uint32_t len, bool writeable) {
+        return frame_buffer{buffer{virt_to_phys(frame_data(frame)), len, writeable}, frame};
+    }
+    template <typename Ring>
+    void setup_ring(uint32_t index, Ring& ring);
+    void complete_rx(uint32_t frame, size_t len);
+    bool refill();
+public:
+    qp_vhost_user(device& dev, uint16_t qid);
+    virtual future<> send(packet p) override {
+        abort();
+    }
+    virtual uint32_t send(circular_buffer<packet>& pb) override;
+    virtual void rx_start() override;
+};
+
+ring_config qp_vhost_user::make_ring_config(char* storage, unsigned size, uint64_t features, bool mergeable) {
+    ring_config r;
+    r.size = size;
+    r.descs = storage;
+    layout_ring(r);
+    r.event_index = (features & VIRTIO_RING_F_EVENT_IDX) != 0;
+    r.indirect = false;
+    r.mergable_buffers = mergeable;
+    return r;
+}
+
+qp_vhost_user::qp_vhost_user(device& dev, uint16_t qid)
+    : net::qp(true, "network", qid)
+    , _dev(dev)
+    , _qid(qid)
+    , _ring_size(dev.ring_size())
+    , _header_len(dev.negotiated_features() & VIRTIO_NET_F_MRG_RXBUF ? sizeof(net_hdr_mrg) : sizeof(net_hdr))
+    , _frames(dev.queue_memory(qid) + 2 * align_up(ring_storage_size(_ring_size), size_t(4096)))
+    , _rx(make_ring_config(dev.queue_memory(qid), _ring_size, dev.negotiated_features(), true), rx_complete{*this})
+    , _tx(make_ring_config(dev.queue_memory(qid) + align_up(ring_storage_size(_ring_size), size_t(4096)), _ring_size,
+            dev.negotiated_features(), false), tx_complete{*this})
+{
+    auto nr_frames = 4 * _ring_size;
+    _free_frames.reserve(nr_frames);
+    for (uint32_t i = nr_frames; i > 0; --i) {
+        _free_frames.push_back(i - 1);
+    }
+    _posting.reserve(_ring_size);
+    setup_ring(2 * qid, _rx);
+    setup_ring(2 * qid + 1, _tx);
+}
+
+template <typename Ring>
+void qp_vhost_user::setup_ring(uint32_t index, Ring& ring) {
+    auto& vu = _dev.vhost_user();
+    auto& config = ring.getconfig();
+    // We poll the used ring
+    reinterpret_cast<std::atomic<uint16_t>*>(config.avail)->store(VRING_AVAIL_F_NO_INTERRUPT, std::memory_order_relaxed);
+    auto tov = [](char* x) { return uint64_t(reinterpret_cast<uintptr_t>(x)); };
+    vu.send(vhost_user_frontend::set_vring_num, vhost_user_frontend::vring_state{index, config.size});
+    vu.send(vhost_user_frontend::set_vring_addr, vhost_user_frontend::vring_addr{
+        index, 0, tov(config.descs), tov(config.used), tov(config.avail), 0
+    });
+    vu.send(vhost_user_frontend::set_vring_base, vhost_user_frontend::vring_state{index, 0});
+    writeable_eventfd kick;
+    vu.send(vhost_user_frontend::set_vring_kick, uint64_t(index), kick.get_read_fd());
+    vu.send(vhost_user_frontend::set_vring_call, uint64_t(index) | vhost_user_frontend::vring_nofd);
+    ring.set_notifier(std::make_unique<notifier_vhost>(std::move(kick)));
+    if (_dev.negotiated_features() & vhost_user_frontend::f_protocol_features) {
+        // Rings start disabled once protocol features are negotiated
+        vu.send(vhost_user_frontend::set_vring_enable, vhost_user_frontend::vring_state{index, 1});
+    }
+}
+
+void qp_vhost_user::rx_start() {
+    _refill_poller = reactor::poller::simple([this] { return refill(); });
+}
+
+bool qp_vhost_user::refill() {
+    auto& available = _rx.available_descriptors();
+    auto n = std::min<size_t>(available.current(), _free_frames.size());
+    if (!n) {
+        return false;
+    }
+    available.consume(n);
+    _posting.clear();
+    for (size_t i = 0; i < n; ++i) {
+        _posting.push_back(make_frame_buffer(_free_frames.back(), vhost_user_frame_size, true));
+        _free_frames.pop_back();
+    }
+    _rx.post(_posting.begin(), _posting.end());
+    return true;
+}
+
+void qp_vhost_user::complete_rx(uint32_t frame, size_t len) {
+    _rx.available_descriptors().signal(1);
+    auto data = frame_data(frame);
+    if (_remaining_buffers == 0) {
+        if (len < _header_len) {
+            _free_frames.push_back(frame);
+            return;
+        }
+        auto hdr = reinterpret_cast<net_hdr_mrg*>(data);
+        _remaining_buffers = _header_len == sizeof(net_hdr_mrg) ? std::max<uint16_t>(hdr->num_buffers, 1) : 1;
+        data += _header_len;
+        len -= _header_len;
+        _fragments.clear();
+        _packet_frames.clear();
+    }
+    _fragments.push_back(fragment{data, len});
+    _packet_frames.push_back(frame);
+    if (--_remaining_buffers) {
+        return;
+    }
+    std::optional<packet> p;
+    if (_free_frames.size() > _ring_size) {
+        p.emplace(_fragments.begin(), _fragments.end(), make_deleter([this, frames = std::move(_packet_frames)] {
+            _free_frames.insert(_free_frames.end(), frames.begin(), frames.end());
+        }));
+        _packet_frames = {};
+    } else {
+        p.emplace();
+        for (auto& f : _fragments) {
+            *p = packet(std::move(*p), f);
+        }
+        _free_frames.insert(_free_frames.end(), _packet_frames.begin(), _packet_frames.end());
+        _stats.rx.good.update_copy_stats(p->nr_frags(), p->len());
+    }
+    _stats.rx.good.update_pkts_bunch(1);
+    _stats.rx.good.update_frags_stats(p->nr_frags(), p->len());
+    _dev.l2receive(std::move(*p));
+}
+
+uint32_t qp_vhost_user::send(circular_buffer<packet>& pb) {
+    auto& available = _tx.available_descriptors();
+    uint32_t sent = 0;
+    uint64_t bytes = 0, nr_frags = 0;
+    _posting.clear();
+    while (!pb.empty() && !_free_frames.empty() && available.try_wait(1)) {
+        auto p = std::move(pb.front());
+        pb.pop_front();
+        ++sent;
+        if (_header_len + p.len() > vhost_user_frame_size) {
+            // Larger than the MTU
+            available.signal(1);
+            continue;
+        }
+        auto frame = _free_frames.back();
+        _free_frames.pop_back();
+        auto vhdr = tx_net_hdr(_dev.hw_features(), p);
+        auto dst = frame_data(frame);
+        std::memcpy(dst, &vhdr, _header_len);
+        dst += _header_len;
+        for (auto&& f : p.fragments()) {
+            std::memcpy(dst, f.base, f.size);
+            dst += f.size;
+        }
+        _posting.push_back(make_frame_buffer(frame, _header_len + p.len(), false));
+        bytes += p.len();
+        nr_frags += p.nr_frags();
+    }
+    if (!_posting.empty()) {
+        _tx.post(_posting.begin(), _posting.end());
+        _stats.tx.good.update_frags_stats(nr_frags, bytes);
+        _stats.tx.good.update_copy_stats(nr_frags, bytes);
+    }
+    return sent;
+}
+
 #ifdef HAVE_OSV
 class qp_osv : public qp {
 private:
@@ -990,6 +1455,9 @@ qp_osv::qp_osv(device *dev, osv::assigned_virtio &virtio,
 #endif
 
 std::unique_ptr<net::qp> device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
+    if (_vhost_user) {
+        return std::make_unique<qp_vhost_user>(*this, qid);
+    }
     static bool called = false;
     assert(!qid);
     assert(!called);
@@ -1025,6 +1493,12 @@ net::virtio_options::virtio_options(program_options::option_group* parent_group)
     , virtio_ring_size(*this, "virtio-ring-size",
                 256,
                 "Virtio ring size (must be power-of-two)")
+    , vhost_user_socket(*this, "vhost-user-socket",
+                std::nullopt,
+                "Unix socket of a vhost-user back-end to connect to, instead of using vhost-net and the tap device")
+    , vhost_user_queues(*this, "vhost-user-queues",
+                0,
+                "Maximum number of vhost-user queue pairs, each driven by its own shard (0 for one per shard)")
 {
 }
 
@@ -0,0 +1,631 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fmt/format.h>
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/if_ether.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/net/xdp.hh>
+#include <seastar/net/const.hh>
+#include <seastar/net/native-stack.hh>
+#include <seastar/net/toeplitz.hh>
+#include <seastar/core/aligned_buffer.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/util/log.hh>
+#endif
+
+namespace seastar {
+
+using namespace net;
+
+namespace xdp {
+
+static logger xdp_log("xdp");
+
+static constexpr uint32_t rx_batch = 64;
+// ETH_RSS_HASH_TOP, which is not part of the kernel's uapi headers
+static constexpr uint8_t rss_hash_toeplitz = 1 << 0;
+
+file_desc bpf(int cmd, bpf_attr& attr, const char* what) {
+    int fd = ::syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+    throw_system_error_on(fd < 0, what);
+    return file_desc::from_fd(fd);
+}
+
+constexpr bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+    return bpf_insn{code, dst, src, off, imm};
+}
+
+/*
+ * The XDP program: redirects the frames of a receive queue to the AF_XDP
+ * socket of the queue in the XSKMAP, or passes them on to the kernel when
+ * the queue has no socket.  With a host address, only IPv4 frames to it and
+ * ARP frames about it are redirected, so that the kernel keeps the rest of
+ * the traffic.
+ */
+std::vector<bpf_insn> make_program(int xsks_map_fd, std::optional<ipv4_address> host_address) {
+    std::vector<bpf_insn> prog;
+    std::vector<size_t> to_pass;
+    auto jump_offset = [&] (size_t from, size_t to) {
+        prog[from].off = int16_t(to - from - 1);
+    };
+
+    if (host_address) {
+        constexpr int32_t arp_len = 28;
+        prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0));
+        prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, data), 0));
+        prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof(xdp_md, data_end), 0));
+        // Frames shorter than an ARP one are left to the kernel
+        prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0));
+        prog.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, eth_hdr_len + arp_len));
+        to_pass.push_back(prog.size());
+        prog.push_back(insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0));
+        prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, offsetof(ethhdr, h_proto), 0));
+        auto to_ipv4 = prog.size();
+        prog.push_back(insn(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_5, 0, 0, htons(ETH_P_IP)));
+        to_pass.push_back(prog.size());
+        prog.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(ETH_P_ARP)));
+        // The ARP target protocol address
+        prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, eth_hdr_len + 24, 0));
+        auto to_check = prog.size();
+        prog.push_back(insn(BPF_JMP | BPF_JA, 0, 0, 0, 0));
+        jump_offset(to_ipv4, prog.size());
+        // The IPv4 destination address
+        prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, eth_hdr_len + 16, 0));
+        jump_offset(to_check, prog.size());
+        to_pass.push_back(prog.size());
+        prog.push_back(insn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, int32_t(htonl(host_address->ip))));
+        prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0));
+    }
+
+    prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, rx_queue_index), 0));
+    prog.push_back(insn(BPF_LD | BPF_IMM | BPF_DW, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xsks_map_fd));
+    prog.push_back(insn(0, 0, 0, 0, 0));
+    // The action when the queue has no socket
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS));
+    prog.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+    prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+    if (host_address) {
+        for (auto from : to_pass) {
+            jump_offset(from, prog.size());
+        }
+        prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS));
+        prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    }
+    return prog;
+}
+
+/*
+ * One of the rings shared with the kernel: the fill and completion rings of
+ * the UMEM, holding frame addresses, or the rx and tx rings of the socket,
+ * holding descriptors.  Each side keeps a cached copy of the other side's
+ * index, and reads the shared one only when the cached one shows the ring as
+ * full (or empty).
+ */
+template <typename Entry>
+class ring {
+    mmap_area _map;
+    uint32_t* _producer;
+    uint32_t* _consumer;
+    uint32_t* _flags;
+    Entry* _entries;
+    uint32_t _size;
+    uint32_t _cached_producer;
+    uint32_t _cached_consumer;
+
+    static uint32_t load_acquire(uint32_t* p) noexcept {
+        return std::atomic_ref<uint32_t>(*p).load(std::memory_order_acquire);
+    }
+    static void store_release(uint32_t* p, uint32_t v) noexcept {
+        std::atomic_ref<uint32_t>(*p).store(v, std::memory_order_release);
+    }
+public:
+    ring(file_desc& fd, const xdp_ring_offset& off, uint32_t size, uint64_t pgoff)
+        : _map(fd.map(off.desc + size * sizeof(Entry), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pgoff))
+        , _producer(reinterpret_cast<uint32_t*>(_map.get() + off.producer))
+        , _consumer(reinterpret_cast<uint32_t*>(_map.get() + off.consumer))
+        , _flags(reinterpret_cast<uint32_t*>(_map.get() + off.flags))
+        , _entries(reinterpret_cast<Entry*>(_map.get() + off.desc))
+        , _size(size)
+        , _cached_producer(load_acquire(_producer))
+        , _cached_consumer(load_acquire(_consumer))
+    {}
+
+    Entry& at(uint32_t idx) noexcept {
+        return _entries[idx & (_size - 1)];
+    }
+
+    bool needs_wakeup() const noexcept {
+        return std::atomic_ref<uint32_t>(*_flags).load(std::memory_order_relaxed) & XDP_RING_NEED_WAKEUP;
+    }
+
+    // Producer side (fill and tx rings)
+
+    // The number of entries that can be produced
+    uint32_t free(uint32_t wanted) noexcept {
+        auto n = _size - (_cached_producer - _cached_consumer);
+        if (n < wanted) {
+            _cached_consumer = load_acquire(_consumer);
+            n = _size - (_cached_producer - _cached_consumer);
+        }
+        return n;
+    }
+    Entry& produce() noexcept {
+        return at(_cached_producer++);
+    }
+    void submit() noexcept {
+        store_release(_producer, _cached_producer);
+    }
+
+    // Consumer side (rx and completion rings)
+
+    // The number of entries that can be consumed
+    uint32_t available() noexcept {
+        auto n = _cached_producer - _cached_consumer;
+        if (!n) {
+            _cached_producer = load_acquire(_producer);
+            n = _cached_producer - _cached_consumer;
+        }
+        return n;
+    }
+    Entry& consume() noexcept {
+        return at(_cached_consumer++);
+    }
+    void release() noexcept {
+        store_release(_consumer, _cached_consumer);
+    }
+};
+
+class device : public net::device {
+    sstring _ifname;
+    unsigned _ifindex;
+    ethernet_address _hw_address;
+    net::hw_features _hw_features;
+    uint16_t _num_queues = 1;
+    std::vector<uint8_t> _rss_key;
+    std::vector<uint32_t> _redir_table;
+    uint32_t _ring_size;
+    uint32_t _frame_size;
+    bool _zero_copy;
+    std::optional<file_desc> _xsks_map;
+    std::optional<file_desc> _prog;
+    std::optional<file_desc> _link;
+
+    void query_device(file_desc& sock);
+    void query_rss(file_desc& sock);
+    void attach_program(std::optional<ipv4_address> host_address);
+public:
+    device(const xdp_options& opts, std::optional<ipv4_address> host_address);
+
+    ethernet_address hw_address() override {
+        return _hw_address;
+    }
+    net::hw_features hw_features() override {
+        return _hw_features;
+    }
+    rss_key_type rss_key() const override {
+        if (_rss_key.empty()) {
+            return default_rsskey_40bytes;
+        }
+        return rss_key_type(_rss_key.data(), _rss_key.size());
+    }
+    uint16_t hw_queues_count() override {
+        return _num_queues;
+    }
+    unsigned hash2qid(uint32_t hash) override {
+        if (_redir_table.empty()) {
+            return hash % _num_queues;
+        }
+        return _redir_table[hash % _redir_table.size()];
+    }
+    std::unique_ptr<net::qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
+
+    unsigned ifindex() const noexcept { return _ifindex; }
+    uint32_t ring_size() const noexcept { return _ring_size; }
+    uint32_t frame_size() const noexcept { return _frame_size; }
+    bool zero_copy() const noexcept { return _zero_copy; }
+    int xsks_map_fd() noexcept { return _xsks_map->get(); }
+};
+
+/*
+ * A queue pair: an AF_XDP socket bound to one of the device's receive
+ * queues, with its UMEM in seastar memory.
+ *
+ * The UMEM holds four frames per ring entry, enough to keep the fill and tx
+ * rings full while received packets are held by the stack.  Received frames
+ * are handed to the stack without being copied, and go back to the free
+ * frames when the packet is destroyed; once fewer than a ring's worth of
+ * frames are left free, received packets are copied instead, so that the
+ * fill ring never runs dry.  Sent packets are copied into frames.
+ */
+class qp : public net::qp {
+    device& _dev;
+    uint16_t _qid;
+    uint32_t _ring_size;
+    uint32_t _frame_size;
+    uint32_t _nr_frames;
+    std::unique_ptr<char[], free_deleter> _umem;
+    file_desc _fd;
+    xdp_mmap_offsets _offsets;
+    ring<uint64_t> _fill;
+    ring<uint64_t> _completion;
+    ring<xdp_desc> _rx;
+    ring<xdp_desc> _tx;
+    std::vector<uint64_t> _free_frames;
+    std::optional<reactor::poller> _rx_poller;
+
+    static xdp_mmap_offsets setup_socket(file_desc& fd, char* umem, uint32_t nr_frames, uint32_t frame_size, uint32_t ring_size);
+    void bind();
+    void refill();
+    void reclaim_completions();
+    void kick_tx();
+    bool poll_rx_once();
+public:
+    qp(device& dev, uint16_t qid);
+    void rx_start() override;
+    future<> send(packet p) override {
+        abort();
+    }
+    uint32_t send(circular_buffer<packet>& pb) override;
+};
+
+xdp_mmap_offsets qp::setup_socket(file_desc& fd, char* umem, uint32_t nr_frames, uint32_t frame_size, uint32_t ring_size) {
+    xdp_umem_reg reg = {};
+    reg.addr = reinterpret_cast<uintptr_t>(umem);
+    reg.len = uint64_t(nr_frames) * frame_size;
+    reg.chunk_size = frame_size;
+    fd.setsockopt(SOL_XDP, XDP_UMEM_REG, reg);
+    fd.setsockopt(SOL_XDP, XDP_UMEM_FILL_RING, ring_size);
+    fd.setsockopt(SOL_XDP, XDP_UMEM_COMPLETION_RING, ring_size);
+    fd.setsockopt(SOL_XDP, XDP_RX_RING, ring_size);
+    fd.setsockopt(SOL_XDP, XDP_TX_RING, ring_size);
+    return fd.getsockopt<xdp_mmap_offsets>(SOL_XDP, XDP_MMAP_OFFSETS);
+}
+
+qp::qp(device& dev, uint16_t qid)
+    : net::qp(true, "network", qid)
+    , _dev(dev)
+    , _qid(qid)
+    , _ring_size(dev.ring_size())
+    , _frame_size(dev.frame_size())
+    , _nr_frames(4 * _ring_size)
+    , _umem(static_cast<char*>(::aligned_alloc(memory::page_size, size_t(_nr_frames) * _frame_size)))
+    , _fd(file_desc::socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0))
+    , _offsets(setup_socket(_fd, _umem.get(), _nr_frames, _frame_size, _ring_size))
+    , _fill(_fd, _offsets.fr, _ring_size, XDP_UMEM_PGOFF_FILL_RING)
+    , _completion(_fd, _offsets.cr, _ring_size, XDP_UMEM_PGOFF_COMPLETION_RING)
+    , _rx(_fd, _offsets.rx, _ring_size, XDP_PGOFF_RX_RING)
+    , _tx(_fd, _offsets.tx, _ring_size, XDP_PGOFF_TX_RING)
+{
+    _free_frames.reserve(_nr_frames);
+    for (uint32_t i = _nr_frames; i > 0; --i) {
+        _free_frames.push_back(uint64_t(i - 1) * _frame_size);
+    }
+    refill();
+    bind();
+
+    uint32_t key = qid;
+    uint32_t value = _fd.get();
+    bpf_attr attr = {};
+    attr.map_fd = _dev.xsks_map_fd();
+    attr.key = reinterpret_cast<uintptr_t>(&key);
+    attr.value = reinterpret_cast<uintptr_t>(&value);
+    attr.flags = BPF_ANY;
+    bpf(BPF_MAP_UPDATE_ELEM, attr, "bpf(BPF_MAP_UPDATE_ELEM)");
+}
+
+void qp::bind() {
+    sockaddr_xdp sxdp = {};
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = _dev.ifindex();
+    sxdp.sxdp_queue_id = _qid;
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | (_dev.zero_copy() ? XDP_ZEROCOPY : XDP_COPY);
+    int r = ::bind(_fd.get(), reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp));
+    if (r == -1 && _dev.zero_copy()) {
+        xdp_log.info("Queue {}: the driver does not support zero-copy AF_XDP, using copy mode", _qid);
+        sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+        r = ::bind(_fd.get(), reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp));
+    }
+    throw_system_error_on(r == -1, "bind AF_XDP socket");
+}
+
+void qp::rx_start() {
+    _rx_poller = reactor::poller::simple([this] { return poll_rx_once(); });
+}
+
+void qp::refill() {
+    auto n = std::min<size_t>(_fill.free(_ring_size), _free_frames.size());
+    for (size_t i = 0; i < n; ++i) {
+        _fill.produce() = _free_frames.back();
+        _free_frames.pop_back();
+    }
+    if (n) {
+        _fill.submit();
+    }
+    if (_fill.needs_wakeup()) {
+        // Lets the driver pick up the new frames
+        ::recvfrom(_fd.get(), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+}
+
+void qp::reclaim_completions() {
+    auto n = _completion.available();
+    if (!n) {
+        return;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        _free_frames.push_back(_completion.consume());
+    }
+    _completion.release();
+}
+
+bool qp::poll_rx_once() {
+    reclaim_completions();
+
+    auto n = std::min(_rx.available(), rx_batch);
+    uint64_t bytes = 0, copied = 0, copied_bytes = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        auto desc = _rx.consume();
+        auto frame = desc.addr & ~uint64_t(_frame_size - 1);
+        fragment frag{_umem.get() + desc.addr, desc.len};
+        bytes += desc.len;
+        std::optional<packet> p;
+        if (_free_frames.size() > _ring_size) {
+            p.emplace(frag, make_deleter([this, frame] {
+                _free_frames.push_back(frame);
+            }));
+        } else {
+            p.emplace(frag);
+            _free_frames.push_back(frame);
+            ++copied;
+            copied_bytes += desc.len;
+        }
+        _dev.l2receive(std::move(*p));
+    }
+    if (n) {
+        _rx.release();
+        _stats.rx.good.update_pkts_bunch(n);
+        _stats.rx.good.update_frags_stats(n, bytes);
+        _stats.rx.good.update_copy_stats(copied, copied_bytes);
+    }
+
+    refill();
+    return n;
+}
+
+void qp::kick_tx() {
+    if (!_tx.needs_wakeup()) {
+        return;
+    }
+    auto r = ::sendto(_fd.get(), nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    // The kernel is busy sending, or out of buffers: the frames stay in the
+    // ring and are sent on the next kick
+    if (r == -1 && errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN) {
+        throw_system_error_on(true, "sendto AF_XDP socket");
+    }
+}
+
+uint32_t qp::send(circular_buffer<packet>& pb) {
+    reclaim_completions();
+
+    auto room = std::min<size_t>({_tx.free(pb.size()), _free_frames.size(), pb.size()});
+    uint32_t sent = 0;
+    uint64_t bytes = 0, nr_frags = 0;
+    while (sent < room) {
+        auto p = std::move(pb.front());
+        pb.pop_front();
+        ++sent;
+        if (p.len() > _frame_size) {
+            // Larger than the MTU the device was configured with
+            continue;
+        }
+        auto frame = _free_frames.back();
+        _free_frames.pop_back();
+        auto dst = _umem.get() + frame;
+        for (auto&& f : p.fragments()) {
+            std::memcpy(dst, f.base, f.size);
+            dst += f.size;
+        }
+        auto& desc = _tx.produce();
+        desc.addr = frame;
+        desc.len = p.len();
+        desc.options = 0;
+        bytes += p.len();
+        nr_frags += p.nr_frags();
+    }
+    if (sent) {
+        _tx.submit();
+        kick_tx();
+        _stats.tx.good.update_frags_stats(nr_frags, bytes);
+        _stats.tx.good.update_copy_stats(nr_frags, bytes);
+    }
+    return sent;
+}
+
+device::device(const xdp_options& opts, std::optional<ipv4_address> host_address)
+    : _ifname(opts.xdp_device.get_value())
+    , _ifindex(if_nametoindex(_ifname.c_str()))
+    , _ring_size(opts.xdp_ring_size.get_value())
+    , _frame_size(opts.xdp_frame_size.get_value())
+    , _zero_copy(!(opts.xdp_zero_copy && opts.xdp_zero_copy.get_value() == "off"))
+{
+    throw_system_error_on(!_ifindex, "if_nametoindex");
+    if (!_ring_size || (_ring_size & (_ring_size - 1))) {
+        throw std::invalid_argument(fmt::format("xdp-ring-size must be a power of two, got {}", _ring_size));
+    }
+    if (_frame_size != 2048 && _frame_size != 4096) {
+        throw std::invalid_argument(fmt::format("xdp-frame-size must be 2048 or 4096, got {}", _frame_size));
+    }
+
+    auto sock = file_desc::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    query_device(sock);
+    if (_num_queues > 1) {
+        query_rss(sock);
+    }
+    if (_num_queues > smp::count) {
+        throw std::runtime_error(fmt::format("{} has {} receive queues, more than the {} shards; "
+                "reduce them with ethtool -L {} combined {}", _ifname, _num_queues, smp::count, _ifname, smp::count));
+    }
+
+    // Older kernels charge BPF maps to the locked memory limit
+    rlimit unlimited = {RLIM_INFINITY, RLIM_INFINITY};
+    ::setrlimit(RLIMIT_MEMLOCK, &unlimited);
+
+    attach_program(host_address);
+    xdp_log.info("Attached to {} with {} queue(s)", _ifname, _num_queues);
+}
+
+void device::query_device(file_desc& sock) {
+    ifreq ifr = {};
+    std::strncpy(ifr.ifr_name, _ifname.c_str(), IFNAMSIZ - 1);
+    sock.ioctl(SIOCGIFHWADDR, ifr);
+    std::copy_n(reinterpret_cast<const uint8_t*>(ifr.ifr_hwaddr.sa_data), ETH_ALEN, _hw_address.mac.begin());
+
+    sock.ioctl(SIOCGIFMTU, ifr);
+    // A received frame has to fit in a UMEM frame, after its headroom
+    _hw_features.mtu = std::min<uint32_t>(ifr.ifr_mtu, _frame_size - XDP_PACKET_HEADROOM - eth_hdr_len);
+
+    ethtool_channels channels = {};
+    channels.cmd = ETHTOOL_GCHANNELS;
+    ifr.ifr_data = reinterpret_cast<char*>(&channels);
+    if (::ioctl(sock.get(), SIOCETHTOOL, &ifr) == 0) {
+        _num_queues = std::max<uint32_t>(channels.combined_count + channels.rx_count, 1);
+    }
+}
+
+void device::query_rss(file_desc& sock) {
+    ifreq ifr = {};
+    std::strncpy(ifr.ifr_name, _ifname.c_str(), IFNAMSIZ - 1);
+    ethtool_rxfh sizes = {};
+    sizes.cmd = ETHTOOL_GRSSH;
+    ifr.ifr_data = reinterpret_cast<char*>(&sizes);
+    if (::ioctl(sock.get(), SIOCETHTOOL, &ifr) == -1) {
+        throw std::system_error(errno, std::system_category(),
+                fmt::format("{} has {} queues, but its RSS configuration can not be read", _ifname, _num_queues));
+    }
+
+    std::vector<uint8_t> buf(sizeof(ethtool_rxfh) + sizes.indir_size * sizeof(uint32_t) + sizes.key_size);
+    auto rxfh = reinterpret_cast<ethtool_rxfh*>(buf.data());
+    *rxfh = sizes;
+    ifr.ifr_data = reinterpret_cast<char*>(rxfh);
+    sock.ioctl(SIOCETHTOOL, ifr);
+    if (!(rxfh->hfunc & rss_hash_toeplitz)) {
+        throw std::runtime_error(fmt::format("{} does not use the Toeplitz RSS hash function; "
+                "set it with ethtool -X {} hfunc toeplitz", _ifname, _ifname));
+    }
+    _redir_table.assign(rxfh->rss_config, rxfh->rss_config + rxfh->indir_size);
+    auto key = reinterpret_cast<const uint8_t*>(rxfh->rss_config + rxfh->indir_size);
+    _rss_key.assign(key, key + rxfh->key_size);
+}
+
+void device::attach_program(std::optional<ipv4_address> host_address) {
+    bpf_attr attr = {};
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = _num_queues;
+    _xsks_map = bpf(BPF_MAP_CREATE, attr, "bpf(BPF_MAP_CREATE)");
+
+    auto prog = make_program(_xsks_map->get(), host_address);
+    std::vector<char> log(64 * 1024);
+    static const char license[] = "Dual BSD/GPL";
+    attr = {};
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = reinterpret_cast<uintptr_t>(prog.data());
+    attr.insn_cnt = prog.size();
+    attr.license = reinterpret_cast<uintptr_t>(license);
+    attr.log_buf = reinterpret_cast<uintptr_t>(log.data());
+    attr.log_size = log.size();
+    attr.log_level = 1;
+    attr.expected_attach_type = BPF_XDP;
+    int fd = ::syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+    if (fd < 0) {
+        throw std::system_error(errno, std::system_category(),
+                fmt::format("Failed to load the XDP program: {}", log.data()));
+    }
+    _prog = file_desc::from_fd(fd);
+
+    // The program stays attached as long as the link is open
+    attr = {};
+    attr.link_create.prog_fd = _prog->get();
+    attr.link_create.target_ifindex = _ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    _link = bpf(BPF_LINK_CREATE, attr, "bpf(BPF_LINK_CREATE)");
+}
+
+std::unique_ptr<net::qp> device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
+    return std::make_unique<qp>(*this, qid);
+}
+
+}
+
+net::xdp_options::xdp_options(program_options::option_group* parent_group)
+    : program_options::option_group(parent_group, "AF_XDP net options")
+    , xdp_device(*this, "xdp-device",
+                std::nullopt,
+                "Network interface to drive with AF_XDP sockets")
+    , xdp_ring_size(*this, "xdp-ring-size",
+                2048,
+                "Size of each AF_XDP ring (must be power-of-two)")
+    , xdp_frame_size(*this, "xdp-frame-size",
+                4096,
+                "Size of a UMEM frame (2048 or 4096)")
+    , xdp_zero_copy(*this, "xdp-zero-copy",
+                "on",
+                "Let the driver receive right into seastar memory, where supported (on / off)")
+{
+}
+
+std::unique_ptr<net::device> create_xdp_net_device(const net::xdp_options& opts, std::optional<net::ipv4_address> host_address) {
+    return std::make_unique<xdp::device>(opts, host_address);
+}
+
+}
@@ -0,0 +1,214 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/rpc/adaptive_compressor.hh>
+#include <seastar/core/metrics.hh>
+#include <boost/algorithm/string.hpp>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <vector>
+
+namespace seastar {
+
+namespace rpc {
+
+static const sstring adaptive_suffix = "_ADAPTIVE";
+
+// A frame is made of a byte, stored or compressed, followed by the frame
+// as it is, or as the wrapped compressor compressed it.
+class adaptive_compressor final : public compressor {
+    static constexpr uint8_t stored = 0;
+    static constexpr uint8_t compressed = 1;
+
+    struct size_class {
+        // The frames to store before compressing one again
+        unsigned skip = 0;
+        unsigned backoff = 0;
+    };
+
+    std::unique_ptr<compressor> _inner;
+    const adaptive_compressor_factory::config& _cfg;
+    adaptive_compressor_factory::stats& _stats;
+    std::array<size_class, 32> _classes;
+
+    snd_buf store(size_t head_space, snd_buf data);
+public:
+    adaptive_compressor(std::unique_ptr<compressor> inner, const adaptive_compressor_factory::config& cfg, adaptive_compressor_factory::stats& stats)
+            : _inner(std::move(inner)), _cfg(cfg), _stats(stats) {}
+    virtual snd_buf compress(size_t head_space, snd_buf data) override;
+    virtual rcv_buf decompress(rcv_buf data) override;
+    virtual sstring name() const override {
+        return _inner->name() + adaptive_suffix;
+    }
+    virtual future<> close() noexcept override {
+        return _inner->close();
+    }
+};
+
+snd_buf adaptive_compressor::store(size_t head_space, snd_buf data) {
+    _stats.stored_frames++;
+    _stats.stored_bytes += data.size;
+    // Put the head space and marker in front, rather than copy the frame
+    temporary_buffer<char> head(head_space + 1);
+    head.get_write()[head_space] = stored;
+    auto size = data.size + head.size();
+    if (auto one = std::get_if<temporary_buffer<char>>(&data.bufs)) {
+        std::vector<temporary_buffer<char>> bufs;
+        bufs.reserve(2);
+        bufs.push_back(std::move(head));
+        bufs.push_back(std::move(*one));
+        return snd_buf(std::move(bufs), size);
+    }
+    auto& bufs = std::get<std::vector<temporary_buffer<char>>>(data.bufs);
+    if (bufs.empty()) {
+        return snd_buf(std::move(head));
+    }
+    bufs.insert(bufs.begin(), std::move(head));
+    return snd_buf(std::move(bufs), size);
+}
+
+snd_buf adaptive_compressor::compress(size_t head_space, snd_buf data) {
+    // Empty frames carry messages between the wrapped compressors
+    if (data.size && data.size < _cfg.min_size) {
+        return store(head_space, std::move(data));
+    }
+    auto& c = _classes[std::bit_width(data.size) % _classes.size()];
+    if (c.skip) {
+        c.skip--;
+        return store(head_space, std::move(data));
+    }
+    auto in = data.size;
+    if (!in) {
+        data = snd_buf(temporary_buffer<char>());
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto out = _inner->compress(head_space + 1, std::move(data));
+    _stats.compress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    out.front().get_write()[head_space] = compressed;
+    if (!in) {
+        return out;
+    }
+    auto compressed_size = out.size - head_space - 1;
+    _stats.compressed_frames++;
+    _stats.compressed_bytes_in += in;
+    _stats.compressed_bytes_out += compressed_size;
+    if (compressed_size > in * _cfg.max_ratio) {
+        c.backoff = std::min(std::max(2 * c.backoff, 1u), _cfg.max_backoff);
+        c.skip = c.backoff;
+    } else {
+        c.backoff = 0;
+    }
+    return out;
+}
+
+rcv_buf adaptive_compressor::decompress(rcv_buf data) {
+    if (!data.size) {
+        throw std::runtime_error("RPC frame adaptive decompression failure: empty frame");
+    }
+    uint8_t marker;
+    if (auto one = std::get_if<temporary_buffer<char>>(&data.bufs)) {
+        marker = (*one)[0];
+        one->trim_front(1);
+    } else {
+        auto& bufs = std::get<std::vector<temporary_buffer<char>>>(data.bufs);
+        auto i = std::find_if(bufs.begin(), bufs.end(), [] (const temporary_buffer<char>& b) { return !b.empty(); });
+        marker = (*i)[0];
+        i->trim_front(1);
+        if (i->empty()) {
+            ++i;
+        }
+        bufs.erase(bufs.begin(), i);
+    }
+    data.size -= 1;
+    if (marker == stored) {
+        return data;
+    }
+    if (marker != compressed) {
+        throw std::runtime_error(format("RPC frame adaptive decompression failure: unknown marker {}", marker));
+    }
+    return _inner->decompress(std::move(data));
+}
+
+adaptive_compressor_factory::adaptive_compressor_factory(const compressor::factory& inner, config cfg)
+        : _inner(inner)
+        , _cfg(std::move(cfg)) {
+    std::vector<sstring> names;
+    boost::split(names, _inner.supported(), boost::is_any_of(","));
+    for (auto& n : names) {
+        n += adaptive_suffix;
+    }
+    _features = boost::algorithm::join(names, sstring(","));
+
+    if (!_cfg.metrics_domain.empty()) {
+        namespace sm = seastar::metrics;
+        auto domain_l = sm::label("domain")(_cfg.metrics_domain);
+        _metrics.add_group("rpc_compression", {
+            sm::make_counter("compressed_frames", _stats.compressed_frames,
+                    sm::description("Total number of frames compressed"), { domain_l }),
+            sm::make_counter("stored_frames", _stats.stored_frames,
+                    sm::description("Total number of frames sent uncompressed, too small or compressing poorly"), { domain_l }),
+            sm::make_counter("compressed_bytes_in", _stats.compressed_bytes_in,
+                    sm::description("Total size of the frames compressed"), { domain_l }),
+            sm::make_counter("compressed_bytes_out", _stats.compressed_bytes_out,
+                    sm::description("Total size the frames were compressed to"), { domain_l }),
+            sm::make_gauge("saved_bytes", [this] { return int64_t(_stats.compressed_bytes_in) - int64_t(_stats.compressed_bytes_out); },
+                    sm::description("Total number of bytes saved by compression, negative if it cost more"), { domain_l }),
+            sm::make_counter("stored_bytes", _stats.stored_bytes,
+                    sm::description("Total size of the frames sent uncompressed"), { domain_l }),
+            sm::make_counter("compress_time_us", [this] { return _stats.compress_ns / 1000; },
+                    sm::description("Total time spent compressing frames, in microseconds"), { domain_l }),
+        });
+    }
+}
+
+const sstring& adaptive_compressor_factory::supported() const {
+    return _features;
+}
+
+std::unique_ptr<compressor> adaptive_compressor_factory::negotiate(sstring feature, bool is_server) const {
+    return negotiate(std::move(feature), is_server, nullptr);
+}
+
+std::unique_ptr<compressor> adaptive_compressor_factory::negotiate(sstring feature, bool is_server, std::function<future<>()> send_empty_frame) const {
+    // Only the adaptive algorithms, without the suffix, for the wrapped
+    // factory to pick from
+    std::vector<sstring> names;
+    boost::split(names, feature, boost::is_any_of(","));
+    std::vector<sstring> inner;
+    for (auto& n : names) {
+        if (n.size() > adaptive_suffix.size() && n.ends_with(adaptive_suffix)) {
+            inner.push_back(n.substr(0, n.size() - adaptive_suffix.size()));
+        }
+    }
+    if (inner.empty()) {
+        return nullptr;
+    }
+    auto c = _inner.negotiate(boost::algorithm::join(inner, sstring(",")), is_server, std::move(send_empty_frame));
+    if (!c) {
+        return nullptr;
+    }
+    return std::make_unique<adaptive_compressor>(std::move(c), _cfg, _stats);
+}
+
+}
+
+}
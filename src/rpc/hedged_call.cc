@@ -0,0 +1,58 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <seastar/rpc/hedged_call.hh>
+
+namespace seastar {
+
+namespace rpc {
+
+peer_latency::peer_latency(double percentile, clock_type::duration initial_delay)
+        : _percentile(std::clamp(percentile, 0.0, 1.0))
+        , _delay(initial_delay) {
+}
+
+void peer_latency::record(clock_type::duration latency) noexcept {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    _samples[_next] = std::clamp<int64_t>(us, 0, std::numeric_limits<uint32_t>::max());
+    _next = (_next + 1) % window;
+    _count = std::min(_count + 1, window);
+    // Sorting the window for every call would cost more than the call,
+    // recompute only every few of them once it is full
+    if (++_stale >= window / 16 || _count < window) {
+        update();
+    }
+}
+
+void peer_latency::update() noexcept {
+    std::array<uint32_t, window> sorted;
+    std::copy_n(_samples.begin(), _count, sorted.begin());
+    auto nth = sorted.begin() + std::min<size_t>(_percentile * _count, _count - 1);
+    std::nth_element(sorted.begin(), nth, sorted.begin() + _count);
+    _delay = std::chrono::microseconds(*nth);
+    _stale = 0;
+}
+
+}
+
+}
@@ -23,6 +23,8 @@
 #include <seastar/core/byteorder.hh>
 #include <lz4.h>
 
+#include "rpc/reusable_buffer.hh"
+
 namespace seastar {
 
 namespace rpc {
@@ -40,80 +42,6 @@ std::unique_ptr<rpc::compressor> lz4_compressor::factory::negotiate(sstring feat
     return feature == supported() ? std::make_unique<lz4_compressor>() : nullptr;
 }
 
-// Reusable contiguous buffers needed for LZ4 compression and decompression functions.
-class reusable_buffer {
-    static constexpr size_t chunk_size = 128 * 1024;
-    static_assert(snd_buf::chunk_size == chunk_size, "snd_buf::chunk_size == chunk_size");
-
-    std::unique_ptr<char[]> _data;
-    size_t _size;
-private:
-    void reserve(size_t n) {
-        if (_size < n) {
-            _data.reset();
-            // Not using std::make_unique to avoid value-initialisation.
-            _data = std::unique_ptr<char[]>(new char[n]);
-            _size = n;
-        }
-    }
-public:
-    // Returns a pointer to a contiguous buffer containing all data stored in input.
-    // The pointer remains valid until next call to this.
-    const char* prepare(const std::variant<std::vector<temporary_buffer<char>>, temporary_buffer<char>>& input, size_t size) {
-        if (const auto single = std::get_if<temporary_buffer<char>>(&input)) {
-            return single->get();
-        }
-        reserve(size);
-        auto dst = _data.get();
-        for (const auto& fragment : std::get<std::vector<temporary_buffer<char>>>(input)) {
-            dst = std::copy_n(fragment.begin(), fragment.size(), dst);
-        }
-        return _data.get();
-    }
-
-    // Calls function fn passing to it a pointer to a temporary contigiuous max_size
-    // buffer.
-    // fn is supposed to return the actual size of the data.
-    // with_reserved() returns an Output object (snd_buf or rcv_buf or compatible),
-    // containing data that was written to the temporary buffer.
-    // Output should be either snd_buf or rcv_buf.
-    template<typename Output, typename Function>
-    requires requires (Function fn, char* ptr) {
-        { fn(ptr) } -> std::convertible_to<size_t>;
-    } && (std::is_same_v<Output, snd_buf> || std::is_same_v<Output, rcv_buf>)
-    Output with_reserved(size_t max_size, Function&& fn) {
-        if (max_size <= chunk_size) {
-            auto dst = temporary_buffer<char>(max_size);
-            size_t dst_size = fn(dst.get_write());
-            dst.trim(dst_size);
-            return Output(std::move(dst));
-        }
-
-        reserve(max_size);
-        size_t dst_size = fn(_data.get());
-        if (dst_size <= chunk_size) {
-            return Output(temporary_buffer<char>(_data.get(), dst_size));
-        }
-
-        auto left = dst_size;
-        auto pos = _data.get();
-        std::vector<temporary_buffer<char>> buffers;
-        while (left) {
-            auto this_size = std::min(left, chunk_size);
-            buffers.emplace_back(this_size);
-            std::copy_n(pos, this_size, buffers.back().get_write());
-            pos += this_size;
-            left -= this_size;
-        }
-        return Output(std::move(buffers), dst_size);
-    }
-
-    void clear() noexcept {
-        _data.reset();
-        _size = 0;
-    }
-};
-
 static thread_local reusable_buffer reusable_buffer_compressed_data;
 static thread_local reusable_buffer reusable_buffer_decompressed_data;
 static thread_local size_t buffer_use_count = 0;
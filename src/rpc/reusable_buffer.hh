@@ -0,0 +1,112 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2016 Scylladb, Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/rpc/rpc_types.hh>
+
+#include <algorithm>
+#include <memory>
+#include <variant>
+#include <vector>
+
+namespace seastar {
+
+namespace rpc {
+
+// Reusable contiguous buffers needed for the LZ4 and zstd compression and decompression functions.
+class reusable_buffer {
+    static constexpr size_t chunk_size = 128 * 1024;
+    static_assert(snd_buf::chunk_size == chunk_size, "snd_buf::chunk_size == chunk_size");
+
+    std::unique_ptr<char[]> _data;
+    size_t _size;
+private:
+    void reserve(size_t n) {
+        if (_size < n) {
+            _data.reset();
+            // Not using std::make_unique to avoid value-initialisation.
+            _data = std::unique_ptr<char[]>(new char[n]);
+            _size = n;
+        }
+    }
+public:
+    // Returns a pointer to a contiguous buffer containing all data stored in input.
+    // The pointer remains valid until next call to this.
+    const char* prepare(const std::variant<std::vector<temporary_buffer<char>>, temporary_buffer<char>>& input, size_t size) {
+        if (const auto single = std::get_if<temporary_buffer<char>>(&input)) {
+            return single->get();
+        }
+        reserve(size);
+        auto dst = _data.get();
+        for (const auto& fragment : std::get<std::vector<temporary_buffer<char>>>(input)) {
+            dst = std::copy_n(fragment.begin(), fragment.size(), dst);
+        }
+        return _data.get();
+    }
+
+    // Calls function fn passing to it a pointer to a temporary contigiuous max_size
+    // buffer.
+    // fn is supposed to return the actual size of the data.
+    // with_reserved() returns an Output object (snd_buf or rcv_buf or compatible),
+    // containing data that was written to the temporary buffer.
+    // Output should be either snd_buf or rcv_buf.
+    template<typename Output, typename Function>
+    requires requires (Function fn, char* ptr) {
+        { fn(ptr) } -> std::convertible_to<size_t>;
+    } && (std::is_same_v<Output, snd_buf> || std::is_same_v<Output, rcv_buf>)
+    Output with_reserved(size_t max_size, Function&& fn) {
+        if (max_size <= chunk_size) {
+            auto dst = temporary_buffer<char>(max_size);
+            size_t dst_size = fn(dst.get_write());
+            dst.trim(dst_size);
+            return Output(std::move(dst));
+        }
+
+        reserve(max_size);
+        size_t dst_size = fn(_data.get());
+        if (dst_size <= chunk_size) {
+            return Output(temporary_buffer<char>(_data.get(), dst_size));
+        }
+
+        auto left = dst_size;
+        auto pos = _data.get();
+        std::vector<temporary_buffer<char>> buffers;
+        while (left) {
+            auto this_size = std::min(left, chunk_size);
+            buffers.emplace_back(this_size);
+            std::copy_n(pos, this_size, buffers.back().get_write());
+            pos += this_size;
+            left -= this_size;
+        }
+        return Output(std::move(buffers), dst_size);
+    }
+
+    void clear() noexcept {
+        _data.reset();
+        _size = 0;
+    }
+};
+
+}
+
+}
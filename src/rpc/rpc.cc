@@ -57,6 +57,44 @@ namespace rpc {
   snd_buf::snd_buf(snd_buf&&) noexcept = default;
   snd_buf& snd_buf::operator=(snd_buf&&) noexcept = default;
 
+  template <typename Buf>
+  static void share_fragments(Buf& buf, const fragmented_buffer& b) {
+      if (b.fragment_count() > 1) {
+          buf.bufs = b.share_fragments();
+      } else {
+          buf.bufs = b.linearize();
+      }
+  }
+
+  snd_buf::snd_buf(const fragmented_buffer& b) : size(b.size()) {
+      share_fragments(*this, b);
+  }
+
+  rcv_buf::rcv_buf(const fragmented_buffer& b) : size(b.size()) {
+      share_fragments(*this, b);
+  }
+
+  template <typename Buf>
+  static fragmented_buffer to_fragmented_buffer(Buf buf) {
+      fragmented_buffer ret;
+      if (auto one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+          ret = fragmented_buffer(std::move(*one));
+      } else {
+          ret = fragmented_buffer(std::move(std::get<std::vector<temporary_buffer<char>>>(buf.bufs)));
+      }
+      // The fragments may be longer than the frame
+      ret.trim(std::min<size_t>(ret.size(), buf.size));
+      return ret;
+  }
+
+  fragmented_buffer make_fragmented_buffer(rcv_buf buf) {
+      return to_fragmented_buffer(std::move(buf));
+  }
+
+  fragmented_buffer make_fragmented_buffer(snd_buf buf) {
+      return to_fragmented_buffer(std::move(buf));
+  }
+
   temporary_buffer<char>& snd_buf::front() {
       auto* one = std::get_if<temporary_buffer<char>>(&bufs);
       if (one) {
@@ -96,14 +134,8 @@ namespace rpc {
   template rcv_buf make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<rcv_buf>>);
 
   static void log_exception(connection& c, log_level level, const char* log, std::exception_ptr eptr) {
-      const char* s;
-      try {
-          std::rethrow_exception(eptr);
-      } catch (std::exception& ex) {
-          s = ex.what();
-      } catch (...) {
-          s = "unknown exception";
-      }
+      auto ex = try_catch<std::exception>(eptr);
+      const char* s = ex ? ex->what() : "unknown exception";
       auto formatted = format("{}: {}", log, s);
       c.get_logger()(c.peer_address(), level, std::string_view(formatted.data(), formatted.size()));
   }
@@ -134,8 +166,25 @@ namespace rpc {
 
   future<> connection::send_entry(outgoing_entry& d) noexcept {
     return futurize_invoke([this, &d] {
-      if (d.buf.size && _propagate_timeout) {
+      if (!d.buf.size) {
+          // Flushes what the entries before it wrote, see enqueue_flush()
+          if (!std::exchange(_unflushed, false)) {
+              return make_ready_future<>();
+          }
+          return _write_buf.flush();
+      }
+      if (_propagate_timeout) {
           static_assert(snd_buf::chunk_size >= sizeof(uint64_t), "send buffer chunk size is too small");
+          if (_tracing_reserved && !_tracing_negotiated) {
+              // The span context follows the header, see request_frame:
+              // move the header over it, and take it out of the length
+              constexpr auto size = tracing::span_context::serialized_size;
+              auto p = d.buf.front().get_write();
+              write_le<uint32_t>(p + 24, read_le<uint32_t>(p + 24) - size);
+              std::memmove(p + size, p, request_frame_headroom);
+              d.buf.front().trim_front(size);
+              d.buf.size -= size;
+          }
           if (_timeout_negotiated) {
               auto expire = d.t.get_timeout();
               uint64_t left = 0;
@@ -151,11 +200,45 @@ namespace rpc {
       auto buf = compress(std::move(d.buf));
       return send_buffer(std::move(buf)).then([this] {
           _stats.sent_messages++;
-          return _write_buf.flush();
+          return flush_or_delay();
       });
     });
   }
 
+  future<> connection::flush_or_delay() {
+      // The output stream batches the flushes of a poll period: the frames
+      // sent back to back already go out together
+      if (!_batches && _coalescing_window == std::chrono::microseconds(0)) {
+          return _write_buf.flush();
+      }
+      _unflushed = true;
+      if (!_batches && !_flush_timer.armed()) {
+          _flush_timer.arm(_coalescing_window);
+      }
+      return make_ready_future<>();
+  }
+
+  void connection::enqueue_flush() {
+      if (_error || !_unflushed) {
+          return;
+      }
+      // Queued, not to flush in the middle of a frame being written. A
+      // failing flush aborts the connection, the entry never fails.
+      // FIXME: future is discarded
+      (void)send(snd_buf()).handle_exception([] (std::exception_ptr) {});
+  }
+
+  void connection::end_batch() noexcept {
+      if (!--_batches) {
+          try {
+              enqueue_flush();
+          } catch (...) {
+              log_exception(*this, log_level::error, "fail to flush a batch", std::current_exception());
+              abort();
+          }
+      }
+  }
+
   void connection::set_negotiated() noexcept {
       _negotiated->set_value();
       _negotiated = std::nullopt;
@@ -163,11 +246,27 @@ namespace rpc {
 
   future<> connection::stop_send_loop(std::exception_ptr ex) {
       _error = true;
+      _flush_timer.cancel();
       if (_connected) {
           _fd.shutdown_output();
       }
       if (ex == nullptr) {
-          ex = std::make_exception_ptr(closed_error());
+          ex = cached_exception_ptr<closed_error>();
+      }
+      while (!_stream_pending.empty()) {
+          _stream_pending.front().done.set_exception(ex);
+          _stream_pending.pop_front();
+      }
+      if (_send_classes) {
+          for (auto& c : *_send_classes) {
+              while (!c.queue.empty()) {
+                  auto& e = c.queue.front();
+                  e.uncancellable();
+                  e.unlink();
+                  _outgoing_queue_size--;
+                  e.done.set_exception(ex);
+              }
+          }
       }
       while (!_outgoing_queue.empty()) {
           auto it = std::prev(_outgoing_queue.end());
@@ -259,11 +358,114 @@ namespace rpc {
       }
   }
 
+  void connection::enable_fair_send_queue() {
+      _send_classes = std::make_unique<std::array<send_class, max_scheduling_groups()>>();
+  }
+
+  // Picks the frame of the class that would be entitled to send it first,
+  // were all the queued classes accruing credit in proportion of their
+  // shares, ties going round robin; all of them accrue the credit it took.
+  connection::outgoing_entry* connection::pick_fair() noexcept {
+      auto& classes = *_send_classes;
+      unsigned best = classes.size();
+      double best_wait = std::numeric_limits<double>::infinity();
+      for (unsigned k = 0; k < classes.size(); ++k) {
+          auto i = (_send_turn + k) % classes.size();
+          auto& c = classes[i];
+          if (c.queue.empty()) {
+              c.credit = 0;
+              continue;
+          }
+          auto wait = std::max(0.0, (c.queue.front().buf.size - c.credit) / std::max(c.sg.get_shares(), 1.0f));
+          if (wait < best_wait) {
+              best = i;
+              best_wait = wait;
+          }
+      }
+      if (best == classes.size()) {
+          return nullptr;
+      }
+      if (best_wait > 0) {
+          for (auto& c : classes) {
+              if (!c.queue.empty()) {
+                  c.credit += best_wait * std::max(c.sg.get_shares(), 1.0f);
+              }
+          }
+      }
+      _send_turn = best;
+      auto& c = classes[best];
+      auto& e = c.queue.front();
+      c.credit -= e.buf.size;
+      e.unlink();
+      return &e;
+  }
+
+  future<> connection::send_fair(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
+      auto p = std::make_unique<outgoing_entry>(std::move(buf));
+      auto& d = *p;
+      auto sg = current_scheduling_group();
+      auto& c = (*_send_classes)[internal::scheduling_group_index(sg)];
+      c.sg = sg;
+      c.queue.push_back(d);
+      _outgoing_queue_size++;
+      // Queued frames are withdrawn, those picked already sent
+      auto deleter = [this, &d] {
+          if (d.is_linked()) {
+              d.uncancellable();
+              d.unlink();
+              _outgoing_queue_size--;
+              d.done.set_value();
+          }
+      };
+      if (timeout) {
+          d.t.set_callback(deleter);
+          d.t.arm(timeout.value());
+      }
+      if (cancel) {
+          cancel->cancel_send = std::move(deleter);
+          cancel->send_back_pointer = &d.pcancel;
+          d.pcancel = cancel;
+      }
+      auto ret = d.done.get_future().finally([p = std::move(p)] {});
+
+      // The slot sends whichever frame is picked when its turn comes, the
+      // one of a frame withdrawn meanwhile nothing
+      auto slot = std::make_unique<outgoing_entry>(snd_buf());
+      _outgoing_queue.push_back(*slot);
+      // FIXME: future is discarded
+      (void)std::exchange(_outgoing_queue_ready, slot->done.get_future()).then([this, slot = std::move(slot)] () mutable {
+          if (__builtin_expect(!slot->is_linked(), false)) {
+              return make_ready_future<>();
+          }
+          auto e = pick_fair();
+          if (!e) {
+              slot->done.set_value();
+              return make_ready_future<>();
+          }
+          _outgoing_queue_size--;
+          e->uncancellable();
+          return send_entry(*e).then_wrapped([this, slot = std::move(slot), e] (auto f) mutable {
+              if (f.failed()) {
+                  f.ignore_ready_future();
+                  abort();
+              }
+              e->done.set_value();
+              slot->done.set_value();
+          });
+      }).handle_exception([] (std::exception_ptr) {
+          // The connection is stopping, and failed the frames queued
+      });
+      return ret;
+  }
+
   future<> connection::send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
       if (!_error) {
           if (timeout && *timeout <= rpc_clock_type::now()) {
               return make_ready_future<>();
           }
+          if (_send_classes) {
+              return send_fair(std::move(buf), timeout, cancel);
+          }
 
           auto p = std::make_unique<outgoing_entry>(std::move(buf));
           auto& d = *p;
@@ -309,7 +511,7 @@ namespace rpc {
               });
           });
       } else {
-          return make_exception_future<>(closed_error());
+          return make_exception_future<>(cached_exception_ptr<closed_error>());
       }
   }
 
@@ -346,7 +548,7 @@ namespace rpc {
   receive_negotiation_frame(Connection& c, input_stream<char>& in) {
       return in.read_exactly(sizeof(negotiation_frame)).then([&c, &in] (temporary_buffer<char> neg) {
           if (!verify_frame(c, neg, sizeof(negotiation_frame), "unexpected eof during negotiation frame")) {
-              return make_exception_future<feature_map>(closed_error());
+              return make_exception_future<feature_map>(cached_exception_ptr<closed_error>());
           }
           negotiation_frame frame;
           std::copy_n(neg.get_write(), sizeof(frame.magic), frame.magic);
@@ -354,13 +556,13 @@ namespace rpc {
           if (std::memcmp(frame.magic, rpc_magic, sizeof(frame.magic)) != 0) {
               c.get_logger()(c.peer_address(), format("wrong protocol magic: {:02x}{:02x}{:02x}{:02x}{:02x}{:02x}{:02x}{:02x}",
                     frame.magic[0], frame.magic[1], frame.magic[2], frame.magic[3], frame.magic[4], frame.magic[5], frame.magic[6], frame.magic[7]));
-              return make_exception_future<feature_map>(closed_error());
+              return make_exception_future<feature_map>(cached_exception_ptr<closed_error>());
           }
           auto len = frame.len;
           return in.read_exactly(len).then([&c, len] (temporary_buffer<char> extra) {
               if (extra.size() != len) {
                   c.get_logger()(c.peer_address(), "unexpected eof during negotiation frame");
-                  return make_exception_future<feature_map>(closed_error());
+                  return make_exception_future<feature_map>(cached_exception_ptr<closed_error>());
               }
               feature_map map;
               auto p = extra.get();
@@ -368,14 +570,14 @@ namespace rpc {
               while (p != end) {
                   if (end - p < 8) {
                       c.get_logger()(c.peer_address(), "bad feature data format in negotiation frame");
-                      return make_exception_future<feature_map>(closed_error());
+                      return make_exception_future<feature_map>(cached_exception_ptr<closed_error>());
                   }
                   auto feature = static_cast<protocol_features>(read_le<uint32_t>(p));
                   auto f_len = read_le<uint32_t>(p + 4);
                   p += 8;
                   if (f_len > end - p) {
                       c.get_logger()(c.peer_address(), "buffer underflow in feature data in negotiation frame");
-                      return make_exception_future<feature_map>(closed_error());
+                      return make_exception_future<feature_map>(cached_exception_ptr<closed_error>());
                   }
                   auto data = sstring(p, f_len);
                   p += f_len;
@@ -493,11 +695,16 @@ namespace rpc {
       }
   }
 
+  // A frame of that length carries the credit granted to the sink of the
+  // other end, on 4 bytes, see protocol_features::STREAM_FLOW_CONTROL
+  static constexpr uint32_t stream_credit_marker = -2U;
+
   struct stream_frame {
       using opt_buf_type = std::optional<rcv_buf>;
       using return_type = opt_buf_type;
       struct header_type {
           bool eos;
+          bool credit;
       };
       static size_t header_size() {
           return 4;
@@ -510,12 +717,23 @@ namespace rpc {
       }
       static std::pair<uint32_t, header_type> decode_header(const char* ptr) {
           auto size = read_le<uint32_t>(ptr);
-          return size != -1U ? std::make_pair(size, header_type{false}) : std::make_pair(0U, header_type{true});
+          if (size == stream_credit_marker) {
+              return std::make_pair(4U, header_type{false, true});
+          }
+          return size != -1U ? std::make_pair(size, header_type{false, false}) : std::make_pair(0U, header_type{true, false});
       }
       static auto make_value(const header_type& t, rcv_buf data) {
           if (t.eos) {
               data.size = -1U;
           }
+          if (t.credit) {
+              // Linearized, and marked like the end of stream is
+              auto in = make_deserializer_stream(data);
+              temporary_buffer<char> credit(4);
+              in.read(credit.get_write(), 4);
+              data = rcv_buf(std::move(credit));
+              data.size = stream_credit_marker;
+          }
           return data;
       }
   };
@@ -547,22 +765,82 @@ namespace rpc {
       });
   }
 
+  // Splits a frame of batched stream elements, each its size, on 4 bytes,
+  // followed by its data, into the elements, sharing the frame's buffers
+  static std::vector<rcv_buf> split_stream_batch(rcv_buf frame) {
+      std::vector<temporary_buffer<char>> frags;
+      if (auto one = std::get_if<temporary_buffer<char>>(&frame.bufs)) {
+          frags.push_back(std::move(*one));
+      } else {
+          frags = std::move(std::get<std::vector<temporary_buffer<char>>>(frame.bufs));
+      }
+      auto i = frags.begin();
+      auto left = frame.size;
+      auto take = [&] (uint32_t size) {
+          if (size > left) {
+              throw std::runtime_error("truncated RPC stream batch");
+          }
+          left -= size;
+          std::vector<temporary_buffer<char>> bufs;
+          for (auto n = size; n;) {
+              while (i->empty()) {
+                  ++i;
+              }
+              auto len = std::min<size_t>(n, i->size());
+              bufs.push_back(i->share(0, len));
+              i->trim_front(len);
+              n -= len;
+          }
+          if (bufs.size() == 1) {
+              return rcv_buf(std::move(bufs.front()));
+          }
+          return rcv_buf(std::move(bufs), size);
+      };
+      std::vector<rcv_buf> elements;
+      while (left) {
+          auto header = take(4);
+          auto in = make_deserializer_stream(header);
+          char size[4];
+          in.read(size, 4);
+          elements.push_back(take(read_le<uint32_t>(size)));
+      }
+      return elements;
+  }
+
   future<> connection::handle_stream_frame() {
       return read_stream_frame_compressed(_read_buf).then([this] (std::optional<rcv_buf> data) {
           if (!data) {
               _error = true;
               return make_ready_future<>();
           }
-          return stream_process_incoming(std::move(*data));
+          if (data->size == stream_credit_marker) {
+              _stream_credit += read_le<uint32_t>(std::get<temporary_buffer<char>>(data->bufs).get());
+              send_pending_stream_frames();
+              return make_ready_future<>();
+          }
+          if (!_stream_batch_size || data->size == -1U) {
+              return stream_process_incoming(std::move(*data));
+          }
+          return do_with(split_stream_batch(std::move(*data)), [this] (std::vector<rcv_buf>& elements) {
+              return do_for_each(elements, [this] (rcv_buf& element) {
+                  return stream_process_incoming(std::move(element));
+              });
+          });
       });
   }
 
   future<> connection::stream_receive(circular_buffer<foreign_ptr<std::unique_ptr<rcv_buf>>>& bufs) {
+      // The source caught up with the sink, which may be waiting for the
+      // credit of what it consumed
+      if (_stream_queue.empty()) {
+          grant_stream_credit();
+      }
       return _stream_queue.not_empty().then([this, &bufs] {
-          bool eof = !_stream_queue.consume([&bufs] (rcv_buf&& b) {
+          bool eof = !_stream_queue.consume([this, &bufs] (rcv_buf&& b) {
               if (b.size == -1U) { // max fragment length marks an end of a stream
                   return false;
               } else {
+                  _stream_credit_owed += stream_charge(b.size + 4);
                   bufs.push_back(make_foreign(std::make_unique<rcv_buf>(std::move(b))));
                   return true;
               }
@@ -571,9 +849,82 @@ namespace rpc {
               assert(_stream_queue.empty());
               _stream_queue.push(rcv_buf(-1U)); // push eof marker back for next read to notice it
           }
+          if (_stream_credit_owed >= _stream_window / 2) {
+              grant_stream_credit();
+          }
       });
   }
 
+  // The batch size and the window, on 4 bytes each
+  static sstring serialize_stream_flow_control(size_t batch_size, size_t window) {
+      constexpr size_t max = std::numeric_limits<uint32_t>::max();
+      sstring data = uninitialized_string(8);
+      write_le<uint32_t>(data.data(), std::min(batch_size, max));
+      write_le<uint32_t>(data.data() + 4, std::min(window, max));
+      return data;
+  }
+
+  static sstring serialize_shard_info(shard_info info) {
+      sstring data = uninitialized_string(8);
+      write_le<uint32_t>(data.data(), info.shards);
+      write_le<uint32_t>(data.data() + 4, info.shard);
+      return data;
+  }
+
+  static shard_info deserialize_shard_info(const sstring& data) {
+      if (data.size() != 8) {
+          throw std::runtime_error("bad shard info feature data in negotiation frame");
+      }
+      shard_info info{read_le<uint32_t>(data.data()), read_le<uint32_t>(data.data() + 4)};
+      if (!info.shards || info.shard >= info.shards) {
+          throw std::runtime_error("bad shard info feature data in negotiation frame");
+      }
+      return info;
+  }
+
+  void connection::set_stream_flow_control(const sstring& data) {
+      if (data.size() != 8) {
+          throw std::runtime_error("bad stream flow control feature data in negotiation frame");
+      }
+      _stream_batch_size = read_le<uint32_t>(data.data());
+      _stream_window = read_le<uint32_t>(data.data() + 4);
+      if (_stream_window) {
+          // A batch is never charged more than the window then
+          _stream_batch_size = std::min(_stream_batch_size, _stream_window);
+      }
+      _stream_credit = _stream_window;
+  }
+
+  future<> connection::send_stream_frame(snd_buf buf, uint32_t charge) {
+      if (_stream_pending.empty() && _stream_credit >= charge) {
+          _stream_credit -= charge;
+          return send(std::move(buf), {}, nullptr);
+      }
+      _stream_pending.push_back(pending_stream_frame{std::move(buf), charge, promise<>()});
+      return _stream_pending.back().done.get_future();
+  }
+
+  void connection::send_pending_stream_frames() {
+      while (!_stream_pending.empty() && _stream_credit >= _stream_pending.front().charge) {
+          auto& f = _stream_pending.front();
+          _stream_credit -= f.charge;
+          send(std::move(f.buf), {}, nullptr).forward_to(std::move(f.done));
+          _stream_pending.pop_front();
+      }
+  }
+
+  void connection::grant_stream_credit() {
+      if (!_stream_credit_owed || _error) {
+          return;
+      }
+      temporary_buffer<char> frame(8);
+      write_le<uint32_t>(frame.get_write(), stream_credit_marker);
+      write_le<uint32_t>(frame.get_write() + 4, std::exchange(_stream_credit_owed, 0));
+      // A failing send aborts the connection, the credit frame never fails
+      // FIXME: future is discarded
+      (void)send(snd_buf(std::move(frame))).handle_exception([] (std::exception_ptr) {});
+  }
+
   void connection::register_stream(connection_id id, xshard_connection_ptr c) {
       _streams.emplace(id, std::move(c));
   }
@@ -591,6 +942,7 @@ namespace rpc {
   //   le64 message type a.k.a. verb ID
   //   le64 message ID
   //   le32 payload length
+  //   ...  optional span context, if protocol_features.TRACING was negotiated
   //   ...  payload
   struct request_frame {
       using opt_buf_type = std::optional<rcv_buf>;
@@ -667,10 +1019,19 @@ namespace rpc {
           case protocol_features::TIMEOUT:
               _timeout_negotiated = true;
               break;
+          case protocol_features::TRACING:
+              _tracing_negotiated = true;
+              break;
           case protocol_features::CONNECTION_ID: {
               _id = deserialize_connection_id(e.second);
               break;
           }
+          case protocol_features::STREAM_FLOW_CONTROL:
+              set_stream_flow_control(e.second);
+              break;
+          case protocol_features::SHARD_INFO:
+              _peer_shard_info = deserialize_shard_info(e.second);
+              break;
           default:
               // nothing to do
               ;
@@ -875,6 +1236,10 @@ namespace rpc {
   client::client(const logger& l, void* s, client_options ops, socket socket, const socket_address& addr, const socket_address& local)
   : rpc::connection(l, s), _socket(std::move(socket)), _server_addr(addr), _local_addr(local), _options(ops), _metrics(*this)
   {
+       _coalescing_window = ops.coalescing_window;
+       if (ops.fair_send_queue && !ops.stream_parent) {
+           enable_fair_send_queue();
+       }
        _socket.set_reuseaddr(ops.reuseaddr);
       // Run client in the background.
       // Communicate result via _stopped.
@@ -896,13 +1261,23 @@ namespace rpc {
           }
           if (_options.stream_parent) {
               features[protocol_features::STREAM_PARENT] = serialize_connection_id(_options.stream_parent);
+              if (_options.stream_batch_size || _options.stream_window) {
+                  features[protocol_features::STREAM_FLOW_CONTROL] = serialize_stream_flow_control(_options.stream_batch_size, _options.stream_window);
+              }
           }
           if (!_options.isolation_cookie.empty()) {
               features[protocol_features::ISOLATION] = _options.isolation_cookie;
           }
+          if (_options.propagate_tracing) {
+              features[protocol_features::TRACING] = "";
+          }
+          if (!_options.stream_parent) {
+              features[protocol_features::SHARD_INFO] = "";
+          }
 
           return negotiate_protocol(std::move(features)).then([this] {
               _propagate_timeout = !is_stream();
+              _tracing_reserved = _options.propagate_tracing && !is_stream();
               set_negotiated();
               return do_until([this] { return _read_buf.eof() || _error; }, [this] () mutable {
                   if (is_stream()) {
@@ -974,6 +1349,47 @@ namespace rpc {
       enqueue_zero_frame();
   }
 
+  verb_metrics::verb_metrics(sstring domain) : _domain(std::move(domain)) {}
+
+  void verb_metrics::track(uint64_t verb_id, sstring name) {
+      auto [i, inserted] = _verbs.try_emplace(verb_id);
+      if (!inserted) {
+          throw std::invalid_argument(format("verb {} is already tracked", verb_id));
+      }
+      i->second = std::make_unique<verb>();
+      auto& v = *i->second;
+      namespace sm = seastar::metrics;
+      std::vector<sm::label_instance> labels = { sm::label("domain")(_domain), sm::label("verb")(name) };
+      _metrics.add_group("rpc_verb", {
+            sm::make_histogram("round_trip_latency", sm::description("Latency from making a call to its reply, in microseconds"), labels,
+                    [&v] { return v.round_trip.to_metrics_histogram(); }).set_skip_when_empty(),
+            sm::make_histogram("request_size", sm::description("Size of the requests sent"), labels,
+                    [&v] { return v.request_size.to_metrics_histogram(); }).set_skip_when_empty(),
+            sm::make_gauge("client_in_flight", [&v] { return v.client_in_flight; },
+                    sm::description("Number of calls waiting for their reply"), labels),
+            sm::make_histogram("handler_latency", sm::description("Time the handler took to handle a request, in microseconds"), labels,
+                    [&v] { return v.handler.to_metrics_histogram(); }).set_skip_when_empty(),
+            sm::make_histogram("wire_to_handler_latency", sm::description("Time from the arrival of a request to its handler, in microseconds"), labels,
+                    [&v] { return v.wire_to_handler.to_metrics_histogram(); }).set_skip_when_empty(),
+            sm::make_histogram("received_request_size", sm::description("Size of the requests handled"), labels,
+                    [&v] { return v.received_request_size.to_metrics_histogram(); }).set_skip_when_empty(),
+            sm::make_histogram("reply_size", sm::description("Size of the replies sent"), labels,
+                    [&v] { return v.reply_size.to_metrics_histogram(); }).set_skip_when_empty(),
+            sm::make_gauge("server_in_flight", [&v] { return v.server_in_flight; },
+                    sm::description("Number of requests being handled"), labels),
+      });
+  }
+
+  client::batch_guard::batch_guard(client& c) noexcept : _client(c.weak_from_this()) {
+      c._batches++;
+  }
+
+  client::batch_guard::~batch_guard() {
+      if (_client) {
+          _client->end_batch();
+      }
+  }
+
   client::client(const logger& l, void* s, const socket_address& addr, const socket_address& local)
   : client(l, s, client_options{}, make_socket(), addr, local)
   {}
@@ -1008,6 +1424,10 @@ namespace rpc {
               _timeout_negotiated = true;
               ret[protocol_features::TIMEOUT] = "";
               break;
+          case protocol_features::TRACING:
+              _tracing_negotiated = true;
+              ret[protocol_features::TRACING] = "";
+              break;
           case protocol_features::STREAM_PARENT: {
               if (!get_server()._options.streaming_domain) {
                   f = f.then([] {
@@ -1039,6 +1459,13 @@ namespace rpc {
               }
               break;
           }
+          case protocol_features::STREAM_FLOW_CONTROL:
+              // Applies to both directions of the stream
+              if (_is_stream) {
+                  set_stream_flow_control(e.second);
+                  ret.emplace(e);
+              }
+              break;
           case protocol_features::ISOLATION: {
               auto&& isolation_cookie = e.second;
               struct isolation_function_visitor {
@@ -1063,6 +1490,9 @@ namespace rpc {
               ret.emplace(e);
               break;
           }
+          case protocol_features::SHARD_INFO:
+              ret[protocol_features::SHARD_INFO] = serialize_shard_info({smp::count, this_shard_id()});
+              break;
           default:
               // nothing to do
               ;
@@ -1121,8 +1551,92 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
     });
 }
 
+future<resource_permit> server::connection::admit(size_t memory_consumed, std::optional<rpc_clock_type::time_point> timeout) {
+    auto& s = get_server();
+    auto& ac = s._limits.admission;
+    if (!ac.target_delay.count()) {
+        return wait_for_resources(memory_consumed, timeout);
+    }
+    auto now = rpc_clock_type::now();
+    if (!s._resources_available.waiters()) {
+        s._resources_queue_empty = now;
+    } else if (timeout && *timeout <= now + s._resources_queue_delay) {
+        // It would expire before being handled
+        return make_exception_future<resource_permit>(overloaded_error());
+    }
+    // Under overload, the queue not having emptied for an interval, wait
+    // only for the target delay
+    auto deadline = now + (now - s._resources_queue_empty > ac.interval ? ac.target_delay : ac.interval);
+    auto f = timeout && *timeout <= deadline
+            ? get_units(s._resources_available, memory_consumed, *timeout)
+            : get_units(s._resources_available, memory_consumed, deadline).handle_exception_type([] (semaphore_timed_out&) {
+                return make_exception_future<resource_permit>(overloaded_error());
+            });
+    return f.then([&s, now] (resource_permit permit) {
+        auto admitted = rpc_clock_type::now();
+        s._resources_queue_delay = admitted - now;
+        if (!s._resources_available.waiters()) {
+            s._resources_queue_empty = admitted;
+        }
+        return permit;
+    });
+}
+
+future<> server::connection::send_overloaded_reply(int64_t msg_id, std::optional<rpc_clock_type::time_point> timeout) {
+    // Sent without waiting for memory, the server being short of it
+    snd_buf data(20);
+    auto p = data.front().get_write() + 12;
+    write_le<uint32_t>(p, uint32_t(exception_type::OVERLOADED));
+    write_le<uint32_t>(p + 4, uint32_t(0));
+    try {
+        // Send asynchronously.
+        // This is safe since connection::stop() will wait for background work.
+        (void)with_gate(get_server()._reply_gate, [this, timeout, msg_id, data = std::move(data)] () mutable {
+            auto c = shared_from_this();
+            return respond(-msg_id, std::move(data), timeout).then([c = std::move(c)] {});
+        });
+    } catch(gate_closed_exception&) {/* ignore */}
+    return make_ready_future<>();
+}
+
+  verb_metrics::verb* server::connection::verb_stats(uint64_t verb) const noexcept {
+      auto vm = get_server()._options.per_verb_metrics;
+      return vm ? vm->find(verb) : nullptr;
+  }
+
+  // Takes the span context off the front of the payload of a request
+  static tracing::span_context read_span_context(rcv_buf& data) {
+      constexpr auto size = tracing::span_context::serialized_size;
+      if (data.size < size) {
+          throw std::runtime_error("RPC request frame is too short for its span context");
+      }
+      char raw[size];
+      if (auto one = std::get_if<temporary_buffer<char>>(&data.bufs)) {
+          std::copy_n(one->get(), size, raw);
+          one->trim_front(size);
+      } else {
+          auto& bufs = std::get<std::vector<temporary_buffer<char>>>(data.bufs);
+          auto i = bufs.begin();
+          for (size_t copied = 0; copied < size; ++i) {
+              auto n = std::min(size - copied, i->size());
+              std::copy_n(i->get(), n, raw + copied);
+              i->trim_front(n);
+              copied += n;
+              if (!i->empty()) {
+                  break;
+              }
+          }
+          bufs.erase(bufs.begin(), i);
+      }
+      data.size -= size;
+      return tracing::span_context::deserialize(raw);
+  }
+
   future<> server::connection::process() {
       return negotiate_protocol().then([this] () mutable {
+        if (get_server()._options.fair_send_queue && !is_stream()) {
+            enable_fair_send_queue();
+        }
         auto sg = _isolation_config ? _isolation_config->sched_group : current_scheduling_group();
         return with_scheduling_group(sg, [this] {
           set_negotiated();
@@ -1139,10 +1653,15 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                       _error = true;
                       return make_ready_future<>();
                   } else {
+                      auto rx_timestamp = _fd.last_rx_timestamp();
                       std::optional<rpc_clock_type::time_point> timeout;
                       if (expire && *expire) {
                           timeout = relative_timeout_to_absolute(std::chrono::milliseconds(*expire));
                       }
+                      tracing::span_context span_context;
+                      if (_tracing_negotiated) {
+                          span_context = read_span_context(*data);
+                      }
                       auto h = get_server()._proto.get_handler(type);
                       if (!h) {
                           return send_unknown_verb_reply(timeout, msg_id, type);
@@ -1151,7 +1670,9 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                       // If the new method of per-connection scheduling group was used, honor it.
                       // Otherwise, use the old per-handler scheduling group.
                       auto sg = _isolation_config ? _isolation_config->sched_group : h->handler.sg;
-                      return with_scheduling_group(sg, [this, timeout, msg_id, &h = h->handler, data = std::move(data.value()), guard = std::move(h->holder)] () mutable {
+                      return with_scheduling_group(sg, [this, timeout, msg_id, &h = h->handler, data = std::move(data.value()), guard = std::move(h->holder), span_context, rx_timestamp] () mutable {
+                          _span_context = span_context;
+                          _rx_timestamp = rx_timestamp;
                           return h.func(shared_from_this(), timeout, msg_id, std::move(data), std::move(guard));
                       });
                   }
@@ -1189,6 +1710,7 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
   server::connection::connection(server& s, connected_socket&& fd, socket_address&& addr, const logger& l, void* serializer, connection_id id)
           : rpc::connection(std::move(fd), l, serializer, id)
           , _info{.addr{std::move(addr)}, .server{s}, .conn_id{id}} {
+      _coalescing_window = s._options.coalescing_window;
   }
 
   future<> server::connection::deregister_this_stream() {
@@ -1255,6 +1777,9 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
               auto fd = std::move(ar.connection);
               auto addr = std::move(ar.remote_address);
               fd.set_nodelay(_options.tcp_nodelay);
+              if (_options.rx_timestamps) {
+                  fd.enable_rx_timestamps();
+              }
               connection_id id = _options.streaming_domain ?
                       connection_id::make_id(_next_client_id++, uint16_t(this_shard_id())) :
                       connection_id::make_invalid_id(_next_client_id++);
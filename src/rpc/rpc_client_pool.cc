@@ -0,0 +1,209 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <seastar/rpc/rpc_client_pool.hh>
+#include <seastar/core/loop.hh>
+
+namespace seastar {
+
+namespace rpc {
+
+// Linux's default ephemeral port range, from which the ports picked for
+// peer_shards are taken not to clash with services
+static constexpr uint16_t first_local_port = 32768;
+static constexpr uint16_t last_local_port = 60999;
+
+static uint16_t random_local_port() {
+    std::random_device rd;
+    return std::uniform_int_distribution<uint16_t>(first_local_port, last_local_port)(rd);
+}
+
+// A port the peer serves on the given shard of its shards, moving next on
+// to the one after it, in case the last one could not be bound
+static uint16_t next_local_port(uint16_t& next, unsigned shards, unsigned shard) {
+    auto port = next - next % shards + shard;
+    if (port < first_local_port || port + shards > last_local_port) {
+        port = first_local_port - first_local_port % shards + shards + shard;
+    }
+    next = port + shards;
+    return port;
+}
+
+client_pool::client_pool(client_pool_options options, factory f)
+        : _options(std::move(options))
+        , _factory(std::move(f)) {
+    if (_options.small_lanes >= _options.connections) {
+        throw std::invalid_argument("an RPC client pool needs connections for the large calls");
+    }
+    if (_options.peer_shards) {
+        if (!*_options.peer_shards) {
+            throw std::invalid_argument("an RPC client pool's peer needs shards");
+        }
+        _next_port = random_local_port();
+    }
+    _clients.reserve(_options.connections);
+    for (unsigned i = 0; i < _options.connections; ++i) {
+        _clients.push_back(connect());
+    }
+}
+
+shared_ptr<client> client_pool::connect() {
+    if (!_options.peer_shards) {
+        return _factory(_options.client, socket_address());
+    }
+    // Served by the peer's shard with the local one's index
+    auto shards = *_options.peer_shards;
+    auto port = next_local_port(_next_port, shards, this_shard_id() % shards);
+    return _factory(_options.client, socket_address(ipv4_addr(port)));
+}
+
+client& client_pool::get(unsigned i) {
+    auto& c = _clients[i];
+    if (c->error()) {
+        auto failed = std::exchange(c, connect());
+        // FIXME: future is discarded
+        (void)with_gate(_replaced, [failed] {
+            return failed->stop().finally([failed] {});
+        });
+    }
+    return *c;
+}
+
+client& client_pool::pick(call_size size) {
+    unsigned first = 0;
+    unsigned n = _clients.size();
+    if (_options.small_lanes) {
+        if (size == call_size::small) {
+            n = _options.small_lanes;
+        } else {
+            first = _options.small_lanes;
+            n -= _options.small_lanes;
+        }
+    }
+    auto start = _next++;
+    if (_options.balancing == client_pool_balancing::round_robin) {
+        return get(first + start % n);
+    }
+    // Ties go round robin
+    unsigned best = 0;
+    size_t best_load = std::numeric_limits<size_t>::max();
+    for (unsigned k = 0; k < n; ++k) {
+        auto i = first + (start + k) % n;
+        auto& c = get(i);
+        auto load = c.incoming_queue_length() + c.outgoing_queue_length();
+        if (load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    return *_clients[best];
+}
+
+future<> client_pool::stop() noexcept {
+    return parallel_for_each(_clients, [] (shared_ptr<client>& c) {
+        return c->stop();
+    }).finally([this] {
+        return _replaced.close();
+    });
+}
+
+shard_aware_client_pool::shard_aware_client_pool(shard_aware_client_pool_options options, client_pool::factory f)
+        : _options(std::move(options))
+        , _factory(std::move(f))
+        , _next_port(random_local_port()) {
+    connect_first();
+}
+
+void shard_aware_client_pool::connect_first() {
+    _first = _factory(_options.client, socket_address());
+    // FIXME: future is discarded
+    (void)with_gate(_background, [this, c = _first] {
+        return c->await_connection().then([this, c] {
+            auto& info = c->peer_shard_info();
+            if (_stopping || c != _first || !info) {
+                return;
+            }
+            _clients.resize(info->shards);
+            _clients[info->shard] = c;
+            for (unsigned shard = 0; shard < info->shards; ++shard) {
+                if (!_clients[shard]) {
+                    _clients[shard] = connect(shard);
+                }
+            }
+        });
+    }).handle_exception([] (std::exception_ptr) {
+        // The connection failed, it is replaced when next picked
+    });
+}
+
+shared_ptr<client> shard_aware_client_pool::connect(unsigned shard) {
+    auto port = next_local_port(_next_port, _clients.size(), shard);
+    return _factory(_options.client, socket_address(ipv4_addr(port)));
+}
+
+void shard_aware_client_pool::replace(shared_ptr<client> failed) {
+    // FIXME: future is discarded
+    (void)with_gate(_background, [failed] {
+        return failed->stop().finally([failed] {});
+    });
+}
+
+client& shard_aware_client_pool::pick_shard(unsigned shard) {
+    if (_clients.empty()) {
+        if (_first->error()) {
+            replace(std::exchange(_first, nullptr));
+            connect_first();
+        }
+        return *_first;
+    }
+    shard %= _clients.size();
+    auto& c = _clients[shard];
+    if (c->error()) {
+        replace(std::exchange(c, connect(shard)));
+    }
+    return *c;
+}
+
+client& shard_aware_client_pool::pick(uint64_t key) {
+    if (_clients.empty()) {
+        return pick_shard(0);
+    }
+    return pick_shard(_options.key_to_shard(key, _clients.size()));
+}
+
+future<> shard_aware_client_pool::stop() noexcept {
+    _stopping = true;
+    if (_clients.empty()) {
+        _clients.push_back(_first);
+    }
+    return parallel_for_each(_clients, [] (shared_ptr<client>& c) {
+        return c->stop();
+    }).finally([this] {
+        return _background.close();
+    });
+}
+
+}
+
+}
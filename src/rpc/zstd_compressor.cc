@@ -0,0 +1,338 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/rpc/zstd_compressor.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/print.hh>
+#include <seastar/core/gate.hh>
+#include <boost/intrusive/list.hpp>
+#include <stdexcept>
+#include <zstd.h>
+#include <zdict.h>
+
+#include "rpc/reusable_buffer.hh"
+
+namespace seastar {
+
+namespace rpc {
+
+namespace bi = boost::intrusive;
+
+namespace {
+
+struct zstd_deleter {
+    void operator()(ZSTD_CCtx* p) const noexcept { ZSTD_freeCCtx(p); }
+    void operator()(ZSTD_DCtx* p) const noexcept { ZSTD_freeDCtx(p); }
+    void operator()(ZSTD_CDict* p) const noexcept { ZSTD_freeCDict(p); }
+    void operator()(ZSTD_DDict* p) const noexcept { ZSTD_freeDDict(p); }
+};
+
+template <typename T>
+using zstd_ptr = std::unique_ptr<T, zstd_deleter>;
+
+static constexpr size_t drop_buffers_trigger = 100'000;
+
+const sstring& zstd_name() {
+    const static sstring name = "ZSTD";
+    return name;
+}
+
+}
+
+// A compressed frame is made of:
+//
+//  - a byte of flags, with carries_dictionary if a dictionary follows:
+//    its version, on 4 bytes, size, on 4 bytes, and contents, for the
+//    frames after it to be decompressed against;
+//  - the version of the dictionary the frame is compressed against, zero
+//    if none, on 4 bytes;
+//  - the size of the frame, on 4 bytes, zero for an empty frame;
+//  - the zstd frame.
+//
+// All the integers are little endian.
+class zstd_compressor final : public compressor {
+    static constexpr uint8_t carries_dictionary = 1;
+
+    zstd_compressor_factory::state& _state;
+    std::function<future<>()> _send_empty_frame;
+    gate _announcing;
+    // The version of the last dictionary sent to the peer
+    uint32_t _sent_version = 0;
+    // The dictionary the peer sent
+    uint32_t _peer_version = 0;
+    zstd_ptr<ZSTD_DDict> _peer_dictionary;
+public:
+    using hook_t = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+    hook_t _hook;
+
+    zstd_compressor(zstd_compressor_factory::state& state, std::function<future<>()> send_empty_frame);
+    // Sends the current dictionary to the peer on an empty frame, rather
+    // than on that of the next call
+    void announce();
+    virtual snd_buf compress(size_t head_space, snd_buf data) override;
+    virtual rcv_buf decompress(rcv_buf data) override;
+    virtual sstring name() const override;
+    virtual future<> close() noexcept override;
+};
+
+class zstd_compressor_factory::state {
+public:
+    config cfg;
+    zstd_ptr<ZSTD_CCtx> cctx;
+    zstd_ptr<ZSTD_DCtx> dctx;
+    reusable_buffer compressed_data;
+    reusable_buffer decompressed_data;
+    size_t buffer_use_count = 0;
+    uint32_t version = 0;
+    temporary_buffer<char> dictionary;
+    zstd_ptr<ZSTD_CDict> cdict;
+    bi::list<zstd_compressor,
+        bi::member_hook<zstd_compressor, zstd_compressor::hook_t, &zstd_compressor::_hook>,
+        bi::constant_time_size<false>> compressors;
+    std::vector<temporary_buffer<char>> samples;
+    size_t samples_size = 0;
+    unsigned frames = 0;
+
+    explicit state(config c)
+            : cfg(c)
+            , cctx(ZSTD_createCCtx())
+            , dctx(ZSTD_createDCtx()) {
+        if (!cctx || !dctx) {
+            throw std::bad_alloc();
+        }
+    }
+
+    void after_buffer_use() noexcept {
+        if (buffer_use_count++ == drop_buffers_trigger) {
+            compressed_data.clear();
+            decompressed_data.clear();
+            buffer_use_count = 0;
+        }
+    }
+
+    void sample(const char* frame, size_t size) {
+        if (!cfg.sample_every || samples_size + size > cfg.max_samples_size || ++frames % cfg.sample_every) {
+            return;
+        }
+        samples.emplace_back(frame, size);
+        samples_size += size;
+    }
+};
+
+zstd_compressor::zstd_compressor(zstd_compressor_factory::state& state, std::function<future<>()> send_empty_frame)
+        : _state(state)
+        , _send_empty_frame(std::move(send_empty_frame)) {
+    // The dictionary goes with the first frame: an empty one may not be
+    // sent before the negotiation is over
+    _state.compressors.push_back(*this);
+}
+
+void zstd_compressor::announce() {
+    if (!_send_empty_frame || _announcing.is_closed()) {
+        return;
+    }
+    // FIXME: future is discarded
+    (void)with_gate(_announcing, [this] {
+        // A failed send fails the connection
+        return _send_empty_frame().handle_exception([] (std::exception_ptr) {});
+    });
+}
+
+future<> zstd_compressor::close() noexcept {
+    _hook.unlink();
+    return _announcing.close();
+}
+
+sstring zstd_compressor::name() const {
+    return zstd_name();
+}
+
+snd_buf zstd_compressor::compress(size_t head_space, snd_buf data) {
+    auto& s = _state;
+    bool announcing = s.cdict && _sent_version != s.version;
+    size_t header_size = 1 + (announcing ? 8 + s.dictionary.size() : 0) + 8;
+    auto src_size = data.size;
+    auto bound = src_size ? ZSTD_compressBound(src_size) : 0;
+    auto dst = s.compressed_data.with_reserved<snd_buf>(head_space + header_size + bound, [&] (char* dst) {
+        auto p = dst + head_space;
+        *p++ = announcing ? carries_dictionary : 0;
+        if (announcing) {
+            write_le<uint32_t>(p, s.version);
+            write_le<uint32_t>(p + 4, s.dictionary.size());
+            p = std::copy_n(s.dictionary.get(), s.dictionary.size(), p + 8);
+        }
+        write_le<uint32_t>(p, s.cdict ? s.version : 0);
+        write_le<uint32_t>(p + 4, src_size);
+        p += 8;
+        size_t size = 0;
+        if (src_size) {
+            auto src = s.decompressed_data.prepare(data.bufs, src_size);
+            size = s.cdict
+                    ? ZSTD_compress_usingCDict(s.cctx.get(), p, bound, src, src_size, s.cdict.get())
+                    : ZSTD_compressCCtx(s.cctx.get(), p, bound, src, src_size, s.cfg.level);
+            if (ZSTD_isError(size)) {
+                throw std::runtime_error(format("RPC frame zstd compression failure: {}", ZSTD_getErrorName(size)));
+            }
+            s.sample(src, src_size);
+        }
+        return p - dst + size;
+    });
+    if (announcing) {
+        _sent_version = s.version;
+    }
+    s.after_buffer_use();
+    return dst;
+}
+
+rcv_buf zstd_compressor::decompress(rcv_buf data) {
+    auto& s = _state;
+    auto src = s.decompressed_data.prepare(data.bufs, data.size);
+    auto end = src + data.size;
+    auto need = [&] (size_t n) {
+        if (size_t(end - src) < n) {
+            throw std::runtime_error("RPC frame zstd decompression failure: truncated frame");
+        }
+    };
+    need(1 + 8);
+    auto flags = uint8_t(*src++);
+    if (flags & carries_dictionary) {
+        need(8);
+        auto version = read_le<uint32_t>(src);
+        auto size = read_le<uint32_t>(src + 4);
+        src += 8;
+        need(size + 8);
+        zstd_ptr<ZSTD_DDict> dictionary(ZSTD_createDDict(src, size));
+        if (!dictionary) {
+            throw std::runtime_error("RPC frame zstd decompression failure: bad dictionary");
+        }
+        _peer_dictionary = std::move(dictionary);
+        _peer_version = version;
+        src += size;
+    }
+    auto version = read_le<uint32_t>(src);
+    uint32_t dst_size = read_le<uint32_t>(src + 4);
+    src += 8;
+    if (!dst_size) {
+        return rcv_buf();
+    }
+    if (version && version != _peer_version) {
+        throw std::runtime_error(format("RPC frame zstd decompression failure: unknown dictionary {}", version));
+    }
+    auto dst = s.compressed_data.with_reserved<rcv_buf>(dst_size, [&] (char* dst) {
+        auto size = version
+                ? ZSTD_decompress_usingDDict(s.dctx.get(), dst, dst_size, src, end - src, _peer_dictionary.get())
+                : ZSTD_decompressDCtx(s.dctx.get(), dst, dst_size, src, end - src);
+        if (ZSTD_isError(size)) {
+            throw std::runtime_error(format("RPC frame zstd decompression failure: {}", ZSTD_getErrorName(size)));
+        }
+        if (size != dst_size) {
+            throw std::runtime_error("RPC frame zstd decompression failure: size mismatch");
+        }
+        return size;
+    });
+    s.after_buffer_use();
+    return dst;
+}
+
+zstd_compressor_factory::zstd_compressor_factory(config cfg) {
+    if (cfg.level < ZSTD_minCLevel() || cfg.level > ZSTD_maxCLevel()) {
+        throw std::invalid_argument(format("zstd compression level {} is not in [{}, {}]", cfg.level, ZSTD_minCLevel(), ZSTD_maxCLevel()));
+    }
+    _state = std::make_unique<state>(cfg);
+}
+
+zstd_compressor_factory::~zstd_compressor_factory() = default;
+
+const sstring& zstd_compressor_factory::supported() const {
+    return zstd_name();
+}
+
+std::unique_ptr<compressor> zstd_compressor_factory::negotiate(sstring feature, bool is_server) const {
+    return negotiate(std::move(feature), is_server, nullptr);
+}
+
+std::unique_ptr<compressor> zstd_compressor_factory::negotiate(sstring feature, bool is_server, std::function<future<>()> send_empty_frame) const {
+    return feature == supported() ? std::make_unique<zstd_compressor>(*_state, std::move(send_empty_frame)) : nullptr;
+}
+
+uint32_t zstd_compressor_factory::set_dictionary(temporary_buffer<char> dictionary) {
+    auto& s = *_state;
+    zstd_ptr<ZSTD_CDict> cdict;
+    if (!dictionary.empty()) {
+        cdict.reset(ZSTD_createCDict(dictionary.get(), dictionary.size(), s.cfg.level));
+        if (!cdict) {
+            throw std::runtime_error("zstd dictionary creation failure");
+        }
+    }
+    s.dictionary = std::move(dictionary);
+    s.cdict = std::move(cdict);
+    // Zero is for no dictionary
+    if (!++s.version) {
+        ++s.version;
+    }
+    if (s.cdict) {
+        for (auto& c : s.compressors) {
+            c.announce();
+        }
+    }
+    return dictionary_version();
+}
+
+uint32_t zstd_compressor_factory::dictionary_version() const noexcept {
+    return _state->cdict ? _state->version : 0;
+}
+
+std::vector<temporary_buffer<char>> zstd_compressor_factory::take_samples() {
+    _state->samples_size = 0;
+    return std::exchange(_state->samples, {});
+}
+
+uint32_t zstd_compressor_factory::train_dictionary(size_t max_size) {
+    auto samples = take_samples();
+    return set_dictionary(train_dictionary(samples, max_size));
+}
+
+temporary_buffer<char> zstd_compressor_factory::train_dictionary(const std::vector<temporary_buffer<char>>& samples, size_t max_size) {
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    size_t total = 0;
+    for (auto& sample : samples) {
+        sizes.push_back(sample.size());
+        total += sample.size();
+    }
+    // zstd takes the samples back to back
+    temporary_buffer<char> all(total);
+    auto p = all.get_write();
+    for (auto& sample : samples) {
+        p = std::copy_n(sample.get(), sample.size(), p);
+    }
+    temporary_buffer<char> dictionary(max_size);
+    auto size = ZDICT_trainFromBuffer(dictionary.get_write(), max_size, all.get(), sizes.data(), sizes.size());
+    if (ZDICT_isError(size)) {
+        throw std::runtime_error(format("zstd dictionary training failure: {}", ZDICT_getErrorName(size)));
+    }
+    dictionary.trim(size);
+    return dictionary;
+}
+
+}
+
+}
@@ -158,6 +158,7 @@ export module seastar;
 #include <seastar/core/abort_on_ebadf.hh>
 #include <seastar/core/abort_on_expiry.hh>
 #include <seastar/core/abort_source.hh>
+#include <seastar/core/algorithm.hh>
 #include <seastar/core/alien.hh>
 #include <seastar/core/align.hh>
 #include <seastar/core/aligned_buffer.hh>
@@ -165,6 +166,10 @@ export module seastar;
 #include <seastar/core/array_map.hh>
 #include <seastar/core/bitops.hh>
 #include <seastar/core/bitset-iter.hh>
+#include <seastar/core/block_cache.hh>
+#include <seastar/core/cache.hh>
+#include <seastar/core/checksummed_file.hh>
+#include <seastar/core/compressed_file.hh>
 #include <seastar/core/byteorder.hh>
 #include <seastar/core/cacheline.hh>
 #include <seastar/core/checked_ptr.hh>
@@ -173,8 +178,10 @@ export module seastar;
 #include <seastar/core/circular_buffer_fixed_capacity.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/coroutine.hh>
+#include <seastar/core/cpu_profile.hh>
 #include <seastar/core/deleter.hh>
 #include <seastar/core/distributed.hh>
+#include <seastar/core/distributed_semaphore.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/core/enum.hh>
 #include <seastar/core/exception_hacks.hh>
@@ -182,17 +189,21 @@ export module seastar;
 #include <seastar/core/expiring_fifo.hh>
 #include <seastar/core/file.hh>
 #include <seastar/core/file-types.hh>
+#include <seastar/core/flat_hash_map.hh>
 #include <seastar/core/fsnotify.hh>
 #include <seastar/core/fsqual.hh>
 #include <seastar/core/fstream.hh>
+#include <seastar/core/fragmented_buffer.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/future-util.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/heap_profile.hh>
 #include <seastar/core/idle_cpu_handler.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/iostream-impl.hh>
 #include <seastar/core/io_intent.hh>
 #include <seastar/core/io_queue.hh>
+#include <seastar/core/io_trace.hh>
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/core/layered_file.hh>
 #include <seastar/core/loop.hh>
@@ -201,33 +212,44 @@ export module seastar;
 #include <seastar/core/manual_clock.hh>
 #include <seastar/core/map_reduce.hh>
 #include <seastar/core/memory.hh>
+#include <seastar/core/memory_pressure.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/metrics_api.hh>
+#include <seastar/core/metrics_histogram.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/metrics_types.hh>
+#include <seastar/core/offload.hh>
+#include <seastar/core/otlp.hh>
 #include <seastar/core/pipe.hh>
+#include <seastar/core/pipeline.hh>
 #include <seastar/core/polymorphic_temporary_buffer.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/preempt.hh>
 #include <seastar/core/prefetch.hh>
 #include <seastar/core/print.hh>
 // #include <seastar/core/prometheus.hh>
+#include <seastar/core/priority_semaphore.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/ragel.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/reactor_config.hh>
+#include <seastar/core/ref_ptr.hh>
 #include <seastar/core/relabel_config.hh>
+#include <seastar/core/replicated.hh>
 #include <seastar/core/report_exception.hh>
 #include <seastar/core/resource.hh>
 #include <seastar/core/rwlock.hh>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/core/scheduling.hh>
 #include <seastar/core/scheduling_specific.hh>
+#include <seastar/core/scoped_arena.hh>
 #include <seastar/core/scollectd.hh>
 #include <seastar/core/scollectd_api.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/shard_scaler.hh>
 #include <seastar/core/sharded.hh>
+#include <seastar/core/sharded_map.hh>
 #include <seastar/core/shared_future.hh>
 #include <seastar/core/shared_mutex.hh>
 #include <seastar/core/shared_ptr.hh>
@@ -239,27 +261,36 @@ export module seastar;
 #include <seastar/core/smp_options.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/stream.hh>
+#include <seastar/core/stall_profile.hh>
 #include <seastar/core/stall_sampler.hh>
 #include <seastar/core/systemwide_memory_barrier.hh>
 #include <seastar/core/task.hh>
+#include <seastar/core/task_local.hh>
+#include <seastar/core/task_profile.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/timer.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/core/transfer.hh>
 #include <seastar/core/unaligned.hh>
 #include <seastar/core/units.hh>
 #include <seastar/core/vector-data-sink.hh>
 #include <seastar/core/weak_ptr.hh>
+#include <seastar/core/warm_restart.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/when_any.hh>
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/with_timeout.hh>
+#include <seastar/core/work_stealing.hh>
 
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/conversions.hh>
+#include <seastar/util/crc32c.hh>
 #include <seastar/util/defer.hh>
+#include <seastar/util/destroy_gently.hh>
+#include <seastar/util/exception_ptr.hh>
 #include <seastar/util/file.hh>
 #include <seastar/util/log-cli.hh>
 #include <seastar/util/log.hh>
@@ -269,6 +300,7 @@ export module seastar;
 #include <seastar/util/process.hh>
 #include <seastar/util/read_first_line.hh>
 #include <seastar/util/short_streams.hh>
+#include <seastar/util/utf8.hh>
 
 #include <seastar/net/arp.hh>
 #include <seastar/net/packet.hh>
@@ -298,6 +330,7 @@ export module seastar;
 
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/json/writer.hh>
 
 module : private;
 
@@ -305,6 +338,7 @@ module : private;
 #include <seastar/core/internal/buffer_allocator.hh>
 #include <seastar/core/internal/io_intent.hh>
 #include <seastar/core/internal/stall_detector.hh>
+#include <seastar/core/internal/tsc_clock.hh>
 #include <seastar/core/internal/uname.hh>
 
 #include "core/cgroup.hh"
@@ -329,6 +363,7 @@ module : private;
 #include <seastar/net/tcp-stack.hh>
 #include <seastar/net/toeplitz.hh>
 #include <seastar/net/virtio.hh>
+#include <seastar/net/xdp.hh>
 
 #include "net/native-stack-impl.hh"
 
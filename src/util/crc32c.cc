@@ -0,0 +1,248 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/util/crc32c.hh>
+#endif
+
+namespace seastar {
+
+namespace {
+
+// The kernels update the CRC register, without the inversions before and
+// after, with the data.
+using crc32c_kernel = uint32_t (*)(uint32_t crc, const unsigned char* data, size_t len) noexcept;
+
+// The Castagnoli polynomial, bit-reflected
+constexpr uint32_t poly = 0x82f63b78;
+
+constexpr std::array<uint32_t, 256> make_table() noexcept {
+    std::array<uint32_t, 256> table = {};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+constexpr auto crc_table = make_table();
+
+uint32_t update_scalar(uint32_t crc, const unsigned char* p, size_t len) noexcept {
+    while (len--) {
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+// Multiplies a and b modulo the polynomial (bit-reflected, so that x^0 is
+// the top bit). a must not be zero.
+uint32_t multmodp(uint32_t a, uint32_t b) noexcept {
+    uint32_t m = uint32_t(1) << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+    }
+    return p;
+}
+
+// x^(8 * len) modulo the polynomial, by which a CRC register is multiplied
+// to run it over len zero bytes
+uint32_t shift_for(size_t len) noexcept {
+    uint32_t p = uint32_t(1) << 31;
+    uint32_t x2k = uint32_t(1) << 30;
+    for (uint64_t n = uint64_t(len) * 8; n; n >>= 1) {
+        if (n & 1) {
+            p = multmodp(x2k, p);
+        }
+        x2k = multmodp(x2k, x2k);
+    }
+    return p;
+}
+
+// Data this long or longer is split into three streams, run in parallel
+// and combined. The combination costs a couple of hundred cycles, so
+// shorter data is not worth it.
+constexpr size_t interleave_min_len = 1024;
+
+// Combines the registers of three consecutive streams of lane bytes each,
+// the first started from the checksum so far and the others from zero.
+// Data is mostly checksummed in blocks of the same size, so the shifts for
+// the last lane length are kept.
+uint32_t combine3(uint32_t c0, uint32_t c1, uint32_t c2, size_t lane) noexcept {
+    struct shifts {
+        size_t lane = 0;
+        uint32_t one = 0;
+        uint32_t two = 0;
+    };
+    static thread_local shifts s;
+    if (s.lane != lane) {
+        s.lane = lane;
+        s.one = shift_for(lane);
+        s.two = shift_for(2 * lane);
+    }
+    return multmodp(s.two, c0) ^ multmodp(s.one, c1) ^ c2;
+}
+
+inline uint64_t load64(const unsigned char* p) noexcept {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+#if defined(__x86_64__)
+
+[[gnu::target("sse4.2")]]
+uint32_t update_sse42(uint32_t crc, const unsigned char* p, size_t len) noexcept {
+    uint64_t c0 = crc;
+    if (len >= interleave_min_len) {
+        auto lane = (len / 3) & ~size_t(7);
+        uint64_t c1 = 0;
+        uint64_t c2 = 0;
+        auto p1 = p + lane;
+        auto p2 = p1 + lane;
+        for (size_t i = 0; i < lane; i += 8) {
+            c0 = _mm_crc32_u64(c0, load64(p + i));
+            c1 = _mm_crc32_u64(c1, load64(p1 + i));
+            c2 = _mm_crc32_u64(c2, load64(p2 + i));
+        }
+        c0 = combine3(c0, c1, c2, lane);
+        p += 3 * lane;
+        len -= 3 * lane;
+    }
+    for (; len >= 8; p += 8, len -= 8) {
+        c0 = _mm_crc32_u64(c0, load64(p));
+    }
+    for (; len; p++, len--) {
+        c0 = _mm_crc32_u8(uint32_t(c0), *p);
+    }
+    return c0;
+}
+
+#elif defined(__aarch64__)
+
+[[gnu::target("+crc")]]
+uint32_t update_armv8(uint32_t crc, const unsigned char* p, size_t len) noexcept {
+    uint32_t c0 = crc;
+    if (len >= interleave_min_len) {
+        auto lane = (len / 3) & ~size_t(7);
+        uint32_t c1 = 0;
+        uint32_t c2 = 0;
+        auto p1 = p + lane;
+        auto p2 = p1 + lane;
+        for (size_t i = 0; i < lane; i += 8) {
+            c0 = __crc32cd(c0, load64(p + i));
+            c1 = __crc32cd(c1, load64(p1 + i));
+            c2 = __crc32cd(c2, load64(p2 + i));
+        }
+        c0 = combine3(c0, c1, c2, lane);
+        p += 3 * lane;
+        len -= 3 * lane;
+    }
+    for (; len >= 8; p += 8, len -= 8) {
+        c0 = __crc32cd(c0, load64(p));
+    }
+    for (; len; p++, len--) {
+        c0 = __crc32cb(c0, *p);
+    }
+    return c0;
+}
+
+#endif
+
+crc32c_kernel kernel_for(internal::crc32c_isa isa) noexcept {
+    using internal::crc32c_isa;
+    switch (isa) {
+    case crc32c_isa::scalar:
+        return update_scalar;
+#if defined(__x86_64__)
+    case crc32c_isa::sse42:
+        return __builtin_cpu_supports("sse4.2") ? update_sse42 : nullptr;
+#elif defined(__aarch64__)
+    case crc32c_isa::armv8:
+        return (::getauxval(AT_HWCAP) & HWCAP_CRC32) ? update_armv8 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+crc32c_kernel best_kernel() noexcept {
+    using internal::crc32c_isa;
+    for (auto isa : {crc32c_isa::sse42, crc32c_isa::armv8}) {
+        if (auto k = kernel_for(isa)) {
+            return k;
+        }
+    }
+    return update_scalar;
+}
+
+crc32c_kernel& active_kernel() noexcept {
+    static crc32c_kernel kernel = best_kernel();
+    return kernel;
+}
+
+}
+
+namespace internal {
+
+bool use_crc32c_isa(crc32c_isa isa) noexcept {
+    auto k = kernel_for(isa);
+    if (!k) {
+        return false;
+    }
+    active_kernel() = k;
+    return true;
+}
+
+}
+
+uint32_t crc32c(const void* data, size_t len, uint32_t crc) noexcept {
+    return ~active_kernel()(~crc, static_cast<const unsigned char*>(data), len);
+}
+
+}
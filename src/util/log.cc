@@ -32,6 +32,13 @@ module;
 #include <system_error>
 #include <chrono>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <fmt/core.h>
 #if FMT_VERSION >= 60000
@@ -318,6 +325,269 @@ logger::~logger() {
 
 static thread_local std::array<char, 8192> static_log_buf;
 
+namespace {
+
+// The messages of a shard, written by it and read by the thread of the
+// async log, without locking
+class log_ring {
+    struct record_header {
+        uint32_t size;
+        // The syslog priority of the message, or no_syslog for the ostream
+        int32_t priority;
+    };
+    const size_t _capacity;
+    std::unique_ptr<char[]> _buf;
+    alignas(64) std::atomic<size_t> _head = { 0 };
+    alignas(64) std::atomic<size_t> _tail = { 0 };
+    std::atomic<uint64_t> _dropped = { 0 };
+    // Read by the thread only
+    uint64_t _reported_dropped = 0;
+
+    void copy_in(size_t pos, const void* data, size_t size) noexcept {
+        pos &= _capacity - 1;
+        auto first = std::min(size, _capacity - pos);
+        std::memcpy(_buf.get() + pos, data, first);
+        std::memcpy(_buf.get(), static_cast<const char*>(data) + first, size - first);
+    }
+    void copy_out(size_t pos, void* data, size_t size) const noexcept {
+        pos &= _capacity - 1;
+        auto first = std::min(size, _capacity - pos);
+        std::memcpy(data, _buf.get() + pos, first);
+        std::memcpy(static_cast<char*>(data) + first, _buf.get(), size - first);
+    }
+public:
+    static constexpr int32_t no_syslog = -1;
+    // A message for the thread to format, starting with a deferred_record
+    static constexpr int32_t deferred = -2;
+
+    explicit log_ring(size_t capacity)
+            : _capacity(capacity)
+            , _buf(new char[capacity]) {
+    }
+
+    void push(int32_t priority, std::string_view msg) noexcept {
+        push(priority, {}, msg);
+    }
+
+    // Pushes a message made of the two parts, back to back
+    void push(int32_t priority, std::string_view first, std::string_view second) noexcept {
+        auto head = _head.load(std::memory_order_relaxed);
+        auto tail = _tail.load(std::memory_order_acquire);
+        size_t msg_size = first.size() + second.size();
+        size_t size = sizeof(record_header) + msg_size;
+        if (_capacity - (head - tail) < size) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        record_header h{uint32_t(msg_size), priority};
+        copy_in(head, &h, sizeof(h));
+        copy_in(head + sizeof(h), first.data(), first.size());
+        copy_in(head + sizeof(h) + first.size(), second.data(), second.size());
+        _head.store(head + size, std::memory_order_release);
+    }
+
+    // Consumes the messages, the text of which is NUL terminated in buf
+    template <typename Func>
+    void drain(std::vector<char>& buf, Func&& func) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        auto head = _head.load(std::memory_order_acquire);
+        while (tail != head) {
+            record_header h;
+            copy_out(tail, &h, sizeof(h));
+            buf.resize(h.size + 1);
+            copy_out(tail + sizeof(h), buf.data(), h.size);
+            buf[h.size] = '\0';
+            tail += sizeof(h) + h.size;
+            _tail.store(tail, std::memory_order_release);
+            func(h.priority, std::string_view(buf.data(), h.size));
+        }
+    }
+
+    uint64_t dropped() const noexcept {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+    // The number of messages dropped since the last call
+    uint64_t take_dropped() noexcept {
+        auto dropped = this->dropped();
+        return dropped - std::exchange(_reported_dropped, dropped);
+    }
+};
+
+// Followed, in a deferred message, by the prefix the shard formatted, the
+// format string and the arguments, which the thread formats with format
+struct deferred_record {
+    internal::deferred_log_args::format_func format;
+    uint32_t prefix_size;
+    // Where the prefix syslog is sent starts, after the level and timestamp
+    uint32_t common_offset;
+    uint32_t format_size;
+    int32_t syslog_priority;
+    bool ostream;
+};
+
+// Writes the messages the shards push to their rings from a thread of its
+// own, woken by the first message pushed after it drained them all
+class async_log {
+    static constexpr unsigned max_shards = 1024;
+
+    const size_t _ring_size;
+    const bool _defer_formatting;
+    std::ostream*& _out;
+    std::array<std::atomic<log_ring*>, max_shards> _rings = {};
+    std::atomic<bool> _wake = { false };
+    std::atomic<bool> _stop = { false };
+    // Held while draining, by the thread or by flush()
+    std::timed_mutex _drain_mutex;
+    std::vector<char> _buf;
+    std::thread _thread;
+
+    // Formats a deferred message into buf, the text of which syslog takes
+    // from the common offset, NUL terminated
+    static const deferred_record& format_deferred(std::string_view msg, internal::log_buf& buf) {
+        auto& r = *reinterpret_cast<const deferred_record*>(msg.data());
+        auto p = msg.data() + sizeof(r);
+        auto it = buf.back_insert_begin();
+        it = std::copy_n(p, r.prefix_size, it);
+        std::string_view format(p + r.prefix_size, r.format_size);
+        try {
+            it = r.format(it, format, format.data() + format.size());
+        } catch (...) {
+            it = fmt::format_to(it, "failed to format message: fmt='{}': {}", format, std::current_exception());
+        }
+        return r;
+    }
+
+    void drain() {
+        bool wrote = false;
+        std::array<char, 4096> formatted_buf;
+        for (unsigned shard = 0; shard < max_shards; ++shard) {
+            auto ring = _rings[shard].load(std::memory_order_acquire);
+            if (!ring) {
+                continue;
+            }
+            ring->drain(_buf, [&] (int32_t priority, std::string_view msg) {
+                if (priority == log_ring::deferred) {
+                    internal::log_buf buf(formatted_buf.data(), formatted_buf.size());
+                    auto& r = format_deferred(msg, buf);
+                    if (r.ostream) {
+                        *_out << buf.view() << '\n';
+                        wrote = true;
+                    }
+                    if (r.syslog_priority != log_ring::no_syslog) {
+                        *buf.back_insert_begin() = '\0';
+                        syslog(r.syslog_priority, "%s", buf.data() + r.common_offset);
+                    }
+                } else if (priority == log_ring::no_syslog) {
+                    *_out << msg;
+                    wrote = true;
+                } else {
+                    syslog(priority, "%s", msg.data());
+                }
+            });
+            if (auto dropped = ring->take_dropped()) {
+                *_out << fmt::format("WARN  seastar - {} log messages of shard {} were dropped, its buffer being full\n", dropped, shard);
+                wrote = true;
+            }
+        }
+        if (wrote) {
+            _out->flush();
+        }
+    }
+
+    void run() {
+        while (!_stop.load(std::memory_order_relaxed)) {
+            _wake.wait(false, std::memory_order_acquire);
+            _wake.store(false, std::memory_order_relaxed);
+            // Pairs with the fence of wake(): either the rings are seen with
+            // what was pushed before it, or _wake is seen cleared by it and
+            // set again
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::lock_guard<std::timed_mutex> g(_drain_mutex);
+            try {
+                drain();
+            } catch (...) {
+                // As do_log() on allocation failure, no log of the failure
+            }
+        }
+    }
+public:
+    async_log(size_t ring_size, bool defer_formatting, std::ostream*& out)
+            : _ring_size(std::bit_ceil(ring_size))
+            , _defer_formatting(defer_formatting)
+            , _out(out)
+            , _thread([this] { run(); }) {
+    }
+
+    ~async_log() {
+        _stop.store(true, std::memory_order_relaxed);
+        wake();
+        _thread.join();
+        flush();
+        for (auto& ring : _rings) {
+            delete ring.load(std::memory_order_relaxed);
+        }
+    }
+
+    // The ring of the shard, null if it could not be made
+    log_ring* ring(unsigned shard) noexcept {
+        if (shard >= max_shards) {
+            return nullptr;
+        }
+        auto ring = _rings[shard].load(std::memory_order_acquire);
+        if (!ring) {
+            try {
+                ring = new log_ring(_ring_size);
+            } catch (...) {
+                return nullptr;
+            }
+            _rings[shard].store(ring, std::memory_order_release);
+        }
+        return ring;
+    }
+
+    bool defer_formatting() const noexcept {
+        return _defer_formatting;
+    }
+
+    void wake() noexcept {
+        // Orders the push to the ring before the load of _wake, which
+        // otherwise may see a true the thread already cleared
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_wake.load(std::memory_order_relaxed) && !_wake.exchange(true, std::memory_order_release)) {
+            _wake.notify_one();
+        }
+    }
+
+    void flush() noexcept {
+        // The thread may be the one aborting, holding the mutex
+        if (std::this_thread::get_id() == _thread.get_id()) {
+            return;
+        }
+        std::unique_lock<std::timed_mutex> g(_drain_mutex, std::defer_lock);
+        if (!g.try_lock_for(std::chrono::seconds(1))) {
+            return;
+        }
+        try {
+            drain();
+        } catch (...) {
+        }
+    }
+
+    uint64_t dropped() const noexcept {
+        uint64_t dropped = 0;
+        for (auto& ring : _rings) {
+            if (auto r = ring.load(std::memory_order_acquire)) {
+                dropped += r->dropped();
+            }
+        }
+        return dropped;
+    }
+};
+
+std::unique_ptr<async_log> the_async_log;
+
+}
+
 bool logger::rate_limit::check() {
     const auto now = clock::now();
     if (now < _next) {
@@ -332,6 +602,17 @@ logger::rate_limit::rate_limit(std::chrono::milliseconds interval)
     : _interval(interval), _next(clock::now())
 { }
 
+static int syslog_priority(log_level level) noexcept {
+    static array_map<int, 20> level_map = {
+            { int(log_level::debug), LOG_DEBUG },
+            { int(log_level::info), LOG_INFO },
+            { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
+            { int(log_level::warn), LOG_WARNING },
+            { int(log_level::error), LOG_ERR },
+    };
+    return level_map[int(level)];
+}
+
 void
 logger::do_log(log_level level, log_writer& writer) {
     bool is_ostream_enabled = _ostream.load(std::memory_order_relaxed);
@@ -351,6 +632,9 @@ logger::do_log(log_level level, log_writer& writer) {
     // oversized allocation warnings and failed allocation errors
     silencer be_silent;
 
+    // The shards log through the async log if any, other threads directly
+    log_ring* ring = the_async_log && local_engine ? the_async_log->ring(this_shard_id()) : nullptr;
+
     if (is_ostream_enabled) {
         internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
         auto it = buf.back_insert_begin();
@@ -358,29 +642,77 @@ logger::do_log(log_level level, log_writer& writer) {
         it = print_timestamp(it);
         it = print_once(it);
         *it++ = '\n';
-        *_out << buf.view();
-        _out->flush();
+        if (ring) {
+            ring->push(log_ring::no_syslog, buf.view());
+        } else {
+            *_out << buf.view();
+            _out->flush();
+        }
     }
     if (is_syslog_enabled) {
         internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
         auto it = buf.back_insert_begin();
         it = print_once(it);
         *it = '\0';
-        static array_map<int, 20> level_map = {
-                { int(log_level::debug), LOG_DEBUG },
-                { int(log_level::info), LOG_INFO },
-                { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
-                { int(log_level::warn), LOG_WARNING },
-                { int(log_level::error), LOG_ERR },
-        };
-        // NOTE: syslog() can block, which will stall the reactor thread.
-        //       this should be rare (will have to fill the pipe buffer
-        //       before syslogd can clear it) but can happen.  If it does,
-        //       we'll have to implement some internal buffering (which
-        //       still means the problem can happen, just less frequently).
+        // NOTE: syslog() can block, which will stall the reactor thread,
+        //       unless the async log calls it.  This should be rare (will
+        //       have to fill the pipe buffer before syslogd can clear it)
+        //       but can happen.
         // syslog() interprets % characters, so send msg as a parameter
-        syslog(level_map[int(level)], "%s", buf.data());
+        if (ring) {
+            ring->push(syslog_priority(level), buf.view());
+        } else {
+            syslog(syslog_priority(level), "%s", buf.data());
+        }
+    }
+    if (ring) {
+        the_async_log->wake();
+    }
+}
+
+bool
+logger::do_log_deferred(log_level level, std::string_view format, const internal::deferred_log_args& args) {
+    if (!the_async_log || !the_async_log->defer_formatting() || !local_engine) {
+        return false;
     }
+    bool is_ostream_enabled = _ostream.load(std::memory_order_relaxed);
+    bool is_syslog_enabled = _syslog.load(std::memory_order_relaxed);
+    if (!is_ostream_enabled && !is_syslog_enabled) {
+        return true;
+    }
+    auto ring = the_async_log->ring(this_shard_id());
+    if (!ring) {
+        return false;
+    }
+    silencer be_silent;
+
+    // The prefix is cheap to format, and the timestamp is the one of the call
+    internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
+    auto it = buf.back_insert_begin();
+    it = fmt::format_to(it, "{} ", wrapped_log_level{level});
+    it = print_timestamp(it);
+    uint32_t common_offset = buf.size();
+    it = fmt::format_to(it, " [shard {:{}}:{}]", this_shard_id(), _shard_field_width, current_scheduling_group().short_name());
+    it = fmt::format_to(it, " {} - ", _name);
+    uint32_t prefix_size = buf.size();
+    // Messages which do not fit are formatted here, rather than allocating
+    if (prefix_size + format.size() + args.encoded_size() > static_log_buf.size()) {
+        return false;
+    }
+    it = std::copy(format.begin(), format.end(), it);
+    it = args.encode(it);
+
+    deferred_record r{
+        .format = args.formatter(),
+        .prefix_size = prefix_size,
+        .common_offset = common_offset,
+        .format_size = uint32_t(format.size()),
+        .syslog_priority = is_syslog_enabled ? syslog_priority(level) : log_ring::no_syslog,
+        .ostream = is_ostream_enabled,
+    };
+    ring->push(log_ring::deferred, std::string_view(reinterpret_cast<const char*>(&r), sizeof(r)), buf.view());
+    the_async_log->wake();
+    return true;
 }
 
 void logger::failed_to_log(std::exception_ptr ex,
@@ -421,6 +753,31 @@ logger::set_syslog_enabled(bool enabled) noexcept {
     _syslog.store(enabled, std::memory_order_relaxed);
 }
 
+void
+logger::set_async(size_t size, bool defer_formatting) {
+    // Writing what the previous one buffered
+    the_async_log.reset();
+    if (size) {
+        the_async_log = std::make_unique<async_log>(size, defer_formatting, _out);
+        static bool registered = false;
+        if (!std::exchange(registered, true)) {
+            std::atexit([] { the_async_log.reset(); });
+        }
+    }
+}
+
+void
+logger::flush_async() noexcept {
+    if (the_async_log) {
+        the_async_log->flush();
+    }
+}
+
+uint64_t
+logger::async_dropped_messages() noexcept {
+    return the_async_log ? the_async_log->dropped() : 0;
+}
+
 void
 logger::set_shard_field_width(unsigned width) noexcept {
     _shard_field_width = width;
@@ -511,6 +868,7 @@ void apply_logging_settings(const logging_settings& s) {
         break;
     }
     logger::set_syslog_enabled(s.syslog_enabled);
+    logger::set_async(s.async_buffer_size, s.async_defer_formatting);
     logger::set_with_color(s.with_color);
 
     switch (s.stdout_timestamp_style) {
@@ -600,6 +958,12 @@ options::options(program_options::option_group* parent_group)
     , logger_ostream_type(*this, "logger-ostream-type", logger_ostream_type::cerr,
             "Send log output to: none|stdout|stderr")
     , log_to_syslog(*this, "log-to-syslog", false, "Send log output to syslog.")
+    , logger_async_buffer_size(*this, "logger-async-buffer-size", 0u,
+            "Write the log from a thread of its own, with a buffer of that many bytes per shard, "
+            "dropping the messages that do not fit. 0 writes it from the shards, which syslog may stall.")
+    , logger_async_defer_formatting(*this, "logger-async-defer-formatting", false,
+            "Have the thread of --logger-async-buffer-size format the messages whose arguments are numbers, "
+            "enums, pointers or strings, the shards only copying them.")
     , log_with_color(*this, "log-with-color", isatty(STDOUT_FILENO), "Print colored tag prefix in log message written to ostream")
 {
 }
@@ -632,6 +996,8 @@ logging_settings extract_settings(const options& opts) {
         opts.log_with_color.get_value(),
         opts.logger_stdout_timestamps.get_value(),
         opts.logger_ostream_type.get_value(),
+        opts.logger_async_buffer_size.get_value(),
+        opts.logger_async_defer_formatting.get_value(),
     };
 }
 
@@ -21,13 +21,17 @@
 
 #ifdef SEASTAR_MODULE
 module;
+#include <string_view>
 #include <utility>
 #include <vector>
 module seastar;
 #else
+#include <string_view>
 #include <seastar/core/future.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/short_streams.hh>
+#include <seastar/util/string_utils.hh>
 #endif
 
 namespace seastar {
@@ -66,6 +70,33 @@ future<sstring> read_entire_stream_contiguous(input_stream<char>& inp) {
     });
 };
 
+future<sstring> read_line(input_stream<char>& inp) {
+    using consumption_result_type = consumption_result<char>;
+    return do_with(sstring(), [&inp] (sstring& line) {
+        return inp.consume([&line] (temporary_buffer<char> buf) {
+            if (buf.empty()) {
+                return make_ready_future<consumption_result_type>(stop_consuming(std::move(buf)));
+            }
+            // The CR may end the previous buffer
+            if (!line.empty() && line.back() == '\r' && buf[0] == '\n') {
+                line.resize(line.size() - 1);
+                buf.trim_front(1);
+                return make_ready_future<consumption_result_type>(stop_consuming(std::move(buf)));
+            }
+            auto pos = internal::find_crlf(std::string_view(buf.get(), buf.size()));
+            if (pos == std::string_view::npos) {
+                line += sstring(buf.get(), buf.size());
+                return make_ready_future<consumption_result_type>(continue_consuming());
+            }
+            line += sstring(buf.get(), pos);
+            buf.trim_front(pos + 2);
+            return make_ready_future<consumption_result_type>(stop_consuming(std::move(buf)));
+        }).then([&line] {
+            return std::move(line);
+        });
+    });
+}
+
 future<> skip_entire_stream(input_stream<char>& inp) {
     return inp.consume([] (temporary_buffer<char> tmp) {
         return tmp.empty() ? make_ready_future<consumption_result<char>>(stop_consuming(temporary_buffer<char>()))
@@ -0,0 +1,214 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/util/string_utils.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+static inline char ascii_lower(char c) noexcept {
+    return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+// 16 bytes at a time, with the comparisons yielding a mask of the bytes
+// matching, which bits() turns into bits_per_byte bits each
+
+static constexpr size_t width = 16;
+
+#if defined(__x86_64__)
+
+using bytes = __m128i;
+static constexpr unsigned bits_per_byte = 1;
+static constexpr uint64_t all_bits = 0xffff;
+
+static inline bytes load(const char* p) noexcept {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+static inline void store(char* p, bytes v) noexcept {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+static inline bytes splat(char c) noexcept {
+    return _mm_set1_epi8(c);
+}
+static inline bytes eq(bytes a, bytes b) noexcept {
+    return _mm_cmpeq_epi8(a, b);
+}
+static inline bytes either(bytes a, bytes b) noexcept {
+    return _mm_or_si128(a, b);
+}
+static inline bytes both(bytes a, bytes b) noexcept {
+    return _mm_and_si128(a, b);
+}
+static inline uint64_t bits(bytes m) noexcept {
+    return uint32_t(_mm_movemask_epi8(m));
+}
+static inline bytes lower(bytes v) noexcept {
+    // The comparisons are signed, the bytes from 0x80 being below 'A'
+    auto upper = both(_mm_cmpgt_epi8(v, splat('A' - 1)), _mm_cmplt_epi8(v, splat('Z' + 1)));
+    return either(v, both(upper, splat(0x20)));
+}
+
+#else
+
+using bytes = uint8x16_t;
+// NEON has no movemask; narrowing the 16 bit lanes by 4 keeps a nibble of
+// each byte
+static constexpr unsigned bits_per_byte = 4;
+static constexpr uint64_t all_bits = ~uint64_t(0);
+
+static inline bytes load(const char* p) noexcept {
+    return vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+}
+static inline void store(char* p, bytes v) noexcept {
+    vst1q_u8(reinterpret_cast<uint8_t*>(p), v);
+}
+static inline bytes splat(char c) noexcept {
+    return vdupq_n_u8(uint8_t(c));
+}
+static inline bytes eq(bytes a, bytes b) noexcept {
+    return vceqq_u8(a, b);
+}
+static inline bytes either(bytes a, bytes b) noexcept {
+    return vorrq_u8(a, b);
+}
+static inline bytes both(bytes a, bytes b) noexcept {
+    return vandq_u8(a, b);
+}
+static inline uint64_t bits(bytes m) noexcept {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+static inline bytes lower(bytes v) noexcept {
+    auto upper = both(vcgeq_u8(v, splat('A')), vcleq_u8(v, splat('Z')));
+    return either(v, both(upper, splat(0x20)));
+}
+
+#endif
+
+static inline size_t first_byte(uint64_t b) noexcept {
+    return std::countr_zero(b) / bits_per_byte;
+}
+
+#endif
+
+size_t find_first_of(std::string_view s, std::string_view chars) noexcept {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__aarch64__)
+    static constexpr size_t max_chars = 8;
+    if (chars.size() && chars.size() <= max_chars) {
+        bytes sets[max_chars];
+        for (size_t j = 0; j != chars.size(); ++j) {
+            sets[j] = splat(chars[j]);
+        }
+        for (; i + width <= s.size(); i += width) {
+            auto v = load(s.data() + i);
+            auto m = eq(v, sets[0]);
+            for (size_t j = 1; j != chars.size(); ++j) {
+                m = either(m, eq(v, sets[j]));
+            }
+            if (auto b = bits(m)) {
+                return i + first_byte(b);
+            }
+        }
+    }
+#endif
+    for (; i < s.size(); ++i) {
+        if (chars.find(s[i]) != std::string_view::npos) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+size_t find_crlf(std::string_view s) noexcept {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__aarch64__)
+    const auto cr = splat('\r');
+    const auto lf = splat('\n');
+    for (; i + width < s.size(); i += width) {
+        auto m = both(eq(load(s.data() + i), cr), eq(load(s.data() + i + 1), lf));
+        if (auto b = bits(m)) {
+            return i + first_byte(b);
+        }
+    }
+#endif
+    for (; i + 1 < s.size(); ++i) {
+        if (s[i] == '\r' && s[i + 1] == '\n') {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+bool case_insensitive_equal(std::string_view a, std::string_view b) noexcept {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__aarch64__)
+    for (; i + width <= a.size(); i += width) {
+        if (bits(eq(lower(load(a.data() + i)), lower(load(b.data() + i)))) != all_bits) {
+            return false;
+        }
+    }
+#endif
+    for (; i < a.size(); ++i) {
+        if (ascii_lower(a[i]) != ascii_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ascii_to_lower(char* p, size_t n) noexcept {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__aarch64__)
+    for (; i + width <= n; i += width) {
+        store(p + i, lower(load(p + i)));
+    }
+#endif
+    for (; i < n; ++i) {
+        p[i] = ascii_lower(p[i]);
+    }
+}
+
+}
+
+}
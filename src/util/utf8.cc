@@ -0,0 +1,412 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/util/utf8.hh>
+#endif
+
+namespace seastar {
+
+namespace {
+
+// The vector kernels check whole text, a block at a time, with the lookup
+// algorithm of Keiser and Lemire ("Validating UTF-8 In Less Than One
+// Instruction Per Byte", 2021): the error classes of each pair of
+// consecutive bytes are looked up by the high nibble of the first, its low
+// nibble and the high nibble of the second, and and-ed together; the bytes
+// which must be the third or fourth of a sequence are checked separately.
+using utf8_kernel = bool (*)(const unsigned char* data, size_t len) noexcept;
+
+constexpr size_t kernel_min_len = 64;
+
+// The length of the sequence a byte starts, 0 if it can't start one
+unsigned sequence_length(unsigned char c) noexcept {
+    if (c < 0x80) {
+        return 1;
+    } else if (c < 0xc2) {
+        // A continuation byte, or the lead of an overlong form
+        return 0;
+    } else if (c < 0xe0) {
+        return 2;
+    } else if (c < 0xf0) {
+        return 3;
+    } else if (c < 0xf5) {
+        return 4;
+    }
+    return 0;
+}
+
+bool validate_scalar(const unsigned char* p, size_t len) noexcept {
+    auto end = p + len;
+    while (p != end) {
+        if (end - p >= 8) {
+            // Skip ASCII a word at a time
+            uint64_t w;
+            std::memcpy(&w, p, sizeof(w));
+            if (!(w & 0x8080808080808080)) {
+                p += 8;
+                continue;
+            }
+        }
+        unsigned char c = *p;
+        if (c < 0x80) {
+            ++p;
+            continue;
+        }
+        auto n = sequence_length(c);
+        if (!n || size_t(end - p) < n) {
+            return false;
+        }
+        // The second byte range excludes overlong forms, surrogates and
+        // code points beyond U+10FFFF
+        unsigned char lo = 0x80, hi = 0xbf;
+        if (c == 0xe0) {
+            lo = 0xa0;
+        } else if (c == 0xed) {
+            hi = 0x9f;
+        } else if (c == 0xf0) {
+            lo = 0x90;
+        } else if (c == 0xf4) {
+            hi = 0x8f;
+        }
+        if (p[1] < lo || p[1] > hi) {
+            return false;
+        }
+        for (unsigned i = 2; i < n; ++i) {
+            if ((p[i] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        p += n;
+    }
+    return true;
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+// Error classes of a pair of bytes
+constexpr uint8_t too_short = 1 << 0;  // 11______ 0_______ or 11______ 11______
+constexpr uint8_t too_long = 1 << 1;   // 0_______ 10______
+constexpr uint8_t overlong_3 = 1 << 2; // 11100000 100_____
+constexpr uint8_t too_large = 1 << 3;  // 11110100 1001____, 11110100 101_____, 11110101+ 10______
+constexpr uint8_t surrogate = 1 << 4;  // 11101101 101_____
+constexpr uint8_t overlong_2 = 1 << 5; // 1100000_ 10______
+constexpr uint8_t too_large_1000 = 1 << 6; // 11110101+ 1000____
+constexpr uint8_t overlong_4 = 1 << 6; // 11110000 1000____
+constexpr uint8_t two_conts = 1 << 7;  // 10______ 10______
+constexpr uint8_t carry = too_short | too_long | two_conts;
+
+// By the high nibble of the first byte
+alignas(16) constexpr uint8_t byte_1_high[16] = {
+    too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+    two_conts, two_conts, two_conts, two_conts,
+    too_short | overlong_2,
+    too_short,
+    too_short | overlong_3 | surrogate,
+    too_short | too_large | too_large_1000 | overlong_4,
+};
+
+// By the low nibble of the first byte
+alignas(16) constexpr uint8_t byte_1_low[16] = {
+    carry | overlong_3 | overlong_2 | overlong_4,
+    carry | overlong_2,
+    carry,
+    carry,
+    carry | too_large,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000 | surrogate,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+};
+
+// By the high nibble of the second byte
+alignas(16) constexpr uint8_t byte_2_high[16] = {
+    too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_short, too_short, too_short, too_short,
+};
+
+#endif
+
+#if defined(__x86_64__)
+
+class avx2_checker {
+    __m256i _byte_1_high;
+    __m256i _byte_1_low;
+    __m256i _byte_2_high;
+    __m256i _prev_input = _mm256_setzero_si256();
+    __m256i _prev_incomplete = _mm256_setzero_si256();
+    __m256i _error = _mm256_setzero_si256();
+
+    [[gnu::target("avx2"), gnu::always_inline]]
+    static __m256i load_table(const uint8_t* table) noexcept {
+        return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+    }
+    [[gnu::target("avx2"), gnu::always_inline]]
+    static __m256i high_nibbles(__m256i v) noexcept {
+        return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+    }
+    // The bytes of v, preceded by the last n of prev
+    template <int N>
+    [[gnu::target("avx2"), gnu::always_inline]]
+    static __m256i preceding(__m256i v, __m256i prev) noexcept {
+        return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(prev, v, 0x21), 16 - N);
+    }
+public:
+    [[gnu::target("avx2")]]
+    avx2_checker() noexcept
+            : _byte_1_high(load_table(byte_1_high))
+            , _byte_1_low(load_table(byte_1_low))
+            , _byte_2_high(load_table(byte_2_high)) {
+    }
+    [[gnu::target("avx2"), gnu::always_inline]]
+    void check(const unsigned char* p) noexcept {
+        auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        if (!_mm256_movemask_epi8(input)) {
+            // All ASCII, fine unless the previous block ended in a sequence
+            _error = _mm256_or_si256(_error, _prev_incomplete);
+        } else {
+            auto prev1 = preceding<1>(input, _prev_input);
+            auto special_cases = _mm256_and_si256(
+                    _mm256_and_si256(
+                            _mm256_shuffle_epi8(_byte_1_high, high_nibbles(prev1)),
+                            _mm256_shuffle_epi8(_byte_1_low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+                    _mm256_shuffle_epi8(_byte_2_high, high_nibbles(input)));
+            auto third = _mm256_subs_epu8(preceding<2>(input, _prev_input), _mm256_set1_epi8(char(0xe0 - 0x80)));
+            auto fourth = _mm256_subs_epu8(preceding<3>(input, _prev_input), _mm256_set1_epi8(char(0xf0 - 0x80)));
+            auto must_be_continuation = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+            _error = _mm256_or_si256(_error, _mm256_xor_si256(must_be_continuation, special_cases));
+            // Leads of the last three bytes which need more bytes
+            _prev_incomplete = _mm256_subs_epu8(input, _mm256_setr_epi8(
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    char(0xf0 - 1), char(0xe0 - 1), char(0xc0 - 1)));
+        }
+        _prev_input = input;
+    }
+    [[gnu::target("avx2")]]
+    bool valid() const noexcept {
+        return _mm256_testz_si256(_mm256_or_si256(_error, _prev_incomplete), _mm256_or_si256(_error, _prev_incomplete));
+    }
+};
+
+[[gnu::target("avx2")]]
+bool validate_avx2(const unsigned char* p, size_t len) noexcept {
+    constexpr size_t block = 32;
+    avx2_checker checker;
+    size_t i = 0;
+    for (; i + block <= len; i += block) {
+        checker.check(p + i);
+    }
+    if (i != len) {
+        // Padded with ASCII, which tells a truncated sequence at the end
+        unsigned char tail[block] = {};
+        std::memcpy(tail, p + i, len - i);
+        checker.check(tail);
+    }
+    return checker.valid();
+}
+
+#elif defined(__aarch64__)
+
+class neon_checker {
+    uint8x16_t _byte_1_high = vld1q_u8(byte_1_high);
+    uint8x16_t _byte_1_low = vld1q_u8(byte_1_low);
+    uint8x16_t _byte_2_high = vld1q_u8(byte_2_high);
+    uint8x16_t _prev_input = vdupq_n_u8(0);
+    uint8x16_t _prev_incomplete = vdupq_n_u8(0);
+    uint8x16_t _error = vdupq_n_u8(0);
+public:
+    void check(const unsigned char* p) noexcept {
+        auto input = vld1q_u8(p);
+        if (vmaxvq_u8(input) < 0x80) {
+            // All ASCII, fine unless the previous block ended in a sequence
+            _error = vorrq_u8(_error, _prev_incomplete);
+        } else {
+            auto prev1 = vextq_u8(_prev_input, input, 16 - 1);
+            auto special_cases = vandq_u8(
+                    vandq_u8(
+                            vqtbl1q_u8(_byte_1_high, vshrq_n_u8(prev1, 4)),
+                            vqtbl1q_u8(_byte_1_low, vandq_u8(prev1, vdupq_n_u8(0x0f)))),
+                    vqtbl1q_u8(_byte_2_high, vshrq_n_u8(input, 4)));
+            auto third = vqsubq_u8(vextq_u8(_prev_input, input, 16 - 2), vdupq_n_u8(0xe0 - 0x80));
+            auto fourth = vqsubq_u8(vextq_u8(_prev_input, input, 16 - 3), vdupq_n_u8(0xf0 - 0x80));
+            auto must_be_continuation = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+            _error = vorrq_u8(_error, veorq_u8(must_be_continuation, special_cases));
+            // Leads of the last three bytes which need more bytes
+            static constexpr uint8_t max_values[16] = {
+                255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+                0xf0 - 1, 0xe0 - 1, 0xc0 - 1,
+            };
+            _prev_incomplete = vqsubq_u8(input, vld1q_u8(max_values));
+        }
+        _prev_input = input;
+    }
+    bool valid() const noexcept {
+        return vmaxvq_u8(vorrq_u8(_error, _prev_incomplete)) == 0;
+    }
+};
+
+bool validate_neon(const unsigned char* p, size_t len) noexcept {
+    constexpr size_t block = 16;
+    neon_checker checker;
+    size_t i = 0;
+    for (; i + block <= len; i += block) {
+        checker.check(p + i);
+    }
+    if (i != len) {
+        // Padded with ASCII, which tells a truncated sequence at the end
+        unsigned char tail[block] = {};
+        std::memcpy(tail, p + i, len - i);
+        checker.check(tail);
+    }
+    return checker.valid();
+}
+
+#endif
+
+utf8_kernel kernel_for(internal::utf8_isa isa) noexcept {
+    using internal::utf8_isa;
+    switch (isa) {
+    case utf8_isa::scalar:
+        return validate_scalar;
+#if defined(__x86_64__)
+    case utf8_isa::avx2:
+        return __builtin_cpu_supports("avx2") ? validate_avx2 : nullptr;
+#elif defined(__aarch64__)
+    case utf8_isa::neon:
+        return validate_neon;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+utf8_kernel best_kernel() noexcept {
+    using internal::utf8_isa;
+    for (auto isa : {utf8_isa::avx2, utf8_isa::neon}) {
+        if (auto k = kernel_for(isa)) {
+            return k;
+        }
+    }
+    return validate_scalar;
+}
+
+utf8_kernel& active_kernel() noexcept {
+    static utf8_kernel kernel = best_kernel();
+    return kernel;
+}
+
+}
+
+namespace internal {
+
+bool use_utf8_isa(utf8_isa isa) noexcept {
+    auto k = kernel_for(isa);
+    if (!k) {
+        return false;
+    }
+    active_kernel() = k;
+    return true;
+}
+
+}
+
+bool is_valid_utf8(const char* data, size_t len) noexcept {
+    auto p = reinterpret_cast<const unsigned char*>(data);
+    if (len < kernel_min_len) {
+        return validate_scalar(p, len);
+    }
+    return active_kernel()(p, len);
+}
+
+bool utf8_validator::feed(const char* data, size_t len) noexcept {
+    if (!_valid) {
+        return false;
+    }
+    auto p = reinterpret_cast<const unsigned char*>(data);
+    auto end = p + len;
+    if (_pending_len) {
+        // Complete the code point the previous piece ended in the middle of
+        auto n = sequence_length(_pending[0]);
+        while (_pending_len < n && p != end) {
+            _pending[_pending_len++] = *p++;
+        }
+        if (_pending_len < n) {
+            return true;
+        }
+        _pending_len = 0;
+        if (!validate_scalar(_pending, n)) {
+            return _valid = false;
+        }
+    }
+    // Hold back a code point this piece ends in the middle of
+    auto split = end;
+    for (auto q = end; q != p && end - q < 3; ) {
+        --q;
+        if ((*q & 0xc0) != 0x80) {
+            auto n = sequence_length(*q);
+            if (n > size_t(end - q)) {
+                split = q;
+            }
+            break;
+        }
+    }
+    if (!is_valid_utf8(reinterpret_cast<const char*>(p), split - p)) {
+        return _valid = false;
+    }
+    _pending_len = end - split;
+    std::memcpy(_pending, split, _pending_len);
+    return true;
+}
+
+bool utf8_validator::finish() noexcept {
+    bool ok = _valid && !_pending_len;
+    reset();
+    return ok;
+}
+
+}
@@ -29,6 +29,18 @@
 #include <seastar/http/request.hh>
 #include <gnutls/crypto.h>
 #include <gnutls/gnutls.h>
+#include <charconv>
+#include <limits>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#ifdef SEASTAR_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 namespace seastar::experimental::websocket {
 
@@ -42,6 +54,333 @@ static sstring http_upgrade_reply_template =
 
 static logger wlogger("websocket");
 
+namespace {
+
+// XORs the payload with the masking key, as repeated over a 64-bit word.
+// The kernels go a vector at a time, over a multiple of kernel_block bytes.
+using unmask_kernel = void (*)(char* p, size_t len, uint64_t mask) noexcept;
+
+constexpr size_t kernel_block = 32;
+
+void unmask_words(char* p, size_t len, uint64_t mask) noexcept {
+    for (size_t i = 0; i < len; i += sizeof(mask)) {
+        uint64_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        w ^= mask;
+        std::memcpy(p + i, &w, sizeof(w));
+    }
+}
+
+#if defined(__x86_64__)
+
+void unmask_sse2(char* p, size_t len, uint64_t mask) noexcept {
+    auto m = _mm_set1_epi64x(mask);
+    for (size_t i = 0; i < len; i += 16) {
+        auto v = reinterpret_cast<__m128i*>(p + i);
+        _mm_storeu_si128(v, _mm_xor_si128(_mm_loadu_si128(v), m));
+    }
+}
+
+[[gnu::target("avx2")]]
+void unmask_avx2(char* p, size_t len, uint64_t mask) noexcept {
+    auto m = _mm256_set1_epi64x(mask);
+    for (size_t i = 0; i < len; i += 32) {
+        auto v = reinterpret_cast<__m256i*>(p + i);
+        _mm256_storeu_si256(v, _mm256_xor_si256(_mm256_loadu_si256(v), m));
+    }
+}
+
+#elif defined(__aarch64__)
+
+void unmask_neon(char* p, size_t len, uint64_t mask) noexcept {
+    auto m = vreinterpretq_u8_u64(vdupq_n_u64(mask));
+    for (size_t i = 0; i < len; i += 16) {
+        auto v = reinterpret_cast<uint8_t*>(p + i);
+        vst1q_u8(v, veorq_u8(vld1q_u8(v), m));
+    }
+}
+
+#endif
+
+unmask_kernel best_unmask_kernel() noexcept {
+#if defined(__x86_64__)
+    return __builtin_cpu_supports("avx2") ? unmask_avx2 : unmask_sse2;
+#elif defined(__aarch64__)
+    return unmask_neon;
+#else
+    return unmask_words;
+#endif
+}
+
+// key holds the bytes of the mask in the order they apply to p
+void unmask(char* p, size_t len, uint32_t key) noexcept {
+    static const unmask_kernel kernel = best_unmask_kernel();
+    uint32_t k = cpu_to_be(key);
+    uint64_t mask = (uint64_t(k) << 32) | k;
+    size_t i = len & ~(kernel_block - 1);
+    kernel(p, i, mask);
+    // The key is word aligned with the rest, which is left to the bytes
+    for (; i < len; ++i) {
+        p[i] ^= static_cast<char>((key << ((i % 4) * 8)) >> 24);
+    }
+}
+
+}
+
+// The header of a frame of the server, which is not masked
+static temporary_buffer<char> make_frame_header(opcodes opcode, bool compressed, size_t size) {
+    temporary_buffer<char> header(10);
+    auto h = header.get_write();
+    h[0] = char(0x80 | (compressed ? 0x40 : 0) | opcode);
+    size_t header_size = 2;
+    if ((126 <= size) && (size <= std::numeric_limits<uint16_t>::max())) {
+        h[1] = 0x7E;
+        write_be<uint16_t>(h + 2, size);
+        header_size += sizeof(uint16_t);
+    } else if (std::numeric_limits<uint16_t>::max() < size) {
+        h[1] = 0x7F;
+        write_be<uint64_t>(h + 2, size);
+        header_size += sizeof(uint64_t);
+    } else {
+        h[1] = uint8_t(size);
+    }
+    header.trim(header_size);
+    return header;
+}
+
+#ifdef SEASTAR_HAVE_ZLIB
+
+namespace {
+
+constexpr size_t chunk_size = 16 * 1024;
+
+// The raw deflate streams of permessage-deflate (RFC 7692), the messages
+// being compressed, and decompressed, one after the other into one stream
+class deflater {
+    z_stream _strm = {};
+public:
+    deflater(int level, int window_bits) {
+        if (deflateInit2(&_strm, level, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::bad_alloc();
+        }
+    }
+    deflater(const deflater&) = delete;
+    ~deflater() {
+        deflateEnd(&_strm);
+    }
+    // Compresses a message, without the 00 00 ff ff ending the flush, which
+    // the peer adds back
+    temporary_buffer<char> compress(const char* data, size_t size) {
+        temporary_buffer<char> out(deflateBound(&_strm, size) + 16);
+        _strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _strm.avail_in = size;
+        size_t done = 0;
+        for (;;) {
+            _strm.next_out = reinterpret_cast<Bytef*>(out.get_write() + done);
+            _strm.avail_out = out.size() - done;
+            if (::deflate(&_strm, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+                throw websocket::exception("zlib compression failure");
+            }
+            done = out.size() - _strm.avail_out;
+            if (_strm.avail_out) {
+                break;
+            }
+            temporary_buffer<char> bigger(out.size() * 2);
+            std::copy_n(out.get(), done, bigger.get_write());
+            out = std::move(bigger);
+        }
+        out.trim(done - 4);
+        return out;
+    }
+    // Forgets the previous messages
+    void reset() {
+        deflateReset(&_strm);
+    }
+};
+
+class inflater {
+    z_stream _strm = {};
+    // The last output was full, inflate() may have more of it
+    bool _full = false;
+public:
+    inflater() {
+        if (inflateInit2(&_strm, -15) != Z_OK) {
+            throw std::bad_alloc();
+        }
+    }
+    inflater(const inflater&) = delete;
+    ~inflater() {
+        inflateEnd(&_strm);
+    }
+    // Takes the input to decompress, which must outlive the calls to
+    // decompress() until all of it has been
+    void feed(const char* data, size_t size) noexcept {
+        _strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _strm.avail_in = size;
+    }
+    // Feeds the end of a message, the flush the sender stripped
+    void end_message() noexcept {
+        static const char trailer[] = {'\x00', '\x00', '\xff', '\xff'};
+        feed(trailer, sizeof(trailer));
+    }
+    // Whether some of the input fed has not been decompressed yet
+    bool pending() const noexcept {
+        return _strm.avail_in || _full;
+    }
+    // Decompresses at most max bytes of the input fed, for a small input
+    // not to make a message of any size at once
+    temporary_buffer<char> decompress(size_t max) {
+        temporary_buffer<char> buf(max);
+        _strm.next_out = reinterpret_cast<Bytef*>(buf.get_write());
+        _strm.avail_out = buf.size();
+        auto r = inflate(&_strm, Z_NO_FLUSH);
+        if (r != Z_OK && r != Z_BUF_ERROR && r != Z_STREAM_END) {
+            throw websocket::exception(fmt::format("Malformed compressed message: {}", _strm.msg ? _strm.msg : "zlib error"));
+        }
+        buf.trim(buf.size() - _strm.avail_out);
+        _full = _strm.avail_out == 0;
+        if (r == Z_STREAM_END) {
+            // The sender ended the stream with the message, the next
+            // one starting a new one
+            inflateReset(&_strm);
+            _strm.avail_in = 0;
+            _full = false;
+        } else if (r == Z_BUF_ERROR && !_full) {
+            // No progress is possible on the input left
+            _strm.avail_in = 0;
+        }
+        return buf;
+    }
+};
+
+// The parameters of a permessage-deflate offer (RFC 7692 section 7.1)
+struct deflate_offer {
+    bool server_no_context_takeover = false;
+    std::optional<int> server_max_window_bits;
+};
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+std::optional<int> parse_window_bits(std::string_view v, int min) {
+    int bits = 0;
+    auto [p, ec] = std::from_chars(v.data(), v.data() + v.size(), bits);
+    if (ec != std::errc() || p != v.data() + v.size() || bits < min || bits > 15) {
+        return std::nullopt;
+    }
+    return bits;
+}
+
+// The parameters of the first permessage-deflate offer of the
+// Sec-WebSocket-Extensions header the server can accept, zlib not
+// compressing with a window of 8 bits
+std::optional<deflate_offer> parse_deflate_offers(std::string_view extensions) {
+    while (!extensions.empty()) {
+        auto comma = extensions.find(',');
+        auto offer = extensions.substr(0, comma);
+        extensions = comma == std::string_view::npos ? std::string_view() : extensions.substr(comma + 1);
+        auto semicolon = offer.find(';');
+        if (trim(offer.substr(0, semicolon)) != "permessage-deflate") {
+            continue;
+        }
+        deflate_offer o;
+        bool client_no_context_takeover = false;
+        bool client_max_window_bits = false;
+        bool ok = true;
+        while (ok && semicolon != std::string_view::npos) {
+            offer.remove_prefix(semicolon + 1);
+            semicolon = offer.find(';');
+            auto param = trim(offer.substr(0, semicolon));
+            auto eq = param.find('=');
+            auto name = trim(param.substr(0, eq));
+            std::optional<std::string_view> value;
+            if (eq != std::string_view::npos) {
+                auto v = trim(param.substr(eq + 1));
+                if (v.size() >= 2 && v.front() == '"' && v.back() == '"') {
+                    v = v.substr(1, v.size() - 2);
+                }
+                value = v;
+            }
+            if (name == "server_no_context_takeover" && !value && !o.server_no_context_takeover) {
+                o.server_no_context_takeover = true;
+            } else if (name == "client_no_context_takeover" && !value && !client_no_context_takeover) {
+                client_no_context_takeover = true;
+            } else if (name == "server_max_window_bits" && value && !o.server_max_window_bits) {
+                o.server_max_window_bits = parse_window_bits(*value, 9);
+                ok = bool(o.server_max_window_bits);
+            } else if (name == "client_max_window_bits" && !client_max_window_bits) {
+                // The server decompresses with any window
+                client_max_window_bits = true;
+                ok = !value || parse_window_bits(*value, 8);
+            } else {
+                ok = false;
+            }
+        }
+        if (ok) {
+            return o;
+        }
+    }
+    return std::nullopt;
+}
+
+}
+
+#endif
+
+class connection::deflate_state {
+public:
+    deflate_config cfg;
+    bool server_context_takeover;
+    int server_window_bits;
+#ifdef SEASTAR_HAVE_ZLIB
+    deflater out;
+    inflater in;
+    // Decompressed bytes of the message being received
+    size_t inflated = 0;
+
+    deflate_state(const deflate_config& c, bool takeover, int window_bits)
+            : cfg(c)
+            , server_context_takeover(takeover)
+            , server_window_bits(window_bits)
+            , out(c.level, window_bits) {
+    }
+#endif
+};
+
+message::message(temporary_buffer<char> payload, opcodes opcode)
+        : _opcode(opcode)
+        , _header(make_frame_header(opcode, false, payload.size()))
+        , _payload(std::move(payload)) {
+}
+
+message message::share() {
+    message m;
+    m._opcode = _opcode;
+    m._header = _header.share();
+    m._payload = _payload.share();
+    m._deflated = _deflated;
+    m._deflated_header = _deflated_header.share();
+    m._deflated_payload = _deflated_payload.share();
+    return m;
+}
+
+void message::deflate(int level) {
+#ifdef SEASTAR_HAVE_ZLIB
+    // With a context of its own, for any connection to decompress
+    deflater d(level, 15);
+    _deflated_payload = d.compress(_payload.get(), _payload.size());
+    _deflated_header = make_frame_header(_opcode, true, _deflated_payload.size());
+    _deflated = true;
+#endif
+}
+
 opcodes websocket_parser::opcode() const {
     if (_header) {
         return opcodes(_header->opcode);
@@ -50,6 +389,16 @@ opcodes websocket_parser::opcode() const {
     }
 }
 
+void websocket_parser::remove_mask(buff_t& p, size_t n) {
+    unmask(p.get_write(), n, _masking_key);
+    // The rest of the payload goes on with the byte of the key after that
+    // of the last byte
+    auto shift = (n % 4) * 8;
+    if (shift) {
+        _masking_key = (_masking_key << shift) | (_masking_key >> (32 - shift));
+    }
+}
+
 websocket_parser::buff_t websocket_parser::result() {
     return std::move(_result);
 }
@@ -110,6 +459,21 @@ future<> server::stop() {
     });
 }
 
+connection::connection(server& server, connected_socket&& fd)
+    : _server(server)
+    , _fd(std::move(fd))
+    , _read_buf(_fd.input())
+    , _write_buf(_fd.output())
+    , _input_buffer{PIPE_SIZE}
+    , _output_buffer{PIPE_SIZE}
+{
+    _input = input_stream<char>{data_source{
+            std::make_unique<connection_source_impl>(&_input_buffer)}};
+    _output = output_stream<char>{data_sink{
+            std::make_unique<connection_sink_impl>(&_output_buffer)}};
+    on_new_connection();
+}
+
 connection::~connection() {
     _server._connections.erase(_server._connections.iterator_to(*this));
 }
@@ -184,12 +548,19 @@ future<> connection::read_http_upgrade_request() {
         std::string sha1_output = sha1_base64(sha1_input);
         wlogger.debug("SHA1 output: {} of size {}", sha1_output, sha1_output.size());
 
+        sstring extensions = negotiate_deflate(req->get_header("Sec-WebSocket-Extensions"));
+
         return _write_buf.write(http_upgrade_reply_template).then([this, sha1_output = std::move(sha1_output)] {
             return _write_buf.write(sha1_output);
         }).then([this] {
             return _write_buf.write("\r\nSec-WebSocket-Protocol: ", 26);
         }).then([this] {
             return _write_buf.write(_subprotocol);
+        }).then([this, extensions = std::move(extensions)] {
+            if (extensions.empty()) {
+                return make_ready_future<>();
+            }
+            return _write_buf.write("\r\nSec-WebSocket-Extensions: " + extensions);
         }).then([this] {
             return _write_buf.write("\r\n\r\n", 4);
         }).then([this] {
@@ -216,14 +587,21 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
 
                 // https://datatracker.ietf.org/doc/html/rfc6455#section-5.1
                 // We must close the connection if data isn't masked.
+                bool starts_message = _header->opcode == opcodes::TEXT || _header->opcode == opcodes::BINARY;
                 if ((!_header->masked) ||
-                        // RSVX must be 0
-                        (_header->rsv1 | _header->rsv2 | _header->rsv3) ||
+                        // RSVX must be 0, but RSV1 of the first frame of a
+                        // compressed message (RFC 7692 section 6)
+                        (_header->rsv2 | _header->rsv3) ||
+                        (_header->rsv1 && !(_deflate && starts_message)) ||
                         // Opcode must be known.
                         (!_header->is_opcode_known())) {
                     _cstate = connection_state::error;
                     return websocket_parser::stop(std::move(data));
                 }
+                if (starts_message) {
+                    _compressed = _header->rsv1;
+                    _text = _header->opcode == opcodes::TEXT;
+                }
             }
             _state = parsing_state::payload_length_and_mask;
         } else {
@@ -261,9 +639,11 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
             _payload_length -= data.size();
             remove_mask(data, data.size());
             _result = std::move(data);
+            _frame_done = false;
             return websocket_parser::stop(buff_t(0));
         } else {
-            _result = data.clone();
+            _frame_done = true;
+            _result = buff_t(data.get(), _payload_length);
             remove_mask(_result, _payload_length);
             data.trim_front(_payload_length);
             _payload_length = 0;
@@ -295,6 +675,16 @@ future<> connection::read_one() {
                 case opcodes::CONTINUATION:
                 case opcodes::TEXT:
                 case opcodes::BINARY:
+                    if (_deflate && _websocket_parser.compressed()) {
+                        return push_inflated(_websocket_parser.result(), _websocket_parser.end_of_message(), _websocket_parser.text());
+                    }
+                    if (_websocket_parser.text()) {
+                        auto data = _websocket_parser.result();
+                        if (!check_text(data, _websocket_parser.end_of_message())) {
+                            return close(true);
+                        }
+                        return _input_buffer.push_eventually(std::move(data));
+                    }
                     return _input_buffer.push_eventually(_websocket_parser.result());
                 case opcodes::CLOSE:
                     wlogger.debug("Received close frame.");
@@ -354,44 +744,169 @@ future<> connection::close(bool send_close) {
     });
 }
 
-future<> connection::send_data(opcodes opcode, temporary_buffer<char>&& buff) {
-    char header[10] = {'\x80', 0};
-    size_t header_size = 2;
-
-    header[0] += opcode;
-
-    if ((126 <= buff.size()) && (buff.size() <= std::numeric_limits<uint16_t>::max())) {
-        header[1] = 0x7E;
-        write_be<uint16_t>(header + 2, buff.size());
-        header_size += sizeof(uint16_t);
-    } else if (std::numeric_limits<uint16_t>::max() < buff.size()) {
-        header[1] = 0x7F;
-        write_be<uint64_t>(header + 2, buff.size());
-        header_size += sizeof(uint64_t);
-    } else {
-        header[1] = uint8_t(buff.size());
-    }
+future<> connection::close_with_status(uint16_t status_code) {
+    temporary_buffer<char> payload(2);
+    write_be<uint16_t>(payload.get_write(), status_code);
+    return send_data(opcodes::CLOSE, std::move(payload)).finally([this] {
+        return close(false);
+    });
+}
 
+future<> connection::write_frame(opcodes opcode, bool compressed, temporary_buffer<char>&& buff) {
     scattered_message<char> msg;
-    msg.append(sstring(header, header_size));
+    msg.append(make_frame_header(opcode, compressed, buff.size()));
     msg.append(std::move(buff));
-    return _write_buf.write(std::move(msg)).then([this] {
+    return _write_buf.write(std::move(msg));
+}
+
+future<> connection::send_data(opcodes opcode, temporary_buffer<char>&& buff) {
+    return write_frame(opcode, false, std::move(buff)).then([this] {
         return _write_buf.flush();
     });
 }
 
+future<> connection::write_outgoing(outgoing o) {
+    if (o.shared) {
+        auto& m = *o.shared;
+        scattered_message<char> msg;
+#ifdef SEASTAR_HAVE_ZLIB
+        // A message larger than the window of the peer may refer too
+        // far back
+        if (_deflate && m._deflated && m.size() <= (size_t(1) << _deflate->server_window_bits)) {
+            // The context of the peer now has a message the compressor
+            // did not see
+            if (_deflate->server_context_takeover) {
+                _deflate->out.reset();
+            }
+            msg.append(std::move(m._deflated_header));
+            msg.append(std::move(m._deflated_payload));
+            return _write_buf.write(std::move(msg));
+        }
+#endif
+        msg.append(std::move(m._header));
+        msg.append(std::move(m._payload));
+        return _write_buf.write(std::move(msg));
+    }
+#ifdef SEASTAR_HAVE_ZLIB
+    if (_deflate && o.payload.size() >= _deflate->cfg.min_size) {
+        auto deflated = _deflate->out.compress(o.payload.get(), o.payload.size());
+        if (!_deflate->server_context_takeover) {
+            _deflate->out.reset();
+        }
+        return write_frame(opcodes::BINARY, true, std::move(deflated));
+    }
+#endif
+    return write_frame(opcodes::BINARY, false, std::move(o.payload));
+}
+
 future<> connection::response_loop() {
     return do_until([this] {return _done;}, [this] {
         // FIXME: implement error handling
-        return _output_buffer.pop_eventually().then([this] (
-                temporary_buffer<char> buf) {
-            return send_data(opcodes::BINARY, std::move(buf));
+        return _output_buffer.pop_eventually().then([this] (outgoing o) {
+            return write_outgoing(std::move(o));
+        }).then([this] {
+            // Writes the messages queued meanwhile with it, to flush once
+            return do_with(size_t(1), [this] (size_t& batched) {
+                return do_until([this, &batched] { return _output_buffer.empty() || batched++ == PIPE_SIZE; }, [this] {
+                    return write_outgoing(_output_buffer.pop());
+                });
+            });
+        }).then([this] {
+            return _write_buf.flush();
         });
     }).finally([this]() {
         return _write_buf.close();
     });
 }
 
+sstring connection::negotiate_deflate(const sstring& extensions) {
+#ifdef SEASTAR_HAVE_ZLIB
+    if (!_server._deflate) {
+        return {};
+    }
+    auto offer = parse_deflate_offers(extensions);
+    if (!offer) {
+        return {};
+    }
+    auto& cfg = *_server._deflate;
+    bool takeover = cfg.server_context_takeover && !offer->server_no_context_takeover;
+    int window_bits = offer->server_max_window_bits.value_or(15);
+    _deflate = std::make_unique<deflate_state>(cfg, takeover, window_bits);
+    _websocket_parser.allow_compression();
+    sstring res = "permessage-deflate";
+    if (!takeover) {
+        res += "; server_no_context_takeover";
+    }
+    if (!cfg.client_context_takeover) {
+        res += "; client_no_context_takeover";
+    }
+    if (offer->server_max_window_bits) {
+        res += format("; server_max_window_bits={}", window_bits);
+    }
+    wlogger.debug("Sec-WebSocket-Extensions: {}", res);
+    return res;
+#else
+    return {};
+#endif
+}
+
+bool connection::check_text(const temporary_buffer<char>& data, bool end_of_message) noexcept {
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-8.1
+    bool valid = _utf8.feed(data.get(), data.size());
+    if (end_of_message) {
+        valid = _utf8.finish() && valid;
+    }
+    if (!valid) {
+        wlogger.debug("Received invalid UTF-8 text.");
+    }
+    return valid;
+}
+
+future<> connection::push_inflated(temporary_buffer<char> data, bool end_of_message, bool text) {
+#ifdef SEASTAR_HAVE_ZLIB
+    _deflate->in.feed(data.get(), data.size());
+    return do_with(std::move(data), false, [this, end_of_message, text] (temporary_buffer<char>&, bool& ended) {
+        // A piece at a time, the queue holding back a handler that does
+        // not keep up
+        return repeat([this, end_of_message, text, &ended] () -> future<stop_iteration> {
+            auto& st = *_deflate;
+            if (!st.in.pending()) {
+                if (!end_of_message || ended) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                ended = true;
+                st.in.end_message();
+            }
+            auto buf = st.in.decompress(chunk_size);
+            st.inflated += buf.size();
+            if (st.inflated > st.cfg.max_message_size) {
+                wlogger.debug("Received a compressed message larger than {} bytes.", st.cfg.max_message_size);
+                return close_with_status(1009).then([] {
+                    return stop_iteration::yes;
+                });
+            }
+            bool last = ended && !st.in.pending();
+            if (last) {
+                st.inflated = 0;
+            }
+            if (text && !check_text(buf, last)) {
+                return close(true).then([] {
+                    return stop_iteration::yes;
+                });
+            }
+            if (buf.empty()) {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            return _input_buffer.push_eventually(std::move(buf)).then([] {
+                return stop_iteration::no;
+            });
+        });
+    });
+#else
+    return make_ready_future<>();
+#endif
+}
+
 bool server::is_handler_registered(std::string const& name) {
     return _handlers.find(name) != _handlers.end();
 }
@@ -400,4 +915,24 @@ void server::register_handler(std::string&& name, handler_t handler) {
     _handlers[name] = handler;
 }
 
+void server::enable_permessage_deflate(deflate_config cfg) {
+    _deflate = cfg;
+}
+
+size_t server::broadcast(message msg, std::string_view subprotocol) {
+    size_t queued = 0;
+    for (auto& c : _connections) {
+        if (!c._handler || c._done || (!subprotocol.empty() && std::string_view(c._subprotocol) != subprotocol)) {
+            continue;
+        }
+        if (c._deflate && !msg._deflated && msg.size() >= c._deflate->cfg.min_size) {
+            msg.deflate(c._deflate->cfg.level);
+        }
+        if (c._output_buffer.push(connection::outgoing{{}, msg.share()})) {
+            ++queued;
+        }
+    }
+    return queued;
+}
+
 }
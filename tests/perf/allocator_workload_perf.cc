@@ -0,0 +1,349 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <random>
+#include <fmt/core.h>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/util/defer.hh>
+#include <unistd.h>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Churns a set of live objects on every shard, each step freeing one of
+// them and allocating a new one, with the sizes of a mix or of a recorded
+// trace, and reports the latency of the allocations and frees, the memory
+// use and the fragmentation as time goes by.
+//
+//  - A mix of sizes, with their weights:
+//      allocator_workload_perf -c4 --sizes 16:40 64:30 512:20 4096:9 65536:1
+//  - The sizes of a trace, one allocation size per line, optionally
+//    followed by the number of allocations of that size:
+//      allocator_workload_perf -c4 --trace sizes.txt --live 1000000
+//  - Objects freed by other shards than the ones that allocated them, as
+//    those passed from producers to consumers are:
+//      allocator_workload_perf -c4 --cross-shard-ratio 0.5
+//  - Large allocations mixed in:
+//      allocator_workload_perf -c4 --large-ratio 0.001 --large-max 16777216
+
+using clock_type = std::chrono::steady_clock;
+
+// Latencies in nanoseconds, within 1/16 of their value
+using latency_histogram = metrics::internal::approximate_exponential_histogram<16, uint64_t(1) << 30, 16>;
+
+class size_sampler {
+    std::vector<size_t> _sizes;
+    std::discrete_distribution<size_t> _pick;
+    double _large_ratio;
+    std::uniform_int_distribution<size_t> _large;
+    std::uniform_real_distribution<double> _uniform{0, 1};
+public:
+    size_sampler(std::vector<std::pair<size_t, double>> weighted, double large_ratio, size_t large_min, size_t large_max)
+        : _large_ratio(large_ratio)
+        , _large(large_min, large_max)
+    {
+        std::vector<double> weights;
+        for (auto& [size, weight] : weighted) {
+            _sizes.push_back(size);
+            weights.push_back(weight);
+        }
+        _pick = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng) {
+        if (_large_ratio && _uniform(rng) < _large_ratio) {
+            return _large(rng);
+        }
+        return _sizes[_pick(rng)];
+    }
+};
+
+struct interval_stats {
+    uint64_t ops = 0;
+    uint64_t cross_shard_frees = 0;
+    latency_histogram malloc_latency;
+    latency_histogram free_latency;
+    size_t allocated_memory = 0;
+    size_t free_memory = 0;
+    size_t largest_free_span = 0;
+    // Free memory outside the largest free span of each shard
+    size_t fragmented_free = 0;
+    // Memory of the small pools, and of it in free objects
+    size_t small_pool_memory = 0;
+    size_t small_pool_free = 0;
+
+    interval_stats& operator+=(const interval_stats& o) {
+        ops += o.ops;
+        cross_shard_frees += o.cross_shard_frees;
+        malloc_latency.merge(o.malloc_latency);
+        free_latency.merge(o.free_latency);
+        allocated_memory += o.allocated_memory;
+        free_memory += o.free_memory;
+        largest_free_span = std::max(largest_free_span, o.largest_free_span);
+        fragmented_free += o.fragmented_free;
+        small_pool_memory += o.small_pool_memory;
+        small_pool_free += o.small_pool_free;
+        return *this;
+    }
+};
+
+interval_stats operator+(interval_stats a, const interval_stats& b) {
+    return a += b;
+}
+
+class worker {
+public:
+    struct config {
+        std::vector<std::pair<size_t, double>> sizes;
+        size_t live;
+        double cross_shard_ratio;
+        double large_ratio;
+        size_t large_min;
+        size_t large_max;
+    };
+private:
+    static constexpr size_t cross_shard_batch = 256;
+    static constexpr unsigned ops_between_yields = 1024;
+
+    config _cfg;
+    std::mt19937_64 _rng;
+    size_sampler _sizes;
+    std::uniform_real_distribution<double> _uniform{0, 1};
+    std::vector<void*> _live;
+    // The objects for the other shards to free, by shard
+    std::vector<std::vector<void*>> _remote;
+    semaphore _remote_frees{16};
+    gate _remote_gate;
+    interval_stats _stats;
+    bool _stop = false;
+    future<> _done = make_ready_future<>();
+
+    void free_remotely(void* p) {
+        auto shard = (this_shard_id() + 1 + _rng() % (smp::count - 1)) % smp::count;
+        auto& batch = _remote[shard];
+        batch.push_back(p);
+        if (batch.size() < cross_shard_batch) {
+            return;
+        }
+        _stats.cross_shard_frees += batch.size();
+        (void)with_gate(_remote_gate, [this, shard, ptrs = std::exchange(batch, {})] () mutable {
+            return with_semaphore(_remote_frees, 1, [shard, ptrs = std::move(ptrs)] () mutable {
+                return smp::submit_to(shard, [ptrs = std::move(ptrs)] {
+                    for (auto p : ptrs) {
+                        std::free(p);
+                    }
+                });
+            });
+        });
+    }
+
+    void step() {
+        auto& slot = _live[_rng() % _live.size()];
+        if (slot) {
+            if (smp::count > 1 && _cfg.cross_shard_ratio && _uniform(_rng) < _cfg.cross_shard_ratio) {
+                free_remotely(std::exchange(slot, nullptr));
+            } else {
+                auto start = clock_type::now();
+                std::free(slot);
+                _stats.free_latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+            }
+        }
+        auto size = _sizes(_rng);
+        auto start = clock_type::now();
+        slot = std::malloc(size);
+        _stats.malloc_latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+        // Touch it, as its user would
+        *static_cast<volatile char*>(slot) = 0;
+        _stats.ops++;
+    }
+
+    future<> churn() {
+        while (!_stop) {
+            for (unsigned i = 0; i < ops_between_yields; i++) {
+                step();
+            }
+            co_await coroutine::maybe_yield();
+        }
+    }
+public:
+    explicit worker(config cfg)
+        : _cfg(std::move(cfg))
+        , _rng(std::random_device()())
+        , _sizes(_cfg.sizes, _cfg.large_ratio, _cfg.large_min, _cfg.large_max)
+        , _live(_cfg.live, nullptr)
+        , _remote(smp::count)
+    {}
+
+    future<> start() {
+        _done = churn();
+        return make_ready_future<>();
+    }
+
+    // The latencies since the last call, and the memory as of now
+    interval_stats collect() {
+        auto s = std::exchange(_stats, {});
+        auto st = memory::stats();
+        s.allocated_memory = st.allocated_memory();
+        s.free_memory = st.free_memory();
+        s.largest_free_span = memory::largest_free_span();
+        s.fragmented_free = s.free_memory - std::min(s.free_memory, s.largest_free_span);
+        for (unsigned i = 0; i < memory::small_pool_count(); i++) {
+            auto sp = memory::get_small_pool_statistics(i);
+            s.small_pool_memory += sp.memory;
+            s.small_pool_free += sp.free_objects * sp.object_size;
+        }
+        return s;
+    }
+
+    future<> stop() {
+        _stop = true;
+        co_await std::move(_done);
+        co_await _remote_gate.close();
+        for (auto& batch : _remote) {
+            for (auto p : batch) {
+                std::free(p);
+            }
+        }
+        for (auto p : _live) {
+            std::free(p);
+        }
+    }
+};
+
+static size_t rss() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+static std::vector<std::pair<size_t, double>> parse_sizes(const std::vector<std::string>& specs) {
+    std::vector<std::pair<size_t, double>> sizes;
+    for (auto& s : specs) {
+        auto colon = s.find(':');
+        sizes.emplace_back(std::stoul(s.substr(0, colon)), colon == std::string::npos ? 1 : std::stod(s.substr(colon + 1)));
+    }
+    return sizes;
+}
+
+static std::vector<std::pair<size_t, double>> read_trace(const std::string& file) {
+    std::ifstream in(file);
+    if (!in) {
+        throw std::runtime_error(fmt::format("cannot read {}", file));
+    }
+    std::map<size_t, double> counts;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        size_t size;
+        double count = 1;
+        if (fields >> size) {
+            fields >> count;
+            counts[size] += count;
+        }
+    }
+    return {counts.begin(), counts.end()};
+}
+
+static double mib(size_t bytes) {
+    return double(bytes) / (1 << 20);
+}
+
+int main(int ac, char** av) {
+    app_template app;
+    namespace bpo = boost::program_options;
+    app.add_options()
+        ("duration", bpo::value<unsigned>()->default_value(30), "time to run the test (seconds)")
+        ("report-interval", bpo::value<unsigned>()->default_value(5), "time between reports (seconds)")
+        ("sizes", bpo::value<std::vector<std::string>>()->multitoken()->default_value({"16:40", "64:30", "512:20", "4096:9", "65536:1"}, "16:40 64:30 512:20 4096:9 65536:1"),
+            "allocation sizes, each optionally followed by its weight, as in 64:30")
+        ("trace", bpo::value<std::string>(), "file of recorded allocation sizes to sample, one a line, optionally followed by their count, instead of --sizes")
+        ("live", bpo::value<size_t>()->default_value(100000), "live objects of each shard")
+        ("cross-shard-ratio", bpo::value<double>()->default_value(0), "fraction of the objects freed by another shard")
+        ("large-ratio", bpo::value<double>()->default_value(0), "fraction of the allocations that are large ones")
+        ("large-min", bpo::value<size_t>()->default_value(128 << 10), "smallest large allocation")
+        ("large-max", bpo::value<size_t>()->default_value(8 << 20), "largest large allocation")
+        ;
+
+    return app.run(ac, av, [&app] {
+        return async([&app] {
+            auto& opts = app.configuration();
+            worker::config cfg{
+                .sizes = opts.count("trace") ? read_trace(opts["trace"].as<std::string>()) : parse_sizes(opts["sizes"].as<std::vector<std::string>>()),
+                .live = opts["live"].as<size_t>(),
+                .cross_shard_ratio = opts["cross-shard-ratio"].as<double>(),
+                .large_ratio = opts["large-ratio"].as<double>(),
+                .large_min = opts["large-min"].as<size_t>(),
+                .large_max = opts["large-max"].as<size_t>(),
+            };
+            if (cfg.sizes.empty() || cfg.live == 0 || cfg.large_min > cfg.large_max) {
+                throw std::runtime_error("needs sizes, live objects and --large-min not above --large-max");
+            }
+            auto duration = std::chrono::seconds(opts["duration"].as<unsigned>());
+            auto interval = std::chrono::seconds(std::max(1u, opts["report-interval"].as<unsigned>()));
+
+            sharded<worker> workers;
+            workers.start(cfg).get();
+            auto stop = defer([&] () noexcept { workers.stop().get(); });
+            workers.invoke_on_all(&worker::start).get();
+
+            fmt::print("{:>6} {:>12} {:>24} {:>24} {:>10} {:>10} {:>10} {:>8} {:>8}\n", "time", "ops/s",
+                       "malloc p50/p99/p99.9 ns", "free p50/p99/p99.9 ns", "rss MiB", "used MiB", "span MiB", "frag", "pools");
+            auto start = clock_type::now();
+            for (auto elapsed = 0s; elapsed < duration; ) {
+                auto t = clock_type::now();
+                seastar::sleep(std::min<std::chrono::seconds>(interval, duration - elapsed)).get();
+                auto s = workers.map_reduce0(std::mem_fn(&worker::collect), interval_stats{}, std::plus<>()).get();
+                auto secs = std::chrono::duration<double>(clock_type::now() - t).count();
+                elapsed = std::chrono::duration_cast<std::chrono::seconds>(clock_type::now() - start);
+                auto latencies = [] (const latency_histogram& h) {
+                    return fmt::format("{}/{}/{}", h.quantile(0.5), h.quantile(0.99), h.quantile(0.999));
+                };
+                // The free memory outside the largest span of its shard, and
+                // the small pool memory in free objects
+                auto frag = s.free_memory ? double(s.fragmented_free) / s.free_memory : 0;
+                fmt::print("{:>5}s {:>12.0f} {:>24} {:>24} {:>10.1f} {:>10.1f} {:>10.1f} {:>8.3f} {:>8.3f}\n", elapsed.count(), s.ops / secs,
+                           latencies(s.malloc_latency), latencies(s.free_latency), mib(rss()), mib(s.allocated_memory),
+                           mib(s.largest_free_span), frag, s.small_pool_memory ? double(s.small_pool_free) / s.small_pool_memory : 0.0);
+                if (s.cross_shard_frees) {
+                    fmt::print("{:>6} {} objects sent to other shards to free\n", "", s.cross_shard_frees);
+                }
+            }
+            auto report = memory::get_fragmentation_report();
+            fmt::print("shard 0: {:.1f} MiB free, largest span {:.1f} MiB, fragmentation {:.3f}\n",
+                       mib(report.free_memory), mib(report.largest_free_span), report.fragmentation());
+        });
+    });
+}
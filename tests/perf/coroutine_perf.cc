@@ -27,6 +27,27 @@
 struct coroutine_test {
 };
 
+// Runs the same coroutines with their frames allocated by the allocator
+// rather than recycled by the coroutine frame pool, to compare the
+// allocations per iteration of the two
+struct coroutine_test_unpooled {
+    size_t _max_pooled_bytes = internal::this_thread_coroutine_frame_pool.max_pooled_bytes();
+    coroutine_test_unpooled() {
+        internal::this_thread_coroutine_frame_pool.set_max_pooled_bytes(0);
+    }
+    ~coroutine_test_unpooled() {
+        internal::this_thread_coroutine_frame_pool.set_max_pooled_bytes(_max_pooled_bytes);
+    }
+};
+
+[[gnu::noinline]]
+future<int> nested_coroutine(int depth) {
+    if (depth == 0) {
+        co_return 0;
+    }
+    co_return co_await nested_coroutine(depth - 1) + 1;
+}
+
 PERF_TEST_C(coroutine_test, empty)
 {
     co_return;
@@ -46,3 +67,23 @@ PERF_TEST_C(coroutine_test, maybe_yield)
 {
     co_await coroutine::maybe_yield();
 }
+
+PERF_TEST_C(coroutine_test, nested)
+{
+    perf_tests::do_not_optimize(co_await nested_coroutine(4));
+}
+
+PERF_TEST_C(coroutine_test_unpooled, empty)
+{
+    co_return;
+}
+
+PERF_TEST_C(coroutine_test_unpooled, maybe_yield)
+{
+    co_await coroutine::maybe_yield();
+}
+
+PERF_TEST_C(coroutine_test_unpooled, nested)
+{
+    perf_tests::do_not_optimize(co_await nested_coroutine(4));
+}
@@ -347,3 +347,97 @@ PERF_TEST_CN(parallel_for_each, cor_pfe_suspend_100)
     perf_tests::do_not_optimize(value);
     co_return range.size();
 }
+
+// Large in-memory loops, most of whose elements are processed synchronously
+
+struct large_for_each {
+    std::vector<int> range;
+    int value;
+
+    static constexpr int range_size = 1000000;
+    static constexpr int suspend_every = 1000;
+
+    large_for_each()
+        : range(boost::copy_range<std::vector<int>>(boost::irange(0, range_size)))
+    { }
+};
+
+[[gnu::noinline]]
+future<> mostly_immediate(int v, int& vs)
+{
+    vs += v;
+    if (v % large_for_each::suspend_every) {
+        return make_ready_future<>();
+    }
+    return yield();
+}
+
+PERF_TEST_F(large_for_each, pfe_immediate)
+{
+    return seastar::parallel_for_each(range, [this] (int v) {
+        return immediate(v, value);
+    }).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
+
+PERF_TEST_F(large_for_each, do_for_each_immediate)
+{
+    return seastar::do_for_each(range, [this] (int v) {
+        return immediate(v, value);
+    }).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
+
+PERF_TEST_F(large_for_each, max_concurrent_immediate)
+{
+    return seastar::max_concurrent_for_each(range, 16, [this] (int v) {
+        return immediate(v, value);
+    }).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
+
+PERF_TEST_F(large_for_each, chunked_immediate)
+{
+    return seastar::chunked_for_each(range, 16, [this] (int v) {
+        return immediate(v, value);
+    }).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
+
+PERF_TEST_F(large_for_each, pfe_mostly_immediate)
+{
+    return seastar::parallel_for_each(range, [this] (int v) {
+        return mostly_immediate(v, value);
+    }).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
+
+PERF_TEST_F(large_for_each, max_concurrent_mostly_immediate)
+{
+    return seastar::max_concurrent_for_each(range, 16, [this] (int v) {
+        return mostly_immediate(v, value);
+    }).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
+
+PERF_TEST_F(large_for_each, chunked_mostly_immediate)
+{
+    return seastar::chunked_for_each(range, 16, [this] (int v) {
+        return mostly_immediate(v, value);
+    }).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/http/request_parser.hh>
+
+// Parses the requests of a browser-like client, headers into strings and
+// in place
+
+using namespace seastar;
+
+namespace {
+
+struct request_parser_bench {
+    sstring msg = "GET /api/v1/resource/17/items?limit=100 HTTP/1.1\r\n"
+            "Host: www.example.com:8080\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+            "Accept-Language: en-US,en;q=0.5\r\n"
+            "Accept-Encoding: gzip, deflate, br\r\n"
+            "Connection: keep-alive\r\n"
+            "Cookie: session=3f6c2b8e9a1d4c7f8e2b5a9d0c3e6f1a; theme=dark\r\n"
+            "Cache-Control: no-cache\r\n"
+            "X-Request-Id: 6b1f2c9e-3a4d-4e8f-9b7c-1d2e3f4a5b6c\r\n"
+            "\r\n";
+    http_request_parser parser;
+
+    size_t parse(bool in_place) {
+        parser.set_parse_in_place(in_place);
+        parser.init();
+        parser(temporary_buffer<char>(msg.data(), msg.size())).get();
+        auto req = parser.get_parsed_request();
+        perf_tests::do_not_optimize(req->get_header("Connection"));
+        perf_tests::do_not_optimize(req->get_header("Content-Length"));
+        return 1;
+    }
+};
+
+}
+
+PERF_TEST_F(request_parser_bench, strings) { return parse(false); }
+PERF_TEST_F(request_parser_bench, in_place) { return parse(true); }
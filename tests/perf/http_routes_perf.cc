@@ -0,0 +1,106 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/matchrules.hh>
+#include <seastar/http/routes.hh>
+#include <vector>
+
+// Routes urls among the rules of a REST API of a few hundred endpoints,
+// most of them with path parameters, the way the rules were evaluated one
+// by one and the way routes matches them.
+
+using namespace seastar;
+using namespace httpd;
+
+namespace {
+
+struct routes_bench {
+    static constexpr unsigned nr_resources = 50;
+    static constexpr unsigned nr_lookups = 100;
+
+    routes r;
+    // The rules in r, in order
+    std::vector<match_rule*> rules;
+    std::vector<sstring> urls;
+
+    void add(match_rule* rule) {
+        rules.push_back(rule);
+        r.add(rule, GET);
+    }
+
+    match_rule* rule() {
+        return new match_rule(new function_handler([] (const_req) { return ""; }));
+    }
+
+    routes_bench() {
+        for (unsigned i = 0; i < nr_resources; i++) {
+            auto base = format("/api/v1/resource{}", i);
+            add(&rule()->add_str(base));
+            add(&rule()->add_str(base).add_param("id"));
+            add(&rule()->add_str(base).add_param("id").add_str("/status"));
+            add(&rule()->add_str(base).add_param("id").add_str("/items").add_param("item"));
+            add(&rule()->add_str(base).add_param("id").add_str("/items").add_param("item").add_str("/history"));
+            add(&rule()->add_str(base + "/files").add_param("path", true));
+        }
+        for (unsigned i = 0; i < nr_lookups; i++) {
+            auto base = format("/api/v1/resource{}", (i * 7) % nr_resources);
+            switch (i % 4) {
+            case 0: urls.push_back(format("{}/{}", base, i)); break;
+            case 1: urls.push_back(format("{}/{}/items/{}/history", base, i, i + 1)); break;
+            case 2: urls.push_back(format("{}/files/etc/hosts", base)); break;
+            case 3: urls.push_back(format("{}/{}/unknown", base, i)); break;
+            }
+        }
+    }
+
+    size_t linear() {
+        parameters params;
+        for (auto& url : urls) {
+            handler_base* handler = nullptr;
+            for (auto rule : rules) {
+                handler = rule->get(url, params);
+                if (handler) {
+                    break;
+                }
+                params.clear();
+            }
+            perf_tests::do_not_optimize(handler);
+            params.clear();
+        }
+        return urls.size();
+    }
+
+    size_t trie() {
+        parameters params;
+        for (auto& url : urls) {
+            perf_tests::do_not_optimize(r.get_handler(GET, url, params));
+            params.clear();
+        }
+        return urls.size();
+    }
+};
+
+}
+
+PERF_TEST_F(routes_bench, linear) { return linear(); }
+PERF_TEST_F(routes_bench, trie) { return trie(); }
@@ -0,0 +1,65 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/net/ip_checksum.hh>
+#include <random>
+#include <vector>
+
+// Checksums an MTU sized and a 64k payload with each instruction set the
+// CPU supports; a test of an unsupported one runs the default kernel.
+
+using seastar::internal::checksum_isa;
+
+namespace {
+
+struct checksum_bench {
+    std::vector<char> mtu = make_data(1500);
+    std::vector<char> large = make_data(65536);
+
+    static std::vector<char> make_data(size_t len) {
+        std::mt19937 rng(0);
+        std::vector<char> data(len);
+        for (auto& c : data) {
+            c = char(rng());
+        }
+        return data;
+    }
+
+    size_t checksum(checksum_isa isa, const std::vector<char>& data) {
+        seastar::internal::use_checksum_isa(isa);
+        perf_tests::do_not_optimize(seastar::net::ip_checksum(data.data(), data.size()));
+        return data.size();
+    }
+};
+
+}
+
+PERF_TEST_F(checksum_bench, scalar_1500) { return checksum(checksum_isa::scalar, mtu); }
+PERF_TEST_F(checksum_bench, sse2_1500) { return checksum(checksum_isa::sse2, mtu); }
+PERF_TEST_F(checksum_bench, avx2_1500) { return checksum(checksum_isa::avx2, mtu); }
+PERF_TEST_F(checksum_bench, avx512_1500) { return checksum(checksum_isa::avx512, mtu); }
+PERF_TEST_F(checksum_bench, neon_1500) { return checksum(checksum_isa::neon, mtu); }
+PERF_TEST_F(checksum_bench, scalar_64k) { return checksum(checksum_isa::scalar, large); }
+PERF_TEST_F(checksum_bench, sse2_64k) { return checksum(checksum_isa::sse2, large); }
+PERF_TEST_F(checksum_bench, avx2_64k) { return checksum(checksum_isa::avx2, large); }
+PERF_TEST_F(checksum_bench, avx512_64k) { return checksum(checksum_isa::avx512, large); }
+PERF_TEST_F(checksum_bench, neon_64k) { return checksum(checksum_isa::neon, large); }
@@ -0,0 +1,129 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/json/formatter.hh>
+#include <seastar/json/json_elements.hh>
+#include <seastar/json/writer.hh>
+#include <vector>
+
+// Formats the same values with the formatter and with the writer, into
+// a stream that discards what it is given.
+
+using namespace seastar;
+
+namespace {
+
+class null_sink final : public data_sink_impl {
+public:
+    virtual future<> put(net::packet) override { return make_ready_future<>(); }
+    virtual future<> close() override { return make_ready_future<>(); }
+};
+
+struct metric_json : public json::json_base {
+    json::json_element<sstring> name;
+    json::json_element<double> value;
+    json::json_list<long> buckets;
+
+    metric_json() {
+        add(&name, "name");
+        add(&value, "value");
+        add(&buckets, "buckets");
+    }
+};
+
+struct json_bench {
+    static constexpr size_t nr_objects = 100;
+
+    output_stream<char> out{data_sink(std::make_unique<null_sink>()), 8192};
+    std::vector<long> numbers;
+    sstring plain = sstring(1024, 'x');
+    sstring escaped;
+    std::vector<metric_json> objects{nr_objects};
+
+    json_bench() {
+        for (long i = 0; i < 1000; ++i) {
+            numbers.push_back(i * 1000003);
+        }
+        for (unsigned i = 0; i < 64; ++i) {
+            escaped += "some text with a \"quote\"\n";
+        }
+        for (size_t i = 0; i < nr_objects; ++i) {
+            objects[i].name = format("reactor_tasks_processed_{}", i);
+            objects[i].value = i * 1.5;
+            objects[i].buckets = std::vector<long>{1, 10, 100, 1000};
+        }
+    }
+
+    size_t to_json(const auto& v) {
+        perf_tests::do_not_optimize(json::formatter::to_json(v));
+        return 1;
+    }
+
+    future<size_t> write(const auto& v) {
+        json::writer w(out);
+        w.value(v);
+        return do_with(std::move(w), [] (json::writer& w) {
+            return w.flush();
+        }).then([] {
+            return size_t(1);
+        });
+    }
+
+    future<size_t> write_objects() {
+        return do_with(json::writer(out), [this] (json::writer& w) {
+            w.begin_array();
+            return do_for_each(objects, [&w] (const metric_json& o) {
+                w.value(o);
+                return w.maybe_flush();
+            }).then([&w] {
+                w.end_array();
+                return w.flush();
+            });
+        }).then([] {
+            return nr_objects;
+        });
+    }
+
+    future<size_t> stream_objects() {
+        return do_for_each(objects, [this] (const metric_json& o) {
+            return o.write(out);
+        }).then([] {
+            return nr_objects;
+        });
+    }
+};
+
+}
+
+PERF_TEST_F(json_bench, to_json_plain_string) { return to_json(plain); }
+PERF_TEST_F(json_bench, write_plain_string) { return write(plain); }
+PERF_TEST_F(json_bench, to_json_escaped_string) { return to_json(escaped); }
+PERF_TEST_F(json_bench, write_escaped_string) { return write(escaped); }
+PERF_TEST_F(json_bench, to_json_numbers) { return to_json(numbers); }
+PERF_TEST_F(json_bench, write_numbers) { return write(numbers); }
+PERF_TEST_F(json_bench, formatter_write_numbers) {
+    return json::formatter::write(out, numbers).then([] { return size_t(1); });
+}
+PERF_TEST_F(json_bench, to_json_object) { return to_json(objects.front()); }
+PERF_TEST_F(json_bench, write_objects) { return write_objects(); }
+PERF_TEST_F(json_bench, stream_objects) { return stream_objects(); }
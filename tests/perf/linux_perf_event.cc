@@ -106,3 +106,29 @@ linux_perf_event::user_cpu_cycles_retired() {
             .exclude_idle = 1,
             }, 0, -1, -1, 0);
 }
+
+linux_perf_event
+linux_perf_event::user_l1_dcache_read_misses() {
+    return linux_perf_event(perf_event_attr{
+            .type = PERF_TYPE_HW_CACHE,
+            .size = sizeof(struct perf_event_attr),
+            .config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            .disabled = 1,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            .exclude_idle = 1,
+            }, 0, -1, -1, 0);
+}
+
+linux_perf_event
+linux_perf_event::user_llc_misses() {
+    return linux_perf_event(perf_event_attr{
+            .type = PERF_TYPE_HARDWARE,
+            .size = sizeof(struct perf_event_attr),
+            .config = PERF_COUNT_HW_CACHE_MISSES,
+            .disabled = 1,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            .exclude_idle = 1,
+            }, 0, -1, -1, 0);
+}
@@ -0,0 +1,609 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <fstream>
+#include <boost/range/algorithm.hpp>
+#include <boost/range/irange.hpp>
+#include <fmt/core.h>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/coroutine/parallel_for_each.hh>
+#include <seastar/json/formatter.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/inet_address.hh>
+#include <seastar/util/defer.hh>
+#include "../unit/loopback_socket.hh"
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Benchmarks of the network stack, the one --network-stack selects or the
+// in-memory loopback sockets of the unit tests (--transport loopback):
+//
+//  - accept: new connections a second, each connected, accepted and closed
+//  - rr: latency of a request answered by a response of the same size
+//  - bulk: throughput of a stream of --bulk-chunk writes
+//  - udp: datagrams a second, sent in batches of --udp-batch
+//
+// Within a process, a server on every shard serves clients on every shard:
+//   net_perf -c4 --test rr --sizes 64 4096
+// Between processes, or hosts, run both with the same -c:
+//   net_perf -c4 --server --port 10002
+//   net_perf -c4 --connect 10.0.0.1 --port 10002
+//
+// --json-output writes the results in the format of the perf_tests ones,
+// the median being the nanoseconds per operation (the latency for rr), for
+// runs of different builds to be compared the same way.
+
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+// A connection starts with the kind of service it wants from the server
+// and the size of its requests
+enum class service : uint32_t { echo, sink, close, udp_count };
+constexpr size_t header_size = 8;
+
+temporary_buffer<char> make_header(service s, uint32_t size) {
+    temporary_buffer<char> buf(header_size);
+    write_be<uint32_t>(buf.get_write(), uint32_t(s));
+    write_be<uint32_t>(buf.get_write() + 4, size);
+    return buf;
+}
+
+temporary_buffer<char> make_count(uint64_t n) {
+    temporary_buffer<char> buf(sizeof(n));
+    write_be<uint64_t>(buf.get_write(), n);
+    return buf;
+}
+
+class transport {
+public:
+    virtual ~transport() = default;
+    virtual server_socket listen(uint16_t port) = 0;
+    virtual future<connected_socket> connect(socket_address addr) = 0;
+};
+
+class stack_transport final : public transport {
+public:
+    virtual server_socket listen(uint16_t port) override {
+        listen_options lo;
+        lo.reuse_address = true;
+        return seastar::listen(make_ipv4_address({port}), lo);
+    }
+    virtual future<connected_socket> connect(socket_address addr) override {
+        return seastar::connect(addr);
+    }
+};
+
+class loopback_transport final : public transport {
+    loopback_connection_factory& _factory;
+public:
+    explicit loopback_transport(loopback_connection_factory& factory) : _factory(factory) {}
+    virtual server_socket listen(uint16_t) override {
+        return _factory.get_server_socket();
+    }
+    virtual future<connected_socket> connect(socket_address addr) override {
+        // The socket must outlive the connection attempt
+        auto s = std::make_unique<seastar::socket>(std::make_unique<loopback_socket_impl>(_factory));
+        auto cs = co_await s->connect(addr);
+        co_return cs;
+    }
+};
+
+std::unique_ptr<transport> make_transport(loopback_connection_factory* loopback) {
+    if (loopback) {
+        return std::make_unique<loopback_transport>(*loopback);
+    }
+    return std::make_unique<stack_transport>();
+}
+
+class server : public peering_sharded_service<server> {
+    std::unique_ptr<transport> _transport;
+    uint16_t _port;
+    std::optional<server_socket> _listener;
+    std::optional<net::datagram_channel> _udp;
+    uint64_t _udp_received = 0;
+    gate _gate;
+
+    future<> serve(connected_socket s) {
+        auto in = s.input();
+        auto out = s.output();
+        try {
+            auto hdr = co_await in.read_exactly(header_size);
+            if (hdr.size() == header_size) {
+                auto size = read_be<uint32_t>(hdr.get() + 4);
+                switch (service(read_be<uint32_t>(hdr.get()))) {
+                case service::echo:
+                    while (true) {
+                        auto req = co_await in.read_exactly(size);
+                        if (req.size() < size) {
+                            break;
+                        }
+                        co_await out.write(std::move(req));
+                        co_await out.flush();
+                    }
+                    break;
+                case service::sink: {
+                    uint64_t total = 0;
+                    while (auto buf = co_await in.read()) {
+                        total += buf.size();
+                    }
+                    co_await out.write(make_count(total));
+                    co_await out.flush();
+                    break;
+                }
+                case service::close:
+                    break;
+                case service::udp_count: {
+                    auto n = co_await container().map_reduce0([] (server& s) { return s._udp_received; }, uint64_t(0), std::plus<>());
+                    co_await out.write(make_count(n));
+                    co_await out.flush();
+                    break;
+                }
+                }
+            }
+        } catch (...) {
+            // Clients go away at will
+        }
+        co_await out.close().handle_exception([] (auto) {});
+        co_await in.close().handle_exception([] (auto) {});
+    }
+
+    future<> accept() {
+        while (true) {
+            accept_result ar;
+            try {
+                ar = co_await _listener->accept();
+            } catch (...) {
+                co_return;
+            }
+            (void)with_gate(_gate, [this, s = std::move(ar.connection)] () mutable {
+                return serve(std::move(s));
+            });
+        }
+    }
+
+    future<> receive() {
+        while (true) {
+            try {
+                auto dgrams = co_await _udp->receive_batch(64);
+                _udp_received += dgrams.size();
+            } catch (...) {
+                co_return;
+            }
+        }
+    }
+public:
+    server(loopback_connection_factory* loopback, uint16_t port) : _transport(make_transport(loopback)), _port(port) {}
+
+    future<> start(bool udp) {
+        _listener = _transport->listen(_port);
+        (void)with_gate(_gate, [this] { return accept(); });
+        if (udp) {
+            // A port for each shard, the clients of a shard sending to theirs
+            _udp = make_bound_datagram_channel(make_ipv4_address({uint16_t(_port + this_shard_id())}));
+            (void)with_gate(_gate, [this] { return receive(); });
+        }
+        return make_ready_future<>();
+    }
+
+    future<> stop() {
+        if (_listener) {
+            _listener->abort_accept();
+        }
+        if (_udp) {
+            _udp->shutdown_input();
+        }
+        co_await _gate.close();
+        if (_udp) {
+            _udp->close();
+        }
+    }
+};
+
+// What the clients of a shard did in a run
+struct sample {
+    uint64_t ops = 0;
+    uint64_t bytes = 0;
+    clock_type::duration latency{};
+
+    sample& operator+=(const sample& o) {
+        ops += o.ops;
+        bytes += o.bytes;
+        latency += o.latency;
+        return *this;
+    }
+};
+
+sample operator+(sample a, const sample& b) {
+    return a += b;
+}
+
+enum class test { accept, rr, bulk, udp };
+
+struct connection {
+    connected_socket socket;
+    input_stream<char> in;
+    output_stream<char> out;
+
+    explicit connection(connected_socket s) : socket(std::move(s)), in(socket.input()), out(socket.output()) {}
+};
+
+class client {
+public:
+    struct config {
+        loopback_connection_factory* loopback;
+        sstring server;
+        uint16_t port;
+        unsigned conns;
+        size_t bulk_chunk;
+        unsigned udp_batch;
+    };
+private:
+    config _cfg;
+    std::unique_ptr<transport> _transport;
+    socket_address _addr;
+    std::vector<std::unique_ptr<connection>> _conns;
+    std::optional<net::datagram_channel> _udp;
+    temporary_buffer<char> _payload;
+
+    future<std::unique_ptr<connection>> connect(service s, uint32_t size) {
+        auto c = std::make_unique<connection>(co_await _transport->connect(_addr));
+        co_await c->out.write(make_header(s, size));
+        co_await c->out.flush();
+        co_return c;
+    }
+
+    future<sample> run_accept(clock_type::time_point deadline) {
+        sample total;
+        co_await coroutine::parallel_for_each(boost::irange(0u, _cfg.conns), [this, deadline, &total] (unsigned) -> future<> {
+            while (clock_type::now() < deadline) {
+                auto c = co_await connect(service::close, 0);
+                // The server closing the connection completes the operation
+                co_await c->in.read();
+                co_await c->out.close();
+                co_await c->in.close();
+                total.ops++;
+            }
+        });
+        co_return total;
+    }
+
+    future<sample> run_rr(clock_type::time_point deadline) {
+        sample total;
+        co_await coroutine::parallel_for_each(_conns, [this, deadline, &total] (std::unique_ptr<connection>& c) -> future<> {
+            while (clock_type::now() < deadline) {
+                auto start = clock_type::now();
+                co_await c->out.write(_payload.share());
+                co_await c->out.flush();
+                auto resp = co_await c->in.read_exactly(_payload.size());
+                if (resp.size() < _payload.size()) {
+                    throw std::runtime_error("server closed the connection");
+                }
+                total.latency += clock_type::now() - start;
+                total.ops++;
+                total.bytes += resp.size();
+            }
+        });
+        co_return total;
+    }
+
+    future<sample> run_bulk(clock_type::time_point deadline) {
+        sample total;
+        co_await coroutine::parallel_for_each(_conns, [this, deadline, &total] (std::unique_ptr<connection>& c) -> future<> {
+            while (clock_type::now() < deadline) {
+                co_await c->out.write(_payload.share());
+                total.ops++;
+                total.bytes += _payload.size();
+            }
+            co_await c->out.flush();
+        });
+        co_return total;
+    }
+
+    future<sample> run_udp(clock_type::time_point deadline) {
+        sample total;
+        auto dst = socket_address(net::inet_address(_addr.addr()), uint16_t(_cfg.port + this_shard_id()));
+        while (clock_type::now() < deadline) {
+            std::vector<net::outgoing_datagram> batch;
+            batch.reserve(_cfg.udp_batch);
+            for (unsigned i = 0; i < _cfg.udp_batch; i++) {
+                batch.push_back(net::outgoing_datagram{dst, net::packet(_payload.share())});
+            }
+            co_await _udp->send_batch(std::move(batch));
+            total.ops += _cfg.udp_batch;
+            total.bytes += _cfg.udp_batch * _payload.size();
+        }
+        co_return total;
+    }
+public:
+    explicit client(config cfg)
+        : _cfg(std::move(cfg))
+        , _transport(make_transport(_cfg.loopback))
+        , _addr(socket_address(net::inet_address(_cfg.server), _cfg.port))
+    {}
+
+    future<> prepare(test t, size_t size) {
+        _payload = temporary_buffer<char>(t == test::bulk ? _cfg.bulk_chunk : size);
+        std::fill_n(_payload.get_write(), _payload.size(), 'x');
+        if (t == test::rr || t == test::bulk) {
+            for (unsigned i = 0; i < _cfg.conns; i++) {
+                _conns.push_back(co_await connect(t == test::rr ? service::echo : service::sink, size));
+            }
+        }
+        if (t == test::udp) {
+            _udp = make_unbound_datagram_channel(AF_INET);
+        }
+    }
+
+    future<sample> run(test t, clock_type::time_point deadline) {
+        switch (t) {
+        case test::accept: return run_accept(deadline);
+        case test::rr: return run_rr(deadline);
+        case test::bulk: return run_bulk(deadline);
+        case test::udp: return run_udp(deadline);
+        }
+        __builtin_unreachable();
+    }
+
+    future<> finish() {
+        for (auto& c : _conns) {
+            co_await c->out.close();
+            // Drains the count a sink sends back
+            while (co_await c->in.read()) {
+            }
+            co_await c->in.close();
+        }
+        _conns.clear();
+        if (_udp) {
+            _udp->close();
+            _udp.reset();
+        }
+    }
+
+    // Datagrams the servers of all shards received so far
+    future<uint64_t> udp_received() {
+        auto c = co_await connect(service::udp_count, 0);
+        auto buf = co_await c->in.read_exactly(sizeof(uint64_t));
+        co_await c->out.close();
+        co_await c->in.close();
+        if (buf.size() < sizeof(uint64_t)) {
+            throw std::runtime_error("server did not send the udp count");
+        }
+        co_return read_be<uint64_t>(buf.get());
+    }
+
+    future<> stop() {
+        return finish();
+    }
+};
+
+struct result {
+    sstring name;
+    std::vector<double> ns_per_op;
+    uint64_t ops = 0;
+    double ops_per_s = 0;
+    double mb_per_s = 0;
+    double loss = 0;
+};
+
+void print_result(const result& r) {
+    auto values = r.ns_per_op;
+    boost::range::sort(values);
+    auto median = values[values.size() / 2];
+    fmt::print("{:<16} {:>12.0f} {:>10.1f} {:>12.1f} {:>12.1f} {:>12.1f}", r.name, r.ops_per_s, r.mb_per_s, median / 1000, values.front() / 1000, values.back() / 1000);
+    if (r.loss) {
+        fmt::print("  loss {:.1f}%", r.loss * 100);
+    }
+    fmt::print("\n");
+}
+
+class json_output {
+    std::unordered_map<std::string, std::unordered_map<std::string, std::unordered_map<std::string, double>>> _root;
+public:
+    void add(const result& r) {
+        auto values = r.ns_per_op;
+        boost::range::sort(values);
+        auto mid = values.size() / 2;
+        auto median = values[mid];
+        auto diffs = values;
+        for (auto& d : diffs) {
+            d = std::fabs(d - median);
+        }
+        boost::range::sort(diffs);
+        auto& j = _root["results"][std::string(r.name)];
+        j["runs"] = values.size();
+        j["total_iterations"] = r.ops;
+        j["median"] = median;
+        j["mad"] = diffs[mid];
+        j["min"] = values.front();
+        j["max"] = values.back();
+        j["ops_per_s"] = r.ops_per_s;
+        j["mb_per_s"] = r.mb_per_s;
+    }
+    void write(const std::string& file) {
+        std::ofstream out(file);
+        out << json::formatter::to_json(_root);
+    }
+};
+
+test parse_test(const std::string& s) {
+    if (s == "accept") {
+        return test::accept;
+    }
+    if (s == "rr") {
+        return test::rr;
+    }
+    if (s == "bulk") {
+        return test::bulk;
+    }
+    if (s == "udp") {
+        return test::udp;
+    }
+    throw std::runtime_error(fmt::format("unknown test {}", s));
+}
+
+result run_test(sharded<client>& clients, test t, const sstring& name, size_t size, unsigned runs, clock_type::duration duration) {
+    clients.invoke_on_all([t, size] (client& c) { return c.prepare(t, size); }).get();
+    auto udp_before = t == test::udp ? clients.local().udp_received().get() : 0;
+
+    result r;
+    r.name = name;
+    clock_type::duration elapsed{};
+    for (unsigned i = 0; i < runs; i++) {
+        auto start = clock_type::now();
+        auto deadline = start + duration;
+        auto s = clients.map_reduce0([t, deadline] (client& c) { return c.run(t, deadline); }, sample{}, std::plus<>()).get();
+        auto dt = clock_type::now() - start;
+        elapsed += dt;
+        r.ops += s.ops;
+        r.mb_per_s += double(s.bytes) / (1 << 20);
+        if (t == test::rr) {
+            r.ns_per_op.push_back(s.ops ? double(std::chrono::nanoseconds(s.latency).count()) / s.ops : 0);
+        } else {
+            r.ns_per_op.push_back(s.ops ? double(std::chrono::nanoseconds(dt).count()) / s.ops : 0);
+        }
+    }
+    clients.invoke_on_all(&client::finish).get();
+
+    auto secs = std::chrono::duration<double>(elapsed).count();
+    r.ops_per_s = r.ops / secs;
+    r.mb_per_s /= secs;
+    if (t == test::udp) {
+        // Let the last datagrams in
+        seastar::sleep(100ms).get();
+        auto received = clients.local().udp_received().get() - udp_before;
+        r.loss = r.ops ? 1 - std::min(1.0, double(received) / r.ops) : 0;
+    }
+    return r;
+}
+
+}
+
+int main(int ac, char** av) {
+    app_template app;
+    namespace bpo = boost::program_options;
+    app.add_options()
+        ("test", bpo::value<std::vector<std::string>>()->multitoken()->default_value({"accept", "rr", "bulk", "udp"}, "accept rr bulk udp"),
+            "tests to run: accept, rr, bulk, udp")
+        ("transport", bpo::value<std::string>()->default_value("stack"),
+            "stack, the one --network-stack selects, or loopback, the in-memory sockets of the unit tests")
+        ("server", "only serve the clients of another process, until interrupted")
+        ("connect", bpo::value<std::string>(), "address of the net_perf --server to run the clients against")
+        ("port", bpo::value<uint16_t>()->default_value(10002), "tcp port, and first of the udp ports, one for each shard")
+        ("sizes", bpo::value<std::vector<unsigned>>()->multitoken()->default_value({64, 1024, 16384}, "64 1024 16384"),
+            "sizes of the rr requests and udp datagrams")
+        ("conns", bpo::value<unsigned>()->default_value(1), "connections of each shard")
+        ("bulk-chunk", bpo::value<size_t>()->default_value(128 << 10), "size of the bulk writes")
+        ("udp-batch", bpo::value<unsigned>()->default_value(32), "datagrams sent at once")
+        ("duration,d", bpo::value<double>()->default_value(1), "duration of a run in seconds")
+        ("runs,r", bpo::value<unsigned>()->default_value(5), "number of runs")
+        ("json-output", bpo::value<std::string>(), "output json file")
+        ;
+
+    return app.run(ac, av, [&app] {
+        return async([&app] {
+            auto& opts = app.configuration();
+            auto port = opts["port"].as<uint16_t>();
+            auto loopback = opts["transport"].as<std::string>() == "loopback";
+            if (!loopback && opts["transport"].as<std::string>() != "stack") {
+                throw std::runtime_error("unknown transport");
+            }
+            if (loopback && (opts.count("server") || opts.count("connect"))) {
+                throw std::runtime_error("loopback sockets do not leave the process");
+            }
+            std::optional<loopback_connection_factory> factory;
+            if (loopback) {
+                factory.emplace();
+            }
+            auto lcf = factory ? &*factory : nullptr;
+
+            sharded<server> servers;
+            if (!opts.count("connect")) {
+                servers.start(lcf, port).get();
+                servers.invoke_on_all([udp = !loopback] (server& s) { return s.start(udp); }).get();
+            }
+            auto stop_servers = defer([&] () noexcept {
+                servers.stop().get();
+                if (factory) {
+                    factory->destroy_all_shards().get();
+                }
+            });
+
+            if (opts.count("server")) {
+                condition_variable stop;
+                engine().handle_signal(SIGINT, [&] { stop.signal(); });
+                engine().handle_signal(SIGTERM, [&] { stop.signal(); });
+                fmt::print("serving on port {}\n", port);
+                stop.wait().get();
+                return;
+            }
+
+            client::config cfg{
+                .loopback = lcf,
+                .server = opts.count("connect") ? sstring(opts["connect"].as<std::string>()) : sstring("127.0.0.1"),
+                .port = port,
+                .conns = opts["conns"].as<unsigned>(),
+                .bulk_chunk = opts["bulk-chunk"].as<size_t>(),
+                .udp_batch = opts["udp-batch"].as<unsigned>(),
+            };
+            sharded<client> clients;
+            clients.start(cfg).get();
+            auto stop_clients = defer([&] () noexcept { clients.stop().get(); });
+
+            auto runs = opts["runs"].as<unsigned>();
+            auto duration = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(opts["duration"].as<double>()));
+            fmt::print("{:<16} {:>12} {:>10} {:>12} {:>12} {:>12}\n", "test", "ops/s", "MB/s", "median us", "min us", "max us");
+            json_output json;
+            for (auto& name : opts["test"].as<std::vector<std::string>>()) {
+                auto t = parse_test(name);
+                if (t == test::udp && loopback) {
+                    fmt::print("{:<16} skipped, loopback sockets are stream ones\n", name);
+                    continue;
+                }
+                std::vector<unsigned> sizes = {0};
+                if (t == test::rr || t == test::udp) {
+                    sizes = opts["sizes"].as<std::vector<unsigned>>();
+                    if (boost::range::count(sizes, 0u)) {
+                        throw std::runtime_error("sizes must be positive");
+                    }
+                }
+                for (auto size : sizes) {
+                    auto full_name = size ? format("net.{}_{}", name, size) : format("net.{}", name);
+                    auto r = run_test(clients, t, full_name, size, runs, duration);
+                    print_result(r);
+                    json.add(r);
+                }
+            }
+            if (opts.count("json-output")) {
+                json.write(opts["json-output"].as<std::string>());
+            }
+        });
+    });
+}
@@ -28,6 +28,8 @@
 #include <boost/range.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/algorithm.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 #include <fmt/ostream.h>
 
@@ -39,6 +41,7 @@
 #include <seastar/testing/random.hh>
 #include <seastar/core/memory.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/util/defer.hh>
 
 #include <signal.h>
 
@@ -124,16 +127,19 @@ uint64_t perf_stats::perf_tasks_processed() {
     return engine().get_sched_stats().tasks_processed;
 }
 
-perf_stats perf_stats::snapshot(linux_perf_event* instructions_retired_counter, linux_perf_event* cpu_cycles_retired_counter) {
+perf_stats perf_stats::snapshot(linux_perf_event* instructions_retired_counter, linux_perf_event* cpu_cycles_retired_counter,
+                                linux_perf_event* l1_dcache_misses_counter, linux_perf_event* llc_misses_counter) {
     return perf_stats(
         perf_mallocs(),
         perf_tasks_processed(),
         instructions_retired_counter ? instructions_retired_counter->read() : 0,
-        cpu_cycles_retired_counter ? cpu_cycles_retired_counter->read() : 0
+        cpu_cycles_retired_counter ? cpu_cycles_retired_counter->read() : 0,
+        l1_dcache_misses_counter ? l1_dcache_misses_counter->read() : 0,
+        llc_misses_counter ? llc_misses_counter->read() : 0
     );
 }
 
-time_measurement measure_time;
+thread_local time_measurement measure_time;
 
 struct config;
 struct result;
@@ -143,6 +149,8 @@ struct result_printer {
 
     virtual void print_configuration(const config&) = 0;
     virtual void print_result(const result&) = 0;
+    // Called once all the tests ran
+    virtual void print_summary() { }
 
     void update_name_column_length(size_t length) {
         _name_column_length = std::max(1ul, length);
@@ -162,6 +170,8 @@ struct config {
     unsigned number_of_runs;
     std::vector<std::unique_ptr<result_printer>> printers;
     unsigned random_seed = 0;
+    // Run each test on all shards at once, rather than on shard 0 alone
+    bool all_shards = false;
 };
 
 struct result {
@@ -179,8 +189,32 @@ struct result {
     double tasks = 0.;
     double inst = 0.;
     double cycles = 0.;
+    double l1_misses = 0.;
+    double llc_misses = 0.;
+
+    // Time of an iteration in each of the runs, in nanoseconds
+    std::vector<double> samples;
+
+    void compute_statistics();
 };
 
+void result::compute_statistics() {
+    auto mid = samples.size() / 2;
+
+    auto sorted = samples;
+    boost::range::sort(sorted);
+    median = sorted[mid];
+
+    auto diffs = boost::copy_range<std::vector<double>>(
+        sorted | boost::adaptors::transformed([&] (double x) { return fabs(x - median); })
+    );
+    boost::range::sort(diffs);
+    mad = diffs[mid];
+
+    min = sorted[0];
+    max = sorted[sorted.size() - 1];
+}
+
 
 struct duration {
     double value;
@@ -206,24 +240,25 @@ static inline std::ostream& operator<<(std::ostream& os, duration d)
 
 struct stdout_printer final : result_printer {
   virtual void print_configuration(const config& c) override {
-    fmt::print("{:<25} {}\n{:<25} {}\n{:<25} {}\n{:<25} {}\n{:<25} {}\n\n",
+    fmt::print("{:<25} {}\n{:<25} {}\n{:<25} {}\n{:<25} {}{}\n{:<25} {}\n\n",
                "single run iterations:", c.single_run_iterations,
                "single run duration:", duration { double(c.single_run_duration.count()) },
                "number of runs:", c.number_of_runs,
-               "number of cores:", smp::count,
+               "number of cores:", smp::count, c.all_shards ? " (all running)" : "",
                "random seed:", c.random_seed);
-    fmt::print(header_format_string, "test", name_column_length(), "iterations", "median", "mad", "min", "max", "allocs", "tasks", "inst", "cycles");
+    fmt::print(header_format_string, "test", name_column_length(), "iterations", "median", "mad", "min", "max", "allocs", "tasks", "inst", "cycles",
+               "l1 miss", "llc miss");
   }
 
   virtual void print_result(const result& r) override {
     fmt::print(format_string, r.test_name, name_column_length(), r.total_iterations / r.runs, duration { r.median },
                duration { r.mad }, duration { r.min }, duration { r.max },
-               r.allocs, r.tasks, r.inst, r.cycles);
+               r.allocs, r.tasks, r.inst, r.cycles, r.l1_misses, r.llc_misses);
   }
 
 private:
-  static constexpr auto header_format_string ="{:<{}} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11}\n";
-  static constexpr auto format_string = "{:<{}} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11.3f} {:>11.3f} {:>11.1f} {:>11.1f}\n";
+  static constexpr auto header_format_string ="{:<{}} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11}\n";
+  static constexpr auto format_string = "{:<{}} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11.3f} {:>11.3f} {:>11.1f} {:>11.1f} {:>11.2f} {:>11.2f}\n";
 };
 
 class json_printer final : public result_printer {
@@ -253,6 +288,64 @@ class json_printer final : public result_printer {
         result["tasks"] = r.tasks;
         result["inst"] = r.inst;
         result["cycles"] = r.cycles;
+        result["l1_misses"] = r.l1_misses;
+        result["llc_misses"] = r.llc_misses;
+    }
+};
+
+// Compares the medians with those of a --json-output file of an earlier run.
+// A change is significant when it is both larger than the threshold and
+// than three standard deviations of the difference, estimated from the MADs.
+class compare_printer final : public result_printer {
+    struct baseline {
+        double median;
+        double mad;
+    };
+    std::unordered_map<std::string, baseline> _baseline;
+    double _threshold;
+    std::vector<std::pair<result, std::optional<baseline>>> _results;
+    unsigned _regressions = 0;
+public:
+    compare_printer(const std::string& file, double threshold) : _threshold(threshold) {
+        boost::property_tree::ptree root;
+        boost::property_tree::read_json(file, root);
+        for (auto& [name, r] : root.get_child("results")) {
+            _baseline.emplace(name, baseline{r.get<double>("median"), r.get<double>("mad")});
+        }
+    }
+
+    virtual void print_configuration(const config&) override { }
+
+    virtual void print_result(const result& r) override {
+        std::optional<baseline> b;
+        if (auto it = _baseline.find(r.test_name); it != _baseline.end()) {
+            b = it->second;
+        }
+        _results.emplace_back(r, b);
+    }
+
+    virtual void print_summary() override {
+        fmt::print("\n" "{:<{}} {:>11} {:>11} {:>8}  {}\n", "comparison", name_column_length(), "baseline", "median", "change", "verdict");
+        for (auto& [r, b] : _results) {
+            if (!b) {
+                fmt::print("{:<{}} {:>11} {:>11} {:>8}  {}\n", r.test_name, name_column_length(), "-", duration { r.median }, "-", "new");
+                continue;
+            }
+            auto delta = r.median - b->median;
+            auto change = b->median ? delta / b->median : 0.;
+            auto noise = 1.4826 * std::sqrt(b->mad * b->mad + r.mad * r.mad);
+            auto significant = std::fabs(change) > _threshold && std::fabs(delta) > 3 * noise;
+            auto verdict = !significant ? "" : delta > 0 ? "REGRESSION" : "improvement";
+            if (significant && delta > 0) {
+                _regressions++;
+            }
+            fmt::print("{:<{}} {:>11} {:>11} {:>+7.1f}%  {}\n", r.test_name, name_column_length(), duration { b->median }, duration { r.median },
+                       change * 100, verdict);
+        }
+    }
+
+    unsigned regressions() const {
+        return _regressions;
     }
 };
 
@@ -289,7 +382,7 @@ class markdown_printer final : public result_printer {
 
 };
 
-void performance_test::do_run(const config& conf)
+result performance_test::do_run(const config& conf)
 {
     _max_single_run_iterations = conf.single_run_iterations;
     if (!_max_single_run_iterations) {
@@ -314,7 +407,7 @@ void performance_test::do_run(const config& conf)
 
     result r{};
 
-    auto results = std::vector<double>(conf.number_of_runs);
+    r.samples.resize(conf.number_of_runs);
     uint64_t total_iterations = 0;
     for (auto i = 0u; i < conf.number_of_runs; i++) {
         // switch out of seastar thread
@@ -323,7 +416,7 @@ void performance_test::do_run(const config& conf)
             return do_single_run().then([&] (run_result rr) {
                 clock_type::duration dt = rr.duration;
                 double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
-                results[i] = ns / _single_run_iterations;
+                r.samples[i] = ns / _single_run_iterations;
 
                 total_iterations += _single_run_iterations;
 
@@ -331,6 +424,8 @@ void performance_test::do_run(const config& conf)
                 r.tasks += double(rr.stats.tasks_executed) / _single_run_iterations;
                 r.inst += double(rr.stats.instructions_retired) / _single_run_iterations;
                 r.cycles += double(rr.stats.cpu_cycles_retired) / _single_run_iterations;
+                r.l1_misses += double(rr.stats.l1_dcache_misses) / _single_run_iterations;
+                r.llc_misses += double(rr.stats.llc_misses) / _single_run_iterations;
             });
         }).get();
     }
@@ -338,41 +433,78 @@ void performance_test::do_run(const config& conf)
     r.test_name = name();
     r.total_iterations = total_iterations;
     r.runs = conf.number_of_runs;
-
-    auto mid = conf.number_of_runs / 2;
-
-    boost::range::sort(results);
-    r.median = results[mid];
-
-    auto diffs = boost::copy_range<std::vector<double>>(
-        results | boost::adaptors::transformed([&] (double x) { return fabs(x - r.median); })
-    );
-    boost::range::sort(diffs);
-    r.mad = diffs[mid];
-
-    r.min = results[0];
-    r.max = results[results.size() - 1];
+    r.compute_statistics();
 
     r.allocs /= conf.number_of_runs;
     r.tasks /= conf.number_of_runs;
     r.inst /= conf.number_of_runs;
     r.cycles /= conf.number_of_runs;
+    r.l1_misses /= conf.number_of_runs;
+    r.llc_misses /= conf.number_of_runs;
+
+    return r;
+}
+
+// Each shard runs its own instance of the test, at the same time as the
+// others, so that they contend for the memory bandwidth, the caches and
+// whatever the test shares between them. The aggregated result pools the
+// runs of all the shards and averages their counters; its iterations are
+// those of all the shards in a run.
+void performance_test::run_on_all_shards(const config& conf)
+{
+    auto results = std::vector<result>(smp::count);
+    smp::invoke_on_all([this, &conf, &results] {
+        return async([this, &conf, &results] {
+            auto test = clone();
+            test->set_up();
+            auto done = defer([&] () noexcept { test->tear_down(); });
+            results[this_shard_id()] = test->do_run(conf);
+        });
+    }).get();
+
+    result total{};
+    total.test_name = name();
+    total.runs = conf.number_of_runs;
+    for (auto& r : results) {
+        total.total_iterations += r.total_iterations;
+        total.samples.insert(total.samples.end(), r.samples.begin(), r.samples.end());
+        total.allocs += r.allocs / smp::count;
+        total.tasks += r.tasks / smp::count;
+        total.inst += r.inst / smp::count;
+        total.cycles += r.cycles / smp::count;
+        total.l1_misses += r.l1_misses / smp::count;
+        total.llc_misses += r.llc_misses / smp::count;
+    }
+    total.compute_statistics();
 
     for (auto& rp : conf.printers) {
-        rp->print_result(r);
+        rp->print_result(total);
+        for (unsigned shard = 0; shard < results.size(); shard++) {
+            results[shard].test_name = fmt::format("{}@{}", name(), shard);
+            rp->print_result(results[shard]);
+        }
     }
 }
 
 void performance_test::run(const config& conf)
 {
+    if (conf.all_shards && smp::count > 1) {
+        run_on_all_shards(conf);
+        return;
+    }
     set_up();
+    result r;
     try {
-        do_run(conf);
+        r = do_run(conf);
     } catch (...) {
         tear_down();
         throw;
     }
     tear_down();
+
+    for (auto& rp : conf.printers) {
+        rp->print_result(r);
+    }
 }
 
 std::vector<std::unique_ptr<performance_test>>& all_tests()
@@ -399,6 +531,9 @@ void run_all(const std::vector<std::string>& tests, config& conf)
     for (auto&& test : all_tests() | boost::adaptors::filtered(can_run)) {
         max_name_column_length = std::max(max_name_column_length, test->name().size());
     }
+    if (conf.all_shards && smp::count > 1) {
+        max_name_column_length += fmt::format("@{}", smp::count - 1).size();
+    }
 
     for (auto& rp : conf.printers) {
         rp->update_name_column_length(max_name_column_length);
@@ -407,6 +542,9 @@ void run_all(const std::vector<std::string>& tests, config& conf)
     for (auto&& test : all_tests() | boost::adaptors::filtered(std::move(can_run))) {
         test->run(conf);
     }
+    for (auto& rp : conf.printers) {
+        rp->print_summary();
+    }
 }
 
 }
@@ -431,6 +569,11 @@ int main(int ac, char** av)
         ("json-output", bpo::value<std::string>(), "output json file")
         ("md-output", bpo::value<std::string>(), "output markdown file")
         ("list", "list available tests")
+        ("all-shards", "run each test on all shards at once, reporting the aggregated and per-shard results")
+        ("compare", bpo::value<std::string>(), "json file of an earlier run to compare the results with; "
+            "exits with 1 if any test regressed significantly")
+        ("compare-threshold", bpo::value<double>()->default_value(5),
+            "smallest change of a median, in percent, --compare reports as significant")
         ;
 
     return app.run(ac, av, [&] {
@@ -443,6 +586,7 @@ int main(int ac, char** av)
             conf.single_run_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(dur);
             conf.number_of_runs = app.configuration()["runs"].as<size_t>();
             conf.random_seed = app.configuration()["random-seed"].as<unsigned>();
+            conf.all_shards = app.configuration().count("all-shards");
 
             std::vector<std::string> tests_to_run;
             if (app.configuration().count("test")) {
@@ -454,7 +598,7 @@ int main(int ac, char** av)
                 for (auto&& t : all_tests()) {
                     fmt::print("\t{}\n", t->name());
                 }
-                return;
+                return 0;
             }
 
             if (!app.configuration().count("no-stdout")) {
@@ -473,6 +617,15 @@ int main(int ac, char** av)
                 ));
             }
 
+            compare_printer* compare = nullptr;
+            if (app.configuration().count("compare")) {
+                auto printer = std::make_unique<compare_printer>(
+                    app.configuration()["compare"].as<std::string>(),
+                    app.configuration()["compare-threshold"].as<double>() / 100);
+                compare = printer.get();
+                conf.printers.emplace_back(std::move(printer));
+            }
+
             if (!conf.random_seed) {
                 conf.random_seed = std::random_device()();
             }
@@ -482,6 +635,7 @@ int main(int ac, char** av)
             }).get();
 
             run_all(tests_to_run, conf);
+            return compare && compare->regressions() ? 1 : 0;
         });
     });
 }
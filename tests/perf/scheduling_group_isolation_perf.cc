@@ -0,0 +1,598 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <fmt/core.h>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/preempt.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/net/api.hh>
+#include <seastar/util/defer.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Runs competing synthetic loads in scheduling groups on every shard and
+// reports how well the groups are isolated from each other:
+//
+//  - shares: a CPU spinner in each of the --shares groups; reports the CPU
+//    time each group got against its fair share, and the worst deviation.
+//  - io-shares: the same with readers of a file, for the disk bandwidth.
+//  - latency: an open-loop foreground load of short requests (some CPU
+//    work and, with io in --background, a small read), alone and then
+//    against the --background loads saturating a low-share group; reports
+//    the request latency percentiles of both runs.
+//  - preemption: a timer in the foreground group, alone and then against
+//    the --background loads; reports how late it fires, compared with the
+//    task quota the background tasks are to yield after.
+//
+// Run it the same way from build to build and compare the --report-file
+// outputs to catch isolation regressions:
+//      scheduling_group_isolation_perf -c4 --report-file isolation.json
+//  - Preemption latency against the task quota:
+//      scheduling_group_isolation_perf -c1 --scenarios preemption --task-quota-ms 0.1
+//      scheduling_group_isolation_perf -c1 --scenarios preemption --task-quota-ms 2
+//  - Background tasks that check for preemption rarely, as long loops
+//    without maybe_yield() do:
+//      scheduling_group_isolation_perf --scenarios latency preemption --preempt-check-us 2000
+//  - CPU against the network only:
+//      scheduling_group_isolation_perf --scenarios latency --background cpu net
+
+using clock_type = std::chrono::steady_clock;
+
+// Latencies in nanoseconds, within 1/16 of their value
+using latency_histogram = metrics::internal::approximate_exponential_histogram<16, uint64_t(1) << 30, 16>;
+
+struct latency_stats {
+    latency_histogram histogram;
+    uint64_t max = 0;
+    uint64_t count = 0;
+
+    void add(clock_type::duration d) {
+        auto ns = uint64_t(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()));
+        histogram.add(ns);
+        max = std::max(max, ns);
+        count++;
+    }
+
+    latency_stats& operator+=(const latency_stats& o) {
+        histogram.merge(o.histogram);
+        max = std::max(max, o.max);
+        count += o.count;
+        return *this;
+    }
+};
+
+latency_stats operator+(latency_stats a, const latency_stats& b) {
+    return a += b;
+}
+
+// What each group, by slot, got during a run
+struct usage {
+    std::vector<double> cpu_seconds;
+    std::vector<double> io_bytes;
+    double net_bytes = 0;
+
+    usage& operator+=(const usage& o) {
+        cpu_seconds.resize(std::max(cpu_seconds.size(), o.cpu_seconds.size()));
+        io_bytes.resize(std::max(io_bytes.size(), o.io_bytes.size()));
+        for (size_t i = 0; i < o.cpu_seconds.size(); i++) {
+            cpu_seconds[i] += o.cpu_seconds[i];
+        }
+        for (size_t i = 0; i < o.io_bytes.size(); i++) {
+            io_bytes[i] += o.io_bytes[i];
+        }
+        net_bytes += o.net_bytes;
+        return *this;
+    }
+};
+
+usage operator+(usage a, const usage& b) {
+    return a += b;
+}
+
+// Burns CPU for about d, the way a compute-bound task does
+static void spin_for(clock_type::duration d) {
+    auto end = clock_type::now() + d;
+    while (clock_type::now() < end) {
+    }
+}
+
+class bench {
+public:
+    struct config {
+        bool cpu;
+        bool io;
+        bool net;
+        clock_type::duration preempt_check;
+        unsigned fg_rate;
+        clock_type::duration fg_work;
+        size_t fg_read_size;
+        clock_type::duration timer_interval;
+        std::string io_dir;
+        size_t io_file_size;
+        size_t io_block_size;
+        unsigned io_parallelism;
+        uint16_t net_port;
+        unsigned net_connections;
+        size_t net_block_size;
+    };
+private:
+    config _cfg;
+    std::mt19937_64 _rng;
+    std::string _path;
+    std::optional<file> _file;
+    std::optional<server_socket> _listener;
+    future<> _accepted = make_ready_future<>();
+    gate _connections;
+    // The loads of a run, and what they got, by slot
+    bool _stop = false;
+    std::vector<future<>> _loads;
+    std::vector<clock_type::duration> _cpu;
+    std::vector<uint64_t> _io;
+    uint64_t _net = 0;
+
+    socket_address address() const {
+        return socket_address(ipv4_addr("127.0.0.1", _cfg.net_port + this_shard_id()));
+    }
+
+    uint64_t random_offset(size_t size) {
+        auto blocks = std::max<size_t>(1, _cfg.io_file_size / size);
+        return (_rng() % blocks) * size;
+    }
+
+    future<> spin(unsigned slot) {
+        while (!_stop) {
+            auto start = clock_type::now();
+            do {
+                spin_for(_cfg.preempt_check);
+            } while (!need_preempt());
+            _cpu[slot] += clock_type::now() - start;
+            co_await coroutine::maybe_yield();
+        }
+    }
+
+    future<> read(unsigned slot) {
+        while (!_stop) {
+            auto buf = co_await _file->dma_read<char>(random_offset(_cfg.io_block_size), _cfg.io_block_size);
+            _io[slot] += buf.size();
+        }
+    }
+
+    future<> echo() {
+        auto s = co_await seastar::connect(address());
+        auto in = s.input();
+        auto out = s.output();
+        temporary_buffer<char> block(_cfg.net_block_size);
+        std::memset(block.get_write(), 'x', block.size());
+        while (!_stop) {
+            co_await out.write(block.get(), block.size());
+            co_await out.flush();
+            for (size_t got = 0; got < block.size(); ) {
+                auto b = co_await in.read_up_to(block.size() - got);
+                if (b.empty()) {
+                    throw std::runtime_error("echo connection closed by the server");
+                }
+                got += b.size();
+            }
+            _net += block.size();
+        }
+        co_await out.close();
+        co_await in.close();
+    }
+
+    future<> serve(connected_socket s) {
+        auto in = s.input();
+        auto out = s.output();
+        try {
+            while (auto buf = co_await in.read()) {
+                co_await out.write(std::move(buf));
+                co_await out.flush();
+            }
+        } catch (...) {
+            // Torn down at exit
+        }
+        co_await out.close().handle_exception([] (auto) {});
+    }
+
+    future<> accept() {
+        while (true) {
+            accept_result ar;
+            try {
+                ar = co_await _listener->accept();
+            } catch (...) {
+                co_return;
+            }
+            (void)with_gate(_connections, [this, s = std::move(ar.connection)] () mutable {
+                return serve(std::move(s));
+            });
+        }
+    }
+
+    future<> request(clock_type::time_point scheduled, latency_stats& stats) {
+        spin_for(_cfg.fg_work);
+        if (_cfg.io && _cfg.fg_read_size) {
+            co_await _file->dma_read<char>(random_offset(_cfg.fg_read_size), _cfg.fg_read_size);
+        }
+        stats.add(clock_type::now() - scheduled);
+    }
+
+    // Issues requests at a fixed rate whether or not the earlier ones are
+    // done, measuring from when each was due, so that stalls count for all
+    // the requests they delay
+    future<> issue(clock_type::duration d, latency_stats& stats) {
+        gate requests;
+        auto period = std::chrono::duration_cast<clock_type::duration>(1s) / std::max(1u, _cfg.fg_rate);
+        auto end = clock_type::now() + d;
+        for (auto next = clock_type::now(); next < end; next += period) {
+            auto now = clock_type::now();
+            if (next > now) {
+                co_await seastar::sleep(next - now);
+            }
+            (void)with_gate(requests, [this, next, &stats] {
+                return request(next, stats);
+            });
+        }
+        co_await requests.close();
+    }
+
+    future<> sample_timers(clock_type::duration d, latency_stats& stats) {
+        auto end = clock_type::now() + d;
+        while (clock_type::now() < end) {
+            auto armed = clock_type::now();
+            co_await seastar::sleep(_cfg.timer_interval);
+            stats.add(clock_type::now() - armed - _cfg.timer_interval);
+        }
+    }
+
+    void launch(scheduling_group sg, std::function<future<> ()> load) {
+        _loads.push_back(with_scheduling_group(sg, std::move(load)));
+    }
+
+    void reset(size_t slots) {
+        _stop = false;
+        _cpu.assign(slots, {});
+        _io.assign(slots, 0);
+        _net = 0;
+    }
+
+    future<usage> finish() {
+        _stop = true;
+        for (auto& f : _loads) {
+            co_await std::move(f);
+        }
+        _loads.clear();
+        usage u;
+        for (auto& d : _cpu) {
+            u.cpu_seconds.push_back(std::chrono::duration<double>(d).count());
+        }
+        u.io_bytes.assign(_io.begin(), _io.end());
+        u.net_bytes = _net;
+        co_return u;
+    }
+public:
+    explicit bench(config cfg)
+        : _cfg(std::move(cfg))
+        , _rng(std::random_device()())
+        , _path(fmt::format("{}/scheduling_group_isolation_perf.{}", _cfg.io_dir, this_shard_id()))
+    {}
+
+    // Writes the file to read and starts the echo server, in the
+    // background group
+    future<> start(scheduling_group bg) {
+        if (_cfg.io) {
+            _file = co_await open_file_dma(_path, open_flags::rw | open_flags::create | open_flags::truncate);
+            auto chunk = std::min<size_t>(_cfg.io_file_size, 1 << 20);
+            auto buf = temporary_buffer<char>::aligned(_file->memory_dma_alignment(), chunk);
+            std::memset(buf.get_write(), 'x', buf.size());
+            for (uint64_t pos = 0; pos < _cfg.io_file_size; pos += chunk) {
+                co_await _file->dma_write(pos, buf.get(), chunk);
+            }
+            co_await _file->flush();
+        }
+        if (_cfg.net) {
+            listen_options lo;
+            lo.reuse_address = true;
+            _listener = seastar::listen(address(), lo);
+            _accepted = with_scheduling_group(bg, [this] { return accept(); });
+        }
+    }
+
+    future<> stop() {
+        if (_listener) {
+            _listener->abort_accept();
+            co_await std::move(_accepted);
+            co_await _connections.close();
+        }
+        if (_file) {
+            co_await _file->close();
+            co_await remove_file(_path);
+        }
+    }
+
+    // Spins in, and with io reads from the file in, each of groups
+    future<usage> compete(std::vector<scheduling_group> groups, bool io, clock_type::duration d) {
+        reset(groups.size());
+        for (unsigned slot = 0; slot < groups.size(); slot++) {
+            if (io) {
+                for (unsigned i = 0; i < _cfg.io_parallelism; i++) {
+                    launch(groups[slot], [this, slot] { return read(slot); });
+                }
+            } else {
+                launch(groups[slot], [this, slot] { return spin(slot); });
+            }
+        }
+        co_await seastar::sleep(d);
+        co_return co_await finish();
+    }
+
+    // Starts the background loads in bg
+    void load(scheduling_group bg) {
+        reset(1);
+        if (_cfg.cpu) {
+            launch(bg, [this] { return spin(0); });
+        }
+        if (_cfg.io) {
+            for (unsigned i = 0; i < _cfg.io_parallelism; i++) {
+                launch(bg, [this] { return read(0); });
+            }
+        }
+        if (_cfg.net) {
+            for (unsigned i = 0; i < _cfg.net_connections; i++) {
+                launch(bg, [this] { return echo(); });
+            }
+        }
+    }
+
+    future<usage> unload() {
+        return finish();
+    }
+
+    future<latency_stats> probe(scheduling_group fg, clock_type::duration d) {
+        latency_stats stats;
+        co_await with_scheduling_group(fg, [this, d, &stats] { return issue(d, stats); });
+        co_return stats;
+    }
+
+    future<latency_stats> timer_lateness(scheduling_group fg, clock_type::duration d) {
+        latency_stats stats;
+        co_await with_scheduling_group(fg, [this, d, &stats] { return sample_timers(d, stats); });
+        co_return stats;
+    }
+};
+
+// Flat results, as "scenario.metric", for comparing runs
+using report = std::map<std::string, double>;
+
+static double us(uint64_t ns) {
+    return ns / 1000.0;
+}
+
+static std::string latencies(const latency_stats& s) {
+    return fmt::format("{:.1f}/{:.1f}/{:.1f}/{:.1f}", us(s.histogram.quantile(0.5)), us(s.histogram.quantile(0.99)),
+                       us(s.histogram.quantile(0.999)), us(s.max));
+}
+
+static void record(report& r, const std::string& prefix, const latency_stats& s) {
+    r[prefix + ".count"] = s.count;
+    r[prefix + ".p50_us"] = us(s.histogram.quantile(0.5));
+    r[prefix + ".p99_us"] = us(s.histogram.quantile(0.99));
+    r[prefix + ".p999_us"] = us(s.histogram.quantile(0.999));
+    r[prefix + ".max_us"] = us(s.max);
+}
+
+// Prints the share each group got of what all of them got, against the
+// share it was given, and returns the worst relative deviation
+static double print_shares(const std::vector<float>& shares, const std::vector<double>& got, const char* unit, double scale) {
+    double total_shares = 0, total = 0;
+    for (unsigned i = 0; i < shares.size(); i++) {
+        total_shares += shares[i];
+        total += got[i];
+    }
+    double worst = 0;
+    fmt::print("{:>10} {:>14} {:>10} {:>10} {:>10}\n", "shares", unit, "expected", "achieved", "error");
+    for (unsigned i = 0; i < shares.size(); i++) {
+        auto expected = shares[i] / total_shares;
+        auto achieved = total ? got[i] / total : 0;
+        auto error = achieved / expected - 1;
+        worst = std::max(worst, std::abs(error));
+        fmt::print("{:>10.0f} {:>14.1f} {:>10.3f} {:>10.3f} {:>+10.3f}\n", shares[i], got[i] / scale, expected, achieved, error);
+    }
+    return worst;
+}
+
+static void write_report(const std::string& file, const report& r) {
+    std::ofstream out(file);
+    if (!out) {
+        throw std::runtime_error(fmt::format("cannot write {}", file));
+    }
+    out << "{\n";
+    for (auto it = r.begin(); it != r.end(); ++it) {
+        out << fmt::format("  \"{}\": {}{}\n", it->first, it->second, std::next(it) == r.end() ? "" : ",");
+    }
+    out << "}\n";
+}
+
+int main(int ac, char** av) {
+    app_template app;
+    namespace bpo = boost::program_options;
+    app.add_options()
+        ("duration", bpo::value<unsigned>()->default_value(10), "time to run each phase of the scenarios (seconds)")
+        ("scenarios", bpo::value<std::vector<std::string>>()->multitoken()->default_value({"shares", "io-shares", "latency", "preemption"}, "shares io-shares latency preemption"),
+            "scenarios to run: shares, io-shares, latency, preemption")
+        ("background", bpo::value<std::vector<std::string>>()->multitoken()->default_value({"cpu", "io", "net"}, "cpu io net"),
+            "background loads: cpu, io, net")
+        ("shares", bpo::value<std::vector<float>>()->multitoken()->default_value({100, 200, 400, 800}, "100 200 400 800"),
+            "shares of the competing groups of the shares scenarios")
+        ("fg-shares", bpo::value<float>()->default_value(1000), "shares of the foreground group")
+        ("bg-shares", bpo::value<float>()->default_value(100), "shares of the background group")
+        ("preempt-check-us", bpo::value<unsigned>()->default_value(10), "time between the preemption checks of the CPU loads (microseconds)")
+        ("fg-rate", bpo::value<unsigned>()->default_value(1000), "foreground requests per second of each shard")
+        ("fg-work-us", bpo::value<unsigned>()->default_value(20), "CPU time of a foreground request (microseconds)")
+        ("fg-read-size", bpo::value<size_t>()->default_value(4096), "bytes read by a foreground request with the io load, or 0")
+        ("timer-interval-us", bpo::value<unsigned>()->default_value(1000), "period of the preemption scenario's timer (microseconds)")
+        ("io-dir", bpo::value<std::string>()->default_value("."), "directory of the files read by the io loads; must support O_DIRECT")
+        ("io-file-size", bpo::value<size_t>()->default_value(256 << 20), "size of the file of each shard")
+        ("io-block-size", bpo::value<size_t>()->default_value(128 << 10), "size of the background reads")
+        ("io-parallelism", bpo::value<unsigned>()->default_value(4), "reads in flight of each io load")
+        ("net-port", bpo::value<uint16_t>()->default_value(10000), "loopback port of the echo server of shard 0, the others use the next ones")
+        ("net-connections", bpo::value<unsigned>()->default_value(4), "echo connections of each shard")
+        ("net-block-size", bpo::value<size_t>()->default_value(64 << 10), "size of the blocks echoed")
+        ("report-file", bpo::value<std::string>(), "file to write the results to, as a JSON object")
+        ;
+
+    return app.run(ac, av, [&app] {
+        return async([&app] {
+            auto& opts = app.configuration();
+            auto scenarios = opts["scenarios"].as<std::vector<std::string>>();
+            auto background = opts["background"].as<std::vector<std::string>>();
+            auto has = [] (const std::vector<std::string>& v, const char* x) {
+                return std::find(v.begin(), v.end(), x) != v.end();
+            };
+            auto shares = opts["shares"].as<std::vector<float>>();
+            bench::config cfg{
+                .cpu = has(background, "cpu"),
+                .io = has(background, "io") || has(scenarios, "io-shares"),
+                .net = has(background, "net"),
+                .preempt_check = std::chrono::microseconds(opts["preempt-check-us"].as<unsigned>()),
+                .fg_rate = opts["fg-rate"].as<unsigned>(),
+                .fg_work = std::chrono::microseconds(opts["fg-work-us"].as<unsigned>()),
+                .fg_read_size = opts["fg-read-size"].as<size_t>(),
+                .timer_interval = std::chrono::microseconds(opts["timer-interval-us"].as<unsigned>()),
+                .io_dir = opts["io-dir"].as<std::string>(),
+                .io_file_size = opts["io-file-size"].as<size_t>(),
+                .io_block_size = opts["io-block-size"].as<size_t>(),
+                .io_parallelism = std::max(1u, opts["io-parallelism"].as<unsigned>()),
+                .net_port = opts["net-port"].as<uint16_t>(),
+                .net_connections = std::max(1u, opts["net-connections"].as<unsigned>()),
+                .net_block_size = std::max<size_t>(1, opts["net-block-size"].as<size_t>()),
+            };
+            if (shares.empty() || std::any_of(shares.begin(), shares.end(), [] (float s) { return s <= 0; })) {
+                throw std::runtime_error("needs --shares, all of them positive");
+            }
+            if (cfg.io && (cfg.io_block_size == 0 || cfg.io_file_size < std::max(cfg.io_block_size, cfg.fg_read_size))) {
+                throw std::runtime_error("needs an --io-file-size of at least --io-block-size and --fg-read-size");
+            }
+            auto duration = std::chrono::seconds(std::max(1u, opts["duration"].as<unsigned>()));
+            // Reactor options are parsed into the same variables map
+            auto task_quota_ms = opts["task-quota-ms"].as<double>();
+
+            std::vector<scheduling_group> groups;
+            auto destroy = defer([&] () noexcept {
+                for (auto sg : groups) {
+                    destroy_scheduling_group(sg).get();
+                }
+            });
+            auto fg = groups.emplace_back(create_scheduling_group("isolation_fg", opts["fg-shares"].as<float>()).get());
+            auto bg = groups.emplace_back(create_scheduling_group("isolation_bg", opts["bg-shares"].as<float>()).get());
+            std::vector<scheduling_group> competing;
+            for (unsigned i = 0; i < shares.size(); i++) {
+                competing.push_back(groups.emplace_back(create_scheduling_group(fmt::format("isolation_{}", i), shares[i]).get()));
+            }
+
+            sharded<bench> benches;
+            benches.start(cfg).get();
+            auto stop = defer([&] () noexcept { benches.stop().get(); });
+            benches.invoke_on_all([bg] (bench& b) { return b.start(bg); }).get();
+
+            report r;
+            r["config.shards"] = smp::count;
+            r["config.task_quota_ms"] = task_quota_ms;
+            r["config.duration_s"] = duration.count();
+            auto secs = double(duration.count()) * smp::count;
+
+            if (has(scenarios, "shares")) {
+                fmt::print("shares: CPU time of spinners in groups of different shares\n");
+                auto u = benches.map_reduce0([&] (bench& b) { return b.compete(competing, false, duration); }, usage{}, std::plus<>()).get();
+                r["shares.max_error"] = print_shares(shares, u.cpu_seconds, "cpu s", 1);
+            }
+            if (has(scenarios, "io-shares")) {
+                fmt::print("io-shares: bandwidth of readers in groups of different shares\n");
+                auto u = benches.map_reduce0([&] (bench& b) { return b.compete(competing, true, duration); }, usage{}, std::plus<>()).get();
+                std::vector<double> bandwidth;
+                for (auto bytes : u.io_bytes) {
+                    bandwidth.push_back(bytes / duration.count());
+                }
+                r["io_shares.max_error"] = print_shares(shares, bandwidth, "MiB/s", 1 << 20);
+            }
+
+            // Runs phase in the foreground alone and then against the
+            // background loads, and prints the latencies of both
+            auto idle_and_loaded = [&] (const char* name, auto phase) {
+                fmt::print("{:>8} {:>10} {:>36} {:>10} {:>10} {:>10}\n", name, "samples", "latency p50/p99/p99.9/max us", "bg cpu", "bg MiB/s", "net MiB/s");
+                for (auto loaded : {false, true}) {
+                    usage u;
+                    if (loaded) {
+                        benches.invoke_on_all([bg] (bench& b) { b.load(bg); }).get();
+                    }
+                    auto stats = benches.map_reduce0(phase, latency_stats{}, std::plus<>()).get();
+                    if (loaded) {
+                        u = benches.map_reduce0(std::mem_fn(&bench::unload), usage{}, std::plus<>()).get();
+                    }
+                    auto cpu = u.cpu_seconds.empty() ? 0 : u.cpu_seconds[0] / secs;
+                    auto io = u.io_bytes.empty() ? 0 : u.io_bytes[0] / duration.count() / (1 << 20);
+                    auto net = u.net_bytes / duration.count() / (1 << 20);
+                    auto label = loaded ? "loaded" : "idle";
+                    fmt::print("{:>8} {:>10} {:>36} {:>10.3f} {:>10.1f} {:>10.1f}\n", label, stats.count, latencies(stats), cpu, io, net);
+                    auto prefix = fmt::format("{}.{}", name, label);
+                    record(r, prefix, stats);
+                    if (loaded) {
+                        r[prefix + ".bg_cpu_share"] = cpu;
+                        r[prefix + ".bg_io_mib_s"] = io;
+                        r[prefix + ".bg_net_mib_s"] = net;
+                    }
+                }
+            };
+            if (has(scenarios, "latency")) {
+                idle_and_loaded("latency", [&] (bench& b) { return b.probe(fg, duration); });
+            }
+            if (has(scenarios, "preemption")) {
+                idle_and_loaded("preemption", [&] (bench& b) { return b.timer_lateness(fg, duration); });
+                // The background tasks are to yield after a task quota, and
+                // the timer to fire after the one it expired during
+                auto quota_us = task_quota_ms * 1000;
+                r["preemption.loaded.p99_over_quota"] = r["preemption.loaded.p99_us"] / quota_us;
+                r["preemption.loaded.max_over_quota"] = r["preemption.loaded.max_us"] / quota_us;
+                fmt::print("timer lateness under load, over the {}ms task quota: p99 {:.2f}, max {:.2f}\n", task_quota_ms,
+                           r["preemption.loaded.p99_over_quota"], r["preemption.loaded.max_over_quota"]);
+            }
+
+            if (opts.count("report-file")) {
+                write_report(opts["report-file"].as<std::string>(), r);
+            }
+        });
+    });
+}
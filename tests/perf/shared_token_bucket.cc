@@ -41,6 +41,12 @@
 // In braces there are minimal and maximum rate of individual shards. These numbers
 // should not differ to much from each other, if they do it means that the t.b.
 // is not fair
+//
+// The "batched" tests grab the tokens through a token_bucket_batch, a batch
+// of a quarter of the per-tick threshold at a time. Each shard reports how many
+// times it grabbed from the bucket itself, touching the cache line all the
+// shards share, next to the tokens it got: the fewer grabs, the less
+// contention, and the min/max spread tells how much fairness that costs.
 
 using clock_type = std::chrono::steady_clock;
 
@@ -95,6 +101,14 @@ struct worker : public seastar::peering_sharded_service<worker<TokenBucket>> {
     timer<> release_tokens;
 
     std::optional<std::pair<int, uint64_t>> head;
+
+    // Batched grabs, for the buckets that support them
+    struct no_batch {};
+    using batch_t = std::conditional_t<TokenBucket::is_capped == internal::capped_release::no,
+            internal::token_bucket_batch<TokenBucket>, no_batch>;
+    std::optional<batch_t> batch;
+    uint64_t bucket_grabs = 0;
+    uint64_t reported_grabs = 0;
     // The IO-scheduler doesn't get more than this number of tokens per tick.
     // The test tries to mimic this behavior
     const uint64_t threshold;
@@ -123,7 +137,7 @@ struct worker : public seastar::peering_sharded_service<worker<TokenBucket>> {
     };
     std::deque<tick_data> ticks;
 
-    worker(TokenBucket& tb_) noexcept
+    worker(TokenBucket& tb_, unsigned batch_divisor) noexcept
         : tb(tb_)
         , release_per_tick(double(tb.rate()) / smp::count * std::chrono::duration_cast<std::chrono::duration<double>>(release_period).count())
         , last_release(clock_type::now())
@@ -132,9 +146,33 @@ struct worker : public seastar::peering_sharded_service<worker<TokenBucket>> {
         , size(1, std::min<int>(threshold, 128))
     {
         release_tokens.arm_periodic(std::chrono::duration_cast<std::chrono::microseconds>(release_period));
+        if constexpr (TokenBucket::is_capped == internal::capped_release::no) {
+            if (batch_divisor) {
+                batch.emplace(tb, std::max<uint64_t>(threshold / batch_divisor, 1));
+            }
+        }
         fmt::print("{} worker, threshold {}, release-per-tick {}\n", this_shard_id(), threshold, release_per_tick);
     }
 
+    uint64_t grab(uint64_t tokens) {
+        if constexpr (TokenBucket::is_capped == internal::capped_release::no) {
+            if (batch) {
+                return batch->grab(tokens);
+            }
+        }
+        bucket_grabs++;
+        return tb.grab(tokens);
+    }
+
+    uint64_t total_bucket_grabs() const {
+        if constexpr (TokenBucket::is_capped == internal::capped_release::no) {
+            if (batch) {
+                return bucket_grabs + batch->bucket_grabs();
+            }
+        }
+        return bucket_grabs;
+    }
+
     void do_release(uint64_t tokens) {
         available -= tokens;
         released += tokens;
@@ -175,7 +213,7 @@ struct worker : public seastar::peering_sharded_service<worker<TokenBucket>> {
                         head.reset();
                     } else {
                         sz = size(testing::local_random_engine);
-                        auto h = tb.grab(sz);
+                        auto h = grab(sz);
                         d = tb.deficiency(h);
                         if (d > 0) {
                             head = std::make_pair(sz, h);
@@ -204,9 +242,16 @@ struct worker : public seastar::peering_sharded_service<worker<TokenBucket>> {
             //  - expected speed (token-bucket.rate() / smp::count)
             //  - ticks -- the number of times the worker had change to grab tokens
             //  - the info about tokens releasing
+            //  - the number of grabs from the bucket itself
+            if constexpr (TokenBucket::is_capped == internal::capped_release::no) {
+                if (batch) {
+                    batch->refund();
+                }
+            }
             auto delay = std::chrono::duration_cast<std::chrono::duration<double>>(clock_type::now() - start).count();
-            fmt::print("{} {}t/{:.3f}s, speed is {:.1f}t/s goal {:.1f}t/s, {} ticks, released {} (accumulated {})\n", this_shard_id(), tokens, delay,
-                    double(tokens) / delay, double(tb.rate()) / smp::count, ticks.size(), released, available);
+            auto grabs = total_bucket_grabs();
+            fmt::print("{} {}t/{:.3f}s, speed is {:.1f}t/s goal {:.1f}t/s, {} ticks, released {} (accumulated {}), {} bucket grabs\n", this_shard_id(), tokens, delay,
+                    double(tokens) / delay, double(tb.rate()) / smp::count, ticks.size(), released, available, grabs - std::exchange(reported_grabs, grabs));
             do_release(available);
             work_result r {
                 .tokens = std::exchange(this->tokens, 0),
@@ -291,7 +336,7 @@ struct hog {
     }
 };
 
-template <typename TokenBucket>
+template <typename TokenBucket, unsigned BatchDivisor = 0>
 struct context {
     using worker_t = worker<TokenBucket>;
     TokenBucket tb;
@@ -304,7 +349,7 @@ struct context {
 
     context() : tb(rate, limit, threshold)
     {
-        w.start(std::ref(tb)).get();
+        w.start(std::ref(tb), BatchDivisor).get();
         h.start(std::chrono::microseconds(300), std::chrono::microseconds(100)).get();
         fmt::print("Created tb {}t/s (limit {} threshold {})\n", tb.rate(), tb.limit(), tb.threshold());
     }
@@ -345,6 +390,7 @@ struct context {
 
 struct perf_capped_context : public context<capped_token_bucket_t> {};
 struct perf_pure_context : public context<pure_token_bucket_t> {};
+struct perf_batched_context : public context<pure_token_bucket_t, 4> {};
 
 // There are 3 tests run over 2 types of buckets:
 //
@@ -352,7 +398,8 @@ struct perf_pure_context : public context<pure_token_bucket_t> {};
 // - sleep in case token bucket reports deficiency
 // - sleep on deficiency, but run CPU hogs in the background
 //
-// All tests are run with capped and non-capped (called pure) token buckets
+// All tests are run with capped and non-capped (called pure) token buckets,
+// and with the latter grabbed in batches
 
 PERF_TEST_F(perf_capped_context, yielding_throughput) { return test_yielding(); }
 PERF_TEST_F(perf_capped_context, sleeping_throughput) { return test_sleeping(); }
@@ -361,3 +408,7 @@ PERF_TEST_F(perf_capped_context, sleeping_throughput_with_hog) { return test_sle
 PERF_TEST_F(perf_pure_context, yielding_throughput) { return test_yielding(); }
 PERF_TEST_F(perf_pure_context, sleeping_throughput) { return test_sleeping(); }
 PERF_TEST_F(perf_pure_context, sleeping_throughput_with_hog) { return test_sleeping_with_hog(); }
+
+PERF_TEST_F(perf_batched_context, yielding_throughput) { return test_yielding(); }
+PERF_TEST_F(perf_batched_context, sleeping_throughput) { return test_sleeping(); }
+PERF_TEST_F(perf_batched_context, sleeping_throughput_with_hog) { return test_sleeping_with_hog(); }
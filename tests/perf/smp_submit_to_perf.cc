@@ -32,6 +32,17 @@
 using namespace seastar;
 using namespace std::chrono;
 
+// Scenarios exercising the latency/throughput tradeoff of smp queue batching:
+//
+//  - Latency, one request in flight per worker; requests are sent (and
+//    answered) right away:
+//      smp_submit_to_perf -c4 --concurrency 1
+//  - Throughput, many requests in flight; requests are batched:
+//      smp_submit_to_perf -c4 --concurrency 128
+//  - Latency under throughput load, on a busy target; compare with and
+//    without --latency-sensitive 1:
+//      smp_submit_to_perf -c4 --concurrency 128 --thinkers 4 --think 50
+
 class thinker {
     class poisson_process {
         std::random_device _rd;
@@ -106,6 +117,8 @@ class worker {
     std::unique_ptr<thinker> _think;
 
     uint64_t _total;
+    steady_clock::duration _total_latency = {};
+    steady_clock::duration _max_latency = {};
     bool _stop;
     future<> _done;
 
@@ -115,10 +128,12 @@ class worker {
         return group_size * group_no;
     }
 
-    future<> start_working(unsigned concurrency, respond_type resp, microseconds tmo) {
-        return parallel_for_each(boost::irange(0u, concurrency), [this, resp, tmo] (unsigned f) {
-            return do_until([this] { return _stop; }, [this, resp, tmo] {
-                return smp::submit_to(_to, [resp, tmo] {
+    future<> start_working(unsigned concurrency, respond_type resp, microseconds tmo, bool latency_sensitive) {
+        return parallel_for_each(boost::irange(0u, concurrency), [this, resp, tmo, latency_sensitive] (unsigned f) {
+            return do_until([this] { return _stop; }, [this, resp, tmo, latency_sensitive] {
+                auto start = steady_clock::now();
+                smp_submit_to_options opts(default_smp_service_group(), smp_no_timeout, latency_sensitive);
+                return smp::submit_to(_to, opts, [resp, tmo] {
                     switch (resp) {
                     case respond_type::ready:
                         return make_ready_future<>();
@@ -131,7 +146,10 @@ class worker {
                     }
 
                     __builtin_unreachable();
-                }).then([this] {
+                }).then([this, start] {
+                    auto latency = steady_clock::now() - start;
+                    _total_latency += latency;
+                    _max_latency = std::max(_max_latency, latency);
                     _total++;
                     return make_ready_future<>();
                 });
@@ -147,6 +165,7 @@ class worker {
         respond_type respond;
         microseconds respond_tmo;
         unsigned concurrency;
+        bool latency_sensitive;
     };
 
     worker(config cfg) noexcept
@@ -154,7 +173,7 @@ class worker {
         , _think(is_target() && (cfg.thinkers > 0) ? std::make_unique<thinker>(cfg.thinkers, cfg.think) : nullptr)
         , _total(0)
         , _stop(false)
-        , _done(start_working(cfg.concurrency, cfg.respond, cfg.respond_tmo))
+        , _done(start_working(cfg.concurrency, cfg.respond, cfg.respond_tmo, cfg.latency_sensitive))
     {
     }
 
@@ -171,6 +190,10 @@ class worker {
 
     bool is_target() const noexcept { return _to == this_shard_id(); }
     uint64_t total() const noexcept { return _total; }
+    double avg_latency_us() const noexcept {
+        return _total ? duration<double, std::micro>(_total_latency).count() / _total : 0.0;
+    }
+    double max_latency_us() const noexcept { return duration<double, std::micro>(_max_latency).count(); }
 };
 
 class stats {
@@ -208,6 +231,7 @@ int main(int ac, char** av) {
             ("respond", bpo::value<std::string>()->default_value("ready"), "how to respond on target (ready, yield, io, timer)")
             ("respond-timeout", bpo::value<unsigned>()->default_value(1), "the 'timer' respond timeout (us)")
             ("concurrency", bpo::value<unsigned>()->default_value(1), "smp::submit_to operations to issue in parallel")
+            ("latency-sensitive", bpo::value<bool>()->default_value(false), "mark smp::submit_to operations as latency sensitive, sending each one right away")
         ;
 
     return at.run(ac, av, [&at] {
@@ -219,6 +243,7 @@ int main(int ac, char** av) {
         cfg.respond = parse_respond_type(at.configuration()["respond"].as<std::string>());
         cfg.respond_tmo = microseconds(at.configuration()["respond-timeout"].as<unsigned>());
         cfg.concurrency = at.configuration()["concurrency"].as<unsigned>();
+        cfg.latency_sensitive = at.configuration()["latency-sensitive"].as<bool>();
 
         return async([cfg, duration] {
             sharded<worker> workers;
@@ -231,16 +256,20 @@ int main(int ac, char** av) {
             auto real_duration = duration_cast<seconds>(steady_clock::now() - start);
             fmt::print("took {}s (expected {}s)\n", real_duration.count(), duration.count());
             stats st(real_duration.count()), st_targets(real_duration.count());
+            double max_latency = 0, latency_sum = 0;
             for (unsigned i = 0; i < smp::count; i++) {
-                workers.invoke_on(i, [&st, &st_targets] (worker& w) {
+                workers.invoke_on(i, [&st, &st_targets, &max_latency, &latency_sum] (worker& w) {
                     if (w.is_target()) {
                         st_targets.append(w.total());
                     } else {
                         st.append(w.total());
+                        latency_sum += w.avg_latency_us();
+                        max_latency = std::max(max_latency, w.max_latency_us());
                     }
                 }).get();
             }
             fmt::print("workers({:2}): min {:.1f} avg {:.1f} max {:.1f} op/s\n", st.nr(), st.min(), st.avg(), st.max());
+            fmt::print("workers({:2}): latency avg {:.1f} max {:.1f} us\n", st.nr(), st.nr() ? latency_sum / st.nr() : 0.0, max_latency);
             fmt::print("targets({:2}): min {:.1f} avg {:.1f} max {:.1f} op/s\n", st_targets.nr(), st_targets.min(), st_targets.avg(), st_targets.max());
 
             workers.stop().get();
@@ -0,0 +1,119 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/timer-set.hh>
+#include <seastar/core/timer-wheel.hh>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Compares timer_set and timer_wheel holding a million timers, the way a
+// shard holds connection idle timers and RPC timeouts: most of them far
+// away, rearmed or cancelled long before they expire.
+
+using namespace std::chrono_literals;
+
+namespace {
+
+struct bench_clock {
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<bench_clock, duration>;
+    static time_point now() noexcept { return time_point(); }
+};
+
+struct bench_timer {
+    using clock = bench_clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    boost::intrusive::list_member_hook<> link;
+    time_point expiry;
+    bool _expired = false;
+
+    time_point get_timeout() const noexcept { return expiry; }
+    void cancel() noexcept {}
+};
+
+template <typename Set>
+struct timers_bench {
+    static constexpr size_t nr_timers = 1 << 20;
+    static constexpr size_t nr_armed_per_run = 1000;
+    static constexpr auto tick = 10ms;
+
+    Set set;
+    std::vector<bench_timer> timers{nr_timers};
+    std::vector<bench_timer> churn{nr_armed_per_run};
+    std::mt19937 rng{0};
+    std::uniform_int_distribution<int64_t> timeout_ms{0, 60000};
+    bench_clock::time_point now;
+
+    bench_clock::duration random_timeout() {
+        return std::chrono::milliseconds(timeout_ms(rng));
+    }
+
+    timers_bench() {
+        for (auto& t : timers) {
+            t.expiry = now + random_timeout();
+            set.insert(t);
+        }
+    }
+
+    ~timers_bench() {
+        set.clear();
+    }
+
+    // Arms timers, and cancels them before they expire
+    size_t arm_cancel() {
+        for (auto& t : churn) {
+            t.expiry = now + random_timeout();
+            set.insert(t);
+        }
+        for (auto& t : churn) {
+            set.remove(t);
+        }
+        return churn.size() * 2;
+    }
+
+    // Advances the clock by a lowres_clock tick, rearming the timers that
+    // expired
+    size_t expire() {
+        now += tick;
+        auto expired = set.expire(now);
+        while (!expired.empty()) {
+            auto& t = *expired.begin();
+            expired.pop_front();
+            t.expiry = now + random_timeout();
+            set.insert(t);
+        }
+        return 1;
+    }
+};
+
+using timer_set_bench = timers_bench<seastar::timer_set<bench_timer, &bench_timer::link>>;
+using timer_wheel_bench = timers_bench<seastar::timer_wheel<bench_timer, &bench_timer::link>>;
+
+}
+
+PERF_TEST_F(timer_set_bench, arm_cancel) { return arm_cancel(); }
+PERF_TEST_F(timer_wheel_bench, arm_cancel) { return arm_cancel(); }
+PERF_TEST_F(timer_set_bench, expire) { return expire(); }
+PERF_TEST_F(timer_wheel_bench, expire) { return expire(); }
@@ -0,0 +1,100 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/websocket/server.hh>
+#include <seastar/util/utf8.hh>
+#include <random>
+#include <string>
+
+// Parses and unmasks a 64k binary and a mostly-ASCII text frame, as the
+// server receives them, validating the text with each instruction set the
+// CPU supports; a test of an unsupported one runs the default kernel.
+
+using namespace seastar;
+using seastar::internal::utf8_isa;
+
+namespace {
+
+struct websocket_bench {
+    static constexpr size_t payload_size = 65536;
+    std::string binary_payload = make_payload(false);
+    std::string text_payload = make_payload(true);
+    std::string binary = make_frame(0x2, binary_payload);
+    std::string text = make_frame(0x1, text_payload);
+
+    static std::string make_payload(bool text) {
+        std::mt19937 rng(0);
+        std::string payload;
+        while (payload.size() < payload_size) {
+            if (!text) {
+                payload += char(rng());
+            } else if (rng() % 16) {
+                payload += char(' ' + rng() % 95);
+            } else {
+                payload += "\xc3\xa9";
+            }
+        }
+        payload.resize(payload_size);
+        if (text) {
+            // Don't end in the middle of a code point
+            payload.back() = '.';
+        }
+        return payload;
+    }
+
+    static std::string make_frame(char opcode, const std::string& payload) {
+        const char key[] = {'\x12', '\x34', '\x56', '\x78'};
+        std::string frame;
+        frame += char(0x80 | opcode);
+        frame += char(0x80 | 127);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame += char(uint64_t(payload.size()) >> shift);
+        }
+        frame.append(key, sizeof(key));
+        for (size_t i = 0; i < payload.size(); ++i) {
+            frame += char(payload[i] ^ key[i % 4]);
+        }
+        return frame;
+    }
+
+    size_t parse(const std::string& frame) {
+        experimental::websocket::websocket_parser parser;
+        parser(temporary_buffer<char>(frame.data(), frame.size())).get();
+        auto payload = parser.result();
+        perf_tests::do_not_optimize(payload);
+        return payload.size();
+    }
+
+    size_t validate(utf8_isa isa) {
+        seastar::internal::use_utf8_isa(isa);
+        perf_tests::do_not_optimize(is_valid_utf8(text_payload.data(), text_payload.size()));
+        return text_payload.size();
+    }
+};
+
+}
+
+PERF_TEST_F(websocket_bench, unmask_binary_64k) { return parse(binary); }
+PERF_TEST_F(websocket_bench, unmask_text_64k) { return parse(text); }
+PERF_TEST_F(websocket_bench, utf8_scalar_64k) { return validate(utf8_isa::scalar); }
+PERF_TEST_F(websocket_bench, utf8_avx2_64k) { return validate(utf8_isa::avx2); }
+PERF_TEST_F(websocket_bench, utf8_neon_64k) { return validate(utf8_isa::neon); }
@@ -0,0 +1,114 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <list>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/algorithm.hh>
+#include <seastar/core/sstring.hh>
+
+using namespace seastar;
+
+namespace {
+
+std::vector<int> random_ints(size_t n) {
+    std::mt19937 rng(n);
+    std::uniform_int_distribution<int> dist(0, 1000);
+    std::vector<int> v(n);
+    for (auto& x : v) {
+        x = dist(rng);
+    }
+    return v;
+}
+
+const algorithm_options all_shards{.min_elements_per_shard = 1};
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sort) {
+    for (size_t n : {0, 1, 100, 1024, 1025, 5000, 100000}) {
+        for (auto opts : {algorithm_options{}, all_shards}) {
+            auto v = random_ints(n);
+            auto expected = v;
+            std::sort(expected.begin(), expected.end());
+            seastar::sort(v.begin(), v.end(), std::less<>(), opts).get();
+            BOOST_REQUIRE(v == expected);
+        }
+    }
+
+    std::vector<sstring> s;
+    for (int x : random_ints(10000)) {
+        s.push_back(to_sstring(x));
+    }
+    auto expected = s;
+    std::sort(expected.begin(), expected.end(), std::greater<>());
+    seastar::sort(s.begin(), s.end(), std::greater<>(), all_shards).get();
+    BOOST_REQUIRE(s == expected);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_merge) {
+    for (auto opts : {algorithm_options{}, all_shards}) {
+        auto a = random_ints(3000);
+        auto b = random_ints(5000);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        std::vector<int> expected(a.size() + b.size()), out(a.size() + b.size());
+        std::merge(a.begin(), a.end(), b.begin(), b.end(), expected.begin());
+        auto end = seastar::merge(a.begin(), a.end(), b.begin(), b.end(), out.begin(), std::less<>(), opts).get();
+        BOOST_REQUIRE(end == out.end());
+        BOOST_REQUIRE(out == expected);
+    }
+
+    // Ties go to the first range.
+    std::vector<std::pair<int, int>> a{{1, 0}, {2, 0}}, b{{1, 1}, {2, 1}}, out;
+    auto by_first = [] (const auto& x, const auto& y) { return x.first < y.first; };
+    std::list<std::pair<int, int>> l(a.begin(), a.end());
+    seastar::merge(l.begin(), l.end(), b.begin(), b.end(), std::back_inserter(out), by_first).get();
+    BOOST_REQUIRE(out == (std::vector<std::pair<int, int>>{{1, 0}, {1, 1}, {2, 0}, {2, 1}}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_transform) {
+    auto v = random_ints(10000);
+    auto twice = [] (int x) { return x * 2; };
+    std::vector<int> expected(v.size());
+    std::transform(v.begin(), v.end(), expected.begin(), twice);
+    for (auto opts : {algorithm_options{}, all_shards}) {
+        std::vector<int> out(v.size());
+        auto end = seastar::transform(v.begin(), v.end(), out.begin(), twice, opts).get();
+        BOOST_REQUIRE(end == out.end());
+        BOOST_REQUIRE(out == expected);
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_accumulate) {
+    auto v = random_ints(10000);
+    auto expected = std::accumulate(v.begin(), v.end(), 7L);
+    BOOST_REQUIRE_EQUAL(seastar::accumulate(v.begin(), v.end(), 7L).get(), expected);
+    BOOST_REQUIRE_EQUAL(seastar::accumulate(v.begin(), v.end(), 7L, std::plus<>(), all_shards).get(), expected);
+    BOOST_REQUIRE_EQUAL(seastar::accumulate(v.begin(), v.begin(), 7L, std::plus<>(), all_shards).get(), 7L);
+
+    std::list<int> l{1, 2, 3};
+    auto s = seastar::accumulate(l.begin(), l.end(), sstring(), [] (sstring s, int x) { return s + to_sstring(x); }).get();
+    BOOST_REQUIRE_EQUAL(s, "123");
+}
@@ -20,6 +20,7 @@
  * Copyright (C) 2018 Red Hat
  */
 
+#include <algorithm>
 #include <future>
 #include <numeric>
 #include <iostream>
@@ -82,9 +83,40 @@ int main(int argc, char** argv)
         for (auto& count : counts) {
             total += count.get();
         }
+        // test for alien::run_batch_on(), which runs the functions in order
+        std::vector<unsigned> order;
+        auto append = [&order] (unsigned i) {
+            return [&order, i] () noexcept {
+                order.push_back(i);
+            };
+        };
+        std::vector<decltype(append(0))> appends;
+        for (auto i : boost::irange(0u, 100u)) {
+            appends.push_back(append(i));
+        }
+        alien::run_batch_on(app.alien(), 0, std::move(appends));
+        // empty batches submit nothing
+        alien::run_batch_on(app.alien(), 0, std::vector<decltype(append(0))>());
+        // test for alien::submit_batch_to(), which returns a std::future<int> each
+        auto make_value = [] (int i) {
+            return [i] {
+                return seastar::make_ready_future<int>(i);
+            };
+        };
+        std::vector<decltype(make_value(0))> make_values;
+        for (auto i : boost::irange(0, 10)) {
+            make_values.push_back(make_value(i));
+        }
+        bool empty_batch = alien::submit_batch_to(app.alien(), 0, std::vector<decltype(make_value(0))>()).empty();
+        int batch_total = 0;
+        for (auto& value : alien::submit_batch_to(app.alien(), 0, std::move(make_values))) {
+            batch_total += value.get();
+        }
+        // the batch was queued after the appends, on the same shard
+        bool in_order = order.size() == 100 && std::ranges::is_sorted(order) && batch_total == 45 && empty_batch;
         // i am done. dismiss the engine
         ::eventfd_write(alien_done, ALIEN_DONE);
-        return std::make_tuple(answer.get(), total);
+        return std::make_tuple(answer.get(), total, in_order);
     });
 
     eventfd_t result = 0;
@@ -115,7 +147,7 @@ int main(int argc, char** argv)
             seastar::engine().exit(0);
         });
     });
-    auto [everything, total] = zim.get();
+    auto [everything, total, in_order] = zim.get();
     if (char expected = '*'; everything != '*') {
         std::cerr << "Bad everything: " << everything << " != " << expected << std::endl;
         return 1;
@@ -126,4 +158,8 @@ int main(int argc, char** argv)
         std::cerr << "Bad total: " << total << " != " << expected << std::endl;
         return 1;
     }
+    if (!in_order) {
+        std::cerr << "Bad batches" << std::endl;
+        return 1;
+    }
 }
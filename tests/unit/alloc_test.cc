@@ -19,16 +19,23 @@
  * Copyright (C) 2015 Cloudius Systems, Ltd.
  */
 
+#include <seastar/core/heap_profile.hh>
 #include <seastar/core/memory.hh>
+#include <seastar/core/memory_pressure.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/sleep.hh>
 #include <seastar/core/shard_id.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/with_scheduling_group.hh>
 #include <seastar/testing/perf_tests.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/memory_diagnostics.hh>
 
+#include <algorithm>
 #include <memory>
 #include <new>
 #include <vector>
@@ -212,6 +219,156 @@ SEASTAR_THREAD_TEST_CASE(test_cross_thread_realloc) {
 
 #ifndef SEASTAR_DEFAULT_ALLOCATOR
 
+SEASTAR_THREAD_TEST_CASE(test_cross_cpu_free_batching) {
+    if (smp::count < 2) {
+        std::cerr << "Skipping test_cross_cpu_free_batching: needs more than 1 shard" << std::endl;
+        return;
+    }
+    auto other_shard = (this_shard_id() + 1) % smp::count;
+    auto before = memory::cross_shard_free_stats(other_shard);
+    auto vec = smp::submit_to(other_shard, [] {
+        auto ret = std::vector<std::unique_ptr<int>>(1000);
+        for (auto& o : ret) {
+            o = std::make_unique<int>(0);
+        }
+        return ret;
+    }).get();
+    vec.clear();
+    auto after = memory::cross_shard_free_stats(other_shard);
+    BOOST_REQUIRE_GE(after.frees - before.frees, 1000);
+    // Full batches are handed back as they fill up
+    BOOST_REQUIRE_GT(after.batches - before.batches, 0);
+    BOOST_REQUIRE_LT(after.batches - before.batches, (after.frees - before.frees) / 2);
+}
+
+SEASTAR_TEST_CASE(test_fragmentation_report) {
+    auto objs = std::vector<std::unique_ptr<char[]>>(10000);
+    for (auto& o : objs) {
+        o = std::make_unique<char[]>(64);
+    }
+    auto report = memory::get_fragmentation_report();
+    auto pool = std::find_if(report.small_pools.begin(), report.small_pools.end(), [] (const memory::small_pool_statistics& sp) {
+        return sp.object_size == 64;
+    });
+    BOOST_REQUIRE(pool != report.small_pools.end());
+    BOOST_REQUIRE_GE(pool->objects_in_use, objs.size());
+    BOOST_REQUIRE_GT(pool->spans, 0);
+    BOOST_REQUIRE_LE((pool->objects_in_use + pool->free_objects) * pool->object_size, pool->memory);
+    BOOST_REQUIRE(pool->fragmentation() >= 0 && pool->fragmentation() <= 1);
+
+    size_t free_memory = 0;
+    for (auto& sp : report.spans) {
+        free_memory += sp.free_memory;
+    }
+    BOOST_REQUIRE_EQUAL(free_memory, report.free_memory);
+    BOOST_REQUIRE_LE(report.largest_free_span, report.free_memory);
+    BOOST_REQUIRE_EQUAL(report.largest_free_span, memory::largest_free_span());
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_huge_page_allocation_threshold) {
+    memory::set_huge_page_allocation_threshold(1 << 20);
+    auto reset = defer([] () noexcept { memory::set_huge_page_allocation_threshold(0); });
+    auto before = memory::get_huge_page_statistics();
+    auto p = std::unique_ptr<char[]>(new char[1536 << 10]);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p.get()) % memory::huge_page_size, 0);
+    BOOST_REQUIRE_GE(::malloc_usable_size(p.get()), memory::huge_page_size);
+    auto after = memory::get_huge_page_statistics();
+    BOOST_REQUIRE_EQUAL(after.large_allocations - before.large_allocations, 1);
+    BOOST_REQUIRE_LE(after.collapse_failures - before.collapse_failures, after.collapses - before.collapses);
+    // Smaller allocations are not affected
+    auto q = std::unique_ptr<char[]>(new char[512 << 10]);
+    BOOST_REQUIRE_EQUAL(memory::get_huge_page_statistics().large_allocations, after.large_allocations);
+    return make_ready_future<>();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_release_free_memory) {
+    constexpr size_t size = 64 << 20;
+    BOOST_REQUIRE_GT(memory::free_memory(), 2 * size);
+    // The second time, all the free memory stayed free since the first
+    memory::release_free_memory(0);
+    memory::release_free_memory(0);
+    auto released = memory::get_released_memory_statistics();
+    BOOST_REQUIRE_GT(released.released_memory, 0);
+
+    // Released memory is faulted back in when allocated again
+    auto p = static_cast<char*>(::malloc(size));
+    BOOST_REQUIRE(p);
+    std::fill_n(p, size, 'x');
+    BOOST_REQUIRE(std::all_of(p, p + size, [] (char c) { return c == 'x'; }));
+    ::free(p);
+    auto reused = memory::get_released_memory_statistics();
+    BOOST_REQUIRE_GE(reused.reused_bytes - released.reused_bytes, size);
+    BOOST_REQUIRE_LE(reused.released_memory, released.released_memory - size);
+
+    // Not idle for a whole period yet
+    memory::release_free_memory(0);
+    auto not_idle = memory::get_released_memory_statistics();
+    BOOST_REQUIRE_LT(not_idle.released_memory, reused.released_memory + size / 2);
+    memory::release_free_memory(0);
+    BOOST_REQUIRE_GE(memory::get_released_memory_statistics().released_memory, not_idle.released_memory + size / 2);
+
+    // Nothing is released beyond what must be kept free
+    BOOST_REQUIRE_EQUAL(memory::release_free_memory(memory::free_memory()), 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_small_submit_to_does_not_allocate) {
+    if (smp::count < 2) {
+        return;
+    }
+    auto mallocs_on = [] (shard_id shard) {
+        return smp::submit_to(shard, [] { return memory::stats().mallocs(); }).get();
+    };
+    int counter = 0;
+    auto* p = &counter;
+    // Warm up the queues.
+    smp::submit_to(1, [] { return 0; }).get();
+    auto local_before = memory::stats().mallocs();
+    auto remote_before = mallocs_on(1);
+    for (int i = 0; i < 1000; ++i) {
+        auto v = smp::submit_to(1, [i] { return i * 2; }).get();
+        BOOST_REQUIRE_EQUAL(v, i * 2);
+        smp::submit_to(1, [] {}).get();
+    }
+    BOOST_REQUIRE_THROW(smp::submit_to(1, [] () -> int { throw std::runtime_error("oops"); }).get(), std::runtime_error);
+    smp::submit_to(1, [p] { return p; }).get()[0] = 1;
+    auto local_after = memory::stats().mallocs();
+    auto remote_after = mallocs_on(1);
+    BOOST_REQUIRE_EQUAL(counter, 1);
+    // Allow for some unrelated background activity, but not one allocation per call.
+    BOOST_REQUIRE_LT(local_after - local_before, 100);
+    BOOST_REQUIRE_LT(remote_after - remote_before, 100);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_memory_pressure_listener) {
+    using namespace std::chrono_literals;
+    std::vector<memory::pressure_level> levels;
+    memory::pressure_listener listener([&levels] (memory::pressure_level l) {
+        levels.push_back(l);
+        return make_ready_future<>();
+    });
+    auto wait_for = [&levels] (memory::pressure_level l) {
+        while (levels.empty() || levels.back() != l) {
+            sleep(1ms).get();
+        }
+    };
+    BOOST_REQUIRE(memory::current_pressure_level() == memory::pressure_level::normal);
+
+    // Leave 10% of the shard's memory free: below the elevated threshold,
+    // above the critical one.
+    auto total = memory::stats().total_memory();
+    auto free = memory::free_memory();
+    BOOST_REQUIRE_GT(free, total / 10 + (1 << 20));
+    auto p = ::malloc(free - total / 10);
+    BOOST_REQUIRE(p);
+    wait_for(memory::pressure_level::elevated);
+    BOOST_REQUIRE(memory::current_pressure_level() == memory::pressure_level::elevated);
+
+    ::free(p);
+    wait_for(memory::pressure_level::normal);
+    BOOST_REQUIRE_EQUAL(levels.size(), 2);
+}
+
 struct thread_alloc_info {
     memory::statistics before;
     memory::statistics after;
@@ -661,6 +818,89 @@ SEASTAR_TEST_CASE(test_change_sample_rate)
     return seastar::make_ready_future();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_sampled_cumulative_profile)
+{
+    seastar::memory::reset_cumulative_memory_profile();
+    BOOST_REQUIRE(seastar::memory::sampled_cumulative_memory_profile().empty());
+
+    std::size_t count = 100;
+    seastar::memory::set_heap_profiling_sampling_rate(100);
+#ifdef __clang__
+    #pragma nounroll
+#endif
+    for (std::size_t i = 0; i < count; ++i) {
+        free(malloc_wrapper(10));
+    }
+    seastar::memory::set_heap_profiling_sampling_rate(0);
+
+    // The allocations freed are no longer live, but still counted
+    auto live = seastar::memory::sampled_memory_profile();
+    auto cumulative = seastar::memory::sampled_cumulative_memory_profile();
+    auto site = std::max_element(cumulative.begin(), cumulative.end(), [] (auto& a, auto& b) {
+        return a.count < b.count;
+    });
+    BOOST_REQUIRE(site != cumulative.end());
+    BOOST_REQUIRE_EQUAL(site->count, count);
+    BOOST_REQUIRE_EQUAL(site->size, count * 100);
+    BOOST_REQUIRE(std::find(live.begin(), live.end(), *site) == live.end());
+
+    // Aggregated over the shards into a pprof profile
+    auto profile = seastar::heap_profile::collect(true).get();
+    BOOST_REQUIRE(std::string_view(profile).find("alloc_space") != std::string_view::npos);
+    BOOST_REQUIRE(std::string_view(profile).find("inuse_space") != std::string_view::npos);
+    BOOST_REQUIRE(seastar::memory::sampled_cumulative_memory_profile().empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_scheduling_group_memory_usage)
+{
+    using namespace std::chrono_literals;
+    auto sg = create_scheduling_group("background", 100).get();
+    auto destroy = defer([sg] () noexcept { destroy_scheduling_group(sg).get(); });
+    seastar::memory::set_heap_profiling_sampling_rate(1000);
+    auto disable = defer([] () noexcept { seastar::memory::set_heap_profiling_sampling_rate(0); });
+
+    std::vector<size_t> usages;
+    bool in_group = false;
+    memory::scheduling_group_soft_limit limit(sg, 4 << 20, [&usages, &in_group, sg] (size_t usage) {
+        in_group = current_scheduling_group() == sg;
+        usages.push_back(usage);
+        return make_ready_future<>();
+    }, 0.5f);
+
+    constexpr size_t count = 100;
+    constexpr size_t size = 64 << 10;
+    auto before = memory::scheduling_group_memory_usage(default_scheduling_group());
+    std::vector<char*> ptrs = with_scheduling_group(sg, [] {
+        std::vector<char*> ptrs;
+        for (size_t i = 0; i < count; ++i) {
+            ptrs.push_back(malloc_wrapper(size));
+        }
+        return ptrs;
+    }).get();
+
+    // Allocations this large are always sampled, at their size
+    BOOST_REQUIRE_GE(memory::scheduling_group_memory_usage(sg), count * size);
+    BOOST_REQUIRE_LT(memory::scheduling_group_memory_usage(default_scheduling_group()), before + count * size);
+    while (usages.empty()) {
+        sleep(1ms).get();
+    }
+    BOOST_REQUIRE(limit.exceeded());
+    BOOST_REQUIRE(in_group);
+    BOOST_REQUIRE_GT(usages[0], size_t(4 << 20));
+    BOOST_REQUIRE_EQUAL(sg.get_cpu_cap(), 0.5f);
+
+    // Freed from the default group, still attributed to the one that
+    // allocated them
+    for (auto p : ptrs) {
+        free(p);
+    }
+    BOOST_REQUIRE_LT(memory::scheduling_group_memory_usage(sg), size_t(1 << 20));
+    while (limit.exceeded()) {
+        sleep(1ms).get();
+    }
+    BOOST_REQUIRE_EQUAL(sg.get_cpu_cap(), 1.0f);
+    BOOST_REQUIRE_EQUAL(usages.size(), 1);
+}
 
 #endif // SEASTAR_HEAPPROF
 
@@ -0,0 +1,179 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/core/block_cache.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/closeable.hh>
+#include <seastar/util/tmp_file.hh>
+
+using namespace seastar;
+
+static constexpr size_t block_size = 4096;
+
+// Writes nr_blocks blocks, each filled with its index, plus a partial one.
+static void write_test_file(const sstring& name, unsigned nr_blocks) {
+    auto f = open_file_dma(name, open_flags::rw | open_flags::create | open_flags::truncate).get();
+    auto close_f = deferred_close(f);
+    auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), block_size);
+    for (unsigned i = 0; i < nr_blocks; i++) {
+        std::fill_n(buf.get_write(), block_size, char('a' + i));
+        f.dma_write(i * block_size, buf.get(), block_size).get();
+    }
+    std::fill_n(buf.get_write(), block_size, char('a' + nr_blocks));
+    f.dma_write(nr_blocks * block_size, buf.get(), block_size).get();
+    f.truncate(nr_blocks * block_size + 100).get();
+}
+
+SEASTAR_TEST_CASE(test_cached_reads) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        write_test_file(name, 3);
+
+        block_cache cache(block_cache::config{ .block_size = block_size });
+        auto f = make_cached_file(open_file_dma(name, open_flags::ro).get(), cache).get();
+        auto close_f = deferred_close(f);
+
+        // Unaligned, spanning two blocks
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), block_size);
+        BOOST_REQUIRE_EQUAL(f.dma_read(block_size - 10, buf.get_write(), 20).get(), 20);
+        BOOST_REQUIRE_EQUAL(std::string_view(buf.get(), 20), std::string(10, 'a') + std::string(10, 'b'));
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 2);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().cached_bytes, 2 * block_size);
+
+        auto hits = cache.get_stats().hits;
+        BOOST_REQUIRE_EQUAL(f.dma_read(0, buf.get_write(), block_size).get(), block_size);
+        BOOST_REQUIRE_EQUAL(buf[block_size - 1], 'a');
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 2);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits, hits + 1);
+
+        // Short read at the end of the file
+        BOOST_REQUIRE_EQUAL(f.dma_read(3 * block_size, buf.get_write(), block_size).get(), 100);
+        BOOST_REQUIRE_EQUAL(buf[99], 'd');
+
+        auto bulk = f.dma_read_bulk<char>(2 * block_size, 2 * block_size).get();
+        BOOST_REQUIRE_EQUAL(bulk.size(), block_size + 100);
+        BOOST_REQUIRE_EQUAL(bulk[0], 'c');
+    });
+}
+
+SEASTAR_TEST_CASE(test_cached_writes_invalidate) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        write_test_file(name, 3);
+
+        block_cache cache(block_cache::config{ .block_size = block_size });
+        auto f = make_cached_file(open_file_dma(name, open_flags::rw).get(), cache).get();
+        auto close_f = deferred_close(f);
+
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), block_size);
+        f.dma_read(0, buf.get_write(), block_size).get();
+        BOOST_REQUIRE_EQUAL(buf[0], 'a');
+
+        std::fill_n(buf.get_write(), block_size, 'x');
+        f.dma_write(0, buf.get(), block_size).get();
+        BOOST_REQUIRE_EQUAL(cache.get_stats().invalidations, 1);
+
+        std::fill_n(buf.get_write(), block_size, 0);
+        f.dma_read(0, buf.get_write(), block_size).get();
+        BOOST_REQUIRE_EQUAL(buf[0], 'x');
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 2);
+    });
+}
+
+SEASTAR_TEST_CASE(test_read_ahead_and_eviction) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        write_test_file(name, 8);
+
+        block_cache cache(block_cache::config{ .block_size = block_size, .memory_budget = 4 * block_size });
+        auto f = make_cached_file(open_file_dma(name, open_flags::ro).get(), cache, cached_file_options{ .read_ahead_blocks = 3 }).get();
+        auto close_f = deferred_close(f);
+
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), block_size);
+        f.dma_read(0, buf.get_write(), block_size).get();
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 1);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().read_ahead, 3);
+
+        // Served by the read-ahead
+        f.dma_read(3 * block_size, buf.get_write(), block_size).get();
+        BOOST_REQUIRE_EQUAL(buf[0], 'd');
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 1);
+
+        // Reading on evicts down to the budget
+        f.dma_read(4 * block_size, buf.get_write(), block_size).get();
+        BOOST_REQUIRE_EQUAL(buf[0], 'e');
+        BOOST_REQUIRE_LE(cache.get_stats().cached_bytes, cache.memory_budget());
+        BOOST_REQUIRE_GT(cache.get_stats().evictions, 0);
+
+        cache.set_memory_budget(0);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().cached_bytes, 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_read_beyond_budget) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        write_test_file(name, 8);
+
+        block_cache cache(block_cache::config{ .block_size = block_size, .memory_budget = 2 * block_size });
+        auto f = make_cached_file(open_file_dma(name, open_flags::ro).get(), cache).get();
+        auto close_f = deferred_close(f);
+
+        // A single read of more blocks than the budget holds
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 9 * block_size);
+        BOOST_REQUIRE_EQUAL(f.dma_read(0, buf.get_write(), buf.size()).get(), 8 * block_size + 100);
+        for (unsigned i = 0; i < 8; i++) {
+            BOOST_REQUIRE_EQUAL(buf[i * block_size], char('a' + i));
+            BOOST_REQUIRE_EQUAL(buf[i * block_size + block_size - 1], char('a' + i));
+        }
+        BOOST_REQUIRE_EQUAL(buf[8 * block_size + 99], 'i');
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 9);
+        BOOST_REQUIRE_LE(cache.get_stats().cached_bytes, cache.memory_budget());
+    });
+}
+
+SEASTAR_TEST_CASE(test_read_with_zero_budget) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        write_test_file(name, 3);
+
+        block_cache cache(block_cache::config{ .block_size = block_size });
+        cache.set_memory_budget(0);
+        auto f = make_cached_file(open_file_dma(name, open_flags::ro).get(), cache, cached_file_options{ .read_ahead_blocks = 2 }).get();
+        auto close_f = deferred_close(f);
+
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 2 * block_size);
+        BOOST_REQUIRE_EQUAL(f.dma_read(block_size - 10, buf.get_write(), 20).get(), 20);
+        BOOST_REQUIRE_EQUAL(std::string_view(buf.get(), 20), std::string(10, 'a') + std::string(10, 'b'));
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 2);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().cached_bytes, 0);
+
+        // Every read misses, up to the end of the file
+        BOOST_REQUIRE_EQUAL(f.dma_read(2 * block_size, buf.get_write(), 2 * block_size).get(), block_size + 100);
+        BOOST_REQUIRE_EQUAL(buf[0], 'c');
+        BOOST_REQUIRE_EQUAL(buf[block_size + 99], 'd');
+        BOOST_REQUIRE_EQUAL(f.dma_read(4 * block_size, buf.get_write(), block_size).get(), 0);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 5);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().cached_bytes, 0);
+    });
+}
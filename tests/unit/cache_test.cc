@@ -0,0 +1,157 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/cache.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/util/closeable.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+using int_cache = cache<int, int>;
+
+// A cache of entries of 1000 bytes, with room for about n of them
+static int_cache::config config_for(size_t n) {
+    int_cache::config cfg;
+    cfg.memory_budget = n * 1100;
+    cfg.entry_size = [] (const int&, const int&) { return 1000; };
+    return cfg;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cache_find_insert_erase) {
+    int_cache c(config_for(100));
+    BOOST_REQUIRE(!c.find(1));
+    c.insert(1, 10);
+    BOOST_REQUIRE(c.find(1));
+    BOOST_REQUIRE_EQUAL(*c.find(1), 10);
+    c.insert(1, 11);
+    BOOST_REQUIRE_EQUAL(*c.find(1), 11);
+    BOOST_REQUIRE_EQUAL(c.size(), 1);
+    BOOST_REQUIRE(c.erase(1));
+    BOOST_REQUIRE(!c.erase(1));
+    BOOST_REQUIRE(!c.find(1));
+    BOOST_REQUIRE_EQUAL(c.get_stats().hits, 3);
+    BOOST_REQUIRE_EQUAL(c.get_stats().misses, 2);
+    BOOST_REQUIRE_EQUAL(c.get_stats().bytes, 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cache_metrics_names) {
+    // Unnamed caches register no metrics, so any number of them coexist
+    int_cache a(config_for(10));
+    int_cache b(config_for(10));
+    auto named = config_for(10);
+    named.name = "named";
+    int_cache c(std::move(named));
+    named = config_for(10);
+    named.name = "named";
+    BOOST_REQUIRE_THROW(int_cache(std::move(named)), metrics::double_registration);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cache_memory_budget) {
+    int_cache c(config_for(100));
+    for (int i = 0; i < 1000; ++i) {
+        c.insert(i, i);
+        BOOST_REQUIRE_LE(c.get_stats().bytes, c.memory_budget());
+    }
+    BOOST_REQUIRE_GE(c.size(), 50);
+    BOOST_REQUIRE_LE(c.size(), 100);
+    c.set_memory_budget(c.memory_budget() / 2);
+    BOOST_REQUIRE_LE(c.get_stats().bytes, c.memory_budget());
+    BOOST_REQUIRE_LE(c.size(), 50);
+    // Larger than the budget
+    int_cache::config cfg = config_for(100);
+    cfg.entry_size = [] (const int&, const int&) { return 1 << 20; };
+    int_cache big(std::move(cfg));
+    big.insert(1, 1);
+    BOOST_REQUIRE(!big.find(1));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cache_scan_resistance) {
+    int_cache c(config_for(100));
+    // Keys used over and over
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 50; ++i) {
+            if (!c.find(i)) {
+                c.insert(i, i);
+            }
+        }
+    }
+    // A scan of keys used once, flushing an LRU cache
+    for (int i = 1000; i < 3000; ++i) {
+        if (!c.find(i)) {
+            c.insert(i, i);
+        }
+    }
+    unsigned kept = 0;
+    for (int i = 0; i < 50; ++i) {
+        kept += bool(c.find(i));
+    }
+    BOOST_REQUIRE_GE(kept, 45);
+    BOOST_REQUIRE_GT(c.get_stats().rejections, 1000);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cache_ttl) {
+    int_cache c(config_for(100));
+    c.insert(1, 1, 20ms);
+    c.insert(2, 2, 20ms);
+    c.insert(3, 3);
+    BOOST_REQUIRE(c.find(1));
+    sleep(100ms).get();
+    BOOST_REQUIRE(!c.find(1));
+    BOOST_REQUIRE_EQUAL(c.get_stats().expirations, 1);
+    c.evict_expired();
+    BOOST_REQUIRE_EQUAL(c.get_stats().expirations, 2);
+    BOOST_REQUIRE_EQUAL(c.size(), 1);
+    BOOST_REQUIRE(c.find(3));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cache_get_or_load) {
+    int_cache c(config_for(100));
+    auto stop = deferred_stop(c);
+    unsigned loads = 0;
+    auto loader = [&loads] (const int& key) {
+        ++loads;
+        return sleep(10ms).then([key] { return key * 2; });
+    };
+    auto f1 = c.get_or_load(1, loader);
+    auto f2 = c.get_or_load(1, loader);
+    BOOST_REQUIRE_EQUAL(f1.get(), 2);
+    BOOST_REQUIRE_EQUAL(f2.get(), 2);
+    BOOST_REQUIRE_EQUAL(loads, 1);
+    BOOST_REQUIRE_EQUAL(c.get_or_load(1, loader).get(), 2);
+    BOOST_REQUIRE_EQUAL(loads, 1);
+    BOOST_REQUIRE_EQUAL(c.get_stats().loads, 1);
+
+    // Failures are not cached
+    auto failing = [&loads] (const int&) {
+        ++loads;
+        return make_exception_future<int>(std::runtime_error("failed"));
+    };
+    BOOST_REQUIRE_THROW(c.get_or_load(2, failing).get(), std::runtime_error);
+    BOOST_REQUIRE(!c.find(2));
+
+    // Nor the loads of keys erased meanwhile
+    auto f3 = c.get_or_load(3, loader);
+    c.erase(3);
+    BOOST_REQUIRE_EQUAL(f3.get(), 6);
+    BOOST_REQUIRE(!c.find(3));
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/core/checksummed_file.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/closeable.hh>
+#include <seastar/util/crc32c.hh>
+#include <seastar/util/tmp_file.hh>
+
+#include <random>
+
+using namespace seastar;
+
+static constexpr size_t block_size = 4096;
+
+SEASTAR_TEST_CASE(test_crc32c) {
+    BOOST_REQUIRE_EQUAL(crc32c("123456789", 9), 0xe3069283);
+    BOOST_REQUIRE_EQUAL(crc32c("", 0), 0);
+
+    std::vector<char> data(100000);
+    std::mt19937 rng;
+    std::generate(data.begin(), data.end(), [&rng] { return char(rng()); });
+    for (size_t len : {1, 7, 8, 1023, 1024, 4096, 5000, 99999}) {
+        BOOST_REQUIRE(internal::use_crc32c_isa(internal::crc32c_isa::scalar));
+        auto expected = crc32c(data.data(), len);
+        for (auto isa : {internal::crc32c_isa::sse42, internal::crc32c_isa::armv8}) {
+            if (!internal::use_crc32c_isa(isa)) {
+                continue;
+            }
+            BOOST_REQUIRE_EQUAL(crc32c(data.data(), len), expected);
+            BOOST_REQUIRE_EQUAL(crc32c(data.data() + len / 3, len - len / 3, crc32c(data.data(), len / 3)), expected);
+        }
+    }
+    return make_ready_future<>();
+}
+
+static void test_round_trip(file f, file data) {
+    auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 3 * block_size);
+    for (unsigned i = 0; i < 3; i++) {
+        std::fill_n(buf.get_write() + i * block_size, block_size, char('a' + i));
+    }
+    // Crosses the end of the first group of the interleaved layout
+    uint64_t pos = (block_size / 4 - 1) * block_size;
+    BOOST_REQUIRE_EQUAL(f.dma_write(pos, buf.get(), buf.size()).get(), buf.size());
+    BOOST_REQUIRE_EQUAL(f.size().get(), pos + buf.size());
+
+    auto rd = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 4 * block_size);
+    BOOST_REQUIRE_EQUAL(f.dma_read(pos, rd.get_write(), rd.size()).get(), buf.size());
+    BOOST_REQUIRE(std::equal(buf.get(), buf.get() + buf.size(), rd.get()));
+
+    // Never written, so a hole
+    BOOST_REQUIRE_EQUAL(f.dma_read(0, rd.get_write(), block_size).get(), block_size);
+    BOOST_REQUIRE_EQUAL(rd[0], 0);
+
+    auto bulk = f.dma_read_bulk<char>(pos + block_size + 10, 20).get();
+    BOOST_REQUIRE_EQUAL(std::string_view(bulk.get(), bulk.size()), std::string(20, 'b'));
+
+    // A block cut short by a truncation still verifies, also once the file
+    // is extended past it again.
+    f.truncate(pos + block_size + 100).get();
+    BOOST_REQUIRE_EQUAL(f.size().get(), pos + block_size + 100);
+    BOOST_REQUIRE_EQUAL(f.dma_read(pos + block_size, rd.get_write(), block_size).get(), 100);
+    BOOST_REQUIRE_EQUAL(rd[99], 'b');
+    f.truncate(pos + 3 * block_size).get();
+    BOOST_REQUIRE_EQUAL(f.dma_read(pos + block_size, rd.get_write(), 2 * block_size).get(), 2 * block_size);
+    BOOST_REQUIRE_EQUAL(rd[100], 0);
+    BOOST_REQUIRE_EQUAL(rd[block_size], 0);
+
+    // Corrupt the data behind the file's back
+    auto st = data.stat().get();
+    auto raw = temporary_buffer<char>::aligned(data.memory_dma_alignment(), block_size);
+    auto raw_pos = uint64_t(st.st_size) / block_size * block_size - block_size;
+    BOOST_REQUIRE_EQUAL(data.dma_read(raw_pos, raw.get_write(), block_size).get(), block_size);
+    raw.get_write()[0] ^= 1;
+    data.dma_write(raw_pos, raw.get(), block_size).get();
+    BOOST_REQUIRE_EXCEPTION(f.dma_read(pos, rd.get_write(), 3 * block_size).get(), checksum_error, [&] (const checksum_error& e) {
+        return e.position() == pos + 2 * block_size;
+    });
+
+    BOOST_REQUIRE_THROW(f.dma_read(pos + 512, rd.get_write(), block_size).get(), std::invalid_argument);
+}
+
+SEASTAR_TEST_CASE(test_interleaved_checksums) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        auto data = open_file_dma(name, open_flags::rw | open_flags::create).get();
+        auto f = make_checksummed_file(data, checksummed_file_options{ .block_size = block_size });
+        auto close_f = deferred_close(f);
+        test_round_trip(f, data);
+    });
+}
+
+SEASTAR_TEST_CASE(test_side_car_checksums) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        sstring checksums_name = (t.get_path() / "testfile.crc").native();
+        auto data = open_file_dma(name, open_flags::rw | open_flags::create).get();
+        auto checksums = open_file_dma(checksums_name, open_flags::rw | open_flags::create).get();
+        auto f = make_checksummed_file(data, checksums, checksummed_file_options{ .block_size = block_size });
+        auto close_f = deferred_close(f);
+        test_round_trip(f, data);
+        BOOST_REQUIRE_EQUAL(checksums.size().get() % 4, 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_checksummed_file_block_size) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        auto data = open_file_dma(name, open_flags::rw | open_flags::create).get();
+        auto close_data = deferred_close(data);
+        BOOST_REQUIRE_THROW(make_checksummed_file(data, checksummed_file_options{ .block_size = 3000 }), std::invalid_argument);
+    });
+}
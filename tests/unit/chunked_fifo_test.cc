@@ -29,6 +29,9 @@
 #include <chrono>
 #include <deque>
 #include <iterator>
+#include <memory>
+#include <numeric>
+#include <vector>
 #if __has_include(<ranges>)
 #include <ranges>
 #endif
@@ -394,3 +397,63 @@ BOOST_AUTO_TEST_CASE(chunked_fifo_const_iterator) {
         BOOST_REQUIRE(std::equal(fifo.cbegin(), fifo.cend(), reference.cbegin(), reference.cend()));
     }
 }
+
+BOOST_AUTO_TEST_CASE(chunked_fifo_bulk_operations) {
+    constexpr auto items_per_chunk = 8;
+    auto fifo = chunked_fifo<int, items_per_chunk>{};
+    auto reference = std::deque<int>{};
+    std::vector<int> values(items_per_chunk * 3 + 5);
+    std::iota(values.begin(), values.end(), 0);
+    std::vector<int> drained(items_per_chunk * 2 + 3);
+    for (int round = 0; round < 10; ++round) {
+        fifo.push_back_n(values.begin(), values.size());
+        reference.insert(reference.end(), values.begin(), values.end());
+        BOOST_REQUIRE_EQUAL(fifo.size(), reference.size());
+        BOOST_REQUIRE_EQUAL(fifo.drain_into(drained), drained.size());
+        BOOST_REQUIRE(std::equal(drained.begin(), drained.end(), reference.begin()));
+        reference.erase(reference.begin(), reference.begin() + drained.size());
+        fifo.pop_front_n(5);
+        reference.erase(reference.begin(), reference.begin() + 5);
+        BOOST_REQUIRE_EQUAL(fifo.size(), reference.size());
+        BOOST_REQUIRE(std::equal(fifo.begin(), fifo.end(), reference.begin(), reference.end()));
+    }
+    fifo.pop_front_n(fifo.size());
+    BOOST_REQUIRE(fifo.empty());
+
+    auto ptrs = chunked_fifo<std::unique_ptr<int>, items_per_chunk>{};
+    std::vector<std::unique_ptr<int>> in;
+    for (int i = 0; i < items_per_chunk * 2; ++i) {
+        in.push_back(std::make_unique<int>(i));
+    }
+    ptrs.push_back_n(std::make_move_iterator(in.begin()), in.size());
+    ptrs.pop_front_n(3);
+    std::vector<std::unique_ptr<int>> out(items_per_chunk * 2);
+    BOOST_REQUIRE_EQUAL(ptrs.drain_into(out), items_per_chunk * 2 - 3);
+    BOOST_REQUIRE_EQUAL(*out[0], 3);
+    BOOST_REQUIRE(ptrs.empty());
+}
+
+BOOST_AUTO_TEST_CASE(chunked_fifo_shard_chunks) {
+    constexpr auto items_per_chunk = 8;
+    // The chunks a queue frees are reused by another
+    auto a = std::make_unique<chunked_fifo<int, items_per_chunk>>();
+    for (int i = 0; i < items_per_chunk * 4; ++i) {
+        a->push_back(i);
+    }
+    std::vector<int*> freed;
+    for (auto& i : *a) {
+        if ((i % items_per_chunk) == 0) {
+            freed.push_back(&i);
+        }
+    }
+    a.reset();
+    auto b = chunked_fifo<int, items_per_chunk>{};
+    for (int i = 0; i < items_per_chunk * 4; ++i) {
+        b.push_back(i);
+    }
+    for (auto& i : b) {
+        if ((i % items_per_chunk) == 0) {
+            BOOST_REQUIRE(std::find(freed.begin(), freed.end(), &i) != freed.end());
+        }
+    }
+}
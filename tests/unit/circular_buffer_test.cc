@@ -26,7 +26,9 @@
 #include <stdlib.h>
 #include <chrono>
 #include <deque>
+#include <numeric>
 #include <random>
+#include <vector>
 #if __has_include(<ranges>)
 #include <ranges>
 #endif
@@ -188,3 +190,37 @@ BOOST_AUTO_TEST_CASE(test_underflow_index_iterator_comparison) {
         buf.erase(buf.begin() + offset, buf.begin() + std::min(size_t(offset + erase_count), buf.size()));
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_bulk_operations) {
+    circular_buffer<int> buf;
+    std::deque<int> reference;
+    std::vector<int> values(100);
+    std::iota(values.begin(), values.end(), 0);
+    std::vector<int> drained(70);
+    // wrap around the end of the storage
+    for (int round = 0; round < 10; ++round) {
+        buf.push_back_n(values.begin(), values.size());
+        reference.insert(reference.end(), values.begin(), values.end());
+        BOOST_REQUIRE_EQUAL(buf.drain_into(drained), drained.size());
+        BOOST_REQUIRE(std::equal(drained.begin(), drained.end(), reference.begin()));
+        reference.erase(reference.begin(), reference.begin() + drained.size());
+        buf.pop_front_n(20);
+        reference.erase(reference.begin(), reference.begin() + 20);
+        BOOST_REQUIRE(std::equal(buf.begin(), buf.end(), reference.begin(), reference.end()));
+    }
+    buf.pop_front_n(buf.size());
+    BOOST_REQUIRE(buf.empty());
+
+    circular_buffer<std::unique_ptr<int>> ptrs;
+    std::vector<std::unique_ptr<int>> in;
+    for (int i = 0; i < 10; ++i) {
+        in.push_back(std::make_unique<int>(i));
+    }
+    ptrs.push_back_n(std::make_move_iterator(in.begin()), in.size());
+    ptrs.pop_front_n(3);
+    std::vector<std::unique_ptr<int>> out(10);
+    BOOST_REQUIRE_EQUAL(ptrs.drain_into(out), 7u);
+    BOOST_REQUIRE_EQUAL(*out[0], 3);
+    BOOST_REQUIRE_EQUAL(*out[6], 9);
+    BOOST_REQUIRE(ptrs.empty());
+}
@@ -0,0 +1,126 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/core/compressed_file.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/closeable.hh>
+#include <seastar/util/tmp_file.hh>
+
+#include <random>
+
+using namespace seastar;
+
+static constexpr size_t chunk_size = 16 << 10;
+
+// Compressible data: runs of random lengths of a few letters, with an
+// incompressible stretch so that some chunks are stored as is.
+static std::string make_test_data(size_t size) {
+    std::string data;
+    std::mt19937 rng;
+    while (data.size() < size) {
+        data.append(rng() % 100, char('a' + rng() % 4));
+    }
+    data.resize(size);
+    for (size_t i = 3 * chunk_size; i < 5 * chunk_size && i < size; i++) {
+        data[i] = char(rng());
+    }
+    return data;
+}
+
+static void write_compressed(const sstring& name, const std::string& data, compressed_file_options opts) {
+    auto f = open_file_dma(name, open_flags::wo | open_flags::create | open_flags::truncate).get();
+    auto out = make_compressed_file_output_stream(std::move(f), opts).get();
+    // Odd sized writes, not aligned to the chunks
+    for (size_t pos = 0; pos < data.size(); pos += 10000) {
+        out.write(data.data() + pos, std::min<size_t>(10000, data.size() - pos)).get();
+    }
+    out.close().get();
+}
+
+static future<> test_round_trip(compressed_file_options opts) {
+    return tmp_dir::do_with_thread([opts] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        auto data = make_test_data(20 * chunk_size + 1234);
+        write_compressed(name, data, opts);
+
+        auto f = open_compressed_file(open_file_dma(name, open_flags::ro).get()).get();
+        auto close_f = deferred_close(f);
+        BOOST_REQUIRE_EQUAL(f.size().get(), data.size());
+        BOOST_REQUIRE_LT(file_size(name).get(), data.size() / 2);
+
+        // Sequential scan with read-ahead, buffers not aligned to the chunks
+        auto in = make_file_input_stream(f, file_input_stream_options{ .buffer_size = 10000, .read_ahead = 4 });
+        std::string read;
+        while (auto buf = in.read().get()) {
+            read.append(buf.get(), buf.size());
+        }
+        in.close().get();
+        BOOST_REQUIRE(read == data);
+
+        // Positional reads within a chunk, across chunks and past the end
+        for (auto [pos, len] : std::initializer_list<std::pair<size_t, size_t>>{
+                {100, 200}, {chunk_size - 10, 3 * chunk_size}, {4 * chunk_size, chunk_size}, {data.size() - 100, 1000}}) {
+            auto buf = f.dma_read_bulk<char>(pos, len).get();
+            BOOST_REQUIRE_EQUAL(buf.size(), std::min(len, data.size() - pos));
+            BOOST_REQUIRE(std::string_view(buf.get(), buf.size()) == std::string_view(data).substr(pos, len));
+        }
+        BOOST_REQUIRE_EQUAL(f.dma_read_bulk<char>(data.size(), 100).get().size(), 0);
+
+        auto wbuf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 4096);
+        BOOST_REQUIRE_THROW(f.dma_write(0, wbuf.get(), wbuf.size()).get(), std::system_error);
+    });
+}
+
+SEASTAR_TEST_CASE(test_compressed_file_lz4) {
+    return test_round_trip(compressed_file_options{ .chunk_size = chunk_size, .algorithm = compressed_file_algorithm::lz4 });
+}
+
+#ifdef SEASTAR_HAVE_ZSTD
+SEASTAR_TEST_CASE(test_compressed_file_zstd) {
+    return test_round_trip(compressed_file_options{ .chunk_size = chunk_size, .algorithm = compressed_file_algorithm::zstd });
+}
+#endif
+
+SEASTAR_TEST_CASE(test_compressed_file_empty) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        write_compressed(name, "", compressed_file_options{});
+        auto f = open_compressed_file(open_file_dma(name, open_flags::ro).get()).get();
+        auto close_f = deferred_close(f);
+        BOOST_REQUIRE_EQUAL(f.size().get(), 0);
+        BOOST_REQUIRE_EQUAL(f.dma_read_bulk<char>(0, 100).get().size(), 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_not_a_compressed_file) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring name = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(name, open_flags::rw | open_flags::create).get();
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 4096);
+        std::fill_n(buf.get_write(), buf.size(), 'x');
+        f.dma_write(0, buf.get(), buf.size()).get();
+        BOOST_REQUIRE_THROW(open_compressed_file(f).get(), std::runtime_error);
+        f.close().get();
+    });
+}
@@ -37,6 +37,8 @@
 #include <seastar/coroutine/generator.hh>
 #include <seastar/testing/random.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/util/later.hh>
 
 using namespace seastar;
@@ -882,6 +884,53 @@ SEASTAR_TEST_CASE(test_async_generator_throws_from_consumer_unbuffered) {
     return test_async_generator_throws_from_consumer<std::optional>();
 }
 
+coroutine::experimental::generator<int, buffered_container>
+counting_sequence(coroutine::experimental::buffer_size_t size, int n, const int* consumed, int* resumed) {
+    for (int i = 0; i < n; ++i) {
+        auto before = *consumed;
+        co_yield i;
+        if (*consumed != before) {
+            ++*resumed;
+        }
+    }
+}
+
+SEASTAR_TEST_CASE(test_async_generator_buffered_resumes_once_per_buffer) {
+    int consumed = 0;
+    int resumed = 0;
+    auto seq = counting_sequence(coroutine::experimental::buffer_size_t{8}, 80, &consumed, &resumed);
+    for (int i = 0; i < 80; ++i) {
+        auto value = co_await seq();
+        BOOST_REQUIRE(value.has_value());
+        BOOST_REQUIRE_EQUAL(*value, i);
+        ++consumed;
+        // a slow consumer
+        co_await seastar::yield();
+    }
+    BOOST_REQUIRE(!(co_await seq()).has_value());
+    BOOST_REQUIRE_LE(resumed, 80 / 8);
+}
+
+coroutine::experimental::generator<int, buffered_container>
+async_sequence(coroutine::experimental::buffer_size_t size, int n) {
+    for (int i = 0; i < n; ++i) {
+        co_await seastar::yield();
+        co_yield i;
+    }
+}
+
+SEASTAR_TEST_CASE(test_async_generator_buffered_async_producer) {
+    for (size_t size : {1, 4}) {
+        auto seq = async_sequence(coroutine::experimental::buffer_size_t{size}, 20);
+        for (int i = 0; i < 20; ++i) {
+            auto value = co_await seq();
+            BOOST_REQUIRE(value.has_value());
+            BOOST_REQUIRE_EQUAL(*value, i);
+        }
+        BOOST_REQUIRE(!(co_await seq()).has_value());
+    }
+}
+
 SEASTAR_TEST_CASE(test_lambda_coroutine_in_continuation) {
     auto dist = std::uniform_real_distribution<>(0.0, 1.0);
     auto rand_eng = std::default_random_engine(std::random_device()());
@@ -908,3 +957,19 @@ SEASTAR_TEST_CASE(test_lambda_coroutine_in_continuation) {
     }));
     BOOST_REQUIRE_EQUAL(sin1, sin2);
 }
+
+#ifdef SEASTAR_COROUTINE_FRAME_POOL
+SEASTAR_THREAD_TEST_CASE(test_coroutine_frame_pool) {
+    auto& pool = internal::this_thread_coroutine_frame_pool;
+    pool.drain();
+    // A completed coroutine leaves its frame to the next one of its size
+    BOOST_REQUIRE_EQUAL(simple_coroutine().get(), 53);
+    BOOST_REQUIRE_GT(pool.pooled_bytes(), 0);
+
+    auto max = pool.max_pooled_bytes();
+    auto restore = defer([&] () noexcept { pool.set_max_pooled_bytes(max); });
+    pool.set_max_pooled_bytes(0);
+    BOOST_REQUIRE_EQUAL(simple_coroutine().get(), 53);
+    BOOST_REQUIRE_EQUAL(pool.pooled_bytes(), 0);
+}
+#endif
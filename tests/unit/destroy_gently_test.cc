@@ -0,0 +1,103 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/chunked_fifo.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/util/destroy_gently.hh>
+
+using namespace seastar;
+
+namespace {
+
+struct counted {
+    static inline unsigned live = 0;
+    counted() { ++live; }
+    counted(const counted&) { ++live; }
+    ~counted() { --live; }
+};
+
+struct custom {
+    bool cleared = false;
+    future<> clear_gently() {
+        cleared = true;
+        return make_ready_future<>();
+    }
+};
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_clear_gently_containers) {
+    std::vector<std::vector<counted>> v(100, std::vector<counted>(100));
+    BOOST_REQUIRE_EQUAL(counted::live, 10000);
+    auto before = get_gentle_destruction_stats().destroyed_elements;
+    clear_gently(v).get();
+    BOOST_REQUIRE(v.empty());
+    BOOST_REQUIRE_EQUAL(counted::live, 0);
+    BOOST_REQUIRE_EQUAL(get_gentle_destruction_stats().destroyed_elements - before, 100 + 10000);
+
+    std::map<int, std::list<counted>> m;
+    std::unordered_map<sstring, std::unique_ptr<counted>> um;
+    chunked_fifo<counted> fifo;
+    circular_buffer<std::optional<counted>> cb;
+    std::set<int> s;
+    for (int i = 0; i < 1000; ++i) {
+        m[i].resize(3);
+        um.emplace(to_sstring(i), std::make_unique<counted>());
+        fifo.emplace_back();
+        cb.emplace_back(counted());
+        s.insert(i);
+    }
+    clear_gently(m).get();
+    clear_gently(um).get();
+    clear_gently(fifo).get();
+    clear_gently(cb).get();
+    clear_gently(s).get();
+    BOOST_REQUIRE(m.empty() && um.empty() && fifo.empty() && cb.empty() && s.empty());
+    BOOST_REQUIRE_EQUAL(counted::live, 0);
+
+    custom c;
+    clear_gently(c).get();
+    BOOST_REQUIRE(c.cleared);
+    static_assert(gently_clearable<std::vector<custom>>);
+    static_assert(!gently_clearable<sstring>);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_dispose_gently) {
+    std::vector<counted> v(100000);
+    auto f = dispose_gently(std::move(v));
+    BOOST_REQUIRE(v.empty());
+    if (!f.available()) {
+        BOOST_REQUIRE_EQUAL(get_gentle_destruction_stats().pending_objects, 1);
+        BOOST_REQUIRE_GE(get_gentle_destruction_stats().pending_bytes, 100000 * sizeof(counted));
+    }
+    f.get();
+    BOOST_REQUIRE_EQUAL(counted::live, 0);
+    BOOST_REQUIRE_EQUAL(get_gentle_destruction_stats().pending_objects, 0);
+    BOOST_REQUIRE_EQUAL(get_gentle_destruction_stats().pending_bytes, 0);
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <ranges>
+#include <vector>
+
+#include <seastar/core/distributed_semaphore.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/defer.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+SEASTAR_THREAD_TEST_CASE(test_distributed_semaphore_local) {
+    sharded<distributed_semaphore> sem;
+    sem.start(4, 2).get();
+    auto stop = defer([&] () noexcept { sem.stop().get(); });
+
+    auto& s = sem.local();
+    auto u1 = s.get_units(3).get();
+    BOOST_REQUIRE_EQUAL(u1.count(), 3);
+    // Returning more than a batch gives the surplus back to the pool
+    u1.return_all();
+    BOOST_REQUIRE_LE(s.available_units(), 2);
+    auto u2 = s.get_units(4).get();
+    BOOST_REQUIRE(!s.try_get_units(1));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_distributed_semaphore_skewed) {
+    if (smp::count < 2) {
+        return;
+    }
+    sharded<distributed_semaphore> sem;
+    sem.start(8, 2).get();
+    auto stop = defer([&] () noexcept { sem.stop().get(); });
+
+    // An idle shard caches some units; a busy one still gets all of them
+    sem.invoke_on(0, [] (distributed_semaphore& s) {
+        return s.get_units(1).discard_result();
+    }).get();
+    sem.invoke_on(1, [] (distributed_semaphore& s) {
+        return s.get_units(8).then([&s] (distributed_semaphore_units u) {
+            BOOST_REQUIRE_EQUAL(u.count(), 8);
+            BOOST_REQUIRE(!s.try_get_units(1));
+        });
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_distributed_semaphore_limit_is_global) {
+    if (smp::count < 2) {
+        return;
+    }
+    sharded<distributed_semaphore> sem;
+    sem.start(3, 1).get();
+    auto stop = defer([&] () noexcept { sem.stop().get(); });
+
+    std::atomic<int> in_use = 0;
+    std::atomic<int> peak = 0;
+    sem.invoke_on_all([&] (distributed_semaphore& s) {
+        return parallel_for_each(std::views::iota(0, 20), [&] (int) {
+            return s.get_units(1).then([&] (distributed_semaphore_units u) {
+                auto n = ++in_use;
+                int p = peak.load();
+                while (n > p && !peak.compare_exchange_weak(p, n)) {
+                }
+                return sleep(1ms).finally([&, u = std::move(u)] {
+                    --in_use;
+                });
+            });
+        });
+    }).get();
+    BOOST_REQUIRE_LE(peak.load(), 3);
+    BOOST_REQUIRE_EQUAL(in_use.load(), 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_distributed_semaphore_timeout) {
+    if (smp::count < 2) {
+        return;
+    }
+    sharded<distributed_semaphore> sem;
+    sem.start(2, 1).get();
+    auto stop = defer([&] () noexcept { sem.stop().get(); });
+
+    auto held = sem.local().get_units(2).get();
+    sem.invoke_on(1, [] (distributed_semaphore& s) {
+        return s.get_units(semaphore::clock::now() + 10ms, 1).then_wrapped([] (future<distributed_semaphore_units> f) {
+            BOOST_REQUIRE_THROW(f.get(), semaphore_timed_out);
+        });
+    }).get();
+    held.return_all();
+    // The units are back for anyone to take
+    sem.invoke_on(1, [] (distributed_semaphore& s) {
+        return s.get_units(2).discard_result();
+    }).get();
+}
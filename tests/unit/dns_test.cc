@@ -24,12 +24,14 @@
 
 #include <seastar/core/do_with.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/net/dns.hh>
 #include <seastar/net/inet_address.hh>
+#include <seastar/util/defer.hh>
 
 using namespace seastar;
 using namespace seastar::net;
@@ -181,3 +183,25 @@ SEASTAR_TEST_CASE(test_parallel_resolve_name_udp) {
         d->resolve_name("www.google.com")
     ).finally([d](auto&...) {}).discard_result();
 }
+
+SEASTAR_THREAD_TEST_CASE(test_cache) {
+    dns_resolver d;
+    auto close = defer([&d] () noexcept { d.close().get(); });
+
+    when_all_succeed(
+        d.resolve_name(seastar_name, inet_address::family::INET),
+        d.resolve_name(seastar_name, inet_address::family::INET),
+        d.resolve_name(seastar_name, inet_address::family::INET)
+    ).get();
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().misses, 1);
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().coalesced, 2);
+
+    auto e = d.get_host_by_name(seastar_name, inet_address::family::INET).get();
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().hits, 1);
+    BOOST_REQUIRE(e.ttl);
+
+    for (int i = 0; i < 2; ++i) {
+        BOOST_REQUIRE_THROW(d.get_host_by_name("apa.ninja.gnu", inet_address::family::INET).get(), std::system_error);
+    }
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().negative_hits, 1);
+}
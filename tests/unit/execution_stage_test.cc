@@ -20,6 +20,7 @@
  */
 
 #include <algorithm>
+#include <numeric>
 #include <vector>
 #include <chrono>
 
@@ -29,6 +30,7 @@
 #include <seastar/testing/test_runner.hh>
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/util/defer.hh>
 
 using namespace std::chrono_literals;
@@ -278,6 +280,63 @@ SEASTAR_TEST_CASE(test_stage_stats) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_stage_waits_for_min_batch) {
+    auto stage = seastar::make_execution_stage("test", [] { });
+    stage.set_batching_policy({.min_batch = 4, .max_delay = std::chrono::hours(1)});
+
+    auto fs = std::vector<future<>>();
+    for (auto i = 0; i < 3; i++) {
+        fs.emplace_back(stage());
+    }
+    for (auto i = 0; i < 10; i++) {
+        thread::yield();
+    }
+    BOOST_REQUIRE_EQUAL(stage.get_stats().function_calls_executed, 0u);
+
+    fs.emplace_back(stage());
+    when_all_succeed(fs.begin(), fs.end()).get();
+    BOOST_REQUIRE_EQUAL(stage.get_stats().tasks_scheduled, 1u);
+    BOOST_REQUIRE_EQUAL(stage.get_stats().batch_sizes[2], 1u);
+    BOOST_REQUIRE_EQUAL(stage.get_stats().function_calls_batched, 3u);
+    BOOST_REQUIRE_EQUAL(stage.get_stats().flushes_on_deadline, 0u);
+
+    // Flushing explicitly does not wait for the batch to fill up
+    auto f = stage();
+    stage.flush();
+    f.get();
+    BOOST_REQUIRE_EQUAL(stage.get_stats().batch_sizes[0], 1u);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_stage_max_delay) {
+    auto stage = seastar::make_execution_stage("test", [] { });
+    stage.set_batching_policy({.min_batch = 100, .max_delay = std::chrono::milliseconds(1), .adaptive = true});
+
+    stage().get();
+    BOOST_REQUIRE_EQUAL(stage.get_stats().flushes_on_deadline, 1u);
+
+    // The adaptive policy no longer waits for batches longer than the last one
+    auto fs = std::vector<future<>>();
+    fs.emplace_back(stage());
+    BOOST_REQUIRE_EQUAL(stage.get_stats().tasks_scheduled, 2u);
+    when_all_succeed(fs.begin(), fs.end()).get();
+    BOOST_REQUIRE_EQUAL(stage.get_stats().flushes_on_deadline, 1u);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_stage_max_batch) {
+    auto stage = seastar::make_execution_stage("test", [] { });
+    stage.set_batching_policy({.max_batch = 2});
+
+    auto fs = std::vector<future<>>();
+    for (auto i = 0; i < 5; i++) {
+        fs.emplace_back(stage());
+    }
+    when_all_succeed(fs.begin(), fs.end()).get();
+    auto& stats = stage.get_stats();
+    BOOST_REQUIRE_EQUAL(stats.function_calls_executed, 5u);
+    BOOST_REQUIRE_GE(stats.tasks_scheduled, 3u);
+    BOOST_REQUIRE_EQUAL(std::accumulate(stats.batch_sizes.begin() + 2, stats.batch_sizes.end(), uint64_t(0)), 0u);
+}
+
 SEASTAR_TEST_CASE(test_unique_stage_names_are_enforced) {
     return seastar::async([] {
         {
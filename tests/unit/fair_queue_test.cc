@@ -150,6 +150,14 @@ class test_env {
         _fq.update_shares_for_class(id, shares);
     }
 
+    void set_latency_target(fair_queue::class_id id, std::chrono::microseconds target) {
+        _fq.set_latency_target_for_class(id, target);
+    }
+
+    unsigned results(unsigned index) const {
+        return _results[index];
+    }
+
     void reset_results(unsigned index) {
         _results[index] = 0;
     }
@@ -195,6 +203,50 @@ SEASTAR_THREAD_TEST_CASE(test_fair_queue_equal_2classes) {
     env.verify("equal_2classes", {1, 1});
 }
 
+// A low-share class with a latency target doesn't wait for its share-based
+// turn once its requests are due.
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_latency_target) {
+    test_env env(1);
+
+    auto a = env.register_priority_class(1000);
+    auto b = env.register_priority_class(10);
+    env.set_latency_target(b, 10us);
+
+    // Let b fall behind a's turn by what it costs to dispatch one of its
+    // requests, i.e. 100 of a's.
+    env.do_op(b, 1);
+    env.tick(2);
+    BOOST_REQUIRE_EQUAL(env.results(b), 1);
+
+    for (int i = 0; i < 100; ++i) {
+        env.do_op(a, 1);
+    }
+    env.do_op(b, 1);
+    sleep(20us).get();
+    env.tick(5);
+    BOOST_REQUIRE_EQUAL(env.results(b), 2);
+}
+
+// Without a latency target, the same request waits for its turn.
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_no_latency_target) {
+    test_env env(1);
+
+    auto a = env.register_priority_class(1000);
+    auto b = env.register_priority_class(10);
+
+    env.do_op(b, 1);
+    env.tick(2);
+    BOOST_REQUIRE_EQUAL(env.results(b), 1);
+
+    for (int i = 0; i < 100; ++i) {
+        env.do_op(a, 1);
+    }
+    env.do_op(b, 1);
+    sleep(20us).get();
+    env.tick(5);
+    BOOST_REQUIRE_EQUAL(env.results(b), 1);
+}
+
 // Equal results, spread among 4 classes.
 SEASTAR_THREAD_TEST_CASE(test_fair_queue_equal_4classes) {
     test_env env(1);
@@ -446,3 +498,44 @@ SEASTAR_THREAD_TEST_CASE(test_fair_queue_random_run) {
     auto expected_error = std::max(1, int(round(reqs * 0.05)));
     env.verify(format("random_run ({:d} requests)", reqs), {1, 1}, expected_error);
 }
+
+// Returns how many of the requests queued in a single busy queue of a
+// group of four it dispatches in one tick.
+static unsigned dispatch_from_busy_queue(bool share_idle_capacity) {
+    fair_group::config gcfg;
+    gcfg.rate_limit_duration = std::chrono::microseconds(100);
+    gcfg.share_idle_capacity = share_idle_capacity;
+    fair_group fg(gcfg, 4);
+    fair_queue fq(fg, fair_queue::config{});
+    fq.register_priority_class(0, 100);
+
+    std::vector<std::unique_ptr<fair_queue_entry>> entries;
+    for (unsigned i = 0; i < 64; i++) {
+        entries.push_back(std::make_unique<fair_queue_entry>(fg.maximum_capacity() / 32));
+        fq.queue(0, *entries.back());
+    }
+
+    unsigned dispatched = 0;
+    unsigned first_tick = 0;
+    for (unsigned tick = 0; dispatched < entries.size(); tick++) {
+        BOOST_REQUIRE_LT(tick, 1000);
+        fg.replenish_capacity(fg.replenished_ts() + std::chrono::milliseconds(1));
+        fq.dispatch_requests([&] (fair_queue_entry& ent) {
+            dispatched++;
+            fq.notify_request_finished(ent.capacity());
+        });
+        if (tick == 0) {
+            first_tick = dispatched;
+        }
+    }
+    BOOST_REQUIRE_EQUAL(fq.borrowed_capacity() > 0, share_idle_capacity);
+    fq.unregister_priority_class(0);
+    return first_tick;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_share_idle_capacity) {
+    auto fair_share = dispatch_from_busy_queue(false);
+    auto shared = dispatch_from_busy_queue(true);
+    BOOST_REQUIRE_LE(fair_share, 32 / 4 + 1);
+    BOOST_REQUIRE_GE(shared, 32 - 1);
+}
@@ -24,6 +24,7 @@
 #include <seastar/testing/test_runner.hh>
 
 #include <seastar/core/seastar.hh>
+#include <seastar/core/reactor.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/file.hh>
@@ -32,6 +33,7 @@
 #include <seastar/core/stall_sampler.hh>
 #include <seastar/core/aligned_buffer.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/io_trace.hh>
 #include <seastar/util/tmp_file.hh>
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/closeable.hh>
@@ -584,6 +586,107 @@ SEASTAR_TEST_CASE(test_file_ioctl) {
     });
 }
 
+SEASTAR_TEST_CASE(test_dma_read_many) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        static constexpr size_t block = 4096;
+        static constexpr unsigned nr_blocks = 16;
+        auto wbuf = allocate_aligned_buffer<char>(block, block);
+        for (unsigned i = 0; i < nr_blocks; i++) {
+            std::fill_n(wbuf.get(), block, char('a' + i));
+            f.dma_write(i * block, wbuf.get(), block).get();
+        }
+
+        const std::vector<unsigned> wanted = { 11, 2, 3, 7, 15 };
+        auto rbuf = allocate_aligned_buffer<char>(block * wanted.size(), block);
+        std::vector<dma_read_request> reqs;
+        for (unsigned i = 0; i < wanted.size(); i++) {
+            reqs.push_back({ wanted[i] * block, rbuf.get() + i * block, block });
+        }
+        // Past the end of the file
+        reqs.push_back({ nr_blocks * block, rbuf.get(), block });
+
+        std::vector<bool> seen(reqs.size());
+        auto consume = [&] () -> future<> {
+            auto results = f.dma_read_many(reqs);
+            while (auto r = co_await results()) {
+                BOOST_REQUIRE(!r->error);
+                BOOST_REQUIRE_LT(r->index, reqs.size());
+                BOOST_REQUIRE(!seen[r->index]);
+                seen[r->index] = true;
+                if (r->index < wanted.size()) {
+                    BOOST_REQUIRE_EQUAL(r->size, block);
+                    BOOST_REQUIRE_EQUAL(rbuf[r->index * block], char('a' + wanted[r->index]));
+                } else {
+                    BOOST_REQUIRE_EQUAL(r->size, 0);
+                }
+            }
+        };
+        consume().get();
+        BOOST_REQUIRE(std::all_of(seen.begin(), seen.end(), [] (bool s) { return s; }));
+    });
+}
+
+SEASTAR_TEST_CASE(test_concurrent_flushes_coalesce) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        auto buf = allocate_aligned_buffer<char>(4096, 4096);
+        f.dma_write(0, buf.get(), 4096).get();
+
+        // The first flush syncs, the others wait for a single sync issued
+        // once it completes.
+        static constexpr unsigned nr_flushes = 10;
+        auto coalesced = engine().get_io_stats().fsyncs_coalesced;
+        std::vector<future<>> flushes;
+        for (unsigned i = 0; i < nr_flushes; i++) {
+            flushes.push_back(f.flush());
+        }
+        when_all_succeed(flushes.begin(), flushes.end()).get();
+        BOOST_REQUIRE_EQUAL(engine().get_io_stats().fsyncs_coalesced - coalesced, nr_flushes - 2);
+
+        // Nothing is left in flight
+        f.flush().get();
+        BOOST_REQUIRE_EQUAL(engine().get_io_stats().fsyncs_coalesced - coalesced, nr_flushes - 2);
+    });
+}
+
+SEASTAR_TEST_CASE(test_io_trace_hook) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        auto buf = allocate_aligned_buffer<char>(8192, 4096);
+
+        std::vector<io_trace_event> events;
+        set_io_trace_hook([&events] (const io_trace_event& ev) noexcept {
+            events.push_back(ev);
+        });
+        auto reset_hook = defer([] () noexcept { set_io_trace_hook({}); });
+        f.dma_write(4096, buf.get(), 8192).get();
+        f.dma_read(8192, buf.get(), 4096).get();
+        set_io_trace_hook({});
+
+        BOOST_REQUIRE_EQUAL(events.size(), 2);
+        BOOST_REQUIRE(events[0].op == io_trace_op::write);
+        BOOST_REQUIRE_EQUAL(events[0].offset, 4096);
+        BOOST_REQUIRE_EQUAL(events[0].length, 8192);
+        BOOST_REQUIRE(events[1].op == io_trace_op::read);
+        BOOST_REQUIRE_EQUAL(events[1].offset, 8192);
+        BOOST_REQUIRE_EQUAL(events[1].length, 4096);
+        BOOST_REQUIRE_EQUAL(events[1].shard, this_shard_id());
+        BOOST_REQUIRE_EQUAL(events[1].class_name, current_scheduling_group().name());
+        BOOST_REQUIRE(events[0].timestamp <= events[1].timestamp);
+
+        // Untraced once the hook is removed
+        f.dma_read(0, buf.get(), 4096).get();
+        BOOST_REQUIRE_EQUAL(events.size(), 2);
+    });
+}
+
 class test_layered_file : public layered_file_impl {
 public:
     explicit test_layered_file(file f) : layered_file_impl(std::move(f)) {}
@@ -946,3 +1049,49 @@ SEASTAR_TEST_CASE(test_oversized_io_works) {
         BOOST_REQUIRE((size_t)std::count_if(buf.get(), buf.get() + buf_size, [](auto x) { return x == 'a'; }) == buf_size);
     });
 }
+
+SEASTAR_TEST_CASE(dma_buffer_pool_recycles_test) {
+    auto buf = engine().allocate_dma_buffer<char>(4096, 128 * 1024);
+    auto p = buf.get();
+    buf = {};
+    // Same size class, so the freed buffer is handed out again
+    buf = engine().allocate_dma_buffer<char>(4096, 100 * 1024);
+    BOOST_REQUIRE_EQUAL(buf.get(), p);
+    BOOST_REQUIRE_EQUAL(buf.size(), 100 * 1024);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(buf.get()) % 4096, 0);
+    // Stricter alignment is not served by the pool, but still honored
+    auto big = engine().allocate_dma_buffer<char>(8192, 4096);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(big.get()) % 8192, 0);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_map_readonly) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        size_t size = 64 * 4096;
+        auto buf = allocate_aligned_buffer<char>(size, 4096);
+        for (size_t i = 0; i < size; i++) {
+            buf.get()[i] = char(i / 4096);
+        }
+        f.dma_write(0, buf.get(), size).get();
+        f.truncate(size - 100).get();
+
+        // Unaligned, and running past the end of the file
+        auto m = f.map_readonly(4096 + 10, size).get();
+        BOOST_REQUIRE_EQUAL(m.size(), size - 100 - 4096 - 10);
+        m.ensure_resident(0, m.size()).get();
+        BOOST_REQUIRE(m.is_resident(0, m.size()));
+        BOOST_REQUIRE(std::equal(m.data(), m.data() + m.size(), buf.get() + 4096 + 10));
+
+        auto whole = f.map_readonly().get();
+        BOOST_REQUIRE_EQUAL(whole.size(), size - 100);
+        whole.ensure_resident(10 * 4096, 4096).get();
+        BOOST_REQUIRE_EQUAL(whole.data()[10 * 4096], char(10));
+
+        auto empty = f.map_readonly(size, 4096).get();
+        BOOST_REQUIRE_EQUAL(empty.size(), 0);
+        empty.ensure_resident(0, 4096).get();
+    });
+}
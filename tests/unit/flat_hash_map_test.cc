@@ -0,0 +1,169 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/flat_hash_map.hh>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+using namespace seastar;
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_basic) {
+    flat_hash_map<std::string, int> m;
+    BOOST_REQUIRE(m.empty());
+    BOOST_REQUIRE(m.find("a") == m.end());
+    BOOST_REQUIRE(m.emplace("a", 1).second);
+    BOOST_REQUIRE(!m.emplace("a", 2).second);
+    BOOST_REQUIRE_EQUAL(m.at("a"), 1);
+    m["b"] = 2;
+    BOOST_REQUIRE_EQUAL(m.size(), 2);
+    BOOST_REQUIRE_EQUAL(m["b"], 2);
+    BOOST_REQUIRE(!m.insert_or_assign("b", 3).second);
+    BOOST_REQUIRE_EQUAL(m.at("b"), 3);
+    BOOST_REQUIRE_THROW(m.at("c"), std::out_of_range);
+    BOOST_REQUIRE_EQUAL(m.erase("a"), 1);
+    BOOST_REQUIRE_EQUAL(m.erase("a"), 0);
+    BOOST_REQUIRE(!m.contains("a"));
+    BOOST_REQUIRE_EQUAL(m.count("b"), 1);
+    m.clear();
+    BOOST_REQUIRE(m.empty());
+    BOOST_REQUIRE(m.begin() == m.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_like_unordered_map) {
+    flat_hash_map<int, std::string> m;
+    std::unordered_map<int, std::string> ref;
+    std::mt19937 gen(0);
+    for (int op = 0; op < 200000; ++op) {
+        int k = gen() % 10000;
+        switch (gen() % 4) {
+        case 0:
+        case 1:
+            BOOST_REQUIRE_EQUAL(m.try_emplace(k, std::to_string(op)).second, ref.try_emplace(k, std::to_string(op)).second);
+            break;
+        case 2:
+            BOOST_REQUIRE_EQUAL(m.erase(k), ref.erase(k));
+            break;
+        default: {
+            auto it = m.find(k);
+            auto r = ref.find(k);
+            BOOST_REQUIRE_EQUAL(it == m.end(), r == ref.end());
+            if (r != ref.end()) {
+                BOOST_REQUIRE_EQUAL(it->second, r->second);
+            }
+        }
+        }
+        BOOST_REQUIRE_EQUAL(m.size(), ref.size());
+    }
+    size_t n = 0;
+    for (auto& [k, v] : m) {
+        BOOST_REQUIRE_EQUAL(ref.at(k), v);
+        ++n;
+    }
+    BOOST_REQUIRE_EQUAL(n, ref.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_grows_incrementally) {
+    flat_hash_map<int, int> m;
+    int n = 0;
+    while (!m.migrating() || m.capacity() < 1024) {
+        m[n] = n;
+        ++n;
+    }
+    // The entries are found in either table meanwhile
+    for (int i = 0; i < n; ++i) {
+        BOOST_REQUIRE_EQUAL(m.at(i), i);
+    }
+    size_t iterated = 0;
+    for (auto& [k, v] : m) {
+        BOOST_REQUIRE_EQUAL(k, v);
+        ++iterated;
+    }
+    BOOST_REQUIRE_EQUAL(iterated, n);
+    // A couple of groups are migrated on each insertion
+    auto capacity = m.capacity();
+    m[n] = n;
+    ++n;
+    BOOST_REQUIRE(m.migrating());
+    BOOST_REQUIRE_EQUAL(m.capacity(), capacity);
+    BOOST_REQUIRE(!m.migrate(1));
+    while (!m.migrate(1)) {
+    }
+    BOOST_REQUIRE_EQUAL(m.size(), n);
+    for (int i = 0; i < n; ++i) {
+        BOOST_REQUIRE_EQUAL(m.at(i), i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_purges_deleted) {
+    flat_hash_map<int, int> m;
+    m.reserve(1000);
+    m.migrate(m.capacity());
+    auto capacity = m.capacity();
+    // Churning through keys reuses the table rather than grow it
+    for (int i = 0; i < 100000; ++i) {
+        m[i] = i;
+        if (i >= 100) {
+            BOOST_REQUIRE_EQUAL(m.erase(i - 100), 1);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(m.size(), 100);
+    BOOST_REQUIRE_EQUAL(m.capacity(), capacity);
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_erase_while_iterating) {
+    flat_hash_map<int, std::unique_ptr<int>> m;
+    for (int i = 0; i < 1000; ++i) {
+        m.emplace(i, std::make_unique<int>(i));
+    }
+    for (auto it = m.begin(); it != m.end();) {
+        if (it->first % 2) {
+            it = m.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    BOOST_REQUIRE_EQUAL(m.size(), 500);
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_REQUIRE_EQUAL(m.contains(i), i % 2 == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_copy_and_move) {
+    flat_hash_map<int, std::string> m;
+    for (int i = 0; i < 100; ++i) {
+        m[i] = std::to_string(i);
+    }
+    auto copy = m;
+    BOOST_REQUIRE_EQUAL(copy.size(), 100);
+    BOOST_REQUIRE_EQUAL(copy.at(42), "42");
+    auto moved = std::move(copy);
+    BOOST_REQUIRE_EQUAL(moved.size(), 100);
+    BOOST_REQUIRE(copy.empty());
+    copy = std::move(moved);
+    BOOST_REQUIRE_EQUAL(copy.at(99), "99");
+    m = copy;
+    BOOST_REQUIRE_EQUAL(m.size(), 100);
+}
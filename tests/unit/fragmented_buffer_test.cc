@@ -0,0 +1,107 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/fragmented_buffer.hh>
+#include <seastar/net/packet.hh>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace seastar;
+
+static fragmented_buffer make_buffer(std::vector<std::string_view> fragments) {
+    std::vector<temporary_buffer<char>> bufs;
+    for (auto f : fragments) {
+        bufs.push_back(temporary_buffer<char>::copy_of(f));
+    }
+    return fragmented_buffer(std::move(bufs));
+}
+
+static std::string to_string(const fragmented_buffer& b) {
+    std::string ret;
+    b.for_each_fragment([&ret] (std::string_view f) {
+        ret += f;
+    });
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(test_slicing) {
+    auto b = make_buffer({"hello", "", ", ", "world"});
+    BOOST_REQUIRE_EQUAL(b.size(), 12u);
+    BOOST_REQUIRE_EQUAL(b.fragment_count(), 3u);
+    BOOST_REQUIRE(b == "hello, world");
+    BOOST_REQUIRE(!(b == "hello, World"));
+    BOOST_REQUIRE_EQUAL(b[7], 'w');
+
+    auto s = b.share(3, 6);
+    BOOST_REQUIRE_EQUAL(to_string(s), "lo, wo");
+    BOOST_REQUIRE_EQUAL(s.fragment_count(), 3u);
+    BOOST_REQUIRE_EQUAL(s[0], 'l');
+    BOOST_REQUIRE_EQUAL(s[5], 'o');
+    s.trim_front(2);
+    s.trim(3);
+    BOOST_REQUIRE(s == ", w");
+    BOOST_REQUIRE_EQUAL(s.fragment_count(), 2u);
+    BOOST_REQUIRE_EQUAL(std::string_view(s.linearize().get(), 3), ", w");
+
+    // A single fragment is shared rather than copied
+    BOOST_REQUIRE(b.share(7, 5).linearize().get() == b.share_fragments().back().get());
+    BOOST_REQUIRE(b.share(0, 0).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_append_shares) {
+    auto b = make_buffer({"abc", "def"});
+    auto prefix = b.share(0, 4);
+    b.append(temporary_buffer<char>::copy_of("ghi"));
+    // Appending to the array they share does not show in the slice
+    BOOST_REQUIRE(prefix == "abcd");
+    BOOST_REQUIRE(b == "abcdefghi");
+    // Appending to a slice does not show in the buffer it was taken from
+    prefix.append(temporary_buffer<char>::copy_of("XY"));
+    BOOST_REQUIRE(prefix == "abcdXY");
+    BOOST_REQUIRE(b == "abcdefghi");
+    BOOST_REQUIRE(prefix.share_fragments()[0].get() == b.share_fragments()[0].get());
+
+    fragmented_buffer c;
+    c.append(b.share(6, 3));
+    c.append(prefix);
+    BOOST_REQUIRE(c == "ghiabcdXY");
+    BOOST_REQUIRE_EQUAL(c[3], 'a');
+    BOOST_REQUIRE_EQUAL(c.fragment_count(), 4u);
+
+    auto moved = std::move(c);
+    BOOST_REQUIRE(c.empty());
+    BOOST_REQUIRE(moved == "ghiabcdXY");
+}
+
+BOOST_AUTO_TEST_CASE(test_packet_conversion) {
+    auto b = make_buffer({"GET ", "/ ", "HTTP/1.1"});
+    net::packet p(b.share(4, 10));
+    BOOST_REQUIRE_EQUAL(p.len(), 10u);
+    BOOST_REQUIRE_EQUAL(p.nr_frags(), 2u);
+    BOOST_REQUIRE(p.frag(0).base == b.share_fragments()[1].get());
+
+    fragmented_buffer back(p.release());
+    BOOST_REQUIRE(back == "/ HTTP/1.1");
+}
@@ -226,3 +226,55 @@ SEASTAR_THREAD_TEST_CASE(test_shutdown_notifier) {
     auto events = fut.get();
     BOOST_REQUIRE(events.empty());
 }
+
+SEASTAR_THREAD_TEST_CASE(test_notify_batch_coalesce) {
+    tmpdir tmp;
+    fsnotifier fsn;
+
+    auto w = fsn.create_watch(tmp.path().native(), fsnotifier::flags::create_child
+        | fsnotifier::flags::modify
+        | fsnotifier::flags::close_write
+    ).get();
+
+    auto p = tmp.path() / "kossa.dat";
+    auto f = open_file_dma(p.native(), open_flags::create|open_flags::rw).get();
+    auto os = make_file_output_stream(f).get();
+    for (int i = 0; i < 10; ++i) {
+        os.write(sstring(4096, 'a')).get();
+        os.flush().get();
+    }
+    os.close().get();
+
+    auto events = fsn.wait(fsnotifier::batch_options{.window = std::chrono::milliseconds(50)}).get();
+    // The creation, then all the writes and the close in one event
+    BOOST_REQUIRE_EQUAL(events.size(), 2);
+    BOOST_REQUIRE(events[0].id == w && events[0].mask == fsnotifier::flags::create_child && events[0].name == "kossa.dat");
+    BOOST_REQUIRE(events[1].mask == (fsnotifier::flags::modify | fsnotifier::flags::close_write));
+    BOOST_REQUIRE_EQUAL(events[1].name, "kossa.dat");
+}
+
+SEASTAR_THREAD_TEST_CASE(test_notify_batch_filter) {
+    tmpdir tmp;
+    fsnotifier fsn;
+
+    auto w = fsn.create_watch(tmp.path().native(), fsnotifier::flags::modify
+        | fsnotifier::flags::close_write
+        | fsnotifier::flags::delete_child
+    ).get();
+
+    auto p = tmp.path() / "kossa.dat";
+    auto f = open_file_dma(p.native(), open_flags::create|open_flags::rw).get();
+    auto os = make_file_output_stream(f).get();
+    os.write("kossa").get();
+    os.flush().get();
+    os.close().get();
+    remove_file(p.native()).get();
+
+    fsnotifier::batch_options opts{.mask = fsnotifier::flags::close_write | fsnotifier::flags::delete_child,
+                                   .window = std::chrono::milliseconds(50)};
+    auto events = fsn.wait(opts).get();
+    BOOST_REQUIRE_EQUAL(events.size(), 2);
+    BOOST_REQUIRE(find_event(events, w, fsnotifier::flags::close_write, "kossa.dat"));
+    BOOST_REQUIRE(find_event(events, w, fsnotifier::flags::delete_child, "kossa.dat"));
+    BOOST_REQUIRE(!find_event(events, w, fsnotifier::flags::modify));
+}
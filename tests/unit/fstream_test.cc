@@ -23,6 +23,7 @@
 #include <iostream>
 #include <numeric>
 #include <seastar/core/fstream.hh>
+#include <seastar/core/memory.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/app-template.hh>
@@ -537,6 +538,39 @@ SEASTAR_TEST_CASE(test_fstream_slow_start) {
     });
 }
 
+SEASTAR_TEST_CASE(test_fstream_adaptive_read_ahead_budget) {
+    return seastar::async([] {
+        static constexpr size_t buffer_size = 64 * 1024;
+        static constexpr size_t file_size = 16 * buffer_size;
+
+        auto mock_file = make_shared<mock_read_only_file>(file_size);
+        file_input_stream_options options{};
+        options.buffer_size = buffer_size;
+        options.read_ahead = 4;
+        options.adaptive_read_ahead = true;
+
+        auto read_all = [&] (size_t requests_per_read) {
+            auto fstr = make_file_input_stream(file(mock_file), 0, file_size, options);
+            auto close_fstr = deferred_close(fstr);
+            mock_file->set_expected_read_size(buffer_size);
+            mock_file->set_allowed_read_requests(requests_per_read);
+            uint64_t total_read = 0;
+            while (total_read != file_size) {
+                auto buf = fstr.read().get();
+                total_read += buf.size();
+                mock_file->set_allowed_read_requests(requests_per_read);
+            }
+        };
+
+        read_all(std::numeric_limits<size_t>::max());
+
+        // Out of budget, only the reads that are waited for are issued
+        set_read_ahead_memory_budget(0);
+        auto restore_budget = defer([] () noexcept { set_read_ahead_memory_budget(memory::stats().total_memory() / 32); });
+        read_all(1);
+    });
+}
+
 #ifdef SEASTAR_ENABLE_ALLOC_FAILURE_INJECTION
 
 SEASTAR_TEST_CASE(test_close_error) {
@@ -43,6 +43,7 @@
 #include <seastar/core/when_any.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/pipeline.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/later.hh>
 #include <boost/iterator/counting_iterator.hpp>
@@ -2082,6 +2083,84 @@ SEASTAR_THREAD_TEST_CASE(test_max_concurrent_for_each) {
     BOOST_REQUIRE_EQUAL(sum, 28);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_chunked_for_each) {
+    BOOST_TEST_MESSAGE("empty range");
+    chunked_for_each(std::vector<int>(), 3, [] (int) {
+        BOOST_FAIL("should not reach");
+        return make_exception_future<>(std::bad_function_call());
+    }).get();
+
+    auto range = boost::copy_range<std::vector<int>>(boost::irange(1, 8));
+
+    BOOST_TEST_MESSAGE("immediate result");
+    auto sum = 0;
+    auto f = chunked_for_each(range.begin(), range.end(), 3, [&sum] (int v) {
+        sum += v;
+        return make_ready_future<>();
+    });
+    BOOST_REQUIRE(f.available());
+    f.get();
+    BOOST_REQUIRE_EQUAL(sum, 28);
+
+    BOOST_TEST_MESSAGE("large range, preempting between chunks");
+    auto large = boost::copy_range<std::vector<int>>(boost::irange(0, 1000000));
+    int64_t large_sum = 0;
+    chunked_for_each(large, 1, [&large_sum] (int v) {
+        large_sum += v;
+        return make_ready_future<>();
+    }).get();
+    BOOST_REQUIRE_EQUAL(large_sum, int64_t(999999) * 1000000 / 2);
+
+    BOOST_TEST_MESSAGE("suspend, with bounded concurrency");
+    sum = 0;
+    size_t in_flight = 0;
+    size_t max_in_flight = 0;
+    chunked_for_each(range, 3, [&] (int v) {
+        max_in_flight = std::max(max_in_flight, ++in_flight);
+        return yield().then([&, v] {
+            --in_flight;
+            sum += v;
+        });
+    }).get();
+    BOOST_REQUIRE_EQUAL(sum, 28);
+    BOOST_REQUIRE_EQUAL(max_in_flight, 3u);
+
+    BOOST_TEST_MESSAGE("some suspend");
+    sum = 0;
+    chunked_for_each(large, 2, [&sum] (int v) {
+        if (v % 1000) {
+            return make_ready_future<>();
+        }
+        return yield().then([&sum] {
+            ++sum;
+        });
+    }).get();
+    BOOST_REQUIRE_EQUAL(sum, 1000);
+
+    BOOST_TEST_MESSAGE("throw immediately");
+    sum = 0;
+    BOOST_CHECK_EXCEPTION(chunked_for_each(range, 3, [&sum] (int v) {
+        sum += v;
+        if (v == 1) {
+            throw 5;
+        }
+        return make_ready_future<>();
+    }).get(), int, [] (int v) { return v == 5; });
+    BOOST_REQUIRE_EQUAL(sum, 28);
+
+    BOOST_TEST_MESSAGE("throw after suspension");
+    sum = 0;
+    BOOST_CHECK_EXCEPTION(chunked_for_each(range, 3, [&sum] (int v) {
+        return yield().then([&sum, v] {
+            sum += v;
+            if (v == 2) {
+                throw 5;
+            }
+        });
+    }).get(), int, [] (int v) { return v == 5; });
+    BOOST_REQUIRE_EQUAL(sum, 28);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_for_each_set) {
     std::bitset<32> s;
     s.set(4);
@@ -2222,3 +2301,64 @@ SEASTAR_THREAD_TEST_CASE(test_foreign_promise_set_value) {
 
     BOOST_REQUIRE_EQUAL(getter.get(), other_shard);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_pipeline_ready) {
+    auto f = make_pipeline(make_ready_future<int>(1))
+            .then([] (int x) { return x + 1; })
+            .then([] (int x) { return make_ready_future<int>(x * 10); })
+            .then([] (int x) { return std::to_string(x); })
+            .get_future();
+    BOOST_REQUIRE(f.available());
+    BOOST_REQUIRE_EQUAL(f.get(), "20");
+
+    int seen = 0;
+    auto v = make_pipeline(make_ready_future<>())
+            .then([] { return 3; })
+            .then([&seen] (int x) { seen = x; })
+            .then([] { return make_ready_future<>(); })
+            .get_future();
+    static_assert(std::is_same_v<decltype(v), future<>>);
+    BOOST_REQUIRE(v.available());
+    v.get();
+    BOOST_REQUIRE_EQUAL(seen, 3);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_pipeline_not_ready) {
+    promise<int> source;
+    promise<int> middle;
+    std::vector<int> ran;
+    auto f = make_pipeline(source.get_future())
+            .then([&] (int x) { ran.push_back(1); return x + 1; })
+            .then([&] (int x) { ran.push_back(2); return middle.get_future().then([x] (int y) { return x + y; }); })
+            .then([&] (int x) { ran.push_back(3); return x * 2; })
+            .get_future();
+    BOOST_REQUIRE(ran.empty());
+    source.set_value(1);
+    yield().get();
+    BOOST_REQUIRE(ran == (std::vector<int>{1, 2}));
+    BOOST_REQUIRE(!f.available());
+    middle.set_value(10);
+    BOOST_REQUIRE_EQUAL(f.get(), 24);
+    BOOST_REQUIRE(ran == (std::vector<int>{1, 2, 3}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_pipeline_exceptions) {
+    bool ran = false;
+    auto thrown = make_pipeline(make_ready_future<int>(1))
+            .then([] (int) -> int { throw std::runtime_error("stage"); })
+            .then([&ran] (int x) { ran = true; return x; })
+            .get_future();
+    BOOST_REQUIRE_THROW(thrown.get(), std::runtime_error);
+
+    auto failed = make_pipeline(make_ready_future<int>(1))
+            .then([] (int) { return make_exception_future<int>(std::runtime_error("future")); })
+            .then([&ran] (int x) { ran = true; return x; })
+            .get_future();
+    BOOST_REQUIRE_THROW(failed.get(), std::runtime_error);
+
+    auto source = make_pipeline(make_exception_future<int>(std::runtime_error("source")))
+            .then([&ran] (int x) { ran = true; return x; })
+            .get_future();
+    BOOST_REQUIRE_THROW(source.get(), std::runtime_error);
+    BOOST_REQUIRE(!ran);
+}
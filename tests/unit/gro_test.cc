@@ -0,0 +1,150 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <string>
+#include <vector>
+
+#include <seastar/net/gro.hh>
+
+using namespace seastar;
+using namespace seastar::net;
+
+namespace {
+
+constexpr uint8_t ack = 0x10;
+constexpr uint8_t psh = 0x08;
+constexpr uint8_t fin = 0x01;
+
+// An Ethernet frame carrying a TCP segment from port src_port
+packet make_frame(uint32_t seq, const std::string& payload, uint8_t flags = ack, uint16_t src_port = 1000) {
+    std::string f(eth_hdr_len + ipv4_hdr_len_min + tcp_hdr_len_min, '\0');
+    write_be<uint16_t>(f.data() + 12, uint16_t(eth_protocol_num::ipv4));
+    auto ip = f.data() + eth_hdr_len;
+    ip[0] = 0x45;
+    write_be<uint16_t>(ip + 2, ipv4_hdr_len_min + tcp_hdr_len_min + payload.size());
+    ip[8] = 64;
+    ip[9] = uint8_t(ip_protocol_num::tcp);
+    write_be<uint32_t>(ip + 12, 0x0a000001);
+    write_be<uint32_t>(ip + 16, 0x0a000002);
+    auto tcp = ip + ipv4_hdr_len_min;
+    write_be<uint16_t>(tcp, src_port);
+    write_be<uint16_t>(tcp + 2, 80);
+    write_be<uint32_t>(tcp + 4, seq);
+    write_be<uint32_t>(tcp + 8, 7);
+    tcp[12] = (tcp_hdr_len_min / 4) << 4;
+    tcp[13] = flags;
+    write_be<uint16_t>(tcp + 14, 1024);
+    f += payload;
+    return packet(f.data(), f.size());
+}
+
+struct receiver {
+    gro g;
+    std::vector<packet> delivered;
+
+    void receive(packet p) {
+        g.receive(std::move(p), [this] (packet p) { delivered.push_back(std::move(p)); });
+    }
+    void flush() {
+        g.flush([this] (packet p) { delivered.push_back(std::move(p)); });
+    }
+};
+
+std::string payload_of(packet& p) {
+    p.linearize();
+    auto ip_len = read_be<uint16_t>(p.get_header(eth_hdr_len, 4) + 2);
+    BOOST_REQUIRE_EQUAL(ip_len + eth_hdr_len, p.len());
+    auto hdr = eth_hdr_len + ipv4_hdr_len_min + tcp_hdr_len_min;
+    return std::string(p.frag(0).base + hdr, p.len() - hdr);
+}
+
+uint32_t seq_of(packet& p) {
+    return read_be<uint32_t>(p.get_header(eth_hdr_len + ipv4_hdr_len_min + 4, 4));
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_merges_in_order_segments) {
+    receiver r;
+    r.receive(make_frame(100, "abc"));
+    r.receive(make_frame(103, "de"));
+    r.receive(make_frame(105, "f"));
+    BOOST_REQUIRE(r.delivered.empty());
+    r.flush();
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), 1);
+    BOOST_REQUIRE_EQUAL(payload_of(r.delivered[0]), "abcdef");
+    BOOST_REQUIRE_EQUAL(seq_of(r.delivered[0]), 100);
+    checksummer csum;
+    csum.sum(r.delivered[0].get_header(eth_hdr_len, ipv4_hdr_len_min), ipv4_hdr_len_min);
+    BOOST_REQUIRE_EQUAL(csum.get(), 0);
+    BOOST_REQUIRE_EQUAL(r.g.merged(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_out_of_order_segment_flushes) {
+    receiver r;
+    r.receive(make_frame(100, "abc"));
+    r.receive(make_frame(200, "xyz"));
+    r.flush();
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), 2);
+    BOOST_REQUIRE_EQUAL(seq_of(r.delivered[0]), 100);
+    BOOST_REQUIRE_EQUAL(seq_of(r.delivered[1]), 200);
+}
+
+BOOST_AUTO_TEST_CASE(test_push_releases) {
+    receiver r;
+    r.receive(make_frame(100, "abc"));
+    r.receive(make_frame(103, "de", ack | psh));
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), 1);
+    BOOST_REQUIRE_EQUAL(payload_of(r.delivered[0]), "abcde");
+    auto flags = r.delivered[0].get_header(eth_hdr_len + ipv4_hdr_len_min + 13, 1)[0];
+    BOOST_REQUIRE(flags & psh);
+    // A PSH segment on its own is not held
+    r.receive(make_frame(105, "f", ack | psh));
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_keeps_flow_order) {
+    receiver r;
+    r.receive(make_frame(100, "abc"));
+    r.receive(make_frame(1, "other", ack, 2000));
+    // A FIN is not merged, but is delivered after the data before it
+    r.receive(make_frame(103, "", ack | fin));
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), 2);
+    BOOST_REQUIRE_EQUAL(seq_of(r.delivered[0]), 100);
+    BOOST_REQUIRE_EQUAL(seq_of(r.delivered[1]), 103);
+    r.flush();
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), 3);
+    BOOST_REQUIRE_EQUAL(payload_of(r.delivered[2]), "other");
+}
+
+BOOST_AUTO_TEST_CASE(test_evicts_flows) {
+    receiver r;
+    for (unsigned i = 0; i < gro::max_flows + 1; ++i) {
+        r.receive(make_frame(100, "abc", ack, 1000 + i));
+    }
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), 1);
+    r.flush();
+    BOOST_REQUIRE_EQUAL(r.delivered.size(), gro::max_flows + 1);
+    BOOST_REQUIRE(!r.g.flush([] (packet) {}));
+}
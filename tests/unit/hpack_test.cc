@@ -0,0 +1,198 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE hpack
+
+#include <boost/test/unit_test.hpp>
+#include <string>
+#include <seastar/http/internal/hpack.hh>
+
+using namespace seastar;
+using namespace seastar::http::internal;
+
+static std::string unhex(std::string_view hex) {
+    std::string out;
+    unsigned nibbles = 0;
+    unsigned char b = 0;
+    for (char c : hex) {
+        if (c == ' ') {
+            continue;
+        }
+        b = (b << 4) | (c <= '9' ? c - '0' : c - 'a' + 10);
+        if (++nibbles % 2 == 0) {
+            out.push_back(char(b));
+            b = 0;
+        }
+    }
+    return out;
+}
+
+static void check_headers(const header_list& got, const header_list& expected) {
+    BOOST_REQUIRE_EQUAL(got.size(), expected.size());
+    for (size_t i = 0; i < got.size(); i++) {
+        BOOST_REQUIRE_EQUAL(got[i].first, expected[i].first);
+        BOOST_REQUIRE_EQUAL(got[i].second, expected[i].second);
+    }
+}
+
+// RFC 7541, C.3 and C.4: the requests of a connection
+static const std::vector<header_list> requests = {
+    {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}},
+    {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}, {"cache-control", "no-cache"}},
+    {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"}, {"custom-key", "custom-value"}},
+};
+
+static const std::vector<std::string> plain_blocks = {
+    unhex("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d"),
+    unhex("8286 84be 5808 6e6f 2d63 6163 6865"),
+    unhex("8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65"),
+};
+
+static const std::vector<std::string> huffman_blocks = {
+    unhex("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff"),
+    unhex("8286 84be 5886 a8eb 1064 9cbf"),
+    unhex("8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"),
+};
+
+static const std::vector<size_t> table_sizes = { 57, 110, 164 };
+
+BOOST_AUTO_TEST_CASE(test_encode_requests) {
+    hpack_encoder plain(false);
+    hpack_encoder huffman;
+    for (size_t i = 0; i < requests.size(); i++) {
+        std::string out;
+        plain.encode(out, requests[i]);
+        BOOST_REQUIRE(out == plain_blocks[i]);
+        BOOST_REQUIRE_EQUAL(plain.table().size(), table_sizes[i]);
+        out.clear();
+        huffman.encode(out, requests[i]);
+        BOOST_REQUIRE(out == huffman_blocks[i]);
+        BOOST_REQUIRE_EQUAL(huffman.table().size(), table_sizes[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_decode_requests) {
+    for (auto* blocks : {&plain_blocks, &huffman_blocks}) {
+        hpack_decoder decoder;
+        for (size_t i = 0; i < requests.size(); i++) {
+            check_headers(decoder.decode((*blocks)[i]), requests[i]);
+            BOOST_REQUIRE_EQUAL(decoder.table().size(), table_sizes[i]);
+        }
+    }
+}
+
+// RFC 7541, C.5: the responses of a connection, evicting from a 256 bytes table
+BOOST_AUTO_TEST_CASE(test_decode_with_eviction) {
+    hpack_decoder decoder(256);
+    check_headers(decoder.decode(unhex(
+            "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 "
+            "3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d")), {
+        {":status", "302"}, {"cache-control", "private"}, {"date", "Mon, 21 Oct 2013 20:13:21 GMT"}, {"location", "https://www.example.com"},
+    });
+    BOOST_REQUIRE_EQUAL(decoder.table().size(), 222);
+    check_headers(decoder.decode(unhex("4803 3330 37c1 c0bf")), {
+        {":status", "307"}, {"cache-control", "private"}, {"date", "Mon, 21 Oct 2013 20:13:21 GMT"}, {"location", "https://www.example.com"},
+    });
+    BOOST_REQUIRE_EQUAL(decoder.table().size(), 222);
+    BOOST_REQUIRE_EQUAL(decoder.table().entries(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip) {
+    hpack_encoder encoder;
+    hpack_decoder decoder;
+    header_list headers = {
+        {":status", "200"},
+        {"content-type", "application/json"},
+        {"authorization", "Bearer secret"},
+        {"x-big", std::string(5000, 'x')},
+        {"x-binary", std::string("\0\x01\xff\x7f", 4)},
+        {"x-empty", ""},
+    };
+    for (int i = 0; i < 3; i++) {
+        std::string out;
+        encoder.encode(out, headers);
+        check_headers(decoder.decode(out), headers);
+        BOOST_REQUIRE_EQUAL(decoder.table().size(), encoder.table().size());
+    }
+    // Neither the sensitive nor the big values are indexed
+    BOOST_REQUIRE_LT(encoder.table().find("authorization", "Bearer secret"), 0);
+    BOOST_REQUIRE_LE(encoder.table().find("x-big", headers[3].second), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_table_size_update) {
+    hpack_encoder encoder;
+    hpack_decoder decoder;
+    header_list headers = {{"custom-key", "custom-value"}};
+    std::string out;
+    encoder.encode(out, headers);
+    check_headers(decoder.decode(out), headers);
+    BOOST_REQUIRE_EQUAL(decoder.table().entries(), 1);
+
+    encoder.set_max_table_size(0);
+    encoder.set_max_table_size(200);
+    out.clear();
+    encoder.encode(out, headers);
+    // Both the smallest and the last sizes come first
+    BOOST_REQUIRE_EQUAL(uint8_t(out[0]), 0x20);
+    BOOST_REQUIRE_EQUAL(uint8_t(out[1]), 0x3f);
+    BOOST_REQUIRE_EQUAL(uint8_t(out[2]), 200 - 31);
+    check_headers(decoder.decode(out), headers);
+    BOOST_REQUIRE_EQUAL(decoder.table().max_size(), 200);
+    BOOST_REQUIRE_EQUAL(decoder.table().entries(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_malformed_blocks) {
+    auto fails = [] (std::string_view block) {
+        hpack_decoder decoder;
+        BOOST_REQUIRE_THROW(decoder.decode(block), hpack_error);
+    };
+    // Index 0, and beyond the tables
+    fails(unhex("80"));
+    fails(unhex("be"));
+    // Truncated integer and string
+    fails(unhex("ff"));
+    fails(unhex("4005 6162"));
+    // Huffman padding of 8 bits, and not of ones
+    fails(unhex("4181 ff"));
+    fails(unhex("4181 00"));
+    // Size update above the limit, and after a header
+    fails(unhex("3fe2 1f"));
+    fails(unhex("8220"));
+    hpack_decoder limited(4096, 64);
+    BOOST_REQUIRE_THROW(limited.decode(unhex("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d")), hpack_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_huffman) {
+    std::string all;
+    for (int c = 0; c < 256; c++) {
+        all.push_back(char(c));
+    }
+    for (std::string_view s : {std::string_view(all), std::string_view("www.example.com"), std::string_view("")}) {
+        std::string out;
+        huffman_encode(out, s);
+        BOOST_REQUIRE_EQUAL(out.size(), huffman_encoded_size(s));
+        auto back = huffman_decode(out);
+        BOOST_REQUIRE(std::string_view(back) == s);
+    }
+    std::string out;
+    huffman_encode(out, "www.example.com");
+    BOOST_REQUIRE(out == unhex("f1e3 c2e5 f23a 6ba0 ab90 f4ff"));
+}
@@ -4,6 +4,7 @@
 
 #include <seastar/http/httpd.hh>
 #include <seastar/http/handlers.hh>
+#include <seastar/http/file_handler.hh>
 #include <seastar/http/matcher.hh>
 #include <seastar/http/matchrules.hh>
 #include <seastar/json/formatter.hh>
@@ -22,12 +23,18 @@
 #include <seastar/util/noncopyable_function.hh>
 #include <seastar/http/json_path.hh>
 #include <seastar/http/response_parser.hh>
+#include <fstream>
 #include <sstream>
+#include <numeric>
 #include <seastar/core/shared_future.hh>
 #include <seastar/http/client.hh>
+#include <seastar/http/balanced_client.hh>
+#include <seastar/http/compression.hh>
+#include <seastar/net/packet-data-source.hh>
 #include <seastar/http/url.hh>
 #include <seastar/util/later.hh>
 #include <seastar/util/short_streams.hh>
+#include <seastar/util/tmp_file.hh>
 
 using namespace seastar;
 using namespace httpd;
@@ -117,6 +124,62 @@ SEASTAR_TEST_CASE(test_match_rule_order)
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(test_match_rule_trie)
+{
+    // Matching firsts by insertion order, whether the trie holds the rules
+    // or not
+    routes route;
+    auto add = [&] (std::function<void(match_rule&)> build) {
+        auto h = new handl();
+        auto rule = new match_rule(h);
+        build(*rule);
+        route.add(rule, GET);
+        return h;
+    };
+    auto users = add([] (match_rule& r) { r.add_str("/api/users").add_param("id"); });
+    auto user_name = add([] (match_rule& r) { r.add_str("/api/users").add_param("id").add_str("/name"); });
+    auto me = add([] (match_rule& r) { r.add_str("/api/users/me"); });
+    auto files = add([] (match_rule& r) { r.add_str("/files").add_param("path", true); });
+    auto api = add([] (match_rule& r) { r.add_str("/api").add_param("path", true); });
+    // Not for the trie
+    auto any = add([] (match_rule&) {});
+
+    auto get = [&] (const sstring& url, parameters& params) {
+        params.clear();
+        return route.get_handler(GET, url, params);
+    };
+    parameters params;
+    BOOST_REQUIRE_EQUAL(get("/api/users/17", params), users);
+    BOOST_REQUIRE_EQUAL(params.at("id"), "/17");
+    BOOST_REQUIRE_EQUAL(get("/api/users/17/", params), users);
+    BOOST_REQUIRE_EQUAL(get("/api/users/17/name", params), user_name);
+    BOOST_REQUIRE_EQUAL(params.at("id"), "/17");
+    // The parameter rule was added first
+    BOOST_REQUIRE_EQUAL(get("/api/users/me", params), users);
+    BOOST_REQUIRE_EQUAL(get("/files", params), files);
+    BOOST_REQUIRE_EQUAL(params.at("path"), "");
+    BOOST_REQUIRE_EQUAL(get("/files/etc/hosts", params), files);
+    BOOST_REQUIRE_EQUAL(params.at("path"), "/etc/hosts");
+    BOOST_REQUIRE_EQUAL(get("/filesystem", params), any);
+    BOOST_REQUIRE_EQUAL(get("files", params), any);
+    BOOST_REQUIRE_EQUAL(get("/api/users/17/age", params), api);
+    BOOST_REQUIRE_EQUAL(params.at("path"), "/users/17/age");
+    BOOST_REQUIRE(!params.exists("id"));
+    BOOST_REQUIRE_EQUAL(get("/api/users", params), api);
+
+    // Rules changed after a lookup are matched on the next one
+    auto m = route.del_cookie(0, GET);
+    BOOST_REQUIRE_EQUAL(get("/api/users/me", params), me);
+    BOOST_REQUIRE_EQUAL(get("/api/users/17", params), api);
+    delete m;
+    delete route.del_cookie(5, GET);
+    auto v2 = add([] (match_rule& r) { r.add_str("/v2").add_param("id"); });
+    BOOST_REQUIRE_EQUAL(get("/v2/17", params), v2);
+    BOOST_REQUIRE_EQUAL(params.at("id"), "/17");
+
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(test_put_drop_rule)
 {
     routes rts;
@@ -835,6 +898,66 @@ SEASTAR_TEST_CASE(content_length_limit) {
     });
 }
 
+SEASTAR_TEST_CASE(test_reply_head) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        future<> client = seastar::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+            auto count = [] (const std::string& s, const std::string& what) {
+                size_t n = 0;
+                for (auto pos = s.find(what); pos != std::string::npos; pos = s.find(what, pos + 1)) {
+                    n++;
+                }
+                return n;
+            };
+
+            output.write(sstring("GET /test HTTP/1.1\r\nHost: test\r\n\r\n")).get();
+            output.flush().get();
+            auto buf = input.read().get();
+            auto resp = std::string(buf.get(), buf.size());
+            BOOST_REQUIRE(resp.starts_with("HTTP/1.1 200 OK\r\n"));
+            BOOST_REQUIRE_EQUAL(count(resp, "\r\nServer: Seastar httpd\r\n"), 1);
+            BOOST_REQUIRE_EQUAL(count(resp, "\r\nDate: "), 1);
+            BOOST_REQUIRE_EQUAL(count(resp, "\r\nContent-Length: 5\r\n"), 1);
+            BOOST_REQUIRE(resp.ends_with("\r\n\r\nhello"));
+
+            // The headers a handler sets take the place of the server's
+            output.write(sstring("GET /own HTTP/1.1\r\nHost: test\r\n\r\n")).get();
+            output.flush().get();
+            buf = input.read().get();
+            resp = std::string(buf.get(), buf.size());
+            BOOST_REQUIRE_EQUAL(count(resp, "Server: "), 1);
+            BOOST_REQUIRE_EQUAL(count(resp, "\r\nServer: test\r\n"), 1);
+            BOOST_REQUIRE_EQUAL(count(resp, "Content-Length: "), 1);
+            BOOST_REQUIRE(resp.ends_with("\r\n\r\nown"));
+
+            input.close().get();
+            output.close().get();
+        });
+
+        server._routes.put(GET, "/test", new function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            rep->write_body("txt", sstring("hello"));
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server._routes.put(GET, "/own", new function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            rep->add_header("Server", "test");
+            rep->add_header("Content-Length", "1000");
+            rep->write_body("txt", sstring("own"));
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
 SEASTAR_TEST_CASE(test_client_unexpected_reply_status) {
     return seastar::async([] {
         class handl : public httpd::handler_base {
@@ -996,6 +1119,303 @@ SEASTAR_TEST_CASE(test_client_retry_request) {
     });
 }
 
+// Reads nr requests without bodies, however they come
+static void read_simple_http_requests(input_stream<char>& in, unsigned nr) {
+    sstring req;
+    size_t pos = 0;
+    while (nr) {
+        if (auto end = req.find("\r\n\r\n", pos); end != sstring::npos) {
+            pos = end + 4;
+            nr--;
+            continue;
+        }
+        auto r = in.read().get();
+        BOOST_REQUIRE(!r.empty());
+        req += sstring(r.get(), r.size());
+    }
+}
+
+SEASTAR_TEST_CASE(test_client_pipelining) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        auto ss = lcf.get_server_socket();
+        future<> server = ss.accept().then([] (accept_result ar) {
+            return seastar::async([sk = std::move(ar.connection)] () mutable {
+                input_stream<char> in = sk.input();
+                output_stream<char> out = sk.output();
+                auto r = [] (int i) { return format("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n{}", i); };
+                // Nothing is pipelined before a reply tells the connection persists
+                read_simple_http_requests(in, 1);
+                out.write(r(0)).get();
+                out.flush().get();
+                // The next requests all come before any reply, the client
+                // waiting for no idle connection
+                read_simple_http_requests(in, 3);
+                for (int i = 1; i <= 3; i++) {
+                    out.write(r(i)).get();
+                }
+                out.flush().get();
+                read_simple_http_requests(in, 1);
+                out.write(r(4)).get();
+                out.flush().get();
+                out.close().get();
+            });
+        });
+
+        future<> client = seastar::async([&lcf] {
+            auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf), 1);
+            cln.set_pipeline_depth(4);
+            auto get = [&cln] () {
+                return cln.make_request(http::request::make("GET", "test", "/test"), [] (const http::reply& rep, input_stream<char>&& in) {
+                    return do_with(std::move(in), [] (input_stream<char>& in) {
+                        return util::read_entire_stream_contiguous(in);
+                    }).then([] (sstring body) {
+                        BOOST_REQUIRE_EQUAL(body.size(), 1);
+                    });
+                }, http::reply::status_type::ok);
+            };
+            get().get();
+            when_all_succeed(get(), get(), get()).get();
+
+            // A streamed reply gives the connection back once its body is read
+            auto r = cln.make_streaming_request(http::request::make("GET", "test", "/test"), http::reply::status_type::ok).get();
+            BOOST_REQUIRE_EQUAL(cln.idle_connections_nr(), 0);
+            BOOST_REQUIRE_EQUAL(r.rep->_status, http::reply::status_type::ok);
+            BOOST_REQUIRE_EQUAL(util::read_entire_stream_contiguous(r.body).get(), "4");
+            r.body.close().get();
+            BOOST_REQUIRE_EQUAL(cln.idle_connections_nr(), 1);
+            BOOST_REQUIRE_EQUAL(cln.total_new_connections_nr(), 1);
+            cln.close().get();
+        });
+
+        when_all(std::move(client), std::move(server)).discard_result().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_client_streaming_reply_closed_early) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        auto ss = lcf.get_server_socket();
+        future<> server = ss.accept().then([] (accept_result ar) {
+            return seastar::async([sk = std::move(ar.connection)] () mutable {
+                input_stream<char> in = sk.input();
+                output_stream<char> out = sk.output();
+                read_simple_http_requests(in, 1);
+                out.write("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n01234").get();
+                out.flush().get();
+                out.close().get();
+            });
+        });
+
+        future<> client = seastar::async([&lcf] {
+            auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf));
+            auto r = cln.make_streaming_request(http::request::make("GET", "test", "/test")).get();
+            BOOST_REQUIRE_EQUAL(r.rep->content_length, 10);
+            BOOST_REQUIRE_EQUAL(cln.connections_nr(), 1);
+            // The rest of the body never came, the connection is not reused
+            r.body.close().get();
+            BOOST_REQUIRE_EQUAL(cln.connections_nr(), 0);
+            BOOST_REQUIRE_EQUAL(cln.idle_connections_nr(), 0);
+            cln.close().get();
+        });
+
+        when_all(std::move(client), std::move(server)).discard_result().get();
+    });
+}
+
+class refusing_http_factory : public http::experimental::connection_factory {
+public:
+    virtual future<connected_socket> make() override {
+        return make_exception_future<connected_socket>(std::system_error(ECONNREFUSED, std::system_category()));
+    }
+};
+
+SEASTAR_TEST_CASE(test_balanced_client) {
+    return seastar::async([] {
+        // Two servers, at 10.0.0.1 and 10.0.0.2, and nothing listening at
+        // 10.0.0.3
+        auto ip = [] (int i) { return net::inet_address(format("10.0.0.{}", i)); };
+        std::vector<std::unique_ptr<loopback_connection_factory>> lcfs;
+        std::vector<std::unique_ptr<http_server>> servers;
+        for (int i = 0; i < 2; i++) {
+            lcfs.push_back(std::make_unique<loopback_connection_factory>(1));
+            servers.push_back(std::make_unique<http_server>("test"));
+            httpd::http_server_tester::listeners(*servers.back()).emplace_back(lcfs.back()->get_server_socket());
+            servers.back()->_routes.put(GET, "/test", new handl());
+            servers.back()->do_accepts(0).get();
+        }
+
+        std::vector<net::inet_address> addrs = {ip(1), ip(2), ip(3)};
+        unsigned resolutions = 0;
+        http::experimental::balanced_client::config cfg;
+        cfg.port = 8080;
+        cfg.min_idle_connections = 2;
+        cfg.min_backoff = std::chrono::hours(1);
+        cfg.resolve = [&] (const sstring& name, net::opt_family) {
+            BOOST_REQUIRE_EQUAL(name, "service");
+            resolutions++;
+            return make_ready_future<net::hostent>(net::hostent{{name}, addrs, std::chrono::seconds(3600)});
+        };
+        cfg.make_connection_factory = [&] (socket_address sa) -> std::unique_ptr<http::experimental::connection_factory> {
+            BOOST_REQUIRE_EQUAL(sa.port(), 8080);
+            for (int i = 0; i < 2; i++) {
+                if (socket_address(ip(i + 1), 8080) == sa) {
+                    return std::make_unique<loopback_http_factory>(*lcfs[i]);
+                }
+            }
+            return std::make_unique<refusing_http_factory>();
+        };
+        http::experimental::balanced_client cln("service", cfg);
+
+        unsigned ok = 0;
+        unsigned failed = 0;
+        for (int i = 0; i < 20; i++) {
+            try {
+                cln.make_request(http::request::make("GET", "service", "/test"), [] (const http::reply&, input_stream<char>&& in) {
+                    return make_ready_future<>();
+                }, http::reply::status_type::ok).get();
+                ok++;
+            } catch (const std::system_error& e) {
+                BOOST_REQUIRE_EQUAL(e.code().value(), ECONNREFUSED);
+                failed++;
+            }
+        }
+        BOOST_REQUIRE_EQUAL(resolutions, 1);
+        // The address refusing connections was tried once, then left aside
+        BOOST_REQUIRE_EQUAL(failed, 1);
+        BOOST_REQUIRE_EQUAL(ok, 19);
+        auto stats = cln.get_address_stats();
+        BOOST_REQUIRE_EQUAL(stats.size(), 3);
+        BOOST_REQUIRE(stats[0].healthy && stats[1].healthy && !stats[2].healthy);
+        BOOST_REQUIRE_GT(stats[0].requests, 0);
+        BOOST_REQUIRE_GT(stats[1].requests, 0);
+        BOOST_REQUIRE_EQUAL(stats[0].requests + stats[1].requests, 19);
+        BOOST_REQUIRE_EQUAL(stats[2].errors, 1);
+        BOOST_REQUIRE(stats[0].latency);
+        BOOST_REQUIRE(!stats[2].latency);
+        // The healthy addresses are kept with idle connections
+        for (int i = 0; i < 100 && (cln.get_address_stats()[0].idle_connections < 2 || cln.get_address_stats()[1].idle_connections < 2); i++) {
+            yield().get();
+        }
+        BOOST_REQUIRE_GE(cln.get_address_stats()[0].idle_connections, 2);
+        BOOST_REQUIRE_GE(cln.get_address_stats()[1].idle_connections, 2);
+
+        // Gone addresses are dropped, the others keep their state
+        addrs = {ip(2)};
+        cln.refresh().get();
+        BOOST_REQUIRE_EQUAL(resolutions, 2);
+        stats = cln.get_address_stats();
+        BOOST_REQUIRE_EQUAL(stats.size(), 1);
+        BOOST_REQUIRE(stats[0].address == socket_address(ip(2), 8080));
+        auto requests = stats[0].requests;
+        cln.make_request(http::request::make("GET", "service", "/test"), [] (const http::reply&, input_stream<char>&& in) {
+            return make_ready_future<>();
+        }, http::reply::status_type::ok).get();
+        BOOST_REQUIRE_EQUAL(cln.get_address_stats()[0].requests, requests + 1);
+
+        cln.close().get();
+        for (auto& server : servers) {
+            server->stop().get();
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_file_handler_cache) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto path = sstring((t.get_path() / "file.txt").native());
+        auto write = [&path] (sstring content) {
+            std::ofstream(path) << content;
+        };
+        auto get = [] (handler_base& h, std::unordered_map<sstring, sstring> headers) {
+            auto req = std::make_unique<http::request>();
+            req->_method = "GET";
+            req->_url = "/file.txt";
+            for (auto& [name, value] : headers) {
+                req->_headers[name] = value;
+            }
+            return h.handle("/file.txt", std::move(req), std::make_unique<http::reply>()).get();
+        };
+
+        write("hello world");
+        file_handler h(path, nullptr, false);
+        h.set_cache({});
+        auto rep = get(h, {});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::ok);
+        BOOST_REQUIRE_EQUAL(rep->_content, "hello world");
+        BOOST_REQUIRE_EQUAL(rep->get_header("Accept-Ranges"), "bytes");
+        auto etag = rep->get_header("ETag");
+        auto last_modified = rep->get_header("Last-Modified");
+        BOOST_REQUIRE(!etag.empty());
+        BOOST_REQUIRE(!last_modified.empty());
+
+        rep = get(h, {{"If-None-Match", "\"other\", " + etag}});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::not_modified);
+        BOOST_REQUIRE(rep->_content.empty());
+        rep = get(h, {{"If-Modified-Since", last_modified}});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::not_modified);
+        rep = get(h, {{"If-None-Match", "\"other\""}, {"If-Modified-Since", last_modified}});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::ok);
+
+        auto range = [&] (sstring value, http::reply::status_type status, sstring content, sstring content_range) {
+            auto rep = get(h, {{"Range", value}});
+            BOOST_REQUIRE_EQUAL(rep->_status, status);
+            BOOST_REQUIRE_EQUAL(rep->_content, content);
+            BOOST_REQUIRE_EQUAL(rep->get_header("Content-Range"), content_range);
+        };
+        range("bytes=6-", http::reply::status_type::partial_content, "world", "bytes 6-10/11");
+        range("bytes=0-4", http::reply::status_type::partial_content, "hello", "bytes 0-4/11");
+        range("bytes=-5", http::reply::status_type::partial_content, "world", "bytes 6-10/11");
+        range("bytes=6-100", http::reply::status_type::partial_content, "world", "bytes 6-10/11");
+        range("bytes=11-", http::reply::status_type::range_not_satisfiable, "", "bytes */11");
+        // Not supported, the whole file is sent
+        range("bytes=0-1,3-4", http::reply::status_type::ok, "hello world", "");
+        range("lines=1-2", http::reply::status_type::ok, "hello world", "");
+        rep = get(h, {{"Range", "bytes=0-4"}, {"If-Range", "\"other\""}});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::ok);
+        rep = get(h, {{"Range", "bytes=0-4"}, {"If-Range", etag}});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::partial_content);
+
+        // Modified, the file is read again
+        write("goodbye");
+        for (int i = 0; i < 1000 && get(h, {})->_content != "goodbye"; i++) {
+            sleep(1ms).get();
+        }
+        rep = get(h, {});
+        BOOST_REQUIRE_EQUAL(rep->_content, "goodbye");
+        BOOST_REQUIRE_NE(rep->get_header("ETag"), etag);
+
+        // Compressed once, for the clients accepting it
+        if (http::is_supported(http::content_encoding::gzip)) {
+            sstring text(4096, 'x');
+            write(text);
+            for (int i = 0; i < 1000 && get(h, {})->_content != text; i++) {
+                sleep(1ms).get();
+            }
+            rep = get(h, {{"Accept-Encoding", "gzip"}});
+            BOOST_REQUIRE_EQUAL(rep->get_header("Content-Encoding"), "gzip");
+            BOOST_REQUIRE_LT(rep->_content.size(), text.size());
+            auto gzip_etag = rep->get_header("ETag");
+            rep = get(h, {});
+            BOOST_REQUIRE_EQUAL(rep->_content, text);
+            BOOST_REQUIRE_NE(rep->get_header("ETag"), gzip_etag);
+            rep = get(h, {{"Accept-Encoding", "gzip"}, {"If-None-Match", gzip_etag}});
+            BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::not_modified);
+            rep = get(h, {{"Accept-Encoding", "gzip"}, {"Range", "bytes=0-9"}});
+            BOOST_REQUIRE_EQUAL(rep->get_header("Content-Encoding"), "");
+            BOOST_REQUIRE_EQUAL(rep->_content, sstring(10, 'x'));
+        }
+
+        // Without a cache, the range is read from the disk
+        write("goodbye");
+        file_handler disk(path, nullptr, false);
+        rep = get(disk, {{"Range", "bytes=1-3"}});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::partial_content);
+        BOOST_REQUIRE_EQUAL(rep->get_header("Content-Range"), "bytes 1-3/7");
+        rep = get(disk, {{"If-None-Match", rep->get_header("ETag")}});
+        BOOST_REQUIRE_EQUAL(rep->_status, http::reply::status_type::not_modified);
+    });
+}
+
 SEASTAR_TEST_CASE(test_100_continue) {
     return seastar::async([] {
         loopback_connection_factory lcf(1);
@@ -1102,6 +1522,58 @@ SEASTAR_TEST_CASE(test_unparsable_request) {
     });
 }
 
+SEASTAR_TEST_CASE(test_pipelined_requests) {
+    // The first request is held until the handler of the second one ran,
+    // which only pipelining lets happen, and its reply still comes first
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        server.set_pipeline_depth(4);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+
+            output.write(sstring("GET /slow HTTP/1.1\r\nHost: test\r\n\r\n"
+                    "GET /fast HTTP/1.1\r\nHost: test\r\n\r\n"
+                    "GET /fast HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n")).get();
+            output.flush().get();
+            auto resp = util::read_entire_stream_contiguous(input).get();
+            auto slow = resp.find("slow reply");
+            auto fast = resp.find("fast reply");
+            BOOST_REQUIRE_NE(slow, sstring::npos);
+            BOOST_REQUIRE_NE(fast, sstring::npos);
+            BOOST_REQUIRE_LT(slow, fast);
+            BOOST_REQUIRE_NE(resp.find("fast reply", fast + 1), sstring::npos);
+
+            input.close().get();
+            output.close().get();
+        });
+
+        promise<> fast_handled;
+        server._routes.put(GET, "/slow", new function_handler([&fast_handled] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            return fast_handled.get_future().then([rep = std::move(rep)] () mutable {
+                rep->write_body("txt", sstring("slow reply"));
+                return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+            });
+        }, "txt"));
+        bool first = true;
+        server._routes.put(GET, "/fast", new function_handler([&fast_handled, &first] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            if (std::exchange(first, false)) {
+                fast_handled.set_value();
+            }
+            rep->write_body("txt", sstring("fast reply"));
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
 struct echo_handler : public handler_base {
     bool chunked_reply;
     echo_handler(bool chunked_reply_) : handler_base(), chunked_reply(chunked_reply_) {}
@@ -1404,13 +1876,248 @@ SEASTAR_TEST_CASE(test_stream_content_chunked) {
     return test_basic_content(true, true);
 }
 
-SEASTAR_TEST_CASE(test_not_implemented_encoding) {
+static future<> test_http2_content(bool streamed) {
+    return seastar::async([streamed] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        server.set_content_streaming(streamed);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lcf] {
+            auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf), 1,
+                    http::experimental::client::retry_requests::no, http::experimental::client::http2::yes);
+
+            fmt::print("Concurrent HTTP/2 requests test\n");
+            std::vector<int> ids(10);
+            std::iota(ids.begin(), ids.end(), 0);
+            parallel_for_each(ids, [&cln] (int id) {
+                auto req = http::request::make("GET", "test", "/test");
+                auto body = format("request {}", id);
+                req.write_body("txt", body);
+                return cln.make_request(std::move(req), [body] (const http::reply& resp, input_stream<char>&& in) {
+                    BOOST_REQUIRE_EQUAL(resp._version, "2.0");
+                    BOOST_REQUIRE_EQUAL(resp.content_length, body.size());
+                    return seastar::async([in = std::move(in), body] () mutable {
+                        BOOST_REQUIRE_EQUAL(util::read_entire_stream_contiguous(in).get(), body);
+                    });
+                }, http::reply::status_type::ok);
+            }).get();
+            // All of them shared the one connection
+            BOOST_REQUIRE_EQUAL(cln.connections_nr(), 1);
+
+            fmt::print("HTTP/2 request with body writer test\n");
+            auto req = http::request::make("GET", "test", "/test");
+            req.write_body("txt", [] (output_stream<char>&& out) {
+                return seastar::async([out = std::move(out)] () mutable {
+                    out.write(sstring("1234567890")).get();
+                    out.write(sstring("AB")).get();
+                    out.flush().get();
+                    out.close().get();
+                });
+            });
+            cln.make_request(std::move(req), [] (const http::reply& resp, input_stream<char>&& in) {
+                return seastar::async([in = std::move(in)] () mutable {
+                    BOOST_REQUIRE_EQUAL(util::read_entire_stream_contiguous(in).get(), sstring("1234567890AB"));
+                });
+            }, http::reply::status_type::ok).get();
+
+            cln.close().get();
+        });
+
+        if (streamed) {
+            server._routes.put(GET, "/test", new echo_stream_handler());
+        } else {
+            server._routes.put(GET, "/test", new echo_string_handler());
+        }
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_http2_string_content) {
+    return test_http2_content(false);
+}
+
+SEASTAR_TEST_CASE(test_http2_stream_content) {
+    return test_http2_content(true);
+}
+
+SEASTAR_TEST_CASE(test_compression_streams) {
+    return seastar::async([] {
+        sstring text;
+        for (int i = 0; i < 1000; i++) {
+            text += format("{{\"key\": {}, \"value\": \"some text\"}},", i);
+        }
+        for (auto enc : {http::content_encoding::gzip, http::content_encoding::deflate, http::content_encoding::zstd}) {
+            if (!http::is_supported(enc)) {
+                continue;
+            }
+            auto compressed = http::compress(enc, text, 3);
+            BOOST_REQUIRE_LT(compressed.size(), text.size() / 4);
+            auto in = http::make_decompressing_input_stream(net::as_input_stream(net::packet(compressed.data(), compressed.size())), enc);
+            BOOST_REQUIRE_EQUAL(util::read_entire_stream_contiguous(in).get(), text);
+
+            std::stringstream ss;
+            auto out = http::make_compressing_output_stream(output_stream<char>(memory_data_sink(ss), 1024), enc, 3);
+            for (size_t pos = 0; pos < text.size(); pos += 1000) {
+                out.write(text.data() + pos, std::min<size_t>(1000, text.size() - pos)).get();
+                out.flush().get();
+            }
+            out.close().get();
+            auto streamed = sstring(ss.str());
+            auto in2 = http::make_decompressing_input_stream(net::as_input_stream(net::packet(streamed.data(), streamed.size())), enc);
+            BOOST_REQUIRE_EQUAL(util::read_entire_stream_contiguous(in2).get(), text);
+
+            auto truncated = http::make_decompressing_input_stream(net::as_input_stream(net::packet(compressed.data(), compressed.size() / 2)), enc);
+            BOOST_REQUIRE_THROW(util::read_entire_stream_contiguous(truncated).get(), http::decompression_error);
+            auto limited = http::make_decompressing_input_stream(net::as_input_stream(net::packet(compressed.data(), compressed.size())), enc, 100);
+            BOOST_REQUIRE_THROW(util::read_entire_stream_contiguous(limited).get(), http::decompression_error);
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_decompression_bomb) {
+    return seastar::async([] {
+        // Inflates about a thousand times
+        sstring zeros(16 << 20, '\0');
+        constexpr size_t max_size = 1 << 20;
+        for (auto enc : {http::content_encoding::gzip, http::content_encoding::deflate, http::content_encoding::zstd}) {
+            if (!http::is_supported(enc)) {
+                continue;
+            }
+            auto compressed = http::compress(enc, zeros, 9);
+            // All of it at once, as one socket buffer
+            auto in = http::make_decompressing_input_stream(net::as_input_stream(net::packet(compressed.data(), compressed.size())), enc, max_size);
+            size_t got = 0;
+            try {
+                for (;;) {
+                    auto buf = in.read().get();
+                    BOOST_REQUIRE(!buf.empty());
+                    // Output comes in pieces, not all of the input's at once
+                    BOOST_REQUIRE_LE(buf.size(), 128u << 10);
+                    got += buf.size();
+                    BOOST_REQUIRE_LE(got, max_size);
+                }
+            } catch (http::decompression_error& e) {
+                BOOST_REQUIRE(e.too_large());
+            }
+            BOOST_REQUIRE_GE(got, max_size - (128 << 10));
+        }
+    });
+}
+
+BOOST_AUTO_TEST_CASE(test_negotiate_content_encoding) {
+    std::vector<http::content_encoding> offered = { http::content_encoding::gzip, http::content_encoding::deflate };
+    auto negotiate = [&] (std::string_view accept_encoding) {
+        return http::negotiate_content_encoding(accept_encoding, offered);
+    };
+    if (!http::is_supported(http::content_encoding::gzip)) {
+        BOOST_REQUIRE(!negotiate("gzip"));
+        return;
+    }
+    BOOST_REQUIRE(negotiate("gzip, deflate, br") == http::content_encoding::gzip);
+    BOOST_REQUIRE(negotiate("deflate;q=0.5, gzip;q=0.4") == http::content_encoding::deflate);
+    BOOST_REQUIRE(negotiate("*") == http::content_encoding::gzip);
+    BOOST_REQUIRE(negotiate("gzip;q=0, *;q=0.1") == http::content_encoding::deflate);
+    BOOST_REQUIRE(negotiate("X-GZIP") == http::content_encoding::gzip);
+    BOOST_REQUIRE(!negotiate("identity"));
+    BOOST_REQUIRE(!negotiate(""));
+    BOOST_REQUIRE(!negotiate("br"));
+}
+
+static future<> test_compressed_content(bool chunked_reply) {
+    return seastar::async([chunked_reply] {
+        if (!http::is_supported(http::content_encoding::gzip)) {
+            return;
+        }
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        server.set_compression(http::compression_config{.min_size = 16});
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lcf] {
+            auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf));
+            sstring body = "a compressible body, a compressible body, a compressible body";
+
+            fmt::print("Compressed request and reply test\n");
+            auto req = http::request::make("GET", "test", "/test");
+            req._headers["Accept-Encoding"] = "br;q=1, gzip;q=0.5";
+            req._headers["Content-Encoding"] = "gzip";
+            req.write_body("txt", http::compress(http::content_encoding::gzip, body, 6));
+            cln.make_request(std::move(req), [&body] (const http::reply& resp, input_stream<char>&& in) {
+                BOOST_REQUIRE_EQUAL(resp.get_header("Content-Encoding"), "gzip");
+                BOOST_REQUIRE_EQUAL(resp.get_header("Vary"), "Accept-Encoding");
+                return seastar::async([in = std::move(in), &body] () mutable {
+                    auto decompressed = http::make_decompressing_input_stream(std::move(in), http::content_encoding::gzip);
+                    BOOST_REQUIRE_EQUAL(util::read_entire_stream_contiguous(decompressed).get(), body);
+                });
+            }, http::reply::status_type::ok).get();
+
+            fmt::print("Reply to a client not accepting compression test\n");
+            req = http::request::make("GET", "test", "/test");
+            req.write_body("txt", body);
+            cln.make_request(std::move(req), [&body] (const http::reply& resp, input_stream<char>&& in) {
+                BOOST_REQUIRE_EQUAL(resp.get_header("Content-Encoding"), "");
+                return seastar::async([in = std::move(in), &body] () mutable {
+                    BOOST_REQUIRE_EQUAL(util::read_entire_stream_contiguous(in).get(), body);
+                });
+            }, http::reply::status_type::ok).get();
+
+            fmt::print("Unsupported request encoding test\n");
+            req = http::request::make("GET", "test", "/test");
+            req._headers["Content-Encoding"] = "compress";
+            req.write_body("txt", body);
+            cln.make_request(std::move(req), [] (const http::reply& resp, input_stream<char>&& in) {
+                return make_ready_future<>();
+            }, http::reply::status_type::unsupported_media_type).get();
+
+            cln.close().get();
+        });
+
+        server._routes.put(GET, "/test", new echo_string_handler(chunked_reply));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_compressed_string_content) {
+    return test_compressed_content(false);
+}
+
+SEASTAR_TEST_CASE(test_compressed_stream_content) {
+    return test_compressed_content(true);
+}
+
+SEASTAR_TEST_CASE(test_compressed_transfer_encoding) {
+    if (!http::is_supported(http::content_encoding::gzip)) {
+        return make_ready_future<>();
+    }
+    auto compressed = http::compress(http::content_encoding::gzip, "12345678901234521345", 6);
     return check_http_reply({
         "GET /test HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: gzip, chunked\r\n\r\n",
+        format("{:x}\r\n", compressed.size()) + compressed + "\r\n",
+        "0\r\n\r\n"
+    }, {"200 OK", "12345678901234521345"}, false, new echo_string_handler());
+}
+
+SEASTAR_TEST_CASE(test_http1_request_read_like_http2_preface) {
+    // Its first byte alone matches the HTTP/2 preface, and is still part
+    // of the HTTP/1 request once the rest does not
+    return check_http_reply({
+        "P",
+        "OST /test HTTP/1.1\r\nHost: test\r\nContent-Length: 4\r\n\r\nabcd",
+    }, {"HTTP/1.1 "}, false, new echo_string_handler());
+}
+
+SEASTAR_TEST_CASE(test_not_implemented_encoding) {
+    return check_http_reply({
+        "GET /test HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: compress, chunked\r\n\r\n",
         "a\r\n1234567890\r\n",
         "a\r\n1234521345\r\n",
         "0\r\n\r\n"
-    }, {"501 Not Implemented", "Encodings other than \"chunked\" are not implemented (received encoding: \"gzip, chunked\")"}, false, new echo_string_handler());
+    }, {"501 Not Implemented", "Encodings other than \"chunked\", after supported compressions, are not implemented (received encoding: \"compress, chunked\")"}, false, new echo_string_handler());
 }
 
 SEASTAR_TEST_CASE(test_full_chunk_format) {
@@ -0,0 +1,77 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+
+#include <seastar/core/internal/idle_poll_policy.hh>
+
+using namespace seastar::internal;
+using namespace std::chrono_literals;
+
+static void learn(idle_poll_policy& policy, idle_poll_policy::duration idle) {
+    for (int i = 0; i < 200; ++i) {
+        policy.record_idle(idle);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_fixed_policy) {
+    idle_poll_policy policy(200us, false, true);
+    learn(policy, 1s);
+    BOOST_REQUIRE(policy.decide(0us) == idle_action::spin);
+    BOOST_REQUIRE(policy.decide(200us) == idle_action::spin);
+    BOOST_REQUIRE(policy.decide(201us) == idle_action::sleep);
+}
+
+BOOST_AUTO_TEST_CASE(test_adaptive_policy_learns) {
+    idle_poll_policy policy(200us, true, true);
+    learn(policy, 20us);
+    BOOST_REQUIRE(policy.expected_idle() > 19us && policy.expected_idle() <= 20us);
+    BOOST_REQUIRE(policy.decide(0us) == idle_action::spin);
+    BOOST_REQUIRE(policy.decide(10us) == idle_action::spin);
+    BOOST_REQUIRE(policy.decide(30us) == idle_action::pause);
+    BOOST_REQUIRE(policy.decide(70us) == idle_action::pause);
+    BOOST_REQUIRE(policy.decide(90us) == idle_action::sleep);
+
+    // Work stops arriving within the window: sleep right away
+    learn(policy, 10ms);
+    BOOST_REQUIRE(policy.decide(0us) == idle_action::sleep);
+
+    // and back
+    learn(policy, 5us);
+    BOOST_REQUIRE(policy.decide(0us) == idle_action::spin);
+    BOOST_REQUIRE(policy.decide(8us) == idle_action::pause);
+    BOOST_REQUIRE(policy.decide(21us) == idle_action::sleep);
+}
+
+BOOST_AUTO_TEST_CASE(test_adaptive_policy_without_pause) {
+    idle_poll_policy policy(200us, true, false);
+    learn(policy, 20us);
+    BOOST_REQUIRE(policy.decide(30us) == idle_action::spin);
+    BOOST_REQUIRE(policy.decide(90us) == idle_action::sleep);
+}
+
+BOOST_AUTO_TEST_CASE(test_adaptive_policy_without_polling) {
+    idle_poll_policy no_poll(0us, true, true);
+    BOOST_REQUIRE(no_poll.decide(0us) == idle_action::sleep);
+}
@@ -34,6 +34,7 @@
 #include <seastar/core/internal/io_request.hh>
 #include <seastar/core/internal/io_sink.hh>
 #include <seastar/util/internal/iovec_utils.hh>
+#include <seastar/util/later.hh>
 
 using namespace seastar;
 
@@ -75,8 +76,8 @@ struct io_queue_for_tests {
     io_queue queue;
     timer<> kicker;
 
-    io_queue_for_tests()
-        : group(std::make_shared<io_group>(io_queue::config{0}, 1))
+    io_queue_for_tests(io_queue::config cfg = io_queue::config{0})
+        : group(std::make_shared<io_group>(std::move(cfg), 1))
         , sink()
         , queue(group, sink)
         , kicker([this] { kick(); })
@@ -93,6 +94,14 @@ struct io_queue_for_tests {
     future<size_t> queue_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
         return queue.queue_request(pc, dnl, std::move(req), intent, std::move(iovs));
     }
+
+    void update_model() {
+        queue.update_model();
+    }
+
+    double model_factor() const {
+        return group->_fgs[0].rate_factor();
+    }
 };
 
 internal::priority_class get_default_pc() {
@@ -119,6 +128,88 @@ SEASTAR_THREAD_TEST_CASE(test_basic_flow) {
     f.get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_adjacent_reads_merge) {
+    io_queue_for_tests tio;
+    char buf[3][512];
+    auto read_dnl = internal::io_direction_and_length(internal::io_direction_and_length::read_idx, sizeof(buf[0]));
+
+    std::vector<future<size_t>> futures;
+    for (unsigned i = 0; i < 3; i++) {
+        futures.push_back(tio.queue_request(get_default_pc(), read_dnl,
+                internal::io_request::make_read(0, i * sizeof(buf[0]), buf[i], sizeof(buf[i]), false), nullptr, {}));
+    }
+    // Not adjacent to the previous ones
+    futures.push_back(tio.queue_request(get_default_pc(), read_dnl,
+            internal::io_request::make_read(0, 16 * sizeof(buf[0]), buf[0], sizeof(buf[0]), false), nullptr, {}));
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    std::vector<internal::io_request::operation> ops;
+    tio.sink.drain([&ops] (const internal::io_request& rq, io_completion* desc) -> bool {
+        ops.push_back(rq.opcode());
+        if (rq.opcode() == internal::io_request::operation::readv) {
+            const auto& op = rq.as<internal::io_request::operation::readv>();
+            BOOST_REQUIRE_EQUAL(op.pos, 0);
+            BOOST_REQUIRE_EQUAL(op.iov_len, 3);
+            // A short read, ending in the middle of the second buffer
+            desc->complete_with(sizeof(buf[0]) * 3 / 2);
+        } else {
+            desc->complete_with(rq.as<internal::io_request::operation::read>().size);
+        }
+        return true;
+    });
+
+    BOOST_REQUIRE_EQUAL(ops.size(), 2);
+    BOOST_REQUIRE(ops[0] == internal::io_request::operation::readv);
+    BOOST_REQUIRE(ops[1] == internal::io_request::operation::read);
+    BOOST_REQUIRE_EQUAL(futures[0].get(), sizeof(buf[0]));
+    BOOST_REQUIRE_EQUAL(futures[1].get(), sizeof(buf[0]) / 2);
+    BOOST_REQUIRE_EQUAL(futures[2].get(), 0);
+    BOOST_REQUIRE_EQUAL(futures[3].get(), sizeof(buf[0]));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_disk_model_calibration) {
+    io_queue::config cfg{0};
+    cfg.model_factor_min = 0.5;
+    cfg.model_factor_max = 2.0;
+    io_queue_for_tests tio(cfg);
+    fake_file file;
+
+    auto complete_slowly = [&] {
+        std::vector<int> values(32);
+        std::vector<future<size_t>> futures;
+        for (unsigned i = 0; i < values.size(); i++) {
+            futures.push_back(tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 0),
+                    file.make_write_req(i, &values[i]), nullptr, {}));
+        }
+        auto done = when_all_succeed(futures.begin(), futures.end());
+        while (!done.available()) {
+            tio.kick();
+            tio.queue.poll_io_queue();
+            // Complete everything way past the latency goal
+            seastar::sleep(std::chrono::duration_cast<std::chrono::microseconds>(tio.group->io_latency_goal() * 10)).get();
+            tio.sink.drain([&file] (const internal::io_request& rq, io_completion* desc) -> bool {
+                file.execute_write_req(rq, desc);
+                return true;
+            });
+            yield().get();
+        }
+        done.get();
+    };
+
+    BOOST_REQUIRE_EQUAL(tio.model_factor(), 1.0);
+    complete_slowly();
+    tio.update_model();
+    BOOST_REQUIRE_LT(tio.model_factor(), 1.0);
+
+    // Never below the lower bound
+    for (int i = 0; i < 50; i++) {
+        complete_slowly();
+        tio.update_model();
+    }
+    BOOST_REQUIRE_EQUAL(tio.model_factor(), 0.5);
+}
+
 enum class part_flaw { none, partial, error };
 
 static void do_test_large_request_flow(part_flaw flaw) {
@@ -324,6 +415,37 @@ SEASTAR_THREAD_TEST_CASE(test_io_cancellation) {
     when_all_succeed(finished.begin(), finished.end()).get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_io_cancellation_in_flight) {
+    fake_file file;
+    io_queue_for_tests tio;
+
+    auto vals = std::make_unique<int[]>(2);
+    io_intent intent;
+    auto f0 = tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 0), file.make_write_req(0, &vals[0]), &intent, {});
+    auto f1 = tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 0), file.make_write_req(1, &vals[1]), &intent, {});
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    std::vector<io_completion*> in_flight;
+    tio.sink.drain([&in_flight] (const internal::io_request& rq, io_completion* desc) -> bool {
+        in_flight.push_back(desc);
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(in_flight.size(), 2);
+
+    // Requests already dispatched are cancelled in the kernel (where it can)
+    // and only resolve when it completes them, the one it cancelled into
+    // cancelled_error, the one that it was too late for as usual
+    intent.cancel();
+    BOOST_REQUIRE(!f0.available());
+    BOOST_REQUIRE(!f1.available());
+
+    in_flight[0]->complete_with(-ECANCELED);
+    in_flight[1]->complete_with(1);
+    BOOST_REQUIRE_THROW(f0.get(), cancelled_error);
+    BOOST_REQUIRE_EQUAL(f1.get(), 1);
+}
+
 SEASTAR_TEST_CASE(test_request_buffer_split) {
     auto ensure = [] (const std::vector<internal::io_request::part>& parts, const internal::io_request& req, int idx, uint64_t pos, size_t size, uintptr_t mem) {
         BOOST_REQUIRE(parts[idx].req.opcode() == req.opcode());
@@ -0,0 +1,135 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <vector>
+
+#include <seastar/net/ip_checksum.hh>
+
+using namespace seastar;
+using namespace seastar::net;
+using seastar::internal::checksum_isa;
+
+namespace {
+
+constexpr checksum_isa vector_isas[] = {
+    checksum_isa::sse2,
+    checksum_isa::avx2,
+    checksum_isa::avx512,
+    checksum_isa::neon,
+};
+
+std::vector<char> random_bytes(size_t len, std::mt19937& rng) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<char> data(len);
+    for (auto& c : data) {
+        c = char(byte(rng));
+    }
+    return data;
+}
+
+// The checksum of data, summed in pieces of the given size
+uint16_t checksum_in_pieces(const std::vector<char>& data, size_t piece) {
+    checksummer csum;
+    for (size_t i = 0; i < data.size(); i += piece) {
+        csum.sum(data.data() + i, std::min(piece, data.size() - i));
+    }
+    return csum.get();
+}
+
+struct restore_isa {
+    ~restore_isa() {
+        // Back to the default, the best one supported
+        for (auto isa : {checksum_isa::avx512, checksum_isa::avx2, checksum_isa::sse2, checksum_isa::neon}) {
+            if (seastar::internal::use_checksum_isa(isa)) {
+                break;
+            }
+        }
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_known_checksum) {
+    // A commonly used example IPv4 header, with its checksum zeroed
+    const unsigned char hdr[] = {
+        0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+        0x00, 0x00, 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7,
+    };
+    BOOST_REQUIRE_EQUAL(ntohs(ip_checksum(hdr, sizeof(hdr))), 0xb861);
+}
+
+BOOST_AUTO_TEST_CASE(test_vector_kernels_match_scalar) {
+    restore_isa restore;
+    std::mt19937 rng(0);
+    const size_t lens[] = {0, 1, 63, 64, 127, 128, 129, 200, 1499, 1500, 4096, 9001, 65535};
+    const size_t pieces[] = {1, 3, 64, 129, 1000, 1 << 20};
+    for (auto len : lens) {
+        auto data = random_bytes(len + 1, rng);
+        for (size_t offset : {0, 1}) {
+            std::vector<char> d(data.begin() + offset, data.begin() + offset + len);
+            BOOST_REQUIRE(seastar::internal::use_checksum_isa(checksum_isa::scalar));
+            auto expected = ip_checksum(d.data(), d.size());
+            std::vector<uint16_t> expected_pieces;
+            for (auto piece : pieces) {
+                expected_pieces.push_back(checksum_in_pieces(d, piece));
+                BOOST_REQUIRE_EQUAL(expected_pieces.back(), expected);
+            }
+            for (auto isa : vector_isas) {
+                if (!seastar::internal::use_checksum_isa(isa)) {
+                    continue;
+                }
+                BOOST_TEST_INFO("isa " << int(isa) << " len " << len << " offset " << offset);
+                BOOST_REQUIRE_EQUAL(ip_checksum(d.data(), d.size()), expected);
+                for (auto piece : pieces) {
+                    BOOST_REQUIRE_EQUAL(checksum_in_pieces(d, piece), expected);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_vector_kernels_edge_values) {
+    restore_isa restore;
+    // All zeros, all ones, and data summing to a multiple of 0xffff, where
+    // the representation of a zero sum matters
+    std::vector<std::vector<char>> inputs;
+    inputs.emplace_back(4096, '\0');
+    inputs.emplace_back(4096, '\xff');
+    std::vector<char> cancel(4096, '\0');
+    cancel[1000] = '\x12';
+    cancel[1001] = '\x34';
+    cancel[3000] = '\xed';
+    cancel[3001] = '\xcb';
+    inputs.push_back(cancel);
+    for (auto& d : inputs) {
+        BOOST_REQUIRE(seastar::internal::use_checksum_isa(checksum_isa::scalar));
+        auto expected = ip_checksum(d.data(), d.size());
+        for (auto isa : vector_isas) {
+            if (seastar::internal::use_checksum_isa(isa)) {
+                BOOST_REQUIRE_EQUAL(ip_checksum(d.data(), d.size()), expected);
+            }
+        }
+    }
+}
@@ -27,6 +27,7 @@
 #include <seastar/core/vector-data-sink.hh>
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/json/writer.hh>
 #include <seastar/testing/thread_test_case.hh>
 
 using namespace seastar;
@@ -115,3 +116,78 @@ SEASTAR_THREAD_TEST_CASE(test_stream_range_as_array) {
     sstring expected = "[{\"subject\":\"1\",\"values\":[1]}, {\"subject\":\"2\",\"values\":[2]}, {\"subject\":\"3\",\"values\":[3]}]";
     BOOST_CHECK_EQUAL(expected, result);
 }
+
+static sstring written(std::vector<net::packet>& vec) {
+    auto packets = net::packet{};
+    for (auto &p : vec) {
+      packets.append(std::move(p));
+    }
+    packets.linearize();
+    auto buf = packets.release();
+    return buf.empty() ? sstring() : sstring(buf.front().get(), buf.front().size());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_writer) {
+    auto vec = std::vector<net::packet>{};
+    auto out = output_stream<char>(data_sink(std::make_unique<vector_data_sink>(vec)), 8);
+
+    object_json obj;
+    obj.subject = "foo";
+    obj.values.push(1);
+    obj.values.push(2);
+
+    writer w(out, 16);
+    w.begin_object();
+    w.key("int").value(-3);
+    w.key("double").value(3.5);
+    w.key("bool").value(true);
+    w.key("str").value("a\"b\\c\n");
+    w.key("list").value(std::vector<int>{1, 2, 3});
+    w.key("map").value(std::map<int, int>({{1, 2}, {3, 4}}));
+    w.key("pairs").value(std::vector<std::pair<int, int>>({{1, 2}, {3, 4}}));
+    w.key("obj").value(obj);
+    w.key("raw").raw("null");
+    w.key("empty").begin_array().begin_object().end_object().end_array();
+    w.end_object();
+    BOOST_REQUIRE_GT(w.buffered(), 16);
+    w.maybe_flush().get();
+    BOOST_REQUIRE_EQUAL(w.buffered(), 0);
+    w.maybe_flush().get();
+    out.close().get();
+
+    BOOST_CHECK_EQUAL(written(vec), "{\"int\":-3,\"double\":3.5,\"bool\":true,\"str\":\"a\\\"b\\\\c\\n\","
+            "\"list\":[1,2,3],\"map\":{1:2,3:4},\"pairs\":[{1:2},{3:4}],"
+            "\"obj\":{\"subject\":\"foo\",\"values\":[1,2]},\"raw\":null,\"empty\":[{}]}");
+
+    BOOST_CHECK_THROW(w.value(std::numeric_limits<double>::infinity()), std::out_of_range);
+    BOOST_CHECK_THROW(w.value(std::nanf("")), std::invalid_argument);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_writer_escapes_as_formatter) {
+    // Escapes at every position of the vectors, and strings longer than
+    // the pieces the writer escapes at a time
+    std::vector<sstring> strs;
+    for (size_t size : {0, 1, 15, 16, 17, 33, 5000}) {
+        for (size_t pos = 0; pos <= std::min<size_t>(size, 40); ++pos) {
+            for (char c : {'"', '\\', '\n', '\x01', '\x1f', '\x7f', '\x80', ' '}) {
+                sstring s(size, 'x');
+                if (pos < size) {
+                    s[pos] = c;
+                }
+                strs.push_back(std::move(s));
+            }
+        }
+    }
+    sstring all(5000, '\x1a');
+    strs.push_back(all);
+
+    for (auto& s : strs) {
+        auto vec = std::vector<net::packet>{};
+        auto out = output_stream<char>(data_sink(std::make_unique<vector_data_sink>(vec)), 8);
+        writer w(out);
+        w.value(s);
+        w.flush().get();
+        out.close().get();
+        BOOST_REQUIRE_EQUAL(written(vec), formatter::to_json(s));
+    }
+}
@@ -59,6 +59,44 @@ SEASTAR_THREAD_TEST_CASE(test_rwlock) {
     l.for_write().unlock();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_rwlock_optimistic_read) {
+    rwlock l;
+
+    auto v = l.optimistic_read_begin();
+    BOOST_REQUIRE(v);
+    BOOST_REQUIRE(l.optimistic_read_validate(*v));
+    l.for_read().lock().get();
+    BOOST_REQUIRE(l.optimistic_read_begin());
+    BOOST_REQUIRE(l.optimistic_read_validate(*v));
+    l.for_read().unlock();
+
+    l.for_write().lock().get();
+    BOOST_REQUIRE(!l.optimistic_read_begin());
+    BOOST_REQUIRE(!l.optimistic_read_validate(*v));
+    l.for_write().unlock();
+    BOOST_REQUIRE(!l.optimistic_read_validate(*v));
+
+    int value = 1;
+    unsigned runs = 0;
+    BOOST_REQUIRE_EQUAL(l.with_optimistic_read([&] { ++runs; return value; }).get(), 1);
+    BOOST_REQUIRE_EQUAL(runs, 1u);
+
+    // A writer comes in while the reader sleeps, which reads again under the lock
+    auto read = l.with_optimistic_read([&] {
+        ++runs;
+        auto seen = value;
+        return sleep(2ms).then([seen] { return seen; });
+    });
+    auto write = with_lock(l.for_write(), [&] {
+        value = 2;
+        return sleep(1ms);
+    });
+    BOOST_REQUIRE_EQUAL(read.get(), 2);
+    BOOST_REQUIRE_EQUAL(runs, 3u);
+    write.get();
+    BOOST_REQUIRE(!l.locked());
+}
+
 SEASTAR_TEST_CASE(test_with_lock_mutable) {
     return do_with(rwlock(), [](rwlock& l) {
         return with_lock(l.for_read(), [p = std::make_unique<int>(42)] () mutable {});
@@ -21,6 +21,8 @@
 
 #include <seastar/testing/test_case.hh>
 #include <seastar/util/log.hh>
+#include <iostream>
+#include <sstream>
 
 using namespace seastar;
 
@@ -120,3 +122,50 @@ SEASTAR_TEST_CASE(log_buf_clear) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(async_log_drops_and_flushes) {
+    std::ostringstream out;
+    logger::set_ostream(out);
+    // Small enough for a burst to overflow it
+    logger::set_async(4096);
+    logger l("async_log_test");
+    constexpr unsigned nr_messages = 1000;
+    for (unsigned i = 0; i < nr_messages; ++i) {
+        l.info("message {}", i);
+    }
+    auto dropped = logger::async_dropped_messages();
+    // Writes what is left
+    logger::set_async(0);
+    logger::set_ostream(std::cerr);
+
+    auto log = out.str();
+    unsigned written = 0;
+    for (size_t pos = 0; (pos = log.find("async_log_test - message ", pos)) != std::string::npos; ++pos) {
+        ++written;
+    }
+    BOOST_REQUIRE_EQUAL(written + dropped, nr_messages);
+    BOOST_REQUIRE_NE(log.find("async_log_test - message 0\n"), std::string::npos);
+    if (dropped) {
+        BOOST_REQUIRE_NE(log.find(" log messages of shard "), std::string::npos);
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(async_log_defers_formatting) {
+    std::ostringstream out;
+    logger::set_ostream(out);
+    logger::set_async(1 << 20, true);
+    logger l("deferred_log_test");
+    sstring name = "shard";
+    l.info("ints {} {:>4} {:#x}", 1, uint8_t(2), 255ul);
+    l.info("strings {} {} {:.3}", name, "literal", std::string_view("view"));
+    l.info("floats {:.2f} {}", 3.14159, true);
+    logger::set_async(0);
+    logger::set_ostream(std::cerr);
+
+    auto log = out.str();
+    BOOST_REQUIRE_NE(log.find("deferred_log_test - ints 1    2 0xff\n"), std::string::npos);
+    BOOST_REQUIRE_NE(log.find("deferred_log_test - strings shard literal vie\n"), std::string::npos);
+    BOOST_REQUIRE_NE(log.find("deferred_log_test - floats 3.14 true\n"), std::string::npos);
+    return make_ready_future<>();
+}
@@ -32,6 +32,7 @@
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/metrics_histogram.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
@@ -384,6 +385,47 @@ SEASTAR_THREAD_TEST_CASE(test_relabel_enable_disable_skip_when_empty) {
     sm::set_relabel_configs({}).get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_metrics_label_interning) {
+    namespace sm = seastar::metrics;
+    auto before = sm::impl::interned_label_sets();
+    sm::metric_groups app_metrics;
+    app_metrics.add_group("test_intern", {
+        sm::make_gauge("gauge_1", sm::description("gauge 1"), { sm::label_instance("intern", "1")}, [] { return 1; }),
+        sm::make_gauge("gauge_2", sm::description("gauge 2"), { sm::label_instance("intern", "1")}, [] { return 2; }),
+        sm::make_gauge("gauge_3", sm::description("gauge 3"), { sm::label_instance("intern", "3")}, [] { return 3; })
+    });
+    // The two sets of labels (each also holding the shard label) are stored once
+    BOOST_CHECK_EQUAL(sm::impl::interned_label_sets(), before + 2);
+
+    auto count_family = [] (const seastar::sstring& name) {
+        auto values = sm::impl::get_values();
+        for (auto&& mf : *values->metadata) {
+            if (mf.mf.name == name) {
+                return mf.metrics.size();
+            }
+        }
+        return size_t(0);
+    };
+    BOOST_CHECK_EQUAL(count_family("test_intern_gauge_1"), 1);
+
+    // Rebuilding the metadata after another registration keeps the
+    // families which did not change
+    sm::metric_groups more_metrics;
+    more_metrics.add_group("test_intern", {
+        sm::make_gauge("gauge_4", sm::description("gauge 4"), { sm::label_instance("intern", "1")}, [] { return 4; })
+    });
+    BOOST_CHECK_EQUAL(sm::impl::interned_label_sets(), before + 2);
+    BOOST_CHECK_EQUAL(count_family("test_intern_gauge_1"), 1);
+    BOOST_CHECK_EQUAL(count_family("test_intern_gauge_3"), 1);
+    BOOST_CHECK_EQUAL(count_family("test_intern_gauge_4"), 1);
+
+    more_metrics.clear();
+    BOOST_CHECK_EQUAL(count_family("test_intern_gauge_4"), 0);
+    BOOST_CHECK_EQUAL(count_family("test_intern_gauge_1"), 1);
+    app_metrics.clear();
+    BOOST_CHECK_EQUAL(sm::impl::interned_label_sets(), before);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_estimated_histogram) {
     using namespace seastar::metrics;
     using namespace std::chrono_literals;
@@ -441,3 +483,63 @@ SEASTAR_THREAD_TEST_CASE(test_estimated_histogram) {
         BOOST_CHECK_EQUAL(mh.buckets[i].count, 33 + i);
     }
 }
+
+SEASTAR_THREAD_TEST_CASE(test_log_linear_histogram) {
+    using namespace seastar::metrics;
+    using namespace std::chrono_literals;
+    log_linear_histogram<128, 1024, 4> h;
+    // The buckets: up to 160, 192, 224, 256, 320, ... 896, 1024, +Inf
+    h.record(100);
+    h.record(300);
+    h.record(330);
+    h.record(2000);
+    h.record(1ms);
+    BOOST_CHECK_EQUAL(h.count(), 5);
+    BOOST_CHECK_EQUAL(h.sum(), 100 + 300 + 330 + 2000 + 1000);
+
+    auto mh = h.to_metrics_histogram();
+    BOOST_REQUIRE_EQUAL(mh.buckets.size(), 12);
+    BOOST_CHECK_EQUAL(mh.sample_count, 5);
+    BOOST_CHECK_EQUAL(mh.sample_sum, h.sum());
+    BOOST_CHECK_EQUAL(mh.buckets[0].upper_bound, 160);
+    BOOST_CHECK_EQUAL(mh.buckets[0].count, 1);
+    // 300 in [256, 320), 330 in [320, 384)
+    BOOST_CHECK_EQUAL(mh.buckets[3].count, 1);
+    BOOST_CHECK_EQUAL(mh.buckets[4].count, 2);
+    BOOST_CHECK_EQUAL(mh.buckets[5].count, 3);
+    // 1000 in [896, 1024), 2000 above
+    BOOST_CHECK_EQUAL(mh.buckets[11].count, 4);
+    BOOST_REQUIRE(mh.native_histogram);
+    BOOST_CHECK_EQUAL(mh.native_histogram->schema, 2);
+
+    // As the metrics of the shards are summed
+    log_linear_histogram<128, 1024, 4> other;
+    other.record(300);
+    histogram empty;
+    empty += mh;
+    empty += other.to_metrics_histogram();
+    BOOST_CHECK_EQUAL(empty.sample_count, 6);
+    BOOST_CHECK_EQUAL(empty.buckets[4].count, 3);
+    BOOST_REQUIRE(empty.native_histogram);
+
+    h.merge(other);
+    BOOST_CHECK_EQUAL(h.count(), 6);
+    h.clear();
+    BOOST_CHECK_EQUAL(h.count(), 0);
+    BOOST_CHECK_EQUAL(h.sum(), 0);
+
+    seastar::metrics::metric_groups metrics;
+    metrics.add_group("log_linear", {
+        make_histogram("latency", description("latency"), h),
+    });
+    h.record(200);
+    auto values = seastar::metrics::impl::get_values();
+    bool found = false;
+    for (size_t i = 0; i < values->metadata->size(); ++i) {
+        if ((*values->metadata)[i].mf.name == "log_linear_latency") {
+            BOOST_CHECK_EQUAL(values->values[i][0].get_histogram().sample_count, 1);
+            found = true;
+        }
+    }
+    BOOST_REQUIRE(found);
+}
@@ -60,13 +60,13 @@ struct payload {
 template <size_t Extra>
 unsigned payload<Extra>::live;
 
-template <size_t Extra>
+template <size_t Extra, size_t InlineSize = 32>
 void do_move_tests() {
     using payload = ::payload<Extra>;
-    auto f1 = noncopyable_function<int ()>(payload(3));
+    auto f1 = noncopyable_function<int (), InlineSize>(payload(3));
     BOOST_REQUIRE_EQUAL(payload::live, 1u);
     BOOST_REQUIRE_EQUAL(f1(), 3);
-    auto f2 = noncopyable_function<int ()>();
+    auto f2 = noncopyable_function<int (), InlineSize>();
     BOOST_CHECK_THROW(f2(), std::bad_function_call);
     f2 = std::move(f1);
     BOOST_CHECK_THROW(f1(), std::bad_function_call);
@@ -85,3 +85,21 @@ BOOST_AUTO_TEST_CASE(large_move_tests) {
     do_move_tests<1000>();
 }
 
+
+BOOST_AUTO_TEST_CASE(inline_size_move_tests) {
+    do_move_tests<40, 64>();
+    do_move_tests<1000, 64>();
+}
+
+BOOST_AUTO_TEST_CASE(heap_captures) {
+    auto& heap_captures = internal::noncopyable_function_heap_captures;
+    auto before = heap_captures;
+    std::array<char, 48> capture{};
+    auto f1 = noncopyable_function<size_t (), 64>([capture] { return capture.size(); });
+    BOOST_REQUIRE(heap_captures == before);
+    auto f2 = noncopyable_function<size_t ()>([capture] { return capture.size(); });
+    BOOST_REQUIRE_EQUAL(heap_captures[std::bit_width(sizeof(capture))], before[std::bit_width(sizeof(capture))] + 1);
+    BOOST_REQUIRE_EQUAL(f1(), f2());
+    auto f3 = noncopyable_function<size_t (), 64>(std::move(f2));
+    BOOST_REQUIRE_EQUAL(f3(), capture.size());
+}
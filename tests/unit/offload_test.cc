@@ -0,0 +1,79 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#include <seastar/core/offload.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Runs with --offload-shards 1 --offload-queue-depth 2
+
+SEASTAR_THREAD_TEST_CASE(test_offload_runs_on_offload_shard) {
+    if (smp::count < 2) {
+        return;
+    }
+    BOOST_REQUIRE_EQUAL(offload_shard_count(), 1);
+    BOOST_REQUIRE(is_offload_shard(smp::count - 1));
+    BOOST_REQUIRE(!is_offload_shard(0));
+
+    auto sg = create_scheduling_group("offloaded", 100).get();
+    auto [shard, group] = offload(sg, [] {
+        return std::make_pair(this_shard_id(), current_scheduling_group());
+    }).get();
+    BOOST_REQUIRE_EQUAL(shard, smp::count - 1);
+    BOOST_REQUIRE(group == sg);
+
+    BOOST_REQUIRE_THROW(offload(sg, [] () -> int { throw std::runtime_error("oops"); }).get(), std::runtime_error);
+
+    // From the offload shard itself, work runs in place
+    auto inner = smp::submit_to(smp::count - 1, [sg] {
+        return offload(sg, [] { return this_shard_id(); });
+    }).get();
+    BOOST_REQUIRE_EQUAL(inner, smp::count - 1);
+    destroy_scheduling_group(sg).get();
+}
+
+static thread_local unsigned running = 0;
+static thread_local unsigned most_running = 0;
+
+SEASTAR_THREAD_TEST_CASE(test_offload_backpressure) {
+    if (smp::count < 2) {
+        return;
+    }
+    std::vector<future<>> results;
+    for (int i = 0; i < 10; ++i) {
+        results.push_back(offload(default_scheduling_group(), [] {
+            most_running = std::max(most_running, ++running);
+            return sleep(1ms).finally([] { --running; });
+        }));
+    }
+    when_all_succeed(results.begin(), results.end()).get();
+    auto most = smp::submit_to(smp::count - 1, [] { return most_running; }).get();
+    BOOST_REQUIRE_EQUAL(most, 2);
+}
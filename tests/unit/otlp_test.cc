@@ -0,0 +1,179 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/metrics.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/otlp.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/http/client.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include "loopback_socket.hh"
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+using namespace seastar;
+
+namespace {
+
+class loopback_http_factory : public http::experimental::connection_factory {
+    loopback_socket_impl lsi;
+public:
+    explicit loopback_http_factory(loopback_connection_factory& f) : lsi(f) {}
+    virtual future<connected_socket> make() override {
+        return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+    }
+};
+
+class collector : public httpd::handler_base {
+public:
+    std::vector<sstring> requests;
+    virtual future<std::unique_ptr<http::reply>> handle(const sstring& path,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override {
+        BOOST_REQUIRE_EQUAL(req->get_header("Content-Type"), "application/x-protobuf");
+        requests.push_back(req->content);
+        rep->done();
+        return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+    }
+};
+
+// A protobuf field: a varint or fixed64 value, or the bytes of a nested
+// message
+struct proto_field {
+    uint32_t number;
+    uint64_t value = 0;
+    std::string_view bytes;
+};
+
+uint64_t read_varint(std::string_view& m) {
+    uint64_t v = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+        BOOST_REQUIRE(!m.empty());
+        auto b = uint8_t(m.front());
+        m.remove_prefix(1);
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+    }
+}
+
+std::vector<proto_field> parse(std::string_view m) {
+    std::vector<proto_field> fields;
+    while (!m.empty()) {
+        auto tag = read_varint(m);
+        proto_field f{uint32_t(tag >> 3)};
+        switch (tag & 7) {
+        case 0:
+            f.value = read_varint(m);
+            break;
+        case 1:
+            BOOST_REQUIRE_GE(m.size(), 8);
+            std::memcpy(&f.value, m.data(), 8);
+            m.remove_prefix(8);
+            break;
+        case 2: {
+            auto size = read_varint(m);
+            BOOST_REQUIRE_GE(m.size(), size);
+            f.bytes = m.substr(0, size);
+            m.remove_prefix(size);
+            break;
+        }
+        default:
+            BOOST_FAIL("unexpected wire type");
+        }
+        fields.push_back(f);
+    }
+    return fields;
+}
+
+std::optional<proto_field> find(std::string_view m, uint32_t number) {
+    for (auto& f : parse(m)) {
+        if (f.number == number) {
+            return f;
+        }
+    }
+    return std::nullopt;
+}
+
+// The Sum of the metric of that name in an ExportMetricsServiceRequest
+std::optional<std::string_view> find_sum(std::string_view request, std::string_view name) {
+    auto resource_metrics = find(request, 1);
+    BOOST_REQUIRE(resource_metrics);
+    auto scope_metrics = find(resource_metrics->bytes, 2);
+    BOOST_REQUIRE(scope_metrics);
+    for (auto& metric : parse(scope_metrics->bytes)) {
+        if (metric.number == 2 && find(metric.bytes, 1)->bytes == name) {
+            auto sum = find(metric.bytes, 7);
+            BOOST_REQUIRE(sum);
+            return sum->bytes;
+        }
+    }
+    return std::nullopt;
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_otlp_push_deltas) {
+    loopback_connection_factory lcf(1);
+    httpd::http_server server("collector");
+    httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+    auto handler = new collector;
+    server._routes.put(httpd::POST, "/v1/metrics", handler);
+    server.do_accepts(0).get();
+
+    uint64_t requests = 0;
+    metrics::metric_groups metrics;
+    metrics.add_group("otlp_test", {
+        metrics::make_counter("requests", requests, metrics::description("Requests served")),
+    });
+
+    otlp::config cfg;
+    cfg.host = "collector";
+    cfg.temporality = otlp::temporality::delta;
+    otlp::exporter exporter(cfg, std::make_unique<loopback_http_factory>(lcf));
+    exporter.start().get();
+    requests = 5;
+    exporter.push().get();
+    requests = 8;
+    exporter.push().get();
+    exporter.stop().get();
+    server.stop().get();
+
+    BOOST_REQUIRE_EQUAL(handler->requests.size(), 2);
+    std::vector<uint64_t> values;
+    for (auto& request : handler->requests) {
+        auto sum = find_sum(request, "seastar_otlp_test_requests");
+        BOOST_REQUIRE(sum);
+        // Delta, monotonic
+        BOOST_REQUIRE_EQUAL(find(*sum, 2)->value, 1);
+        BOOST_REQUIRE_EQUAL(find(*sum, 3)->value, 1);
+        auto point = find(*sum, 1);
+        BOOST_REQUIRE(point);
+        values.push_back(find(point->bytes, 6)->value);
+        BOOST_REQUIRE_LT(find(point->bytes, 2)->value, find(point->bytes, 3)->value);
+    }
+    BOOST_REQUIRE_EQUAL(values[0], 5);
+    BOOST_REQUIRE_EQUAL(values[1], 3);
+}
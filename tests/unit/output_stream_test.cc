@@ -25,9 +25,11 @@
 #include <seastar/core/loop.hh>
 #include <seastar/util/later.hh>
 #include <seastar/core/sstring.hh>
+#include <seastar/core/print.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
+#include <cstring>
 #include <vector>
 
 using namespace seastar;
@@ -157,3 +159,84 @@ SEASTAR_THREAD_TEST_CASE(test_simple_write) {
     BOOST_REQUIRE_EQUAL(buf.size(), 1);
     BOOST_REQUIRE_EQUAL(sstring(buf.front().get(), buf.front().size()), value);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_cork) {
+    auto vec = std::vector<net::packet>{};
+    auto out = output_stream<char>(data_sink(std::make_unique<vector_data_sink>(vec)), 4);
+
+    out.cork();
+    out.write("12").get();
+    out.write("345").get();
+    out.write("6789").get();
+    out.flush().get();
+    BOOST_REQUIRE(vec.empty());
+
+    out.write("ab").get();
+    out.uncork().get();
+    BOOST_REQUIRE_EQUAL(vec.size(), 1);
+    BOOST_REQUIRE(to_sstring(vec[0]) == "123456789ab");
+
+    out.write("cd").get();
+    out.flush().get();
+    BOOST_REQUIRE_EQUAL(vec.size(), 2);
+    BOOST_REQUIRE(to_sstring(vec[1]) == "cd");
+    out.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cork_zero_copy) {
+    auto vec = std::vector<net::packet>{};
+    auto out = output_stream<char>(data_sink(std::make_unique<vector_data_sink>(vec)), 16);
+    auto zc = [] (const char* s) {
+        return net::packet(temporary_buffer<char>(s, std::strlen(s)));
+    };
+
+    // Zero-copy writes are held back with the buffered ones, in order
+    out.write(zc("zz")).get();
+    out.cork();
+    out.write("12").get();
+    out.write(zc("ZZZ")).get();
+    out.write("34").get();
+    out.flush().get();
+    BOOST_REQUIRE(vec.empty());
+    out.uncork().get();
+    BOOST_REQUIRE_EQUAL(vec.size(), 1);
+    BOOST_REQUIRE(to_sstring(vec[0]) == "zz12ZZZ34");
+
+    // Put early, in order, past max_corked_buffers
+    sstring expected;
+    out.cork();
+    for (int i = 0; i < 200; i++) {
+        auto s = seastar::format("{:03}", i);
+        expected += s;
+        if (i % 2) {
+            out.write(zc(s.c_str())).get();
+        } else {
+            out.write(s).get();
+        }
+    }
+    BOOST_REQUIRE_GT(vec.size(), 1u);
+    out.uncork().get();
+    sstring got;
+    for (auto i = vec.begin() + 1; i != vec.end(); ++i) {
+        got += to_sstring(*i);
+    }
+    BOOST_REQUIRE(got == expected);
+    out.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_write_formatted) {
+    auto vec = std::vector<net::packet>{};
+    auto out = output_stream<char>(data_sink(std::make_unique<vector_data_sink>(vec)), 8);
+
+    out.write_formatted("{}-{}", 12, "ab").get();
+    out.write_formatted("{:>6}", 7).get();
+    out.write("x").get();
+    out.write_formatted("{}", std::string(20, 'y')).get();
+    out.close().get();
+
+    auto packets = net::packet{};
+    for (auto& p : vec) {
+        packets.append(std::move(p));
+    }
+    BOOST_REQUIRE_EQUAL(to_sstring(packets), "12-ab     7x" + sstring(20, 'y'));
+}
@@ -49,3 +49,22 @@ SEASTAR_THREAD_TEST_CASE(simple_pipe_test) {
     BOOST_CHECK(f2.available());
     BOOST_REQUIRE_EQUAL(*f2.get(), 42);
 }
+
+SEASTAR_THREAD_TEST_CASE(batch_pipe_test) {
+    seastar::pipe<int> p(3);
+
+    auto f0 = p.reader.read_batch(10);
+    BOOST_CHECK(!f0.available());
+    auto w = p.writer.write_batch({1, 2, 3, 4, 5});
+    BOOST_REQUIRE(f0.get() == (std::vector<int>{1, 2, 3}));
+    w.get();
+    BOOST_REQUIRE(p.reader.read_batch(1).get() == std::vector<int>{4});
+    p.reader.unread(17);
+    BOOST_REQUIRE(p.reader.read_batch(10).get() == std::vector<int>{17});
+    BOOST_REQUIRE(p.reader.read_batch(10).get() == std::vector<int>{5});
+
+    {
+        auto writer = std::move(p.writer);
+    }
+    BOOST_REQUIRE(p.reader.read_batch(10).get().empty());
+}
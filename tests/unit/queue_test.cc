@@ -161,3 +161,36 @@ SEASTAR_TEST_CASE(test_queue_push_abort) {
         done.get();
     });
 }
+
+SEASTAR_THREAD_TEST_CASE(test_queue_batch) {
+    queue<int> q(4);
+    std::vector<int> items{1, 2, 3, 4, 5, 6};
+    auto it = q.push_batch(items.begin(), items.end());
+    BOOST_REQUIRE(it == items.begin() + 4);
+    BOOST_REQUIRE(q.full());
+
+    BOOST_REQUIRE(q.pop_batch(3) == (std::vector<int>{1, 2, 3}));
+    BOOST_REQUIRE(q.pop_batch(3) == (std::vector<int>{4}));
+    BOOST_REQUIRE(q.pop_batch(3).empty());
+
+    auto popped = q.pop_eventually_batch(10);
+    BOOST_REQUIRE(!popped.available());
+    auto pushed = q.push_eventually_batch(std::vector<int>{7, 8, 9, 10, 11, 12, 13});
+    BOOST_REQUIRE(!pushed.available());
+    BOOST_REQUIRE(popped.get() == (std::vector<int>{7, 8, 9, 10}));
+    std::vector<int> rest;
+    while (rest.size() < 3) {
+        auto batch = q.pop_eventually_batch(10).get();
+        rest.insert(rest.end(), batch.begin(), batch.end());
+    }
+    pushed.get();
+    BOOST_REQUIRE(rest == (std::vector<int>{11, 12, 13}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_queue_batch_abort) {
+    queue<int> q(1);
+    auto popped = q.pop_eventually_batch(10);
+    q.abort(std::make_exception_ptr(std::runtime_error("boom")));
+    BOOST_REQUIRE_THROW(popped.get(), std::runtime_error);
+    BOOST_REQUIRE_THROW(q.push_eventually_batch(std::vector<int>{1, 2}).get(), std::runtime_error);
+}
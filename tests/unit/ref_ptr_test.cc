@@ -0,0 +1,130 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/ref_ptr.hh>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+using namespace seastar;
+
+struct base : ref_counted {
+    int& _destroyed;
+    explicit base(int& destroyed) : _destroyed(destroyed) {}
+    // Not virtual, a ref_ptr<base> still destroys a derived
+    ~base() {
+        ++_destroyed;
+    }
+};
+
+struct derived : base, weakly_referencable<derived> {
+    std::vector<int> _values{1, 2, 3};
+    int& _derived_destroyed;
+    derived(int& destroyed, int& derived_destroyed) : base(destroyed), _derived_destroyed(derived_destroyed) {}
+    ~derived() {
+        ++_derived_destroyed;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(test_ref_ptr_counts) {
+    int destroyed = 0;
+    auto p = make_ref<base>(destroyed);
+    static_assert(sizeof(p) == sizeof(void*));
+    BOOST_REQUIRE_EQUAL(p.use_count(), 1);
+    {
+        auto q = p;
+        BOOST_REQUIRE_EQUAL(p.use_count(), 2);
+        ref_ptr<base> r(q.get());
+        BOOST_REQUIRE_EQUAL(p.use_count(), 3);
+        BOOST_REQUIRE(r == p);
+        auto m = std::move(r);
+        BOOST_REQUIRE(!r);
+        BOOST_REQUIRE_EQUAL(p.use_count(), 3);
+    }
+    BOOST_REQUIRE_EQUAL(p.use_count(), 1);
+    auto& self = p;
+    p = self;
+    BOOST_REQUIRE_EQUAL(p.use_count(), 1);
+    BOOST_REQUIRE_EQUAL(destroyed, 0);
+    p = nullptr;
+    BOOST_REQUIRE_EQUAL(destroyed, 1);
+
+    std::unordered_set<ref_ptr<base>> set;
+    set.insert(make_ref<base>(destroyed));
+    set.clear();
+    BOOST_REQUIRE_EQUAL(destroyed, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_ref_ptr_polymorphic_and_weak) {
+    int destroyed = 0;
+    int derived_destroyed = 0;
+    weak_ptr<derived> w;
+    {
+        ref_ptr<base> b = make_ref<derived>(destroyed, derived_destroyed);
+        auto d = static_pointer_cast<derived>(b);
+        BOOST_REQUIRE_EQUAL(d->_values.size(), 3u);
+        w = d->weak_from_this();
+        ref_ptr<derived> again(w);
+        BOOST_REQUIRE(again == b);
+        BOOST_REQUIRE_EQUAL(b.use_count(), 3);
+    }
+    BOOST_REQUIRE_EQUAL(destroyed, 1);
+    BOOST_REQUIRE_EQUAL(derived_destroyed, 1);
+    BOOST_REQUIRE(!w);
+    BOOST_REQUIRE(!ref_ptr<derived>(w));
+}
+
+template <typename T>
+struct counting_allocator {
+    using value_type = T;
+    using is_always_equal = std::false_type;
+    int* allocated;
+    explicit counting_allocator(int* a) noexcept : allocated(a) {}
+    template <typename U>
+    counting_allocator(const counting_allocator<U>& o) noexcept : allocated(o.allocated) {}
+    T* allocate(size_t n) {
+        ++*allocated;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        --*allocated;
+        std::allocator<T>().deallocate(p, n);
+    }
+    bool operator==(const counting_allocator& o) const noexcept {
+        return allocated == o.allocated;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(test_allocate_ref) {
+    int allocated = 0;
+    int destroyed = 0;
+    {
+        auto p = allocate_ref<base>(counting_allocator<base>(&allocated), destroyed);
+        BOOST_REQUIRE_EQUAL(allocated, 1);
+        ref_ptr<const base> c = p;
+        BOOST_REQUIRE_EQUAL(c.use_count(), 2);
+    }
+    BOOST_REQUIRE_EQUAL(destroyed, 1);
+    BOOST_REQUIRE_EQUAL(allocated, 0);
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/replicated.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/when_all.hh>
+
+#include <map>
+#include <string>
+
+using namespace seastar;
+
+namespace {
+
+// Counts how many are alive, to check the old values are reclaimed
+struct table {
+    static inline std::atomic<int> alive = 0;
+    std::map<int, std::string> routes;
+    explicit table(std::map<int, std::string> r) : routes(std::move(r)) { alive++; }
+    table(const table& o) : routes(o.routes) { alive++; }
+    table(table&& o) : routes(std::move(o.routes)) { alive++; }
+    ~table() { alive--; }
+};
+
+}
+
+static void test_publish(bool per_numa_node) {
+    replicated<table> r;
+    r.start(table({{1, "a"}}), per_numa_node).get();
+    BOOST_REQUIRE_EQUAL(r.version(), 1u);
+    smp::invoke_on_all([&r] {
+        BOOST_REQUIRE_EQUAL(r.local().routes.at(1), "a");
+    }).get();
+
+    r.publish(table({{1, "b"}, {2, "c"}})).get();
+    BOOST_REQUIRE_EQUAL(r.version(), 2u);
+    smp::invoke_on_all([&r] {
+        BOOST_REQUIRE_EQUAL(r.local().routes.at(1), "b");
+        BOOST_REQUIRE_EQUAL(r.local().routes.at(2), "c");
+    }).get();
+
+    auto copies = table::alive.load();
+    BOOST_REQUIRE_GE(copies, 1);
+    BOOST_REQUIRE_LE(copies, int(smp::count));
+    if (!per_numa_node) {
+        BOOST_REQUIRE_EQUAL(copies, 1);
+    }
+
+    r.stop().get();
+    BOOST_REQUIRE_EQUAL(table::alive.load(), 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_single_copy) {
+    test_publish(false);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_per_numa_node) {
+    test_publish(true);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_concurrent_publish) {
+    replicated<int> r;
+    r.start(0).get();
+    std::vector<future<>> f;
+    for (int i = 1; i <= 10; ++i) {
+        f.push_back(r.publish(i));
+    }
+    when_all_succeed(f.begin(), f.end()).get();
+    BOOST_REQUIRE_EQUAL(r.version(), 11u);
+    smp::invoke_on_all([&r] {
+        BOOST_REQUIRE_EQUAL(r.local(), 10);
+    }).get();
+    r.stop().get();
+}
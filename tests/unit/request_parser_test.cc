@@ -72,3 +72,40 @@ SEASTAR_TEST_CASE(test_header_parsing) {
     }
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(test_header_parsing_in_place) {
+    sstring msg = "GET /test HTTP/1.1\r\nHost: test\r\nHeader:  f  i e l d  \r\nFolded: fiel\r\n    d\r\n"
+            "Header: Field2\r\nEmpty:\r\n\r\nbody";
+    // Split at every position of the headers, the fields across the two
+    // buffers being copied
+    for (size_t split = 1; split < msg.size() - 4; split++) {
+        http_request_parser parser;
+        parser.set_parse_in_place(true);
+        parser.init();
+        auto rest = parser(temporary_buffer<char>(msg.c_str(), split)).get();
+        if (!rest) {
+            rest = parser(temporary_buffer<char>(msg.c_str() + split, msg.size() - split)).get();
+        }
+        BOOST_REQUIRE(rest);
+        BOOST_REQUIRE(!parser.failed());
+        BOOST_REQUIRE_EQUAL(sstring(rest->get(), rest->size()), "body");
+        auto req = parser.get_parsed_request();
+        BOOST_REQUIRE(req->_headers.empty());
+        BOOST_REQUIRE_EQUAL(req->_header_views.size(), 5);
+        BOOST_REQUIRE_EQUAL(req->_url, "/test");
+        BOOST_REQUIRE_EQUAL(req->get_header("host"), "test");
+        BOOST_REQUIRE_EQUAL(req->get_header("Header"), "f  i e l d,Field2");
+        BOOST_REQUIRE_EQUAL(req->get_header("Folded"), "fiel d");
+        BOOST_REQUIRE(req->_header_views.find("Empty"));
+        BOOST_REQUIRE_EQUAL(req->get_header("Empty"), "");
+        BOOST_REQUIRE(!req->_header_views.find("Missing"));
+        BOOST_REQUIRE(req->should_keep_alive());
+
+        req->materialize_headers();
+        BOOST_REQUIRE(req->_header_views.empty());
+        BOOST_REQUIRE_EQUAL(req->_headers.size(), 4);
+        BOOST_REQUIRE_EQUAL(req->_headers["Header"], "f  i e l d,Field2");
+        BOOST_REQUIRE_EQUAL(req->get_header("Folded"), "fiel d");
+    }
+    return make_ready_future<>();
+}
@@ -45,7 +45,7 @@ void set_routes(routes& r) {
         api_json::my_object obj;
         obj.var1 = req.param.at("var1");
         obj.var2 = req.param.at("var2");
-        api_json::ns_hello_world::query_enum v = api_json::ns_hello_world::str2query_enum(req.query_parameters.at("query_enum"));
+        auto v = api_json::ns_hello_world::get_query_enum(req).value_or(api_json::ns_hello_world::query_enum::NUM_ITEMS);
         // This demonstrate enum conversion
         obj.enum_var = v;
         return obj;
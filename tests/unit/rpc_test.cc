@@ -23,7 +23,11 @@
 #include "seastar/core/condition-variable.hh"
 #include "seastar/core/temporary_buffer.hh"
 #include <seastar/rpc/rpc.hh>
+#include <seastar/rpc/rpc_client_pool.hh>
+#include <seastar/rpc/hedged_call.hh>
+#include <seastar/rpc/zstd_compressor.hh>
 #include <seastar/rpc/rpc_types.hh>
+#include <seastar/rpc/adaptive_compressor.hh>
 #include <seastar/rpc/lz4_compressor.hh>
 #include <seastar/rpc/lz4_fragmented_compressor.hh>
 #include <seastar/rpc/multi_algo_compressor_factory.hh>
@@ -31,6 +35,7 @@
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
 #include <seastar/core/thread.hh>
+#include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/loop.hh>
@@ -41,6 +46,7 @@
 #include <seastar/util/noncopyable_function.hh>
 #include <seastar/util/later.hh>
 
+#include <set>
 #include <span>
 
 using namespace seastar;
@@ -701,6 +707,57 @@ SEASTAR_TEST_CASE(test_stream_negotiation_error) {
     });
 }
 
+SEASTAR_TEST_CASE(test_stream_batching_and_window) {
+    rpc::server_options so;
+    so.streaming_domain = rpc::streaming_domain_type(1);
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    rpc::client_options co;
+    co.stream_batch_size = 64;
+    // Smaller than some of the elements sent back
+    co.stream_window = 256;
+    return rpc_test_env<>::do_with_thread(cfg, co, [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        static constexpr int count = 1000;
+        auto reply_size = [] (int n) { return n % 100 ? 1 : 1000; };
+        future<> server_done = make_ready_future();
+        env.register_handler(1, [&] (rpc::source<int> source) {
+            auto sink = source.make_sink<serializer, sstring>();
+            server_done = seastar::async([source, sink, reply_size] () mutable {
+                int n = 0;
+                while (auto data = source().get()) {
+                    BOOST_REQUIRE_EQUAL(std::get<0>(*data), n++);
+                    sink(sstring(reply_size(n), 'x')).get();
+                }
+                BOOST_REQUIRE_EQUAL(n, count);
+                sink.close().get();
+            });
+            return sink;
+        }).get();
+
+        auto call = env.proto().make_client<rpc::source<sstring> (rpc::sink<int>)>(1);
+        auto sink = c.make_stream_sink<serializer, int>(env.make_socket()).get();
+        auto source = call(c, sink).get();
+        auto client_done = seastar::async([source, reply_size] () mutable {
+            int n = 0;
+            while (auto data = source().get()) {
+                BOOST_REQUIRE_EQUAL(std::get<0>(*data).size(), reply_size(++n));
+            }
+            BOOST_REQUIRE_EQUAL(n, count);
+        });
+        // Written ahead of one another, to be batched in order anyway
+        for (int i = 0; i < count; i += 10) {
+            std::vector<future<>> written;
+            for (int j = i; j < i + 10; j++) {
+                written.push_back(sink(j));
+            }
+            when_all_succeed(written.begin(), written.end()).get();
+        }
+        sink.close().get();
+        server_done.get();
+        client_done.get();
+    });
+}
+
 static future<> test_rpc_connection_send_glitch(bool on_client) {
     struct context {
         int limit;
@@ -1268,6 +1325,174 @@ SEASTAR_THREAD_TEST_CASE(test_lz4_fragmented_compressor) {
     test_compressor([] { return std::make_unique<rpc::lz4_fragmented_compressor>(); });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_adaptive_compressor) {
+    rpc::lz4_fragmented_compressor::factory lz4;
+    rpc::adaptive_compressor_factory factory(lz4);
+    BOOST_REQUIRE_EQUAL(factory.supported(), "LZ4_FRAGMENTED_ADAPTIVE");
+    BOOST_REQUIRE(!factory.negotiate("LZ4_FRAGMENTED", false));
+    test_compressor([&factory] { return factory.negotiate("LZ4_FRAGMENTED_ADAPTIVE", false); });
+    BOOST_REQUIRE(factory.get_stats().stored_frames);
+    BOOST_REQUIRE(factory.get_stats().compressed_frames);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_adaptive_compressor_backoff) {
+    rpc::lz4_compressor::factory lz4;
+    rpc::adaptive_compressor_factory factory(lz4, {.min_size = 100, .max_backoff = 4});
+    auto c = factory.negotiate("LZ4_ADAPTIVE", false);
+    BOOST_REQUIRE(c);
+    BOOST_REQUIRE_EQUAL(c->name(), "LZ4_ADAPTIVE");
+    auto& stats = factory.get_stats();
+
+    auto pass = [&] (const sstring& msg) {
+        auto snd = c->compress(4, rpc::snd_buf(temporary_buffer<char>(msg.data(), msg.size())));
+        rpc::rcv_buf rcv;
+        rcv.size = snd.size - 4;
+        std::vector<temporary_buffer<char>> bufs;
+        seastar::visit(snd.bufs,
+            [&] (temporary_buffer<char>& buf) { bufs.push_back(std::move(buf)); },
+            [&] (std::vector<temporary_buffer<char>>& v) { bufs = std::move(v); });
+        bufs.front().trim_front(4);
+        rcv.bufs = std::move(bufs);
+        auto out = c->decompress(std::move(rcv));
+        BOOST_REQUIRE_EQUAL(out.size, msg.size());
+    };
+
+    // Too small
+    pass(sstring(50, 'a'));
+    BOOST_REQUIRE_EQUAL(stats.stored_frames, 1);
+    BOOST_REQUIRE_EQUAL(stats.compressed_frames, 0);
+
+    std::mt19937 rnd;
+    auto random_blob = [&] {
+        sstring blob(sstring::initialized_later(), 4096);
+        std::generate(blob.begin(), blob.end(), [&] { return char(rnd()); });
+        return blob;
+    };
+    // Poor ratios store 1, 2, 4 and then 4 frames after each compressed one
+    for (int i = 0; i < 1 + 1 + 1 + 2 + 1 + 4 + 1 + 4; ++i) {
+        pass(random_blob());
+    }
+    BOOST_REQUIRE_EQUAL(stats.compressed_frames, 4);
+    BOOST_REQUIRE_EQUAL(stats.stored_frames, 1 + 1 + 2 + 4 + 4);
+    BOOST_REQUIRE_GT(stats.compressed_bytes_out, stats.compressed_bytes_in * 9 / 10);
+
+    // Other sizes are not held back, and a good ratio resets the backoff
+    pass(sstring(1000, 'b'));
+    BOOST_REQUIRE_EQUAL(stats.compressed_frames, 5);
+    pass(sstring(4096, 'c'));
+    BOOST_REQUIRE_EQUAL(stats.compressed_frames, 6);
+    pass(random_blob());
+    BOOST_REQUIRE_EQUAL(stats.compressed_frames, 7);
+    pass(random_blob());
+    BOOST_REQUIRE_EQUAL(stats.compressed_frames, 7);
+}
+
+#ifdef SEASTAR_HAVE_ZSTD
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor) {
+    rpc::zstd_compressor_factory factory;
+    test_compressor([&factory] { return factory.negotiate("ZSTD", false); });
+}
+
+static sstring zstd_test_message(int i) {
+    return format("{{\"keyspace\":\"shop\",\"table\":\"orders\",\"consistency\":\"LOCAL_QUORUM\","
+            "\"key\":\"customer-{}\",\"columns\":[\"id\",\"status\",\"total\"],\"limit\":{}}}", i * 7919 % 100000, i % 100);
+}
+
+static rpc::snd_buf zstd_test_buf(const sstring& s) {
+    return rpc::snd_buf(temporary_buffer<char>(s.data(), s.size()));
+}
+
+// Passes a message from one compressor to another, returning the size it
+// was compressed to
+static size_t zstd_test_pass(rpc::compressor& from, rpc::compressor& to, const sstring& msg) {
+    auto snd = from.compress(0, zstd_test_buf(msg));
+    auto size = snd.size;
+    rpc::rcv_buf rcv;
+    rcv.size = snd.size;
+    rcv.bufs = std::move(snd.bufs);
+    auto out = to.decompress(std::move(rcv));
+    auto* buf = std::get_if<temporary_buffer<char>>(&out.bufs);
+    BOOST_REQUIRE(buf);
+    BOOST_REQUIRE_EQUAL(sstring(buf->get(), buf->size()), msg);
+    return size;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor_dictionary) {
+    rpc::zstd_compressor_factory sender({.sample_every = 1});
+    rpc::zstd_compressor_factory receiver;
+    auto from = sender.negotiate("ZSTD", false);
+    auto to = receiver.negotiate("ZSTD", true);
+    BOOST_REQUIRE(from && to);
+    BOOST_REQUIRE(!receiver.negotiate("LZ4", true));
+
+    size_t plain = 0;
+    for (int i = 0; i < 2000; ++i) {
+        plain += zstd_test_pass(*from, *to, zstd_test_message(i));
+    }
+    BOOST_REQUIRE_EQUAL(sender.dictionary_version(), 0);
+    auto version = sender.train_dictionary(4096);
+    BOOST_REQUIRE_NE(version, 0);
+    BOOST_REQUIRE_EQUAL(sender.dictionary_version(), version);
+    BOOST_REQUIRE(sender.take_samples().empty());
+
+    // The first frame carries the dictionary
+    size_t first = zstd_test_pass(*from, *to, zstd_test_message(2000));
+    size_t with_dictionary = 0;
+    for (int i = 2001; i < 4001; ++i) {
+        with_dictionary += zstd_test_pass(*from, *to, zstd_test_message(i));
+    }
+    BOOST_TEST_MESSAGE(format("without dictionary {} bytes, with {} bytes", plain, with_dictionary));
+    BOOST_REQUIRE_LT(with_dictionary, plain / 2);
+    BOOST_REQUIRE_GT(first, with_dictionary / 2000);
+
+    // A new version replaces it, and no dictionary stops using one
+    auto trained = rpc::zstd_compressor_factory::train_dictionary(sender.take_samples(), 4096);
+    auto next = sender.set_dictionary(trained.share());
+    BOOST_REQUIRE_GT(next, version);
+    zstd_test_pass(*from, *to, zstd_test_message(4001));
+    BOOST_REQUIRE_EQUAL(sender.set_dictionary(temporary_buffer<char>()), 0);
+    zstd_test_pass(*from, *to, zstd_test_message(4002));
+
+    // A frame against a dictionary the receiver was not sent
+    sender.set_dictionary(std::move(trained));
+    auto from2 = sender.negotiate("ZSTD", false);
+    auto to2 = receiver.negotiate("ZSTD", true);
+    (void)from2->compress(0, zstd_test_buf(zstd_test_message(0)));
+    auto snd = from2->compress(0, zstd_test_buf(zstd_test_message(1)));
+    rpc::rcv_buf rcv;
+    rcv.size = snd.size;
+    rcv.bufs = std::move(snd.bufs);
+    BOOST_REQUIRE_THROW(to2->decompress(std::move(rcv)), std::runtime_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor_rpc) {
+    rpc::zstd_compressor_factory server_factory;
+    rpc::zstd_compressor_factory client_factory({.sample_every = 1});
+    rpc_test_config cfg;
+    cfg.server_options.compressor_factory = &server_factory;
+    rpc::client_options co{.compressor_factory = &client_factory};
+
+    rpc_test_env<>::do_with_thread(cfg, co, [&] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        env.register_handler(1, [] (sstring s) { return s; }).get();
+        auto echo = env.proto().make_client<sstring (sstring)>(1);
+        for (int i = 0; i < 2000; ++i) {
+            BOOST_REQUIRE_EQUAL(echo(c, zstd_test_message(i)).get(), zstd_test_message(i));
+        }
+        // Sent to the server on an empty frame
+        client_factory.train_dictionary(4096);
+        for (int i = 0; i < 2000; ++i) {
+            BOOST_REQUIRE_EQUAL(echo(c, zstd_test_message(i)).get(), zstd_test_message(i));
+        }
+        server_factory.set_dictionary(rpc::zstd_compressor_factory::train_dictionary(client_factory.take_samples(), 4096));
+        for (int i = 0; i < 100; ++i) {
+            BOOST_REQUIRE_EQUAL(echo(c, zstd_test_message(i)).get(), zstd_test_message(i));
+        }
+    }).get();
+}
+
+#endif
+
 // Test reproducing issue #671: If timeout is time_point::max(), translating
 // it to relative timeout in the sender and then back in the receiver, when
 // these calculations happen across a millisecond boundary, overflowed the
@@ -1383,6 +1608,49 @@ SEASTAR_TEST_CASE(test_rpc_variadic_client_nonvariadic_server) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_tracing) {
+    using namespace std::chrono_literals;
+    rpc::client_options co;
+    co.propagate_tracing = true;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (int a) -> future<int> {
+            return sleep(1ms).then([a] {
+                tracing::span s("handler");
+                return a + 1;
+            });
+        }).get();
+        auto inc = env.proto().make_client<int (int)>(1);
+        // Not traced, with an empty context
+        BOOST_REQUIRE_EQUAL(inc(c1, 1).get(), 2);
+        BOOST_REQUIRE(tracing::take_spans().empty());
+
+        tracing::set_sample_rate(1);
+        auto result = tracing::with_span(tracing::span("caller"), [&] {
+            return inc(c1, 2);
+        }).get();
+        tracing::set_sample_rate(0);
+        BOOST_REQUIRE_EQUAL(result, 3);
+        auto spans = tracing::take_spans();
+        BOOST_REQUIRE_EQUAL(spans.size(), 4);
+        auto find = [&] (std::string_view name) {
+            auto i = std::find_if(spans.begin(), spans.end(), [name] (const tracing::span_record& r) { return r.name == name; });
+            BOOST_REQUIRE(i != spans.end());
+            return *i;
+        };
+        auto caller = find("caller");
+        auto client = find("rpc.client 1");
+        auto server = find("rpc.server 1");
+        auto handler = find("handler");
+        BOOST_REQUIRE_EQUAL(client.parent_id, caller.span_id);
+        BOOST_REQUIRE_EQUAL(server.parent_id, client.span_id);
+        BOOST_REQUIRE_EQUAL(handler.parent_id, server.span_id);
+        for (auto& s : spans) {
+            BOOST_REQUIRE(s.trace == caller.trace);
+        }
+        BOOST_REQUIRE_GE(server.duration, 1ms);
+    });
+}
+
 SEASTAR_TEST_CASE(test_handler_registration) {
     rpc_test_config cfg;
     rpc_loopback_error_injector::config ecfg;
@@ -1662,7 +1930,7 @@ SEASTAR_THREAD_TEST_CASE(test_rpc_metric_domains) {
         const auto& mf = values.find(name);
         BOOST_REQUIRE(mf != values.end());
         for (auto&& mi : mf->second) {
-            for (auto&&li : mi.first) {
+            for (auto&&li : mi.first.get()) {
                 if (li.first == "domain" && li.second == domain) {
                     return mi.second->get_function()().i();
                 }
@@ -1829,3 +2097,385 @@ SEASTAR_THREAD_TEST_CASE(test_compressor_empty_frames) {
         }
     }).get();
 }
+
+static rpc::client_pool::factory test_client_factory(rpc_test_env<>& env) {
+    return [&env] (const rpc::client_options& co, const socket_address& local) -> shared_ptr<rpc::client> {
+        return make_shared<test_rpc_proto::client>(env.proto(), co, env.make_socket(), ipv4_addr(), local);
+    };
+}
+
+SEASTAR_TEST_CASE(test_rpc_client_pool_lanes) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env) {
+        rpc::client_pool_options o;
+        o.connections = 3;
+        o.small_lanes = 1;
+        o.balancing = rpc::client_pool_balancing::round_robin;
+        rpc::client_pool pool(o, test_client_factory(env));
+        auto stop = deferred_stop(pool);
+        env.register_handler(1, [] (int a, int b) { return a + b; }).get();
+        auto sum = env.proto().make_client<int (int, int)>(1);
+
+        auto& small = pool.pick();
+        for (int i = 0; i < 3; ++i) {
+            BOOST_REQUIRE_EQUAL(&pool.pick(rpc::call_size::small), &small);
+        }
+        auto& large1 = pool.pick(rpc::call_size::large);
+        auto& large2 = pool.pick(rpc::call_size::large);
+        BOOST_REQUIRE(&large1 != &large2);
+        BOOST_REQUIRE(&large1 != &small && &large2 != &small);
+        BOOST_REQUIRE_EQUAL(&pool.pick(rpc::call_size::large), &large1);
+
+        BOOST_REQUIRE_EQUAL(sum(small, 1, 2).get(), 3);
+        BOOST_REQUIRE_EQUAL(sum(large1, 3, 4).get(), 7);
+        BOOST_REQUIRE_EQUAL(sum(large2, 5, 6).get(), 11);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_client_pool_least_outstanding) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env) {
+        rpc::client_pool_options o;
+        o.connections = 2;
+        rpc::client_pool pool(o, test_client_factory(env));
+        auto stop = deferred_stop(pool);
+        env.register_handler(1, [] { return sleep(std::chrono::milliseconds(100)); }).get();
+        auto slow = env.proto().make_client<void ()>(1);
+
+        auto& first = pool.pick();
+        auto f1 = slow(first);
+        // The other one is idle
+        auto& second = pool.pick();
+        BOOST_REQUIRE(&second != &first);
+        auto f2 = slow(second);
+        auto f3 = slow(pool.pick());
+        // Both have one call in flight, the last one two
+        auto& least = pool.pick();
+        BOOST_REQUIRE_EQUAL(least.incoming_queue_length(), 1);
+        when_all_succeed(std::move(f1), std::move(f2), std::move(f3)).get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_client_pool_options) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env) {
+        rpc::client_pool_options o;
+        o.connections = 2;
+        o.small_lanes = 2;
+        BOOST_REQUIRE_THROW(rpc::client_pool(o, test_client_factory(env)), std::invalid_argument);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_shard_aware_client_pool) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env) {
+        rpc::shard_aware_client_pool pool({}, test_client_factory(env));
+        auto stop = deferred_stop(pool);
+        env.register_handler(1, [] (int a, int b) { return a + b; }).get();
+        auto sum = env.proto().make_client<int (int, int)>(1);
+
+        // Served by the first connection until the shards are learnt
+        auto& first = pool.pick(1);
+        BOOST_REQUIRE_EQUAL(sum(first, 1, 2).get(), 3);
+        BOOST_REQUIRE(first.peer_shard_info());
+        BOOST_REQUIRE_EQUAL(first.peer_shard_info()->shards, smp::count);
+        BOOST_REQUIRE_EQUAL(first.peer_shard_info()->shard, this_shard_id());
+        while (!pool.peer_shards()) {
+            yield().get();
+        }
+        BOOST_REQUIRE_EQUAL(pool.peer_shards(), smp::count);
+        BOOST_REQUIRE_EQUAL(&pool.pick_shard(this_shard_id()), &first);
+        std::set<rpc::client*> clients;
+        for (unsigned key = 0; key < smp::count; ++key) {
+            auto& c = pool.pick(key);
+            BOOST_REQUIRE_EQUAL(&c, &pool.pick_shard(key));
+            BOOST_REQUIRE_EQUAL(sum(c, key, 1).get(), key + 1);
+            clients.insert(&c);
+        }
+        BOOST_REQUIRE_EQUAL(clients.size(), smp::count);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_hedged_call) {
+    using namespace std::chrono_literals;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env) {
+        rpc::client_pool_options o;
+        o.connections = 2;
+        o.balancing = rpc::client_pool_balancing::round_robin;
+        rpc::client_pool pool(o, test_client_factory(env));
+        auto stop = deferred_stop(pool);
+        int calls = 0;
+        // Replies with its argument after as many milliseconds, fails on a
+        // negative one
+        env.register_handler(1, [&calls] (int ms) {
+            ++calls;
+            if (ms < 0) {
+                return make_exception_future<int>(std::runtime_error("failed"));
+            }
+            return sleep(std::chrono::milliseconds(ms)).then([ms] { return ms; });
+        }).get();
+        auto call = env.proto().make_client<int (int)>(1);
+        auto& primary = pool.pick();
+        auto& alternate = pool.pick();
+        rpc::peer_latency primary_latency(0.95, 10ms);
+        rpc::peer_latency alternate_latency(0.95, 10ms);
+        auto hedged = [&] (int primary_ms, int alternate_ms) {
+            calls = 0;
+            return rpc::hedged_call(primary, primary_latency, alternate, alternate_latency, [&] (rpc::client& c, rpc::cancellable& cancel) {
+                return call(c, cancel, &c == &primary ? primary_ms : alternate_ms);
+            }).get();
+        };
+
+        // A fast primary is not hedged
+        BOOST_REQUIRE_EQUAL(hedged(0, 1), 0);
+        BOOST_REQUIRE_EQUAL(calls, 1);
+        // A slow one is, and is cancelled
+        auto start = steady_clock_type::now();
+        BOOST_REQUIRE_EQUAL(hedged(2000, 1), 1);
+        BOOST_REQUIRE_EQUAL(calls, 2);
+        BOOST_REQUIRE(steady_clock_type::now() - start < 1s);
+        // A failed one right away
+        BOOST_REQUIRE_EQUAL(hedged(-1, 1), 1);
+        BOOST_REQUIRE_EQUAL(calls, 2);
+        BOOST_REQUIRE_THROW(hedged(-1, -1), rpc::remote_verb_error);
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_peer_latency) {
+    using namespace std::chrono_literals;
+    rpc::peer_latency l(0.9, 5ms);
+    BOOST_REQUIRE(l.hedge_delay() == 5ms);
+    for (int i = 1; i <= 100; ++i) {
+        l.record(std::chrono::milliseconds(i));
+    }
+    BOOST_REQUIRE(l.hedge_delay() >= 89ms && l.hedge_delay() <= 92ms);
+    // Only the last window of calls count
+    for (size_t i = 0; i < rpc::peer_latency::window; ++i) {
+        l.record(1ms);
+    }
+    BOOST_REQUIRE(l.hedge_delay() == 1ms);
+}
+
+static temporary_buffer<char> payload_test_buffer(size_t size, char seed) {
+    temporary_buffer<char> buf(size);
+    for (size_t i = 0; i < size; ++i) {
+        buf.get_write()[i] = char(seed + i % 251);
+    }
+    return buf;
+}
+
+static temporary_buffer<char> payload_linearize(const rpc::fragmented_payload& p) {
+    temporary_buffer<char> buf(p.size());
+    auto dst = buf.get_write();
+    for (auto& f : p.fragments()) {
+        dst = std::copy_n(f.get(), f.size(), dst);
+    }
+    return buf;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_fragmented_payload_marshall) {
+    serializer s;
+    auto big = payload_test_buffer(100000, 1);
+    auto data = big.get();
+    rpc::fragmented_payload p(big.share());
+    auto snd = rpc::marshall(s, 4, int32_t(1), p, int32_t(2));
+    BOOST_REQUIRE_EQUAL(snd.size, 4 + 4 + 4 + 100000 + 4);
+    auto& bufs = std::get<std::vector<temporary_buffer<char>>>(snd.bufs);
+    BOOST_REQUIRE_EQUAL(bufs.size(), 3);
+    BOOST_REQUIRE_EQUAL(bufs[0].size(), 4 + 4 + 4);
+    // Not copied
+    BOOST_REQUIRE_EQUAL(bufs[1].get(), data);
+    BOOST_REQUIRE_EQUAL(bufs[2].size(), 4);
+
+    // Nor the last one, with nothing after it
+    auto last = rpc::marshall(s, 4, p);
+    BOOST_REQUIRE_EQUAL(std::get<std::vector<temporary_buffer<char>>>(last.bufs).size(), 2);
+
+    // Small payloads are copied
+    auto small = rpc::marshall(s, 4, rpc::fragmented_payload(payload_test_buffer(100, 2)));
+    BOOST_REQUIRE(std::holds_alternative<temporary_buffer<char>>(small.bufs));
+    BOOST_REQUIRE_EQUAL(small.size, 4 + 4 + 100);
+}
+
+SEASTAR_TEST_CASE(test_rpc_fragmented_payload) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        env.register_handler(1, [] (int32_t tag, rpc::fragmented_payload p, rpc::fragmented_payload q) {
+            // Sharing the frame
+            BOOST_REQUIRE(!p.fragments().empty());
+            return rpc::tuple<int32_t, rpc::fragmented_payload, rpc::fragmented_payload>(tag, std::move(q), std::move(p));
+        }).get();
+        auto swap = env.proto().make_client<rpc::tuple<int32_t, rpc::fragmented_payload, rpc::fragmented_payload> (int32_t, rpc::fragmented_payload, rpc::fragmented_payload)>(1);
+
+        std::vector<temporary_buffer<char>> fragments;
+        fragments.push_back(payload_test_buffer(300000, 3));
+        fragments.push_back(payload_test_buffer(7, 4));
+        fragments.push_back(payload_test_buffer(200000, 5));
+        rpc::fragmented_payload big(std::move(fragments));
+        rpc::fragmented_payload small(payload_test_buffer(10, 6));
+        auto expected_big = payload_linearize(big);
+        auto expected_small = payload_linearize(small);
+
+        auto [tag, q, p] = swap(c, 42, big, small).get();
+        BOOST_REQUIRE_EQUAL(tag, 42);
+        BOOST_REQUIRE(payload_linearize(p) == expected_big);
+        BOOST_REQUIRE(payload_linearize(q) == expected_small);
+
+        auto [tag2, empty, p2] = swap(c, 43, big, rpc::fragmented_payload()).get();
+        BOOST_REQUIRE_EQUAL(tag2, 43);
+        BOOST_REQUIRE_EQUAL(empty.size(), 0);
+        BOOST_REQUIRE(payload_linearize(p2) == expected_big);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_batch) {
+    rpc_test_config cfg;
+    cfg.server_options.coalescing_window = std::chrono::microseconds(200);
+    return rpc_test_env<>::do_with_thread(cfg, [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        env.register_handler(1, [] (int x) { return x * 2; }).get();
+        auto twice = env.proto().make_client<int (int)>(1);
+
+        std::vector<future<int>> replies;
+        {
+            auto batch = c.batch();
+            for (int i = 0; i < 100; i++) {
+                replies.push_back(twice(c, i));
+            }
+            // Nested batches end with the outermost one
+            auto nested = c.batch();
+            replies.push_back(twice(c, 100));
+        }
+        auto results = when_all_succeed(replies.begin(), replies.end()).get();
+        for (int i = 0; i <= 100; i++) {
+            BOOST_REQUIRE_EQUAL(results[i], 2 * i);
+        }
+
+        // Not flushed until the batch ends
+        auto batch = std::make_unique<rpc::client::batch_guard>(c);
+        auto f = twice(c, 7);
+        sleep(std::chrono::milliseconds(10)).get();
+        BOOST_REQUIRE(!f.available());
+        batch.reset();
+        BOOST_REQUIRE_EQUAL(f.get(), 14);
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_fair_send_queue) {
+    auto background = create_scheduling_group("background", 10).get();
+    auto background_kill = defer([&] () noexcept { destroy_scheduling_group(background).get(); });
+    rpc::client_options co;
+    co.fair_send_queue = true;
+    rpc_test_env<>::do_with_thread(rpc_test_config(), co, [background] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        std::vector<int> order;
+        env.register_handler(1, [&order] (int id, sstring) { order.push_back(id); }).get();
+        auto call = env.proto().make_client<void (int, sstring)>(1);
+        call(c, 0, sstring()).get();
+        order.clear();
+
+        promise<> resume;
+        c.suspend_for_testing(resume);
+        std::vector<future<>> calls;
+        for (int i = 1; i <= 3; ++i) {
+            calls.push_back(with_scheduling_group(background, [&, i] {
+                return call(c, i, sstring(100000, 'x'));
+            }));
+        }
+        // Queued last, sent first
+        calls.push_back(call(c, 4, sstring()));
+        BOOST_REQUIRE_EQUAL(c.outgoing_queue_length(), 4);
+        resume.set_value();
+        when_all_succeed(calls.begin(), calls.end()).get();
+        BOOST_REQUIRE(order == std::vector<int>({4, 1, 2, 3}));
+    }).get();
+}
+
+SEASTAR_TEST_CASE(test_rpc_coalescing_window) {
+    rpc::client_options co;
+    co.coalescing_window = std::chrono::microseconds(500);
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        env.register_handler(1, [] (int x) { return x + 1; }).get();
+        auto inc = env.proto().make_client<int (int)>(1);
+
+        for (int i = 0; i < 10; i++) {
+            BOOST_REQUIRE_EQUAL(inc(c, i).get(), i + 1);
+        }
+        std::vector<future<int>> replies;
+        for (int i = 0; i < 50; i++) {
+            replies.push_back(inc(c, i));
+            if (i % 10 == 0) {
+                yield().get();
+            }
+        }
+        auto results = when_all_succeed(replies.begin(), replies.end()).get();
+        for (int i = 0; i < 50; i++) {
+            BOOST_REQUIRE_EQUAL(results[i], i + 1);
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_verb_metrics) {
+    auto vm = make_lw_shared<rpc::verb_metrics>("test_verb_metrics");
+    vm->track(1, "echo");
+    rpc_test_config cfg;
+    cfg.server_options.per_verb_metrics = vm.get();
+    rpc::client_options co;
+    co.per_verb_metrics = vm.get();
+    return rpc_test_env<>::do_with_thread(cfg, co, [vm] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        BOOST_REQUIRE_THROW(vm->track(1, "again"), std::invalid_argument);
+        promise<> handling;
+        promise<> release;
+        env.register_handler(1, [&] (sstring s) {
+            handling.set_value();
+            return release.get_future().then([s] { return s + s; });
+        }).get();
+        env.register_handler(2, [] (sstring s) { return s; }).get();
+        auto echo = env.proto().make_client<sstring (sstring)>(1);
+        auto other = env.proto().make_client<sstring (sstring)>(2);
+
+        auto f = echo(c, sstring(1000, 'x'));
+        handling.get_future().get();
+        auto& v = *vm->find(1);
+        BOOST_REQUIRE_EQUAL(v.client_in_flight, 1);
+        BOOST_REQUIRE_EQUAL(v.server_in_flight, 1);
+        release.set_value();
+        BOOST_REQUIRE_EQUAL(f.get().size(), 2000);
+        other(c, sstring("y")).get();
+
+        BOOST_REQUIRE_EQUAL(v.client_in_flight, 0);
+        BOOST_REQUIRE_EQUAL(v.server_in_flight, 0);
+        BOOST_REQUIRE_EQUAL(v.round_trip.to_metrics_histogram().sample_count, 1);
+        BOOST_REQUIRE_EQUAL(v.handler.to_metrics_histogram().sample_count, 1);
+        BOOST_REQUIRE_EQUAL(v.request_size.to_metrics_histogram().sample_count, 1);
+        BOOST_REQUIRE_EQUAL(v.received_request_size.to_metrics_histogram().sample_count, 1);
+        BOOST_REQUIRE_EQUAL(v.reply_size.to_metrics_histogram().sample_count, 1);
+        BOOST_REQUIRE(vm->find(2) == nullptr);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_admission_control) {
+    rpc_test_config cfg;
+    cfg.resource_limits.basic_request_size = 1000;
+    cfg.resource_limits.max_memory = 1500;
+    cfg.resource_limits.admission.target_delay = std::chrono::milliseconds(5);
+    cfg.resource_limits.admission.interval = std::chrono::milliseconds(50);
+    return rpc_test_env<>::do_with_thread(cfg, [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        promise<> handling;
+        promise<> release;
+        bool first = true;
+        env.register_handler(1, [&] (int x) {
+            if (!std::exchange(first, false)) {
+                return make_ready_future<int>(x);
+            }
+            handling.set_value();
+            return release.get_future().then([x] { return x; });
+        }).get();
+        auto call = env.proto().make_client<int (int)>(1);
+
+        // Holds all the memory
+        auto holder = call(c, 1);
+        handling.get_future().get();
+        // Waits for an interval, then is shed
+        auto start = rpc::rpc_clock_type::now();
+        BOOST_REQUIRE_THROW(call(c, 2).get(), rpc::overloaded_error);
+        BOOST_REQUIRE(rpc::rpc_clock_type::now() - start >= std::chrono::milliseconds(50));
+
+        release.set_value();
+        BOOST_REQUIRE_EQUAL(holder.get(), 1);
+        BOOST_REQUIRE_EQUAL(call(c, 3).get(), 3);
+    });
+}
@@ -28,6 +28,7 @@
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
 #include <seastar/core/execution_stage.hh>
+#include <seastar/core/metrics_api.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/scheduling_specific.hh>
@@ -381,3 +382,117 @@ SEASTAR_THREAD_TEST_CASE(sg_create_check_unique_constructor_invocation) {
         groups = {};
     }).get();
 }
+
+SEASTAR_THREAD_TEST_CASE(sg_nested_shares) {
+    auto tenant_a = create_scheduling_group("tenant_a", "tna", 100).get();
+    auto cleanup_a = defer([&] () noexcept { destroy_scheduling_group(tenant_a).get(); });
+    auto tenant_b = create_scheduling_group("tenant_b", "tnb", 100).get();
+    auto cleanup_b = defer([&] () noexcept { destroy_scheduling_group(tenant_b).get(); });
+    auto fg = create_scheduling_group("tenant_a_fg", "tafg", 300, tenant_a).get();
+    auto cleanup_fg = defer([&] () noexcept { destroy_scheduling_group(fg).get(); });
+    auto bg = create_scheduling_group("tenant_a_bg", "tabg", 100, tenant_a).get();
+    auto cleanup_bg = defer([&] () noexcept { destroy_scheduling_group(bg).get(); });
+
+    BOOST_REQUIRE(!tenant_a.parent());
+    BOOST_REQUIRE(fg.parent() == tenant_a);
+    // tenant_a's IO shares are split between its own requests and its
+    // nested groups', in the proportion of their shares
+    BOOST_REQUIRE_CLOSE(tenant_a.get_io_shares(), 20.0f, 0.1);
+    BOOST_REQUIRE_CLOSE(fg.get_io_shares(), 60.0f, 0.1);
+    BOOST_REQUIRE_CLOSE(bg.get_io_shares(), 20.0f, 0.1);
+    BOOST_REQUIRE_CLOSE(tenant_b.get_io_shares(), 100.0f, 0.1);
+
+    BOOST_REQUIRE_THROW(destroy_scheduling_group(tenant_a).get(), std::runtime_error);
+
+    // With tenant_a's own queue idle, its nested groups share its half of
+    // the CPU 3:1
+    using clock = std::chrono::steady_clock;
+    auto end = clock::now() + 500ms;
+    auto spin = [end] (scheduling_group sg, clock::duration& runtime) {
+        thread_attributes attr;
+        attr.sched_group = sg;
+        return seastar::async(std::move(attr), [end, &runtime] {
+            while (clock::now() < end) {
+                auto start = clock::now();
+                while (!need_preempt() && clock::now() < end) {
+                }
+                runtime += clock::now() - start;
+                thread::yield();
+            }
+        });
+    };
+    clock::duration fg_runtime{}, bg_runtime{}, b_runtime{};
+    when_all_succeed(spin(fg, fg_runtime), spin(bg, bg_runtime), spin(tenant_b, b_runtime)).get();
+
+    auto a_runtime = fg_runtime + bg_runtime;
+    BOOST_TEST_MESSAGE(fmt::format("fg {}ms, bg {}ms, tenant_b {}ms", fg_runtime / 1ms, bg_runtime / 1ms, b_runtime / 1ms));
+    BOOST_REQUIRE_GT(double(b_runtime.count()) / a_runtime.count(), 0.7);
+    BOOST_REQUIRE_LT(double(b_runtime.count()) / a_runtime.count(), 1.4);
+    BOOST_REQUIRE_GT(double(fg_runtime.count()) / bg_runtime.count(), 2.0);
+    BOOST_REQUIRE_LT(double(fg_runtime.count()) / bg_runtime.count(), 4.5);
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_cpu_cap) {
+    auto sg = create_scheduling_group("capped", "cap", 1000).get();
+    auto cleanup = defer([&] () noexcept { destroy_scheduling_group(sg).get(); });
+    BOOST_REQUIRE_EQUAL(sg.get_cpu_cap(), 1.0f);
+    sg.set_cpu_cap(0.2, 10ms);
+    BOOST_REQUIRE_CLOSE(sg.get_cpu_cap(), 0.2f, 0.1);
+
+    // Alone on the shard, the group still gets a fifth of the CPU only
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto end = start + 500ms;
+    clock::duration runtime{};
+    thread_attributes attr;
+    attr.sched_group = sg;
+    seastar::async(std::move(attr), [end, &runtime] {
+        while (clock::now() < end) {
+            auto start = clock::now();
+            while (!need_preempt() && clock::now() < end) {
+            }
+            runtime += clock::now() - start;
+            thread::yield();
+        }
+    }).get();
+    auto elapsed = clock::now() - start;
+
+    BOOST_TEST_MESSAGE(fmt::format("ran {}ms out of {}ms", runtime / 1ms, elapsed / 1ms));
+    BOOST_REQUIRE_GT(double(runtime.count()) / elapsed.count(), 0.1);
+    BOOST_REQUIRE_LT(double(runtime.count()) / elapsed.count(), 0.35);
+
+    // Removing the cap lets it run freely again
+    sg.set_cpu_cap(1);
+    BOOST_REQUIRE_EQUAL(sg.get_cpu_cap(), 1.0f);
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_task_latency_sampling) {
+    auto sg = create_scheduling_group("sampled", "smpl", 100).get();
+    auto cleanup = defer([&] () noexcept { destroy_scheduling_group(sg).get(); });
+
+    // One task in task-latency-sample-interval (128 by default) is sampled
+    with_scheduling_group(sg, [] {
+        return seastar::async([] {
+            for (int i = 0; i < 10000; ++i) {
+                thread::yield();
+            }
+        });
+    }).get();
+
+    auto samples = [&sg] (sstring name) -> uint64_t {
+        const auto& values = seastar::metrics::impl::get_value_map();
+        auto mf = values.find(name);
+        BOOST_REQUIRE(mf != values.end());
+        for (auto&& mi : mf->second) {
+            for (auto&& li : mi.first.get()) {
+                if (li.first == "group" && li.second == sg.name()) {
+                    return mi.second->get_function()().get_histogram().sample_count;
+                }
+            }
+        }
+        BOOST_FAIL("cannot find the group's histogram");
+        return 0;
+    };
+    BOOST_REQUIRE_GT(samples("scheduler_queueing_delay"), 0);
+    BOOST_REQUIRE_GT(samples("scheduler_task_runtime"), 0);
+}
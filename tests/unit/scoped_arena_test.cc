@@ -0,0 +1,92 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/scoped_arena.hh>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+
+using namespace seastar;
+using memory::scoped_arena;
+
+BOOST_AUTO_TEST_CASE(test_bump_allocation) {
+    scoped_arena arena(1024);
+    BOOST_REQUIRE_EQUAL(arena.reserved_bytes(), 0);
+    auto a = static_cast<char*>(arena.allocate(10, 1));
+    auto b = static_cast<char*>(arena.allocate(8, 8));
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(b) % 8, 0);
+    BOOST_REQUIRE(b >= a + 10);
+    BOOST_REQUIRE(b < a + 24);
+    BOOST_REQUIRE_EQUAL(arena.allocated_bytes(), 18);
+    BOOST_REQUIRE_EQUAL(arena.reserved_bytes(), 1024);
+
+    // Freeing the last allocation gives its memory back.
+    arena.deallocate(b, 8);
+    BOOST_REQUIRE_EQUAL(arena.allocate(8, 8), b);
+
+    // Filling the chunk moves on to a new one.
+    for (int i = 0; i < 10; ++i) {
+        arena.allocate(200, 8);
+    }
+    BOOST_REQUIRE_GT(arena.reserved_bytes(), 1024);
+
+    arena.reset();
+    BOOST_REQUIRE_EQUAL(arena.allocated_bytes(), 0);
+    BOOST_REQUIRE_EQUAL(arena.reserved_bytes(), 1024);
+}
+
+BOOST_AUTO_TEST_CASE(test_large_allocations) {
+    scoped_arena arena(1024);
+    auto a = arena.allocate(4096);
+    auto b = arena.allocate(4096);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(a) % alignof(std::max_align_t), 0);
+    BOOST_REQUIRE_EQUAL(arena.allocated_bytes(), 8192);
+    // Large allocations don't come out of the chunks.
+    BOOST_REQUIRE_EQUAL(arena.reserved_bytes(), 0);
+    arena.deallocate(a, 4096);
+    BOOST_REQUIRE_EQUAL(arena.allocated_bytes(), 4096);
+    // b is freed with the arena.
+    (void)b;
+}
+
+BOOST_AUTO_TEST_CASE(test_containers) {
+    scoped_arena arena;
+    memory::arena_vector<int> v{memory::arena_allocator<int>(arena)};
+    for (int i = 0; i < 1000; ++i) {
+        v.push_back(i);
+    }
+    BOOST_REQUIRE_EQUAL(v.size(), 1000);
+    BOOST_REQUIRE_EQUAL(v[999], 999);
+
+    memory::arena_string s("a string long enough not to fit inline", memory::arena_allocator<char>(arena));
+    s += s;
+    BOOST_REQUIRE_EQUAL(s.size(), 76);
+
+    std::pmr::map<int, int> m(&arena);
+    for (int i = 0; i < 100; ++i) {
+        m.emplace(i, i * i);
+    }
+    BOOST_REQUIRE_EQUAL(m.at(9), 81);
+    BOOST_REQUIRE_GT(arena.reserved_bytes(), 0);
+}
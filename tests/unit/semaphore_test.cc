@@ -26,6 +26,11 @@
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/priority_semaphore.hh>
+#include <seastar/util/later.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/util/defer.hh>
+#include <seastar/util/exception_ptr.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/map_reduce.hh>
@@ -507,3 +512,112 @@ SEASTAR_THREAD_TEST_CASE(test_immediate_abort_after_move_assign) {
 
     BOOST_REQUIRE_THROW(get_units(sem, 1, as).get(), abort_requested_exception);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_priority_semaphore_shares) {
+    auto a = create_scheduling_group("sem_a", 100).get();
+    auto b = create_scheduling_group("sem_b", 300).get();
+    auto destroy = defer([&] () noexcept {
+        destroy_scheduling_group(a).get();
+        destroy_scheduling_group(b).get();
+    });
+    priority_semaphore sem(0);
+    std::vector<char> order;
+    std::vector<future<>> waits;
+    for (int i = 0; i < 40; ++i) {
+        waits.push_back(sem.wait(a, 1).then([&] { order.push_back('a'); }));
+        waits.push_back(sem.wait(b, 1).then([&] { order.push_back('b'); }));
+    }
+    BOOST_REQUIRE_EQUAL(sem.waiters(), 80u);
+    for (int i = 0; i < 40; ++i) {
+        sem.signal(1);
+    }
+    yield().get();
+    BOOST_REQUIRE_EQUAL(order.size(), 40u);
+    auto served_b = std::count(order.begin(), order.end(), 'b');
+    BOOST_REQUIRE_GE(served_b, 28);
+    BOOST_REQUIRE_LE(served_b, 32);
+    BOOST_REQUIRE_EQUAL(sem.get_stats(b).waits, uint64_t(served_b));
+    sem.signal(40);
+    when_all_succeed(waits.begin(), waits.end()).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_priority_semaphore_small_bypass) {
+    priority_semaphore sem(0, {.small_request_bypass = 1});
+    auto big = sem.wait(10);
+    sem.signal(5);
+    BOOST_REQUIRE(!big.available());
+    BOOST_REQUIRE(sem.try_wait(1));
+    BOOST_REQUIRE(!sem.try_wait(2));
+    sem.wait(1).get();
+    BOOST_REQUIRE_EQUAL(sem.get_stats(current_scheduling_group()).bypasses, 2u);
+    sem.signal(7);
+    big.get();
+    BOOST_REQUIRE_EQUAL(sem.available_units(), 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_priority_semaphore_aging) {
+    auto a = create_scheduling_group("sem_a", 1000).get();
+    auto b = create_scheduling_group("sem_b", 100).get();
+    auto destroy = defer([&] () noexcept {
+        destroy_scheduling_group(a).get();
+        destroy_scheduling_group(b).get();
+    });
+    for (auto max_wait : {std::chrono::milliseconds(10), std::chrono::milliseconds(10000)}) {
+        priority_semaphore sem(1, {.max_wait = max_wait});
+        // b got more units for its shares than a, and goes last
+        sem.wait(b, 1).get();
+        sem.signal(1);
+        sem.wait(a, 1).get();
+        std::vector<char> order;
+        auto wb = sem.wait(b, 1).then([&] { order.push_back('b'); });
+        sleep(std::chrono::milliseconds(20)).get();
+        auto wa = sem.wait(a, 1).then([&] { order.push_back('a'); });
+        sem.signal(1);
+        yield().get();
+        BOOST_REQUIRE_EQUAL(order.size(), 1u);
+        BOOST_REQUIRE_EQUAL(order[0], max_wait.count() == 10 ? 'b' : 'a');
+        sem.signal(1);
+        when_all_succeed(std::move(wa), std::move(wb)).get();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_priority_semaphore_timeout) {
+    priority_semaphore sem(0);
+    auto f = sem.wait(std::chrono::milliseconds(1));
+    BOOST_REQUIRE_THROW(f.get(), semaphore_timed_out);
+    BOOST_REQUIRE_EQUAL(sem.waiters(), 0u);
+    {
+        auto u = get_units(sem, 0).get();
+    }
+    sem.signal(2);
+    {
+        auto u = get_units(sem, 2).get();
+        BOOST_REQUIRE_EQUAL(sem.available_units(), 0);
+    }
+    BOOST_REQUIRE_EQUAL(sem.available_units(), 2);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_semaphore_timeout_exception_is_shared) {
+    semaphore sem(0);
+    auto f1 = sem.wait(std::chrono::milliseconds(1));
+    auto f2 = sem.wait(std::chrono::milliseconds(1));
+    sleep(std::chrono::milliseconds(10)).get();
+    BOOST_REQUIRE(f1.failed() && f2.failed());
+    auto ex1 = f1.get_exception();
+    auto ex2 = f2.get_exception();
+    BOOST_REQUIRE(ex1 == ex2);
+    BOOST_REQUIRE(try_catch<semaphore_timed_out>(ex1));
+    BOOST_REQUIRE(try_catch<timed_out_error>(ex1));
+    BOOST_REQUIRE_EQUAL(try_catch<std::exception>(ex1)->what(), semaphore_timed_out().what());
+    BOOST_REQUIRE(!try_catch<broken_semaphore>(ex1));
+    BOOST_REQUIRE(!try_catch<std::runtime_error>(ex1));
+    BOOST_REQUIRE(!try_catch<std::exception>(std::exception_ptr()));
+
+    named_semaphore nsem(0, named_semaphore_exception_factory{"named"});
+    auto f3 = nsem.wait(std::chrono::milliseconds(1));
+    sleep(std::chrono::milliseconds(10)).get();
+    auto ex3 = f3.get_exception();
+    auto* e = try_catch<named_semaphore_timed_out>(ex3);
+    BOOST_REQUIRE(e);
+    BOOST_REQUIRE_NE(std::string_view(e->what()).find("named"), std::string_view::npos);
+}
@@ -22,6 +22,8 @@
 #include <seastar/testing/thread_test_case.hh>
 
 #include <seastar/core/sharded.hh>
+#include <seastar/core/sharded_map.hh>
+#include <seastar/util/closeable.hh>
 
 using namespace seastar;
 
@@ -221,3 +223,184 @@ SEASTAR_THREAD_TEST_CASE(invoke_on_modifiers) {
 
     srv.stop().get();
 }
+
+SEASTAR_THREAD_TEST_CASE(broadcast_reaches_every_shard_once) {
+    class counter {
+    public:
+        unsigned calls = 0;
+    };
+
+    seastar::sharded<counter> srv;
+    srv.start().get();
+
+    for (auto origin : smp::all_cpus()) {
+        smp::submit_to(origin, [&srv] {
+            return srv.broadcast([] (counter& c) { c.calls++; });
+        }).get();
+    }
+    srv.invoke_on_all([] (counter& c) {
+        BOOST_REQUIRE_EQUAL(c.calls, smp::count);
+    }).get();
+
+    auto total = srv.broadcast_map_reduce([] (counter& c) {
+        return make_ready_future<unsigned>(c.calls);
+    }, std::plus<unsigned>()).get();
+    BOOST_REQUIRE_EQUAL(total, smp::count * smp::count);
+
+    srv.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(broadcast_map_reduce_keeps_shard_order) {
+    // Concatenation is associative but not commutative.
+    auto origin = smp::count - 1;
+    auto order = smp::submit_to(origin, [] {
+        return smp::broadcast_map_reduce([] {
+            return std::vector<unsigned>{this_shard_id()};
+        }, [] (std::vector<unsigned> a, std::vector<unsigned> b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        });
+    }).get();
+    BOOST_REQUIRE_EQUAL(order.size(), smp::count);
+    for (unsigned i = 0; i < smp::count; ++i) {
+        BOOST_REQUIRE_EQUAL(order[i], (origin + i) % smp::count);
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(broadcast_propagates_exceptions) {
+    auto last = smp::count - 1;
+    BOOST_REQUIRE_THROW(smp::broadcast([last] {
+        if (this_shard_id() == last) {
+            throw std::runtime_error("broadcast failure");
+        }
+    }).get(), std::runtime_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(jump_consistent_hash_moves_few_keys) {
+    jump_consistent_hash<unsigned> four(4), five(5);
+    unsigned moved = 0;
+    for (unsigned k = 0; k < 10000; ++k) {
+        auto from = four(k), to = five(k);
+        BOOST_REQUIRE_LT(from, 4u);
+        if (from != to) {
+            // Growing only moves keys to the new shard
+            BOOST_REQUIRE_EQUAL(to, 4u);
+            moved++;
+        }
+    }
+    BOOST_REQUIRE_GT(moved, 1500u);
+    BOOST_REQUIRE_LT(moved, 2500u);
+}
+
+namespace {
+struct kv_shard {
+    std::unordered_map<unsigned, unsigned> entries;
+};
+}
+
+SEASTAR_THREAD_TEST_CASE(sharded_map_routes_keys) {
+    sharded<kv_shard> s;
+    s.start().get();
+    auto stop = deferred_stop(s);
+    sharded_map<unsigned, kv_shard> m(s);
+
+    std::vector<unsigned> keys;
+    for (unsigned k = 0; k < 100; ++k) {
+        keys.push_back(k);
+        m.invoke_on(k, [&m] (kv_shard& shard, unsigned key, unsigned value) {
+            BOOST_REQUIRE_EQUAL(this_shard_id(), m.shard_of(key));
+            shard.entries[key] = value;
+        }, k * 2).get();
+    }
+    auto values = m.invoke_on_keys(keys, [] (kv_shard& shard, std::vector<unsigned> keys) {
+        std::vector<unsigned> values;
+        for (auto k : keys) {
+            values.push_back(shard.entries.at(k));
+        }
+        return values;
+    }).get();
+    BOOST_REQUIRE_EQUAL(values.size(), keys.size());
+    for (unsigned k = 0; k < 100; ++k) {
+        BOOST_REQUIRE_EQUAL(values[k], k * 2);
+    }
+
+    // From wherever the hash put them to the last shard, all the bounds
+    // being 0
+    sharded_map<unsigned, kv_shard, range_partitioning<unsigned>> r(s, range_partitioning<unsigned>({}));
+    std::vector<unsigned> bounds(smp::count - 1, 0);
+    using entries = std::vector<std::pair<unsigned, unsigned>>;
+    r.rebalance(range_partitioning<unsigned>(bounds), [] (kv_shard& shard, const std::function<bool (const unsigned&)>& moves) {
+        entries out;
+        std::erase_if(shard.entries, [&] (auto& e) {
+            if (moves(e.first)) {
+                out.push_back(e);
+                return true;
+            }
+            return false;
+        });
+        return out;
+    }, [] (kv_shard& shard, entries in) {
+        shard.entries.insert(in.begin(), in.end());
+    }).get();
+    s.invoke_on_all([] (kv_shard& shard) {
+        BOOST_REQUIRE_EQUAL(shard.entries.size(), this_shard_id() == smp::count - 1 ? 100u : 0u);
+    }).get();
+    r.invoke_on_keys(keys, [] (kv_shard& shard, std::vector<unsigned> keys) {
+        BOOST_REQUIRE_EQUAL(this_shard_id(), smp::count - 1);
+        BOOST_REQUIRE_EQUAL(keys.size(), 100);
+    }).get();
+    r.invoke_on(7, [] (kv_shard& shard, unsigned key) {
+        BOOST_REQUIRE_EQUAL(shard.entries.at(key), 14u);
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(invoke_on_active_skips_parked_shards) {
+    if (smp::count < 2) {
+        return;
+    }
+    struct service {};
+    sharded<service> s;
+    s.start().get();
+    auto stop = deferred_stop(s);
+
+    BOOST_REQUIRE_EQUAL(smp::active_count(), smp::count);
+    smp::park(1).get();
+    BOOST_REQUIRE(smp::parked(1));
+    BOOST_REQUIRE_EQUAL(smp::active_count(), smp::count - 1);
+    BOOST_REQUIRE_NE(smp::active_shard(1), 1u);
+    for (unsigned c = 0; c < smp::count; c++) {
+        auto served_by = s.invoke_on_active(c, [] (service&) { return this_shard_id(); }).get();
+        BOOST_REQUIRE_EQUAL(served_by, smp::active_shard(c));
+        BOOST_REQUIRE_NE(served_by, 1u);
+    }
+    // Still running what is submitted to it directly
+    BOOST_REQUIRE_EQUAL(s.invoke_on(1, [] (service&) { return this_shard_id(); }).get(), 1u);
+    BOOST_REQUIRE_THROW(smp::park(0).get(), std::invalid_argument);
+
+    smp::unpark(1).get();
+    BOOST_REQUIRE(!smp::parked(1));
+    BOOST_REQUIRE_EQUAL(s.invoke_on_active(1, [] (service&) { return this_shard_id(); }).get(), 1u);
+}
+
+SEASTAR_THREAD_TEST_CASE(nearest_shard_by_numa_distance) {
+    smp::invoke_on_all([] {
+        auto& order = smp::shards_by_distance(this_shard_id());
+        BOOST_REQUIRE_EQUAL(order.size(), smp::count);
+        BOOST_REQUIRE_EQUAL(order.front(), this_shard_id());
+        auto sorted = order;
+        std::sort(sorted.begin(), sorted.end());
+        for (unsigned c = 0; c < smp::count; c++) {
+            BOOST_REQUIRE_EQUAL(sorted[c], c);
+        }
+        BOOST_REQUIRE_EQUAL(smp::nearest_shard([] (unsigned) { return true; }).value(), this_shard_id());
+        BOOST_REQUIRE(!smp::nearest_shard([] (unsigned) { return false; }));
+        // The same node is never farther than another one
+        auto other = smp::nearest_shard([] (unsigned c) { return c != this_shard_id(); });
+        BOOST_REQUIRE_EQUAL(bool(other), smp::count > 1);
+        for (unsigned c = 0; other && c < smp::count; c++) {
+            if (c != this_shard_id() && smp::numa_node(c) == smp::numa_node(this_shard_id())) {
+                BOOST_REQUIRE_EQUAL(smp::numa_node(*other), smp::numa_node(this_shard_id()));
+            }
+        }
+    }).get();
+}
@@ -71,3 +71,36 @@ SEASTAR_TEST_CASE(test_basic_capped_loop) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(test_batched_grabs) {
+    using token_bucket_t = internal::shared_token_bucket<uint64_t, std::ratio<1>, internal::capped_release::no, manual_clock>;
+    token_bucket_t tb(10, 10, 1, false);
+    internal::token_bucket_batch<token_bucket_t> batch(tb, 4);
+
+    // The first grab takes the batch from the bucket, the next fit in it
+    BOOST_REQUIRE_EQUAL(batch.grab(1), 1);
+    BOOST_REQUIRE_EQUAL(batch.grab(2), 3);
+    BOOST_REQUIRE_EQUAL(batch.bucket_grabs(), 1);
+    // This one does not. What's left is refunded, but the head did not
+    // reach it yet, and a new batch is grabbed
+    BOOST_REQUIRE_EQUAL(batch.grab(3), 7);
+    BOOST_REQUIRE_EQUAL(batch.bucket_grabs(), 2);
+    BOOST_REQUIRE_EQUAL(batch.left(), 1);
+    BOOST_REQUIRE(tb.deficiency(7) > 0);
+
+    manual_clock::advance(1s);
+    tb.replenish(manual_clock::now());
+    BOOST_REQUIRE_EQUAL(tb.deficiency(7), 0);
+    // The head is past the token left this time, which goes back
+    batch.refund();
+    BOOST_REQUIRE_EQUAL(batch.left(), 0);
+    BOOST_REQUIRE_EQUAL(tb.deficiency(11), 0);
+    BOOST_REQUIRE(tb.deficiency(12) > 0);
+
+    // Grabs of a batch or more go to the bucket
+    BOOST_REQUIRE_EQUAL(batch.grab(4), 12);
+    BOOST_REQUIRE_EQUAL(batch.bucket_grabs(), 3);
+    BOOST_REQUIRE_EQUAL(batch.left(), 0);
+
+    return make_ready_future<>();
+}
@@ -0,0 +1,206 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/shm.hh>
+#include <seastar/util/closeable.hh>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace seastar;
+
+static socket_address test_address(const char* name) {
+    // Abstract, not to leave files behind
+    return socket_address(unix_domain_addr(std::string(1, '\0') + fmt::format("seastar-shm-test-{}-{}", ::getpid(), name)));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_echo) {
+    auto addr = test_address("echo");
+    auto ss = net::shm_listen(addr);
+    auto server = ss.accept().then([] (accept_result ar) {
+        return do_with(std::move(ar.connection), [] (connected_socket& s) {
+            return do_with(s.input(), s.output(), [] (input_stream<char>& in, output_stream<char>& out) {
+                return repeat([&in, &out] {
+                    return in.read().then([&out] (temporary_buffer<char> buf) {
+                        if (buf.empty()) {
+                            return out.close().then([] { return stop_iteration::yes; });
+                        }
+                        return out.write(std::move(buf)).then([&out] {
+                            return out.flush();
+                        }).then([] { return stop_iteration::no; });
+                    });
+                });
+            });
+        });
+    });
+
+    // Small rings, for the data to wrap around them and to fill them up
+    auto s = net::make_shm_socket({.ring_size = 4096}).connect(addr).get();
+    auto in = s.input();
+    auto out = s.output();
+    sstring sent;
+    for (int i = 0; i < 1000; i++) {
+        sent += fmt::format("message {} ", i);
+    }
+    auto writer = out.write(sent).then([&out] {
+        return out.close();
+    });
+    sstring received;
+    while (auto buf = in.read().get()) {
+        received.append(buf.get(), buf.size());
+    }
+    writer.get();
+    server.get();
+    BOOST_REQUIRE_EQUAL(received, sent);
+    in.close().get();
+    ss.abort_accept();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_peer_gone) {
+    auto addr = test_address("gone");
+    auto ss = net::shm_listen(addr);
+    auto accepted = ss.accept();
+    auto s = net::make_shm_socket().connect(addr).get();
+    auto server = accepted.get();
+    auto out = server.connection.output();
+    out.write("last words").get();
+    out.flush().get();
+    // The server end goes away without closing its output
+    server = {};
+    out = output_stream<char>();
+
+    auto in = s.input();
+    sstring received;
+    while (auto buf = in.read().get()) {
+        received.append(buf.get(), buf.size());
+    }
+    BOOST_REQUIRE_EQUAL(received, "last words");
+    s.wait_input_shutdown().get();
+    ss.abort_accept();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_bad_ring_size) {
+    BOOST_REQUIRE_THROW(net::make_shm_socket({.ring_size = 1000}), std::invalid_argument);
+}
+
+// The client end of a connection set up by hand, as a process of its own
+// would, with the descriptor of the unix domain socket and the mapping
+struct raw_client {
+    file_desc sock;
+    mmap_area area;
+};
+
+// The layout of src/net/shm.cc: a header of three cache lines, head, tail
+// and the rest, at the front of each ring, the first one carrying what the
+// client sends
+static constexpr size_t ring_header_size = 192;
+
+static raw_client raw_connect(const socket_address& addr, size_t ring_size, bool seal) {
+    auto sock = file_desc::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC);
+    auto sa = addr;
+    sock.connect(sa.as_posix_sockaddr(), sa.length());
+    int mfd = ::memfd_create("shm-test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    BOOST_REQUIRE_NE(mfd, -1);
+    auto memfd = file_desc::from_fd(mfd);
+    memfd.truncate(2 * (ring_header_size + ring_size));
+    if (seal) {
+        BOOST_REQUIRE_NE(::fcntl(memfd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW), -1);
+    }
+    auto area = memfd.map_shared_rw(2 * (ring_header_size + ring_size), 0);
+
+    struct {
+        uint32_t magic = 0x53484d31;
+        uint32_t reserved = 0;
+        uint64_t ring_size;
+    } body;
+    body.ring_size = ring_size;
+    iovec iov = {&body, sizeof(body)};
+    msghdr hdr = {};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    auto c = CMSG_FIRSTHDR(&hdr);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(c), &mfd, sizeof(int));
+    BOOST_REQUIRE_EQUAL(sock.sendmsg(&hdr, 0).value_or(0), sizeof(body));
+    return raw_client{std::move(sock), std::move(area)};
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_unsealed_memfd) {
+    auto addr = test_address("unsealed");
+    auto ss = net::shm_listen(addr);
+    auto [sock, area] = raw_connect(addr, 4096, false);
+    // Dropped without being accepted, as the client could truncate it
+    char c;
+    std::optional<ssize_t> n;
+    while (!(n = sock.recv(&c, 1, MSG_DONTWAIT))) {
+        sleep(std::chrono::milliseconds(1)).get();
+    }
+    BOOST_REQUIRE_EQUAL(*n, 0);
+    ss.abort_accept();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_corrupted_ring) {
+    auto addr = test_address("corrupted");
+    auto ss = net::shm_listen(addr);
+    constexpr size_t ring_size = 4096;
+
+    {
+        // More in the ring the server reads than it holds
+        auto accepted = ss.accept();
+        auto [sock, area] = raw_connect(addr, ring_size, true);
+        auto server = accepted.get();
+        auto in = server.connection.input();
+        auto tail = reinterpret_cast<std::atomic<uint64_t>*>(area.get() + 64);
+        tail->store(ring_size + 1);
+        char c = 0;
+        sock.send(&c, 1, MSG_NOSIGNAL);
+        BOOST_REQUIRE_THROW(in.read().get(), std::system_error);
+    }
+    {
+        // Its head past its tail in the ring the server writes
+        auto accepted = ss.accept();
+        auto [sock, area] = raw_connect(addr, ring_size, true);
+        auto server = accepted.get();
+        auto out = server.connection.output();
+        auto head = reinterpret_cast<std::atomic<uint64_t>*>(area.get() + ring_header_size + ring_size);
+        head->store(1);
+        out.write("data").get();
+        BOOST_REQUIRE_THROW(out.flush().get(), std::system_error);
+    }
+    ss.abort_accept();
+}
@@ -118,10 +118,52 @@ static void test_allocation_with_lru(const double growth_factor, const unsigned
     std::cout << __FUNCTION__ << " done!\n";
 }
 
+static void test_rebalance(const double growth_factor, const unsigned slab_limit_size) {
+    bi::list<item, bi::member_hook<item, bi::list_member_hook<>, &item::_cache_link>> _cache;
+    unsigned evictions = 0;
+
+    slab_allocator<item> slab(growth_factor, slab_limit_size, max_object_size,
+        [&](item& item_ref) { _cache.erase(_cache.iterator_to(item_ref)); evictions++; });
+    size_t small = 1024;
+    size_t large = max_object_size / 4;
+
+    // the small items take all the pages
+    auto small_per_page = max_object_size / slab.class_size(small);
+    auto pages = slab_limit_size / max_object_size;
+    for (auto i = 0u; i < small_per_page * pages; i++) {
+        _cache.push_front(*slab.create(small));
+    }
+    assert(evictions == 0);
+    assert(!slab.rebalance());
+
+    // the large ones then evict each other within their single page
+    auto large_per_page = max_object_size / slab.class_size(large);
+    for (auto i = 0u; i < large_per_page * 2; i++) {
+        _cache.push_front(*slab.create(large));
+    }
+    assert(evictions == large_per_page);
+
+    // until a page of the small ones is moved to them
+    assert(slab.rebalance());
+    assert(evictions == large_per_page + small_per_page);
+    for (auto i = 0u; i < large_per_page; i++) {
+        _cache.push_front(*slab.create(large));
+    }
+    assert(evictions == large_per_page + small_per_page);
+
+    // and no page moves without evictions
+    assert(!slab.rebalance());
+
+    _cache.clear();
+
+    std::cout << __FUNCTION__ << " done!\n";
+}
+
 int main(int ac, char** av) {
     test_allocation_1(1.25, 5*1024*1024);
     test_allocation_2(1.07, 5*1024*1024); // 1.07 is the growth factor used by facebook.
     test_allocation_with_lru(1.25, 5*1024*1024);
+    test_rebalance(1.25, 5*1024*1024);
 
     return 0;
 }
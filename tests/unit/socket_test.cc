@@ -31,8 +31,12 @@
 #include <seastar/core/sleep.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/when_all.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/util/defer.hh>
 
 #include <seastar/net/posix-stack.hh>
+#include <seastar/core/file.hh>
+#include <seastar/util/tmp_file.hh>
 
 using namespace seastar;
 
@@ -224,3 +228,258 @@ SEASTAR_TEST_CASE(socket_on_close_local_shutdown_test) {
         when_all(std::move(client), std::move(server)).discard_result().get();
     });
 }
+
+SEASTAR_TEST_CASE(socket_zerocopy_send_test) {
+    return seastar::async([&] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12346), lo);
+
+        constexpr size_t chunk = 64 * 1024;
+        constexpr size_t nr_chunks = 64;
+
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12346)).get();
+            if (!cln.enable_zerocopy_send(4096)) {
+                fmt::print("Client: MSG_ZEROCOPY not supported, sending with copies\n");
+            }
+            auto out = cln.output(chunk);
+            for (size_t i = 0; i < nr_chunks; i++) {
+                temporary_buffer<char> buf(chunk);
+                std::fill_n(buf.get_write(), chunk, char('a' + i % 26));
+                out.write(std::move(buf)).get();
+            }
+            out.flush().get();
+            out.close().get();
+        });
+
+        accept_result acc = ss.accept().get();
+        auto in = acc.connection.input();
+        size_t received = 0;
+        while (auto buf = in.read().get()) {
+            for (auto c : buf) {
+                BOOST_REQUIRE_EQUAL(c, char('a' + (received / chunk) % 26));
+                received++;
+            }
+        }
+        BOOST_REQUIRE_EQUAL(received, chunk * nr_chunks);
+        in.close().get();
+        client.get();
+    });
+}
+
+SEASTAR_TEST_CASE(socket_notsent_lowat_test) {
+    return seastar::async([&] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12348), lo);
+
+        constexpr size_t chunk = 64 * 1024;
+        constexpr size_t nr_chunks = 256;
+
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12348)).get();
+            BOOST_REQUIRE(cln.set_notsent_lowat(chunk));
+            auto out = cln.output(chunk);
+            for (size_t i = 0; i < nr_chunks; i++) {
+                temporary_buffer<char> buf(chunk);
+                std::fill_n(buf.get_write(), chunk, char('a' + i % 26));
+                out.write(std::move(buf)).get();
+            }
+            out.flush().get();
+            out.close().get();
+        });
+
+        accept_result acc = ss.accept().get();
+        // Let the writer run into the watermark
+        sleep(std::chrono::milliseconds(100)).get();
+        auto in = acc.connection.input();
+        size_t received = 0;
+        while (auto buf = in.read().get()) {
+            for (auto c : buf) {
+                BOOST_REQUIRE_EQUAL(c, char('a' + (received / chunk) % 26));
+                received++;
+            }
+        }
+        BOOST_REQUIRE_EQUAL(received, chunk * nr_chunks);
+        in.close().get();
+        client.get();
+    });
+}
+
+SEASTAR_TEST_CASE(socket_rx_timestamps_test) {
+    return seastar::async([&] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12349), lo);
+
+        promise<> enabled;
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12349)).get();
+            // Data received before is not stamped
+            enabled.get_future().get();
+            auto out = cln.output();
+            out.write("ping").get();
+            out.flush().get();
+            out.close().get();
+        });
+
+        accept_result acc = ss.accept().get();
+        BOOST_REQUIRE(!acc.connection.last_rx_timestamp());
+        if (!acc.connection.enable_rx_timestamps()) {
+            fmt::print("Server: SO_TIMESTAMPING not supported\n");
+            enabled.set_value();
+            client.get();
+            return;
+        }
+        enabled.set_value();
+        auto in = acc.connection.input();
+        sstring received;
+        while (auto buf = in.read().get()) {
+            received += sstring(buf.get(), buf.size());
+            // Loopback data is stamped by the kernel as it is sent
+            auto ts = acc.connection.last_rx_timestamp();
+            BOOST_REQUIRE(ts);
+            auto now = std::chrono::system_clock::now();
+            BOOST_REQUIRE(*ts <= now && *ts > now - std::chrono::minutes(1));
+        }
+        BOOST_REQUIRE_EQUAL(received, "ping");
+        in.close().get();
+        client.get();
+    });
+}
+
+SEASTAR_TEST_CASE(socket_write_from_file_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        constexpr size_t file_size = 3 * 1024 * 1024;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto wbuf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), file_size);
+        for (size_t i = 0; i < file_size; i++) {
+            wbuf.get_write()[i] = char(i % 251);
+        }
+        f.dma_write(0, wbuf.get(), wbuf.size()).get();
+        f.flush().get();
+
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12347), lo);
+
+        // An unaligned range, preceded and followed by buffered data
+        constexpr uint64_t offset = 1000;
+        constexpr size_t len = file_size - 3000;
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12347)).get();
+            auto out = cln.output();
+            out.write("head").get();
+            out.write_from_file(f, offset, len).get();
+            out.write("tail").get();
+            out.close().get();
+        });
+
+        accept_result acc = ss.accept().get();
+        auto in = acc.connection.input();
+        sstring received;
+        while (auto buf = in.read().get()) {
+            received.append(buf.get(), buf.size());
+        }
+        in.close().get();
+        client.get();
+        f.close().get();
+
+        BOOST_REQUIRE_EQUAL(received.size(), len + 8);
+        BOOST_REQUIRE_EQUAL(received.substr(0, 4), "head");
+        BOOST_REQUIRE_EQUAL(received.substr(len + 4), "tail");
+        BOOST_REQUIRE(std::equal(received.begin() + 4, received.end() - 4, wbuf.get() + offset));
+    });
+}
+
+SEASTAR_TEST_CASE(datagram_batch_test) {
+    return seastar::async([] {
+        auto server = make_bound_datagram_channel(ipv4_addr("127.0.0.1", 0));
+        auto client = make_bound_datagram_channel(ipv4_addr("127.0.0.1", 0));
+
+        // Equally sized datagrams followed by a short one, so that GSO
+        // (where available) coalesces them into a single message
+        constexpr size_t nr_datagrams = 100;
+        constexpr size_t size = 1000;
+        std::vector<net::outgoing_datagram> out;
+        for (size_t i = 0; i < nr_datagrams; i++) {
+            auto len = i == nr_datagrams - 1 ? size / 2 : size;
+            temporary_buffer<char> buf(len);
+            std::fill_n(buf.get_write(), len, char(i));
+            out.push_back({server.local_address(), net::packet(std::move(buf))});
+        }
+        client.send_batch(std::move(out)).get();
+
+        size_t received = 0;
+        while (received < nr_datagrams) {
+            auto batch = server.receive_batch().get();
+            BOOST_REQUIRE(!batch.empty());
+            for (auto& d : batch) {
+                auto& p = d.get_data();
+                p.linearize();
+                auto& frag = p.frag(0);
+                BOOST_REQUIRE_EQUAL(frag.size, received == nr_datagrams - 1 ? size / 2 : size);
+                BOOST_REQUIRE(std::all_of(frag.base, frag.base + frag.size, [&] (char c) { return c == char(received); }));
+                BOOST_REQUIRE_EQUAL(d.get_src(), client.local_address());
+                received++;
+            }
+        }
+        client.close();
+        server.close();
+    });
+}
+
+namespace {
+
+class counting_listener {
+    server_socket _ss;
+    future<> _loop = make_ready_future<>();
+    unsigned _accepted = 0;
+public:
+    void start(uint16_t port) {
+        listen_options lo;
+        lo.reuse_address = true;
+        lo.lba = server_socket::load_balancing_algorithm::incoming_cpu;
+        _ss = seastar::listen(ipv4_addr("127.0.0.1", port), lo);
+        _loop = repeat([this] {
+            return _ss.accept().then([this] (accept_result) {
+                _accepted++;
+                return stop_iteration::no;
+            });
+        }).handle_exception([] (std::exception_ptr) {});
+    }
+    future<> stop() {
+        _ss.abort_accept();
+        return std::move(_loop);
+    }
+    unsigned accepted() const noexcept { return _accepted; }
+};
+
+}
+
+SEASTAR_TEST_CASE(socket_incoming_cpu_steering_test) {
+    return seastar::async([] {
+        constexpr uint16_t port = 12347;
+        constexpr unsigned nr_connections = 20;
+        sharded<counting_listener> listeners;
+        listeners.start().get();
+        auto stop_listeners = defer([&] () noexcept { listeners.stop().get(); });
+        listeners.invoke_on_all(&counting_listener::start, port).get();
+        fmt::print("Steering by incoming CPU {}\n", engine().posix_incoming_cpu_steering_available() ? "available" : "not available");
+
+        for (unsigned i = 0; i < nr_connections; i++) {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", port)).get();
+            cln.shutdown_output();
+        }
+        // Every connection is accepted exactly once, by whichever shard
+        auto accepted = [&] {
+            return listeners.map_reduce0(std::mem_fn(&counting_listener::accepted), 0u, std::plus<unsigned>()).get();
+        };
+        for (int i = 0; i < 1000 && accepted() < nr_connections; i++) {
+            sleep(std::chrono::milliseconds(10)).get();
+        }
+        BOOST_REQUIRE_EQUAL(accepted(), nr_connections);
+    });
+}
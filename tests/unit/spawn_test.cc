@@ -21,9 +21,12 @@
  */
 #include <seastar/core/reactor.hh>
 #include <seastar/core/seastar.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/process.hh>
+#include <seastar/util/short_streams.hh>
 
 using namespace seastar;
 using namespace seastar::experimental;
@@ -147,3 +150,26 @@ SEASTAR_TEST_CASE(test_spawn_kill) {
         });
     });
 }
+
+SEASTAR_THREAD_TEST_CASE(test_spawn_concurrent_pipes_do_not_leak) {
+    // If the second cat inherited the pipes of the first one, the first
+    // wouldn't see EOF on its stdin (nor we on its stdout) until the
+    // second one exits.
+    auto [f1, f2] = when_all_succeed(spawn_process("/bin/cat"), spawn_process("/bin/cat")).get();
+    auto p1 = std::move(f1);
+    auto p2 = std::move(f2);
+    auto cin1 = p1.cin();
+    auto cout1 = p1.cout();
+    cin1.write("hello").get();
+    cin1.close().get();
+    auto out = util::read_entire_stream_contiguous(cout1).get();
+    BOOST_CHECK_EQUAL(out, "hello");
+    p1.wait().get();
+
+    auto cin2 = p2.cin();
+    cin2.close().get();
+    auto wstatus = p2.wait().get();
+    auto* exit_status = std::get_if<process::wait_exited>(&wstatus);
+    BOOST_REQUIRE(exit_status != nullptr);
+    BOOST_CHECK_EQUAL(exit_status->exit_code, EXIT_SUCCESS);
+}
@@ -25,6 +25,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <seastar/core/sstring.hh>
+#include <seastar/util/string_utils.hh>
 #include <list>
 #include <fmt/ranges.h>
 #if FMT_VERSION >= FMT_VERSION_OPTIONAL_FORMAT
@@ -327,3 +328,39 @@ BOOST_AUTO_TEST_CASE(test_fmt) {
 }
 
 #endif
+
+BOOST_AUTO_TEST_CASE(test_string_search) {
+    using seastar::internal::find_first_of;
+    using seastar::internal::find_crlf;
+    // Around and across the 16 byte blocks the searches go by
+    for (size_t pos = 0; pos < 40; ++pos) {
+        std::string s(pos, 'a');
+        s += "\r\n";
+        s += std::string(20, 'b');
+        BOOST_REQUIRE_EQUAL(find_crlf(s), pos);
+        BOOST_REQUIRE_EQUAL(find_first_of(s, "\n "), pos + 1);
+        BOOST_REQUIRE_EQUAL(find_first_of(s, "b"), pos + 2);
+        s[pos + 1] = 'x';
+        BOOST_REQUIRE_EQUAL(find_crlf(s), std::string_view::npos);
+    }
+    BOOST_REQUIRE_EQUAL(find_crlf("\r"), std::string_view::npos);
+    BOOST_REQUIRE_EQUAL(find_crlf(""), std::string_view::npos);
+    BOOST_REQUIRE_EQUAL(find_first_of("abc", ""), std::string_view::npos);
+    // Past the characters compared a block at a time
+    BOOST_REQUIRE_EQUAL(find_first_of(std::string(30, 'a') + "z", "0123456789xyz"), 30u);
+}
+
+BOOST_AUTO_TEST_CASE(test_case_insensitive_equal) {
+    using seastar::internal::case_insensitive_equal;
+    BOOST_REQUIRE(case_insensitive_equal("Content-Length", "content-length"));
+    BOOST_REQUIRE(case_insensitive_equal("X-LONG-HEADER-NAME-ABOVE-16", "x-long-header-name-above-16"));
+    BOOST_REQUIRE(!case_insensitive_equal("X-LONG-HEADER-NAME-ABOVE-16", "x-long-header-name-above-17"));
+    BOOST_REQUIRE(!case_insensitive_equal("Content-Length", "Content-Lengt"));
+    // Only the ASCII letters are folded
+    BOOST_REQUIRE(!case_insensitive_equal("[@]^^^^^^^^^^^^^^^^", "{`}~~~~~~~~~~~~~~~~"));
+    BOOST_REQUIRE(!case_insensitive_equal("\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0\xc0",
+                                          "\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0\xe0"));
+    sstring s = "Transfer-Encoding: CHUNKED";
+    seastar::internal::ascii_to_lower(s.data(), s.size());
+    BOOST_REQUIRE_EQUAL(s, "transfer-encoding: chunked");
+}
@@ -21,15 +21,24 @@
 
 #include <boost/test/tools/old/interface.hpp>
 #include <cstddef>
+#include <seastar/core/cpu_profile.hh>
 #include <seastar/core/internal/stall_detector.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/stall_profile.hh>
 #include <seastar/core/thread_cputime_clock.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/util/later.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string.hpp>
 #include <sys/mman.h>
 
 #ifndef SEASTAR_DEBUG
@@ -175,6 +184,76 @@ SEASTAR_THREAD_TEST_CASE(spin_in_kernel) {
     test_spin_with_body("kernel", [] { mmap_populate(128 * 1024); });
 }
 
+SEASTAR_THREAD_TEST_CASE(stalls_profiled) {
+    reactor::test::set_stall_profile(true);
+    auto disable = defer([] () noexcept { reactor::test::set_stall_profile(false); });
+    stall_profile::reset().get();
+    std::atomic<unsigned> reports{};
+    temporary_stall_detector_settings tsds(10ms, [&] { ++reports; });
+    unsigned nr = 10;
+    for (unsigned i = 0; i < nr; ++i) {
+        spin_some_cooperatively(100ms);
+        spin(20ms);
+    }
+    spin_some_cooperatively(100ms);
+
+    // All the stalls are profiled, not only the reported ones
+    auto folded = stall_profile::collect(true).get();
+    std::vector<std::string> lines;
+    boost::split(lines, folded, boost::is_any_of("\n"), boost::token_compress_on);
+    uint64_t stalls = 0;
+    for (auto& line : lines) {
+        if (line.empty()) {
+            continue;
+        }
+        BOOST_REQUIRE(line.starts_with("shard 0;"));
+        auto space = line.rfind(' ');
+        BOOST_REQUIRE(space != std::string::npos);
+        stalls += std::stoull(line.substr(space + 1));
+    }
+    BOOST_REQUIRE_GE(stalls, nr);
+    BOOST_REQUIRE_GT(nr, reports);
+    BOOST_REQUIRE(stall_profile::collect().get().empty());
+}
+
+static uint64_t folded_samples(const sstring& folded, std::string_view prefix) {
+    std::vector<std::string> lines;
+    boost::split(lines, folded, boost::is_any_of("\n"), boost::token_compress_on);
+    uint64_t samples = 0;
+    for (auto& line : lines) {
+        if (line.starts_with(prefix)) {
+            samples += std::stoull(line.substr(line.rfind(' ') + 1));
+        }
+    }
+    return samples;
+}
+
+SEASTAR_THREAD_TEST_CASE(cpu_profiled) {
+    auto sg = create_scheduling_group("profiled", 100).get();
+    auto destroy = defer([sg] () noexcept { destroy_scheduling_group(sg).get(); });
+    reactor::test::set_cpu_profiler(1000);
+    auto disable = defer([] () noexcept { reactor::test::set_cpu_profiler(0); });
+
+    thread_attributes attr;
+    attr.sched_group = sg;
+    async(attr, [] {
+        spin_some_cooperatively(200ms);
+    }).get();
+
+    // About a sample per millisecond spun, in the group of the thread
+    auto folded = cpu_profile::collect(true).get();
+    BOOST_REQUIRE_GE(folded_samples(folded, "shard 0;sg:profiled;task:"), 100);
+    BOOST_REQUIRE_EQUAL(folded_samples(folded, "shard 0;[dropped]"), 0);
+    BOOST_REQUIRE_EQUAL(folded_samples(cpu_profile::collect().get(), "shard 0;sg:profiled;"), 0);
+
+    // The samples of the entries beyond the bound are dropped
+    reactor::test::set_cpu_profiler(1000, 1);
+    spin_some_cooperatively(100ms);
+    folded = cpu_profile::collect().get();
+    BOOST_REQUIRE_GT(folded_samples(folded, "shard 0;[dropped]"), 0);
+    BOOST_REQUIRE_EQUAL(std::count(folded.begin(), folded.end(), '\n'), 2);
+}
+
 
 #else
 
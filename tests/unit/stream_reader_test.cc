@@ -28,6 +28,8 @@
 #include <seastar/http/request.hh>
 #include <seastar/util/short_streams.hh>
 #include <string>
+#include <string_view>
+#include <vector>
 
 using namespace seastar;
 using namespace util;
@@ -109,3 +111,58 @@ SEASTAR_TEST_CASE(test_skip_all) {
         BOOST_REQUIRE(to_sstring(empty_inp.read().get()).empty());
     });
 }
+
+// Produces the given buffers, one at a time
+class buffers_source_impl : public data_source_impl {
+    std::vector<temporary_buffer<char>> _bufs;
+    size_t _next = 0;
+public:
+    explicit buffers_source_impl(std::vector<std::string_view> bufs) {
+        for (auto b : bufs) {
+            _bufs.emplace_back(b.data(), b.size());
+        }
+    }
+    virtual future<temporary_buffer<char>> get() override {
+        if (_next == _bufs.size()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        return make_ready_future<temporary_buffer<char>>(std::move(_bufs[_next++]));
+    }
+};
+
+SEASTAR_TEST_CASE(test_read_line) {
+    return async([] {
+        input_stream<char> inp(data_source(std::make_unique<buffers_source_impl>(std::vector<std::string_view>{
+            "GET /index.html HTTP/1.1\r", "\nHost: ", "example.com\r\nAccept: */*\r\n", "\r\nbody\rwith a CR"})));
+        BOOST_REQUIRE_EQUAL(read_line(inp).get(), "GET /index.html HTTP/1.1");
+        BOOST_REQUIRE_EQUAL(read_line(inp).get(), "Host: example.com");
+        BOOST_REQUIRE_EQUAL(read_line(inp).get(), "Accept: */*");
+        BOOST_REQUIRE_EQUAL(read_line(inp).get(), "");
+        BOOST_REQUIRE_EQUAL(read_line(inp).get(), "body\rwith a CR");
+        BOOST_REQUIRE(inp.eof());
+    });
+}
+
+SEASTAR_TEST_CASE(test_peek_fragments) {
+    return async([] {
+        input_stream<char> inp(data_source(std::make_unique<buffers_source_impl>(std::vector<std::string_view>{
+            "head", "er", "body1", "body2"})));
+        auto frags = inp.peek_fragments(6).get();
+        BOOST_REQUIRE_EQUAL(frags.size(), 2);
+        BOOST_REQUIRE_EQUAL(std::string_view(frags[0].get(), frags[0].size()), "head");
+        BOOST_REQUIRE_EQUAL(std::string_view(frags[1].get(), frags[1].size()), "er");
+        inp.consume_buffered(5);
+        BOOST_REQUIRE_EQUAL(to_sstring(inp.read_exactly(3).get()), "rbo");
+
+        // The rest of a fragment partly read comes first
+        frags = inp.peek_fragments(100).get();
+        BOOST_REQUIRE_EQUAL(frags.size(), 3);
+        BOOST_REQUIRE_EQUAL(std::string_view(frags[0].get(), frags[0].size()), "dy1");
+        BOOST_REQUIRE(frags[2].empty());
+        inp.consume_buffered(4);
+        inp.skip(1).get();
+        BOOST_REQUIRE_EQUAL(to_sstring(inp.read().get()), "dy2");
+        BOOST_REQUIRE(inp.read().get().empty());
+        BOOST_REQUIRE(inp.eof());
+    });
+}
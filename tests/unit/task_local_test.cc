@@ -0,0 +1,132 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <iostream>
+#include <optional>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/task_local.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static task_local_key<int> tenant;
+static task_local_key<unsigned> request_id;
+
+SEASTAR_TEST_CASE(test_task_local_follows_continuations) {
+    BOOST_REQUIRE(!tenant.get());
+    auto v = co_await with_task_local(tenant, 7, [] {
+        return sleep(1ms).then([] {
+            return sleep(0ms);
+        }).then([] {
+            return *tenant.get();
+        });
+    });
+    BOOST_REQUIRE_EQUAL(v, 7);
+    BOOST_REQUIRE(!tenant.get());
+}
+
+SEASTAR_TEST_CASE(test_task_local_follows_coroutines) {
+    auto v = co_await with_task_local(tenant, 3, [] () -> future<int> {
+        co_await sleep(1ms);
+        co_await coroutine::maybe_yield();
+        // Nested values shadow the outer ones, and leave the other keys alone
+        auto inner = co_await with_task_local(tenant, 4, [] () -> future<std::pair<int, std::optional<unsigned>>> {
+            co_await sleep(0ms);
+            co_return std::make_pair(*tenant.get(), request_id.get());
+        });
+        BOOST_REQUIRE_EQUAL(inner.first, 4);
+        BOOST_REQUIRE(!inner.second);
+        co_return *tenant.get();
+    });
+    BOOST_REQUIRE_EQUAL(v, 3);
+}
+
+SEASTAR_TEST_CASE(test_task_local_background_fiber) {
+    std::optional<int> seen;
+    future<> background = make_ready_future<>();
+    co_await with_task_local(tenant, 11, [&] {
+        background = sleep(10ms).then([&] {
+            seen = tenant.get();
+        });
+        return make_ready_future<>();
+    });
+    // The fiber outlives the call, and keeps the value
+    co_await std::move(background);
+    BOOST_REQUIRE(seen);
+    BOOST_REQUIRE_EQUAL(*seen, 11);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_task_local_thread) {
+    with_task_local(request_id, 5u, [] {
+        return async([] {
+            sleep(1ms).get();
+            BOOST_REQUIRE_EQUAL(*request_id.get(), 5u);
+            with_task_local(tenant, 1, [] {
+                // Blocks in the scope
+                sleep(1ms).get();
+                BOOST_REQUIRE_EQUAL(*tenant.get(), 1);
+                thread::yield();
+                BOOST_REQUIRE_EQUAL(*tenant.get(), 1);
+                return make_ready_future<>();
+            }).get();
+            BOOST_REQUIRE(!tenant.get());
+            sleep(1ms).get();
+            BOOST_REQUIRE_EQUAL(*request_id.get(), 5u);
+        });
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_task_local_does_not_cross_shards) {
+    if (smp::count < 2) {
+        std::cerr << "Skipping test_task_local_does_not_cross_shards: needs more than 1 shard" << std::endl;
+        return;
+    }
+    with_task_local(tenant, 2, [] {
+        return smp::submit_to((this_shard_id() + 1) % smp::count, [] () -> future<> {
+            BOOST_REQUIRE(!tenant.get());
+            // Continuations on the remote shard don't see them either
+            co_await sleep(1ms);
+            BOOST_REQUIRE(!tenant.get());
+        }).then([] {
+            BOOST_REQUIRE_EQUAL(*tenant.get(), 2);
+        });
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_task_local_submit_to_own_shard) {
+    with_task_local(tenant, 3, [] {
+        return smp::submit_to(this_shard_id(), [] () -> future<> {
+            BOOST_REQUIRE(!tenant.get());
+            co_await sleep(1ms);
+            BOOST_REQUIRE(!tenant.get());
+        }).then([] {
+            BOOST_REQUIRE_EQUAL(*tenant.get(), 3);
+        });
+    }).get();
+}
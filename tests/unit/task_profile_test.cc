@@ -0,0 +1,95 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string_view>
+#include <utility>
+
+#include <seastar/core/make_task.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/task_profile.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/defer.hh>
+
+// Run with --task-latency-by-type 1 --task-latency-sample-interval 1, for
+// all the tasks to be sampled
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static void spin(std::chrono::microseconds d) {
+    auto end = std::chrono::steady_clock::now() + d;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+template <typename Task>
+static future<> run_task(Task* t) {
+    auto f = t->get_future();
+    schedule(t);
+    return f;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_tagged_tasks_accounted_by_tag) {
+    auto sg = create_scheduling_group("spinning", 100).get();
+    auto destroy = defer([sg] () noexcept { destroy_scheduling_group(sg).get(); });
+
+    // One task of a queue is sampled at a time
+    for (int i = 0; i < 100; ++i) {
+        run_task(make_task(sg, "spinner", [] { spin(100us); })).get();
+        run_task(make_task(sg, [] { spin(10us); })).get();
+    }
+
+    auto types = engine().top_task_types(sg, 1);
+    BOOST_REQUIRE_EQUAL(types.size(), 1);
+    BOOST_REQUIRE_EQUAL(types[0].name, "spinner");
+    BOOST_REQUIRE_GE(types[0].samples, 100);
+    BOOST_REQUIRE_GE(types[0].runtime, 100 * 100us);
+    BOOST_REQUIRE_EQUAL(engine().top_task_types(sg, 10).size(), 2);
+
+    auto profile = task_profile::collect(1).get();
+    BOOST_REQUIRE(std::string_view(profile).find("sg:spinning;task:spinner ") != std::string_view::npos);
+}
+
+template <int N>
+static void run_type(scheduling_group sg) {
+    run_task(make_task(sg, [] {})).get();
+}
+
+template <int... N>
+static void run_distinct_types(scheduling_group sg, std::integer_sequence<int, N...>) {
+    (run_type<N>(sg), ...);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_task_types_bounded) {
+    auto sg = create_scheduling_group("many_types", 100).get();
+    auto destroy = defer([sg] () noexcept { destroy_scheduling_group(sg).get(); });
+
+    run_distinct_types(sg, std::make_integer_sequence<int, 100>());
+
+    // The types beyond the bound are accounted together
+    auto types = engine().top_task_types(sg, 1000);
+    BOOST_REQUIRE_EQUAL(types.size(), 64);
+    BOOST_REQUIRE(std::any_of(types.begin(), types.end(), [] (auto& t) { return t.name == "[other]"; }));
+}
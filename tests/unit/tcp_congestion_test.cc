@@ -0,0 +1,155 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <stdexcept>
+
+#include <seastar/net/tcp.hh>
+
+using namespace seastar;
+using namespace seastar::net;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint32_t mss = 1000;
+
+// A connection's window, driven by ACKs arriving every tick
+struct flow {
+    std::unique_ptr<tcp_congestion_control> cc;
+    uint32_t cwnd = 10 * mss;
+    uint32_t ssthresh = 64 * mss;
+    tcp_congestion_control::clock_type::time_point now{1s};
+
+    explicit flow(std::string_view name) : cc(make_tcp_congestion_control(name)) {}
+
+    tcp_congestion_control::window window() {
+        return {cwnd, ssthresh, mss};
+    }
+    // Acknowledges a window's worth of data, a round-trip time later
+    void round(std::chrono::milliseconds rtt = 10ms) {
+        now += rtt;
+        cc->on_rtt_sample(rtt, now);
+        for (uint32_t acked = 0, window = cwnd; acked < window; acked += mss) {
+            cc->on_ack(this->window(), mss, now);
+        }
+    }
+    void loss() {
+        cc->on_loss(window(), cwnd, now);
+        cwnd = ssthresh;
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_factory) {
+    for (auto name : {"reno", "cubic", "bbr"}) {
+        BOOST_REQUIRE_EQUAL(make_tcp_congestion_control(name)->name(), std::string_view(name));
+    }
+    BOOST_REQUIRE_THROW(make_tcp_congestion_control("vegas"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_reno) {
+    flow f("reno");
+    // Slow start doubles the window every round
+    f.round();
+    BOOST_REQUIRE_EQUAL(f.cwnd, 20 * mss);
+    f.loss();
+    BOOST_REQUIRE_EQUAL(f.cwnd, 10 * mss);
+    // Congestion avoidance grows it by about a segment per round
+    f.round();
+    BOOST_REQUIRE_GE(f.cwnd, 10 * mss + mss / 2);
+    BOOST_REQUIRE_LE(f.cwnd, 11 * mss);
+    BOOST_REQUIRE_EQUAL(f.cc->pacing_rate(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_cubic) {
+    flow f("cubic");
+    f.cwnd = f.ssthresh = 100 * mss;
+    f.loss();
+    BOOST_REQUIRE_EQUAL(f.cwnd, 70 * mss);
+    // On a long path, the window grows back to where it was lost in
+    // K = cbrt(30 / 0.4) seconds, about 4.2s, flattening out around it
+    uint32_t at_half_k = 0;
+    for (int i = 0; i < 42; ++i) {
+        f.round(100ms);
+        if (i == 21) {
+            at_half_k = f.cwnd;
+        }
+    }
+    BOOST_REQUIRE_GT(at_half_k, 85 * mss);
+    BOOST_REQUIRE_LT(at_half_k, 100 * mss);
+    BOOST_REQUIRE_GE(f.cwnd, 97 * mss);
+    BOOST_REQUIRE_LE(f.cwnd, 103 * mss);
+    // Then probes beyond it, faster and faster
+    for (int i = 0; i < 50; ++i) {
+        f.round(100ms);
+    }
+    BOOST_REQUIRE_GT(f.cwnd, 110 * mss);
+    BOOST_REQUIRE_EQUAL(f.cc->pacing_rate(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_cubic_fast_convergence) {
+    flow f("cubic");
+    f.cwnd = f.ssthresh = 100 * mss;
+    f.loss();
+    // Losing again before getting back to the last maximum lowers it, and
+    // so the window plateaus lower
+    f.loss();
+    for (int i = 0; i < 50; ++i) {
+        f.round(100ms);
+    }
+    flow g("cubic");
+    g.cwnd = g.ssthresh = 100 * mss;
+    g.loss();
+    for (int i = 0; i < 50; ++i) {
+        g.round(100ms);
+    }
+    BOOST_REQUIRE_LT(f.cwnd, g.cwnd);
+}
+
+BOOST_AUTO_TEST_CASE(test_bbr) {
+    flow f("bbr");
+    BOOST_REQUIRE_EQUAL(f.cc->pacing_rate(), 0);
+    // A path delivering 1000 bytes per millisecond, with a 20ms minimum
+    // round-trip time: the bandwidth-delay product is 20 segments
+    constexpr uint64_t rate = 1000000;
+    auto rtt = 20ms;
+    for (int i = 0; i < 100; ++i) {
+        f.now += rtt;
+        f.cc->on_rtt_sample(rtt, f.now);
+        for (unsigned s = 0; s < 20; ++s) {
+            f.cc->on_ack(f.window(), mss, f.now);
+        }
+    }
+    BOOST_REQUIRE_GE(f.cwnd, 30 * mss);
+    BOOST_REQUIRE_LE(f.cwnd, 40 * mss);
+    // Paced around the bottleneck bandwidth, at the gain of the cycle
+    BOOST_REQUIRE_GE(f.cc->pacing_rate(), rate * 3 / 4);
+    BOOST_REQUIRE_LE(f.cc->pacing_rate(), rate * 5 / 4);
+    // Isolated losses do not shrink the window
+    auto cwnd = f.cwnd;
+    f.loss();
+    BOOST_REQUIRE_EQUAL(f.cwnd, cwnd);
+}
@@ -0,0 +1,126 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <array>
+
+#include <seastar/net/tcp.hh>
+
+using namespace seastar;
+using namespace seastar::net;
+
+static uint8_t* options_of(std::array<char, 60>& hdr) {
+    return reinterpret_cast<uint8_t*>(hdr.data()) + tcp_hdr::len;
+}
+
+BOOST_AUTO_TEST_CASE(test_syn_carries_sack_permitted) {
+    tcp_option opt;
+    opt._local_mss = 1460;
+    // mss, window scale and SACK-permitted, then padding
+    auto size = opt.get_size(true, false);
+    BOOST_REQUIRE_EQUAL(size, 12);
+
+    std::array<char, 60> hdr{};
+    tcp_hdr th{};
+    th.f_syn = true;
+    opt.fill(hdr.data(), &th, size);
+
+    tcp_option peer;
+    peer.parse(options_of(hdr), options_of(hdr) + size);
+    BOOST_REQUIRE(peer._sack_received);
+    BOOST_REQUIRE_EQUAL(peer._remote_mss, 1460);
+
+    // SYN-ACK echoes SACK-permitted only if the SYN carried it
+    tcp_option no_sack;
+    no_sack._local_mss = 1460;
+    BOOST_REQUIRE_EQUAL(no_sack.get_size(true, true), 0);
+    BOOST_REQUIRE_EQUAL(peer.get_size(true, true), 12);
+}
+
+BOOST_AUTO_TEST_CASE(test_sack_disabled) {
+    tcp_option opt;
+    opt._local_mss = 1460;
+    opt._local_sack = false;
+    // mss and window scale, then padding
+    auto size = opt.get_size(true, false);
+    BOOST_REQUIRE_EQUAL(size, 8);
+
+    std::array<char, 60> hdr{};
+    tcp_hdr th{};
+    th.f_syn = true;
+    opt.fill(hdr.data(), &th, size);
+    tcp_option peer;
+    peer.parse(options_of(hdr), options_of(hdr) + size);
+    BOOST_REQUIRE(!peer._sack_received);
+
+    // Nor is the SACK-permitted of the peer accepted
+    tcp_option sack;
+    sack._local_mss = 1460;
+    size = sack.get_size(true, false);
+    sack.fill(hdr.data(), &th, size);
+    tcp_option no_sack;
+    no_sack._local_sack = false;
+    no_sack.parse(options_of(hdr), options_of(hdr) + size);
+    BOOST_REQUIRE(!no_sack._sack_received);
+    BOOST_REQUIRE_EQUAL(no_sack.get_size(true, true), 8);
+}
+
+BOOST_AUTO_TEST_CASE(test_sack_blocks_roundtrip) {
+    tcp_option opt;
+    std::array<tcp_sack_block, 3> blocks = {{
+        {make_seq(3000), make_seq(4000)},
+        {make_seq(1000), make_seq(2000)},
+        {make_seq(0xfffffc00), make_seq(200)},
+    }};
+    auto size = opt.get_size(false, true, blocks.size());
+    BOOST_REQUIRE_EQUAL(size, 4 + 3 * tcp_option::sack_block_len);
+    BOOST_REQUIRE_EQUAL(size % tcp_option::align, 0);
+
+    std::array<char, 60> hdr{};
+    tcp_hdr th{};
+    th.f_ack = true;
+    opt.fill(hdr.data(), &th, size, blocks.data(), blocks.size());
+
+    std::array<tcp_sack_block, tcp_option::max_sack_blocks> parsed;
+    auto nr = tcp_option::parse_sack_blocks(options_of(hdr), options_of(hdr) + size, parsed.data());
+    BOOST_REQUIRE_EQUAL(nr, blocks.size());
+    for (unsigned i = 0; i < nr; ++i) {
+        BOOST_REQUIRE_EQUAL(parsed[i].left, blocks[i].left);
+        BOOST_REQUIRE_EQUAL(parsed[i].right, blocks[i].right);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_malformed_sack_option) {
+    std::array<tcp_sack_block, tcp_option::max_sack_blocks> parsed;
+    // Length running past the end of the options
+    uint8_t truncated[] = {1, 1, 5, 18, 0, 0, 0, 1, 0, 0, 0, 2};
+    BOOST_REQUIRE_EQUAL(tcp_option::parse_sack_blocks(truncated, truncated + sizeof(truncated), parsed.data()), 0);
+    // Zero length
+    uint8_t zero[] = {5, 0, 0, 0};
+    BOOST_REQUIRE_EQUAL(tcp_option::parse_sack_blocks(zero, zero + sizeof(zero), parsed.data()), 0);
+    // Other options before
+    uint8_t mixed[] = {2, 4, 5, 0xb4, 5, 10, 0, 0, 0, 1, 0, 0, 0, 2};
+    BOOST_REQUIRE_EQUAL(tcp_option::parse_sack_blocks(mixed, mixed + sizeof(mixed), parsed.data()), 1);
+    BOOST_REQUIRE_EQUAL(parsed[0].left, make_seq(1));
+    BOOST_REQUIRE_EQUAL(parsed[0].right, make_seq(2));
+}
@@ -166,6 +166,22 @@ SEASTAR_TEST_CASE(test_thread_custom_stack_size) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_thread_stack_reuse) {
+    // An exited thread's stack is handed to the next thread of the same
+    // stack size
+    auto stack_address = [] {
+        thread_attributes attr;
+        attr.stack_size = 65536;
+        return async(attr, [] {
+            char c;
+            return reinterpret_cast<uintptr_t>(&c);
+        }).get();
+    };
+    auto first = stack_address();
+    auto second = stack_address();
+    BOOST_REQUIRE_LT(std::max(first, second) - std::min(first, second), 65536);
+}
+
 // The test case uses x86_64 specific signal handler info. The test
 // fails with detect_stack_use_after_return=1. We could put it behind
 // a command line option and fork/exec to run it after removing
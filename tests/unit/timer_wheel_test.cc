@@ -0,0 +1,261 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <seastar/core/timer-wheel.hh>
+
+// Checks timer_wheel against a reference model, a multimap of the armed
+// timers by expiry, of which expire() must return exactly the due ones.
+
+using namespace seastar;
+
+namespace {
+
+struct test_clock {
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<test_clock, duration>;
+    static time_point now() noexcept { return time_point(); }
+};
+
+struct test_timer {
+    using clock = test_clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    boost::intrusive::list_member_hook<> link;
+    time_point expiry;
+    bool _expired = false;
+    bool armed = false;
+
+    time_point get_timeout() const noexcept { return expiry; }
+    void cancel() noexcept;
+};
+
+// With ticks as fine as the clock, the default of the tests, every level is
+// reached in a few seconds of the clock: expiries 2^36ns or more ahead
+// overflow the top one
+constexpr int64_t overflow_distance = int64_t(1) << 36;
+
+// Removes a timer from the wheel of the running test
+void (*remove_timer)(test_timer&) noexcept;
+
+void test_timer::cancel() noexcept {
+    remove_timer(*this);
+    armed = false;
+}
+
+template <unsigned TickShift = 0>
+struct model_test {
+    using wheel_t = timer_wheel<test_timer, &test_timer::link, TickShift>;
+    static inline wheel_t* the_wheel;
+
+    // Destroyed after the wheel, which cancels the armed ones
+    std::vector<test_timer> timers;
+    wheel_t wheel;
+    std::multimap<int64_t, test_timer*> model;
+    int64_t now = 0;
+
+    explicit model_test(size_t nr_timers) : timers(nr_timers) {
+        the_wheel = &wheel;
+        remove_timer = [] (test_timer& t) noexcept { the_wheel->remove(t); };
+    }
+
+    void arm(test_timer& t, int64_t expiry) {
+        BOOST_REQUIRE(!t.armed);
+        t.expiry = test_clock::time_point(test_clock::duration(expiry));
+        t.armed = true;
+        auto next = wheel.get_next_timeout().time_since_epoch().count();
+        bool earlier = wheel.insert(t);
+        // Not telling the timer is earlier is only right if expire() was
+        // to be called by its expiry anyway
+        BOOST_REQUIRE(earlier || next <= std::max(now, expiry));
+        model.emplace(expiry, &t);
+        check_next();
+    }
+
+    void cancel(test_timer& t) {
+        BOOST_REQUIRE(t.armed);
+        auto expiry = t.expiry.time_since_epoch().count();
+        auto [b, e] = model.equal_range(expiry);
+        auto it = std::find_if(b, e, [&] (auto& m) { return m.second == &t; });
+        BOOST_REQUIRE(it != e);
+        model.erase(it);
+        t.cancel();
+        BOOST_REQUIRE_EQUAL(wheel.size(), model.size());
+    }
+
+    // Returns the number of timers expired
+    size_t expire(int64_t to) {
+        BOOST_REQUIRE_GE(to, now);
+        now = to;
+        auto expired = wheel.expire(test_clock::time_point(test_clock::duration(now)));
+        std::vector<test_timer*> got;
+        for (auto& t : expired) {
+            got.push_back(&t);
+        }
+        expired.clear();
+        std::vector<test_timer*> want;
+        while (!model.empty() && model.begin()->first <= now) {
+            want.push_back(model.begin()->second);
+            model.erase(model.begin());
+        }
+        std::sort(got.begin(), got.end());
+        std::sort(want.begin(), want.end());
+        BOOST_REQUIRE(got == want);
+        for (auto t : got) {
+            t->armed = false;
+        }
+        BOOST_REQUIRE_EQUAL(wheel.size(), model.size());
+        check_next();
+        return got.size();
+    }
+
+    // get_next_timeout() may be early, never late
+    void check_next() {
+        BOOST_REQUIRE_EQUAL(wheel.empty(), model.empty());
+        auto next = wheel.get_next_timeout().time_since_epoch().count();
+        BOOST_REQUIRE_GE(next, now);
+        if (!model.empty()) {
+            BOOST_REQUIRE_LE(next, std::max(now, model.begin()->first));
+        }
+    }
+
+    // Expires everything by following get_next_timeout(), as the reactor
+    // does, which must take a bounded number of calls per expiry
+    void drain() {
+        size_t calls = 0;
+        size_t expired = 0;
+        while (!model.empty()) {
+            auto next = wheel.get_next_timeout().time_since_epoch().count();
+            expired += expire(std::max(next, now + 1));
+            ++calls;
+        }
+        BOOST_REQUIRE_LE(calls, 8 * (expired + 1));
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_arm_and_cancel) {
+    model_test<> m(4);
+    m.arm(m.timers[0], 100);
+    m.arm(m.timers[1], 50);
+    m.arm(m.timers[2], 1 << 20);
+    m.arm(m.timers[3], 0);
+    m.cancel(m.timers[1]);
+    BOOST_REQUIRE_EQUAL(m.expire(10), 1);
+    m.cancel(m.timers[2]);
+    BOOST_REQUIRE_EQUAL(m.expire(99), 0);
+    BOOST_REQUIRE_EQUAL(m.expire(100), 1);
+    BOOST_REQUIRE(m.wheel.empty());
+
+    // Rearmed after being cancelled, and in the past
+    m.arm(m.timers[1], 5);
+    m.arm(m.timers[2], 1000);
+    m.cancel(m.timers[2]);
+    m.arm(m.timers[2], 200);
+    BOOST_REQUIRE_EQUAL(m.expire(200), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_level_cascades) {
+    // Timers at and around the boundaries of every level, expired by a
+    // clock that steps over the boundaries or lands right on them
+    model_test<> m(6 * 6);
+    size_t i = 0;
+    for (unsigned level = 0; level < 6; ++level) {
+        int64_t span = int64_t(1) << (6 * (level + 1));
+        for (int64_t expiry : {span - 1, span, span + 1, 2 * span - 1, 2 * span, 3 * span + span / 2}) {
+            m.arm(m.timers[i++], expiry);
+        }
+    }
+    for (unsigned level = 0; level < 6; ++level) {
+        int64_t span = int64_t(1) << (6 * (level + 1));
+        m.expire(span - 1);
+        m.expire(span);
+        m.expire(2 * span - 2);
+    }
+    m.drain();
+}
+
+BOOST_AUTO_TEST_CASE(test_overflow) {
+    model_test<> m(5);
+    m.arm(m.timers[0], overflow_distance - 1);
+    m.arm(m.timers[1], overflow_distance);
+    m.arm(m.timers[2], 3 * overflow_distance + 7);
+    m.arm(m.timers[3], std::numeric_limits<int64_t>::max());
+    m.arm(m.timers[4], 10);
+    BOOST_REQUIRE_EQUAL(m.expire(10), 1);
+    BOOST_REQUIRE_EQUAL(m.expire(overflow_distance - 1), 1);
+    BOOST_REQUIRE_EQUAL(m.expire(overflow_distance), 1);
+    m.cancel(m.timers[3]);
+    // Coming back out of the overflow list
+    m.drain();
+}
+
+template <unsigned TickShift>
+static void random_against_model() {
+    std::mt19937_64 rng(1);
+    model_test<TickShift> m(1000);
+    // Log-uniform distances, for all the levels and the overflow list
+    auto distance = [&] {
+        auto bits = std::uniform_int_distribution<int>(0, 40)(rng);
+        return int64_t(std::uniform_int_distribution<uint64_t>(0, (uint64_t(1) << bits) - 1)(rng));
+    };
+    for (unsigned step = 0; step < 100000; ++step) {
+        auto& t = m.timers[std::uniform_int_distribution<size_t>(0, m.timers.size() - 1)(rng)];
+        switch (std::uniform_int_distribution<int>(0, 3)(rng)) {
+        case 0:
+        case 1:
+            if (t.armed) {
+                m.cancel(t);
+            }
+            m.arm(t, m.now + distance() - 8);
+            break;
+        case 2:
+            if (t.armed) {
+                m.cancel(t);
+            }
+            break;
+        case 3:
+            m.expire(m.now + distance());
+            break;
+        }
+    }
+    m.drain();
+}
+
+BOOST_AUTO_TEST_CASE(test_random_against_model) {
+    random_against_model<0>();
+}
+
+// Timers sharing ticks, expired at their exact time all the same
+BOOST_AUTO_TEST_CASE(test_random_against_model_coarse_ticks) {
+    random_against_model<10>();
+}
@@ -963,6 +963,78 @@ SEASTAR_THREAD_TEST_CASE(test_reload_certificates) {
     }
 }
 
+// The credentials of all shards reloading when the calling shard parses
+// the new certificates
+SEASTAR_THREAD_TEST_CASE(test_reload_sharded_certificates) {
+    tmpdir tmp;
+
+    namespace fs = std::filesystem;
+
+    fs::copy_file(certfile("other.crt"), tmp.path() / "test.crt");
+    fs::copy_file(certfile("other.key"), tmp.path() / "test.key");
+
+    auto cert = (tmp.path() / "test.crt").native();
+    auto key = (tmp.path() / "test.key").native();
+    std::unordered_set<sstring> changed;
+    promise<> p;
+
+    tls::credentials_builder b;
+    b.set_x509_key_file(cert, key, tls::x509_crt_format::PEM).get();
+    b.set_dh_level();
+
+    auto certs = b.build_sharded_reloadable_server_credentials([&](const std::unordered_set<sstring>& files, std::exception_ptr ep) {
+        if (ep) {
+            return;
+        }
+        changed.insert(files.begin(), files.end());
+        if (changed.count(cert) && changed.count(key)) {
+            p.set_value();
+        }
+    }).get();
+    BOOST_REQUIRE_EQUAL(certs.size(), smp::count);
+
+    fs::copy_file(certfile("test.crt"), tmp.path() / "test0.crt");
+    fs::copy_file(certfile("test.key"), tmp.path() / "test0.key");
+
+    rename_file((tmp.path() / "test0.crt").native(), (tmp.path() / "test.crt").native()).get();
+    rename_file((tmp.path() / "test0.key").native(), (tmp.path() / "test.key").native()).get();
+
+    p.get_future().get();
+
+    // The trusted certificates on every shard now
+    for (unsigned c = 0; c < smp::count; c++) {
+        smp::submit_to(c, [mine = std::move(certs[c])] () mutable {
+            return seastar::async([mine = mine.release()] {
+                ::listen_options opts;
+                opts.reuse_address = true;
+                opts.set_fixed_cpu(this_shard_id());
+                auto addr = ::make_ipv4_address({0x7f000001, 4712});
+                auto server = tls::listen(mine, addr, opts);
+
+                tls::credentials_builder b2;
+                b2.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+
+                auto sa = server.accept();
+                auto c = tls::connect(b2.build_certificate_credentials(), addr).get();
+                auto s = sa.get();
+                auto in = s.connection.input();
+
+                output_stream<char> out(c.output().detach(), 4096);
+
+                out.write("apa").get();
+                auto f = out.flush();
+                auto buf = in.read().get();
+                f.get();
+                out.close().get();
+                in.read().get(); // ignore - just want eof
+                in.close().get();
+
+                BOOST_CHECK_EQUAL(sstring(buf.begin(), buf.end()), "apa");
+            });
+        }).get();
+    }
+}
+
 SEASTAR_THREAD_TEST_CASE(test_reload_broken_certificates) {
     tmpdir tmp;
 
@@ -1594,3 +1666,192 @@ SEASTAR_THREAD_TEST_CASE(test_tls13_session_tickets) {
     }
 
 }
+
+/**
+ * Kernel TLS transmit offload. Falls back to userspace encryption
+ * where the kernel lacks the tls module, so the exchange must
+ * work either way.
+*/
+SEASTAR_THREAD_TEST_CASE(test_kernel_tls_offload) {
+    for (auto prio : { "SECURE128:-VERS-TLS-ALL:+VERS-TLS1.2", "SECURE128:-VERS-TLS-ALL:+VERS-TLS1.3" }) {
+        tls::credentials_builder b;
+
+        b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+        b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+        b.set_priority_string(prio);
+        b.set_kernel_tls_offload(true);
+
+        auto creds = b.build_certificate_credentials();
+        auto serv = b.build_server_credentials();
+
+        ::listen_options opts;
+        opts.reuse_address = true;
+        opts.set_fixed_cpu(this_shard_id());
+
+        auto addr = ::make_ipv4_address({0x7f000001, 4712});
+        auto server = tls::listen(serv, addr, opts);
+
+        auto sa = server.accept();
+        auto c = tls::connect(creds, addr).get();
+        auto s = sa.get();
+
+        sstring msg = uninitialized_string(1024 * 1024);
+        for (size_t i = 0; i < msg.size(); i++) {
+            msg[i] = char('a' + i % 26);
+        }
+
+        auto cout = c.output();
+        auto sin = s.connection.input();
+        auto sout = s.connection.output();
+        auto cin = c.input();
+
+        auto fin = sin.read_exactly(msg.size());
+        cout.write(msg).get();
+        cout.flush().get();
+        auto buf = fin.get();
+        BOOST_REQUIRE(sstring(buf.begin(), buf.end()) == msg);
+
+        fin = cin.read_exactly(msg.size());
+        sout.write(msg).get();
+        sout.flush().get();
+        buf = fin.get();
+        BOOST_REQUIRE(sstring(buf.begin(), buf.end()) == msg);
+
+        cout.close().get();
+        sout.close().get();
+        // close_notify from both sides arrives as EOF
+        BOOST_REQUIRE(sin.read().get().empty());
+        BOOST_REQUIRE(cin.read().get().empty());
+        sin.close().get();
+        cin.close().get();
+    }
+}
+
+/**
+ * Server handshakes on the offload threads, with a concurrency limit
+ * of one, for both TLS versions.
+*/
+SEASTAR_THREAD_TEST_CASE(test_handshake_offload) {
+    for (auto prio : { "SECURE128:-VERS-TLS-ALL:+VERS-TLS1.2", "SECURE128:-VERS-TLS-ALL:+VERS-TLS1.3" }) {
+        tls::credentials_builder b;
+
+        b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+        b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+        b.set_priority_string(prio);
+        b.set_handshake_offload(tls::handshake_offload_config{.max_concurrency = 1, .threads_per_node = 2});
+
+        auto creds = b.build_certificate_credentials();
+        auto serv = b.build_server_credentials();
+
+        ::listen_options opts;
+        opts.reuse_address = true;
+        opts.set_fixed_cpu(this_shard_id());
+
+        auto addr = ::make_ipv4_address({0x7f000001, 4712});
+        auto server = tls::listen(serv, addr, opts);
+
+        constexpr unsigned connections = 4;
+        std::vector<future<>> exchanges;
+        for (unsigned i = 0; i < connections; i++) {
+            exchanges.push_back(server.accept().then([] (accept_result ar) {
+                return do_with(std::move(ar.connection), [] (connected_socket& s) {
+                    return tls::check_session_is_resumed(s).then([&s] (bool) {
+                        auto in = s.input();
+                        auto out = s.output();
+                        return do_with(std::move(in), std::move(out), [] (input_stream<char>& in, output_stream<char>& out) {
+                            return in.read_exactly(5).then([&out] (temporary_buffer<char> buf) {
+                                return out.write(std::move(buf));
+                            }).then([&out] {
+                                return out.close();
+                            });
+                        });
+                    });
+                });
+            }));
+        }
+        for (unsigned i = 0; i < connections; i++) {
+            auto c = tls::connect(creds, addr).get();
+            auto out = c.output();
+            auto in = c.input();
+            out.write("hello").get();
+            out.flush().get();
+            auto buf = in.read_exactly(5).get();
+            BOOST_REQUIRE_EQUAL(sstring(buf.begin(), buf.end()), "hello");
+            out.close().get();
+            in.close().get();
+        }
+        when_all_succeed(exchanges.begin(), exchanges.end()).get();
+    }
+}
+
+/**
+ * The offload pool is process-wide: credentials asking for another
+ * number of threads are rejected.
+*/
+SEASTAR_THREAD_TEST_CASE(test_handshake_offload_conflicting_threads) {
+    tls::credentials_builder b;
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_handshake_offload(tls::handshake_offload_config{.threads_per_node = 2});
+    b.build_server_credentials();
+
+    b.set_handshake_offload(tls::handshake_offload_config{.threads_per_node = 3});
+    BOOST_REQUIRE_THROW(b.build_server_credentials(), std::invalid_argument);
+}
+
+/**
+ * Client side session cache, and tickets accepted by server
+ * credentials other than the ones that issued them (as with
+ * credentials built from one builder on each shard).
+*/
+SEASTAR_THREAD_TEST_CASE(test_session_cache_across_credentials) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+    b.set_session_resume_mode(tls::session_resume_mode::TLS13_SESSION_TICKET);
+    b.set_session_cache_size(16);
+    b.set_priority_string("SECURE128:+SECURE192:-VERS-TLS-ALL:+VERS-TLS1.3");
+
+    auto creds = b.build_certificate_credentials();
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+
+    auto exchange = [&] (uint16_t port) {
+        auto addr = ::make_ipv4_address({0x7f000001, port});
+        auto server = tls::listen(b.build_server_credentials(), addr, opts);
+        auto sa = server.accept();
+        auto c = tls::connect(creds, addr, tls::tls_options{.server_name = "test.scylladb.org"}).get();
+        auto s = sa.get();
+
+        auto in = s.connection.input();
+        auto cin = c.input();
+        output_stream<char> out(c.output().detach(), 1024);
+        output_stream<char> sout(s.connection.output().detach(), 1024);
+
+        // data in both directions, so that the client gets its ticket
+        out.write("nils").get();
+        auto fin = in.read();
+        out.flush().get();
+        fin.get();
+
+        sout.write("banan").get();
+        fin = cin.read();
+        sout.flush().get();
+        fin.get();
+
+        auto resumed = tls::check_session_is_resumed(c).get();
+
+        in.close().get();
+        out.close().get();
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+        c.shutdown_input();
+        c.shutdown_output();
+        return resumed;
+    };
+
+    BOOST_REQUIRE(!exchange(4712));
+    BOOST_REQUIRE(exchange(4713));
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/tracing.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/util/later.hh>
+#include <algorithm>
+#include <chrono>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static const tracing::span_record& find_span(const std::vector<tracing::span_record>& spans, std::string_view name) {
+    auto i = std::find_if(spans.begin(), spans.end(), [name] (const tracing::span_record& r) { return r.name == name; });
+    BOOST_REQUIRE(i != spans.end());
+    return *i;
+}
+
+SEASTAR_TEST_CASE(test_span_follows_continuations) {
+    tracing::set_sample_rate(1);
+    tracing::take_spans();
+    co_await tracing::with_span(tracing::span("root"), [] {
+        return sleep(1ms).then([] {
+            tracing::span child("child");
+            return yield().then([] {
+                tracing::span grandchild("after yield");
+            });
+        });
+    });
+    // Started once the root ended, of no trace
+    tracing::span("after").end();
+    tracing::set_sample_rate(0);
+
+    auto spans = tracing::take_spans();
+    BOOST_REQUIRE_EQUAL(spans.size(), 4);
+    auto& root = find_span(spans, "root");
+    auto& child = find_span(spans, "child");
+    auto& other = find_span(spans, "after yield");
+    auto& after = find_span(spans, "after");
+    BOOST_REQUIRE_EQUAL(root.parent_id, 0);
+    BOOST_REQUIRE(child.trace == root.trace);
+    BOOST_REQUIRE_EQUAL(child.parent_id, root.span_id);
+    // The child was not current, only alive, while the yield ran
+    BOOST_REQUIRE(other.trace == root.trace);
+    BOOST_REQUIRE_EQUAL(other.parent_id, root.span_id);
+    BOOST_REQUIRE(!(after.trace == root.trace));
+    BOOST_REQUIRE_EQUAL(after.parent_id, 0);
+    BOOST_REQUIRE_GE(root.duration, 1ms);
+    BOOST_REQUIRE(tracing::take_spans().empty());
+}
+
+SEASTAR_TEST_CASE(test_span_not_sampled) {
+    tracing::set_sample_rate(0);
+    auto recorded = tracing::get_stats().recorded;
+    co_await tracing::with_span(tracing::span("root"), [] {
+        return yield().then([] {
+            // Not the root of a trace of its own
+            tracing::set_sample_rate(1);
+            tracing::span child("child");
+            BOOST_REQUIRE(!child.sampled());
+            BOOST_REQUIRE(!tracing::current_context().valid());
+            tracing::set_sample_rate(0);
+        });
+    });
+    BOOST_REQUIRE_EQUAL(tracing::get_stats().recorded, recorded);
+    BOOST_REQUIRE(tracing::take_spans().empty());
+}
+
+SEASTAR_TEST_CASE(test_span_remote_parent) {
+    tracing::take_spans();
+    tracing::span_context parent{{1, 2}, 3, true};
+    {
+        tracing::span s("remote child", parent);
+        BOOST_REQUIRE(s.sampled());
+        BOOST_REQUIRE(s.context().trace == parent.trace);
+    }
+    tracing::span("unsampled", tracing::span_context{{1, 2}, 3, false}).end();
+    auto spans = tracing::take_spans();
+    BOOST_REQUIRE_EQUAL(spans.size(), 1);
+    BOOST_REQUIRE(spans[0].trace == parent.trace);
+    BOOST_REQUIRE_EQUAL(spans[0].parent_id, 3);
+    BOOST_REQUIRE_EQUAL(spans[0].shard, this_shard_id());
+    co_return;
+}
+
+SEASTAR_TEST_CASE(test_span_buffer_capacity) {
+    tracing::take_spans();
+    tracing::set_buffer_capacity(2);
+    auto dropped = tracing::get_stats().dropped;
+    for (int i = 0; i < 3; i++) {
+        tracing::span("s", tracing::span_context{{0, 1}, 1, true});
+    }
+    BOOST_REQUIRE_EQUAL(tracing::take_spans().size(), 2);
+    BOOST_REQUIRE_EQUAL(tracing::get_stats().dropped, dropped + 1);
+    tracing::set_buffer_capacity(4096);
+    co_return;
+}
+
+SEASTAR_TEST_CASE(test_span_context_encoding) {
+    tracing::span_context ctx{{0x0af7651916cd43dd, 0x8448eb211c80319c}, 0xb7ad6b7169203331, true};
+    auto header = ctx.to_traceparent();
+    BOOST_REQUIRE_EQUAL(header, "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01");
+    BOOST_REQUIRE(tracing::span_context::from_traceparent(header) == ctx);
+    BOOST_REQUIRE(tracing::span_context::from_traceparent("01-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-00-extra")
+            == (tracing::span_context{ctx.trace, ctx.span_id, false}));
+    BOOST_REQUIRE(!tracing::span_context::from_traceparent(""));
+    BOOST_REQUIRE(!tracing::span_context::from_traceparent("00-00000000000000000000000000000000-b7ad6b7169203331-01"));
+    BOOST_REQUIRE(!tracing::span_context::from_traceparent("ff-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01"));
+    BOOST_REQUIRE(!tracing::span_context::from_traceparent("00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01-"));
+
+    char raw[tracing::span_context::serialized_size];
+    ctx.serialize(raw);
+    BOOST_REQUIRE(tracing::span_context::deserialize(raw) == ctx);
+    co_return;
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <algorithm>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/internal/tsc_clock.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+using internal::tsc_clock;
+
+SEASTAR_THREAD_TEST_CASE(test_tsc_clock_tracks_steady_clock) {
+    if (!tsc_clock::enabled()) {
+        BOOST_TEST_MESSAGE("The timestamp counter isn't used on this machine");
+        return;
+    }
+    auto prev = reactor::now();
+    auto end = prev + 500ms;
+    while (reactor::now() < end) {
+        sleep(1ms).get();
+        auto now = tsc_clock::refresh();
+        BOOST_REQUIRE(now >= prev);
+        prev = now;
+        if (!tsc_clock::enabled()) {
+            // Found unreliable (e.g. on an overcommitted VM).
+            return;
+        }
+        auto error = std::chrono::steady_clock::now() - reactor::now();
+        BOOST_REQUIRE_LT(std::chrono::abs(error), 10ms);
+    }
+}
+
+// Disables the clock on this shard, so it has to run last
+SEASTAR_THREAD_TEST_CASE(test_tsc_clock_fallback_is_monotonic) {
+    if (!tsc_clock::enabled()) {
+        BOOST_TEST_MESSAGE("The timestamp counter isn't used on this machine");
+        return;
+    }
+    // A counter found running ahead of steady_clock by more than can be
+    // slewed away makes the next recalibration fall back to steady_clock
+    tsc_clock::skew(200ms);
+    auto ahead = tsc_clock::refresh();
+    auto lowres_ahead = lowres_clock::now();
+    // A lowres timer expiring while the clock is ahead
+    sleep<lowres_clock>(1ms).get();
+    auto prev = std::max(ahead, tsc_clock::now());
+    auto lowres_prev = lowres_clock::now();
+    BOOST_REQUIRE(lowres_prev >= lowres_ahead);
+    auto end = std::chrono::steady_clock::now() + 300ms;
+    while (std::chrono::steady_clock::now() < end) {
+        sleep<lowres_clock>(10ms).get();
+        auto now = tsc_clock::refresh();
+        BOOST_REQUIRE(now >= prev);
+        BOOST_REQUIRE(reactor::now() >= now);
+        BOOST_REQUIRE(lowres_clock::now() >= lowres_prev);
+        prev = now;
+        lowres_prev = lowres_clock::now();
+    }
+    BOOST_REQUIRE(!tsc_clock::enabled());
+    // Back on steady_clock once it caught up
+    auto error = std::chrono::steady_clock::now() - reactor::now();
+    BOOST_REQUIRE_LT(std::chrono::abs(error), 10ms);
+}
@@ -0,0 +1,175 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <string>
+
+#include <seastar/util/utf8.hh>
+
+using namespace seastar;
+using seastar::internal::utf8_isa;
+
+namespace {
+
+constexpr utf8_isa isas[] = {
+    utf8_isa::scalar,
+    utf8_isa::avx2,
+    utf8_isa::neon,
+};
+
+struct restore_isa {
+    ~restore_isa() {
+        // Back to the default, the best one supported
+        for (auto isa : {utf8_isa::avx2, utf8_isa::neon, utf8_isa::scalar}) {
+            if (seastar::internal::use_utf8_isa(isa)) {
+                break;
+            }
+        }
+    }
+};
+
+// Decodes the code points, the reference the validators are checked against
+bool decodes(const std::string& s) {
+    size_t i = 0;
+    while (i < s.size()) {
+        unsigned char c = s[i];
+        unsigned n;
+        uint32_t cp;
+        if (c < 0x80) {
+            ++i;
+            continue;
+        } else if ((c >> 5) == 0x6) {
+            n = 2;
+            cp = c & 0x1f;
+        } else if ((c >> 4) == 0xe) {
+            n = 3;
+            cp = c & 0xf;
+        } else if ((c >> 3) == 0x1e) {
+            n = 4;
+            cp = c & 0x7;
+        } else {
+            return false;
+        }
+        if (i + n > s.size()) {
+            return false;
+        }
+        for (unsigned k = 1; k < n; ++k) {
+            unsigned char cc = s[i + k];
+            if ((cc & 0xc0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (cc & 0x3f);
+        }
+        if ((n == 2 && cp < 0x80) || (n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000)
+                || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+// Mostly ASCII and valid sequences, with the odd invalid one
+std::string random_text(size_t len, std::mt19937& rng) {
+    static const std::string valid[] = {"\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xef\xbf\xbf", "\xf4\x8f\xbf\xbf"};
+    static const std::string invalid[] = {
+        "\x80", "\xc0\x80", "\xc1\xbf", "\xed\xa0\x80", "\xf4\x90\x80\x80",
+        "\xe0\x80\x80", "\xf0\x80\x80\x80", "\xf8", "\xff", "\xc3", "\xe2\x82", "\xf0\x9f\x98",
+    };
+    std::string s;
+    while (s.size() < len) {
+        auto r = rng() % 1000;
+        if (r < 700) {
+            s += char('a' + rng() % 26);
+        } else if (r < 998) {
+            s += valid[rng() % std::size(valid)];
+        } else {
+            s += invalid[rng() % std::size(invalid)];
+        }
+    }
+    return s;
+}
+
+bool valid_in_pieces(const std::string& s, size_t piece) {
+    utf8_validator v;
+    bool valid = true;
+    for (size_t i = 0; i < s.size(); i += piece) {
+        valid = v.feed(s.data() + i, std::min(piece, s.size() - i)) && valid;
+    }
+    return v.finish() && valid;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_known_sequences) {
+    restore_isa restore;
+    const std::pair<std::string, bool> cases[] = {
+        {"", true},
+        {"hello", true},
+        {"\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5", true},
+        {"\xf0\x90\x80\x80", true},       // U+10000
+        {"\xf4\x8f\xbf\xbf", true},       // U+10FFFF
+        {"\xf4\x90\x80\x80", false},      // beyond U+10FFFF
+        {"\xed\x9f\xbf", true},           // U+D7FF
+        {"\xed\xa0\x80", false},          // a surrogate
+        {"\xc0\xaf", false},              // overlong
+        {"\xe0\x9f\xbf", false},          // overlong
+        {"\xf0\x8f\xbf\xbf", false},      // overlong
+        {"\xce\xba\xe1", false},          // truncated
+        {"\x80", false},                  // lone continuation
+        {"\xfe", false},
+    };
+    for (auto isa : isas) {
+        if (!seastar::internal::use_utf8_isa(isa)) {
+            continue;
+        }
+        for (auto& [text, valid] : cases) {
+            // Also in the middle of long text, for the vector kernels
+            auto padded = std::string(61, 'x') + text + std::string(70, 'y');
+            BOOST_TEST_INFO("isa " << int(isa) << " text " << text);
+            BOOST_REQUIRE_EQUAL(is_valid_utf8(text.data(), text.size()), valid);
+            BOOST_REQUIRE_EQUAL(is_valid_utf8(padded.data(), padded.size()), valid);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_kernels_match_reference) {
+    restore_isa restore;
+    std::mt19937 rng(0);
+    const size_t pieces[] = {1, 2, 3, 7, 64, 1000};
+    for (int i = 0; i < 2000; ++i) {
+        auto s = random_text(rng() % 300, rng);
+        bool expected = decodes(s);
+        for (auto isa : isas) {
+            if (!seastar::internal::use_utf8_isa(isa)) {
+                continue;
+            }
+            BOOST_TEST_INFO("isa " << int(isa) << " len " << s.size());
+            BOOST_REQUIRE_EQUAL(is_valid_utf8(s.data(), s.size()), expected);
+            for (auto piece : pieces) {
+                BOOST_REQUIRE_EQUAL(valid_in_pieces(s, piece), expected);
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <charconv>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <seastar/core/warm_restart.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+using namespace seastar;
+namespace warm_restart = seastar::experimental::warm_restart;
+
+// Hands the regions saved so far over to this process, through duplicates
+// of their fds, as exec() would to the next one.
+static void hand_over_to_self() {
+    auto env = warm_restart::environment();
+    auto prefix = std::string(warm_restart::environment_variable) + "=";
+    BOOST_REQUIRE(env.starts_with(prefix));
+    std::string_view value(env);
+    value.remove_prefix(prefix.size());
+    std::string spec;
+    while (!value.empty()) {
+        auto end = std::min(value.find(','), value.size());
+        auto entry = value.substr(0, end);
+        value.remove_prefix(std::min(end + 1, value.size()));
+        int fd;
+        auto [p, ec] = std::from_chars(entry.data(), entry.data() + entry.size(), fd);
+        BOOST_REQUIRE(ec == std::errc());
+        auto copy = ::dup(fd);
+        BOOST_REQUIRE(copy != -1);
+        spec += fmt::format("{}{}{}", spec.empty() ? "" : ",", copy, std::string_view(p, entry.data() + entry.size() - p));
+    }
+    warm_restart::internal::take_over(spec);
+}
+
+// First, before anything takes the regions over
+SEASTAR_THREAD_TEST_CASE(test_environment_is_consumed) {
+    ::setenv(warm_restart::environment_variable, "", 1);
+    BOOST_REQUIRE(!warm_restart::restore("name").get());
+    BOOST_REQUIRE(!std::getenv(warm_restart::environment_variable));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_save_and_restore) {
+    std::vector<temporary_buffer<char>> data;
+    data.emplace_back(temporary_buffer<char>::copy_of("hello "));
+    data.emplace_back(temporary_buffer<char>::copy_of("world"));
+    warm_restart::save("greeting", std::move(data)).get();
+    warm_restart::save("empty", {}).get();
+    BOOST_REQUIRE_THROW(warm_restart::save("bad,name", {}).get(), std::invalid_argument);
+
+    hand_over_to_self();
+
+    BOOST_REQUIRE(!warm_restart::restore("greeting", this_shard_id() + 1).get());
+    auto greeting = warm_restart::restore("greeting").get();
+    BOOST_REQUIRE(greeting);
+    BOOST_REQUIRE_EQUAL(std::string_view(greeting->data(), greeting->size()), "hello world");
+    BOOST_REQUIRE(!warm_restart::restore("greeting").get());
+
+    warm_restart::discard();
+    BOOST_REQUIRE(!warm_restart::restore("empty").get());
+    // The mapping outlives the regions
+    BOOST_REQUIRE_EQUAL(std::string_view(greeting->data(), greeting->size()), "hello world");
+}
+
+SEASTAR_THREAD_TEST_CASE(test_malformed_regions_are_ignored) {
+    warm_restart::internal::take_over("junk,12:x,-1:0:name");
+    BOOST_REQUIRE(!warm_restart::restore("name", 0).get());
+    warm_restart::discard();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_unsealed_fds_are_left_alone) {
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(::pipe(fds), 0);
+    warm_restart::internal::take_over(fmt::format("{}:0:pipe", fds[0]));
+    BOOST_REQUIRE(!warm_restart::restore("pipe", 0).get());
+    warm_restart::discard();
+    // Neither closed nor made close-on-exec
+    auto flags = ::fcntl(fds[0], F_GETFD);
+    BOOST_REQUIRE_NE(flags, -1);
+    BOOST_REQUIRE(!(flags & FD_CLOEXEC));
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
@@ -5,6 +5,7 @@
 #include <seastar/websocket/server.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
+#include <seastar/http/compression.hh>
 #include <seastar/http/response_parser.hh>
 #include <seastar/util/defer.hh>
 #include "loopback_socket.hh"
@@ -152,3 +153,214 @@ SEASTAR_TEST_CASE(test_websocket_handler_registration) {
         BOOST_REQUIRE_EQUAL(rs_frame, response_str);
     });
 }
+
+static future<> echo(input_stream<char>& in, output_stream<char>& out) {
+    return repeat([&in, &out]() {
+        return in.read().then([&out](temporary_buffer<char> f) {
+            if (f.empty()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            return out.write(std::move(f)).then([&out]() {
+                return out.flush().then([] {
+                    return make_ready_future<stop_iteration>(stop_iteration::no);
+                });
+            });
+        });
+    });
+}
+
+static std::unique_ptr<http::reply> handshake(input_stream<char>& input, output_stream<char>& output, std::string extensions = {}) {
+    std::string request =
+            "GET / HTTP/1.1\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "Sec-WebSocket-Protocol: echo\r\n";
+    if (!extensions.empty()) {
+        request += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+    }
+    request += "\r\n";
+    output.write(request).get();
+    output.flush().get();
+    http_response_parser parser;
+    parser.init();
+    input.consume(parser).get();
+    auto resp = parser.get_parsed_response();
+    BOOST_REQUIRE(resp);
+    return resp;
+}
+
+SEASTAR_TEST_CASE(test_websocket_permessage_deflate) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        auto acceptor = factory.get_server_socket().accept();
+        auto connector = lsi.connect(socket_address(), socket_address());
+        connected_socket sock = connector.get();
+        auto input = sock.input();
+        auto output = sock.output();
+
+        websocket::server ws;
+        ws.register_handler("echo", echo);
+        ws.enable_permessage_deflate({.min_size = 1});
+        websocket::connection conn(ws, acceptor.get().connection);
+        future<> serve = conn.process();
+        auto close = defer([&conn, &input, &output, &serve] () noexcept {
+            conn.close().get();
+            input.close().get();
+            output.close().get();
+            serve.get();
+        });
+
+        auto resp = handshake(input, output, "x-unknown, permessage-deflate; server_max_window_bits=8, permessage-deflate; client_max_window_bits");
+        auto extensions = resp->get_header("Sec-WebSocket-Extensions");
+        if (extensions.empty()) {
+            // Built without zlib
+            return;
+        }
+        BOOST_REQUIRE_EQUAL(extensions, "permessage-deflate");
+
+        // "Hello" compressed, as in RFC 7692 section 7.2.3.1, then against
+        // the first one
+        const auto ws_frame = std::string(
+            "\301\207"  // FIN, RSV1, TEXT; masked, 7 bytes
+            "\0\0\0\0"  // Masking Key
+            "\xf2\x48\xcd\xc9\xc9\x07\x00", 13);
+        output.write(ws_frame).get();
+        output.flush().get();
+        auto response = input.read_exactly(9).get();
+        BOOST_REQUIRE_EQUAL(std::string(response.begin(), response.end()), std::string("\302\007\xf2\x48\xcd\xc9\xc9\x07\x00", 9));
+
+        output.write(ws_frame).get();
+        output.flush().get();
+        response = input.read_exactly(7).get();
+        BOOST_REQUIRE_EQUAL(std::string(response.begin(), response.end()), std::string("\302\005\xf2\x00\x11\x00\x00", 7));
+    });
+}
+
+SEASTAR_TEST_CASE(test_websocket_deflate_bomb) {
+    return seastar::async([] {
+        if (!http::is_supported(http::content_encoding::deflate)) {
+            return;
+        }
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        auto acceptor = factory.get_server_socket().accept();
+        auto connector = lsi.connect(socket_address(), socket_address());
+        connected_socket sock = connector.get();
+        auto input = sock.input();
+        auto output = sock.output();
+
+        websocket::server ws;
+        size_t received = 0;
+        size_t largest = 0;
+        ws.register_handler("echo", [&received, &largest] (input_stream<char>& in, output_stream<char>& out) {
+            return repeat([&in, &received, &largest] {
+                return in.read().then([&received, &largest] (temporary_buffer<char> buf) {
+                    received += buf.size();
+                    largest = std::max(largest, buf.size());
+                    return stop_iteration(buf.empty());
+                });
+            });
+        });
+        constexpr size_t max_size = 1 << 20;
+        ws.enable_permessage_deflate({.max_message_size = max_size});
+        websocket::connection conn(ws, acceptor.get().connection);
+        future<> serve = conn.process();
+        auto close = defer([&conn, &input, &output, &serve] () noexcept {
+            conn.close().get();
+            input.close().get();
+            output.close().get();
+            serve.get();
+        });
+
+        handshake(input, output, "permessage-deflate");
+
+        // 16MB of zeros, inflating about a thousand times; the raw deflate
+        // stream of the zlib one
+        auto zlib = http::compress(http::content_encoding::deflate, sstring(16 << 20, '\0'), 9);
+        std::string_view payload(zlib.data() + 2, zlib.size() - 6);
+        std::string frame = "\302\377";  // FIN, RSV1, BINARY; masked, 64-bit length
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame += char(uint64_t(payload.size()) >> shift);
+        }
+        frame.append(4, '\0');  // Masking Key
+        frame.append(payload);
+        output.write(frame).get();
+        output.flush().get();
+
+        // Closed with 1009, message too big
+        auto response = input.read_exactly(4).get();
+        BOOST_REQUIRE_EQUAL(std::string(response.begin(), response.end()), std::string("\210\002\003\361", 4));
+        BOOST_REQUIRE_LE(received, max_size);
+        BOOST_REQUIRE_LE(largest, 64u << 10);
+    });
+}
+
+SEASTAR_TEST_CASE(test_websocket_broadcast) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        auto acceptor = factory.get_server_socket().accept();
+        auto connector = lsi.connect(socket_address(), socket_address());
+        connected_socket sock = connector.get();
+        auto input = sock.input();
+        auto output = sock.output();
+
+        websocket::server ws;
+        ws.register_handler("echo", echo);
+        websocket::connection conn(ws, acceptor.get().connection);
+        future<> serve = conn.process();
+        auto close = defer([&conn, &input, &output, &serve] () noexcept {
+            conn.close().get();
+            input.close().get();
+            output.close().get();
+            serve.get();
+        });
+
+        handshake(input, output);
+
+        BOOST_REQUIRE_EQUAL(ws.broadcast(websocket::message(temporary_buffer<char>("TEST", 4)), "other"), 0);
+        BOOST_REQUIRE_EQUAL(ws.broadcast(websocket::message(temporary_buffer<char>("TEST", 4))), 1);
+        BOOST_REQUIRE_EQUAL(ws.broadcast(websocket::message(temporary_buffer<char>("TEXT", 4), websocket::opcodes::TEXT), "echo"), 1);
+
+        auto response = input.read_exactly(12).get();
+        BOOST_REQUIRE_EQUAL(std::string(response.begin(), response.end()), std::string("\202\004TEST\201\004TEXT", 12));
+    });
+}
+
+SEASTAR_TEST_CASE(test_websocket_parser_unmasks_pieces) {
+    return seastar::async([] {
+        const char key[] = {'\x01', '\x23', '\x45', '\x67'};
+        std::string payload;
+        for (int i = 0; i < 300; ++i) {
+            payload += char(i * 7);
+        }
+        std::string frame = "\202\376";  // FIN, BINARY; masked, 16-bit length
+        frame += char(payload.size() >> 8);
+        frame += char(payload.size() & 0xff);
+        frame.append(key, sizeof(key));
+        for (size_t i = 0; i < payload.size(); ++i) {
+            frame += char(payload[i] ^ key[i % 4]);
+        }
+
+        // In pieces which don't keep to the key's alignment
+        const size_t pieces[] = {1, 7, 33, 64, 5};
+        websocket::websocket_parser parser;
+        std::string unmasked;
+        for (size_t i = 0, p = 0; i < frame.size(); p = (p + 1) % std::size(pieces)) {
+            auto n = std::min(pieces[p], frame.size() - i);
+            parser(temporary_buffer<char>(frame.data() + i, n)).get();
+            i += n;
+            auto result = parser.result();
+            unmasked.append(result.get(), result.size());
+        }
+        BOOST_REQUIRE(parser.is_valid());
+        BOOST_REQUIRE(parser.end_of_message());
+        BOOST_REQUIRE(unmasked == payload);
+    });
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <chrono>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/core/work_stealing.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+using namespace seastar;
+
+SEASTAR_TEST_CASE(test_stealable_work_results) {
+    auto v = co_await submit_stealable([] { return std::vector<int>(1000, 7); });
+    BOOST_REQUIRE_EQUAL(v.size(), 1000);
+    BOOST_REQUIRE_EQUAL(v[999], 7);
+
+    bool ran = false;
+    co_await submit_stealable(default_scheduling_group(), [&ran] { ran = true; });
+    BOOST_REQUIRE(ran);
+
+    BOOST_REQUIRE_THROW(co_await submit_stealable([] () -> int { throw std::runtime_error("oops"); }), std::runtime_error);
+}
+
+// Runs with --work-stealing: a backlog of CPU-bound work on one shard is
+// taken over by its idle peers.
+SEASTAR_THREAD_TEST_CASE(test_stealable_work_is_stolen) {
+    using namespace std::chrono_literals;
+    std::vector<future<shard_id>> results;
+    for (int i = 0; i < 200; ++i) {
+        results.push_back(submit_stealable([] {
+            auto end = std::chrono::steady_clock::now() + 1ms;
+            while (std::chrono::steady_clock::now() < end) {
+            }
+            return this_shard_id();
+        }));
+    }
+    std::set<shard_id> shards;
+    for (auto shard : when_all_succeed(results.begin(), results.end()).get()) {
+        shards.insert(shard);
+    }
+    if (smp::count > 1) {
+        BOOST_REQUIRE_GT(shards.size(), 1);
+    }
+}